@@ -23,3 +23,19 @@ kernel void adder(device float *in [[ buffer(1) ]],
     uint iy = index2.y;
     out[iy * nx + ix] = in[iy * nx + ix] + iy + ix;
 }
+
+//  The same operation, but with the arrays held in half precision, used by the C++ code if the
+//  'Half' command line parameter is specified. The arithmetic is done in single precision, and
+//  only the values read and written are half precision, so the results are as close as half
+//  precision allows, and each element needs only half as many bytes of memory traffic.
+
+kernel void adderHalf(device half *in [[ buffer(1) ]],
+                   device half *out[[ buffer(2) ]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]]) {
+
+    uint nx = gridSize.x;
+    uint ix = index2.x;
+    uint iy = index2.y;
+    out[iy * nx + ix] = half(float(in[iy * nx + ix]) + float(iy + ix));
+}
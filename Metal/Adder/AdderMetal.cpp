@@ -39,7 +39,55 @@
 //
 //     Debug must be specified explicitly by name, eg Debug = "timing". The '=' is optional.
 //     There are a number of different options for Debug. If you are prompted for the value
-//     of Debug and reply with '?' a list of the options will be provided.
+//     of Debug and reply with '?' a list of the options will be provided. 'Profile' has the
+//     CPU code time the range of rows each thread handles, using the time stamp counter, and
+//     report the time per row.
+//
+//     Half     has the GPU hold the arrays in half precision, using the 'adderHalf' kernel,
+//              so only two bytes are read and written for each element. The input is converted
+//              to half precision as it is loaded into the GPU buffer, and the results are
+//              converted back as they are read, and the conversions are timed separately. The
+//              arrays have to be small enough for their values to fit in half precision, and
+//              the results are checked against values rounded to half precision.
+//
+//     InFlight is the number of command buffers the GPU is allowed to have at once, up to 16.
+//              By default this is 1, and each pass is waited for before the next is set up,
+//              so the timing includes the full round trip to the GPU for each pass. With a
+//              larger value, the CPU sets up each pass while the GPU runs the earlier ones,
+//              and only waits when it runs out of command buffers or needs the results, so
+//              the timing shows the throughput the GPU can sustain.
+//
+//     Indirect has the GPU dispatch encoded just once, into an indirect command buffer, which
+//              each pass then simply executes, instead of each pass setting the pipeline state
+//              and the buffers again. This takes most of the CPU's encoding time out of the
+//              loop, which matters for small arrays, where it can be more than the kernel.
+//
+//     Untracked creates the input buffer without hazard tracking, so Metal doesn't have to
+//              track its use by every encoder. It is only written by the CPU, before the first
+//              pass, and only read by the GPU, so no pass depends on another through it. The
+//              output buffer, which every pass writes, is still tracked.
+//
+//     Backend  runs the GPU code through a MetalBackend, using the backend-neutral code in
+//              BackendAdder.h that the Vulkan version of Adder also uses with its own backend,
+//              instead of the Metal code here. This is the simplest form of the GPU loop, with
+//              the arrays in single precision and one pass at a time, so 'Half', 'InFlight',
+//              'Indirect' and 'Untracked' are ignored.
+//
+//     Trace    is the name of a file to which a timeline of the run is written, in the Chrome
+//              trace format, so it can be viewed using chrome://tracing or Perfetto. It shows
+//              the setup, each pass, each command buffer from its commit until it is seen to
+//              complete, and the kernel times measured by the GPU. Default "", for no trace.
+//
+//     Pin      controls the CPUs the CPU threads run on, which can make CPU timings more
+//              repeatable. It can be "None", the default, which leaves it to the system,
+//              "PCores", which only uses the performance cores, "Physical", which uses one
+//              logical CPU of each physical core, or "Numa", which only uses the CPUs on the
+//              same NUMA node as the main thread. If Threads is zero, or more than the number
+//              of CPUs selected, one thread is used for each of them.
+//
+//     Priority raises the priority of the CPU threads. On Linux this needs permission to
+//              use real-time scheduling. The CPU topology and the placement used are listed
+//              if either 'Pin' or 'Priority' is given.
 //
 //     The command line is processed by the flexible but possibly quirky command line handler
 //     used for all these GPU examples. With luck you'll get used to it. It also supports the
@@ -88,6 +136,35 @@
 //      27th Sep 2024. CPU and GPU times now reported even if results prove to be wrong. KS.
 //      14th Oct 2024. Modified initial values for input array to make the test of the
 //                     results more stringent. KS.
+//      14th Oct 2026. The CPU code now uses a pool of threads created once, shared by all the
+//                     passes, instead of creating new threads for each pass. KS.
+//                     SetInputArray() and the result checks now run in the shared thread pool,
+//                     with loops that compile to vector code, and stop at the first bad row. KS.
+//                     Added 'Half', which keeps the arrays on the GPU in half precision, using
+//                     the new 'adderHalf' kernel. KS.
+//      15th Oct 2026. Added 'InFlight', which keeps several command buffers with the GPU at
+//                     once instead of waiting for each pass to complete. KS.
+//                     The input and output buffers now come from a BufferHeap. KS.
+//                     The GPU kernel time is now reported as well, from timestamps the GPU
+//                     samples at the start and end of each compute encoder. KS.
+//                     Added 'Indirect', which encodes the dispatch once, in an indirect
+//                     command buffer, and has each pass execute that. KS.
+//                     The time for each pass of the GPU and CPU loops is now collected in an
+//                     MsecStats, and the distribution of the times reported. KS.
+//                     Added 'Warmup', 'Sizes' and 'Report', which use the new BenchReport to
+//                     run the tests over a list of sizes and append the timings, leaving out
+//                     the first passes, to a CSV or JSON file. KS.
+//                     The 'Timing' debug calls in the loops now test a bit looked up once. KS.
+//                     Added 'Trace', which writes a timeline of the run using the new
+//                     TraceRecorder. KS.
+//                     Added the 'Profile' debug level, which times each range of rows handled
+//                     by the CPU code using the new CycleTimer. KS.
+//                     Added 'Pin' and 'Priority', which use the new ThreadPlacement to pin
+//                     the CPU threads to chosen CPUs and raise their priority. KS.
+//                     Added 'Untracked', which creates the input buffer without hazard
+//                     tracking. KS.
+//                     Added 'Backend', which runs the GPU code written once, in BackendAdder.h,
+//                     against the new ComputeBackend interface, using a MetalBackend. KS.
 
 //  ------------------------------------------------------------------------------------------------
 //
@@ -96,32 +173,63 @@
 //  Needed to allow multi-threading of the CPU code
 
 #include <thread>
+#include <atomic>
 
 //  Some utility code. A Command Handler provides a flexible way of handling command line
 //  parameters, and simplifies the coding required for this. An MsecTimer provides a very simple
 //  way of timing blocks of code. A Debug Handler provides control over debug output, allowing
-//  various debug levels to be enabled from the command line.
+//  various debug levels to be enabled from the command line. HalfFloat.h has the conversions
+//  to and from half precision used for 'Half'. A BenchReport collects the timings to be written
+//  out for 'Report', and the TraceRecorder records the timeline written out for 'Trace'.
+//  A CycleProfile times the CPU code for 'Profile', and a ThreadPlacement pins the CPU threads
+//  for 'Pin'.
 
 #include "CommandHandler.h"
 #include "MsecTimer.h"
+#include "BenchReport.h"
+#include "TraceRecorder.h"
+#include "CycleTimer.h"
+#include "ThreadPool.h"
+#include "ThreadPlacement.h"
 #include "DebugHandler.h"
+#include "HalfFloat.h"
+
+//  Needed for fabs(), used when checking half precision results.
+
+#include <math.h>
 
 //  This provides a global Debug Handler that all the routines here can use.
 
 DebugHandler TheDebugHandler;
 
+//  The bits for its 'Timing' and 'Profile' levels, set once the level names are known. The
+//  debug calls made on each pass of a timing loop test just these bits, rather than looking the
+//  levels up by name.
+
+DebugHandler::LevelBits TimingDebug = 0;
+DebugHandler::LevelBits ProfileDebug = 0;
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                             F o r w a r d  D e f i n i t i o n s
 
+//  The most command buffers 'InFlight' can keep with the GPU at once.
+
+static const int C_MaxInFlight = 16;
+
 //  Perform the basic opetation using the GPU
-void ComputeUsingGPU(int Nx,int Ny,int Nrpt);
+void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Half,int InFlight,bool Indirect,
+                                             bool Untracked,int Warmup,BenchReport& Bench);
+//  Perform the basic operation using the GPU, through the backend-neutral code
+void ComputeUsingMetalBackend(int Nx,int Ny,int Nrpt,int Warmup,BenchReport& Bench);
 //  Perform the basic operation using the CPU
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt);
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt,int Warmup,BenchReport& Bench);
 //  Set initial values for the input array.
 void SetInputArray(float** InputArray,int Nx,int Ny);
 //  Check the results of the operation
 bool CheckResults(float** InputArray,int Nx,int Ny,float** OutputArray);
+//  Check the results of the operation performed with the arrays in half precision
+bool CheckHalfResults(float** InputArray,int Nx,int Ny,float** OutputArray);
 //  Utility to set up an array of row addresses to allow use of Array[Iy][Ix] syntax for access.
 float** CreateRowAddrs(float* Array,int Nx,int Ny);
 
@@ -152,7 +260,9 @@ int main (int Argc, char* Argv[]) {
 
     //  Set up the various levels for the Debug handler
 
-    TheDebugHandler.LevelsList("Timing,Setup,Metal");
+    TheDebugHandler.LevelsList("Timing,Setup,Metal,Profile");
+    TimingDebug = TheDebugHandler.Level("Timing");
+    ProfileDebug = TheDebugHandler.Level("Profile");
    
     //  Get the values of the command line arguments. This uses a Command Handler class that
     //  provides a flexible way of dealing with a number of different arguments, for example
@@ -172,6 +282,18 @@ int main (int Argc, char* Argv[]) {
     IntArg ThreadsArg(TheHandler,"Threads",4,"",DefaultThreads,0,MaxThreads,"CPU threads to use");
     BoolArg CpuArg(TheHandler,"Cpu",0,"",false,"Perform computation using CPU");
     BoolArg GpuArg(TheHandler,"Gpu",0,"",false,"Perform computation using GPU");
+    BoolArg HalfArg(TheHandler,"Half",0,"",false,"Hold the arrays on the GPU in half precision");
+    IntArg InFlightArg(TheHandler,"InFlight",0,"",1,1,C_MaxInFlight,
+                                                         "GPU command buffers kept in flight");
+    BoolArg IndirectArg(TheHandler,"Indirect",0,"",false,"Encode the GPU dispatch just once");
+    BoolArg UntrackedArg(TheHandler,"Untracked",0,"",false,"No hazard tracking for the input");
+    BoolArg BackendArg(TheHandler,"Backend",0,"",false,"Use the backend-neutral GPU code");
+    IntArg WarmupArg(TheHandler,"Warmup",0,"",0,0,1000000,"Passes left out of the timings");
+    StringArg SizesArg(TheHandler,"Sizes",0,"","","Sizes to run in turn, eg 512,1024x512");
+    StringArg ReportArg(TheHandler,"Report",0,"","","File for timings (.csv or .json)");
+    StringArg TraceArg(TheHandler,"Trace",0,"","","File for a timeline trace (.json)");
+    StringArg PinArg(TheHandler,"Pin",0,"","","Pin CPU threads (None,PCores,Physical,Numa)");
+    BoolArg PriorityArg(TheHandler,"Priority",0,"",false,"Raise the CPU threads' priority");
     StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
     DebugArgHelper DebugHelper;
     DebugArg.SetHelper(&DebugHelper);
@@ -189,14 +311,39 @@ int main (int Argc, char* Argv[]) {
     int Threads = ThreadsArg.GetValue(&Ok,&Error);
     bool UseCPU = CpuArg.GetValue(&Ok,&Error);
     bool UseGPU = GpuArg.GetValue(&Ok,&Error);
+    bool Half = HalfArg.GetValue(&Ok,&Error);
+    int InFlight = InFlightArg.GetValue(&Ok,&Error);
+    bool Indirect = IndirectArg.GetValue(&Ok,&Error);
+    bool Untracked = UntrackedArg.GetValue(&Ok,&Error);
+    bool UseBackend = BackendArg.GetValue(&Ok,&Error);
+    int Warmup = WarmupArg.GetValue(&Ok,&Error);
+    std::string Sizes = SizesArg.GetValue(&Ok,&Error);
+    std::string Report = ReportArg.GetValue(&Ok,&Error);
+    std::string Trace = TraceArg.GetValue(&Ok,&Error);
+    std::string Pin = PinArg.GetValue(&Ok,&Error);
+    bool Priority = PriorityArg.GetValue(&Ok,&Error);
     std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
     
+    //  If 'Sizes' was given, the tests are run for each of the sizes listed instead of Nx,Ny.
+    
+    std::vector<int> SizesX(1,Nx),SizesY(1,Ny);
+    bool SizesOK = (Sizes == "" || BenchReport::Sizes(Sizes,SizesX,SizesY));
+    
+    //  If 'Pin' was given, it has to be one of the placements ThreadPlacement knows about.
+    
+    ThreadPlacement Placement;
+    bool PinOK = Placement.SetMode(Pin);
+    
     //  Check the argument parsing went OK, and didn't end with an exit being requested.
     
     if (!Ok) {
         if (!TheHandler.ExitRequested()) {
             printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
         }
+    } else if (!SizesOK) {
+        printf ("Error in 'Sizes': '%s' should be a list such as 512,1024x512\n",Sizes.c_str());
+    } else if (!PinOK) {
+        printf ("Error in 'Pin': '%s' should be None, PCores, Physical or Numa\n",Pin.c_str());
     } else {
         if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
 
@@ -204,21 +351,64 @@ int main (int Argc, char* Argv[]) {
         
         TheDebugHandler.SetLevels(DebugLevels);
         
-        printf ("\nPerforming 'Adder' test, arrays of %d rows, %d columns. Repeat count %d.\n\n",
-                Ny,Nx,Nrpt);
-
+        //  If a trace is wanted, start recording the timeline.
+        
+        if (Trace != "") {
+            TraceRecorder::Global().Enable(true);
+            TraceRecorder::Global().SetThreadName("Main");
+            TraceRecorder::Global().WriteOnExit(Trace);
+        }
+        
+        //  'Pin' and 'Priority' set up the threads of the shared pool used by the CPU code,
+        //  which include this main thread. The topology is listed so the CPU timings can
+        //  be related to the machine they were taken on.
+        
+        if (Pin != "" || Priority) {
+            printf ("\nCPU topology: %s\n",Placement.Topology().c_str());
+            std::string PlacementError;
+            if (!Placement.Apply(ThreadPool::Shared(),Priority,&PlacementError)) {
+                printf ("Warning: %s.\n",PlacementError.c_str());
+            }
+            printf ("CPU threads: %s%s\n",Placement.Description().c_str(),
+                                                   Priority ? ", raised priority" : "");
+            if (Placement.Threads() > 0 && (Threads <= 0 || Threads > Placement.Threads())) {
+                Threads = Placement.Threads();
+            }
+        }
+        
         //  If neither CPU not GPU were specified on the command line, use GPU.
         
         if (!UseGPU && !UseCPU) UseGPU = true;
         
-        //  Perform the test using either CPU or GPU (or both). Both ComputeUsingGPU() and its CPU
-        //  equivalent, ComputeUsingCPU() are expected to create arrays of the size specified, call
-        //  SetInputArray() to initialise the input array, then perform the basic 'adder' operation
-        //  as specified, and then call CheckResults() to verify that they got the right answer.
+        if (Warmup >= Nrpt && Nrpt > 0) {
+            printf ("\n'Warmup' (%d) leaves none of the %d passes to be timed.\n",Warmup,Nrpt);
+        }
+        
+        //  Perform the test using either CPU or GPU (or both), for each size in turn. Both
+        //  ComputeUsingGPU() and its CPU equivalent, ComputeUsingCPU() are expected to create
+        //  arrays of the size specified, call SetInputArray() to initialise the input array,
+        //  then perform the basic 'adder' operation as specified, and then call CheckResults()
+        //  to verify that they got the right answer. They add their timings to Bench.
+        
+        BenchReport Bench;
+        for (size_t Size = 0; Size < SizesX.size(); Size++) {
+            Nx = SizesX[Size];
+            Ny = SizesY[Size];
+            printf ("\nPerforming 'Adder' test, arrays of %d rows, %d columns. "
+                                                       "Repeat count %d.\n\n",Ny,Nx,Nrpt);
+        
+            if (UseGPU && UseBackend) {
+                ComputeUsingMetalBackend(Nx,Ny,Nrpt,Warmup,Bench);
+            } else if (UseGPU) {
+                ComputeUsingGPU(Nx,Ny,Nrpt,Half,InFlight,Indirect,Untracked,Warmup,Bench);
+            }
+        
+            if (UseCPU) ComputeUsingCPU(Threads,Nx,Ny,Nrpt,Warmup,Bench);
+        }
         
-        if (UseGPU) ComputeUsingGPU(Nx,Ny,Nrpt);
+        //  'Report' appends the timings collected to a file.
         
-        if (UseCPU) ComputeUsingCPU(Threads,Nx,Ny,Nrpt);
+        if (Report != "" && Bench.Rows() > 0) Bench.Write(Report);
     }
     return 0;
 }
@@ -259,24 +449,49 @@ int main (int Argc, char* Argv[]) {
 #include <AppKit/AppKit.hpp>
 #include <MetalKit/MetalKit.hpp>
 
+//  The heap allocator for GPU buffers, the kernel timer and the indirect dispatch, which need
+//  the Metal definitions.
+
+#include "BufferHeap.h"
+#include "DispatchTimer.h"
+#include "IndirectDispatch.h"
+
+//  The Metal implementation of the ComputeBackend used for 'Backend', and the backend-neutral
+//  GPU code run through it.
+
+#include "MetalBackend.h"
+#include "BackendAdder.h"
+
 //  Metal-cpp sometimes lets its underlying implementation in objective-C show through. One is
 //  its use of NS::String objects, and it helps to not have to keep writing "NS::StringEncoding::".
 
 using NS::StringEncoding::UTF8StringEncoding;
 
-void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
+void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Half,int InFlight,bool Indirect,
+                                             bool Untracked,int Warmup,BenchReport& Bench)
 {
     //  This is where we actually start to use Metal, specifically the metal-cpp layer provided
     //  by Apple for use with C++.
     
     MsecTimer SetupTimer;
     TheDebugHandler.Log("Setup","GPU setup starting");
+    TraceRecorder& Tracer = TraceRecorder::Global();
+    Tracer.Begin("GPU setup","Adder");
 
     //  The metal-cpp routines need an autorelease pool they can use to keep track of
     //  allocated items. This gives them what they need. All we need to do is create it.
     
     NS::AutoreleasePool* MainAutoreleasePool = NS::AutoreleasePool::alloc()->init();
     
+    //  The largest value involved is the result for the last element of the last row, and
+    //  half precision can't go beyond 65504. (See SetInputArray().)
+    
+    if (Half && double(Nx) + 4.0 * double(Ny) > double(C_HalfMax)) {
+        printf ("Arrays are too large for their values to be held in half precision.\n\n");
+        Half = false;
+    }
+    const char* FunctionName = Half ? "adderHalf" : "adder";
+    
     //  We create an MTL::Device object to represent the GPU itself. (If a system has multiple
     //  GPUs this can get more complicated, but most Apple systems only have one GPU, and the
     //  default device is usually what we need.)
@@ -302,8 +517,11 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
     } else {
         TheDebugHandler.Logf("Setup","GPU library created at %.3f msec",
                                                                    SetupTimer.ElapsedMsec());
-        AdderFunction = Library->newFunction(NS::String::string("adder",UTF8StringEncoding));
-        if (AdderFunction == nullptr) printf ("Unable to find 'adder' function in library\n");
+        AdderFunction = Library->newFunction(NS::String::string(FunctionName,
+                                                                       UTF8StringEncoding));
+        if (AdderFunction == nullptr) {
+            printf ("Unable to find '%s' function in library\n",FunctionName);
+        }
     }
     
     //  If we've got the Adder function set up, things are probably going to work. Because this
@@ -330,24 +548,65 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
         //  buffer is to be 'shared', ie visible to both the GPU and the CPU (since we need to
         //  use the CPU to set its initial values.
         
-        int Length = Nx * Ny * sizeof(float);
+        //
+        //  If the arrays are held in half precision, the buffers are only half the size.
+        
+        int Length = Nx * Ny * (Half ? sizeof(uint16_t) : sizeof(float));
         unsigned int Alignment = sysconf(_SC_PAGE_SIZE);
         int AllocationSize = (Length + Alignment - 1) & (~(Alignment - 1));
         uint BufferOptions = MTL::StorageModeShared;
-        MTL::Buffer* InputBuffer = Device->newBuffer(AllocationSize,BufferOptions);
+        
+        //  With 'Untracked', the input buffer has no hazard tracking. It is written by the CPU
+        //  before anything is committed, and the GPU only reads it, so there is no dependency
+        //  between passes for Metal to track, and no fence is needed in its place. The output
+        //  buffer is still tracked. An untracked buffer comes from a heap of its own.
+        
+        uint InputOptions = BufferOptions;
+        if (Untracked) InputOptions |= MTL::ResourceHazardTrackingModeUntracked;
+        BufferHeap Heap(Device,Untracked ? AllocationSize : 2 * AllocationSize);
+        MTL::Buffer* InputBuffer = Heap.NewBuffer(AllocationSize,InputOptions);
         
         //  To set the contents of the buffer using the CPU, we need the address the CPU can use
         //  for this buffer, which we get using its contents() method. Then we can initialise
+        //
+        //  In half precision, the CPU works with its own arrays of floats, and the input is
+        //  converted as it goes into the buffer. This is much slower than a simple copy, so
+        //  the rows are shared out between the pool threads.
         
-        InputArray = CreateRowAddrs((float*)InputBuffer->contents(),Nx,Ny);
-        SetInputArray(InputArray,Nx,Ny);
+        float* InputArrayData = nullptr;
+        float* OutputArrayData = nullptr;
+        float UploadMsec = 0.0;
+        if (Half) {
+            InputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+            OutputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+            InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+            SetInputArray(InputArray,Nx,Ny);
+            MsecTimer UploadTimer;
+            uint16_t* InputBufferAddr = (uint16_t*)InputBuffer->contents();
+            ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+                for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                    const float* Row = InputArray[Iy];
+                    uint16_t* Target = InputBufferAddr + size_t(Iy) * size_t(Nx);
+                    for (int Ix = 0; Ix < Nx; Ix++) Target[Ix] = FloatToHalf(Row[Ix]);
+                }
+            });
+            UploadMsec = UploadTimer.ElapsedMsec();
+        } else {
+            InputArray = CreateRowAddrs((float*)InputBuffer->contents(),Nx,Ny);
+            SetInputArray(InputArray,Nx,Ny);
+        }
 
         //  And now a device buffer for the output data array. This is essentially the same as for
         //  the input buffer. This will have to be accessed on the CPU side by CheckResults(),
-        //  so we use CreateRowAddrs() to set up for this.
+        //  so we use CreateRowAddrs() to set up for this. (In half precision, the output array
+        //  is the CPU's own, and the results are converted into it once the GPU is done.)
         
-        MTL::Buffer* OutputBuffer = Device->newBuffer(AllocationSize,BufferOptions);
-        OutputArray = CreateRowAddrs((float*)OutputBuffer->contents(),Nx,Ny);
+        MTL::Buffer* OutputBuffer = Heap.NewBuffer(AllocationSize,BufferOptions);
+        if (Half) {
+            OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+        } else {
+            OutputArray = CreateRowAddrs((float*)OutputBuffer->contents(),Nx,Ny);
+        }
         TheDebugHandler.Logf("Setup","GPU buffers created at %.3f msec",SetupTimer.ElapsedMsec());
 
         //  We need a command queue that will be able to supply a command buffer.
@@ -356,10 +615,12 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
         TheDebugHandler.Logf("Setup","GPU command queue created at %.3f msec",
                                                                    SetupTimer.ElapsedMsec());
 
-        //  This lets us create a 'pipeline state' that will execute this function.
+        //  This lets us create a 'pipeline state' that will execute this function. For
+        //  'Indirect', it has to be one that can be used in an indirect command buffer.
         
-        MTL::ComputePipelineState* PipelineState =
-        Device->newComputePipelineState(AdderFunction,&ErrorPtr);
+        MTL::ComputePipelineState* PipelineState = Indirect ?
+                  IndirectDispatch::NewPipelineState(Device,AdderFunction,&ErrorPtr) :
+                                    Device->newComputePipelineState(AdderFunction,&ErrorPtr);
         TheDebugHandler.Logf("Setup","GPU pipeline state created at %.3f msec",
                                                                   SetupTimer.ElapsedMsec());
 
@@ -382,17 +643,74 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
                                            ThreadGroupSize / ThreadWidth,ThreadWidth,1);
         TheDebugHandler.Logf("Setup","Grid size %d, %d, %d",
                                                 GridSize.width,GridSize.height,GridSize.depth);
+        
+        //  For 'Indirect', the pipeline state, the buffers and the dispatch are encoded once,
+        //  now, and each pass just executes that. If the indirect command buffer can't be
+        //  created, the passes encode the dispatch as usual.
+        
+        IndirectDispatch Command(Device);
+        if (Indirect) {
+            if (Command.Begin(PipelineState,2)) {
+                Command.SetBuffer(InputBuffer,1);
+                Command.SetBuffer(OutputBuffer,2);
+                Command.Dispatch(GridSize,ThreadGroupDims);
+            } else {
+                printf ("Unable to create an indirect command buffer, so 'Indirect' is ignored.\n");
+                Indirect = false;
+            }
+        }
         TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+        Tracer.End("GPU setup","Adder");
 
         //  And that completes the basic setup for the GPU pipeline. From here, all Metal items
         //  are transient, and need to be created anew if the calculation is to be repeated,
         //  which it is going to be in the loop that follows.
+
+        //  With 'InFlight', up to InFlight command buffers are with the GPU at once. Each one
+        //  committed is retained in the next of a ring of slots, and is only waited for when
+        //  that slot comes round again, so the CPU sets up the following passes while the GPU
+        //  is still running the earlier ones, and the loop measures throughput rather than the
+        //  round trip for each pass. Metal runs the command buffers from one queue in order.
+        
+        //  The time the GPU spends in the kernel is measured by a DispatchTimer, with a slot
+        //  for each command buffer in flight, and added up once each one completes. The time
+        //  for each pass is also collected in KernelStats. For a trace, each command buffer is
+        //  recorded from its commit until it's seen to complete, identified by its address, and
+        //  the kernel time is shown ending when it completed - the GPU only gives a duration.
+        
+        DispatchTimer KernelTimer(Device,InFlight);
+        float KernelMsec = 0.0;
+        MsecStats KernelStats;
+        KernelStats.SetWarmup(Warmup);
+        
+        MTL::CommandBuffer* InFlightBuffers[C_MaxInFlight] = {};
+        auto WaitForSlot = [&](int Slot) {
+            if (InFlightBuffers[Slot]) {
+                InFlightBuffers[Slot]->waitUntilCompleted();
+                double DoneUsec = Tracer.NowUsec();
+                Tracer.AsyncEnd("GPU submission","Metal",uint64_t(InFlightBuffers[Slot]));
+                float DispatchMsec = KernelTimer.DispatchMsec(InFlightBuffers[Slot],Slot);
+                KernelMsec += DispatchMsec;
+                KernelStats.Record(DispatchMsec);
+                Tracer.Complete("Adder kernel","GPU",DoneUsec - DispatchMsec * 1000.0,
+                                                                           DispatchMsec * 1000.0);
+                InFlightBuffers[Slot]->release();
+                InFlightBuffers[Slot] = nullptr;
+            }
+        };
                 
+        //  The time for each pass is collected in LoopStats. (With 'InFlight', this is the time
+        //  for the CPU to get the pass to the GPU, including any wait for a free slot.)
+        
+        MsecStats LoopStats;
+        LoopStats.SetWarmup(Warmup);
         MsecTimer ComputeTimer;
         
         for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
             
             MsecTimer LoopTimer;
+            TraceScope PassTrace("GPU pass","Adder");
+            WaitForSlot(Irpt % InFlight);
             
             //  This sets up the pipeline for the GPU calculation and runs it. It's good
             //  practice to use a separate autorelease pool for separate sections like this.
@@ -404,46 +722,111 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
             //  that will perform the calculation.
             
             MTL::CommandBuffer* CommandBuffer = CommandQueue->commandBuffer();
-            MTL::ComputeCommandEncoder* Encoder = CommandBuffer->computeCommandEncoder();
-            TheDebugHandler.Logf("Timing","Command buffer and encoder created at %.3f msec",
+            MTL::ComputeCommandEncoder* Encoder =
+                                          KernelTimer.NewEncoder(CommandBuffer,Irpt % InFlight);
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,
+                                                  "Command buffer and encoder created at %.3f msec",
                                                                      LoopTimer.ElapsedMsec());
-            Encoder->setComputePipelineState(PipelineState);
-
-            //  Set the two data buffers, for the input array and the output array. These are
-            //  associated with different bindings, specified by the index numbers 1 and 2, which
-            //  must match the index values used in the metal kernel code in Adder.metal
-            
-            Encoder->setBuffer(InputBuffer,0,1);
-            Encoder->setBuffer(OutputBuffer,0,2);
-            TheDebugHandler.Logf("Timing","Data buffers set at %.3f msec",LoopTimer.ElapsedMsec());
+            if (Indirect) {
+                Command.Execute(Encoder);
+            } else {
+                Encoder->setComputePipelineState(PipelineState);
 
-            Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+                //  Set the two data buffers, for the input array and the output array. These are
+                //  associated with different bindings, specified by the index numbers 1 and 2,
+                //  which must match the index values used in the metal kernel code in Adder.metal
+                
+                Encoder->setBuffer(InputBuffer,0,1);
+                Encoder->setBuffer(OutputBuffer,0,2);
+                DEBUG_LOGF(TheDebugHandler,TimingDebug,"Data buffers set at %.3f msec",
+                                                                     LoopTimer.ElapsedMsec());
+                Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+            }
             Encoder->endEncoding();
-            TheDebugHandler.Logf("Timing","Encoding finished at %.3f msec",LoopTimer.ElapsedMsec());
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"Encoding finished at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
             
             //  Finally, we run the kernel. We 'commit' the command buffer, ie submit it
-            //  for execution, and wait for it to complete. (A cleverer program could be doing
-            //  something else while the buffer executes, but we just wait.)
+            //  for execution, and normally wait for it to complete. With 'InFlight', we keep
+            //  it instead, and only wait for it when its slot is needed again.
             
             CommandBuffer->commit();
-            TheDebugHandler.Logf("Timing","Compute committed at %.3f msec",LoopTimer.ElapsedMsec());
-            CommandBuffer->waitUntilCompleted();
-            TheDebugHandler.Logf("Timing","Compute complete at %.3f msec",LoopTimer.ElapsedMsec());
+            Tracer.AsyncBegin("GPU submission","Metal",uint64_t(CommandBuffer));
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute committed at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+            if (InFlight > 1) {
+                InFlightBuffers[Irpt % InFlight] = CommandBuffer->retain();
+            } else {
+                CommandBuffer->waitUntilCompleted();
+                double DoneUsec = Tracer.NowUsec();
+                Tracer.AsyncEnd("GPU submission","Metal",uint64_t(CommandBuffer));
+                DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute complete at %.3f msec",
+                                                                     LoopTimer.ElapsedMsec());
+                float DispatchMsec = KernelTimer.DispatchMsec(CommandBuffer);
+                DEBUG_LOGF(TheDebugHandler,TimingDebug,"GPU kernel took %.3f msec",DispatchMsec);
+                KernelMsec += DispatchMsec;
+                KernelStats.Record(DispatchMsec);
+                Tracer.Complete("Adder kernel","GPU",DoneUsec - DispatchMsec * 1000.0,
+                                                                           DispatchMsec * 1000.0);
+            }
 
             //  And at the end of the block, let the auto-release pool for the loop do its thing.
             
             PipeAutoreleasePool->release();
+            LoopStats.Record(LoopTimer.ElapsedMsec());
         }
         
-        //  Check that we got it right, and if so report on the timing.
+        //  The results are needed now, so wait for any passes still with the GPU, oldest first.
+        
+        for (int Islot = 0; Islot < InFlight; Islot++) WaitForSlot((Nrpt + Islot) % InFlight);
+        
+        //  In half precision, the results have to be converted back to floats.
         
         float Msec = ComputeTimer.ElapsedMsec();
+        float ReadbackMsec = 0.0;
+        if (Half && Nrpt > 0) {
+            MsecTimer ReadbackTimer;
+            const uint16_t* OutputBufferAddr = (const uint16_t*)OutputBuffer->contents();
+            ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+                for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                    const uint16_t* Source = OutputBufferAddr + size_t(Iy) * size_t(Nx);
+                    float* Row = OutputArray[Iy];
+                    for (int Ix = 0; Ix < Nx; Ix++) Row[Ix] = HalfToFloat(Source[Ix]);
+                }
+            });
+            ReadbackMsec = ReadbackTimer.ElapsedMsec();
+        }
+        
+        //  Check that we got it right, and if so report on the timing.
+        
         if (Nrpt <= 0) {
             printf ("No values computed using GPU, as number of repeats set to zero.\n");
         } else {
-            printf ("GPU took %.3f msec\n",Msec);
+            printf ("GPU%s took %.3f msec\n",Half ? " (half precision)" : "",Msec);
             printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
-            if (CheckResults(InputArray,Nx,Ny,OutputArray)) {
+            LoopStats.Report("GPU iterations");
+            if (LoopStats.Count() > 0) {
+                Bench.SetContext("Adder","Metal",Device->name()->cString(UTF8StringEncoding),"");
+                std::string Test = "GPU";
+                if (Half) Test += " half";
+                if (InFlight > 1) Test += " in flight " + std::to_string(InFlight);
+                if (Indirect) Test += " indirect";
+                if (Untracked) Test += " untracked";
+                Bench.AddRow(Test,Nx,Ny,LoopStats,&KernelStats);
+            }
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+            if (InFlight > 1) printf ("(With up to %d command buffers in flight)\n",InFlight);
+            if (Indirect) printf ("(Dispatch encoded once, in an indirect command buffer)\n");
+            if (Untracked) printf ("(Input buffer created without hazard tracking)\n");
+            if (Half) {
+                printf ("Conversion to half precision took %.3f msec, and back %.3f msec\n",
+                                                                      UploadMsec,ReadbackMsec);
+            }
+            bool Good = false;
+            if (Half) Good = CheckHalfResults(InputArray,Nx,Ny,OutputArray);
+            else Good = CheckResults(InputArray,Nx,Ny,OutputArray);
+            if (Good) {
                 printf ("GPU completed OK, all values computed as expected.\n\n");
             } else {
                 printf ("** GPU completes, but with errors **\n\n");
@@ -454,6 +837,10 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
         
         if (OutputArray) free(OutputArray);
         if (InputArray) free(InputArray);
+        if (OutputArrayData) free(OutputArrayData);
+        if (InputArrayData) free(InputArrayData);
+    } else {
+        Tracer.End("GPU setup","Adder");
     }
     
     //  And now finish up by releasing any resources known to the main auto-release pool.
@@ -461,6 +848,31 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt)
     MainAutoreleasePool->release();
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                       C o m p u t e  U s i n g  M e t a l  B a c k e n d
+//
+//  Used for 'Backend'. This just sets up a MetalBackend, with the same library and kernel as
+//  ComputeUsingGPU(), and has ComputeUsingBackend() in BackendAdder.h do the rest - the same
+//  code the Vulkan version of Adder runs with a VulkanBackend.
+
+void ComputeUsingMetalBackend(int Nx,int Ny,int Nrpt,int Warmup,BenchReport& Bench)
+{
+    //  The backend is deleted, releasing everything it created, before the pool is.
+    
+    NS::AutoreleasePool* MainAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    bool StatusOK = true;
+    MetalBackend* Backend = new MetalBackend("Compute.metallib",StatusOK);
+    if (StatusOK) {
+        TraceScope BackendTrace("GPU backend","Adder");
+        ComputeUsingBackend(*Backend,"adder",Nx,Ny,Nrpt,Warmup,Bench);
+    } else {
+        printf ("Unable to set up the Metal backend.\n\n");
+    }
+    delete Backend;
+    MainAutoreleasePool->release();
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    C P U  c o d e
@@ -503,45 +915,23 @@ void ComputeRangeUsingCPU(float** InputArray,int Nx,int Iyst,int Iyen,float** Ou
 //  OnePassUsingCPU() performs one pass through the whole of the input data, splitting up
 //  the work across multiple threads. It will use as many CPU threads as are available, up
 //  to the value of Threads. If Threads is set to zero, it uses all available CPU threads.
+//  If Profile is not null, the time each thread spends in ComputeRangeUsingCPU() is recorded
+//  in it.
 
-int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,float** OutputArray)
+int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,float** OutputArray,
+                                                                        CycleProfile* Profile)
 {
-    //  If we're only using one thread, do the calculation in the main thread, avoiding any
-    //  threading overheads.
+    //  The rows are divided between the threads of the shared pool, which are created once
+    //  and then reused for each pass, so creating threads isn't included in the timings.
+    //  If only one thread is to be used, ParallelFor() just does the work in this thread.
     
-    if (Threads == 1) {
-        ComputeRangeUsingCPU(InputArray,Nx,0,Ny,OutputArray);
-    } else {
-        
-        //  If threading, create the specified number of threads, and divide the image rows
-        //  between them.
-        
-        std::thread ThreadList[Threads];
-        int Iy = 0;
-        int Iyinc = Ny / Threads;
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread] = std::thread (ComputeRangeUsingCPU,
-                                               InputArray,Nx,Iy,Iy+Iyinc,OutputArray);
-            Iy += Iyinc;
-        }
-        
-        //  Wait for all the threads to complete.
-        
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread].join();
-        }
-        
-        //  If there were rows left unhandled (because Ny was not a multiple of NThreads),
-        //  finish them off in the main thread.
-        
-        if (Iy < Ny) {
-            ComputeRangeUsingCPU(InputArray,Nx,Iy,Ny,OutputArray);
-        }
-    }
-    return Threads;
+    return ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        CycleScope RangeTime(Profile,uint64_t(Iyen - Iyst));
+        ComputeRangeUsingCPU(InputArray,Nx,Iyst,Iyen,OutputArray);
+    },Threads);
 }
 
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt,int Warmup,BenchReport& Bench)
 {
     //  Create the two arrays we need, one for the input data, one for the output. To make things
     //  easier for ourselves, setup two arrays that contain the addresses of the start of the
@@ -571,6 +961,19 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
     if (Threads > MaxThreads) Threads = MaxThreads;
     TheDebugHandler.Logf("Setup","CPU using %d threads out of maximum of %d\n",Threads,MaxThreads);
     
+    //  With the 'Profile' debug level, the time each thread spends on its range of rows is
+    //  recorded, leaving out the warm-up passes. The timer is calibrated first, so that isn't
+    //  included in the first pass.
+    
+    CycleProfile RangeProfile;
+    CycleProfile* Profile = nullptr;
+    if (TheDebugHandler.Active(ProfileDebug)) {
+        CycleTimer::Calibrate();
+        Profile = &RangeProfile;
+    }
+    
+    MsecStats LoopStats;
+    LoopStats.SetWarmup(Warmup);
     MsecTimer ComputeTimer;
     
     //  Repeat a single pass through the whole image, as many times as specified by the repeat
@@ -579,8 +982,12 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
     
     for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
         MsecTimer LoopTimer;
-        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,OutputArray);
-        TheDebugHandler.Logf("Timing","CPU Compute complete at %.3f msec",LoopTimer.ElapsedMsec());
+        TraceScope PassTrace("CPU pass","Adder");
+        if (Irpt == Warmup) RangeProfile.Clear();
+        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,OutputArray,Profile);
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"CPU Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+        LoopStats.Record(LoopTimer.ElapsedMsec());
     }
     
     //  Report on results, and on timing.
@@ -592,6 +999,12 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
         printf ("CPU took %.3f msec\n",Msec);
         printf ("Average msec per iteration for CPU = %.3f (%d thread(s))\n",
                                                              Msec / float(Nrpt),Threads);
+        LoopStats.Report("CPU iterations");
+        if (Profile) Profile->Report("CPU row ranges (items are rows)");
+        if (LoopStats.Count() > 0) {
+            Bench.SetContext("Adder","CPU","","");
+            Bench.AddRow("CPU " + std::to_string(Threads) + " thread(s)",Nx,Ny,LoopStats);
+        }
         if (CheckResults(InputArray,Nx,Ny,OutputArray)) {
             printf ("CPU completed OK, all values computed as expected.\n\n");
         } else {
@@ -621,13 +1034,17 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
 
 void SetInputArray(float** InputArray,int Nx,int Ny)
 {
-    //  Initialise the input array. The actual values don't really matter.
+    //  Initialise the input array. The actual values don't really matter. For large arrays
+    //  this takes a while, so the rows are shared out between the threads in the shared pool.
     
-    for (int Iy = 0; Iy < Ny; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            InputArray[Iy][Ix] = float(Ny + Iy + Iy + Nx - Ix - Ix);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            float* Row = InputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                Row[Ix] = float(Ny + Iy + Iy + Nx - Ix - Ix);
+            }
         }
-    }
+    });
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -654,20 +1071,100 @@ float** CreateRowAddrs(float* Array,int Nx,int Ny)
 //
 //  This routine simply uses the CPU to check that the results in OutputArray match what was
 //  expected. If it finds any mismatch, it outputs an error message and returns false.
+//
+//  For large arrays this can take longer than the calculation being checked, so the rows are
+//  shared out between the threads in the shared pool. Each row is checked with a loop that
+//  just ORs together the results of the comparisons, with no branch, which the compiler can
+//  turn into vector code. Only if a row has a mismatch is it searched element by element for
+//  the first bad value. The lowest bad row found so far is shared between the threads, and
+//  they stop once they get past it, so a bad result doesn't mean checking the whole array.
 
 bool CheckResults(float** InputArray,int Nx,int Ny,float** OutputArray)
 {
+    std::atomic<int> FirstBadRow(Ny);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen && Iy < FirstBadRow.load(std::memory_order_relaxed); Iy++) {
+            const float* InRow = InputArray[Iy];
+            const float* OutRow = OutputArray[Iy];
+            int Bad = 0;
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                Bad |= (OutRow[Ix] != InRow[Ix] + float(Ix + Iy));
+            }
+            if (Bad) {
+                int Lowest = FirstBadRow.load();
+                while (Iy < Lowest && !FirstBadRow.compare_exchange_weak(Lowest,Iy)) {}
+                break;
+            }
+        }
+    });
+    
+    //  If there was a bad row, find the first bad value in it, and report it.
+    
     bool AllOK = true;
-    for (int Iy = 0; Iy < Ny; Iy++) {
+    int Iy = FirstBadRow.load();
+    if (Iy < Ny) {
         for (int Ix = 0; Ix < Nx; Ix++) {
             if (OutputArray[Iy][Ix] != InputArray[Iy][Ix] + float(Ix + Iy)) {
                 printf ("*** Error at [%d][%d]. Got %.1f expected %.1f\n",Iy,Ix,
                         OutputArray[Iy][Ix],InputArray[Iy][Ix] + float(Ix + Iy));
-                AllOK = false;
                 break;
             }
         }
-        if (!AllOK) break;
+        AllOK = false;
+    }
+    return AllOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            C h e c k  H a l f  R e s u l t s
+//
+//  The equivalent of CheckResults() when the arrays were held on the GPU in half precision.
+//  The GPU was given the input values rounded to half precision, and added Ix + Iy to them as
+//  floats, which is exact for anything half precision can hold. The result was then rounded
+//  back to half precision. Metal rounds to nearest, but this allows for rounding towards zero
+//  as well, just as the Vulkan version has to, so HalfMatches() accepts either.
+
+static bool HalfMatches(float Got,float Exact)
+{
+    uint16_t Nearest = FloatToHalf(Exact);
+    float NearestValue = HalfToFloat(Nearest);
+    if (Got == NearestValue) return true;
+    if (fabs(NearestValue) > fabs(Exact) && (Nearest & 0x7fff) != 0) {
+        return Got == HalfToFloat(uint16_t(Nearest - 1));
+    }
+    return false;
+}
+
+bool CheckHalfResults(float** InputArray,int Nx,int Ny,float** OutputArray)
+{
+    std::atomic<int> FirstBadRow(Ny);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen && Iy < FirstBadRow.load(std::memory_order_relaxed); Iy++) {
+            const float* InRow = InputArray[Iy];
+            const float* OutRow = OutputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                if (!HalfMatches(OutRow[Ix],RoundToHalf(InRow[Ix]) + float(Ix + Iy))) {
+                    int Lowest = FirstBadRow.load();
+                    while (Iy < Lowest && !FirstBadRow.compare_exchange_weak(Lowest,Iy)) {}
+                    break;
+                }
+            }
+        }
+    });
+
+    bool AllOK = true;
+    int Iy = FirstBadRow.load();
+    if (Iy < Ny) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            float Exact = RoundToHalf(InputArray[Iy][Ix]) + float(Ix + Iy);
+            if (!HalfMatches(OutputArray[Iy][Ix],Exact)) {
+                printf ("*** Error at [%d][%d]. Got %.1f expected %.1f\n",Iy,Ix,
+                                                        OutputArray[Iy][Ix],RoundToHalf(Exact));
+                break;
+            }
+        }
+        AllOK = false;
     }
     return AllOK;
 }
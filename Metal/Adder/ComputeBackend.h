@@ -0,0 +1,79 @@
+//
+//                         C o m p u t e  B a c k e n d . h
+//
+//  The Metal and Vulkan versions of these programs started as parallel copies of each other,
+//  and each change to the way the GPU is driven - keeping command buffers in flight, reusing
+//  buffers, timing the kernels - has had to be written twice, once for each API. A
+//  ComputeBackend is the small part of either API that most of that code actually needs:
+//  buffers shared by the CPU and GPU, kernels that use them, running a kernel over a 2D grid,
+//  and the time the GPU took. Code written against it - see BackendAdder.h - runs unchanged
+//  with either MetalBackend (MetalBackend.h, in the Metal programs) or VulkanBackend
+//  (VulkanBackend.h, in the Vulkan programs), and the programs just create the one they use.
+//
+//  A backend is used like this:
+//
+//     int Kernel = Backend.NewKernel(Name,sizeof(MyArgs),StatusOK);
+//     float* In = (float*)Backend.NewBuffer(Kernel,1,Bytes,ComputeBackend::In,StatusOK);
+//     float* Out = (float*)Backend.NewBuffer(Kernel,2,Bytes,ComputeBackend::Out,StatusOK);
+//     Backend.SetGrid(Kernel,Nx,Ny);
+//     Backend.Submit(Kernel,&Args,StatusOK);
+//     Backend.Wait(Kernel,StatusOK);
+//
+//  The kernel's name is in the backend's own terms - the function in the Metal library, or the
+//  SPIR-V file for Vulkan - as that's the one thing that can't be the same for both. The
+//  arguments are passed at binding 0, which is where both the Metal and the Vulkan kernels in
+//  these programs already expect them: with setBytes() for Metal, and in a uniform buffer for
+//  Vulkan, which has to be laid out to match (std140 - for a structure of ints and floats, just
+//  as a C++ compiler lays it out). The buffers are bound at the bindings given, which must
+//  match the kernel. A kernel may run over more of the grid than Nx by Ny - Vulkan rounds it up
+//  to whole workgroups - so the kernel has to ignore any extras.
+//
+//  Errors are reported the same way as by the KVVulkanFramework: each call takes a StatusOK
+//  flag, does nothing if it is already false, and clears it if something goes wrong.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __ComputeBackend__
+#define __ComputeBackend__
+
+#include <string>
+#include <stddef.h>
+
+class ComputeBackend
+{
+public:
+    //  How a kernel uses a buffer - reads it, writes it, or both.
+    enum Usage { In, Out, InOut };
+    virtual ~ComputeBackend() {}
+    //  The API used ("Metal" or "Vulkan") and the name of the GPU, as used in reports.
+    virtual std::string Api(void) = 0;
+    virtual std::string DeviceName(void) = 0;
+    //  Sets up a kernel, passed ArgBytes of arguments at binding 0, returning its id.
+    virtual int NewKernel(const std::string& Name,size_t ArgBytes,bool& StatusOK) = 0;
+    //  Creates a buffer of Bytes, shared by the CPU and GPU, that the kernel sees at Binding,
+    //  and returns its address for the CPU. Buffers are created before the kernel first runs.
+    virtual void* NewBuffer(int Kernel,int Binding,size_t Bytes,Usage Use,bool& StatusOK) = 0;
+    //  Sets the grid the kernel is run over, one invocation for each element of Nx by Ny.
+    virtual void SetGrid(int Kernel,int Nx,int Ny) = 0;
+    //  Starts the kernel, with the given arguments, without waiting for it to finish.
+    virtual void Submit(int Kernel,const void* Args,bool& StatusOK) = 0;
+    //  Waits for the kernel started by Submit() to finish, so its output can be read.
+    virtual void Wait(int Kernel,bool& StatusOK) = 0;
+    //  Returns the time the last run took on the GPU, if it could be measured.
+    virtual bool KernelMsec(int Kernel,float* Msec) = 0;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   This is deliberately the least the programs need, rather than a wrapper for all of
+        either API. Anything only one API has - indirect command buffers, heaps, Vulkan's
+        buffer access modes - stays in the program that uses it, which can still use its API
+        directly alongside a backend.
+
+    o   A kernel holds on to its buffers, and Submit() waits for any run of the same kernel
+        still going before it starts another, so a kernel can't be in flight more than once.
+        Two kernels can be, and a program that wants to keep several passes in flight can
+        set up one kernel for each.
+*/
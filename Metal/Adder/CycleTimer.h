@@ -0,0 +1,160 @@
+//
+//                            C y c l e  T i m e r . h
+//
+//  This provides timing fine enough, and cheap enough, to time each piece of work a CPU thread
+//  does - a few rows of an image, say - inside the code being timed. An MsecTimer is fine for a
+//  whole pass, but reading std::chrono::steady_clock can take a good fraction of a microsecond
+//  on some systems, which adds up when it's done for every few rows. The time stamp counter
+//  read by TcsUtil::ReadTSC() costs much less, but it counts ticks, not nanoseconds, and on
+//  older CPUs the rate it ticks at changes with the clock speed.
+//
+//  CycleTimer::Now() returns the current tick count, and CycleTimer::Nsec() converts a number
+//  of ticks to nanoseconds. The first time either is needed, the ticks are calibrated against
+//  steady_clock, which takes a few milliseconds, so CycleTimer::Calibrate() can be called at
+//  startup to get that out of the way. If TcsUtil::InvariantTSC() says the counter doesn't tick
+//  at a constant rate, or there isn't one, steady_clock itself is used, in nanoseconds.
+//
+//  A CycleProfile adds up the ticks spent in one piece of code, from any number of threads, and
+//  the number of items - rows, say - that it handled. Report() prints the total, the average per
+//  item and the longest single call. A CycleScope times a block of code for a CycleProfile. If
+//  it's given a null CycleProfile it does nothing at all, so the profiling can be turned on and
+//  off just by passing a profile or a null pointer.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __CycleTimer__
+#define __CycleTimer__
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+//  TcsUtil::ReadTSC() is only provided for Unix-like systems. Elsewhere, steady_clock is used.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CYCLE_TIMER_TSC
+#include "TcsUtil.h"
+#endif
+
+class CycleTimer
+{
+public:
+    CycleTimer() { Restart(); }
+    ~CycleTimer() {}
+    void Restart(void) { _startTicks = Now(); }
+    uint64_t ElapsedTicks(void) const { return Now() - _startTicks; }
+    double ElapsedNsec(void) const { return Nsec(ElapsedTicks()); }
+    //  Returns the current tick count.
+    static uint64_t Now(void) {
+#ifdef CYCLE_TIMER_TSC
+        if (Calibration().UseTSC) return uint64_t(TcsUtil::ReadTSC());
+#endif
+        return SteadyNsec();
+    }
+    //  Converts a number of ticks to nanoseconds.
+    static double Nsec(uint64_t Ticks) { return double(Ticks) * Calibration().NsecPerTick; }
+    //  Returns true if the ticks are those of the time stamp counter, false for steady_clock.
+    static bool UsingTSC(void) { return Calibration().UseTSC; }
+    //  Calibrates the ticks, if that hasn't already been done.
+    static void Calibrate(void) { Calibration(); }
+private:
+    //  How long the ticks are counted for, against steady_clock, to calibrate them.
+    static const uint64_t C_CalibrationNsec = 20000000;
+    struct Details {
+        bool UseTSC;
+        double NsecPerTick;
+    };
+    static const Details& Calibration(void) {
+        static const Details TheDetails = Measure();
+        return TheDetails;
+    }
+    static Details Measure(void) {
+        Details Result = {false,1.0};
+#ifdef CYCLE_TIMER_TSC
+        if (TcsUtil::InvariantTSC()) {
+            uint64_t StartNsec = SteadyNsec();
+            unsigned long long StartTicks = TcsUtil::ReadTSC();
+            uint64_t EndNsec;
+            do {
+                EndNsec = SteadyNsec();
+            } while (EndNsec - StartNsec < C_CalibrationNsec);
+            unsigned long long EndTicks = TcsUtil::ReadTSC();
+            if (EndTicks > StartTicks) {
+                Result.UseTSC = true;
+                Result.NsecPerTick = double(EndNsec - StartNsec) / double(EndTicks - StartTicks);
+            }
+        }
+#endif
+        return Result;
+    }
+    static uint64_t SteadyNsec(void) {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    uint64_t _startTicks;
+};
+
+class CycleProfile
+{
+public:
+    CycleProfile() { Clear(); }
+    ~CycleProfile() {}
+    //  Adds a call that took Ticks and handled Items items. This can be called by any thread.
+    void Record(uint64_t Ticks,uint64_t Items) {
+        _ticks.fetch_add(Ticks,std::memory_order_relaxed);
+        _items.fetch_add(Items,std::memory_order_relaxed);
+        _calls.fetch_add(1,std::memory_order_relaxed);
+        uint64_t Longest = _longest.load(std::memory_order_relaxed);
+        while (Ticks > Longest && !_longest.compare_exchange_weak(Longest,Ticks)) {}
+    }
+    //  Discards everything recorded so far.
+    void Clear(void) {
+        _ticks = 0;
+        _items = 0;
+        _calls = 0;
+        _longest = 0;
+    }
+    uint64_t Calls(void) const { return _calls; }
+    uint64_t Items(void) const { return _items; }
+    double TotalMsec(void) const { return CycleTimer::Nsec(_ticks) * 1.0e-6; }
+    double NsecPerItem(void) const {
+        return _items > 0 ? CycleTimer::Nsec(_ticks) / double(_items) : 0.0;
+    }
+    double LongestUsec(void) const { return CycleTimer::Nsec(_longest) * 0.001; }
+    //  Prints what was recorded, for the code described as What.
+    void Report(const char* What) const {
+        if (_calls == 0) return;
+        printf ("%s: %llu calls, %llu items, %.3f msec, %.1f nsec per item, longest %.3f usec"
+                  " (%s)\n",What,(unsigned long long)Calls(),(unsigned long long)Items(),
+                             TotalMsec(),NsecPerItem(),LongestUsec(),
+                                               CycleTimer::UsingTSC() ? "TSC" : "steady clock");
+    }
+private:
+    std::atomic<uint64_t> _ticks;
+    std::atomic<uint64_t> _items;
+    std::atomic<uint64_t> _calls;
+    std::atomic<uint64_t> _longest;
+};
+
+//  A CycleScope records the time from its creation until it goes out of scope in Profile,
+//  as a call that handled Items items. If Profile is null, it does nothing.
+
+class CycleScope
+{
+public:
+    CycleScope(CycleProfile* Profile,uint64_t Items = 1) {
+        _profile = Profile;
+        _items = Items;
+        if (_profile) _startTicks = CycleTimer::Now();
+    }
+    ~CycleScope() {
+        if (_profile) _profile->Record(CycleTimer::Now() - _startTicks,_items);
+    }
+private:
+    CycleProfile* _profile;
+    uint64_t _items;
+    uint64_t _startTicks = 0;
+};
+
+#endif
@@ -126,6 +126,37 @@
 //      If you end up with a non-blank string, there may be a problem. In practice, this may be
 //      tricky to use for reasons of program structure.
 //
+//  Debug calls in time-critical code:
+//
+//      Active(), Log() and Logf() all look up the named level each time they are called, which
+//      involves a case-blind comparison with each level name in turn. That's fine for most debug
+//      code, but not in the middle of a loop being timed. For those cases, a level can be looked
+//      up once, using Level(), which returns a bit mask - a DebugHandler::LevelBits value - for
+//      it. That can be passed to Active(), Log() or Logf() instead of the level name, and the
+//      test is then just a check against a bit mask of the active levels that is updated
+//      whenever levels are enabled or disabled. The DEBUG_ACTIVE() and DEBUG_LOGF() macros
+//      wrap these, so the arguments to a disabled Logf() call are not even evaluated, eg:
+//
+//          DebugHandler::LevelBits TimingBits = TheDebugHandler.Level("Timing");
+//          ...
+//          DEBUG_LOGF(TheDebugHandler,TimingBits,"Pass took %.3f msec",Timer.ElapsedMsec());
+//
+//      If NO_DEBUG_HANDLER is defined when this is compiled, Active() always returns false, and
+//      the compiler can remove all such debug code completely.
+//
+//  Logging from several threads:
+//
+//      Normally, Log() and Logf() print each message as they are called, from whichever thread
+//      calls them. printf() holds a lock on stdout while it prints, so threads that log at the
+//      same time wait for each other, and that waiting gets into any timings being logged. Once
+//      the global DebugLogSink has been started, messages are instead queued by the thread that
+//      logs them, with the time, and written out - to stdout, or to a file - by a background
+//      thread, all of which is described with DebugLogSink below. For example:
+//
+//          DebugLogSink::Global().Start("Debug.log");
+//          ...
+//          DebugLogSink::Global().Stop();
+//
 //  Author(s): Keith Shortridge, K&V  (Keith@KnaveAndVarlet.com.au)
 //
 //  History:
@@ -136,6 +167,10 @@
 //                     routines re-named for clarity. Added use of '!' in level specifications. KS.
 //     14th Aug 2024.  Added CheckLevels(). Removed the programming note saying such a routine
 //                     would be a good idea. KS.
+//     15th Oct 2026.  Added Level() and the LevelBits versions of Active(), Log() and Logf(),
+//                     the DEBUG_ACTIVE() and DEBUG_LOGF() macros, and NO_DEBUG_HANDLER. KS.
+//                     Added DebugLogSink, to have messages written out by a background thread.
+//                     Logf() now calls va_end() for its name version too. KS.
 //
 //  Note:
 //
@@ -156,13 +191,239 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+//  DEBUG_ACTIVE() tests a level looked up using Level(), and DEBUG_LOGF() only evaluates its
+//  arguments if that level is active. With NO_DEBUG_HANDLER defined, both compile to nothing.
+
+#ifdef NO_DEBUG_HANDLER
+#define DEBUG_ACTIVE(Handler,Bits) (false)
+#else
+#define DEBUG_ACTIVE(Handler,Bits) ((Handler).Active(Bits))
+#endif
+
+#define DEBUG_LOGF(Handler,Bits,...) \
+    do { if (DEBUG_ACTIVE(Handler,Bits)) (Handler).Logf(Bits,__VA_ARGS__); } while (0)
+
+// -------------------------------------------------------------------------------------------------
+//
+//                               D e b u g  L o g  S i n k
+//
+//  There is just the one, global, DebugLogSink, returned by DebugLogSink::Global(). Until its
+//  Start() is called, it does nothing, and DebugHandlers print their messages directly. Once it
+//  is running, Post() copies each message into a ring buffer belonging to the calling thread,
+//  with the time in msec since the sink was created, and a background thread takes them from
+//  there and writes them out, each prefixed by that time and the number of the thread that
+//  logged it. Each ring has only the one thread adding to it and the background thread taking
+//  from it, so it needs no lock, just an atomic count at each end. The only lock is taken the
+//  first time a thread logs anything, to add a ring for it. If a thread logs messages faster
+//  than they can be written, and its ring fills up, the message is dropped rather than have the
+//  thread wait, and Stop() reports how many were dropped.
+//
+//  The background thread looks at the rings every few msec, and writes what it finds in time
+//  order, merging the rings, so messages from different threads are written in the order they
+//  were logged, unless one arrives in a later look than one logged after it. Stop() has it
+//  write out everything still queued, and then closes any file. The destructor calls Stop(),
+//  so nothing is lost if the program exits normally without calling it.
+
+class DebugLogSink {
+public:
+    
+    //  Returns the one global sink.
+    
+    static DebugLogSink& Global (void) {
+        static DebugLogSink TheSink;
+        return TheSink;
+    }
+    
+    //  The destructor writes out anything still queued.
+    
+    ~DebugLogSink () {
+        Stop();
+    }
+    
+    //  Start() starts the background thread, writing to the named file, or to stdout if the
+    //  name is blank or "stdout". Returns false if the file can't be created.
+    
+    bool Start (const std::string& FileName = "") {
+        std::lock_guard<std::mutex> Lock(I_Mutex);
+        if (I_Running) return true;
+        I_File = stdout;
+        if (FileName != "" && FileName != "stdout") {
+            I_File = fopen(FileName.c_str(),"w");
+            if (I_File == nullptr) {
+                I_File = stdout;
+                return false;
+            }
+        }
+        I_Dropped = 0;
+        I_Running = true;
+        I_Writer = std::thread([this]{ Drain(); });
+        return true;
+    }
+    
+    //  Running() returns true between Start() and Stop().
+    
+    bool Running (void) const {
+        return I_Running.load(std::memory_order_acquire);
+    }
+    
+    //  Post() queues one line of text, without its newline, logged by the calling thread.
+    //  Text longer than a ring record allows for is truncated.
+    
+    void Post (const char* Text) {
+        Ring* TheRing = ThreadRing();
+        uint64_t Head = TheRing->Head.load(std::memory_order_relaxed);
+        if (Head - TheRing->Tail.load(std::memory_order_acquire) >= C_RingRecords) {
+            I_Dropped++;
+            return;
+        }
+        Record& TheRecord = TheRing->Records[Head % C_RingRecords];
+        TheRecord.Msec = NowMsec();
+        strncpy(TheRecord.Text,Text,sizeof(TheRecord.Text) - 1);
+        TheRecord.Text[sizeof(TheRecord.Text) - 1] = '\0';
+        TheRing->Head.store(Head + 1,std::memory_order_release);
+    }
+    
+    //  Stop() stops the background thread, once it has written out everything queued, and
+    //  closes any file it was writing to. Messages logged after this are printed directly.
+    
+    void Stop (void) {
+        std::thread Writer;
+        {
+            std::lock_guard<std::mutex> Lock(I_Mutex);
+            if (!I_Running) return;
+            I_Running = false;
+            Writer = std::move(I_Writer);
+        }
+        Writer.join();
+        if (I_Dropped > 0) {
+            fprintf (I_File,"[DebugLogSink] %ld messages dropped, ring buffers full\n",
+                                                                          long(I_Dropped));
+        }
+        if (I_File != stdout) fclose(I_File);
+        else fflush(stdout);
+        I_File = stdout;
+    }
+    
+    //  NowMsec() returns the current time in msec, on the same scale as the times written.
+    
+    double NowMsec (void) const {
+        return std::chrono::duration<double,std::milli>(
+                                     std::chrono::steady_clock::now() - I_StartTime).count();
+    }
+    
+private:
+    
+    DebugLogSink () : I_StartTime(std::chrono::steady_clock::now()) {}
+    
+    //  The number of records in each thread's ring, and the interval between looks at them.
+    
+    static constexpr uint64_t C_RingRecords = 1024;
+    static constexpr int C_PollMsec = 5;
+    
+    //  One message, with its time. The record is 256 bytes in all.
+    
+    struct Record {
+        double Msec;
+        char Text[248];
+    };
+    
+    //  A thread's ring buffer. Head counts the records added, Tail those written out.
+    
+    struct Ring {
+        std::atomic<uint64_t> Head{0};
+        std::atomic<uint64_t> Tail{0};
+        int Thread = 0;
+        Record Records[C_RingRecords];
+    };
+    
+    //  ThreadRing() returns the calling thread's ring, adding one the first time it is called.
+    //  The rings belong to the sink, so a thread that finishes leaves its messages behind.
+    
+    Ring* ThreadRing (void) {
+        static thread_local Ring* TheRing = nullptr;
+        if (TheRing == nullptr) {
+            std::lock_guard<std::mutex> Lock(I_Mutex);
+            I_Rings.emplace_back(new Ring);
+            TheRing = I_Rings.back().get();
+            TheRing->Thread = int(I_Rings.size());
+        }
+        return TheRing;
+    }
+    
+    //  Drain() is the background thread. Each time round, it writes out everything queued,
+    //  always taking the earliest of the records at the front of the rings next. Once Stop()
+    //  has been called, it goes round once more, to catch anything logged just before.
+    
+    void Drain (void) {
+        bool Last = false;
+        while (!Last) {
+            Last = !Running();
+            std::vector<Ring*> Rings;
+            {
+                std::lock_guard<std::mutex> Lock(I_Mutex);
+                for (std::unique_ptr<Ring>& TheRing : I_Rings) Rings.push_back(TheRing.get());
+            }
+            for (;;) {
+                Ring* Earliest = nullptr;
+                double EarliestMsec = 0.0;
+                for (Ring* TheRing : Rings) {
+                    uint64_t Tail = TheRing->Tail.load(std::memory_order_relaxed);
+                    if (Tail != TheRing->Head.load(std::memory_order_acquire)) {
+                        double Msec = TheRing->Records[Tail % C_RingRecords].Msec;
+                        if (Earliest == nullptr || Msec < EarliestMsec) {
+                            Earliest = TheRing;
+                            EarliestMsec = Msec;
+                        }
+                    }
+                }
+                if (Earliest == nullptr) break;
+                uint64_t Tail = Earliest->Tail.load(std::memory_order_relaxed);
+                const Record& TheRecord = Earliest->Records[Tail % C_RingRecords];
+                fprintf (I_File,"%10.3f T%-2d %s\n",TheRecord.Msec,Earliest->Thread,
+                                                                             TheRecord.Text);
+                Earliest->Tail.store(Tail + 1,std::memory_order_release);
+            }
+            fflush(I_File);
+            if (!Last) std::this_thread::sleep_for(std::chrono::milliseconds(C_PollMsec));
+        }
+    }
+    
+    //  Set while the background thread is running.
+    std::atomic<bool> I_Running{false};
+    //  The number of messages dropped because a ring was full.
+    std::atomic<long> I_Dropped{0};
+    //  Taken to start and stop the background thread, and to add a ring.
+    std::mutex I_Mutex;
+    //  The background thread.
+    std::thread I_Writer;
+    //  Where the messages are written.
+    FILE* I_File = stdout;
+    //  The rings, one for each thread that has logged anything.
+    std::vector<std::unique_ptr<Ring>> I_Rings;
+    //  The time the sink was created, which the message times are relative to.
+    std::chrono::steady_clock::time_point I_StartTime;
+};
+
+// -------------------------------------------------------------------------------------------------
 
 class DebugHandler {
 public:
     
+    //  A bit mask for one or more levels, as returned by Level().
+    
+    typedef uint64_t LevelBits;
+    
     //  Constructor, takes optional sub-system name.
     
     DebugHandler (const std::string& SubSystem = "") {
@@ -191,6 +452,21 @@ public:
         TcsUtil::Tokenize(List,I_Levels,",");
         I_Flags.resize(I_Levels.size());
         for (int& Flag : I_Flags) { Flag = false; }
+        I_ActiveBits = 0;
+    }
+    
+    //  Level() returns the bit mask for the named level, for use with the LevelBits versions of
+    //  Active(), Log() and Logf(). Only the first 64 levels have bits, and Level() returns 0 -
+    //  which is never active - for any later level, or for a level that isn't recognised.
+    
+    LevelBits Level (const std::string& Name) const {
+        int NLevels = I_Levels.size();
+        for (int I = 0; I < NLevels && I < 64; I++) {
+            if (TcsUtil::MatchCaseBlind(I_Levels[I].c_str(),Name.c_str())) {
+                return LevelBits(1) << I;
+            }
+        }
+        return 0;
     }
     
     //  ListLevels() returns the level names used by this subsystem as a comma-separated string.
@@ -228,6 +504,9 @@ public:
     //  Active() returns true if the named level is currently active.
     
     bool Active (const std::string& Level) {
+#ifdef NO_DEBUG_HANDLER
+        return false;
+#endif
         bool Match = false;
         int NLevels = I_Levels.size();
         for (int I = 0; I < NLevels; I++) {
@@ -239,16 +518,21 @@ public:
         return Match;
     }
     
+    //  This version of Active() takes a level returned by Level(), and just tests its bit.
+    
+    bool Active (LevelBits Bits) const {
+#ifdef NO_DEBUG_HANDLER
+        (void) Bits;
+        return false;
+#else
+        return (I_ActiveBits & Bits) != 0;
+#endif
+    }
+    
     //  Log() outputs the text string supplied if the specified level is active.
     
     void Log (const std::string& Level,const std::string Text) {
-        if (Active(Level)) {
-            if (I_SubSystem != "") {
-                printf ("[%s.%s] %s\n",I_SubSystem.c_str(),Level.c_str(),Text.c_str());
-            } else {
-                printf ("[%s] %s\n",Level.c_str(),Text.c_str());
-            }
-        }
+        if (Active(Level)) Output(Level,Text.c_str());
     }
 
     //  Logf() is like Log() but provides printf() style formatting.
@@ -259,11 +543,26 @@ public:
             va_list Args;
             va_start (Args,Format);
             vsnprintf (Message,sizeof(Message),Format,Args);
-            if (I_SubSystem != "") {
-                printf ("[%s.%s] %s\n",I_SubSystem.c_str(),Level.c_str(),Message);
-            } else {
-                printf ("[%s] %s\n",Level.c_str(),Message);
-            }
+            va_end (Args);
+            Output(Level,Message);
+        }
+    }
+
+    //  These versions of Log() and Logf() take a level returned by Level(). The level name is
+    //  only looked up if the message is actually going to be output.
+
+    void Log (LevelBits Bits,const std::string Text) {
+        if (Active(Bits)) Log(LevelName(Bits),Text);
+    }
+
+    void Logf (LevelBits Bits,const char * const Format, ...) {
+        if (Active(Bits)) {
+            char Message[1024];
+            va_list Args;
+            va_start (Args,Format);
+            vsnprintf (Message,sizeof(Message),Format,Args);
+            va_end (Args);
+            Log(LevelName(Bits),Message);
         }
     }
 
@@ -343,6 +642,10 @@ private:
                     if (WildcardMatchCaseBlind(Level.c_str(),I_Levels[I].c_str())) {
                         I_Flags[I] = Enable;
                         Known = true;
+                        if (I < 64) {
+                            if (Enable) I_ActiveBits |= LevelBits(1) << I;
+                            else I_ActiveBits &= ~(LevelBits(1) << I);
+                        }
                     }
                 }
             }
@@ -355,12 +658,39 @@ private:
         return Unrecognised;
     }
     
+    //  Output() outputs a message logged for a level, prefixed by the subsystem and level
+    //  names - printing it directly, or passing it to the DebugLogSink if that's running.
+    
+    void Output (const std::string& Level,const char* Text) {
+        char Line[1100];
+        if (I_SubSystem != "") {
+            snprintf (Line,sizeof(Line),"[%s.%s] %s",I_SubSystem.c_str(),Level.c_str(),Text);
+        } else {
+            snprintf (Line,sizeof(Line),"[%s] %s",Level.c_str(),Text);
+        }
+        DebugLogSink& Sink = DebugLogSink::Global();
+        if (Sink.Running()) Sink.Post(Line);
+        else printf ("%s\n",Line);
+    }
+    
+    //  LevelName() returns the name of the lowest level set in Bits.
+    
+    std::string LevelName (LevelBits Bits) const {
+        int NLevels = I_Levels.size();
+        for (int I = 0; I < NLevels && I < 64; I++) {
+            if (Bits & (LevelBits(1) << I)) return I_Levels[I];
+        }
+        return "";
+    }
+    
     //  The name of the current sub-system.
     std::string I_SubSystem;
     //  All the individual level names.
     std::vector<std::string> I_Levels;
     //  Flags for each level, true when the level is active.
     std::vector<int> I_Flags;
+    //  Bit mask of the active levels, bit I being set when I_Flags[I] is true.
+    LevelBits I_ActiveBits = 0;
 };
 
 #endif
@@ -369,6 +699,13 @@ private:
 
 /*                        P r o g r a m m i n g  N o t e s
 
+ o  The DebugLogSink's rings are read by the background thread while the threads that own them
+    add to them, which is safe because each count is only ever changed by one side: a record
+    is filled in before Head is stored (with release ordering) and read after Head is loaded
+    (with acquire), and Tail works the same way in the other direction. A message logged by
+    another thread at the same moment Stop() is called may miss the last look at the rings,
+    and not be written at all.
+
  o  I did play with using a map<string,bool> instead of the two vectors, one
     for the strings and one for the flags, but found it too awkward in the end,
     althogh it does feel like the obvious implementation. Maybe I'm just not
@@ -0,0 +1,186 @@
+//
+//                           M e t a l  B a c k e n d . h
+//
+//  The Metal implementation of a ComputeBackend - see ComputeBackend.h. It uses the default
+//  device and a library of compiled kernels, named when it is created. Each kernel gets its own
+//  pipeline state, and each run its own command buffer, with one compute encoder for the one
+//  dispatch, timed by a DispatchTimer. The arguments are passed with setBytes(), and the
+//  buffers are created in shared storage, so the CPU and GPU see the same memory and nothing
+//  ever needs to be synchronised - Metal's default hazard tracking sees to the rest.
+//
+//  The Metal headers have to be included before this.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __MetalBackend__
+#define __MetalBackend__
+
+#include "Metal/Metal.hpp"
+
+#include "ComputeBackend.h"
+#include "DispatchTimer.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class MetalBackend : public ComputeBackend
+{
+public:
+    //  Sets up the default device, and opens the named library of kernels.
+    MetalBackend(const std::string& LibraryName,bool& StatusOK) {
+        _device = MTLCreateSystemDefaultDevice();
+        _library = nullptr;
+        _commandQueue = nullptr;
+        if (_device == nullptr) {
+            StatusOK = false;
+            return;
+        }
+        NS::Error* ErrorPtr = nullptr;
+        _library = _device->newLibrary(NS::String::string(LibraryName.c_str(),
+                                                    NS::UTF8StringEncoding),&ErrorPtr);
+        if (_library == nullptr || ErrorPtr != nullptr) {
+            printf ("Error opening library '%s'.\n",LibraryName.c_str());
+            StatusOK = false;
+        }
+        _commandQueue = _device->newCommandQueue();
+        if (_commandQueue == nullptr) StatusOK = false;
+    }
+    ~MetalBackend() {
+        for (Kernel& TheKernel : _kernels) {
+            if (TheKernel.CommandBuffer) {
+                TheKernel.CommandBuffer->waitUntilCompleted();
+                TheKernel.CommandBuffer->release();
+            }
+            for (Binding& TheBinding : TheKernel.Buffers) TheBinding.Buffer->release();
+            delete TheKernel.Timer;
+            TheKernel.Pipeline->release();
+            TheKernel.Function->release();
+        }
+        if (_commandQueue) _commandQueue->release();
+        if (_library) _library->release();
+        if (_device) _device->release();
+    }
+    std::string Api(void) { return "Metal"; }
+    std::string DeviceName(void) {
+        return _device ? _device->name()->cString(NS::UTF8StringEncoding) : "";
+    }
+    int NewKernel(const std::string& Name,size_t ArgBytes,bool& StatusOK) {
+        if (!StatusOK) return -1;
+        Kernel TheKernel;
+        TheKernel.Function = _library->newFunction(NS::String::string(Name.c_str(),
+                                                                    NS::UTF8StringEncoding));
+        if (TheKernel.Function == nullptr) {
+            printf ("Unable to find '%s' function in library\n",Name.c_str());
+            StatusOK = false;
+            return -1;
+        }
+        NS::Error* ErrorPtr = nullptr;
+        TheKernel.Pipeline = _device->newComputePipelineState(TheKernel.Function,&ErrorPtr);
+        if (TheKernel.Pipeline == nullptr) {
+            TheKernel.Function->release();
+            StatusOK = false;
+            return -1;
+        }
+        TheKernel.ArgBytes = ArgBytes;
+        TheKernel.Timer = new DispatchTimer(_device);
+        _kernels.push_back(TheKernel);
+        return int(_kernels.size()) - 1;
+    }
+    void* NewBuffer(int KernelId,int BindingIndex,size_t Bytes,Usage,bool& StatusOK) {
+        if (!StatusOK || !Valid(KernelId)) {
+            StatusOK = false;
+            return nullptr;
+        }
+        MTL::Buffer* Buffer = _device->newBuffer(Bytes,MTL::ResourceStorageModeShared);
+        if (Buffer == nullptr) {
+            StatusOK = false;
+            return nullptr;
+        }
+        _kernels[KernelId].Buffers.push_back({BindingIndex,Buffer});
+        return Buffer->contents();
+    }
+    void SetGrid(int KernelId,int Nx,int Ny) {
+        if (Valid(KernelId)) _kernels[KernelId].Grid = MTL::Size(Nx,Ny,1);
+    }
+    //  The threadgroup shape follows the general guidelines in the Apple documentation, just
+    //  as the programs' own GPU code does, and dispatchThreads() lets the grid be any size.
+    void Submit(int KernelId,const void* Args,bool& StatusOK) {
+        if (!StatusOK || !Valid(KernelId)) {
+            StatusOK = false;
+            return;
+        }
+        Wait(KernelId,StatusOK);
+        Kernel& TheKernel = _kernels[KernelId];
+        NS::AutoreleasePool* Pool = NS::AutoreleasePool::alloc()->init();
+        TheKernel.CommandBuffer = _commandQueue->commandBuffer()->retain();
+        MTL::ComputeCommandEncoder* Encoder =
+                                         TheKernel.Timer->NewEncoder(TheKernel.CommandBuffer);
+        Encoder->setComputePipelineState(TheKernel.Pipeline);
+        for (Binding& TheBinding : TheKernel.Buffers) {
+            Encoder->setBuffer(TheBinding.Buffer,0,TheBinding.Index);
+        }
+        if (TheKernel.ArgBytes > 0) Encoder->setBytes(Args,TheKernel.ArgBytes,0);
+        NS::UInteger GroupSize = TheKernel.Pipeline->maxTotalThreadsPerThreadgroup();
+        NS::UInteger Width = TheKernel.Pipeline->threadExecutionWidth();
+        Encoder->dispatchThreads(TheKernel.Grid,MTL::Size(GroupSize / Width,Width,1));
+        Encoder->endEncoding();
+        TheKernel.CommandBuffer->commit();
+        Pool->release();
+    }
+    void Wait(int KernelId,bool& StatusOK) {
+        if (!Valid(KernelId)) return;
+        Kernel& TheKernel = _kernels[KernelId];
+        if (TheKernel.CommandBuffer == nullptr) return;
+        TheKernel.CommandBuffer->waitUntilCompleted();
+        if (TheKernel.CommandBuffer->status() == MTL::CommandBufferStatusCompleted) {
+            TheKernel.Msec = TheKernel.Timer->DispatchMsec(TheKernel.CommandBuffer);
+            TheKernel.Timed = true;
+        } else {
+            TheKernel.Timed = false;
+            StatusOK = false;
+        }
+        TheKernel.CommandBuffer->release();
+        TheKernel.CommandBuffer = nullptr;
+    }
+    bool KernelMsec(int KernelId,float* Msec) {
+        if (!Valid(KernelId) || !_kernels[KernelId].Timed) return false;
+        *Msec = _kernels[KernelId].Msec;
+        return true;
+    }
+private:
+    bool Valid(int KernelId) { return KernelId >= 0 && KernelId < int(_kernels.size()); }
+    //  A buffer, and the index it is bound to.
+    struct Binding {
+        int Index;
+        MTL::Buffer* Buffer;
+    };
+    //  Everything for one kernel, including the command buffer of a run not yet waited for.
+    struct Kernel {
+        MTL::Function* Function = nullptr;
+        MTL::ComputePipelineState* Pipeline = nullptr;
+        DispatchTimer* Timer = nullptr;
+        std::vector<Binding> Buffers;
+        size_t ArgBytes = 0;
+        MTL::Size Grid = MTL::Size(1,1,1);
+        MTL::CommandBuffer* CommandBuffer = nullptr;
+        float Msec = 0.0;
+        bool Timed = false;
+    };
+    MTL::Device* _device;
+    MTL::Library* _library;
+    MTL::CommandQueue* _commandQueue;
+    std::vector<Kernel> _kernels;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The kernels are kept in a vector of structures holding plain pointers, so copying one
+        as the vector grows is harmless, and everything is released just once, by the
+        destructor. The DispatchTimer is held by pointer for the same reason.
+
+    o   Each run is encoded afresh. That costs the CPU a little, but it's what the programs'
+        own GPU code does without 'Indirect', and keeps the timings comparable.
+*/
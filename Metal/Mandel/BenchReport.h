@@ -0,0 +1,328 @@
+//
+//                           B e n c h  R e p o r t . h
+//
+//  This provides a simple way for the test programs - Adder, Median and Mandel, in both their
+//  Vulkan and Metal versions - to write their timings in a form other programs can read,
+//  rather than just as the "GPU took %.3f msec" lines they print, which are fine for a person
+//  but a nuisance to pick out of the output with a script.
+//
+//  A program creates a BenchReport, tells it what it is and what it's running on with
+//  SetContext(), and then, for each test it times, adds a row with AddRow(), passing the
+//  MsecStats holding the time of each pass measured by the CPU and, if it has them, the GPU
+//  kernel times for each pass. Write() then appends the rows to a file, either as CSV, with a
+//  heading line if the file is new, or, if the file name ends in ".json", as JSON with one
+//  object per line. Because rows are appended, the results of a series of runs - on different
+//  machines, or with different options - can be collected in the one file.
+//
+//  Warm-up passes are handled by the MsecStats themselves - see MsecStats::SetWarmup() - and
+//  the number used is written in each row, along with the spread of the times, their standard
+//  deviation as a percentage of their mean. Sizes() reads a list of image sizes, so a program
+//  can sweep through them in one run, and Sweep() reads ranges or lists of values for any
+//  number of parameters - sizes, thread counts, filter sizes - and lists all their combinations,
+//  so a program can run the lot without being relaunched by a script for each one.
+//
+//  A program that has counted what the CPU hardware did during a test's passes - see
+//  PerfCounters.h - can add the instructions per cycle and the cache and branch misses for
+//  each pixel to the row for it with AddCounters(). These are written as three more columns,
+//  left empty for rows without them.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __BenchReport__
+#define __BenchReport__
+
+#include "MsecTimer.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+class BenchReport
+{
+public:
+    BenchReport() {}
+    ~BenchReport() {}
+    //  Sets the program name, the API (eg "Vulkan" or "Metal") and the device and driver used.
+    void SetContext(const std::string& Program,const std::string& Api,
+                                         const std::string& Device,const std::string& Driver) {
+        _program = Program;
+        _api = Api;
+        _device = Device;
+        _driver = Driver;
+    }
+    //  Adds a row for Test, on an Nx by Ny image, with the host times for each pass and the GPU
+    //  kernel times, if there are any.
+    void AddRow(const std::string& Test,int Nx,int Ny,MsecStats& HostStats,
+                                                                  MsecStats* GpuStats = nullptr) {
+        Row NewRow;
+        NewRow.Program = _program;
+        NewRow.Api = _api;
+        NewRow.Device = _device;
+        NewRow.Driver = _driver;
+        NewRow.Test = Test;
+        NewRow.Nx = Nx;
+        NewRow.Ny = Ny;
+        NewRow.Warmup = HostStats.Warmup();
+        NewRow.Iterations = HostStats.Count();
+        NewRow.HostMin = HostStats.Min();
+        NewRow.HostMean = HostStats.Mean();
+        NewRow.HostP50 = HostStats.Percentile(50.0);
+        NewRow.HostP95 = HostStats.Percentile(95.0);
+        NewRow.HostMax = HostStats.Max();
+        NewRow.HostSpread = 100.0 * HostStats.Spread();
+        NewRow.GpuTimed = (GpuStats && GpuStats->Count() > 0);
+        NewRow.GpuMean = NewRow.GpuTimed ? GpuStats->Mean() : 0.0;
+        NewRow.GpuP50 = NewRow.GpuTimed ? GpuStats->Percentile(50.0) : 0.0;
+        NewRow.GpuSpread = NewRow.GpuTimed ? 100.0 * GpuStats->Spread() : 0.0;
+        NewRow.Counted = false;
+        NewRow.Ipc = NewRow.LlcPerPixel = NewRow.BranchPerPixel = -1.0;
+        _rows.push_back(NewRow);
+    }
+    //  Adds the instructions per cycle and the last level cache and branch misses for each
+    //  pixel to the last row added. A negative value is one that wasn't counted.
+    void AddCounters(double Ipc,double LlcPerPixel,double BranchPerPixel) {
+        if (_rows.empty()) return;
+        Row& Last = _rows.back();
+        Last.Counted = (Ipc >= 0.0 || LlcPerPixel >= 0.0 || BranchPerPixel >= 0.0);
+        Last.Ipc = Ipc;
+        Last.LlcPerPixel = LlcPerPixel;
+        Last.BranchPerPixel = BranchPerPixel;
+    }
+    int Rows(void) const { return int(_rows.size()); }
+    //  Returns the median host time of the last row added, or a negative value if there are none.
+    double LastHostP50(void) const { return _rows.empty() ? -1.0 : _rows.back().HostP50; }
+    //  Appends the rows to FileName, as JSON if it ends in ".json", and CSV otherwise.
+    bool Write(const std::string& FileName) {
+        bool Json = (FileName.size() > 5 && FileName.substr(FileName.size() - 5) == ".json");
+        FILE* File = fopen(FileName.c_str(),"a");
+        if (File == nullptr) {
+            printf ("Unable to write benchmark results to %s\n",FileName.c_str());
+            return false;
+        }
+        fseek(File,0,SEEK_END);
+        if (!Json && ftell(File) == 0) {
+            fprintf (File,"Program,Api,Device,Driver,Test,Nx,Ny,Warmup,Iterations,");
+            fprintf (File,"HostMinMsec,HostMeanMsec,HostP50Msec,HostP95Msec,HostMaxMsec,");
+            fprintf (File,"GpuMeanMsec,GpuP50Msec,HostSpreadPct,GpuSpreadPct,");
+            fprintf (File,"Ipc,LlcMissesPerPixel,BranchMissesPerPixel\n");
+        }
+        for (const Row& R : _rows) {
+            if (Json) {
+                fprintf (File,"{\"program\":%s,\"api\":%s,\"device\":%s,\"driver\":%s,",
+                            Quoted(R.Program,true).c_str(),Quoted(R.Api,true).c_str(),
+                            Quoted(R.Device,true).c_str(),Quoted(R.Driver,true).c_str());
+                fprintf (File,"\"test\":%s,\"nx\":%d,\"ny\":%d,\"warmup\":%d,\"iterations\":%d,",
+                                   Quoted(R.Test,true).c_str(),R.Nx,R.Ny,R.Warmup,R.Iterations);
+                fprintf (File,"\"host_msec\":{\"min\":%.4f,\"mean\":%.4f,\"p50\":%.4f,",
+                                                                 R.HostMin,R.HostMean,R.HostP50);
+                fprintf (File,"\"p95\":%.4f,\"max\":%.4f,\"spread_pct\":%.3f}",R.HostP95,
+                                                                          R.HostMax,R.HostSpread);
+                if (R.GpuTimed) {
+                    fprintf (File,",\"gpu_msec\":{\"mean\":%.4f,\"p50\":%.4f,\"spread_pct\":%.3f}",
+                                                             R.GpuMean,R.GpuP50,R.GpuSpread);
+                }
+                if (R.Counted) {
+                    fprintf (File,",\"counters\":{%s,%s,%s}",
+                                Counter("ipc",R.Ipc,true).c_str(),
+                                Counter("llc_misses_per_pixel",R.LlcPerPixel,true).c_str(),
+                                Counter("branch_misses_per_pixel",R.BranchPerPixel,true).c_str());
+                }
+                fprintf (File,"}\n");
+            } else {
+                fprintf (File,"%s,%s,%s,%s,%s,%d,%d,%d,%d,",Quoted(R.Program,false).c_str(),
+                   Quoted(R.Api,false).c_str(),Quoted(R.Device,false).c_str(),
+                   Quoted(R.Driver,false).c_str(),Quoted(R.Test,false).c_str(),R.Nx,R.Ny,
+                                                                          R.Warmup,R.Iterations);
+                fprintf (File,"%.4f,%.4f,%.4f,%.4f,%.4f,",R.HostMin,R.HostMean,R.HostP50,
+                                                                          R.HostP95,R.HostMax);
+                if (R.GpuTimed) fprintf (File,"%.4f,%.4f,",R.GpuMean,R.GpuP50);
+                else fprintf (File,",,");
+                fprintf (File,"%.3f,",R.HostSpread);
+                if (R.GpuTimed) fprintf (File,"%.3f,",R.GpuSpread);
+                else fprintf (File,",");
+                fprintf (File,"%s,%s,%s\n",Counter("",R.Ipc,false).c_str(),
+                   Counter("",R.LlcPerPixel,false).c_str(),
+                                                 Counter("",R.BranchPerPixel,false).c_str());
+            }
+        }
+        fclose(File);
+        printf ("Benchmark results (%d rows) appended to %s\n",int(_rows.size()),
+                                                                          FileName.c_str());
+        _rows.clear();
+        return true;
+    }
+    //  Reads a comma-separated list of sizes, each either N for N by N or NxM for N by M,
+    //  into Nx and Ny. Returns false if the list can't be read.
+    static bool Sizes(const std::string& List,std::vector<int>& Nx,std::vector<int>& Ny) {
+        Nx.clear();
+        Ny.clear();
+        const char* Ptr = List.c_str();
+        while (*Ptr) {
+            char* End;
+            long X = strtol(Ptr,&End,10);
+            if (End == Ptr || X < 2) return false;
+            long Y = X;
+            Ptr = End;
+            if (*Ptr == 'x' || *Ptr == 'X') {
+                Y = strtol(Ptr + 1,&End,10);
+                if (End == Ptr + 1 || Y < 2) return false;
+                Ptr = End;
+            }
+            Nx.push_back(int(X));
+            Ny.push_back(int(Y));
+            if (*Ptr == ',') Ptr++;
+            else if (*Ptr) return false;
+        }
+        return !Nx.empty();
+    }
+    //  One combination of parameter values from Sweep(), keyed by the lower case parameter name.
+    typedef std::map<std::string,long> Combination;
+    //  Reads a sweep such as "Nx=1024:16384:x2 Ny=512,1024 Threads=1,2,4" into Combinations, all
+    //  the combinations of the values given, the first parameter changing slowest. Parameters
+    //  are separated by spaces or ';', and each has a comma-separated list of values, each of
+    //  which can be a range, Start:End:Step, where the Step is added or, as xN, multiplies (a
+    //  missing Step adds 1). Names is a comma-separated list of the parameters allowed, in
+    //  lower case. Returns false, with Error explaining why, if the sweep can't be read.
+    static bool Sweep(const std::string& Spec,const std::string& Names,
+                              std::vector<Combination>& Combinations,std::string* Error) {
+        Combinations.assign(1,Combination());
+        std::string Text = Spec;
+        for (char& C : Text) C = (C == ';' || C == '\t') ? ' ' : char(tolower(C));
+        size_t Posn;
+        while ((Posn = Text.find(" =")) != std::string::npos) Text.erase(Posn,1);
+        while ((Posn = Text.find("= ")) != std::string::npos) Text.erase(Posn + 1,1);
+        std::string Allowed = "," + Names + ",";
+        Posn = 0;
+        while ((Posn = Text.find_first_not_of(' ',Posn)) != std::string::npos) {
+            size_t End = Text.find(' ',Posn);
+            std::string Item = Text.substr(Posn,End == std::string::npos ? End : End - Posn);
+            Posn = End;
+            size_t Equals = Item.find('=');
+            std::string Name = Item.substr(0,Equals);
+            if (Equals == std::string::npos || Name == "" ||
+                                  Allowed.find("," + Name + ",") == std::string::npos) {
+                *Error = "'" + Item + "' should be one of " + Names + ", then = and values";
+                return false;
+            }
+            if (Combinations[0].count(Name)) {
+                *Error = "'" + Name + "' is given more than once";
+                return false;
+            }
+            std::vector<long> Values;
+            if (!SweepValues(Item.substr(Equals + 1),Values)) {
+                *Error = "'" + Item + "' should have values such as 4,8 or 1024:16384:x2";
+                return false;
+            }
+            if (Combinations.size() * Values.size() > C_MaxCombinations) {
+                *Error = "there are more than " + std::to_string(C_MaxCombinations) +
+                                                                        " combinations";
+                return false;
+            }
+            std::vector<Combination> Previous;
+            Previous.swap(Combinations);
+            for (const Combination& Earlier : Previous) {
+                for (long Value : Values) {
+                    Combinations.push_back(Earlier);
+                    Combinations.back()[Name] = Value;
+                }
+            }
+        }
+        return true;
+    }
+    //  Returns the value of a parameter in a combination, or Default if it isn't swept.
+    static long Value(const Combination& Combo,const std::string& Name,long Default) {
+        Combination::const_iterator Iter = Combo.find(Name);
+        return (Iter == Combo.end()) ? Default : Iter->second;
+    }
+    //  Returns a combination as text, eg "nx=1024 threads=4", to show which one is being run.
+    static std::string Describe(const Combination& Combo) {
+        std::string Text;
+        for (const auto& Param : Combo) {
+            if (Text != "") Text += " ";
+            Text += Param.first + "=" + std::to_string(Param.second);
+        }
+        return Text;
+    }
+private:
+    //  The most values one parameter, and all the combinations, can have - more is a mistake.
+    static const size_t C_MaxValues = 1000;
+    static const size_t C_MaxCombinations = 100000;
+    //  Reads the comma-separated values and ranges for one parameter of a sweep.
+    static bool SweepValues(const std::string& List,std::vector<long>& Values) {
+        const char* Ptr = List.c_str();
+        while (*Ptr) {
+            char* End;
+            long First = strtol(Ptr,&End,10);
+            if (End == Ptr) return false;
+            Ptr = End;
+            if (*Ptr != ':') {
+                Values.push_back(First);
+            } else {
+                long Last = strtol(Ptr + 1,&End,10);
+                if (End == Ptr + 1 || Last < First) return false;
+                Ptr = End;
+                bool Multiply = false;
+                long Step = 1;
+                if (*Ptr == ':') {
+                    Ptr++;
+                    if (*Ptr == 'x') {
+                        Multiply = true;
+                        Ptr++;
+                    }
+                    Step = strtol(Ptr,&End,10);
+                    if (End == Ptr) return false;
+                    Ptr = End;
+                }
+                if (Multiply ? (Step < 2 || First < 1) : Step < 1) return false;
+                long Value = First;
+                for (;;) {
+                    if (Values.size() >= C_MaxValues) return false;
+                    Values.push_back(Value);
+                    if (Multiply ? (Value > Last / Step) : (Value > Last - Step)) break;
+                    Value = Multiply ? Value * Step : Value + Step;
+                }
+            }
+            if (Values.size() > C_MaxValues) return false;
+            if (*Ptr == ',') Ptr++;
+            else if (*Ptr) return false;
+        }
+        return !Values.empty();
+    }
+    //  The details written for each test.
+    struct Row {
+        std::string Program, Api, Device, Driver, Test;
+        int Nx, Ny, Warmup, Iterations;
+        double HostMin, HostMean, HostP50, HostP95, HostMax, HostSpread;
+        bool GpuTimed;
+        double GpuMean, GpuP50, GpuSpread;
+        bool Counted;
+        double Ipc, LlcPerPixel, BranchPerPixel;
+    };
+    //  Returns one of the counter values, formatted for JSON - as "Name":Value, with null for
+    //  a value not counted - or for CSV, where a value not counted is left empty.
+    static std::string Counter(const std::string& Name,double Value,bool Json) {
+        char Text[64] = "";
+        if (Value >= 0.0) snprintf(Text,sizeof(Text),"%.5g",Value);
+        if (!Json) return Text;
+        return "\"" + Name + "\":" + (Value >= 0.0 ? std::string(Text) : "null");
+    }
+    //  Returns Text quoted for JSON or, if it needs it, for CSV.
+    static std::string Quoted(const std::string& Text,bool Json) {
+        if (!Json && Text.find_first_of(",\"\n") == std::string::npos) return Text;
+        std::string Result = "\"";
+        for (char C : Text) {
+            if (C == '"') Result += Json ? "\\\"" : "\"\"";
+            else if (C == '\\' && Json) Result += "\\\\";
+            else if (C == '\n') Result += Json ? "\\n" : " ";
+            else Result += C;
+        }
+        return Result + "\"";
+    }
+    std::string _program, _api, _device, _driver;
+    std::vector<Row> _rows;
+};
+
+#endif
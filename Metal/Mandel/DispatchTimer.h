@@ -0,0 +1,128 @@
+//
+//                           D i s p a t c h  T i m e r . h
+//
+//  This provides a very basic way of measuring the time the GPU spends on the work in a
+//  Metal compute encoder, used by the Metal versions of the Adder, Median and Mandel programs.
+//  Timing a command buffer on the CPU, from commit() to the end of waitUntilCompleted(),
+//  includes the time Metal takes to schedule it and to tell the CPU it has finished, which
+//  for short kernels can be more than the kernel itself. This is the Metal equivalent of the
+//  Vulkan framework's EnableDispatchTiming() and GetDispatchTimes().
+//
+//  NewEncoder() is used in place of the command buffer's computeCommandEncoder() call. If the
+//  GPU can sample its timestamp counter at the boundaries of a compute encoder, the encoder is
+//  created with a pass descriptor that samples it when the encoder starts and ends, into a
+//  counter sample buffer with room for a number of 'slots', so that several command buffers
+//  can be in flight at once, each using its own slot. Once the command buffer has completed,
+//  DispatchMsec() returns the time between the two samples. GPU timestamps are in the GPU's
+//  own units, so they're converted to time using pairs of CPU and GPU timestamps taken when
+//  the DispatchTimer is created and each time DispatchMsec() is called. NewEncoder() can also
+//  be asked for a concurrent encoder, whose dispatches the GPU is free to run at once.
+//
+//  Not every GPU can sample at encoder boundaries, and if it can't, NewEncoder() just creates
+//  an ordinary encoder and DispatchMsec() falls back on the command buffer's GPUStartTime()
+//  and GPUEndTime(). These still exclude the scheduling on the CPU side, but include any gaps
+//  between the encoders in the command buffer. UsingCounters() says which is being used.
+//
+//  15th Oct 2026. First version. KS.
+//                 NewEncoder() can now create concurrent encoders. KS.
+
+#ifndef __DispatchTimer__
+#define __DispatchTimer__
+
+#include "Metal/Metal.hpp"
+
+class DispatchTimer
+{
+public:
+    //  Sets up timing for Device, for up to Slots command buffers in flight at once.
+    DispatchTimer(MTL::Device* Device,int Slots = 1) {
+        _device = Device;
+        _slots = Slots > 0 ? Slots : 1;
+        _sampleBuffer = nullptr;
+        _firstCpu = _firstGpu = _lastCpu = _lastGpu = 0;
+        if (_device->supportsCounterSampling(MTL::CounterSamplingPointAtStageBoundary)) {
+            MTL::CounterSet* Timestamps = nullptr;
+            NS::Array* CounterSets = _device->counterSets();
+            if (CounterSets) {
+                for (NS::UInteger Index = 0; Index < CounterSets->count(); Index++) {
+                    MTL::CounterSet* Set = CounterSets->object<MTL::CounterSet>(Index);
+                    if (Set->name()->isEqualToString(MTL::CommonCounterSetTimestamp)) {
+                        Timestamps = Set;
+                    }
+                }
+            }
+            if (Timestamps) {
+                MTL::CounterSampleBufferDescriptor* Desc =
+                                            MTL::CounterSampleBufferDescriptor::alloc()->init();
+                Desc->setCounterSet(Timestamps);
+                Desc->setSampleCount(_slots * 2);
+                Desc->setStorageMode(MTL::StorageModeShared);
+                _sampleBuffer = _device->newCounterSampleBuffer(Desc,nullptr);
+                Desc->release();
+            }
+        }
+        if (_sampleBuffer) _device->sampleTimestamps(&_firstCpu,&_firstGpu);
+    }
+    ~DispatchTimer() {
+        if (_sampleBuffer) _sampleBuffer->release();
+    }
+    //  Returns a new compute encoder for CommandBuffer, timed using the given Slot, whose
+    //  dispatches run one after the other unless Type is MTL::DispatchTypeConcurrent.
+    MTL::ComputeCommandEncoder* NewEncoder(MTL::CommandBuffer* CommandBuffer,int Slot = 0,
+                                         MTL::DispatchType Type = MTL::DispatchTypeSerial) {
+        if (_sampleBuffer == nullptr) return CommandBuffer->computeCommandEncoder(Type);
+        MTL::ComputePassDescriptor* Desc = MTL::ComputePassDescriptor::computePassDescriptor();
+        Desc->setDispatchType(Type);
+        MTL::ComputePassSampleBufferAttachmentDescriptor* Attachment =
+                                                      Desc->sampleBufferAttachments()->object(0);
+        Attachment->setSampleBuffer(_sampleBuffer);
+        Attachment->setStartOfEncoderSampleIndex(NS::UInteger(Slot % _slots) * 2);
+        Attachment->setEndOfEncoderSampleIndex(NS::UInteger(Slot % _slots) * 2 + 1);
+        return CommandBuffer->computeCommandEncoder(Desc);
+    }
+    //  Returns the GPU time in milliseconds taken by the encoder created by NewEncoder() for
+    //  CommandBuffer and Slot. CommandBuffer must have completed.
+    float DispatchMsec(MTL::CommandBuffer* CommandBuffer,int Slot = 0) {
+        if (_sampleBuffer) {
+            NS::Range Range(NS::UInteger(Slot % _slots) * 2,2);
+            NS::Data* Data = _sampleBuffer->resolveCounterRange(Range);
+            if (Data && Data->length() >= 2 * sizeof(MTL::CounterResultTimestamp)) {
+                const MTL::CounterResultTimestamp* Samples =
+                                        (const MTL::CounterResultTimestamp*)Data->mutableBytes();
+                uint64_t Start = Samples[0].timestamp;
+                uint64_t End = Samples[1].timestamp;
+                if (Start != C_CounterError && End != C_CounterError && End >= Start) {
+                    _device->sampleTimestamps(&_lastCpu,&_lastGpu);
+                    return float(double(End - Start) * NsecPerTick() * 1.0e-6);
+                }
+            }
+        }
+        return float((CommandBuffer->GPUEndTime() - CommandBuffer->GPUStartTime()) * 1000.0);
+    }
+    //  Returns true if the times come from timestamp counters rather than the command buffer.
+    bool UsingCounters(void) { return _sampleBuffer != nullptr; }
+private:
+    //  Returns the nanoseconds per GPU timestamp tick, from the CPU and GPU timestamps. Until
+    //  they have moved on enough to tell, it assumes the GPU's timestamps are in nanoseconds.
+    double NsecPerTick(void) {
+        if (_lastGpu > _firstGpu && _lastCpu > _firstCpu && _lastGpu - _firstGpu > 1000000) {
+            return double(_lastCpu - _firstCpu) / double(_lastGpu - _firstGpu);
+        }
+        return 1.0;
+    }
+    //  The value Metal puts in a sample it couldn't take.
+    static constexpr uint64_t C_CounterError = ~uint64_t(0);
+    //  The device being timed.
+    MTL::Device* _device;
+    //  The number of slots in the sample buffer, two samples each.
+    int _slots;
+    //  The buffer the timestamps are sampled into, or null if they can't be.
+    MTL::CounterSampleBuffer* _sampleBuffer;
+    //  The CPU and GPU timestamps taken when created, and the latest ones.
+    MTL::Timestamp _firstCpu;
+    MTL::Timestamp _firstGpu;
+    MTL::Timestamp _lastCpu;
+    MTL::Timestamp _lastGpu;
+};
+
+#endif
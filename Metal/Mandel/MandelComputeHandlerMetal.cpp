@@ -23,18 +23,130 @@
 //     18 Jun 2024. Added Initialise(), ComputeDouble() and GPUSupportsDouble(), to be consistent
 //                  with the Vulkan version. Initialise() is also a first step to support for use
 //                  of a DebugHandler. KS.
+//     14 Oct 2026. ComputeInCThreads() now uses the shared ThreadPool, rather than creating
+//                  new threads for each image. KS.
+//     15 Oct 2026. Added ComputeInCProgressive(), which computes a CPU image a pass at a time,
+//                  coarse to fine. KS.
+//                  Added MoveCentre(). If the image has only moved by a whole number of pixels
+//                  since it was last computed, it is now shifted and only the strips that have
+//                  come into view are computed, on the GPU or the CPU. KS.
+//                  Added ComputePerturbed(), ReferenceOrbitInC(), PerturbedOK() and
+//                  OffsetCentre(), for magnifications beyond the reach of double precision.
+//                  The image centre is now held as a DoubleDouble. KS.
+//                  Added ComputeFloatFloat() and FloatFloatOK(), which use float-float
+//                  arithmetic to get close to double precision. Compute() now uses the new
+//                  ComputeWith(), which both share. KS.
+//                  The CPU code and kernels now skip points in the main cardioid and the
+//                  period-2 bulb, and stop iterating orbits found to be cycling. These
+//                  interior checks can be disabled using SetInteriorChecks(). KS.
+//                  The CPU code now computes rows of points using AVX2, AVX-512 or NEON vector
+//                  instructions, where the CPU has them, selected at run time. KS.
+//                  The CPU threads now take rows a few at a time as they become free, rather
+//                  than each being given a fixed band of the image. KS.
+//                  Added SetTileQueue(), which has Compute() use a fixed number of persistent
+//                  thread groups taking tiles from a queue, using the new mandelQueue kernel.
+//                  The time the GPU takes for each image is now logged. KS.
+//                  Added ComputeHybrid(), which splits an image between the GPU and the CPU
+//                  threads, adjusting the split so both finish at about the same time. KS.
+//                  Added StartGPUImage() and FinishGPUImage(), which compute the next image
+//                  into a second image buffer while the current one is being displayed. KS.
+//                  The image buffer now holds the iteration counts as uint32_t rather than as
+//                  float, written that way by the kernels and the CPU code, so the renderer
+//                  no longer has to convert every pixel back to an integer. KS.
+//                  Added GetImageBuffer(), so a renderer using the same device can draw the
+//                  image straight from the buffer it was computed in. KS.
+//                  Added StartCPUImage() and FinishCPUImage(), which compute the next image
+//                  into the second image buffer using a background thread, so the CPU can
+//                  compute one image while the last is being coloured and displayed. KS.
+//                  The pipeline states are now kept in a binary archive on disk, using a
+//                  PipelineArchive, so later runs don't have to compile the kernels. KS.
+//                  The image and orbit buffers now come from a BufferHeap, and are recycled
+//                  when they're replaced, so changes of image size reuse the same memory. KS.
+//                  The kernel times logged are now taken from GPU timestamp counters sampled
+//                  at the start and end of each compute encoder, using a DispatchTimer. KS.
+//                  Added the 'Profile' debug level, which has the time each few rows of a CPU
+//                  image take measured using the time stamp counter, and logged. KS.
 
 #include "MandelComputeHandlerMetal.h"
 
-#include <thread>
+#include "ThreadPool.h"
+#include "PipelineArchive.h"
+#include "BufferHeap.h"
+#include "DispatchTimer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <utility>
 
 using NS::StringEncoding::UTF8StringEncoding;
 
+//  The block size used by the first pass of ComputeInCProgressive(). This must be a power of 2.
+
+static const int C_RefineStep = 8;
+
+//  The number of rows the CPU threads take at a time when computing a whole image.
+
+static const int C_CPUTileRows = 4;
+
+//  The thread group size used by the mandelQueue kernel, which is also the size of a tile, and
+//  the most thread groups that are launched to work through the queue. Smaller tiles share out
+//  the work more evenly, and the number of thread groups only has to be enough to keep all of
+//  the GPU busy.
+
+static const int C_QueueTileSize = 16;
+static const int C_QueueGroups = 512;
+
+//  ComputeHybrid() gives both the GPU and the CPU at least this many rows of the image, so the
+//  rate at which each works through them can always be measured. It sets the split using an
+//  average of those rates over the last few images, with the latest given this weight.
+
+static const int C_HybridMinRows = 8;
+static const double C_HybridWeight = 0.3;
+
+//  The default limit on the memory used by the image cache. At the default image size of
+//  1024 by 1024, this holds 64 images.
+
+static const long C_ImageCacheBytes = 256L * 1024L * 1024L;
+
+//  The file in which BuildComputeShader() keeps the compiled pipeline states.
+
+static const char* const C_PipelineArchiveFile = "MandelCompute.binarchive";
+
+//  Creates the pipeline state for the named kernel in Library, using Archive.
+
+static MTL::ComputePipelineState* NewPipeline(PipelineArchive& Archive,MTL::Library* Library,
+                                                           const char* Name,NS::Error** Error)
+{
+    MTL::Function* Function = Library->newFunction(NS::String::string(Name,UTF8StringEncoding));
+    MTL::ComputePipelineState* State = Archive.NewComputePipeline(Function,Error);
+    if (Function) Function->release();
+    return State;
+}
+
+//  The CPU code computes a row of points at a time using a 'row' routine, which may use vector
+//  instructions. SelectRowRoutine() returns the best one for this CPU - see ComputeRangeInC().
+
+typedef void (*RowRoutine)(uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                  prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks);
+
+static RowRoutine SelectRowRoutine(const char** Name = nullptr);
+
+//  How close, in pixels, a move of the image has to be to a whole number of pixels for
+//  ShiftImage() to treat it as one.
+
+static const double C_ShiftTolerance = 0.01;
+
+//  The relative precision of a DoubleDouble - 2 to the power -104 - used by PerturbedOK().
+
+static const double C_DoubleDoubleEpsilon = 4.93e-32;
+
 //  _debugOptions is the comma-separated list of all the diagnostic levels that the built-in debug
 //  handler recognises. If a call to _debug.Log() or .Logf() is added with a new level name, this
 //  new name must be added to this string.
 
-const std::string MandelComputeHandler::_debugOptions = "Setup,Timing";
+const std::string MandelComputeHandler::_debugOptions = "Setup,Timing,Profile";
 
 //  ------------------------------------------------------------------------------------------------
 
@@ -43,28 +155,66 @@ const std::string MandelComputeHandler::_debugOptions = "Setup,Timing";
 MandelComputeHandler::MandelComputeHandler(MTL::Device* Device )
     : _device( Device->retain() )
 {
+    _bufferHeap = new BufferHeap(_device);
+    _dispatchTimer = new DispatchTimer(_device,2);
     _xCent = 0.0;
     _yCent = 0.0;;
+    _xCentLo = 0.0;
+    _yCentLo = 0.0;
+    _xMoveLeft = 0.0;
+    _yMoveLeft = 0.0;
     _magnification = 1.0;
     _width = 512.0;
     _height = 512.0;
     _nx = 0;
     _ny = 0;
     _maxiter = 1024;
+    _interiorChecks = true;
+    _imageSource = IMAGE_NONE;
+    _imageStep = 0;
     _outputBuffer = nullptr;
     _imageData = nullptr;
+    _nextBuffer = nullptr;
+    _nextImageData = nullptr;
+    _nextCommandBuffer = nullptr;
+    _nextPrecision = GPU_FLOAT;
+    _nextXCentLo = 0.0;
+    _nextYCentLo = 0.0;
+    _aheadPool = nullptr;
+    _mandelPerturbFunction = nullptr;
+    _orbitBuffer = nullptr;
+    _orbitBytes = 0;
     _mandelFunction = nullptr;
+    _mandelFFFunction = nullptr;
+    _hybridGPURate = 0.0;
+    _hybridCPURate = 0.0;
+    _tileQueue = false;
+    _mandelQueueFunction = nullptr;
+    _queueBuffer = nullptr;
+    _imageCacheLimit = C_ImageCacheBytes;
+    _imageCacheHits = 0;
     _commandQueue = nullptr;
     _debug.SetSubSystem("Compute");
     _debug.LevelsList(_debugOptions);
+    _profileDebug = _debug.Level("Profile");
 }
 
 MandelComputeHandler::~MandelComputeHandler()
 {
+    DropNextImage();
+    if (_aheadPool) delete _aheadPool;
+    if (_nextBuffer) _nextBuffer->release();
     if (_commandQueue) _commandQueue->release();
     if (_device) _device->release();
     if (_mandelFunction) _mandelFunction->release();
     if (_outputBuffer) _outputBuffer->release();
+    if (_mandelPerturbFunction) _mandelPerturbFunction->release();
+    if (_mandelFFFunction) _mandelFFFunction->release();
+    if (_orbitBuffer) _orbitBuffer->release();
+    if (_mandelQueueFunction) _mandelQueueFunction->release();
+    if (_queueBuffer) _queueBuffer->release();
+    delete _bufferHeap;
+    delete _dispatchTimer;
     _commandQueue = nullptr;
     _device = nullptr;;
     _mandelFunction = nullptr;;
@@ -89,6 +239,9 @@ void MandelComputeHandler::Initialise(bool /*Validate*/,const std::string& Debug
     _commandQueue = _device->newCommandQueue();
     _debug.Logf("Setup","GPU command queue created at %.3f msec",SetupTimer.ElapsedMsec());
     BuildComputeShader();
+    const char* RowName = "";
+    SelectRowRoutine(&RowName);
+    _debug.Logf("Setup","CPU code will use %s instructions.",RowName);
 }
 
 bool MandelComputeHandler::GPUSupportsDouble()
@@ -111,8 +264,13 @@ void MandelComputeHandler::BuildComputeShader()
         }
     } else {
         _debug.Logf("Setup","GPU library created at %.3f msec",SetupTimer.ElapsedMsec());
-        _mandelFunction = _device->newComputePipelineState(
-                   library->newFunction(NS::String::string("mandel",UTF8StringEncoding)),&pError);
+        
+        //  The pipeline states come from the binary archive if they were saved there by an
+        //  earlier run, which saves compiling the kernels for the GPU.
+        
+        PipelineArchive archive(_device,C_PipelineArchiveFile);
+        float pipelineStart = SetupTimer.ElapsedMsec();
+        _mandelFunction = NewPipeline(archive,library,"mandel",&pError);
         if (_mandelFunction == nullptr || pError != nullptr) {
             printf ("Unable to find 'mandel' function in library\n");
             if (pError) {
@@ -122,6 +280,60 @@ void MandelComputeHandler::BuildComputeShader()
             _debug.Logf("Setup","GPU mandel function created at %.3f msec",
                         SetupTimer.ElapsedMsec());
         }
+        
+        //  The perturbation kernel is only needed at very high magnifications, so the program
+        //  can carry on without it, just as it would with a GPU that lacked it.
+        
+        _mandelPerturbFunction = NewPipeline(archive,library,"mandelPerturbed",&pError);
+        if (_mandelPerturbFunction == nullptr || pError != nullptr) {
+            printf ("Unable to find 'mandelPerturbed' function in library\n");
+            if (pError) {
+                printf ("Reason: %s\n",pError->localizedDescription()->cString(UTF8StringEncoding));
+            }
+        } else {
+            _debug.Logf("Setup","GPU mandelPerturbed function created at %.3f msec",
+                        SetupTimer.ElapsedMsec());
+        }
+        
+        //  The same goes for the float-float kernel.
+        
+        pError = nullptr;
+        _mandelFFFunction = NewPipeline(archive,library,"mandelFF",&pError);
+        if (_mandelFFFunction == nullptr || pError != nullptr) {
+            printf ("Unable to find 'mandelFF' function in library\n");
+            if (pError) {
+                printf ("Reason: %s\n",pError->localizedDescription()->cString(UTF8StringEncoding));
+            }
+        } else {
+            _debug.Logf("Setup","GPU mandelFF function created at %.3f msec",
+                        SetupTimer.ElapsedMsec());
+        }
+        
+        //  And for the tile queue kernel, which also needs the counter used as the queue. It
+        //  can only be used if its thread groups can be as large as a tile.
+        
+        pError = nullptr;
+        _mandelQueueFunction = NewPipeline(archive,library,"mandelQueue",&pError);
+        NS::UInteger tileThreads = C_QueueTileSize * C_QueueTileSize;
+        if (_mandelQueueFunction == nullptr || pError != nullptr) {
+            printf ("Unable to find 'mandelQueue' function in library\n");
+            if (pError) {
+                printf ("Reason: %s\n",pError->localizedDescription()->cString(UTF8StringEncoding));
+            }
+        } else if (_mandelQueueFunction->maxTotalThreadsPerThreadgroup() < tileThreads) {
+            _debug.Log("Setup","GPU mandelQueue thread groups too small for a tile, not used.");
+            _mandelQueueFunction->release();
+            _mandelQueueFunction = nullptr;
+        } else {
+            _queueBuffer = _device->newBuffer(sizeof(uint32_t),MTL::StorageModeShared);
+            _debug.Logf("Setup","GPU mandelQueue function created at %.3f msec",
+                        SetupTimer.ElapsedMsec());
+        }
+        _debug.Logf("Setup","GPU pipelines took %.3f msec, %d from archive, %d compiled.",
+               SetupTimer.ElapsedMsec() - pipelineStart,archive.Hits(),archive.Misses());
+        if (!archive.Save()) {
+            _debug.Logf("Setup","Unable to save pipelines to '%s'.",C_PipelineArchiveFile);
+        }
     }
 
     if (library) library->release();
@@ -135,15 +347,16 @@ void MandelComputeHandler::SetImageSize(int Nx,int Ny)
     if (_nx != Nx || _ny != Ny) {
         
         _debug.Logf("Setup","Rebuilding image buffer to %d by %d.",Nx,Ny);
+        _imageSource = IMAGE_NONE;
         MsecTimer theTimer;
 
-        //  Release any existing buffer. (I believe this is what's required - indeed, it may
-        //  be that either of these calls will the do the job.)
+        //  Release any existing buffers. They come from the buffer heap, which lets the new
+        //  ones reuse their memory even if the renderer still has a frame in flight that
+        //  reads the old image.
         
-        if (_outputBuffer) {
-            _outputBuffer->setPurgeableState(MTL::PurgeableStateEmpty);
-            _outputBuffer->release();
-        }
+        DropNextImage();
+        _bufferHeap->Recycle(_outputBuffer);
+        _bufferHeap->Recycle(_nextBuffer);
         
         //  We create a Metal buffer for the computed images. This will be used by the GPU
         //  pipeline code (see the code for Compute()) and is made shared so that it can
@@ -154,12 +367,18 @@ void MandelComputeHandler::SetImageSize(int Nx,int Ny)
         //  CPU create an image at the address given by _imageData. (See programming notes
         //  for a little more discussion of buffer allocation.)
         
-        int length = Nx * Ny * sizeof(float);
+        int length = Nx * Ny * sizeof(uint32_t);
         unsigned int alignment = sysconf(_SC_PAGE_SIZE);
         int allocationSize = (length + alignment - 1) & (~(alignment - 1));
         uint bufferOptions = MTL::StorageModeShared;
-        _outputBuffer = _device->newBuffer(allocationSize,bufferOptions);
-        _imageData = (float*)_outputBuffer->contents();
+        _outputBuffer = _bufferHeap->NewBuffer(allocationSize,bufferOptions);
+        _imageData = (uint32_t*)_outputBuffer->contents();
+        
+        //  StartGPUImage() computes the next image into a second buffer just like it, while
+        //  the first is being displayed. It swaps them over when the image is complete.
+        
+        _nextBuffer = _bufferHeap->NewBuffer(allocationSize,bufferOptions);
+        _nextImageData = (uint32_t*)_nextBuffer->contents();
         _debug.Logf("Timing","Resized image buffer at %.2f msec",theTimer.ElapsedMsec());
 
         //  Tweaking the arrangement of GPU threads and thread groups can be tricky, but this
@@ -171,6 +390,29 @@ void MandelComputeHandler::SetImageSize(int Nx,int Ny)
         if (threadGroupSize > (Nx * Ny)) threadGroupSize = Nx * Ny;
         _gridSize = MTL::Size(Nx,Ny,1);
         _threadGroupDims = MTL::Size(threadGroupSize / threadWidth,threadWidth,1);
+        _threadGroupDimsFF = _threadGroupDims;
+        if (_mandelFFFunction) {
+            threadGroupSize = _mandelFFFunction->maxTotalThreadsPerThreadgroup();
+            threadWidth = _mandelFFFunction->threadExecutionWidth();
+            if (threadGroupSize > (Nx * Ny)) threadGroupSize = Nx * Ny;
+            _threadGroupDimsFF = MTL::Size(threadGroupSize / threadWidth,threadWidth,1);
+        }
+        _threadGroupDimsP = _threadGroupDims;
+        if (_mandelPerturbFunction) {
+            threadGroupSize = _mandelPerturbFunction->maxTotalThreadsPerThreadgroup();
+            threadWidth = _mandelPerturbFunction->threadExecutionWidth();
+            if (threadGroupSize > (Nx * Ny)) threadGroupSize = Nx * Ny;
+            _threadGroupDimsP = MTL::Size(threadGroupSize / threadWidth,threadWidth,1);
+        }
+
+        //  The rates ComputeHybrid() has measured were for rows of the old length.
+        
+        _hybridGPURate = 0.0;
+        _hybridCPURate = 0.0;
+        
+        //  And the cached images are all the wrong size.
+        
+        _imageCache.clear();
 
         _nx = Nx;
         _ny = Ny;
@@ -182,6 +424,10 @@ void MandelComputeHandler::SetCentre(double XCent,double YCent)
 {
     _xCent = XCent;
     _yCent = YCent;
+    _xCentLo = 0.0;
+    _yCentLo = 0.0;
+    _xMoveLeft = 0.0;
+    _yMoveLeft = 0.0;
 }
 
 void MandelComputeHandler::SetMagnification(double Magnification)
@@ -203,6 +449,76 @@ void MandelComputeHandler::SetMaxIter(int MaxIter)
     RecomputeArgs();
 }
 
+//  SetInteriorChecks() enables or disables the checks that save iterating the points inside
+//  the set - see PointInC() and the GPU code. They are enabled by default, and don't change
+//  the image, so this is only of interest when benchmarking. The next image is computed in
+//  full, rather than reusing the current one, so the difference shows.
+
+void MandelComputeHandler::SetInteriorChecks(bool Enable)
+{
+    if (Enable != _interiorChecks) {
+        _imageSource = IMAGE_NONE;
+        _imageCache.clear();
+    }
+    _interiorChecks = Enable;
+    RecomputeArgs();
+}
+
+bool MandelComputeHandler::GetInteriorChecks(void)
+{
+    return _interiorChecks;
+}
+
+//  SetTileQueue() selects how Compute() has the GPU work through the image. Normally, it
+//  launches a thread for each pixel, and leaves it to the GPU to schedule the thread groups.
+//  Points inside the set take far longer than those outside, so some thread groups take much
+//  longer than others. With the tile queue, a fixed number of thread groups each keep taking
+//  the next tile from a counter until the image is done - see mandelQueue in mandel.metal.
+//  The image is the same either way, so this is only of interest when benchmarking, and as
+//  with SetInteriorChecks() the next image is computed in full.
+
+void MandelComputeHandler::SetTileQueue(bool Enable)
+{
+    if (Enable != _tileQueue) {
+        _imageSource = IMAGE_NONE;
+        _imageCache.clear();
+    }
+    _tileQueue = Enable;
+}
+
+bool MandelComputeHandler::GetTileQueue(void)
+{
+    return _tileQueue;
+}
+
+//  SetImageCacheLimit() sets the most memory, in bytes, the image cache can use. Complete
+//  images are kept in the cache, and if the parameters for a new image match one of them, and
+//  it would be computed the same way, the cached image is used rather than computing it again.
+//  This saves recomputing the images when the view goes back to one already seen - when
+//  zooming back out along the same path, or going back to a remembered position. When the
+//  cache is full, the image least recently used is dropped. A limit of zero disables the cache.
+
+void MandelComputeHandler::SetImageCacheLimit(long Bytes)
+{
+    _imageCacheLimit = Bytes;
+    long bytes = long(_nx) * long(_ny) * long(sizeof(uint32_t));
+    while (!_imageCache.empty() && long(_imageCache.size()) * bytes > _imageCacheLimit) {
+        _imageCache.pop_back();
+    }
+}
+
+long MandelComputeHandler::GetImageCacheLimit(void)
+{
+    return _imageCacheLimit;
+}
+
+//  GetImageCacheHits() returns the number of images that have been taken from the cache.
+
+long MandelComputeHandler::GetImageCacheHits(void)
+{
+    return _imageCacheHits;
+}
+
 double MandelComputeHandler::GetMagnification(void)
 {
     return _magnification;
@@ -214,11 +530,21 @@ void MandelComputeHandler::GetCentre(double* Xcent,double* Ycent)
     *Ycent = _yCent;
 }
 
-float* MandelComputeHandler::GetImageData()
+uint32_t* MandelComputeHandler::GetImageData()
 {
     return _imageData;
 }
 
+//  GetImageBuffer() returns the Metal buffer holding the current image - the one whose contents
+//  GetImageData() returns - so a renderer using the same device can read the image on the GPU
+//  without copying it. It is only valid until the next image is computed, and may then be
+//  replaced by a different buffer.
+
+MTL::Buffer* MandelComputeHandler::GetImageBuffer()
+{
+    return _outputBuffer;
+}
+
 //  GetDebugOptions() returns the comma-separated list of the various diagnostic levels supported
 //  by the compute handler. Note that this is a static routine; it can be convenient for a program
 //  to have this list available before the compuet handler is constructed, and it is in any case a
@@ -229,6 +555,28 @@ std::string MandelComputeHandler::GetDebugOptions(void)
     return _debugOptions;
 }
 
+//  CPUProfile() returns the profile the times taken by the CPU tiles are to be recorded in, or
+//  null if the 'Profile' debug level isn't active. The tiles are timed using the time stamp
+//  counter, which costs little enough that timing every few rows doesn't change the figures.
+//  ReportCPUProfile() logs the times recorded, at the 'Profile' level, and clears them. (An
+//  image computed ahead by StartCPUImage() isn't profiled, as it runs alongside other work.)
+
+CycleProfile* MandelComputeHandler::CPUProfile()
+{
+    if (!_debug.Active(_profileDebug)) return nullptr;
+    CycleTimer::Calibrate();
+    return &_cpuProfile;
+}
+
+void MandelComputeHandler::ReportCPUProfile()
+{
+    if (_cpuProfile.Calls() == 0) return;
+    _debug.Logf(_profileDebug,"CPU tiles: %d of up to %d rows, %.1f usec a row, longest %.1f usec",
+                  int(_cpuProfile.Calls()),C_CPUTileRows,_cpuProfile.NsecPerItem() * 0.001,
+                                                                    _cpuProfile.LongestUsec());
+    _cpuProfile.Clear();
+}
+
 void MandelComputeHandler::RecomputeArgs()
 {
     //  This may seem to be an odd place to take this into account, but it was actually easiest
@@ -249,12 +597,61 @@ void MandelComputeHandler::RecomputeArgs()
     double yRange = aspect * xRange * double(_ny) / double(_nx);
     _dx = xRange/double(_nx);
     _dy = yRange/double(_ny);
-    _currentArgs = {float(_xCent),float(_yCent),float(_dx),float(_dy),_maxiter};
+    
+    //  The float-float kernel also needs the parts of the centre and scale values lost when
+    //  they're rounded to float. (This includes the low part of the DoubleDouble centre, which
+    //  is well below what a float-float can hold, but costs nothing.)
+    
+    float xCentLo = float((_xCent - double(float(_xCent))) + _xCentLo);
+    float yCentLo = float((_yCent - double(float(_yCent))) + _yCentLo);
+    float dXLo = float(_dx - double(float(_dx)));
+    float dYLo = float(_dy - double(float(_dy)));
+    _currentArgs = {float(_xCent),float(_yCent),float(_dx),float(_dy),_maxiter,_nx,_ny,0,0,
+                                       xCentLo,yCentLo,dXLo,dYLo,_interiorChecks ? 1 : 0};
 }
 
 void MandelComputeHandler::Compute ()
+{
+    ComputeWith(_mandelFunction,IMAGE_GPU);
+}
+
+//  ComputeFloatFloat() is the same as Compute(), but uses the float-float kernel, which gets
+//  close to double precision using only float operations. Without that kernel, the best that
+//  can be done is the normal GPU code.
+
+void MandelComputeHandler::ComputeFloatFloat ()
+{
+    if (_mandelFFFunction == nullptr) {
+        Compute();
+    } else {
+        ComputeWith(_mandelFFFunction,IMAGE_GPU_FF);
+    }
+}
+
+//  ComputeWith() does the work for Compute() and ComputeFloatFloat(), using the given kernel,
+//  which takes the MandelArgs structure, and noting the image as computed by the given source.
+
+void MandelComputeHandler::ComputeWith (MTL::ComputePipelineState* Function,ImageSource Source)
 {
     RecomputeArgs();
+    if (ImageFromCache(Source)) return;
+    MTL::Size threadGroupDims = _threadGroupDims;
+    if (Function == _mandelFFFunction) threadGroupDims = _threadGroupDimsFF;
+    
+    //  If this is the last GPU image moved by a whole number of pixels, only the strips that
+    //  have come into view need computing. The buffer is shared, so ShiftImage() can move the
+    //  rest of the image directly.
+    
+    std::vector<Strip> strips;
+    bool shifted = ShiftImage(Source,strips);
+    if (shifted && strips.empty()) return;
+    
+    //  The tile queue is only used for whole images with the normal kernel. The strips of a
+    //  shifted image are small enough not to be worth it.
+    
+    bool useQueue = _tileQueue && _mandelQueueFunction && Function == _mandelFunction &&
+                                                                                   !shifted;
+    if (useQueue) Function = _mandelQueueFunction;
     
     //  This sets up the command buffer that controls for the GPU calculation.
         
@@ -268,28 +665,320 @@ void MandelComputeHandler::Compute ()
 
     //MsecTimer TheTimer;
     MTL::CommandBuffer* commandBuffer = _commandQueue->commandBuffer();
-    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder();
-    encoder->setComputePipelineState(_mandelFunction);
+    MTL::ComputeCommandEncoder* encoder = _dispatchTimer->NewEncoder(commandBuffer);
+    encoder->setComputePipelineState(Function);
 
     //  Set the two data buffers, the actual 2D array to be written into by the compute
     //  kernel, and the structure giving the parameters for the calculation.
 
     encoder->setBuffer(_outputBuffer,0,1);
-    encoder->setBytes(&_currentArgs,sizeof(MandelArgs),2);
+    if (shifted) {
+    
+        //  Each strip is a separate grid, with its own origin in the image.
+        
+        for (const Strip& Area : strips) {
+            MandelArgs stripArgs = _currentArgs;
+            stripArgs.ixOrigin = Area.Ixst;
+            stripArgs.iyOrigin = Area.Iyst;
+            encoder->setBytes(&stripArgs,sizeof(MandelArgs),2);
+            encoder->dispatchThreads(MTL::Size(Area.Ixen - Area.Ixst,Area.Iyen - Area.Iyst,1),
+                                                                              threadGroupDims);
+        }
+    } else if (useQueue) {
+    
+        //  Only as many thread groups as there are tiles are needed, up to C_QueueGroups, and
+        //  the counter they use to take the tiles has to start at zero.
+        
+        *(uint32_t*)_queueBuffer->contents() = 0;
+        int tiles = ((_nx + C_QueueTileSize - 1) / C_QueueTileSize) *
+                                                  ((_ny + C_QueueTileSize - 1) / C_QueueTileSize);
+        encoder->setBytes(&_currentArgs,sizeof(MandelArgs),2);
+        encoder->setBuffer(_queueBuffer,0,3);
+        encoder->dispatchThreadgroups(MTL::Size(std::min(tiles,C_QueueGroups),1,1),
+                                           MTL::Size(C_QueueTileSize,C_QueueTileSize,1));
+    } else {
+        encoder->setBytes(&_currentArgs,sizeof(MandelArgs),2);
+        encoder->dispatchThreads(_gridSize,threadGroupDims);
+    }
 
     // Submit the command buffer for execution and wait for it to complete.
 
-    encoder->dispatchThreads(_gridSize,_threadGroupDims);
     encoder->endEncoding();
     //printf ("Command buffer encoding took %f msec\n",TheTimer.ElapsedMsec());
     //TheTimer.Restart();
     commandBuffer->commit();
     commandBuffer->waitUntilCompleted();
     //printf ("Command buffer commit and execution took %f msec\n",TheTimer.ElapsedMsec());
+    _debug.Logf("Timing","GPU %skernel took %.3f msec",useQueue ? "tile queue " : "",
+                                                     _dispatchTimer->DispatchMsec(commandBuffer));
 
     //  Tidy up
     
     pipeAutoreleasePool->release();
+    NoteImage(Source,0);
+}
+
+//  StartGPUImage() has the GPU start computing the image for the current parameters, in the
+//  given precision, but doesn't wait for it to finish. This lets a program that knows what the
+//  next image will be - one zooming in, for example - have the GPU compute it while the current
+//  image is being displayed. The new image goes into a second buffer, so GetImageData() still
+//  returns the current one until FinishGPUImage() is called. It returns false if the GPU can't
+//  compute the image in that precision - Metal GPUs don't have double precision - or if it
+//  doesn't need to because the image is in the cache. (This always uses the normal dispatch,
+//  even if the tile queue is enabled.) With GPU_PERTURBED, the reference orbit is computed by
+//  the CPU before the GPU is started.
+
+bool MandelComputeHandler::StartGPUImage (GPUPrecision Precision)
+{
+    DropNextImage();
+    if (_nextBuffer == nullptr || _commandQueue == nullptr) return false;
+    MTL::ComputePipelineState* function = _mandelFunction;
+    MTL::Size threadGroupDims = _threadGroupDims;
+    if (Precision == GPU_DOUBLE) {
+        return false;
+    } else if (Precision == GPU_FLOAT_FLOAT) {
+        if (_mandelFFFunction == nullptr) return false;
+        function = _mandelFFFunction;
+        threadGroupDims = _threadGroupDimsFF;
+    } else if (Precision == GPU_PERTURBED) {
+        if (_mandelPerturbFunction == nullptr) return false;
+        function = _mandelPerturbFunction;
+        threadGroupDims = _threadGroupDimsP;
+    }
+    RecomputeArgs();
+    if (FindCachedImage(GPUSource(Precision)) != _imageCache.end()) return false;
+    
+    //  The arguments only hold the low parts of the centre rounded to float, so those are
+    //  kept as well, for FinishGPUImage() to check.
+    
+    _nextArgs = _currentArgs;
+    _nextXCentLo = _xCentLo;
+    _nextYCentLo = _yCentLo;
+    _nextPrecision = Precision;
+    int refLen = 0;
+    if (Precision == GPU_PERTURBED) refLen = PrepareOrbit();
+    
+    //  The command buffer belongs to the autorelease pool, so it has to be retained until
+    //  FinishGPUImage() or DropNextImage() is done with it.
+    
+    NS::AutoreleasePool* pipeAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    _nextCommandBuffer = _commandQueue->commandBuffer()->retain();
+    MTL::ComputeCommandEncoder* encoder = _dispatchTimer->NewEncoder(_nextCommandBuffer,1);
+    encoder->setComputePipelineState(function);
+    encoder->setBuffer(_nextBuffer,0,1);
+    if (Precision == GPU_PERTURBED) {
+        PerturbArgs args = {float(_dx),float(_dy),_maxiter,_nx,_ny,refLen};
+        encoder->setBytes(&args,sizeof(PerturbArgs),2);
+        encoder->setBuffer(_orbitBuffer,0,3);
+    } else {
+        encoder->setBytes(&_nextArgs,sizeof(MandelArgs),2);
+    }
+    encoder->dispatchThreads(_gridSize,threadGroupDims);
+    encoder->endEncoding();
+    _nextCommandBuffer->commit();
+    pipeAutoreleasePool->release();
+    return true;
+}
+
+//  FinishGPUImage() is called when the next image is needed. If StartGPUImage() was called
+//  with the same precision, and the image parameters haven't changed since, it waits for the
+//  GPU to finish that image, makes it the current image, and returns true. Otherwise, it
+//  returns false, and the image has to be computed in the usual way.
+
+bool MandelComputeHandler::FinishGPUImage (GPUPrecision Precision)
+{
+    if (_nextCommandBuffer == nullptr) return false;
+    RecomputeArgs();
+    bool same = (Precision == _nextPrecision && _nextXCentLo == _xCentLo &&
+                                                               _nextYCentLo == _yCentLo &&
+                              memcmp(&_nextArgs,&_currentArgs,sizeof(MandelArgs)) == 0);
+    MsecTimer waitTimer;
+    DropNextImage();
+    if (!same) return false;
+    _debug.Logf("Timing","Waited %.3f msec for GPU image started ahead",waitTimer.ElapsedMsec());
+    SwapNextImage();
+    NoteImage(GPUSource(Precision),0);
+    return true;
+}
+
+//  GPUSource() returns the image source for an image computed by the GPU in the given precision.
+
+MandelComputeHandler::ImageSource MandelComputeHandler::GPUSource (GPUPrecision Precision)
+{
+    if (Precision == GPU_DOUBLE) return IMAGE_GPU_D;
+    if (Precision == GPU_FLOAT_FLOAT) return IMAGE_GPU_FF;
+    if (Precision == GPU_PERTURBED) return IMAGE_GPU_P;
+    return IMAGE_GPU;
+}
+
+
+//  StartCPUImage() is the CPU equivalent of StartGPUImage(). It starts a background thread
+//  computing the image for the current parameters into the second buffer, just as ComputeInC()
+//  would, and returns without waiting for it. The thread uses a thread pool of its own, with one
+//  thread fewer than the hardware supports, so the calling thread - and the shared pool, which
+//  the renderer uses to colour the image - can get on with displaying the current image in the
+//  meantime. It returns false if the image doesn't need computing because it's in the cache.
+
+bool MandelComputeHandler::StartCPUImage ()
+{
+    DropNextImage();
+    if (_nx == 0 || _ny == 0 || _nextImageData == nullptr) return false;
+    RecomputeArgs();
+    if (FindCachedImage(IMAGE_CPU) != _imageCache.end()) return false;
+    _nextArgs = _currentArgs;
+    _nextXCentLo = _xCentLo;
+    _nextYCentLo = _yCentLo;
+    if (_aheadPool == nullptr) {
+        _aheadPool = new ThreadPool(std::max(ThreadPool::MaxThreads() - 1,1));
+    }
+    _nextThread = std::thread(ComputeInCThreads,_nextImageData,_nx,_ny,0,_ny,_xCent,_yCent,
+                                         _dx,_dy,_maxiter,_interiorChecks,_aheadPool,nullptr);
+    return true;
+}
+
+//  FinishCPUImage() is the CPU equivalent of FinishGPUImage(). If StartCPUImage() was called,
+//  and the image parameters haven't changed since, it waits for the image to be finished, makes
+//  it the current image, and returns true. Otherwise, it returns false, and the image has to
+//  be computed in the usual way.
+
+bool MandelComputeHandler::FinishCPUImage ()
+{
+    if (!_nextThread.joinable()) return false;
+    RecomputeArgs();
+    bool same = (_nextXCentLo == _xCentLo && _nextYCentLo == _yCentLo &&
+                              memcmp(&_nextArgs,&_currentArgs,sizeof(MandelArgs)) == 0);
+    MsecTimer waitTimer;
+    DropNextImage();
+    if (!same) return false;
+    _debug.Logf("Timing","Waited %.3f msec for CPU image started ahead",waitTimer.ElapsedMsec());
+    SwapNextImage();
+    NoteImage(IMAGE_CPU,0);
+    return true;
+}
+
+//  DropNextImage() waits for any image started by StartGPUImage() or StartCPUImage() to finish,
+//  and forgets it.
+
+void MandelComputeHandler::DropNextImage ()
+{
+    if (_nextCommandBuffer) {
+        _nextCommandBuffer->waitUntilCompleted();
+        _debug.Logf("Timing","GPU kernel for image started ahead took %.3f msec",
+                                                _dispatchTimer->DispatchMsec(_nextCommandBuffer,1));
+        _nextCommandBuffer->release();
+        _nextCommandBuffer = nullptr;
+    }
+    if (_nextThread.joinable()) _nextThread.join();
+}
+
+//  SwapNextImage() makes the image in the second buffer the current one.
+
+void MandelComputeHandler::SwapNextImage ()
+{
+    std::swap(_outputBuffer,_nextBuffer);
+    std::swap(_imageData,_nextImageData);
+}
+
+//  ComputeHybrid() computes the image using both the GPU and the CPU at the same time. The GPU
+//  computes the rows above a split point, using the float-float kernel, while the CPU threads
+//  compute the rest. Where the split falls is set from the number of rows a msec each managed
+//  for the last few images, so that both should finish at about the same time. This is for the
+//  magnifications where single precision isn't enough, where the GPU is much slower than
+//  usual, and the CPU can make a real difference.
+
+void MandelComputeHandler::ComputeHybrid ()
+{
+    MTL::ComputePipelineState* function = _mandelFFFunction;
+    MTL::Size threadGroupDims = _threadGroupDimsFF;
+    if (function == nullptr) {
+        function = _mandelFunction;
+        threadGroupDims = _threadGroupDims;
+    }
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_HYBRID)) return;
+    
+    //  The strips of a shifted image are small, and are left to the GPU.
+    
+    std::vector<Strip> strips;
+    bool shifted = ShiftImage(IMAGE_HYBRID,strips);
+    if (shifted && strips.empty()) return;
+    
+    NS::AutoreleasePool* pipeAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    MTL::CommandBuffer* commandBuffer = _commandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* encoder = _dispatchTimer->NewEncoder(commandBuffer);
+    encoder->setComputePipelineState(function);
+    encoder->setBuffer(_outputBuffer,0,1);
+    int split = 0;
+    if (shifted) {
+        for (const Strip& Area : strips) {
+            MandelArgs stripArgs = _currentArgs;
+            stripArgs.ixOrigin = Area.Ixst;
+            stripArgs.iyOrigin = Area.Iyst;
+            encoder->setBytes(&stripArgs,sizeof(MandelArgs),2);
+            encoder->dispatchThreads(MTL::Size(Area.Ixen - Area.Ixst,Area.Iyen - Area.Iyst,1),
+                                                                              threadGroupDims);
+        }
+    } else {
+        split = HybridSplit();
+        encoder->setBytes(&_currentArgs,sizeof(MandelArgs),2);
+        if (split > 0) encoder->dispatchThreads(MTL::Size(_nx,split,1),threadGroupDims);
+    }
+    encoder->endEncoding();
+    
+    //  Start the GPU on its rows, and don't wait for it before having the CPU start on the
+    //  rest. The GPU's time is taken from its own timestamps, as the time until the wait for
+    //  it returns includes any time spent waiting for the CPU.
+    
+    commandBuffer->commit();
+    if (!shifted) {
+        MsecTimer cpuTimer;
+        ComputeInCThreads (_imageData,_nx,_ny,split,_ny,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                           _interiorChecks,nullptr,CPUProfile());
+        float cpuMsec = cpuTimer.ElapsedMsec();
+        ReportCPUProfile();
+        commandBuffer->waitUntilCompleted();
+        float gpuMsec = _dispatchTimer->DispatchMsec(commandBuffer);
+        _debug.Logf("Timing","Hybrid image: GPU %d rows in %.3f msec, CPU %d rows in %.3f msec",
+                                                          split,gpuMsec,_ny - split,cpuMsec);
+        NoteHybridRates(split,gpuMsec,cpuMsec);
+    } else {
+        commandBuffer->waitUntilCompleted();
+    }
+    pipeAutoreleasePool->release();
+    NoteImage(IMAGE_HYBRID,0);
+}
+
+//  HybridSplit() returns the number of rows, starting from the top of the image, that
+//  ComputeHybrid() should give to the GPU, sharing out the rows in proportion to the rates
+//  at which the GPU and CPU have been computing them. Until both rates are known, it splits
+//  the image evenly.
+
+int MandelComputeHandler::HybridSplit ()
+{
+    double gpuShare = 0.5;
+    if (_hybridGPURate > 0.0 && _hybridCPURate > 0.0) {
+        gpuShare = _hybridGPURate / (_hybridGPURate + _hybridCPURate);
+    }
+    int minRows = std::min(C_HybridMinRows,_ny / 2);
+    int split = int(gpuShare * double(_ny) + 0.5);
+    return std::max(minRows,std::min(_ny - minRows,split));
+}
+
+//  NoteHybridRates() updates the average rates, in rows a msec, at which the GPU and the CPU
+//  have been computing their rows, given the split and times for the latest image.
+
+void MandelComputeHandler::NoteHybridRates (int Split,float GPUMsec,float CPUMsec)
+{
+    if (Split > 0 && GPUMsec > 0.0) {
+        double rate = double(Split) / double(GPUMsec);
+        if (_hybridGPURate <= 0.0) _hybridGPURate = rate;
+        else _hybridGPURate += C_HybridWeight * (rate - _hybridGPURate);
+    }
+    if (Split < _ny && CPUMsec > 0.0) {
+        double rate = double(_ny - Split) / double(CPUMsec);
+        if (_hybridCPURate <= 0.0) _hybridCPURate = rate;
+        else _hybridCPURate += C_HybridWeight * (rate - _hybridCPURate);
+    }
 }
 
 void MandelComputeHandler::ComputeDouble ()
@@ -298,72 +987,802 @@ void MandelComputeHandler::ComputeDouble ()
     //  never call it (since GPUSupportsDouble() always returns false for Metal GPUs.)
 }
 
+//  ComputePerturbed() computes the image using perturbation - see the notes at the start of
+//  the header and in mandel.metal. The reference orbit, for the centre of the image, is
+//  computed by the CPU and written into the orbit buffer, which is enlarged if the iteration
+//  limit has grown. The GPU then computes the differences from that orbit for each pixel, in
+//  single precision.
+
+void MandelComputeHandler::ComputePerturbed ()
+{
+    //  Without the perturbation kernel, the best that can be done is the normal GPU code.
+    
+    if (_mandelPerturbFunction == nullptr) {
+        Compute();
+        return;
+    }
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_GPU_P)) return;
+    
+    //  An image started by StartGPUImage() may still be using the orbit buffer.
+    
+    DropNextImage();
+    int refLen = PrepareOrbit();
+    PerturbArgs args = {float(_dx),float(_dy),_maxiter,_nx,_ny,refLen};
+    
+    //  This follows Compute(), but with the orbit as an additional buffer. The thread group
+    //  shape is the one worked out for this kernel, which may not allow as many threads as the
+    //  other.
+    
+    NS::AutoreleasePool* pipeAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    MTL::CommandBuffer* commandBuffer = _commandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* encoder = _dispatchTimer->NewEncoder(commandBuffer);
+    encoder->setComputePipelineState(_mandelPerturbFunction);
+    encoder->setBuffer(_outputBuffer,0,1);
+    encoder->setBytes(&args,sizeof(PerturbArgs),2);
+    encoder->setBuffer(_orbitBuffer,0,3);
+    encoder->dispatchThreads(_gridSize,_threadGroupDimsP);
+    encoder->endEncoding();
+    commandBuffer->commit();
+    commandBuffer->waitUntilCompleted();
+    _debug.Logf("Timing","GPU perturbation kernel took %.3f msec",
+                                                     _dispatchTimer->DispatchMsec(commandBuffer));
+    pipeAutoreleasePool->release();
+    NoteImage(IMAGE_GPU_P,0);
+}
+
+//  PrepareOrbit() computes the reference orbit for the centre of the image, and writes it into
+//  the orbit buffer, replacing that first with a larger one if the iteration limit has grown.
+//  It returns the length of the orbit. The GPU mustn't be using the buffer at the time.
+
+int MandelComputeHandler::PrepareOrbit ()
+{
+    MsecTimer orbitTimer;
+    int refLen = ReferenceOrbitInC(DoubleDouble(_xCent,_xCentLo),DoubleDouble(_yCent,_yCentLo),
+                                                                              _maxiter,_orbit);
+    long bytesNeeded = long(_maxiter + 1) * 2 * long(sizeof(float));
+    if (_orbitBytes < bytesNeeded) {
+        _bufferHeap->Recycle(_orbitBuffer);
+        _orbitBuffer = _bufferHeap->NewBuffer(bytesNeeded,MTL::ResourceStorageModeShared);
+        _orbitBytes = bytesNeeded;
+    }
+    float* orbitData = (float*)_orbitBuffer->contents();
+    for (int I = 0; I < refLen * 2; I++) orbitData[I] = float(_orbit[I]);
+    _debug.Logf("Timing","Reference orbit of %d points took %.3f msec",refLen,
+                                                                  orbitTimer.ElapsedMsec());
+    return refLen;
+}
+
 void MandelComputeHandler::ComputeInC ()
 {
     RecomputeArgs();
+    if (ImageFromCache(IMAGE_CPU)) return;
+    
+    //  If this is the last CPU image moved by a whole number of pixels, only the pixels that
+    //  have come into view need computing.
+    
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_CPU,strips)) {
+        for (const Strip& Area : strips) {
+            ComputeStripInC (_imageData,_nx,_ny,Area,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                                             _interiorChecks);
+        }
+    } else {
+        ComputeInCThreads (_imageData,_nx,_ny,0,_ny,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                           _interiorChecks,nullptr,CPUProfile());
+        ReportCPUProfile();
+    }
+    
+    //  This is a complete image, so ComputeInCProgressive() has nothing left to do for it.
+    
+    NoteImage(IMAGE_CPU,0);
+}
+
+//  ComputeInCProgressive() computes the image using the CPU, just as ComputeInC() does, but a
+//  pass at a time, coarse to fine, so a slow image can be displayed as it builds up. Each call
+//  does one more pass, and returns true once the image is complete. The first pass computes
+//  every C_RefineStep'th pixel in X and Y, and sets the whole block of pixels that each one
+//  starts to its value. Each later pass halves the block size, and only computes the pixels
+//  that start the new blocks, as the others already have their values. So the complete image
+//  takes no more computation than ComputeInC(), and ends up exactly the same. If the image
+//  parameters have changed since the last call, any passes left for the old image are dropped,
+//  and a new image is started - unless the complete image has just been moved, in which case
+//  the pixels that have come into view are few enough to be computed in one go.
+
+bool MandelComputeHandler::ComputeInCProgressive ()
+{
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_CPU)) return true;
     
-    ComputeInCThreads (_imageData,_nx,_ny,_xCent,_yCent,_dx,_dy,_maxiter);
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_CPU,strips)) {
+        for (const Strip& Area : strips) {
+            ComputeStripInC (_imageData,_nx,_ny,Area,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                                             _interiorChecks);
+        }
+        NoteImage(IMAGE_CPU,0);
+        return true;
+    }
+    if (_imageSource != IMAGE_CPU || !SameImage()) NoteImage(IMAGE_CPU,C_RefineStep);
+    if (_imageStep > 0) {
+        bool FirstPass = (_imageStep == C_RefineStep);
+        ComputeRefineInC (_imageData,_nx,_ny,_imageStep,FirstPass,_xCent,_yCent,_dx,_dy,
+                                                                    _maxiter,_interiorChecks);
+        _imageStep /= 2;
+        if (_imageStep == 0) CacheImage();
+    }
+    return (_imageStep == 0);
+}
+
+//  MoveCentre() moves the centre of the image by the whole number of pixels closest to the
+//  given offset in Mandelbrot coordinates. When the image is dragged, this lets the next image
+//  be made by shifting the last one and computing only the pixels that have come into view.
+//  Whatever is left over is added to the offset for the next call, so a drag made up of many
+//  small moves still ends up where it should.
+
+void MandelComputeHandler::MoveCentre (double XOffset,double YOffset)
+{
+    RecomputeArgs();
+    double XMove = XOffset + _xMoveLeft;
+    double YMove = YOffset + _yMoveLeft;
+    double XWhole = std::round(XMove / _dx) * _dx;
+    double YWhole = std::round(YMove / _dy) * _dy;
+    _xMoveLeft = XMove - XWhole;
+    _yMoveLeft = YMove - YWhole;
+    OffsetCentre(XWhole,YWhole);
+}
+
+//  OffsetCentre() moves the centre of the image by the given offset in Mandelbrot coordinates.
+//  The centre is held as a DoubleDouble, so this keeps the offset in full even when it is far
+//  smaller than the precision of a double at the centre, as it is at high magnifications.
+
+void MandelComputeHandler::OffsetCentre (double XOffset,double YOffset)
+{
+    DoubleDouble XCent = DoubleDouble(_xCent,_xCentLo) + XOffset;
+    DoubleDouble YCent = DoubleDouble(_yCent,_yCentLo) + YOffset;
+    _xCent = XCent.Hi;
+    _xCentLo = XCent.Lo;
+    _yCent = YCent.Hi;
+    _yCentLo = YCent.Lo;
+}
+
+//  NoteImage() records how the image in the buffer was computed, and its parameters. Step is
+//  the block size for the next pass of ComputeInCProgressive() - zero if the image is complete,
+//  in which case it is also added to the image cache.
+
+void MandelComputeHandler::NoteImage (ImageSource Source,int Step)
+{
+    _imageSource = Source;
+    _imageStep = Step;
+    _imageXCent = _xCent;
+    _imageYCent = _yCent;
+    _imageXCentLo = _xCentLo;
+    _imageYCentLo = _yCentLo;
+    _imageDx = _dx;
+    _imageDy = _dy;
+    _imageMaxIter = _maxiter;
+    if (Step == 0 && Source != IMAGE_NONE) CacheImage();
+}
+
+//  FindCachedImage() returns the entry in the image cache for the image with the current
+//  parameters computed using Source, or the end of the cache if there isn't one.
+
+std::list<MandelComputeHandler::CachedImage>::iterator MandelComputeHandler::FindCachedImage (
+                                                                          ImageSource Source)
+{
+    auto image = _imageCache.begin();
+    while (image != _imageCache.end()) {
+        if (image->Source == Source && image->XCent == _xCent && image->YCent == _yCent &&
+               image->XCentLo == _xCentLo && image->YCentLo == _yCentLo && image->Dx == _dx &&
+                                        image->Dy == _dy && image->MaxIter == _maxiter) break;
+        image++;
+    }
+    return image;
+}
+
+//  ImageFromCache() checks the image cache for the image with the current parameters computed
+//  using Source. If it's there, it copies it into the image buffer and returns true.
+
+bool MandelComputeHandler::ImageFromCache (ImageSource Source)
+{
+    auto image = FindCachedImage(Source);
+    if (image == _imageCache.end()) return false;
+    MsecTimer copyTimer;
+    memcpy(_imageData,image->Data.data(),image->Data.size() * sizeof(uint32_t));
+    NoteImage(Source,0);
+    _imageCacheHits++;
+    _debug.Logf("Timing","Image taken from cache in %.3f msec",copyTimer.ElapsedMsec());
+    return true;
+}
+
+//  CacheImage() adds the complete image in the image buffer to the image cache, unless it's
+//  already there, in which case it becomes the most recently used. The cache is a list kept
+//  in order of use, most recent first, so when it's full, the image at the end is dropped,
+//  and its storage is reused for the new one. All the images are the same size, as the cache
+//  is cleared when the size changes.
+
+void MandelComputeHandler::CacheImage (void)
+{
+    long bytes = long(_nx) * long(_ny) * long(sizeof(uint32_t));
+    if (bytes == 0 || bytes > _imageCacheLimit) return;
+    auto image = FindCachedImage(_imageSource);
+    if (image != _imageCache.end()) {
+        _imageCache.splice(_imageCache.begin(),_imageCache,image);
+        return;
+    }
+    std::vector<uint32_t> data;
+    while (!_imageCache.empty() && long(_imageCache.size() + 1) * bytes > _imageCacheLimit) {
+        data.swap(_imageCache.back().Data);
+        _imageCache.pop_back();
+    }
+    data.assign(_imageData,_imageData + size_t(_nx) * size_t(_ny));
+    _imageCache.push_front({_imageSource,_xCent,_yCent,_xCentLo,_yCentLo,_dx,_dy,_maxiter,
+                                                                             std::move(data)});
+}
+
+
+//  SameImage() returns true if the current parameters are those of the image in the buffer.
+
+bool MandelComputeHandler::SameImage (void)
+{
+    return (_imageXCent == _xCent && _imageYCent == _yCent && _imageXCentLo == _xCentLo &&
+                _imageYCentLo == _yCentLo && _imageDx == _dx && _imageDy == _dy &&
+                                                                 _imageMaxIter == _maxiter);
+}
+
+//  ShiftImage() checks whether the image now wanted is the complete image last computed using
+//  Source, moved by a whole number of pixels with nothing else changed, as it is when the image
+//  is dragged using MoveCentre(). If so, it moves the image data to match and returns true,
+//  with Strips set to the parts of the image that have come into view and still need computing
+//  - none, if the image hasn't moved at all. Otherwise, it returns false, and the whole image
+//  needs computing.
+
+bool MandelComputeHandler::ShiftImage (ImageSource Source,std::vector<Strip>& Strips)
+{
+    Strips.clear();
+    if (Source != _imageSource || _imageStep != 0) return false;
+    if (_imageDx != _dx || _imageDy != _dy || _imageMaxIter != _maxiter) return false;
+    
+    //  The new pixel (Ix,Iy) is the old pixel (Ix + ShiftX,Iy + ShiftY). Rounding error means
+    //  the shifts won't be exact whole numbers, but they should be very close. The high parts of
+    //  the centres are close enough that subtracting them is exact.
+    
+    double ShiftX = ((_xCent - _imageXCent) + (_xCentLo - _imageXCentLo)) / _dx;
+    double ShiftY = ((_yCent - _imageYCent) + (_yCentLo - _imageYCentLo)) / _dy;
+    if (fabs(ShiftX) >= double(_nx) || fabs(ShiftY) >= double(_ny)) return false;
+    int Sx = int(std::round(ShiftX));
+    int Sy = int(std::round(ShiftY));
+    if (fabs(ShiftX - Sx) > C_ShiftTolerance || fabs(ShiftY - Sy) > C_ShiftTolerance) return false;
+    if (Sx == 0 && Sy == 0) return true;
+    
+    //  The rows that have come into view are computed in full, and then the columns that have
+    //  come into view for the rest of the rows.
+    
+    ShiftInC(_imageData,_nx,_ny,Sx,Sy);
+    int Iyst = 0;
+    int Iyen = _ny;
+    if (Sy > 0) {
+        Strips.push_back({0,_nx,_ny - Sy,_ny});
+        Iyen = _ny - Sy;
+    } else if (Sy < 0) {
+        Strips.push_back({0,_nx,0,-Sy});
+        Iyst = -Sy;
+    }
+    if (Sx > 0) Strips.push_back({_nx - Sx,_nx,Iyst,Iyen});
+    else if (Sx < 0) Strips.push_back({0,-Sx,Iyst,Iyen});
+    return true;
+}
+
+//  ShiftInC() moves the image data so that the new pixel (Ix,Iy) has the value of the old pixel
+//  (Ix + ShiftX,Iy + ShiftY), wherever that is in the image. The rows are gone through in the
+//  order that moves each before it is overwritten.
+
+void MandelComputeHandler::ShiftInC (uint32_t* Data,int Nx,int Ny,int ShiftX,int ShiftY)
+{
+    int IxFrom = std::max(0,ShiftX);
+    int IxTo = std::max(0,-ShiftX);
+    size_t Bytes = size_t(Nx - std::abs(ShiftX)) * sizeof(uint32_t);
+    if (ShiftY >= 0) {
+        for (int Iy = 0; Iy < Ny - ShiftY; Iy++) {
+            memmove(Data + size_t(Iy) * Nx + IxTo,Data + size_t(Iy + ShiftY) * Nx + IxFrom,Bytes);
+        }
+    } else {
+        for (int Iy = Ny - 1; Iy >= -ShiftY; Iy--) {
+            memmove(Data + size_t(Iy) * Nx + IxTo,Data + size_t(Iy + ShiftY) * Nx + IxFrom,Bytes);
+        }
+    }
 }
 
 void MandelComputeHandler::ComputeInCThreads (
-        float* Data,int Nx,int Ny,prec Xcent,prec Ycent,
-                                       prec Dx,prec Dy,int MaxIter)
+        uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
+                 prec Dx,prec Dy,int MaxIter,bool Checks,ThreadPool* Pool,CycleProfile* Profile)
 {
-    int nThreads = std::thread::hardware_concurrency();
-    if (nThreads <= 0) nThreads = 1;
+    //  The rows are divided between the threads of the shared pool, which are created once
+    //  and then reused, rather than creating a new set of threads for each image. Some parts
+    //  of the image take far longer than others - points in the set take every iteration -
+    //  so rather than giving each thread a fixed band of rows, the rows are handed out a few
+    //  at a time, each thread taking the next few as soon as it has finished the last, so all
+    //  the threads finish at about the same time. (So the range ParallelFor() gives each
+    //  thread isn't used, only the number of threads.) An image being computed ahead by
+    //  StartCPUImage() uses a pool of its own, passed as Pool. If Profile is not null, the
+    //  time taken by each few rows is recorded in it.
+    
+    if (Pool == nullptr) Pool = &ThreadPool::Shared();
+    int Tiles = (Iyen - Iyst + C_CPUTileRows - 1) / C_CPUTileRows;
+    std::atomic<int> NextTile(0);
+    Pool->ParallelFor(0,Tiles,[&](int,int) {
+        for (int Tile = NextTile++; Tile < Tiles; Tile = NextTile++) {
+            int First = Iyst + Tile * C_CPUTileRows;
+            int Last = std::min(Iyen,First + C_CPUTileRows);
+            CycleScope TileTime(Profile,uint64_t(Last - First));
+            ComputeRangeInC(Data,Nx,Ny,First,Last,Xcent,Ycent,Dx,Dy,MaxIter,Checks);
+        }
+    });
+}
+
+//  PointInC() returns the image value for the point (x0,y0), used by all the CPU code. Points
+//  in the set take all MaxIter iterations, and usually make up most of the work, so if Checks
+//  is set, two shortcuts are used for them. Points in the main cardioid or the period-2 bulb,
+//  which have a closed form, aren't iterated at all. For the rest, the orbit is compared with
+//  a point saved from it, which is replaced at iterations 1,2,4,8... (Brent's method). If the
+//  orbit ever gets back to that point exactly, it is cycling, and can never escape. Neither
+//  changes the result, so Checks can be cleared to see what they save.
 
-    std::thread threads[nThreads];
-    int iY = 0;
-    int iYinc = Ny / nThreads;
-    for (int iThread = 0; iThread < nThreads; iThread++) {
-        threads[iThread] = std::thread (ComputeRangeInC,Data,Nx,Ny,iY,iY+iYinc,
-                                                              Xcent,Ycent,Dx,Dy,MaxIter);
-        iY += iYinc;
+static inline uint32_t PointInC (prec x0,prec y0,int MaxIter,bool Checks)
+{
+    if (Checks) {
+        prec xq = x0 - 0.25;
+        prec q = xq * xq + y0 * y0;
+        if (q * (q + xq) <= 0.25 * y0 * y0) return 0.0;
+        if ((x0 + 1.0) * (x0 + 1.0) + y0 * y0 <= 0.0625) return 0.0;
     }
-    for (int iThread = 0; iThread < nThreads; iThread++) {
-        threads[iThread].join();
+
+    // Implement Mandelbrot set
+   
+    prec x = 0.0;
+    prec y = 0.0;
+    int iteration = 0;
+    prec xtmp = 0.0;
+    prec xSaved = 0.0;
+    prec ySaved = 0.0;
+    int count = 0;
+    int limit = 1;
+    while (((x * x) + (y * y) <= 4.0) && (iteration < MaxIter))
+    {
+        xtmp = (x + y) * (x - y) + x0;
+        y = (2.0 * x * y) + y0;
+        x = xtmp;
+        iteration += 1;
+        if (Checks) {
+            if (x == xSaved && y == ySaved) return 0.0;
+            if (++count == limit) {
+                xSaved = x;
+                ySaved = y;
+                count = 0;
+                limit *= 2;
+            }
+        }
+    }
+
+    // Treat iteration result as a colour value for the image.
+    uint32_t colour = uint32_t(iteration);
+    if (iteration == MaxIter) colour = 0;
+    return colour;
+}
+
+//                               I n c l u d e  F i l e s
+//
+//  Needed for the vector versions of the CPU code.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MANDEL_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define MANDEL_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+//  The CPU code computes the image a row at a time, or, for ComputeRefineInC(), a row of
+//  evenly spaced points at a time, using one of the following 'row' routines. The scalar
+//  version just calls PointInC() for each point. The vector versions do exactly the same, but
+//  for 4 (AVX2), 8 (AVX-512) or 2 (NEON) points at a time, one in each lane of a vector of
+//  doubles. Each lane has a mask saying whether its point is still being iterated. A lane
+//  drops out when its point escapes - when its value is set to the iteration count - or when
+//  the interior checks show it is in the set, and once all the lanes have dropped out, the
+//  next set of points is started. Brent's periodicity check saves the orbit at the same
+//  iterations for every point, so the lanes can share that schedule. The operations are the
+//  same as those in PointInC(), in the same order, so the results are the same. Any points
+//  left over at the end of a row are handled one at a time. These all assume 'prec' is double.
+//  With gcc and clang, the x86 versions are compiled for their instruction sets using the
+//  'target' attribute, rather than by compiling the whole program for them, so the program
+//  still runs on older CPUs - they just never get called there. See SelectRowRoutine(). (AVX-512
+//  includes fused multiply-add, and gcc would otherwise fuse the multiplies and adds, which
+//  changes the rounding, so it is told not to.)
+
+static void RowInC (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,prec GridXcent,
+                                                  prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    for (int I = 0; I < Count; I++) {
+        prec x0 = Xcent + (prec(Ixst + I * IxStep) - GridXcent) * Dx;
+        Values[I] = PointInC(x0,y0,MaxIter,Checks);
+    }
+}
+
+#if defined(MANDEL_X86_SIMD) && defined(__clang__)
+#define MANDEL_TARGET(Isa) __attribute__((target(Isa)))
+#elif defined(MANDEL_X86_SIMD) && defined(__GNUC__)
+#define MANDEL_TARGET(Isa) __attribute__((target(Isa),optimize("fp-contract=off")))
+#else
+#define MANDEL_TARGET(Isa)
+#endif
+
+#ifdef MANDEL_X86_SIMD
+
+MANDEL_TARGET("avx2")
+static void RowUsingAVX2 (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                 prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    const __m256d Zero = _mm256_setzero_pd();
+    const __m256d Two = _mm256_set1_pd(2.0);
+    const __m256d Four = _mm256_set1_pd(4.0);
+    const __m256d Y0 = _mm256_set1_pd(y0);
+    const __m256d Y0Sq = _mm256_set1_pd(y0 * y0);
+    const __m256d Y0SqQuarter = _mm256_set1_pd(0.25 * y0 * y0);
+    int I = 0;
+    for (; I + 4 <= Count; I += 4) {
+        int Ix = Ixst + I * IxStep;
+        __m256d X0 = _mm256_add_pd(_mm256_set1_pd(Xcent),_mm256_mul_pd(_mm256_sub_pd(
+               _mm256_setr_pd(Ix,Ix + IxStep,Ix + 2 * IxStep,Ix + 3 * IxStep),
+                                      _mm256_set1_pd(GridXcent)),_mm256_set1_pd(Dx)));
+        __m256d Active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        if (Checks) {
+            __m256d Xq = _mm256_sub_pd(X0,_mm256_set1_pd(0.25));
+            __m256d Q = _mm256_add_pd(_mm256_mul_pd(Xq,Xq),Y0Sq);
+            __m256d Cardioid = _mm256_cmp_pd(_mm256_mul_pd(Q,_mm256_add_pd(Q,Xq)),
+                                                                 Y0SqQuarter,_CMP_LE_OQ);
+            __m256d Xp = _mm256_add_pd(X0,_mm256_set1_pd(1.0));
+            __m256d Bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(Xp,Xp),Y0Sq),
+                                                     _mm256_set1_pd(0.0625),_CMP_LE_OQ);
+            Active = _mm256_andnot_pd(_mm256_or_pd(Cardioid,Bulb),Active);
+        }
+        __m256d X = Zero;
+        __m256d Y = Zero;
+        __m256d XSaved = Zero;
+        __m256d YSaved = Zero;
+        __m256d Result = Zero;
+        int SaveCount = 0;
+        int SaveLimit = 1;
+        for (int Iter = 1; Iter < MaxIter && _mm256_movemask_pd(Active) != 0; Iter++) {
+            __m256d XTmp = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(X,Y),
+                                                           _mm256_sub_pd(X,Y)),X0);
+            Y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(Two,X),Y),Y0);
+            X = XTmp;
+            __m256d Escaped = _mm256_and_pd(_mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(X,X),
+                                            _mm256_mul_pd(Y,Y)),Four,_CMP_GT_OQ),Active);
+            Result = _mm256_blendv_pd(Result,_mm256_set1_pd(double(Iter)),Escaped);
+            Active = _mm256_andnot_pd(Escaped,Active);
+            if (Checks) {
+                __m256d Cycling = _mm256_and_pd(_mm256_cmp_pd(X,XSaved,_CMP_EQ_OQ),
+                                                      _mm256_cmp_pd(Y,YSaved,_CMP_EQ_OQ));
+                Active = _mm256_andnot_pd(Cycling,Active);
+                if (++SaveCount == SaveLimit) {
+                    XSaved = X;
+                    YSaved = Y;
+                    SaveCount = 0;
+                    SaveLimit *= 2;
+                }
+            }
+        }
+        _mm_storeu_si128((__m128i*)(Values + I),_mm256_cvtpd_epi32(Result));
+    }
+    RowInC(Values + I,Count - I,Ixst + I * IxStep,IxStep,Xcent,GridXcent,Dx,y0,MaxIter,Checks);
+}
+
+MANDEL_TARGET("avx512f")
+static void RowUsingAVX512 (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                   prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    const __m512d Zero = _mm512_setzero_pd();
+    const __m512d Two = _mm512_set1_pd(2.0);
+    const __m512d Four = _mm512_set1_pd(4.0);
+    const __m512d Y0 = _mm512_set1_pd(y0);
+    const __m512d Y0Sq = _mm512_set1_pd(y0 * y0);
+    const __m512d Y0SqQuarter = _mm512_set1_pd(0.25 * y0 * y0);
+    const __m512d Lanes = _mm512_setr_pd(0.0,1.0,2.0,3.0,4.0,5.0,6.0,7.0);
+    int I = 0;
+    for (; I + 8 <= Count; I += 8) {
+        int Ix = Ixst + I * IxStep;
+        __m512d X0 = _mm512_add_pd(_mm512_set1_pd(Xcent),_mm512_mul_pd(_mm512_sub_pd(
+                   _mm512_add_pd(_mm512_set1_pd(Ix),_mm512_mul_pd(Lanes,_mm512_set1_pd(IxStep))),
+                                      _mm512_set1_pd(GridXcent)),_mm512_set1_pd(Dx)));
+        __mmask8 Active = 0xff;
+        if (Checks) {
+            __m512d Xq = _mm512_sub_pd(X0,_mm512_set1_pd(0.25));
+            __m512d Q = _mm512_add_pd(_mm512_mul_pd(Xq,Xq),Y0Sq);
+            __mmask8 Cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(Q,_mm512_add_pd(Q,Xq)),
+                                                                 Y0SqQuarter,_CMP_LE_OQ);
+            __m512d Xp = _mm512_add_pd(X0,_mm512_set1_pd(1.0));
+            __mmask8 Bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(Xp,Xp),Y0Sq),
+                                                     _mm512_set1_pd(0.0625),_CMP_LE_OQ);
+            Active &= ~(Cardioid | Bulb);
+        }
+        __m512d X = Zero;
+        __m512d Y = Zero;
+        __m512d XSaved = Zero;
+        __m512d YSaved = Zero;
+        __m512d Result = Zero;
+        int SaveCount = 0;
+        int SaveLimit = 1;
+        for (int Iter = 1; Iter < MaxIter && Active != 0; Iter++) {
+            __m512d XTmp = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(X,Y),
+                                                           _mm512_sub_pd(X,Y)),X0);
+            Y = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(Two,X),Y),Y0);
+            X = XTmp;
+            __mmask8 Escaped = _mm512_mask_cmp_pd_mask(Active,_mm512_add_pd(
+                       _mm512_mul_pd(X,X),_mm512_mul_pd(Y,Y)),Four,_CMP_GT_OQ);
+            Result = _mm512_mask_blend_pd(Escaped,Result,_mm512_set1_pd(double(Iter)));
+            Active &= ~Escaped;
+            if (Checks) {
+                Active &= ~(_mm512_cmp_pd_mask(X,XSaved,_CMP_EQ_OQ) &
+                                                  _mm512_cmp_pd_mask(Y,YSaved,_CMP_EQ_OQ));
+                if (++SaveCount == SaveLimit) {
+                    XSaved = X;
+                    YSaved = Y;
+                    SaveCount = 0;
+                    SaveLimit *= 2;
+                }
+            }
+        }
+        _mm256_storeu_si256((__m256i*)(Values + I),_mm512_cvtpd_epi32(Result));
     }
-    if (iY < Ny) {
-        ComputeRangeInC(Data,Nx,Ny,iY,Ny,Xcent,Ycent,Dx,Dy,MaxIter);
+    RowInC(Values + I,Count - I,Ixst + I * IxStep,IxStep,Xcent,GridXcent,Dx,y0,MaxIter,Checks);
+}
+
+#endif
+
+#ifdef MANDEL_NEON_SIMD
+
+static void RowUsingNEON (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                 prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    const float64x2_t Zero = vdupq_n_f64(0.0);
+    const float64x2_t Two = vdupq_n_f64(2.0);
+    const float64x2_t Four = vdupq_n_f64(4.0);
+    const float64x2_t Y0 = vdupq_n_f64(y0);
+    const float64x2_t Y0Sq = vdupq_n_f64(y0 * y0);
+    const float64x2_t Y0SqQuarter = vdupq_n_f64(0.25 * y0 * y0);
+    int I = 0;
+    for (; I + 2 <= Count; I += 2) {
+        int Ix = Ixst + I * IxStep;
+        const double Indices[2] = {double(Ix),double(Ix + IxStep)};
+        float64x2_t X0 = vaddq_f64(vdupq_n_f64(Xcent),vmulq_f64(vsubq_f64(vld1q_f64(Indices),
+                                                vdupq_n_f64(GridXcent)),vdupq_n_f64(Dx)));
+        uint64x2_t Active = vdupq_n_u64(~uint64_t(0));
+        if (Checks) {
+            float64x2_t Xq = vsubq_f64(X0,vdupq_n_f64(0.25));
+            float64x2_t Q = vaddq_f64(vmulq_f64(Xq,Xq),Y0Sq);
+            uint64x2_t Cardioid = vcleq_f64(vmulq_f64(Q,vaddq_f64(Q,Xq)),Y0SqQuarter);
+            float64x2_t Xp = vaddq_f64(X0,vdupq_n_f64(1.0));
+            uint64x2_t Bulb = vcleq_f64(vaddq_f64(vmulq_f64(Xp,Xp),Y0Sq),vdupq_n_f64(0.0625));
+            Active = vbicq_u64(Active,vorrq_u64(Cardioid,Bulb));
+        }
+        float64x2_t X = Zero;
+        float64x2_t Y = Zero;
+        float64x2_t XSaved = Zero;
+        float64x2_t YSaved = Zero;
+        float64x2_t Result = Zero;
+        int SaveCount = 0;
+        int SaveLimit = 1;
+        for (int Iter = 1; Iter < MaxIter &&
+                    (vgetq_lane_u64(Active,0) | vgetq_lane_u64(Active,1)) != 0; Iter++) {
+            float64x2_t XTmp = vaddq_f64(vmulq_f64(vaddq_f64(X,Y),vsubq_f64(X,Y)),X0);
+            Y = vaddq_f64(vmulq_f64(vmulq_f64(Two,X),Y),Y0);
+            X = XTmp;
+            uint64x2_t Escaped = vandq_u64(vcgtq_f64(vaddq_f64(vmulq_f64(X,X),
+                                                       vmulq_f64(Y,Y)),Four),Active);
+            Result = vbslq_f64(Escaped,vdupq_n_f64(double(Iter)),Result);
+            Active = vbicq_u64(Active,Escaped);
+            if (Checks) {
+                Active = vbicq_u64(Active,vandq_u64(vceqq_f64(X,XSaved),vceqq_f64(Y,YSaved)));
+                if (++SaveCount == SaveLimit) {
+                    XSaved = X;
+                    YSaved = Y;
+                    SaveCount = 0;
+                    SaveLimit *= 2;
+                }
+            }
+        }
+        vst1_u32(Values + I,vmovn_u64(vcvtq_u64_f64(Result)));
     }
+    RowInC(Values + I,Count - I,Ixst + I * IxStep,IxStep,Xcent,GridXcent,Dx,y0,MaxIter,Checks);
+}
 
+#endif
+
+//  CPUSupports() returns true if the CPU being used supports a given set of vector instructions,
+//  "AVX2", "AVX512" or "NEON". (NEON is a standard part of 64-bit ARM, so is always there.)
+
+[[maybe_unused]] static bool CPUSupports(const std::string& Isa)
+{
+    bool Supported = false;
+#ifdef MANDEL_X86_SIMD
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (Isa == "AVX2") Supported = __builtin_cpu_supports("avx2");
+    if (Isa == "AVX512") Supported = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER)
     
+    //  CPUID leaf 7 gives the instruction set bits, but the operating system also has to be
+    //  saving the wider registers, which _xgetbv() shows (bits 1,2 for AVX, 5-7 for AVX-512).
+    
+    int Info[4];
+    __cpuid(Info,0);
+    if (Info[0] >= 7) {
+        __cpuidex(Info,7,0);
+        bool HasAVX2 = (Info[1] & (1 << 5)) != 0;
+        bool HasAVX512 = (Info[1] & (1 << 16)) != 0;
+        __cpuid(Info,1);
+        bool OSSaves = (Info[2] & (1 << 27)) != 0;
+        unsigned long long XCR0 = OSSaves ? _xgetbv(0) : 0;
+        if (Isa == "AVX2") Supported = HasAVX2 && ((XCR0 & 0x6) == 0x6);
+        if (Isa == "AVX512") Supported = HasAVX512 && ((XCR0 & 0xe6) == 0xe6);
+    }
+#endif
+#endif
+#ifdef MANDEL_NEON_SIMD
+    if (Isa == "NEON") Supported = true;
+#endif
+    return Supported;
+}
+
+//  SelectRowRoutine() returns the row routine to use - the one with the widest vectors the CPU
+//  supports - and sets Name to the instruction set it uses. It only checks the CPU once.
+
+static RowRoutine SelectRowRoutine(const char** Name)
+{
+    static const char* RoutineName = "Scalar";
+    static const RowRoutine Routine = [](){
+        RowRoutine Selected = RowInC;
+#ifdef MANDEL_X86_SIMD
+        if (CPUSupports("AVX512")) {
+            Selected = RowUsingAVX512;
+            RoutineName = "AVX512";
+        } else if (CPUSupports("AVX2")) {
+            Selected = RowUsingAVX2;
+            RoutineName = "AVX2";
+        }
+#endif
+#ifdef MANDEL_NEON_SIMD
+        if (CPUSupports("NEON")) {
+            Selected = RowUsingNEON;
+            RoutineName = "NEON";
+        }
+#endif
+        return Selected;
+    }();
+    if (Name) *Name = RoutineName;
+    return Routine;
 }
 
 void MandelComputeHandler::ComputeRangeInC (
-       float* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
-                                             prec Dx,prec Dy,int MaxIter)
+       uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
+                                             prec Dx,prec Dy,int MaxIter,bool Checks)
 {
+    //  Each row is computed by the row routine for this CPU, using vector instructions if it
+    //  has them.
+    
+    RowRoutine Row = SelectRowRoutine();
     Data += Iyst * Nx;
     prec gridXcent = Nx * 0.5;
     prec gridYcent = Ny * 0.5;
     for (int Iy = Iyst; Iy < Iyen; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            // Scale
+        prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+        Row(Data,Nx,0,1,Xcent,gridXcent,Dx,y0,MaxIter,Checks);
+        Data += Nx;
+    }
+
+}
+
+//  ComputeRefineInC() performs one pass of ComputeInCProgressive(), for blocks Step pixels
+//  square. Unless this is the first pass, the pixels that start the blocks of the previous
+//  pass - those on multiples of 2 * Step in both X and Y - already have their values, as do
+//  the blocks they start, and are skipped.
+
+void MandelComputeHandler::ComputeRefineInC (
+        uint32_t* Data,int Nx,int Ny,int Step,bool FirstPass,prec Xcent,prec Ycent,
+                                             prec Dx,prec Dy,int MaxIter,bool Checks)
+{
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    int Done = 2 * Step;
+    
+    //  The rows of blocks are divided between the threads of the shared pool, each thread
+    //  taking the next row of blocks as soon as it has finished the last, as for
+    //  ComputeInCThreads(). A block only covers rows in its own row of blocks, so no two
+    //  threads write to the same pixels. The points to compute in a row are evenly spaced -
+    //  every Step pixels, or, in a row done by the previous pass, every 2 * Step pixels
+    //  starting at Step - so the row routine for this CPU can compute them all, before they are
+    //  spread over their blocks.
+    
+    RowRoutine RowValues = SelectRowRoutine();
+    int BlockRows = (Ny + Step - 1) / Step;
+    std::atomic<int> NextBlockRow(0);
+    ThreadPool::Shared().ParallelFor(0,BlockRows,[&](int,int) {
+        std::vector<uint32_t> Values(Nx);
+        for (int Ib = NextBlockRow++; Ib < BlockRows; Ib = NextBlockRow++) {
+            int Iy = Ib * Step;
+            int Iyen = std::min(Ny,Iy + Step);
+            bool DoneRow = !FirstPass && (Iy % Done) == 0;
+            prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+            int Ixst = DoneRow ? Step : 0;
+            int IxStep = DoneRow ? Done : Step;
+            int Count = (Nx - Ixst + IxStep - 1) / IxStep;
+            if (Count <= 0) continue;
+            RowValues(Values.data(),Count,Ixst,IxStep,Xcent,gridXcent,Dx,y0,MaxIter,Checks);
+            for (int I = 0; I < Count; I++) {
+                int Ix = Ixst + I * IxStep;
+                int Ixen = std::min(Nx,Ix + Step);
+                for (int Jy = Iy; Jy < Iyen; Jy++) {
+                    uint32_t* Row = Data + size_t(Jy) * size_t(Nx);
+                    for (int Jx = Ix; Jx < Ixen; Jx++) Row[Jx] = Values[I];
+                }
+            }
+        }
+    });
+}
+
+//  ComputeStripInC() computes the pixels in one strip of the image. The pixels of the strip
+//  are divided between the threads of the shared pool as a single range, as a strip may only
+//  be a row or two deep.
+
+void MandelComputeHandler::ComputeStripInC (
+        uint32_t* Data,int Nx,int Ny,const Strip& Area,prec Xcent,prec Ycent,
+                                          prec Dx,prec Dy,int MaxIter,bool Checks)
+{
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    int Width = Area.Ixen - Area.Ixst;
+    int Pixels = Width * (Area.Iyen - Area.Iyst);
+    ThreadPool::Shared().ParallelFor(0,Pixels,[&](int Ist,int Ien) {
+        for (int I = Ist; I < Ien; I++) {
+            int Ix = Area.Ixst + I % Width;
+            int Iy = Area.Iyst + I / Width;
             prec x0 = Xcent + (prec(Ix) - gridXcent) * Dx;
             prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+            Data[size_t(Iy) * Nx + Ix] = PointInC(x0,y0,MaxIter,Checks);
+        }
+    });
+}
 
-            // Implement Mandelbrot set
-           
-            prec x = 0.0;
-            prec y = 0.0;
-            int iteration = 0;
-            prec xtmp = 0.0;
-            while (((x * x) + (y * y) <= 4.0) && (iteration < MaxIter))
-            {
-                xtmp = (x + y) * (x - y) + x0;
-                y = (2.0 * x * y) + y0;
-                x = xtmp;
-                iteration += 1;
-            }
+//  ReferenceOrbitInC() computes the orbit of the point (X0,Y0) in DoubleDouble precision, for
+//  use as the reference orbit by ComputePerturbed(), setting Orbit to the X,Y pairs of the
+//  orbit rounded to double, starting with (0,0). The orbit stops after MaxIter iterations, or
+//  once it diverges, and the number of points in it is returned.
 
-            // Treat iteration result as a colour value for the image.
-            float colour = (float)(iteration);
-            if (iteration == MaxIter) colour = 0.0;
-            *Data++ = colour;
-       }
+int MandelComputeHandler::ReferenceOrbitInC (
+   const DoubleDouble& X0,const DoubleDouble& Y0,int MaxIter,std::vector<double>& Orbit)
+{
+    Orbit.resize(size_t(MaxIter + 1) * 2);
+    Orbit[0] = Orbit[1] = 0.0;
+    DoubleDouble x = 0.0;
+    DoubleDouble y = 0.0;
+    int Points = 1;
+    while (Points <= MaxIter) {
+        DoubleDouble xtmp = (x + y) * (x - y) + X0;
+        y = x * y * 2.0 + Y0;
+        x = xtmp;
+        double xd = x.ToDouble();
+        double yd = y.ToDouble();
+        Orbit[Points * 2] = xd;
+        Orbit[Points * 2 + 1] = yd;
+        Points++;
+        if ((xd * xd) + (yd * yd) > 4.0) break;
     }
-
+    return Points;
 }
 
 bool MandelComputeHandler::FloatOKatXY(int Ix,int Iy)
@@ -434,6 +1853,58 @@ bool MandelComputeHandler::DoubleOK(void)
     return true;
 }
 
+//  FloatFloat() returns a value rounded to the precision of a float-float - the sum of its
+//  value rounded to a float and the remainder rounded to a float.
+
+double MandelComputeHandler::FloatFloat(double Value)
+{
+    float Hi = float(Value);
+    float Lo = float(Value - double(Hi));
+    return double(Hi) + double(Lo);
+}
+
+bool MandelComputeHandler::FloatFloatOKatXY(int Ix,int Iy)
+{
+    //  The same as FloatOKatXY(), but using float-float precision.
+    
+    double Xinc = double(_nx) / double(_width);
+    double X0 = FloatFloat(_xCent + (double(Ix) - _nx * 0.5) * _dx);
+    double X1 = FloatFloat(_xCent + (double(Ix) + Xinc - _nx * 0.5) * _dx);
+    double Yinc = double(_ny) / double(_height);
+    double Y0 = FloatFloat(_yCent + (double(Iy) - _ny * 0.5) * _dy);
+    double Y1 = FloatFloat(_yCent + (double(Iy) + Yinc - _ny * 0.5) * _dy);
+    return ((Y1 - Y0) > 0.0) && ((X1 - X0) > 0.0);
+}
+
+bool MandelComputeHandler::FloatFloatOK(void)
+{
+    //  The same as FloatOK() but uses float-float precision.
+    
+    int Ix = 0;
+    int Iy = 0;
+    int Ixinc = _nx / 10;
+    int Iyinc = _ny / 10;
+    for (int I = 0; I < 10; I++) {
+        if (!FloatFloatOKatXY(Ix,Iy)) return false;
+        Ix += Ixinc;
+        Iy += Iyinc;
+    }
+    return true;
+}
+
+//  PerturbedOK() is the equivalent of FloatOK() and DoubleOK() for ComputePerturbed(). The
+//  offsets of the pixels from the centre are small enough to be held accurately, but the centre
+//  itself is only held to the precision of a DoubleDouble, and once a pixel is within a factor
+//  100 or so of that, rounding error will start to show.
+
+bool MandelComputeHandler::PerturbedOK(void)
+{
+    RecomputeArgs();
+    double Scale = std::max(1.0,std::max(fabs(_xCent),fabs(_yCent)));
+    double Limit = Scale * C_DoubleDoubleEpsilon * 100.0;
+    return (fabs(_dx) > Limit && fabs(_dy) > Limit);
+}
+
 /*
                                    P r o g r a m m i n g  N o t e s
  
@@ -25,6 +25,56 @@
 //  that the address of the generated image will then be obtained using GetImageData() and
 //  the image will then be written out or displayed in some way.
 //
+//  ComputeInC() can take a while at high magnifications, so ComputeInCProgressive() can be
+//  used instead to compute the image a pass at a time, coarse to fine - first every 8th pixel,
+//  filling the 8 by 8 block each one starts, then every 4th, every 2nd and finally every pixel,
+//  reusing the pixels already computed. Each call does one pass, and returns true once the
+//  image is complete, so the image can be displayed as it builds up. If the image parameters
+//  change before it is complete, the remaining passes are dropped and a new image is started.
+//
+//  When an image is dragged, MoveCentre() can be used instead of SetCentre() to move the
+//  centre by a whole number of pixels. If the only change since the last complete image is such
+//  a move, and the image is computed the same way - GPU, GPU double precision, or CPU - the
+//  existing image is shifted and only the strips that have come into view are computed.
+//
+//  Beyond a magnification of around 1e13, even double precision can't tell neighbouring
+//  pixels apart - DoubleOK() returns false - and ComputePerturbed() can be used instead. This
+//  computes the orbit of the centre point of the image using the CPU, in the extended
+//  precision of a DoubleDouble, and passes it to the GPU, which then only has to compute the
+//  small differences between each pixel's orbit and that reference orbit. The centre is held
+//  to the same precision, so the image should be moved using OffsetCentre() or MoveCentre(),
+//  which take offsets from the current centre, rather than SetCentre(). PerturbedOK() returns
+//  false once even this precision is no longer enough.
+//
+//  Short of that, ComputeFloatFloat() can be used. This holds each quantity as the sum of two
+//  floats, a high and a low part, which gives around 48 bits of mantissa - not quite double
+//  precision, which Metal GPUs don't have, but a lot closer to it than a single float, at a
+//  cost of a few times as many float operations. FloatFloatOK() is its equivalent of FloatOK()
+//  and DoubleOK().
+//
+//  At those magnifications, the GPU is much slower than it is in single precision, and
+//  ComputeHybrid() can be used to have the CPU compute part of the image while the GPU computes
+//  the rest. The split between the two is adjusted from image to image so that both finish at
+//  about the same time.
+//
+//  When the next image is known in advance - when zooming, for example - StartGPUImage() can
+//  be used to have the GPU start computing it, into a second image buffer, while the current
+//  image is displayed. FinishGPUImage() then waits for it and makes it the current image, so
+//  long as nothing has changed in the meantime. This works for perturbation images as well, as
+//  the reference orbit can be computed before the GPU is started. StartCPUImage() and
+//  FinishCPUImage() do the same for an image computed by the CPU, which is computed by a
+//  background thread using a thread pool of its own, leaving a CPU thread free to display
+//  the current image.
+//
+//  Complete images are kept in an image cache, up to a memory limit set by SetImageCacheLimit(),
+//  and an image the cache already holds, computed the same way, is copied from the cache
+//  rather than being computed again.
+//
+//  SetTileQueue() changes the way Compute() shares out the image between the GPU's threads.
+//  Rather than launching a thread for each pixel, it launches a fixed number of thread groups
+//  that each take tiles from a queue until the image is done. This can even out the load when
+//  some parts of the image take much longer than others.
+//
 //  The image is generated in a float array, Nx by Ny. Although a float array is used, each
 //  pixel in the image will be the number of iterations that it took the code to decide
 //  whether the point lies within the Mandlebrot set or not. If the code runs more than
@@ -69,6 +119,22 @@
 //                  of a DebugHandler. KS.
 //     30 Aug 2024. Added use of a debug handler, support for GetDebugOptions() and added Validate
 //                  parameter to Initialise(), following recent changes to the Vulkan version. KS.
+//     15 Oct 2026. Added ComputeInCProgressive(). KS.
+//                  Added MoveCentre(), and shifting of moved images. KS.
+//                  Added ComputeFloatFloat() and FloatFloatOK(). KS.
+//                  Added SetInteriorChecks() and GetInteriorChecks(). KS.
+//                  Added SetTileQueue() and GetTileQueue(). KS.
+//                  Added ComputeHybrid(). KS.
+//                  Added StartGPUImage() and FinishGPUImage(). KS.
+//                  Added the image cache, with SetImageCacheLimit(), GetImageCacheLimit()
+//                  and GetImageCacheHits(). KS.
+//                  StartGPUImage() can now start perturbation images. KS.
+//                  The image is now an array of uint32_t iteration counts, not floats. KS.
+//                  Added GetImageBuffer(). KS.
+//                  Added StartCPUImage() and FinishCPUImage(). KS.
+//                  Added _bufferHeap. KS.
+//                  Added _dispatchTimer. KS.
+//                  Added the 'Profile' debug level, with CPUProfile() and ReportCPUProfile(). KS.
 
 
 #ifndef __MandelComputeHandler__
@@ -78,6 +144,17 @@
 #include "MetalKit/MetalKit.hpp"
 #include "MsecTimer.h"
 #include "DebugHandler.h"
+#include "CycleTimer.h"
+#include "DoubleDouble.h"
+
+#include <list>
+#include <cstdint>
+#include <vector>
+#include <thread>
+
+class ThreadPool;
+class BufferHeap;
+class DispatchTimer;
 
 //  The MandelComputeDevice type is defined here so a controller can know what sort
 //  of device is expected by the constructor. (A Vulkan version of the controller,
@@ -93,23 +170,45 @@
 class MandelComputeHandler
 {
     public:
+        //  The precisions in which StartGPUImage() can have the GPU compute an image.
+        enum GPUPrecision {GPU_FLOAT,GPU_DOUBLE,GPU_FLOAT_FLOAT,GPU_PERTURBED};
         MandelComputeHandler(MTL::Device* Device);
         ~MandelComputeHandler();
         void Initialise(bool Validate,const std::string& DebugLevels);
         void SetImageSize (int Nx, int Ny);
         void SetCentre(double XCent,double YCent);
+        void MoveCentre(double XOffset,double YOffset);
+        void OffsetCentre(double XOffset,double YOffset);
         void SetMagnification(double Magnification);
         void SetAspect(double Width, double Height);
         void SetMaxIter(int MaxIter);
+        void SetInteriorChecks(bool Enable);
+        bool GetInteriorChecks();
+        void SetTileQueue(bool Enable);
+        bool GetTileQueue();
+        void SetImageCacheLimit(long Bytes);
+        long GetImageCacheLimit();
+        long GetImageCacheHits();
         double GetMagnification();
         bool FloatOK();
         bool DoubleOK();
+        bool FloatFloatOK();
+        bool PerturbedOK();
         bool GPUSupportsDouble();
         void GetCentre(double* XCent,double* YCent);
         void Compute ();
         void ComputeDouble();
+        void ComputeFloatFloat();
+        void ComputePerturbed();
+        void ComputeHybrid();
+        bool StartGPUImage(GPUPrecision Precision);
+        bool FinishGPUImage(GPUPrecision Precision);
+        bool StartCPUImage();
+        bool FinishCPUImage();
         void ComputeInC();
-        float* GetImageData();
+        bool ComputeInCProgressive();
+        uint32_t* GetImageData();
+        MTL::Buffer* GetImageBuffer();
         static std::string GetDebugOptions (void);
     private:
         //  Single structure to pass the arguments to the compute kernel on the GPU
@@ -118,22 +217,89 @@ class MandelComputeHandler
         //  structure could contain the address of the output array as well, but I'm
         //  leaving in two argument buffers just to show that works.) The structure
         //  defined in the .metal code must match this exactly - be wary of alignment
-        //  and size issues.
+        //  and size issues. The low parts given by xCentLo etc. are only used by the
+        //  float-float kernel, which adds them to the single precision values.
         struct MandelArgs {
             float xCent;
             float yCent;
             float dX;
             float dY;
             int maxIter;
+            int nx;
+            int ny;
+            int ixOrigin;
+            int iyOrigin;
+            float xCentLo;
+            float yCentLo;
+            float dXLo;
+            float dYLo;
+            int checks;
+        };
+        //  The arguments for the perturbation kernel, which only needs the pixel scale and the
+        //  length of the reference orbit.
+        struct PerturbArgs {
+            float dX;
+            float dY;
+            int maxIter;
+            int nx;
+            int ny;
+            int refLen;
+        };
+        static void ComputeInCThreads (uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,
+                 prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks,
+                         ThreadPool* Pool = nullptr,CycleProfile* Profile = nullptr);
+        static void ComputeRangeInC (uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        static void ComputeRefineInC (uint32_t* Data,int Nx,int Ny,int Step,bool FirstPass,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        //  A strip of the image, from (Ixst,Iyst) up to (not including) (Ixen,Iyen).
+        struct Strip {
+            int Ixst;
+            int Ixen;
+            int Iyst;
+            int Iyen;
+        };
+        //  How the image in the buffer was computed.
+        enum ImageSource {IMAGE_NONE,IMAGE_GPU,IMAGE_GPU_D,IMAGE_GPU_P,IMAGE_GPU_FF,IMAGE_HYBRID,
+                                                                                 IMAGE_CPU};
+        //  An image held in the image cache, with how it was computed and its parameters.
+        struct CachedImage {
+            ImageSource Source;
+            double XCent;
+            double YCent;
+            double XCentLo;
+            double YCentLo;
+            double Dx;
+            double Dy;
+            int MaxIter;
+            std::vector<uint32_t> Data;
         };
-        static void ComputeInCThreads (float* Data,int Nx,int Ny,prec Xcent,prec Ycent,
-                                                          prec Dx,prec Dy,int MaxIter);
-        static void ComputeRangeInC (float* Data,int Nx,int Ny,int Iyst,int Iyen,
-                                     prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter);
+        static int ReferenceOrbitInC (const DoubleDouble& X0,const DoubleDouble& Y0,int MaxIter,
+                                                                  std::vector<double>& Orbit);
+        static void ComputeStripInC (uint32_t* Data,int Nx,int Ny,const Strip& Area,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        static void ShiftInC (uint32_t* Data,int Nx,int Ny,int ShiftX,int ShiftY);
+        bool ShiftImage(ImageSource Source,std::vector<Strip>& Strips);
+        void NoteImage(ImageSource Source,int Step);
+        bool SameImage();
+        std::list<CachedImage>::iterator FindCachedImage(ImageSource Source);
+        bool ImageFromCache(ImageSource Source);
+        void CacheImage();
+        static ImageSource GPUSource(GPUPrecision Precision);
         void BuildComputeShader ();
         bool FloatOKatXY(int Ix,int Iy);
         bool DoubleOKatXY(int Ix,int Iy);
+        bool FloatFloatOKatXY(int Ix,int Iy);
+        static double FloatFloat(double Value);
+        void ComputeWith(MTL::ComputePipelineState* Function,ImageSource Source);
+        int HybridSplit();
+        void DropNextImage();
+        void SwapNextImage();
+        void NoteHybridRates(int Split,float GPUMsec,float CPUMsec);
+        int PrepareOrbit();
         void RecomputeArgs();
+        CycleProfile* CPUProfile();
+        void ReportCPUProfile();
         static const std::string _debugOptions;
         DebugHandler _debug;
         MTL::CommandQueue* _commandQueue;
@@ -141,8 +307,51 @@ class MandelComputeHandler
         MTL::Size _threadGroupDims;
         MTL::Device* _device;
         MTL::ComputePipelineState* _mandelFunction;
+        //  The float-float kernel, and the thread group shape to use with it.
+        MTL::ComputePipelineState* _mandelFFFunction;
+        MTL::Size _threadGroupDimsFF;
+        //  True if Compute() is to use the tile queue kernel, the kernel itself, and the
+        //  buffer holding the counter it uses as the queue.
+        bool _tileQueue;
+        MTL::ComputePipelineState* _mandelQueueFunction;
+        MTL::Buffer* _queueBuffer;
+        //  The second image buffer, used by StartGPUImage(), with its address, and the command
+        //  buffer computing an image into it, if any. _nextPrecision, _nextArgs and the low
+        //  parts of the centre are what that image was computed with. If StartCPUImage() is
+        //  computing the image instead, _nextThread is the thread doing it, using the threads
+        //  of _aheadPool.
+        MTL::Buffer* _nextBuffer;
+        uint32_t* _nextImageData;
+        MTL::CommandBuffer* _nextCommandBuffer;
+        GPUPrecision _nextPrecision;
+        MandelArgs _nextArgs;
+        double _nextXCentLo;
+        double _nextYCentLo;
+        std::thread _nextThread;
+        ThreadPool* _aheadPool;
+        //  The average rates, in rows a msec, at which the GPU and the CPU have computed their
+        //  parts of the images computed by ComputeHybrid(). Zero if not yet known.
+        double _hybridGPURate;
+        double _hybridCPURate;
+        //  The perturbation kernel, the thread group shape to use with it, the buffer used to
+        //  pass it the reference orbit, and the current size of that buffer.
+        MTL::ComputePipelineState* _mandelPerturbFunction;
+        MTL::Size _threadGroupDimsP;
+        MTL::Buffer* _orbitBuffer;
+        //  The allocator for the image and orbit buffers.
+        BufferHeap* _bufferHeap;
+        //  Times the kernels on the GPU. Slot 1 is used for images started ahead.
+        DispatchTimer* _dispatchTimer;
+        long _orbitBytes;
+        std::vector<double> _orbit;
         double _xCent;
         double _yCent;
+        //  The low parts of the centre, which with _xCent and _yCent make up DoubleDouble
+        //  values, and the part of the offsets passed to MoveCentre() not yet applied.
+        double _xCentLo;
+        double _yCentLo;
+        double _xMoveLeft;
+        double _yMoveLeft;
         double _magnification;
         double _width;
         double _height;
@@ -150,10 +359,32 @@ class MandelComputeHandler
         double _dy;
         MandelArgs _currentArgs;
         MTL::Buffer* _outputBuffer;
-        float* _imageData;
+        uint32_t* _imageData;
         int _maxiter;
+        //  True if the checks that save iterating points inside the set are to be used.
+        bool _interiorChecks;
         int _nx;
         int _ny;
+        //  How the image in the buffer was computed, the block size for the next pass of
+        //  ComputeInCProgressive() - zero if the image is complete - and its parameters.
+        ImageSource _imageSource;
+        int _imageStep;
+        double _imageXCent;
+        double _imageYCent;
+        double _imageXCentLo;
+        double _imageYCentLo;
+        double _imageDx;
+        double _imageDy;
+        int _imageMaxIter;
+        //  The image cache, most recently used image first, the most memory in bytes it can
+        //  use, and the number of images taken from it so far.
+        std::list<CachedImage> _imageCache;
+        long _imageCacheLimit;
+        long _imageCacheHits;
+        //  The bit for the 'Profile' debug level, and the times taken by the CPU tiles of the
+        //  image being computed, recorded when that level is active.
+        DebugHandler::LevelBits _profileDebug;
+        CycleProfile _cpuProfile;
 };
 
 #endif
@@ -36,10 +36,95 @@
 //                  maximum iterations will not be changed after initially being set in the
 //                  Initialise() call, and the controller handles changes to centre and
 //                  magnification in response to cursor and key events. KS.
+//     15 Oct 2026. When not zooming, images computed using the CPU are now drawn a pass at a
+//                  time, coarse to fine, using ComputeInCProgressive(), so a slow image doesn't
+//                  freeze the display. Draw() keeps asking for a redraw until it's complete. KS.
+//                  Dragging the image now moves its centre using MoveCentre(). KS.
+//                  Beyond the magnifications double precision can handle, images are now
+//                  computed on the GPU using ComputePerturbed(). Zooming, dragging and 'j' now
+//                  move the centre by an offset, so it keeps its full precision. KS.
+//                  On GPUs without double precision, auto mode now uses the float-float
+//                  ComputeFloatFloat() before falling back on the CPU, as does GPU mode. KS.
+//                  Added the 'b' key, to toggle the interior checks. KS.
+//                  Added the 'q' key, to toggle the GPU tile queue. Zoom timings now say
+//                  whether GPU images used it. KS.
+//                  Where auto mode used GPU double precision or float-float, it now shares
+//                  each image between the GPU and the CPU, using ComputeHybrid(). The 'y' key
+//                  toggles this. Added USE_HYBRID and its zoom counts. KS.
+//                  When zooming, the GPU now computes the next image while the current one is
+//                  being drawn, using StartGPUImage(). Added SelectMode(), GPUPrecisionFor()
+//                  and the 'u' key, which toggles this. KS.
+//                  Added the 'k' key, to toggle the compute handler's image cache. When it's
+//                  in use, a timed zoom now retraces its way in on the way out, so it can
+//                  reuse the cached images, and reports how many it used. KS.
+//                  Perturbation images are now also computed ahead when zooming. KS.
+//                  Added the 'n' key, which toggles an automatic iteration limit, set by
+//                  AdjustIterations() from the histogram of the last image drawn. KS.
+//                  Added the 'v' key, which toggles an interactive mode, where images are
+//                  computed at reduced resolution while the user drags or scrolls, chosen by
+//                  InteractiveScale() to keep up with the display, and at full resolution once
+//                  the input has been idle for a moment. KS.
+//                  Added the 'f' key, which runs a benchmark along a zoom path read from a
+//                  file, with a fixed number of frames, writing the timings and compute mode
+//                  for each frame to a CSV file. KS.
+//                  Image data from the compute handler is now uint32_t. KS.
+//                  Added the '.' key, which switches the renderer between drawing the image
+//                  as a single quad and as a triangle strip. KS.
+//                  If the compute handler and renderer share a device, the renderer now draws
+//                  the image straight from the compute handler's buffer, so the image doesn't
+//                  have to be copied by the CPU. KS.
+//                  The render times and frame intervals in a zoom, and the input to present
+//                  latencies, are now collected in MsecStats, and reported as distributions
+//                  rather than just averages. KS.
+//                  The latency from each drag or scroll to the drawing of the first image that
+//                  reflects it is now measured, and the ',' key reports statistics on it. KS.
+//                  The view coordinates of a Mandelbrot path are now converted into arrays
+//                  allocated along with the path, rather than ones allocated for each redraw. KS.
+//                  When zooming with the CPU, the next image is now started ahead by the
+//                  compute handler's StartCPUImage(), as it already was for the GPU, so the
+//                  CPU computes each image while the one before is coloured and presented. KS.
+//                  Added the '/' key, which starts and stops the renderer capturing each
+//                  frame drawn to a file, for making videos. KS.
+//                  Added the '=' key, which toggles a mode where the image size follows the
+//                  size of the view, so each pixel computed is one pixel displayed. KS.
+//                  The route arrays are now freed by the destructor. KS.
 
 #include "MandelController.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cctype>
+#include <cstdlib>
+
+//  The range of iteration limits AdjustIterations() can set. It raises the limit by a factor
+//  C_AutoIterRaise if more than a fraction C_AutoIterNear of the pixels only escaped in the
+//  top part of the range, above a fraction C_AutoIterTop of the limit. The lowest limit it
+//  will set is C_AutoIterMin multiplied by one more than the log of the magnification.
+
+static const int C_AutoIterMin = 64;
+static const int C_AutoIterMax = 65536;
+static const double C_AutoIterRaise = 1.5;
+static const double C_AutoIterNear = 0.001;
+static const double C_AutoIterTop = 0.875;
+
+//  In interactive mode, the image size is reduced by up to a factor C_InteractiveMaxScale in
+//  each dimension, to bring the compute time below C_InteractiveMsec, until there has been no
+//  drag or scroll input for C_InteractiveIdleMsec.
+
+static const int C_InteractiveMaxScale = 8;
+static const float C_InteractiveMsec = 16.0;
+static const float C_InteractiveIdleMsec = 250.0;
+
+//  A benchmark run draws C_BenchFrames frames along the zoom path read from C_BenchPathFile,
+//  writing the timings to C_BenchCsvFile.
+
+static const int C_BenchFrames = 600;
+static const char* const C_BenchPathFile = "MandelPath.txt";
+static const char* const C_BenchCsvFile = "MandelBench.csv";
+
+//  The '/' key captures the frames drawn to files whose names start with C_CapturePrefix.
+
+static const char* const C_CapturePrefix = "MandelFrame";
 
 MandelController::MandelController (void)
 {
@@ -60,20 +145,49 @@ MandelController::MandelController (void)
     _ZoomFramesCPU = 0;
     _ZoomFramesGPU = 0;
     _ZoomFramesGPU_D = 0.0;
+    _ZoomFramesGPU_P = 0;
+    _ZoomFramesGPU_FF = 0;
+    _ZoomFramesHybrid = 0;
     _LastZoomMsec = 0.0;
     _TotalComputeMsecCPU = 0.0;
     _TotalComputeMsecGPU = 0.0;
     _TotalComputeMsecGPU_D = 0.0;
-    _TotalRenderMsec = 0.0;
+    _TotalComputeMsecGPU_P = 0.0;
+    _TotalComputeMsecGPU_FF = 0.0;
+    _TotalComputeMsecHybrid = 0.0;
     _ComputeMode = AUTO_MODE;
     _GPUSupportsDouble = false;
     _ScaleMagByTime = true;
+    _Hybrid = true;
+    _ComputeAhead = true;
+    _ImageCacheLimit = 0;
+    _AutoIter = false;
+    _CurrentIter = 1024;
+    _Interactive = false;
+    _QuadDraw = true;
+    _Capturing = false;
+    _FollowView = false;
+    _ViewResized = false;
+    _SharedDevice = false;
+    _InputPending = false;
+    _ImageNx = 1024;
+    _ImageNy = 1024;
+    _ImageScale = 1;
+    _FullResMsec = 0.0;
+    _ComputedMagnification = 0.0;
+    _ZoomCacheHits = 0;
+    _BenchFrame = 0;
+    _BenchFile = nullptr;
+    _BenchTotalMsec = 0.0;
+    _BenchCacheLimit = 0;
     _RouteX = nullptr;
     _RouteY = nullptr;
+    _RouteAtX = nullptr;
+    _RouteAtY = nullptr;
     _RouteN = 0;
     _InDrag = false;
-    _DragImageX = 0.0;
-    _DragImageY = 0.0;
+    _DragFrameX = 0.0;
+    _DragFrameY = 0.0;
     _Drawing = false;
     SetMemoriesToDefault();
 }
@@ -85,6 +199,7 @@ void MandelController::Initialise(MandelComputeDevice* ComputeDevice,
     //  Create the compute handler and renderer, and initialise them.
     
     _View = View;
+    _SharedDevice = ((void*)ComputeDevice == (void*)RendererDevice);
     _ComputeHandler = new MandelComputeHandler(ComputeDevice);
     _Renderer = new Renderer(RendererDevice);
     if (_ComputeHandler) {
@@ -103,10 +218,13 @@ void MandelController::Initialise(MandelComputeDevice* ComputeDevice,
     
     _RouteX = (double*) malloc(Iter * sizeof(double));
     _RouteY = (double*) malloc(Iter * sizeof(double));
+    _RouteAtX = (float*) malloc(Iter * sizeof(float));
+    _RouteAtY = (float*) malloc(Iter * sizeof(float));
     
     //  Set the default image size and iteration count to the passed values.
     
     _Iter = Iter;
+    _CurrentIter = Iter;
     _BaseNx = Nx;
     _BaseNy = Ny;
     SetImageSize(Nx,Ny);
@@ -116,8 +234,13 @@ void MandelController::Initialise(MandelComputeDevice* ComputeDevice,
 
 MandelController::~MandelController()
 {
+    if (_BenchFile) fclose(_BenchFile);
     if (_Renderer) delete(_Renderer);
     if (_ComputeHandler) delete(_ComputeHandler);
+    if (_RouteX) free(_RouteX);
+    if (_RouteY) free(_RouteY);
+    if (_RouteAtX) free(_RouteAtX);
+    if (_RouteAtY) free(_RouteAtY);
 }
 
 //  Introduce the controller to its request handler.
@@ -130,10 +253,63 @@ void MandelController::SetAppContact (MandelAppContact* Contact)
 //  Set the image size to be used by the compute handler, and notify the renderer.
 void MandelController::SetImageSize(int Nx, int Ny)
 {
+    _ImageNx = Nx;
+    _ImageNy = Ny;
+    _ImageScale = 1;
+    _ComputedMagnification = 0.0;
     if (_ComputeHandler) _ComputeHandler->SetImageSize(Nx,Ny);
     if (_Renderer) _Renderer->SetImageSize(Nx,Ny);
 }
 
+//  Have the compute handler work at the image size reduced by a factor Scale in each dimension.
+//  The renderer stretches whatever size of image it is given to fill the view, so it just needs
+//  to know the new size.
+void MandelController::SetImageScale(int Scale)
+{
+    _ImageScale = Scale;
+    int Nx = std::max(_ImageNx / Scale,16);
+    int Ny = std::max(_ImageNy / Scale,16);
+    if (_ComputeHandler) _ComputeHandler->SetImageSize(Nx,Ny);
+    if (_Renderer) _Renderer->SetImageSize(Nx,Ny);
+}
+
+//  InteractiveScale() returns the smallest factor by which reducing the image size in each
+//  dimension should bring the compute time within the target frame time, using the estimated
+//  time for a full resolution image.
+int MandelController::InteractiveScale()
+{
+    int Scale = 1;
+    while (Scale < C_InteractiveMaxScale &&
+                           _FullResMsec > C_InteractiveMsec * float(Scale * Scale)) Scale *= 2;
+    return Scale;
+}
+
+//  NoteInput() is called for each drag or scroll. It restarts the timer used to tell when the
+//  input has gone idle and, unless an earlier input is still waiting to be drawn, starts the
+//  timer for the latency from this input to the first image drawn after it - see Draw().
+void MandelController::NoteInput()
+{
+    _InputTimer.Restart();
+    if (!_InputPending) {
+        _LatencyTimer.Restart();
+        _InputPending = true;
+    }
+}
+
+//  ReportLatency() outputs statistics on the latencies from drags or scrolls to the images that
+//  reflect them being drawn, collected since the last time it was called. The latency ends when
+//  the renderer has handed the frame to be presented, so how long it then waits for the display
+//  depends on the presentation mode and the number of swap chain images.
+void MandelController::ReportLatency()
+{
+    if (_LatencyStats.Count() == 0) {
+        printf ("No input to present latencies recorded since the last report\n");
+        return;
+    }
+    _LatencyStats.Report("Input to present latency");
+    _LatencyStats.Clear();
+}
+
 //  This specifies the dimensions of the view. The renderer needs to know these.
 //  The compute handler does not need to know the actual dimensions, but it does need
 //  to know the aspect ratio that will be used to display the image. This will be called
@@ -144,16 +320,32 @@ void MandelController::SetViewSize(double Width, double Height)
     _FrameY = float(Height);
     if (_ComputeHandler) _ComputeHandler->SetAspect(Width,Height);
     if (_Renderer) _Renderer->SetDrawableSize(float(Width),float(Height));
+    _ViewResized = true;
     _NeedToRedraw = true;
 }
 
+//  If the image size is to follow the view, set it to the view size. This is called by Draw(),
+//  rather than by SetViewSize(), so a run of resizes while a window is dragged to a new size
+//  only changes the image size once for each frame. Most changes cost very little, since the
+//  compute handler and renderer only reallocate their buffers when they need to grow.
+void MandelController::FollowViewSize()
+{
+    if (_FollowView && _ViewResized) {
+        int Nx = std::max(int(_FrameX),16);
+        int Ny = std::max(int(_FrameY),16);
+        if (Nx != _ImageNx || Ny != _ImageNy) SetImageSize(Nx,Ny);
+    }
+    _ViewResized = false;
+}
+
 //  Called whenever the scroll wheel has been moved.
 void MandelController::ScrollWheel (float DeltaX, float DeltaY, float AtX, float AtY)
 {
+    if (_ZoomMode == ZOOM_PATH) return;
     if (_ComputeHandler && DeltaY != 0.0) {
-        double XCoord = 0.0;
-        double YCoord = 0.0;
-        FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
+        double XOffset = 0.0;
+        double YOffset = 0.0;
+        FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
         double Magnification = _ComputeHandler->GetMagnification();
         double NewMagnification = Magnification;
         if (DeltaY > 0.0) NewMagnification = Magnification * (1.0 + 0.01 * DeltaY);
@@ -162,24 +354,16 @@ void MandelController::ScrollWheel (float DeltaX, float DeltaY, float AtX, float
         _ComputeHandler->SetMagnification(Magnification);
         RedisplayTitle();
         
-        //  With the new magnification, this reworks the calculation done
-        //  by frameToImageCoord to work out what new center coordinates
-        //  will keep the point currently under the cursor at the same
-        //  point in screen coordinates.
+        //  With the new magnification, the point under the cursor is at a different offset
+        //  from the centre. Moving the centre by the difference puts it back under the
+        //  cursor. (Working with offsets, rather than with the coordinates themselves, keeps
+        //  the full precision of the centre at high magnifications.)
         
-        double CoordRangeInX = 2.0;
-        double FrameWidth = _FrameX;
-        double DistFromFrameCentX = FrameWidth * 0.5 - AtX;
-        double XCoordFromCent =
-             DistFromFrameCentX * CoordRangeInX / (FrameWidth * Magnification);
-        double xCent = XCoord + XCoordFromCent;
-        double FrameHeight = _FrameY;
-        double CoordRangeInY = 2.0 * FrameHeight / FrameWidth;
-        double DistFromFrameCentY = FrameHeight * 0.5 - AtY;
-        double YCoordFromCent =
-             DistFromFrameCentY * CoordRangeInY / (FrameHeight * Magnification);
-        double yCent = YCoord + YCoordFromCent;
-        _ComputeHandler->SetCentre(xCent,yCent);
+        double NewXOffset = 0.0;
+        double NewYOffset = 0.0;
+        FrameToImageOffset(AtX,AtY,&NewXOffset,&NewYOffset);
+        _ComputeHandler->OffsetCentre(XOffset - NewXOffset,YOffset - NewYOffset);
+        NoteInput();
         _NeedToRedraw = true;
     }
 }
@@ -203,6 +387,18 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
     
     if (*Key == 'h') PrintHelp();
     
+    //  A benchmark run has to follow its path undisturbed, so 'f', which cancels it, is the
+    //  only other key that has any effect while one is in progress.
+    
+    if (_ZoomMode == ZOOM_PATH) {
+        if (*Key == 'f') EndBenchmark(false);
+        return;
+    }
+    
+    //  Start a benchmark run.
+    
+    if (*Key == 'f' && _ComputeHandler) StartBenchmark();
+    
     if (_ComputeHandler) {
         double Magnification = _ComputeHandler->GetMagnification();
         
@@ -248,10 +444,10 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
         //  Center the image on the point under the cursor.
         
         if (*Key == 'j') {
-            double XCoord = 0.0;
-            double YCoord = 0.0;
-            FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
-            _ComputeHandler->SetCentre(XCoord,YCoord);
+            double XOffset = 0.0;
+            double YOffset = 0.0;
+            FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
+            _ComputeHandler->OffsetCentre(XOffset,YOffset);
             _NeedToRedraw = true;
         }
         
@@ -277,30 +473,49 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
                 _ZoomMode = ZOOM_NONE;
                 float Msec = _ZoomTimer.ElapsedMsec();
                 printf ("Zoom mode cancelled, frame rate = %.2f frames/sec\n",
-                        float(_ZoomFramesCPU + _ZoomFramesGPU_D + _ZoomFramesGPU) * 1000.0 /Msec);
+                        float(_ZoomFramesCPU + _ZoomFramesGPU_D + _ZoomFramesGPU +
+                                   _ZoomFramesGPU_P + _ZoomFramesGPU_FF +
+                                   _ZoomFramesHybrid) * 1000.0 /Msec);
             } else {
                 _ZoomMode = ZOOM_TIMED;
                 _ZoomTimer.Restart();
+                _ZoomPath.clear();
+                _ZoomCacheHits = _ComputeHandler->GetImageCacheHits();
                 _ZoomFramesCPU = 0;
                 _ZoomFramesGPU = 0;
                 _ZoomFramesGPU_D = 0;
+                _ZoomFramesGPU_P = 0;
+                _ZoomFramesGPU_FF = 0;
+                _ZoomFramesHybrid = 0;
                 _TotalComputeMsecCPU = 0.0;
                 _TotalComputeMsecGPU = 0.0;
                 _TotalComputeMsecGPU_D = 0.0;
-                _TotalRenderMsec = 0.0;
+                _TotalComputeMsecGPU_P = 0.0;
+                _TotalComputeMsecGPU_FF = 0.0;
+                _TotalComputeMsecHybrid = 0.0;
+                _RenderStats.Clear();
+                _FrameStats.Clear();
                 _NeedToRedraw = true;
             }
         }
         if (*Key == 'i' || *Key == 'o') {
             if (_ZoomMode == ZOOM_NONE || _ZoomMode == ZOOM_TIMED) {
                 _ZoomTimer.Restart();
+                _ZoomCacheHits = _ComputeHandler->GetImageCacheHits();
                 _ZoomFramesCPU = 0;
                 _ZoomFramesGPU = 0;
                 _ZoomFramesGPU_D = 0;
+                _ZoomFramesGPU_P = 0;
+                _ZoomFramesGPU_FF = 0;
+                _ZoomFramesHybrid = 0;
                 _TotalComputeMsecCPU = 0.0;
                 _TotalComputeMsecGPU = 0.0;
                 _TotalComputeMsecGPU_D = 0.0;
-                _TotalRenderMsec = 0.0;
+                _TotalComputeMsecGPU_P = 0.0;
+                _TotalComputeMsecGPU_FF = 0.0;
+                _TotalComputeMsecHybrid = 0.0;
+                _RenderStats.Clear();
+                _FrameStats.Clear();
                 _NeedToRedraw = true;
             }
             if (*Key == 'i') _ZoomMode = ZOOM_IN;
@@ -322,11 +537,30 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
         
         //  Allows the image size to be changed, showing the effect on resolution.
         
+        //  Any of these stops the image size following the view size.
+        
+        if (*Key == 'l' || *Key == 'm' || *Key == 's' || *Key == 't') _FollowView = false;
         if (*Key == 'l') { SetImageSize(_BaseNx * 2,_BaseNy * 2); _NeedToRedraw = true; }
         if (*Key == 'm') { SetImageSize(_BaseNx,_BaseNy); _NeedToRedraw = true; }
         if (*Key == 's') { SetImageSize(_BaseNx / 2,_BaseNy / 2); _NeedToRedraw = true; }
         if (*Key == 't') { SetImageSize(_BaseNx / 4,_BaseNy / 4); _NeedToRedraw = true; }
         
+        //  Toggle having the image size follow the view size, so the number of pixels computed
+        //  matches the number displayed, instead of stretching an image of fixed size.
+        
+        if (*Key == '=') {
+            _FollowView = !_FollowView;
+            if (_FollowView) {
+                _ViewResized = true;
+                FollowViewSize();
+                printf ("Image size now follows the view, %d by %d\n",_ImageNx,_ImageNy);
+            } else {
+                SetImageSize(_BaseNx,_BaseNy);
+                printf ("Image size now fixed at %d by %d\n",_ImageNx,_ImageNy);
+            }
+            _NeedToRedraw = true;
+        }
+        
         //  Enable or disable the weighting of the magnification during zoom to compensate
         //  for the time for the computation.
         
@@ -337,6 +571,102 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
             else printf ("disabled\n");
         }
         
+        //  Toggle the checks that save iterating points inside the set, for benchmarking.
+        
+        if (*Key == 'b') {
+            bool Checks = !_ComputeHandler->GetInteriorChecks();
+            _ComputeHandler->SetInteriorChecks(Checks);
+            printf ("Cardioid, bulb and periodicity checks %s\n",Checks ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle the automatic iteration limit. When it's turned off, the limit goes back to
+        //  the one the program started with.
+        
+        if (*Key == 'n') {
+            _AutoIter = !_AutoIter;
+            if (!_AutoIter) SetIterations(_Iter);
+            printf ("Automatic iteration limit %s\n",_AutoIter ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle interactive mode. When it's turned off, any reduced image goes back to full
+        //  resolution.
+        
+        if (*Key == 'v') {
+            _Interactive = !_Interactive;
+            printf ("Reduced resolution while dragging or scrolling %s\n",
+                                                     _Interactive ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle between drawing the image as a single quad and as a triangle strip.
+        
+        if (*Key == '.' && _Renderer) {
+            _QuadDraw = !_QuadDraw;
+            bool Quad = _Renderer->SetQuadDraw(_QuadDraw);
+            printf ("Image drawn as %s\n",Quad ? "a single quad" : "a triangle strip");
+            _NeedToRedraw = true;
+        }
+        
+        //  Report the input to present latency statistics.
+        
+        if (*Key == ',') ReportLatency();
+        
+        //  Start or stop capturing the frames drawn to files. Drawing isn't held up to do this,
+        //  so if the files can't be written quickly enough some frames are dropped.
+        
+        if (*Key == '/' && _Renderer) {
+            if (_Capturing) {
+                int Frames = 0;
+                int Dropped = 0;
+                _Renderer->StopCapture(&Frames,&Dropped);
+                _Capturing = false;
+                printf ("Frame capture stopped, %d frames written to %s_*.ppm, %d dropped\n",
+                                                               Frames,C_CapturePrefix,Dropped);
+            } else if (_Renderer->StartCapture(C_CapturePrefix)) {
+                _Capturing = true;
+                printf ("Capturing frames to %s_*.ppm\n",C_CapturePrefix);
+            } else {
+                printf ("Frame capture is not supported\n");
+            }
+        }
+        
+        //  Toggle the sharing of images between the GPU and CPU in auto mode.
+        
+        if (*Key == 'y') {
+            _Hybrid = !_Hybrid;
+            printf ("Sharing of images between GPU and CPU %s\n",_Hybrid ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle the computing of the next zoom image while the current one is drawn.
+        
+        if (*Key == 'u') {
+            _ComputeAhead = !_ComputeAhead;
+            printf ("Computing zoom images ahead %s\n",
+                                                     _ComputeAhead ? "enabled" : "disabled");
+        }
+        
+        //  Toggle the image cache. Its limit is kept while it's disabled, so it can be restored.
+        
+        if (*Key == 'k') {
+            long Limit = _ComputeHandler->GetImageCacheLimit();
+            _ComputeHandler->SetImageCacheLimit(_ImageCacheLimit);
+            _ImageCacheLimit = Limit;
+            printf ("Image cache %s\n",Limit == 0 ? "enabled" : "disabled");
+        }
+        
+        //  Toggle the GPU tile queue, also for benchmarking - compare 'z' timings with it
+        //  enabled and disabled.
+        
+        if (*Key == 'q') {
+            bool Queue = !_ComputeHandler->GetTileQueue();
+            _ComputeHandler->SetTileQueue(Queue);
+            printf ("GPU tile queue %s\n",Queue ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
         //  Calculate the track of a Mandelbrot calculation from the point under the cursor.
         
         if (*Key == 'd') {
@@ -377,21 +707,33 @@ void MandelController::KeyUp (const char* Key, long Flags, float AtX, float AtY)
         //  The only key releases we care about are the 'i' and 'o' keys, which
         //  cancel the zoom in/out modes.
         
-        if (*Key == 'i' || *Key == 'o') {
+        if ((*Key == 'i' || *Key == 'o') && _ZoomMode != ZOOM_PATH) {
             _ZoomMode = ZOOM_NONE;
             float Msec = _ZoomTimer.ElapsedMsec();
-            int ZoomFrames = _ZoomFramesGPU + + _ZoomFramesGPU_D + _ZoomFramesCPU;
+            int ZoomFrames = _ZoomFramesGPU + + _ZoomFramesGPU_D + _ZoomFramesGPU_P +
+                                                       _ZoomFramesGPU_FF + _ZoomFramesHybrid +
+                                                                         _ZoomFramesCPU;
             printf ("Frame rate = %.2f frames/sec\n",float(ZoomFrames) * 1000.0 /Msec);
             printf ("Average compute time:");
-            if (_ZoomFramesGPU > 0) printf (" %.2f msec (GPU)",
-                                            _TotalComputeMsecGPU / float(_ZoomFramesGPU));
+            if (_ZoomFramesGPU > 0) printf (" %.2f msec (GPU%s)",
+                                            _TotalComputeMsecGPU / float(_ZoomFramesGPU),
+                                   _ComputeHandler->GetTileQueue() ? ", tile queue" : "");
             if (_ZoomFramesGPU_D > 0) printf (" %.2f msec (GPU-D)",
                                             _TotalComputeMsecGPU_D / float(_ZoomFramesGPU_D));
+            if (_ZoomFramesGPU_P > 0) printf (" %.2f msec (GPU-P)",
+                                            _TotalComputeMsecGPU_P / float(_ZoomFramesGPU_P));
+            if (_ZoomFramesGPU_FF > 0) printf (" %.2f msec (GPU-FF)",
+                                            _TotalComputeMsecGPU_FF / float(_ZoomFramesGPU_FF));
+            if (_ZoomFramesHybrid > 0) printf (" %.2f msec (GPU+CPU)",
+                                            _TotalComputeMsecHybrid / float(_ZoomFramesHybrid));
             if (_ZoomFramesCPU > 0) printf (" %.2f msec (CPU)",
                                             _TotalComputeMsecCPU / float(_ZoomFramesCPU));
             printf ("\n");
-            if (ZoomFrames > 0) printf ("Average render time: %.2f msec\n",
-                                                    _TotalRenderMsec / float(ZoomFrames));
+            if (ZoomFrames > 0) {
+                printf ("Average render time: %.2f msec\n",_RenderStats.Mean());
+                _RenderStats.Report("Render time");
+                _FrameStats.Report("Frame interval");
+            }
         }
     }
 }
@@ -404,16 +746,20 @@ void MandelController::MouseMoved (float AtX, float AtY)
     if (_InDrag) {
         
         //  Calculate the image coordinate difference between the image point below the
-        //  cursor and the image point where the drag started. This is the correction to
-        //  the image center needed to reposition the image so the cursor is now above
-        //  that start point in the image.
+        //  cursor and the image point below it when it last moved. This is the correction to
+        //  the image center needed to reposition the image so the cursor is still above
+        //  the same point in the image. The centre moves by a whole number of pixels, so
+        //  the compute handler can shift the last image and only compute what comes into view.
+        //  (Working with offsets from the centre, rather than the image coordinates, keeps
+        //  the full precision of the centre at high magnifications.)
         
-        FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
-        double XOffset = _DragImageX - XCoord;
-        double YOffset = _DragImageY - YCoord;
-        double XCent,YCent;
-        _ComputeHandler->GetCentre(&XCent,&YCent);
-        _ComputeHandler->SetCentre(XCent + XOffset,YCent + YOffset);
+        double LastXOffset,LastYOffset,XOffset,YOffset;
+        FrameToImageOffset(_DragFrameX,_DragFrameY,&LastXOffset,&LastYOffset);
+        FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
+        _ComputeHandler->MoveCentre(LastXOffset - XOffset,LastYOffset - YOffset);
+        _DragFrameX = AtX;
+        _DragFrameY = AtY;
+        NoteInput();
         _NeedToRedraw = true;
     }
     if (_Drawing) {
@@ -441,13 +787,10 @@ void MandelController::MouseUp (float AtX, float AtY)
 //  Called whenever the user clicks down on the mouse with the cursor in the view.
 void MandelController::MouseDown (float AtX, float AtY)
 {
-    if (_ComputeHandler) {
-        double XCoord = 0.0;
-        double YCoord = 0.0;
-        FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
+    if (_ComputeHandler && _ZoomMode != ZOOM_PATH) {
         _InDrag = true;
-        _DragImageX = XCoord;
-        _DragImageY = YCoord;
+        _DragFrameX = AtX;
+        _DragFrameY = AtY;
     }
 }
 
@@ -481,6 +824,63 @@ void MandelController::SetMemoriesToDefault()
     SetMemory(9,0.270925,0.004725,15000.0);
 }
 
+//  SelectMode() returns the way the image should be computed using the current settings.
+
+MandelController::UseMode MandelController::SelectMode()
+{
+    //  Use either the CPU or GPU. In auto mode, use the GPU unless floating point
+    //  rounding error at the current settings will be a problem, in which case use
+    //  double precision on the GPU if it has it, or float-float arithmetic on the GPU if
+    //  that's good enough, or the CPU. Those GPU modes are much slower than single precision,
+    //  so unless disabled, auto mode shares those images between the GPU and the CPU. Once
+    //  even double precision isn't enough, use the GPU again, but computing perturbations
+    //  from a reference orbit, both in auto mode and when the GPU has been selected.
+    
+    bool FloatOK = _ComputeHandler->FloatOK();
+    bool DoubleOK = FloatOK || _ComputeHandler->DoubleOK();
+    UseMode ModeToUse = USE_NONE;
+    if (_ComputeMode == AUTO_MODE) {
+        if (FloatOK) {
+            ModeToUse = USE_GPU;
+        } else if (!DoubleOK) {
+            ModeToUse = USE_GPU_P;
+        } else {
+            if (_GPUSupportsDouble) {
+                ModeToUse = USE_GPU_D;
+            } else if (_ComputeHandler->FloatFloatOK()) {
+                ModeToUse = USE_GPU_FF;
+            } else {
+                ModeToUse = USE_CPU;
+            }
+            if (_Hybrid && ModeToUse != USE_CPU) ModeToUse = USE_HYBRID;
+        }
+    } else if (_ComputeMode == CPU_MODE) {
+        ModeToUse = USE_CPU;
+    } else {
+        ModeToUse = USE_GPU;
+        if (!DoubleOK) {
+            ModeToUse = USE_GPU_P;
+        } else if (!FloatOK) {
+            ModeToUse = _GPUSupportsDouble ? USE_GPU_D : USE_GPU_FF;
+        }
+    }
+    return ModeToUse;
+}
+
+//  GPUPrecisionFor() returns true if the given mode computes the image using the GPU alone, in
+//  which case the image can be started ahead of time, and sets the precision for that mode.
+
+bool MandelController::GPUPrecisionFor (
+                            UseMode Mode,MandelComputeHandler::GPUPrecision* Precision)
+{
+    if (Mode == USE_GPU) *Precision = MandelComputeHandler::GPU_FLOAT;
+    else if (Mode == USE_GPU_D) *Precision = MandelComputeHandler::GPU_DOUBLE;
+    else if (Mode == USE_GPU_FF) *Precision = MandelComputeHandler::GPU_FLOAT_FLOAT;
+    else if (Mode == USE_GPU_P) *Precision = MandelComputeHandler::GPU_PERTURBED;
+    else return false;
+    return true;
+}
+
 //  Invoked when the view needs to be drawn or redrawn. This will be called first as soon
 //  as the program starts up and the window and view are created. Then it will be called
 //  at whatever frame rate the program has set - usually 60 frames/sec. It is possible to
@@ -491,48 +891,87 @@ void MandelController::Draw()
 {
     //  Most of the time, there's nothing that needs doing. If anything has changed that
     //  will have an effect on the image (zooming, changing image center, for example),
-    //  _NeedToRedraw should have been set.
+    //  _NeedToRedraw should have been set. In interactive mode, an image computed at reduced
+    //  resolution while the user was dragging or scrolling has to be replaced by one at full
+    //  resolution once the input has been idle for a while.
+    
+    FollowViewSize();
+    
+    bool Idle = _InputTimer.ElapsedMsec() > C_InteractiveIdleMsec;
+    if (_ImageScale > 1 && (Idle || !_Interactive)) _NeedToRedraw = true;
     
     if (_NeedToRedraw && _Renderer && _ComputeHandler) {
         
-        //  Get the compute handler to recompute the image using the current settings,
-        //  using either the CPU or GPU. In auto mode, use the GPU unless floating point
-        //  rounding error at the current settings will be a problem, in which case use
-        //  the CPU.
+        //  In interactive mode, while input keeps arriving, the image is computed at a size
+        //  reduced enough to keep up with it. (Not when zooming, where the image changes
+        //  with every frame anyway, and the frame rates at full resolution are of interest.)
         
-        bool FloatOK = _ComputeHandler->FloatOK();
-        UseMode ModeToUse = USE_NONE;
-        if (_ComputeMode == AUTO_MODE) {
-            if (FloatOK) {
-                ModeToUse = USE_GPU;
-            } else {
-                if (_GPUSupportsDouble) {
-                    ModeToUse = USE_GPU_D;
-                } else {
-                    ModeToUse = USE_CPU;
-                }
-            }
-        } else if (_ComputeMode == CPU_MODE) {
-            ModeToUse = USE_CPU;
-        } else {
-            ModeToUse = USE_GPU;
-            if (!FloatOK && _GPUSupportsDouble) {
-                ModeToUse = USE_GPU_D;
-            }
-        }
+        int Scale = 1;
+        if (_Interactive && !Idle && _ZoomMode == ZOOM_NONE) Scale = InteractiveScale();
+        bool Resized = (Scale != _ImageScale);
+        if (Resized) SetImageScale(Scale);
+        
+        //  Work out how the image is to be computed, and get the compute handler to compute
+        //  it. If the GPU was started on this image while the last one was being drawn (see
+        //  below), it just has to be waited for.
+        
+        UseMode ModeToUse = SelectMode();
+        
+        //  When the CPU is used, and we aren't zooming, the image is computed a pass at a time,
+        //  starting with every 8th pixel, and each pass is drawn as it is completed, so that
+        //  the display keeps up with the user. If the view changes before the image is
+        //  complete, the compute handler starts again with a new image. (When zooming, the
+        //  image changes with every frame anyway, and the frame rates are of interest, so
+        //  the full image is always computed.)
+        
+        bool ImageComplete = true;
+        MsecTimer FrameTimer;
         MsecTimer ComputeTimer;
+        bool Ahead = false;
+        MandelComputeHandler::GPUPrecision Precision;
+        if (GPUPrecisionFor(ModeToUse,&Precision)) {
+            Ahead = _ComputeHandler->FinishGPUImage(Precision);
+        }
         if (ModeToUse == USE_GPU) {
-            _ComputeHandler->Compute();
+            if (!Ahead) _ComputeHandler->Compute();
             _TotalComputeMsecGPU += ComputeTimer.ElapsedMsec();
         } else if (ModeToUse == USE_GPU_D) {
-            _ComputeHandler->ComputeDouble();
+            if (!Ahead) _ComputeHandler->ComputeDouble();
             _TotalComputeMsecGPU_D += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_GPU_P) {
+            if (!Ahead) _ComputeHandler->ComputePerturbed();
+            _TotalComputeMsecGPU_P += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_GPU_FF) {
+            if (!Ahead) _ComputeHandler->ComputeFloatFloat();
+            _TotalComputeMsecGPU_FF += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_HYBRID) {
+            _ComputeHandler->ComputeHybrid();
+            _TotalComputeMsecHybrid += ComputeTimer.ElapsedMsec();
         } else if (ModeToUse == USE_CPU) {
-            _ComputeHandler->ComputeInC();
+            if (_ZoomMode == ZOOM_NONE) {
+                ImageComplete = _ComputeHandler->ComputeInCProgressive();
+            } else {
+                Ahead = _ComputeHandler->FinishCPUImage();
+                if (!Ahead) _ComputeHandler->ComputeInC();
+            }
             _TotalComputeMsecCPU += ComputeTimer.ElapsedMsec();
         } else {
             printf ("**Internal error, compute mode unspecified**\n");
         }
+        float ComputeMsec = ComputeTimer.ElapsedMsec();
+        
+        //  The time taken gives an estimate of the time for a full resolution image, which sets
+        //  the image size to use next time the user drags or scrolls. Only images computed in
+        //  full are any guide - not those computed a pass at a time, or those where a drag
+        //  let the compute handler shift the last image and just fill in the edges. (A change
+        //  in magnification or image size rules that out.)
+        
+        double Magnification = _ComputeHandler->GetMagnification();
+        bool Progressive = (ModeToUse == USE_CPU && _ZoomMode == ZOOM_NONE);
+        if (!Progressive && !Ahead && (Resized || Magnification != _ComputedMagnification)) {
+            _FullResMsec = ComputeMsec * float(_ImageScale * _ImageScale);
+        }
+        _ComputedMagnification = Magnification;
                 
         //  If the mode (CPU/GPU) has changed, we need to show this in the window title.
         //  Note that RedisplayTitle() uses _LastUsedMode so this has to be set before
@@ -550,28 +989,18 @@ void MandelController::Draw()
         //  this point.
         
         if (_RouteN > 0) {
-            float* XPosns = (float*)malloc(_Iter * sizeof(float));
-            float* YPosns = (float*)malloc(_Iter * sizeof(float));
-            ImageToFrameCoord(_RouteX,_RouteY,XPosns,YPosns,_RouteN);
-            _Renderer->SetOverlay(XPosns,YPosns,_RouteN);
-            free (XPosns);
-            free (YPosns);
+            ImageToFrameCoord(_RouteX,_RouteY,_RouteAtX,_RouteAtY,_RouteN);
+            _Renderer->SetOverlay(_RouteAtX,_RouteAtY,_RouteN);
         } else {
             _Renderer->SetOverlay(nullptr,nullptr,0);
         }
         
-        //  Get the renderer to draw the new image into the view, getting its address
-        //  from the compute handler.
-        
-        float* ImageData = _ComputeHandler->GetImageData();
-        MsecTimer RenderTimer;
-        _Renderer->Draw(_View,ImageData);
-        _TotalRenderMsec += RenderTimer.ElapsedMsec();
-        _NeedToRedraw = false;
+        _NeedToRedraw = !ImageComplete;
         
-        //  Handle Zoom mode by changing the magnification for the next frame.
+        //  Handle Zoom mode by changing the magnification for the next frame. (A benchmark run
+        //  moves on to its next frame once this one has been drawn and timed - see below.)
         
-        if (_ZoomMode != ZOOM_NONE) {
+        if (_ZoomMode != ZOOM_NONE && _ZoomMode != ZOOM_PATH) {
             double Magnification =_ComputeHandler->GetMagnification();
             float Msec = _ZoomTimer.ElapsedMsec();
             
@@ -584,7 +1013,16 @@ void MandelController::Draw()
             if (_ZoomMode == ZOOM_TIMED) {
                 if (Msec > 10000.0) {
                     printf ("Zoom mode ends, frame rate = %.2f frames/sec\n",
-                       float(_ZoomFramesCPU + _ZoomFramesGPU + _ZoomFramesGPU_D) * 1000.0 /Msec);
+                       float(_ZoomFramesCPU + _ZoomFramesGPU + _ZoomFramesGPU_D +
+                                   _ZoomFramesGPU_P + _ZoomFramesGPU_FF +
+                                   _ZoomFramesHybrid) * 1000.0 /Msec);
+                    if (_ZoomFramesGPU > 0) {
+                        printf ("Average GPU compute time = %.2f msec%s\n",
+                                _TotalComputeMsecGPU / float(_ZoomFramesGPU),
+                                _ComputeHandler->GetTileQueue() ? " (tile queue)" : "");
+                    }
+                    long Hits = _ComputeHandler->GetImageCacheHits() - _ZoomCacheHits;
+                    if (Hits > 0) printf ("%ld images were taken from the image cache\n",Hits);
                     _ZoomMode = ZOOM_NONE;
                 } else {
                     if (Msec < 5000.0) IncreaseMag = true;
@@ -611,13 +1049,31 @@ void MandelController::Draw()
             //  we're running at exactly 60fps, FrameSecs will be exactly 1.0/60.0)
             
             double MagFactor = pow(2.0,(1.0 / 60.0));
-            int ZoomFrames = _ZoomFramesGPU + _ZoomFramesGPU_D + _ZoomFramesCPU;
+            int ZoomFrames = _ZoomFramesGPU + _ZoomFramesGPU_D + _ZoomFramesGPU_P +
+                                                       _ZoomFramesGPU_FF + _ZoomFramesHybrid +
+                                                                         _ZoomFramesCPU;
+            if (ZoomFrames > 0) _FrameStats.Record(Msec - _LastZoomMsec);
             if (ZoomFrames > 0 && _ScaleMagByTime) {
                 float FrameSec = (Msec - _LastZoomMsec) * 0.001f;
                 MagFactor = pow(2.0,FrameSec);
             }
-            if (IncreaseMag) Magnification = Magnification * MagFactor;
-            if (DecreaseMag) Magnification = Magnification / MagFactor;
+            //  In ZOOM_TIMED mode, if the compute handler is caching images, the way out
+            //  retraces the magnifications used on the way in, so the images still in the
+            //  cache can be reused. Once those run out, it carries on as usual.
+            
+            bool Retrace = (_ZoomMode == ZOOM_TIMED && _ComputeHandler->GetImageCacheLimit() > 0);
+            if (IncreaseMag) {
+                if (Retrace) _ZoomPath.push_back(Magnification);
+                Magnification = Magnification * MagFactor;
+            }
+            if (DecreaseMag) {
+                if (Retrace && !_ZoomPath.empty()) {
+                    Magnification = _ZoomPath.back();
+                    _ZoomPath.pop_back();
+                } else {
+                    Magnification = Magnification / MagFactor;
+                }
+            }
             
             //  Display the new magnification and apply it,  and remember the time so we can
             //  allow for the frame rate next time round.
@@ -626,13 +1082,257 @@ void MandelController::Draw()
             RedisplayTitle();
             if (ModeToUse == USE_GPU) _ZoomFramesGPU++;
             else if (ModeToUse == USE_GPU_D) _ZoomFramesGPU_D++;
+            else if (ModeToUse == USE_GPU_P) _ZoomFramesGPU_P++;
+            else if (ModeToUse == USE_GPU_FF) _ZoomFramesGPU_FF++;
+            else if (ModeToUse == USE_HYBRID) _ZoomFramesHybrid++;
             else _ZoomFramesCPU++;
             _LastZoomMsec = Msec;
             _NeedToRedraw = true;
+            
+            //  The next image is now known, so if it will be computed by the GPU alone, start
+            //  the GPU on it now, so it computes it while this one is being drawn. (Not with the
+            //  tile queue, which is there to compare GPU compute times.) If it will be computed
+            //  by the CPU alone, the compute handler starts a background thread on it instead.
+            
+            if (_ZoomMode != ZOOM_NONE && _ComputeAhead) {
+                UseMode NextMode = SelectMode();
+                if (NextMode == USE_CPU) {
+                    _ComputeHandler->StartCPUImage();
+                } else if (!_ComputeHandler->GetTileQueue() &&
+                                                     GPUPrecisionFor(NextMode,&Precision)) {
+                    _ComputeHandler->StartGPUImage(Precision);
+                }
+            }
+        }
+        
+        //  Get the renderer to draw the new image into the view, getting its address
+        //  from the compute handler. This is the image just computed, even if the GPU is
+        //  now computing the next one. If they share a device, the renderer can read the
+        //  image directly from the buffer the compute handler holds it in.
+        
+        uint32_t* ImageData = _ComputeHandler->GetImageData();
+        MsecTimer RenderTimer;
+        if (_SharedDevice) {
+            _Renderer->Draw(_View,ImageData,_ComputeHandler->GetImageBuffer());
+        } else {
+            _Renderer->Draw(_View,ImageData);
+        }
+        _RenderStats.Record(RenderTimer.ElapsedMsec());
+        
+        //  If this is the first image drawn since a drag or scroll, that input has now reached
+        //  the display - or at least, the renderer has handed the frame over to be presented.
+        
+        if (_InputPending) {
+            _LatencyStats.Record(_LatencyTimer.ElapsedMsec());
+            _InputPending = false;
+        }
+        
+        //  With the automatic iteration limit, the histogram of the image just drawn is used
+        //  to set the limit for the next one. If that changes, the view needs computing again,
+        //  and any image the GPU has started ahead is wasted.
+        
+        if (_AutoIter && ImageComplete && AdjustIterations()) {
+            _NeedToRedraw = true;
+            RedisplayTitle();
+        }
+        
+        //  In a benchmark run, write out the timings for this frame and move on to the next.
+        
+        if (_ZoomMode == ZOOM_PATH) {
+            float ColourMsec = 0.0;
+            float PresentMsec = 0.0;
+            _Renderer->GetDrawTimes(&ColourMsec,&PresentMsec);
+            float TotalMsec = FrameTimer.ElapsedMsec();
+            double XCent = 0.0,YCent = 0.0;
+            _ComputeHandler->GetCentre(&XCent,&YCent);
+            fprintf (_BenchFile,"%d,%.16g,%.16g,%.10g,%d,%s,%.3f,%.3f,%.3f,%.3f\n",_BenchFrame,
+                     XCent,YCent,_ComputeHandler->GetMagnification(),_CurrentIter,
+                     ModeName(ModeToUse),ComputeMsec,ColourMsec,PresentMsec,TotalMsec);
+            _BenchTotalMsec += TotalMsec;
+            if (++_BenchFrame < C_BenchFrames) {
+                SetBenchmarkFrame(_BenchFrame);
+                _NeedToRedraw = true;
+            } else {
+                EndBenchmark(true);
+            }
         }
     }
 }
 
+//  StartBenchmark() starts a benchmark run, which draws a fixed number of frames along a zoom
+//  path given by a set of keyframes read from a file, writing the time taken by each, and how
+//  it was computed, to a CSV file, so runs on different drivers or hardware can be compared.
+//  If there's no path file, it zooms from the starting view to preset 3, which goes through
+//  most of the compute modes. The image cache is disabled during the run, so every frame is
+//  computed, and nothing is computed ahead, so each frame's compute time is its own.
+
+void MandelController::StartBenchmark (void)
+{
+    _BenchPath.clear();
+    if (!ReadZoomPath(C_BenchPathFile,&_BenchPath)) {
+        printf ("No %s zoom path file, using default path to preset 3\n",C_BenchPathFile);
+        _BenchPath.push_back(_Memories[0]);
+        _BenchPath.push_back(_Memories[3]);
+    }
+    if (_BenchPath.size() < 2) {
+        printf ("Zoom path in %s needs at least two keyframes\n",C_BenchPathFile);
+        return;
+    }
+    _BenchFile = fopen(C_BenchCsvFile,"w");
+    if (_BenchFile == nullptr) {
+        printf ("Unable to create benchmark file %s\n",C_BenchCsvFile);
+        return;
+    }
+    fprintf (_BenchFile,"Frame,XCent,YCent,Magnification,Iterations,Mode,");
+    fprintf (_BenchFile,"ComputeMsec,ColourMsec,PresentMsec,TotalMsec\n");
+    printf ("Benchmark: %d frames along a zoom path with %d keyframes\n",
+                                                        C_BenchFrames,int(_BenchPath.size()));
+    _BenchCacheLimit = _ComputeHandler->GetImageCacheLimit();
+    _ComputeHandler->SetImageCacheLimit(0);
+    _BenchFrame = 0;
+    _BenchTotalMsec = 0.0;
+    _ZoomMode = ZOOM_PATH;
+    SetBenchmarkFrame(0);
+    _NeedToRedraw = true;
+}
+
+//  EndBenchmark() closes the timings file at the end of a benchmark run, or when it's cancelled.
+
+void MandelController::EndBenchmark (bool Completed)
+{
+    if (_BenchFile) fclose(_BenchFile);
+    _BenchFile = nullptr;
+    _ComputeHandler->SetImageCacheLimit(_BenchCacheLimit);
+    _ZoomMode = ZOOM_NONE;
+    if (Completed) {
+        printf ("Benchmark ends, average frame time %.2f msec, timings written to %s\n",
+                                  _BenchTotalMsec / float(_BenchFrame),C_BenchCsvFile);
+    } else {
+        printf ("Benchmark cancelled after %d frames\n",_BenchFrame);
+    }
+}
+
+//  SetBenchmarkFrame() sets the view for a frame of a benchmark run. The frames are spread
+//  evenly over the sections between keyframes, with the magnification changing by the same
+//  factor each frame within a section. The centre moves so that the point being zoomed towards
+//  stays put in the view, which means its offset from the final centre has to shrink in step
+//  with the magnification, rather than linearly.
+
+void MandelController::SetBenchmarkFrame (int Frame)
+{
+    int Sections = int(_BenchPath.size()) - 1;
+    double Posn = double(Frame) * double(Sections) / double(C_BenchFrames - 1);
+    int Section = std::min(int(Posn),Sections - 1);
+    double Fraction = Posn - double(Section);
+    const Setting& From = _BenchPath[Section];
+    const Setting& To = _BenchPath[Section + 1];
+    double Ratio = To.Magnification / From.Magnification;
+    double Magnification = From.Magnification * pow(Ratio,Fraction);
+    double Move = Fraction;
+    if (fabs(Ratio - 1.0) > 1.0e-9) {
+        Move = (1.0 - From.Magnification / Magnification) / (1.0 - 1.0 / Ratio);
+    }
+    _ComputeHandler->SetCentre(From.XCent + (To.XCent - From.XCent) * Move,
+                               From.YCent + (To.YCent - From.YCent) * Move);
+    _ComputeHandler->SetMagnification(Magnification);
+    RedisplayTitle();
+}
+
+//  ReadZoomPath() reads the keyframes of a zoom path from a file. Each line gives the X and Y
+//  coordinates of the centre and the magnification. Any words on the line are ignored, so
+//  the output from the 'p' key can be used as it is. Lines starting with '#' are comments.
+
+bool MandelController::ReadZoomPath (const char* FileName,std::vector<Setting>* Path)
+{
+    FILE* File = fopen(FileName,"r");
+    if (File == nullptr) return false;
+    char Line[1024];
+    while (fgets(Line,sizeof(Line),File)) {
+        if (Line[0] == '#') continue;
+        double Values[3];
+        int NValues = 0;
+        char* Ptr = Line;
+        while (*Ptr && NValues < 3) {
+            while (*Ptr && (isspace(*Ptr) || *Ptr == ',')) Ptr++;
+            char* End = Ptr;
+            double Value = strtod(Ptr,&End);
+            if (End != Ptr && (*End == '\0' || isspace(*End) || *End == ',')) {
+                Values[NValues++] = Value;
+            } else {
+                while (*End && !isspace(*End) && *End != ',') End++;
+            }
+            Ptr = End;
+        }
+        if (NValues == 3 && Values[2] > 0.0) Path->push_back({Values[0],Values[1],Values[2]});
+    }
+    fclose(File);
+    return true;
+}
+
+//  ModeName() returns the short name used for a compute mode.
+
+const char* MandelController::ModeName (UseMode Mode)
+{
+    if (Mode == USE_CPU) return "CPU";
+    if (Mode == USE_GPU) return "GPU";
+    if (Mode == USE_GPU_D) return "GPU-D";
+    if (Mode == USE_GPU_P) return "GPU-P";
+    if (Mode == USE_GPU_FF) return "GPU-FF";
+    if (Mode == USE_HYBRID) return "GPU+CPU";
+    return "None";
+}
+
+//  AdjustIterations() sets the iteration limit to suit the image, using the histogram of pixel
+//  values the renderer built for the image just drawn. If more than a small fraction of the
+//  pixels only escaped in the top eighth of the limit, there is detail at the edge of the set
+//  that more iterations would show, and the limit is raised. If even the slowest pixel to
+//  escape took less than half the limit, most of the iterations spent on the pixels inside
+//  the set are wasted, and the limit is lowered to twice that. The limit is kept above a floor
+//  that grows with the magnification, and it is left alone if no pixels escaped at all, as
+//  there's nothing to go on. It returns true if it changed the limit.
+
+bool MandelController::AdjustIterations (void)
+{
+    const std::vector<int>& Hist = _Renderer->GetHistogram();
+    int Limit = int(Hist.size());
+    if (Limit != _CurrentIter) return false;
+    
+    long Pixels = Hist[0];
+    long NearPixels = 0;
+    int MaxValue = 0;
+    int NearValue = int(double(Limit) * C_AutoIterTop);
+    for (int I = 1; I < Limit; I++) {
+        if (Hist[I] > 0) {
+            Pixels += Hist[I];
+            MaxValue = I;
+            if (I >= NearValue) NearPixels += Hist[I];
+        }
+    }
+    if (MaxValue == 0) return false;
+    
+    int NewLimit = Limit;
+    if (double(NearPixels) > double(Pixels) * C_AutoIterNear) {
+        NewLimit = int(double(Limit) * C_AutoIterRaise);
+    } else if (MaxValue < Limit / 2) {
+        NewLimit = MaxValue * 2;
+    }
+    double Magnification = _ComputeHandler->GetMagnification();
+    int Floor = int(double(C_AutoIterMin) * (1.0 + log10(std::max(Magnification,1.0))));
+    NewLimit = std::min(std::max(NewLimit,Floor),C_AutoIterMax);
+    if (NewLimit == Limit) return false;
+    SetIterations(NewLimit);
+    return true;
+}
+
+//  SetIterations() sets the iteration limit used by the compute handler and the renderer.
+
+void MandelController::SetIterations (int Iter)
+{
+    _CurrentIter = Iter;
+    _ComputeHandler->SetMaxIter(Iter);
+    _Renderer->SetMaxIter(Iter);
+}
+
 //  Format the magnification into a suitable window title.
 std::string MandelController::FormatMagnification (double Magnification)
 {
@@ -651,6 +1351,26 @@ std::string MandelController::FormatMagnification (double Magnification)
         } else {
             Device = "*GPU-D*";
         }
+    } else if (_LastUsedMode == USE_GPU_P) {
+        if (_ComputeHandler->PerturbedOK()) {
+            Device = "GPU-P";
+        } else {
+            Device = "*GPU-P*";
+        }
+    } else if (_LastUsedMode == USE_GPU_FF) {
+        if (_ComputeHandler->FloatFloatOK()) {
+            Device = "GPU-FF";
+        } else {
+            Device = "*GPU-FF*";
+        }
+    } else if (_LastUsedMode == USE_HYBRID) {
+        bool PrecisionOK = _GPUSupportsDouble ? _ComputeHandler->DoubleOK() :
+                                                        _ComputeHandler->FloatFloatOK();
+        if (PrecisionOK) {
+            Device = "GPU+CPU";
+        } else {
+            Device = "*GPU+CPU*";
+        }
     } else {
        if (_ComputeHandler->DoubleOK()) {
             Device = "CPU";
@@ -679,6 +1399,7 @@ std::string MandelController::FormatMagnification (double Magnification)
     snprintf (Number,sizeof(Number),"%.3g",Value);
     std::string TitleString = Number;
     TitleString += (" " + Units + " (" + Device + ")");
+    if (_AutoIter) TitleString += (" " + std::to_string(_CurrentIter) + " iterations");
     return TitleString;
 }
 
@@ -688,21 +1409,34 @@ void MandelController::FrameToImageCoord(float AtX, float AtY,double* XCoord,dou
     if (_ComputeHandler) {
         double XCent,YCent;
         _ComputeHandler->GetCentre(&XCent,&YCent);
+        double XOffset,YOffset;
+        FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
+        *XCoord = XCent + XOffset;
+        *YCoord = YCent + YOffset;
+    }
+
+}
+
+//  Convert from view coordinates to an offset in Mandelbrot set coordinates from the centre
+//  of the image. At high magnifications, adding this to the centre loses most of it, so
+//  anything that moves the centre should work with the offset.
+void MandelController::FrameToImageOffset(float AtX, float AtY,double* XOffset,double* YOffset)
+{
+    if (_ComputeHandler) {
         double Magnification = _ComputeHandler->GetMagnification();
         double CoordRangeInX = 2.0;
         double FrameWidth = _FrameX;
         double DistFromFrameCentX = FrameWidth * 0.5 - AtX;
         double XCoordFromCent =
              DistFromFrameCentX * CoordRangeInX / (FrameWidth * Magnification);
-        *XCoord = XCent - XCoordFromCent;
+        *XOffset = -XCoordFromCent;
         double FrameHeight = _FrameY;
         double CoordRangeInY = 2.0 * FrameHeight / FrameWidth;
         double DistFromFrameCentY = FrameHeight * 0.5 - AtY;
         double YCoordFromCent =
              DistFromFrameCentY * CoordRangeInY / (FrameHeight * Magnification);
-        *YCoord = YCent - YCoordFromCent;
+        *YOffset = -YCoordFromCent;
     }
-
 }
 
 //  Convert from Mandelbrot set coordinates to view coordinates.
@@ -744,8 +1478,10 @@ void MandelController::PrintHelp()
             "    errors would cause pixelation.";
     } else {
         DoublePrecText =
-            "    This GPU does not support double precision floating point and at magnifications\n"
-            "    above about 100,000, single precision floating point will cause pixelation.";
+            "    This GPU does not support double precision floating point, so at magnifications\n"
+            "    above about 100,000, where single precision floating point errors would cause\n"
+            "    pixelation, it uses pairs of single precision values, which are good to about\n"
+            "    10 trillion. Beyond that, auto mode uses the CPU.";
     }
     
     //  Output what I hope is useful help information.
@@ -773,13 +1509,37 @@ void MandelController::PrintHelp()
     printf ("'e' toggles a continuous display of the Mandelbrot path as the cursor moves.\n");
     printf ("'x' clears any Mandelbrot path from the display\n");
     printf ("'z' does a zoom test. It zooms in for 5 seconds, then out for 5 seconds\n");
+    printf ("'f' runs a benchmark of %d frames along the zoom path in %s, one\n",
+                                                                 C_BenchFrames,C_BenchPathFile);
+    printf ("    'p' output line per keyframe, writing frame timings to %s\n",C_BenchCsvFile);
     printf ("'a' sets auto mode - the program uses the GPU so long as its floating point\n");
     printf ("    support is accurate enough at the current magnification.\n");
     printf ("'c' forces the program to use the CPU - all available cores.\n");
     printf ("'g' forces the program to use the GPU at all magnifications.\n");
     printf ("%s\n",DoublePrecText.c_str());
-    printf ("    (Above about 100 trillion even double precision has problems.)\n");
+    printf ("    Above about 100 trillion, where even double precision has problems, the GPU\n");
+    printf ("    computes small differences from a reference orbit calculated by the CPU.\n");
     printf ("'w' toggles magnification rate compensation for slow compute times during zoom\n");
+    printf ("'u' toggles having the GPU or CPU compute the next zoom image while the current\n");
+    printf ("    one is drawn (enabled by default)\n");
+    printf ("'k' toggles the image cache, which saves recomputing images already seen,\n");
+    printf ("    and makes the 'z' zoom test retrace its way in (enabled by default)\n");
+    printf ("'y' toggles sharing of images between GPU and CPU where auto mode would use\n");
+    printf ("    GPU double precision or pairs of floats (enabled by default)\n");
+    printf ("'n' toggles an automatic iteration limit, set to suit each image\n");
+    printf ("'v' toggles computing images at reduced resolution while dragging or scrolling,\n");
+    printf ("    going back to full resolution once the image is left alone\n");
+    printf ("'b' toggles the checks that skip points inside the set (for benchmarking)\n");
+    printf ("'q' toggles the GPU tile queue, where a fixed number of workgroups take\n");
+    printf ("    tiles of the image as they become free (for benchmarking)\n");
+    printf ("'.' toggles drawing the image as a single quad, coloured by the fragment\n");
+    printf ("    shader, or as a triangle strip with two triangles for each pixel\n");
+    printf ("',' reports the latency from dragging or scrolling to the image being drawn\n");
+    printf ("'/' starts or stops writing each frame drawn to %s_nnnnnn.ppm, for\n",
+                                                                            C_CapturePrefix);
+    printf ("    making videos - frames are dropped if they can't be written fast enough\n");
+    printf ("'=' toggles making the image size follow the size of the view, so each pixel\n");
+    printf ("    computed is one pixel displayed\n");
     printf ("'l' sets size of images to %d by %d (large)\n",_BaseNx * 2,_BaseNy * 2);
     printf ("'m' sets size of images to %d by %d (medium - default)\n",_BaseNx,_BaseNy);
     printf ("'s' sets size of images to %d by %d (small)\n",_BaseNx / 2,_BaseNy / 2);
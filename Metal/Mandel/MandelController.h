@@ -69,6 +69,26 @@
 //                  maximum iterations will not be changed after initially being set in the
 //                  Initialise() call, and the controller handles changes to centre and
 //                  magnification in response to cursor and key events. KS.
+//     15 Oct 2026. Added FrameToImageOffset(), USE_GPU_P and the GPU perturbation zoom
+//                  counts. Drags are now tracked in view coordinates. KS.
+//                  Added USE_GPU_FF and the GPU float-float zoom counts. KS.
+//                  Added USE_HYBRID, the GPU+CPU zoom counts and _Hybrid. KS.
+//                  Added SelectMode(), GPUPrecisionFor() and _ComputeAhead. KS.
+//                  Added _ImageCacheLimit, _ZoomPath and _ZoomCacheHits. KS.
+//                  Added AdjustIterations(), SetIterations(), _AutoIter and _CurrentIter. KS.
+//                  Added SetImageScale(), InteractiveScale(), _Interactive, _ImageNx, _ImageNy,
+//                  _ImageScale, _FullResMsec, _ComputedMagnification and _InputTimer. KS.
+//                  Added ZOOM_PATH, StartBenchmark(), EndBenchmark(), SetBenchmarkFrame(),
+//                  ReadZoomPath(), ModeName() and the _Bench variables. KS.
+//                  Added _QuadDraw. KS.
+//                  Added _SharedDevice. KS.
+//                  Added NoteInput(), ReportLatency(), _LatencyTimer, _InputPending and
+//                  _Latencies. KS.
+//                  Added _RouteAtX and _RouteAtY. KS.
+//                  Added _Capturing. KS.
+//                  Added FollowViewSize(), _FollowView and _ViewResized. KS.
+//                  _Latencies and _TotalRenderMsec replaced by the MsecStats _LatencyStats and
+//                  _RenderStats. Added _FrameStats. KS.
 
 #ifndef __MandelController__
 #define __MandelController__
@@ -85,6 +105,8 @@
 #endif
 
 #include <string>
+#include <vector>
+#include <cstdio>
 
 class MandelAppContact
 {
@@ -130,21 +152,51 @@ private:
         double YCent;
         double Magnification;
     } Setting;
-    enum ZoomMode {ZOOM_NONE,ZOOM_IN,ZOOM_OUT,ZOOM_TIMED};
+    enum ZoomMode {ZOOM_NONE,ZOOM_IN,ZOOM_OUT,ZOOM_TIMED,ZOOM_PATH};
     enum ComputeMode {AUTO_MODE,CPU_MODE,GPU_MODE};
-    enum UseMode {USE_NONE,USE_CPU,USE_GPU,USE_GPU_D};
+    enum UseMode {USE_NONE,USE_CPU,USE_GPU,USE_GPU_D,USE_GPU_P,USE_GPU_FF,USE_HYBRID};
+    //  Work out how the image should be computed using the current settings.
+    UseMode SelectMode();
+    //  Get the precision for a mode that uses the GPU alone - false for other modes.
+    bool GPUPrecisionFor(UseMode Mode,MandelComputeHandler::GPUPrecision* Precision);
+    //  Adjust the iteration limit to suit the last image drawn - true if it changed.
+    bool AdjustIterations();
+    //  Set the iteration limit used by the compute handler and renderer.
+    void SetIterations(int Iter);
+    //  Get the short name for a compute mode, as used in the window title.
+    static const char* ModeName(UseMode Mode);
+    //  Start a benchmark run along a recorded zoom path.
+    void StartBenchmark();
+    //  End a benchmark run, either completed or cancelled.
+    void EndBenchmark(bool Completed);
+    //  Set the centre and magnification for a given frame of a benchmark run.
+    void SetBenchmarkFrame(int Frame);
+    //  Read the keyframes of a zoom path from a file - false if it can't be opened.
+    bool ReadZoomPath(const char* FileName,std::vector<Setting>* Path);
     //  Format the magnification into a suitable window title.
     std::string FormatMagnification (double Magnification);
     //  Display an updated window title.
     void RedisplayTitle();
     //  Convert from view coordinates to Mandelbrot set coordinates.
     void FrameToImageCoord(float AtX, float AtY,double* XCoord,double* YCoord);
+    //  Convert from view coordinates to an offset from the image centre.
+    void FrameToImageOffset(float AtX, float AtY,double* XOffset,double* YOffset);
     //  Convert from Mandelbrot set coordinates to view coordinates.
     void ImageToFrameCoord(double* XCoord,double* YCoord,float* AtX,float* AtY,int N);
     //  Calculate route of Mandelbrot calculation from given coordinates.
     int CalcRoute (double X0,double Y0,double* XPosns,double* YPosns,int MaxIter);
     //  Set the image size and create the various buffers
     void SetImageSize(int Nx, int Ny);
+    //  Compute images at the image size reduced by a given factor.
+    void SetImageScale(int Scale);
+    //  Get the factor to reduce the image size by while the user is dragging or scrolling.
+    int InteractiveScale();
+    //  Note a drag or scroll, for the idle timer and the input to present latency.
+    void NoteInput();
+    //  Output the input to present latency statistics, and start collecting them afresh.
+    void ReportLatency();
+    //  Make the image size match the view size, if it's to follow it and the view has changed.
+    void FollowViewSize();
     //  Output help text
     void PrintHelp();
     //  Set a specific memory to specified positiona and magnification
@@ -159,14 +211,54 @@ private:
     ComputeMode _ComputeMode;
     //  Set if the GPU supports double precision.
     bool _GPUSupportsDouble;
+    //  Set if the compute handler and renderer use the same device.
+    bool _SharedDevice;
     //  Base size of image in X - set by Initialise() call.
     int _BaseNx;
     //  Base size of image in y - set by Initialise() call.
     int _BaseNy;
     //  Iteration limit for calculation - set by Initialise() call.
     int _Iter;
+    //  Set the iteration limit to suit each image, using AdjustIterations().
+    bool _AutoIter;
+    //  The iteration limit in use - _Iter unless _AutoIter is set.
+    int _CurrentIter;
+    //  Compute images at reduced resolution while the user is dragging or scrolling.
+    bool _Interactive;
+    //  Have the renderer draw the image as a single quad rather than as triangles.
+    bool _QuadDraw;
+    //  True while the renderer is capturing the frames drawn - see the '/' key.
+    bool _Capturing;
+    //  Set if the image size follows the view size - see the '=' key.
+    bool _FollowView;
+    //  Set when the view size changes, until FollowViewSize() next runs.
+    bool _ViewResized;
+    //  Size of image in X set by SetImageSize(), used at full resolution.
+    int _ImageNx;
+    //  Size of image in Y set by SetImageSize(), used at full resolution.
+    int _ImageNy;
+    //  The factor the image size in use is reduced by - 1 at full resolution.
+    int _ImageScale;
+    //  Estimated time to compute an image at full resolution, from the last one computed.
+    float _FullResMsec;
+    //  The magnification of the last image computed.
+    double _ComputedMagnification;
+    //  Timer restarted by each drag or scroll, used to tell when input has gone idle.
+    MsecTimer _InputTimer;
+    //  Timer started by the first drag or scroll not yet reflected in a drawn image.
+    MsecTimer _LatencyTimer;
+    //  Set if there has been a drag or scroll since the last image was drawn.
+    bool _InputPending;
+    //  The input to present latencies, in msec, collected since the last ReportLatency().
+    MsecStats _LatencyStats;
     //  Compensate for computation delays during zoom by scaling the magnification.
     bool _ScaleMagByTime;
+    //  Share images between the GPU and CPU where auto mode would use GPU double or float-float.
+    bool _Hybrid;
+    //  When zooming, have the GPU compute the next image while the current one is drawn.
+    bool _ComputeAhead;
+    //  The image cache limit to restore when the cache is enabled again - zero if it's enabled.
+    long _ImageCacheLimit;
     //  How the last image was calculated.
     UseMode _LastUsedMode;
     //  The current Zoom mode
@@ -181,30 +273,61 @@ private:
     int _ZoomFramesGPU_D;
     //  Zoom frame count (GPU)
     int _ZoomFramesGPU;
+    //  Zoom frame count (GPU perturbation)
+    int _ZoomFramesGPU_P;
+    //  Zoom frame count (GPU float-float)
+    int _ZoomFramesGPU_FF;
+    //  Zoom frame count (GPU and CPU together)
+    int _ZoomFramesHybrid;
     //  Total compute time in last Zoom (CPU)
     float _TotalComputeMsecCPU;
     //  Total compute time in last Zoom (GPU double)
     float _TotalComputeMsecGPU_D;
     //  Total compute time in last Zoom (GPU)
     float _TotalComputeMsecGPU;
-    //  Total render time in last Zoom
-    float _TotalRenderMsec;
+    //  Total compute time in last Zoom (GPU perturbation)
+    float _TotalComputeMsecGPU_P;
+    //  Total compute time in last Zoom (GPU float-float)
+    float _TotalComputeMsecGPU_FF;
+    //  Total compute time in last Zoom (GPU and CPU together)
+    float _TotalComputeMsecHybrid;
+    //  Render times in last Zoom
+    MsecStats _RenderStats;
+    //  Intervals between frames in last Zoom
+    MsecStats _FrameStats;
     //  The Zoom timer when the last frame was drawn
     float _LastZoomMsec;
+    //  The magnifications used on the way in by a timed zoom, for the way out to retrace.
+    std::vector<double> _ZoomPath;
+    //  The number of images the compute handler had taken from its cache when the Zoom began.
+    long _ZoomCacheHits;
+    //  The keyframes of the zoom path followed by a benchmark run.
+    std::vector<Setting> _BenchPath;
+    //  The frame of the benchmark run being drawn.
+    int _BenchFrame;
+    //  The file the benchmark timings are written to - null if no run is in progress.
+    FILE* _BenchFile;
+    //  The total frame time so far in the benchmark run.
+    float _BenchTotalMsec;
+    //  The image cache limit to restore at the end of the benchmark run.
+    long _BenchCacheLimit;
     //  True if drawing of Mandelbrot path is enabled.
     bool _Drawing;
     //  Buffer used to hold last calculated route X coordinates.
     double* _RouteX;
     //  Buffer used to hold last calculated route Y coordinates.
     double* _RouteY;
+    //  Buffers used to hold the view coordinates of the last calculated route.
+    float* _RouteAtX;
+    float* _RouteAtY;
     //  Number of tracks in last calculated route.
     int _RouteN;
     //  True if mouse is being used to drag image.
     bool _InDrag;
-    //  Image position in X below cursor when drag starts.
-    double _DragImageX;
-    //  Image position in Y below cursor when drag starts.
-    double _DragImageY;
+    //  View position in X of cursor when drag starts or it last moved.
+    double _DragFrameX;
+    //  View position in Y of cursor when drag starts or it last moved.
+    double _DragFrameY;
     //  The address of the compute handler.
     MandelAppContact* _AppContact;
     //  The address of the compute handler.
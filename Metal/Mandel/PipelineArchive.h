@@ -0,0 +1,143 @@
+//
+//                       P i p e l i n e  A r c h i v e . h
+//
+//  This provides a very basic wrapper around a Metal binary archive, used by the Metal
+//  compute handler and renderer to keep the pipeline states they build on disk, so that
+//  later runs of the program can skip compiling the shader code for the GPU. The Metal
+//  shaders are already compiled into compute.metallib when the program is built, but that
+//  only gets them as far as an intermediate form. Turning that into code the GPU can run
+//  happens each time a pipeline state is created, unless Metal finds it in a binary archive.
+//
+//  A PipelineArchive is created with the name of its file. If the file exists, the archive
+//  is loaded from it, otherwise a new, empty, archive is created. NewComputePipeline() and
+//  NewRenderPipeline() create pipeline states just as the Metal device calls of the same
+//  name would, but first look for them in the archive. Any they don't find are compiled as
+//  usual, and added to the archive. Save() then writes the archive back to its file, if
+//  anything was added. Hits() and Misses() return the number of pipeline states found and
+//  not found in the archive, which is useful for diagnostics. If the archive can't be
+//  created at all, the pipeline states are simply compiled each time.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __PipelineArchive__
+#define __PipelineArchive__
+
+#include "Metal/Metal.hpp"
+
+#include <string>
+#include <fstream>
+
+class PipelineArchive
+{
+public:
+    //  Loads the archive from Filename if it exists, or creates an empty one if not.
+    PipelineArchive(MTL::Device* Device,const std::string& Filename) {
+        using NS::StringEncoding::UTF8StringEncoding;
+        _device = Device;
+        _filename = Filename;
+        _archive = nullptr;
+        _loaded = false;
+        _added = false;
+        _hits = 0;
+        _misses = 0;
+        NS::Error* Error = nullptr;
+        MTL::BinaryArchiveDescriptor* Desc = MTL::BinaryArchiveDescriptor::alloc()->init();
+        if (std::ifstream(Filename).good()) {
+            Desc->setUrl(NS::URL::fileURLWithPath(
+                                   NS::String::string(Filename.c_str(),UTF8StringEncoding)));
+            _archive = _device->newBinaryArchive(Desc,&Error);
+            _loaded = (_archive != nullptr);
+        }
+
+        //  If there was no file, or it couldn't be read - written by a different version of
+        //  the OS, perhaps - start again with an empty archive.
+
+        if (_archive == nullptr) {
+            Desc->setUrl(nullptr);
+            Error = nullptr;
+            _archive = _device->newBinaryArchive(Desc,&Error);
+        }
+        Desc->release();
+    }
+    ~PipelineArchive() {
+        if (_archive) _archive->release();
+    }
+    //  Returns a new compute pipeline state for Function, from the archive if possible.
+    MTL::ComputePipelineState* NewComputePipeline(MTL::Function* Function,NS::Error** Error) {
+        if (Function == nullptr) return nullptr;
+        MTL::ComputePipelineDescriptor* Desc = MTL::ComputePipelineDescriptor::alloc()->init();
+        Desc->setComputeFunction(Function);
+        MTL::ComputePipelineState* State = nullptr;
+        if (_archive) {
+            Desc->setBinaryArchives(NS::Array::array(_archive));
+            if (_loaded) {
+                State = _device->newComputePipelineState(Desc,
+                                    MTL::PipelineOptionFailOnBinaryArchiveMiss,nullptr,nullptr);
+            }
+            if (State) {
+                _hits++;
+            } else {
+                _misses++;
+                if (_archive->addComputePipelineFunctions(Desc,nullptr)) _added = true;
+            }
+        }
+        if (State == nullptr) {
+            State = _device->newComputePipelineState(Desc,MTL::PipelineOptionNone,nullptr,Error);
+        }
+        Desc->release();
+        return State;
+    }
+    //  Returns a new render pipeline state described by Desc, from the archive if possible.
+    //  This sets the binary archives in Desc.
+    MTL::RenderPipelineState* NewRenderPipeline(MTL::RenderPipelineDescriptor* Desc,
+                                                                          NS::Error** Error) {
+        MTL::RenderPipelineState* State = nullptr;
+        if (_archive) {
+            Desc->setBinaryArchives(NS::Array::array(_archive));
+            if (_loaded) {
+                State = _device->newRenderPipelineState(Desc,
+                                    MTL::PipelineOptionFailOnBinaryArchiveMiss,nullptr,nullptr);
+            }
+            if (State) {
+                _hits++;
+            } else {
+                _misses++;
+                if (_archive->addRenderPipelineFunctions(Desc,nullptr)) _added = true;
+            }
+        }
+        if (State == nullptr) State = _device->newRenderPipelineState(Desc,Error);
+        return State;
+    }
+    //  Writes the archive to its file, if anything has been added to it. Returns false if
+    //  this fails.
+    bool Save(void) {
+        using NS::StringEncoding::UTF8StringEncoding;
+        if (_archive == nullptr || !_added) return true;
+        NS::Error* Error = nullptr;
+        bool Saved = _archive->serializeToURL(NS::URL::fileURLWithPath(
+                                 NS::String::string(_filename.c_str(),UTF8StringEncoding)),&Error);
+        if (Saved) _added = false;
+        return Saved;
+    }
+    //  Returns the number of pipeline states found in the archive.
+    int Hits(void) { return _hits; }
+    //  Returns the number of pipeline states that had to be compiled.
+    int Misses(void) { return _misses; }
+private:
+    //  The device the pipeline states are for.
+    MTL::Device* _device;
+    //  The name of the archive file.
+    std::string _filename;
+    //  The archive itself, or null if it couldn't be created.
+    MTL::BinaryArchive* _archive;
+    //  Set if the archive was loaded from its file.
+    bool _loaded;
+    //  Set if anything has been added to the archive since it was loaded or saved.
+    bool _added;
+    //  The number of pipeline states found in the archive.
+    int _hits;
+    //  The number of pipeline states not found in the archive.
+    int _misses;
+};
+
+#endif
@@ -20,10 +20,59 @@
 //                  Initialise(). This brings this up to date with the latest changes to the
 //                  Vulkan version. KS.
 //      4 Sep 2024. Added SetOverlay() to support display of Mandelbrot paths. KS.
+//     15 Oct 2026. The histogram of pixel values is now kept, and returned by
+//                  GetHistogram(). Values beyond the iteration limit are now drawn in the
+//                  colour for the highest value. KS.
+//                  Draw() now times the colouring and the drawing of each frame, returned
+//                  by GetDrawTimes(). KS.
+//                  Image data is now passed as uint32_t iteration counts. KS.
+//                  The image is now coloured by compute kernels, using SetColourDataGPU(), if
+//                  they can be set up. The histogram equalisation itself is now done by
+//                  BuildColourIndex(). KS.
+//                  Added a mode, selected by SetQuadDraw(), that draws the image as a single
+//                  quad, with a fragment shader looking up the colour of each pixel in the
+//                  image and the colour table used by the colouring kernels. This is the
+//                  default if it can be set up. KS.
+//                  Added a version of Draw() that is passed a buffer already holding the
+//                  image - the compute handler's own output buffer, if it uses the same
+//                  device - which the GPU colouring then reads directly, instead of the CPU
+//                  copying the image into a buffer. KS.
+//                  SetColourDataHistEq() now builds the histogram and sets the colours using
+//                  the shared ThreadPool, and the colour index and the partial histograms
+//                  are now kept from one frame to the next. KS.
+//                  Added StartCapture() and StopCapture(), which match the Vulkan version's
+//                  frame capture calls, but as yet this version can't capture frames. KS.
+//                  The shaders and kernels are no longer compiled from source text when the
+//                  program starts. They are now in renderer.metal, compiled into the Metal
+//                  library when the program is built, and Initialise() opens the library
+//                  and keeps the pipeline states in a binary archive, using a
+//                  PipelineArchive, so later runs don't have to compile them either. KS.
+//                  The buffers now come from a BufferHeap, and those replaced when the image
+//                  size or iteration limit changes are recycled, so their memory is reused. KS.
+//                  Added _usePrivateBuffers, the default, with which the vertex buffers are
+//                  private to the GPU. The GPU colouring kernel writes the colours straight
+//                  into them, and when the CPU colours the image it writes a shared staging
+//                  buffer, from which only the lines whose colours changed are copied by a
+//                  blit encoder. With managed buffers, only those lines are now signalled
+//                  as modified. KS.
+//                  The quad is now drawn from a texture, if BuildTexturePipeline() can set
+//                  that up. SetColourDataGPU() has a kernel write the colour of each image
+//                  pixel into the texture, and the fragment shader just samples it. KS.
+//                  The triangle strip no longer needs a positions buffer, if the pipeline
+//                  set up by BuildStripPipeline() can be used, as its vertex shader works out
+//                  the position of each vertex from its index. And when the CPU colours the
+//                  image, it now just sets one byte per pixel, the colour level, if the
+//                  pipeline set up by BuildLevelsPipeline() can be used, its vertex shader
+//                  looking up the colours in a palette. This brings the Metal version into
+//                  line with the Vulkan version. KS.
 
 #include "RendererMetal.h"
+#include "ThreadPool.h"
+#include "PipelineArchive.h"
+#include "BufferHeap.h"
 
 #include <simd/simd.h>
+#include <algorithm>
 
 //  _debugOptions is the comma-separated list of all the diagnostic levels that the built-in debug
 //  handler recognises. If a call to _debug.Log() or .Logf() is added with a new level name, this
@@ -31,6 +80,27 @@
 
 const std::string Renderer::_debugOptions = "Setup,Timing";
 
+//  The arguments for the colouring kernels. This must match the layout of the ColourArgs
+//  structure in renderer.metal.
+
+typedef struct {
+    int Nx;
+    int Ny;
+    int IterLimit;
+} ColourArgs;
+
+//  The thread group size used by the colouring kernels, and the most thread groups
+//  SetColourDataGPU() dispatches - the kernels loop over any pixels beyond those.
+
+static const int C_ColourGroupSize = 256;
+static const int C_ColourMaxGroups = 4096;
+
+//  The Metal library holding the renderer's shaders and kernels, and the file in which
+//  Initialise() keeps their pipeline states.
+
+static const char* const C_LibraryFile = "compute.metallib";
+static const char* const C_PipelineArchiveFile = "MandelRenderer.binarchive";
+
 Renderer::Renderer(MTL::Device* pDevice)
 : _pDevice(pDevice->retain())
 {
@@ -39,24 +109,72 @@ Renderer::Renderer(MTL::Device* pDevice)
     _viewWidth = 512.0;
     _viewHeight = 512.0;
     _frames = 0;
+    _colourMsec = 0.0;
+    _presentMsec = 0.0;
     _iterLimit = 1024;
     _pVertexPositionsBuffer = nullptr;
     _pVertexColorsBuffer = nullptr;
     _pCommandQueue = _pDevice->newCommandQueue();
+    _pBufferHeap = new BufferHeap(_pDevice);
     _useManagedBuffers = true;
+    _usePrivateBuffers = true;
+    _pColourStaging = nullptr;
+    _pUploadCmd = nullptr;
     _debug.SetSubSystem("Renderer");
     _debug.LevelsList(_debugOptions);
     _pOverlayVertexBuffer = nullptr;
     _pOverlayColorsBuffer = nullptr;
     _maxOverVerts = 0;
     _overVerts = 0;
+    _gpuColouring = false;
+    _pClearHistPSO = nullptr;
+    _pBuildHistPSO = nullptr;
+    _pSetColoursPSO = nullptr;
+    _pImageBuffer = nullptr;
+    _pColourImageBuffer = nullptr;
+    _pHistBuffer = nullptr;
+    _pLutBuffer = nullptr;
+    _quadAvailable = false;
+    _quadDraw = true;
+    _pQuadPSO = nullptr;
+    _textureAvailable = false;
+    _pSetTexturePSO = nullptr;
+    _pTexturePSO = nullptr;
+    _pImageTexture = nullptr;
+    _stripAvailable = false;
+    _pStripPSO = nullptr;
+    _levelsAvailable = false;
+    _pLevelsPSO = nullptr;
+    _pLevelsBuffer = nullptr;
+    _pPaletteBuffer = nullptr;
+    _pLibrary = nullptr;
+    _pArchive = nullptr;
 }
 
 Renderer::~Renderer()
 {
+    WaitForUpload();
     if (_pVertexPositionsBuffer) _pVertexPositionsBuffer->release();
     if (_pVertexColorsBuffer) _pVertexColorsBuffer->release();
+    if (_pColourStaging) _pColourStaging->release();
     if (_pPSO) _pPSO->release();
+    if (_pClearHistPSO) _pClearHistPSO->release();
+    if (_pBuildHistPSO) _pBuildHistPSO->release();
+    if (_pSetColoursPSO) _pSetColoursPSO->release();
+    if (_pImageBuffer) _pImageBuffer->release();
+    if (_pHistBuffer) _pHistBuffer->release();
+    if (_pLutBuffer) _pLutBuffer->release();
+    if (_pQuadPSO) _pQuadPSO->release();
+    if (_pSetTexturePSO) _pSetTexturePSO->release();
+    if (_pTexturePSO) _pTexturePSO->release();
+    if (_pImageTexture) _pImageTexture->release();
+    if (_pStripPSO) _pStripPSO->release();
+    if (_pLevelsPSO) _pLevelsPSO->release();
+    if (_pLevelsBuffer) _pLevelsBuffer->release();
+    if (_pPaletteBuffer) _pPaletteBuffer->release();
+    if (_pOverlayVertexBuffer) _pOverlayVertexBuffer->release();
+    if (_pOverlayColorsBuffer) _pOverlayColorsBuffer->release();
+    delete _pBufferHeap;
     if (_pCommandQueue) _pCommandQueue->release();
     if (_pDevice) _pDevice->release();
 }
@@ -70,7 +188,39 @@ void Renderer::Initialise(const std::string& DebugLevels)
     
     _debug.SetLevels(DebugLevels);
     //printf ("Set debuglevels to '%s'\n",DebugLevels.c_str());
+    
+    //  The shaders are already compiled into the Metal library, and the pipeline states come
+    //  from the binary archive if an earlier run saved them there. The library and archive
+    //  are only needed while the pipelines are being built.
+    
+    using NS::StringEncoding::UTF8StringEncoding;
+    MsecTimer SetupTimer;
+    NS::Error* pError = nullptr;
+    _pLibrary = _pDevice->newLibrary(NS::String::string(C_LibraryFile,UTF8StringEncoding),&pError);
+    if (_pLibrary == nullptr || pError != nullptr) {
+        printf ("Error opening library '%s'.\n",C_LibraryFile);
+        if (pError) printf ("Reason: %s\n",pError->localizedDescription()->utf8String());
+        if (_pLibrary) _pLibrary->release();
+        _pLibrary = nullptr;
+    }
+    _debug.Logf("Setup","Renderer library opened at %.3f msec",SetupTimer.ElapsedMsec());
+    _pArchive = new PipelineArchive(_pDevice,C_PipelineArchiveFile);
+    float PipelineStart = SetupTimer.ElapsedMsec();
     BuildShaders();
+    _gpuColouring = BuildColourPipeline();
+    if (_gpuColouring) _quadAvailable = BuildQuadPipeline();
+    if (_quadAvailable) _textureAvailable = BuildTexturePipeline();
+    _stripAvailable = BuildStripPipeline();
+    if (_stripAvailable) _levelsAvailable = BuildLevelsPipeline();
+    _debug.Logf("Setup","Renderer pipelines took %.3f msec, %d from archive, %d compiled.",
+             SetupTimer.ElapsedMsec() - PipelineStart,_pArchive->Hits(),_pArchive->Misses());
+    if (!_pArchive->Save()) {
+        _debug.Logf("Setup","Unable to save pipelines to '%s'.",C_PipelineArchiveFile);
+    }
+    delete _pArchive;
+    _pArchive = nullptr;
+    if (_pLibrary) _pLibrary->release();
+    _pLibrary = nullptr;
     _debug.Log("Setup","Basic Metal Setup complete");
 }
 
@@ -96,6 +246,58 @@ void Renderer::SetMaxIter (int MaxIter)
     _iterLimit = MaxIter;
 }
 
+//  GetHistogram() returns the histogram of the pixel values of the last image drawn, built by
+//  SetColourDataHistEq() or SetColourDataGPU(). It has an entry for each value from 0 up to
+//  the iteration limit the image was drawn with, less one, giving the number of pixels with
+//  that value. Entry 0 is the number of pixels inside the set. It is empty if no image has
+//  been drawn yet.
+
+const std::vector<int>& Renderer::GetHistogram (void)
+{
+    return _hist;
+}
+
+//  GetDrawTimes() returns the times taken by the last call to Draw(): the time spent setting
+//  the vertex colours from the image data, and the time spent then drawing and presenting the
+//  frame. The command buffer is only committed, not waited for, so this
+//  doesn't include the time the GPU takes to draw the frame.
+
+void Renderer::GetDrawTimes (float* ColourMsec,float* PresentMsec)
+{
+    *ColourMsec = _colourMsec;
+    *PresentMsec = _presentMsec;
+}
+
+//  SetQuadDraw() selects how the image is drawn. If UseQuad is true, it is drawn as a single quad
+//  covering the view, with the fragment shader looking up the colour for each pixel. If false,
+//  it is drawn as a triangle strip, with two triangles for each image pixel, whose vertex
+//  colours are set by the CPU or by the colouring kernels. The quad needs the GPU to be
+//  colouring the image, and if it can't be used the triangle strip is used anyway. This
+//  returns true if the quad will be used.
+
+bool Renderer::SetQuadDraw (bool UseQuad)
+{
+    _quadDraw = UseQuad;
+    return _quadDraw && _quadAvailable && _gpuColouring;
+}
+
+//  StartCapture() and StopCapture() are provided so the controller can use the same calls as
+//  for the Vulkan version, which can write each frame drawn to a file. This version doesn't
+//  support that yet - it would need the view's drawables to be readable, which makes drawing
+//  them less efficient - so StartCapture() always returns false.
+
+bool Renderer::StartCapture (const std::string& /*FilePrefix*/)
+{
+    _debug.Log("Setup","Frame capture is not supported by the Metal renderer.");
+    return false;
+}
+
+void Renderer::StopCapture (int* Frames,int* Dropped)
+{
+    *Frames = 0;
+    *Dropped = 0;
+}
+
 //  GetDebugOptions() returns the comma-separated list of the various diagnostic levels supported
 //  by the renderer. Note that this is a static routine; it can be convenient for a program to
 //  have this list available before the renderer is constructed, and it is in any case a fixed
@@ -107,7 +309,7 @@ std::string Renderer::GetDebugOptions(void)
 }
 
 
-void Renderer::SetColourData (float* imageData, int Nx, int Ny)
+void Renderer::SetColourData (uint32_t* imageData, int Nx, int Ny)
 {
     //  This was my first attempt at setting a suitable set of colours for the images,
     //  based on scaling over a given percentile range of data, but I decided this didn't
@@ -125,9 +327,21 @@ void Renderer::SetColourData (float* imageData, int Nx, int Ny)
     float rangeMin,rangeMax;
     PercentileRange(imageData,Nx,Ny,Percentile,&rangeMin,&rangeMax);
     
+    WaitForUpload();
+    if (_pLevelsBuffer) {
+        uint8_t* levels = (uint8_t*)ColourStagingBuffer()->contents();
+        for (int iptr = 0; iptr < Nx * Ny; iptr++) {
+            float data = imageData[iptr];
+            int index = int(((data - rangeMin) * 255.0 / (rangeMax - rangeMin)) + 0.5);
+            levels[iptr] = uint8_t(std::min(std::max(index,0),255));
+        }
+        _dirtyLines.assign(Ny,1);
+        UploadColourLines(NS::UInteger(Nx));
+        return;
+    }
     int cptr = 0;
     int iptr = 0;
-    simd::float3* colours = (simd::float3*)_pVertexColorsBuffer->contents();
+    simd::float3* colours = (simd::float3*)ColourStagingBuffer()->contents();
     for (int Iy = 0; Iy < Ny; Iy++) {
         for (int Ix = 0; Ix < Nx; Ix++) {
             float data = imageData[iptr++];
@@ -139,14 +353,13 @@ void Renderer::SetColourData (float* imageData, int Nx, int Ny)
             for (int I = 0; I < 6; I++) { colours[cptr++] = RGB; }
         }
     }
-    if (_useManagedBuffers) {
-        _pVertexColorsBuffer->didModifyRange(NS::Range::Make(0,_pVertexColorsBuffer->length()));
-    }
+    _dirtyLines.assign(Ny,1);
+    UploadColourLines(NS::UInteger((Nx - 1) * 2 + 6) * sizeof(simd::float3));
     
     //printf ("Setting colours took %.2f msec\n",theTimer.ElapsedMsec());
 }
 
-void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
+void Renderer::SetColourDataHistEq (uint32_t* imageData, int Nx, int Ny)
 {
     MsecTimer theTimer;
     
@@ -170,22 +383,205 @@ void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
     //  zero, because this is black in this colour table, and this usually looks best for
     //  displaying the pixels actually in the Mandelbrot set. We then want to distribute
     //  the rest of the available 255 colour index values as evenly as possible amongst
-    //  only those data values that actually occur in the current data.
+    //  only those data values that actually occur in the current data. (The colour index
+    //  array is kept in _colourIndex, so it isn't allocated afresh for each frame.)
     
-    int* ColourIndex = (int*) malloc(_iterLimit * sizeof(int));
+    _colourIndex.resize(_iterLimit);
+    int* ColourIndex = _colourIndex.data();
     
     //  Now the second array. Hist will be the histogram of the data values. Hist[0] will
     //  be the count of pixels within the Mandelbrot set, and Hist[i] is the count of pixels
     //  with value i. We will use the distribution of actual values in the data to allocate
-    //  the colour table indices amongst the data values.
+    //  the colour table indices amongst the data values. This is kept in _hist, so that
+    //  GetHistogram() can return it.
+    //
+    //  The image is split into bands of rows, one for each thread in the shared pool, and
+    //  each band gets its own partial histogram in _bandHists, so the threads never update
+    //  the same counts. These are then added together to give the full histogram.
     
-    int* Hist = (int*) malloc(_iterLimit * sizeof(int));
-    for (int I = 0; I < _iterLimit; I++) Hist[I] = 0;
-    for (int iptr = 0; iptr < (Nx * Ny); iptr++) {
-        int iData = int(imageData[iptr]);
-        if (iData >= 0 && iData < _iterLimit) Hist[iData]++;
+    ThreadPool& Pool = ThreadPool::Shared();
+    int Bands = std::max(std::min(Pool.Threads(),Ny),1);
+    _bandHists.assign(size_t(Bands) * _iterLimit,0);
+    int* BandHists = _bandHists.data();
+    int Levels = _iterLimit;
+    Pool.ParallelFor(0,Bands,[=](int First,int Last) {
+        for (int Band = First; Band < Last; Band++) {
+            int* BandHist = BandHists + size_t(Band) * Levels;
+            long Start = long(Ny) * Band / Bands * Nx;
+            long End = long(Ny) * (Band + 1) / Bands * Nx;
+            for (long iptr = Start; iptr < End; iptr++) {
+                int iData = int(imageData[iptr]);
+                if (iData >= 0 && iData < Levels) BandHist[iData]++;
+            }
+        }
+    });
+    _hist.assign(BandHists,BandHists + Levels);
+    int* Hist = _hist.data();
+    for (int Band = 1; Band < Bands; Band++) {
+        const int* BandHist = BandHists + size_t(Band) * Levels;
+        for (int I = 0; I < Levels; I++) Hist[I] += BandHist[I];
     }
     
+    //  Turn the histogram into the lookup table of colour levels for each data value.
+    
+    BuildColourIndex(ColourIndex);
+    
+    //  ColourIndex[i] now represents the colour level to be used for data of value i. Every
+    //  line has the same number of vertices, so each line's colours can be set independently,
+    //  and the lines are shared out between the threads. The colours are written into the
+    //  staging buffer, or the colours buffer itself if it isn't private, which still holds
+    //  those for the last frame, and only colours that have changed are written. Each line
+    //  with any changes is flagged in _dirtyLines, and only those lines are passed on to the
+    //  GPU by UploadColourLines() - when zooming slowly, or with a still image, that can be
+    //  far fewer than all of them.
+    //
+    //  If the vertex shader looks up the colours, all that's needed is the colour level for
+    //  each pixel - one byte, rather than a colour for each of its vertices - and the lines
+    //  whose levels have changed are flagged and passed on in just the same way.
+    
+    WaitForUpload();
+    _dirtyLines.assign(Ny,0);
+    uint8_t* DirtyLines = _dirtyLines.data();
+    if (_pLevelsBuffer) {
+        uint8_t* PixelLevels = (uint8_t*)ColourStagingBuffer()->contents();
+        Pool.ParallelFor(0,Ny,[=](int FirstLine,int LastLine) {
+            for (int Iy = FirstLine; Iy < LastLine; Iy++) {
+                const uint32_t* LineData = imageData + long(Iy) * Nx;
+                uint8_t* LineLevels = PixelLevels + long(Iy) * Nx;
+                bool Dirty = false;
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    int idata = int(LineData[Ix]);
+                    if (idata >= Levels) idata = Levels - 1;
+                    uint8_t Level = uint8_t(ColourIndex[idata]);
+                    if (LineLevels[Ix] != Level) {
+                        LineLevels[Ix] = Level;
+                        Dirty = true;
+                    }
+                }
+                DirtyLines[Iy] = Dirty;
+            }
+        });
+        UploadColourLines(NS::UInteger(Nx));
+        return;
+    }
+    simd::float3* colours = (simd::float3*)ColourStagingBuffer()->contents();
+    int LineVertices = (Nx - 1) * 2 + 6;
+    Pool.ParallelFor(0,Ny,[=](int FirstLine,int LastLine) {
+        for (int Iy = FirstLine; Iy < LastLine; Iy++) {
+            long iptr = long(Iy) * Nx;
+            long cptr = long(Iy) * LineVertices;
+            bool Dirty = false;
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                int idata = int(imageData[iptr++]);
+                if (idata >= Levels) idata = Levels - 1;
+                int index = ColourIndex[idata];
+                float R,G,B;
+                GetRGB (index,&R,&G,&B);
+                simd::float3 RGB= {R,G,B};
+                int Vertices = 2;
+                if (Ix == 0) Vertices = 5;
+                for (int I = 0; I < Vertices; I++) {
+                    simd::float3& Colour = colours[cptr++];
+                    if (Colour.x != R || Colour.y != G || Colour.z != B) {
+                        Colour = RGB;
+                        Dirty = true;
+                    }
+                }
+            }
+            colours[cptr++] = {0.0,0.0,0.0};
+            DirtyLines[Iy] = Dirty;
+        }
+    });
+
+    UploadColourLines(NS::UInteger(LineVertices) * sizeof(simd::float3));
+
+    //printf ("Setting colours took %.2f msec\n",theTimer.ElapsedMsec());
+}
+
+//  ColourStagingBuffer() returns the buffer into which the CPU writes the vertex colours, or the
+//  colour levels if there's a levels buffer. If that buffer is private to the GPU, this is the
+//  staging buffer set up by BuildBuffers(), otherwise it's the colours or levels buffer itself.
+
+MTL::Buffer* Renderer::ColourStagingBuffer (void)
+{
+    if (_pColourStaging) return _pColourStaging;
+    return _pLevelsBuffer ? _pLevelsBuffer : _pVertexColorsBuffer;
+}
+
+//  UploadColourLines() passes on to the GPU the vertex colours, or colour levels, the CPU has
+//  written for the lines of the image flagged in _dirtyLines, each line being LineBytes. Each run
+//  of adjacent flagged lines is handled as one range. If the colours buffer is private, each
+//  range is copied from the staging buffer by a blit encoder, in a command buffer that is
+//  committed without waiting for it - the command buffer Draw() commits runs after it, and
+//  WaitForUpload() is called before the staging buffer is written again. If the colours
+//  buffer is managed, each range is signalled as modified. If it's shared, there's nothing
+//  to do.
+
+void Renderer::UploadColourLines (NS::UInteger LineBytes)
+{
+    if (!_usePrivateBuffers && !_useManagedBuffers) return;
+    
+    MTL::Buffer* pColourBuffer = _pLevelsBuffer ? _pLevelsBuffer : _pVertexColorsBuffer;
+    int Lines = int(_dirtyLines.size());
+    int LinesChanged = 0;
+    int Ranges = 0;
+    NS::AutoreleasePool* pPool = NS::AutoreleasePool::alloc()->init();
+    MTL::CommandBuffer* pCmd = nullptr;
+    MTL::BlitCommandEncoder* pBlit = nullptr;
+    int First = 0;
+    while (First < Lines) {
+        if (!_dirtyLines[First]) {
+            First++;
+            continue;
+        }
+        int Last = First;
+        while (Last < Lines && _dirtyLines[Last]) Last++;
+        NS::UInteger Offset = NS::UInteger(First) * LineBytes;
+        NS::UInteger Bytes = NS::UInteger(Last - First) * LineBytes;
+        if (_usePrivateBuffers) {
+            if (pBlit == nullptr) {
+                pCmd = _pCommandQueue->commandBuffer();
+                pBlit = pCmd->blitCommandEncoder();
+            }
+            pBlit->copyFromBuffer(_pColourStaging,Offset,pColourBuffer,Offset,Bytes);
+        } else {
+            pColourBuffer->didModifyRange(NS::Range::Make(Offset,Bytes));
+        }
+        LinesChanged += Last - First;
+        Ranges++;
+        First = Last;
+    }
+    if (pBlit) {
+        pBlit->endEncoding();
+        pCmd->commit();
+        _pUploadCmd = pCmd->retain();
+    }
+    pPool->release();
+    _debug.Logf("Timing","Colours changed for %d of %d lines, in %d ranges",
+                                                                   LinesChanged,Lines,Ranges);
+}
+
+//  WaitForUpload() waits for any copy from the staging buffer started by UploadColourLines()
+//  to complete, so the staging buffer can be written again.
+
+void Renderer::WaitForUpload (void)
+{
+    if (_pUploadCmd) {
+        _pUploadCmd->waitUntilCompleted();
+        _pUploadCmd->release();
+        _pUploadCmd = nullptr;
+    }
+}
+
+//  BuildColourIndex() sets the lookup table ColourIndex, which must have an entry for each data
+//  value up to the iteration limit, to the colour level to be used for each value, using the
+//  histogram in _hist. This is the histogram equalisation used by both SetColourDataHistEq()
+//  and SetColourDataGPU(), so the two colour an image in exactly the same way.
+
+void Renderer::BuildColourIndex (int* ColourIndex)
+{
+    const int* Hist = _hist.data();
+    
     //  Determine the range of actual data values, ignoring the zero values pixels
     //  inside the Mandelbrot set. We can do this just by starting at each end of
     //  the data histogram and seeing when we first hit a non-zero count.
@@ -251,36 +647,138 @@ void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
             if (ColourIndex[I] >= LevelsAvailable) ColourIndex[I] = LevelsAvailable - 1;
         }
     }
+}
+
+//  SetColourDataGPU() does the same job as SetColourDataHistEq(), but uses the compute kernels
+//  set up by BuildColourPipeline() to build the histogram and set the vertex colours, which are
+//  the parts that have to look at every pixel. Only the histogram is used by the CPU, which
+//  turns it into a table of the colour for each data value using BuildColourIndex(), so the
+//  result is the same as for the CPU version. The kernel that sets the colours is committed
+//  without waiting for it, as the command buffer Draw() then commits runs after it. If the
+//  image is being drawn as a quad, the vertex colours aren't needed, and that kernel isn't run,
+//  but if the quad is drawn from a texture, another kernel sets the colours in the texture.
+//  The image is copied into a buffer of the renderer's own, unless pImageBuffer is passed as a
+//  buffer that already holds it (see Draw()), in which case that is used as it is.
+
+void Renderer::SetColourDataGPU (uint32_t* imageData, int Nx, int Ny, MTL::Buffer* pImageBuffer)
+{
+    if (_pVertexColorsBuffer == nullptr || imageData == nullptr) return;
     
-    //  ColourIndex[i] now represents the colour level to be used for data of value i.
+    _nx = Nx;
+    _ny = Ny;
     
-    int cptr = 0;
-    int iptr = 0;
-    simd::float3* colours = (simd::float3*)_pVertexColorsBuffer->contents();
-    for (int Iy = 0; Iy < Ny; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            int idata = int(imageData[iptr++]);
-            int index = ColourIndex[idata];
-            float R,G,B;
-            GetRGB (index,&R,&G,&B);
-            simd::float3 RGB= {R,G,B};
-            int Vertices = 2;
-            if (Ix == 0) Vertices = 5;
-            for (int I = 0; I < Vertices; I++) { colours[cptr++] = RGB; }
+    //  The image buffer depends on the image size, and the histogram and colour table on the
+    //  iteration limit.
+    
+    size_t Pixels = size_t(Nx) * size_t(Ny);
+    if (pImageBuffer == nullptr) {
+        if (_pImageBuffer == nullptr || _pImageBuffer->length() < Pixels * sizeof(uint32_t)) {
+            _pBufferHeap->Recycle(_pImageBuffer);
+            _pImageBuffer = _pBufferHeap->NewBuffer(Pixels * sizeof(uint32_t),
+                                                             MTL::ResourceStorageModeShared);
         }
-        colours[cptr++] = {0.0,0.0,0.0};
+        memcpy(_pImageBuffer->contents(),imageData,Pixels * sizeof(uint32_t));
+        pImageBuffer = _pImageBuffer;
     }
-
-    if (_useManagedBuffers) {
-        _pVertexColorsBuffer->didModifyRange(NS::Range::Make(0,_pVertexColorsBuffer->length()));
+    _pColourImageBuffer = pImageBuffer;
+    size_t Levels = size_t(_iterLimit);
+    if (_pHistBuffer == nullptr || _pHistBuffer->length() < Levels * sizeof(uint32_t)) {
+        _pBufferHeap->Recycle(_pHistBuffer);
+        _pBufferHeap->Recycle(_pLutBuffer);
+        _pHistBuffer = _pBufferHeap->NewBuffer(Levels * sizeof(uint32_t),
+                                                             MTL::ResourceStorageModeShared);
+        _pLutBuffer = _pBufferHeap->NewBuffer(Levels * sizeof(simd::float3),
+                                                             MTL::ResourceStorageModeShared);
     }
+    
+    //  The kernels loop over as many pixels as they need to, so the number of thread groups
+    //  can be limited.
+    
+    ColourArgs Args = {Nx,Ny,_iterLimit};
+    NS::UInteger GroupSize = std::min(NS::UInteger(C_ColourGroupSize),
+                                       _pBuildHistPSO->maxTotalThreadsPerThreadgroup());
+    NS::UInteger PixelGroups = std::min(NS::UInteger((Pixels + GroupSize - 1) / GroupSize),
+                                                           NS::UInteger(C_ColourMaxGroups));
+    
+    NS::AutoreleasePool* pPool = NS::AutoreleasePool::alloc()->init();
 
-    free (Hist);
-    free (ColourIndex);
-    //printf ("Setting colours took %.2f msec\n",theTimer.ElapsedMsec());
+    //  First, clear the histogram and build it, and wait for it.
+    
+    MTL::CommandBuffer* pCmd = _pCommandQueue->commandBuffer();
+    MTL::ComputeCommandEncoder* pEnc = pCmd->computeCommandEncoder();
+    pEnc->setBuffer(pImageBuffer,0,0);
+    pEnc->setBuffer(_pHistBuffer,0,2);
+    pEnc->setBytes(&Args,sizeof(ColourArgs),4);
+    pEnc->setComputePipelineState(_pClearHistPSO);
+    pEnc->dispatchThreads(MTL::Size(Levels,1,1),MTL::Size(
+                std::min(GroupSize,_pClearHistPSO->maxTotalThreadsPerThreadgroup()),1,1));
+    pEnc->setComputePipelineState(_pBuildHistPSO);
+    pEnc->dispatchThreadgroups(MTL::Size(PixelGroups,1,1),MTL::Size(GroupSize,1,1));
+    pEnc->endEncoding();
+    pCmd->commit();
+    pCmd->waitUntilCompleted();
+    
+    //  Then work out the colour for each data value, and have the GPU set the colours.
+    
+    const uint32_t* Hist = (const uint32_t*)_pHistBuffer->contents();
+    _hist.assign(Hist,Hist + Levels);
+    _colourIndex.resize(_iterLimit);
+    int* ColourIndex = _colourIndex.data();
+    BuildColourIndex(ColourIndex);
+    simd::float3* Lut = (simd::float3*)_pLutBuffer->contents();
+    for (int I = 0; I < _iterLimit; I++) {
+        float R,G,B;
+        GetRGB(ColourIndex[I],&R,&G,&B);
+        Lut[I] = {R,G,B};
+    }
+    
+    if (_quadDraw && _quadAvailable && _textureAvailable) {
+        
+        //  The texture has a pixel for each image pixel, and is only replaced if the image
+        //  size changes. Only the GPU uses it, so it can be private.
+        
+        if (_pImageTexture == nullptr || _pImageTexture->width() != NS::UInteger(Nx) ||
+                                         _pImageTexture->height() != NS::UInteger(Ny)) {
+            if (_pImageTexture) _pImageTexture->release();
+            MTL::TextureDescriptor* pTexDesc = MTL::TextureDescriptor::texture2DDescriptor(
+                                                   MTL::PixelFormatRGBA8Unorm,Nx,Ny,false);
+            pTexDesc->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+            pTexDesc->setStorageMode(MTL::StorageModePrivate);
+            _pImageTexture = _pDevice->newTexture(pTexDesc);
+            _debug.Logf("Setup","Image texture set to %d by %d.",Nx,Ny);
+        }
+        pCmd = _pCommandQueue->commandBuffer();
+        pEnc = pCmd->computeCommandEncoder();
+        pEnc->setComputePipelineState(_pSetTexturePSO);
+        pEnc->setBuffer(pImageBuffer,0,0);
+        pEnc->setBuffer(_pLutBuffer,0,3);
+        pEnc->setBytes(&Args,sizeof(ColourArgs),4);
+        pEnc->setTexture(_pImageTexture,0);
+        NS::UInteger Width = _pSetTexturePSO->threadExecutionWidth();
+        NS::UInteger Height = std::max(NS::UInteger(1),
+                                   _pSetTexturePSO->maxTotalThreadsPerThreadgroup() / Width);
+        pEnc->dispatchThreads(MTL::Size(Nx,Ny,1),MTL::Size(Width,Height,1));
+        pEnc->endEncoding();
+        pCmd->commit();
+    } else if (!(_quadDraw && _quadAvailable)) {
+        pCmd = _pCommandQueue->commandBuffer();
+        pEnc = pCmd->computeCommandEncoder();
+        pEnc->setComputePipelineState(_pSetColoursPSO);
+        pEnc->setBuffer(pImageBuffer,0,0);
+        pEnc->setBuffer(_pVertexColorsBuffer,0,1);
+        pEnc->setBuffer(_pLutBuffer,0,3);
+        pEnc->setBytes(&Args,sizeof(ColourArgs),4);
+        GroupSize = std::min(NS::UInteger(C_ColourGroupSize),
+                                       _pSetColoursPSO->maxTotalThreadsPerThreadgroup());
+        pEnc->dispatchThreadgroups(MTL::Size(PixelGroups,1,1),MTL::Size(GroupSize,1,1));
+        pEnc->endEncoding();
+        pCmd->commit();
+    }
+    
+    pPool->release();
 }
 
-void Renderer::PercentileRange (float* imageData,int Nx,int Ny,float Percentile,
+void Renderer::PercentileRange (uint32_t* imageData,int Nx,int Ny,float Percentile,
                                                  float* rangeMin,float* rangeMax)
 {
     //  This is made easier by the fact that we know all the values in imageData will
@@ -344,60 +842,207 @@ bool Renderer::BuildShaders()
     using NS::StringEncoding::UTF8StringEncoding;
 
     //  This is a very basic pair of shaders, taken from the code used for the examples supplied
-    //  with metal-cpp. The vertex shader takes two buffers, one giving the x,y,z positions for the
-    //  various vertices and the other giving the corresponding R,G,B colours. It will be invoked
-    //  for each vertex and returns the position as x,y,z,w where w is a scaling factor by which
-    //  x,y,z are divided to scale them to the -1 to +1 range of the normalised coordinates
-    //  used by Metal, and returns the colour as the r,g,b values unchanged. So it does very
-    //  little indeed. The fragment shader is invoked for every display pixel, and is passed
-    //  the interpolated r,g,b colour for that display pixel. It simply returns this as an
-    //  r,g,b,a value where a is the opacity value, in this case set to 1 for fully opaque.
-    //  In other words, neither do very much, but they have to be supplied for the pipeline
-    //  to run.
-    
-    const char* shaderSrc = R"(
-        #include <metal_stdlib>
-        using namespace metal;
-
-        struct v2f
-        {
-            float4 position [[position]];
-            half3 color;
-        };
-
-        v2f vertex vertexMain( uint vertexId [[vertex_id]],
-                               device const float3* positions [[buffer(0)]],
-                               device const float3* colors [[buffer(1)]] )
-        {
-            v2f o;
-            o.position = float4( positions[ vertexId ], 1.0 );
-            o.color = half3 ( colors[ vertexId ] );
-            return o;
+    //  with metal-cpp - vertexMain and fragmentMain in renderer.metal. The vertex shader takes
+    //  two buffers, one giving the x,y,z positions for the various vertices and the other
+    //  giving the corresponding R,G,B colours, and returns the position as x,y,z,w and the
+    //  colour unchanged. The fragment shader is invoked for every display pixel, and simply
+    //  returns the interpolated colour as fully opaque. Neither does very much, but they have
+    //  to be supplied for the pipeline to run. They used to be compiled on the fly from source
+    //  text here, but are now compiled into the Metal library when the program is built.
+    
+    NS::Error* pError = nullptr;
+    MTL::Function* pVertexFn = nullptr;
+    MTL::Function* pFragFn = nullptr;
+    MTL::RenderPipelineDescriptor* pDesc = nullptr;
+    
+    if (_pLibrary) {
+
+        pVertexFn = _pLibrary->newFunction( NS::String::string("vertexMain",UTF8StringEncoding) );
+        pFragFn = _pLibrary->newFunction( NS::String::string("fragmentMain",UTF8StringEncoding) );
+
+        pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
+        pDesc->setVertexFunction( pVertexFn );
+        pDesc->setFragmentFunction( pFragFn );
+        pDesc->colorAttachments()->object(0)->setPixelFormat(
+                                                MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB );
+
+        _pPSO = _pArchive->NewRenderPipeline( pDesc, &pError );
+        if ( !_pPSO ) {
+           if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
+        } else {
+            ReturnOK = true;
+        }
+    }
+
+    if (pVertexFn) pVertexFn->release();
+    if (pFragFn) pFragFn->release();
+    if (pDesc) pDesc->release();
+    
+    return ReturnOK;
+}
+
+//  BuildColourPipeline() creates the compute pipelines used by SetColourDataGPU(), for the
+//  kernels in renderer.metal. These clear the histogram, build the histogram - each thread
+//  group counting the low values, which are almost all of them, in threadgroup memory, and
+//  adding its counts to the histogram at the end - and set the colours of the vertices for
+//  each pixel from the table of colours for each value. Each kernel loops over as many pixels
+//  as it needs to. It returns false if any of this fails, in which case the CPU is used to
+//  colour the image instead.
+
+bool Renderer::BuildColourPipeline()
+{
+    bool ReturnOK = false;
+    
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::Error* pError = nullptr;
+    if (_pLibrary) {
+        const char* names[3] = {"clearHist","buildHist","setColours"};
+        MTL::ComputePipelineState** states[3] =
+                                       {&_pClearHistPSO,&_pBuildHistPSO,&_pSetColoursPSO};
+        ReturnOK = true;
+        for (int I = 0; I < 3; I++) {
+            MTL::Function* pFn =
+                        _pLibrary->newFunction( NS::String::string(names[I],UTF8StringEncoding) );
+            *states[I] = _pArchive->NewComputePipeline( pFn, &pError );
+            if ( !*states[I] ) {
+                if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
+                ReturnOK = false;
+            }
+            if (pFn) pFn->release();
         }
+    }
+    if (ReturnOK) {
+        _debug.Log("Setup","Colouring kernels created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the colouring kernels. The CPU will be used.");
+    }
+    return ReturnOK;
+}
 
-        half4 fragment fragmentMain( v2f in [[stage_in]] )
-        {
-            return half4( in.color, 1.0 );
+//  BuildTexturePipeline() creates the compute pipeline that writes the colour of each image
+//  pixel into a texture, and the render pipeline that draws the quad from that texture, using
+//  setTexture, quadVertex and textureFragment in renderer.metal. This is used instead of the
+//  quad pipeline, which looks up the colour of every display pixel, if it can be set up. It
+//  returns false if this fails.
+
+bool Renderer::BuildTexturePipeline()
+{
+    bool ReturnOK = false;
+    
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::Error* pError = nullptr;
+    MTL::Function* pKernelFn = nullptr;
+    MTL::Function* pVertexFn = nullptr;
+    MTL::Function* pFragFn = nullptr;
+    MTL::RenderPipelineDescriptor* pDesc = nullptr;
+    
+    if (_pLibrary) {
+        pKernelFn = _pLibrary->newFunction( NS::String::string("setTexture",UTF8StringEncoding) );
+        _pSetTexturePSO = _pArchive->NewComputePipeline( pKernelFn, &pError );
+        if ( !_pSetTexturePSO ) {
+            if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
+        } else {
+            pVertexFn =
+                     _pLibrary->newFunction( NS::String::string("quadVertex",UTF8StringEncoding) );
+            pFragFn = _pLibrary->newFunction(
+                                     NS::String::string("textureFragment",UTF8StringEncoding) );
+            pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
+            pDesc->setVertexFunction( pVertexFn );
+            pDesc->setFragmentFunction( pFragFn );
+            pDesc->colorAttachments()->object(0)->setPixelFormat(
+                                                MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB );
+            _pTexturePSO = _pArchive->NewRenderPipeline( pDesc, &pError );
+            if ( !_pTexturePSO ) {
+                if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
+            } else {
+                ReturnOK = true;
+            }
         }
-    )";
+    }
 
-    //  Compile the shaders on the fly from the text above. It might be more usual to have
-    //  them already compiled into a Metal library (see the compute handler code for an
-    //  example of this), but it can be simpler to have everything in one place like this.
+    if (pKernelFn) pKernelFn->release();
+    if (pVertexFn) pVertexFn->release();
+    if (pFragFn) pFragFn->release();
+    if (pDesc) pDesc->release();
+    
+    if (ReturnOK) {
+        _debug.Log("Setup","Texture drawing pipelines created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the texture drawing pipelines.");
+    }
+    return ReturnOK;
+}
+
+//  BuildQuadPipeline() creates the render pipeline used to draw the image as a single quad,
+//  using quadVertex and quadFragment in renderer.metal. The vertex shader needs no buffers -
+//  it makes the three vertices of a triangle that covers the whole view from the vertex
+//  index - and the fragment shader looks up the image value for each display pixel in the
+//  image buffer used by the colouring kernels, and its colour in their colour table. It
+//  returns false if this fails, in which case the image is always drawn as a triangle strip.
+
+bool Renderer::BuildQuadPipeline()
+{
+    bool ReturnOK = false;
     
+    using NS::StringEncoding::UTF8StringEncoding;
+
     NS::Error* pError = nullptr;
     MTL::Function* pVertexFn = nullptr;
     MTL::Function* pFragFn = nullptr;
     MTL::RenderPipelineDescriptor* pDesc = nullptr;
     
-    MTL::Library* pLibrary =
-        _pDevice->newLibrary(NS::String::string(shaderSrc,UTF8StringEncoding), nullptr, &pError );
-    if ( !pLibrary ) {
-        printf( "%s", pError->localizedDescription()->utf8String() );
+    if (_pLibrary) {
+        pVertexFn = _pLibrary->newFunction( NS::String::string("quadVertex",UTF8StringEncoding) );
+        pFragFn = _pLibrary->newFunction( NS::String::string("quadFragment",UTF8StringEncoding) );
+
+        pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
+        pDesc->setVertexFunction( pVertexFn );
+        pDesc->setFragmentFunction( pFragFn );
+        pDesc->colorAttachments()->object(0)->setPixelFormat(
+                                                MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB );
+
+        _pQuadPSO = _pArchive->NewRenderPipeline( pDesc, &pError );
+        if ( !_pQuadPSO ) {
+           if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
+        } else {
+            ReturnOK = true;
+        }
+    }
+
+    if (pVertexFn) pVertexFn->release();
+    if (pFragFn) pFragFn->release();
+    if (pDesc) pDesc->release();
+    
+    if (ReturnOK) {
+        _debug.Log("Setup","Quad drawing pipeline created.");
     } else {
+        _debug.Log("Setup","Unable to set up the quad drawing pipeline.");
+    }
+    return ReturnOK;
+}
+
+//  BuildStripPipeline() creates the render pipeline used to draw the image as a triangle strip
+//  without a positions buffer, using stripVertex and fragmentMain in renderer.metal. The vertex
+//  shader works out the position of each vertex from its index and the image dimensions, and
+//  takes its colour from the colours buffer, as vertexMain does. It returns false if this
+//  fails, in which case BuildBuffers() sets up a positions buffer and vertexMain is used.
 
-        pVertexFn = pLibrary->newFunction( NS::String::string("vertexMain",UTF8StringEncoding) );
-        pFragFn = pLibrary->newFunction( NS::String::string("fragmentMain",UTF8StringEncoding) );
+bool Renderer::BuildStripPipeline()
+{
+    bool ReturnOK = false;
+    
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::Error* pError = nullptr;
+    MTL::Function* pVertexFn = nullptr;
+    MTL::Function* pFragFn = nullptr;
+    MTL::RenderPipelineDescriptor* pDesc = nullptr;
+    
+    if (_pLibrary) {
+        pVertexFn = _pLibrary->newFunction( NS::String::string("stripVertex",UTF8StringEncoding) );
+        pFragFn = _pLibrary->newFunction( NS::String::string("fragmentMain",UTF8StringEncoding) );
 
         pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
         pDesc->setVertexFunction( pVertexFn );
@@ -405,9 +1050,9 @@ bool Renderer::BuildShaders()
         pDesc->colorAttachments()->object(0)->setPixelFormat(
                                                 MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB );
 
-        _pPSO = _pDevice->newRenderPipelineState( pDesc, &pError );
-        if ( !_pPSO ) {
-           printf( "%s", pError->localizedDescription()->utf8String() );
+        _pStripPSO = _pArchive->NewRenderPipeline( pDesc, &pError );
+        if ( !_pStripPSO ) {
+           if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
         } else {
             ReturnOK = true;
         }
@@ -416,8 +1061,70 @@ bool Renderer::BuildShaders()
     if (pVertexFn) pVertexFn->release();
     if (pFragFn) pFragFn->release();
     if (pDesc) pDesc->release();
-    if (pLibrary) pLibrary->release();
     
+    if (ReturnOK) {
+        _debug.Log("Setup","Triangle strip pipeline created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the triangle strip pipeline.");
+    }
+    return ReturnOK;
+}
+
+//  BuildLevelsPipeline() creates the render pipeline used to draw the triangle strip when the
+//  CPU colours the image, using levelsVertex and fragmentMain in renderer.metal, and sets up the
+//  palette it uses - the colour for each of the 256 colour levels, which never changes. The
+//  vertex shader works out the vertex positions just as stripVertex does, and looks up the
+//  colour of each vertex in the palette from the colour level of its pixel, so the CPU only has
+//  to set one byte per pixel. It returns false if this fails, in which case the CPU sets the
+//  colours of all the vertices instead.
+
+bool Renderer::BuildLevelsPipeline()
+{
+    bool ReturnOK = false;
+    
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::Error* pError = nullptr;
+    MTL::Function* pVertexFn = nullptr;
+    MTL::Function* pFragFn = nullptr;
+    MTL::RenderPipelineDescriptor* pDesc = nullptr;
+    
+    if (_pLibrary) {
+        pVertexFn = _pLibrary->newFunction( NS::String::string("levelsVertex",UTF8StringEncoding) );
+        pFragFn = _pLibrary->newFunction( NS::String::string("fragmentMain",UTF8StringEncoding) );
+
+        pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
+        pDesc->setVertexFunction( pVertexFn );
+        pDesc->setFragmentFunction( pFragFn );
+        pDesc->colorAttachments()->object(0)->setPixelFormat(
+                                                MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB );
+
+        _pLevelsPSO = _pArchive->NewRenderPipeline( pDesc, &pError );
+        if ( !_pLevelsPSO ) {
+           if (pError) printf( "%s", pError->localizedDescription()->utf8String() );
+        } else {
+            ReturnOK = true;
+        }
+    }
+
+    if (pVertexFn) pVertexFn->release();
+    if (pFragFn) pFragFn->release();
+    if (pDesc) pDesc->release();
+    
+    if (ReturnOK) {
+        const int LevelsAvailable = 256;
+        _pPaletteBuffer = _pDevice->newBuffer(LevelsAvailable * sizeof(simd::float3),
+                                                             MTL::ResourceStorageModeShared);
+        simd::float3* Palette = (simd::float3*)_pPaletteBuffer->contents();
+        for (int Level = 0; Level < LevelsAvailable; Level++) {
+            float R,G,B;
+            GetRGB(Level,&R,&G,&B);
+            Palette[Level] = {R,G,B};
+        }
+        _debug.Log("Setup","Colour levels pipeline created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the colour levels pipeline.");
+    }
     return ReturnOK;
 }
 
@@ -444,23 +1151,52 @@ void Renderer::BuildBuffers()
     _debug.Logf("Setup","Rebuilding renderer buffers to %d by %d.",Nx,Ny);
     MsecTimer theTimer;
     
-    const size_t NumVertices = ((Nx - 1) * 2 + 6) * Ny;;
+    const size_t NumVertices = ((Nx - 1) * 2 + 6) * Ny;
+    const size_t Pixels = size_t(Nx) * size_t(Ny);
 
+    //  If the vertex shader works out the vertex positions, there's no positions buffer at
+    //  all. If it looks up the colours from the colour level of each pixel, which it can do
+    //  when the CPU colours the image, the CPU only writes one byte per pixel, into the levels
+    //  buffer, and there's no vertex colours buffer either.
+    
+    bool UseLevels = _levelsAvailable && !_gpuColouring;
     const size_t positionsDataSize = NumVertices * sizeof( simd::float3 );
-    const size_t colorDataSize = NumVertices * sizeof( simd::float3 );
+    const size_t colorDataSize = UseLevels ? Pixels : NumVertices * sizeof( simd::float3 );
     
-    //  Should we test to see if the image dimensions have actually changed?
+    //  Should we test to see if the image dimensions have actually changed? (The buffer heap
+    //  makes replacing the buffers cheap, and reuses the memory of the old ones - although
+    //  managed buffers can't come from a heap.)
     
-    if (_pVertexPositionsBuffer) _pVertexPositionsBuffer->release();
-    if (_pVertexColorsBuffer) _pVertexColorsBuffer->release();
+    WaitForUpload();
+    _pBufferHeap->Recycle(_pVertexPositionsBuffer);
+    _pBufferHeap->Recycle(_pVertexColorsBuffer);
+    _pBufferHeap->Recycle(_pLevelsBuffer);
+    _pBufferHeap->Recycle(_pColourStaging);
+    _pVertexPositionsBuffer = nullptr;
+    _pVertexColorsBuffer = nullptr;
+    _pLevelsBuffer = nullptr;
+    _pColourStaging = nullptr;
+    
+    //  Private buffers are only visible to the GPU, so the CPU writes their contents into
+    //  a shared staging buffer, and a blit encoder copies them from there. The colours (or
+    //  levels) keep their staging buffer, for SetColourDataHistEq() to use, unless the GPU
+    //  sets them.
     
     MTL::ResourceOptions storageMode = MTL::ResourceStorageModeShared;
     if (_useManagedBuffers) storageMode = MTL::ResourceStorageModeManaged;
-    MTL::Buffer* pVertexPositionsBuffer = _pDevice->newBuffer( positionsDataSize, storageMode);
-    MTL::Buffer* pVertexColorsBuffer = _pDevice->newBuffer(colorDataSize, storageMode);
-    
-    _pVertexPositionsBuffer = pVertexPositionsBuffer;
-    _pVertexColorsBuffer = pVertexColorsBuffer;
+    if (_usePrivateBuffers) storageMode = MTL::ResourceStorageModePrivate;
+    if (!_stripAvailable) {
+        _pVertexPositionsBuffer = _pBufferHeap->NewBuffer(positionsDataSize,storageMode);
+    }
+    MTL::Buffer* pColourBuffer = _pBufferHeap->NewBuffer(colorDataSize,storageMode);
+    if (UseLevels) {
+        _pLevelsBuffer = pColourBuffer;
+    } else {
+        _pVertexColorsBuffer = pColourBuffer;
+    }
+    if (_usePrivateBuffers) {
+        _pColourStaging = _pBufferHeap->NewBuffer(colorDataSize,MTL::ResourceStorageModeShared);
+    }
     _debug.Logf("Timing","Resized renderer buffers at %.2f msec",theTimer.ElapsedMsec());
 
     //  This adds overlay buffers, just as a test...
@@ -469,8 +1205,8 @@ void Renderer::BuildBuffers()
         int MaxOverVerts = (_iterLimit * 2 + 1) * 2;
         printf ("MaxOverVerts = %d\n",MaxOverVerts);
         int MaxOverVertBytes = MaxOverVerts * sizeof(simd::float3);
-        MTL::Buffer* pOverlayVertexBuffer = _pDevice->newBuffer(MaxOverVertBytes,storageMode);
-        MTL::Buffer* pOverlayColorsBuffer = _pDevice->newBuffer(MaxOverVertBytes,storageMode);
+        MTL::Buffer* pOverlayVertexBuffer = _pBufferHeap->NewBuffer(MaxOverVertBytes,storageMode);
+        MTL::Buffer* pOverlayColorsBuffer = _pBufferHeap->NewBuffer(MaxOverVertBytes,storageMode);
         _pOverlayVertexBuffer = pOverlayVertexBuffer;
         _pOverlayColorsBuffer = pOverlayColorsBuffer;
         _maxOverVerts = MaxOverVerts;
@@ -488,10 +1224,14 @@ void Renderer::BuildBuffers()
     
     //  The vertex positions remain constant even if a new image is computed, so long as the
     //  size of the image has not changed, but new image data requires that the colour values
-    //  for each pixel be recalculated.
+    //  for each pixel be recalculated. (stripPosition() in renderer.metal works out the same
+    //  positions, if there's no positions buffer.)
     
-    simd::float3 *positions = new simd::float3[NumVertices];
-    simd::float3 *colors = new simd::float3[NumVertices];
+    simd::float3 *positions = nullptr;
+    if (_pVertexPositionsBuffer) positions = new simd::float3[NumVertices];
+    simd::float3 *colors = new simd::float3[(colorDataSize + sizeof(simd::float3) - 1) /
+                                                                     sizeof(simd::float3)];
+    uint8_t *levels = (uint8_t*)colors;
     
     //  Set up the vertex positions for all the triangles. Note that the coordinate range
     //  for a View is from -1.0 to +1.0. For each pixel to be displayed, we calculate the
@@ -501,7 +1241,7 @@ void Renderer::BuildBuffers()
     int Nv = 0;
     float Yinc = 2.0 / float(Ny);
     float Xinc = 2.0 / float(Nx);
-    for (int Iy = 0; Iy < Ny; Iy++) {
+    for (int Iy = 0; positions && Iy < Ny; Iy++) {
         float Y = Iy * Yinc - 1.0;
         float Yp1 = Y + Yinc;
         float X = -1.0;
@@ -540,7 +1280,8 @@ void Renderer::BuildBuffers()
     //  but if they're all the same we get a solid rectangle). Generally, this
     //  grey-scale 'dome' will never get a chance to be seen, but the buffers
     //  do need to be initialised to something, and this shows how to set the
-    //  colour buffer values.
+    //  colour buffer values. If there are levels instead, each pixel just gets
+    //  a colour level that decreases in the same way.
     
     int Nc = 0;
     float NxBy2 = float(Nx) * 0.5;
@@ -551,7 +1292,11 @@ void Renderer::BuildBuffers()
             float Xdist = fabs(float(Ix) - NxBy2);
             float Ydist = fabs(float(Iy) - NyBy2);
             float DistSq = Xdist * Xdist + Ydist * Ydist;
-            float Grey = 1.0 - sqrt(DistSq / MaxDistSq);
+            float Grey = std::max(1.0 - sqrt(DistSq / MaxDistSq),0.0);
+            if (UseLevels) {
+                levels[Nc++] = uint8_t(Grey * 255.0);
+                continue;
+            }
             simd::float3 RGB= {Grey,Grey,Grey};
             int Vertices = 2;
             
@@ -565,22 +1310,48 @@ void Renderer::BuildBuffers()
         //  Then there is one extra colour needed for at the end of each line for the
         //  final vertex that produces the terminating zero-area triangle.
 
-        colors[Nc++] = {0.0,0.0,0.0};
+        if (!UseLevels) colors[Nc++] = {0.0,0.0,0.0};
     }
     _debug.Logf("Timing","Recalculated vertices & colours at %.2f msec",theTimer.ElapsedMsec());
 
-    memcpy( _pVertexPositionsBuffer->contents(), positions, positionsDataSize );
-    memcpy( _pVertexColorsBuffer->contents(), colors, colorDataSize );
+    if (_usePrivateBuffers) {
+        MTL::Buffer* pPositionsStaging = nullptr;
+        memcpy( _pColourStaging->contents(), colors, colorDataSize );
+        NS::AutoreleasePool* pPool = NS::AutoreleasePool::alloc()->init();
+        MTL::CommandBuffer* pCmd = _pCommandQueue->commandBuffer();
+        MTL::BlitCommandEncoder* pBlit = pCmd->blitCommandEncoder();
+        if (positions) {
+            pPositionsStaging =
+                     _pBufferHeap->NewBuffer(positionsDataSize,MTL::ResourceStorageModeShared);
+            memcpy( pPositionsStaging->contents(), positions, positionsDataSize );
+            pBlit->copyFromBuffer(pPositionsStaging,0,_pVertexPositionsBuffer,0,positionsDataSize);
+        }
+        pBlit->copyFromBuffer(_pColourStaging,0,pColourBuffer,0,colorDataSize);
+        pBlit->endEncoding();
+        pCmd->commit();
+        pCmd->waitUntilCompleted();
+        pPool->release();
+        _pBufferHeap->Recycle(pPositionsStaging);
+        if (_gpuColouring) {
+            _pBufferHeap->Recycle(_pColourStaging);
+            _pColourStaging = nullptr;
+        }
+    } else {
+        if (positions) memcpy( _pVertexPositionsBuffer->contents(), positions, positionsDataSize );
+        memcpy( pColourBuffer->contents(), colors, colorDataSize );
+    }
 
-    if (_useManagedBuffers) {
-        _pVertexPositionsBuffer->didModifyRange(
+    if (_useManagedBuffers && !_usePrivateBuffers) {
+        if (positions) {
+            _pVertexPositionsBuffer->didModifyRange(
                                           NS::Range::Make(0,_pVertexPositionsBuffer->length()));
-        _pVertexColorsBuffer->didModifyRange(NS::Range::Make(0,_pVertexColorsBuffer->length()));
+        }
+        pColourBuffer->didModifyRange(NS::Range::Make(0,pColourBuffer->length()));
     }
     _debug.Logf("Timing","Copied data to renderer buffers at %.2f msec",theTimer.ElapsedMsec());
 
     if (positions) delete[] positions;
-    if (colors) delete[] colors;
+    delete[] colors;
 
 }
 
@@ -603,9 +1374,27 @@ void Renderer::SetOverlay(float* xPosns,float* yPosns,int nPosns)
     _overVerts = nPosns;
 }
 
-void Renderer::Draw(MTK::View* pView, float* imageData )
+void Renderer::Draw(MTK::View* pView, uint32_t* imageData )
 {
-    SetColourDataHistEq(imageData,_nx,_ny);
+    Draw(pView,imageData,nullptr);
+}
+
+//  This version of Draw() is also passed a buffer that already holds the image - normally the
+//  one the compute handler computed it in, which is only possible if the compute handler uses
+//  the same device. If the GPU colours the image, it reads it straight from that buffer, so the
+//  image never has to be copied by the CPU. imageData must still be the image, as the CPU
+//  colours it if the GPU can't. Since the owner of the buffer may write to it again as soon as
+//  this returns, this waits for the frame to be drawn if it used the buffer.
+
+void Renderer::Draw(MTK::View* pView, uint32_t* imageData, MTL::Buffer* pImageBuffer)
+{
+    MsecTimer colourTimer;
+    if (_gpuColouring) {
+        SetColourDataGPU(imageData,_nx,_ny,pImageBuffer);
+    } else {
+        SetColourDataHistEq(imageData,_nx,_ny);
+    }
+    _colourMsec = colourTimer.ElapsedMsec();
 
     int Nx = _nx;
     int Ny = _ny;
@@ -621,12 +1410,51 @@ void Renderer::Draw(MTK::View* pView, float* imageData )
     MTL::RenderPassDescriptor* pRpd = pView->currentRenderPassDescriptor();
     MTL::RenderCommandEncoder* pEnc = pCmd->renderCommandEncoder( pRpd );
 
-    pEnc->setRenderPipelineState( _pPSO );
+    //  The quad is just the three vertices of the triangle covering the view, made by the
+    //  vertex shader. The fragment shader is given the image and the colour table set up by
+    //  SetColourDataGPU().
+    
+    //  If the texture is used, the fragment shader only needs that.
     
-    pEnc->setVertexBuffer( _pVertexPositionsBuffer, 0, 0 );
-    pEnc->setVertexBuffer( _pVertexColorsBuffer, 0, 1 );
-    pEnc->drawPrimitives( MTL::PrimitiveType::PrimitiveTypeTriangleStrip, NS::UInteger(0),
-                            NS::UInteger(NumVertices) );
+    if (_quadDraw && _quadAvailable && _gpuColouring) {
+        if (_textureAvailable && _pImageTexture) {
+            pEnc->setRenderPipelineState( _pTexturePSO );
+            pEnc->setFragmentTexture( _pImageTexture, 0 );
+        } else {
+            ColourArgs Args = {Nx,Ny,_iterLimit};
+            pEnc->setRenderPipelineState( _pQuadPSO );
+            pEnc->setFragmentBuffer( _pColourImageBuffer, 0, 0 );
+            pEnc->setFragmentBuffer( _pLutBuffer, 0, 3 );
+            pEnc->setFragmentBytes( &Args, sizeof(ColourArgs), 4 );
+        }
+        pEnc->drawPrimitives( MTL::PrimitiveType::PrimitiveTypeTriangle, NS::UInteger(0),
+                                NS::UInteger(3) );
+        pEnc->setRenderPipelineState( _pPSO );
+    } else {
+    
+        //  The triangle strip needs the positions buffer only if the vertex shader can't
+        //  work them out, and if there's a levels buffer, the colours come from that and the
+        //  palette instead of the colours buffer.
+        
+        ColourArgs Args = {Nx,Ny,_iterLimit};
+        if (_pLevelsBuffer) {
+            pEnc->setRenderPipelineState( _pLevelsPSO );
+            pEnc->setVertexBytes( &Args, sizeof(ColourArgs), 4 );
+            pEnc->setVertexBuffer( _pLevelsBuffer, 0, 5 );
+            pEnc->setVertexBuffer( _pPaletteBuffer, 0, 6 );
+        } else if (_stripAvailable) {
+            pEnc->setRenderPipelineState( _pStripPSO );
+            pEnc->setVertexBytes( &Args, sizeof(ColourArgs), 4 );
+            pEnc->setVertexBuffer( _pVertexColorsBuffer, 0, 1 );
+        } else {
+            pEnc->setRenderPipelineState( _pPSO );
+            pEnc->setVertexBuffer( _pVertexPositionsBuffer, 0, 0 );
+            pEnc->setVertexBuffer( _pVertexColorsBuffer, 0, 1 );
+        }
+        pEnc->drawPrimitives( MTL::PrimitiveType::PrimitiveTypeTriangleStrip, NS::UInteger(0),
+                                NS::UInteger(NumVertices) );
+        pEnc->setRenderPipelineState( _pPSO );
+    }
     
     if (_overVerts > 0) {
         pEnc->setVertexBuffer( _pOverlayVertexBuffer, 0, 0 );
@@ -638,8 +1466,10 @@ void Renderer::Draw(MTK::View* pView, float* imageData )
     pEnc->endEncoding();
     pCmd->presentDrawable( pView->currentDrawable() );
     pCmd->commit();
+    if (_gpuColouring && pImageBuffer) pCmd->waitUntilCompleted();
 
     pPool->release();
+    _presentMsec = theTimer.ElapsedMsec();
     
     //printf ("Draw took %.2f msec\n",theTimer.ElapsedMsec());
     _frames++;
@@ -769,6 +1599,9 @@ void Renderer::GetRGB (int Index, float* R, float* G, float* B) {
      comes from. It may be that using just two triangles to form a rectangle covering
      the whole image and using a texture would be even faster, but in any case, the time
      taken for the rendering is generally small compared to that required for the computation.
+     (The quad drawn from a texture - see BuildTexturePipeline() - now does just that, and
+     is the default when the GPU colours the image. The triangle strip is still there, for
+     comparison, and for when the GPU colouring can't be set up.)
 
     o   For Apple's basic documentation on the render pipeline, see:
         https://developer.appl
@@ -42,6 +42,24 @@
 //                  Initialise(). This brings this up to date with the latest changes to the
 //                  Vulkan version. KS.
 //      4 Sep 2024. Added support for SetOverlay(). KS.
+//     15 Oct 2026. Added GetHistogram(). KS.
+//                  Added GetDrawTimes(). KS.
+//                  Image data is now passed as uint32_t iteration counts. KS.
+//                  Added SetColourDataGPU(), BuildColourIndex() and BuildColourPipeline(),
+//                  so the image can be coloured by compute kernels. KS.
+//                  Added SetQuadDraw() and BuildQuadPipeline(), so the image can be drawn
+//                  as a single quad coloured by the fragment shader. KS.
+//                  Added a version of Draw() that is passed a buffer already holding the
+//                  image. KS.
+//                  Added _colourIndex and _bandHists. KS.
+//                  Added StartCapture() and StopCapture(), to match the Vulkan version. KS.
+//                  Added _pLibrary and _pArchive. KS.
+//                  Added _pBufferHeap. KS.
+//                  Added _usePrivateBuffers, _pColourStaging, _pUploadCmd and _dirtyLines,
+//                  and ColourStagingBuffer(), UploadColourLines() and WaitForUpload(). KS.
+//                  Added BuildTexturePipeline(), so the quad can be drawn from a texture. KS.
+//                  Added BuildStripPipeline() and BuildLevelsPipeline(), _pLevelsBuffer and
+//                  _pPaletteBuffer. UploadColourLines() is now passed the bytes per line. KS.
 
 #ifndef __RendererMetal__
 #define __RendererMetal__
@@ -51,6 +69,9 @@
 #include "MsecTimer.h"
 #include "DebugHandler.h"
 
+#include <vector>
+#include <cstdint>
+
 //  The MandelRenderDevice type is defined here so a controller can know what sort
 //  of device is expected by the constructor. (A Vulkan version of the controller,
 //  for example, would expect a different type of device.) Ditto MandelRendererView
@@ -59,6 +80,9 @@
 #define MandelRendererDevice MTL::Device
 #define MandelRendererView MTK::View
 
+class PipelineArchive;
+class BufferHeap;
+
 class Renderer
 {
     public:
@@ -68,20 +92,38 @@ class Renderer
         void SetImageSize (int Nx, int Ny);
         void SetDrawableSize (float width, float height);
         void SetMaxIter (int MaxIter);
+        const std::vector<int>& GetHistogram();
+        void GetDrawTimes(float* ColourMsec,float* PresentMsec);
         void SetOverlay(float* XPosns,float* YPosns,int NPosns);
-        void Draw(MTK::View* pView, float* imageData);
+        bool SetQuadDraw(bool UseQuad);
+        void Draw(MTK::View* pView, uint32_t* imageData);
+        void Draw(MTK::View* pView, uint32_t* imageData, MTL::Buffer* pImageBuffer);
+        bool StartCapture(const std::string& FilePrefix);
+        void StopCapture(int* Frames,int* Dropped);
         static std::string GetDebugOptions(void);
     private:
-        void SetColourData(float* imageData,int Nx,int Ny);
-        void SetColourDataHistEq(float* imageData,int Nx,int Ny);
+        void SetColourData(uint32_t* imageData,int Nx,int Ny);
+        void SetColourDataHistEq(uint32_t* imageData,int Nx,int Ny);
+        void SetColourDataGPU(uint32_t* imageData,int Nx,int Ny,MTL::Buffer* pImageBuffer);
+        void BuildColourIndex(int* ColourIndex);
         bool BuildShaders();
+        bool BuildColourPipeline();
+        bool BuildQuadPipeline();
+        bool BuildTexturePipeline();
+        bool BuildStripPipeline();
+        bool BuildLevelsPipeline();
         void BuildBuffers();
+        MTL::Buffer* ColourStagingBuffer(void);
+        void UploadColourLines(NS::UInteger LineBytes);
+        void WaitForUpload(void);
         void GetRGB (int Index, float* R, float* G, float* B);
-        void PercentileRange (float* imageData,int Nx,int Ny,float Percentile,
+        void PercentileRange (uint32_t* imageData,int Nx,int Ny,float Percentile,
                           float* rangeMin,float* rangeMax);
         static const std::string _debugOptions;
         MTL::Device* _pDevice;
         MTL::CommandQueue* _pCommandQueue;
+        //  The allocator for the renderer's buffers.
+        BufferHeap* _pBufferHeap;
         MTL::RenderPipelineState* _pPSO;
         MTL::Buffer* _pVertexPositionsBuffer;
         MTL::Buffer* _pVertexColorsBuffer;
@@ -92,12 +134,71 @@ class Renderer
         MsecTimer _frameTimer;
         DebugHandler _debug;
         bool _useManagedBuffers;
+        //  If set, the vertex buffers are private to the GPU, and the CPU writes the colours
+        //  into _pColourStaging, from which the lines flagged in _dirtyLines are copied by a
+        //  blit encoder in the command buffer _pUploadCmd. This overrides _useManagedBuffers.
+        bool _usePrivateBuffers;
+        MTL::Buffer* _pColourStaging;
+        MTL::CommandBuffer* _pUploadCmd;
+        std::vector<uint8_t> _dirtyLines;
         float _viewWidth;
         float _viewHeight;
         int _frames;
         int _iterLimit;
+        //  The histogram of the pixel values of the last image drawn - see GetHistogram().
+        std::vector<int> _hist;
+        //  Scratch arrays used in colouring an image, kept from one frame to the next: the
+        //  colour level for each pixel value, and the partial histograms of the bands of rows
+        //  handled by each thread in SetColourDataHistEq().
+        std::vector<int> _colourIndex;
+        std::vector<int> _bandHists;
+        //  The times taken by the last Draw() - see GetDrawTimes().
+        float _colourMsec;
+        float _presentMsec;
         int _nx;
         int _ny;
+        //  The compute kernels used by SetColourDataGPU(), and the buffers they use as well
+        //  as the colours buffer. _gpuColouring is false if these couldn't be set up.
+        bool _gpuColouring;
+        MTL::ComputePipelineState* _pClearHistPSO;
+        MTL::ComputePipelineState* _pBuildHistPSO;
+        MTL::ComputePipelineState* _pSetColoursPSO;
+        MTL::Buffer* _pImageBuffer;
+        MTL::Buffer* _pHistBuffer;
+        //  The buffer holding the image last coloured by SetColourDataGPU() - either
+        //  _pImageBuffer or one passed to Draw().
+        MTL::Buffer* _pColourImageBuffer;
+        MTL::Buffer* _pLutBuffer;
+        //  The render pipeline used to draw the image as a single quad. _quadAvailable is false
+        //  if this couldn't be set up, and _quadDraw is true if it's to be used.
+        bool _quadAvailable;
+        bool _quadDraw;
+        MTL::RenderPipelineState* _pQuadPSO;
+        //  The kernel that writes the image colours into a texture, and the render pipeline
+        //  that draws the quad from it, used instead of _pQuadPSO if _textureAvailable is set,
+        //  and the texture itself.
+        bool _textureAvailable;
+        MTL::ComputePipelineState* _pSetTexturePSO;
+        MTL::RenderPipelineState* _pTexturePSO;
+        MTL::Texture* _pImageTexture;
+        //  The render pipeline used to draw the triangle strip with the vertex positions worked
+        //  out by the vertex shader, so there's no positions buffer. _stripAvailable is false
+        //  if this couldn't be set up.
+        bool _stripAvailable;
+        MTL::RenderPipelineState* _pStripPSO;
+        //  The render pipeline used to draw the triangle strip when the CPU colours the image,
+        //  with the vertex shader looking up the colour of each vertex in the palette from the
+        //  colour level of its pixel. The levels buffer, one byte per pixel, is only created
+        //  if this is used - in which case there's no vertex colours buffer, and the staging
+        //  buffer holds levels. _levelsAvailable is false if this couldn't be set up.
+        bool _levelsAvailable;
+        MTL::RenderPipelineState* _pLevelsPSO;
+        MTL::Buffer* _pLevelsBuffer;
+        MTL::Buffer* _pPaletteBuffer;
+        //  The Metal library holding the shaders and kernels, and the archive of pipeline
+        //  states, only set while Initialise() builds the pipelines.
+        MTL::Library* _pLibrary;
+        PipelineArchive* _pArchive;
 };
 
 #endif
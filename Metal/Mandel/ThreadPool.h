@@ -0,0 +1,163 @@
+//
+//                             T h r e a d  P o o l . h
+//
+//  This provides a very basic pool of worker threads, intended for the CPU versions of
+//  the calculations in these programs. These all work by dividing the rows of an image
+//  up between a number of threads, and creating a new set of threads each time round
+//  adds the cost of creating (and joining) them to every pass - which matters if the
+//  passes are short, or - as with the Mandelbrot program when zooming - there are a lot
+//  of them. A ThreadPool creates its threads once, and they then wait to be given work.
+//
+//  The only facility provided is ParallelFor(), which is passed a range of rows, from
+//  Start up to (but not including) End, and a function that handles a sub-range of those
+//  rows. ParallelFor() splits the range into as many sub-ranges as there are threads to
+//  use, has the workers handle all but one of them, handles the last itself in the
+//  calling thread, and returns when they have all been done. OnEachThread() runs a function
+//  once in each thread, to set each one up - see ThreadPlacement.h.
+//
+//  Most programs will want to use the single shared pool returned by ThreadPool::Shared(),
+//  which has one thread for each CPU thread the hardware supports (counting the calling
+//  thread as one of them).
+//
+//  14th Oct 2026. First version. KS.
+//  15th Oct 2026. Added OnEachThread(). KS.
+
+#ifndef __ThreadPool__
+#define __ThreadPool__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    //  Creates a pool that can run up to Threads threads at once, counting the thread
+    //  that calls ParallelFor(). Zero means one per hardware thread.
+    ThreadPool(int Threads = 0) {
+        if (Threads <= 0) Threads = MaxThreads();
+        _generation = 0;
+        _pending = 0;
+        _ranges = 0;
+        _start = _end = 0;
+        _body = nullptr;
+        _stop = false;
+        for (int Index = 0; Index < Threads - 1; Index++) {
+            _workers.push_back(std::thread(&ThreadPool::Worker,this,Index));
+        }
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> Lock(_mutex);
+            _stop = true;
+        }
+        _startCond.notify_all();
+        for (std::thread& Worker : _workers) Worker.join();
+    }
+    //  Returns the number of threads the pool can use, including the calling thread.
+    int Threads(void) { return int(_workers.size()) + 1; }
+    //  Returns the number of threads the hardware supports, at least 1.
+    static int MaxThreads(void) {
+        int Threads = std::thread::hardware_concurrency();
+        if (Threads <= 0) Threads = 1;
+        return Threads;
+    }
+    //  Calls Body(First,Last) for consecutive sub-ranges from Start up to End, using
+    //  up to Threads threads, or all the threads in the pool if Threads is zero. Returns
+    //  the number of threads used. Calls from different threads are run one at a time.
+    int ParallelFor(int Start,int End,const std::function<void(int,int)>& Body,
+                                                                        int Threads = 0) {
+        if (Threads <= 0 || Threads > this->Threads()) Threads = this->Threads();
+        if (Threads > End - Start) Threads = End - Start;
+        if (Threads <= 1) {
+            if (End > Start) Body(Start,End);
+            return 1;
+        }
+        std::lock_guard<std::mutex> CallLock(_callMutex);
+        {
+            std::lock_guard<std::mutex> Lock(_mutex);
+            _body = &Body;
+            _start = Start;
+            _end = End;
+            _ranges = Threads;
+            _pending = Threads - 1;
+            _generation++;
+        }
+        _startCond.notify_all();
+        int First,Last;
+        RangeLimits(Threads - 1,&First,&Last);
+        Body(First,Last);
+        std::unique_lock<std::mutex> Lock(_mutex);
+        _doneCond.wait(Lock,[this]{ return _pending == 0; });
+        _body = nullptr;
+        return Threads;
+    }
+    //  Calls Body(Index) once in each thread of the pool, with Index 0 in the calling thread
+    //  and 1 up to Threads() - 1 in the workers, numbered so that a ParallelFor() using N
+    //  threads uses the ones given Index 0 to N - 1. Used to set up each thread, for example
+    //  to pin it to a CPU.
+    void OnEachThread(const std::function<void(int)>& Body) {
+        int Count = Threads();
+        ParallelFor(0,Count,[&](int First,int) { Body((First + 1) % Count); },Count);
+    }
+    //  Returns a pool shared by the whole program, created the first time it's needed.
+    static ThreadPool& Shared(void) {
+        static ThreadPool ThePool;
+        return ThePool;
+    }
+private:
+    //  Sets First and Last for sub-range Index of the current ParallelFor() call.
+    void RangeLimits(int Index,int* First,int* Last) {
+        long Rows = long(_end) - long(_start);
+        *First = _start + int((Rows * Index) / _ranges);
+        *Last = _start + int((Rows * (Index + 1)) / _ranges);
+    }
+    //  Each worker waits for a new ParallelFor() call, and handles its own sub-range
+    //  if that call has one for it.
+    void Worker(int Index) {
+        unsigned long Seen = 0;
+        for (;;) {
+            std::unique_lock<std::mutex> Lock(_mutex);
+            _startCond.wait(Lock,[this,Seen]{ return _stop || _generation != Seen; });
+            if (_stop) return;
+            Seen = _generation;
+            if (Index >= _ranges - 1) continue;
+            int First,Last;
+            RangeLimits(Index,&First,&Last);
+            const std::function<void(int,int)>* Body = _body;
+            Lock.unlock();
+            (*Body)(First,Last);
+            Lock.lock();
+            if (--_pending == 0) _doneCond.notify_one();
+        }
+    }
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::mutex _callMutex;
+    std::condition_variable _startCond;
+    std::condition_variable _doneCond;
+    const std::function<void(int,int)>* _body;
+    int _start;
+    int _end;
+    int _ranges;
+    int _pending;
+    unsigned long _generation;
+    bool _stop;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The workers sleep on a condition variable between calls, so an idle pool costs
+        nothing, but each ParallelFor() still has to wake them, which takes a few tens of
+        microseconds. That's much less than creating threads, but it isn't zero.
+
+    o   The calling thread always does one of the sub-ranges itself, which is why a pool
+        for N threads only has N-1 workers. This also means ParallelFor() must not be
+        called from inside a Body being run by the same pool - the inner call would wait
+        for the outer call to finish, which it never would.
+
+*/
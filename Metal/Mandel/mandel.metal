@@ -32,35 +32,81 @@ struct MandelArgs {
     float dX;         // Change in X-coordinate per pixel
     float dY;         // Change in Y-coordinate per pixel
     int iter;         // Maximum number of iterations
+    int nx;           // Number of image pixels in X
+    int ny;           // Number of image pixels in Y
+    int ixOrigin;     // First pixel in X covered by the grid
+    int iyOrigin;     // First pixel in Y covered by the grid
+    float xCentLo;    // Low parts of the center and scale values,
+    float yCentLo;    // used only by mandelFF - see mandelFF.metal
+    float dXLo;
+    float dYLo;
+    int checks;       // Non-zero to use the interior checks
 };
 
-kernel void mandel(device float *out [[ buffer(1) ]],
-                   constant MandelArgs *args [[buffer(2)]],
-                   uint2 index2 [[thread_position_in_grid]],
-                   uint2 gridSize [[threads_per_grid]]) {
+//  mandelPoint returns the value for the pixel (ix,iy) - the
+//  iteration count, or zero if the point is taken to be in the
+//  set. It is used both by mandel, which has one thread for each
+//  pixel, and by mandelQueue.
+
+static uint mandelPoint(constant MandelArgs *args,uint ix,uint iy) {
     
-    //  Work out the Mandelbrot coordinate of the center of
-    //  the pixel in question.
+    //  Work out the Mandelbrot coordinate of the center of the
+    //  pixel in question.
     
-    float gridXcent = gridSize.x * 0.5;
-    float gridYcent = gridSize.y * 0.5;
-    float x0 = args->xCent + (index2.x - gridXcent) * args->dX;
-    float y0 = args->yCent + (index2.y - gridYcent) * args->dY;
+    float gridXcent = args->nx * 0.5;
+    float gridYcent = args->ny * 0.5;
+    float x0 = args->xCent + (float(ix) - gridXcent) * args->dX;
+    float y0 = args->yCent + (float(iy) - gridYcent) * args->dY;
 
+    //  Points in the set take the maximum number of iterations,
+    //  and usually make up most of the work. Unless the checks
+    //  have been disabled, points in the main cardioid or the
+    //  period-2 bulb, which have a closed form, are not iterated
+    //  at all.
+    
+    uint iteration = 0;
+    uint max_iteration = args->iter;
+    bool inside = false;
+    if (args->checks != 0) {
+        float xq = x0 - 0.25;
+        float q = xq * xq + y0 * y0;
+        inside = (q * (q + xq) <= 0.25 * y0 * y0) ||
+                     ((x0 + 1.0) * (x0 + 1.0) + y0 * y0 <= 0.0625);
+    }
+    if (inside) iteration = max_iteration;
+    
     //  Perform the standard Mandelbrot calculation and see if
-    //  and when it is evident that it diverges.
+    //  and when it is evident that it diverges. Unless disabled,
+    //  the orbit is compared with a point saved from it, which
+    //  is replaced at iterations 1,2,4,8... (Brent's method). If
+    //  the orbit gets back to that point exactly, it is cycling,
+    //  and will never diverge.
     
     float x = 0.0;
     float y = 0.0;
-    uint iteration = 0;
-    uint max_iteration = args->iter;
     float xtmp = 0.0;
+    float xSaved = 0.0;
+    float ySaved = 0.0;
+    uint count = 0;
+    uint limit = 1;
     while(((x * x) + (y * y) <= 4.0) && (iteration < max_iteration))
     {
         xtmp = (x + y) * (x - y) + x0;
         y = (2.0 * x * y) + y0;
         x = xtmp;
         iteration += 1;
+        if (args->checks != 0) {
+            if (x == xSaved && y == ySaved) {
+                iteration = max_iteration;
+                break;
+            }
+            if (++count == limit) {
+                xSaved = x;
+                ySaved = y;
+                count = 0;
+                limit *= 2;
+            }
+        }
     }
 
     //  Set the element of the output array to the iteration count,
@@ -68,8 +114,128 @@ kernel void mandel(device float *out [[ buffer(1) ]],
     //  iteration count will have exceeded the maximum limit), in
     //  which case we set it to zero.
     
-    float value = iteration;
-    if (iteration >= max_iteration) value = 0.0;
-    uint index = index2.y * gridSize.x + index2.x;
-    out[index] = value;
+    uint value = iteration;
+    if (iteration >= max_iteration) value = 0;
+    return value;
+}
+
+kernel void mandel(device uint *out [[ buffer(1) ]],
+                   constant MandelArgs *args [[buffer(2)]],
+                   uint2 index2 [[thread_position_in_grid]]) {
+    
+    //  The grid covers either the whole image or just a strip
+    //  of it exposed when the image is panned, starting at
+    //  (ixOrigin,iyOrigin).
+    
+    uint ix = args->ixOrigin + index2.x;
+    uint iy = args->iyOrigin + index2.y;
+    uint index = iy * args->nx + ix;
+    out[index] = mandelPoint(args,ix,iy);
+}
+
+//  mandelQueue is an alternative to mandel, used when the CPU
+//  code asks for a 'tile queue'. Rather than one thread for each
+//  pixel, a fixed number of threadgroups is launched, and each
+//  of these keeps taking the next tile of the image - a block
+//  of pixels the size of the threadgroup - until there are none
+//  left. The tiles are counted off using the counter passed as
+//  buffer(3), which the CPU sets to zero beforehand. Points in
+//  the set take far longer than those outside it, so with one
+//  thread per pixel some threadgroups finish long before others.
+//  Here, a threadgroup that finishes early just takes another
+//  tile. This always computes the whole image.
+
+kernel void mandelQueue(device uint *out [[ buffer(1) ]],
+                   constant MandelArgs *args [[buffer(2)]],
+                   device atomic_uint *nextTile [[buffer(3)]],
+                   uint2 local [[thread_position_in_threadgroup]],
+                   uint2 tileDims [[threads_per_threadgroup]],
+                   uint localIndex [[thread_index_in_threadgroup]]) {
+    
+    threadgroup uint tile;
+    uint nx = args->nx;
+    uint ny = args->ny;
+    uint tilesX = (nx + tileDims.x - 1) / tileDims.x;
+    uint tilesY = (ny + tileDims.y - 1) / tileDims.y;
+    uint nTiles = tilesX * tilesY;
+    
+    for (;;) {
+        if (localIndex == 0) {
+            tile = atomic_fetch_add_explicit(nextTile,1,memory_order_relaxed);
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        uint myTile = tile;
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        if (myTile >= nTiles) break;
+        uint ix = (myTile % tilesX) * tileDims.x + local.x;
+        uint iy = (myTile / tilesX) * tileDims.y + local.y;
+        if (ix < nx && iy < ny) out[iy * nx + ix] = mandelPoint(args,ix,iy);
+    }
+}
+
+//  mandelPerturbed is used instead of mandel at magnifications
+//  where even double precision - which Metal GPUs don't have
+//  anyway - can't tell neighbouring pixels apart. The CPU
+//  computes the orbit of a single reference point, the centre of
+//  the image, in extended precision, and passes it as buffer(3).
+//  This kernel then only computes the difference between each
+//  pixel's orbit and the reference orbit. Those differences are
+//  tiny, but float handles tiny numbers as well as large ones -
+//  it's only adding them to the centre coordinates that loses
+//  them. The argument structure is buffer(2), as for mandel.
+
+struct PerturbArgs {
+    float dX;         // Change in X-coordinate per pixel
+    float dY;         // Change in Y-coordinate per pixel
+    int iter;         // Maximum number of iterations
+    int nx;           // Number of image pixels in X
+    int ny;           // Number of image pixels in Y
+    int refLen;       // Number of points in the reference orbit
+};
+
+kernel void mandelPerturbed(device uint *out [[ buffer(1) ]],
+                   constant PerturbArgs *args [[buffer(2)]],
+                   device const float2 *orbit [[buffer(3)]],
+                   uint2 index2 [[thread_position_in_grid]]) {
+    
+    //  The reference point is the centre of the image, so the
+    //  offset of this pixel from it is just its pixel offset
+    //  from the centre scaled by the size of a pixel.
+    
+    uint ix = index2.x;
+    uint iy = index2.y;
+    float2 dc = float2((float(ix) - args->nx * 0.5) * args->dX,
+                       (float(iy) - args->ny * 0.5) * args->dY);
+
+    //  If the reference orbit is Z, and this pixel's orbit is
+    //  Z + dz, then dz -> (2Z + dz) * dz + dc. Where Z + dz gets
+    //  smaller than dz, dz can no longer follow this pixel's
+    //  orbit accurately - this is what causes 'glitches' - so
+    //  the orbit is rebased: Z + dz becomes the new dz, relative
+    //  to the start of the reference orbit. The same happens if
+    //  this pixel outlasts the reference orbit.
+    
+    float2 dz = float2(0.0,0.0);
+    int m = 0;
+    int iteration = 0;
+    int max_iteration = args->iter;
+    while (iteration < max_iteration) {
+        float2 w = 2.0 * orbit[m] + dz;
+        dz = float2(w.x * dz.x - w.y * dz.y,w.x * dz.y + w.y * dz.x) + dc;
+        m++;
+        iteration++;
+        float2 z = orbit[m] + dz;
+        float zSq = dot(z,z);
+        if (zSq > 4.0) break;
+        if (zSq < dot(dz,dz) || m >= args->refLen - 1) {
+            dz = z;
+            m = 0;
+        }
+    }
+
+    //  As for mandel, points in the Mandelbrot set are set to zero.
+    
+    uint value = iteration;
+    if (iteration >= max_iteration) value = 0;
+    out[iy * args->nx + ix] = value;
 }
@@ -0,0 +1,139 @@
+//
+//                   m a n d e l  F F . m e t a l
+//
+//  This is the 'float-float' version of the Metal GPU code used
+//  by the Mandel GPU demonstration program. It does just what
+//  the mandel kernel in mandel.metal does, but holds each
+//  quantity as the unevaluated sum of two floats, a high part
+//  and a low part. This gives around 48 bits of mantissa rather
+//  than the 24 of a single float, which takes it most of the way
+//  to double precision - which Metal GPUs don't have - at a cost
+//  of around ten float operations for each operation.
+//
+//  The float-float operations depend on the exact rounding of
+//  each float operation - the low part is the rounding error of
+//  the high part - and the fast math the Metal compiler uses by
+//  default would be free to rearrange them and lose it. So this
+//  is kept in a file of its own, which the Makefile compiles
+//  with -fno-fast-math, leaving mandel.metal to use fast math.
+
+#include <metal_stdlib>
+using namespace metal;
+
+//  This has to match the MandelArgs structure used by mandel.metal
+//  and the C++ code. The low parts of the centre and scale values
+//  are added to the single precision values passed to mandel.
+
+struct MandelArgs {
+    float xCent;      // X-coordinate of the array center (high part)
+    float yCent;      // Y-coordinate of the array center (high part)
+    float dX;         // Change in X-coordinate per pixel (high part)
+    float dY;         // Change in Y-coordinate per pixel (high part)
+    int iter;         // Maximum number of iterations
+    int nx;           // Number of image pixels in X
+    int ny;           // Number of image pixels in Y
+    int ixOrigin;     // First pixel in X covered by the grid
+    int iyOrigin;     // First pixel in Y covered by the grid
+    float xCentLo;    // Low part of the X-coordinate of the center
+    float yCentLo;    // Low part of the Y-coordinate of the center
+    float dXLo;       // Low part of the change in X per pixel
+    float dYLo;       // Low part of the change in Y per pixel
+    int checks;       // Non-zero to use the interior checks
+};
+
+//  A float-float value is held in a float2, with the high part
+//  in x and the low part in y. ffAdd() uses Knuth's TwoSum to get
+//  the exact rounding error of the sum of the high parts, and
+//  ffMul() uses a fused multiply-add to get the exact rounding
+//  error of the product of the high parts. Both then add in the
+//  low part terms and normalise the result.
+
+static float2 ffAdd(float2 a, float2 b)
+{
+    float s = a.x + b.x;
+    float v = s - a.x;
+    float e = (a.x - (s - v)) + (b.x - v) + (a.y + b.y);
+    float hi = s + e;
+    return float2(hi,e - (hi - s));
+}
+
+static float2 ffMul(float2 a, float2 b)
+{
+    float p = a.x * b.x;
+    float e = fma(a.x,b.x,-p) + (a.x * b.y + a.y * b.x);
+    float hi = p + e;
+    return float2(hi,e - (hi - p));
+}
+
+kernel void mandelFF(device uint *out [[ buffer(1) ]],
+                   constant MandelArgs *args [[buffer(2)]],
+                   uint2 index2 [[thread_position_in_grid]]) {
+    
+    //  As for mandel, the grid covers the whole image or a strip
+    //  of it. The pixel offsets from the centre are whole or half
+    //  numbers, which a float holds exactly, so only the scaling
+    //  and the addition of the centre need float-float.
+    
+    uint ix = args->ixOrigin + index2.x;
+    uint iy = args->iyOrigin + index2.y;
+    float2 x0 = ffAdd(float2(args->xCent,args->xCentLo),
+                 ffMul(float2(float(ix) - args->nx * 0.5,0.0),
+                                      float2(args->dX,args->dXLo)));
+    float2 y0 = ffAdd(float2(args->yCent,args->yCentLo),
+                 ffMul(float2(float(iy) - args->ny * 0.5,0.0),
+                                      float2(args->dY,args->dYLo)));
+
+    //  As for mandel, unless the checks have been disabled, points
+    //  in the main cardioid or the period-2 bulb aren't iterated,
+    //  for which the high parts are enough, and orbits that get
+    //  back exactly to a point saved at iterations 1,2,4,8... are
+    //  cycling, and will never diverge.
+    
+    uint iteration = 0;
+    uint max_iteration = args->iter;
+    if (args->checks != 0) {
+        float xq = x0.x - 0.25;
+        float q = xq * xq + y0.x * y0.x;
+        if ((q * (q + xq) <= 0.25 * y0.x * y0.x) ||
+            ((x0.x + 1.0) * (x0.x + 1.0) + y0.x * y0.x <= 0.0625)) {
+            iteration = max_iteration;
+        }
+    }
+
+    //  The standard Mandelbrot calculation, in float-float. Only
+    //  the high parts are needed to see if it has diverged.
+    
+    float2 x = float2(0.0,0.0);
+    float2 y = float2(0.0,0.0);
+    float2 xSaved = x;
+    float2 ySaved = y;
+    uint count = 0;
+    uint limit = 1;
+    while (((x.x * x.x) + (y.x * y.x) <= 4.0) && (iteration < max_iteration))
+    {
+        float2 xx = ffMul(x,x);
+        float2 yy = ffMul(y,y);
+        float2 xy = ffMul(x,y);
+        x = ffAdd(ffAdd(xx,-yy),x0);
+        y = ffAdd(ffAdd(xy,xy),y0);
+        iteration += 1;
+        if (args->checks != 0) {
+            if (all(x == xSaved) && all(y == ySaved)) {
+                iteration = max_iteration;
+                break;
+            }
+            if (++count == limit) {
+                xSaved = x;
+                ySaved = y;
+                count = 0;
+                limit *= 2;
+            }
+        }
+    }
+
+    //  As for mandel, points in the Mandelbrot set are set to zero.
+    
+    uint value = iteration;
+    if (iteration >= max_iteration) value = 0;
+    out[iy * args->nx + ix] = value;
+}
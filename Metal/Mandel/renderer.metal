@@ -0,0 +1,264 @@
+//
+//                   r e n d e r e r . m e t a l
+//
+//  This is the Metal GPU code used by the renderer in the Mandel
+//  GPU demonstration program. It used to be compiled from source
+//  strings in RendererMetal.cpp each time the program started,
+//  but is now compiled into compute.metallib along with the
+//  compute kernels when the program is built. There are three
+//  groups of functions, each used by one of the renderer's
+//  Build...() routines:
+//
+//  vertexMain and fragmentMain are the shaders used to draw the
+//  image as a triangle strip, with the vertex positions and
+//  colours in buffers - see BuildShaders().
+//
+//  clearHist, buildHist and setColours are the compute kernels
+//  used to colour the image on the GPU - see BuildColourPipeline().
+//
+//  quadVertex and quadFragment draw the image as a single quad,
+//  the fragment shader looking up the colour of each display
+//  pixel - see BuildQuadPipeline().
+//
+//  setTexture and textureFragment draw the quad from a texture
+//  instead. The kernel writes the colour of each image pixel into
+//  the texture, and the fragment shader just samples it - see
+//  BuildTexturePipeline().
+//
+//  stripVertex and levelsVertex draw the triangle strip without
+//  a positions buffer, working out the position of each vertex
+//  from its index. stripVertex takes the colours the colouring
+//  kernels set, and levelsVertex looks up the colour of each
+//  vertex in a palette, from the one byte colour level of its
+//  pixel set by the CPU - see BuildStripPipeline() and
+//  BuildLevelsPipeline(). Both use fragmentMain.
+
+#include <metal_stdlib>
+using namespace metal;
+
+//  The arguments for the colouring kernels and the quad fragment
+//  shader. This must match the layout of the ColourArgs structure
+//  in RendererMetal.cpp.
+
+struct ColourArgs
+{
+    int nx;
+    int ny;
+    int iterLimit;
+};
+
+//  The triangle strip shaders. These are a very basic pair, taken
+//  from the code used for the examples supplied with metal-cpp. The
+//  vertex shader just passes on the position and colour of each
+//  vertex, and the fragment shader returns the interpolated colour
+//  as fully opaque.
+
+struct v2f
+{
+    float4 position [[position]];
+    half3 color;
+};
+
+v2f vertex vertexMain( uint vertexId [[vertex_id]],
+                       device const float3* positions [[buffer(0)]],
+                       device const float3* colors [[buffer(1)]] )
+{
+    v2f o;
+    o.position = float4( positions[ vertexId ], 1.0 );
+    o.color = half3 ( colors[ vertexId ] );
+    return o;
+}
+
+half4 fragment fragmentMain( v2f in [[stage_in]] )
+{
+    return half4( in.color, 1.0 );
+}
+
+//  The colouring kernels. Each thread group counts the low values,
+//  which are almost all of them, in threadgroup memory, and adds
+//  its counts to the histogram at the end.
+
+constant uint SharedBins = 4096;
+
+kernel void clearHist( device uint* hist [[buffer(2)]],
+                       constant ColourArgs& args [[buffer(4)]],
+                       uint index [[thread_position_in_grid]] )
+{
+    if (index < uint(args.iterLimit)) hist[index] = 0;
+}
+
+kernel void buildHist( device const uint* image [[buffer(0)]],
+                       device atomic_uint* hist [[buffer(2)]],
+                       constant ColourArgs& args [[buffer(4)]],
+                       uint index [[thread_position_in_grid]],
+                       uint threads [[threads_per_grid]],
+                       uint local [[thread_position_in_threadgroup]],
+                       uint groupThreads [[threads_per_threadgroup]] )
+{
+    threadgroup atomic_uint localHist[SharedBins];
+    for (uint i = local; i < SharedBins; i += groupThreads) {
+        atomic_store_explicit(&localHist[i],0,memory_order_relaxed);
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    uint pixels = uint(args.nx) * uint(args.ny);
+    uint levels = uint(args.iterLimit);
+    for (uint i = index; i < pixels; i += threads) {
+        uint value = image[i];
+        if (value < levels) {
+            if (value < SharedBins) {
+                atomic_fetch_add_explicit(&localHist[value],1,memory_order_relaxed);
+            } else {
+                atomic_fetch_add_explicit(&hist[value],1,memory_order_relaxed);
+            }
+        }
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    for (uint i = local; i < SharedBins && i < levels; i += groupThreads) {
+        uint count = atomic_load_explicit(&localHist[i],memory_order_relaxed);
+        if (count > 0) atomic_fetch_add_explicit(&hist[i],count,memory_order_relaxed);
+    }
+}
+
+kernel void setColours( device const uint* image [[buffer(0)]],
+                        device float3* colours [[buffer(1)]],
+                        device const float3* lut [[buffer(3)]],
+                        constant ColourArgs& args [[buffer(4)]],
+                        uint index [[thread_position_in_grid]],
+                        uint threads [[threads_per_grid]] )
+{
+    uint nx = uint(args.nx);
+    uint pixels = nx * uint(args.ny);
+    uint lineVertices = (nx - 1) * 2 + 6;
+    for (uint i = index; i < pixels; i += threads) {
+        float3 rgb = lut[min(image[i],uint(args.iterLimit) - 1)];
+        uint iy = i / nx;
+        uint ix = i - iy * nx;
+        uint vertex = iy * lineVertices;
+        uint count = 5;
+        if (ix > 0) {
+            vertex += 5 + (ix - 1) * 2;
+            count = 2;
+        }
+        for (uint v = vertex; v < vertex + count; v++) colours[v] = rgb;
+    }
+}
+
+//  The quad shaders. The vertex shader needs no buffers - it makes
+//  the three vertices of a triangle that covers the whole view from
+//  the vertex index - and the fragment shader looks up the image
+//  value for each display pixel in the image buffer used by the
+//  colouring kernels, and its colour in their colour table.
+
+struct quadV2f
+{
+    float4 position [[position]];
+    float2 imagePosn;
+};
+
+quadV2f vertex quadVertex( uint vertexId [[vertex_id]] )
+{
+    float2 posn = float2( float((vertexId << 1) & 2) * 2.0 - 1.0,
+                          float(vertexId & 2) * 2.0 - 1.0 );
+    quadV2f o;
+    o.position = float4( posn, 0.0, 1.0 );
+    o.imagePosn = ( posn + 1.0 ) * 0.5;
+    return o;
+}
+
+half4 fragment quadFragment( quadV2f in [[stage_in]],
+                             device const uint* image [[buffer(0)]],
+                             device const float3* lut [[buffer(3)]],
+                             constant ColourArgs& args [[buffer(4)]] )
+{
+    int ix = clamp( int(in.imagePosn.x * float(args.nx)), 0, args.nx - 1 );
+    int iy = clamp( int(in.imagePosn.y * float(args.ny)), 0, args.ny - 1 );
+    uint value = min( image[iy * args.nx + ix], uint(args.iterLimit) - 1 );
+    return half4( half3( lut[value] ), 1.0 );
+}
+
+//  The texture kernel and fragment shader. The kernel looks up the
+//  colour of each image pixel just once, however many display
+//  pixels it covers, and writes it into the texture, whose rows
+//  are the image rows in the same order as in the image buffer.
+//  The fragment shader, used with quadVertex, samples the texture
+//  at the same position in the image that quadFragment looks up,
+//  taking the nearest pixel, so the two draw the same picture.
+
+kernel void setTexture( device const uint* image [[buffer(0)]],
+                        device const float3* lut [[buffer(3)]],
+                        constant ColourArgs& args [[buffer(4)]],
+                        texture2d<half, access::write> colours [[texture(0)]],
+                        uint2 posn [[thread_position_in_grid]] )
+{
+    if (posn.x >= uint(args.nx) || posn.y >= uint(args.ny)) return;
+    uint value = min( image[posn.y * uint(args.nx) + posn.x], uint(args.iterLimit) - 1 );
+    colours.write( half4( half3( lut[value] ), 1.0 ), posn );
+}
+
+half4 fragment textureFragment( quadV2f in [[stage_in]],
+                                texture2d<half> colours [[texture(0)]] )
+{
+    constexpr sampler nearest( coord::normalized, filter::nearest,
+                               address::clamp_to_edge );
+    return colours.sample( nearest, in.imagePosn );
+}
+
+//  The triangle strip shaders that need no positions buffer. The
+//  vertices are laid out as BuildBuffers() sets them when it does
+//  use a positions buffer: each line has (nx - 1) * 2 + 6 of them,
+//  the first two at the bottom left of its first pixel, then one
+//  at its top left, then two - bottom right and top right - for
+//  each pixel, and a final one repeating the last of those. The
+//  first 5 belong to the first pixel, there are 2 for each other
+//  pixel, and the last one, which ends the line, is always black.
+//  stripPosition() returns the position of a vertex, and sets the
+//  line it is in and its index within that line.
+
+float2 stripPosition( uint vertexId, constant ColourArgs& args,
+                      thread uint& iy, thread uint& vertex )
+{
+    uint lineVertices = uint(args.nx - 1) * 2 + 6;
+    iy = vertexId / lineVertices;
+    vertex = vertexId - iy * lineVertices;
+    float yinc = 2.0 / float(args.ny);
+    float xinc = 2.0 / float(args.nx);
+    float y = float(iy) * yinc - 1.0;
+    float yp1 = y + yinc;
+    if (vertex < 2) return float2( -1.0, y );
+    if (vertex == 2) return float2( -1.0, yp1 );
+    uint edge = min( vertex - 3, uint(args.nx) * 2 - 1 );
+    float xp1 = float(edge / 2 + 1) * xinc - 1.0;
+    return float2( xp1, ((edge & 1) == 0) ? y : yp1 );
+}
+
+v2f vertex stripVertex( uint vertexId [[vertex_id]],
+                        device const float3* colors [[buffer(1)]],
+                        constant ColourArgs& args [[buffer(4)]] )
+{
+    uint iy, vertex;
+    v2f o;
+    o.position = float4( stripPosition( vertexId, args, iy, vertex ), 0.0, 1.0 );
+    o.color = half3( colors[ vertexId ] );
+    return o;
+}
+
+//  The levels are one byte per pixel, and the palette has the
+//  R,G,B colour for each of the 256 colour levels. It is set once,
+//  and small enough to go in the constant address space.
+
+v2f vertex levelsVertex( uint vertexId [[vertex_id]],
+                         constant ColourArgs& args [[buffer(4)]],
+                         device const uchar* levels [[buffer(5)]],
+                         constant float3* palette [[buffer(6)]] )
+{
+    uint iy, vertex;
+    v2f o;
+    o.position = float4( stripPosition( vertexId, args, iy, vertex ), 0.0, 1.0 );
+    if (vertex == uint(args.nx - 1) * 2 + 5) {
+        o.color = half3( 0.0 );
+    } else {
+        uint ix = (vertex < 5) ? 0 : (vertex - 5) / 2 + 1;
+        o.color = half3( palette[ levels[ iy * uint(args.nx) + ix ] ] );
+    }
+    return o;
+}
@@ -0,0 +1,152 @@
+//
+//                            B u f f e r  H e a p . h
+//
+//  This provides a very basic sub-allocator for Metal buffers, used by the Metal versions of
+//  the Adder, Median and Mandel programs. Creating each buffer with its own call to the
+//  device's newBuffer() has Metal find and map fresh memory every time, which adds up when
+//  buffers are replaced as image sizes change, or when a program needs new buffers for each
+//  of a series of images. A BufferHeap instead creates a few large MTL::Heaps and carves the
+//  buffers out of those, which is cheap, and the memory used stays close to the peak needed.
+//
+//  NewBuffer() is used just like the device's newBuffer(). It takes the buffer from a heap
+//  with the same resource options that has room for it, creating a new heap - at least
+//  MinHeapBytes, as passed to the constructor - if none has. A buffer can simply be released
+//  as usual, which returns its memory to its heap. But a buffer that's being replaced - an
+//  old size of a per-frame buffer, or a scratch buffer - should be passed to Recycle(), which
+//  marks it as aliasable before releasing it. Metal can then reuse its memory for the next
+//  buffer straight away, even if command buffers still in flight hold on to the old one, so
+//  long as nothing more is encoded that uses it. Heaps that Recycle() leaves empty are dropped,
+//  apart from the latest one for each set of options.
+//
+//  The heaps track hazards, just as buffers created individually do, so none of the code
+//  using the buffers needs to change - unless the options ask for a buffer without hazard
+//  tracking (MTL::ResourceHazardTrackingModeUntracked), which then comes from a heap that
+//  doesn't track hazards either, and the program has to order any encoders that depend on
+//  each other through it itself, with fences or events. Heaps can't use the managed storage
+//  mode, so buffers with that mode - and any buffer a heap can't be created for - come from
+//  the device in the usual way, and the program doesn't need to know the difference. The
+//  buffers keep their heaps alive, so a BufferHeap can be deleted while its buffers are still
+//  in use.
+//
+//  15th Oct 2026. First version. KS.
+//                 Buffers can now be asked for without hazard tracking. The fields of the
+//                 resource options are now found using masks of its own. KS.
+
+#ifndef __BufferHeap__
+#define __BufferHeap__
+
+#include "Metal/Metal.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+
+class BufferHeap
+{
+public:
+    //  Creates an allocator for Device, whose heaps are at least MinHeapBytes each.
+    BufferHeap(MTL::Device* Device,NS::UInteger MinHeapBytes = 64 * 1024 * 1024) {
+        _device = Device;
+        _minHeapBytes = MinHeapBytes;
+    }
+    ~BufferHeap() {
+        for (HeapEntry& Entry : _heaps) Entry.Heap->release();
+    }
+    //  Returns a new buffer of Bytes with the resource Options, from a heap if possible.
+    MTL::Buffer* NewBuffer(NS::UInteger Bytes,MTL::ResourceOptions Options) {
+        if (StorageMode(Options) == MTL::StorageModeManaged) {
+            return _device->newBuffer(Bytes,Options);
+        }
+        MTL::SizeAndAlign SizeAlign = _device->heapBufferSizeAndAlign(Bytes,Options);
+        for (HeapEntry& Entry : _heaps) {
+            if (Entry.Options == Options &&
+                           Entry.Heap->maxAvailableSize(SizeAlign.align) >= SizeAlign.size) {
+                MTL::Buffer* Buffer = Entry.Heap->newBuffer(Bytes,Options);
+                if (Buffer) return Buffer;
+            }
+        }
+        MTL::Heap* Heap = NewHeap(std::max(SizeAlign.size,_minHeapBytes),Options);
+        if (Heap) {
+            _heaps.push_back({Heap,Options});
+            MTL::Buffer* Buffer = Heap->newBuffer(Bytes,Options);
+            if (Buffer) return Buffer;
+        }
+        return _device->newBuffer(Bytes,Options);
+    }
+    //  Releases Buffer, letting its memory be reused at once. Nothing that uses it can be
+    //  encoded after this, but command buffers already committed can still be running.
+    void Recycle(MTL::Buffer* Buffer) {
+        if (Buffer == nullptr) return;
+        MTL::Heap* Heap = Buffer->heap();
+        if (Heap) Buffer->makeAliasable();
+        Buffer->release();
+        if (Heap) Trim();
+    }
+    //  Returns the total size of the heaps currently held.
+    NS::UInteger HeapBytes(void) {
+        NS::UInteger Bytes = 0;
+        for (HeapEntry& Entry : _heaps) Bytes += Entry.Heap->size();
+        return Bytes;
+    }
+private:
+    //  Creates a heap of at least Bytes for buffers with the resource Options.
+    MTL::Heap* NewHeap(NS::UInteger Bytes,MTL::ResourceOptions Options) {
+        NS::UInteger PageSize = NS::UInteger(sysconf(_SC_PAGE_SIZE));
+        Bytes = (Bytes + PageSize - 1) / PageSize * PageSize;
+        MTL::HeapDescriptor* Desc = MTL::HeapDescriptor::alloc()->init();
+        Desc->setSize(Bytes);
+        Desc->setStorageMode(StorageMode(Options));
+        Desc->setCpuCacheMode(MTL::CPUCacheMode(Options & C_CPUCacheModeMask));
+        Desc->setHazardTrackingMode(HazardTrackingMode(Options));
+        MTL::Heap* Heap = _device->newHeap(Desc);
+        Desc->release();
+        return Heap;
+    }
+    //  Returns the storage mode given by resource options.
+    static MTL::StorageMode StorageMode(MTL::ResourceOptions Options) {
+        return MTL::StorageMode((Options & C_StorageModeMask) >> C_StorageModeShift);
+    }
+    //  Returns the hazard tracking mode for a heap of buffers with resource options - tracked,
+    //  unless the options ask for untracked buffers.
+    static MTL::HazardTrackingMode HazardTrackingMode(MTL::ResourceOptions Options) {
+        if ((Options & C_HazardTrackingModeMask) == MTL::ResourceHazardTrackingModeUntracked) {
+            return MTL::HazardTrackingModeUntracked;
+        }
+        return MTL::HazardTrackingModeTracked;
+    }
+    //  Drops any empty heap that isn't the latest for its options.
+    void Trim(void) {
+        size_t Index = 0;
+        while (Index < _heaps.size()) {
+            bool Later = false;
+            for (size_t Next = Index + 1; Next < _heaps.size(); Next++) {
+                if (_heaps[Next].Options == _heaps[Index].Options) Later = true;
+            }
+            if (Later && _heaps[Index].Heap->usedSize() == 0) {
+                _heaps[Index].Heap->release();
+                _heaps.erase(_heaps.begin() + Index);
+            } else {
+                Index++;
+            }
+        }
+    }
+    //  The fields of the resource options, as laid out by MTLResourceOptions - metal-cpp
+    //  doesn't provide the masks and shifts Objective-C has for these.
+    static const NS::UInteger C_CPUCacheModeMask = 0xf;
+    static const NS::UInteger C_StorageModeShift = 4;
+    static const NS::UInteger C_StorageModeMask = 0xf << C_StorageModeShift;
+    static const NS::UInteger C_HazardTrackingModeMask = 0x3 << 8;
+    //  A heap, and the resource options of the buffers it holds.
+    struct HeapEntry {
+        MTL::Heap* Heap;
+        MTL::ResourceOptions Options;
+    };
+    //  The device the buffers are for.
+    MTL::Device* _device;
+    //  The smallest heap to create.
+    NS::UInteger _minHeapBytes;
+    //  The heaps held, oldest first.
+    std::vector<HeapEntry> _heaps;
+};
+
+#endif
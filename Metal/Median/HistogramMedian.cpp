@@ -0,0 +1,269 @@
+//
+//                      H i s t o g r a m  M e d i a n . c p p
+//
+//  The implementation of the HistogramMedian class. See HistogramMedian.h for an overview.
+//
+//  14th Oct 2026. First version. KS.
+//                 NaNs are now left out of the boxes, instead of being counted in the
+//                 highest bin. KS.
+
+#include "HistogramMedian.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <mutex>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+//  The keys are 16 bits, split into 8-bit coarse and fine parts.
+
+static const int C_KeyLevels = 65536;
+static const int C_Bins = 256;
+
+//  NaNs have the highest key to themselves, and the finite values are scaled into the rest.
+
+static const int C_BlankKey = C_KeyLevels - 1;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          H i s t o g r a m  M e d i a n
+//
+//  The constructor works out the range of the finite values in the image and scales each value
+//  into a 16-bit key. Both passes are shared between the threads of the shared pool. The first
+//  also notes if there are any NaNs.
+
+HistogramMedian::HistogramMedian(float** InputArray,int Nx,int Ny,int Npix,int Threads)
+{
+    if (Npix < 1) Npix = 1;
+    if (Npix > C_MaxNpix) Npix = C_MaxNpix;
+    I_Nx = Nx;
+    I_Ny = Ny;
+    I_Npix = Npix;
+
+    //  Each band of rows finds its own range, and these are then combined.
+
+    float Low = FLT_MAX;
+    float High = -FLT_MAX;
+    bool Blanks = false;
+    std::mutex RangeMutex;
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        float BandLow = FLT_MAX;
+        float BandHigh = -FLT_MAX;
+        bool BandBlanks = false;
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* Row = InputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                float Value = Row[Ix];
+                if (isfinite(Value)) {
+                    BandLow = std::min(BandLow,Value);
+                    BandHigh = std::max(BandHigh,Value);
+                } else if (Value != Value) BandBlanks = true;
+            }
+        }
+        std::lock_guard<std::mutex> Lock(RangeMutex);
+        Low = std::min(Low,BandLow);
+        High = std::max(High,BandHigh);
+        Blanks = Blanks || BandBlanks;
+    },Threads);
+    if (Low > High) Low = High = 0.0;
+
+    //  If every value is the same, the bins have zero width, every key is zero, and every
+    //  result is that value.
+
+    I_Low = Low;
+    I_BinWidth = (double(High) - double(Low)) / double(C_BlankKey);
+    I_Blanks = Blanks;
+    double Scale = (I_BinWidth > 0.0) ? 1.0 / I_BinWidth : 0.0;
+
+    I_Keys.resize(size_t(Nx) * size_t(Ny));
+    uint16_t* Keys = I_Keys.data();
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* Row = InputArray[Iy];
+            uint16_t* RowKeys = Keys + size_t(Iy) * size_t(Nx);
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                float Value = Row[Ix];
+                if (Value != Value) {
+                    RowKeys[Ix] = uint16_t(C_BlankKey);
+                } else {
+                    double Scaled = (Scale > 0.0) ? (double(Value) - I_Low) * Scale : 0.0;
+                    if (Scaled <= 0.0) RowKeys[Ix] = 0;
+                    else if (Scaled >= double(C_BlankKey - 1)) {
+                        RowKeys[Ix] = uint16_t(C_BlankKey - 1);
+                    } else RowKeys[Ix] = uint16_t(Scaled);
+                }
+            }
+        }
+    },Threads);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               F i l t e r  R o w s
+//
+//  Filters a band of rows. This sets up its own column histograms for the band, so bands can
+//  be filtered independently, in different threads.
+
+void HistogramMedian::FilterRows(int Iyst,int Iyen,float** OutputArray) const
+{
+    int Nx = I_Nx;
+    int Ny = I_Ny;
+    int Half = I_Npix / 2;
+    const uint16_t* Keys = I_Keys.data();
+    if (Iyst < 0) Iyst = 0;
+    if (Iyen > Ny) Iyen = Ny;
+    if (Iyst >= Iyen) return;
+
+    //  The coarse histogram for each column, covering the rows in the box for the current row,
+    //  and the coarse histogram for the box itself. Counts can't exceed C_MaxNpix squared, so
+    //  16 bits are enough, which lets the compiler add and subtract 16 bins at a time.
+
+    std::vector<uint16_t> ColumnHists(size_t(Nx) * C_Bins,0);
+    uint16_t BoxHist[C_Bins];
+
+    //  The fine histogram for each coarse bin, and the range of columns it currently covers.
+    //  Each is only brought up to date when the median falls in its coarse bin. A range with
+    //  Last less than First means the histogram isn't in use for the current row.
+
+    std::vector<uint16_t> FineHists(size_t(C_Bins) * C_Bins,0);
+    int FineFirst[C_Bins];
+    int FineLast[C_Bins];
+    
+    //  If the image has NaNs, the number of them in each column of the box, and in the box.
+    
+    std::vector<uint16_t> ColumnBlanks(I_Blanks ? Nx : 0,0);
+    int BoxBlanks = 0;
+    
+    //  Adds or removes row Jy in the column histograms.
+    
+    auto ScanRow = [&](int Jy,int Change) {
+        const uint16_t* RowKeys = Keys + size_t(Jy) * size_t(Nx);
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            ColumnHists[size_t(Ix) * C_Bins + (RowKeys[Ix] >> 8)] += Change;
+        }
+        if (I_Blanks) {
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                ColumnBlanks[Ix] += Change * (RowKeys[Ix] == C_BlankKey);
+            }
+        }
+    };
+
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+
+        //  Bring the column histograms up to date for this row. For the first row of the band,
+        //  that means adding all the rows in the box, but after that it means removing the row
+        //  that has just left the box and adding the one that has just entered it.
+
+        int Row0 = std::max(0,Iy - Half);
+        int Row1 = std::min(Ny - 1,Iy + Half);
+        if (Iy == Iyst) {
+            for (int Jy = Row0; Jy <= Row1; Jy++) ScanRow(Jy,1);
+        } else {
+            if (Iy - Half - 1 >= 0) ScanRow(Iy - Half - 1,-1);
+            if (Iy + Half < Ny) ScanRow(Iy + Half,1);
+        }
+        int Rows = Row1 - Row0 + 1;
+
+        //  The fine histograms all start out unused for each row, and the box histogram
+        //  starts out with the columns in the box for the first pixel.
+
+        for (int Bin = 0; Bin < C_Bins; Bin++) {
+            FineFirst[Bin] = 0;
+            FineLast[Bin] = -1;
+        }
+        memset(BoxHist,0,sizeof(BoxHist));
+        BoxBlanks = 0;
+        for (int Jx = 0; Jx <= std::min(Nx - 1,Half); Jx++) {
+            const uint16_t* Column = &ColumnHists[size_t(Jx) * C_Bins];
+            for (int Bin = 0; Bin < C_Bins; Bin++) BoxHist[Bin] += Column[Bin];
+            if (I_Blanks) BoxBlanks += ColumnBlanks[Jx];
+        }
+
+        for (int Ix = 0; Ix < Nx; Ix++) {
+
+            //  Slide the box histogram along one column.
+
+            if (Ix > 0) {
+                if (Ix + Half < Nx) {
+                    const uint16_t* Column = &ColumnHists[size_t(Ix + Half) * C_Bins];
+                    for (int Bin = 0; Bin < C_Bins; Bin++) BoxHist[Bin] += Column[Bin];
+                    if (I_Blanks) BoxBlanks += ColumnBlanks[Ix + Half];
+                }
+                if (Ix - Half - 1 >= 0) {
+                    const uint16_t* Column = &ColumnHists[size_t(Ix - Half - 1) * C_Bins];
+                    for (int Bin = 0; Bin < C_Bins; Bin++) BoxHist[Bin] -= Column[Bin];
+                    if (I_Blanks) BoxBlanks -= ColumnBlanks[Ix - Half - 1];
+                }
+            }
+            int Col0 = std::max(0,Ix - Half);
+            int Col1 = std::min(Nx - 1,Ix + Half);
+            int Count = Rows * (Col1 - Col0 + 1) - BoxBlanks;
+
+            //  FindKey() returns the key of the value with a given rank (counting from zero)
+            //  in the box. It finds the coarse bin from the box histogram, then brings the
+            //  fine histogram for that bin up to date for the current box and uses that.
+            //  If the fine histogram covers columns that overlap the box, it is cheaper to
+            //  remove and add the columns that differ than to start again, unless the box has
+            //  moved a long way since it was last used.
+
+            auto FindKey = [&](int Rank) -> int {
+                int Coarse = 0;
+                int Below = 0;
+                while (Below + BoxHist[Coarse] <= Rank) Below += BoxHist[Coarse++];
+                uint16_t* Fine = &FineHists[size_t(Coarse) * C_Bins];
+                auto ScanColumn = [&](int Jx,bool Add) {
+                    for (int Jy = Row0; Jy <= Row1; Jy++) {
+                        uint16_t Key = Keys[size_t(Jy) * size_t(Nx) + size_t(Jx)];
+                        if ((Key >> 8) == Coarse) {
+                            if (Add) Fine[Key & 0xff]++;
+                            else Fine[Key & 0xff]--;
+                        }
+                    }
+                };
+                int First = FineFirst[Coarse];
+                int Last = FineLast[Coarse];
+                bool Overlaps = (Last >= First && Last >= Col0);
+                if (Overlaps && (Col0 - First) + (Col1 - Last) < (Col1 - Col0 + 1)) {
+                    for (int Jx = First; Jx < Col0; Jx++) ScanColumn(Jx,false);
+                    for (int Jx = Last + 1; Jx <= Col1; Jx++) ScanColumn(Jx,true);
+                } else {
+                    memset(Fine,0,C_Bins * sizeof(uint16_t));
+                    for (int Jx = Col0; Jx <= Col1; Jx++) ScanColumn(Jx,true);
+                }
+                FineFirst[Coarse] = Col0;
+                FineLast[Coarse] = Col1;
+                int FineBin = 0;
+                while (Below + Fine[FineBin] <= Rank) Below += Fine[FineBin++];
+                return Coarse * C_Bins + FineBin;
+            };
+
+            //  As for CalcMedian(), an even number of values gives the average of the two
+            //  middle values. The NaNs have the highest key, so they don't affect the ranks
+            //  of the valid values, only their number.
+
+            float Median;
+            if (Count == 0) {
+                Median = NAN;
+            } else if (Count % 2) {
+                Median = KeyValue(FindKey(Count / 2));
+            } else {
+                Median = (KeyValue(FindKey(Count / 2 - 1)) + KeyValue(FindKey(Count / 2))) * 0.5;
+            }
+            OutputArray[Iy][Ix] = Median;
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                   F i l t e r
+//
+//  Filters the whole image, with the rows divided into one band for each thread.
+
+int HistogramMedian::Filter(float** OutputArray,int Threads) const
+{
+    return ThreadPool::Shared().ParallelFor(0,I_Ny,[&](int Iyst,int Iyen) {
+        FilterRows(Iyst,Iyen,OutputArray);
+    },Threads);
+}
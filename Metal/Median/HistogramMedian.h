@@ -0,0 +1,98 @@
+//
+//                        H i s t o g r a m  M e d i a n . h
+//
+//  A median filter for the CPU whose cost per pixel hardly depends on the size of the box,
+//  based on the algorithm described by Perreault and Hebert ("Median Filtering in Constant
+//  Time", IEEE Transactions on Image Processing, 2007). The MedianElement() code collects
+//  all Npix * Npix values for each pixel and runs a quickselect on them, which is fine for
+//  small boxes, but gets very slow for the 31x31 or 63x63 boxes used to estimate a smooth
+//  background, and is limited to 11x11 anyway by the fixed size of its work array.
+//
+//  Instead, this works with histograms. The image values are first scaled into 16-bit keys,
+//  covering the range between the smallest and largest values in the image. For each column,
+//  a histogram of the top 8 bits of the keys is kept for the Npix rows around the current
+//  row, and as the filter moves down a row, each of those only has one value removed and one
+//  added. Along a row, the histogram for the whole box is kept by adding the histogram of the
+//  column entering the box and subtracting the one leaving it. That gives the 256-entry coarse
+//  bin that holds the median, and the exact 16-bit key is then found from a fine histogram for
+//  just that coarse bin, which is updated lazily, only when it is needed.
+//
+//  The result for each pixel is the middle of the 16-bit bin holding the median, so it is
+//  within half a bin width of the true median - BinWidth() returns the width. For the even
+//  numbers of values in the boxes cut short at the image edges, it is the average of the two
+//  middle values, as for the quickselect code. Blank pixels - NaNs - are left out of the boxes,
+//  again as for the quickselect code, and a box with no valid pixels gives a NaN.
+//
+//  A HistogramMedian is created for a given image and box size. Creating it works out the
+//  keys for the image. Filter() then filters the whole image, dividing the rows into bands
+//  shared between the threads of the shared thread pool, or FilterRows() can be used to
+//  filter just a band of rows.
+//
+//  14th Oct 2026. First version. KS.
+//                 NaNs are now left out of the boxes, instead of being counted in the
+//                 highest bin. KS.
+
+#ifndef __HistogramMedian__
+#define __HistogramMedian__
+
+#include <stdint.h>
+#include <vector>
+
+class HistogramMedian
+{
+public:
+    //  The largest box allowed, so the counts in the box histogram fit in 16 bits.
+    static const int C_MaxNpix = 255;
+    //  Sets up to filter the Nx by Ny image in InputArray, using an Npix by Npix box. Threads
+    //  is the number of threads to use working out the keys, zero meaning all available.
+    HistogramMedian(float** InputArray,int Nx,int Ny,int Npix,int Threads = 0);
+    //  Filters rows Iyst up to (not including) Iyen, writing the results to OutputArray.
+    void FilterRows(int Iyst,int Iyen,float** OutputArray) const;
+    //  Filters the whole image, using up to Threads threads, returning the number used.
+    int Filter(float** OutputArray,int Threads = 0) const;
+    //  Returns the width of a histogram bin. Results are within half of this of the median.
+    float BinWidth(void) const { return float(I_BinWidth); }
+private:
+    //  Returns the value at the center of the bin for a given key.
+    float KeyValue(int Key) const { return float(I_Low + (double(Key) + 0.5) * I_BinWidth); }
+    //  The image dimensions.
+    int I_Nx;
+    int I_Ny;
+    //  The box size.
+    int I_Npix;
+    //  The value at the bottom of the lowest bin, and the width of each bin.
+    double I_Low;
+    double I_BinWidth;
+    //  True if the image has any NaNs.
+    bool I_Blanks;
+    //  The 16-bit key for each image value, in the same order as the image.
+    std::vector<uint16_t> I_Keys;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   Each band of rows needs its own set of column histograms - 512 bytes for each column -
+        and these are set up from scratch at the start of the band, which costs about as much
+        as filtering Npix rows. So the bands should be reasonably deep, which they are if
+        there is one for each thread, as Filter() arranges.
+
+    o   The fine histograms are Perreault and Hebert's lazy scheme, but without their fine
+        column histograms, which for 16-bit keys would need 128 KBytes for each column. Instead,
+        bringing a column into the fine histogram for a coarse bin means looking at the Npix
+        keys for that column and counting the ones that fall in that bin. In a smooth image the
+        median stays in the same coarse bin from one pixel to the next, and then this is just
+        the one column entering and the one leaving the box. So this isn't strictly constant
+        time - it goes up with Npix, rather than with Npix squared - but the 256-entry coarse
+        histogram updates dominate anyway for the box sizes that matter.
+
+    o   The scaling is just linear between the smallest and largest finite values, so a few
+        very bright pixels can make the bins wider than ideal for the background. Infinities
+        end up in the lowest or highest bin.
+        
+    o   NaNs get a key of their own, the highest, and each column also counts the NaNs in it,
+        so the box can leave them out. Because their key sorts last, the rank of the median
+        among the valid values is unchanged, and only the count needs adjusting. The counts
+        are only kept if the image has any NaNs.
+*/
@@ -0,0 +1,94 @@
+//
+//                       I n d i r e c t  D i s p a t c h . h
+//
+//  This provides a very basic way of encoding a compute dispatch just once and then running it
+//  as often as needed, used by the Metal versions of the Adder and Median programs. Normally
+//  each pass of a repeat loop has to set the pipeline state and each of the buffers again in a
+//  new encoder, and for a small image that CPU work can take longer than the kernel itself.
+//  An IndirectDispatch instead encodes the pipeline state, the buffers and the dispatch into
+//  a one-command MTL::IndirectCommandBuffer when it is set up, and each pass then just has the
+//  encoder execute that. (Each pass still needs its own command buffer and encoder - that's
+//  what the GPU is given to run - but there is nothing more to encode in it.)
+//
+//  The pipeline state has to have been created with indirect command buffers allowed, which
+//  NewPipelineState() does. Set up the command with Begin(), then SetBuffer() for each buffer
+//  the kernel uses, and Dispatch(). Small arguments that would have been passed with setBytes()
+//  have to be put in a buffer, as an indirect command has no equivalent. Execute() then runs
+//  the command in an encoder, first telling it which buffers the command uses, since Metal
+//  can't see those for itself. If the device can't create the indirect command buffer, Begin()
+//  returns false, and the caller should just encode the dispatch as usual.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __IndirectDispatch__
+#define __IndirectDispatch__
+
+#include "Metal/Metal.hpp"
+
+#include <vector>
+
+class IndirectDispatch
+{
+public:
+    IndirectDispatch(MTL::Device* Device) {
+        _device = Device;
+        _commandBuffer = nullptr;
+        _command = nullptr;
+    }
+    ~IndirectDispatch() {
+        if (_commandBuffer) _commandBuffer->release();
+    }
+    //  Returns a pipeline state for Function that can be used in an indirect command buffer.
+    static MTL::ComputePipelineState* NewPipelineState(MTL::Device* Device,
+                                                  MTL::Function* Function,NS::Error** Error) {
+        MTL::ComputePipelineDescriptor* Desc = MTL::ComputePipelineDescriptor::alloc()->init();
+        Desc->setComputeFunction(Function);
+        Desc->setSupportIndirectCommandBuffers(true);
+        MTL::ComputePipelineState* PipelineState =
+                    Device->newComputePipelineState(Desc,MTL::PipelineOptionNone,nullptr,Error);
+        Desc->release();
+        return PipelineState;
+    }
+    //  Starts the command, for PipelineState, with buffer indices up to MaxBufferIndex.
+    bool Begin(MTL::ComputePipelineState* PipelineState,int MaxBufferIndex) {
+        MTL::IndirectCommandBufferDescriptor* Desc =
+                                            MTL::IndirectCommandBufferDescriptor::alloc()->init();
+        Desc->setCommandTypes(MTL::IndirectCommandTypeConcurrentDispatchThreads);
+        Desc->setInheritPipelineState(false);
+        Desc->setInheritBuffers(false);
+        Desc->setMaxKernelBufferBindCount(MaxBufferIndex + 1);
+        _commandBuffer = _device->newIndirectCommandBuffer(Desc,1,MTL::ResourceStorageModeShared);
+        Desc->release();
+        if (_commandBuffer == nullptr) return false;
+        _command = _commandBuffer->indirectComputeCommand(0);
+        _command->setComputePipelineState(PipelineState);
+        return true;
+    }
+    //  Binds Buffer at Index, as setBuffer() would in an encoder.
+    void SetBuffer(MTL::Buffer* Buffer,int Index) {
+        _command->setKernelBuffer(Buffer,0,Index);
+        _buffers.push_back(Buffer);
+    }
+    //  Dispatches the grid, as dispatchThreads() would in an encoder.
+    void Dispatch(MTL::Size GridSize,MTL::Size ThreadGroupDims) {
+        _command->concurrentDispatchThreads(GridSize,ThreadGroupDims);
+    }
+    //  Runs the command in Encoder.
+    void Execute(MTL::ComputeCommandEncoder* Encoder) {
+        for (MTL::Buffer* Buffer : _buffers) {
+            Encoder->useResource(Buffer,MTL::ResourceUsageRead | MTL::ResourceUsageWrite);
+        }
+        Encoder->executeCommandsInBuffer(_commandBuffer,NS::Range(0,1));
+    }
+private:
+    //  The device the command is for.
+    MTL::Device* _device;
+    //  The indirect command buffer holding the one command, or null if not set up.
+    MTL::IndirectCommandBuffer* _commandBuffer;
+    //  The command itself.
+    MTL::IndirectComputeCommand* _command;
+    //  The buffers the command uses.
+    std::vector<MTL::Buffer*> _buffers;
+};
+
+#endif
@@ -12,6 +12,29 @@
 //
 //  Modified:
 //     27th Oct 2024. Comments expanded. KS.
+//     14th Oct 2026. Added MedianHalf, which works on images held in half precision.
+//                    Both kernels now use the same templated code. KS.
+//                    Added Median3, Median5, Median7 and their half precision versions,
+//                    which use the selection networks in MedianNetworks.h. KS.
+//                    Added MedianTiled and its variants, which first load the image for each
+//                    threadgroup into threadgroup memory, and fill the boxes from that. KS.
+//                    Added Median9, Median11 and their variants, which use fixed size code
+//                    with no clamping for full boxes of those sizes. KS.
+//                    Boxes too large for the work array now use RadixMedian(), a bitwise
+//                    search that doesn't need the values in the box to be held at all. KS.
+//                    Added MedianScales, which filters the image with up to four box sizes
+//                    at once, from the one tile, writing one output image for each. KS.
+//                    Blank pixels - NaNs, which is how the C++ code now reads FITS BLANK
+//                    values - are left out of the boxes. If the image has any, which the
+//                    arguments flag, the fixed size code is only used for tiles with none. KS.
+//                    Added MedianInt16, MedianTiledInt16 and their variants, which read the
+//                    16-bit integers of a BITPIX 16 FITS image and scale them to floats. LoadTile()
+//                    now reads the image through a source object. KS.
+//     15th Oct 2026. Added MedianShuffle3 to MedianShuffle11 and their variants, in which each
+//                    thread reads just one column of its box and gets the rest from the
+//                    neighbouring threads in its SIMD-group, using simd_shuffle(). KS.
+//                    Added SwapFits, which converts an image loaded straight from a FITS file
+//                    for 'DirectLoad'. KS.
 
 #include <metal_stdlib>
 using namespace metal;
@@ -20,13 +43,15 @@ using namespace metal;
 //  filter box. This allows for a rectangular box, with different
 //  X and Y dimensions, but in fact this code uses a square box
 //  Npix by Npix and sets Npix to the specified xsize value.
+//  blanks is non-zero if the image has any blank (NaN) pixels.
 
 struct MedianArgs {
     uint xsize;
     uint ysize;
+    uint blanks;
 };
 
-// Allow for values of Npix up to 11.
+// Allow for values of Npix up to 11 in the work array. Larger boxes use RadixMedian().
 
 #define NPIXSQ_MAX 121
 
@@ -77,11 +102,170 @@ float CalcMedian(float X[NPIXSQ_MAX], uint len)
    return median;
 }
 
-kernel void Median(const device float *inputImage [[ buffer(0) ]],
-                   device float  *outputImage [[ buffer(1) ]],
-                   constant MedianArgs *args [[buffer(2)]],
-                   uint2 index2 [[thread_position_in_grid]],
-                   uint2 gridSize [[threads_per_grid]])
+//  Blank pixels are NaNs, and are left out of the boxes, so the median is that of the valid
+//  values. A box with none at all gives a blank result. Metal compiles with fast math by
+//  default, which lets it assume there are no NaNs, so they are tested for using their bits.
+
+inline bool IsBlank(float value)
+{
+  return (as_type<uint>(value) & 0x7fffffffu) > 0x7f800000u;
+}
+
+#define BLANK_VALUE as_type<float>(0x7fc00000u)
+
+//  The selection networks in MedianNetworks.h, used for full 3x3, 5x5 and 7x7 boxes - ones
+//  that don't run past the edge of the image. NetworkMedian() is specialised for each of those
+//  sizes, and since it only indexes its work array with constants, that can be kept in
+//  registers, and there are no data-dependent branches. (The general version is only there so
+//  MedianFilter() compiles for the other values of W, when it is never called.)
+
+#include "MedianNetworks.h"
+
+#define MEDIAN_SORT(a,b) { float t = min(w[a],w[b]); w[b] = max(w[a],w[b]); w[a] = t; }
+#define MEDIAN_MIN(a,b) { w[a] = min(w[a],w[b]); }
+#define MEDIAN_MAX(a,b) { w[b] = max(w[a],w[b]); }
+
+template <int W> float NetworkMedian(thread float* w) { return w[0]; }
+template <> float NetworkMedian<3>(thread float* w) { MEDIAN_NETWORK_9 return w[4]; }
+template <> float NetworkMedian<5>(thread float* w) { MEDIAN_NETWORK_25 return w[12]; }
+template <> float NetworkMedian<7>(thread float* w) { MEDIAN_NETWORK_49 return w[24]; }
+
+//  MedianFilter() reads the image values through a source object, whose value(x,y) returns
+//  the input image value at (x,y) as a float. ImageSource reads them from the input image in
+//  device memory, and TileSource from a copy of part of the image in threadgroup memory.
+//  For both, blanks is true if the values may include blank pixels.
+
+template <typename T>
+struct ImageSource {
+  const device T *image;
+  int nx;
+  bool blanks;
+  float value(int x, int y) const { return float(image[y * nx + x]); }
+};
+
+//  Int16Source reads a 16-bit integer image, just as it was in a BITPIX 16 FITS file, and does
+//  what cfitsio would otherwise have done on the CPU: pixels with the BLANK value become NaNs,
+//  and the others are scaled by the BSCALE and BZERO values in an Int16Args structure.
+//  (The C++ code uses fmaf() for the scaling too, so the CPU gets exactly the same values.)
+
+struct Int16Args {
+  float bscale;
+  float bzero;
+  int blankValue;
+  uint checkBlank;
+};
+
+struct Int16Source {
+  const device short *image;
+  int nx;
+  bool blanks;
+  Int16Args scaling;
+  float value(int x, int y) const {
+    int raw = image[y * nx + x];
+    if (scaling.checkBlank != 0 && raw == scaling.blankValue) return BLANK_VALUE;
+    return fma(float(raw),scaling.bscale,scaling.bzero);
+  }
+};
+
+struct TileSource {
+  const threadgroup float *tile;
+  int x0;
+  int y0;
+  int width;
+  bool blanks;
+  float value(int x, int y) const { return tile[(y - y0) * width + (x - x0)]; }
+};
+
+//  Boxes too large for the work array are handled without holding their values at all.
+//  Each float is mapped to a uint key that sorts in the same order (the sign bit is flipped for
+//  positive values, and all the bits for negative ones), and the key of the median is then
+//  built up one bit at a time, from the top: a bit is set if there are still no more than
+//  rank values with keys below the result. Each of the 32 steps is a pass counting through
+//  the box - with a tiled kernel these come from threadgroup memory when the tile fits - so
+//  the cost goes up with the number of bits times the number of values, but no work array is
+//  needed, and the result is exactly the value quickselect would find. Blank pixels have NaN
+//  keys, which aren't counted, and if the source may have blanks an extra pass counts the
+//  valid values.
+
+inline uint OrderedKey(float value)
+{
+  uint bits = as_type<uint>(value);
+  return ((bits & 0x80000000u) != 0u) ? ~bits : (bits | 0x80000000u);
+}
+
+inline float KeyValue(uint key)
+{
+  return as_type<float>(((key & 0x80000000u) != 0u) ? (key & 0x7fffffffu) : ~key);
+}
+
+template <typename S>
+uint CountBelow(S source, uint key, int ixmin, int ixmax, int iymin, int iymax)
+{
+  uint count = 0;
+  for (int yind = iymin; yind <= iymax; yind++) {
+     for (int xind = ixmin; xind <= ixmax; xind++) {
+        float value = source.value(xind,yind);
+        if (!IsBlank(value) && OrderedKey(value) < key) count++;
+     }
+  }
+  return count;
+}
+
+template <typename S>
+float RadixMedian(S source, int ixmin, int ixmax, int iymin, int iymax)
+{
+  uint len = uint((ixmax - ixmin + 1) * (iymax - iymin + 1));
+  if (source.blanks) {
+     len = 0;
+     for (int yind = iymin; yind <= iymax; yind++) {
+        for (int xind = ixmin; xind <= ixmax; xind++) {
+           if (!IsBlank(source.value(xind,yind))) len++;
+        }
+     }
+     if (len == 0) return BLANK_VALUE;
+  }
+  uint rank = len / 2;
+  uint upper = 0;
+  for (int bit = 31; bit >= 0; bit--) {
+     uint trial = upper | (1u << uint(bit));
+     if (CountBelow(source,trial,ixmin,ixmax,iymin,iymax) <= rank) upper = trial;
+  }
+  float median = KeyValue(upper);
+  
+  //  As for CalcMedian(), an even number of values gives the average of the two middle
+  //  values. upper is the key of the higher one, and the lower one is either the largest
+  //  key below that or, if fewer than rank values are below it, a repeat of the same value.
+  
+  if ((len % 2) == 0) {
+     uint below = 0;
+     uint lower = 0;
+     for (int yind = iymin; yind <= iymax; yind++) {
+        for (int xind = ixmin; xind <= ixmax; xind++) {
+           float value = source.value(xind,yind);
+           uint key = OrderedKey(value);
+           if (!IsBlank(value) && key < upper) {
+              below++;
+              lower = max(lower,key);
+           }
+        }
+     }
+     float temp = (below == rank) ? KeyValue(lower) : median;
+     median = (median + temp) * 0.5;
+  }
+  return median;
+}
+
+//  The median filter itself, templated on the type used to hold the output image, which can be
+//  float or half, on the box size W, or zero if that isn't known at compile time, and on the
+//  source of the input values. If W is known, full boxes are handled by fixed size code, with
+//  no clamping, using a selection network for the sizes that have one, and only the boxes at
+//  the edges of the image need the general code - or those that might hold blank pixels,
+//  which the fixed size code doesn't allow for. The work array and the median
+//  calculation are always float - converting a half to a float is exact, and only the final
+//  result has to be rounded back.
+
+template <typename T, int W, typename S>
+void MedianFilter(S source, device T *outputImage, uint npix, uint2 index2, uint2 gridSize)
 {
   uint ix = index2.x;
   uint iy = index2.y;
@@ -93,12 +277,29 @@ kernel void Median(const device float *inputImage [[ buffer(0) ]],
   
   // if(ix >= nx || iy >= ny) return;
 
+  //  If this kernel is for a known box size, and the box is a full one, use the fixed size
+  //  code. W is known at compile time, so the loops are unrolled, and for W zero this all
+  //  disappears. source.blanks is the same for the whole threadgroup.
+  
+  if (W != 0 && !source.blanks) {
+     int h = W / 2;
+     if (int(ix) >= h && int(ix) + h < int(nx) && int(iy) >= h && int(iy) + h < int(ny)) {
+        float w[W > 0 ? W * W : 1];
+        for (int j = 0; j < W; j++) {
+           for (int i = 0; i < W; i++) w[j * W + i] = source.value(int(ix) + i - h,int(iy) + j - h);
+        }
+        bool network = (W == 3 || W == 5 || W == 7);
+        outputImage[nx * iy + ix] = T(network ? NetworkMedian<W>(w) : CalcMedian(w,W * W));
+        return;
+     }
+  }
+
   //  Fill a work array with the input array elements in a box npix wide around the
-  //  target element. Allow for the edges of the image.
+  //  target element. Allow for the edges of the image. Each value is written to the next
+  //  free element, but that only moves on if the value isn't blank, which packs the valid
+  //  values together without a branch. If the box is too big for the work array, use
+  //  RadixMedian() instead.
   
-  uint npix = args->xsize;
-  while (npix * npix > NPIXSQ_MAX) npix--;
-  float work[NPIXSQ_MAX];
   int npixby2 = int(npix) / 2;
   int ixmin = int(ix) - npixby2;
   int ixmax = int(ix) + npixby2;
@@ -108,16 +309,446 @@ kernel void Median(const device float *inputImage [[ buffer(0) ]],
   if (ixmax >= int(nx)) ixmax = int(nx - 1);
   if (iymin < 0) iymin = 0;
   if (iymax >= int(ny)) iymax = int(ny - 1);
+  if (npix * npix > NPIXSQ_MAX) {
+     outputImage[nx * iy + ix] = T(RadixMedian(source,ixmin,ixmax,iymin,iymax));
+     return;
+  }
+  float work[NPIXSQ_MAX];
   uint ipix = 0;
   for (int yind = iymin; yind <= iymax; yind++) {
      for (int xind = ixmin; xind <= ixmax; xind++) {
-        work[ipix++] = inputImage[yind * nx + xind];
+        float value = source.value(xind,yind);
+        work[ipix] = value;
+        ipix += IsBlank(value) ? 0 : 1;
      }
   }
     
-  float median = CalcMedian(work,ipix);
+  float median = (ipix == 0) ? BLANK_VALUE : CalcMedian(work,ipix);
+
+  outputImage[nx * iy + ix] = T(median);
+}
 
-  outputImage[nx * iy + ix] = median;
+//  The kernels are all instantiations of this one template. 'Median' and 'MedianHalf' work
+//  on images held as float and half precision respectively, and can handle any box size.
+//  Median3, Median5, Median7 and MedianHalf3 etc. are the same but use a selection network for
+//  full boxes, and Median9, Median11, MedianHalf9 and MedianHalf11 use fixed size loops for
+//  them. These are used by the C++ code when the box is that size.
+
+template <typename T, int W>
+kernel void MedianKernel(const device T *inputImage [[ buffer(0) ]],
+                   device T  *outputImage [[ buffer(1) ]],
+                   constant MedianArgs *args [[buffer(2)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]])
+{
+  ImageSource<T> source = {inputImage,int(gridSize.x),args->blanks != 0};
+  MedianFilter<T,W>(source,outputImage,args->xsize,index2,gridSize);
+}
+
+//  The tiled kernels, MedianTiled, MedianTiledHalf, MedianTiled3, MedianTiledHalf3 and so on,
+//  used for the C++ code's 'Tiled' option, do the same as the others, but the threadgroup
+//  first copies the part of the image it needs - its own tile, plus a halo npix/2 wide all
+//  round - into threadgroup memory. Each image value is then read from device memory just once
+//  by the threadgroup, instead of by each of the npix * npix threads whose boxes include it.
+//  The tile array has a fixed size, enough for a 32 by 32 threadgroup and an 11 by 11 box. If
+//  the threadgroup needs more than that, the kernel just reads device memory as usual.
+
+#define TILE_MAX ((32 + 10) * (32 + 10))
+
+//  LoadTile() has the threadgroup copy a width by height tile of the image, starting at (x0,y0),
+//  into threadgroup memory. Elements that fall outside the image are never used, and are left
+//  unset. Every thread in the threadgroup has to call this, as it ends with a barrier. If the
+//  image has blank pixels, it uses tileBlanks to flag any in the tile, and returns true if
+//  there are, so the threadgroups whose tiles have none can still use the fixed size code.
+//  (Clearing the flag before any thread sets it costs an extra barrier, but only then.) The
+//  image values are read through a source object, an ImageSource or an Int16Source.
+
+template <typename S>
+bool LoadTile(threadgroup float *tile, threadgroup atomic_uint *tileBlanks, bool blanks,
+                            S image, int x0, int y0, int width,
+                            int height, uint2 local, uint2 groupSize, uint2 gridSize)
+{
+  if (blanks) {
+     if (local.x == 0 && local.y == 0) atomic_store_explicit(tileBlanks,0u,memory_order_relaxed);
+     threadgroup_barrier(mem_flags::mem_threadgroup);
+  }
+  bool found = false;
+  int threads = int(groupSize.x * groupSize.y);
+  for (int i = int(local.y * groupSize.x + local.x); i < width * height; i += threads) {
+     int x = x0 + i % width;
+     int y = y0 + i / width;
+     if (x >= 0 && x < int(gridSize.x) && y >= 0 && y < int(gridSize.y)) {
+        float value = image.value(x,y);
+        tile[i] = value;
+        found = found || IsBlank(value);
+     }
+  }
+  if (blanks && found) atomic_fetch_or_explicit(tileBlanks,1u,memory_order_relaxed);
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  return blanks && atomic_load_explicit(tileBlanks,memory_order_relaxed) != 0u;
+}
+
+//  TiledFilter() is the body of the tiled kernels, which just supply the source object for
+//  the image and the tile memory. If the tile would be too big, the boxes are filled straight
+//  from that source instead.
+
+template <typename T, int W, typename S>
+void TiledFilter(S image, threadgroup float *tile, threadgroup atomic_uint *tileBlanks,
+                   device T *outputImage, uint npix, uint2 index2, uint2 gridSize,
+                   uint2 local, uint2 groupSize)
+{
+  int npixby2 = int(npix) / 2;
+  int width = int(groupSize.x) + 2 * npixby2;
+  int height = int(groupSize.y) + 2 * npixby2;
+  if (width * height > TILE_MAX) {
+     MedianFilter<T,W>(image,outputImage,npix,index2,gridSize);
+     return;
+  }
+  
+  //  The tile starts npixby2 before the first pixel of the threadgroup in each direction.
+  
+  int x0 = int(index2.x - local.x) - npixby2;
+  int y0 = int(index2.y - local.y) - npixby2;
+  bool tileHasBlanks = LoadTile(tile,tileBlanks,image.blanks,image,x0,y0,width,height,local,
+                                                                         groupSize,gridSize);
+  
+  TileSource source = {tile,x0,y0,width,tileHasBlanks};
+  MedianFilter<T,W>(source,outputImage,npix,index2,gridSize);
+}
+
+template <typename T, int W>
+kernel void MedianTiledKernel(const device T *inputImage [[ buffer(0) ]],
+                   device T  *outputImage [[ buffer(1) ]],
+                   constant MedianArgs *args [[buffer(2)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]],
+                   uint2 local [[thread_position_in_threadgroup]],
+                   uint2 groupSize [[threads_per_threadgroup]])
+{
+  threadgroup float tile[TILE_MAX];
+  threadgroup atomic_uint tileBlanks;
+  
+  ImageSource<T> image = {inputImage,int(gridSize.x),args->blanks != 0};
+  TiledFilter<T,W>(image,tile,&tileBlanks,outputImage,args->xsize,index2,gridSize,local,
+                                                                                  groupSize);
+}
+
+//  The Int16 kernels, MedianInt16, MedianTiledInt16, MedianInt16_3 and so on, used for the C++
+//  code's 'Native' option, are the same as the float versions except that they read a 16-bit
+//  integer image, through an Int16Source, using the scaling values passed in buffer 3. The
+//  output is floats, as usual.
+
+template <int W>
+kernel void MedianInt16Kernel(const device short *inputImage [[ buffer(0) ]],
+                   device float  *outputImage [[ buffer(1) ]],
+                   constant MedianArgs *args [[buffer(2)]],
+                   constant Int16Args *scaling [[buffer(3)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]])
+{
+  Int16Source source = {inputImage,int(gridSize.x),args->blanks != 0,*scaling};
+  MedianFilter<float,W>(source,outputImage,args->xsize,index2,gridSize);
+}
+
+template <int W>
+kernel void MedianTiledInt16Kernel(const device short *inputImage [[ buffer(0) ]],
+                   device float  *outputImage [[ buffer(1) ]],
+                   constant MedianArgs *args [[buffer(2)]],
+                   constant Int16Args *scaling [[buffer(3)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]],
+                   uint2 local [[thread_position_in_threadgroup]],
+                   uint2 groupSize [[threads_per_threadgroup]])
+{
+  threadgroup float tile[TILE_MAX];
+  threadgroup atomic_uint tileBlanks;
+  
+  Int16Source image = {inputImage,int(gridSize.x),args->blanks != 0,*scaling};
+  TiledFilter<float,W>(image,tile,&tileBlanks,outputImage,args->xsize,index2,gridSize,local,
+                                                                                  groupSize);
+}
+
+//  MedianScales, used for the C++ code's 'Scales' option, filters the image with up to four
+//  box sizes at once. The threadgroup loads a tile of the image as for the tiled kernels, but
+//  with a halo wide enough for the largest of the boxes, and each thread then finds the median
+//  for each box size from that tile, writing the results for each size to successive images in
+//  the output buffer. So all the sizes need just one pass through the image in device memory.
+//  The tile here allows for boxes up to 31 by 31 - still only 15 KBytes - since the largest
+//  box is often a big one. The box size is only known at run time, but it is the same for all
+//  the threads, so ScaleFilter() can switch to the instantiation of MedianFilter() for it.
+
+struct ScaleArgs {
+    uint scales;
+    uint npix[4];
+    uint blanks;
+};
+
+#define SCALES_TILE_MAX ((32 + 30) * (32 + 30))
+
+template <typename S>
+void ScaleFilter(S source, device float *outputImage, uint npix, uint2 index2, uint2 gridSize)
+{
+  switch (npix) {
+     case 3: MedianFilter<float,3>(source,outputImage,npix,index2,gridSize); break;
+     case 5: MedianFilter<float,5>(source,outputImage,npix,index2,gridSize); break;
+     case 7: MedianFilter<float,7>(source,outputImage,npix,index2,gridSize); break;
+     case 9: MedianFilter<float,9>(source,outputImage,npix,index2,gridSize); break;
+     case 11: MedianFilter<float,11>(source,outputImage,npix,index2,gridSize); break;
+     default: MedianFilter<float,0>(source,outputImage,npix,index2,gridSize); break;
+  }
+}
+
+kernel void MedianScales(const device float *inputImage [[ buffer(0) ]],
+                   device float  *outputImage [[ buffer(1) ]],
+                   constant ScaleArgs *args [[buffer(2)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]],
+                   uint2 local [[thread_position_in_threadgroup]],
+                   uint2 groupSize [[threads_per_threadgroup]])
+{
+  threadgroup float tile[SCALES_TILE_MAX];
+  threadgroup atomic_uint tileBlanks;
+  
+  bool blanks = (args->blanks != 0);
+  uint largest = 0;
+  for (uint s = 0; s < args->scales; s++) largest = max(largest,args->npix[s]);
+  int npixby2 = int(largest) / 2;
+  int width = int(groupSize.x) + 2 * npixby2;
+  int height = int(groupSize.y) + 2 * npixby2;
+  uint plane = gridSize.x * gridSize.y;
+  if (width * height > SCALES_TILE_MAX) {
+     ImageSource<float> source = {inputImage,int(gridSize.x),blanks};
+     for (uint s = 0; s < args->scales; s++) {
+        ScaleFilter(source,outputImage + s * plane,args->npix[s],index2,gridSize);
+     }
+     return;
+  }
+  int x0 = int(index2.x - local.x) - npixby2;
+  int y0 = int(index2.y - local.y) - npixby2;
+  ImageSource<float> image = {inputImage,int(gridSize.x),blanks};
+  bool tileHasBlanks = LoadTile(tile,&tileBlanks,blanks,image,x0,y0,width,height,local,
+                                                                         groupSize,gridSize);
+  
+  TileSource source = {tile,x0,y0,width,tileHasBlanks};
+  for (uint s = 0; s < args->scales; s++) {
+     ScaleFilter(source,outputImage + s * plane,args->npix[s],index2,gridSize);
+  }
+}
+
+#define MEDIAN_KERNEL(Name,T,W) template [[host_name(Name)]] kernel void \
+      MedianKernel<T,W>(const device T*, device T*, constant MedianArgs*, uint2, uint2);
+
+#define MEDIAN_TILED_KERNEL(Name,T,W) template [[host_name(Name)]] kernel void \
+      MedianTiledKernel<T,W>(const device T*, device T*, constant MedianArgs*, uint2, uint2, \
+                                                                              uint2, uint2);
+
+#define MEDIAN_INT16_KERNEL(Name,W) template [[host_name(Name)]] kernel void \
+      MedianInt16Kernel<W>(const device short*, device float*, constant MedianArgs*, \
+                                                          constant Int16Args*, uint2, uint2);
+
+#define MEDIAN_TILED_INT16_KERNEL(Name,W) template [[host_name(Name)]] kernel void \
+      MedianTiledInt16Kernel<W>(const device short*, device float*, constant MedianArgs*, \
+                                            constant Int16Args*, uint2, uint2, uint2, uint2);
+
+MEDIAN_KERNEL("Median",float,0)
+MEDIAN_KERNEL("Median3",float,3)
+MEDIAN_KERNEL("Median5",float,5)
+MEDIAN_KERNEL("Median7",float,7)
+MEDIAN_KERNEL("Median9",float,9)
+MEDIAN_KERNEL("Median11",float,11)
+MEDIAN_KERNEL("MedianHalf",half,0)
+MEDIAN_KERNEL("MedianHalf3",half,3)
+MEDIAN_KERNEL("MedianHalf5",half,5)
+MEDIAN_KERNEL("MedianHalf7",half,7)
+MEDIAN_KERNEL("MedianHalf9",half,9)
+MEDIAN_KERNEL("MedianHalf11",half,11)
+MEDIAN_TILED_KERNEL("MedianTiled",float,0)
+MEDIAN_TILED_KERNEL("MedianTiled3",float,3)
+MEDIAN_TILED_KERNEL("MedianTiled5",float,5)
+MEDIAN_TILED_KERNEL("MedianTiled7",float,7)
+MEDIAN_TILED_KERNEL("MedianTiled9",float,9)
+MEDIAN_TILED_KERNEL("MedianTiled11",float,11)
+MEDIAN_TILED_KERNEL("MedianTiledHalf",half,0)
+MEDIAN_TILED_KERNEL("MedianTiledHalf3",half,3)
+MEDIAN_TILED_KERNEL("MedianTiledHalf5",half,5)
+MEDIAN_TILED_KERNEL("MedianTiledHalf7",half,7)
+MEDIAN_TILED_KERNEL("MedianTiledHalf9",half,9)
+MEDIAN_TILED_KERNEL("MedianTiledHalf11",half,11)
+MEDIAN_INT16_KERNEL("MedianInt16",0)
+MEDIAN_INT16_KERNEL("MedianInt16_3",3)
+MEDIAN_INT16_KERNEL("MedianInt16_5",5)
+MEDIAN_INT16_KERNEL("MedianInt16_7",7)
+MEDIAN_INT16_KERNEL("MedianInt16_9",9)
+MEDIAN_INT16_KERNEL("MedianInt16_11",11)
+MEDIAN_TILED_INT16_KERNEL("MedianTiledInt16",0)
+MEDIAN_TILED_INT16_KERNEL("MedianTiledInt16_3",3)
+MEDIAN_TILED_INT16_KERNEL("MedianTiledInt16_5",5)
+MEDIAN_TILED_INT16_KERNEL("MedianTiledInt16_7",7)
+MEDIAN_TILED_INT16_KERNEL("MedianTiledInt16_9",9)
+MEDIAN_TILED_INT16_KERNEL("MedianTiledInt16_11",11)
+
+//  The shuffle kernels, MedianShuffle3, MedianShuffleHalf3, MedianShuffleInt16_3 and so on up to
+//  11x11, used for the C++ code's 'Shuffle' option, only exist for the fixed box sizes. The C++
+//  code dispatches them with each SIMD-group one row of the threadgroup, so the threads of a
+//  SIMD-group work along an image row, and the boxes of adjacent threads share all but one
+//  column. Each thread reads just the W values of its own column, and takes the other columns
+//  of its box from its neighbours with simd_shuffle(), so the image is read W times rather than
+//  W * W times, with no threadgroup memory and no barriers. For 3x3 boxes, each thread sorts
+//  its own column - which is then shared, already sorted - and the median of the box is the
+//  median of the largest of the three lowest values, the median of the middle values and the
+//  smallest of the highest values, so there is no work array at all. The threads at the ends
+//  of a SIMD-group, whose neighbours are in another one, and those whose boxes run past the
+//  edge of the image, fall back on MedianFilter(), as does an image with blank pixels.
+
+inline float MedianOf3(float a, float b, float c)
+{
+  return max(min(a,b),min(max(a,b),c));
+}
+
+inline ushort NeighbourLane(ushort lane, int offset, int liveLanes)
+{
+  return ushort(clamp(int(lane) + offset,0,liveLanes - 1));
+}
+
+template <typename T, int W, typename S>
+void ShuffleFilter(S source, device T *outputImage, uint npix, uint2 index2, uint2 gridSize,
+                   uint2 local, uint2 groupSize, ushort lane, ushort simdWidth, ushort simdIndex)
+{
+  if (source.blanks) {
+     MedianFilter<T,W>(source,outputImage,npix,index2,gridSize);
+     return;
+  }
+  
+  //  Every thread reads its column, clamped to the image so the values are always real ones,
+  //  and takes part in every shuffle. Only then can those that can't use the shared columns
+  //  drop out. The last SIMD-group of a threadgroup may not be full, and liveLanes is the
+  //  number of its threads that exist.
+  
+  const int h = W / 2;
+  int ix = int(index2.x);
+  int iy = int(index2.y);
+  int ny = int(gridSize.y);
+  int groupThreads = int(groupSize.x * groupSize.y);
+  int liveLanes = min(int(simdWidth),groupThreads - int(simdIndex) * int(simdWidth));
+  bool shared = ix >= h && ix + h < int(gridSize.x) && iy >= h && iy + h < ny &&
+                int(local.x) >= h && int(local.x) + h < int(groupSize.x) &&
+                int(lane) >= h && int(lane) + h < liveLanes;
+  float column[W];
+  for (int j = 0; j < W; j++) column[j] = source.value(ix,clamp(iy + j - h,0,ny - 1));
+  float median = 0.0;
+  if (W == 3) {
+     float lo = min(column[0],column[1]);
+     float hi = max(column[0],column[1]);
+     float mid = min(hi,column[2]);
+     hi = max(hi,column[2]);
+     float t = min(lo,mid);
+     mid = max(lo,mid);
+     lo = t;
+     ushort left = NeighbourLane(lane,-1,liveLanes);
+     ushort right = NeighbourLane(lane,1,liveLanes);
+     float maxLo = max(lo,max(simd_shuffle(lo,left),simd_shuffle(lo,right)));
+     float minHi = min(hi,min(simd_shuffle(hi,left),simd_shuffle(hi,right)));
+     float midMid = MedianOf3(simd_shuffle(mid,left),mid,simd_shuffle(mid,right));
+     median = MedianOf3(maxLo,midMid,minHi);
+  } else {
+     float w[W * W];
+     for (int i = 0; i < W; i++) {
+        ushort from = NeighbourLane(lane,i - h,liveLanes);
+        for (int j = 0; j < W; j++) w[j * W + i] = simd_shuffle(column[j],from);
+     }
+     if (shared) {
+        bool network = (W == 5 || W == 7);
+        median = network ? NetworkMedian<W>(w) : CalcMedian(w,W * W);
+     }
+  }
+  if (shared) {
+     outputImage[int(gridSize.x) * iy + ix] = T(median);
+  } else {
+     MedianFilter<T,W>(source,outputImage,npix,index2,gridSize);
+  }
+}
+
+template <typename T, int W>
+kernel void MedianShuffleKernel(const device T *inputImage [[ buffer(0) ]],
+                   device T  *outputImage [[ buffer(1) ]],
+                   constant MedianArgs *args [[buffer(2)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]],
+                   uint2 local [[thread_position_in_threadgroup]],
+                   uint2 groupSize [[threads_per_threadgroup]],
+                   ushort lane [[thread_index_in_simdgroup]],
+                   ushort simdWidth [[threads_per_simdgroup]],
+                   ushort simdIndex [[simdgroup_index_in_threadgroup]])
+{
+  ImageSource<T> source = {inputImage,int(gridSize.x),args->blanks != 0};
+  ShuffleFilter<T,W>(source,outputImage,args->xsize,index2,gridSize,local,groupSize,lane,
+                                                                        simdWidth,simdIndex);
+}
+
+template <int W>
+kernel void MedianShuffleInt16Kernel(const device short *inputImage [[ buffer(0) ]],
+                   device float  *outputImage [[ buffer(1) ]],
+                   constant MedianArgs *args [[buffer(2)]],
+                   constant Int16Args *scaling [[buffer(3)]],
+                   uint2 index2 [[thread_position_in_grid]],
+                   uint2 gridSize [[threads_per_grid]],
+                   uint2 local [[thread_position_in_threadgroup]],
+                   uint2 groupSize [[threads_per_threadgroup]],
+                   ushort lane [[thread_index_in_simdgroup]],
+                   ushort simdWidth [[threads_per_simdgroup]],
+                   ushort simdIndex [[simdgroup_index_in_threadgroup]])
+{
+  Int16Source source = {inputImage,int(gridSize.x),args->blanks != 0,*scaling};
+  ShuffleFilter<float,W>(source,outputImage,args->xsize,index2,gridSize,local,groupSize,lane,
+                                                                        simdWidth,simdIndex);
+}
+
+#define MEDIAN_SHUFFLE_KERNEL(Name,T,W) template [[host_name(Name)]] kernel void \
+      MedianShuffleKernel<T,W>(const device T*, device T*, constant MedianArgs*, uint2, uint2, \
+                                                      uint2, uint2, ushort, ushort, ushort);
+
+#define MEDIAN_SHUFFLE_INT16_KERNEL(Name,W) template [[host_name(Name)]] kernel void \
+      MedianShuffleInt16Kernel<W>(const device short*, device float*, constant MedianArgs*, \
+                           constant Int16Args*, uint2, uint2, uint2, uint2, ushort, ushort, ushort);
+
+MEDIAN_SHUFFLE_KERNEL("MedianShuffle3",float,3)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffle5",float,5)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffle7",float,7)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffle9",float,9)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffle11",float,11)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffleHalf3",half,3)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffleHalf5",half,5)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffleHalf7",half,7)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffleHalf9",half,9)
+MEDIAN_SHUFFLE_KERNEL("MedianShuffleHalf11",half,11)
+MEDIAN_SHUFFLE_INT16_KERNEL("MedianShuffleInt16_3",3)
+MEDIAN_SHUFFLE_INT16_KERNEL("MedianShuffleInt16_5",5)
+MEDIAN_SHUFFLE_INT16_KERNEL("MedianShuffleInt16_7",7)
+MEDIAN_SHUFFLE_INT16_KERNEL("MedianShuffleInt16_9",9)
+MEDIAN_SHUFFLE_INT16_KERNEL("MedianShuffleInt16_11",11)
+
+//  SwapFits converts, in place, an image of 32-bit floats loaded just as it was in a FITS
+//  file, for 'DirectLoad'. FITS data is big-endian, so each word is byte-swapped, and then
+//  treated just as the C++ code treats one read from a file: NaNs and infinities are blank
+//  pixels, set to NaN, and values with a zero exponent (underflows) are set to zero. If there
+//  are any blank pixels, *blanks is set non-zero. count is the number of pixels.
+
+kernel void SwapFits(device uint *image [[ buffer(0) ]],
+                     device atomic_uint *blanks [[ buffer(1) ]],
+                     constant uint &count [[ buffer(2) ]],
+                     uint index [[thread_position_in_grid]])
+{
+  if (index >= count) return;
+  uint word = image[index];
+  word = (word >> 24) | ((word >> 8) & 0xff00) | ((word << 8) & 0xff0000) | (word << 24);
+  uint exponent = word & 0x7f800000;
+  if (exponent == 0x7f800000) {
+     word = 0x7fc00000;
+     atomic_store_explicit(blanks,1,memory_order_relaxed);
+  } else if (exponent == 0) {
+     word = 0;
+  }
+  image[index] = word;
 }
 
 /*                           P r o g r a m m i n g   N o t e s
@@ -131,4 +762,28 @@ kernel void Median(const device float *inputImage [[ buffer(0) ]],
         than this code with a small local work array, presumably because buffer access is
         going to be much slower than register access.
         
+    o   The tiled kernels rely on the dispatch using non-uniform threadgroups, as the C++ code
+        does with dispatchThreads(). The threadgroups at the right and bottom edges of the
+        image are then smaller than the rest, and [[threads_per_threadgroup]] gives their
+        actual size, so the tile loading loop only counts on the threads that really exist,
+        and no thread returns before the barrier. The tile only pays off once the boxes are
+        reasonably large - for 3x3 boxes the caches already catch most of the repeated reads.
+        
+    o   Images with blank pixels are still filtered in a single pass: the general code skips
+        any NaNs as it fills its work array, and the tiled kernels flag which tiles hold any,
+        so only those lose the fixed size code. The untiled kernels can't tell where the blanks
+        are, so with blanks every box uses the general code there.
+        
+    o   simd_shuffle() from a thread that doesn't exist gives an undefined value, so the shuffle
+        kernels clamp the lane they read from to the live threads and only use what they get
+        when the lanes either side of them really hold their neighbours. They need no
+        threadgroup memory, unlike the tiled kernels, but a SIMD-group of 32 threads only fills
+        32 - (W - 1) boxes from shared columns, and the others read their boxes as usual, so
+        the saving falls off for the larger boxes.
+        
+    o   SwapFits has one thread for each pixel, and nothing to share between them, so it is
+        limited by memory bandwidth - it reads and writes each word once. Blank pixels are rare,
+        so very few threads ever touch the atomic flag, and a relaxed store is all that's needed,
+        since the C++ code only reads it once the command buffer has completed.
+        
 */
@@ -25,7 +25,10 @@
 //     File,Npix,Nrpt,Threads are positional parameters, and can be specified either by just
 //     providing values for them on the command line in the order above, or explicitly
 //     by name and value, with an optional '=' sign. If Threads is zero, the maximum number
-//     of CPU threads available will be used. Pix should be an odd number.
+//     of CPU threads available will be used. Pix should be an odd number. Boxes larger
+//     than 11 by 11 are too big for the work arrays used to find the median, so the GPU code
+//     uses a slower bitwise search for them, up to 31 by 31, and the CPU uses the histogram
+//     median filter (see 'Histogram' below). Larger boxes can only be handled by the CPU.
 //
 //     Cpu     specifies that the operation is to be carried out using the CPU.
 //     Gpu     specifies that the operation is to be carried out using the GPU.
@@ -38,11 +41,143 @@
 //     If File is specified as blank, then the program will not read data from a file,
 //     but will generate dummy data for test purposes. In this case, it will need to
 //     know how large an array to generate, and this is provided by the optional
-//     Nx,Ny parameters. If File is non-blank, these are ignored.
+//     Nx,Ny parameters. If File is non-blank, these are ignored. Any blank pixels in the
+//     file - given by its BLANK keyword, or NaNs - are left out of the boxes, so each median
+//     is that of the valid pixels in its box, and a box with none gives a NaN.
+//
+//     If the file's image is a cube (NAXIS = 3), each plane is filtered separately, by the
+//     GPU, and the planes are passed through a ring of GPU buffers so that the reading and
+//     writing of one plane overlaps the filtering of others. The whole cube is never held in
+//     memory, so there's no CPU check, and 'Cpu', 'Nrpt', 'Half', 'Native' and 'Scales' are
+//     ignored.
 //
 //     Nx      is the X dimension of the arrays in question.
 //     Ny      is the Y dimension of the arrays in question.
 //
+//     Half    has the GPU hold the image in half precision, using the 'MedianHalf' kernel.
+//             The image is converted to half precision as it is loaded into the GPU buffer,
+//             and the results are converted back as they are read. This halves the memory
+//             used and the bytes read for each pixel, at the cost of precision, so the GPU
+//             and CPU results are then only expected to agree to within the precision of
+//             half-precision values.
+//
+//     Histogram has the CPU use a median filter based on histograms (see HistogramMedian.h),
+//             whose time per pixel hardly depends on the size of the box, instead of finding
+//             the median of all the values in each box. This scales the values into 16-bit
+//             bins, so its results are only within half a bin width of the true median, and
+//             they are checked against any GPU results allowing for that. This is always used
+//             for boxes larger than 11 by 11, which can be up to 255 by 255.
+//
+//     Simd    has the CPU run the selection networks for 3x3, 5x5 and 7x7 boxes on a block
+//             of adjacent pixels at once, one pixel in each lane of the vector registers,
+//             instead of one pixel at a time. Where the program was built with GCC or Clang
+//             for x86, this uses AVX-512 or AVX2 if the CPU has them, checked when it runs.
+//             The results are the same as without it. It has no effect on other box sizes,
+//             or with 'Histogram'.
+//
+//     Tiled   has the GPU use the 'MedianTiled' kernels, in which each threadgroup first
+//             copies its part of the image, plus the Npix/2 pixels around it, into threadgroup
+//             memory, and fills its boxes from there. This cuts the reads from device memory
+//             by about a factor of Npix squared, which matters most for the larger boxes. The
+//             results are the same as without it.
+//
+//     Shuffle has the GPU use the 'MedianShuffle' kernels for the box sizes up to 11 by 11
+//             that have fixed size code, in which each thread reads just one column of its box
+//             and gets the others from the neighbouring threads of its SIMD-group, using
+//             simd_shuffle(). This cuts the reads from device memory by about a factor of Npix
+//             without using threadgroup memory. The results are the same as without it. It is
+//             ignored with 'Tiled', and for other box sizes.
+//
+//     Files   is a list of FITS files to be filtered one after the other, separated by commas
+//             or spaces, where each name can use '*' as a wildcard, for example
+//             Files = "night1/*.fits". The device, kernel and pipeline are set up just once,
+//             and the same buffers used for all the files (new ones are only needed for a
+//             larger image), so a large number of files can be filtered with none of the
+//             setup time for each. The result for each file is written to a "Median_" copy of
+//             it, and with 'Cpu' each file is also filtered by the CPU and the results
+//             compared. 'File', 'Nrpt' and 'Half' are ignored with 'Files'.
+//
+//     Concurrent is the number of files 'Files' has the GPU filter at once, up to 8. By default
+//             this is 1, and each file is read and filtered in turn. With a larger value, that
+//             many files are read, and then all filtered in one concurrent compute encoder, so
+//             the GPU can run their threadgroups side by side. This helps when the images are
+//             each too small to fill the GPU. It needs an input buffer for each file.
+//
+//     Scales  is a list of up to four box sizes, eg Scales = "3,7,15", for which the image is
+//             to be filtered at the same time. The GPU uses the 'MedianScales' kernel, in which
+//             each threadgroup loads its tile of the image into threadgroup memory once, and
+//             finds the median for each box size from it, writing all the results in one
+//             dispatch. The result for each size is written to its own copy of the input file,
+//             eg "Median7_name.fits", and with 'Cpu' the CPU filters the image with each size,
+//             for comparison. Npix is ignored, as is 'Half'.
+//
+//     Native  applies to a FITS file whose image is 16-bit integers (BITPIX = 16), usually
+//             with BSCALE and BZERO values. Normally cfitsio scales each pixel to a float as
+//             the file is read, on the CPU, and the GPU is given the floats. With 'Native',
+//             the integers are read just as they are in the file, the GPU is given those -
+//             half as many bytes - and the 'MedianInt16' kernels apply the scaling as they
+//             read them. The results are the same as without it. It is ignored for other
+//             images, and with 'Half', 'Files' and 'Scales'.
+//
+//     InFlight is the number of command buffers the GPU is allowed to have at once, up to 16.
+//             By default this is 1, and each pass is waited for before the next is set up.
+//             With a larger value, the CPU sets up each pass while the GPU runs the earlier
+//             ones, and only waits when it runs out of command buffers or needs the results,
+//             so the timing shows the throughput rather than the round trip for each pass.
+//             It only affects the repeat loop for a single image.
+//
+//     Indirect has the GPU dispatch encoded just once, into an indirect command buffer, which
+//             each pass of the repeat loop for a single image then simply executes, instead of
+//             each pass setting the pipeline state, the buffers and the arguments again. This
+//             takes most of the CPU's encoding time out of the loop, which matters for small
+//             images.
+//
+//     Untracked creates the input buffer, and for 'Indirect' the buffers holding the arguments,
+//             without hazard tracking, so Metal doesn't have to track their use by every
+//             encoder. They are only written by the CPU, before the first pass, and only read
+//             by the GPU, so no pass depends on another through them. The output buffer, which
+//             every pass writes, is still tracked. Like 'InFlight', it only affects the repeat
+//             loop for a single image.
+//
+//     DirectLoad reads an uncompressed image of 32-bit floats straight from the data unit of
+//             the file into the memory that becomes the GPU's input buffer, leaving the values
+//             just as they are in the file, and a small kernel then converts them, in place,
+//             from the big-endian FITS format, handling blank pixels the same way the usual
+//             read does. Only the header is parsed by the CPU, and the CPU never touches the
+//             pixels. Other images are read as usual. It is ignored with 'Half', 'Files',
+//             'Scales', for a cube, and if the GPU isn't used.
+//
+//     Tolerance is the difference allowed between CPU and GPU results when both are computed,
+//             for example when the GPU code is being changed in a way that changes the rounding.
+//             It is zero by default, when the results have to be the same (apart from the
+//             allowances made for 'Half' and 'Histogram'). Either way, any differences are
+//             reported as the number of values that don't match, the largest difference, and
+//             the mean difference over the whole image.
+//
+//     Trace   is the name of a file to which a timeline of the run is written, in the Chrome
+//             trace format, so it can be viewed using chrome://tracing or Perfetto. It shows
+//             the reading and writing of the file, the setup, each pass, each command buffer
+//             from its commit until it is seen to complete, and the kernel times measured by
+//             the GPU. Default "", for no trace.
+//
+//     Pin     controls the CPUs the CPU threads run on, which can make CPU timings more
+//             repeatable. It can be "None", the default, which leaves it to the system,
+//             "PCores", which only uses the performance cores, "Physical", which uses one
+//             logical CPU of each physical core, or "Numa", which only uses the CPUs on the
+//             same NUMA node as the main thread. If Threads is zero, or more than the number
+//             of CPUs selected, one thread is used for each of them.
+//
+//     Priority raises the priority of the CPU threads. On Linux this needs permission to
+//             use real-time scheduling. The CPU topology and the placement used are listed
+//             if either 'Pin' or 'Priority' is given.
+//
+//     WarmStart has the GPU device, the library and the pipeline state for the kernel set up
+//             in a separate thread while the FITS file is read, instead of one after the
+//             other, which can noticeably shorten a short run. With 'Native', the pipeline
+//             for the 16-bit integer kernel is set up as well, since which is needed isn't
+//             known until the file has been read. It is ignored with 'Files' and 'Scales',
+//             for a cube, and if the GPU isn't used.
+//
 //     Debug   is a string that can be used to control debug output. It must be specified
 //             explicitly by name, eg Debug = "timing". The '=' is optional, but the quotes
 //             are needed in some cases. 'Debug = timing,fits' is OK, but 'Debug = "*"' will
@@ -79,6 +214,88 @@
 //      12th Sep 2024. Changed 'File' default to blank, and now doesn't try to write out
 //                     a result file if one wasn't specified. KS.
 //      27th Sep 2024. CPU and GPU times now reported even if results prove to be wrong. KS.
+//      14th Oct 2026. The CPU code now uses a pool of threads created once, shared by all the
+//                     passes, instead of creating new threads for each pass. KS.
+//                     SetInputArray() and the result checks now run in the shared thread pool,
+//                     with loops that compile to vector code, and stop at the first bad row. KS.
+//                     Added 'Half', which holds the image on the GPU in half precision, using
+//                     the new 'MedianHalf' kernel. KS.
+//                     Full 3x3, 5x5 and 7x7 boxes now use the branch-free selection networks
+//                     in MedianNetworks.h, on both the CPU and the GPU, where each size has
+//                     its own instantiation of the kernel. KS.
+//                     Added 'Histogram', which has the CPU use the new HistogramMedian class,
+//                     and boxes of up to 255 by 255, which always use it. KS.
+//                     Added 'Tiled', which has the GPU use the new 'MedianTiled' kernels. KS.
+//                     For box sizes without a selection network, the CPU now filters each row
+//                     by sliding a sorted window along it, rather than sorting each box. KS.
+//                     Added Median9 and Median11 kernels, and their variants, for full boxes of
+//                     those sizes, and the CPU now handles the full boxes in each row
+//                     separately from those at the edges. KS.
+//                     The GPU can now handle boxes up to 31 by 31, using a bitwise search for the
+//                     median of boxes too large for its work array. KS.
+//                     Added 'Files', which filters a list of files using the one GPU setup.
+//                     The "Median_" copy of a file now goes in the same directory. KS.
+//                     Added 'Scales', which filters the image with several box sizes at once,
+//                     using the new 'MedianScales' kernel. KS.
+//                     Blank pixels in a FITS file are now read as NaNs instead of zeros, and
+//                     both the CPU and GPU code leave them out of the boxes. KS.
+//                     Added 'Simd', which has the CPU run the selection networks on a block
+//                     of pixels at once, using AVX2 or AVX-512 where available. KS.
+//                     The output file is now created directly, with a copy of the input header,
+//                     instead of copying the whole input file and overwriting its image. KS.
+//                     Uncompressed float images are now read through a memory mapping of the
+//                     file, converting the data straight into the input array. KS.
+//                     ReadFitsFile() can be given a Destination for the image, which 'Files'
+//                     uses to read each file straight into the GPU's input buffer, and the
+//                     image it allocates itself is page aligned, so that ComputeUsingGPU() can
+//                     use it for the input buffer without a copy. KS.
+//                     Added 'Native', which gives the GPU the raw integers of a BITPIX 16 image
+//                     and has the new 'MedianInt16' kernels apply BSCALE and BZERO. KS.
+//                     'Files' now writes each result in the background, using a FitsWriter,
+//                     while the next file is filtered. KS.
+//                     ReadFitsFile() now finds the first image HDU, so handles tile-compressed
+//                     files, and decompresses bands of their tiles in parallel. KS.
+//                     NoteResults() now keeps the CPU result instead of copying it, checks
+//                     every value and reports the largest and mean differences. Added
+//                     'Tolerance'. KS.
+//                     A 3D image (a cube) is now filtered plane by plane, with the planes
+//                     passed through a ring of GPU buffers so the I/O overlaps the GPU. KS.
+//                     The CPU code now works through the image in cache-sized tiles, handed
+//                     out to the threads as they become free, indexing the image directly
+//                     instead of through the row addresses. KS.
+//      15th Oct 2026. Added 'InFlight', which keeps several command buffers with the GPU at
+//                     once instead of waiting for each pass to complete. KS.
+//                     The GPU buffers now come from a BufferHeap. 'Files' recycles its buffers
+//                     when a larger image needs new ones, so their memory is reused. KS.
+//                     The GPU kernel time is now reported as well, from timestamps the GPU
+//                     samples at the start and end of each compute encoder. KS.
+//                     Page aligned memory now comes from PageAlloc(). The GPU results are now
+//                     written into page aligned memory wrapped as a buffer without a copy,
+//                     which NoteResults() then keeps, instead of copying them. KS.
+//                     Added 'Shuffle', which has the GPU use the new 'MedianShuffle' kernels. KS.
+//                     Added 'Indirect', which encodes the dispatch once, in an indirect
+//                     command buffer, and has each pass execute that. KS.
+//                     Added 'Concurrent', which has 'Files' filter several files at once, in
+//                     one concurrent compute encoder. KS.
+//                     The time for each pass of the GPU and CPU loops is now collected in an
+//                     MsecStats, and the distribution of the times reported. KS.
+//                     Added 'Warmup', 'Sizes' and 'Report', which use the new BenchReport to
+//                     run the tests over a list of sizes and append the timings, leaving out
+//                     the first passes, to a CSV or JSON file. KS.
+//                     The 'Timing' debug calls in the loops now test a bit looked up once. KS.
+//                     Added 'Trace', which writes a timeline of the run using the new
+//                     TraceRecorder. KS.
+//                     Added 'Pin' and 'Priority', which use the new ThreadPlacement to pin
+//                     the CPU threads to chosen CPUs and raise their priority. KS.
+//                     The CPU's sliding median for 9x9 and 11x11 boxes now uses a version
+//                     instantiated for the box size, away from the top and bottom rows. KS.
+//                     Added 'WarmStart', which sets up the GPU in another thread, using the
+//                     new WarmGPU, while the FITS file is read. KS.
+//                     Added 'Untracked', which creates the read-only GPU buffers without hazard
+//                     tracking. KS.
+//                     Added 'DirectLoad', which reads the image as it is in the file and has
+//                     the GPU convert it, using the new LoadFitsData() and SwapOnGPU(). The
+//                     checks MapFitsImage() made are now in FitsDataStart(), for both. KS.
 
 //  ------------------------------------------------------------------------------------------------
 //
@@ -87,28 +304,78 @@
 //  Needed to allow multi-threading of the CPU code
 
 #include <thread>
+#include <atomic>
+
+//  And by FitsWriter, to write FITS files in the background.
+
+#include <mutex>
+#include <condition_variable>
 
 //  The file handling code uses C++17's std::filesystem
 
 #include <filesystem>
 
+//  ReadFitsFile() can be passed a std::function that supplies the memory for the image.
+
+#include <functional>
+
+//  'WarmStart' keeps the kernels it sets up in a std::map.
+
+#include <map>
+
 //  Some utility code. A Command Handler provides a flexible way of handling command line
 //  parameters, and simplifies the coding required for this. An MsecTimer provides a very simple
 //  way of timing blocks of code. A Debug Handler provides control over debug output, allowing
-//  various debug levels to be enabled from the command line.
+//  various debug levels to be enabled from the command line. HalfFloat.h has the conversions
+//  to and from half precision used for 'Half'. A BenchReport collects the timings to be written
+//  out for 'Report', and the TraceRecorder records the timeline written out for 'Trace'.
+//  A ThreadPlacement pins the CPU threads for 'Pin'.
 
 #include "CommandHandler.h"
 #include "MsecTimer.h"
+#include "BenchReport.h"
+#include "TraceRecorder.h"
+#include "ThreadPool.h"
+#include "ThreadPlacement.h"
 #include "DebugHandler.h"
+#include "HalfFloat.h"
+#include "PageMemory.h"
+
+//  WildcardMatch() is used to expand wildcards in the list of files given by 'Files'.
+
+#include "Wildcard.h"
+
+//  The histogram median filter used by the CPU for 'Histogram' and for large boxes.
+
+#include "HistogramMedian.h"
+
+//  Needed for fabs() and std::max(), used when checking half precision results.
+
+#include <math.h>
+#include <algorithm>
 
 //  FITS file access uses the cfitsio library.
 
 #include "fitsio.h"
 
+//  An uncompressed floating point image can be read by mapping the file into memory. See
+//  MapFitsImage().
+
+#define USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 //  This provides a global Debug Handler that all the routines here can use.
 
 DebugHandler TheDebugHandler;
 
+//  The bit for its 'Timing' level, set once the level names are known. The debug calls made on
+//  each pass of a timing loop test just this bit, rather than looking the level up by name.
+
+DebugHandler::LevelBits TimingDebug = 0;
+
 //  ------------------------------------------------------------------------------------------------
 //
 //               F o r w a r d  D e f i n i t i o n s  &  S t r u c t u r e s
@@ -122,21 +389,92 @@ struct MedianDetails {
     float* GPUOutputData = nullptr;     //  Address of array used for GPU version of output data.
     float* CPUOutputData = nullptr;     //  Address of array used for CPU version of output data.
     std::string OutputFileName = "";    //  Name of the output FITS file.
+    bool GPUHalf = false;               //  True if the GPU held the image in half precision.
+    float HistogramTolerance = 0.0;     //  If the CPU used the histogram filter, its accuracy.
+    float CheckTolerance = 0.0;         //  Difference allowed between CPU and GPU results.
+    bool HasBlanks = false;             //  True if the image has blank (NaN) pixels.
+    bool OwnsInputData = true;          //  False if InputData belongs to the caller, eg a buffer.
+    short* RawData = nullptr;           //  With 'Native', a BITPIX 16 image as it is in the file.
+    float RawScale = 1.0;               //  The BSCALE value to apply to RawData.
+    float RawZero = 0.0;                //  The BZERO value to apply to RawData.
+    int RawBlank = 0;                   //  The BLANK value for RawData, if RawHasBlank is set.
+    bool RawHasBlank = false;           //  True if RawData has a BLANK value.
+    bool NeedsSwap = false;             //  True if InputData is still as in the file.
 };
 
+//  The largest box that the GPU code and the CPU's MedianElement() can handle, set by the
+//  size of the work arrays they use (see NPIXSQ_MAX). Larger boxes need the histogram filter
+//  on the CPU, and a bitwise search on the GPU.
+
+static const int C_MaxWorkNpix = 11;
+
+//  The largest box the GPU is used for. Larger boxes use a bitwise search, which takes 33
+//  passes through the box to find each median, and beyond this it would take so long that
+//  the GPU driver might well decide the GPU had hung.
+
+static const int C_MaxGPUNpix = 31;
+
+//  The most box sizes that can be given with 'Scales', set by the size of the list of them
+//  passed to the GPU code.
+
+static const int C_MaxScales = 4;
+
+//  The number of planes of a cube that can be with the GPU at once. Three lets one plane be
+//  filtered while the results of another are written out and a third is read in.
+
+static const int C_CubeSlots = 3;
+
+//  The most command buffers 'InFlight' can keep with the GPU at once.
+
+static const int C_MaxInFlight = 16;
+
+//  The most files 'Concurrent' can have the GPU filter at once.
+
+static const int C_MaxConcurrent = 8;
+
 //  Read the data from the FITS file.
-bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details);
+bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details,
+                                             const std::string& Prefix = "Median_",
+                         const std::function<float*(int Nx,int Ny)>& Destination = nullptr,
+                                                    bool Native = false,bool Direct = false);
+//  Convert an image read by 'DirectLoad' on the CPU, if the GPU hasn't done it.
+void SwapFitsData(MedianDetails* Details,int Nx,int Ny);
+//  The GPU setup done in the background for 'WarmStart'
+class WarmGPU;
 //  Perform the basic opetation using the GPU
-void ComputeUsingGPU(int Nx,int Ny,int Pix,int Nrpt,MedianDetails* Details);
+void ComputeUsingGPU(int Nx,int Ny,int Pix,int Nrpt,bool Half,bool Tiled,bool Shuffle,
+                         int InFlight,bool Indirect,bool Untracked,MedianDetails* Details,
+                      int Warmup = 0,BenchReport* Bench = nullptr,WarmGPU* Warm = nullptr);
+//  Start setting up the GPU for ComputeUsingGPU() in the background, for 'WarmStart'
+WarmGPU* StartWarmGPU(int Npix,bool Half,bool Tiled,bool Shuffle,bool Native,bool Indirect);
+//  Wait for, and release, what StartWarmGPU() set up.
+void FinishWarmGPU(WarmGPU* Warm);
+//  Filter each of a list of FITS files in turn, using the one GPU setup for all of them
+void ComputeBatchUsingGPU(const std::vector<std::string>& Files,int Npix,bool UseCPU,
+               int Threads,bool Histogram,bool Simd,float Tolerance,bool Tiled,int Concurrent);
+//  Filter each plane of a 3D FITS image, passing the planes through the GPU one after another
+void ComputeCubeUsingGPU(const std::string& Filename,int Npix,bool Tiled);
+//  See if a FITS file's image is a 3D cube.
+bool IsFitsCube(const std::string& Filename);
+//  Perform the basic operation using the GPU, for several box sizes at once
+void ComputeScalesUsingGPU(int Nx,int Ny,const std::vector<int>& Scales,int Nrpt,
+                                                                   MedianDetails* Details);
+//  Parse the list of box sizes given by 'Scales'.
+bool ParseScales(const std::string& Text,std::vector<int>* Scales);
+//  Expand the list of files given by 'Files', including any wildcards.
+std::vector<std::string> ExpandFileList(const std::string& Files);
 //  Perform the basic operation using the CPU
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Pix,int Nrpt,MedianDetails* Details);
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Pix,int Nrpt,bool Histogram,
+                                                            bool Simd,MedianDetails* Details,
+                                               int Warmup = 0,BenchReport* Bench = nullptr);
 //  Set initial values for the input array.
 void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details);
 //  Check the results of the operation
-bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details);
+bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details,
+                                                                   float** Owner = nullptr);
 //  Utility to set up an array of row addresses to allow use of Array[Iy][Ix] syntax for access.
 float** CreateRowAddrs(float* Array,int Nx,int Ny);
-//  Write calculated output array to copy of input FITS file.
+//  Write calculated output array to the output FITS file.
 bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details);
 //  Shutdown program and release resources.
 void Shutdown(MedianDetails* Details);
@@ -176,6 +514,40 @@ public:
     std::string HelpText(void);
 };
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                                F i t s  W r i t e r
+//
+//  Writing out a result can take as long as filtering it, so when filtering a list of files the
+//  writing is done by a FitsWriter, which has its own thread for the purpose. Submit() hands it
+//  the MedianDetails for a file whose results have been noted, and it then owns them: the thread
+//  calls WriteFitsFile() and Shutdown() for them, while the caller gets on with the next file.
+//  It only holds one file's results at a time, so Submit() waits until any earlier one has been
+//  written. (That keeps the memory needed to two sets of results - the one being written, and
+//  the next one.) Finish() waits for the last write. The implementation is at the end of this
+//  file.
+
+class FitsWriter {
+public:
+    FitsWriter(void);
+    ~FitsWriter();
+    //  Takes over Details, leaving *Details as a new, empty, MedianDetails.
+    void Submit(int Nx,int Ny,MedianDetails* Details);
+    //  Waits for any write still going on, and stops the thread.
+    void Finish(void);
+private:
+    void Run(void);
+    std::mutex I_Mutex;
+    std::condition_variable I_Cond;
+    MedianDetails I_Details;
+    int I_Nx = 0;
+    int I_Ny = 0;
+    bool I_Pending = false;
+    bool I_Stop = false;
+    bool I_Background = false;
+    std::thread I_Thread;
+};
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    M a i n
@@ -185,6 +557,7 @@ int main (int Argc, char* Argv[]) {
     //  Set up the various levels for the Debug handler
     
     TheDebugHandler.LevelsList("Timing,Setup,Checks,Fits,Metal");
+    TimingDebug = TheDebugHandler.Level("Timing");
 
     //  Get the values of the command line arguments. This uses a Command Handler class that
     //  provides a flexible way of dealing with a number of different arguments, for example
@@ -200,7 +573,7 @@ int main (int Argc, char* Argv[]) {
     CmdHandler TheHandler("Median");
     FileArg FilenameArg(TheHandler,"File",Posn++,"MustExist,NullOk","",
                                                             "FITS file containing image");
-    OddIntArg NpixArg(TheHandler,"Npix",Posn++,"",5,1,11,
+    OddIntArg NpixArg(TheHandler,"Npix",Posn++,"",5,1,HistogramMedian::C_MaxNpix,
                                "Size of median box in pixels - should be an odd number");
     IntArg NrptArg(TheHandler,"Nrpt",Posn++,"",1,0,5000,"Repeat count for operation");
     int DefaultThreads = 1;
@@ -212,6 +585,32 @@ int main (int Argc, char* Argv[]) {
     IntArg NyArg(TheHandler,"Ny",0,"",1024,2,1024*1024,"Y-dimension of image");
     BoolArg CpuArg(TheHandler,"Cpu",0,"",false,"Perform computation using CPU");
     BoolArg GpuArg(TheHandler,"Gpu",0,"",false,"Perform computation using GPU");
+    BoolArg HalfArg(TheHandler,"Half",0,"",false,"Hold the image on the GPU in half precision");
+    BoolArg HistogramArg(TheHandler,"Histogram",0,"",false,"Use the histogram filter on the CPU");
+    BoolArg SimdArg(TheHandler,"Simd",0,"",false,"Run CPU networks on blocks of pixels");
+    BoolArg TiledArg(TheHandler,"Tiled",0,"",false,"Fill GPU boxes from threadgroup memory tiles");
+    BoolArg ShuffleArg(TheHandler,"Shuffle",0,"",false,"Share GPU box columns across SIMD-groups");
+    BoolArg NativeArg(TheHandler,"Native",0,"",false,"Give the GPU 16-bit images unscaled");
+    IntArg InFlightArg(TheHandler,"InFlight",0,"",1,1,C_MaxInFlight,
+                                                         "GPU command buffers kept in flight");
+    BoolArg IndirectArg(TheHandler,"Indirect",0,"",false,"Encode the GPU dispatch just once");
+    BoolArg UntrackedArg(TheHandler,"Untracked",0,"",false,
+                                               "No hazard tracking for read-only GPU buffers");
+    BoolArg DirectLoadArg(TheHandler,"DirectLoad",0,"",false,
+                                                "Load the file as it is, converted by the GPU");
+    IntArg ConcurrentArg(TheHandler,"Concurrent",0,"",1,1,C_MaxConcurrent,
+                                                          "Files the GPU filters together");
+    RealArg ToleranceArg(TheHandler,"Tolerance",0,"",0.0,0.0,1.0e30,
+                                          "Difference allowed between CPU and GPU results");
+    StringArg FilesArg(TheHandler,"Files",0,"NoSave","","FITS files to filter, may use '*'");
+    StringArg ScalesArg(TheHandler,"Scales",0,"NoSave","","Box sizes to filter with at once");
+    IntArg WarmupArg(TheHandler,"Warmup",0,"",0,0,5000,"Passes left out of the timings");
+    StringArg SizesArg(TheHandler,"Sizes",0,"","","Sizes to run in turn, eg 512,1024x512");
+    StringArg ReportArg(TheHandler,"Report",0,"","","File for timings (.csv or .json)");
+    StringArg TraceArg(TheHandler,"Trace",0,"","","File for a timeline trace (.json)");
+    StringArg PinArg(TheHandler,"Pin",0,"","","Pin CPU threads (None,PCores,Physical,Numa)");
+    BoolArg PriorityArg(TheHandler,"Priority",0,"",false,"Raise the CPU threads' priority");
+    BoolArg WarmStartArg(TheHandler,"WarmStart",0,"",false,"Set up the GPU while reading the file");
     StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
     DebugArgHelper DebugHelper;
     DebugArg.SetHelper(&DebugHelper);
@@ -234,7 +633,33 @@ int main (int Argc, char* Argv[]) {
     int Threads = ThreadsArg.GetValue(&Ok,&Error);
     bool UseCPU = CpuArg.GetValue(&Ok,&Error);
     bool UseGPU = GpuArg.GetValue(&Ok,&Error);
+    bool Half = HalfArg.GetValue(&Ok,&Error);
+    bool Histogram = HistogramArg.GetValue(&Ok,&Error);
+    bool Simd = SimdArg.GetValue(&Ok,&Error);
+    bool Tiled = TiledArg.GetValue(&Ok,&Error);
+    bool Shuffle = ShuffleArg.GetValue(&Ok,&Error);
+    bool Native = NativeArg.GetValue(&Ok,&Error);
+    int InFlight = InFlightArg.GetValue(&Ok,&Error);
+    bool Indirect = IndirectArg.GetValue(&Ok,&Error);
+    bool Untracked = UntrackedArg.GetValue(&Ok,&Error);
+    bool DirectLoad = DirectLoadArg.GetValue(&Ok,&Error);
+    int Concurrent = ConcurrentArg.GetValue(&Ok,&Error);
+    float Tolerance = float(ToleranceArg.GetValue(&Ok,&Error));
     std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
+    std::string Files = FilesArg.GetValue(&Ok,&Error);
+    std::string Scales = ScalesArg.GetValue(&Ok,&Error);
+    int Warmup = WarmupArg.GetValue(&Ok,&Error);
+    std::string Sizes = SizesArg.GetValue(&Ok,&Error);
+    std::string Report = ReportArg.GetValue(&Ok,&Error);
+    std::string Trace = TraceArg.GetValue(&Ok,&Error);
+    std::string Pin = PinArg.GetValue(&Ok,&Error);
+    bool Priority = PriorityArg.GetValue(&Ok,&Error);
+    bool WarmStart = WarmStartArg.GetValue(&Ok,&Error);
+    
+    //  If 'Pin' was given, it has to be one of the placements ThreadPlacement knows about.
+    
+    ThreadPlacement Placement;
+    bool PinOK = Placement.SetMode(Pin);
     
     //  Check the argument parsing went OK, and didn't end with an exit being requested.
     
@@ -242,6 +667,8 @@ int main (int Argc, char* Argv[]) {
         if (!TheHandler.ExitRequested()) {
             printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
         }
+    } else if (!PinOK) {
+        printf ("Error in 'Pin': '%s' should be None, PCores, Physical or Numa\n",Pin.c_str());
     } else {
         if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
         
@@ -249,35 +676,222 @@ int main (int Argc, char* Argv[]) {
         
         TheDebugHandler.SetLevels(DebugLevels);
         
-        //  If a file name was specified, make a copy of the file (which will become the output
-        //  file), get the image dimensions, and read in the main data array.
-
-        MedianDetails Details;
-        if (Filename != "") {
-            ReadFitsFile(Filename,&Nx,&Ny,&Details);
+        //  If a trace is wanted, start recording the timeline. It's written out however the
+        //  program finishes.
+        
+        if (Trace != "") {
+            TraceRecorder::Global().Enable(true);
+            TraceRecorder::Global().SetThreadName("Main");
+            TraceRecorder::Global().WriteOnExit(Trace);
+        }
+        
+        //  'Pin' and 'Priority' set up the threads of the shared pool used by the CPU code,
+        //  which include this main thread. The topology is listed so the CPU timings can
+        //  be related to the machine they were taken on.
+        
+        if (Pin != "" || Priority) {
+            printf ("\nCPU topology: %s\n",Placement.Topology().c_str());
+            std::string PlacementError;
+            if (!Placement.Apply(ThreadPool::Shared(),Priority,&PlacementError)) {
+                printf ("Warning: %s.\n",PlacementError.c_str());
+            }
+            printf ("CPU threads: %s%s\n",Placement.Description().c_str(),
+                                                   Priority ? ", raised priority" : "");
+            if (Placement.Threads() > 0 && (Threads <= 0 || Threads > Placement.Threads())) {
+                Threads = Placement.Threads();
+            }
+        }
+        
+        //  If a list of files was given, they are all filtered by the GPU, one after the other,
+        //  keeping the same GPU setup for all of them, and that's all the program does. 'File'
+        //  and 'Half' are ignored.
+        
+        if (Files != "") {
+            std::vector<std::string> FileList = ExpandFileList(Files);
+            if (FileList.empty()) {
+                printf ("No files to filter.\n");
+            } else if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used with 'Files', as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nFiltering %d files using the GPU. Median box is %d by %d.\n\n",
+                                                           int(FileList.size()),Npix,Npix);
+                if (Half || Native) printf ("'Half' and 'Native' are ignored with 'Files'.\n\n");
+                if (Npix > C_MaxWorkNpix) Histogram = true;
+                ComputeBatchUsingGPU(FileList,Npix,UseCPU,Threads,Histogram,Simd,Tolerance,Tiled,
+                                                                                  Concurrent);
+            }
+            return 0;
+        }
+        
+        //  A 3D image - a cube - is filtered plane by plane, by the GPU, and that's all the
+        //  program does with it.
+        
+        if (Filename != "" && IsFitsCube(Filename)) {
+            if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used for a cube, as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nFiltering each plane of cube %s using the GPU. Median box is %d by %d."
+                                                        "\n\n",Filename.c_str(),Npix,Npix);
+                if (UseCPU || Half || Native || Nrpt != 1 || Scales != "") {
+                    printf ("'Cpu', 'Nrpt', 'Half', 'Native' and 'Scales' are ignored for a "
+                                                                              "cube.\n\n");
+                }
+                ComputeCubeUsingGPU(Filename,Npix,Tiled);
+            }
+            return 0;
+        }
+        
+        //  If a list of box sizes was given, the GPU filters the image with all of them at once,
+        //  and the result for each size is written to its own copy of the input file, with the
+        //  size in its name, eg "Median7_name.fits". Each size has its own MedianDetails, so
+        //  the CPU results for each can be checked against the GPU's in the usual way.
+        
+        if (Scales != "") {
+            std::vector<int> ScaleList;
+            if (ParseScales(Scales,&ScaleList) && !ScaleList.empty()) {
+                std::vector<MedianDetails> ScaleDetails(ScaleList.size());
+                for (size_t Iscale = 0; Iscale < ScaleList.size(); Iscale++) {
+                    ScaleDetails[Iscale].CheckTolerance = Tolerance;
+                    if (Filename != "") {
+                        std::string Prefix = "Median" + std::to_string(ScaleList[Iscale]) + "_";
+                        ReadFitsFile(Filename,&Nx,&Ny,&ScaleDetails[Iscale],Prefix);
+                    }
+                }
+                printf ("\nPerforming multi-scale 'Median' test, arrays of %d rows, %d columns. "
+                                                   "Repeat count %d.\n",Ny,Nx,Nrpt);
+                printf ("Median boxes are %s.\n\n",Scales.c_str());
+                if (Half || Native) printf ("'Half' and 'Native' are ignored with 'Scales'.\n\n");
+                if (!UseGPU && !UseCPU) UseGPU = true;
+                if (UseGPU) ComputeScalesUsingGPU(Nx,Ny,ScaleList,Nrpt,ScaleDetails.data());
+                for (size_t Iscale = 0; Iscale < ScaleList.size(); Iscale++) {
+                    int ScaleNpix = ScaleList[Iscale];
+                    if (UseCPU) {
+                        printf ("Box %d by %d:\n",ScaleNpix,ScaleNpix);
+                        ComputeUsingCPU(Threads,Nx,Ny,ScaleNpix,Nrpt,
+                         Histogram || ScaleNpix > C_MaxWorkNpix,Simd,&ScaleDetails[Iscale]);
+                    }
+                    if (Filename != "") WriteFitsFile(Nx,Ny,&ScaleDetails[Iscale]);
+                    Shutdown(&ScaleDetails[Iscale]);
+                }
+            }
+            return 0;
+        }
+        
+        //  If 'Sizes' was given, and there's no file, the test is run for each of the sizes
+        //  listed instead of Nx,Ny.
+        
+        std::vector<int> SizesX(1,Nx),SizesY(1,Ny);
+        if (Sizes != "") {
+            if (Filename != "") {
+                printf ("\n'Sizes' is ignored when filtering a file.\n");
+            } else if (!BenchReport::Sizes(Sizes,SizesX,SizesY)) {
+                printf ("Error in 'Sizes': '%s' should be a list such as 512,1024x512\n",
+                                                                               Sizes.c_str());
+                return 0;
+            }
         }
         
-        printf ("\nPerforming 'Median' test, arrays of %d rows, %d columns. Repeat count %d.\n",
-                Ny,Nx,Nrpt);
-        printf ("Median box is %d by %d.\n\n",Npix,Npix);
+        printf ("\n");
+        if (Native && Half) printf ("'Native' is ignored with 'Half'.\n\n");
+        if (Shuffle && Tiled) printf ("'Shuffle' is ignored with 'Tiled'.\n\n");
+        Shuffle = Shuffle && !Tiled && Npix >= 3 && Npix <= C_MaxWorkNpix;
+        if (Warmup >= Nrpt && Nrpt > 0) {
+            printf ("'Warmup' (%d) leaves none of the %d passes to be timed.\n\n",Warmup,Nrpt);
+        }
         
-        //  If neither CPU not GPU was specified on the command line, use GPU.
+        //  If neither CPU not GPU was specified on the command line, use GPU. But a box too
+        //  large for the GPU code can only be handled by the CPU, and a box too large for the
+        //  CPU's work array needs the histogram filter.
         
         if (!UseGPU && !UseCPU) UseGPU = true;
+        if (Npix > C_MaxGPUNpix && UseGPU) {
+            printf ("Boxes larger than %d by %d need the CPU's histogram filter, so the GPU "
+                                            "isn't used.\n\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            UseGPU = false;
+            UseCPU = true;
+        }
+        if (Npix > C_MaxWorkNpix) {
+            if (UseGPU) printf ("Boxes larger than %d by %d use a bitwise search for the median "
+                                         "on the GPU.\n\n",C_MaxWorkNpix,C_MaxWorkNpix);
+            Histogram = true;
+        }
+        
+        //  With 'WarmStart', the GPU device, library and pipeline state are set up in the
+        //  background while the file is read. ComputeUsingGPU() then uses those, for each size.
+        
+        WarmGPU* Warm = nullptr;
+        if (WarmStart) {
+            if (UseGPU) {
+                Warm = StartWarmGPU(Npix,Half,Tiled,Shuffle,Native && !Half,Indirect);
+            } else {
+                printf ("'WarmStart' is ignored without the GPU.\n\n");
+            }
+        }
+        
+        //  'DirectLoad' leaves the image as it is in the file for the GPU to convert, which
+        //  only makes sense if the GPU gets the image as it was read.
+        
+        if (DirectLoad && (!UseGPU || Half)) {
+            printf ("'DirectLoad' is ignored %s.\n\n",Half ? "with 'Half'" : "without the GPU");
+            DirectLoad = false;
+        }
+        
+        BenchReport Bench;
+        for (size_t Size = 0; Size < SizesX.size(); Size++) {
+        
+            //  If a file name was specified, get the image dimensions, read in the main data
+            //  array, and create the output file with a copy of the file's header. With
+            //  'Native', a 16-bit integer image is read unscaled, for the 'MedianInt16' kernels.
+            //  With 'DirectLoad', an image of floats is read as it is in the file.
+
+            MedianDetails Details;
+            Details.CheckTolerance = Tolerance;
+            if (Filename != "") {
+                TraceScope ReadTrace("Read FITS file","Median");
+                ReadFitsFile(Filename,&Nx,&Ny,&Details,"Median_",nullptr,Native && !Half,
+                                                                                 DirectLoad);
+            } else {
+                Nx = SizesX[Size];
+                Ny = SizesY[Size];
+            }
+        
+            printf ("Performing 'Median' test, arrays of %d rows, %d columns. "
+                                                         "Repeat count %d.\n",Ny,Nx,Nrpt);
+            printf ("Median box is %d by %d.\n\n",Npix,Npix);
+        
+            //  Perform the test using either CPU or GPU (or both). Both ComputeUsingGPU() and
+            //  its CPU equivalent, ComputeUsingCPU() are expected to create arrays of the size
+            //  specified, call SetInputArray() to initialise the input array, then perform the
+            //  basic 'Median' operation as specified. They add their timings to Bench.
+        
+            if (UseGPU) {
+                ComputeUsingGPU(Nx,Ny,Npix,Nrpt,Half,Tiled,Shuffle,InFlight,Indirect,
+                                                     Untracked,&Details,Warmup,&Bench,Warm);
+            }
+            
+            //  If the GPU didn't convert an image read by 'DirectLoad', the CPU does.
+            
+            if (Details.NeedsSwap) SwapFitsData(&Details,Nx,Ny);
         
-        //  Perform the test using either CPU or GPU (or both). Both ComputeUsingGPU() and its CPU
-        //  equivalent, ComputeUsingCPU() are expected to create arrays of the size specified, call
-        //  SetInputArray() to initialise the input array, then perform the basic 'Median' operation
-        //  as specified.
+            if (UseCPU) {
+                ComputeUsingCPU(Threads,Nx,Ny,Npix,Nrpt,Histogram,Simd,&Details,Warmup,&Bench);
+            }
         
-        if (UseGPU) ComputeUsingGPU(Nx,Ny,Npix,Nrpt,&Details);
+            //  Write out the filtered array to the output FITS file and close program.
         
-        if (UseCPU) ComputeUsingCPU(Threads,Nx,Ny,Npix,Nrpt,&Details);
+            if (Filename != "") {
+                TraceScope WriteTrace("Write FITS file","Median");
+                WriteFitsFile (Nx,Ny,&Details);
+            }
+            Shutdown(&Details);
+        }
+        FinishWarmGPU(Warm);
         
-        //  Write out the filtered array to the copy of the input FITS file and close program.
+        //  'Report' appends the timings collected to a file.
         
-        if (Filename != "") WriteFitsFile (Nx,Ny,&Details);
-        Shutdown(&Details);
+        if (Report != "" && Bench.Rows() > 0) Bench.Write(Report);
     }
     return 0;
 }
@@ -286,80 +900,156 @@ int main (int Argc, char* Argv[]) {
 //
 //                             R e a d  F i t s  F i l e
 
-bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
+bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details,
+   const std::string& Prefix,const std::function<float*(int Nx,int Ny)>& Destination,
+                                                                     bool Native,bool Direct)
 {
     fitsfile *Fptr;
     char Error[80];
     int Status = 0;
     
-    //  First, we make a copy of the input file with "Median_" prepended to the filename,
-    //  and make sure the resulting file has write access. (This allows the FITS routines
-    //  to modify the new file even if the original was readonly.) If such a file exists
-    //  (it often will) overwrite it. Since we have to use C++17 anyway, we may as well
-    //  use the std::filesystem routines for this.
+    //  The output goes to a new file with "Median_" (or Prefix, if that's something else)
+    //  prepended to the filename, in the same directory as the original. If such a file
+    //  exists (it often will) it gets overwritten - the leading '!' in the name passed to
+    //  fits_create_file() tells cfitsio to do that. The new file gets a copy of the header of
+    //  the input file's main image, and WriteFitsFile() writes the filtered image to it. An
+    //  earlier version copied the whole input file and then overwrote its image, but for a
+    //  large file that was a complete extra read and write before anything else could start.
+    //  This way the input is read once and the output written once. (It does mean that any
+    //  extensions in the input file aren't carried over to the output.)
     
-    
-    std::string MedianFile = "Median_" + Filename;
-    TheDebugHandler.Logf("Fits","Copying input file %s to new output file %s",Filename.c_str(),
-                                                                            MedianFile.c_str());
+    std::filesystem::path InputPath(Filename);
+    std::string MedianFile =
+           (InputPath.parent_path() / (Prefix + InputPath.filename().string())).string();
+    TheDebugHandler.Logf("Fits","Reading input file %s, output will go to new file %s",
+                                                       Filename.c_str(),MedianFile.c_str());
     std::error_code ErrorCode;
     if (std::filesystem::exists(MedianFile,ErrorCode)) {
         TheDebugHandler.Logf("Fits","File %s already exists and will be overwritten",
                                                                    MedianFile.c_str());
     }
-    std::string Text;
-    if (!std::filesystem::copy_file(Filename,MedianFile,
-                            std::filesystem::copy_options::overwrite_existing,ErrorCode)) {
-        Text = "Unable to create new median file: " + ErrorCode.message();
-        Status = 1;
-    } else {
-        std::filesystem::permissions(MedianFile,std::filesystem::perms::owner_write,
-                                          std::filesystem::perm_options::add,ErrorCode);
-        if (ErrorCode) {
-            Text = "Unable to make new median file writeable: " + ErrorCode.message();
-            Status = 1;
-        }
-    }
-    if (Status) {
-        strncpy(Error,Text.c_str(),sizeof(Error) - 1);
+    
+    //  Open the input file, read-only, allocate a large enough block of memory to hold
+    //  the main image, and read it in. Then create the output file and copy the header
+    //  over. (This code is using cfitsio routines, which have their origins some time
+    //  back, and so have a bit of a different feel to the C++17 code used for the names.)
+    //  fits_open_image() moves to the first HDU that has an image, which for a tile-
+    //  compressed file is an extension, stored as a binary table. That's also why the
+    //  dimensions come from fits_get_img_size() and not from the NAXIS keywords, which for
+    //  a compressed image describe the table.
+    
+    fitsfile* InFptr = nullptr;
+    if (fits_open_image(&InFptr,Filename.c_str(),READONLY,&Status)) {
+        fits_get_errstatus (Status,Error);
     } else {
-        
-        //  Now open the copy of the original file, allocate a large enough block of memory
-        //  to hold the main image, and read it in. (This code is using cfitsio routines, which
-        //  have their origins some time back, and so have a bit of a different feel to the
-        //  C++17 code just used to do the file copy.)
-         
-        if (fits_open_file(&Fptr,MedianFile.c_str(),READWRITE,&Status)) {
+        long Naxes[2] = {0,0};
+        int Nfound = 0;
+        if (fits_get_img_dim(InFptr,&Nfound,&Status) ||
+                          (Nfound == 2 && fits_get_img_size(InFptr,2,Naxes,&Status))) {
             fits_get_errstatus (Status,Error);
         } else {
-            long Naxes[2];
-            int Nfound;
-            Details->Fptr = Fptr;
-            if (fits_read_keys_lng(Fptr,"NAXIS",1,2,Naxes,&Nfound,&Status)) {
-                fits_get_errstatus (Status,Error);
+            if (Nfound != 2) {
+                strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+                Status = 1;
             } else {
-                if (Nfound != 2) {
-                    strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+                //  The memory is page aligned, and a whole number of pages, so the GPU code
+                //  can use it for a Metal buffer without having to copy it. See
+                //  ComputeUsingGPU(). If the caller already has somewhere for the image, it
+                //  passes Destination, which is given the dimensions and returns the address
+                //  to read it into. The batch code uses this to read each file straight into
+                //  the GPU's input buffer. With 'Native', a 16-bit integer image is read as it
+                //  is, into RawData, by ReadRawFitsImage(), and then there's no float data.
+                
+                bool ReadRawFitsImage(fitsfile* Fptr,long NPixels,MedianDetails* Details,
+                                                                              int* Status);
+                int NPixels = Naxes[0] * Naxes[1];
+                float* Data = nullptr;
+                bool Raw = Native && !Destination &&
+                                       ReadRawFitsImage(InFptr,NPixels,Details,&Status);
+                if (Raw) {
+                    TheDebugHandler.Log("Fits","Image read as unscaled 16-bit integers");
+                } else if (Destination) {
+                    Data = Destination(int(Naxes[0]),int(Naxes[1]));
+                    Details->OwnsInputData = false;
+                } else {
+                    Data = (float*)PageAlloc(size_t(NPixels) * sizeof(float));
+                }
+                
+                //  Blank pixels are read as NaNs, which the median code leaves out
+                //  of the boxes. (A Nullval of zero would read them as zeros.) Anynull
+                //  tells us if there were any, so the code can skip the checks if not.
+                //  Most images can be read straight from a memory mapping of the file,
+                //  which is faster, a compressed image can be decompressed in parallel, and
+                //  fits_read_img() is only needed for the others. With 'DirectLoad', the image
+                //  is read by LoadFitsData(), as it is in the file, and the GPU converts it.
+                
+                bool LoadFitsData(const std::string& Filename,fitsfile* Fptr,long NPixels,
+                                                                                 float* Data);
+                bool MapFitsImage(const std::string& Filename,fitsfile* Fptr,long NPixels,
+                                                                  float* Data,int* Anynull);
+                bool ReadCompressedFitsImage(const std::string& Filename,fitsfile* Fptr,
+                                       long Nx,long Ny,float* Data,int* Anynull,int* Status);
+                long Fpixel = 1;
+                float Nullval = NAN;
+                int Anynull = 0;
+                if (Raw) {
+                    //  Already read.
+                } else if (Data == nullptr) {
+                    strncpy(Error,"Unable to allocate memory for the image",sizeof(Error));
                     Status = 1;
+                } else if (Direct && LoadFitsData(Filename,InFptr,NPixels,Data)) {
+                    TheDebugHandler.Log("Fits","Image data loaded unconverted, for the GPU");
+                    Details->NeedsSwap = true;
+                } else if (MapFitsImage(Filename,InFptr,NPixels,Data,&Anynull)) {
+                    TheDebugHandler.Log("Fits","Image data read through a memory mapping");
+                } else if (ReadCompressedFitsImage(Filename,InFptr,Naxes[0],Naxes[1],Data,
+                                                                        &Anynull,&Status)) {
+                    TheDebugHandler.Log("Fits","Compressed image tiles read in parallel");
+                } else {
+                    fits_read_img(InFptr,TFLOAT,Fpixel,NPixels,&Nullval,Data,&Anynull,&Status);
+                }
+                if (Status) {
+                    if (Data || Raw) fits_get_errstatus (Status,Error);
                 } else {
-                    int NPixels = Naxes[0] * Naxes[1];
-                    float* Data = (float*)malloc(NPixels * sizeof(float));
-                    long Fpixel = 1;
-                    float Nullval = 0.0;
-                    int Anynull;
-                    if (fits_read_img(Fptr,TFLOAT,Fpixel,NPixels,&Nullval,Data,&Anynull,&Status)) {
+                    if (!Raw) {
+                        Details->InputData = Data;
+                        Details->HasBlanks = (Anynull != 0);
+                    }
+                    if (Details->HasBlanks) TheDebugHandler.Log("Fits","Image has blank pixels");
+                    *Nx = Naxes[0];
+                    *Ny = Naxes[1];
+                    TheDebugHandler.Logf("Fits","File opened, 2D data array %d by %d",*Nx,*Ny);
+                    std::string CreateName = "!" + MedianFile;
+                    if (fits_create_file(&Fptr,CreateName.c_str(),&Status)) {
                         fits_get_errstatus (Status,Error);
                     } else {
-                        Details->InputData = Data;
-                        *Nx = Naxes[0];
-                        *Ny = Naxes[1];
-                        TheDebugHandler.Logf("Fits","File opened, 2D data array %d by %d",*Nx,*Ny);
+                        
+                        //  A compressed image's header has to be turned back into that of
+                        //  an ordinary image, since that's what WriteFitsFile() writes.
+                        
+                        Details->Fptr = Fptr;
+                        int CompStatus = 0;
+                        if (fits_is_compressed_image(InFptr,&CompStatus)) {
+                            fits_img_decompress_header(InFptr,Fptr,&Status);
+                        } else {
+                            fits_copy_header(InFptr,Fptr,&Status);
+                        }
+                        if (Status) fits_get_errstatus (Status,Error);
                     }
                 }
             }
         }
-        if (Status == 0) Details->OutputFileName = MedianFile;
+        
+        //  The input file isn't needed any more. Don't let a close error replace the
+        //  description of an earlier one.
+        
+        int CloseStatus = 0;
+        if (fits_close_file(InFptr,&CloseStatus) && Status == 0) {
+            Status = CloseStatus;
+            fits_get_errstatus (Status,Error);
+        }
     }
+    if (Status == 0) Details->OutputFileName = MedianFile;
     if (Status) {
         if (TheDebugHandler.Active("Fits")) {
             TheDebugHandler.Logf("Fits","Error reading FITS file: %s",Error);
@@ -370,6 +1060,306 @@ bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
     return (Status == 0);
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                            F i t s  D a t a  S t a r t
+//
+//  Used by MapFitsImage() and LoadFitsData(), which both read the data unit of the file for
+//  themselves, to see if the image is one they can handle: an uncompressed image of 32-bit
+//  floats (BITPIX = -32) with no scaling, in an ordinary file on disk, with room for NPixels
+//  values. If it is, this returns true, with *DataStart set to the offset of the data unit.
+
+bool FitsDataStart(const std::string& Filename,fitsfile* Fptr,long NPixels,LONGLONG* DataStart)
+{
+    //  Anything cfitsio would have to do something clever with - a compressed image, a file
+    //  that isn't just a file on disk (eg a gzipped file cfitsio unpacks into memory, or a name
+    //  using cfitsio's extended syntax), or scaled data - is left to fits_read_img().
+    
+    int Status = 0;
+    int Bitpix = 0;
+    char UrlType[FLEN_FILENAME];
+    LONGLONG HeadStart = 0;
+    LONGLONG DataEnd = 0;
+    fits_get_img_type(Fptr,&Bitpix,&Status);
+    int Compressed = fits_is_compressed_image(Fptr,&Status);
+    fits_url_type(Fptr,UrlType,&Status);
+    fits_get_hduaddrll(Fptr,&HeadStart,DataStart,&DataEnd,&Status);
+    auto KeyValue = [Fptr](const char* Name,double Default) {
+        int KeyStatus = 0;
+        double Value = Default;
+        if (fits_read_key(Fptr,TDOUBLE,Name,&Value,nullptr,&KeyStatus)) Value = Default;
+        return Value;
+    };
+    size_t Bytes = size_t(NPixels) * sizeof(float);
+    std::error_code ErrorCode;
+    return (Status == 0 && Bitpix == FLOAT_IMG && !Compressed && !strcmp(UrlType,"file://") &&
+            KeyValue("BSCALE",1.0) == 1.0 && KeyValue("BZERO",0.0) == 0.0 &&
+            DataEnd - *DataStart >= LONGLONG(Bytes) &&
+            std::filesystem::is_regular_file(Filename,ErrorCode));
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             L o a d  F i t s  D a t a
+//
+//  Used by ReadFitsFile() for 'DirectLoad'. For the same images as MapFitsImage(), this reads
+//  the data unit straight into Data with pread(), leaving the values just as they are in the
+//  file - big-endian, with any blank pixels still whatever NaNs or infinities the file holds.
+//  ComputeUsingGPU() then has the GPU convert them where they are, once Data is its input
+//  buffer (see SwapOnGPU()), so the CPU only ever deals with the header. It returns false if
+//  the image isn't one it can handle, or can't be read, and the caller should then read the
+//  image as usual.
+
+bool LoadFitsData(const std::string& Filename,fitsfile* Fptr,long NPixels,float* Data)
+{
+    LONGLONG DataStart = 0;
+    if (!FitsDataStart(Filename,Fptr,NPixels,&DataStart)) return false;
+    int Fd = open(Filename.c_str(),O_RDONLY);
+    if (Fd < 0) return false;
+    
+    //  pread() can return less than was asked for - macOS won't read more than 2GB at once -
+    //  so this keeps going until it has the lot, or gets nothing.
+    
+    size_t Bytes = size_t(NPixels) * sizeof(float);
+    size_t Done = 0;
+    while (Done < Bytes) {
+        size_t Chunk = std::min(Bytes - Done,size_t(1) << 30);
+        ssize_t Count = pread(Fd,(char*)Data + Done,Chunk,off_t(DataStart) + off_t(Done));
+        if (Count <= 0) break;
+        Done += size_t(Count);
+    }
+    close(Fd);
+    return (Done == Bytes);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             S w a p  F i t s  D a t a
+//
+//  Converts an image read by LoadFitsData() in place, on the CPU, for when the GPU hasn't - if
+//  the GPU code couldn't be set up, or the image couldn't be wrapped as its input buffer. The
+//  conversion is the one MapFitsImage() does as it copies, and the GPU's SwapFits kernel
+//  does, with the rows shared out between the pool threads.
+
+void SwapFitsData(MedianDetails* Details,int Nx,int Ny)
+{
+    uint32_t* Words = (uint32_t*)Details->InputData;
+    const uint32_t One = 1;
+    bool Swap = (*(const unsigned char*)&One == 1);
+    std::atomic<uint32_t> Blanks(0);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        uint32_t RowBlanks = 0;
+        for (size_t I = size_t(Iyst) * size_t(Nx); I < size_t(Iyen) * size_t(Nx); I++) {
+            uint32_t Word = Words[I];
+            if (Swap) Word = (Word >> 24) | ((Word >> 8) & 0xff00) |
+                                               ((Word << 8) & 0xff0000) | (Word << 24);
+            uint32_t Exponent = Word & 0x7f800000;
+            RowBlanks |= (Exponent == 0x7f800000);
+            Words[I] = (Exponent == 0x7f800000) ? 0x7fc00000 : (Exponent == 0) ? 0 : Word;
+        }
+        Blanks |= RowBlanks;
+    });
+    Details->HasBlanks = (Blanks != 0);
+    Details->NeedsSwap = false;
+    TheDebugHandler.Log("Fits","Image data converted by the CPU");
+    if (Details->HasBlanks) TheDebugHandler.Log("Fits","Image has blank pixels");
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             M a p  F i t s  I m a g e
+//
+//  This is a fast path used by ReadFitsFile() for the usual case of an uncompressed image of
+//  32-bit floats (BITPIX = -32) with no scaling. Instead of fits_read_img() reading the data
+//  through cfitsio's own buffers and then converting it into Data, this maps the data unit of
+//  the file into memory and converts it from the big-endian FITS format straight into Data, so
+//  the data is only handled once, and reading it is little more than the cost of the page
+//  faults. It returns false, having done nothing, if the image isn't one it can handle, and
+//  the caller should then use fits_read_img(). The conversion matches the one cfitsio does
+//  when checking for nulls: NaNs and infinities are blank pixels, set to NaN and flagged in
+//  *Anynull, and values with a zero exponent (underflows) are set to zero.
+//
+//  (Data can't just be left pointing into the mapped file, even where no byte swap is needed,
+//  because the data unit starts at a multiple of 2880 bytes into the file, not on a page
+//  boundary, and Shutdown() expects to be able to free() the array.)
+
+bool MapFitsImage(const std::string& Filename,fitsfile* Fptr,long NPixels,float* Data,
+                                                                                 int* Anynull)
+{
+    bool Mapped = false;
+    
+#ifdef USE_MMAP
+
+    LONGLONG DataStart = 0;
+    if (!FitsDataStart(Filename,Fptr,NPixels,&DataStart)) return false;
+    size_t Bytes = size_t(NPixels) * sizeof(float);
+    
+    //  mmap() needs an offset that's a multiple of the page size, so the mapping may start a
+    //  little before the data.
+    
+    int Fd = open(Filename.c_str(),O_RDONLY);
+    if (Fd < 0) return false;
+    struct stat FileStat;
+    off_t MapStart = off_t(DataStart) - off_t(DataStart) % off_t(sysconf(_SC_PAGESIZE));
+    size_t MapLength = size_t(DataStart - MapStart) + Bytes;
+    if (fstat(Fd,&FileStat) == 0 && FileStat.st_size >= off_t(MapStart + MapLength)) {
+        void* Map = mmap(nullptr,MapLength,PROT_READ,MAP_PRIVATE,Fd,MapStart);
+        if (Map != MAP_FAILED) {
+            madvise(Map,MapLength,MADV_SEQUENTIAL);
+            
+            //  The data unit starts at a multiple of 2880 bytes, so the words are aligned.
+            //  The loop has no branches, so the compiler can vectorize it.
+            
+            const uint32_t* Words =
+                      (const uint32_t*)((const char*)Map + size_t(DataStart - MapStart));
+            const uint32_t One = 1;
+            bool Swap = (*(const unsigned char*)&One == 1);
+            uint32_t Blanks = 0;
+            for (long I = 0; I < NPixels; I++) {
+                uint32_t Word = Words[I];
+                if (Swap) Word = (Word >> 24) | ((Word >> 8) & 0xff00) |
+                                                   ((Word << 8) & 0xff0000) | (Word << 24);
+                uint32_t Exponent = Word & 0x7f800000;
+                Blanks |= (Exponent == 0x7f800000);
+                Word = (Exponent == 0x7f800000) ? 0x7fc00000 : (Exponent == 0) ? 0 : Word;
+                memcpy(&Data[I],&Word,sizeof(float));
+            }
+            *Anynull = (Blanks != 0);
+            munmap(Map,MapLength);
+            Mapped = true;
+        }
+    }
+    close(Fd);
+
+#endif
+
+    return Mapped;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                  R e a d  C o m p r e s s e d  F i t s  I m a g e
+//
+//  Used by ReadFitsFile() for a tile-compressed image (Rice, GZIP etc). fits_read_img() would
+//  decompress the tiles one after another in the calling thread, and for a large image that
+//  decompression, not the disk, is what takes the time. This splits the image into bands of
+//  whole tile rows and has the shared thread pool read them at once, each band into its own
+//  part of Data, so each tile is only decompressed once. cfitsio doesn't let two threads use
+//  the same fitsfile, so each band opens the file for itself. That's only safe if cfitsio was
+//  built to be reentrant, so this returns false, having done nothing, if it wasn't, or if the
+//  image isn't compressed or has only one row of tiles, and the caller should then use
+//  fits_read_img(). Otherwise it returns true, with Anynull set as fits_read_img() would set
+//  it and any error returned in *Status.
+
+bool ReadCompressedFitsImage(const std::string& Filename,fitsfile* Fptr,long Nx,long Ny,
+                                                       float* Data,int* Anynull,int* Status)
+{
+    //  A file cfitsio has to unpack into memory (eg a gzipped file) would be unpacked again
+    //  by each band, so that's also left to fits_read_img().
+    
+    int CheckStatus = 0;
+    char UrlType[FLEN_FILENAME];
+    if (!fits_is_reentrant() || !fits_is_compressed_image(Fptr,&CheckStatus)) return false;
+    if (fits_url_type(Fptr,UrlType,&CheckStatus) || strcmp(UrlType,"file://")) return false;
+    if (ThreadPool::Shared().Threads() <= 1) return false;
+    
+    //  ZTILE2 is the number of image rows in each tile. Without it, each row is a tile.
+    
+    long TileRows = 1;
+    int HduNum = 0;
+    fits_get_hdu_num(Fptr,&HduNum);
+    if (fits_read_key(Fptr,TLONG,"ZTILE2",&TileRows,nullptr,&CheckStatus) || TileRows < 1) {
+        TileRows = 1;
+    }
+    int Tiles = int((Ny + TileRows - 1) / TileRows);
+    if (Tiles <= 1) return false;
+    
+    //  Each band reports blank pixels and errors through these. Only the first error is kept.
+    
+    std::atomic<int> AnyBlanks(0);
+    std::atomic<int> FirstError(0);
+    ThreadPool::Shared().ParallelFor(0,Tiles,[&](int First,int Last) {
+        int BandStatus = 0;
+        int BandNull = 0;
+        fitsfile* BandFptr = nullptr;
+        long FirstRow = First * TileRows;
+        long LastRow = Last * TileRows;
+        if (LastRow > Ny) LastRow = Ny;
+        float Nullval = NAN;
+        if (fits_open_file(&BandFptr,Filename.c_str(),READONLY,&BandStatus) == 0 &&
+                fits_movabs_hdu(BandFptr,HduNum,nullptr,&BandStatus) == 0) {
+            fits_read_img(BandFptr,TFLOAT,FirstRow * Nx + 1,(LastRow - FirstRow) * Nx,
+                                       &Nullval,Data + FirstRow * Nx,&BandNull,&BandStatus);
+        }
+        int CloseStatus = 0;
+        if (BandFptr) fits_close_file(BandFptr,&CloseStatus);
+        if (BandNull) AnyBlanks = 1;
+        int NoError = 0;
+        if (BandStatus) FirstError.compare_exchange_strong(NoError,BandStatus);
+    });
+    *Anynull = AnyBlanks;
+    if (FirstError != 0) *Status = FirstError;
+    TheDebugHandler.Logf("Fits","Compressed image, %d rows of tiles, each %ld rows high",
+                                                                         Tiles,TileRows);
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         R e a d  R a w  F i t s  I m a g e
+//
+//  Used by ReadFitsFile() for 'Native'. If the image is 16-bit integers (BITPIX = 16), this reads
+//  them into Details->RawData just as they are in the file, with none of the scaling to floats
+//  that fits_read_img() would normally do, and sets the BSCALE, BZERO and BLANK values in Details
+//  for whatever converts them later - usually a 'MedianInt16' kernel. The memory is page aligned
+//  and a whole number of pages, like that for a float image, so the GPU can use it as it is.
+//  This returns false, having done nothing, if the image isn't 16-bit integers or the memory
+//  can't be allocated, and the caller should read it as floats instead. Otherwise it returns
+//  true, and any error reading the image is returned in *Status.
+
+bool ReadRawFitsImage(fitsfile* Fptr,long NPixels,MedianDetails* Details,int* Status)
+{
+    int TypeStatus = 0;
+    int Bitpix = 0;
+    if (fits_get_img_type(Fptr,&Bitpix,&TypeStatus) || Bitpix != SHORT_IMG) return false;
+    short* RawData = (short*)PageAlloc(size_t(NPixels) * sizeof(short));
+    if (RawData == nullptr) return false;
+    
+    //  BSCALE and BZERO default to 1 and 0. BLANK is optional, and without it no pixel is blank.
+    
+    double Bscale = 1.0;
+    double Bzero = 0.0;
+    long Blank = 0;
+    int KeyStatus = 0;
+    if (fits_read_key(Fptr,TDOUBLE,"BSCALE",&Bscale,nullptr,&KeyStatus)) Bscale = 1.0;
+    KeyStatus = 0;
+    if (fits_read_key(Fptr,TDOUBLE,"BZERO",&Bzero,nullptr,&KeyStatus)) Bzero = 0.0;
+    KeyStatus = 0;
+    bool HasBlank = (fits_read_key(Fptr,TLONG,"BLANK",&Blank,nullptr,&KeyStatus) == 0) &&
+                                                           Blank >= -32768 && Blank <= 32767;
+    
+    //  With the scaling turned off, fits_read_img() only has to byte swap the values, and a
+    //  null Nulval means it doesn't look for blank values either.
+    
+    long Fpixel = 1;
+    int Anynull = 0;
+    fits_set_bscale(Fptr,1.0,0.0,Status);
+    fits_read_img(Fptr,TSHORT,Fpixel,NPixels,nullptr,RawData,&Anynull,Status);
+    if (*Status) {
+        free(RawData);
+    } else {
+        Details->RawData = RawData;
+        Details->RawScale = float(Bscale);
+        Details->RawZero = float(Bzero);
+        Details->RawBlank = int(Blank);
+        Details->RawHasBlank = HasBlank;
+        short* RawEnd = RawData + NPixels;
+        Details->HasBlanks = HasBlank && std::find(RawData,RawEnd,short(Blank)) != RawEnd;
+        TheDebugHandler.Logf("Fits","16-bit image, BSCALE %g, BZERO %g",Bscale,Bzero);
+    }
+    return true;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    G P U  c o d e
@@ -410,18 +1400,201 @@ bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
 #include <AppKit/AppKit.hpp>
 #include <MetalKit/MetalKit.hpp>
 
+//  The heap allocator for GPU buffers, the kernel timer and the indirect dispatch, which need
+//  the Metal definitions.
+
+#include "BufferHeap.h"
+#include "DispatchTimer.h"
+#include "IndirectDispatch.h"
+
 //  Metal-cpp sometimes lets its underlying implementation in objective-C show through. One is
 //  its use of NS::String objects, and it helps to not have to keep writing "NS::StringEncoding::".
 
 using NS::StringEncoding::UTF8StringEncoding;
 
-void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  W a r m  G P U
+//
+//  For 'WarmStart', a WarmGPU sets up the GPU device, opens the library and creates the
+//  pipeline states for the kernels ComputeUsingGPU() may need, all in a thread of its own, so
+//  that can go on while the FITS file is read. ComputeUsingGPU() waits for it, and uses what
+//  it set up. Anything it couldn't set up comes back as nullptr, and ComputeUsingGPU() then
+//  sets that up itself in the usual way, which also reports the error. MedianKernelName()
+//  gives the name of the kernel ComputeUsingGPU() uses, so the two agree.
+
+std::string MedianKernelName(int Npix,bool Half,bool Tiled,bool Shuffle,bool Int16)
+{
+    //  The 3x3, 5x5 and 7x7 box sizes each have their own kernel, using a selection network
+    //  for the median, called Median3, MedianHalf3 etc., and 9x9 and 11x11 have kernels
+    //  with fixed size loops for the full boxes. 'Tiled' has its own set, MedianTiled,
+    //  MedianTiledHalf, MedianTiled3 and so on, and 'Shuffle' has MedianShuffle3,
+    //  MedianShuffleHalf3 etc., for the fixed sizes only. A 16-bit integer image read for
+    //  'Native' uses MedianInt16, MedianInt16_3, MedianTiledInt16 etc.
+    
+    std::string FunctionName =
+                std::string(Tiled ? "MedianTiled" : (Shuffle ? "MedianShuffle" : "Median")) +
+                                      (Half ? "Half" : "") + (Int16 ? "Int16" : "");
+    if (Npix >= 3 && Npix <= C_MaxWorkNpix) {
+        FunctionName += (Int16 ? "_" : "") + std::to_string(Npix);
+    }
+    return FunctionName;
+}
+
+class WarmGPU {
+public:
+    //  Starts setting up the named kernels, using indirect pipeline states if Indirect is set.
+    WarmGPU(const std::vector<std::string>& Names,bool Indirect) {
+        I_Thread = std::thread(&WarmGPU::Run,this,Names,Indirect);
+    }
+    ~WarmGPU() {
+        Wait();
+        for (auto& Entry : I_Kernels) {
+            if (Entry.second.Pipeline) Entry.second.Pipeline->release();
+            if (Entry.second.Function) Entry.second.Function->release();
+        }
+        if (I_Library) I_Library->release();
+        if (I_Device) I_Device->release();
+    }
+    //  Waits for the setup to finish. This must be called before any of the routines below.
+    void Wait(void) { if (I_Thread.joinable()) I_Thread.join(); }
+    //  The device and library, or nullptr if they couldn't be set up.
+    MTL::Device* Device(void) const { return I_Device; }
+    MTL::Library* Library(void) const { return I_Library; }
+    //  The function and pipeline state for a kernel, or nullptr if it wasn't set up.
+    MTL::Function* Function(const std::string& Name) const {
+        auto Found = I_Kernels.find(Name);
+        return (Found == I_Kernels.end()) ? nullptr : Found->second.Function;
+    }
+    MTL::ComputePipelineState* Pipeline(const std::string& Name) const {
+        auto Found = I_Kernels.find(Name);
+        return (Found == I_Kernels.end()) ? nullptr : Found->second.Pipeline;
+    }
+private:
+    void Run(std::vector<std::string> Names,bool Indirect) {
+        NS::AutoreleasePool* Pool = NS::AutoreleasePool::alloc()->init();
+        TraceScope WarmTrace("GPU warm start","Median");
+        MsecTimer WarmTimer;
+        I_Device = MTLCreateSystemDefaultDevice();
+        NS::Error* ErrorPtr = nullptr;
+        if (I_Device) {
+            I_Library = I_Device->newLibrary(NS::String::string("Compute.metallib",
+                                                               UTF8StringEncoding),&ErrorPtr);
+            if (I_Library && ErrorPtr) {
+                I_Library->release();
+                I_Library = nullptr;
+            }
+        }
+        if (I_Library) {
+            for (const std::string& Name : Names) {
+                Kernel TheKernel = {nullptr,nullptr};
+                TheKernel.Function = I_Library->newFunction(NS::String::string(Name.c_str(),
+                                                                        UTF8StringEncoding));
+                if (TheKernel.Function) {
+                    ErrorPtr = nullptr;
+                    TheKernel.Pipeline = Indirect ?
+                        IndirectDispatch::NewPipelineState(I_Device,TheKernel.Function,&ErrorPtr) :
+                              I_Device->newComputePipelineState(TheKernel.Function,&ErrorPtr);
+                }
+                I_Kernels[Name] = TheKernel;
+            }
+        }
+        TheDebugHandler.Logf("Setup","GPU warm start finished at %.3f msec",
+                                                                    WarmTimer.ElapsedMsec());
+        Pool->release();
+    }
+    struct Kernel {
+        MTL::Function* Function;
+        MTL::ComputePipelineState* Pipeline;
+    };
+    MTL::Device* I_Device = nullptr;
+    MTL::Library* I_Library = nullptr;
+    std::map<std::string,Kernel> I_Kernels;
+    std::thread I_Thread;
+};
+
+WarmGPU* StartWarmGPU(int Npix,bool Half,bool Tiled,bool Shuffle,bool Native,bool Indirect)
+{
+    std::vector<std::string> Names;
+    Names.push_back(MedianKernelName(Npix,Half,Tiled,Shuffle,false));
+    if (Native) Names.push_back(MedianKernelName(Npix,Half,Tiled,Shuffle,true));
+    return new WarmGPU(Names,Indirect);
+}
+
+void FinishWarmGPU(WarmGPU* Warm)
+{
+    delete Warm;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                S w a p  O n  G P U
+//
+//  Used by ComputeUsingGPU() for 'DirectLoad', to convert the image LoadFitsData() read, in
+//  Buffer, from the big-endian FITS format, using the SwapFits kernel in Median.metal. This is
+//  done once, before the repeat loop, and waited for. It returns false if the kernel can't be
+//  set up or doesn't run, leaving the image alone. Otherwise *Blanks is set if the image has
+//  any blank pixels, and *Msec is the time the GPU took.
+
+bool SwapOnGPU(MTL::Device* Device,MTL::Library* Library,MTL::Buffer* Buffer,long NPixels,
+                                                                   bool* Blanks,float* Msec)
+{
+    bool Swapped = false;
+    NS::Error* ErrorPtr = nullptr;
+    MTL::ComputePipelineState* PipelineState = nullptr;
+    MTL::Function* SwapFunction =
+               Library->newFunction(NS::String::string("SwapFits",UTF8StringEncoding));
+    if (SwapFunction) PipelineState = Device->newComputePipelineState(SwapFunction,&ErrorPtr);
+    MTL::Buffer* BlankBuffer = Device->newBuffer(sizeof(uint32_t),MTL::ResourceStorageModeShared);
+    if (PipelineState && BlankBuffer) {
+        *(uint32_t*)BlankBuffer->contents() = 0;
+        uint32_t Count = uint32_t(NPixels);
+        MTL::CommandQueue* CommandQueue = Device->newCommandQueue();
+        MTL::CommandBuffer* CommandBuffer = CommandQueue->commandBuffer();
+        MTL::ComputeCommandEncoder* Encoder = CommandBuffer->computeCommandEncoder();
+        Encoder->setComputePipelineState(PipelineState);
+        Encoder->setBuffer(Buffer,0,0);
+        Encoder->setBuffer(BlankBuffer,0,1);
+        Encoder->setBytes(&Count,sizeof(Count),2);
+        NS::UInteger GroupSize = PipelineState->maxTotalThreadsPerThreadgroup();
+        Encoder->dispatchThreads(MTL::Size(NPixels,1,1),MTL::Size(GroupSize,1,1));
+        Encoder->endEncoding();
+        CommandBuffer->commit();
+        CommandBuffer->waitUntilCompleted();
+        if (CommandBuffer->status() == MTL::CommandBufferStatusCompleted) {
+            *Blanks = (*(uint32_t*)BlankBuffer->contents() != 0);
+            *Msec = float((CommandBuffer->GPUEndTime() - CommandBuffer->GPUStartTime()) * 1000.0);
+            Swapped = true;
+        }
+        CommandQueue->release();
+    }
+    if (BlankBuffer) BlankBuffer->release();
+    if (PipelineState) PipelineState->release();
+    if (SwapFunction) SwapFunction->release();
+    return Swapped;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//  ComputeUsingGPU() itself, as described at the start of the GPU code.
+
+void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Half,bool Tiled,bool Shuffle,
+                          int InFlight,bool Indirect,bool Untracked,MedianDetails* Details,
+                                                   int Warmup,BenchReport* Bench,WarmGPU* Warm)
 {
     //  This is where we actually start to use Metal, specifically the metal-cpp layer provided
     //  by Apple for use with C++.
     
+    //  With 'Native', a 16-bit integer image is given to the GPU as it was read, and the
+    //  'MedianInt16' kernels scale it. (If the image is to be held in half precision, it has
+    //  to be scaled on the CPU anyway, by SetInputArray().)
+    
+    bool Int16 = (!Half && Details->RawData != nullptr);
+    
     MsecTimer SetupTimer;
     TheDebugHandler.Log("Setup","GPU setup starting");
+    TraceRecorder& Tracer = TraceRecorder::Global();
+    Tracer.Begin("GPU setup","Median");
 
     //  The metal-cpp routines need an autorelease pool they can use to keep track of
     //  allocated items. This gives them what they need. All we need to do is create it.
@@ -430,9 +1603,13 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
     
     //  We create an MTL::Device object to represent the GPU itself. (If a system has multiple
     //  GPUs this can get more complicated, but most Apple systems only have one GPU, and the
-    //  default device is usually what we need.
+    //  default device is usually what we need. With 'WarmStart', the WarmGPU has already set
+    //  up the device, the library and the pipeline state in another thread, and we just wait
+    //  for it and use those.
     
-    MTL::Device* Device = MTLCreateSystemDefaultDevice();
+    if (Warm) Warm->Wait();
+    MTL::Device* Device = Warm ? Warm->Device() : nullptr;
+    if (Device == nullptr) Device = MTLCreateSystemDefaultDevice();
     TheDebugHandler.Logf("Setup","GPU setup device created at %.3f msec",SetupTimer.ElapsedMsec());
     TheDebugHandler.Logf("Metal","Device is '%s'",Device->name()->cString(UTF8StringEncoding));
 
@@ -443,8 +1620,12 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
     
     NS::Error* ErrorPtr = nullptr;
     MTL::Function* MedianFunction = nullptr;
-    MTL::Library* Library = Device->newLibrary(NS::String::string("Compute.metallib",
+    std::string FunctionName = MedianKernelName(Npix,Half,Tiled,Shuffle,Int16);
+    MTL::Library* Library = Warm ? Warm->Library() : nullptr;
+    if (Library == nullptr) {
+        Library = Device->newLibrary(NS::String::string("Compute.metallib",
                                                        UTF8StringEncoding),&ErrorPtr);
+    }
     if (Library == nullptr || ErrorPtr != nullptr) {
         printf ("Error opening library 'Compute.metallib'.\n");
         if (ErrorPtr) {
@@ -453,10 +1634,19 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
     } else {
         TheDebugHandler.Logf("Setup","GPU setup library created at %.3f msec",
                                                                    SetupTimer.ElapsedMsec());
-        MedianFunction = Library->newFunction(NS::String::string("Median",UTF8StringEncoding));
-        if (MedianFunction == nullptr) printf ("Unable to find 'Median' function in library\n");
-    }
-    
+        
+        //  The kernel used depends on the box size and the options - see MedianKernelName().
+        
+        if (Warm) MedianFunction = Warm->Function(FunctionName);
+        if (MedianFunction == nullptr) {
+            MedianFunction = Library->newFunction(NS::String::string(FunctionName.c_str(),
+                                                                       UTF8StringEncoding));
+        }
+        if (MedianFunction == nullptr) {
+            printf ("Unable to find '%s' function in library\n",FunctionName.c_str());
+        }
+    }
+    
     //  If we've got the Median function set up, things are probably going to work. Because this
     //  is intended as example code rather than real production code, I don't want to clutter
     //  it too much with error handling from here on - production code should be more careful!
@@ -481,24 +1671,141 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
         //  buffer is to be 'shared', ie visible to both the GPU and the CPU (since we need to
         //  use the CPU to set its initial values.
         
-        int Length = Nx * Ny * sizeof(float);
+        //
+        //  If the image is held in half precision, the buffers are only half the size, and so
+        //  is the input buffer for a 16-bit integer image.
+        
+        int Length = Nx * Ny * (Half || Int16 ? sizeof(uint16_t) : sizeof(float));
+        int OutputLength = Nx * Ny * (Half ? sizeof(uint16_t) : sizeof(float));
         unsigned int Alignment = sysconf(_SC_PAGE_SIZE);
         int AllocationSize = (Length + Alignment - 1) & (~(Alignment - 1));
+        int OutputAllocationSize = (OutputLength + Alignment - 1) & (~(Alignment - 1));
         unsigned int BufferOptions = MTL::StorageModeShared;
-        MTL::Buffer* InputBuffer = Device->newBuffer(AllocationSize,BufferOptions);
+        
+        //  With 'Untracked', the buffers the GPU only reads - the input, and the arguments for
+        //  'Indirect' - have no hazard tracking. The CPU writes them before anything is
+        //  committed, and no pass writes them, so there is no dependency between passes for
+        //  Metal to track, and no fence is needed in its place. The output buffer is still
+        //  tracked.
+        
+        unsigned int ReadOptions = BufferOptions;
+        if (Untracked) ReadOptions |= MTL::ResourceHazardTrackingModeUntracked;
+        
+        //  The buffers we create ourselves come from a heap just big enough for both - or
+        //  from two heaps, with 'Untracked', as untracked buffers need a heap of their own.
+        
+        BufferHeap Heap(Device,Untracked ? std::max(AllocationSize,OutputAllocationSize) :
+                                                          AllocationSize + OutputAllocationSize);
+        
+        //  An image read from a file is in page aligned memory that is a whole number of pages
+        //  long, so - unless it's to be held in half precision - the buffer can just use that
+        //  memory, with the newBufferWithBytesNoCopy variant of newBuffer() (the one that takes
+        //  a deallocator, passed as null since Shutdown() releases the memory). That saves
+        //  copying the whole image. The same goes for the integers read for 'Native'.
+        
+        void* ImageData = Int16 ? (void*)Details->RawData : (void*)Details->InputData;
+        bool Imported = (!Half && ImageData != nullptr);
+        MTL::Buffer* InputBuffer = nullptr;
+        if (Imported) {
+            InputBuffer = Device->newBuffer(ImageData,AllocationSize,ReadOptions,nullptr);
+        }
+        if (InputBuffer == nullptr) {
+            Imported = false;
+            InputBuffer = Heap.NewBuffer(AllocationSize,ReadOptions);
+        }
+        
+        //  With 'DirectLoad', the image is still as it was in the file, and if the buffer is
+        //  the image's own memory the GPU converts it there, before anything else uses it.
+        //  (That includes TheArgs, which needs to know about any blank pixels.) Otherwise the
+        //  CPU has to convert it before SetInputArray() copies it.
+        
+        float SwapMsec = 0.0;
+        bool GPUSwapped = false;
+        if (Details->NeedsSwap) {
+            bool Blanks = false;
+            GPUSwapped = Imported && SwapOnGPU(Device,Library,InputBuffer,long(Nx) * long(Ny),
+                                                                            &Blanks,&SwapMsec);
+            if (GPUSwapped) {
+                Details->HasBlanks = Blanks;
+                Details->NeedsSwap = false;
+                TheDebugHandler.Logf("Fits","Image data converted by the GPU in %.3f msec",
+                                                                                     SwapMsec);
+                if (Blanks) TheDebugHandler.Log("Fits","Image has blank pixels");
+            } else {
+                SwapFitsData(Details,Nx,Ny);
+            }
+        }
         
         //  To set the contents of the buffer using the CPU, we need the address the CPU can use
         //  for this buffer, which we get using its contents() method. Then we can initialise
+        //
+        //  In half precision, the CPU works with its own arrays of floats, and the image is
+        //  converted as it goes into the buffer. This is much slower than a simple copy, so
+        //  the rows are shared out between the pool threads. Real data may have values too
+        //  large for half precision, which become infinities, so we count those.
         
-        InputArray = CreateRowAddrs((float*)InputBuffer->contents(),Nx,Ny);
-        SetInputArray(InputArray,Nx,Ny,Details);
+        float* InputArrayData = nullptr;
+        float* OutputArrayData = nullptr;
+        float UploadMsec = 0.0;
+        if (Half) {
+            InputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+            OutputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+            InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+            SetInputArray(InputArray,Nx,Ny,Details);
+            MsecTimer UploadTimer;
+            std::atomic<long> OutOfRange(0);
+            uint16_t* InputBufferAddr = (uint16_t*)InputBuffer->contents();
+            ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+                long Count = 0;
+                for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                    const float* Row = InputArray[Iy];
+                    uint16_t* Target = InputBufferAddr + size_t(Iy) * size_t(Nx);
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        Target[Ix] = FloatToHalf(Row[Ix]);
+                        Count += (Row[Ix] > C_HalfMax || Row[Ix] < -C_HalfMax);
+                    }
+                }
+                OutOfRange += Count;
+            });
+            UploadMsec = UploadTimer.ElapsedMsec();
+            if (OutOfRange > 0) {
+                printf ("Warning: %ld pixel values are too large for half precision.\n",
+                                                                          OutOfRange.load());
+            }
+        } else if (Int16) {
+            if (!Imported) memcpy(InputBuffer->contents(),Details->RawData,Length);
+        } else {
+            InputArray = CreateRowAddrs((float*)InputBuffer->contents(),Nx,Ny);
+            if (!Imported) SetInputArray(InputArray,Nx,Ny,Details);
+        }
 
-        //  And now a device buffer for the output data array. This is essentially the same as for
-        //  the input buffer. This will have to be accessed on the CPU side by NoteResults(),
-        //  so we use CreateRowAddrs() to set up for this.
+        //  And now a device buffer for the output data array. This will have to be accessed on
+        //  the CPU side by NoteResults(), so we use CreateRowAddrs() to set up for this. (In half
+        //  precision, the output array is the CPU's own, and the results are converted into it
+        //  once the GPU is done.) NoteResults() keeps the results, and rather than have it copy
+        //  them, the GPU writes them into page aligned memory of our own, wrapped as a buffer
+        //  without a copy, which NoteResults() can then just take over. If that can't be set
+        //  up, the buffer comes from the heap and NoteResults() copies the results as before.
         
-        MTL::Buffer* OutputBuffer = Device->newBuffer(AllocationSize,BufferOptions);
-        OutputArray = CreateRowAddrs((float*)OutputBuffer->contents(),Nx,Ny);
+        float* OutputData = nullptr;
+        MTL::Buffer* OutputBuffer = nullptr;
+        if (!Half) {
+            OutputData = (float*)PageAlloc(OutputLength);
+            if (OutputData) {
+                OutputBuffer = Device->newBuffer(OutputData,OutputAllocationSize,
+                                                                          BufferOptions,nullptr);
+            }
+        }
+        if (OutputBuffer == nullptr) {
+            free(OutputData);
+            OutputData = nullptr;
+            OutputBuffer = Heap.NewBuffer(OutputAllocationSize,BufferOptions);
+        }
+        if (Half) {
+            OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+        } else {
+            OutputArray = CreateRowAddrs((float*)OutputBuffer->contents(),Nx,Ny);
+        }
         TheDebugHandler.Logf("Setup","GPU setup buffers created at %.3f msec",
                                                                    SetupTimer.ElapsedMsec());
 
@@ -506,12 +1813,27 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
         //  we do need to put them in a structure that matches what the GPU code in Median.metal
         //  expects. In this case, we don't really need a structure, but in more complex cases
         //  with more parameters we will, so we might as well use one here and initialise it
-        //  with the size of the median box.
+        //  with the size of the median box, in X and Y, and whether the image has any blank
+        //  pixels.
         
         struct MedianArgs {
             int Npix;
+            int NpixY;
+            int Blanks;
+        };
+        MedianArgs TheArgs = {Npix,Npix,Details->HasBlanks};
+        
+        //  The 'MedianInt16' kernels also need the values used to scale the integers, passed
+        //  in a structure matching Int16Args in Median.metal.
+        
+        struct Int16Args {
+            float Bscale;
+            float Bzero;
+            int BlankValue;
+            int CheckBlank;
         };
-        MedianArgs TheArgs = {Npix};
+        Int16Args TheScaling = {Details->RawScale,Details->RawZero,Details->RawBlank,
+                                                                     Details->RawHasBlank};
         
         //  We need a command queue that will be able to supply a command buffer.
         
@@ -519,10 +1841,16 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
         TheDebugHandler.Logf("Setup","GPU setup command queue created at %.3f msec",
                                                                    SetupTimer.ElapsedMsec());
 
-        //  This lets us create a 'pipeline state' that will execute this function.
+        //  This lets us create a 'pipeline state' that will execute this function. For
+        //  'Indirect', it has to be one that can be used in an indirect command buffer. (With
+        //  'WarmStart', it has already been created.)
         
-        MTL::ComputePipelineState* PipelineState =
-        Device->newComputePipelineState(MedianFunction,&ErrorPtr);
+        MTL::ComputePipelineState* PipelineState = Warm ? Warm->Pipeline(FunctionName) : nullptr;
+        if (PipelineState == nullptr) {
+            PipelineState = Indirect ?
+                  IndirectDispatch::NewPipelineState(Device,MedianFunction,&ErrorPtr) :
+                                    Device->newComputePipelineState(MedianFunction,&ErrorPtr);
+        }
         TheDebugHandler.Logf("Setup","GPU setup pipeline state created at %.3f msec",
                                                                   SetupTimer.ElapsedMsec());
 
@@ -535,17 +1863,92 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
         TheDebugHandler.Logf("Metal","Max threads per threadgroup %d, Thread width %d",
                              ThreadGroupSize,ThreadWidth);
         TheDebugHandler.Logf("Metal","Using thread group size %d",ThreadGroupSize);
+        
+        //  We need to set up the grid the GPU will use - the kernel code can get the grid
+        //  dimensions and will use that to get the size of the arrays - it needs to know
+        //  this, so we set it simply to Nx by Ny - the GPU can handle a third dimension but
+        //  we set that to 1. The shuffle kernels need each SIMD-group to be one row of the
+        //  threadgroup, so for those the threadgroup is ThreadWidth threads wide rather than high.
+        
+        MTL::Size GridSize(Nx,Ny,1);
+        MTL::Size ThreadGroupDims(ThreadGroupSize / ThreadWidth,ThreadWidth,1);
+        if (Shuffle) ThreadGroupDims = MTL::Size(ThreadWidth,ThreadGroupSize / ThreadWidth,1);
+        
+        //  For 'Indirect', the pipeline state, the buffers and the dispatch are encoded once,
+        //  now, and each pass just executes that. An indirect command can't be given the
+        //  arguments with setBytes(), so they go in small buffers of their own. If the indirect
+        //  command buffer can't be created, the passes encode the dispatch as usual.
+        
+        IndirectDispatch Command(Device);
+        MTL::Buffer* ArgsBuffer = nullptr;
+        MTL::Buffer* ScalingBuffer = nullptr;
+        if (Indirect) {
+            if (Command.Begin(PipelineState,3)) {
+                ArgsBuffer = Device->newBuffer(&TheArgs,sizeof(MedianArgs),ReadOptions);
+                Command.SetBuffer(InputBuffer,0);
+                Command.SetBuffer(OutputBuffer,1);
+                Command.SetBuffer(ArgsBuffer,2);
+                if (Int16) {
+                    ScalingBuffer = Device->newBuffer(&TheScaling,sizeof(Int16Args),ReadOptions);
+                    Command.SetBuffer(ScalingBuffer,3);
+                }
+                Command.Dispatch(GridSize,ThreadGroupDims);
+            } else {
+                printf ("Unable to create an indirect command buffer, so 'Indirect' is ignored.\n");
+                Indirect = false;
+            }
+        }
         TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+        Tracer.End("GPU setup","Median");
         
         //  And that completes the basic setup for the GPU pipeline. From here, all Metal items
         //  are transient, and need to be created anew if the calculation is to be repeated,
         //  which it is going to be in the loop that follows.
+
+        //  With 'InFlight', up to InFlight command buffers are with the GPU at once, kept in a
+        //  ring of slots just as in the Adder example, so the CPU encodes each pass while the
+        //  GPU runs the ones before it. Every pass writes the same output, and Metal runs the
+        //  command buffers from one queue in order, so the result is the same either way.
+        
+        //  The time the GPU spends in the kernel is measured by a DispatchTimer, with a slot
+        //  for each command buffer in flight, and added up once each one completes. The time
+        //  for each pass is also collected in KernelStats. For a trace, each command buffer is
+        //  recorded from its commit until it's seen to complete, identified by its address, and
+        //  the kernel time is shown ending when it completed - the GPU only gives a duration.
+        
+        DispatchTimer KernelTimer(Device,InFlight);
+        float KernelMsec = 0.0;
+        MsecStats KernelStats;
+        KernelStats.SetWarmup(Warmup);
+        
+        MTL::CommandBuffer* InFlightBuffers[C_MaxInFlight] = {};
+        auto WaitForSlot = [&](int Slot) {
+            if (InFlightBuffers[Slot]) {
+                InFlightBuffers[Slot]->waitUntilCompleted();
+                double DoneUsec = Tracer.NowUsec();
+                Tracer.AsyncEnd("GPU submission","Metal",uint64_t(InFlightBuffers[Slot]));
+                float DispatchMsec = KernelTimer.DispatchMsec(InFlightBuffers[Slot],Slot);
+                KernelMsec += DispatchMsec;
+                KernelStats.Record(DispatchMsec);
+                Tracer.Complete("Median kernel","GPU",DoneUsec - DispatchMsec * 1000.0,
+                                                                           DispatchMsec * 1000.0);
+                InFlightBuffers[Slot]->release();
+                InFlightBuffers[Slot] = nullptr;
+            }
+        };
                 
+        //  The time for each pass is collected in LoopStats. (With 'InFlight', this is the time
+        //  for the CPU to get the pass to the GPU, including any wait for a free slot.)
+        
+        MsecStats LoopStats;
+        LoopStats.SetWarmup(Warmup);
         MsecTimer ComputeTimer;
         
         for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
             
             MsecTimer LoopTimer;
+            TraceScope PassTrace("GPU pass","Median");
+            WaitForSlot(Irpt % InFlight);
             
             //  This sets up the pipeline for the GPU calculation and runs it. It's good
             //  practice to use a separate autorelease pool for separate sections like this.
@@ -557,72 +1960,741 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
             //  that will perform the calculation.
             
             MTL::CommandBuffer* CommandBuffer = CommandQueue->commandBuffer();
-            MTL::ComputeCommandEncoder* Encoder = CommandBuffer->computeCommandEncoder();
-            TheDebugHandler.Logf("Timing","Command buffer and encoder created at %.3f msec",
+            MTL::ComputeCommandEncoder* Encoder =
+                                          KernelTimer.NewEncoder(CommandBuffer,Irpt % InFlight);
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,
+                                                  "Command buffer and encoder created at %.3f msec",
                                                                      LoopTimer.ElapsedMsec());
-            Encoder->setComputePipelineState(PipelineState);
-            
-            //  Set the two data buffers, for the input array and the output array. These are
-            //  associated with different bindings, specified by the index numbers 1 and 2, which
-            //  must match the index values used in the metal kernel code in Median.metal
+            if (Indirect) {
+                Command.Execute(Encoder);
+            } else {
+                Encoder->setComputePipelineState(PipelineState);
             
-            Encoder->setBuffer(InputBuffer,0,0);
-            Encoder->setBuffer(OutputBuffer,0,1);
-            TheDebugHandler.Logf("Timing","Data buffers set at %.3f msec",LoopTimer.ElapsedMsec());
-
-            //  Metal lets us associate small amounts of data - in this case the parameter
-            //  structure (TheArgs) that holds the X and Y size of the median box - with a
-            //  binding index, which must also match that used in Median.metal.
+                //  Set the two data buffers, for the input array and the output array. These are
+                //  associated with different bindings, specified by the index numbers 0 and 1,
+                //  which must match the index values used in the metal kernel code in Median.metal
             
-            Encoder->setBytes(&TheArgs,sizeof(MedianArgs),2);
+                Encoder->setBuffer(InputBuffer,0,0);
+                Encoder->setBuffer(OutputBuffer,0,1);
+                DEBUG_LOGF(TheDebugHandler,TimingDebug,"Data buffers set at %.3f msec",
+                                                                     LoopTimer.ElapsedMsec());
 
-            //  We need to set up the grid the GPU will use - the kernel code can get the grid
-            //  dimensions and will use that to get the size of the arrays - it needs to know
-            //  this, so we set it simply to Nx by Ny - the GPU can handle a third dimension but
-            //  we set that to 1.
+                //  Metal lets us associate small amounts of data - in this case the parameter
+                //  structure (TheArgs) that holds the X and Y size of the median box - with a
+                //  binding index, which must also match that used in Median.metal.
             
-            MTL::Size GridSize(Nx,Ny,1);
-            MTL::Size ThreadGroupDims(ThreadGroupSize / ThreadWidth,ThreadWidth,1);
-            Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+                Encoder->setBytes(&TheArgs,sizeof(MedianArgs),2);
+                if (Int16) Encoder->setBytes(&TheScaling,sizeof(Int16Args),3);
+                Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+            }
             Encoder->endEncoding();
-            TheDebugHandler.Logf("Timing","Encoding finished at %.3f msec",LoopTimer.ElapsedMsec());
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"Encoding finished at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
             
             //  Finally, we run the kernel. We 'commit' the command buffer, ie submit it
-            //  for execution, and wait for it to complete. (A cleverer program could be doing
-            //  something else while the buffer executes, but we just wait.)
+            //  for execution, and normally wait for it to complete. With 'InFlight', we keep
+            //  it instead, and only wait for it when its slot is needed again.
             
             CommandBuffer->commit();
-            TheDebugHandler.Logf("Timing","Compute committed at %.3f msec",LoopTimer.ElapsedMsec());
-            CommandBuffer->waitUntilCompleted();
-            TheDebugHandler.Logf("Timing","Compute complete at %.3f msec",LoopTimer.ElapsedMsec());
+            Tracer.AsyncBegin("GPU submission","Metal",uint64_t(CommandBuffer));
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute committed at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+            if (InFlight > 1) {
+                InFlightBuffers[Irpt % InFlight] = CommandBuffer->retain();
+            } else {
+                CommandBuffer->waitUntilCompleted();
+                double DoneUsec = Tracer.NowUsec();
+                Tracer.AsyncEnd("GPU submission","Metal",uint64_t(CommandBuffer));
+                DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute complete at %.3f msec",
+                                                                     LoopTimer.ElapsedMsec());
+                float DispatchMsec = KernelTimer.DispatchMsec(CommandBuffer);
+                DEBUG_LOGF(TheDebugHandler,TimingDebug,"GPU kernel took %.3f msec",DispatchMsec);
+                KernelMsec += DispatchMsec;
+                KernelStats.Record(DispatchMsec);
+                Tracer.Complete("Median kernel","GPU",DoneUsec - DispatchMsec * 1000.0,
+                                                                           DispatchMsec * 1000.0);
+            }
 
             //  And at the end of the block, let the auto-release pool for the loop do its thing.
             
             PipeAutoreleasePool->release();
+            LoopStats.Record(LoopTimer.ElapsedMsec());
         }
         
-        //  Report on the timing, and check that we got it right.
+        //  The results are needed now, so wait for any passes still with the GPU, oldest first.
+        
+        for (int Islot = 0; Islot < InFlight; Islot++) WaitForSlot((Nrpt + Islot) % InFlight);
+        
+        //  In half precision, the results have to be converted back to floats.
         
         float Msec = ComputeTimer.ElapsedMsec();
-        printf ("GPU took %.3f msec\n",Msec);
+        float ReadbackMsec = 0.0;
+        if (Half && Nrpt > 0) {
+            MsecTimer ReadbackTimer;
+            const uint16_t* OutputBufferAddr = (const uint16_t*)OutputBuffer->contents();
+            ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+                for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                    const uint16_t* Source = OutputBufferAddr + size_t(Iy) * size_t(Nx);
+                    float* Row = OutputArray[Iy];
+                    for (int Ix = 0; Ix < Nx; Ix++) Row[Ix] = HalfToFloat(Source[Ix]);
+                }
+            });
+            ReadbackMsec = ReadbackTimer.ElapsedMsec();
+        }
+        
+        //  Report on the timing, and check that we got it right.
+        
+        printf ("GPU%s took %.3f msec\n",Half ? " (half precision)" : "",Msec);
         printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        LoopStats.Report("GPU iterations");
+        if (Bench && LoopStats.Count() > 0) {
+            Bench->SetContext("Median","Metal",Device->name()->cString(UTF8StringEncoding),"");
+            std::string Test = "GPU " + std::to_string(Npix) + "x" + std::to_string(Npix);
+            if (Half) Test += " half";
+            if (Tiled) Test += " tiled";
+            if (Shuffle) Test += " shuffle";
+            if (InFlight > 1) Test += " in flight " + std::to_string(InFlight);
+            if (Indirect) Test += " indirect";
+            if (Untracked) Test += " untracked";
+            Bench->AddRow(Test,Nx,Ny,LoopStats,&KernelStats);
+        }
+        printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        if (InFlight > 1) printf ("(With up to %d command buffers in flight)\n",InFlight);
+        if (Indirect) printf ("(Dispatch encoded once, in an indirect command buffer)\n");
+        if (Untracked) printf ("(Read-only buffers created without hazard tracking)\n");
+        if (GPUSwapped) {
+            printf ("(Image loaded as it is in the file, converted by the GPU in %.3f msec)\n",
+                                                                                     SwapMsec);
+        }
+        if (Half) {
+            printf ("Conversion to half precision took %.3f msec, and back %.3f msec\n",
+                                                                      UploadMsec,ReadbackMsec);
+        }
         bool FromGPU = true;
         if (Nrpt <= 0) {
             printf ("No values computed using GPU, as number of repeats set to zero.\n");
         } else {
-            NoteResults(OutputArray,FromGPU,Nx,Ny,Details);
+            Details->GPUHalf = Half;
+            NoteResults(OutputArray,FromGPU,Nx,Ny,Details,Half ? &OutputArrayData : &OutputData);
+        }
+        printf ("\n");
+
+        //  Release the buffers, then the arrays used to hold the row addresses for the two
+        //  arrays, and any of the arrays themselves that NoteResults() didn't keep.
+        
+        InputBuffer->release();
+        OutputBuffer->release();
+        if (ArgsBuffer) ArgsBuffer->release();
+        if (ScalingBuffer) ScalingBuffer->release();
+        if (OutputData) free(OutputData);
+        if (OutputArray) free(OutputArray);
+        if (InputArray) free(InputArray);
+        if (OutputArrayData) free(OutputArrayData);
+        if (InputArrayData) free(InputArrayData);
+    } else {
+        Tracer.End("GPU setup","Median");
+    }
+    
+    //  And now finish up by releasing any resources known to the main auto-release pool.
+    
+    MainAutoreleasePool->release();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G P U  c o d e  ( b a t c h )
+//
+//  ComputeBatchUsingGPU() filters each of a list of FITS files in turn, writing each result to a
+//  "Median_" copy of the file as usual. Getting the device, the library, the kernel function and
+//  building its pipeline state can take longer than filtering a modest image, and doing that
+//  again for each file of a night's data wastes most of the time. So this does all that just
+//  once, and keeps the same buffers for all the files. Metal buffers can't be resized, so new
+//  ones are only created when an image is larger than any seen so far - a smaller image just
+//  uses the start of the existing ones. Each file is filtered once, just as ComputeUsingGPU()
+//  would do it, and if UseCPU is set the CPU filters it too, so the results can be checked.
+//  Each result is then written out by a FitsWriter, in the background, while the next file is
+//  read and filtered. With Concurrent greater than one, that many files are read at a time, and
+//  their dispatches all go into one concurrent encoder, so a set of small images can keep the
+//  GPU as busy as one large one.
+
+void ComputeBatchUsingGPU(const std::vector<std::string>& Files,int Npix,bool UseCPU,
+               int Threads,bool Histogram,bool Simd,float Tolerance,bool Tiled,int Concurrent)
+{
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU batch setup starting");
+
+    NS::AutoreleasePool* MainAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    
+    //  The device, library, function and pipeline state are set up just as in ComputeUsingGPU().
+    
+    MTL::Device* Device = MTLCreateSystemDefaultDevice();
+    NS::Error* ErrorPtr = nullptr;
+    MTL::Function* MedianFunction = nullptr;
+    MTL::Library* Library = Device->newLibrary(NS::String::string("Compute.metallib",
+                                                       UTF8StringEncoding),&ErrorPtr);
+    std::string FunctionName = Tiled ? "MedianTiled" : "Median";
+    if (Npix >= 3 && Npix <= C_MaxWorkNpix) FunctionName += std::to_string(Npix);
+    if (Library == nullptr || ErrorPtr != nullptr) {
+        printf ("Error opening library 'Compute.metallib'.\n");
+        if (ErrorPtr) {
+            printf ("Reason: %s\n",ErrorPtr->localizedDescription()->cString(UTF8StringEncoding));
+        }
+    } else {
+        MedianFunction = Library->newFunction(NS::String::string(FunctionName.c_str(),
+                                                                       UTF8StringEncoding));
+        if (MedianFunction == nullptr) {
+            printf ("Unable to find '%s' function in library\n",FunctionName.c_str());
+        }
+    }
+    
+    if (MedianFunction) {
+        MTL::CommandQueue* CommandQueue = Device->newCommandQueue();
+        MTL::ComputePipelineState* PipelineState =
+                                   Device->newComputePipelineState(MedianFunction,&ErrorPtr);
+        DispatchTimer KernelTimer(Device);
+        int MaxThreadGroupSize = PipelineState->maxTotalThreadsPerThreadgroup();
+        int ThreadWidth = PipelineState->threadExecutionWidth();
+        struct MedianArgs {
+            int Npix;
+            int NpixY;
+            int Blanks;
+        };
+        MedianArgs TheArgs = {Npix,Npix,false};
+        printf ("GPU setup took %.3f msec, once for all %d files\n\n",SetupTimer.ElapsedMsec(),
+                                                                            int(Files.size()));
+        
+        //  Now work through the files, Concurrent of them at a time. Each member of a group has
+        //  its own input buffer, created when the first file for it has been read, and its
+        //  capacity is that buffer's allocated size, zero until then. They come from a heap,
+        //  and when a larger image needs a new one the old one is recycled, so a list of files
+        //  of varying sizes doesn't keep adding to the memory used. Each result has to be kept
+        //  until it has been written, so the output for each file goes into page aligned memory
+        //  of its own, wrapped as a buffer without a copy, which NoteResults() then keeps.
+        
+        BufferHeap Heap(Device);
+        MTL::Buffer* InputBuffers[C_MaxConcurrent] = {};
+        long BufferCapacity[C_MaxConcurrent] = {};
+        unsigned int Alignment = sysconf(_SC_PAGE_SIZE);
+        unsigned int BufferOptions = MTL::StorageModeShared;
+        int FilesFiltered = 0;
+        float TotalGPUMsec = 0.0;
+        FitsWriter Writer;
+        MsecTimer BatchTimer;
+        
+        size_t NextFile = 0;
+        while (NextFile < Files.size()) {
+            
+            //  Each file has its own MedianDetails, set up by ReadFitsFile() and released once
+            //  the result has been written. Read the files for the next group, skipping any
+            //  that can't be read.
+            
+            MedianDetails Details[C_MaxConcurrent];
+            std::string GroupFiles[C_MaxConcurrent];
+            int GroupNx[C_MaxConcurrent] = {};
+            int GroupNy[C_MaxConcurrent] = {};
+            int Members = 0;
+            while (Members < Concurrent && NextFile < Files.size()) {
+                const std::string& File = Files[NextFile++];
+                Details[Members].CheckTolerance = Tolerance;
+                std::string Filename = File;
+            
+                //  ReadFitsFile() reads the image straight into this member's input buffer.
+                //  Once the file has been opened and its dimensions are known, it calls this to
+                //  get the buffer address, and this replaces the buffer first if the image
+                //  won't fit in it.
+            
+                MTL::Buffer*& InputBuffer = InputBuffers[Members];
+                long& Capacity = BufferCapacity[Members];
+                auto Destination = [&](int ImageNx,int ImageNy) -> float* {
+                    long Length = long(ImageNx) * long(ImageNy) * sizeof(float);
+                    if (Length > Capacity) {
+                        Heap.Recycle(InputBuffer);
+                        Capacity = (Length + Alignment - 1) & (~long(Alignment - 1));
+                        InputBuffer = Heap.NewBuffer(Capacity,BufferOptions);
+                        TheDebugHandler.Logf("Setup","GPU buffer created for %d by %d image",
+                                                                              ImageNx,ImageNy);
+                    }
+                    return InputBuffer ? (float*)InputBuffer->contents() : nullptr;
+                };
+                if (!ReadFitsFile(Filename,&GroupNx[Members],&GroupNy[Members],&Details[Members],
+                                                                     "Median_",Destination)) {
+                    printf ("%s skipped.\n\n",File.c_str());
+                    Shutdown(&Details[Members]);
+                    Details[Members] = MedianDetails();
+                    continue;
+                }
+                GroupFiles[Members++] = File;
+            }
+            if (Members == 0) continue;
+            
+            //  Filter the images, each just as for one pass of ComputeUsingGPU(), into the page
+            //  aligned output for its file - or a buffer from the heap if that can't be set up.
+            //  The images have nothing to do with each other, so they all go into the one
+            //  concurrent encoder, and the GPU is free to run their threadgroups side by side -
+            //  which fills it when each image alone is too small to. No barriers are needed,
+            //  since no dispatch reads anything another writes.
+            
+            float* OutputData[C_MaxConcurrent] = {};
+            MTL::Buffer* OutputBuffers[C_MaxConcurrent] = {};
+            for (int Member = 0; Member < Members; Member++) {
+                int Nx = GroupNx[Member];
+                int Ny = GroupNy[Member];
+                size_t OutputBytes = PageRound(size_t(Nx) * size_t(Ny) * sizeof(float));
+                OutputData[Member] = (float*)PageAlloc(OutputBytes);
+                if (OutputData[Member]) {
+                    OutputBuffers[Member] = Device->newBuffer(OutputData[Member],OutputBytes,
+                                                                          BufferOptions,nullptr);
+                }
+                if (OutputBuffers[Member] == nullptr) {
+                    free(OutputData[Member]);
+                    OutputData[Member] = nullptr;
+                    OutputBuffers[Member] = Heap.NewBuffer(OutputBytes,BufferOptions);
+                }
+            }
+            MsecTimer ComputeTimer;
+            NS::AutoreleasePool* PipeAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+            MTL::CommandBuffer* CommandBuffer = CommandQueue->commandBuffer();
+            MTL::ComputeCommandEncoder* Encoder = KernelTimer.NewEncoder(CommandBuffer,0,
+                    Members > 1 ? MTL::DispatchTypeConcurrent : MTL::DispatchTypeSerial);
+            Encoder->setComputePipelineState(PipelineState);
+            for (int Member = 0; Member < Members; Member++) {
+                int Nx = GroupNx[Member];
+                int Ny = GroupNy[Member];
+                int ThreadGroupSize = MaxThreadGroupSize;
+                if (ThreadGroupSize > (Nx * Ny)) ThreadGroupSize = Nx * Ny;
+                TheArgs.Blanks = Details[Member].HasBlanks;
+                Encoder->setBuffer(InputBuffers[Member],0,0);
+                Encoder->setBuffer(OutputBuffers[Member],0,1);
+                Encoder->setBytes(&TheArgs,sizeof(MedianArgs),2);
+                MTL::Size GridSize(Nx,Ny,1);
+                MTL::Size ThreadGroupDims(ThreadGroupSize / ThreadWidth,ThreadWidth,1);
+                Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+            }
+            Encoder->endEncoding();
+            CommandBuffer->commit();
+            CommandBuffer->waitUntilCompleted();
+            float KernelMsec = KernelTimer.DispatchMsec(CommandBuffer);
+            PipeAutoreleasePool->release();
+            float Msec = ComputeTimer.ElapsedMsec();
+            
+            if (Members == 1) {
+                printf ("%s, %d by %d: GPU took %.3f msec (kernel %.3f msec)\n",
+                         GroupFiles[0].c_str(),GroupNx[0],GroupNy[0],Msec,KernelMsec);
+            } else {
+                for (int Member = 0; Member < Members; Member++) {
+                    printf ("%s, %d by %d\n",GroupFiles[Member].c_str(),GroupNx[Member],
+                                                                            GroupNy[Member]);
+                }
+                printf ("GPU took %.3f msec (kernel %.3f msec) for these %d files together\n",
+                                                                     Msec,KernelMsec,Members);
+            }
+            TotalGPUMsec += Msec;
+            for (int Member = 0; Member < Members; Member++) {
+                int Nx = GroupNx[Member];
+                int Ny = GroupNy[Member];
+                float** OutputArray =
+                               CreateRowAddrs((float*)OutputBuffers[Member]->contents(),Nx,Ny);
+                NoteResults(OutputArray,true,Nx,Ny,&Details[Member],&OutputData[Member]);
+                free(OutputArray);
+                Heap.Recycle(OutputBuffers[Member]);
+                if (OutputData[Member]) free(OutputData[Member]);
+                if (UseCPU) {
+                    ComputeUsingCPU(Threads,Nx,Ny,Npix,1,Histogram,Simd,&Details[Member]);
+                }
+                Writer.Submit(Nx,Ny,&Details[Member]);
+                FilesFiltered++;
+            }
+        }
+        Writer.Finish();
+        
+        printf ("\nFiltered %d of %d files in %.3f msec, of which the GPU took %.3f msec\n\n",
+                       FilesFiltered,int(Files.size()),BatchTimer.ElapsedMsec(),TotalGPUMsec);
+        for (MTL::Buffer* InputBuffer : InputBuffers) if (InputBuffer) InputBuffer->release();
+    }
+    
+    MainAutoreleasePool->release();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G P U  c o d e  ( s c a l e s )
+//
+//  ComputeScalesUsingGPU() filters the image with each of the box sizes in Scales at once, using
+//  the MedianScales kernel. Each threadgroup loads its tile of the image into threadgroup
+//  memory just once, with a halo wide enough for the largest box, and every thread then finds
+//  the median for each box size from that tile, writing them to successive images in one
+//  output buffer. So finding, say, the 3x3, 7x7 and 15x15 medians needs one pass through the
+//  image and one dispatch, rather than one of each for each size. It is passed an array of
+//  MedianDetails, one for each scale, and the input image comes from the first of these. The
+//  results for each scale are passed to NoteResults() with the MedianDetails for that scale,
+//  so each can be checked and written out separately.
+
+void ComputeScalesUsingGPU(int Nx,int Ny,const std::vector<int>& Scales,int Nrpt,
+                                                                   MedianDetails* Details)
+{
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU multi-scale setup starting");
+    
+    NS::AutoreleasePool* MainAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    
+    //  The device, library and function are set up just as in ComputeUsingGPU().
+    
+    MTL::Device* Device = MTLCreateSystemDefaultDevice();
+    NS::Error* ErrorPtr = nullptr;
+    MTL::Function* MedianFunction = nullptr;
+    MTL::Library* Library = Device->newLibrary(NS::String::string("Compute.metallib",
+                                                       UTF8StringEncoding),&ErrorPtr);
+    if (Library == nullptr || ErrorPtr != nullptr) {
+        printf ("Error opening library 'Compute.metallib'.\n");
+        if (ErrorPtr) {
+            printf ("Reason: %s\n",ErrorPtr->localizedDescription()->cString(UTF8StringEncoding));
+        }
+    } else {
+        MedianFunction = Library->newFunction(NS::String::string("MedianScales",
+                                                                       UTF8StringEncoding));
+        if (MedianFunction == nullptr) {
+            printf ("Unable to find 'MedianScales' function in library\n");
+        }
+    }
+    
+    if (MedianFunction) {
+        
+        //  The input buffer is initialised by SetInputArray() as usual, and the output buffer
+        //  holds an image for each scale.
+        
+        int NScales = int(Scales.size());
+        long Length = long(Nx) * long(Ny) * sizeof(float);
+        unsigned int Alignment = sysconf(_SC_PAGE_SIZE);
+        long InputSize = (Length + Alignment - 1) & (~long(Alignment - 1));
+        long OutputSize = (Length * NScales + Alignment - 1) & (~long(Alignment - 1));
+        unsigned int BufferOptions = MTL::StorageModeShared;
+        BufferHeap Heap(Device,InputSize + OutputSize);
+        MTL::Buffer* InputBuffer = Heap.NewBuffer(InputSize,BufferOptions);
+        MTL::Buffer* OutputBuffer = Heap.NewBuffer(OutputSize,BufferOptions);
+        float** InputArray = CreateRowAddrs((float*)InputBuffer->contents(),Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,&Details[0]);
+        
+        //  The parameters for the kernel, which must match the ScaleArgs structure in
+        //  Median.metal.
+        
+        struct ScaleArgs {
+            uint32_t Scales;
+            uint32_t Npix[C_MaxScales];
+            uint32_t Blanks;
+        } TheArgs = {uint32_t(NScales),{0},Details[0].HasBlanks};
+        for (int Iscale = 0; Iscale < NScales; Iscale++) TheArgs.Npix[Iscale] = Scales[Iscale];
+        
+        MTL::CommandQueue* CommandQueue = Device->newCommandQueue();
+        MTL::ComputePipelineState* PipelineState =
+                                   Device->newComputePipelineState(MedianFunction,&ErrorPtr);
+        int ThreadGroupSize = PipelineState->maxTotalThreadsPerThreadgroup();
+        int ThreadWidth = PipelineState->threadExecutionWidth();
+        if (ThreadGroupSize > (Nx * Ny)) ThreadGroupSize = Nx * Ny;
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+        
+        //  The repeat loop is just as for ComputeUsingGPU(), each pass finding all the scales.
+        
+        MsecTimer ComputeTimer;
+        for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+            NS::AutoreleasePool* PipeAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+            MTL::CommandBuffer* CommandBuffer = CommandQueue->commandBuffer();
+            MTL::ComputeCommandEncoder* Encoder = CommandBuffer->computeCommandEncoder();
+            Encoder->setComputePipelineState(PipelineState);
+            Encoder->setBuffer(InputBuffer,0,0);
+            Encoder->setBuffer(OutputBuffer,0,1);
+            Encoder->setBytes(&TheArgs,sizeof(ScaleArgs),2);
+            MTL::Size GridSize(Nx,Ny,1);
+            MTL::Size ThreadGroupDims(ThreadGroupSize / ThreadWidth,ThreadWidth,1);
+            Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+            Encoder->endEncoding();
+            CommandBuffer->commit();
+            CommandBuffer->waitUntilCompleted();
+            PipeAutoreleasePool->release();
+        }
+        float Msec = ComputeTimer.ElapsedMsec();
+        
+        //  Report on the timing, and note the results for each scale.
+        
+        printf ("GPU took %.3f msec for %d box sizes\n",Msec,NScales);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            float* OutputBufferAddr = (float*)OutputBuffer->contents();
+            for (int Iscale = 0; Iscale < NScales; Iscale++) {
+                float** OutputArray = CreateRowAddrs(OutputBufferAddr +
+                                               size_t(Iscale) * size_t(Nx) * size_t(Ny),Nx,Ny);
+                NoteResults(OutputArray,true,Nx,Ny,&Details[Iscale]);
+                free(OutputArray);
+            }
+        }
+        printf ("\n");
+        free(InputArray);
+        InputBuffer->release();
+        OutputBuffer->release();
+    }
+    
+    MainAutoreleasePool->release();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              G P U  c o d e  ( c u b e )
+//
+//  ComputeCubeUsingGPU() filters each plane of a 3D FITS image - a data cube, such as the output
+//  of an integral field unit - writing the result to a "Median_" copy of the file, as usual. The
+//  planes are quite independent, so a median box never reaches from one plane into the next.
+//  The device, library and pipeline state are set up just once, and the planes are passed
+//  through a small ring of C_CubeSlots 'slots', each with its own input and output buffers and
+//  command buffer. For each plane the CPU waits for the slot that's next in turn to finish the
+//  plane it was given last time round, writes out that plane's result straight from the slot's
+//  output buffer, reads the new plane straight into the slot's input buffer, and commits its
+//  command buffer, without waiting. So while the CPU is reading and writing one plane, the
+//  GPU already has the next ones queued, and is kept busy for the whole cube.
+//
+//  The cube is never all in memory, so this only uses the GPU. The planes are read and written
+//  with fits_read_pix() and fits_write_pix(), and blank pixels are read as NaNs, as they are by
+//  ReadFitsFile().
+
+void ComputeCubeUsingGPU(const std::string& Filename,int Npix,bool Tiled)
+{
+    char Error[80];
+    int Status = 0;
+
+    //  Open the input file at its first image, get the cube's dimensions, and create the output
+    //  file, with the same name as ReadFitsFile() would use. A compressed cube's header has to be
+    //  turned back into that of an ordinary image.
+
+    std::filesystem::path InputPath(Filename);
+    std::string MedianFile =
+               (InputPath.parent_path() / ("Median_" + InputPath.filename().string())).string();
+    fitsfile* InFptr = nullptr;
+    fitsfile* OutFptr = nullptr;
+    int Naxis = 0;
+    long Naxes[3] = {0,0,0};
+    std::string CreateName = "!" + MedianFile;
+    if (fits_open_image(&InFptr,Filename.c_str(),READONLY,&Status) == 0 &&
+            fits_get_img_dim(InFptr,&Naxis,&Status) == 0 &&
+                    fits_get_img_size(InFptr,3,Naxes,&Status) == 0) {
+        if (Naxis != 3) {
+            strncpy(Error,"File main image is not 3-dimensional",sizeof(Error));
+            Status = 1;
+        } else if (fits_create_file(&OutFptr,CreateName.c_str(),&Status) == 0) {
+            int CompStatus = 0;
+            if (fits_is_compressed_image(InFptr,&CompStatus)) {
+                fits_img_decompress_header(InFptr,OutFptr,&Status);
+            } else {
+                fits_copy_header(InFptr,OutFptr,&Status);
+            }
+        }
+    }
+    if (Status != 0) {
+        if (Status > 1) fits_get_errstatus (Status,Error);
+        printf ("Error reading FITS file: %s\n",Error);
+        int CloseStatus = 0;
+        if (OutFptr) fits_close_file(OutFptr,&CloseStatus);
+        CloseStatus = 0;
+        if (InFptr) fits_close_file(InFptr,&CloseStatus);
+        return;
+    }
+    int Nx = int(Naxes[0]);
+    int Ny = int(Naxes[1]);
+    int Planes = int(Naxes[2]);
+    TheDebugHandler.Logf("Fits","Cube of %d planes, each %d by %d",Planes,Nx,Ny);
+
+    //  Reading and writing a plane.
+
+    auto ReadPlane = [&](int Plane,float* Data,bool* Blanks) {
+        long Fpixel[3] = {1,1,long(Plane) + 1};
+        float Nullval = NAN;
+        int Anynull = 0;
+        fits_read_pix(InFptr,TFLOAT,Fpixel,long(Nx) * long(Ny),&Nullval,Data,&Anynull,&Status);
+        *Blanks = (Anynull != 0);
+    };
+    auto WritePlane = [&](int Plane,float* Data) {
+        long Fpixel[3] = {1,1,long(Plane) + 1};
+        fits_write_pix(OutFptr,TFLOAT,Fpixel,long(Nx) * long(Ny),Data,&Status);
+    };
+
+    MsecTimer SetupTimer;
+    NS::AutoreleasePool* MainAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+
+    //  The device, library, function and pipeline state are set up just as in ComputeUsingGPU().
+
+    MTL::Device* Device = MTLCreateSystemDefaultDevice();
+    NS::Error* ErrorPtr = nullptr;
+    MTL::Function* MedianFunction = nullptr;
+    MTL::Library* Library = Device->newLibrary(NS::String::string("Compute.metallib",
+                                                       UTF8StringEncoding),&ErrorPtr);
+    std::string FunctionName = Tiled ? "MedianTiled" : "Median";
+    if (Npix >= 3 && Npix <= C_MaxWorkNpix) FunctionName += std::to_string(Npix);
+    if (Library == nullptr || ErrorPtr != nullptr) {
+        printf ("Error opening library 'Compute.metallib'.\n");
+        if (ErrorPtr) {
+            printf ("Reason: %s\n",ErrorPtr->localizedDescription()->cString(UTF8StringEncoding));
+        }
+    } else {
+        MedianFunction = Library->newFunction(NS::String::string(FunctionName.c_str(),
+                                                                       UTF8StringEncoding));
+        if (MedianFunction == nullptr) {
+            printf ("Unable to find '%s' function in library\n",FunctionName.c_str());
+        }
+    }
+
+    if (MedianFunction) {
+        MTL::CommandQueue* CommandQueue = Device->newCommandQueue();
+        MTL::ComputePipelineState* PipelineState =
+                                   Device->newComputePipelineState(MedianFunction,&ErrorPtr);
+        int ThreadGroupSize = PipelineState->maxTotalThreadsPerThreadgroup();
+        int ThreadWidth = PipelineState->threadExecutionWidth();
+        if (ThreadGroupSize > (Nx * Ny)) ThreadGroupSize = Nx * Ny;
+        struct MedianArgs {
+            int Npix;
+            int NpixY;
+            int Blanks;
+        };
+
+        //  Each slot's buffers, and the command buffer it was last committed with, which is
+        //  retained until it has been waited for. Plane is the plane the slot is working on,
+        //  or -1 if it has none.
+
+        struct CubeSlot {
+            MTL::Buffer* InputBuffer = nullptr;
+            MTL::Buffer* OutputBuffer = nullptr;
+            MTL::CommandBuffer* CommandBuffer = nullptr;
+            int Plane = -1;
+        };
+        CubeSlot Slots[C_CubeSlots];
+        bool BuffersOK = true;
+        long PlaneBytes = long(Nx) * long(Ny) * sizeof(float);
+        BufferHeap Heap(Device,C_CubeSlots * 2 * PlaneBytes);
+        for (CubeSlot& Slot : Slots) {
+            Slot.InputBuffer = Heap.NewBuffer(PlaneBytes,MTL::ResourceStorageModeShared);
+            Slot.OutputBuffer = Heap.NewBuffer(PlaneBytes,MTL::ResourceStorageModeShared);
+            if (Slot.InputBuffer == nullptr || Slot.OutputBuffer == nullptr) BuffersOK = false;
+        }
+        if (BuffersOK) {
+            printf ("GPU setup took %.3f msec, once for all %d planes\n",
+                                                          SetupTimer.ElapsedMsec(),Planes);
+        } else {
+            printf ("Unable to create GPU buffers for the cube.\n");
+        }
+
+        //  Waiting for a slot to finish its plane, and writing out the result.
+
+        MsecTimer CubeTimer;
+        float IOMsec = 0.0;
+        float WaitMsec = 0.0;
+        bool GPUOK = true;
+        auto FinishSlot = [&](CubeSlot& Slot) {
+            if (Slot.Plane < 0) return;
+            MsecTimer WaitTimer;
+            Slot.CommandBuffer->waitUntilCompleted();
+            if (Slot.CommandBuffer->status() != MTL::CommandBufferStatusCompleted) GPUOK = false;
+            Slot.CommandBuffer->release();
+            Slot.CommandBuffer = nullptr;
+            WaitMsec += WaitTimer.ElapsedMsec();
+            if (GPUOK && Status == 0) {
+                MsecTimer IOTimer;
+                WritePlane(Slot.Plane,(float*)Slot.OutputBuffer->contents());
+                IOMsec += IOTimer.ElapsedMsec();
+            }
+            Slot.Plane = -1;
+        };
+
+        for (int Plane = 0; Plane < Planes && Status == 0 && GPUOK && BuffersOK; Plane++) {
+            CubeSlot& Slot = Slots[Plane % C_CubeSlots];
+            FinishSlot(Slot);
+            if (Status != 0 || !GPUOK) break;
+            bool Blanks = false;
+            MsecTimer IOTimer;
+            ReadPlane(Plane,(float*)Slot.InputBuffer->contents(),&Blanks);
+            IOMsec += IOTimer.ElapsedMsec();
+            if (Status != 0) break;
+            MedianArgs TheArgs = {Npix,Npix,Blanks};
+            NS::AutoreleasePool* PipeAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+            MTL::CommandBuffer* CommandBuffer = CommandQueue->commandBuffer();
+            MTL::ComputeCommandEncoder* Encoder = CommandBuffer->computeCommandEncoder();
+            Encoder->setComputePipelineState(PipelineState);
+            Encoder->setBuffer(Slot.InputBuffer,0,0);
+            Encoder->setBuffer(Slot.OutputBuffer,0,1);
+            Encoder->setBytes(&TheArgs,sizeof(MedianArgs),2);
+            MTL::Size GridSize(Nx,Ny,1);
+            MTL::Size ThreadGroupDims(ThreadGroupSize / ThreadWidth,ThreadWidth,1);
+            Encoder->dispatchThreads(GridSize,ThreadGroupDims);
+            Encoder->endEncoding();
+            CommandBuffer->commit();
+            Slot.CommandBuffer = CommandBuffer->retain();
+            Slot.Plane = Plane;
+            PipeAutoreleasePool->release();
         }
-        printf ("\n");
 
-        //  Release the arrays used to hold the row addresses for the two arrays.
-        
-        if (OutputArray) free(OutputArray);
-        if (InputArray) free(InputArray);
+        //  The last planes are still with the GPU. They have to be waited for even after an
+        //  error, as their buffers mustn't be released while they're in use. The oldest comes
+        //  first.
+
+        int FirstSlot = Planes % C_CubeSlots;
+        for (int Islot = 0; Islot < C_CubeSlots; Islot++) {
+            FinishSlot(Slots[(FirstSlot + Islot) % C_CubeSlots]);
+        }
+        for (CubeSlot& Slot : Slots) {
+            if (Slot.InputBuffer) Slot.InputBuffer->release();
+            if (Slot.OutputBuffer) Slot.OutputBuffer->release();
+        }
+        if (!GPUOK && Status == 0) {
+            strncpy(Error,"GPU execution failed",sizeof(Error));
+            Status = 1;
+        } else if (!BuffersOK && Status == 0) {
+            strncpy(Error,"No GPU buffers for the cube",sizeof(Error));
+            Status = 1;
+        } else if (Status == 0) {
+            float Msec = CubeTimer.ElapsedMsec();
+            printf ("Filtered %d planes of %d by %d in %.3f msec (%.3f msec per plane)\n",
+                                   Planes,Nx,Ny,Msec,Msec / float(std::max(Planes,1)));
+            printf ("File I/O took %.3f msec, waiting for the GPU %.3f msec\n",IOMsec,WaitMsec);
+        }
+    } else {
+        strncpy(Error,"No GPU function to filter the cube",sizeof(Error));
+        Status = 1;
     }
-    
-    //  And now finish up by releasing any resources known to the main auto-release pool.
-    
     MainAutoreleasePool->release();
+
+    //  Close the files. As in WriteFitsFile(), a close error shouldn't replace the description
+    //  of an earlier error.
+
+    if (Status > 1) fits_get_errstatus (Status,Error);
+    int CloseStatus = 0;
+    if (OutFptr && fits_close_file(OutFptr,&CloseStatus)) {
+        if (Status == 0) fits_get_errstatus (CloseStatus,Error);
+        if (Status == 0) Status = CloseStatus;
+    }
+    CloseStatus = 0;
+    if (InFptr) fits_close_file(InFptr,&CloseStatus);
+
+    if (Status != 0) {
+        printf ("Error filtering FITS cube: %s\n",Error);
+    } else {
+        printf ("Output cube written OK to %s\n",MedianFile.c_str());
+    }
+    printf ("\n");
+}
+
+//  IsFitsCube() is true if the first image in a FITS file has three dimensions. The main
+//  program uses it to send cubes to ComputeCubeUsingGPU().
+
+bool IsFitsCube(const std::string& Filename)
+{
+    int Naxis = 0;
+    int Status = 0;
+    fitsfile* Fptr = nullptr;
+    if (fits_open_image(&Fptr,Filename.c_str(),READONLY,&Status) == 0) {
+        fits_get_img_dim(Fptr,&Naxis,&Status);
+        int CloseStatus = 0;
+        fits_close_file(Fptr,&CloseStatus);
+    }
+    if (Status != 0) Naxis = 0;
+    return (Naxis == 3);
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -644,20 +2716,23 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
 //  maximum available number of CPU threads. Otherwise, Threads is taken as the maximum number of
 //  CPU threads to use.
 //
-//  The basic operation is performed by ComputeRangeUsingCPU() and you could do the whole thing
-//  just with one call to ComputeRangeUsingCPU() with the Y-range parameters Iyst and Iyen set
-//  to 0 and Ny respectively. That would handle the whole image using one CPU thread. However, as
-//  this operation will probably gain by using CPU multi-threading, the main routine actually
-//  calls OnePassUsingCPU() for each iteration. This then handles the threading, being able to
-//  split the job up so that multiple threads each handle a subset of the rows of the image (ie
-//  splitting up in Y). It starts up a number of threads, each running ComputeRangeUsingCPU()
-//  over a different set of image rows.
-
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
+//  The basic operation is performed by ComputeTileUsingCPU() and you could do the whole thing
+//  just with one call to ComputeTileUsingCPU() with the X and Y ranges set to cover the whole
+//  image. That would handle the whole image using one CPU thread. However, as this operation
+//  will probably gain by using CPU multi-threading, the main routine actually calls
+//  OnePassUsingCPU() for each iteration. This then handles the threading, splitting the image
+//  into tiles of C_CPUTileWidth columns by C_CPUTileRows rows, which the threads of the shared
+//  pool take one at a time, each running ComputeTileUsingCPU() on it, until none are left.
+
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,bool Histogram,
+                                                             bool Simd,MedianDetails* Details,
+                                                                int Warmup,BenchReport* Bench)
 {
     //  Forward declaration for the routine that does most of the work.
     
-    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray);
+    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                         bool Histogram,bool Simd,bool Blanks,float* BinWidth);
+    const char* SimdDescription(void);
     
     //  Create the two arrays we need, one for the input data, one for the output. To make things
     //  easier for ourselves, setup two arrays that contain the addresses of the start of the
@@ -693,21 +2768,49 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,MedianDetails*
     //  count. OnePassUsingCPU is passed the number of threads specified (with zero meaning
     //  use as many as are available) and returns the number actually used.
     
+    float BinWidth = 0.0;
+    MsecStats PassStats;
+    PassStats.SetWarmup(Warmup);
     for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
-        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,Npix,OutputArray);
+        MsecTimer PassTimer;
+        TraceScope PassTrace("CPU pass","Median");
+        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,Npix,OutputArray,Histogram,Simd,
+                                                               Details->HasBlanks,&BinWidth);
+        PassStats.Record(PassTimer.ElapsedMsec());
     }
     
     //  Report on the timing, and check that we got it right.
 
     float Msec = LoopTimer.ElapsedMsec();
-    printf ("CPU took %.3f msec\n",Msec);
+    std::string Engine = "";
+    if (Histogram) Engine = " (histogram filter)";
+    else if (Simd && (Npix == 3 || Npix == 5 || Npix == 7)) {
+        Engine = std::string(" (SIMD, ") + SimdDescription() + ")";
+    }
+    printf ("CPU%s took %.3f msec\n",Engine.c_str(),Msec);
     printf ("Average msec per iteration for CPU = %.3f (threads = %d)\n",
                                                         Msec / float(Nrpt),Threads);
+    PassStats.Report("CPU iterations");
+    if (Bench && PassStats.Count() > 0) {
+        Bench->SetContext("Median","CPU","","");
+        std::string Test = "CPU " + std::to_string(Npix) + "x" + std::to_string(Npix) + Engine +
+                                                    " " + std::to_string(Threads) + " thread(s)";
+        Bench->AddRow(Test,Nx,Ny,PassStats);
+    }
+    if (Histogram) printf ("Histogram filter results are within %g of the median\n",
+                                                                               BinWidth * 0.5);
     bool FromGPU = false;
     if (Nrpt <= 0) {
         printf ("No values computed using CPU, as number of repeats set to zero.\n");
     } else {
-        NoteResults(OutputArray,FromGPU,Nx,Ny,Details);
+        
+        //  The histogram filter results are within half a bin width of the exact ones. The
+        //  check allows a whole bin width, to allow for rounding.
+        
+        //  NoteResults() can keep the result array rather than copy it.
+        
+        if (Histogram) Details->HistogramTolerance = BinWidth;
+        NoteResults(OutputArray,FromGPU,Nx,Ny,Details,&OutputArrayData);
     }
     printf ("\n");
 
@@ -720,62 +2823,119 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,MedianDetails*
     if (InputArrayData) free(InputArrayData);
 }
 
-//  ComputeRangeUsingCPU() performs the CPU median calculation over a range of lines of the
-//  image - specified by Iyst and Iyen (starting from 0) - but only once and using a single thread.
-
-void ComputeRangeUsingCPU(float** InputArray,int Nx,int Ny,int Iyst,
-                                   int Iyen,int Npix,float** OutputArray)
+//  The CPU code works through the image in tiles. A tile's boxes only use the rows and columns
+//  of the tile and the Npix/2 around it, so for a box of up to 11 by 11 the part of the image a
+//  tile needs is about 40 rows of 520 values - 80 KBytes or so - which stays in a typical L2
+//  cache while the tile is worked on, however wide the image is. Working along whole rows of a
+//  wide image, the Npix rows the boxes need can be too large for the cache, so each value has
+//  to be fetched from memory again for every row that uses it. (The sliding median has to fill
+//  its box again at the start of each row of a tile, but with tiles this wide that's only a
+//  few percent more work.)
+
+static const int C_CPUTileWidth = 512;
+static const int C_CPUTileRows = 32;
+
+//  ComputeTileUsingCPU() performs the CPU median calculation for a tile of the image - columns
+//  Ixst up to (not including) Ixen of rows Iyst up to Iyen, all starting from 0 - but only once
+//  and using a single thread. Input and Output are the image and result arrays, each Nx by Ny,
+//  with row Iy starting Iy * Nx values in. The box sizes with a selection network are fastest
+//  calculated pixel by pixel, which is done by NetworkMedianRow(), but for the others each row
+//  of the tile is filtered by SlidingMedianRow(), which updates the box as it moves along.
+//
+//  If the image has blank (NaN) pixels, which the networks can't leave out, BlankRows flags
+//  the rows that have any, and is otherwise null. SlidingMedianRow() always allows for them,
+//  but for NetworkMedianRow() each row of the tile checks the rows its boxes use, and the rows
+//  whose boxes include any blanks are done without the networks. The rows well away from any
+//  blanks still get the full speed of the networks. If Simd is set, NetworkMedianRow() runs
+//  the networks on blocks of pixels at once.
+
+void ComputeTileUsingCPU(const float* Input,int Nx,int Ny,int Ixst,int Ixen,int Iyst,int Iyen,
+                              int Npix,float* Output,const char* BlankRows,bool Simd)
 {
-    //  Forward definition of routine to calculate median for a specific array location, Ix,Iy.
+    //  Forward definitions of the routines to calculate the medians for part of a row.
     
-    float MedianElement(float** InputArray,int Nx,int Ny,int Ix,int Iy,int Npix);
+    void NetworkMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                     float* OutputRow,bool Blanks,bool Simd);
+    void SlidingMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                                           float* OutputRow);
 
+    bool Sliding = (Npix != 3 && Npix != 5 && Npix != 7);
+    int Npixby2 = Npix / 2;
     for (int Iy = Iyst; Iy < Iyen; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            OutputArray[Iy][Ix] = MedianElement(InputArray,Nx,Ny,Ix,Iy,Npix);
+        float* OutputRow = Output + size_t(Iy) * size_t(Nx);
+        if (Sliding) SlidingMedianRow(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+        else {
+            bool RowBlanks = false;
+            if (BlankRows) {
+                int Jy = std::max(0,Iy - Npixby2);
+                int Jyen = std::min(Ny,Iy + Npixby2 + 1);
+                for (; Jy < Jyen && !RowBlanks; Jy++) RowBlanks = BlankRows[Jy];
+            }
+            NetworkMedianRow(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow,RowBlanks,Simd);
         }
     }
 }
 
 //  OnePassUsingCPU() performs the CPU median calculation over the whole image, only once, using
 //  up to a specified number (Threads) of CPU threads. If Threads is zero, it uses the maximum
-//  available number of threads. It returns the number of threads actually used.
-
-int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray)
+//  available number of threads. It returns the number of threads actually used. If Histogram
+//  is set, it uses the histogram median filter, and returns the filter's bin width in BinWidth.
+//  Blanks is set if the image has blank (NaN) pixels, and Simd if the selection networks are
+//  to be run on blocks of pixels at once. InputArray and OutputArray are row addresses set up
+//  by CreateRowAddrs(), so the data for each starts at its first row.
+
+int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                          bool Histogram,bool Simd,bool Blanks,float* BinWidth)
 {
-    //  If we're only using one thread, do the calculation in the main thread, avoiding any
-    //  threading overheads.
+    //  The histogram filter divides the rows into bands between the threads itself.
     
-    if (Threads == 1) {
-        ComputeRangeUsingCPU(InputArray,Nx,Ny,0,Ny,Npix,OutputArray);
-    } else {
-        
-        //  If threading, create the specified number of threads, and divide the image rows
-        //  between them.
-        
-        std::thread ThreadList[Threads];
-        int Iy = 0;
-        int Iyinc = Ny / Threads;
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread] = std::thread (ComputeRangeUsingCPU,
-                                        InputArray,Nx,Ny,Iy,Iy+Iyinc,Npix,OutputArray);
-            Iy += Iyinc;
-        }
-        
-        //  Wait for all the threads to complete.
-        
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread].join();
-        }
-        
-        //  If there were rows left unhandled (because Ny was not a multiple of NThreads),
-        //  finish them off in the main thread.
-        
-        if (Iy < Ny) {
-            ComputeRangeUsingCPU(InputArray,Nx,Ny,Iy,Ny,Npix,OutputArray);
-        }
+    if (Histogram) {
+        HistogramMedian Filter(InputArray,Nx,Ny,Npix,Threads);
+        *BinWidth = Filter.BinWidth();
+        return Filter.Filter(OutputArray,Threads);
+    }
+    const float* Input = InputArray[0];
+    float* Output = OutputArray[0];
+    
+    //  If there are blanks, and the networks might be used, first note which rows have any.
+    //  That's a quick scan of the image, not a second pass through the boxes.
+    
+    bool Sliding = (Npix != 3 && Npix != 5 && Npix != 7);
+    std::vector<char> BlankRows;
+    if (Blanks && !Sliding) {
+        BlankRows.resize(Ny);
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = Input + size_t(Iy) * size_t(Nx);
+                int Found = 0;
+                for (int Ix = 0; Ix < Nx; Ix++) Found |= (Row[Ix] != Row[Ix]);
+                BlankRows[Iy] = Found;
+            }
+        },Threads);
     }
-    return Threads;
+    
+    //  The tiles are shared out between the threads of the shared pool, which are created once
+    //  and then reused for each pass, so creating threads isn't included in the timings. Rather
+    //  than giving each thread a fixed share, each takes the next tile as soon as it has
+    //  finished the last, so a thread with slower tiles - more blanks, say, or the edges of the
+    //  image - just does fewer of them, and all the threads finish at about the same time. (So
+    //  the range ParallelFor() gives each thread isn't used, only the number of threads.) If
+    //  only one thread is to be used, ParallelFor() just does the work in this thread.
+    
+    int TilesX = (Nx + C_CPUTileWidth - 1) / C_CPUTileWidth;
+    int TilesY = (Ny + C_CPUTileRows - 1) / C_CPUTileRows;
+    int Tiles = TilesX * TilesY;
+    std::atomic<int> NextTile(0);
+    const char* RowFlags = BlankRows.empty() ? nullptr : BlankRows.data();
+    return ThreadPool::Shared().ParallelFor(0,Tiles,[&](int,int) {
+        for (int Tile = NextTile++; Tile < Tiles; Tile = NextTile++) {
+            int Ixst = (Tile % TilesX) * C_CPUTileWidth;
+            int Iyst = (Tile / TilesX) * C_CPUTileRows;
+            int Ixen = std::min(Nx,Ixst + C_CPUTileWidth);
+            int Iyen = std::min(Ny,Iyst + C_CPUTileRows);
+            ComputeTileUsingCPU(Input,Nx,Ny,Ixst,Ixen,Iyst,Iyen,Npix,Output,RowFlags,Simd);
+        }
+    },Threads);
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -841,14 +3001,56 @@ float CalcMedian(float X[NPIXSQ_MAX], int len)
     return median;
 }
 
-float MedianElement(float** InputArray,int Nx,int Ny,int Ix,int Iy,int Npix)
+//  For the common box sizes - 3x3, 5x5 and 7x7 - a full box, one that doesn't run past the
+//  edge of the image, uses one of the branch-free selection networks in MedianNetworks.h
+//  instead of CalcMedian(), just as the GPU code does. BoxMedian() is instantiated for each
+//  of those sizes, so its loops have constant bounds and can be unrolled, and the network
+//  only indexes its work array with constants.
+
+#include "MedianNetworks.h"
+
+#define MEDIAN_SORT(a,b) { float t = std::min(w[a],w[b]); w[b] = std::max(w[a],w[b]); w[a] = t; }
+#define MEDIAN_MIN(a,b) { w[a] = std::min(w[a],w[b]); }
+#define MEDIAN_MAX(a,b) { w[b] = std::max(w[a],w[b]); }
+
+template <int W> float NetworkMedian(float* w);
+template <> inline float NetworkMedian<3>(float* w) { MEDIAN_NETWORK_9 return w[4]; }
+template <> inline float NetworkMedian<5>(float* w) { MEDIAN_NETWORK_25 return w[12]; }
+template <> inline float NetworkMedian<7>(float* w) { MEDIAN_NETWORK_49 return w[24]; }
+
+template <int W> float BoxMedian(const float* Input,int Nx,int Ix,int Iy)
+{
+    float w[W * W];
+    for (int j = 0; j < W; j++) {
+        const float* Row = Input + size_t(Iy + j - W / 2) * size_t(Nx) + Ix - W / 2;
+        for (int i = 0; i < W; i++) w[j * W + i] = Row[i];
+    }
+    return NetworkMedian<W>(w);
+}
+
+//  MedianElement() leaves blank (NaN) pixels out of the box, and returns a NaN if there are
+//  no valid pixels at all. If Blanks is set, the box may hold blanks, and the networks,
+//  which can't leave them out, aren't used. Like the other routines here, it is passed the
+//  start of the image data, whose rows are Nx values apart.
+
+float MedianElement(const float* Input,int Nx,int Ny,int Ix,int Iy,int Npix,bool Blanks = false)
 {
-    //  Fill a work array with the input array elements in a box Pix wide around the
-    //  target element. Allow for the edges of the image.
+    //  Use a selection network if there is one for this box size and the box is a full one.
     
     while (Npix * Npix > NPIXSQ_MAX) Npix--;
-    float work[NPIXSQ_MAX];
     int npixby2 = Npix / 2;
+    if (!Blanks && Ix >= npixby2 && Ix + npixby2 < Nx && Iy >= npixby2 && Iy + npixby2 < Ny) {
+        if (Npix == 3) return BoxMedian<3>(Input,Nx,Ix,Iy);
+        if (Npix == 5) return BoxMedian<5>(Input,Nx,Ix,Iy);
+        if (Npix == 7) return BoxMedian<7>(Input,Nx,Ix,Iy);
+    }
+    
+    //  Otherwise, fill a work array with the input array elements in a box Pix wide around the
+    //  target element. Allow for the edges of the image. Each value goes into the next free
+    //  element, which only moves on if the value isn't a NaN, so the valid values are packed
+    //  together without a branch.
+    
+    float work[NPIXSQ_MAX];
     int ixmin = Ix - npixby2;
     int ixmax = Ix + npixby2;
     int iymin = Iy - npixby2;
@@ -859,13 +3061,353 @@ float MedianElement(float** InputArray,int Nx,int Ny,int Ix,int Iy,int Npix)
     if (iymax >= Ny) iymax = Ny - 1;
     int ipix = 0;
     for (int yind = iymin; yind <= iymax; yind++) {
+        const float* Row = Input + size_t(yind) * size_t(Nx);
         for (int xind = ixmin; xind <= ixmax; xind++) {
-            work[ipix++] = InputArray[yind][xind];
+            float Value = Row[xind];
+            work[ipix] = Value;
+            ipix += (Value == Value);
         }
     }
+    if (ipix == 0) return NAN;
     return CalcMedian(work,ipix);
 }
 
+//  The code that handles the full boxes of a row a block of pixels at a time, for 'Simd'.
+//  See the SIMD median code section below.
+
+template <int W> void SimdMedianRun(const float* Input,int Nx,int Ixst,int Ixen,int Iy,
+                                                                            float* OutputRow);
+
+//  NetworkMedianRow() calculates the medians for columns Ixst up to (not including) Ixen of row
+//  Iy, written to OutputRow, for a box size with a selection network. The full boxes away from
+//  the edges of the image are handled by a loop that just calls BoxMedian(), with no checks or
+//  clamping, and only the boxes at the ends of the row - or all of them, for a row within
+//  Npix/2 of the top or bottom - go through MedianElement(). This is the same split the GPU
+//  code makes. If Blanks is set, the boxes for this row may hold blank pixels, and they all go
+//  through MedianElement(). If Simd is set, the full boxes are handled by SimdMedianRun()
+//  instead.
+
+void NetworkMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                      float* OutputRow,bool Blanks,bool Simd)
+{
+    if (Blanks) {
+        for (int Ix = Ixst; Ix < Ixen; Ix++) {
+            OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix,true);
+        }
+        return;
+    }
+    
+    //  Ixfull up to (not including) Ixfullen is the range of full boxes, if any.
+    
+    int npixby2 = Npix / 2;
+    int Ixfull = Ixen;
+    int Ixfullen = Ixen;
+    if (Iy >= npixby2 && Iy + npixby2 < Ny && Nx > 2 * npixby2) {
+        Ixfull = std::min(std::max(Ixst,npixby2),Ixen);
+        Ixfullen = std::max(Ixfull,std::min(Ixen,Nx - npixby2));
+    }
+    for (int Ix = Ixst; Ix < Ixfull; Ix++) {
+        OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix);
+    }
+    if (Simd && Npix == 3) {
+        SimdMedianRun<3>(Input,Nx,Ixfull,Ixfullen,Iy,OutputRow);
+    } else if (Simd && Npix == 5) {
+        SimdMedianRun<5>(Input,Nx,Ixfull,Ixfullen,Iy,OutputRow);
+    } else if (Simd && Npix == 7) {
+        SimdMedianRun<7>(Input,Nx,Ixfull,Ixfullen,Iy,OutputRow);
+    } else if (Npix == 3) {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) OutputRow[Ix] = BoxMedian<3>(Input,Nx,Ix,Iy);
+    } else if (Npix == 5) {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) OutputRow[Ix] = BoxMedian<5>(Input,Nx,Ix,Iy);
+    } else if (Npix == 7) {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) OutputRow[Ix] = BoxMedian<7>(Input,Nx,Ix,Iy);
+    } else {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) {
+            OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix);
+        }
+    }
+    for (int Ix = Ixfullen; Ix < Ixen; Ix++) {
+        OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix);
+    }
+}
+
+//  SlidingMedianRow() gives the same results as calling MedianElement() for each pixel from Ixst
+//  up to (not including) Ixen in row Iy, written to OutputRow, but it keeps the values in the
+//  box sorted, and as the box moves along the row it only has to remove the column that has
+//  left it and merge in the one that has entered it, instead of starting again for each pixel.
+//  (This is the idea behind Huang's running histogram median, but with the values themselves,
+//  so the result is exact.) Both are single passes through the sorted values, so this is much
+//  faster than CalcMedian() for the larger boxes, but the selection networks are faster still
+//  for the sizes they handle.
+//
+//  The work is done by SlidingMedianRowFor(), which is a template on the box size, W. For the
+//  sizes that come here - those without a selection network - up to 11, a row whose boxes are
+//  all W values high, at least W/2 rows from the top and bottom of the image, uses the version
+//  for that size, in which the number of values in each column, the number of columns kept,
+//  and so the loops that gather and sort each column, all have constant bounds, which the
+//  compiler can unroll. W of zero is the general version, which takes the size as Npix, and
+//  is used for the rows near the top and bottom and for any other size.
+
+//  The window is kept sorted in this order, which is the usual one except that NaNs come after
+//  everything else, so that they can be found again when they leave the box. Since they are
+//  all at the end, leaving them out of the median, as MedianElement() does, just means not
+//  counting them.
+
+static inline bool SortsBefore(float First,float Second)
+{
+    return First < Second || (Second != Second && First == First);
+}
+
+//  Sorts the Count values of a column of the box - never more than 11 - by insertion. If W is
+//  non-zero, Count is always W.
+
+template <int W> static void SortColumn(float* Values,int Count)
+{
+    if (W > 0) Count = W;
+    for (int I = 1; I < Count; I++) {
+        float Value = Values[I];
+        int J = I;
+        while (J > 0 && SortsBefore(Value,Values[J - 1])) {
+            Values[J] = Values[J - 1];
+            J--;
+        }
+        Values[J] = Value;
+    }
+}
+
+template <int W> void SlidingMedianRowFor(const float* Input,int Nx,int Ny,int Iy,int Npix,
+                                                      int Ixst,int Ixen,float* OutputRow)
+{
+    //  With W non-zero, these are all constants, since the caller has checked the row.
+    
+    if (W > 0) Npix = W;
+    while (Npix * Npix > NPIXSQ_MAX) Npix--;
+    int npixby2 = Npix / 2;
+    int iymin = (W > 0) ? Iy - W / 2 : std::max(0,Iy - npixby2);
+    int Rows = (W > 0) ? W : std::min(Ny - 1,Iy + npixby2) - iymin + 1;
+    
+    //  Window holds the values in the box, sorted, and Count is how many there are. Each
+    //  column is sorted as it enters the box, and kept in Columns until it leaves, in the
+    //  entry given by its X position modulo Npix, which the entering column then reuses.
+    
+    float Window[NPIXSQ_MAX];
+    float Columns[NPIXSQ_MAX];
+    int Count = 0;
+    int Blanks = 0;
+    
+    //  Adding a column merges it into the window, working back from the end so this can be
+    //  done in place. Removing one takes out the first value in the window matching each of
+    //  its values in turn, since both are sorted.
+    
+    auto AddColumn = [&](int xind) {
+        float* Column = Columns + (xind % Npix) * Rows;
+        for (int J = 0; J < Rows; J++) {
+            float Value = Input[size_t(iymin + J) * size_t(Nx) + xind];
+            Column[J] = Value;
+            Blanks += (Value != Value);
+        }
+        SortColumn<W>(Column,Rows);
+        int I = Count - 1;
+        int Out = Count + Rows - 1;
+        for (int J = Rows - 1; J >= 0; J--) {
+            while (I >= 0 && SortsBefore(Column[J],Window[I])) Window[Out--] = Window[I--];
+            Window[Out--] = Column[J];
+        }
+        Count += Rows;
+    };
+    auto RemoveColumn = [&](int xind) {
+        const float* Column = Columns + (xind % Npix) * Rows;
+        int Kept = 0;
+        int Next = 0;
+        for (int I = 0; I < Count; I++) {
+            if (Next < Rows && !SortsBefore(Window[I],Column[Next])) Next++;
+            else Window[Kept++] = Window[I];
+        }
+        for (int J = 0; J < Rows; J++) Blanks -= (Column[J] != Column[J]);
+        Count = Kept;
+    };
+    
+    //  The box for the first pixel needs columns up to Npix/2 either side of it.
+    
+    if (Ixst >= Ixen) return;
+    int xfirst = std::max(0,Ixst - npixby2);
+    int xlast = std::min(Nx - 1,Ixst + npixby2);
+    for (int xind = xfirst; xind <= xlast; xind++) AddColumn(xind);
+    for (int Ix = Ixst; Ix < Ixen; Ix++) {
+        if (Ix > Ixst) {
+            if (Ix - npixby2 - 1 >= 0) RemoveColumn(Ix - npixby2 - 1);
+            if (Ix + npixby2 < Nx) AddColumn(Ix + npixby2);
+        }
+        
+        //  As for CalcMedian(), an even number of values gives the average of the two
+        //  middle values. The NaNs at the end of the window aren't counted.
+        
+        int Valid = Count - Blanks;
+        int Cent = Valid / 2;
+        if (Valid == 0) OutputRow[Ix] = NAN;
+        else if (Valid % 2) OutputRow[Ix] = Window[Cent];
+        else OutputRow[Ix] = (Window[Cent] + Window[Cent - 1]) * 0.5;
+    }
+}
+
+//  SlidingMedianRow() picks the version of SlidingMedianRowFor() to use for a row.
+
+void SlidingMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                                            float* OutputRow)
+{
+    bool FullRow = (Iy >= Npix / 2 && Iy + Npix / 2 < Ny);
+    if (FullRow && Npix == 9) {
+        SlidingMedianRowFor<9>(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+    } else if (FullRow && Npix == 11) {
+        SlidingMedianRowFor<11>(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+    } else {
+        SlidingMedianRowFor<0>(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               S I M D  M e d i a n  c o d e
+//
+//  With 'Simd', the full boxes in a row are handled a block of L adjacent pixels at a time.
+//  Each value in the work array becomes a row of L values, one for each pixel in the block,
+//  and the network runs in a loop over the L pixels. The loop has no branches, and each
+//  iteration works on the next element of every row, so the compiler can vectorize it, with
+//  each vector register holding the same network value for a whole block of pixels, and each
+//  step of the network becoming a vector min and max. (This is sometimes called vertical
+//  SIMD - the lanes of a vector are different pixels, not different values in one box.) The
+//  remaining pixels at the end of the row, fewer than L of them, are just done one at a time.
+
+//  The instruction set for this code is chosen when the program runs, so one binary can use
+//  AVX2 or AVX-512 where the CPU has them. That needs GCC or Clang on x86, which can compile
+//  individual functions for a given target. Elsewhere - with MSVC, say, or on Apple silicon,
+//  where NEON is always available - it is compiled for the default target, with 8 lanes, which
+//  the compiler handles as pairs of 4-lane vector instructions. The routines called by the
+//  routines compiled for each target have to be inlined into them, or they would only be
+//  compiled for the default target.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MEDIAN_SIMD_DISPATCH
+#define MEDIAN_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define MEDIAN_SIMD_INLINE inline
+#endif
+
+//  The network steps, for lane l. These replace the definitions used above. (Running each
+//  step in its own loop over the lanes looks more like vector code, but then the compiler
+//  has to vectorize hundreds of tiny loops separately, and in practice it makes a poor job
+//  of it.)
+
+#undef MEDIAN_SORT
+#undef MEDIAN_MIN
+#undef MEDIAN_MAX
+
+#define MEDIAN_SORT(a,b) { \
+    float t = std::min(w[a][l],w[b][l]); w[b][l] = std::max(w[a][l],w[b][l]); w[a][l] = t; }
+#define MEDIAN_MIN(a,b) { w[a][l] = std::min(w[a][l],w[b][l]); }
+#define MEDIAN_MAX(a,b) { w[b][l] = std::max(w[a][l],w[b][l]); }
+
+//  SimdMedians() finds the medians of the W by W boxes for the L pixels starting at (Ix,Iy),
+//  all of which must be full boxes, and writes them to Output.
+
+template <int W,int L> MEDIAN_SIMD_INLINE void SimdMedians(const float* Input,int Nx,int Ix,
+                                                                        int Iy,float* Output)
+{
+    float w[W * W][L];
+    for (int j = 0; j < W; j++) {
+        for (int i = 0; i < W; i++) {
+            const float* Row = Input + size_t(Iy + j - W / 2) * size_t(Nx) + Ix + i - W / 2;
+            for (int l = 0; l < L; l++) w[j * W + i][l] = Row[l];
+        }
+    }
+    for (int l = 0; l < L; l++) {
+        if constexpr (W == 3) {
+            MEDIAN_NETWORK_9
+        } else if constexpr (W == 5) {
+            MEDIAN_NETWORK_25
+        } else {
+            MEDIAN_NETWORK_49
+        }
+    }
+    for (int l = 0; l < L; l++) Output[l] = w[W * W / 2][l];
+}
+
+//  Handles the full boxes from Ixst up to (not including) Ixen in row Iy, L pixels at a time.
+
+template <int W,int L> MEDIAN_SIMD_INLINE void SimdBlocks(const float* Input,int Nx,int Ixst,
+                                                            int Ixen,int Iy,float* OutputRow)
+{
+    int Ix = Ixst;
+    for (; Ix + L <= Ixen; Ix += L) SimdMedians<W,L>(Input,Nx,Ix,Iy,OutputRow + Ix);
+    for (; Ix < Ixen; Ix++) OutputRow[Ix] = BoxMedian<W>(Input,Nx,Ix,Iy);
+}
+
+//  The versions of SimdBlocks() compiled for each target. SimdLevel() returns the best one
+//  the CPU supports - 2 for AVX-512, 1 for AVX2, 0 for the default - checking just once.
+
+template <int W> void SimdBlocksDefault(const float* Input,int Nx,int Ixst,int Ixen,int Iy,
+                                                                             float* OutputRow)
+{
+    SimdBlocks<W,8>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
+#ifdef MEDIAN_SIMD_DISPATCH
+
+template <int W> __attribute__((target("avx2")))
+void SimdBlocksAVX2(const float* Input,int Nx,int Ixst,int Ixen,int Iy,float* OutputRow)
+{
+    SimdBlocks<W,8>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
+template <int W> __attribute__((target("avx512f")))
+void SimdBlocksAVX512(const float* Input,int Nx,int Ixst,int Ixen,int Iy,float* OutputRow)
+{
+    SimdBlocks<W,16>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
+#endif
+
+static int SimdLevel(void)
+{
+#ifdef MEDIAN_SIMD_DISPATCH
+    static const int Level = __builtin_cpu_supports("avx512f") ? 2 :
+                                                        (__builtin_cpu_supports("avx2") ? 1 : 0);
+    return Level;
+#else
+    return 0;
+#endif
+}
+
+//  Describes the SIMD code that will be used, for the timing report.
+
+const char* SimdDescription(void)
+{
+    int Level = SimdLevel();
+    if (Level == 2) return "AVX-512, 16 lanes";
+    if (Level == 1) return "AVX2, 8 lanes";
+    return "8 lanes";
+}
+
+//  SimdMedianRun() is what NetworkMedianRow() calls, for the full boxes from Ixst up to (not
+//  including) Ixen in row Iy, and it uses the best version of SimdBlocks() for the CPU.
+
+template <int W> void SimdMedianRun(const float* Input,int Nx,int Ixst,int Ixen,int Iy,
+                                                                             float* OutputRow)
+{
+#ifdef MEDIAN_SIMD_DISPATCH
+    int Level = SimdLevel();
+    if (Level == 2) {
+        SimdBlocksAVX512<W>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+        return;
+    }
+    if (Level == 1) {
+        SimdBlocksAVX2<W>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+        return;
+    }
+#endif
+    SimdBlocksDefault<W>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    S e t  I n p u t  A r r a y
@@ -883,17 +3425,39 @@ void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details)
     //  actual input array.
     
     if (Details->InputData) {
-        memcpy(InputArray[0],Details->InputData,Nx * Ny * sizeof(float));
+        memcpy(InputArray[0],Details->InputData,size_t(Nx) * size_t(Ny) * sizeof(float));
+    } else if (Details->RawData) {
+    
+        //  A 16-bit integer image read for 'Native' hasn't been scaled, so do that here, the
+        //  same way as the 'MedianInt16' kernels do, for anything else that needs the image.
+        
+        float Scale = Details->RawScale;
+        float Zero = Details->RawZero;
+        int Blank = Details->RawHasBlank ? Details->RawBlank : 0x10000;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const short* RawRow = Details->RawData + size_t(Iy) * size_t(Nx);
+                float* Row = InputArray[Iy];
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    float Value = fmaf(float(RawRow[Ix]),Scale,Zero);
+                    Row[Ix] = (RawRow[Ix] == Blank) ? NAN : Value;
+                }
+            }
+        });
     } else {
     
         //  Otherwise, we just make up some suitable values. The actual values don't matter
-        //  too much.
+        //  too much. For large images this takes a while, so the rows are shared out between
+        //  the threads in the shared pool.
         
-        for (int Iy = 0; Iy < Ny; Iy++) {
-            for (int Ix = 0; Ix < Nx; Ix++) {
-                InputArray[Iy][Ix] = float(Ny - Iy + Nx - Ix);
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                float* Row = InputArray[Iy];
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    Row[Ix] = float(Ny - Iy + Nx - Ix);
+                }
             }
-        }
+        });
     }
 }
 
@@ -902,7 +3466,7 @@ void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details)
 //                             W r i t e  F i t s  F i l e
 //
 //  This routine writes the calculated image (saved by a call to NoteResults()) to the output
-//  file created by ReadFitsFile() as its main image, replacing the original unfiltered image.
+//  file created by ReadFitsFile() as its main image, following the header copied from the input.
 
 bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details)
 {
@@ -950,6 +3514,161 @@ bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details)
     return (Status == 0);
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                                F i t s  W r i t e r
+//
+//  The implementation of the FitsWriter class declared at the start of this file.
+
+FitsWriter::FitsWriter(void)
+{
+    //  cfitsio can only be used by two threads at once if it was built to be reentrant. If it
+    //  wasn't, the files are just written as they are submitted.
+    
+    I_Background = fits_is_reentrant();
+    if (I_Background) I_Thread = std::thread(&FitsWriter::Run,this);
+}
+
+FitsWriter::~FitsWriter()
+{
+    Finish();
+}
+
+void FitsWriter::Submit(int Nx,int Ny,MedianDetails* Details)
+{
+    if (!I_Background) {
+        WriteFitsFile(Nx,Ny,Details);
+        Shutdown(Details);
+    } else {
+        std::unique_lock<std::mutex> Lock(I_Mutex);
+        I_Cond.wait(Lock,[this]{ return !I_Pending; });
+        I_Details = *Details;
+        I_Nx = Nx;
+        I_Ny = Ny;
+        I_Pending = true;
+        Lock.unlock();
+        I_Cond.notify_all();
+    }
+    *Details = MedianDetails();
+}
+
+void FitsWriter::Finish(void)
+{
+    if (I_Thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lock(I_Mutex);
+            I_Stop = true;
+        }
+        I_Cond.notify_all();
+        I_Thread.join();
+    }
+}
+
+//  The thread waits for a file to be submitted, and writes it. The file stays pending until it
+//  has been written and released, so Submit() can't overwrite it. When told to stop, it finishes
+//  any file still pending first.
+
+void FitsWriter::Run(void)
+{
+    std::unique_lock<std::mutex> Lock(I_Mutex);
+    for (;;) {
+        I_Cond.wait(Lock,[this]{ return I_Pending || I_Stop; });
+        if (!I_Pending) break;
+        Lock.unlock();
+        WriteFitsFile(I_Nx,I_Ny,&I_Details);
+        Shutdown(&I_Details);
+        Lock.lock();
+        I_Pending = false;
+        I_Cond.notify_all();
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                P a r s e  S c a l e s
+//
+//  Parses the value of the 'Scales' parameter, a list of box sizes separated by commas or
+//  spaces, eg "3,7,15". Each must be an odd number no larger than the GPU can handle, and
+//  there can be no more than C_MaxScales of them. Returns false, having reported the problem,
+//  if the list isn't valid.
+
+bool ParseScales(const std::string& Text,std::vector<int>* Scales)
+{
+    Scales->clear();
+    size_t Start = 0;
+    while (Start < Text.size()) {
+        size_t End = Text.find_first_of(", ",Start);
+        if (End == std::string::npos) End = Text.size();
+        std::string Entry = Text.substr(Start,End - Start);
+        Start = End + 1;
+        if (Entry == "") continue;
+        char* Rest = nullptr;
+        long Npix = strtol(Entry.c_str(),&Rest,10);
+        if (*Rest != '\0' || Npix < 1 || Npix > C_MaxGPUNpix || (Npix % 2) == 0) {
+            printf ("Invalid box size '%s' in 'Scales' - each should be an odd number "
+                                     "from 1 to %d.\n",Entry.c_str(),C_MaxGPUNpix);
+            return false;
+        }
+        Scales->push_back(int(Npix));
+    }
+    if (Scales->size() > size_t(C_MaxScales)) {
+        printf ("'Scales' can only list up to %d box sizes.\n",C_MaxScales);
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             E x p a n d  F i l e  L i s t
+//
+//  Expands the value of the 'Files' parameter into the list of files to filter. This can be a
+//  list of names separated by commas or spaces, and any name can use '*' as a wildcard in its
+//  final component, eg "data/night1/*.fits". The files matching each wildcard are listed in
+//  alphabetical order. Files whose names start with "Median_" are skipped by the wildcards, as
+//  they will be the results of earlier runs.
+
+std::vector<std::string> ExpandFileList(const std::string& Files)
+{
+    std::vector<std::string> FileList;
+    size_t Start = 0;
+    while (Start < Files.size()) {
+        size_t End = Files.find_first_of(", ",Start);
+        if (End == std::string::npos) End = Files.size();
+        std::string Entry = Files.substr(Start,End - Start);
+        Start = End + 1;
+        if (Entry == "") continue;
+        
+        //  Names without a wildcard are used as they are. If they don't exist, ReadFitsFile()
+        //  will say so.
+        
+        std::filesystem::path EntryPath(Entry);
+        std::string Pattern = EntryPath.filename().string();
+        if (Pattern.find('*') == std::string::npos) {
+            FileList.push_back(Entry);
+            continue;
+        }
+        
+        //  Otherwise, look through the directory for files that match.
+        
+        std::filesystem::path Directory = EntryPath.parent_path();
+        std::vector<std::string> Matches;
+        std::error_code ErrorCode;
+        std::filesystem::path Where = Directory.empty() ? std::filesystem::path(".") : Directory;
+        for (const auto& Item : std::filesystem::directory_iterator(Where,ErrorCode)) {
+            std::string Name = Item.path().filename().string();
+            if (Name.compare(0,7,"Median_") == 0) continue;
+            if (Item.is_regular_file(ErrorCode) && WildcardMatch(Pattern.c_str(),Name.c_str())) {
+                Matches.push_back((Directory / Name).string());
+            }
+        }
+        if (Matches.empty()) printf ("No files match '%s'\n",Entry.c_str());
+        std::sort(Matches.begin(),Matches.end());
+        FileList.insert(FileList.end(),Matches.begin(),Matches.end());
+    }
+    return FileList;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                              C r e a t e  R o w  A d d r s
@@ -979,7 +3698,47 @@ float** CreateRowAddrs(float* Array,int Nx,int Ny)
 //  allows the single routines that comprise the GPU and CPU code to release the arrays they
 //  create, which keeps things simpler.)
 
-bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details)
+//  HalfClose() is used when the GPU held the image in half precision. A median is one of the
+//  values in the box, and rounding doesn't change their order, so usually the GPU result is
+//  just the CPU result rounded. But if the box has an even number of pixels the median is the
+//  average of two rounded values, rounded again, which can be out by up to one and a half
+//  units in the last place of a half-precision value, so this allows for two. (Values too
+//  large for half precision end up as infinities, so those are accepted for anything out of
+//  range.)
+
+static bool HalfClose(float First,float Second)
+{
+    if (First == Second) return true;
+    float Magnitude = std::max(fabs(First),fabs(Second));
+    if (Magnitude > C_HalfMax) return fabs(First) >= C_HalfMax && fabs(Second) >= C_HalfMax;
+    uint16_t Half = FloatToHalf(Magnitude);
+    float Unit = HalfToFloat(uint16_t(Half + 1)) - HalfToFloat(Half);
+    return fabs(First - Second) <= 2.0 * Unit;
+}
+
+//  SameValue() is true if two results are equal, or both NaNs - the result for a box with only
+//  blank pixels. It has no branches, so the loop checking each row can still use vector code.
+
+static inline bool SameValue(float First,float Second)
+{
+    return (First == Second) | ((First != First) & (Second != Second));
+}
+
+//  ResultsMatch() compares a CPU and a GPU result. Normally they should be the same, but if
+//  the GPU held the image in half precision they only have to pass HalfClose(), and if the CPU
+//  used the histogram filter they only have to agree to within its tolerance. Any difference
+//  up to the one given by 'Tolerance' is also accepted.
+
+static bool ResultsMatch(float First,float Second,const MedianDetails* Details)
+{
+    if (SameValue(First,Second)) return true;
+    if (Details->GPUHalf && HalfClose(First,Second)) return true;
+    float Tolerance = std::max(Details->HistogramTolerance,Details->CheckTolerance);
+    return (Tolerance > 0.0 && fabs(First - Second) <= Tolerance);
+}
+
+bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details,
+                                                                              float** Owner)
 {
     bool AllOK = true;
     
@@ -991,7 +3750,10 @@ bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* D
     //  Save the data we're being passed. See if we already have the data from the other device
     //  (ie the GPU if this data is from the CPU, or vice-versa). We only need to save the data
     //  from the first device that calls this routine. The data from both should be the same,
-    //  after all, and we only need to save one of the two to be able to check this.
+    //  after all, and we only need to save one of the two to be able to check this. If the
+    //  caller passed Owner, the data is in a block it allocated with malloc() or PageAlloc(),
+    //  and rather than copy that, this takes it over and clears *Owner so the caller doesn't
+    //  release it. The second set of data is always compared where it is, without a copy.
     
     const char* ThisDevice = FromGPU ? "GPU" : "CPU";
     const char* OtherDevice = FromGPU ? "CPU" : "GPU";
@@ -999,10 +3761,17 @@ bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* D
     if (FromGPU) OtherData = Details->CPUOutputData;
     else OtherData = Details->GPUOutputData;
     if (OtherData == nullptr) {
-        TheDebugHandler.Logf("Checks","Saving %s data",ThisDevice);
-        int DataBytes = Nx * Ny * sizeof(float);
-        float* SavedData = (float*)malloc(DataBytes);
-        memcpy(SavedData,OutputArray[0],DataBytes);
+        float* SavedData = nullptr;
+        if (Owner && *Owner == OutputArray[0]) {
+            TheDebugHandler.Logf("Checks","Keeping %s data",ThisDevice);
+            SavedData = *Owner;
+            *Owner = nullptr;
+        } else {
+            TheDebugHandler.Logf("Checks","Saving %s data",ThisDevice);
+            size_t DataBytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+            SavedData = (float*)malloc(DataBytes);
+            memcpy(SavedData,OutputArray[0],DataBytes);
+        }
         if (FromGPU) Details->GPUOutputData = SavedData;
         else Details->CPUOutputData = SavedData;
     }
@@ -1010,30 +3779,112 @@ bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* D
     //  The code is checking two floating point values for equality, which is usually frowned
     //  upon, but in this case the values in question aren't being calculated (in which case
     //  rounding error might be a problem) but simply copied, so should be exactly the same.
+    //  The exceptions are if the GPU held the image in half precision, or the CPU used the
+    //  histogram filter, when the values can only be expected to agree to within the precision
+    //  of those, and any differences allowed by 'Tolerance' - see ResultsMatch().
+    //  For large images this check can take longer than the calculation, so the rows are
+    //  shared out between the threads in the shared pool. Each row is first checked with a loop
+    //  that just counts the values that don't match, with no branch, which the compiler can
+    //  turn into vector code. Rather than stop at the first bad value, every value is checked,
+    //  and the differences are summarised - how many values don't match, the largest difference
+    //  and where it is, and the mean difference. Where the values have to be equal, a row with
+    //  no bad values has no differences, so only the rows with bad values need the second loop
+    //  that measures them. (A blank pixel in only one of the results counts as an infinite
+    //  difference, but is left out of the mean.)
     
     if (OtherData) {
         TheDebugHandler.Logf ("Checks","Checking %s results against %s results",
                                                                   ThisDevice,OtherDevice);
         float** OtherArray = CreateRowAddrs(OtherData,Nx,Ny);
-        for (int Iy = 0; Iy < Ny; Iy++) {
-            for (int Ix = 0; Ix < Nx; Ix++) {
-                if (OutputArray[Iy][Ix] != OtherArray[Iy][Ix]) {
-                    if (DebugChecks) {
-                        TheDebugHandler.Logf("Checks","Error at [%d][%d] %8.1f (%s) != %8.1f (%s)",
-                              Iy,Ix,OutputArray[Iy][Ix],ThisDevice,OtherArray[Iy][Ix],OtherDevice);
-                    } else {
-                        printf ("Error at [%d][%d] %8.1f (%s) != %8.1f (%s)\n",
-                            Iy,Ix,OutputArray[Iy][Ix],ThisDevice,OtherArray[Iy][Ix],OtherDevice);
+        bool Approximate = Details->GPUHalf || Details->HistogramTolerance > 0.0 ||
+                                                             Details->CheckTolerance > 0.0;
+        std::mutex TotalsMutex;
+        long BadValues = 0;
+        double SumDiff = 0.0;
+        float MaxDiff = 0.0;
+        int MaxDiffRow = -1;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            long BandBad = 0;
+            double BandSum = 0.0;
+            float BandMax = 0.0;
+            int BandMaxRow = -1;
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = OutputArray[Iy];
+                const float* OtherRow = OtherArray[Iy];
+                int Bad = 0;
+                if (Approximate) {
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        Bad += !ResultsMatch(Row[Ix],OtherRow[Ix],Details);
+                    }
+                } else {
+                    for (int Ix = 0; Ix < Nx; Ix++) Bad += !SameValue(Row[Ix],OtherRow[Ix]);
+                }
+                BandBad += Bad;
+                if (Bad || Approximate) {
+                    float RowMax = 0.0;
+                    double RowSum = 0.0;
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        float Diff = fabsf(Row[Ix] - OtherRow[Ix]);
+                        if (SameValue(Row[Ix],OtherRow[Ix])) Diff = 0.0;
+                        else if (Diff != Diff) Diff = INFINITY;
+                        if (Diff < INFINITY) RowSum += Diff;
+                        if (Diff > RowMax) RowMax = Diff;
                     }
-                    AllOK = false;
-                    break;
+                    BandSum += RowSum;
+                    if (RowMax > BandMax) {
+                        BandMax = RowMax;
+                        BandMaxRow = Iy;
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> Lock(TotalsMutex);
+            BadValues += BandBad;
+            SumDiff += BandSum;
+            if (BandMax > MaxDiff) {
+                MaxDiff = BandMax;
+                MaxDiffRow = BandMaxRow;
+            }
+        });
+        
+        //  Find where in its row the largest difference is.
+        
+        int MaxDiffCol = 0;
+        if (MaxDiffRow >= 0) {
+            float Largest = 0.0;
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                float Diff = fabsf(OutputArray[MaxDiffRow][Ix] - OtherArray[MaxDiffRow][Ix]);
+                if (SameValue(OutputArray[MaxDiffRow][Ix],OtherArray[MaxDiffRow][Ix])) {
+                    Diff = 0.0;
+                } else if (Diff != Diff) {
+                    Diff = INFINITY;
+                }
+                if (Diff > Largest) {
+                    Largest = Diff;
+                    MaxDiffCol = Ix;
                 }
             }
-            if (!AllOK) break;
         }
-        if (AllOK) {
-            if (DebugChecks) TheDebugHandler.Log("Checks","Data from CPU and GPU match OK");
-            else printf ("Data from CPU and GPU match OK\n");
+        double MeanDiff = SumDiff / (double(Nx) * double(Ny));
+        char Summary[256];
+        if (MaxDiffRow >= 0) {
+            snprintf (Summary,sizeof(Summary),"largest difference %g at [%d][%d] "
+                    "%8.1f (%s) v %8.1f (%s), mean difference %g",MaxDiff,MaxDiffRow,
+                    MaxDiffCol,OutputArray[MaxDiffRow][MaxDiffCol],ThisDevice,
+                    OtherArray[MaxDiffRow][MaxDiffCol],OtherDevice,MeanDiff);
+        }
+        if (BadValues > 0) {
+            AllOK = false;
+            if (DebugChecks) {
+                TheDebugHandler.Logf("Checks","Error: %ld values differ, %s",BadValues,Summary);
+            } else {
+                printf ("Error: %ld values differ, %s\n",BadValues,Summary);
+            }
+        } else if (DebugChecks) {
+            TheDebugHandler.Log("Checks","Data from CPU and GPU match OK");
+            if (MaxDiffRow >= 0) TheDebugHandler.Logf("Checks","Within tolerance, %s",Summary);
+        } else {
+            printf ("Data from CPU and GPU match OK\n");
+            if (MaxDiffRow >= 0) printf ("Within tolerance, %s\n",Summary);
         }
         free (OtherArray);
     }
@@ -1050,7 +3901,8 @@ void Shutdown(MedianDetails* Details)
 {
     int Status = 0;
     if (Details->Fptr) fits_close_file(Details->Fptr,&Status);
-    if (Details->InputData) free(Details->InputData);
+    if (Details->InputData && Details->OwnsInputData) free(Details->InputData);
+    if (Details->RawData) free(Details->RawData);
     if (Details->GPUOutputData) free(Details->GPUOutputData);
     if (Details->CPUOutputData) free(Details->CPUOutputData);
 }
@@ -0,0 +1,43 @@
+//
+//                           P a g e  M e m o r y . h
+//
+//  Page aligned memory allocation. Metal can wrap memory the program has allocated itself as
+//  a buffer, without copying it, using the newBufferWithBytesNoCopy variant of the device's
+//  newBuffer() call, so long as the memory starts on a page boundary and is a whole number of
+//  pages long. On machines with unified memory the GPU then works on the program's own arrays,
+//  and arrays that would otherwise have to be copied into or out of a separate buffer - an
+//  image read from a file, or the results the program wants to keep - can simply be shared.
+//
+//  PageAlloc() returns a block of at least Bytes, page aligned and rounded up to a whole number
+//  of pages, or nullptr if it can't be allocated. It is released with free() in the usual way,
+//  but not before any buffer wrapping it has been released. PageRound() returns the size the
+//  block actually has, which is the length to give newBuffer().
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __PageMemory__
+#define __PageMemory__
+
+#include <stdlib.h>
+#include <unistd.h>
+
+//  PageRound() returns Bytes rounded up to a whole number of pages.
+
+static inline size_t PageRound(size_t Bytes)
+{
+    size_t Page = size_t(sysconf(_SC_PAGE_SIZE));
+    return (Bytes + Page - 1) & ~(Page - 1);
+}
+
+//  PageAlloc() returns page aligned memory for at least Bytes, rounded up to whole pages.
+
+static inline void* PageAlloc(size_t Bytes)
+{
+    void* Memory = nullptr;
+    if (posix_memalign(&Memory,size_t(sysconf(_SC_PAGE_SIZE)),PageRound(Bytes)) != 0) {
+        Memory = nullptr;
+    }
+    return Memory;
+}
+
+#endif
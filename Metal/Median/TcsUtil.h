@@ -33,6 +33,9 @@
 //                     arguments supporting quoted strings and end-of-line
 //                     comments. KS.
 //      4th Jun 2007.  Added C++ string version of ExpandFileName(). KS.
+//     15th Oct 2026.  Added InvariantTSC(). KS.
+//                     Added ReadSocketDataV(), WriteSocketDataV() and the
+//                     SocketSegment structure they use. KS.
 //
 //  RCS id:
 //     "@(#) $Id: ACMM:HectorConfigUtility/TcsUtil.h,v 1.2+ 20-Nov-2020 13:47:31+11 ks $"
@@ -47,6 +50,8 @@
 #include <string>
 #include <vector>
 
+#include <stddef.h>
+
 //!  TcsUtil is a class containing an unrelated collection of utility routines.
 
 /*!  The TcsUtil class is a repository for a collection of unrelated routines
@@ -60,6 +65,11 @@
   
 class TcsUtil {
 public:
+   //!  One of the buffers read or written by Read/WriteSocketDataV().
+   struct SocketSegment {
+      void* Buffer;                     // Start of the buffer.
+      size_t Bytes;                     // Bytes to read into, or write from, it.
+   };
    //!  Format the latest errno value into a string.
    static std::string GetErrnoText (void);
    //!  Format an unsigned integer into a string.
@@ -78,8 +88,16 @@ public:
    //!  Write to a socket, allowing for transient errors.
    static int WriteSocketData (int SocketFd,const char* Buffer,
                                    unsigned int Bytes, std::string& ErrorText);
+   //!  Read from a socket into a set of separate buffers, in one go.
+   static long ReadSocketDataV (int SocketFd,const SocketSegment* Segments,
+            int Count,unsigned int TimeoutMsec, std::string& ErrorText);
+   //!  Write to a socket from a set of separate buffers, in one go.
+   static long WriteSocketDataV (int SocketFd,const SocketSegment* Segments,
+                                   int Count, std::string& ErrorText);
    //!  Return the current Time Stamp Counter (or a suitable emulation).  
    static unsigned long long ReadTSC (void);
+   //!  Return true if the Time Stamp Counter ticks at a constant rate.
+   static bool InvariantTSC (void);
    //!  Expand a file name that contains environment variable names.      
    static bool ExpandFileName (const std::string& Name, 
                                              std::string& ExpandedName);
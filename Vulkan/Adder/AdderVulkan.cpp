@@ -45,7 +45,149 @@
 //
 //     Debug must be specified explicitly by name, eg Debug = "timing". The '=' is optional.
 //     There are a number of different options for Debug. If you are prompted for the value
-//     of Debug and reply with '?' a list of the options will be provided.
+//     of Debug and reply with '?' a list of the options will be provided. 'Profile' has the
+//     CPU code time the range of rows each thread handles, using the time stamp counter, and
+//     report the time per row. 'Startup' lists how long each stage of the program's start-up
+//     took - creating the Vulkan instance and device, reading the shader, creating buffers,
+//     descriptors and pipeline - once the GPU is ready to run.
+//
+//     Padding  has the GPU code pick the workgroup shape, with the usual number of threads,
+//              that launches fewest invocations for the size of the arrays - a dispatch runs
+//              whole workgroups, and those past the edges of the arrays do nothing - and count
+//              the invocations each pass actually runs, using a pipeline statistics query, to
+//              report how many were only padding. 'Autotune' still picks the shape if given,
+//              but the invocations are counted. Default false.
+//
+//     Vec4     has the GPU use a version of the shader (Adder4.comp) in which each thread
+//              handles four elements, using vec4 loads and stores, rather than one. The GPU
+//              timings include the memory bandwidth achieved, to compare the two.
+//
+//     Roofline has the program measure the peak memory bandwidth of the GPU and of the CPU,
+//              using simple copy tests, and report the bandwidth achieved by each as a
+//              percentage of that peak as well. Since the adder operation does almost nothing
+//              but read and write memory, this shows how close each comes to what the hardware
+//              can really do, and so whether a slowdown is in the code or in the platform.
+//
+//     Sweep    has the GPU version time every combination of buffer access modes for the
+//              input and output arrays, for a range of array sizes up to Nx by Ny, all using
+//              the same device, and print a table of the setup, sync and compute times. This
+//              is a quick way to find which modes suit a particular GPU.
+//
+//     Stream   has the GPU process the arrays in tiles of rows, so they can be much larger
+//              than will fit in GPU memory. (Otherwise each array has to fit in one buffer.)
+//     TileRows is the number of rows in each tile when streaming. If zero, the default, the
+//              program picks a size that keeps each tile comfortably within device limits.
+//              'Autotune' and 'Batch' are ignored when streaming.
+//
+//     Queues   has the GPU version split the arrays into bands of rows, one for each of up to
+//              this many queues from the device's compute queue family, and submit each band to
+//              its own queue from a separate CPU thread. It does this for each number of queues
+//              from one up to that many (or as many as the family has), and lists the time and
+//              bandwidth for each, with the speedup over using one queue. This shows whether
+//              the GPU gains from concurrent submission. Default 0, which doesn't do this.
+//
+//     Simd     selects the vector instructions used by the CPU code - one of "Auto" (the
+//              default), "Scalar", "AVX2", "AVX512" or "NEON". "Auto" uses the best that the
+//              CPU supports. Asking for one the CPU doesn't support gets a warning, and "Auto".
+//
+//     Ops      replaces the adder operation with a chain of element-wise operations, all done
+//              in one pass over the arrays, eg Ops = "scale=2,offset=-1,clip=0:5000,gradient=1:1".
+//              The operations are scale=<factor>, offset=<value>, clip=<low>:<high> and
+//              gradient=<per column>:<per row>, applied in the order given. (The adder operation
+//              itself is just "gradient=1:1".) On the GPU this uses Elementwise.comp, with the
+//              chain built into the pipeline - see ElementwiseChain.h. 'Vec4' and 'Autotune' are
+//              ignored with 'Ops', and 'Ops' is ignored when streaming or sweeping.
+//
+//     InPlace  has the operation update the input array in place, rather than writing to a
+//              separate output array. On the GPU this uses a version of the shader
+//              (AdderInPlace.comp) with just the one buffer, which halves the GPU memory needed.
+//              Since the array is updated in place, each repeat adds to the result of the last,
+//              and the results are checked allowing for that. 'Vec4', 'Autotune' and 'Ops' are
+//              ignored with 'InPlace', and 'InPlace' is ignored when streaming or sweeping.
+//
+//     Half     has the GPU hold the arrays in half precision (Adder16.comp), so only two bytes
+//              are read and written for each element. The input is converted to half precision
+//              as it is loaded into the GPU, and the results are converted back as they are read,
+//              and the times for the conversions are reported separately. This needs the GPU
+//              to support 16-bit storage - if it doesn't, 'Half' is ignored. The arrays have to
+//              be small enough for their values to fit in half precision, and the results are
+//              checked against values rounded to half precision. 'Half' only affects the GPU.
+//              'Ops', 'InPlace', 'Vec4', 'Autotune' and 'Batch' are ignored with 'Half'.
+//
+//     Trace    is the name of a file to which a timeline of the run is written, in the Chrome
+//              trace format, so it can be viewed using chrome://tracing or Perfetto. It shows
+//              the setup, each pass and each submission to the GPU, the Vulkan Framework calls
+//              made, and the kernel times measured by the GPU. Default "", for no trace.
+//
+//     Pin      controls the CPUs the CPU threads run on, which can make CPU timings more
+//              repeatable. It can be "None", the default, which leaves it to the system,
+//              "PCores", which only uses the performance cores, "Physical", which uses one
+//              logical CPU of each physical core, or "Numa", which only uses the CPUs on the
+//              same NUMA node as the main thread. If Threads is zero, or more than the number
+//              of CPUs selected, one thread is used for each of them.
+//
+//     Priority raises the priority of the CPU threads. On Linux this needs permission to
+//              use real-time scheduling. The CPU topology and the placement used are listed
+//              if either 'Pin' or 'Priority' is given.
+//
+//     GpuCheck checks the results of the GPU calculation on the GPU, rather than have the CPU
+//              work through the output array. Only the number of bad values, the largest
+//              difference and the first bad value are read back. 'GpuCheck' is ignored with
+//              'InPlace' and 'Ops'. Default false.
+//
+//     Vary     runs the tests for every combination of a set of values for Nx, Ny and Threads,
+//              all in the one run, eg Vary = "Nx=1024:16384:x2 Ny=1024,4096 Threads=1,2,4". Each
+//              parameter has a list of values, any of which can be a range Start:End:Step, where
+//              the Step is added, or as xN multiplies. The GPU device is set up once and used for
+//              all of them, with the buffers released after each so their memory can be reused.
+//              'Sizes' is ignored with 'Vary'. Default "", for just the one combination.
+//              Spin can also be varied, eg Vary = "Nx=256:4096:x2 Spin=0,20,100".
+//
+//     Spin     is the time, in microseconds, for which the GPU code polls for each submission
+//              to complete before blocking until it does. Waking a blocked thread can take
+//              tens of microseconds, which matters for small arrays. Polling keeps a CPU core
+//              busy instead. The time taken by the waits is listed, so the two can be compared,
+//              and a non-zero Spin is included in the test name in any 'Report'. Only the
+//              ordinary GPU code polls - not 'Half', 'Sweep' or 'Stream'. Default 0, which
+//              blocks at once.
+//
+//     Auto     runs each size on whichever of the CPU and the GPU is faster for it, rather than
+//              on the one chosen by 'Cpu' and 'Gpu', which are ignored. The crossover - the
+//              smallest number of elements for which the GPU is faster - is found by timing
+//              both on a range of square arrays the first time it's needed, and is saved in the
+//              file AdderCrossover.txt in the current directory, so later runs can use it at
+//              once. The crossover is kept for each combination of GPU, driver, GPU kernel and
+//              CPU threads and vector code, and deleting the file forces a new calibration.
+//              'Auto' is ignored with 'Half', 'Sweep', 'Stream' and 'Queues'. Default false.
+//
+//     Backend  runs the GPU code through a VulkanBackend, using the backend-neutral code in
+//              BackendAdder.h that the Metal version of Adder also uses with its own backend,
+//              instead of the Vulkan code here. This is the simplest form of the GPU loop, with
+//              the arrays in single precision and one pass at a time, so the options that
+//              change the GPU code - 'Half', 'Sweep', 'Stream', 'Batch', 'Vec4' and so on - are
+//              ignored. Default false.
+//
+//     HugePages backs the CPU arrays with huge pages - usually 2 MBytes rather than 4 KBytes -
+//              where the system will provide them, which cuts the TLB misses in a pass through
+//              a large array. If both the GPU and CPU are used, the input array they share is
+//              allocated this way too, and the GPU imports it as before. How much of each array
+//              actually ended up in huge pages is reported, since the system can decline.
+//              Default false.
+//
+//     Counters counts the cycles, instructions, last level cache misses and branch misses
+//              for the timed CPU passes, leaving out the warm-up passes, using the Linux
+//              perf_event hardware counters, and reports the instructions per cycle and the
+//              misses for each element, which show whether the CPU code is limited by memory,
+//              by branches or by the arithmetic. These are added to any 'Report' file. Only
+//              available on Linux, where the kernel allows it. Default false.
+//
+//     Settle   is the longest time, in msec, for which the GPU code runs the kernel before
+//              the timed passes, until the times of the last few passes settle down - so the
+//              GPU has raised its clocks from idle and the driver has done any work it leaves
+//              until the first submissions. The number of passes this took, and how much the
+//              times spread, are reported, and they count as warm-up passes in any 'Report'
+//              file, which also gives the spread of the timed passes. Ignored with 'InPlace',
+//              since the extra passes would change the results. Default 0, no settling.
 //
 //     The command line is processed by the flexible but possibly quirky command line handler
 //     used for all these GPU examples. With luck you'll get used to it. It also supports the
@@ -104,6 +246,83 @@
 //                     GPU code still makes them shared, but this makes the code work if the
 //                     setup code is modified experimentally to make them staged. KS.
 //      21st Oct 2024. Added programming note about command buffer re-use. KS.
+//      14th Oct 2026. The syncs for staged buffers are now recorded into the compute command
+//                     buffer itself, so each iteration needs only one submission. KS.
+//                     The workgroup size is now passed to the shader as specialization
+//                     constants, and can be chosen by timing candidates with 'Autotune'. KS.
+//                     The GPU time spent in the shader itself is now measured using GPU
+//                     timestamps and reported along with the overall time. KS.
+//                     Added 'Batch', which records all the repeats into a single command
+//                     buffer so they go to the GPU as one submission. KS.
+//                     The command buffer is now marked as reusable, so it is only recorded
+//                     once rather than on each iteration. KS.
+//                     The output buffer is now a "READBACK" buffer, so it uses cached memory
+//                     where the device has it. KS.
+//                     The CPU code now has AVX2, AVX-512 and NEON versions of the inner loop,
+//                     chosen at run time according to what the CPU supports, or using the new
+//                     'Simd' parameter. The version used is included in the CPU timing report. KS.
+//                     The CPU code now uses a pool of threads created once, shared by all the
+//                     passes, instead of creating new threads for each pass. KS.
+//                     Added 'Stream' and 'TileRows', which process the arrays on the GPU in
+//                     tiles of rows, double-buffered, so that the arrays can be larger than
+//                     GPU memory. The shader is now passed a row offset for this. KS.
+//                     Added 'Vec4', which uses a vectorised shader, Adder4.comp, and the GPU
+//                     timing now includes the memory bandwidth achieved. KS.
+//                     The CPU timing now includes the bandwidth achieved, and 'Roofline' has
+//                     both reported as a percentage of a measured peak. KS.
+//                     Added 'Sweep', which times all the buffer access mode combinations. KS.
+//                     SetInputArray() and the result checks now run in the shared thread pool,
+//                     with loops that compile to vector code, and stop at the first bad row. KS.
+//                     Added 'Ops', which runs a chain of element-wise operations in one pass,
+//                     using the new ElementwiseChain code and Elementwise.comp shader. KS.
+//                     Added 'InPlace', which updates the array in place, in one GPU buffer. KS.
+//                     Added 'Half', which keeps the arrays on the GPU in half precision, using
+//                     the new Adder16.comp shader, if the device supports 16-bit storage. KS.
+//      15th Oct 2026. The time for each pass of the GPU and CPU loops is now collected in an
+//                     MsecStats, and the distribution of the times reported. With 'Batch', a
+//                     pass is the single submission of all the repeats. KS.
+//                     Added 'Warmup', 'Sizes' and 'Report', which use the new BenchReport to
+//                     run the tests over a list of sizes and append the timings, leaving out
+//                     the first passes, to a CSV or JSON file. KS.
+//                     The 'Timing' debug calls in the loops now test a bit looked up once. KS.
+//                     Added 'Trace', which writes a timeline of the run using the new
+//                     TraceRecorder. KS.
+//                     Added the 'Profile' debug level, which times each range of rows handled
+//                     by the CPU code using the new CycleTimer. KS.
+//                     Added 'Pin' and 'Priority', which use the new ThreadPlacement to pin
+//                     the CPU threads to chosen CPUs and raise their priority. KS.
+//                     Added the 'Startup' debug level, which lists the start-up stages
+//                     recorded by the new StartupProfile. KS.
+//                     ComputeUsingGPUHalf() now uses the new KVComputeKernel, and passes its
+//                     arguments to Adder16.comp as push constants. KS.
+//                     If both the GPU and CPU are used, the input array is now set up once,
+//                     in importable memory, and both work from it. KS.
+//                     Array and buffer sizes are now VkDeviceSize or size_t, so they no longer
+//                     overflow for arrays over 2 GBytes, and ComputeUsingGPU() checks the
+//                     arrays against the device's largest storage buffer, pointing to
+//                     'Stream' for arrays larger than that. KS.
+//                     Added 'GpuCheck', which checks the GPU results on the GPU itself, using
+//                     the new AdderCheck.comp, and reads back only a summary. KS.
+//                     Added 'Vary', which runs every combination of values for Nx, Ny and
+//                     Threads, using the one GPU device for all of them. KS.
+//                     Added 'Spin', which has the GPU waits poll before blocking, and lists
+//                     the time the waits took. It can be varied with 'Vary'. KS.
+//                     Added 'Auto', which runs each size on the faster of the CPU and GPU,
+//                     using a crossover size found by CalibrateCrossover() and kept in a
+//                     file by ReadCrossover() and WriteCrossover(). KS.
+//                     Added 'Backend', which runs the GPU code written once, in BackendAdder.h,
+//                     against the new ComputeBackend interface, using a VulkanBackend. KS.
+//                     Added 'Queues', which times the GPU code split over a number of compute
+//                     queues, submitted to from separate threads. KS.
+//                     Added 'Padding', which uses the least padded workgroup shape and reports
+//                     the shader invocations counted by a pipeline statistics query. KS.
+//                     Added 'HugePages', which allocates the CPU arrays using the new HugePages,
+//                     and AllocateArray() and FreeArray(). KS.
+//                     ComputeUsingGPU() has the input buffer put into device-local memory the
+//                     CPU can see, if there is any, when the CPU won't read it back. KS.
+//                     Added 'Counters', which counts the CPU passes using PerfCounters. KS.
+//                     Added 'Settle', which runs the GPU kernel until its times settle down,
+//                     using the new MsecSettle, before the timed passes. KS.
 
 //  ------------------------------------------------------------------------------------------------
 //
@@ -112,34 +331,121 @@
 //  Needed to allow multi-threading of the CPU code
 
 #include <thread>
+#include <atomic>
+
+//  Needed for fabs(), used when checking the results of the in place operation.
+
+#include <math.h>
 
 //  Some utility code. A Command Handler provides a flexible way of handling command line
 //  parameters, and simplifies the coding required for this. An MsecTimer provides a very simple
 //  way of timing blocks of code. A Debug Handler provides control over debug output, allowing
-//  various debug levels to be enabled from the command line.
+//  various debug levels to be enabled from the command line. An ElementwiseChain describes a
+//  sequence of element-wise operations that can be run in a single pass, used for 'Ops', and
+//  HalfFloat.h has the conversions to and from half precision used for 'Half'. A BenchReport
+//  collects the timings to be written out for 'Report', and the TraceRecorder records the
+//  timeline written out for 'Trace'. A CycleProfile times the CPU code for 'Profile', a
+//  ThreadPlacement pins the CPU threads for 'Pin', the StartupProfile records the start-up
+//  stages listed for 'Startup', and HugePages allocates the arrays for 'HugePages'.
 
 #include "CommandHandler.h"
 #include "MsecTimer.h"
+#include "BenchReport.h"
+#include "TraceRecorder.h"
+#include "CycleTimer.h"
+#include "ThreadPool.h"
+#include "ThreadPlacement.h"
+#include "StartupProfile.h"
+#include "HugePages.h"
+#include "PerfCounters.h"
 #include "DebugHandler.h"
+#include "ElementwiseChain.h"
+#include "HalfFloat.h"
 
 //  This provides a global Debug Handler that all the routines here can use.
 
 DebugHandler TheDebugHandler;
 
+//  The bits for its 'Timing' and 'Profile' levels, set once the level names are known. The
+//  debug calls made on each pass of a timing loop test just these bits, rather than looking the
+//  levels up by name.
+
+DebugHandler::LevelBits TimingDebug = 0;
+DebugHandler::LevelBits ProfileDebug = 0;
+
+//  Set by 'HugePages', to have AllocateArray() use huge pages for the CPU arrays.
+
+bool UseHugePages = false;
+
+//  Set by 'Counters', to have ComputeUsingCPU() count the CPU passes with PerfCounters.
+
+bool UseCounters = false;
+
+//  Set by 'Settle', the most time ComputeUsingGPU() spends waiting for the times of the GPU
+//  passes to settle before it starts timing them - zero if it doesn't.
+
+int SettleMsec = 0;
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                             F o r w a r d  D e f i n i t i o n s
 
 //  Perform the basic opetation using the GPU
-void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& DebugLevels);
+void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,bool Autotune,bool Batch,bool Vec4,
+        bool Roofline,bool InPlace,const ElementwiseChain& Chain,const std::string& DebugLevels,
+         int Warmup,bool GpuCheck,int Spin,bool Padding,BenchReport& Bench,
+                               float* SharedInput = nullptr,KVVulkanFramework* Warm = nullptr);
+//  Perform the basic operation on the GPU, with the arrays held there in half precision
+bool ComputeUsingGPUHalf(int Nx,int Ny,int Nrpt,bool Validate,bool Roofline,
+                                                                const std::string& DebugLevels);
+//  Perform the basic operation using the GPU, through the backend-neutral code
+void ComputeUsingVulkanBackend(int Nx,int Ny,int Nrpt,bool Validate,
+                               const std::string& DebugLevels,int Warmup,BenchReport& Bench);
+//  Perform the basic operation on the GPU, streaming the arrays through it in tiles of rows
+void ComputeUsingGPUStreamed(int Nx,int Ny,int Nrpt,int TileRows,bool Validate,
+                                   bool Vec4,bool Roofline,const std::string& DebugLevels);
+//  Time all the combinations of buffer access modes, over a range of sizes
+void ComputeUsingGPUQueues(int Nx,int Ny,int Nrpt,int MaxQueues,bool Validate,bool Vec4,
+                                                               const std::string& DebugLevels);
+void SweepBufferModes(int Nx,int Ny,int Nrpt,bool Validate,const std::string& DebugLevels);
+//  Report the memory bandwidth achieved, and optionally as a percentage of the peak
+void ReportBandwidth(const char* Device,const char* What,int Nx,int Ny,int Nrpt,float Msec,
+                                           double PeakGBytes,int ValueBytes = sizeof(float));
+//  Measure the peak memory bandwidth of the CPU using a simple copy
+double MeasureCPUBandwidth(int Threads);
 //  Perform the basic operation using the CPU
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt);
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt,const std::string& Simd,
+            bool Roofline,bool InPlace,const ElementwiseChain& Chain,int Warmup,BenchReport& Bench,
+                                                                float* SharedInput = nullptr);
 //  Set initial values for the input array.
 void SetInputArray(float** InputArray,int Nx,int Ny);
 //  Check the results of the operation
 bool CheckResults(float** InputArray,int Nx,int Ny,float** OutputArray);
+//  Check the results of a chain of element-wise operations
+bool CheckChainResults(const ElementwiseChain& Chain,float** InputArray,int Nx,int Ny,
+                                                                          float** OutputArray);
+//  Check the results of the operation performed with the arrays in half precision
+bool CheckHalfResults(float** InputArray,int Nx,int Ny,float** OutputArray);
+//  Check the results of the operation performed in place a number of times
+bool CheckInPlaceResults(float** Array,int Nx,int Ny,int Passes);
 //  Utility to set up an array of row addresses to allow use of Array[Iy][Ix] syntax for access.
 float** CreateRowAddrs(float* Array,int Nx,int Ny);
+//  Allocate the data for a CPU array, in huge pages with 'HugePages', and release it
+void* AllocateArray(size_t Bytes);
+void FreeArray(void* Address);
+//  Mark the end of start-up, and list its stages if 'Startup' debugging is enabled
+void EndOfStartup(void);
+//  Describe the GPU kernel and CPU code used, as the key for a saved crossover
+std::string CrossoverKey(KVVulkanFramework& Framework,bool Batch,bool Vec4,bool InPlace,
+                     const ElementwiseChain& Chain,int Threads,const std::string& Simd);
+//  Find the smallest number of elements for which the GPU is faster than the CPU
+long CalibrateCrossover(KVVulkanFramework* Warm,bool Validate,bool Autotune,bool Batch,
+              bool Vec4,bool InPlace,const ElementwiseChain& Chain,const std::string& DebugLevels,
+                                       int Spin,int Threads,const std::string& Simd);
+//  Read a crossover saved by an earlier run, returning false if there isn't one
+bool ReadCrossover(const std::string& Key,long* Crossover);
+//  Save a crossover for later runs
+void WriteCrossover(const std::string& Key,long Crossover);
 
 //  ------------------------------------------------------------------------------------------------
 //
@@ -166,9 +472,15 @@ public:
 
 int main (int Argc, char* Argv[]) {
    
+    //  Start-up stages are timed from here.
+    
+    StartupProfile::Global().Start();
+    
     //  Set up the various levels for the Debug handler
     
-    TheDebugHandler.LevelsList("Timing,Setup");
+    TheDebugHandler.LevelsList("Timing,Setup,Profile,Startup");
+    TimingDebug = TheDebugHandler.Level("Timing");
+    ProfileDebug = TheDebugHandler.Level("Profile");
 
     //  Get the values of the command line arguments. This uses a Command Handler class that
     //  provides a flexible way of dealing with a number of different arguments, for example
@@ -189,6 +501,33 @@ int main (int Argc, char* Argv[]) {
     BoolArg CpuArg(TheHandler,"Cpu",0,"",false,"Perform computation using CPU");
     BoolArg GpuArg(TheHandler,"Gpu",0,"",false,"Perform computation using GPU");
     BoolArg ValidateArg(TheHandler,"Validate",0,"",true,"Enable Vulkan validation layers");
+    BoolArg AutotuneArg(TheHandler,"Autotune",0,"",false,"Time GPU workgroup shapes, use fastest");
+    BoolArg PaddingArg(TheHandler,"Padding",0,"",false,"Use least padded GPU workgroup shape");
+    BoolArg BatchArg(TheHandler,"Batch",0,"",false,"Submit all GPU repeats as one command buffer");
+    BoolArg Vec4Arg(TheHandler,"Vec4",0,"",false,"Use GPU shader with vec4 loads and stores");
+    BoolArg RooflineArg(TheHandler,"Roofline",0,"",false,"Report bandwidth as % of measured peak");
+    BoolArg SweepArg(TheHandler,"Sweep",0,"",false,"Time all GPU buffer access modes");
+    BoolArg StreamArg(TheHandler,"Stream",0,"",false,"Stream arrays through the GPU in tiles");
+    IntArg TileRowsArg(TheHandler,"TileRows",0,"",0,0,1024*1024,"Rows per tile when streaming");
+    IntArg QueuesArg(TheHandler,"Queues",0,"",0,0,64,"Time GPU submission to 1..N queues");
+    StringArg SimdArg(TheHandler,"Simd",0,"","Auto","CPU vector code (Auto,Scalar,AVX2,...)");
+    StringArg OpsArg(TheHandler,"Ops",0,"","","Element-wise operations, eg scale=2,offset=1");
+    BoolArg InPlaceArg(TheHandler,"InPlace",0,"",false,"Update the array in place");
+    BoolArg HalfArg(TheHandler,"Half",0,"",false,"Hold the arrays on the GPU in half precision");
+    IntArg WarmupArg(TheHandler,"Warmup",0,"",0,0,1000000,"Passes left out of the timings");
+    StringArg SizesArg(TheHandler,"Sizes",0,"","","Sizes to run in turn, eg 512,1024x512");
+    StringArg VaryArg(TheHandler,"Vary",0,"","","Values to run in turn, eg Nx=512:4096:x2");
+    IntArg SpinArg(TheHandler,"Spin",0,"",0,0,1000000,"Usec to poll GPU before blocking");
+    StringArg ReportArg(TheHandler,"Report",0,"","","File for timings (.csv or .json)");
+    StringArg TraceArg(TheHandler,"Trace",0,"","","File for a timeline trace (.json)");
+    StringArg PinArg(TheHandler,"Pin",0,"","","Pin CPU threads (None,PCores,Physical,Numa)");
+    BoolArg PriorityArg(TheHandler,"Priority",0,"",false,"Raise the CPU threads' priority");
+    BoolArg GpuCheckArg(TheHandler,"GpuCheck",0,"",false,"Check the GPU results on the GPU");
+    BoolArg AutoArg(TheHandler,"Auto",0,"",false,"Run each size on the faster of CPU and GPU");
+    BoolArg BackendArg(TheHandler,"Backend",0,"",false,"Use the backend-neutral GPU code");
+    BoolArg HugePagesArg(TheHandler,"HugePages",0,"",false,"Use huge pages for the CPU arrays");
+    BoolArg CountersArg(TheHandler,"Counters",0,"",false,"Count CPU cycles, instructions, misses");
+    IntArg SettleArg(TheHandler,"Settle",0,"",0,0,600000,"Most msec to let GPU times settle");
     StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
     DebugArgHelper DebugHelper;
     DebugArg.SetHelper(&DebugHelper);
@@ -207,14 +546,91 @@ int main (int Argc, char* Argv[]) {
     bool UseCPU = CpuArg.GetValue(&Ok,&Error);
     bool UseGPU = GpuArg.GetValue(&Ok,&Error);
     bool Validate = ValidateArg.GetValue(&Ok,&Error);
+    bool Autotune = AutotuneArg.GetValue(&Ok,&Error);
+    bool Padding = PaddingArg.GetValue(&Ok,&Error);
+    bool Batch = BatchArg.GetValue(&Ok,&Error);
+    bool Vec4 = Vec4Arg.GetValue(&Ok,&Error);
+    bool Roofline = RooflineArg.GetValue(&Ok,&Error);
+    bool Sweep = SweepArg.GetValue(&Ok,&Error);
+    bool Stream = StreamArg.GetValue(&Ok,&Error);
+    int TileRows = TileRowsArg.GetValue(&Ok,&Error);
+    int Queues = QueuesArg.GetValue(&Ok,&Error);
+    std::string Simd = SimdArg.GetValue(&Ok,&Error);
+    std::string Ops = OpsArg.GetValue(&Ok,&Error);
+    bool InPlace = InPlaceArg.GetValue(&Ok,&Error);
+    bool Half = HalfArg.GetValue(&Ok,&Error);
+    int Warmup = WarmupArg.GetValue(&Ok,&Error);
+    std::string Sizes = SizesArg.GetValue(&Ok,&Error);
+    std::string Vary = VaryArg.GetValue(&Ok,&Error);
+    int Spin = SpinArg.GetValue(&Ok,&Error);
+    std::string Report = ReportArg.GetValue(&Ok,&Error);
+    std::string Trace = TraceArg.GetValue(&Ok,&Error);
+    std::string Pin = PinArg.GetValue(&Ok,&Error);
+    bool Priority = PriorityArg.GetValue(&Ok,&Error);
+    bool GpuCheck = GpuCheckArg.GetValue(&Ok,&Error);
+    bool Auto = AutoArg.GetValue(&Ok,&Error);
+    bool UseBackend = BackendArg.GetValue(&Ok,&Error);
+    UseHugePages = HugePagesArg.GetValue(&Ok,&Error);
+    UseCounters = CountersArg.GetValue(&Ok,&Error);
+    SettleMsec = SettleArg.GetValue(&Ok,&Error);
     std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
     
+    //  If 'Pin' was given, it has to be one of the placements ThreadPlacement knows about.
+    
+    ThreadPlacement Placement;
+    bool PinOK = Placement.SetMode(Pin);
+    
     //  Check the argument parsing went OK, and didn't end with an exit being requested.
     
+    //  If 'Ops' was given, it has to make sense as a chain of operations.
+    
+    ElementwiseChain Chain;
+    std::string ChainError;
+    bool ChainOK = Chain.Parse(Ops,&ChainError);
+    
+    //  If 'Sizes' was given, the tests are run for each of the sizes listed instead of Nx,Ny.
+    
+    std::vector<int> SizesX(1,Nx),SizesY(1,Ny);
+    bool SizesOK = (Sizes == "" || BenchReport::Sizes(Sizes,SizesX,SizesY));
+    
+    //  If 'Vary' was given, they are run instead for each combination of the values it lists,
+    //  which have to be in the ranges allowed for the parameters themselves. Either way, the
+    //  tests end up as a list of combinations of parameter values to run in turn.
+    
+    std::vector<BenchReport::Combination> Combinations;
+    std::string VaryError;
+    bool VaryOK = true;
+    if (Vary != "") {
+        VaryOK = BenchReport::Sweep(Vary,"nx,ny,threads,spin",Combinations,&VaryError);
+    } else {
+        for (size_t Size = 0; Size < SizesX.size(); Size++) {
+            Combinations.push_back({{"nx",SizesX[Size]},{"ny",SizesY[Size]}});
+        }
+    }
+    for (size_t Run = 0; VaryOK && Run < Combinations.size(); Run++) {
+        long RunNx = BenchReport::Value(Combinations[Run],"nx",Nx);
+        long RunNy = BenchReport::Value(Combinations[Run],"ny",Ny);
+        long RunThreads = BenchReport::Value(Combinations[Run],"threads",Threads);
+        long RunSpin = BenchReport::Value(Combinations[Run],"spin",Spin);
+        if (RunNx < 2 || RunNx > 1024*1024 || RunNy < 2 || RunNy > 1024*1024 ||
+               RunThreads < 0 || RunThreads > MaxThreads || RunSpin < 0 || RunSpin > 1000000) {
+            VaryError = "'" + BenchReport::Describe(Combinations[Run]) + "' is out of range";
+            VaryOK = false;
+        }
+    }
+    
     if (!Ok) {
         if (!TheHandler.ExitRequested()) {
             printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
         }
+    } else if (!ChainOK) {
+        printf ("Error in 'Ops': %s\n",ChainError.c_str());
+    } else if (!SizesOK) {
+        printf ("Error in 'Sizes': '%s' should be a list such as 512,1024x512\n",Sizes.c_str());
+    } else if (!VaryOK) {
+        printf ("Error in 'Vary': %s\n",VaryError.c_str());
+    } else if (!PinOK) {
+        printf ("Error in 'Pin': '%s' should be None, PCores, Physical or Numa\n",Pin.c_str());
     } else {
         if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
 
@@ -222,25 +638,342 @@ int main (int Argc, char* Argv[]) {
         
         TheDebugHandler.SetLevels(DebugLevels);
         
-        printf ("\nPerforming 'Adder' test, arrays of %d rows, %d columns. Repeat count %d.\n\n",
-                Ny,Nx,Nrpt);
+        //  With 'Startup', record the start-up stages, the first being the command line.
+        
+        if (TheDebugHandler.Active("Startup")) {
+            StartupProfile::Global().Enable(true);
+            StartupProfile::Global().Record("Command line",0.0,StartupProfile::Global().NowMsec());
+        }
+        
+        //  If a trace is wanted, start recording the timeline.
+        
+        if (Trace != "") {
+            TraceRecorder::Global().Enable(true);
+            TraceRecorder::Global().SetThreadName("Main");
+            TraceRecorder::Global().WriteOnExit(Trace);
+        }
+        
+        //  'Pin' and 'Priority' set up the threads of the shared pool used by the CPU code,
+        //  which include this main thread. The topology is listed so the CPU timings can
+        //  be related to the machine they were taken on.
+        
+        if (Pin != "" || Priority) {
+            printf ("\nCPU topology: %s\n",Placement.Topology().c_str());
+            std::string PlacementError;
+            if (!Placement.Apply(ThreadPool::Shared(),Priority,&PlacementError)) {
+                printf ("Warning: %s.\n",PlacementError.c_str());
+            }
+            printf ("CPU threads: %s%s\n",Placement.Description().c_str(),
+                                                   Priority ? ", raised priority" : "");
+            if (Placement.Threads() > 0 && (Threads <= 0 || Threads > Placement.Threads())) {
+                Threads = Placement.Threads();
+            }
+        }
+        
+        if (InPlace && Chain.Operations() > 0) {
+            printf ("\n'Ops' is ignored with 'InPlace'.\n");
+            Chain.Clear();
+        }
+        if (Chain.Operations() > 0) {
+            printf ("\nUsing element-wise operations: %s\n",Chain.Description().c_str());
+        }
         
-        //  If neither CPU not GPU were specified on the command line, use GPU.
+        //  If neither CPU not GPU were specified on the command line, use GPU. With 'Auto',
+        //  both are available, and each size is run on one of them.
         
+        bool MultiQueue = (Queues > 0);
+        if (Auto && (Half || Sweep || Stream || MultiQueue)) {
+            printf ("\n'Auto' is ignored with 'Half', 'Sweep', 'Stream' and 'Queues'.\n");
+            Auto = false;
+        }
+        if (Auto) UseGPU = UseCPU = true;
         if (!UseGPU && !UseCPU) UseGPU = true;
         
-        //  Perform the test using either CPU or GPU (or both). Both ComputeUsingGPU() and its CPU
-        //  equivalent, ComputeUsingCPU() are expected to create arrays of the size specified, call
-        //  SetInputArray() to initialise the input array, then perform the basic 'adder' operation
-        //  as specified, and then call CheckResults() to verify that they got the right answer.
+        if (UseGPU) {
+            if ((Sweep || Stream) && (Chain.Operations() > 0 || InPlace || Half)) {
+                printf ("\n'Ops', 'InPlace' and 'Half' are ignored when streaming or sweeping.\n");
+                Half = false;
+            }
+            if (MultiQueue && (Sweep || Stream || Half || Chain.Operations() > 0 || InPlace)) {
+                printf ("\n'Queues' is ignored with 'Sweep', 'Stream', 'Half', 'Ops' and "
+                                                                           "'InPlace'.\n");
+                MultiQueue = false;
+            }
+            if (Half && (Chain.Operations() > 0 || InPlace || Vec4 || Autotune || Batch)) {
+                printf ("\n'Ops', 'InPlace', 'Vec4', 'Autotune' and 'Batch' are ignored "
+                                                                            "with 'Half'.\n");
+            }
+            if (GpuCheck && (Chain.Operations() > 0 || InPlace)) {
+                printf ("\n'GpuCheck' is ignored with 'Ops' and 'InPlace'.\n");
+                GpuCheck = false;
+            }
+        }
+        if (Warmup >= Nrpt && Nrpt > 0) {
+            printf ("\n'Warmup' (%d) leaves none of the %d passes to be timed.\n",Warmup,Nrpt);
+        }
+        
+        //  Perform the test using either CPU or GPU (or both), for each size in turn. Both
+        //  ComputeUsingGPU() and its CPU equivalent, ComputeUsingCPU() are expected to create
+        //  arrays of the size specified, call SetInputArray() to initialise the input array,
+        //  then perform the basic 'adder' operation as specified, and then call CheckResults()
+        //  to verify that they got the right answer. They add their timings to Bench.
+        //
+        //  If both are used, and the GPU is using the ordinary ComputeUsingGPU(), the input
+        //  array is set up just once, in memory the GPU can import, and both work from that
+        //  rather than each making and initialising its own copy.
+        //
+        //  With 'Vary', ComputeUsingGPU() uses the one Framework for all the combinations, so
+        //  the Vulkan instance and the device are only set up once, in the background while the
+        //  first input array is being initialised. It releases the buffers and pipeline it
+        //  creates each time, so their memory is reused for the next combination.
+        
+        //
+        //  'Auto' keeps a Framework in the same way, which it also uses to identify the GPU.
+        
+        KVVulkanFramework* WarmFramework = nullptr;
+        if (Vary != "" && Sizes != "") printf ("\n'Sizes' is ignored with 'Vary'.\n");
+        if ((Vary != "" || Auto) && UseGPU && !Half && !Sweep && !Stream && !MultiQueue) {
+            WarmFramework = new KVVulkanFramework;
+            WarmFramework->SetDebugSystemName("Vulkan");
+            WarmFramework->SetDebugLevels(DebugLevels);
+            WarmFramework->EnableValidation(Validate);
+            WarmFramework->StartDeviceSetup();
+        }
+        
+        //  With 'Auto', the crossover is read from the file, or found and saved if it isn't
+        //  there. A size with at least that many elements is run on the GPU, and any smaller
+        //  size on the CPU. A crossover of -1 means the GPU was never the faster.
+        
+        long Crossover = 0;
+        if (Auto) {
+            bool SetupOK = true;
+            WarmFramework->WaitForDeviceSetup(SetupOK);
+            if (!SetupOK) {
+                printf ("\n'Auto' can't set up the GPU, so is using the CPU.\n");
+                Crossover = -1;
+            } else {
+                std::string Key = CrossoverKey(*WarmFramework,Batch,Vec4,InPlace,Chain,
+                                                                              Threads,Simd);
+                if (ReadCrossover(Key,&Crossover)) {
+                    printf ("\nUsing saved CPU/GPU crossover for %s\n",Key.c_str());
+                } else {
+                    printf ("\nCalibrating CPU/GPU crossover for %s\n",Key.c_str());
+                    Crossover = CalibrateCrossover(WarmFramework,Validate,Autotune,Batch,Vec4,
+                                          InPlace,Chain,DebugLevels,Spin,Threads,Simd);
+                    WriteCrossover(Key,Crossover);
+                }
+            }
+            if (Crossover < 0) printf ("The CPU is faster for all the sizes calibrated.\n");
+            else printf ("The GPU is faster from %ld elements.\n",Crossover);
+        }
+        
+        int BaseNx = Nx;
+        int BaseNy = Ny;
+        int BaseThreads = Threads;
+        int BaseSpin = Spin;
+        BenchReport Bench;
+        for (size_t Run = 0; Run < Combinations.size(); Run++) {
+            Nx = int(BenchReport::Value(Combinations[Run],"nx",BaseNx));
+            Ny = int(BenchReport::Value(Combinations[Run],"ny",BaseNy));
+            Threads = int(BenchReport::Value(Combinations[Run],"threads",BaseThreads));
+            Spin = int(BenchReport::Value(Combinations[Run],"spin",BaseSpin));
+            if (Vary != "") {
+                printf ("\nCombination %d of %d: %s\n",int(Run + 1),int(Combinations.size()),
+                                                  BenchReport::Describe(Combinations[Run]).c_str());
+            }
+            bool RunGPU = UseGPU;
+            bool RunCPU = UseCPU;
+            if (Auto) {
+                RunGPU = (Crossover >= 0 && long(Nx) * long(Ny) >= Crossover);
+                RunCPU = !RunGPU;
+                printf ("\n'Auto' is using the %s.\n",RunGPU ? "GPU" : "CPU");
+            }
+            printf ("\nPerforming 'Adder' test, arrays of %d rows, %d columns. "
+                                                       "Repeat count %d.\n\n",Ny,Nx,Nrpt);
+            //  (With 'HugePages', the shared input comes from HugePages, whose alignment is
+            //  enough for the GPU to import it just the same.)
+            
+            float* SharedInput = nullptr;
+            if (RunGPU && RunCPU && !Half && !Sweep && !Stream && !MultiQueue) {
+                size_t SharedBytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+                if (UseHugePages) SharedInput = (float*)HugePages::Allocate(SharedBytes);
+                else SharedInput = (float*)KVVulkanFramework::AllocateImportableMemory(SharedBytes);
+                if (SharedInput) {
+                    float** SharedArray = CreateRowAddrs(SharedInput,Nx,Ny);
+                    SetInputArray(SharedArray,Nx,Ny);
+                    free(SharedArray);
+                    if (UseHugePages) {
+                        printf ("Shared input array: %s\n\n",
+                                                     HugePages::Describe(SharedInput).c_str());
+                    }
+                }
+            }
+            if (RunGPU) {
+            
+                //  'Backend' runs the backend-neutral code instead of any of this. 'Half' has
+                //  its own, simpler, version of the GPU code. If the device turns out not to
+                //  support 16-bit storage, that returns false, and the normal code is used.
+            
+                if (UseBackend) {
+                    ComputeUsingVulkanBackend(Nx,Ny,Nrpt,Validate,DebugLevels,Warmup,Bench);
+                } else if (Half && ComputeUsingGPUHalf(Nx,Ny,Nrpt,Validate,Roofline,
+                                                                              DebugLevels)) {
+                    //  All done, in half precision.
+                } else if (Sweep) {
+                    SweepBufferModes(Nx,Ny,Nrpt,Validate,DebugLevels);
+                } else if (Stream) {
+                    ComputeUsingGPUStreamed(Nx,Ny,Nrpt,TileRows,Validate,Vec4,Roofline,
+                                                                                DebugLevels);
+                } else if (MultiQueue) {
+                    ComputeUsingGPUQueues(Nx,Ny,Nrpt,Queues,Validate,Vec4,DebugLevels);
+                } else {
+                    ComputeUsingGPU(Nx,Ny,Nrpt,Validate,Autotune,Batch,Vec4,Roofline,InPlace,
+              Chain,DebugLevels,Warmup,GpuCheck,Spin,Padding,Bench,SharedInput,WarmFramework);
+                }
+            }
+            if (RunCPU) {
+                ComputeUsingCPU(Threads,Nx,Ny,Nrpt,Simd,Roofline,InPlace,Chain,Warmup,Bench,
+                                                                                 SharedInput);
+            }
+            if (!HugePages::Free(SharedInput)) {
+                KVVulkanFramework::FreeImportableMemory(SharedInput);
+            }
+        }
+        delete WarmFramework;
         
-        if (UseGPU) ComputeUsingGPU(Nx,Ny,Nrpt,Validate,DebugLevels);
+        //  'Report' appends the timings collected to a file. ('Half', 'Sweep', 'Stream' and
+        //  'Queues' have their own reports, and don't add to these.)
         
-        if (UseCPU) ComputeUsingCPU(Threads,Nx,Ny,Nrpt);
+        if (Report != "" && Bench.Rows() > 0) Bench.Write(Report);
     }
     return 0;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                       C P U / G P U  c r o s s o v e r
+//
+//  For small arrays the CPU is faster, as each GPU pass has the fixed cost of submitting the
+//  command buffer and waiting for it, and for large arrays the GPU is faster. 'Auto' uses
+//  these routines to find the size at which that changes, and to keep it in a file, one line
+//  for each combination of GPU and CPU code, so it only has to be found once on each machine.
+
+//  The file the crossovers are kept in.
+
+static const char* const C_CrossoverFile = "AdderCrossover.txt";
+
+//  The calibration times square arrays of each of these sizes in turn, and the passes timed
+//  for each, after the warm-up passes, which aren't.
+
+static const int C_CalibrationSizes[] = {64,128,256,512,1024,2048,4096};
+static const int C_CalibrationPasses = 20;
+static const int C_CalibrationWarmup = 5;
+
+//  CrossoverKey() describes what determines the crossover - the GPU, its driver and the kernel
+//  used, and the CPU threads and vector code - as the key the crossover is kept under.
+
+std::string CrossoverKey(KVVulkanFramework& Framework,bool Batch,bool Vec4,bool InPlace,
+                     const ElementwiseChain& Chain,int Threads,const std::string& Simd)
+{
+    std::string Device,Driver;
+    Framework.GetDeviceDescription(&Device,&Driver);
+    std::string Key = Device + " (" + Driver + "), add";
+    if (Batch) Key += " batch";
+    if (Vec4) Key += " vec4";
+    if (InPlace) Key += " in place";
+    if (Chain.Operations() > 0) Key += " ops " + Chain.Description();
+    Key += ", CPU " + std::to_string(Threads) + " thread(s) " + Simd;
+    for (char& C : Key) if (C == '\n') C = ' ';
+    return Key;
+}
+
+//  CalibrateCrossover() runs ComputeUsingGPU() and ComputeUsingCPU() on each of the calibration
+//  sizes in turn, and returns the number of elements in the first for which the GPU's median
+//  time for a pass is the shorter. It stops there, as the GPU is faster for all larger arrays
+//  too. If the CPU is faster for all the sizes, it returns -1.
+
+long CalibrateCrossover(KVVulkanFramework* Warm,bool Validate,bool Autotune,bool Batch,
+              bool Vec4,bool InPlace,const ElementwiseChain& Chain,const std::string& DebugLevels,
+                                         int Spin,int Threads,const std::string& Simd)
+{
+    long Crossover = -1;
+    for (int Size : C_CalibrationSizes) {
+        BenchReport GPUBench,CPUBench;
+        printf ("\nCalibrating with %d by %d arrays.\n\n",Size,Size);
+        ComputeUsingGPU(Size,Size,C_CalibrationPasses,Validate,Autotune,Batch,Vec4,false,
+          InPlace,Chain,DebugLevels,C_CalibrationWarmup,false,Spin,false,GPUBench,nullptr,Warm);
+        ComputeUsingCPU(Threads,Size,Size,C_CalibrationPasses,Simd,false,InPlace,Chain,
+                                                             C_CalibrationWarmup,CPUBench);
+        double GPUMsec = GPUBench.LastHostP50();
+        double CPUMsec = CPUBench.LastHostP50();
+        if (GPUMsec < 0.0 || CPUMsec < 0.0) break;
+        if (Batch) GPUMsec /= double(C_CalibrationPasses);
+        if (GPUMsec < CPUMsec) {
+            Crossover = long(Size) * long(Size);
+            break;
+        }
+    }
+    return Crossover;
+}
+
+//  ReadCrossover() looks for the crossover kept under Key in the file, each line of which is
+//  the crossover followed by the key, returning false if it isn't there.
+
+bool ReadCrossover(const std::string& Key,long* Crossover)
+{
+    bool Found = false;
+    FILE* File = fopen(C_CrossoverFile,"r");
+    if (File) {
+        char Line[1024];
+        while (!Found && fgets(Line,sizeof(Line),File)) {
+            char* End;
+            long Value = strtol(Line,&End,10);
+            if (End == Line || *End != ' ') continue;
+            std::string LineKey = End + 1;
+            while (!LineKey.empty() && (LineKey.back() == '\n' || LineKey.back() == '\r')) {
+                LineKey.pop_back();
+            }
+            if (LineKey == Key) {
+                *Crossover = Value;
+                Found = true;
+            }
+        }
+        fclose(File);
+    }
+    return Found;
+}
+
+//  WriteCrossover() adds a crossover to the file, replacing any already kept under the same key.
+
+void WriteCrossover(const std::string& Key,long Crossover)
+{
+    std::vector<std::string> Lines;
+    FILE* File = fopen(C_CrossoverFile,"r");
+    if (File) {
+        char Line[1024];
+        while (fgets(Line,sizeof(Line),File)) {
+            std::string Text = Line;
+            size_t Space = Text.find(' ');
+            if (Space == std::string::npos) continue;
+            std::string LineKey = Text.substr(Space + 1);
+            while (!LineKey.empty() && (LineKey.back() == '\n' || LineKey.back() == '\r')) {
+                LineKey.pop_back();
+            }
+            if (Text.back() != '\n') Text += '\n';
+            if (LineKey != Key) Lines.push_back(Text);
+        }
+        fclose(File);
+    }
+    File = fopen(C_CrossoverFile,"w");
+    if (File == nullptr) {
+        printf ("Unable to save the CPU/GPU crossover in %s\n",C_CrossoverFile);
+        return;
+    }
+    for (const std::string& Line : Lines) fputs(Line.c_str(),File);
+    fprintf (File,"%ld %s\n",Crossover,Key.c_str());
+    fclose(File);
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    G P U  c o d e
@@ -257,25 +990,84 @@ int main (int Argc, char* Argv[]) {
 
 //                               I n c l u d e  F i l e s
 //
-//  Needed for Vulkan
+//  Needed for Vulkan, and for std::min() in the streaming code.
 
 #include "KVVulkanFramework.h"
+#include "KVComputeKernel.h"
+#include <algorithm>
+
+//  The Vulkan implementation of the ComputeBackend used for 'Backend', and the backend-neutral
+//  GPU code run through it.
+
+#include "VulkanBackend.h"
+#include "BackendAdder.h"
 
 //                                  C o n s t a n t s
 //
-//  These have to match the values used by the GPU shader code in Adder.comp.
+//  These have to match the values used by the GPU shader code in Adder.comp. (The workgroup
+//  size is passed to the shader as specialization constants, so this is really just the
+//  default used unless 'Autotune' is specified.)
 
 static const uint32_t C_WorkGroupSize = 32;
 static const int C_UniformBufferBinding = 0;
 static const int C_InputBufferBinding = 1;
 static const int C_OutputBufferBinding = 2;
 
-void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& DebugLevels)
+//  When streaming, this is the target size for the tile buffers if TileRows isn't specified. It
+//  is well inside the 128 MByte that Vulkan guarantees for maxStorageBufferRange.
+
+static const long C_DefaultTileBytes = 64 * 1024 * 1024;
+
+//  And this is the number of tiles that can be in device memory at once when streaming.
+
+static const int C_StreamSlots = 2;
+
+//  The two versions of the shader. With the vec4 version, each thread handles four elements,
+//  so the grid of threads only need be a quarter as wide, which is what GridWidth() returns.
+
+static const char* const C_ScalarShader = "Adder.spv";
+static const char* const C_Vec4Shader = "Adder4.spv";
+
+static uint32_t GridWidth(int Nx,bool Vec4) { return Vec4 ? uint32_t(Nx + 3) / 4 : uint32_t(Nx); }
+
+//  And the shader used for a chain of element-wise operations, if 'Ops' is specified.
+
+static const char* const C_ChainShader = "Elementwise.spv";
+
+//  And the version that works in place, which has only the one storage buffer, using the
+//  input buffer's binding.
+
+static const char* const C_InPlaceShader = "AdderInPlace.spv";
+
+//  And the version that keeps the arrays in half precision, used for 'Half'.
+
+static const char* const C_HalfShader = "Adder16.spv";
+
+//  And the shader that checks the results on the GPU for 'GpuCheck', which has the input and
+//  output buffers at the usual bindings, and the small buffer for the results of the check at
+//  the binding given here.
+
+static const char* const C_CheckShader = "AdderCheck.spv";
+static const int C_CheckBufferBinding = 3;
+
+//  Checks the results of ComputeUsingGPU() on the GPU, for 'GpuCheck'.
+
+bool CheckResultsOnGPU(KVVulkanFramework& Framework,
+             KVVulkanFramework::KVBufferHandle InputBufferHndl,float** InputArray,
+           KVVulkanFramework::KVBufferHandle OutputBufferHndl,float** OutputArray,int Nx,int Ny,
+                                                                               bool& StatusOK);
+
+void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,bool Autotune,bool Batch,bool Vec4,
+        bool Roofline,bool InPlace,const ElementwiseChain& Chain,const std::string& DebugLevels,
+                        int Warmup,bool GpuCheck,int Spin,bool Padding,BenchReport& Bench,
+                                                  float* SharedInput,KVVulkanFramework* Warm)
 {
     bool StatusOK = true;
     
     MsecTimer SetupTimer;
     TheDebugHandler.Log("Setup","GPU setup starting");
+    TraceRecorder& Tracer = TraceRecorder::Global();
+    Tracer.Begin("GPU setup","Adder");
 
     //  To make things easier for the CPU code, we will create an array of the addresses of
     //  the rows of the input buffer - this allows the use of an ArrayRows[Iy][Ix] syntax when
@@ -295,17 +1087,33 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
     //  This is a basic Vulkan initialisation sequence - it creates a Vulkan 'instance', used
     //  to interact with Vulkan, locates a suitable GPU device (with is often the only one
     //  available) and opens that, creating a 'logical device' that represents the selected GPU.
+    //  With 'Vary', main() has already started all that, in a Framework it keeps for all the
+    //  combinations it runs, and passes to us as Warm, so we just wait for it.
     
-    KVVulkanFramework Framework;
-    Framework.SetDebugSystemName("Vulkan");
-    Framework.SetDebugLevels(DebugLevels);
-    Framework.EnableValidation(Validate);
-    Framework.CreateVulkanInstance(StatusOK);
-    TheDebugHandler.Logf("Setup","Vulkan instance created at %.3f msec",SetupTimer.ElapsedMsec());
-    Framework.FindSuitableDevice(StatusOK);
-    Framework.CreateLogicalDevice(StatusOK);
+    KVVulkanFramework Local;
+    KVVulkanFramework& Framework = Warm ? *Warm : Local;
+    if (Warm) {
+        Framework.WaitForDeviceSetup(StatusOK);
+    } else {
+        Framework.SetDebugSystemName("Vulkan");
+        Framework.SetDebugLevels(DebugLevels);
+        Framework.EnableValidation(Validate);
+        Framework.CreateVulkanInstance(StatusOK);
+        TheDebugHandler.Logf("Setup","Vulkan instance created at %.3f msec",
+                                                                     SetupTimer.ElapsedMsec());
+        Framework.FindSuitableDevice(StatusOK);
+        Framework.CreateLogicalDevice(StatusOK);
+    }
     TheDebugHandler.Logf("Setup","GPU device created at %.3f msec",SetupTimer.ElapsedMsec());
     
+    //  If we're to report the bandwidth as a fraction of the peak, we need to know the peak.
+    
+    double PeakGBytes = 0.0;
+    if (Roofline) {
+        PeakGBytes = Framework.MeasureDeviceBandwidth(StatusOK);
+        printf ("GPU measured peak bandwidth = %.2f GBytes/sec\n",PeakGBytes);
+    }
+    
     //  Create a device buffer to contain the input data array. The options specify that the
     //  buffer is to be used for storage (as opposed to uniform values) and 'shared', ie visible
     //  to both the GPU and the CPU (since we need to use the CPU to set its initial values.)
@@ -313,39 +1121,81 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
     //  for this buffer, which we get by mapping it. Then we can initialise the buffer, using
     //  a call to SetInputArray(). We could use "STAGED_CPU" instead of "SHARED", which sets up
     //  a CPU-local buffer and a GPU-local buffer which have to be explicitly synched. This may
-    //  provide better performance with some discrete GPUs.
+    //  provide better performance with some discrete GPUs. (Running with 'Sweep' times all the
+    //  sensible combinations - see SweepBufferModes().)
+    //
+    //  If the CPU is to work from the same input, main() passes it as SharedInput, already
+    //  initialised in memory from AllocateImportableMemory(), and we use an "IMPORTED" buffer
+    //  for it instead. (If the GPU can't use that memory as it is, ImportBuffer() copies it
+    //  into a shared buffer.)
 
-    int Length = Nx * Ny * sizeof(float);
+    //  A shader can only see as much of a storage buffer as the device's maxStorageBufferRange
+    //  - often 4 GBytes, sometimes much less - so larger arrays can't be done in one go.
+    //  'Stream' works through the arrays a tile of rows at a time, and doesn't have that problem.
+    
+    StartupPhase BufferPhase("GPU buffers");
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    if (StatusOK && Length > Framework.GetMaxStorageBufferRange()) {
+        printf ("Arrays of %llu bytes are larger than the GPU's largest storage buffer "
+                "(%llu bytes). Use 'Stream' to work through them in pieces.\n\n",
+                (unsigned long long)Length,
+                                     (unsigned long long)Framework.GetMaxStorageBufferRange());
+        StatusOK = false;
+    }
     KVVulkanFramework::KVBufferHandle InputBufferHndl;
-    InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE","SHARED",StatusOK);
-    Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    if (SharedInput) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,SharedInput,Length,StatusOK);
+    } else {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        
+        //  If the CPU isn't going to read the input back to check the results, it only writes
+        //  it, and the buffer can go into device-local memory if the CPU can see any.
+        
+        if (!InPlace && (GpuCheck || !Validate)) {
+            Framework.SetBufferHostWriteOnly(InputBufferHndl,StatusOK);
+        }
+        Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    }
     
-    long Bytes;
+    VkDeviceSize Bytes;
     float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
     InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
-    SetInputArray(InputArray,Nx,Ny);
+    if (!SharedInput) SetInputArray(InputArray,Nx,Ny);
     
     //  And now a device buffer for the output data array. This is essentially the same as for
     //  the input buffer. This will have to be accessed on the CPU side by CheckResults(),
-    //  so we use CreateRowAddrs() to set up for this. (Here, "SHARED" could be replaced by
-    //  "STAGED_GPU" for buffers that need explicit synch, as the GPU creates the data that
-    //  then has to be copied to the CPU.)
+    //  so we use CreateRowAddrs() to set up for this. It is a "READBACK" buffer, which is
+    //  shared, but is put into cached memory if possible, as the CPU reads from it. (Here,
+    //  "READBACK" could be replaced by "STAGED_GPU" for buffers that need explicit synch, as
+    //  the GPU creates the data that then has to be copied to the CPU.)
+    //
+    //  If the operation is performed in place, there is no output buffer - the results go back
+    //  into the input buffer, so that is also the output array.
     
-    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
-    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
-                                                                            "SHARED",StatusOK);
-    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
-    float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
-    OutputArray = CreateRowAddrs(OutputBufferAddr,Nx,Ny);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    if (InPlace) {
+        OutputArray = InputArray;
+    } else {
+        OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+        Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+        float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+        OutputArray = CreateRowAddrs(OutputBufferAddr,Nx,Ny);
+    }
 
     //  Create a uniform buffer - visible to all the GPU threads - to hold parameters we want
-    //  to pass to the GPU code. In this case, the values of Ny and Ny. The layout of this
-    //  structure must match that defined in the Adder.comp GPU shader code.
+    //  to pass to the GPU code. In this case, the values of Ny and Ny, and the index of the
+    //  first row, which is only non-zero when streaming. The layout of this structure must
+    //  match that defined in the Adder.comp GPU shader code.
     
     struct AdderArgs {
         int Nx;
         int Ny;
-    } Parameters = {Nx,Ny};
+        int RowOffset;
+    } Parameters = {Nx,Ny,0};
     
     long SizeInBytes = sizeof(AdderArgs);
     KVVulkanFramework::KVBufferHandle UniformBufferHndl;
@@ -356,14 +1206,16 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
     if (StatusOK && UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,Bytes);
 
     TheDebugHandler.Logf("Setup","GPU buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+    BufferPhase.End();
 
     //  Given the handles to those three buffer descriptions, we can specify the layout of the
     //  descriptor set that will be needed to describe them to the GPU shader.
     
+    StartupPhase DescriptorPhase("GPU descriptors");
     std::vector<KVVulkanFramework::KVBufferHandle> Handles;
     Handles.push_back(UniformBufferHndl);
     Handles.push_back(InputBufferHndl);
-    Handles.push_back(OutputBufferHndl);
+    if (!InPlace) Handles.push_back(OutputBufferHndl);
     VkDescriptorSetLayout SetLayout;
     Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
     
@@ -379,16 +1231,7 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
     Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
     Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
     TheDebugHandler.Logf("Setup","GPU descriptors created at %.3f msec",SetupTimer.ElapsedMsec());
-
-    //  And, given the set layout, we can specify the layout of the compute pipeline that will
-    //  run the shader, and we can create it.
-    
-    VkPipelineLayout ComputePipelineLayout;
-    VkPipeline ComputePipeline;
-    Framework.CreateComputePipeline("Adder.spv","main",
-                            &SetLayout,&ComputePipelineLayout,&ComputePipeline,StatusOK);
-    TheDebugHandler.Logf("Setup","GPU pipeline for adder created at %.3f msec",
-                                                               SetupTimer.ElapsedMsec());
+    DescriptorPhase.End();
 
     //  We can also create the one compute queue we will need
     
@@ -404,19 +1247,86 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
     Framework.CreateCommandPool(&CommandPool,StatusOK);
     Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
     
-    //  Tweaking the arrangement of GPU threads and thread groups can be tricky, but if
-    //  we assume the GPU shader code has set up a hard-coded local workgroup size of
-    //  {C_WorkGroupSize,C_WorkGroupSize,1}, then the following values for _workGroupCounts
-    //  cover the whole image (with some possible spillover at the edges that the shader
-    //  code has to allow for).
+    //  Nothing about the computation changes from one iteration to the next, so the command
+    //  buffer can be recorded once and then just resubmitted.
+    
+    Framework.SetCommandBufferReusable(CommandBuffer,true,StatusOK);
+    
+    //  Tweaking the arrangement of GPU threads and thread groups can be tricky. By default we
+    //  use a local workgroup size of {C_WorkGroupSize,C_WorkGroupSize,1}, but if autotuning
+    //  was requested we let the Framework time the shader with a number of different shapes
+    //  on the actual arrays and use the fastest.
+    
+    //  If 'Vec4' was specified, the vectorised shader is used instead, with a narrower grid.
+    //  If a chain of element-wise operations was specified, neither is used - see below.
+    //  And working in place needs its own shader, with just the one buffer. (Autotuning
+    //  would run that shader over the array, updating it, so isn't allowed then.)
+    
+    bool UseChain = (Chain.Operations() > 0);
+    if (UseChain && (Vec4 || Autotune)) {
+        printf ("'Vec4' and 'Autotune' are ignored with 'Ops'.\n");
+        Vec4 = Autotune = false;
+    }
+    if (InPlace && (Vec4 || Autotune)) {
+        printf ("'Vec4' and 'Autotune' are ignored with 'InPlace'.\n");
+        Vec4 = Autotune = false;
+    }
+    const char* ShaderName = Vec4 ? C_Vec4Shader : C_ScalarShader;
+    if (UseChain) ShaderName = C_ChainShader;
+    if (InPlace) ShaderName = C_InPlaceShader;
+    uint32_t GridNx = GridWidth(Nx,Vec4);
+    TheDebugHandler.Logf("Setup","Using shader %s",ShaderName);
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    if (Autotune) {
+        Framework.AutotuneWorkGroupSize(ShaderName,"main",&SetLayout,&DescriptorSet,
+                         GridNx,uint32_t(Ny),CommandPool,ComputeQueue,WorkGroupSize,StatusOK);
+        TheDebugHandler.Logf("Setup","Autotuned work group size %d, %d at %.3f msec",
+                                 WorkGroupSize[0],WorkGroupSize[1],SetupTimer.ElapsedMsec());
+    } else if (Padding) {
+        
+        //  With 'Padding', the shape is the one with the same number of threads that needs
+        //  fewest invocations past the edges of the grid. For a grid that isn't a multiple
+        //  of the default shape, that can be a much wider or a much taller one.
+        
+        Framework.LeastPaddedWorkGroupSize(GridNx,uint32_t(Ny),WorkGroupSize,StatusOK);
+        TheDebugHandler.Logf("Setup","Least padded work group size %d, %d",
+                                                           WorkGroupSize[0],WorkGroupSize[1]);
+    }
+    
+    //  And, given the set layout, we can specify the layout of the compute pipeline that will
+    //  run the shader, and we can create it, passing the workgroup size as specialization
+    //  constants.
+    
+    //  For a chain of operations, an ElementwisePipelines object creates the pipeline, with
+    //  the operations as further specialization constants, and the operands are passed as
+    //  push constants. (It would only create it once, however many times it was asked.)
+    
+    VkPipelineLayout ComputePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline ComputePipeline = VK_NULL_HANDLE;
+    ElementwisePipelines ChainPipelines(&Framework,SetLayout,C_ChainShader);
+    if (UseChain) {
+        ChainPipelines.GetPipeline(Chain,WorkGroupSize,&ComputePipelineLayout,
+                                                                 &ComputePipeline,StatusOK);
+    } else {
+        std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1]};
+        Framework.CreateComputePipeline(ShaderName,"main",&SetLayout,&ComputePipelineLayout,
+                                                   &ComputePipeline,SpecConstants,StatusOK);
+    }
+    TheDebugHandler.Logf("Setup","GPU pipeline for adder created at %.3f msec",
+                                                               SetupTimer.ElapsedMsec());
+
+    //  The following values for WorkGroupCounts cover the whole image (with some possible
+    //  spillover at the edges that the shader code has to allow for).
     
     uint32_t WorkGroupCounts[3];
-    WorkGroupCounts[0] = (uint32_t(Nx) + C_WorkGroupSize - 1)/C_WorkGroupSize;
-    WorkGroupCounts[1] = (uint32_t(Ny) + C_WorkGroupSize - 1)/C_WorkGroupSize;
+    WorkGroupCounts[0] = (GridNx + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
     WorkGroupCounts[2] = 1;
-    TheDebugHandler.Logf("Setup","Work group size %d, %d, %d",C_WorkGroupSize,C_WorkGroupSize,1);
+    TheDebugHandler.Logf("Setup","Work group size %d, %d, %d",WorkGroupSize[0],WorkGroupSize[1],1);
     TheDebugHandler.Logf("Setup","Work group counts %d, %d, %d",
                          WorkGroupCounts[0],WorkGroupCounts[1],WorkGroupCounts[2]);
+    Tracer.End("GPU setup","Adder");
+    EndOfStartup();
     if (StatusOK) {
         TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
     } else {
@@ -425,29 +1335,134 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
     }
 
     //  This sets up the pipeline for the GPU calculation and runs it. Basically, we have to
-    //  record the command buffer - command buffers are 'use once' - and run it. If we have
-    //  staged buffers, they need to be synch'ed - the SyncBuffer() calls are null operations
-    //  for shared buffers.
+    //  record the command buffer and run it - although as it has been marked as reusable, only
+    //  the first call to RecordComputeBatch() actually records anything. If we have
+    //  staged buffers, they need to be synch'ed - the input before the computation and the
+    //  output after it. Rather than separate SyncBuffer() calls, each waiting for its own
+    //  transfer, the copies are recorded into the compute command buffer along with the
+    //  barriers needed to order them. Unstaged (shared) buffers are simply ignored. With
+    //  dispatch timing enabled, the command buffer also records GPU timestamps, so we can
+    //  see how much of the time is spent in the shader itself, rather than in the overheads.
+    //  If 'Batch' was specified, all the repeats are recorded as separate dispatches in the
+    //  one command buffer, so there is only one submission and one wait for the whole lot.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter;
+    if (!InPlace) SyncAfter.push_back(OutputBufferHndl);
+    
+    KVVulkanFramework::KVDispatch Dispatch;
+    Dispatch.PipelineHndl = ComputePipeline;
+    Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+    Dispatch.DescriptorSetHndl = DescriptorSet;
+    for (int I = 0; I < 3; I++) Dispatch.WorkGroupCounts[I] = WorkGroupCounts[I];
+    Dispatch.PushConstants = UseChain ? Chain.PushConstants() : nullptr;
+    Dispatch.PushConstantSize = UseChain ? Chain.PushConstantSize() : 0;
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches(Batch ? Nrpt : 1,Dispatch);
+    int Submissions = Nrpt;
+    if (Batch && Nrpt > 0) Submissions = 1;
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    
+    //  With 'Settle', the same submission is run until its times settle down, using the kernel
+    //  time where the GPU records one. These passes count as warm-up passes, but aren't timed.
+    
+    int SettlePasses = 0;
+    if (SettleMsec > 0 && Nrpt > 0 && StatusOK) {
+        if (InPlace) {
+            printf ("'Settle' is ignored with 'InPlace'.\n");
+        } else {
+            MsecSettle Settle(SettleMsec);
+            bool Settling = true;
+            while (Settling && StatusOK) {
+                MsecTimer PassTimer;
+                Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,
+                                                                                     StatusOK);
+                Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+                float DispatchMsec;
+                bool Timed = Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK);
+                Settling = !Settle.Record(Timed ? DispatchMsec : PassTimer.ElapsedMsec());
+            }
+            Settle.Report("GPU warm-up");
+            SettlePasses = Settle.Passes();
+        }
+    }
+    
+    //  'Padding' also has the command buffer count the shader invocations it runs, which can
+    //  be compared with the number the grid actually needs. (Not all devices can count them.)
+    
+    if (Padding) Framework.EnablePipelineStatistics(true,StatusOK);
+    uint64_t PassInvocations = 0;
+    bool InvocationsCounted = false;
     
+    //  'Spin' has the waits for each submission poll for completion before blocking. The wait
+    //  counts are reset, so they only cover the passes.
+    
+    Framework.SetWaitSpin(unsigned(Spin));
+    KVVulkanFramework::KVWaitStats WaitStats;
+    Framework.GetWaitStats(&WaitStats,true);
+    
+    //  With 'Batch', all the repeats are one submission, so there are no passes to leave out.
+    
+    MsecStats LoopStats;
+    MsecStats KernelStats;
+    if (!Batch) {
+        LoopStats.SetWarmup(Warmup);
+        KernelStats.SetWarmup(Warmup);
+    }
+    LoopStats.AddWarmup(SettlePasses);
+    KernelStats.AddWarmup(SettlePasses);
     MsecTimer ComputeTimer;
     
-    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+    for (int Irpt = 0; Irpt < Submissions; Irpt++) {
         
         MsecTimer LoopTimer;
+        TraceScope PassTrace("GPU pass","Adder");
         
-        Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
-
-        Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
-                                    ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
-        TheDebugHandler.Logf("Timing","Command buffer recorded at %.3f msec",
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,StatusOK);
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"Command buffer recorded at %.3f msec",
                              LoopTimer.ElapsedMsec());
         
         Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        double DoneUsec = Tracer.NowUsec();
         
-        Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        //  The output is read by the CPU without a SyncBuffer() call, so if its memory isn't
+        //  coherent it has to be invalidated here. (Usually, this does nothing.)
         
-        TheDebugHandler.Logf("Timing","Compute complete at %.3f msec",LoopTimer.ElapsedMsec());
+        Framework.InvalidateBuffer(InPlace ? InputBufferHndl : OutputBufferHndl,StatusOK);
+        
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+        float BeforeMsec,DispatchMsec,AfterMsec;
+        if (Framework.GetDispatchTimes(&BeforeMsec,&DispatchMsec,&AfterMsec,StatusOK)) {
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"GPU kernel took %.3f msec",DispatchMsec);
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+            KernelStats.Record(DispatchMsec);
+            
+            //  The GPU times are durations, not times on the CPU's clock, so the trace shows
+            //  them ending when the CPU saw the command buffer complete. That's a little late,
+            //  but shows how much of the pass the GPU actually spent working.
+            
+            if (Tracer.Enabled()) {
+                double EndUsec = DoneUsec - AfterMsec * 1000.0;
+                Tracer.Complete("Sync before","GPU",
+                               EndUsec - (DispatchMsec + BeforeMsec) * 1000.0,BeforeMsec * 1000.0);
+                Tracer.Complete("Adder kernel","GPU",
+                                            EndUsec - DispatchMsec * 1000.0,DispatchMsec * 1000.0);
+                Tracer.Complete("Sync after","GPU",EndUsec,AfterMsec * 1000.0);
+            }
+        }
+        uint64_t Invocations;
+        if (Padding && Framework.GetDispatchInvocations(&Invocations,StatusOK)) {
+            PassInvocations = Invocations / uint64_t(Dispatches.size());
+            InvocationsCounted = true;
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"GPU ran %llu invocations",
+                                                                (unsigned long long)Invocations);
+        }
         if (!StatusOK) break;
+        LoopStats.Record(LoopTimer.ElapsedMsec());
     }
         
     //  Check that we got it right, and if so report on the timing.
@@ -456,10 +1471,63 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
         float Msec = ComputeTimer.ElapsedMsec();
         printf ("GPU took %.3f msec\n",Msec);
         printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        LoopStats.Report(Batch ? "GPU submissions" : "GPU iterations");
+        if (SettlePasses > 0) {
+            printf ("GPU times spread %.2f%%",100.0 * LoopStats.Spread());
+            if (KernelStats.Count() > 0) printf (", kernel %.2f%%",100.0 * KernelStats.Spread());
+            printf (" (standard deviation / mean)\n");
+        }
+        Framework.GetWaitStats(&WaitStats);
+        if (WaitStats.Waits > 0) {
+            std::string Strategy = "blocking";
+            if (Spin > 0) Strategy = "polling for " + std::to_string(Spin) + " usec";
+            printf ("GPU waits, %s: %d, mean %.1f usec, max %.1f usec",Strategy.c_str(),
+                     int(WaitStats.Waits),WaitStats.TotalUsec / double(WaitStats.Waits),
+                                                                          WaitStats.MaxUsec);
+            if (Spin > 0) printf (", %d finished while polling",int(WaitStats.Spun));
+            printf ("\n");
+        }
+        if (LoopStats.Count() > 0) {
+            std::string Device,Driver;
+            Framework.GetDeviceDescription(&Device,&Driver);
+            Bench.SetContext("Adder","Vulkan",Device,Driver);
+            std::string Test = "GPU";
+            if (Batch) Test += " batch";
+            if (Vec4) Test += " vec4";
+            if (InPlace) Test += " in place";
+            if (UseChain) Test += " ops " + Chain.Description();
+            if (Spin > 0) Test += " spin " + std::to_string(Spin);
+            Bench.AddRow(Test,Nx,Ny,LoopStats,&KernelStats);
+        }
+        ReportBandwidth("GPU","overall",Nx,Ny,Nrpt,Msec,PeakGBytes);
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+            ReportBandwidth("GPU","in kernel",Nx,Ny,Nrpt,KernelMsec,PeakGBytes);
+        }
+        if (InvocationsCounted) {
+            uint64_t Needed = uint64_t(GridNx) * uint64_t(Ny);
+            double Wasted = 0.0;
+            if (PassInvocations > Needed) {
+                Wasted = 100.0 * double(PassInvocations - Needed) / double(PassInvocations);
+            }
+            printf ("GPU workgroup %u x %u ran %llu invocations per pass for %llu needed, "
+                      "%.2f%% padding\n",WorkGroupSize[0],WorkGroupSize[1],
+                      (unsigned long long)PassInvocations,(unsigned long long)Needed,Wasted);
+        } else if (Padding && Nrpt > 0) {
+            printf ("GPU workgroup %u x %u (invocations can't be counted on this device)\n",
+                                                           WorkGroupSize[0],WorkGroupSize[1]);
+        }
         if (Nrpt <= 0) {
             printf ("No values computed using GPU, as number of repeats set to zero.\n");
         } else {
-            if (CheckResults(InputArray,Nx,Ny,OutputArray)) {
+            bool Good = false;
+            if (InPlace) Good = CheckInPlaceResults(OutputArray,Nx,Ny,Nrpt);
+            else if (UseChain) Good = CheckChainResults(Chain,InputArray,Nx,Ny,OutputArray);
+            else if (GpuCheck) Good = CheckResultsOnGPU(Framework,InputBufferHndl,InputArray,
+                                                OutputBufferHndl,OutputArray,Nx,Ny,StatusOK);
+            else Good = CheckResults(InputArray,Nx,Ny,OutputArray);
+            if (Good) {
                 printf ("GPU completed OK, all values computed as expected.\n\n");
             } else {
                 printf ("** GPU completes, but with errors **\n\n");
@@ -471,94 +1539,1227 @@ void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,const std::string& Deb
 
     //  Release the arrays used to hold the row addresses for the two arrays.
         
-    if (OutputArray) free(OutputArray);
+    if (OutputArray && OutputArray != InputArray) free(OutputArray);
     if (InputArray) free(InputArray);
     
-    //  The Framework destructor will release all the various Vulkan resources.
+    //  The Framework destructor will release all the various Vulkan resources. If it's the one
+    //  main() keeps for 'Vary', that won't happen until all the combinations have been run, so
+    //  the buffers and the pipeline are released now, and their memory can be used again.
+    //  (What's left - the descriptor pool and command pool - is small.)
+    
+    if (Warm) {
+        for (KVVulkanFramework::KVBufferHandle Hndl : Handles) {
+            bool ReleaseOK = true;
+            Framework.DeleteBuffer(Hndl,ReleaseOK);
+        }
+        Framework.DestroyComputePipeline(ComputePipelineLayout,ComputePipeline);
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                    C P U  c o d e
+//                       C h e c k  R e s u l t s  O n  G P U
 //
-//  This code performs the 'Adder' operation using the CPU, and is designed to do exactly what
-//  ComputeUsingGPU() does, but using the CPU. Just like ComputeUsingGPU(), it is passed the
-//  dimensions, Nx and Ny of the arrays to use. It creates an array of floats, Nx by Ny, and
-//  calls SetInputArray() to initialise it. It also has to create an output array of the same
-//  size and perform the basic 'adder' operation to set the output array values based on those
-//  of the input array. It is also passed the repeat count for the operation (Nrpt) and has to
-//  perform that operation the number of times specified in Nrpt.
-
-//  The basic operation is a really trivial piece of CPU code, shown here in ComputeRangeUsingCPU()
-//  and you could do the whole thing just with one call to ComputeRangeUsingCPU() with the Y-range
-//  parameters Iyst and Iyen set to 0 and Ny respectively. That would handle the whole image using
-//  one CPU thread. And for something this simple, that's probably the fastest thing to do anyway.
-//  However, just to allow some experimentation with CPU multi-threading, the main routine actually
-//  calls OnePassUsingCPU() for each iteration. This then handles the threading, being able to
-//  split the job up so that multiple threads each handle a subset of the rows of the image (ie
-//  splitting up in Y). It starts up a number of threads, each running ComputeRangeUsingCPU()
-//  over a different set of image rows.
+//  This does the same check as CheckResults(), but on the GPU, using AdderCheck.spv, for
+//  'GpuCheck'. For a large array, having the CPU work through the whole of the output array
+//  can take longer than the calculation being checked, while on the GPU the check costs about
+//  as much as one more pass of the calculation. The shader reduces the check to the number of
+//  bad values, the largest difference and the index of the first bad value, and those three
+//  values are all that has to be read back. Only if there is a bad value does the CPU look at
+//  the arrays, to report that one value, just as CheckResults() does.
 //
-//  In practice, for most sensible image sizes, the overheads of starting up multiple threads
-//  will more than soak up the gain from multi-threading the actual operation. But this at lets
-//  you play with this. (Also see Programming notes at the end of this code.)
-
-//  ComputeUsingCPU() is the routine called from the main line code, but the actual work is
-//  done by ComputeRangeUsingCPU(), which processes a range of rows, from Iyst to Iyen (starting
-//  at 0), all in a single thread.
-
-void ComputeRangeUsingCPU(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray)
-{
-    for (int Iy = Iyst; Iy < Iyen; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            OutputArray[Iy][Ix] = InputArray[Iy][Ix] + float(Ix + Iy);
-        }
-    }
-}
-
-//  OnePassUsingCPU() performs one pass through the whole of the input data, splitting up
-//  the work across multiple threads. It will use as many CPU threads as are available, up
-//  to the value of Threads. If Threads is set to zero, it uses all available CPU threads.
+//  It is passed the Framework used for the calculation, the handles of its input and output
+//  buffers, and the row addresses the CPU uses for them. It returns true if all the values
+//  are as expected. If the check can't be run on the GPU, StatusOK is set false, and it falls
+//  back on CheckResults().
 
-int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,float** OutputArray)
+bool CheckResultsOnGPU(KVVulkanFramework& Framework,
+             KVVulkanFramework::KVBufferHandle InputBufferHndl,float** InputArray,
+           KVVulkanFramework::KVBufferHandle OutputBufferHndl,float** OutputArray,int Nx,int Ny,
+                                                                               bool& StatusOK)
 {
-    //  If we're only using one thread, do the calculation in the main thread, avoiding any
-    //  threading overheads.
+    //  The check runs as a KVComputeKernel that uses the existing input and output buffers
+    //  as they are, and adds the buffer for the results. The layout of the arguments has to
+    //  match that defined in AdderCheck.comp.
     
-    if (Threads == 1) {
-        ComputeRangeUsingCPU(InputArray,Nx,0,Ny,OutputArray);
-    } else {
+    struct CheckArgs {
+        int Nx;
+        int Ny;
+    } Args = {Nx,Ny};
+    
+    MsecTimer CheckTimer;
+    KVComputeKernel<CheckArgs> Kernel(Framework);
+    Kernel.UseBuffer(InputBufferHndl,"IN");
+    Kernel.UseBuffer(OutputBufferHndl,"IN");
+    KVVulkanFramework::KVBufferHandle CheckBufferHndl =
+                      Kernel.AddBuffer(C_CheckBufferBinding,"STORAGE","SHARED","OUT",StatusOK);
+    uint32_t* Check = (uint32_t*)Kernel.SizeBuffer(CheckBufferHndl,3 * sizeof(uint32_t),StatusOK);
+    if (StatusOK && Check) {
+        Check[0] = 0;
+        Check[1] = 0;
+        Check[2] = 0xffffffff;
+    }
+    Kernel.Create(C_CheckShader,C_WorkGroupSize,C_WorkGroupSize,StatusOK);
+    Kernel.SetGrid(uint32_t(Nx),uint32_t(Ny));
+    Kernel.Run(Args,StatusOK);
+    if (!StatusOK || Check == nullptr) {
+        printf ("Unable to check the results on the GPU, checking them using the CPU.\n");
+        return CheckResults(InputArray,Nx,Ny,OutputArray);
+    }
+    printf ("GPU check took %.3f msec\n",CheckTimer.ElapsedMsec());
+    
+    //  If there was a bad value, report the first one, and a summary of the rest.
+    
+    bool AllOK = true;
+    if (Check[0] > 0) {
+        int Iy = int(Check[2] / uint32_t(Nx));
+        int Ix = int(Check[2] % uint32_t(Nx));
+        float MaxDiff;
+        memcpy(&MaxDiff,&Check[1],sizeof(float));
+        printf ("*** Error at [%d][%d]. Got %.1f expected %.1f\n",Iy,Ix,
+                                  OutputArray[Iy][Ix],InputArray[Iy][Ix] + float(Ix + Iy));
+        printf ("*** %u values in error, largest difference %g\n",Check[0],MaxDiff);
+        AllOK = false;
+    }
+    return AllOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         G P U  c o d e  ( h a l f  p r e c i s i o n )
+//
+//  ComputeUsingGPUHalf() does the same as ComputeUsingGPU(), but holds the arrays on the GPU in
+//  half precision, using the Adder16.comp shader, so each element read or written is only two
+//  bytes rather than four. The CPU keeps its own input and output arrays as floats, and converts
+//  the input to half precision as it loads it into the GPU buffer, and converts the results
+//  back as it reads them. Those conversions are timed separately from the GPU work. The
+//  operation is limited by memory bandwidth, so halving the bytes moved should make it nearly
+//  twice as fast - at the cost of the precision of the results.
+//
+//  This needs the device to support 16-bit storage buffer access. If it doesn't, this returns
+//  false without doing anything else, and the caller can fall back on ComputeUsingGPU(). It
+//  returns true otherwise, even if something went wrong, as any error will have been reported.
+
+bool ComputeUsingGPUHalf(int Nx,int Ny,int Nrpt,bool Validate,bool Roofline,
+                                                                 const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+    
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU half precision setup starting");
+
+    //  The Vulkan initialisation is just as for ComputeUsingGPU(), but once the device has been
+    //  created we can find out if it supports 16-bit storage.
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    TheDebugHandler.Logf("Setup","GPU device created at %.3f msec",SetupTimer.ElapsedMsec());
+    if (StatusOK && !Framework.DeviceSupports16BitStorage()) {
+        printf ("GPU does not support 16-bit storage, so 'Half' is ignored.\n\n");
+        return false;
+    }
+    
+    //  The largest value involved is the result for the last element of the last row, and
+    //  half precision can't go beyond 65504. (See SetInputArray().)
+    
+    if (double(Nx) + 4.0 * double(Ny) > double(C_HalfMax)) {
+        printf ("Arrays are too large for their values to be held in half precision.\n\n");
+        return true;
+    }
+    
+    double PeakGBytes = 0.0;
+    if (Roofline) {
+        PeakGBytes = Framework.MeasureDeviceBandwidth(StatusOK);
+        printf ("GPU measured peak bandwidth = %.2f GBytes/sec\n",PeakGBytes);
+    }
+
+    //  The CPU's own arrays, as floats.
+    
+    size_t Elements = size_t(Nx) * size_t(Ny);
+    float* InputArrayData = (float*)malloc(Elements * sizeof(float));
+    float* OutputArrayData = (float*)malloc(Elements * sizeof(float));
+    if (InputArrayData == nullptr || OutputArrayData == nullptr) {
+        printf ("Unable to allocate the %d by %d arrays in CPU memory.\n",Nx,Ny);
+        if (OutputArrayData) free(OutputArrayData);
+        if (InputArrayData) free(InputArrayData);
+        return true;
+    }
+    float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+    float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+    SetInputArray(InputArray,Nx,Ny);
+    
+    //  This uses a KVComputeKernel to handle the GPU buffers, descriptor set, pipeline and
+    //  command buffer, which it sets up much as ComputeUsingGPU() does for its simplest case,
+    //  except that the arguments are passed as push constants, and the buffers are half the
+    //  size. The layout of HalfArgs must match the push constant block in Adder16.comp.
+    
+    struct HalfArgs {
+        int Nx;
+        int Ny;
+        int RowOffset;
+    } Parameters = {Nx,Ny,0};
+    KVComputeKernel<HalfArgs> Kernel(Framework);
+    VkDeviceSize Length = VkDeviceSize(Elements) * sizeof(uint16_t);
+    KVVulkanFramework::KVBufferHandle InputBufferHndl =
+                         Kernel.AddBuffer(C_InputBufferBinding,"STORAGE","SHARED","IN",StatusOK);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl =
+                     Kernel.AddBuffer(C_OutputBufferBinding,"STORAGE","READBACK","OUT",StatusOK);
+    uint16_t* InputBufferAddr = (uint16_t*)Kernel.SizeBuffer(InputBufferHndl,Length,StatusOK);
+    uint16_t* OutputBufferAddr = (uint16_t*)Kernel.SizeBuffer(OutputBufferHndl,Length,StatusOK);
+    TheDebugHandler.Logf("Setup","GPU buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+    
+    //  Convert the input array to half precision as it goes into the GPU buffer. This is
+    //  much slower than a simple copy, so the rows are shared out between the pool threads.
+    
+    float UploadMsec = 0.0;
+    if (StatusOK && InputBufferAddr) {
+        MsecTimer UploadTimer;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = InputArray[Iy];
+                uint16_t* Target = InputBufferAddr + size_t(Iy) * size_t(Nx);
+                for (int Ix = 0; Ix < Nx; Ix++) Target[Ix] = FloatToHalf(Row[Ix]);
+            }
+        });
+        UploadMsec = UploadTimer.ElapsedMsec();
+    }
+    
+    TheDebugHandler.Logf("Setup","Using shader %s",C_HalfShader);
+    Kernel.Create(C_HalfShader,C_WorkGroupSize,C_WorkGroupSize,StatusOK);
+    Kernel.SetGrid(uint32_t(Nx),uint32_t(Ny));
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+
+    //  The repeat loop is just as for ComputeUsingGPU() without 'Batch'. The command buffer is
+    //  only recorded the first time, as nothing changes between repeats.
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        Kernel.Run(Parameters,StatusOK);
+        float DispatchMsec;
+        if (Kernel.GetKernelMsec(&DispatchMsec)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        if (!StatusOK) break;
+    }
+    float Msec = ComputeTimer.ElapsedMsec();
+    
+    //  And convert the results back to floats.
+    
+    float ReadbackMsec = 0.0;
+    if (StatusOK && OutputBufferAddr && Nrpt > 0) {
+        MsecTimer ReadbackTimer;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const uint16_t* Source = OutputBufferAddr + size_t(Iy) * size_t(Nx);
+                float* Row = OutputArray[Iy];
+                for (int Ix = 0; Ix < Nx; Ix++) Row[Ix] = HalfToFloat(Source[Ix]);
+            }
+        });
+        ReadbackMsec = ReadbackTimer.ElapsedMsec();
+    }
+    
+    //  Check that we got it right, and report on the timing. The bandwidth is worked out using
+    //  two bytes per element.
+    
+    if (StatusOK) {
+        printf ("GPU (half precision) took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        ReportBandwidth("GPU","overall",Nx,Ny,Nrpt,Msec,PeakGBytes,sizeof(uint16_t));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+            ReportBandwidth("GPU","in kernel",Nx,Ny,Nrpt,KernelMsec,PeakGBytes,
+                                                                            sizeof(uint16_t));
+        }
+        printf ("Conversion to half precision took %.3f msec, and back %.3f msec\n",
+                                                                      UploadMsec,ReadbackMsec);
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            if (CheckHalfResults(InputArray,Nx,Ny,OutputArray)) {
+                printf ("GPU completed OK, all values computed as expected.\n\n");
+            } else {
+                printf ("** GPU completes, but with errors **\n\n");
+            }
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n\n");
+    }
+    
+    //  Release the arrays. The Framework destructor will release all the Vulkan resources.
+    
+    free(OutputArray);
+    free(InputArray);
+    free(OutputArrayData);
+    free(InputArrayData);
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                      C o m p u t e  U s i n g  V u l k a n  B a c k e n d
+//
+//  Used for 'Backend'. This just sets up a VulkanBackend, with the same shader as the default
+//  for ComputeUsingGPU(), and has ComputeUsingBackend() in BackendAdder.h do the rest - the
+//  same code the Metal version of Adder runs with a MetalBackend.
+
+void ComputeUsingVulkanBackend(int Nx,int Ny,int Nrpt,bool Validate,
+                               const std::string& DebugLevels,int Warmup,BenchReport& Bench)
+{
+    bool StatusOK = true;
+    VulkanBackend Backend(Validate,DebugLevels,StatusOK);
+    if (StatusOK) {
+        TraceScope BackendTrace("GPU backend","Adder");
+        ComputeUsingBackend(Backend,C_ScalarShader,Nx,Ny,Nrpt,Warmup,Bench);
+    } else {
+        printf ("Unable to set up the Vulkan backend.\n\n");
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G P U  c o d e  ( s t r e a m i n g )
+//
+//  ComputeUsingGPUStreamed() does the same as ComputeUsingGPU(), but never needs the GPU to hold
+//  the whole of either array. The arrays are in ordinary CPU memory, and are passed through the
+//  GPU in tiles of TileRows rows. There are C_StreamSlots (two) sets of GPU buffers, each able
+//  to hold one tile of input and output, each with its own descriptor set and command buffer.
+//  While the GPU works on the tile in one slot, the CPU copies the results of the last tile
+//  processed in the other slot back into the output array and then copies the next tile of
+//  input into it. That tile is then submitted, and the CPU waits for the first slot to finish
+//  before doing the same for that. So copying in, computing and copying out all overlap, and
+//  the GPU is never left idle waiting for the CPU, unless the copies take longer than the
+//  computation - which, for something as simple as this, they may well do.
+//
+//  Each tile's rows are numbered from zero in the GPU buffers, so the uniform buffer for each
+//  slot also gives the shader the index of the tile's first row in the whole array, which it
+//  adds in to get the right result.
+
+void ComputeUsingGPUStreamed(int Nx,int Ny,int Nrpt,int TileRows,bool Validate,
+                                    bool Vec4,bool Roofline,const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+    
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU streaming setup starting");
+
+    //  The arrays themselves are just in CPU memory. Note the use of size_t, as these can be
+    //  larger than an int can describe in bytes.
+    
+    size_t Elements = size_t(Nx) * size_t(Ny);
+    float* InputArrayData = (float*)malloc(Elements * sizeof(float));
+    float* OutputArrayData = (float*)malloc(Elements * sizeof(float));
+    if (InputArrayData == nullptr || OutputArrayData == nullptr) {
+        printf ("Unable to allocate the %d by %d arrays in CPU memory.\n",Nx,Ny);
+        if (OutputArrayData) free(OutputArrayData);
+        if (InputArrayData) free(InputArrayData);
+        return;
+    }
+    float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+    float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+    SetInputArray(InputArray,Nx,Ny);
+    
+    //  Work out the tile size, if not specified. A tile is never more than the whole array.
+    
+    if (TileRows <= 0) {
+        TileRows = int(C_DefaultTileBytes / (long(Nx) * long(sizeof(float))));
+        if (TileRows < 1) TileRows = 1;
+    }
+    if (TileRows > Ny) TileRows = Ny;
+    int Tiles = (Ny + TileRows - 1) / TileRows;
+    VkDeviceSize TileBytes = VkDeviceSize(TileRows) * VkDeviceSize(Nx) * sizeof(float);
+    TheDebugHandler.Logf("Setup","Streaming %d tiles of %d rows, %llu bytes",
+                                              Tiles,TileRows,(unsigned long long)TileBytes);
+
+    //  The Vulkan initialisation is just as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    TheDebugHandler.Logf("Setup","GPU device created at %.3f msec",SetupTimer.ElapsedMsec());
+    double PeakGBytes = 0.0;
+    if (Roofline) {
+        PeakGBytes = Framework.MeasureDeviceBandwidth(StatusOK);
+        printf ("GPU measured peak bandwidth = %.2f GBytes/sec\n",PeakGBytes);
+    }
+
+    //  The parameters for the shader, as in ComputeUsingGPU(). Each slot has its own copy.
+    
+    struct AdderArgs {
+        int Nx;
+        int Ny;
+        int RowOffset;
+    };
+    
+    //  Now the buffers for each slot, and the descriptor sets that describe them. All the sets
+    //  have the same layout, so the first slot's buffers are used to create that, and the one
+    //  pool provides all the sets.
+    
+    struct StreamSlot {
+        KVVulkanFramework::KVBufferHandle InputBufferHndl;
+        KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+        KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+        float* InputAddr;
+        float* OutputAddr;
+        AdderArgs* ArgsAddr;
+        VkDescriptorSet DescriptorSet;
+        VkCommandBuffer CommandBuffer;
+        KVVulkanFramework::KVSubmitTicket Ticket;
+        int Tile;
+    } Slots[C_StreamSlots];
+    for (StreamSlot& Slot : Slots) {
+        Slot.Ticket = KVVulkanFramework::KV_NULL_TICKET;
+        Slot.Tile = -1;
+    }
+    
+    VkDeviceSize Bytes;
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+    VkCommandPool CommandPool;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    for (int Islot = 0; Islot < C_StreamSlots; Islot++) {
+        StreamSlot& Slot = Slots[Islot];
+        Slot.InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(Slot.InputBufferHndl,TileBytes,StatusOK);
+        Slot.InputAddr = (float*)Framework.MapBuffer(Slot.InputBufferHndl,&Bytes,StatusOK);
+        Slot.OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+        Framework.CreateBuffer(Slot.OutputBufferHndl,TileBytes,StatusOK);
+        Slot.OutputAddr = (float*)Framework.MapBuffer(Slot.OutputBufferHndl,&Bytes,StatusOK);
+        Slot.UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                                  "UNIFORM","SHARED",StatusOK);
+        Framework.CreateBuffer(Slot.UniformBufferHndl,sizeof(AdderArgs),StatusOK);
+        Slot.ArgsAddr = (AdderArgs*)Framework.MapBuffer(Slot.UniformBufferHndl,&Bytes,StatusOK);
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles = {Slot.UniformBufferHndl,
+                                                   Slot.InputBufferHndl,Slot.OutputBufferHndl};
+        if (Islot == 0) {
+            Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+            Framework.CreateVulkanDescriptorPool(Handles,C_StreamSlots,&DescriptorPool,StatusOK);
+        }
+        Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&Slot.DescriptorSet,
+                                                                                     StatusOK);
+        Framework.SetupVulkanDescriptorSet(Handles,Slot.DescriptorSet,StatusOK);
+        Framework.CreateComputeCommandBuffer(CommandPool,&Slot.CommandBuffer,StatusOK);
+        Framework.SetCommandBufferReusable(Slot.CommandBuffer,true,StatusOK);
+        if (!StatusOK) break;
+    }
+    TheDebugHandler.Logf("Setup","GPU tile buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+
+    //  The pipeline uses the default workgroup size, and the workgroup counts cover a whole
+    //  tile. The last tile may be shorter, but the shader ignores rows past the Ny it's given,
+    //  and keeping the counts the same means the command buffers never need re-recording.
+
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1]};
+    const char* ShaderName = Vec4 ? C_Vec4Shader : C_ScalarShader;
+    Framework.CreateComputePipeline(ShaderName,"main",&SetLayout,&ComputePipelineLayout,
+                                                   &ComputePipeline,SpecConstants,StatusOK);
+    KVVulkanFramework::KVDispatch Dispatch;
+    Dispatch.PipelineHndl = ComputePipeline;
+    Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+    Dispatch.WorkGroupCounts[0] = (GridWidth(Nx,Vec4) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    Dispatch.WorkGroupCounts[1] = (uint32_t(TileRows) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+    Dispatch.WorkGroupCounts[2] = 1;
+    Dispatch.PushConstants = nullptr;
+    Dispatch.PushConstantSize = 0;
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    //  Each repeat streams every tile through the GPU. Tile numbers run on from one repeat
+    //  to the next, so the slots just keep alternating. Before a slot is reused, its previous
+    //  tile has to have finished, and its results copied out. Then the next tile is copied in
+    //  and submitted. At the end, the tiles still in progress are waited for and copied out.
+    
+    MsecTimer ComputeTimer;
+    int TotalTiles = Tiles * Nrpt;
+    for (int Itile = 0; Itile < TotalTiles + C_StreamSlots && StatusOK; Itile++) {
+        StreamSlot& Slot = Slots[Itile % C_StreamSlots];
+        if (Slot.Ticket != KVVulkanFramework::KV_NULL_TICKET) {
+            Framework.WaitFor(Slot.Ticket,StatusOK);
+            Framework.InvalidateBuffer(Slot.OutputBufferHndl,StatusOK);
+            Slot.Ticket = KVVulkanFramework::KV_NULL_TICKET;
+            if (!StatusOK) break;
+            int FirstRow = (Slot.Tile % Tiles) * TileRows;
+            int Rows = std::min(TileRows,Ny - FirstRow);
+            memcpy(OutputArray[FirstRow],Slot.OutputAddr,size_t(Rows) * Nx * sizeof(float));
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"Tile %d read back at %.3f msec",Slot.Tile,
+                                                                ComputeTimer.ElapsedMsec());
+        }
+        if (Itile < TotalTiles) {
+            int FirstRow = (Itile % Tiles) * TileRows;
+            int Rows = std::min(TileRows,Ny - FirstRow);
+            memcpy(Slot.InputAddr,InputArray[FirstRow],size_t(Rows) * Nx * sizeof(float));
+            Slot.ArgsAddr->Nx = Nx;
+            Slot.ArgsAddr->Ny = Rows;
+            Slot.ArgsAddr->RowOffset = FirstRow;
+            std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {Slot.InputBufferHndl};
+            std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {Slot.OutputBufferHndl};
+            Dispatch.DescriptorSetHndl = Slot.DescriptorSet;
+            std::vector<KVVulkanFramework::KVDispatch> Dispatches = {Dispatch};
+            Framework.RecordComputeBatch(Slot.CommandBuffer,Dispatches,SyncBefore,SyncAfter,
+                                                                                     StatusOK);
+            Slot.Ticket = Framework.SubmitCommandBuffer(ComputeQueue,Slot.CommandBuffer,StatusOK);
+            Slot.Tile = Itile;
+        }
+    }
+    
+    //  Check that we got it right, and if so report on the timing.
+        
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU (streaming %d tiles of %d rows) took %.3f msec\n",Tiles,TileRows,Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        ReportBandwidth("GPU","including copies",Nx,Ny,Nrpt,Msec,PeakGBytes);
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            if (CheckResults(InputArray,Nx,Ny,OutputArray)) {
+                printf ("GPU completed OK, all values computed as expected.\n\n");
+            } else {
+                printf ("** GPU completes, but with errors **\n\n");
+            }
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n\n");
+    }
+
+    //  Release the arrays. The Framework destructor will release all the Vulkan resources.
         
-        //  If threading, create the specified number of threads, and divide the image rows
-        //  between them.
+    free(OutputArray);
+    free(InputArray);
+    free(OutputArrayData);
+    free(InputArrayData);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        G P U  c o d e  ( m u l t i p l e  q u e u e s )
+//
+//  ComputeUsingGPUQueues() is used for 'Queues'. It asks the Framework for up to MaxQueues
+//  queues from the compute family, and then, for each number of queues from one up to as many
+//  as the device actually provides, splits the rows of the arrays into that many bands and has
+//  a separate CPU thread submit each band to its own queue, Nrpt times, waiting for each pass to
+//  finish before submitting the next. The time for all the threads to finish is compared with
+//  the time using one queue, which shows whether the GPU gains anything from work submitted to
+//  several queues at once. That varies a lot from one GPU to another, and is most likely to
+//  help when each dispatch is too small to keep the whole GPU busy on its own.
+//
+//  Each band has its own buffers, with its rows numbered from zero, and - as when streaming -
+//  the uniform buffer for each band gives the shader the index of its first row in the whole
+//  array. Band Iq is only used when there are more than Iq queues, so never has more than
+//  Ny / (Iq + 1) rows (rounded up), and the buffers for all the bands come to only a few times
+//  the size of the arrays. Each thread records its band's command buffer, using its own command
+//  pool, before the timing starts, and then just resubmits it.
+
+void ComputeUsingGPUQueues(int Nx,int Ny,int Nrpt,int MaxQueues,bool Validate,bool Vec4,
+                                                                const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+    
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU multiple queue setup starting");
+
+    //  The arrays themselves are just in CPU memory, as when streaming.
+    
+    size_t Elements = size_t(Nx) * size_t(Ny);
+    float* InputArrayData = (float*)malloc(Elements * sizeof(float));
+    float* OutputArrayData = (float*)malloc(Elements * sizeof(float));
+    if (InputArrayData == nullptr || OutputArrayData == nullptr) {
+        printf ("Unable to allocate the %d by %d arrays in CPU memory.\n",Nx,Ny);
+        if (OutputArrayData) free(OutputArrayData);
+        if (InputArrayData) free(InputArrayData);
+        return;
+    }
+    float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+    float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+    SetInputArray(InputArray,Nx,Ny);
+    
+    //  The Vulkan initialisation is just as for ComputeUsingGPU(), except that the Framework is
+    //  asked for the extra queues before the logical device is created. There can't be more
+    //  queues than rows.
+    
+    if (MaxQueues > Ny) MaxQueues = Ny;
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.SetComputeQueueCount(MaxQueues,StatusOK);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    int Queues = StatusOK ? Framework.GetComputeQueueCount() : 0;
+    if (StatusOK && Queues < MaxQueues) {
+        printf ("%d queues requested, but the compute queue family only provides %d.\n",
+                                                                            MaxQueues,Queues);
+    }
+    TheDebugHandler.Logf("Setup","GPU device created at %.3f msec",SetupTimer.ElapsedMsec());
+
+    //  The parameters for the shader, as in ComputeUsingGPUStreamed(). Each band has its own.
+    
+    struct AdderArgs {
+        int Nx;
+        int Ny;
+        int RowOffset;
+    };
+    
+    //  The buffers for each band, and the descriptor set that describes them. All the sets
+    //  have the same layout, so the first band's buffers are used to create that, and the one
+    //  pool provides all the sets.
+    
+    struct QueueBand {
+        KVVulkanFramework::KVBufferHandle InputBufferHndl;
+        KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+        KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+        float* InputAddr;
+        float* OutputAddr;
+        AdderArgs* ArgsAddr;
+        VkDescriptorSet DescriptorSet;
+        VkQueue Queue;
+        int FirstRow;
+        int Rows;
+    };
+    std::vector<QueueBand> Bands(Queues);
+    
+    VkDeviceSize Bytes;
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+    for (int Iq = 0; Iq < Queues; Iq++) {
+        QueueBand& Band = Bands[Iq];
+        int MaxRows = (Ny + Iq) / (Iq + 1);
+        VkDeviceSize BandBytes = VkDeviceSize(MaxRows) * VkDeviceSize(Nx) * sizeof(float);
+        Band.InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(Band.InputBufferHndl,BandBytes,StatusOK);
+        Band.InputAddr = (float*)Framework.MapBuffer(Band.InputBufferHndl,&Bytes,StatusOK);
+        Band.OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+        Framework.CreateBuffer(Band.OutputBufferHndl,BandBytes,StatusOK);
+        Band.OutputAddr = (float*)Framework.MapBuffer(Band.OutputBufferHndl,&Bytes,StatusOK);
+        Band.UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                                  "UNIFORM","SHARED",StatusOK);
+        Framework.CreateBuffer(Band.UniformBufferHndl,sizeof(AdderArgs),StatusOK);
+        Band.ArgsAddr = (AdderArgs*)Framework.MapBuffer(Band.UniformBufferHndl,&Bytes,StatusOK);
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles = {Band.UniformBufferHndl,
+                                                   Band.InputBufferHndl,Band.OutputBufferHndl};
+        if (Iq == 0) {
+            Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+            Framework.CreateVulkanDescriptorPool(Handles,Queues,&DescriptorPool,StatusOK);
+        }
+        Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&Band.DescriptorSet,
+                                                                                     StatusOK);
+        Framework.SetupVulkanDescriptorSet(Handles,Band.DescriptorSet,StatusOK);
+        Framework.GetComputeQueue(Iq,&Band.Queue,StatusOK);
+        if (!StatusOK) break;
+    }
+    TheDebugHandler.Logf("Setup","GPU band buffers created at %.3f msec",
+                                                                   SetupTimer.ElapsedMsec());
+
+    //  The pipeline uses the default workgroup size. Each band's workgroup counts are set when
+    //  its command buffer is recorded, since they depend on how many rows it has.
+
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1]};
+    const char* ShaderName = Vec4 ? C_Vec4Shader : C_ScalarShader;
+    Framework.CreateComputePipeline(ShaderName,"main",&SetLayout,&ComputePipelineLayout,
+                                                   &ComputePipeline,SpecConstants,StatusOK);
+    KVVulkanFramework::KVDispatch Dispatch;
+    Dispatch.PipelineHndl = ComputePipeline;
+    Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+    Dispatch.WorkGroupCounts[0] = (GridWidth(Nx,Vec4) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    Dispatch.WorkGroupCounts[1] = 1;
+    Dispatch.WorkGroupCounts[2] = 1;
+    Dispatch.PushConstants = nullptr;
+    Dispatch.PushConstantSize = 0;
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Queues = 0;
+    }
+    
+    //  What each thread does with its band. It records the band's command buffer, using its
+    //  own command pool, and then waits for the others to be ready, so that the timing covers
+    //  only the submissions. Whatever happens, it has to count itself as ready, or the main
+    //  thread would wait for it for ever.
+    
+    std::atomic<int> Ready(0);
+    std::atomic<bool> Go(false);
+    auto RunBand = [&](int Iq,char* BandOK) {
+        QueueBand& Band = Bands[Iq];
+        bool ThreadOK = true;
+        VkCommandPool CommandPool = Framework.GetThreadCommandPool("COMPUTE",ThreadOK);
+        VkCommandBuffer CommandBuffer;
+        Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,ThreadOK);
+        Framework.SetCommandBufferReusable(CommandBuffer,true,ThreadOK);
+        KVVulkanFramework::KVDispatch BandDispatch = Dispatch;
+        BandDispatch.DescriptorSetHndl = Band.DescriptorSet;
+        BandDispatch.WorkGroupCounts[1] = (uint32_t(Band.Rows) + WorkGroupSize[1] - 1) /
+                                                                            WorkGroupSize[1];
+        std::vector<KVVulkanFramework::KVDispatch> Dispatches = {BandDispatch};
+        std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {Band.InputBufferHndl};
+        std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {Band.OutputBufferHndl};
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,ThreadOK);
+        Ready++;
+        while (!Go) std::this_thread::yield();
+        for (int Irpt = 0; Irpt < Nrpt && ThreadOK; Irpt++) {
+            KVVulkanFramework::KVSubmitTicket Ticket =
+                                 Framework.SubmitCommandBuffer(Band.Queue,CommandBuffer,ThreadOK);
+            Framework.WaitFor(Ticket,ThreadOK);
+        }
+        Framework.ReleaseThreadCommandPools(ThreadOK);
+        *BandOK = ThreadOK;
+    };
+    
+    //  Now the runs themselves, one for each number of queues. Each band's input is copied
+    //  into its buffer before the run, and its results copied out afterwards, and neither is
+    //  included in the time. The bandwidth is that of the whole array, as for the other modes.
+    
+    float OneQueueMsec = 0.0;
+    if (Queues > 0) {
+        printf ("%-8s %12s %14s %14s %10s\n","Queues","Total msec","Msec/iteration",
+                                                                       "GBytes/sec","Speedup");
+    }
+    for (int Used = 1; Used <= Queues && StatusOK; Used++) {
+        for (int Iq = 0; Iq < Used; Iq++) {
+            QueueBand& Band = Bands[Iq];
+            Band.FirstRow = int(long(Ny) * long(Iq) / long(Used));
+            Band.Rows = int(long(Ny) * long(Iq + 1) / long(Used)) - Band.FirstRow;
+            memcpy(Band.InputAddr,InputArray[Band.FirstRow],
+                                                    size_t(Band.Rows) * Nx * sizeof(float));
+            Band.ArgsAddr->Nx = Nx;
+            Band.ArgsAddr->Ny = Band.Rows;
+            Band.ArgsAddr->RowOffset = Band.FirstRow;
+        }
+        memset(OutputArrayData,0,Elements * sizeof(float));
+        Ready = 0;
+        Go = false;
+        std::vector<char> BandOK(Used,0);
+        std::vector<std::thread> Threads;
+        for (int Iq = 0; Iq < Used; Iq++) {
+            Threads.push_back(std::thread(RunBand,Iq,&BandOK[Iq]));
+        }
+        while (Ready < Used) std::this_thread::yield();
+        MsecTimer RunTimer;
+        Go = true;
+        for (std::thread& Thread : Threads) Thread.join();
+        float Msec = RunTimer.ElapsedMsec();
+        for (int Iq = 0; Iq < Used; Iq++) {
+            if (!BandOK[Iq]) StatusOK = false;
+        }
+        if (!StatusOK) break;
+        for (int Iq = 0; Iq < Used; Iq++) {
+            QueueBand& Band = Bands[Iq];
+            Framework.InvalidateBuffer(Band.OutputBufferHndl,StatusOK);
+            memcpy(OutputArray[Band.FirstRow],Band.OutputAddr,
+                                                    size_t(Band.Rows) * Nx * sizeof(float));
+        }
+        if (Used == 1) OneQueueMsec = Msec;
+        double GBytes = 0.0;
+        if (Msec > 0.0) GBytes = 2.0 * double(Elements) * sizeof(float) * Nrpt / (Msec * 1.0e6);
+        float Speedup = (Msec > 0.0) ? OneQueueMsec / Msec : 0.0;
+        printf ("%-8d %12.3f %14.3f %14.2f %10.2f\n",Used,Msec,
+                                     Nrpt > 0 ? Msec / float(Nrpt) : 0.0,GBytes,Speedup);
+        if (Nrpt > 0 && !CheckResults(InputArray,Nx,Ny,OutputArray)) {
+            printf ("** GPU completes using %d queues, but with errors **\n",Used);
+        }
+    }
+    if (StatusOK && Queues > 0) {
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n\n");
+        } else {
+            printf ("Speedup is relative to one queue, each pass waited for before the next.\n\n");
+        }
+    } else if (Nrpt > 0) {
+        printf ("GPU execution failed.\n\n");
+    }
+
+    //  Release the arrays. The Framework destructor will release all the Vulkan resources.
         
-        std::thread* ThreadList = new std::thread[Threads];
-        int Iy = 0;
-        int Iyinc = Ny / Threads;
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread] = std::thread (ComputeRangeUsingCPU,
-                                               InputArray,Nx,Iy,Iy+Iyinc,OutputArray);
-            Iy += Iyinc;
+    free(OutputArray);
+    free(InputArray);
+    free(OutputArrayData);
+    free(InputArrayData);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        G P U  c o d e  ( b u f f e r  m o d e s )
+//
+//  SweepBufferModes() runs the same GPU operation as ComputeUsingGPU(), for each combination of
+//  the buffer access modes that make sense for the input and output arrays, and for a range of
+//  array sizes, halving Nx and Ny each time down to 256 (or to the specified size if that is
+//  smaller). The input array is written by the CPU and read by the GPU, so can be "SHARED" or
+//  "STAGED_CPU". The output array is written by the GPU and read by the CPU, so can be "SHARED",
+//  "READBACK" or "STAGED_GPU". (A "STAGED_GPU" input or "STAGED_CPU" output would be synched
+//  the wrong way.) Everything is done with one Framework and one device, so only the buffers
+//  change from one run to the next - the layout, descriptor set and pipeline are set up once
+//  and reused.
+//
+//  For each run it prints the time taken to create the buffers and set the input values (setup),
+//  the GPU time spent in the buffer syncs and in the shader per iteration - measured using GPU
+//  timestamps - and the overall time per iteration, as measured by the CPU.
+
+void SweepBufferModes(int Nx,int Ny,int Nrpt,bool Validate,const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+    
+    const std::vector<std::string> InputModes = {"SHARED","STAGED_CPU"};
+    const std::vector<std::string> OutputModes = {"SHARED","READBACK","STAGED_GPU"};
+    
+    //  The sizes to use, smallest first.
+    
+    std::vector<int> SizesX,SizesY;
+    int Sx = Nx;
+    int Sy = Ny;
+    do {
+        SizesX.insert(SizesX.begin(),Sx);
+        SizesY.insert(SizesY.begin(),Sy);
+        Sx /= 2;
+        Sy /= 2;
+    } while (Sx >= 256 && Sy >= 256);
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    //  The uniform buffer with the array dimensions can be the same for all runs.
+    
+    struct AdderArgs {
+        int Nx;
+        int Ny;
+        int RowOffset;
+    };
+    VkDeviceSize Bytes;
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(AdderArgs),StatusOK);
+    AdderArgs* ArgsAddr = (AdderArgs*)Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    Framework.SetCommandBufferReusable(CommandBuffer,true,StatusOK);
+    Framework.EnableDispatchTiming(true,StatusOK);
+    
+    //  These are set up for the first run, and then reused.
+    
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout ComputePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline ComputePipeline = VK_NULL_HANDLE;
+    
+    if (!StatusOK) {
+        printf("GPU setup failed.\n");
+        return;
+    }
+    printf ("Buffer access mode sweep, %d repeats. Times in msec, per iteration except setup.\n\n",
+                                                                                         Nrpt);
+    printf ("      Nx       Ny  Input       Output        Setup     Sync  Compute    Total\n");
+    
+    for (size_t Isize = 0; Isize < SizesX.size() && StatusOK; Isize++) {
+        int SizeX = SizesX[Isize];
+        int SizeY = SizesY[Isize];
+        ArgsAddr->Nx = SizeX;
+        ArgsAddr->Ny = SizeY;
+        ArgsAddr->RowOffset = 0;
+        VkDeviceSize Length = VkDeviceSize(SizeX) * VkDeviceSize(SizeY) * sizeof(float);
+        for (const std::string& InputMode : InputModes) {
+            for (const std::string& OutputMode : OutputModes) {
+                
+                //  Create the two buffers, and set the input values.
+                
+                MsecTimer SetupTimer;
+                KVVulkanFramework::KVBufferHandle InputBufferHndl =
+                   Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",InputMode,StatusOK);
+                Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+                float* InputAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+                KVVulkanFramework::KVBufferHandle OutputBufferHndl =
+                 Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",OutputMode,StatusOK);
+                Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+                float* OutputAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+                if (!StatusOK) break;
+                float** InputArray = CreateRowAddrs(InputAddr,SizeX,SizeY);
+                float** OutputArray = CreateRowAddrs(OutputAddr,SizeX,SizeY);
+                SetInputArray(InputArray,SizeX,SizeY);
+                
+                std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                                         {UniformBufferHndl,InputBufferHndl,OutputBufferHndl};
+                if (SetLayout == VK_NULL_HANDLE) {
+                    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+                    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+                    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,
+                                                                     &DescriptorSet,StatusOK);
+                    std::vector<uint32_t> SpecConstants = {C_WorkGroupSize,C_WorkGroupSize};
+                    Framework.CreateComputePipeline(C_ScalarShader,"main",&SetLayout,
+                        &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+                }
+                Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+                float SetupMsec = SetupTimer.ElapsedMsec();
+                
+                //  The buffers are new, so the command buffer has to be recorded afresh.
+                
+                Framework.InvalidateRecordings();
+                KVVulkanFramework::KVDispatch Dispatch;
+                Dispatch.PipelineHndl = ComputePipeline;
+                Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+                Dispatch.DescriptorSetHndl = DescriptorSet;
+                Dispatch.WorkGroupCounts[0] = (uint32_t(SizeX) + C_WorkGroupSize - 1) /
+                                                                             C_WorkGroupSize;
+                Dispatch.WorkGroupCounts[1] = (uint32_t(SizeY) + C_WorkGroupSize - 1) /
+                                                                             C_WorkGroupSize;
+                Dispatch.WorkGroupCounts[2] = 1;
+                Dispatch.PushConstants = nullptr;
+                Dispatch.PushConstantSize = 0;
+                std::vector<KVVulkanFramework::KVDispatch> Dispatches = {Dispatch};
+                std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl};
+                std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {OutputBufferHndl};
+                
+                float SyncMsec = 0.0;
+                float KernelMsec = 0.0;
+                bool Timed = false;
+                MsecTimer ComputeTimer;
+                for (int Irpt = 0; Irpt < Nrpt && StatusOK; Irpt++) {
+                    Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,
+                                                                                     StatusOK);
+                    Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+                    Framework.InvalidateBuffer(OutputBufferHndl,StatusOK);
+                    float BeforeMsec,DispatchMsec,AfterMsec;
+                    if (Framework.GetDispatchTimes(&BeforeMsec,&DispatchMsec,&AfterMsec,
+                                                                                 StatusOK)) {
+                        SyncMsec += BeforeMsec + AfterMsec;
+                        KernelMsec += DispatchMsec;
+                        Timed = true;
+                    }
+                }
+                float TotalMsec = ComputeTimer.ElapsedMsec();
+                
+                //  Report, flagging any run that got the wrong answer.
+                
+                if (StatusOK && Nrpt > 0) {
+                    bool Correct = CheckResults(InputArray,SizeX,SizeY,OutputArray);
+                    float Per = 1.0 / float(Nrpt);
+                    if (Timed) {
+                        printf ("%8d %8d  %-11s %-11s %8.3f %8.3f %8.3f %8.3f%s\n",SizeX,SizeY,
+                           InputMode.c_str(),OutputMode.c_str(),SetupMsec,SyncMsec * Per,
+                              KernelMsec * Per,TotalMsec * Per,Correct ? "" : "  ** Errors **");
+                    } else {
+                        printf ("%8d %8d  %-11s %-11s %8.3f %8s %8s %8.3f%s\n",SizeX,SizeY,
+                           InputMode.c_str(),OutputMode.c_str(),SetupMsec,"-","-",
+                                          TotalMsec * Per,Correct ? "" : "  ** Errors **");
+                    }
+                }
+                
+                //  Release the buffers, ready for the next run.
+                
+                free(OutputArray);
+                free(InputArray);
+                Framework.DeleteBuffer(OutputBufferHndl,StatusOK);
+                Framework.DeleteBuffer(InputBufferHndl,StatusOK);
+            }
         }
-        
-        //  Wait for all the threads to complete.
-        
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread].join();
+    }
+    if (!StatusOK) printf ("GPU execution failed.\n");
+    printf ("\n");
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ReportBandwidth() prints the memory bandwidth achieved given the time taken for all the
+//  repeats. Each pass reads the input array and writes the output array, so moves 8 bytes for
+//  each element. Device is "GPU" or "CPU" and What describes what the time covers. If a
+//  measured peak bandwidth is supplied (PeakGBytes non-zero), the bandwidth is also given as
+//  a percentage of that.
+
+void ReportBandwidth(const char* Device,const char* What,int Nx,int Ny,int Nrpt,float Msec,
+                                                           double PeakGBytes,int ValueBytes)
+{
+    if (Nrpt > 0 && Msec > 0.0) {
+        double Bytes = 2.0 * double(Nx) * double(Ny) * double(ValueBytes) * double(Nrpt);
+        double GBytes = Bytes / (double(Msec) * 1.0e6);
+        if (PeakGBytes > 0.0) {
+            printf ("%s bandwidth (%s) = %.2f GBytes/sec, %.1f%% of peak\n",Device,What,
+                                                        GBytes,100.0 * GBytes / PeakGBytes);
+        } else {
+            printf ("%s bandwidth (%s) = %.2f GBytes/sec\n",Device,What,GBytes);
         }
-	delete[] ThreadList;
-        
-        //  If there were rows left unhandled (because Ny was not a multiple of NThreads),
-        //  finish them off in the main thread.
-        
-        if (Iy < Ny) {
-            ComputeRangeUsingCPU(InputArray,Nx,Iy,Ny,OutputArray);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    C P U  c o d e
+//
+//  This code performs the 'Adder' operation using the CPU, and is designed to do exactly what
+//  ComputeUsingGPU() does, but using the CPU. Just like ComputeUsingGPU(), it is passed the
+//  dimensions, Nx and Ny of the arrays to use. It creates an array of floats, Nx by Ny, and
+//  calls SetInputArray() to initialise it. It also has to create an output array of the same
+//  size and perform the basic 'adder' operation to set the output array values based on those
+//  of the input array. It is also passed the repeat count for the operation (Nrpt) and has to
+//  perform that operation the number of times specified in Nrpt.
+
+//  The basic operation is a really trivial piece of CPU code, shown here in ComputeRangeUsingCPU()
+//  and you could do the whole thing just with one call to ComputeRangeUsingCPU() with the Y-range
+//  parameters Iyst and Iyen set to 0 and Ny respectively. That would handle the whole image using
+//  one CPU thread. And for something this simple, that's probably the fastest thing to do anyway.
+//  However, just to allow some experimentation with CPU multi-threading, the main routine actually
+//  calls OnePassUsingCPU() for each iteration. This then handles the threading, being able to
+//  split the job up so that multiple threads each handle a subset of the rows of the image (ie
+//  splitting up in Y). It starts up a number of threads, each running ComputeRangeUsingCPU()
+//  over a different set of image rows.
+//
+//  In practice, for most sensible image sizes, the overheads of starting up multiple threads
+//  will more than soak up the gain from multi-threading the actual operation. But this at lets
+//  you play with this. (Also see Programming notes at the end of this code.)
+
+//  ComputeUsingCPU() is the routine called from the main line code, but the actual work is
+//  done by ComputeRangeUsingCPU(), which processes a range of rows, from Iyst to Iyen (starting
+//  at 0), all in a single thread.
+
+void ComputeRangeUsingCPU(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray)
+{
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            OutputArray[Iy][Ix] = InputArray[Iy][Ix] + float(Ix + Iy);
+        }
+    }
+}
+
+//                               I n c l u d e  F i l e s
+//
+//  Needed for the vector versions of the CPU code.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ADDER_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define ADDER_NEON_SIMD
+#include <arm_neon.h>
+#endif
+#include <ctype.h>
+
+//  The vector versions of ComputeRangeUsingCPU() do exactly the same as the scalar version,
+//  but handle 8 (AVX2), 16 (AVX-512) or 4 (NEON) elements of a row at a time. The values to be
+//  added, Ix + Iy, form a ramp along the row, so rather than convert each index to float, they
+//  keep a vector holding the ramp values for the current elements, and just add the vector
+//  width to it each time. (The values are whole numbers well below 2^24, so this is exact.) Any
+//  elements left over at the end of a row are handled one at a time. With gcc and clang, the
+//  x86 versions are compiled for their instruction sets using the 'target' attribute, rather
+//  than by compiling the whole program for them, so the program still runs on older CPUs -
+//  they just never get called there. See SelectCPURange().
+
+#if defined(ADDER_X86_SIMD) && defined(__GNUC__)
+#define ADDER_TARGET(Isa) __attribute__((target(Isa)))
+#else
+#define ADDER_TARGET(Isa)
+#endif
+
+#ifdef ADDER_X86_SIMD
+
+ADDER_TARGET("avx2")
+void ComputeRangeUsingAVX2(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray)
+{
+    const __m256 Step = _mm256_set1_ps(8.0f);
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* InRow = InputArray[Iy];
+        float* OutRow = OutputArray[Iy];
+        __m256 Ramp = _mm256_add_ps(_mm256_setr_ps(0.0f,1.0f,2.0f,3.0f,4.0f,5.0f,6.0f,7.0f),
+                                                            _mm256_set1_ps(float(Iy)));
+        int Ix = 0;
+        for (; Ix + 8 <= Nx; Ix += 8) {
+            _mm256_storeu_ps(OutRow + Ix,_mm256_add_ps(_mm256_loadu_ps(InRow + Ix),Ramp));
+            Ramp = _mm256_add_ps(Ramp,Step);
+        }
+        for (; Ix < Nx; Ix++) OutRow[Ix] = InRow[Ix] + float(Ix + Iy);
+    }
+}
+
+ADDER_TARGET("avx512f")
+void ComputeRangeUsingAVX512(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray)
+{
+    const __m512 Step = _mm512_set1_ps(16.0f);
+    const __m512 Lanes = _mm512_setr_ps(0.0f,1.0f,2.0f,3.0f,4.0f,5.0f,6.0f,7.0f,
+                                        8.0f,9.0f,10.0f,11.0f,12.0f,13.0f,14.0f,15.0f);
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* InRow = InputArray[Iy];
+        float* OutRow = OutputArray[Iy];
+        __m512 Ramp = _mm512_add_ps(Lanes,_mm512_set1_ps(float(Iy)));
+        int Ix = 0;
+        for (; Ix + 16 <= Nx; Ix += 16) {
+            _mm512_storeu_ps(OutRow + Ix,_mm512_add_ps(_mm512_loadu_ps(InRow + Ix),Ramp));
+            Ramp = _mm512_add_ps(Ramp,Step);
+        }
+        for (; Ix < Nx; Ix++) OutRow[Ix] = InRow[Ix] + float(Ix + Iy);
+    }
+}
+
+#endif
+
+#ifdef ADDER_NEON_SIMD
+
+void ComputeRangeUsingNEON(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray)
+{
+    static const float LaneValues[4] = {0.0f,1.0f,2.0f,3.0f};
+    const float32x4_t Step = vdupq_n_f32(4.0f);
+    const float32x4_t Lanes = vld1q_f32(LaneValues);
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* InRow = InputArray[Iy];
+        float* OutRow = OutputArray[Iy];
+        float32x4_t Ramp = vaddq_f32(Lanes,vdupq_n_f32(float(Iy)));
+        int Ix = 0;
+        for (; Ix + 4 <= Nx; Ix += 4) {
+            vst1q_f32(OutRow + Ix,vaddq_f32(vld1q_f32(InRow + Ix),Ramp));
+            Ramp = vaddq_f32(Ramp,Step);
         }
+        for (; Ix < Nx; Ix++) OutRow[Ix] = InRow[Ix] + float(Ix + Iy);
+    }
+}
+
+#endif
+
+//  All the versions of the routine have the same arguments, so OnePassUsingCPU() can be passed
+//  whichever is to be used.
+
+typedef void (*CPURangeRoutine)(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray);
+
+//  CPUSupports() returns true if the CPU being used supports a given set of vector instructions,
+//  "AVX2", "AVX512" or "NEON". (NEON is a standard part of 64-bit ARM, so is always there.)
+
+bool CPUSupports(const std::string& Isa)
+{
+    bool Supported = false;
+#ifdef ADDER_X86_SIMD
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (Isa == "AVX2") Supported = __builtin_cpu_supports("avx2");
+    if (Isa == "AVX512") Supported = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER)
+    
+    //  CPUID leaf 7 gives the instruction set bits, but the operating system also has to be
+    //  saving the wider registers, which _xgetbv() shows (bits 1,2 for AVX, 5-7 for AVX-512).
+    
+    int Info[4];
+    __cpuid(Info,0);
+    if (Info[0] >= 7) {
+        __cpuidex(Info,7,0);
+        bool HasAVX2 = (Info[1] & (1 << 5)) != 0;
+        bool HasAVX512 = (Info[1] & (1 << 16)) != 0;
+        __cpuid(Info,1);
+        bool OSSaves = (Info[2] & (1 << 27)) != 0;
+        unsigned long long XCR0 = OSSaves ? _xgetbv(0) : 0;
+        if (Isa == "AVX2") Supported = HasAVX2 && ((XCR0 & 0x6) == 0x6);
+        if (Isa == "AVX512") Supported = HasAVX512 && ((XCR0 & 0xe6) == 0xe6);
+    }
+#endif
+#endif
+#ifdef ADDER_NEON_SIMD
+    if (Isa == "NEON") Supported = true;
+#endif
+    return Supported;
+}
+
+//  SelectCPURange() returns the version of ComputeRangeUsingCPU() to use, given the value of
+//  the 'Simd' command line parameter, and sets Name to the instruction set it uses. "Auto"
+//  picks the widest vectors the CPU supports. If a specific set of instructions is requested
+//  but isn't supported, it says so and does the same as for "Auto".
+
+CPURangeRoutine SelectCPURange(const std::string& Simd,std::string* Name)
+{
+    std::string Requested = Simd;
+    for (char& Char : Requested) Char = toupper(Char);
+    if (Requested == "") Requested = "AUTO";
+    if (Requested != "AUTO" && Requested != "SCALAR" && !CPUSupports(Requested)) {
+        printf ("Warning: '%s' vector code is not supported on this CPU, using 'Auto'.\n",
+                                                                                Simd.c_str());
+        Requested = "AUTO";
     }
-    return Threads;
+    CPURangeRoutine Routine = ComputeRangeUsingCPU;
+    *Name = "Scalar";
+#ifdef ADDER_X86_SIMD
+    if ((Requested == "AUTO" && CPUSupports("AVX512")) || Requested == "AVX512") {
+        Routine = ComputeRangeUsingAVX512;
+        *Name = "AVX512";
+    } else if ((Requested == "AUTO" && CPUSupports("AVX2")) || Requested == "AVX2") {
+        Routine = ComputeRangeUsingAVX2;
+        *Name = "AVX2";
+    }
+#endif
+#ifdef ADDER_NEON_SIMD
+    if (Requested == "AUTO" || Requested == "NEON") {
+        Routine = ComputeRangeUsingNEON;
+        *Name = "NEON";
+    }
+#endif
+    return Routine;
+}
+
+//  OnePassUsingCPU() performs one pass through the whole of the input data, splitting up
+//  the work across multiple threads. It will use as many CPU threads as are available, up
+//  to the value of Threads. If Threads is set to zero, it uses all available CPU threads.
+//  Range is the version of ComputeRangeUsingCPU() to use, as returned by SelectCPURange().
+//  If Profile is not null, the time each thread spends in Range is recorded in it.
+
+int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,float** OutputArray,
+                                                  CPURangeRoutine Range,CycleProfile* Profile)
+{
+    //  The rows are divided between the threads of the shared pool, which are created once
+    //  and then reused for each pass, so creating threads isn't included in the timings.
+    //  If only one thread is to be used, ParallelFor() just does the work in this thread.
+    
+    return ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        CycleScope RangeTime(Profile,uint64_t(Iyen - Iyst));
+        Range(InputArray,Nx,Iyst,Iyen,OutputArray);
+    },Threads);
 }
 
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt,const std::string& Simd,
+            bool Roofline,bool InPlace,const ElementwiseChain& Chain,int Warmup,BenchReport& Bench,
+                                                                           float* SharedInput)
 {
     //  Create the two arrays we need, one for the input data, one for the output. To make things
     //  easier for ourselves, setup two arrays that contain the addresses of the start of the
@@ -568,15 +2769,27 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
     //  the array of row addresses - this is the trick used by the C version of Numerical Methods,
     //  and I've always found it very effective.
     
-    float* InputArrayData = (float*)malloc(Nx * Ny * sizeof(float));
+    //  If the operation is to be performed in place, the one array is both input and output.
+    //
+    //  If main() passes a SharedInput, that's the input array the GPU has just used, and we
+    //  use it as it is, rather than allocating and initialising another.
+    
+    size_t ArrayBytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+    float* InputArrayData = SharedInput;
+    if (!SharedInput) InputArrayData = (float*)AllocateArray(ArrayBytes);
     float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
-    float* OutputArrayData = (float*)malloc(Nx * Ny * sizeof(float));
-    float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+    float* OutputArrayData = nullptr;
+    float** OutputArray = InputArray;
+    if (!InPlace) {
+        OutputArrayData = (float*)AllocateArray(ArrayBytes);
+        OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+    }
     TheDebugHandler.Log("Setup","CPU arrays created");
     
-    //  Initialise the input array;
+    //  Initialise the input array. A shared one already is, unless the GPU has just used it
+    //  in place, which leaves its results there instead.
     
-    SetInputArray(InputArray,Nx,Ny);
+    if (!SharedInput || InPlace) SetInputArray(InputArray,Nx,Ny);
 
     //  See how many threads the hardware supports. If Threads was passed as zero, use this
     //  maximum number of threads. Otherwise use the number passed in Threads, if that many
@@ -588,6 +2801,47 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
     if (Threads > MaxThreads) Threads = MaxThreads;
     TheDebugHandler.Logf("Setup","CPU using %d threads out of maximum of %d\n",Threads,MaxThreads);
     
+    //  Pick the version of the inner loop to use, depending on the vector instructions the
+    //  CPU supports and on what the command line asked for.
+    
+    //  (A chain of element-wise operations has its own code, which doesn't need this.)
+    
+    bool UseChain = (Chain.Operations() > 0);
+    std::string SimdName = "element-wise chain";
+    CPURangeRoutine Range = nullptr;
+    if (!UseChain) Range = SelectCPURange(Simd,&SimdName);
+    TheDebugHandler.Logf("Setup","CPU using %s code",SimdName.c_str());
+    
+    //  If the bandwidth is to be compared with the peak, measure that, with the same threads.
+    
+    double PeakGBytes = 0.0;
+    if (Roofline) {
+        PeakGBytes = MeasureCPUBandwidth(Threads);
+        printf ("CPU measured peak bandwidth = %.2f GBytes/sec (%d thread(s))\n",
+                                                                         PeakGBytes,Threads);
+    }
+    
+    //  With the 'Profile' debug level, the time each thread spends on its range of rows is
+    //  recorded, leaving out the warm-up passes. The timer is calibrated first, so that isn't
+    //  included in the first pass.
+    
+    CycleProfile RangeProfile;
+    CycleProfile* Profile = nullptr;
+    if (TheDebugHandler.Active(ProfileDebug)) {
+        CycleTimer::Calibrate();
+        Profile = &RangeProfile;
+    }
+    
+    //  With 'Counters', the hardware counters are opened before the passes start any threads,
+    //  and count just the passes after the warm-up.
+    
+    PerfCounters Counters;
+    if (UseCounters && !Counters.Open()) {
+        printf ("CPU hardware counters not available: %s\n",Counters.Error().c_str());
+    }
+    
+    MsecStats LoopStats;
+    LoopStats.SetWarmup(Warmup);
     MsecTimer ComputeTimer;
     
     //  Repeat a single pass through the whole image, as many times as specified by the repeat
@@ -596,8 +2850,22 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
     
     for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
         MsecTimer LoopTimer;
-        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,OutputArray);
-        TheDebugHandler.Logf("Timing","CPU Compute complete at %.3f msec",LoopTimer.ElapsedMsec());
+        TraceScope PassTrace("CPU pass","Adder");
+        if (Irpt == Warmup) RangeProfile.Clear();
+        bool Counted = (Counters.IsOpen() && Irpt >= Warmup);
+        if (Counted) Counters.Start();
+        if (UseChain) {
+            Threads = ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+                CycleScope RangeTime(Profile,uint64_t(Iyen - Iyst));
+                Chain.ApplyRange(InputArray,Nx,Iyst,Iyen,OutputArray);
+            },Threads);
+        } else {
+            Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,OutputArray,Range,Profile);
+        }
+        if (Counted) Counters.Stop();
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"CPU Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+        LoopStats.Record(LoopTimer.ElapsedMsec());
     }
     
     //  Report on results, and on timing.
@@ -607,9 +2875,39 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
         printf ("No values computed using CPU, as number of repeats set to zero.\n");
     } else {
         printf ("CPU took %.3f msec\n",Msec);
-        printf ("Average msec per iteration for CPU = %.3f (%d thread(s))\n",
-                                                             Msec / float(Nrpt),Threads);
-        if (CheckResults(InputArray,Nx,Ny,OutputArray)) {
+        printf ("Average msec per iteration for CPU = %.3f (%d thread(s), %s)\n",
+                                               Msec / float(Nrpt),Threads,SimdName.c_str());
+        if (UseHugePages && !SharedInput) {
+            printf ("CPU input array: %s\n",HugePages::Describe(InputArrayData).c_str());
+        }
+        if (UseHugePages && OutputArrayData) {
+            printf ("CPU output array: %s\n",HugePages::Describe(OutputArrayData).c_str());
+        }
+        LoopStats.Report("CPU iterations");
+        if (Profile) Profile->Report("CPU row ranges (items are rows)");
+        double Pixels = double(Nx) * double(Ny);
+        if (Counters.IsOpen()) {
+            printf ("CPU counters: %s\n",Counters.Describe(Pixels).c_str());
+        }
+        if (LoopStats.Count() > 0) {
+            Bench.SetContext("Adder","CPU",SimdName,"");
+            std::string Test = "CPU " + std::to_string(Threads) + " thread(s)";
+            if (InPlace) Test += " in place";
+            if (UseChain) Test += " ops " + Chain.Description();
+            Bench.AddRow(Test,Nx,Ny,LoopStats);
+            if (Counters.IsOpen()) {
+                PerfCounters::Counts Totals = Counters.GetCounts();
+                Bench.AddCounters(PerfCounters::Ipc(Totals),
+                              PerfCounters::PerPixel(Totals,PerfCounters::CacheMisses,Pixels),
+                              PerfCounters::PerPixel(Totals,PerfCounters::BranchMisses,Pixels));
+            }
+        }
+        ReportBandwidth("CPU","overall",Nx,Ny,Nrpt,Msec,PeakGBytes);
+        bool Good = false;
+        if (InPlace) Good = CheckInPlaceResults(OutputArray,Nx,Ny,Nrpt);
+        else if (UseChain) Good = CheckChainResults(Chain,InputArray,Nx,Ny,OutputArray);
+        else Good = CheckResults(InputArray,Nx,Ny,OutputArray);
+        if (Good) {
             printf ("CPU completed OK, all values computed as expected.\n\n");
         } else {
             printf ("** CPU completes, but with errors **\n\n");
@@ -619,10 +2917,44 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
     //  Release the arrays used to hold the row addresses for the two arrays, and the array
     //  data.
     
-    if (OutputArray) free(OutputArray);
+    if (OutputArray && OutputArray != InputArray) free(OutputArray);
     if (InputArray) free(InputArray);
-    if (OutputArrayData) free(OutputArrayData);
-    if (InputArrayData) free(InputArrayData);
+    FreeArray(OutputArrayData);
+    if (!SharedInput) FreeArray(InputArrayData);
+}
+
+//  MeasureCPUBandwidth() measures the memory bandwidth the CPU can manage using a given number
+//  of threads, by timing memcpy() between two buffers much larger than any cache. The copy is
+//  split between the threads of the shared pool, as the adder operation itself is, it's run a
+//  few times (the first just to get all the pages mapped in), and the best time is used. Each
+//  byte copied is read once and written once, so counts twice, matching the way the adder's
+//  own bandwidth is counted. It returns the bandwidth in GBytes/sec, or zero if it failed.
+
+double MeasureCPUBandwidth(int Threads)
+{
+    const size_t Bytes = size_t(256) * 1024 * 1024;
+    char* Source = (char*)malloc(Bytes);
+    char* Dest = (char*)malloc(Bytes);
+    double GBytes = 0.0;
+    if (Source && Dest) {
+        memset(Source,1,Bytes);
+        const int Chunks = 1024;
+        const size_t ChunkBytes = Bytes / Chunks;
+        float BestMsec = 0.0;
+        for (int Run = 0; Run < 4; Run++) {
+            MsecTimer CopyTimer;
+            ThreadPool::Shared().ParallelFor(0,Chunks,[&](int First,int Last) {
+                memcpy(Dest + First * ChunkBytes,Source + First * ChunkBytes,
+                                                                   (Last - First) * ChunkBytes);
+            },Threads);
+            float Msec = CopyTimer.ElapsedMsec();
+            if (Run > 0 && (BestMsec <= 0.0 || Msec < BestMsec)) BestMsec = Msec;
+        }
+        if (BestMsec > 0.0) GBytes = 2.0 * double(Bytes) / (double(BestMsec) * 1.0e6);
+    }
+    if (Dest) free(Dest);
+    if (Source) free(Source);
+    return GBytes;
 }
 
 
@@ -636,15 +2968,27 @@ void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt)
 //  the start of an array giving the address of the start of each row of the input array, which
 //  makes the indexing syntax much easier.
 
+//  InitialValue() gives the value SetInputArray() sets for element [Iy][Ix]. This lets the
+//  checks for the in place operation work out what was there originally.
+
+static inline float InitialValue(int Ix,int Iy,int Nx,int Ny)
+{
+    return float(Ny + Iy + Iy + Nx - Ix - Ix);
+}
+
 void SetInputArray(float** InputArray,int Nx,int Ny)
 {
-    //  Initialise the input array. The actual values don't really matter.
+    //  Initialise the input array. The actual values don't really matter. For large arrays
+    //  this takes a while, so the rows are shared out between the threads in the shared pool.
     
-    for (int Iy = 0; Iy < Ny; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            InputArray[Iy][Ix] = float(Ny + Iy + Iy + Nx - Ix - Ix);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            float* Row = InputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                Row[Ix] = InitialValue(Ix,Iy,Nx,Ny);
+            }
         }
-    }
+    });
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -660,35 +3004,244 @@ float** CreateRowAddrs(float* Array,int Nx,int Ny)
 {
     float** RowAddrs = (float**)malloc(Ny * sizeof(float*));
     for (int Iy = 0; Iy < Ny; Iy++) {
-        RowAddrs[Iy] = Array + (Iy * Nx);
+        RowAddrs[Iy] = Array + (size_t(Iy) * size_t(Nx));
     }
     return RowAddrs;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                          A l l o c a t e  A r r a y
+//
+//  Allocates the memory for the data of a CPU array. With 'HugePages' this comes from HugePages,
+//  in huge pages if the system will provide them, and otherwise from malloc(). Either way, it
+//  has to be released using FreeArray(), which can tell which it was.
+
+void* AllocateArray(size_t Bytes)
+{
+    if (UseHugePages) return HugePages::Allocate(Bytes);
+    return malloc(Bytes);
+}
+
+void FreeArray(void* Address)
+{
+    if (!HugePages::Free(Address)) free(Address);
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                              C h e c k  R e s u l t s
 //
 //  This routine simply uses the CPU to check that the results in OutputArray match what was
 //  expected. If it finds any mismatch, it outputs an error message and returns false.
+//
+//  For large arrays this can take longer than the calculation being checked, so the rows are
+//  shared out between the threads in the shared pool. Each row is checked with a loop that
+//  just ORs together the results of the comparisons, with no branch, which the compiler can
+//  turn into vector code. Only if a row has a mismatch is it searched element by element for
+//  the first bad value. The lowest bad row found so far is shared between the threads, and
+//  they stop once they get past it, so a bad result doesn't mean checking the whole array.
 
 bool CheckResults(float** InputArray,int Nx,int Ny,float** OutputArray)
 {
+    std::atomic<int> FirstBadRow(Ny);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen && Iy < FirstBadRow.load(std::memory_order_relaxed); Iy++) {
+            const float* InRow = InputArray[Iy];
+            const float* OutRow = OutputArray[Iy];
+            int Bad = 0;
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                Bad |= (OutRow[Ix] != InRow[Ix] + float(Ix + Iy));
+            }
+            if (Bad) {
+                int Lowest = FirstBadRow.load();
+                while (Iy < Lowest && !FirstBadRow.compare_exchange_weak(Lowest,Iy)) {}
+                break;
+            }
+        }
+    });
+    
+    //  If there was a bad row, find the first bad value in it, and report it.
+    
     bool AllOK = true;
-    for (int Iy = 0; Iy < Ny; Iy++) {
+    int Iy = FirstBadRow.load();
+    if (Iy < Ny) {
         for (int Ix = 0; Ix < Nx; Ix++) {
             if (OutputArray[Iy][Ix] != InputArray[Iy][Ix] + float(Ix + Iy)) {
                 printf ("*** Error at [%d][%d]. Got %.1f expected %.1f\n",Iy,Ix,
                         OutputArray[Iy][Ix],InputArray[Iy][Ix] + float(Ix + Iy));
-                AllOK = false;
                 break;
             }
         }
-        if (!AllOK) break;
+        AllOK = false;
+    }
+    return AllOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        C h e c k  I n  P l a c e  R e s u l t s
+//
+//  The equivalent of CheckResults() when the operation was performed in place, Passes times,
+//  so each element should have had Ix + Iy added to its initial value Passes times. There's
+//  no copy of the initial values, but InitialValue() can work them out. So long as all the
+//  values along the way are integers too small to lose precision in a float, the result is
+//  exactly the initial value plus Passes * (Ix + Iy), which is quick to calculate. Otherwise,
+//  each addition may have been rounded, and the only way to be sure of the exact answer is to
+//  repeat the additions in the same way.
+
+static float InPlaceExpected(int Ix,int Iy,int Nx,int Ny,int Passes)
+{
+    const double C_ExactLimit = 16777216.0;      // 2^24, beyond which floats lose integers.
+    float Initial = InitialValue(Ix,Iy,Nx,Ny);
+    double Final = double(Initial) + double(Passes) * double(Ix + Iy);
+    if (fabs(Final) < C_ExactLimit && fabs(double(Initial)) < C_ExactLimit) return float(Final);
+    float Value = Initial;
+    for (int Pass = 0; Pass < Passes; Pass++) Value = Value + float(Ix + Iy);
+    return Value;
+}
+
+bool CheckInPlaceResults(float** Array,int Nx,int Ny,int Passes)
+{
+    std::atomic<int> FirstBadRow(Ny);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen && Iy < FirstBadRow.load(std::memory_order_relaxed); Iy++) {
+            const float* Row = Array[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                if (Row[Ix] != InPlaceExpected(Ix,Iy,Nx,Ny,Passes)) {
+                    int Lowest = FirstBadRow.load();
+                    while (Iy < Lowest && !FirstBadRow.compare_exchange_weak(Lowest,Iy)) {}
+                    break;
+                }
+            }
+        }
+    });
+
+    bool AllOK = true;
+    int Iy = FirstBadRow.load();
+    if (Iy < Ny) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            float Expected = InPlaceExpected(Ix,Iy,Nx,Ny,Passes);
+            if (Array[Iy][Ix] != Expected) {
+                printf ("*** Error at [%d][%d]. Got %.1f expected %.1f\n",Iy,Ix,
+                                                                      Array[Iy][Ix],Expected);
+                break;
+            }
+        }
+        AllOK = false;
+    }
+    return AllOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            C h e c k  H a l f  R e s u l t s
+//
+//  The equivalent of CheckResults() when the arrays were held on the GPU in half precision.
+//  The GPU was given the input values rounded to half precision, and added Ix + Iy to them as
+//  floats, which is exact for anything half precision can hold. The result was then rounded
+//  back to half precision - but Vulkan allows this to round either to nearest or towards zero,
+//  so HalfMatches() accepts either.
+
+static bool HalfMatches(float Got,float Exact)
+{
+    uint16_t Nearest = FloatToHalf(Exact);
+    float NearestValue = HalfToFloat(Nearest);
+    if (Got == NearestValue) return true;
+    if (fabs(NearestValue) > fabs(Exact) && (Nearest & 0x7fff) != 0) {
+        return Got == HalfToFloat(uint16_t(Nearest - 1));
+    }
+    return false;
+}
+
+bool CheckHalfResults(float** InputArray,int Nx,int Ny,float** OutputArray)
+{
+    std::atomic<int> FirstBadRow(Ny);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen && Iy < FirstBadRow.load(std::memory_order_relaxed); Iy++) {
+            const float* InRow = InputArray[Iy];
+            const float* OutRow = OutputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                if (!HalfMatches(OutRow[Ix],RoundToHalf(InRow[Ix]) + float(Ix + Iy))) {
+                    int Lowest = FirstBadRow.load();
+                    while (Iy < Lowest && !FirstBadRow.compare_exchange_weak(Lowest,Iy)) {}
+                    break;
+                }
+            }
+        }
+    });
+
+    bool AllOK = true;
+    int Iy = FirstBadRow.load();
+    if (Iy < Ny) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            float Exact = RoundToHalf(InputArray[Iy][Ix]) + float(Ix + Iy);
+            if (!HalfMatches(OutputArray[Iy][Ix],Exact)) {
+                printf ("*** Error at [%d][%d]. Got %.1f expected %.1f\n",Iy,Ix,
+                                                        OutputArray[Iy][Ix],RoundToHalf(Exact));
+                break;
+            }
+        }
+        AllOK = false;
+    }
+    return AllOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          C h e c k  C h a i n  R e s u l t s
+//
+//  The equivalent of CheckResults() for a chain of element-wise operations, using the chain's
+//  own Apply() routine to work out the expected values. This does the same arithmetic in the
+//  same order as both the GPU shader and the CPU code, so the results are checked exactly.
+
+bool CheckChainResults(const ElementwiseChain& Chain,float** InputArray,int Nx,int Ny,
+                                                                          float** OutputArray)
+{
+    std::atomic<int> FirstBadRow(Ny);
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen && Iy < FirstBadRow.load(std::memory_order_relaxed); Iy++) {
+            const float* InRow = InputArray[Iy];
+            const float* OutRow = OutputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                if (OutRow[Ix] != Chain.Apply(InRow[Ix],Ix,Iy)) {
+                    int Lowest = FirstBadRow.load();
+                    while (Iy < Lowest && !FirstBadRow.compare_exchange_weak(Lowest,Iy)) {}
+                    break;
+                }
+            }
+        }
+    });
+
+    bool AllOK = true;
+    int Iy = FirstBadRow.load();
+    if (Iy < Ny) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            float Expected = Chain.Apply(InputArray[Iy][Ix],Ix,Iy);
+            if (OutputArray[Iy][Ix] != Expected) {
+                printf ("*** Error at [%d][%d]. Got %g expected %g\n",Iy,Ix,
+                                                               OutputArray[Iy][Ix],Expected);
+                break;
+            }
+        }
+        AllOK = false;
     }
     return AllOK;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                              E n d  O f  S t a r t u p
+//
+//  Called once the GPU is set up and ready to run the tests. This marks the end of the
+//  start-up recorded by the StartupProfile and, the first time it's called with the 'Startup'
+//  debug level set, lists the stages recorded. (For a list of sizes, this is the first size.)
+
+void EndOfStartup(void)
+{
+    if (StartupProfile::Global().Finish()) StartupProfile::Global().Report();
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //              D e b u g  A r g  H e l p e r  ::  C h e c k  V a l i d i t y
@@ -769,6 +3322,9 @@ std::string DebugArgHelper::HelpText(void)
         run much slower than you might expect. The latest versions of clang and g++ will produce
         very efficient code for this operation, making use of the CPU vector operations at high
         levels of optimisation (say -O2 and -O3), which I think is very impressive.
+        But without -march options they can only use the vector instructions every CPU of
+        the family has (SSE2 on x86_64), which is why there are now explicit AVX2 and AVX-512
+        versions, selected at run time. 'Simd = Scalar' gives the compiler's own version.
   
     o   The CPU code would make much more efficient use of threads if we were to split up the
         calculation by rows, create a number of threads each handling a number of rows, and
@@ -803,5 +3359,8 @@ std::string DebugArgHelper::HelpText(void)
         command buffer to finish executing before being re-used. It would be potentially more
         flexible to create the command buffer inside the repeat loop and not let the Framework
         set the re-use flag (which maybe marginally more efficient).
+        Since the command buffer is also marked as reusable through the Framework routine
+        SetCommandBufferReusable(), it isn't even recorded again - each iteration simply
+        resubmits the same recording.
 
  */
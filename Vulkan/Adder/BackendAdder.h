@@ -0,0 +1,132 @@
+//
+//                           B a c k e n d  A d d e r . h
+//
+//  The 'adder' operation run on the GPU through a ComputeBackend, used by the Metal and Vulkan
+//  versions of Adder for 'Backend'. This is the one copy of the GPU driver code for the simple
+//  case - set up the kernel and its buffers, initialise the input, run the repeat loop, time it
+//  and check the results - and it is the same code whichever API the backend uses, so the two
+//  programs' results can be compared directly. Each program only supplies the backend and the
+//  name of its kernel.
+//
+//  The kernel has the input array at binding 1 and the output array at binding 2, and is
+//  passed the array dimensions at binding 0, as an AdderArgs structure, just as Adder.metal
+//  and Adder.comp expect.
+//
+//  The routines it uses to set up and check the arrays are the program's own.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __BackendAdder__
+#define __BackendAdder__
+
+#include "ComputeBackend.h"
+#include "BenchReport.h"
+#include "MsecTimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+
+//  Set initial values for the input array.
+void SetInputArray(float** InputArray,int Nx,int Ny);
+//  Check the results of the operation
+bool CheckResults(float** InputArray,int Nx,int Ny,float** OutputArray);
+//  Utility to set up an array of row addresses to allow use of Array[Iy][Ix] syntax for access.
+float** CreateRowAddrs(float* Array,int Nx,int Ny);
+
+inline void ComputeUsingBackend(ComputeBackend& Backend,const std::string& KernelName,
+                                  int Nx,int Ny,int Nrpt,int Warmup,BenchReport& Bench)
+{
+    bool StatusOK = true;
+    MsecTimer SetupTimer;
+
+    //  The arguments, laid out to match AdderArgs in the kernels. RowOffset is only used when
+    //  the arrays are streamed through the GPU in tiles, so here it's always zero.
+
+    struct AdderArgs {
+        int32_t Nx;
+        int32_t Ny;
+        int32_t RowOffset;
+    } Args = {Nx,Ny,0};
+
+    size_t Bytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+    int Kernel = Backend.NewKernel(KernelName,sizeof(AdderArgs),StatusOK);
+    float* InputData = (float*)Backend.NewBuffer(Kernel,1,Bytes,ComputeBackend::In,StatusOK);
+    float* OutputData = (float*)Backend.NewBuffer(Kernel,2,Bytes,ComputeBackend::Out,StatusOK);
+    Backend.SetGrid(Kernel,Nx,Ny);
+    if (!StatusOK || InputData == nullptr || OutputData == nullptr) {
+        printf ("GPU setup using the %s backend failed.\n\n",Backend.Api().c_str());
+        return;
+    }
+    float** InputArray = CreateRowAddrs(InputData,Nx,Ny);
+    float** OutputArray = CreateRowAddrs(OutputData,Nx,Ny);
+    SetInputArray(InputArray,Nx,Ny);
+    float SetupMsec = SetupTimer.ElapsedMsec();
+
+    //  Each pass is submitted and waited for, and timed as a whole, with the GPU's own time
+    //  for it collected separately if the backend can measure it.
+
+    MsecStats LoopStats;
+    LoopStats.SetWarmup(Warmup);
+    MsecStats KernelStats;
+    KernelStats.SetWarmup(Warmup);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt && StatusOK; Irpt++) {
+        MsecTimer LoopTimer;
+        Backend.Submit(Kernel,&Args,StatusOK);
+        Backend.Wait(Kernel,StatusOK);
+        LoopStats.Record(LoopTimer.ElapsedMsec());
+        float DispatchMsec = 0.0;
+        if (Backend.KernelMsec(Kernel,&DispatchMsec)) {
+            KernelMsec += DispatchMsec;
+            KernelStats.Record(DispatchMsec);
+            KernelTimed = true;
+        }
+    }
+    float Msec = ComputeTimer.ElapsedMsec();
+
+    //  Check that we got it right, and report on the timing, just as the programs' own GPU
+    //  code does.
+
+    if (!StatusOK) {
+        printf ("GPU execution using the %s backend failed.\n\n",Backend.Api().c_str());
+    } else if (Nrpt <= 0) {
+        printf ("No values computed using GPU, as number of repeats set to zero.\n");
+    } else {
+        printf ("GPU (%s backend) setup took %.3f msec\n",Backend.Api().c_str(),SetupMsec);
+        printf ("GPU (%s backend) took %.3f msec\n",Backend.Api().c_str(),Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        LoopStats.Report("GPU iterations");
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        if (LoopStats.Count() > 0) {
+            Bench.SetContext("Adder",Backend.Api(),Backend.DeviceName(),"");
+            Bench.AddRow("GPU backend",Nx,Ny,LoopStats,KernelTimed ? &KernelStats : nullptr);
+        }
+        if (CheckResults(InputArray,Nx,Ny,OutputArray)) {
+            printf ("GPU completed OK, all values computed as expected.\n\n");
+        } else {
+            printf ("** GPU completes, but with errors **\n\n");
+        }
+    }
+    free(OutputArray);
+    free(InputArray);
+}
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The buffers belong to the backend, which releases them when it is deleted, so this
+        only frees the row address arrays. A program that runs several sizes creates a new
+        backend for each, just as its own GPU code sets up the API afresh for each size.
+
+    o   This is the simplest form of the GPU loop, with one pass at a time. The options that
+        change how the passes are submitted - 'InFlight' and 'Indirect' for Metal, 'Batch' and
+        'Spin' for Vulkan - are still only in the programs' own GPU code.
+*/
@@ -0,0 +1,355 @@
+//
+//                       E l e m e n t w i s e  C h a i n . c p p
+//
+//  The implementation of the ElementwiseChain and ElementwisePipelines classes. See
+//  ElementwiseChain.h for an overview.
+//
+//  14th Oct 2026. First version. KS.
+
+#include "ElementwiseChain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          E l e m e n t w i s e  C h a i n
+//
+//  The constructor just creates an empty chain - one that copies its input unchanged.
+
+ElementwiseChain::ElementwiseChain(void)
+{
+    Clear();
+}
+
+void ElementwiseChain::Clear(void)
+{
+    I_Count = 0;
+    for (int Index = 0; Index < C_MaxOperations; Index++) {
+        I_Ops[Index] = NONE;
+        I_Operands[Index][0] = I_Operands[Index][1] = 0.0f;
+    }
+}
+
+bool ElementwiseChain::Add(Operation Op,float First,float Second)
+{
+    if (I_Count >= C_MaxOperations) return false;
+    I_Ops[I_Count] = Op;
+    I_Operands[I_Count][0] = First;
+    I_Operands[I_Count][1] = Second;
+    I_Count++;
+    return true;
+}
+
+bool ElementwiseChain::Scale(float Factor) { return Add(SCALE,Factor,0.0f); }
+
+bool ElementwiseChain::Offset(float Value) { return Add(OFFSET,Value,0.0f); }
+
+bool ElementwiseChain::Clip(float Low,float High) { return Add(CLIP,Low,High); }
+
+bool ElementwiseChain::AddGradient(float PerColumn,float PerRow)
+{
+    return Add(GRADIENT,PerColumn,PerRow);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    P a r s e
+//
+//  Sets the chain from a string that lists the operations in order, separated by commas. Each
+//  operation is a name and one or two values, eg "scale=2", "offset=-1.5", "clip=0:1000" or
+//  "gradient=1:1". The names are not case-sensitive, and spaces are ignored. An empty string
+//  gives an empty chain.
+//
+//  Parameters:
+//     Spec     (const std::string&) The list of operations.
+//     Error    (std::string*) Receives a description of the problem, if there is one.
+//
+//  Returns:
+//     bool     True if the whole string was understood, false otherwise. If false, the chain
+//              is left empty.
+
+bool ElementwiseChain::Parse(const std::string& Spec,std::string* Error)
+{
+    Clear();
+
+    //  Take a copy with the spaces removed and the names in lower case, which makes the rest
+    //  much simpler.
+
+    std::string Text;
+    for (char Chr : Spec) {
+        if (Chr != ' ' && Chr != '\t') Text.push_back(tolower(Chr));
+    }
+
+    size_t Start = 0;
+    while (Start < Text.size()) {
+        size_t End = Text.find(',',Start);
+        if (End == std::string::npos) End = Text.size();
+        std::string Item = Text.substr(Start,End - Start);
+        Start = End + 1;
+        if (Item.empty()) continue;
+
+        //  Split the item into a name and up to two values.
+
+        std::string Name = Item;
+        std::string Values;
+        size_t Equals = Item.find('=');
+        if (Equals != std::string::npos) {
+            Name = Item.substr(0,Equals);
+            Values = Item.substr(Equals + 1);
+        }
+        int NeedValues = 0;
+        Operation Op = NONE;
+        if (Name == "scale") { Op = SCALE; NeedValues = 1; }
+        else if (Name == "offset") { Op = OFFSET; NeedValues = 1; }
+        else if (Name == "clip") { Op = CLIP; NeedValues = 2; }
+        else if (Name == "gradient") { Op = GRADIENT; NeedValues = 2; }
+        if (Op == NONE) {
+            if (Error) *Error = "'" + Name + "' is not a known operation";
+            Clear();
+            return false;
+        }
+        float Operands[2] = {0.0f,0.0f};
+        int GotValues = 0;
+        const char* Ptr = Values.c_str();
+        while (*Ptr && GotValues < 2) {
+            char* EndPtr = nullptr;
+            Operands[GotValues] = strtof(Ptr,&EndPtr);
+            if (EndPtr == Ptr) break;
+            GotValues++;
+            Ptr = EndPtr;
+            if (*Ptr == ':') Ptr++;
+            else break;
+        }
+        if (GotValues != NeedValues || *Ptr) {
+            if (Error) {
+                *Error = "'" + Item + "' needs " + (NeedValues == 1 ? "one value" :
+                                                             "two values, separated by ':'");
+            }
+            Clear();
+            return false;
+        }
+        if (Op == CLIP && Operands[0] > Operands[1]) {
+            if (Error) *Error = "'" + Item + "' has its lower limit above its upper limit";
+            Clear();
+            return false;
+        }
+        if (!Add(Op,Operands[0],Operands[1])) {
+            if (Error) {
+                *Error = "Too many operations, the limit is " + std::to_string(C_MaxOperations);
+            }
+            Clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                  D e s c r i p t i o n ,  K e y  a n d  S p e c  C o n s t a n t s
+
+std::string ElementwiseChain::Description(void) const
+{
+    std::string Text;
+    char Buffer[64];
+    for (int Index = 0; Index < I_Count; Index++) {
+        float First = I_Operands[Index][0];
+        float Second = I_Operands[Index][1];
+        switch (I_Ops[Index]) {
+            case SCALE: snprintf(Buffer,sizeof(Buffer),"scale=%g",First); break;
+            case OFFSET: snprintf(Buffer,sizeof(Buffer),"offset=%g",First); break;
+            case CLIP: snprintf(Buffer,sizeof(Buffer),"clip=%g:%g",First,Second); break;
+            case GRADIENT: snprintf(Buffer,sizeof(Buffer),"gradient=%g:%g",First,Second); break;
+            default: Buffer[0] = '\0'; break;
+        }
+        if (Index > 0) Text += ",";
+        Text += Buffer;
+    }
+    return Text;
+}
+
+std::string ElementwiseChain::Key(void) const
+{
+    std::string Text;
+    for (int Index = 0; Index < I_Count; Index++) Text.push_back(char('0' + I_Ops[Index]));
+    return Text;
+}
+
+//  Specialization constants 0 and 1 are the workgroup size, 2 is the number of operations,
+//  and 3 onwards are the operation codes, with unused ones set to NONE.
+
+std::vector<uint32_t> ElementwiseChain::SpecConstants(const uint32_t WorkGroupSize[2]) const
+{
+    std::vector<uint32_t> Constants = {WorkGroupSize[0],WorkGroupSize[1],uint32_t(I_Count)};
+    for (int Index = 0; Index < C_MaxOperations; Index++) {
+        Constants.push_back(uint32_t(I_Ops[Index]));
+    }
+    return Constants;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    A p p l y
+//
+//  Applies the chain to a single value. This is the reference version of the calculation,
+//  used to check results. It performs exactly the same arithmetic, in the same order, as both
+//  ApplyRange() and Elementwise.comp, so all three should give identical results.
+
+float ElementwiseChain::Apply(float Value,int Ix,int Iy) const
+{
+    for (int Index = 0; Index < I_Count; Index++) {
+        float First = I_Operands[Index][0];
+        float Second = I_Operands[Index][1];
+        switch (I_Ops[Index]) {
+            case SCALE: Value = Value * First; break;
+            case OFFSET: Value = Value + First; break;
+            case CLIP:
+                if (Value < First) Value = First;
+                if (Value > Second) Value = Second;
+                break;
+            case GRADIENT: {
+                float Ramp = First * float(Ix) + Second * float(Iy);
+                Value = Value + Ramp;
+                break;
+            }
+            default: break;
+        }
+    }
+    return Value;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              A p p l y  R a n g e
+//
+//  Applies the chain to a range of rows, from Iyst up to (but not including) Iyen. Each row is
+//  copied to the output, and then each operation is applied to the output row in turn. By then
+//  the row is in cache, so the whole chain is still only one pass over main memory, and each
+//  operation is a simple loop that the compiler can turn into vector code. This is the routine
+//  to pass to a ThreadPool, one sub-range of rows for each thread.
+
+void ElementwiseChain::ApplyRange(
+    float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray) const
+{
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* In = InputArray[Iy];
+        float* Out = OutputArray[Iy];
+        memcpy(Out,In,size_t(Nx) * sizeof(float));
+        for (int Index = 0; Index < I_Count; Index++) {
+            const float First = I_Operands[Index][0];
+            const float Second = I_Operands[Index][1];
+            switch (I_Ops[Index]) {
+                case SCALE:
+                    for (int Ix = 0; Ix < Nx; Ix++) Out[Ix] = Out[Ix] * First;
+                    break;
+                case OFFSET:
+                    for (int Ix = 0; Ix < Nx; Ix++) Out[Ix] = Out[Ix] + First;
+                    break;
+                case CLIP:
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        float Value = Out[Ix];
+                        Value = Value < First ? First : Value;
+                        Out[Ix] = Value > Second ? Second : Value;
+                    }
+                    break;
+                case GRADIENT: {
+                    const float RowPart = Second * float(Iy);
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        float Ramp = First * float(Ix) + RowPart;
+                        Out[Ix] = Out[Ix] + Ramp;
+                    }
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       E l e m e n t w i s e  P i p e l i n e s
+
+ElementwisePipelines::ElementwisePipelines(KVVulkanFramework* Framework,
+                               VkDescriptorSetLayout SetLayout,const std::string& ShaderName)
+{
+    I_Framework = Framework;
+    I_SetLayout = SetLayout;
+    I_ShaderName = ShaderName;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                G e t  P i p e l i n e
+//
+//  Returns the compute pipeline, and its layout, that runs a given chain with a given workgroup
+//  size. The first time a particular sequence of operations is asked for, this creates the
+//  pipeline, with the operations passed to Elementwise.spv as specialization constants, and
+//  remembers it. After that, the same pipeline is simply returned. The operands don't affect
+//  the pipeline, since they are push constants, so chains that differ only in their operands
+//  share one.
+//
+//  Parameters:
+//     Chain         (const ElementwiseChain&) The chain of operations.
+//     WorkGroupSize (const uint32_t[2]) The X and Y workgroup size to use.
+//     PipelineLayoutHndlPtr (VkPipelineLayout*) Receives the layout for the pipeline.
+//     PipelineHndlPtr (VkPipeline*) Receives the pipeline.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Note:
+//     The Framework owns the pipelines created, and releases them when it is destroyed.
+
+void ElementwisePipelines::GetPipeline(const ElementwiseChain& Chain,
+                  const uint32_t WorkGroupSize[2],VkPipelineLayout* PipelineLayoutHndlPtr,
+                                                   VkPipeline* PipelineHndlPtr,bool& StatusOK)
+{
+    *PipelineLayoutHndlPtr = VK_NULL_HANDLE;
+    *PipelineHndlPtr = VK_NULL_HANDLE;
+    if (!StatusOK) return;
+
+    std::string Key = Chain.Key() + "/" + std::to_string(WorkGroupSize[0]) + "x"
+                                                           + std::to_string(WorkGroupSize[1]);
+    auto Iter = I_Pipelines.find(Key);
+    if (Iter != I_Pipelines.end()) {
+        *PipelineLayoutHndlPtr = Iter->second.PipelineLayoutHndl;
+        *PipelineHndlPtr = Iter->second.PipelineHndl;
+        return;
+    }
+    T_CachedPipeline Cached;
+    I_Framework->CreateComputePipeline(I_ShaderName,"main",&I_SetLayout,
+                &Cached.PipelineLayoutHndl,&Cached.PipelineHndl,
+                      Chain.SpecConstants(WorkGroupSize),Chain.PushConstantSize(),StatusOK);
+    if (StatusOK) {
+        I_Pipelines[Key] = Cached;
+        *PipelineLayoutHndlPtr = Cached.PipelineLayoutHndl;
+        *PipelineHndlPtr = Cached.PipelineHndl;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              S e t u p  D i s p a t c h
+//
+//  Fills in a KVDispatch, as used by KVVulkanFramework::RecordComputeBatch(), that runs a chain
+//  over an Nx by Ny array, getting the pipeline using GetPipeline(). The dispatch's push
+//  constants point to the chain's operands, so the chain must still exist, unchanged, when
+//  the dispatch is recorded.
+
+void ElementwisePipelines::SetupDispatch(const ElementwiseChain& Chain,
+                 const uint32_t WorkGroupSize[2],VkDescriptorSet DescriptorSetHndl,
+                 uint32_t Nx,uint32_t Ny,KVVulkanFramework::KVDispatch* Dispatch,bool& StatusOK)
+{
+    GetPipeline(Chain,WorkGroupSize,&Dispatch->PipelineLayoutHndl,&Dispatch->PipelineHndl,
+                                                                                    StatusOK);
+    Dispatch->DescriptorSetHndl = DescriptorSetHndl;
+    Dispatch->WorkGroupCounts[0] = (Nx + WorkGroupSize[0] - 1) / WorkGroupSize[0];
+    Dispatch->WorkGroupCounts[1] = (Ny + WorkGroupSize[1] - 1) / WorkGroupSize[1];
+    Dispatch->WorkGroupCounts[2] = 1;
+    Dispatch->PushConstants = Chain.PushConstants();
+    Dispatch->PushConstantSize = Chain.PushConstantSize();
+}
@@ -0,0 +1,129 @@
+//
+//                        E l e m e n t w i s e  C h a i n . h
+//
+//  The Adder operation is just one element-wise operation - each output element depends only
+//  on the corresponding input element and its position. Real processing often needs a whole
+//  sequence of such steps - scale, offset, clip, add a gradient - and running each as a
+//  separate Adder-style kernel means every step reads and writes the whole array. Since these
+//  operations are limited by memory bandwidth, not arithmetic, a chain of N steps costs about N
+//  times as much as one. An ElementwiseChain describes such a sequence, so that it can be run
+//  as a single pass over memory, either on the GPU using the Elementwise.comp shader, or on
+//  the CPU using ApplyRange().
+//
+//  A chain is built up by calling Scale(), Offset(), Clip() and AddGradient() in the order
+//  the operations are to be applied, or by Parse(), which takes a string such as
+//  "scale=2,offset=-1,clip=0:1000,gradient=1:1". A chain can hold up to C_MaxOperations
+//  operations.
+//
+//  For the GPU, the operation codes become specialization constants for Elementwise.comp, so
+//  each different sequence of operations gets its own pipeline, compiled by the driver with
+//  the chain built in. The operands are passed as push constants, so changing a scale factor
+//  does not need a new pipeline. ElementwisePipelines keeps the pipelines it creates, keyed
+//  on the sequence of operations and the workgroup size, so each is only created once, no
+//  matter how many times it is asked for.
+//
+//  14th Oct 2026. First version. KS.
+
+#ifndef __ElementwiseChain__
+#define __ElementwiseChain__
+
+#include "KVVulkanFramework.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class ElementwiseChain
+{
+public:
+    //  The operations supported. These codes have to match those used in Elementwise.comp.
+    enum Operation { NONE = 0, SCALE = 1, OFFSET = 2, CLIP = 3, GRADIENT = 4 };
+    //  The maximum number of operations in a chain. This also has to match Elementwise.comp.
+    static const int C_MaxOperations = 8;
+
+    ElementwiseChain(void);
+    //  Removes all the operations from the chain.
+    void Clear(void);
+    //  Each of these adds an operation to the end of the chain, returning false if it is full.
+    //  Multiplies each value by Factor.
+    bool Scale(float Factor);
+    //  Adds Value to each value.
+    bool Offset(float Value);
+    //  Clamps each value to the range Low to High.
+    bool Clip(float Low,float High);
+    //  Adds PerColumn times the column index plus PerRow times the row index to each value.
+    bool AddGradient(float PerColumn,float PerRow);
+    //  Sets the chain from a comma-separated list of operations, eg "scale=2,clip=0:100".
+    bool Parse(const std::string& Spec,std::string* Error);
+    //  Returns the number of operations in the chain.
+    int Operations(void) const { return I_Count; }
+    //  Returns a description of the chain, in the form accepted by Parse().
+    std::string Description(void) const;
+    //  Returns a string that identifies the sequence of operations, ignoring the operands.
+    std::string Key(void) const;
+    //  Returns the specialization constants for Elementwise.comp, given the workgroup size.
+    std::vector<uint32_t> SpecConstants(const uint32_t WorkGroupSize[2]) const;
+    //  Returns the address and size of the push constant data for Elementwise.comp.
+    const void* PushConstants(void) const { return I_Operands; }
+    uint32_t PushConstantSize(void) const { return sizeof(I_Operands); }
+    //  Applies the chain to a single value, at column Ix and row Iy.
+    float Apply(float Value,int Ix,int Iy) const;
+    //  Applies the chain to rows Iyst up to (not including) Iyen, using the CPU.
+    void ApplyRange(float** InputArray,int Nx,int Iyst,int Iyen,float** OutputArray) const;
+private:
+    //  Adds an operation with the given operands, returning false if the chain is full.
+    bool Add(Operation Op,float First,float Second);
+    //  The number of operations in the chain.
+    int I_Count;
+    //  The operation codes.
+    Operation I_Ops[C_MaxOperations];
+    //  The two operands for each operation, laid out as the shader expects them.
+    float I_Operands[C_MaxOperations][2];
+};
+
+class ElementwisePipelines
+{
+public:
+    //  The Framework must outlive this, and owns the pipelines. SetLayout describes the buffers
+    //  used, which are bound as for Adder.comp.
+    ElementwisePipelines(KVVulkanFramework* Framework,VkDescriptorSetLayout SetLayout,
+                                          const std::string& ShaderName = "Elementwise.spv");
+    //  Returns the pipeline and pipeline layout for a chain, creating them if necessary.
+    void GetPipeline(const ElementwiseChain& Chain,const uint32_t WorkGroupSize[2],
+              VkPipelineLayout* PipelineLayoutHndlPtr,VkPipeline* PipelineHndlPtr,bool& StatusOK);
+    //  Sets up a dispatch of a chain over an Nx by Ny grid, using the given descriptor set.
+    void SetupDispatch(const ElementwiseChain& Chain,const uint32_t WorkGroupSize[2],
+                        VkDescriptorSet DescriptorSetHndl,uint32_t Nx,uint32_t Ny,
+                        KVVulkanFramework::KVDispatch* Dispatch,bool& StatusOK);
+    //  Returns the number of pipelines actually created so far.
+    int PipelinesCreated(void) const { return int(I_Pipelines.size()); }
+private:
+    //  A cached pipeline and its layout.
+    typedef struct {
+        VkPipelineLayout PipelineLayoutHndl;
+        VkPipeline PipelineHndl;
+    } T_CachedPipeline;
+    //  The Framework used to create the pipelines.
+    KVVulkanFramework* I_Framework;
+    //  The layout of the descriptor sets for the shader.
+    VkDescriptorSetLayout I_SetLayout;
+    //  The name of the compiled shader file.
+    std::string I_ShaderName;
+    //  The pipelines created so far, keyed on the chain's Key() and the workgroup size.
+    std::map<std::string,T_CachedPipeline> I_Pipelines;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   A chain is still memory bound, but it reads and writes each element once whatever the
+        number of operations, which is the whole point. On the CPU, ApplyRange() copies a row
+        into the output and then runs each operation over that row in turn - the row is in
+        cache by then, so this is still one pass over main memory, and each of the simple row
+        loops vectorises, which a loop with a switch on the operation for each element won't.
+
+    o   The push constants are the operand array itself, so the KVDispatch set up by
+        SetupDispatch() points into the chain. The chain must not change, or be deleted,
+        until the command buffer using that dispatch has been recorded.
+*/
@@ -0,0 +1,122 @@
+//
+//                            H a l f  F l o a t . h
+//
+//  Conversions between 32-bit floats and 16-bit IEEE half-precision floats, held as uint16_t.
+//  These are used when an array is kept on the GPU in half precision - the CPU code keeps its
+//  own copies as floats, and converts them to half precision as it loads them into the GPU
+//  buffers, and back again as it reads the results. Half-precision values only have an
+//  11-bit significand, and can be no larger than 65504, so this loses precision, but halves
+//  the number of bytes moved for each element, which is what matters for code that is limited
+//  by memory bandwidth.
+//
+//  This doesn't rely on any compiler support for half-precision types (which varies a lot
+//  between compilers and CPUs), and just does the conversions with integer code. The float
+//  to half conversion rounds to nearest, ties to even, as the IEEE standard specifies.
+//
+//  14th Oct 2026. First version. KS.
+
+#ifndef __HalfFloat__
+#define __HalfFloat__
+
+#include <stdint.h>
+#include <string.h>
+
+//  The largest finite value that can be held in half precision.
+
+static const float C_HalfMax = 65504.0f;
+
+//  FloatToHalf() returns the half-precision value closest to Value.
+
+static inline uint16_t FloatToHalf(float Value)
+{
+    uint32_t Bits;
+    memcpy(&Bits,&Value,sizeof(Bits));
+    uint32_t Sign = (Bits >> 16) & 0x8000;
+    uint32_t Exponent = (Bits >> 23) & 0xff;
+    uint32_t Mantissa = Bits & 0x7fffff;
+
+    //  Infinities and NaNs. A NaN stays a NaN, even if its top mantissa bits are all zero.
+
+    if (Exponent == 0xff) {
+        return uint16_t(Sign | 0x7c00 | (Mantissa ? 0x200 | (Mantissa >> 13) : 0));
+    }
+
+    //  Rebias the exponent. Anything too large becomes infinity.
+
+    int HalfExponent = int(Exponent) - 127 + 15;
+    if (HalfExponent >= 0x1f) return uint16_t(Sign | 0x7c00);
+
+    //  Values too small for a normalised half become denormals, or zero. The implicit leading
+    //  bit is made explicit and the mantissa shifted down, rounding to nearest even.
+
+    if (HalfExponent <= 0) {
+        if (HalfExponent < -10) return uint16_t(Sign);
+        Mantissa |= 0x800000;
+        uint32_t Shift = uint32_t(14 - HalfExponent);
+        uint32_t Half = Mantissa >> Shift;
+        uint32_t Remainder = Mantissa & ((1u << Shift) - 1);
+        uint32_t Midpoint = 1u << (Shift - 1);
+        if (Remainder > Midpoint || (Remainder == Midpoint && (Half & 1))) Half++;
+        return uint16_t(Sign | Half);
+    }
+
+    //  Normal values. Rounding up may carry into the exponent, which is what we want - even
+    //  if that carries all the way to infinity.
+
+    uint32_t Half = (uint32_t(HalfExponent) << 10) | (Mantissa >> 13);
+    uint32_t Remainder = Mantissa & 0x1fff;
+    if (Remainder > 0x1000 || (Remainder == 0x1000 && (Half & 1))) Half++;
+    return uint16_t(Sign | Half);
+}
+
+//  HalfToFloat() returns the float value of a half-precision value. This is always exact.
+
+static inline float HalfToFloat(uint16_t Value)
+{
+    uint32_t Sign = uint32_t(Value & 0x8000) << 16;
+    uint32_t Exponent = (Value >> 10) & 0x1f;
+    uint32_t Mantissa = Value & 0x3ff;
+    uint32_t Bits;
+    if (Exponent == 0x1f) {
+        Bits = Sign | 0x7f800000 | (Mantissa << 13);
+    } else if (Exponent != 0) {
+        Bits = Sign | ((Exponent - 15 + 127) << 23) | (Mantissa << 13);
+    } else if (Mantissa == 0) {
+        Bits = Sign;
+    } else {
+
+        //  A denormal half is a normal float, once the mantissa is shifted up until its
+        //  leading bit becomes the implicit one.
+
+        Exponent = 127 - 15 + 1;
+        while ((Mantissa & 0x400) == 0) {
+            Mantissa <<= 1;
+            Exponent--;
+        }
+        Bits = Sign | (Exponent << 23) | ((Mantissa & 0x3ff) << 13);
+    }
+    float Result;
+    memcpy(&Result,&Bits,sizeof(Result));
+    return Result;
+}
+
+//  RoundToHalf() returns Value rounded to the nearest value that half precision can hold.
+
+static inline float RoundToHalf(float Value)
+{
+    return HalfToFloat(FloatToHalf(Value));
+}
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The GPU doesn't necessarily round the same way. Vulkan allows a conversion from float
+        to half precision to round either to nearest even or towards zero, unless the shader
+        asks for a specific mode, which needs yet another extension. So code checking GPU
+        results against values rounded using FloatToHalf() should allow for either.
+
+    o   The conversions are simple enough that the compiler can vectorise loops of them
+        reasonably well, but they are still much slower than a plain copy. For large arrays,
+        the callers here split them between the threads of the shared thread pool.
+*/
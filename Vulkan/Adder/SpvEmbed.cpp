@@ -0,0 +1,168 @@
+//
+//                            S p v  E m b e d . c p p
+//
+//  SpvEmbed is a small program used by the Makefile, when a program is built with 'EMBED=1',
+//  to build the SPIR-V code for its shaders into the program itself. It reads the .spv files
+//  that glslc has produced and writes a C++ source file that holds the code of each one as a
+//  constexpr uint32_t array, together with a static KVEmbeddedShader for each that passes the
+//  code to KVVulkanFramework::EmbedShader() before main() starts. The Framework then uses that
+//  code whenever it is asked for the file with that name, and the .spv files aren't needed
+//  when the program runs - it no longer matters what the current directory is, and the code
+//  can't get out of step with the program.
+//
+//  Invocation:
+//     SpvEmbed <Output> <SpvFile> [<SpvFile>...]
+//
+//  Where:
+//
+//     Output    is the C++ source file to be written.
+//     SpvFile   is a file of SPIR-V code. The name it is registered under is the name as given
+//               here, less any directory, which is how the programs refer to their shaders.
+//
+//  The exit status is 0 if all went well, and 1 if a file can't be read or written, or doesn't
+//  contain SPIR-V code, so a failure stops 'make'.
+//
+//  15th Oct 2026. First version. KS.
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+//  The first word of any SPIR-V module.
+
+static const uint32_t C_SpirVMagic = 0x07230203;
+
+//  Routines used by the main routine.
+
+static bool ReadSpirV(const std::string& FileName,std::vector<uint32_t>* Code);
+static std::string BaseName(const std::string& FileName);
+static std::string ArrayName(const std::string& Name);
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    M a i n
+
+int main (int Argc, char* Argv[]) {
+
+    if (Argc < 3) {
+        fprintf (stderr,"Usage: SpvEmbed <Output> <SpvFile> [<SpvFile>...]\n");
+        return 1;
+    }
+    std::string OutputName = Argv[1];
+    FILE* Output = fopen(OutputName.c_str(),"w");
+    if (Output == NULL) {
+        fprintf (stderr,"SpvEmbed: Unable to create '%s'\n",OutputName.c_str());
+        return 1;
+    }
+    fprintf (Output,"//\n//  %s - SPIR-V code built into the program. Generated by SpvEmbed,\n"
+                                      "//  so any changes will be overwritten.\n\n",
+                                                               BaseName(OutputName).c_str());
+    fprintf (Output,"#include \"KVVulkanFramework.h\"\n\n#include <stdint.h>\n");
+
+    bool AllOK = true;
+    for (int Index = 2; Index < Argc; Index++) {
+        std::vector<uint32_t> Code;
+        if (!ReadSpirV(Argv[Index],&Code)) {
+            AllOK = false;
+            break;
+        }
+        std::string Name = BaseName(Argv[Index]);
+        std::string Array = ArrayName(Name);
+        fprintf (Output,"\n//  %s\n\nstatic constexpr uint32_t %s[%zu] = {",Name.c_str(),
+                                                                   Array.c_str(),Code.size());
+        for (size_t Word = 0; Word < Code.size(); Word++) {
+            if (Word % 6 == 0) fprintf (Output,"\n   ");
+            fprintf (Output," 0x%08x%s",Code[Word],(Word + 1 < Code.size()) ? "," : "");
+        }
+        fprintf (Output,"\n};\n\nstatic KVEmbeddedShader %s_Embedded(\"%s\",%s,sizeof(%s));\n",
+                               Array.c_str(),Name.c_str(),Array.c_str(),Array.c_str());
+    }
+    if (fclose(Output) != 0) {
+        fprintf (stderr,"SpvEmbed: Error writing '%s'\n",OutputName.c_str());
+        AllOK = false;
+    }
+    if (!AllOK) {
+        remove(OutputName.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                R e a d  S p i r  V
+//
+//  Reads the SPIR-V code in a file into a vector of 32-bit words, checking that it starts with
+//  the SPIR-V magic number and is a whole number of words long. glslc writes the code in the
+//  byte order of the machine it runs on, which is the one the program will be built for.
+
+static bool ReadSpirV(const std::string& FileName,std::vector<uint32_t>* Code)
+{
+    FILE* Input = fopen(FileName.c_str(),"rb");
+    if (Input == NULL) {
+        fprintf (stderr,"SpvEmbed: Unable to open '%s'\n",FileName.c_str());
+        return false;
+    }
+    std::vector<char> Bytes;
+    char Buffer[4096];
+    size_t Count;
+    while ((Count = fread(Buffer,1,sizeof(Buffer),Input)) > 0) {
+        Bytes.insert(Bytes.end(),Buffer,Buffer + Count);
+    }
+    bool ReadOK = !ferror(Input);
+    fclose(Input);
+    if (!ReadOK) {
+        fprintf (stderr,"SpvEmbed: Error reading '%s'\n",FileName.c_str());
+        return false;
+    }
+    if (Bytes.size() < sizeof(uint32_t) || Bytes.size() % sizeof(uint32_t) != 0) {
+        fprintf (stderr,"SpvEmbed: '%s' is not a whole number of 32-bit words\n",
+                                                                           FileName.c_str());
+        return false;
+    }
+    Code->resize(Bytes.size() / sizeof(uint32_t));
+    for (size_t Word = 0; Word < Code->size(); Word++) {
+        uint32_t Value = 0;
+        for (size_t Byte = 0; Byte < sizeof(uint32_t); Byte++) {
+            ((char*)&Value)[Byte] = Bytes[Word * sizeof(uint32_t) + Byte];
+        }
+        (*Code)[Word] = Value;
+    }
+    if ((*Code)[0] != C_SpirVMagic) {
+        fprintf (stderr,"SpvEmbed: '%s' does not contain SPIR-V code\n",FileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 B a s e  N a m e
+//
+//  Returns a file name less any directory, allowing for either sort of separator.
+
+static std::string BaseName(const std::string& FileName)
+{
+    size_t Separator = FileName.find_last_of("/\\");
+    if (Separator == std::string::npos) return FileName;
+    return FileName.substr(Separator + 1);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 A r r a y  N a m e
+//
+//  Returns the name used for the array holding a file's code - the file name with anything
+//  that can't go in a C++ identifier replaced by an underscore, and prefixed by 'Spv_'.
+
+static std::string ArrayName(const std::string& Name)
+{
+    std::string Array = "Spv_";
+    for (char Char : Name) {
+        bool Valid = (Char >= 'a' && Char <= 'z') || (Char >= 'A' && Char <= 'Z') ||
+                                                                  (Char >= '0' && Char <= '9');
+        Array += Valid ? Char : '_';
+    }
+    return Array;
+}
@@ -0,0 +1,131 @@
+//
+//                          V u l k a n  B a c k e n d . h
+//
+//  The Vulkan implementation of a ComputeBackend - see ComputeBackend.h. It sets up a
+//  KVVulkanFramework just as the programs' own GPU code does, with dispatch timing enabled,
+//  and each kernel is a KVComputeKernel, which does all the work of setting up its buffers,
+//  descriptor set, pipeline and command buffer. The arguments go in a small uniform buffer at
+//  binding 0, as the Adder shaders expect, rather than as push constants, whose size would have
+//  to be fixed when the code is compiled. Input buffers are in shared memory and output buffers
+//  in readback memory, as ComputeUsingGPU() uses by default, and the KVComputeKernel syncs
+//  them around each run.
+//
+//  A kernel's pipeline can only be created once all its buffers have been added, so it is
+//  created when the kernel is first submitted.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __VulkanBackend__
+#define __VulkanBackend__
+
+#include "ComputeBackend.h"
+#include "KVVulkanFramework.h"
+#include "KVComputeKernel.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+class VulkanBackend : public ComputeBackend
+{
+public:
+    //  Sets up the Vulkan instance and device, with validation if requested.
+    VulkanBackend(bool Validate,const std::string& DebugLevels,bool& StatusOK) {
+        I_Framework.SetDebugSystemName("Vulkan");
+        I_Framework.SetDebugLevels(DebugLevels);
+        I_Framework.EnableValidation(Validate);
+        I_Framework.CreateVulkanInstance(StatusOK);
+        I_Framework.FindSuitableDevice(StatusOK);
+        I_Framework.CreateLogicalDevice(StatusOK);
+        I_Framework.EnableDispatchTiming(true,StatusOK);
+    }
+    std::string Api(void) { return "Vulkan"; }
+    std::string DeviceName(void) {
+        std::string Name,Driver;
+        I_Framework.GetDeviceDescription(&Name,&Driver);
+        return Name;
+    }
+    int NewKernel(const std::string& Name,size_t ArgBytes,bool& StatusOK) {
+        if (!StatusOK) return -1;
+        std::unique_ptr<Kernel> TheKernel(new Kernel(I_Framework));
+        TheKernel->Shader = Name;
+        TheKernel->ArgBytes = ArgBytes;
+        if (ArgBytes > 0) {
+            auto Hndl = TheKernel->Compute.AddBuffer(0,"UNIFORM","SHARED","IN",StatusOK);
+            TheKernel->Args = TheKernel->Compute.SizeBuffer(Hndl,ArgBytes,StatusOK);
+        }
+        if (!StatusOK) return -1;
+        I_Kernels.push_back(std::move(TheKernel));
+        return int(I_Kernels.size()) - 1;
+    }
+    void* NewBuffer(int KernelId,int Binding,size_t Bytes,Usage Use,bool& StatusOK) {
+        if (!StatusOK || !Valid(KernelId)) {
+            StatusOK = false;
+            return nullptr;
+        }
+        const char* Access = (Use == Out) ? "READBACK" : "SHARED";
+        const char* Sync = (Use == In) ? "IN" : (Use == Out) ? "OUT" : "INOUT";
+        KVComputeKernel<PushArgs>& Compute = I_Kernels[KernelId]->Compute;
+        auto Hndl = Compute.AddBuffer(Binding,"STORAGE",Access,Sync,StatusOK);
+        return Compute.SizeBuffer(Hndl,Bytes,StatusOK);
+    }
+    void SetGrid(int KernelId,int Nx,int Ny) {
+        if (!Valid(KernelId)) return;
+        I_Kernels[KernelId]->Nx = Nx;
+        I_Kernels[KernelId]->Ny = Ny;
+    }
+    void Submit(int KernelId,const void* Args,bool& StatusOK) {
+        if (!StatusOK || !Valid(KernelId)) {
+            StatusOK = false;
+            return;
+        }
+        Kernel& TheKernel = *I_Kernels[KernelId];
+        TheKernel.Compute.Wait(StatusOK);
+        TheKernel.Compute.Create(TheKernel.Shader,C_LocalSize,C_LocalSize,StatusOK);
+        TheKernel.Compute.SetGrid(uint32_t(TheKernel.Nx),uint32_t(TheKernel.Ny));
+        if (TheKernel.Args && StatusOK) memcpy(TheKernel.Args,Args,TheKernel.ArgBytes);
+        PushArgs Unused = {0};
+        TheKernel.Compute.Submit(Unused,StatusOK);
+    }
+    void Wait(int KernelId,bool& StatusOK) {
+        if (Valid(KernelId)) I_Kernels[KernelId]->Compute.Wait(StatusOK);
+    }
+    bool KernelMsec(int KernelId,float* Msec) {
+        return Valid(KernelId) && I_Kernels[KernelId]->Compute.GetKernelMsec(Msec);
+    }
+private:
+    bool Valid(int KernelId) { return KernelId >= 0 && KernelId < int(I_Kernels.size()); }
+    //  The shaders take no push constants, but a KVComputeKernel needs a structure for them.
+    struct PushArgs {
+        int32_t Unused;
+    };
+    //  Each kernel, and the details it needs to be created and run.
+    struct Kernel {
+        Kernel(KVVulkanFramework& Framework) : Compute(Framework) {}
+        KVComputeKernel<PushArgs> Compute;
+        std::string Shader;
+        size_t ArgBytes = 0;
+        void* Args = nullptr;
+        int Nx = 1;
+        int Ny = 1;
+    };
+    //  The workgroup shape, passed to the shaders as specialization constants 0 and 1.
+    static const uint32_t C_LocalSize = 16;
+    //  The framework is declared first, so that it outlives the kernels.
+    KVVulkanFramework I_Framework;
+    std::vector<std::unique_ptr<Kernel>> I_Kernels;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   All the Vulkan objects belong to the KVVulkanFramework, which releases them when it is
+        deleted, after the kernels, as members are destroyed in the reverse order to the one
+        they are declared in.
+
+    o   The arguments are written to their uniform buffer before each run, so a kernel must
+        have finished - Submit() waits for it - before it is given new ones.
+*/
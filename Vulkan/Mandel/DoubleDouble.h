@@ -0,0 +1,71 @@
+//
+//                           D o u b l e  D o u b l e . h
+//
+//  This provides a very basic extended precision floating point type, intended for the
+//  Mandelbrot programs, which need more precision than double gives them once the image is
+//  magnified beyond about 1e13. A DoubleDouble holds a value as the unevaluated sum of two
+//  doubles, Hi and Lo, with Lo no more than half a unit in the last place of Hi. This gives
+//  about 106 bits of mantissa - around 32 decimal digits - but with only the exponent range
+//  of a double, which is all that's needed here.
+//
+//  Only the operations the Mandelbrot code needs are provided: addition, subtraction and
+//  multiplication, of two DoubleDouble values or of a DoubleDouble and a double. These use
+//  the standard error-free transformations - Knuth's TwoSum for addition, and a fused
+//  multiply-add to get the exact error of a product - so they rely on IEEE double arithmetic
+//  being done as written. This code must not be compiled with options like -ffast-math that
+//  allow the compiler to reorder floating point operations.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __DoubleDouble__
+#define __DoubleDouble__
+
+#include <cmath>
+
+class DoubleDouble
+{
+public:
+    DoubleDouble(double Value = 0.0) : Hi(Value), Lo(0.0) {}
+    DoubleDouble(double High,double Low) { Hi = TwoSum(High,Low,&Lo); }
+    //  Returns the value rounded to a double.
+    double ToDouble(void) const { return Hi + Lo; }
+    DoubleDouble operator+ (const DoubleDouble& Other) const {
+        double Error;
+        double Sum = TwoSum(Hi,Other.Hi,&Error);
+        Error += Lo + Other.Lo;
+        return DoubleDouble(Sum,Error);
+    }
+    DoubleDouble operator- (const DoubleDouble& Other) const {
+        return *this + DoubleDouble(-Other.Hi,-Other.Lo);
+    }
+    DoubleDouble operator* (const DoubleDouble& Other) const {
+        double Error;
+        double Product = TwoProd(Hi,Other.Hi,&Error);
+        Error += Hi * Other.Lo + Lo * Other.Hi;
+        return DoubleDouble(Product,Error);
+    }
+    DoubleDouble operator+ (double Value) const { return *this + DoubleDouble(Value); }
+    DoubleDouble operator- (double Value) const { return *this + DoubleDouble(-Value); }
+    DoubleDouble operator* (double Value) const { return *this * DoubleDouble(Value); }
+    DoubleDouble& operator+= (const DoubleDouble& Other) { return *this = *this + Other; }
+    DoubleDouble& operator+= (double Value) { return *this = *this + Value; }
+    //  The high and low parts of the value.
+    double Hi;
+    double Lo;
+private:
+    //  Returns A + B rounded to a double, setting *Error to the exact rounding error.
+    static double TwoSum(double A,double B,double* Error) {
+        double Sum = A + B;
+        double BVirtual = Sum - A;
+        *Error = (A - (Sum - BVirtual)) + (B - BVirtual);
+        return Sum;
+    }
+    //  Returns A * B rounded to a double, setting *Error to the exact rounding error.
+    static double TwoProd(double A,double B,double* Error) {
+        double Product = A * B;
+        *Error = std::fma(A,B,-Product);
+        return Product;
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+//
+//                         K V  C o m p u t e  K e r n e l . h
+//
+//  Running a compute shader using the KVVulkanFramework takes the same sequence of calls every
+//  time - set the details of each buffer, create and map them, create a descriptor set layout,
+//  a descriptor pool and a descriptor set, fill in the set, create the pipeline, get a queue,
+//  create a command pool and a command buffer, work out the workgroup counts, and then record
+//  and run the command buffer - and the test programs each have this written out more than once.
+//  A KVComputeKernel does all of this for one shader, and does it the way that has been found
+//  to work best: the arguments are passed as push constants, not in a uniform buffer, and the
+//  command buffer is reusable, so it's only recorded again if something has changed.
+//
+//  The template argument is the structure holding the shader's arguments, which must match the
+//  push constant block declared in the shader. Push constants are laid out like a storage
+//  buffer (std430), where each scalar is aligned to its own size, just as a C++ compiler lays
+//  out a structure of ints, floats and doubles, so a structure of those will match. The
+//  structure is checked as far as it can be at compile time - it must be plain data, a whole
+//  number of 4-byte words, and no bigger than the 128 bytes of push constants every device
+//  supports. (Vector types are a different matter - a vec3, for example, is aligned to 16 bytes
+//  - and are best avoided in the structure.)
+//
+//  A kernel is used like this:
+//
+//     KVComputeKernel<MyArgs> Kernel(Framework);
+//     auto InHndl = Kernel.AddBuffer(0,"STORAGE","SHARED","IN",StatusOK);
+//     auto OutHndl = Kernel.AddBuffer(1,"STORAGE","READBACK","OUT",StatusOK);
+//     float* In = (float*)Kernel.SizeBuffer(InHndl,Bytes,StatusOK);
+//     float* Out = (float*)Kernel.SizeBuffer(OutHndl,Bytes,StatusOK);
+//     Kernel.Create("My.spv",16,16,StatusOK);
+//     Kernel.SetGrid(Nx,Ny);
+//     Kernel.Run(Args,StatusOK);
+//
+//  The buffers must be added before Create() is called, but can be resized at any time the
+//  kernel isn't running. Each buffer's 'Usage' says whether the shader reads it ("IN"), writes
+//  it ("OUT") or both ("INOUT"), and if it is a staged buffer it is synchronised before or after
+//  each dispatch accordingly. Run() runs the kernel and waits for it to finish, and invalidates
+//  any output buffers so the CPU sees the results. Submit() starts it without waiting, and
+//  Wait() waits for it. The workgroup shape is passed to the shader as specialization constants
+//  0 and 1, as all the shaders in these programs expect.
+//
+//  All the Vulkan objects are created through the Framework, which releases them when it
+//  closes down, so the kernel must not outlive the Framework, and needs no clearing up itself.
+//
+//  15th Oct 2026. First version. KS.
+//                 SizeBuffer() now takes a VkDeviceSize, as the Framework does. KS.
+//                 Added UseBuffer(), so a kernel can work on buffers that already exist. KS.
+
+#ifndef __KVComputeKernel__
+#define __KVComputeKernel__
+
+#include "KVVulkanFramework.h"
+
+#include <string>
+#include <vector>
+#include <type_traits>
+
+template <typename Args>
+class KVComputeKernel
+{
+    //  The checks on the argument structure.
+    static_assert(std::is_trivially_copyable<Args>::value && std::is_standard_layout<Args>::value,
+                  "KVComputeKernel arguments must be a plain data structure");
+    static_assert(sizeof(Args) % 4 == 0,
+                  "KVComputeKernel arguments must be a whole number of 4-byte words");
+    static_assert(alignof(Args) >= 4 && alignof(Args) <= 8,
+                  "KVComputeKernel arguments must be made up of 4 or 8 byte scalars");
+    static_assert(sizeof(Args) <= 128,
+                  "KVComputeKernel arguments must fit in the 128 bytes of push constants allowed");
+public:
+    KVComputeKernel(KVVulkanFramework& Framework) {
+        I_Framework = &Framework;
+        I_Created = false;
+        I_DescriptorsOK = false;
+        I_SetLayout = VK_NULL_HANDLE;
+        I_DescriptorPool = VK_NULL_HANDLE;
+        I_DescriptorSet = VK_NULL_HANDLE;
+        I_PipelineLayout = VK_NULL_HANDLE;
+        I_Pipeline = VK_NULL_HANDLE;
+        I_Queue = VK_NULL_HANDLE;
+        I_CommandPool = VK_NULL_HANDLE;
+        I_CommandBuffer = VK_NULL_HANDLE;
+        I_LocalSize[0] = I_LocalSize[1] = 1;
+        I_GroupCounts[0] = I_GroupCounts[1] = I_GroupCounts[2] = 1;
+        I_Ticket = KVVulkanFramework::KV_NULL_TICKET;
+        I_KernelMsec = 0.0;
+        I_KernelTimed = false;
+    }
+    //  Adds a buffer used by the shader. Binding, Type and Access are as for the Framework's
+    //  SetBufferDetails(). Usage is "IN", "OUT" or "INOUT", or blank if it needs no syncing.
+    KVVulkanFramework::KVBufferHandle AddBuffer(long Binding,const std::string& Type,
+                       const std::string& Access,const std::string& Usage,bool& StatusOK) {
+        if (!StatusOK) return KVVulkanFramework::KV_NULL_HANDLE;
+        KVVulkanFramework::KVBufferHandle Hndl =
+                                 I_Framework->SetBufferDetails(Binding,Type,Access,StatusOK);
+        UseBuffer(Hndl,Usage);
+        return Hndl;
+    }
+    //  Adds a buffer that already exists - one set up for another kernel, say, whose results
+    //  this one is to work on. The shader sees it at the binding given when its details were
+    //  set, and Usage is as for AddBuffer(). It has to have been created before the kernel runs.
+    void UseBuffer(KVVulkanFramework::KVBufferHandle Hndl,const std::string& Usage) {
+        I_Buffers.push_back(Hndl);
+        if (Usage == "IN" || Usage == "INOUT") I_SyncBefore.push_back(Hndl);
+        if (Usage == "OUT" || Usage == "INOUT") I_SyncAfter.push_back(Hndl);
+        I_DescriptorsOK = false;
+    }
+    //  Creates the memory for a buffer, or resizes it, and returns its address for the CPU.
+    void* SizeBuffer(KVVulkanFramework::KVBufferHandle Hndl,VkDeviceSize Bytes,bool& StatusOK) {
+        if (!StatusOK) return nullptr;
+        I_Framework->ResizeBuffer(Hndl,Bytes,StatusOK);
+        I_DescriptorsOK = false;
+        VkDeviceSize MappedBytes = 0;
+        return I_Framework->MapBuffer(Hndl,&MappedBytes,StatusOK);
+    }
+    //  Creates the pipeline for the shader, with the given workgroup shape, and everything
+    //  needed to run it.
+    void Create(const std::string& ShaderFilename,uint32_t LocalX,uint32_t LocalY,
+                                                                           bool& StatusOK) {
+        if (!StatusOK || I_Created) return;
+        I_LocalSize[0] = LocalX;
+        I_LocalSize[1] = LocalY;
+        I_Framework->CreateVulkanDescriptorSetLayout(I_Buffers,&I_SetLayout,StatusOK);
+        I_Framework->CreateVulkanDescriptorPool(I_Buffers,1,&I_DescriptorPool,StatusOK);
+        I_Framework->AllocateVulkanDescriptorSet(I_SetLayout,I_DescriptorPool,&I_DescriptorSet,
+                                                                                    StatusOK);
+        std::vector<uint32_t> SpecConstants = {LocalX,LocalY};
+        I_Framework->CreateComputePipeline(ShaderFilename,"main",&I_SetLayout,&I_PipelineLayout,
+                                      &I_Pipeline,SpecConstants,uint32_t(sizeof(Args)),StatusOK);
+        I_Framework->GetDeviceQueue(&I_Queue,StatusOK);
+        I_Framework->CreateCommandPool(&I_CommandPool,StatusOK);
+        I_Framework->CreateComputeCommandBuffer(I_CommandPool,&I_CommandBuffer,StatusOK);
+        I_Framework->SetCommandBufferReusable(I_CommandBuffer,true,StatusOK);
+        I_Created = StatusOK;
+    }
+    //  Sets the number of invocations the kernel is run for, one for each element of an Nx by
+    //  Ny by Nz grid, rounded up to whole workgroups. The shader has to ignore any extras.
+    void SetGrid(uint32_t Nx,uint32_t Ny = 1,uint32_t Nz = 1) {
+        I_GroupCounts[0] = (Nx + I_LocalSize[0] - 1) / I_LocalSize[0];
+        I_GroupCounts[1] = (Ny + I_LocalSize[1] - 1) / I_LocalSize[1];
+        I_GroupCounts[2] = Nz;
+    }
+    //  Runs the kernel with the given arguments, and waits for it to finish.
+    void Run(const Args& Arguments,bool& StatusOK) {
+        if (!Record(Arguments,StatusOK)) return;
+        I_Framework->RunCommandBuffer(I_Queue,I_CommandBuffer,StatusOK);
+        Finished(StatusOK);
+    }
+    //  Starts the kernel with the given arguments, without waiting for it to finish.
+    KVVulkanFramework::KVSubmitTicket Submit(const Args& Arguments,bool& StatusOK) {
+        if (!Record(Arguments,StatusOK)) return KVVulkanFramework::KV_NULL_TICKET;
+        I_Ticket = I_Framework->SubmitCommandBuffer(I_Queue,I_CommandBuffer,StatusOK);
+        return I_Ticket;
+    }
+    //  Waits for the kernel started by Submit() to finish.
+    void Wait(bool& StatusOK) {
+        if (I_Ticket == KVVulkanFramework::KV_NULL_TICKET) return;
+        I_Framework->WaitFor(I_Ticket,StatusOK);
+        I_Ticket = KVVulkanFramework::KV_NULL_TICKET;
+        Finished(StatusOK);
+    }
+    //  Returns the time the last run took on the GPU, if dispatch timing is enabled.
+    bool GetKernelMsec(float* Msec) {
+        if (I_KernelTimed) *Msec = I_KernelMsec;
+        return I_KernelTimed;
+    }
+    //  Returns the workgroup counts set by SetGrid(), the queue and the command pool, for a
+    //  program that needs them for something else, such as syncing a buffer itself.
+    const uint32_t* GetGroupCounts(void) const { return I_GroupCounts; }
+    VkQueue GetQueue(void) const { return I_Queue; }
+    VkCommandPool GetCommandPool(void) const { return I_CommandPool; }
+private:
+    //  Records the command buffer, if anything has changed since it was last recorded. The
+    //  descriptor set is filled in again first if any buffer has been resized. Returns false
+    //  if the kernel can't be run. A kernel started by Submit() is waited for first, as its
+    //  command buffer can't be recorded again while it's running.
+    bool Record(const Args& Arguments,bool& StatusOK) {
+        if (!StatusOK) return false;
+        if (!I_Created) {
+            StatusOK = false;
+            return false;
+        }
+        Wait(StatusOK);
+        if (!I_DescriptorsOK) {
+            I_Framework->SetupVulkanDescriptorSet(I_Buffers,I_DescriptorSet,StatusOK);
+            I_DescriptorsOK = StatusOK;
+        }
+        I_Args = Arguments;
+        I_Framework->RecordComputeCommandBuffer(I_CommandBuffer,I_Pipeline,I_PipelineLayout,
+                           &I_DescriptorSet,I_GroupCounts,I_SyncBefore,I_SyncAfter,&I_Args,
+                                                            uint32_t(sizeof(Args)),StatusOK);
+        return StatusOK;
+    }
+    //  Called once a run has finished, to make the results visible to the CPU and get the time.
+    void Finished(bool& StatusOK) {
+        for (KVVulkanFramework::KVBufferHandle Hndl : I_SyncAfter) {
+            I_Framework->InvalidateBuffer(Hndl,StatusOK);
+        }
+        I_KernelTimed = I_Framework->GetDispatchTimes(nullptr,&I_KernelMsec,nullptr,StatusOK);
+    }
+    KVVulkanFramework* I_Framework;
+    bool I_Created;
+    bool I_DescriptorsOK;
+    std::vector<KVVulkanFramework::KVBufferHandle> I_Buffers;
+    std::vector<KVVulkanFramework::KVBufferHandle> I_SyncBefore;
+    std::vector<KVVulkanFramework::KVBufferHandle> I_SyncAfter;
+    VkDescriptorSetLayout I_SetLayout;
+    VkDescriptorPool I_DescriptorPool;
+    VkDescriptorSet I_DescriptorSet;
+    VkPipelineLayout I_PipelineLayout;
+    VkPipeline I_Pipeline;
+    VkQueue I_Queue;
+    VkCommandPool I_CommandPool;
+    VkCommandBuffer I_CommandBuffer;
+    uint32_t I_LocalSize[2];
+    uint32_t I_GroupCounts[3];
+    Args I_Args;
+    KVVulkanFramework::KVSubmitTicket I_Ticket;
+    float I_KernelMsec;
+    bool I_KernelTimed;
+};
+
+#endif
@@ -18,7 +18,7 @@
 //  compute handler and their display by the renderer.
 //
 //  Running:
-//      ./Mandel <Nx> <Ny> <Iter> <Validate> <Debug>
+//      ./Mandel <Nx> <Ny> <Iter> <Validate> <Debug> <Present> <Images> <Frames>
 //
 //  where:
 //      Nx        (integer) is the initial size of the calculated image in X. Default 1024.
@@ -26,6 +26,11 @@
 //      Iter      (boolean) is the maximum number of iterations for the calculation. Default 1024.
 //      Validate  (boolean) is true if the Vulcan validation layers are to be enabled. Default true.
 //      Debug     (string) is a comma-separated list of hierarchical debugging options. Default "".
+//      Present   (string) is the swap chain presentation mode: FIFO, FIFO_RELAXED, MAILBOX or
+//                IMMEDIATE. Default "", which uses MAILBOX if it's available.
+//      Images    (integer) is the number of swap chain images. Default 0, which lets the
+//                renderer choose.
+//      Frames    (integer) is the number of frames that can be in flight at once. Default 2.
 //
 //  History:
 //       8th Nov 2024. Initial version for MacOS.
@@ -42,6 +47,12 @@
 //                     MouseMovedCallback(). KS.
 //      14th Sep 2024. Modified following renaming of Framework routines and types. KS.
 //      29th Sep 2024. Now ignores key presses outside the 'ordinary' character range. KS.
+//      15th Oct 2026. Now uses a single Framework by default, so the renderer can draw images
+//                     straight from the compute handler's buffer. KS.
+//                     Added the Present and Images parameters. KS.
+//                     Added the Frames parameter. KS.
+//                     Added the Async parameter, which has the compute handler use a separate
+//                     compute queue, if the GPU has one. KS.
 
 #include "WindowHandler.h"
 #include "MandelController.h"
@@ -180,7 +191,7 @@ int main(int Argc,char* Argv[])
 {
     //  See comments below about using one Vulkan Framework for both computation and graphics.
 
-    bool UseSingleFramework = false;
+    bool UseSingleFramework = true;
     
     //  Set up the command line handler for the various command line parameters. Note that
     //  only Debug has a sufficiently complex syntax to need a helper to validate its value.
@@ -192,6 +203,11 @@ int main(int Argc,char* Argv[])
     IntArg IterArg(TheHandler,"Iter",Posn++,"",1024,16,1024*1024,"Iteration limit");
     BoolArg ValidateArg(TheHandler,"Validate",0,"",true,"Enable Vulkan validation layers");
     StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
+    StringArg PresentArg(TheHandler,"Present",0,"","",
+                             "Present mode (FIFO, FIFO_RELAXED, MAILBOX, IMMEDIATE or blank)");
+    IntArg ImagesArg(TheHandler,"Images",0,"",0,0,16,"Swap chain images (0 for default)");
+    IntArg FramesArg(TheHandler,"Frames",0,"",2,1,16,"Number of frames in flight");
+    BoolArg AsyncArg(TheHandler,"Async",0,"",true,"Compute on a separate queue, if possible");
     DebugArgHelper DebugHelper;
     DebugArg.SetHelper(&DebugHelper);
     DebugHelper.SetSingleFramework(UseSingleFramework);
@@ -206,6 +222,10 @@ int main(int Argc,char* Argv[])
     int Iter = IterArg.GetValue(&Ok,&Error);
     bool Validate = ValidateArg.GetValue(&Ok,&Error);
     std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
+    std::string PresentMode = PresentArg.GetValue(&Ok,&Error);
+    int Images = ImagesArg.GetValue(&Ok,&Error);
+    int Frames = FramesArg.GetValue(&Ok,&Error);
+    bool Async = AsyncArg.GetValue(&Ok,&Error);
     
     //  Check the argument parsing went OK, and didn't end with an exit being requested.
     
@@ -227,9 +247,10 @@ int main(int Argc,char* Argv[])
         //  if two frameworks are used (we call one "VulkanGraphics" and the other "VulkanCompute",
         //  as opposed to just "Vulkan"). The addresses of the Framework(s) to be used are passed
         //  to the Controller than coordinates the Compute Handler and Renderer. Both options are
-        //  supported here, mostly to show that both options work. Using the same instance may have
-        //  advantages if we wanted to couple the graphics and computation code more tightly, for
-        //  example to keep more operations purely on the GPU.
+        //  supported here, mostly to show that both options work. Using the same instance does
+        //  have one advantage: the Renderer can then read each image directly from the buffer the
+        //  Compute Handler computed it in, instead of the image being copied by the CPU, so that
+        //  is the default.
         
         KVVulkanFramework TheGraphicsFramework;
         KVVulkanFramework* TheComputeFrameworkPtr = nullptr;
@@ -261,8 +282,27 @@ int main(int Argc,char* Argv[])
         TheWindowHandler.CreateSurface(TheGraphicsFramework.GetInstance());
         TheGraphicsFramework.EnableGraphics(TheWindowHandler.GetSurface(),StatusOK);
         TheGraphicsFramework.FindSuitableDevice(StatusOK);
+        
+        //  With a single Framework, the Compute Handler would normally share the graphics queue
+        //  with the Renderer, and its computations would be queued behind the drawing of each
+        //  frame. If the GPU has a separate compute-only queue family, Async has the Compute
+        //  Handler use a queue from that instead, so the next image can be computed while the
+        //  current one is drawn and presented. (If it hasn't, this makes no difference.)
+        
+        if (UseSingleFramework && Async) {
+            TheGraphicsFramework.EnableSeparateQueues(false,true,StatusOK);
+        }
         TheGraphicsFramework.CreateLogicalDevice(StatusOK);
         
+        //  The presentation mode, the number of swap chain images and the number of frames in
+        //  flight have to be set before the Renderer creates the swap chain. Uncapped modes like
+        //  MAILBOX and IMMEDIATE suit benchmarking, while FIFO with few images gives the lowest
+        //  latency at the display rate. More frames in flight help when the GPU is the limit.
+        
+        TheGraphicsFramework.SetPresentMode(PresentMode,StatusOK);
+        TheGraphicsFramework.SetSwapChainImages(uint32_t(Images));
+        TheGraphicsFramework.SetFramesInFlight(Frames);
+        
         //  Create the Controller that creates and coordinates the Renderer and the Compute handler.
         
         MandelController* TheControllerPtr = new MandelController();
@@ -32,22 +32,185 @@
 //     14 Sep 2024. Modified following renaming of Framework routines and types. KS.
 //     16 Oct 2024. Belatedly modified to use new and delete[] instead of a C99 dynamic array
 //                  to keep track of threads in CPU code. KS.
+//     14 Oct 2026. The GPU time spent in the shader is now measured using GPU timestamps and
+//                  logged at the 'Timing' debug level. KS.
+//                  The arguments are now passed to the shaders as push constants recorded into
+//                  the command buffer, rather than through a mapped uniform buffer. KS.
+//                  The command buffer is marked as reusable, so it is only re-recorded when
+//                  the arguments, the pipeline or the image size change. KS.
+//                  The image buffer is now a "READBACK" buffer, so it uses cached memory
+//                  where the device has it. KS.
+//                  ComputeInCThreads() now uses the shared ThreadPool, rather than creating
+//                  new threads for each image. KS.
+//     15 Oct 2026. Added ComputeInCProgressive(), which computes a CPU image a pass at a time,
+//                  coarse to fine. KS.
+//                  Added MoveCentre(). If the image has only moved by a whole number of pixels
+//                  since it was last computed, it is now shifted and only the strips that have
+//                  come into view are computed, on the GPU or the CPU. KS.
+//                  Added ComputePerturbed(), ReferenceOrbitInC(), PerturbedOK() and
+//                  OffsetCentre(), for magnifications beyond the reach of double precision.
+//                  The image centre is now held as a DoubleDouble. KS.
+//                  Added ComputeFloatFloat() and FloatFloatOK(), which use float-float
+//                  arithmetic on GPUs that don't support double precision. KS.
+//                  The CPU code and shaders now skip points in the main cardioid and the
+//                  period-2 bulb, and stop iterating orbits found to be cycling. These
+//                  interior checks can be disabled using SetInteriorChecks(). KS.
+//                  The CPU code now computes rows of points using AVX2, AVX-512 or NEON vector
+//                  instructions, where the CPU has them, selected at run time. KS.
+//                  The CPU threads now take rows a few at a time as they become free, rather
+//                  than each being given a fixed band of the image. KS.
+//                  Added SetTileQueue(), which has Compute() use a fixed number of persistent
+//                  workgroups taking tiles from a queue, rather than one per tile. KS.
+//                  Added ComputeHybrid(), which splits an image between the GPU and the CPU
+//                  threads, adjusting the split so both finish at about the same time. KS.
+//                  Added StartGPUImage() and FinishGPUImage(), which compute the next image
+//                  into a second image buffer while the current one is being displayed. KS.
+//                  The image buffer now holds the iteration counts as uint32_t rather than as
+//                  float, written that way by the shaders and the CPU code, so the renderer
+//                  no longer has to convert every pixel back to an integer. KS.
+//                  Added GetImageBuffer(), so a renderer using the same Framework can draw the
+//                  image straight from the buffer it was computed in. KS.
+//                  Added StartCPUImage() and FinishCPUImage(), which compute the next image
+//                  into the second image buffer using a background thread, so the CPU can
+//                  compute one image while the last is being coloured and displayed. KS.
+//                  Added the 'Profile' debug level, which has the time each few rows of a CPU
+//                  image take measured using the time stamp counter, and logged. KS.
+//                  Added the 'Stats' debug level, which has Compute() use MandelStats.comp to
+//                  record the iterations run by each workgroup, and log the load imbalance and
+//                  divergence they show, and GetWorkGroupStats(). KS.
+//                  The regions of the image buffer to sync are now given as VkDeviceSize
+//                  offsets and lengths, as the Framework now expects. KS.
+//                  The handler now uses the Framework's "COMPUTE" queue, which is a separate
+//                  compute-only queue if the program enabled one, so its work can overlap the
+//                  renderer's on the graphics queue. The image buffers are shared concurrently
+//                  by the queue families, and an image started by StartGPUImage() signals a
+//                  timeline semaphore that the renderer can wait for, through the new
+//                  GetImageReadyPoints(). KS.
+//                  Added SetSubdivide(), which has Compute(), ComputeInC() and StartCPUImage()
+//                  skip uniform areas of the image using the Mariani-Silver method, with the
+//                  new ComputeSubdivided(), ComputeSubdividedInC() and SubdivideInC(). KS.
+//                  Added GetImageChanges(), which says which strips of the image are new
+//                  since it was last called, recorded by the new NoteChanges(). The strips
+//                  are synched using regions from the new StripRegions(), which covers a
+//                  strip of whole rows with a single region. KS.
+//                  Added ComputeMixed(), which classifies the tiles of the image by the
+//                  precision they need, using the new TilePrecision() and ClassifyTiles(), and
+//                  has the GPU compute each set with its own shader in one command buffer,
+//                  through the new ComputeStripSets(). Added CountTilePrecisions(). KS.
+//                  Added ComputeFrames(), which computes a batch of complete images, each
+//                  with its own parameters and its own buffer, in one submission, with
+//                  GetFrameData(), MaxBatchFrames() and SetupFrameBuffers(). KS.
+//                  Added ComputeChunked(), which has the GPU compute an image in bands of rows
+//                  run a few at a time by the Framework's RunComputeChunks(), so a slow image
+//                  can be shown as it builds up, and dropped part way through by the new
+//                  CancelImage() when the view changes. Added SetupChunks(). KS.
+//                  ComputeChunked() now says whether it started a new image, so the caller
+//                  can time an image from its first band, not from one it abandoned. KS.
 
 #include "MandelComputeHandlerVulkan.h"
 
-#include <thread>
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <utility>
 
 //  These have to match the values used by the GPU shader code.
 
 static const uint32_t C_WorkGroupSize = 32;
 static const int C_StorageBufferBinding = 0;
-static const int C_UniformBufferBinding = 1;
+static const int C_OrbitBufferBinding = 1;
+static const int C_QueueBufferBinding = 1;
+static const int C_StatsBufferBinding = 1;
+
+//  The number of values MandelStats.comp records for each workgroup - the total iterations,
+//  the most iterations for one invocation, the lockstep cost and the number of pixels.
+
+static const uint32_t C_StatsPerGroup = 4;
+
+//  The workgroup size used by the tile queue shader, MandelQ.comp, which is also the size of
+//  a tile, and the most workgroups that are launched to work through the queue. These are
+//  set when the pipeline is created, so the shader doesn't hard-code them. Smaller tiles
+//  share out the work more evenly, and the number of workgroups only has to be enough to
+//  keep all of the GPU busy.
+
+static const uint32_t C_QueueTileSize = 16;
+static const uint32_t C_QueueGroups = 512;
+
+//  The workgroup size used by the subdivision shader, MandelMS.comp, which is also the size of
+//  the tiles it fills if their borders are uniform. The CPU code starts from larger tiles,
+//  C_SubdivideCPUTile square, which the threads take as they become free. It divides them into
+//  four until their insides are less than C_SubdivideMin pixels across, and then computes them
+//  in full.
+
+static const uint32_t C_SubdivideTileSize = 16;
+static const int C_SubdivideCPUTile = 64;
+static const int C_SubdivideMin = 4;
+
+//  The size of the square tiles that ComputeMixed() sorts by the precision they need. This is
+//  a multiple of C_WorkGroupSize, so each tile is a whole number of workgroups, and large
+//  enough that the tiles in a row that need the same precision can be merged into a handful
+//  of dispatches.
+
+static const int C_MixedTileSize = 64;
+
+//  The block size used by the first pass of ComputeInCProgressive(). This must be a power of 2.
+
+static const int C_RefineStep = 8;
+
+//  The number of rows the CPU threads take at a time when computing a whole image.
+
+static const int C_CPUTileRows = 4;
+
+//  ComputeHybrid() gives both the GPU and the CPU at least this many rows of the image, so the
+//  rate at which each works through them can always be measured. It sets the split using an
+//  average of those rates over the last few images, with the latest given this weight.
+
+static const int C_HybridMinRows = 8;
+static const double C_HybridWeight = 0.3;
+
+//  The default limit on the memory used by the image cache. At the default image size of
+//  1024 by 1024, this holds 64 images.
+
+static const long C_ImageCacheBytes = 256L * 1024L * 1024L;
+
+//  The most frames ComputeFrames() can compute in one batch, which is the number of descriptor
+//  sets in the pool for the frame buffers.
+
+static const int C_MaxBatchFrames = 16;
+
+//  ComputeChunked() has the GPU compute the image in bands of C_ChunkRows rows - a multiple of
+//  C_WorkGroupSize - with each submission aiming to take C_ChunkTargetMsec, and returns once
+//  it has been running for C_ChunkBudgetMsec, so the program can display what it has so far.
+
+static const int C_ChunkRows = 32;
+static const float C_ChunkTargetMsec = 10.0f;
+static const float C_ChunkBudgetMsec = 30.0f;
+
+//  The CPU code computes a row of points at a time using a 'row' routine, which may use vector
+//  instructions. SelectRowRoutine() returns the best one for this CPU - see ComputeRangeInC().
+
+typedef void (*RowRoutine)(uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                  prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks);
+
+static RowRoutine SelectRowRoutine(const char** Name = nullptr);
+
+//  How close, in pixels, a move of the image has to be to a whole number of pixels for
+//  ShiftImage() to treat it as one.
+
+static const double C_ShiftTolerance = 0.01;
+
+//  The relative precision of a DoubleDouble - 2 to the power -104 - used by PerturbedOK().
+
+static const double C_DoubleDoubleEpsilon = 4.93e-32;
 
 //  _debugOptions is the comma-separated list of all the diagnostic levels that the built-in debug
 //  handler recognises. If a call to _debug.Log() or .Logf() is added with a new level name, this
 //  new name must be added to this string.
 
-const std::string MandelComputeHandler::_debugOptions = "Setup,Timing";
+const std::string MandelComputeHandler::_debugOptions = "Setup,Timing,Profile,Stats";
 
 //  ------------------------------------------------------------------------------------------------
 
@@ -56,11 +219,28 @@ const std::string MandelComputeHandler::_debugOptions = "Setup,Timing";
 MandelComputeHandler::MandelComputeHandler(void* Framework)
 {
     _statusOK = true;
-    _uniformBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
     _imageBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
-    _uniformBufferAddr = nullptr;
+    _nextBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    _nextImageData = nullptr;
+    _nextDescriptorSet = VK_NULL_HANDLE;
+    _nextDescriptorSetP = VK_NULL_HANDLE;
+    _nextDescriptorSetPOK = false;
+    _nextCommandBuffer = VK_NULL_HANDLE;
+    _nextTicket = KVVulkanFramework::KV_NULL_TICKET;
+    _imageSemaphore = VK_NULL_HANDLE;
+    _imageSemaphoreValue = 0;
+    _imageReadyValue = 0;
+    _nextReadyValue = 0;
+    _nextPrecision = GPU_FLOAT;
+    _nextXCentLo = 0.0;
+    _nextYCentLo = 0.0;
+    _aheadPool = nullptr;
     _xCent = 0.0;
     _yCent = 0.0;;
+    _xCentLo = 0.0;
+    _yCentLo = 0.0;
+    _xMoveLeft = 0.0;
+    _yMoveLeft = 0.0;
     _magnification = 1.0;
     _width = 512.0;
     _height = 512.0;
@@ -69,6 +249,14 @@ MandelComputeHandler::MandelComputeHandler(void* Framework)
     _dx = 2.0 / 1024.0;
     _dy = 2.0 / 1024.0;
     _maxiter = 1024;
+    _interiorChecks = true;
+    _imageSource = IMAGE_NONE;
+    _imageStep = 0;
+    _changesPending = true;
+    _changesAll = true;
+    _changesShifted = false;
+    _changeShiftX = 0;
+    _changeShiftY = 0;
     _imageData = nullptr;
     _computeQueue = VK_NULL_HANDLE;
     _commandPool = VK_NULL_HANDLE;
@@ -81,15 +269,65 @@ MandelComputeHandler::MandelComputeHandler(void* Framework)
     _doubleSupportInGPU = false;
     _computePipelineLayoutD = VK_NULL_HANDLE;
     _computePipelineD = VK_NULL_HANDLE;
+    _computePipelineLayoutFF = VK_NULL_HANDLE;
+    _computePipelineFF = VK_NULL_HANDLE;
+    _orbitBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    _orbitData = nullptr;
+    _orbitBytes = 0;
+    _descriptorSetPOK = false;
+    _setLayoutP = VK_NULL_HANDLE;
+    _descriptorPoolP = VK_NULL_HANDLE;
+    _descriptorSetP = VK_NULL_HANDLE;
+    _computePipelineLayoutP = VK_NULL_HANDLE;
+    _computePipelineP = VK_NULL_HANDLE;
+    _computePipelineLayoutPD = VK_NULL_HANDLE;
+    _computePipelinePD = VK_NULL_HANDLE;
+    _hybridGPURate = 0.0;
+    _hybridCPURate = 0.0;
+    _tileQueue = false;
+    _queueBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    _queueData = nullptr;
+    _descriptorSetQOK = false;
+    _setLayoutQ = VK_NULL_HANDLE;
+    _descriptorPoolQ = VK_NULL_HANDLE;
+    _descriptorSetQ = VK_NULL_HANDLE;
+    _computePipelineLayoutQ = VK_NULL_HANDLE;
+    _computePipelineQ = VK_NULL_HANDLE;
+    _subdivide = false;
+    _computePipelineLayoutMS = VK_NULL_HANDLE;
+    _computePipelineMS = VK_NULL_HANDLE;
+    _statsBufferHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    _statsData = nullptr;
+    _statsBytes = 0;
+    _statsSubgroups = false;
+    _descriptorSetSOK = false;
+    _setLayoutS = VK_NULL_HANDLE;
+    _descriptorPoolS = VK_NULL_HANDLE;
+    _descriptorSetS = VK_NULL_HANDLE;
+    _computePipelineLayoutS = VK_NULL_HANDLE;
+    _computePipelineS = VK_NULL_HANDLE;
+    _lastStats = WorkGroupStats();
+    _lastStatsOK = false;
+    _imageCacheLimit = C_ImageCacheBytes;
+    _imageCacheHits = 0;
+    _descriptorPoolF = VK_NULL_HANDLE;
+    _frameNx = 0;
+    _frameNy = 0;
+    _nextChunk = 0;
+    _cancelFlag = false;
     _workGroupCounts[0] = _workGroupCounts[1] = _workGroupCounts[2] = 0;
     _frameworkIsLocal = false;
     _debug.SetSubSystem("Compute");
-    _debug.LevelsList("Setup,Timing");
+    _debug.LevelsList(_debugOptions);
+    _profileDebug = _debug.Level("Profile");
+    _statsDebug = _debug.Level("Stats");
     _vulkanFramework = (KVVulkanFramework*)Framework;
 }
 
 MandelComputeHandler::~MandelComputeHandler()
 {
+    if (_vulkanFramework) DropNextImage();
+    if (_aheadPool) delete _aheadPool;
     _imageData = nullptr;
     if (_frameworkIsLocal && _vulkanFramework) delete _vulkanFramework;
 }
@@ -110,6 +348,9 @@ void MandelComputeHandler::Initialise(bool Validate,const std::string& DebugLeve
     }
     InitialiseVulkanItems();
     RecomputeArgs();
+    const char* RowName = "";
+    SelectRowRoutine(&RowName);
+    _debug.Logf("Setup","CPU code will use %s instructions.",RowName);
 }
 
 void MandelComputeHandler::InitialiseVulkanItems()
@@ -125,70 +366,192 @@ void MandelComputeHandler::InitialiseVulkanItems()
     //  need that don't depend on knowing the image size to use - which we will eventually
     //  be told by a call to SetImageSize().
     
-    //  We can create the uniform buffer used for the arguments here. It never changes - although
-    //  its contents do.
+    //  The arguments for the computation are small enough to be passed as push constants,
+    //  which are recorded into the command buffer along with each dispatch, so no uniform
+    //  buffer is needed for them.
     
-    _debug.Log("Setup","Setting up uniform buffer for compute arguments.");
-    long uniformSizeInBytes = sizeof(MandelArgs);
-    _uniformBufferHndl = _vulkanFramework->SetBufferDetails(
-                                        C_UniformBufferBinding,"UNIFORM","SHARED",_statusOK);
-    _vulkanFramework->CreateBuffer(_uniformBufferHndl,uniformSizeInBytes,_statusOK);
-    long bytes;
-    _debug.Log("Setup","Mapping and initialising uniform buffer.");
-    _uniformBufferAddr = _vulkanFramework->MapBuffer(_uniformBufferHndl,&bytes,_statusOK);
-    if (_statusOK && _uniformBufferAddr) memcpy(_uniformBufferAddr,&_currentArgs,bytes);
-    
-    //  We can even set up the buffer description that will be used to create the main data
-    //  buffer, although for the moment we don't actually create the buffer. (To experiment
-    //  with a staged buffer, change 'SHARED' to 'STAGED_GPU' That's all that's needed.)
+    //  We can set up the buffer description that will be used to create the main data
+    //  buffer, although for the moment we don't actually create the buffer. The CPU reads
+    //  the image, so it is a 'READBACK' buffer, which uses cached memory if it can. (To
+    //  experiment with a staged buffer, change 'READBACK' to 'STAGED_GPU' That's all that's
+    //  needed.)
 
     _debug.Log("Setup","Setting up buffer to store resulting image.");
     _imageBufferHndl = _vulkanFramework->SetBufferDetails(
-                                        C_StorageBufferBinding,"STORAGE","SHARED",_statusOK);
+                                        C_StorageBufferBinding,"STORAGE","READBACK",_statusOK);
+                                        
+    //  StartGPUImage() computes the next image into a second buffer just like it, while the
+    //  first is being displayed. It swaps them over when the image is complete.
+    
+    _nextBufferHndl = _vulkanFramework->SetBufferDetails(
+                                        C_StorageBufferBinding,"STORAGE","READBACK",_statusOK);
+    
+    //  The compute queue may be from a different family to the graphics queue a renderer using
+    //  the same Framework reads the images with, so both image buffers are shared concurrently
+    //  between the families, rather than being passed from one to the other for every image.
+    
+    _vulkanFramework->SetBufferConcurrent(_imageBufferHndl,_statusOK);
+    _vulkanFramework->SetBufferConcurrent(_nextBufferHndl,_statusOK);
        
-    //  Given the handles to those two buffer descriptions, we can specify the layout of the
-    //  descriptor set that will be needed to describe them to the GPU shader.
+    //  Given the handle to that buffer description, we can specify the layout of the
+    //  descriptor set that will be needed to describe it to the GPU shader.
     
     std::vector<KVVulkanFramework::KVBufferHandle> handles;
     handles.push_back(_imageBufferHndl);
-    handles.push_back(_uniformBufferHndl);
     _vulkanFramework->CreateVulkanDescriptorSetLayout(handles,&_setLayout,_statusOK);
     
-     //  We also create a pool that can supply such descriptor sets.
+     //  We also create a pool that can supply such descriptor sets - one for each buffer.
     
-    _vulkanFramework->CreateVulkanDescriptorPool(handles,1,&_descriptorPool,_statusOK);
+    _vulkanFramework->CreateVulkanDescriptorPool(handles,2,&_descriptorPool,_statusOK);
 
-    //  And get that pool to supply the descriptor set that we'll use for the pipeline.
+    //  And get that pool to supply the descriptor sets that we'll use for the pipeline.
     
     _vulkanFramework->AllocateVulkanDescriptorSet(_setLayout,_descriptorPool,&_descriptorSet,
                                                                                     _statusOK);
+    _vulkanFramework->AllocateVulkanDescriptorSet(_setLayout,_descriptorPool,
+                                                                &_nextDescriptorSet,_statusOK);
     _debug.Log("Setup","Buffers and descriptors set up.");
 
-    //  And, given the set layout, we can specify the layout of the compute pipeline that will
-    //  run the shader, and we can create it.
+    //  And, given the set layout and the size of the push constant block, we can specify the
+    //  layout of the compute pipeline that will run the shader, and we can create it.
     
-    _vulkanFramework->CreateComputePipeline("MandelComp.spv","main",
-                       &_setLayout,&_computePipelineLayout,&_computePipeline,_statusOK);
+    std::vector<uint32_t> noConstants;
+    _vulkanFramework->CreateComputePipeline("MandelComp.spv","main",&_setLayout,
+        &_computePipelineLayout,&_computePipeline,noConstants,sizeof(MandelArgs),_statusOK);
     _debug.Log("Setup","Single precision pipeline created using MandelComp.spv.");
 
     
     //  If the GPU supports double precision, set up an alternative pipeline that can use it.
     
     if (_doubleSupportInGPU) {    
-        _vulkanFramework->CreateComputePipeline("MandelDComp.spv","main",
-                       &_setLayout,&_computePipelineLayoutD,&_computePipelineD,_statusOK);
+        _vulkanFramework->CreateComputePipeline("MandelDComp.spv","main",&_setLayout,
+          &_computePipelineLayoutD,&_computePipelineD,noConstants,sizeof(MandelArgs),_statusOK);
         _debug.Log("Setup","Double precision pipeline created using MandelDComp.spv.");
     }
+    
+    //  The float-float pipeline only uses float operations, so it can always be created. It
+    //  uses the same descriptor set and arguments as the others.
+    
+    _vulkanFramework->CreateComputePipeline("MandelFFComp.spv","main",&_setLayout,
+        &_computePipelineLayoutFF,&_computePipelineFF,noConstants,sizeof(MandelArgs),_statusOK);
+    _debug.Log("Setup","Float-float pipeline created using MandelFFComp.spv.");
+    
+    //  The perturbation pipelines, used once even double precision isn't enough, need the
+    //  reference orbit as well as the image, so they have a descriptor set of their own. The
+    //  CPU writes the orbit, so it is a 'SHARED' buffer. How big it needs to be depends on the
+    //  iteration limit, so it isn't created until ComputePerturbed() needs it. As with the
+    //  other pipelines, there is a second descriptor set for the second image buffer.
+    
+    _orbitBufferHndl = _vulkanFramework->SetBufferDetails(
+                                        C_OrbitBufferBinding,"STORAGE","SHARED",_statusOK);
+    handles.push_back(_orbitBufferHndl);
+    _vulkanFramework->CreateVulkanDescriptorSetLayout(handles,&_setLayoutP,_statusOK);
+    _vulkanFramework->CreateVulkanDescriptorPool(handles,2,&_descriptorPoolP,_statusOK);
+    _vulkanFramework->AllocateVulkanDescriptorSet(_setLayoutP,_descriptorPoolP,&_descriptorSetP,
+                                                                                    _statusOK);
+    _vulkanFramework->AllocateVulkanDescriptorSet(_setLayoutP,_descriptorPoolP,
+                                                               &_nextDescriptorSetP,_statusOK);
+    _vulkanFramework->CreateComputePipeline("MandelPComp.spv","main",&_setLayoutP,
+        &_computePipelineLayoutP,&_computePipelineP,noConstants,sizeof(PerturbArgs),_statusOK);
+    _debug.Log("Setup","Perturbation pipeline created using MandelPComp.spv.");
+    if (_doubleSupportInGPU) {
+        _vulkanFramework->CreateComputePipeline("MandelPDComp.spv","main",&_setLayoutP,
+                           &_computePipelineLayoutPD,&_computePipelinePD,noConstants,
+                                                             sizeof(PerturbArgs),_statusOK);
+        _debug.Log("Setup",
+                   "Double precision perturbation pipeline created using MandelPDComp.spv.");
+    }
+    
+    //  The tile queue pipeline also has a descriptor set of its own, with the counter the
+    //  workgroups use to take tiles from the queue. The CPU resets the counter before each
+    //  dispatch, so this is another 'SHARED' buffer, and it only needs to hold one int.
+    //  Its workgroup size is set using specialization constants.
+    
+    _queueBufferHndl = _vulkanFramework->SetBufferDetails(
+                                        C_QueueBufferBinding,"STORAGE","SHARED",_statusOK);
+    std::vector<KVVulkanFramework::KVBufferHandle> handlesQ;
+    handlesQ.push_back(_imageBufferHndl);
+    handlesQ.push_back(_queueBufferHndl);
+    _vulkanFramework->CreateVulkanDescriptorSetLayout(handlesQ,&_setLayoutQ,_statusOK);
+    _vulkanFramework->CreateVulkanDescriptorPool(handlesQ,1,&_descriptorPoolQ,_statusOK);
+    _vulkanFramework->AllocateVulkanDescriptorSet(_setLayoutQ,_descriptorPoolQ,&_descriptorSetQ,
+                                                                                    _statusOK);
+    _vulkanFramework->ResizeBuffer(_queueBufferHndl,sizeof(int),_statusOK);
+    long queueBytes;
+    _queueData = (int*)_vulkanFramework->MapBuffer(_queueBufferHndl,&queueBytes,_statusOK);
+    std::vector<uint32_t> tileConstants = {C_QueueTileSize,C_QueueTileSize};
+    _vulkanFramework->CreateComputePipeline("MandelQComp.spv","main",&_setLayoutQ,
+        &_computePipelineLayoutQ,&_computePipelineQ,tileConstants,sizeof(MandelArgs),_statusOK);
+    _debug.Log("Setup","Tile queue pipeline created using MandelQComp.spv.");
+    
+    //  The subdivision pipeline only needs the image buffer, so it uses the same descriptor
+    //  sets as the main pipeline. Its tile size is also set using specialization constants.
+    
+    std::vector<uint32_t> subdivideConstants = {C_SubdivideTileSize,C_SubdivideTileSize};
+    _vulkanFramework->CreateComputePipeline("MandelMSComp.spv","main",&_setLayout,
+                             &_computePipelineLayoutMS,&_computePipelineMS,subdivideConstants,
+                                                                sizeof(MandelArgs),_statusOK);
+    _debug.Log("Setup","Subdivision pipeline created using MandelMSComp.spv.");
+    
+    //  The workgroup statistics pipeline is only needed if the 'Stats' level is active. Like
+    //  the tile queue pipeline, it has a descriptor set of its own, adding a 'SHARED' buffer
+    //  that the CPU clears before each dispatch and reads afterwards. That buffer's size
+    //  depends on the number of workgroups, so it isn't created until it's used. If the device
+    //  supports subgroup arithmetic in compute shaders, the version of the shader that uses it
+    //  is chosen.
+    
+    if (_debug.Active(_statsDebug)) {
+        _statsBufferHndl = _vulkanFramework->SetBufferDetails(
+                                        C_StatsBufferBinding,"STORAGE","SHARED",_statusOK);
+        std::vector<KVVulkanFramework::KVBufferHandle> handlesS;
+        handlesS.push_back(_imageBufferHndl);
+        handlesS.push_back(_statsBufferHndl);
+        _vulkanFramework->CreateVulkanDescriptorSetLayout(handlesS,&_setLayoutS,_statusOK);
+        _vulkanFramework->CreateVulkanDescriptorPool(handlesS,1,&_descriptorPoolS,_statusOK);
+        _vulkanFramework->AllocateVulkanDescriptorSet(_setLayoutS,_descriptorPoolS,
+                                                                &_descriptorSetS,_statusOK);
+        uint32_t subgroupSize = 0;
+        _statsSubgroups = _vulkanFramework->DeviceSupportsSubgroupArithmetic(&subgroupSize);
+        std::string statsShader = "MandelStatsComp.spv";
+        if (_statsSubgroups) statsShader = "MandelStatsSGComp.spv";
+        std::vector<uint32_t> statsConstants = {C_WorkGroupSize,C_WorkGroupSize};
+        _vulkanFramework->CreateComputePipeline(statsShader,"main",&_setLayoutS,
+                                  &_computePipelineLayoutS,&_computePipelineS,statsConstants,
+                                                                sizeof(MandelArgs),_statusOK);
+        _debug.Logf("Setup","Workgroup statistics pipeline created using %s (subgroup size %u).",
+                                                            statsShader.c_str(),subgroupSize);
+    }
        
-   //  We can also create the one compute queue we will need
+   //  We can also get the one compute queue we will need. If the program has enabled a separate
+   //  compute queue, this is a queue from a compute-only family (if the GPU has one), so images
+   //  can be computed while a renderer using the same Framework draws on the graphics queue.
+   //  Otherwise, it's the same queue the renderer uses.
     
-    _vulkanFramework->GetDeviceQueue(&_computeQueue,_statusOK);
+    _vulkanFramework->GetDeviceQueue("COMPUTE",&_computeQueue,_statusOK);
     
-    //  And the command pool and command buffer
+    //  And the command pool and command buffer, which have to be for the same queue family.
     
-    _vulkanFramework->CreateCommandPool(&_commandPool,_statusOK);
+    _vulkanFramework->CreateCommandPool("COMPUTE",&_commandPool,_statusOK);
     _vulkanFramework->CreateComputeCommandBuffer(_commandPool,&_commandBuffer,_statusOK);
+    _vulkanFramework->CreateComputeCommandBuffer(_commandPool,&_nextCommandBuffer,_statusOK);
     _debug.Log("Setup","Command queue and command buffer created.");
+    
+    //  An image started by StartGPUImage() signals a timeline semaphore when it's complete, so a
+    //  renderer on another queue can have the GPU wait for it. See GetImageReadyPoints().
+    
+    if (_vulkanFramework->TimelineSemaphoresSupported()) {
+        _vulkanFramework->CreateTimelineSemaphore(0,&_imageSemaphore,_statusOK);
+    }
+    
+    //  Have the command buffer record GPU timestamps, so the time spent in the shader itself
+    //  can be logged. If the device doesn't support timestamps, this just logs a warning.
+    
+    _vulkanFramework->EnableDispatchTiming(true,_statusOK);
+    
+    //  The command buffer only needs to be recorded again if the arguments, the pipeline or
+    //  the image buffer change, so let the Framework reuse it when it can.
+    
+    _vulkanFramework->SetCommandBufferReusable(_commandBuffer,true,_statusOK);
 
  
     //  And that's all we can do to set things up until we're told the size of the image
@@ -210,9 +573,8 @@ void MandelComputeHandler::SetImageSize(int Nx,int Ny)
     //  CPU create an image at the address given by _imageData. (See programming notes
     //  for a little more discussion of buffer allocation.)
     
-    //  We also need a uniform buffer to pass the parameters for the computation to the
-    //  GPU. This is created when this compute handler is itself created, and its size
-    //  (but not its contents) never needs to change. However, the image size can change.
+    //  The parameters for the computation are passed to the GPU as push constants, so
+    //  don't need a buffer. However, the image size can change.
     
     //  If the image size changes, the image buffer has to change to match it. So do the the
     //  number of work groups needed to process it. So this routine will be called at the start
@@ -226,8 +588,14 @@ void MandelComputeHandler::SetImageSize(int Nx,int Ny)
     if (_nx != Nx || _ny != Ny) {
         
         _debug.Logf("Setup","Rebuilding image buffer to %d by %d.",Nx,Ny);
+        _imageSource = IMAGE_NONE;
+        NoteChanges();
         MsecTimer theTimer;
         
+        //  The GPU mustn't still be computing an image into the second buffer.
+        
+        DropNextImage();
+        
         //  First we need to deal with the image buffer.
         
         //  Note that the first time through this code, we will have a handle for the buffer
@@ -237,23 +605,45 @@ void MandelComputeHandler::SetImageSize(int Nx,int Ny)
         //  ResizeBuffer() can handle the case where the Vulkan buffer doesn't exist yet, so we
         //  can get away with treating all cases as a rezise.
                     
-        int sizeInBytes = Nx * Ny * sizeof(float);
+        int sizeInBytes = Nx * Ny * sizeof(uint32_t);
         _vulkanFramework->ResizeBuffer(_imageBufferHndl,sizeInBytes,_statusOK);
 
         _debug.Logf("Timing","Resized image buffer at %.2f msec",theTimer.ElapsedMsec());
 
         long bytes;
-        _imageData = (float*)_vulkanFramework->MapBuffer(_imageBufferHndl,&bytes,_statusOK);
+        _imageData = (uint32_t*)_vulkanFramework->MapBuffer(_imageBufferHndl,&bytes,_statusOK);
         
-        //  Now that we have created both our buffers - the uniform buffer used for the arguments
-        //  and the storage buffer used for the image data, we finally set their details into
-        //  the descriptor set that's already been created and associated with the pipeline (all
+        //  Now that we have created the storage buffer used for the image data, we finally set
+        //  its details into the descriptor set that's already been created and associated with the pipeline (all
         //  this was done in InitialiseVulkan()).
             
         std::vector<KVVulkanFramework::KVBufferHandle> bufferHandles;
         bufferHandles.push_back(_imageBufferHndl);
-        bufferHandles.push_back(_uniformBufferHndl);
         _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_descriptorSet,_statusOK);
+        
+        //  The second buffer, used by StartGPUImage(), is just the same.
+        
+        _vulkanFramework->ResizeBuffer(_nextBufferHndl,sizeInBytes,_statusOK);
+        _nextImageData = (uint32_t*)_vulkanFramework->MapBuffer(_nextBufferHndl,&bytes,_statusOK);
+        bufferHandles[0] = _nextBufferHndl;
+        _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_nextDescriptorSet,_statusOK);
+        
+        //  The perturbation and tile queue descriptor sets also describe the image buffers, so
+        //  they will need setting up again before they're next used.
+        
+        _descriptorSetPOK = false;
+        _nextDescriptorSetPOK = false;
+        _descriptorSetQOK = false;
+        _descriptorSetSOK = false;
+        
+        //  The rates ComputeHybrid() has measured were for rows of the old length.
+        
+        _hybridGPURate = 0.0;
+        _hybridCPURate = 0.0;
+        
+        //  And the cached images are all the wrong size.
+        
+        _imageCache.clear();
                
         //  Tweaking the arrangement of GPU threads and thread groups can be tricky, but if
         //  we assume the GPU shader code has set up a hard-coded local workgroup size of
@@ -285,6 +675,10 @@ void MandelComputeHandler::SetCentre(double XCent,double YCent)
 {
     _xCent = XCent;
     _yCent = YCent;
+    _xCentLo = 0.0;
+    _yCentLo = 0.0;
+    _xMoveLeft = 0.0;
+    _yMoveLeft = 0.0;
 }
 
 void MandelComputeHandler::SetMagnification(double Magnification)
@@ -306,6 +700,108 @@ void MandelComputeHandler::SetMaxIter(int MaxIter)
     RecomputeArgs();
 }
 
+//  SetInteriorChecks() enables or disables the checks that save iterating the points inside
+//  the set - see PointInC() and the GPU code. They are enabled by default, and don't change
+//  the image, so this is only of interest when benchmarking. The next image is computed in
+//  full, rather than reusing the current one, so the difference shows.
+
+void MandelComputeHandler::SetInteriorChecks(bool Enable)
+{
+    if (Enable != _interiorChecks) {
+        _imageSource = IMAGE_NONE;
+        _imageCache.clear();
+    }
+    _interiorChecks = Enable;
+    RecomputeArgs();
+}
+
+bool MandelComputeHandler::GetInteriorChecks(void)
+{
+    return _interiorChecks;
+}
+
+//  SetTileQueue() selects how Compute() has the GPU work through the image. Normally, it
+//  launches one workgroup for each tile of the image, and leaves it to the GPU to schedule
+//  them. Points inside the set take far longer than those outside, so some workgroups take
+//  much longer than others. With the tile queue, a fixed number of workgroups each keep
+//  taking the next tile from a counter until the image is done - see MandelQ.comp. The image
+//  is the same either way, so this is only of interest when benchmarking, and as with
+//  SetInteriorChecks() the next image is computed in full.
+
+void MandelComputeHandler::SetTileQueue(bool Enable)
+{
+    if (Enable != _tileQueue) {
+        _imageSource = IMAGE_NONE;
+        _imageCache.clear();
+    }
+    _tileQueue = Enable;
+}
+
+bool MandelComputeHandler::GetTileQueue(void)
+{
+    return _tileQueue;
+}
+
+//  SetSubdivide() enables or disables the skipping of uniform areas of the image by Compute(),
+//  ComputeInC() and StartCPUImage() - see the notes in the header. (ComputeInCProgressive()
+//  just uses ComputeInC() when this is enabled, as the image is then quick enough to compute in
+//  one go.) The other GPU routines, and the strips computed when an image is moved, always
+//  compute every pixel. A subdivided image may differ slightly from a full one, so the next
+//  image is computed afresh, not taken from the cache.
+
+void MandelComputeHandler::SetSubdivide(bool Enable)
+{
+    if (Enable != _subdivide) {
+        _imageSource = IMAGE_NONE;
+        _imageCache.clear();
+    }
+    _subdivide = Enable;
+}
+
+bool MandelComputeHandler::GetSubdivide(void)
+{
+    return _subdivide;
+}
+
+//  SetImageCacheLimit() sets the most memory, in bytes, the image cache can use. Complete
+//  images are kept in the cache, and if the parameters for a new image match one of them, and
+//  it would be computed the same way, the cached image is used rather than computing it again.
+//  This saves recomputing the images when the view goes back to one already seen - when
+//  zooming back out along the same path, or going back to a remembered position. When the
+//  cache is full, the image least recently used is dropped. A limit of zero disables the cache.
+
+void MandelComputeHandler::SetImageCacheLimit(long Bytes)
+{
+    _imageCacheLimit = Bytes;
+    long bytes = long(_nx) * long(_ny) * long(sizeof(uint32_t));
+    while (!_imageCache.empty() && long(_imageCache.size()) * bytes > _imageCacheLimit) {
+        _imageCache.pop_back();
+    }
+}
+
+long MandelComputeHandler::GetImageCacheLimit(void)
+{
+    return _imageCacheLimit;
+}
+
+//  GetWorkGroupStats() returns the workgroup statistics for the last image computed by
+//  Compute() while the 'Stats' debug level was active. It returns false if there is no such
+//  image. Images taken from the cache, or only partly computed after the image was moved,
+//  don't change these.
+
+bool MandelComputeHandler::GetWorkGroupStats(WorkGroupStats* Stats)
+{
+    if (_lastStatsOK) *Stats = _lastStats;
+    return _lastStatsOK;
+}
+
+//  GetImageCacheHits() returns the number of images that have been taken from the cache.
+
+long MandelComputeHandler::GetImageCacheHits(void)
+{
+    return _imageCacheHits;
+}
+
 double MandelComputeHandler::GetMagnification(void)
 {
     return _magnification;
@@ -317,11 +813,63 @@ void MandelComputeHandler::GetCentre(double* Xcent,double* Ycent)
     *Ycent = _yCent;
 }
 
-float* MandelComputeHandler::GetImageData()
+uint32_t* MandelComputeHandler::GetImageData()
 {
     return _imageData;
 }
 
+//  GetImageChanges() says how the current image differs from the one that was current when it
+//  was last called. If the image is the old one moved so that the new pixel (Ix,Iy) has the
+//  value of the old pixel (Ix + ShiftX,Iy + ShiftY), with only the strips in Areas computed
+//  afresh, it returns true. If the image hasn't changed at all, it also returns true, with no
+//  shift and no areas. Otherwise, including when more than one new image has been computed
+//  since the last call, it returns false, and the whole image has to be taken as new.
+
+bool MandelComputeHandler::GetImageChanges(int* ShiftX,int* ShiftY,std::vector<Strip>& Areas)
+{
+    bool partial = !(_changesPending && _changesAll);
+    *ShiftX = 0;
+    *ShiftY = 0;
+    Areas.clear();
+    if (_changesPending && partial) {
+        *ShiftX = _changeShiftX;
+        *ShiftY = _changeShiftY;
+        Areas = _changeAreas;
+    }
+    _changesPending = false;
+    _changesAll = false;
+    return partial;
+}
+
+//  GetImageBuffer() returns the Framework handle of the buffer holding the current image - the
+//  one whose address GetImageData() returns - so a renderer using the same Framework can read
+//  the image on the GPU, without it passing through the CPU. Any image data written by the CPU
+//  is flushed first, so the GPU sees it. The buffer is a storage buffer with binding 0. It is
+//  only valid until the next image is computed, and may then be replaced by a different buffer.
+
+KVVulkanFramework::KVBufferHandle MandelComputeHandler::GetImageBuffer()
+{
+    _vulkanFramework->FlushBuffer(_imageBufferHndl,_statusOK);
+    return _imageBufferHndl;
+}
+
+//  GetImageReadyPoints() returns the timeline semaphore value signalled when the GPU finished
+//  writing the current image into the buffer GetImageBuffer() returns, for a renderer to have
+//  its own submissions wait for. This orders them after the compute queue's writes on the GPU
+//  itself, which matters if the compute and graphics queues are different. The vector is empty
+//  if there is nothing to wait for - if the device doesn't support timeline semaphores, or the
+//  image wasn't computed ahead by StartGPUImage(). (Images computed any other way have been
+//  waited for by the CPU.)
+
+std::vector<KVVulkanFramework::KVTimelinePoint> MandelComputeHandler::GetImageReadyPoints()
+{
+    std::vector<KVVulkanFramework::KVTimelinePoint> points;
+    if (_imageSemaphore != VK_NULL_HANDLE && _imageReadyValue > 0) {
+        points.push_back({_imageSemaphore,_imageReadyValue});
+    }
+    return points;
+}
+
 //  GetDebugOptions() returns the comma-separated list of the various diagnostic levels supported
 //  by the compute handler. Note that this is a static routine; it can be convenient for a program
 //  to have this list available before the compuet handler is constructed, and it is in any case a
@@ -332,6 +880,28 @@ std::string MandelComputeHandler::GetDebugOptions(void)
     return _debugOptions;
 }
 
+//  CPUProfile() returns the profile the times taken by the CPU tiles are to be recorded in, or
+//  null if the 'Profile' debug level isn't active. The tiles are timed using the time stamp
+//  counter, which costs little enough that timing every few rows doesn't change the figures.
+//  ReportCPUProfile() logs the times recorded, at the 'Profile' level, and clears them. (An
+//  image computed ahead by StartCPUImage() isn't profiled, as it runs alongside other work.)
+
+CycleProfile* MandelComputeHandler::CPUProfile()
+{
+    if (!_debug.Active(_profileDebug)) return nullptr;
+    CycleTimer::Calibrate();
+    return &_cpuProfile;
+}
+
+void MandelComputeHandler::ReportCPUProfile()
+{
+    if (_cpuProfile.Calls() == 0) return;
+    _debug.Logf(_profileDebug,"CPU tiles: %d of up to %d rows, %.1f usec a row, longest %.1f usec",
+                  int(_cpuProfile.Calls()),C_CPUTileRows,_cpuProfile.NsecPerItem() * 0.001,
+                                                                    _cpuProfile.LongestUsec());
+    _cpuProfile.Clear();
+}
+
 void MandelComputeHandler::RecomputeArgs()
 {
     //  This may seem to be an odd place to take this into account, but it was actually easiest
@@ -352,8 +922,18 @@ void MandelComputeHandler::RecomputeArgs()
     double yRange = aspect * xRange * double(_ny) / double(_nx);
     _dx = xRange/double(_nx);
     _dy = yRange/double(_ny);
-    _currentArgs = {float(_xCent),float(_yCent),float(_dx),float(_dy),_maxiter,_nx,_ny,0,
-                                                                       _xCent,_yCent,_dx,_dy};
+    
+    //  The float-float shader also needs the parts of the centre and scale values lost when
+    //  they're rounded to float. (This includes the low part of the DoubleDouble centre, which
+    //  is well below what a float-float can hold, but costs nothing.)
+    
+    float xCentLo = float((_xCent - double(float(_xCent))) + _xCentLo);
+    float yCentLo = float((_yCent - double(float(_yCent))) + _yCentLo);
+    float dXLo = float(_dx - double(float(_dx)));
+    float dYLo = float(_dy - double(float(_dy)));
+    _currentArgs = {float(_xCent),float(_yCent),float(_dx),float(_dy),_maxiter,_nx,_ny,
+                    0,0,_nx,_ny,xCentLo,yCentLo,dXLo,dYLo,_interiorChecks ? 1 : 0,
+                                                                  _xCent,_yCent,_dx,_dy};
 }
 
 void MandelComputeHandler::Compute ()
@@ -362,19 +942,48 @@ void MandelComputeHandler::Compute ()
     //printf ("%p %d %d %f %f %f %f %d\n",_imageData,_nx,_ny,_xCent,_yCent,_dx,_dy,_maxiter);
         
     RecomputeArgs();
-    if (_statusOK && _uniformBufferAddr) memcpy(_uniformBufferAddr,&_currentArgs,
-                                                                           sizeof(MandelArgs));
+    if (ImageFromCache(IMAGE_GPU)) return;
+    
+    //  If this is the last GPU image moved by a whole number of pixels, only the strips that
+    //  have come into view need computing.
+    
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_GPU,strips)) {
+        ComputeStrips(_computePipeline,_computePipelineLayout,strips);
+        NoteImage(IMAGE_GPU,0);
+        return;
+    }
+    if (_tileQueue) {
+        ComputeWithTileQueue();
+        return;
+    }
+    if (_subdivide) {
+        ComputeSubdivided();
+        return;
+    }
+    if (_computePipelineS != VK_NULL_HANDLE && _debug.Active(_statsDebug)) {
+        ComputeWithStats();
+        return;
+    }
 
-    //  This sets up the pipeline for the GPU calculation and runs it.
-        
+    //  This sets up the pipeline for the GPU calculation and runs it. The arguments are
+    //  recorded into the command buffer as push constants.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
     _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,_computePipeline,
-                        _computePipelineLayout,&_descriptorSet,_workGroupCounts,_statusOK);
+                        _computePipelineLayout,&_descriptorSet,_workGroupCounts,noBuffers,
+                                   noBuffers,&_currentArgs,sizeof(MandelArgs),_statusOK);
     _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU kernel took %.3f msec",kernelMsec);
+    }
     
     //  If a staged buffer is being used, it needs to be synched at this point. If a non-staged
     //  buffer is being used, this call is simply a null operation, so it can be left in anyway.
     
     _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    NoteImage(IMAGE_GPU,0);
 }
 
 void MandelComputeHandler::ComputeDouble ()
@@ -393,158 +1002,2022 @@ void MandelComputeHandler::ComputeDouble ()
         //  precision pipeline and its associated layout, descriptor set, etc..
         
         RecomputeArgs();
-        if (_statusOK && _uniformBufferAddr) memcpy(_uniformBufferAddr,&_currentArgs,
-                                                                           sizeof(MandelArgs));
+        if (ImageFromCache(IMAGE_GPU_D)) return;
+        std::vector<Strip> strips;
+        if (ShiftImage(IMAGE_GPU_D,strips)) {
+            ComputeStrips(_computePipelineD,_computePipelineLayoutD,strips);
+            NoteImage(IMAGE_GPU_D,0);
+            return;
+        }
 
         //  Set up the pipeline for the GPU calculation and run it.
         
+        std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
         _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,_computePipelineD,
-                        _computePipelineLayoutD,&_descriptorSet,_workGroupCounts,_statusOK);
+                        _computePipelineLayoutD,&_descriptorSet,_workGroupCounts,noBuffers,
+                                   noBuffers,&_currentArgs,sizeof(MandelArgs),_statusOK);
         _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+        float kernelMsec;
+        if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+            _debug.Logf("Timing","GPU double precision kernel took %.3f msec",kernelMsec);
+        }
     
         //  If a staged buffer is being used, synch it.
     
         _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+        NoteImage(IMAGE_GPU_D,0);
     }
 }
 
+//  ComputeFloatFloat() is the same as Compute(), but uses the float-float pipeline, which gets
+//  close to double precision using only float operations, so it works on any GPU.
 
-void MandelComputeHandler::ComputeInC ()
+void MandelComputeHandler::ComputeFloatFloat ()
 {
     RecomputeArgs();
+    if (ImageFromCache(IMAGE_GPU_FF)) return;
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_GPU_FF,strips)) {
+        ComputeStrips(_computePipelineFF,_computePipelineLayoutFF,strips);
+        NoteImage(IMAGE_GPU_FF,0);
+        return;
+    }
+
+    //  Set up the pipeline for the GPU calculation and run it.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,_computePipelineFF,
+                    _computePipelineLayoutFF,&_descriptorSet,_workGroupCounts,noBuffers,
+                               noBuffers,&_currentArgs,sizeof(MandelArgs),_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU float-float kernel took %.3f msec",kernelMsec);
+    }
     
-    ComputeInCThreads (_imageData,_nx,_ny,_xCent,_yCent,_dx,_dy,_maxiter);
+    //  If a staged buffer is being used, synch it.
+    
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    NoteImage(IMAGE_GPU_FF,0);
 }
 
-void MandelComputeHandler::ComputeInCThreads (
-        float* Data,int Nx,int Ny,prec Xcent,prec Ycent,
-                                       prec Dx,prec Dy,int MaxIter)
-{
-    int nThreads = std::thread::hardware_concurrency();
-    if (nThreads <= 0) nThreads = 1;
+//  ComputeChunked() computes the image using the GPU in the given precision, just as Compute(),
+//  ComputeDouble() or ComputeFloatFloat() do, but in bands of rows, which the Framework's
+//  RunComputeChunks() submits a few at a time, so no one submission runs for long. Each call
+//  runs bands for up to C_ChunkBudgetMsec, and returns true once the image is complete, so a
+//  slow image can be displayed as it builds up. If the image parameters have changed since the
+//  last call, or CancelImage() has been called, the bands left for the old image are dropped,
+//  and a new image is started. The tile queue, subdivision and workgroup statistics have
+//  their own ways of dispatching the image, so with those the whole image is computed at once,
+//  as it is with GPU_PERTURBED. *Started is set true if this call started computing an image
+//  from scratch - false if it went on with one already started, or took the image from the
+//  cache or shifted the last one - so the time the calls take for an image can be added up.
 
-    std::thread* threads = new std::thread[nThreads];
-    int iY = 0;
-    int iYinc = Ny / nThreads;
-    for (int iThread = 0; iThread < nThreads; iThread++) {
-        threads[iThread] = std::thread (ComputeRangeInC,Data,Nx,Ny,iY,iY+iYinc,Xcent,Ycent,Dx,Dy,
-                                                                                         MaxIter);
-        iY += iYinc;
+bool MandelComputeHandler::ComputeChunked (GPUPrecision Precision,bool* Started)
+{
+    *Started = false;
+    if (Precision == GPU_DOUBLE && !_doubleSupportInGPU) Precision = GPU_FLOAT;
+    bool statsActive = (_computePipelineS != VK_NULL_HANDLE && _debug.Active(_statsDebug));
+    if (Precision == GPU_PERTURBED) {
+        ComputePerturbed();
+        *Started = true;
+        return true;
+    }
+    if (Precision == GPU_FLOAT && (_tileQueue || _subdivide || statsActive)) {
+        Compute();
+        *Started = true;
+        return true;
+    }
+    VkPipeline pipeline = _computePipeline;
+    VkPipelineLayout pipelineLayout = _computePipelineLayout;
+    if (Precision == GPU_DOUBLE) {
+        pipeline = _computePipelineD;
+        pipelineLayout = _computePipelineLayoutD;
+    } else if (Precision == GPU_FLOAT_FLOAT) {
+        pipeline = _computePipelineFF;
+        pipelineLayout = _computePipelineLayoutFF;
     }
-    for (int iThread = 0; iThread < nThreads; iThread++) {
-        threads[iThread].join();
+    
+    RecomputeArgs();
+    ImageSource source = GPUSource(Precision);
+    if (ImageFromCache(source)) return true;
+    std::vector<Strip> strips;
+    if (ShiftImage(source,strips)) {
+        ComputeStrips(pipeline,pipelineLayout,strips);
+        NoteImage(source,0);
+        return true;
     }
-    delete[] threads;
     
-    if (iY < Ny) {
-        ComputeRangeInC(Data,Nx,Ny,iY,Ny,Xcent,Ycent,Dx,Dy,MaxIter);
+    //  A new image is started by setting up its bands and noting the image as incomplete,
+    //  which NoteImage() does for any non-zero step.
+    
+    bool cancelled = _cancelFlag.exchange(false);
+    if (cancelled || _imageSource != source || !SameImage() || _chunks.empty()) {
+        SetupChunks(pipeline,pipelineLayout);
+        NoteImage(source,1);
+        *Started = true;
     }
-
+    NoteChanges();
+    MsecTimer chunkTimer;
+    int firstChunk = _nextChunk;
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _nextChunk = _vulkanFramework->RunComputeChunks(_computeQueue,_commandBuffer,_chunks,
+             firstChunk,noBuffers,C_ChunkTargetMsec,C_ChunkBudgetMsec,&_cancelFlag,_statusOK);
+    _debug.Logf("Timing","GPU ran bands %d to %d of %d in %.3f msec",firstChunk,_nextChunk - 1,
+                                          int(_chunks.size()),chunkTimer.ElapsedMsec());
+    if (_nextChunk < int(_chunks.size())) return false;
     
+    //  The image is complete, so any staged buffer is synched, and the image cached.
+    
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    _chunks.clear();
+    _imageStep = 0;
+    CacheImage();
+    return true;
 }
 
-void MandelComputeHandler::ComputeRangeInC (
-       float* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
-                                             prec Dx,prec Dy,int MaxIter)
+//  CancelImage() has ComputeChunked() drop the bands of the image it is computing that have yet
+//  to run. It only sets a flag, so it can be called from any thread, and if ComputeChunked() is
+//  running, it returns once the submission in progress has completed.
+
+void MandelComputeHandler::CancelImage ()
 {
-    Data += Iyst * Nx;
-    prec gridXcent = Nx * 0.5;
-    prec gridYcent = Ny * 0.5;
-    for (int Iy = Iyst; Iy < Iyen; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            // Scale
-            prec x0 = Xcent + (prec(Ix) - gridXcent) * Dx;
-            prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+    _cancelFlag = true;
+}
 
-            // Implement Mandelbrot set
-           
-            prec x = 0.0;
-            prec y = 0.0;
-            int iteration = 0;
-            prec xtmp = 0.0;
-            while (((x * x) + (y * y) <= 4.0) && (iteration < MaxIter))
-            {
-                xtmp = (x + y) * (x - y) + x0;
-                y = (2.0 * x * y) + y0;
-                x = xtmp;
-                iteration += 1;
-            }
+//  SetupChunks() sets up the dispatches ComputeChunked() uses for the current image, one for
+//  each band of C_ChunkRows rows, using the given pipeline.
 
-            // Treat iteration result as a colour value for the image.
-            float colour = (float)(iteration);
-            if (iteration == MaxIter) colour = 0.0;
-            *Data++ = colour;
-       }
+void MandelComputeHandler::SetupChunks (VkPipeline Pipeline,VkPipelineLayout PipelineLayout)
+{
+    int bands = (_ny + C_ChunkRows - 1) / C_ChunkRows;
+    _chunkArgs.assign(bands,_currentArgs);
+    _chunks.clear();
+    for (int band = 0; band < bands; band++) {
+        MandelArgs& args = _chunkArgs[band];
+        args.iyOrigin = band * C_ChunkRows;
+        args.iyEnd = std::min(args.iyOrigin + C_ChunkRows,_ny);
+        KVVulkanFramework::KVDispatch dispatch;
+        dispatch.PipelineHndl = Pipeline;
+        dispatch.PipelineLayoutHndl = PipelineLayout;
+        dispatch.DescriptorSetHndl = _descriptorSet;
+        dispatch.WorkGroupCounts[0] = _workGroupCounts[0];
+        dispatch.WorkGroupCounts[1] =
+                      (uint32_t(args.iyEnd - args.iyOrigin) + C_WorkGroupSize - 1)/C_WorkGroupSize;
+        dispatch.WorkGroupCounts[2] = 1;
+        dispatch.PushConstants = &args;
+        dispatch.PushConstantSize = sizeof(MandelArgs);
+        _chunks.push_back(dispatch);
     }
-
+    _nextChunk = 0;
 }
 
-bool MandelComputeHandler::FloatOKatXY(int Ix,int Iy)
+//  StartGPUImage() has the GPU start computing the image for the current parameters, in the
+//  given precision, but doesn't wait for it to finish. This lets a program that knows what the
+//  next image will be - one zooming in, for example - have the GPU compute it while the current
+//  image is being displayed. The new image goes into a second buffer, so GetImageData() still
+//  returns the current one until FinishGPUImage() is called. It returns false if the GPU can't
+//  compute the image in that precision, or if it doesn't need to because the image is in the
+//  cache. (This always uses the normal dispatch, even if the tile queue is enabled.) With
+//  GPU_PERTURBED, the reference orbit is computed by the CPU before the GPU is started.
+
+bool MandelComputeHandler::StartGPUImage (GPUPrecision Precision)
 {
-    //  This checks whether floating point rounding error will not show up at a given
-    //  point in the image (given by its pixel coordinates). It calculates the position
-    //  in the Mandelbrot set for this pixel given the current X and Y center and the
-    //  magnification, then offsets this by roughly the equivalent in image pixel
-    //  coordinates of a pixel in the display and recalculates the position. If floating
-    //  point precision is such that these two positions appear the same due to rounding
-    //  error, then it returns false. Strictly, there still will be rounding error, but
-    //  it probably won't be visible with the current display settings.
+    DropNextImage();
+    if (_nx == 0 || _ny == 0) return false;
+    VkPipeline pipeline = _computePipeline;
+    VkPipelineLayout pipelineLayout = _computePipelineLayout;
+    if (Precision == GPU_DOUBLE) {
+        if (!_doubleSupportInGPU) return false;
+        pipeline = _computePipelineD;
+        pipelineLayout = _computePipelineLayoutD;
+    } else if (Precision == GPU_FLOAT_FLOAT) {
+        pipeline = _computePipelineFF;
+        pipelineLayout = _computePipelineLayoutFF;
+    } else if (Precision == GPU_PERTURBED) {
+        pipeline = _computePipelineP;
+        pipelineLayout = _computePipelineLayoutP;
+        if (_doubleSupportInGPU) {
+            pipeline = _computePipelinePD;
+            pipelineLayout = _computePipelineLayoutPD;
+        }
+    }
+    RecomputeArgs();
+    if (FindCachedImage(GPUSource(Precision)) != _imageCache.end()) return false;
     
-    float Xinc = float(_nx) / float(_width);
-    float X0 = float(_xCent + (float(Ix) - _nx * 0.5) * _dx);
-    float X1 = float(_xCent + (float(Ix) + Xinc - _nx * 0.5) * _dx);
-    float Yinc = float(_ny) / float(_height);
-    float Y0 = float(_yCent + (float(Iy) - _ny * 0.5) * _dy);
-    float Y1 = float(_yCent + (float(Iy) + Yinc - _ny * 0.5) * _dy);
+    //  The arguments only hold the low parts of the centre rounded to float, so those are
+    //  kept as well, for FinishGPUImage() to check.
+    
+    _nextArgs = _currentArgs;
+    _nextXCentLo = _xCentLo;
+    _nextYCentLo = _yCentLo;
+    _nextPrecision = Precision;
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    if (Precision == GPU_PERTURBED) {
+        int refLen = PrepareOrbit();
+        if (!_nextDescriptorSetPOK) {
+            std::vector<KVVulkanFramework::KVBufferHandle> bufferHandles;
+            bufferHandles.push_back(_nextBufferHndl);
+            bufferHandles.push_back(_orbitBufferHndl);
+            _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_nextDescriptorSetP,
+                                                                                   _statusOK);
+            _nextDescriptorSetPOK = _statusOK;
+        }
+        if (refLen == 0 || !_nextDescriptorSetPOK) return false;
+        PerturbArgs args = {float(_dx),float(_dy),_maxiter,_nx,_ny,refLen,_dx,_dy};
+        _vulkanFramework->RecordComputeCommandBuffer(_nextCommandBuffer,pipeline,pipelineLayout,
+                               &_nextDescriptorSetP,_workGroupCounts,noBuffers,noBuffers,&args,
+                                                             sizeof(PerturbArgs),_statusOK);
+    } else {
+        _vulkanFramework->RecordComputeCommandBuffer(_nextCommandBuffer,pipeline,pipelineLayout,
+                        &_nextDescriptorSet,_workGroupCounts,noBuffers,noBuffers,&_nextArgs,
+                                                                  sizeof(MandelArgs),_statusOK);
+    }
+    
+    //  If it can, the submission signals the next value of the image semaphore when it's done.
+    
+    _nextReadyValue = 0;
+    if (_imageSemaphore != VK_NULL_HANDLE) {
+        _nextReadyValue = ++_imageSemaphoreValue;
+        std::vector<KVVulkanFramework::KVTimelinePoint> noWaits;
+        std::vector<KVVulkanFramework::KVTimelinePoint> signals = {{_imageSemaphore,
+                                                                             _nextReadyValue}};
+        _nextTicket = _vulkanFramework->SubmitCommandBuffer(_computeQueue,_nextCommandBuffer,
+                                                              noWaits,0,signals,_statusOK);
+    } else {
+        _nextTicket = _vulkanFramework->SubmitCommandBuffer(_computeQueue,_nextCommandBuffer,
+                                                                                   _statusOK);
+    }
+    return _nextTicket != KVVulkanFramework::KV_NULL_TICKET;
+}
 
-    return ((Y1 - Y0) > 0.0f) && ((X1 - X0) > 0.0f);
+//  FinishGPUImage() is called when the next image is needed. If StartGPUImage() was called
+//  with the same precision, and the image parameters haven't changed since, it waits for the
+//  GPU to finish that image, makes it the current image, and returns true. Otherwise, it
+//  returns false, and the image has to be computed in the usual way.
+
+bool MandelComputeHandler::FinishGPUImage (GPUPrecision Precision)
+{
+    if (_nextTicket == KVVulkanFramework::KV_NULL_TICKET) return false;
+    RecomputeArgs();
+    bool same = (Precision == _nextPrecision && _nextXCentLo == _xCentLo &&
+                                                               _nextYCentLo == _yCentLo &&
+                              memcmp(&_nextArgs,&_currentArgs,sizeof(MandelArgs)) == 0);
+    MsecTimer waitTimer;
+    DropNextImage();
+    if (!same) return false;
+    _debug.Logf("Timing","Waited %.3f msec for GPU image started ahead",waitTimer.ElapsedMsec());
+    SwapNextImage();
+    _imageReadyValue = _nextReadyValue;
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    NoteImage(GPUSource(Precision),0);
+    return true;
 }
 
-bool MandelComputeHandler::FloatOK(void)
+//  GPUSource() returns the image source for an image computed by the GPU in the given precision.
+
+MandelComputeHandler::ImageSource MandelComputeHandler::GPUSource (GPUPrecision Precision)
 {
-    //  This runs a quick test for floating point accuracy at the current display settings
-    //  at a set of points that cover the range of the image in both X and Y.
-    
-    int Ix = 0;
-    int Iy = 0;
-    int Ixinc = _nx / 10;
-    int Iyinc = _ny / 10;
-    for (int I = 0; I < 10; I++) {
-        if (!FloatOKatXY(Ix,Iy)) return false;
-        Ix += Ixinc;
-        Iy += Iyinc;
+    if (Precision == GPU_DOUBLE) return IMAGE_GPU_D;
+    if (Precision == GPU_FLOAT_FLOAT) return IMAGE_GPU_FF;
+    if (Precision == GPU_PERTURBED) return IMAGE_GPU_P;
+    return IMAGE_GPU;
+}
+
+//  StartCPUImage() is the CPU equivalent of StartGPUImage(). It starts a background thread
+//  computing the image for the current parameters into the second buffer, just as ComputeInC()
+//  would, and returns without waiting for it. The thread uses a thread pool of its own, with one
+//  thread fewer than the hardware supports, so the calling thread - and the shared pool, which
+//  the renderer uses to colour the image - can get on with displaying the current image in the
+//  meantime. It returns false if the image doesn't need computing because it's in the cache.
+
+bool MandelComputeHandler::StartCPUImage ()
+{
+    DropNextImage();
+    if (_nx == 0 || _ny == 0 || _nextImageData == nullptr) return false;
+    RecomputeArgs();
+    if (FindCachedImage(IMAGE_CPU) != _imageCache.end()) return false;
+    _nextArgs = _currentArgs;
+    _nextXCentLo = _xCentLo;
+    _nextYCentLo = _yCentLo;
+    if (_aheadPool == nullptr) {
+        _aheadPool = new ThreadPool(std::max(ThreadPool::MaxThreads() - 1,1));
+    }
+    if (_subdivide) {
+        _nextThread = std::thread(ComputeSubdividedInC,_nextImageData,_nx,_ny,0,_ny,_xCent,
+                                    _yCent,_dx,_dy,_maxiter,_interiorChecks,_aheadPool);
+    } else {
+        _nextThread = std::thread(ComputeInCThreads,_nextImageData,_nx,_ny,0,_ny,_xCent,
+                              _yCent,_dx,_dy,_maxiter,_interiorChecks,_aheadPool,nullptr);
     }
     return true;
 }
 
-bool MandelComputeHandler::DoubleOKatXY(int Ix,int Iy)
+//  FinishCPUImage() is the CPU equivalent of FinishGPUImage(). If StartCPUImage() was called,
+//  and the image parameters haven't changed since, it waits for the image to be finished, makes
+//  it the current image, and returns true. Otherwise, it returns false, and the image has to
+//  be computed in the usual way.
+
+bool MandelComputeHandler::FinishCPUImage ()
 {
-    //  The same as FloatOKatXY(), bur using double precision.
-    
-    double Xinc = double(_nx) / double(_width);
-    double X0 = _xCent + (double(Ix) - _nx * 0.5) * _dx;
-    double X1 = _xCent + (double(Ix) + Xinc - _nx * 0.5) * _dx;
-    double Yinc = double(_ny) / double(_height);
-    double Y0 = _yCent + (double(Iy) - _ny * 0.5) * _dy;
-    double Y1 = _yCent + (double(Iy) + Yinc - _ny * 0.5) * _dy;
-    //if (((Y1 - Y0) <= 0.0) || ((X1 - X0) <= 0.0)) printf ("%g %g\n",Y1 - Y0,X1 - X0);
-    return ((Y1 - Y0) > 0.0) && ((X1 - X0) > 0.0);
+    if (!_nextThread.joinable()) return false;
+    RecomputeArgs();
+    bool same = (_nextXCentLo == _xCentLo && _nextYCentLo == _yCentLo &&
+                              memcmp(&_nextArgs,&_currentArgs,sizeof(MandelArgs)) == 0);
+    MsecTimer waitTimer;
+    DropNextImage();
+    if (!same) return false;
+    _debug.Logf("Timing","Waited %.3f msec for CPU image started ahead",waitTimer.ElapsedMsec());
+    SwapNextImage();
+    NoteImage(IMAGE_CPU,0);
+    return true;
 }
 
-bool MandelComputeHandler::DoubleOK(void)
+//  DropNextImage() waits for any image started by StartGPUImage() or StartCPUImage() to finish,
+//  and forgets it.
+
+void MandelComputeHandler::DropNextImage ()
 {
-    //  The same as FloatOK() but uses double precision.
-    
-    int Ix = 0;
-    int Iy = 0;
-    int Ixinc = _nx / 10;
-    int Iyinc = _ny / 10;
-    for (int I = 0; I < 10; I++) {
-        if (!DoubleOKatXY(Ix,Iy)) return false;
-        Ix += Ixinc;
-        Iy += Iyinc;
+    if (_nextTicket != KVVulkanFramework::KV_NULL_TICKET) {
+        _vulkanFramework->WaitFor(_nextTicket,_statusOK);
+        _nextTicket = KVVulkanFramework::KV_NULL_TICKET;
     }
-    return true;
+    if (_nextThread.joinable()) _nextThread.join();
+}
+
+//  SwapNextImage() makes the image in the second buffer the current one. The buffers are swapped
+//  over, and the descriptor sets that go with them. The tile queue and workgroup statistics
+//  descriptor sets describe the old image buffer, so need setting up again.
+
+void MandelComputeHandler::SwapNextImage ()
+{
+    std::swap(_imageBufferHndl,_nextBufferHndl);
+    std::swap(_imageData,_nextImageData);
+    std::swap(_descriptorSet,_nextDescriptorSet);
+    std::swap(_descriptorSetP,_nextDescriptorSetP);
+    std::swap(_descriptorSetPOK,_nextDescriptorSetPOK);
+    _descriptorSetQOK = false;
+    _descriptorSetSOK = false;
+}
+
+//  ComputeHybrid() computes the image using both the GPU and the CPU at the same time. The GPU
+//  computes the rows above a split point, using double precision if it has it and float-float
+//  arithmetic if not, while the CPU threads compute the rest. Where the split falls is set from
+//  the number of rows a msec each managed for the last few images, so that both should finish
+//  at about the same time. This is for the magnifications where single precision isn't enough,
+//  where the GPU is much slower than usual, and the CPU can make a real difference.
+
+void MandelComputeHandler::ComputeHybrid ()
+{
+    VkPipeline pipeline = _computePipelineFF;
+    VkPipelineLayout pipelineLayout = _computePipelineLayoutFF;
+    if (_doubleSupportInGPU) {
+        pipeline = _computePipelineD;
+        pipelineLayout = _computePipelineLayoutD;
+    }
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_HYBRID)) return;
+    
+    //  The strips of a shifted image are small, and are left to the GPU.
+    
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_HYBRID,strips)) {
+        ComputeStrips(pipeline,pipelineLayout,strips);
+        NoteImage(IMAGE_HYBRID,0);
+        return;
+    }
+    
+    //  Start the GPU on its rows, and don't wait for it before having the CPU start on the
+    //  rest. Once the CPU has finished, its rows have to be flushed in case the buffer's
+    //  memory isn't coherent.
+    
+    int split = HybridSplit();
+    MandelArgs gpuArgs = _currentArgs;
+    gpuArgs.iyEnd = split;
+    uint32_t workGroupCounts[3] = {_workGroupCounts[0],
+                                   (uint32_t(split) + C_WorkGroupSize - 1)/C_WorkGroupSize,1};
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,pipeline,pipelineLayout,
+                    &_descriptorSet,workGroupCounts,noBuffers,noBuffers,&gpuArgs,
+                                                              sizeof(MandelArgs),_statusOK);
+    MsecTimer gpuTimer;
+    KVVulkanFramework::KVSubmitTicket ticket =
+                 _vulkanFramework->SubmitCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    MsecTimer cpuTimer;
+    ComputeInCThreads (_imageData,_nx,_ny,split,_ny,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                           _interiorChecks,nullptr,CPUProfile());
+    float cpuMsec = cpuTimer.ElapsedMsec();
+    ReportCPUProfile();
+    _vulkanFramework->FlushBuffer(_imageBufferHndl,_statusOK);
+    
+    //  Now wait for the GPU. Its time is taken from the timestamps if there are any, as the
+    //  time to get here includes any time spent waiting for the CPU.
+    
+    if (ticket != KVVulkanFramework::KV_NULL_TICKET) _vulkanFramework->WaitFor(ticket,_statusOK);
+    float gpuMsec = gpuTimer.ElapsedMsec();
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        gpuMsec = kernelMsec;
+    }
+    std::vector<KVVulkanFramework::KVBufferRegion> regions;
+    regions.push_back({0,VkDeviceSize(split) * VkDeviceSize(_nx) * sizeof(uint32_t)});
+    _vulkanFramework->SyncBufferRegions(_imageBufferHndl,regions,_commandPool,_computeQueue,
+                                                                                   _statusOK);
+    _vulkanFramework->InvalidateBuffer(_imageBufferHndl,_statusOK);
+    _debug.Logf("Timing","Hybrid image: GPU %d rows in %.3f msec, CPU %d rows in %.3f msec",
+                                                          split,gpuMsec,_ny - split,cpuMsec);
+    NoteHybridRates(split,gpuMsec,cpuMsec);
+    NoteImage(IMAGE_HYBRID,0);
+}
+
+//  HybridSplit() returns the number of rows, starting from the top of the image, that
+//  ComputeHybrid() should give to the GPU, sharing out the rows in proportion to the rates
+//  at which the GPU and CPU have been computing them. Until both rates are known, it splits
+//  the image evenly.
+
+int MandelComputeHandler::HybridSplit ()
+{
+    double gpuShare = 0.5;
+    if (_hybridGPURate > 0.0 && _hybridCPURate > 0.0) {
+        gpuShare = _hybridGPURate / (_hybridGPURate + _hybridCPURate);
+    }
+    int minRows = std::min(C_HybridMinRows,_ny / 2);
+    int split = int(gpuShare * double(_ny) + 0.5);
+    return std::max(minRows,std::min(_ny - minRows,split));
+}
+
+//  NoteHybridRates() updates the average rates, in rows a msec, at which the GPU and the CPU
+//  have been computing their rows, given the split and times for the latest image.
+
+void MandelComputeHandler::NoteHybridRates (int Split,float GPUMsec,float CPUMsec)
+{
+    if (Split > 0 && GPUMsec > 0.0) {
+        double rate = double(Split) / double(GPUMsec);
+        if (_hybridGPURate <= 0.0) _hybridGPURate = rate;
+        else _hybridGPURate += C_HybridWeight * (rate - _hybridGPURate);
+    }
+    if (Split < _ny && CPUMsec > 0.0) {
+        double rate = double(_ny - Split) / double(CPUMsec);
+        if (_hybridCPURate <= 0.0) _hybridCPURate = rate;
+        else _hybridCPURate += C_HybridWeight * (rate - _hybridCPURate);
+    }
+}
+
+//  ComputeWithTileQueue() is used by Compute() to compute the whole image using the tile
+//  queue pipeline. The queue is just a counter, which has to be reset before each dispatch.
+//  Only as many workgroups as there are tiles are needed, up to C_QueueGroups.
+
+void MandelComputeHandler::ComputeWithTileQueue ()
+{
+    if (!_descriptorSetQOK) {
+        std::vector<KVVulkanFramework::KVBufferHandle> bufferHandles;
+        bufferHandles.push_back(_imageBufferHndl);
+        bufferHandles.push_back(_queueBufferHndl);
+        _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_descriptorSetQ,_statusOK);
+        _descriptorSetQOK = _statusOK;
+    }
+    if (_queueData) *_queueData = 0;
+    _vulkanFramework->FlushBuffer(_queueBufferHndl,_statusOK);
+    
+    uint32_t tiles = ((uint32_t(_nx) + C_QueueTileSize - 1)/C_QueueTileSize) *
+                                        ((uint32_t(_ny) + C_QueueTileSize - 1)/C_QueueTileSize);
+    uint32_t workGroupCounts[3] = {std::min(tiles,C_QueueGroups),1,1};
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,_computePipelineQ,
+                        _computePipelineLayoutQ,&_descriptorSetQ,workGroupCounts,noBuffers,
+                                   noBuffers,&_currentArgs,sizeof(MandelArgs),_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU tile queue kernel took %.3f msec (%u workgroups, %u tiles)",
+                                                      kernelMsec,workGroupCounts[0],tiles);
+    }
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    NoteImage(IMAGE_GPU,0);
+}
+
+//  ComputeSubdivided() is used by Compute() to compute the whole image using the subdivision
+//  pipeline. The dispatch is just as for the main pipeline, with one workgroup for each tile,
+//  but the tiles are a different size.
+
+void MandelComputeHandler::ComputeSubdivided ()
+{
+    uint32_t workGroupCounts[3] = {(uint32_t(_nx) + C_SubdivideTileSize - 1)/C_SubdivideTileSize,
+                                   (uint32_t(_ny) + C_SubdivideTileSize - 1)/C_SubdivideTileSize,1};
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,_computePipelineMS,
+                        _computePipelineLayoutMS,&_descriptorSet,workGroupCounts,noBuffers,
+                                   noBuffers,&_currentArgs,sizeof(MandelArgs),_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU subdivision kernel took %.3f msec",kernelMsec);
+    }
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    NoteImage(IMAGE_GPU,0);
+}
+
+//  ComputeWithStats() is used by Compute() to compute the whole image using the workgroup
+//  statistics pipeline, when the 'Stats' debug level is active. The dispatch is just the same
+//  as for the normal pipeline, but the statistics buffer, with room for each workgroup, has to
+//  be cleared before it runs, and is then read back by ReduceWorkGroupStats().
+
+void MandelComputeHandler::ComputeWithStats ()
+{
+    uint32_t groups = _workGroupCounts[0] * _workGroupCounts[1] * _workGroupCounts[2];
+    long bytesNeeded = long(groups) * long(C_StatsPerGroup * sizeof(uint32_t));
+    if (_statsBytes < bytesNeeded) {
+        _vulkanFramework->ResizeBuffer(_statsBufferHndl,bytesNeeded,_statusOK);
+        _statsData = (uint32_t*)_vulkanFramework->MapBuffer(_statsBufferHndl,&_statsBytes,
+                                                                                   _statusOK);
+        _descriptorSetSOK = false;
+    }
+    if (!_descriptorSetSOK) {
+        std::vector<KVVulkanFramework::KVBufferHandle> bufferHandles;
+        bufferHandles.push_back(_imageBufferHndl);
+        bufferHandles.push_back(_statsBufferHndl);
+        _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_descriptorSetS,_statusOK);
+        _descriptorSetSOK = _statusOK;
+    }
+    if (_statsData == nullptr) return;
+    memset(_statsData,0,size_t(bytesNeeded));
+    _vulkanFramework->FlushBuffer(_statsBufferHndl,_statusOK);
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,_computePipelineS,
+                        _computePipelineLayoutS,&_descriptorSetS,_workGroupCounts,noBuffers,
+                                   noBuffers,&_currentArgs,sizeof(MandelArgs),_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU statistics kernel took %.3f msec",kernelMsec);
+    }
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    _vulkanFramework->InvalidateBuffer(_statsBufferHndl,_statusOK);
+    NoteImage(IMAGE_GPU,0);
+    ReduceWorkGroupStats(groups);
+}
+
+//  ReduceWorkGroupStats() turns the values recorded for each workgroup by MandelStats.comp
+//  into the figures for the image as a whole, which it saves for GetWorkGroupStats() and logs
+//  at the 'Stats' level. Workgroups that computed no pixels - there shouldn't be any - are
+//  ignored.
+
+void MandelComputeHandler::ReduceWorkGroupStats (uint32_t Groups)
+{
+    WorkGroupStats stats = WorkGroupStats();
+    double lockstep = 0.0;
+    double groupEfficiency = 0.0;
+    for (uint32_t group = 0; group < Groups; group++) {
+        const uint32_t* values = _statsData + group * C_StatsPerGroup;
+        uint32_t pixels = values[3];
+        if (pixels == 0) continue;
+        double cost = double(values[0]);
+        stats.Groups++;
+        stats.TotalIter += cost;
+        stats.MaxCost = std::max(stats.MaxCost,cost);
+        stats.MaxIter = std::max(stats.MaxIter,values[1]);
+        lockstep += double(values[2]);
+        double worst = double(values[1]) * double(pixels);
+        groupEfficiency += (worst > 0.0) ? cost / worst : 1.0;
+    }
+    _lastStatsOK = (stats.Groups > 0);
+    if (!_lastStatsOK) return;
+    stats.MeanCost = stats.TotalIter / double(stats.Groups);
+    stats.Imbalance = (stats.MeanCost > 0.0) ? stats.MaxCost / stats.MeanCost : 1.0;
+    stats.GroupEfficiency = groupEfficiency / double(stats.Groups);
+    if (_statsSubgroups) stats.Efficiency = (lockstep > 0.0) ? stats.TotalIter / lockstep : 1.0;
+    _lastStats = stats;
+    
+    _debug.Logf(_statsDebug,"%d workgroups, %.0f iterations, mean %.0f, max %.0f a workgroup",
+                                 stats.Groups,stats.TotalIter,stats.MeanCost,stats.MaxCost);
+    if (_statsSubgroups) {
+        _debug.Logf(_statsDebug,
+                    "Imbalance %.2f, workgroup efficiency %.1f%%, subgroup efficiency %.1f%%",
+                    stats.Imbalance,stats.GroupEfficiency * 100.0,stats.Efficiency * 100.0);
+    } else {
+        _debug.Logf(_statsDebug,"Imbalance %.2f, workgroup efficiency %.1f%%",
+                                                stats.Imbalance,stats.GroupEfficiency * 100.0);
+    }
+}
+
+//  ComputeStrips() has the GPU compute the strips of the image that ShiftImage() found had
+//  come into view, using the given pipeline, with one dispatch for each strip recorded in the
+//  one command buffer.
+
+void MandelComputeHandler::ComputeStrips (
+      VkPipeline Pipeline,VkPipelineLayout PipelineLayout,const std::vector<Strip>& Strips)
+{
+    std::vector<StripSet> sets = {{Pipeline,PipelineLayout,Strips}};
+    ComputeStripSets(sets,Strips);
+}
+
+//  ComputeStripSets() has the GPU compute each set of strips using its own pipeline, with one
+//  dispatch for each strip, all recorded in the one command buffer. The strips all lie within
+//  the given areas of the image, which are the parts that have to be synched if the buffer is
+//  staged. If ShiftImage() has just moved the rest of the image using the CPU, and the buffer's
+//  memory isn't coherent, that has to be flushed first, so the buffer is always flushed.
+
+void MandelComputeHandler::ComputeStripSets (
+                      const std::vector<StripSet>& Sets,const std::vector<Strip>& Areas)
+{
+    size_t stripCount = 0;
+    for (const StripSet& Set : Sets) stripCount += Set.Strips.size();
+    if (stripCount == 0) return;
+    _vulkanFramework->FlushBuffer(_imageBufferHndl,_statusOK);
+    
+    //  The dispatches point to their push constants, so these must all be in place before the
+    //  first dispatch is set up.
+    
+    std::vector<MandelArgs> stripArgs(stripCount,_currentArgs);
+    std::vector<KVVulkanFramework::KVDispatch> dispatches;
+    for (const StripSet& Set : Sets) {
+        for (const Strip& Area : Set.Strips) {
+            MandelArgs& args = stripArgs[dispatches.size()];
+            args.ixOrigin = Area.Ixst;
+            args.iyOrigin = Area.Iyst;
+            args.ixEnd = Area.Ixen;
+            args.iyEnd = Area.Iyen;
+            KVVulkanFramework::KVDispatch dispatch;
+            dispatch.PipelineHndl = Set.Pipeline;
+            dispatch.PipelineLayoutHndl = Set.PipelineLayout;
+            dispatch.DescriptorSetHndl = _descriptorSet;
+            dispatch.WorkGroupCounts[0] =
+                        (uint32_t(Area.Ixen - Area.Ixst) + C_WorkGroupSize - 1)/C_WorkGroupSize;
+            dispatch.WorkGroupCounts[1] =
+                        (uint32_t(Area.Iyen - Area.Iyst) + C_WorkGroupSize - 1)/C_WorkGroupSize;
+            dispatch.WorkGroupCounts[2] = 1;
+            dispatch.PushConstants = &args;
+            dispatch.PushConstantSize = sizeof(MandelArgs);
+            dispatches.push_back(dispatch);
+        }
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeBatch(_commandBuffer,dispatches,noBuffers,noBuffers,_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU kernel for %d strips took %.3f msec",int(stripCount),
+                                                                                  kernelMsec);
+    }
+    std::vector<KVVulkanFramework::KVBufferRegion> regions = StripRegions(Areas);
+    _vulkanFramework->SyncBufferRegions(_imageBufferHndl,regions,_commandPool,_computeQueue,
+                                                                                   _statusOK);
+    _vulkanFramework->InvalidateBuffer(_imageBufferHndl,_statusOK);
+}
+
+//  ComputeMixed() computes the image using the GPU, but rather than using the same precision
+//  for the whole image, it divides it into tiles, and computes each in single precision,
+//  float-float or double precision, whichever is the cheapest that can resolve its pixels -
+//  see ClassifyTiles(). The tiles needing each precision are computed using the matching
+//  pipeline, but all in the one command buffer. If the GPU doesn't support double precision,
+//  the tiles that need it are computed using float-float, which is as close as it can get.
+//  If the image has been moved by a whole number of pixels, just the strips that have come
+//  into view are divided up this way.
+
+void MandelComputeHandler::ComputeMixed ()
+{
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_GPU_MIXED)) return;
+    std::vector<Strip> areas;
+    if (!ShiftImage(IMAGE_GPU_MIXED,areas)) areas.push_back({0,_nx,0,_ny});
+    
+    std::vector<Strip> tiles[3];
+    for (const Strip& Area : areas) ClassifyTiles(Area,tiles);
+    std::vector<StripSet> sets;
+    sets.push_back({_computePipeline,_computePipelineLayout,tiles[GPU_FLOAT]});
+    sets.push_back({_computePipelineFF,_computePipelineLayoutFF,tiles[GPU_FLOAT_FLOAT]});
+    if (_doubleSupportInGPU) {
+        sets.push_back({_computePipelineD,_computePipelineLayoutD,tiles[GPU_DOUBLE]});
+    } else {
+        sets.push_back({_computePipelineFF,_computePipelineLayoutFF,tiles[GPU_DOUBLE]});
+    }
+    _debug.Logf("Timing","Mixed precision strips: %d float, %d float-float, %d double",
+                int(tiles[GPU_FLOAT].size()),int(tiles[GPU_FLOAT_FLOAT].size()),
+                                                                int(tiles[GPU_DOUBLE].size()));
+    ComputeStripSets(sets,areas);
+    NoteImage(IMAGE_GPU_MIXED,0);
+}
+
+//  TilePrecision() returns the cheapest precision that can resolve the pixels of the given
+//  tile - GPU_FLOAT, GPU_FLOAT_FLOAT or GPU_DOUBLE, taken to be in that order of cost. The
+//  spacing of the values a precision can represent grows with the size of the value, so the
+//  pixels hardest to resolve are those at the edges of the tile furthest from zero, and two
+//  opposite corners between them cover both edges in X and both in Y. If even double
+//  precision isn't enough, it still returns GPU_DOUBLE, as that's the best the GPU can do.
+
+MandelComputeHandler::GPUPrecision MandelComputeHandler::TilePrecision (const Strip& Tile)
+{
+    int Ixst = Tile.Ixst;
+    int Iyst = Tile.Iyst;
+    int Ixen = Tile.Ixen - 1;
+    int Iyen = Tile.Iyen - 1;
+    if (FloatOKatXY(Ixst,Iyst) && FloatOKatXY(Ixen,Iyen)) return GPU_FLOAT;
+    if (FloatFloatOKatXY(Ixst,Iyst) && FloatFloatOKatXY(Ixen,Iyen)) return GPU_FLOAT_FLOAT;
+    return GPU_DOUBLE;
+}
+
+//  ClassifyTiles() divides the given area of the image into tiles C_MixedTileSize square - or
+//  smaller, at the right and bottom edges - and adds each to the list for the precision it
+//  needs, indexed by its GPUPrecision value. Neighbouring tiles in a row that need the same
+//  precision are merged into a single strip, so there are fewer dispatches.
+
+void MandelComputeHandler::ClassifyTiles (const Strip& Area,std::vector<Strip> Tiles[3])
+{
+    for (int Iyst = Area.Iyst; Iyst < Area.Iyen; Iyst += C_MixedTileSize) {
+        int Iyen = std::min(Iyst + C_MixedTileSize,Area.Iyen);
+        Strip run = {Area.Ixst,Area.Ixst,Iyst,Iyen};
+        GPUPrecision runPrecision = GPU_FLOAT;
+        for (int Ixst = Area.Ixst; Ixst < Area.Ixen; Ixst += C_MixedTileSize) {
+            Strip tile = {Ixst,std::min(Ixst + C_MixedTileSize,Area.Ixen),Iyst,Iyen};
+            GPUPrecision precision = TilePrecision(tile);
+            if (run.Ixen > run.Ixst && precision != runPrecision) {
+                Tiles[runPrecision].push_back(run);
+                run.Ixst = tile.Ixst;
+            }
+            run.Ixen = tile.Ixen;
+            runPrecision = precision;
+        }
+        if (run.Ixen > run.Ixst) Tiles[runPrecision].push_back(run);
+    }
+}
+
+//  CountTilePrecisions() returns the number of tiles ComputeMixed() would compute in each
+//  precision using the current image parameters. A tile that needs double precision is
+//  counted as such even if the GPU doesn't support it.
+
+void MandelComputeHandler::CountTilePrecisions (
+                                    int* FloatTiles,int* FloatFloatTiles,int* DoubleTiles)
+{
+    RecomputeArgs();
+    int counts[3] = {0,0,0};
+    for (int Iyst = 0; Iyst < _ny; Iyst += C_MixedTileSize) {
+        for (int Ixst = 0; Ixst < _nx; Ixst += C_MixedTileSize) {
+            Strip tile = {Ixst,std::min(Ixst + C_MixedTileSize,_nx),Iyst,
+                                                         std::min(Iyst + C_MixedTileSize,_ny)};
+            counts[TilePrecision(tile)]++;
+        }
+    }
+    *FloatTiles = counts[GPU_FLOAT];
+    *FloatFloatTiles = counts[GPU_FLOAT_FLOAT];
+    *DoubleTiles = counts[GPU_DOUBLE];
+}
+
+//  ComputeFrames() computes a batch of complete images - consecutive frames of a zoom, say -
+//  each with its own centre, magnification and precision. The dispatches for all of them are
+//  recorded into the one command buffer and submitted together, so the GPU goes straight from
+//  one frame to the next, rather than waiting for the CPU to collect each image and submit the
+//  next. Each frame goes into a buffer of its own, whose contents GetFrameData() returns until
+//  the next batch, and the current image and its parameters are left as they were. Frames
+//  are neither taken from nor added to the image cache. GPU_DOUBLE uses float-float if the GPU
+//  doesn't support double precision. It returns false, having computed nothing, if there are
+//  more than MaxBatchFrames() frames, or if any needs GPU_PERTURBED - the orbit buffer only
+//  holds one reference orbit at a time.
+
+bool MandelComputeHandler::ComputeFrames (const std::vector<FrameDetails>& Frames)
+{
+    if (_nx == 0 || _ny == 0 || Frames.empty()) return false;
+    if (int(Frames.size()) > C_MaxBatchFrames) return false;
+    for (const FrameDetails& Frame : Frames) {
+        if (Frame.Precision == GPU_PERTURBED) return false;
+    }
+    SetupFrameBuffers(int(Frames.size()));
+    if (!_statusOK) return false;
+    
+    //  The arguments for each frame are worked out just as they are for the current image,
+    //  whose parameters are put back afterwards. The dispatches point to their push constants,
+    //  so these must all be in place before the first dispatch is set up.
+    
+    double xCent = _xCent;
+    double yCent = _yCent;
+    double xCentLo = _xCentLo;
+    double yCentLo = _yCentLo;
+    double magnification = _magnification;
+    std::vector<MandelArgs> frameArgs(Frames.size());
+    for (size_t I = 0; I < Frames.size(); I++) {
+        _xCent = Frames[I].XCent;
+        _yCent = Frames[I].YCent;
+        _xCentLo = 0.0;
+        _yCentLo = 0.0;
+        _magnification = Frames[I].Magnification;
+        RecomputeArgs();
+        frameArgs[I] = _currentArgs;
+    }
+    _xCent = xCent;
+    _yCent = yCent;
+    _xCentLo = xCentLo;
+    _yCentLo = yCentLo;
+    _magnification = magnification;
+    RecomputeArgs();
+    
+    std::vector<KVVulkanFramework::KVDispatch> dispatches;
+    for (size_t I = 0; I < Frames.size(); I++) {
+        KVVulkanFramework::KVDispatch dispatch;
+        dispatch.PipelineHndl = _computePipeline;
+        dispatch.PipelineLayoutHndl = _computePipelineLayout;
+        if (Frames[I].Precision == GPU_DOUBLE && _doubleSupportInGPU) {
+            dispatch.PipelineHndl = _computePipelineD;
+            dispatch.PipelineLayoutHndl = _computePipelineLayoutD;
+        } else if (Frames[I].Precision != GPU_FLOAT) {
+            dispatch.PipelineHndl = _computePipelineFF;
+            dispatch.PipelineLayoutHndl = _computePipelineLayoutFF;
+        }
+        dispatch.DescriptorSetHndl = _frameDescriptorSets[I];
+        dispatch.WorkGroupCounts[0] = _workGroupCounts[0];
+        dispatch.WorkGroupCounts[1] = _workGroupCounts[1];
+        dispatch.WorkGroupCounts[2] = _workGroupCounts[2];
+        dispatch.PushConstants = &frameArgs[I];
+        dispatch.PushConstantSize = sizeof(MandelArgs);
+        dispatches.push_back(dispatch);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeBatch(_commandBuffer,dispatches,noBuffers,noBuffers,_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU kernels for %d frames took %.3f msec",int(Frames.size()),
+                                                                                  kernelMsec);
+    }
+    
+    //  If the buffers are staged, they need synching, just as the image buffer does.
+    
+    for (size_t I = 0; I < Frames.size(); I++) {
+        _vulkanFramework->SyncBuffer(_frameBufferHndls[I],_commandPool,_computeQueue,_statusOK);
+    }
+    return _statusOK;
+}
+
+//  GetFrameData() returns the address of the given frame - counting from zero - of the last
+//  batch computed by ComputeFrames(), or null if there is no such frame.
+
+uint32_t* MandelComputeHandler::GetFrameData (int Frame)
+{
+    if (Frame < 0 || Frame >= int(_frameData.size())) return nullptr;
+    return _frameData[Frame];
+}
+
+//  MaxBatchFrames() returns the most frames ComputeFrames() can compute in one batch. Like
+//  GetDebugOptions(), this is static, so a program can check its arguments before it sets up
+//  the compute handler.
+
+int MandelComputeHandler::MaxBatchFrames (void)
+{
+    return C_MaxBatchFrames;
+}
+
+//  SetupFrameBuffers() makes sure ComputeFrames() has buffers for at least the given number of
+//  frames, all the size of the current image. They are just like the image buffer, and use the
+//  same descriptor set layout, so the usual pipelines can write to them. Buffers are added as
+//  they are needed, but never released, so changing the size of the batches doesn't keep
+//  creating them. If the image size has changed, they are all resized to match.
+
+void MandelComputeHandler::SetupFrameBuffers (int Frames)
+{
+    if (_descriptorPoolF == VK_NULL_HANDLE) {
+        std::vector<KVVulkanFramework::KVBufferHandle> handles;
+        handles.push_back(_imageBufferHndl);
+        _vulkanFramework->CreateVulkanDescriptorPool(handles,C_MaxBatchFrames,&_descriptorPoolF,
+                                                                                   _statusOK);
+    }
+    while (_statusOK && int(_frameBufferHndls.size()) < Frames) {
+        KVVulkanFramework::KVBufferHandle bufferHndl = _vulkanFramework->SetBufferDetails(
+                                        C_StorageBufferBinding,"STORAGE","READBACK",_statusOK);
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        _vulkanFramework->AllocateVulkanDescriptorSet(_setLayout,_descriptorPoolF,
+                                                                  &descriptorSet,_statusOK);
+        _frameBufferHndls.push_back(bufferHndl);
+        _frameDescriptorSets.push_back(descriptorSet);
+        _frameData.push_back(nullptr);
+    }
+    bool resize = (_frameNx != _nx || _frameNy != _ny);
+    for (size_t I = 0; _statusOK && I < _frameBufferHndls.size(); I++) {
+        if (resize || _frameData[I] == nullptr) {
+            VkDeviceSize sizeInBytes = VkDeviceSize(_nx) * VkDeviceSize(_ny) * sizeof(uint32_t);
+            _vulkanFramework->ResizeBuffer(_frameBufferHndls[I],sizeInBytes,_statusOK);
+            long bytes;
+            _frameData[I] = (uint32_t*)_vulkanFramework->MapBuffer(_frameBufferHndls[I],&bytes,
+                                                                                   _statusOK);
+            std::vector<KVVulkanFramework::KVBufferHandle> bufferHandles;
+            bufferHandles.push_back(_frameBufferHndls[I]);
+            _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_frameDescriptorSets[I],
+                                                                                   _statusOK);
+        }
+    }
+    _frameNx = _nx;
+    _frameNy = _ny;
+}
+
+//  ComputePerturbed() computes the image using perturbation - see the notes at the start of
+//  the header and in MandelP.comp. The reference orbit, for the centre of the image, is
+//  computed by the CPU and written into the orbit buffer, which is enlarged if the iteration
+//  limit has grown. The GPU then computes the differences from that orbit for each pixel,
+//  using double precision if it supports it, and single precision if not.
+
+void MandelComputeHandler::ComputePerturbed ()
+{
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_GPU_P)) return;
+    
+    //  An image started by StartGPUImage() may still be using the orbit buffer.
+    
+    DropNextImage();
+    int refLen = PrepareOrbit();
+    if (!_descriptorSetPOK) {
+        std::vector<KVVulkanFramework::KVBufferHandle> bufferHandles;
+        bufferHandles.push_back(_imageBufferHndl);
+        bufferHandles.push_back(_orbitBufferHndl);
+        _vulkanFramework->SetupVulkanDescriptorSet(bufferHandles,_descriptorSetP,_statusOK);
+        _descriptorSetPOK = _statusOK;
+    }
+    if (refLen == 0) return;
+    
+    //  Set up the pipeline for the GPU calculation and run it.
+    
+    PerturbArgs args = {float(_dx),float(_dy),_maxiter,_nx,_ny,refLen,_dx,_dy};
+    VkPipeline pipeline = _computePipelineP;
+    VkPipelineLayout pipelineLayout = _computePipelineLayoutP;
+    if (_doubleSupportInGPU) {
+        pipeline = _computePipelinePD;
+        pipelineLayout = _computePipelineLayoutPD;
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> noBuffers;
+    _vulkanFramework->RecordComputeCommandBuffer(_commandBuffer,pipeline,pipelineLayout,
+                            &_descriptorSetP,_workGroupCounts,noBuffers,noBuffers,&args,
+                                                          sizeof(PerturbArgs),_statusOK);
+    _vulkanFramework->RunCommandBuffer(_computeQueue,_commandBuffer,_statusOK);
+    float kernelMsec;
+    if (_vulkanFramework->GetDispatchTimes(nullptr,&kernelMsec,nullptr,_statusOK)) {
+        _debug.Logf("Timing","GPU perturbation kernel took %.3f msec",kernelMsec);
+    }
+    
+    //  If a staged buffer is being used, synch it.
+    
+    _vulkanFramework->SyncBuffer(_imageBufferHndl,_commandPool,_computeQueue,_statusOK);
+    NoteImage(IMAGE_GPU_P,0);
+}
+
+
+//  PrepareOrbit() computes the reference orbit for the centre of the image, and writes it into
+//  the orbit buffer, enlarging that first if the iteration limit has grown. It returns the
+//  length of the orbit, or zero if there is no orbit buffer. The GPU mustn't be using the
+//  buffer at the time.
+
+int MandelComputeHandler::PrepareOrbit ()
+{
+    MsecTimer orbitTimer;
+    int refLen = ReferenceOrbitInC(DoubleDouble(_xCent,_xCentLo),DoubleDouble(_yCent,_yCentLo),
+                                                                              _maxiter,_orbit);
+    long bytesNeeded = long(_maxiter + 1) * 2 * long(sizeof(double));
+    if (_orbitBytes < bytesNeeded) {
+        _vulkanFramework->ResizeBuffer(_orbitBufferHndl,bytesNeeded,_statusOK);
+        _orbitData = _vulkanFramework->MapBuffer(_orbitBufferHndl,&_orbitBytes,_statusOK);
+        _descriptorSetPOK = false;
+        _nextDescriptorSetPOK = false;
+    }
+    if (_orbitData == nullptr) return 0;
+    
+    //  The double precision shader takes the orbit as doubles, the single precision one as floats.
+    
+    if (_doubleSupportInGPU) {
+        memcpy(_orbitData,_orbit.data(),size_t(refLen) * 2 * sizeof(double));
+    } else {
+        float* orbitData = (float*)_orbitData;
+        for (int I = 0; I < refLen * 2; I++) orbitData[I] = float(_orbit[I]);
+    }
+    _vulkanFramework->FlushBuffer(_orbitBufferHndl,_statusOK);
+    _debug.Logf("Timing","Reference orbit of %d points took %.3f msec",refLen,
+                                                                  orbitTimer.ElapsedMsec());
+    return refLen;
+}
+
+void MandelComputeHandler::ComputeInC ()
+{
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_CPU)) return;
+    
+    //  If this is the last CPU image moved by a whole number of pixels, only the pixels that
+    //  have come into view need computing.
+    
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_CPU,strips)) {
+        for (const Strip& Area : strips) {
+            ComputeStripInC (_imageData,_nx,_ny,Area,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                                             _interiorChecks);
+        }
+    } else if (_subdivide) {
+        long computed = ComputeSubdividedInC (_imageData,_nx,_ny,0,_ny,_xCent,_yCent,_dx,_dy,
+                                                                   _maxiter,_interiorChecks);
+        _debug.Logf("Timing","Subdivision computed %ld of %ld pixels (%.1f%%)",computed,
+                        long(_nx) * long(_ny),100.0 * double(computed) / (double(_nx) * _ny));
+    } else {
+        ComputeInCThreads (_imageData,_nx,_ny,0,_ny,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                           _interiorChecks,nullptr,CPUProfile());
+        ReportCPUProfile();
+    }
+    
+    //  This is a complete image, so ComputeInCProgressive() has nothing left to do for it.
+    
+    NoteImage(IMAGE_CPU,0);
+}
+
+//  ComputeInCProgressive() computes the image using the CPU, just as ComputeInC() does, but a
+//  pass at a time, coarse to fine, so a slow image can be displayed as it builds up. Each call
+//  does one more pass, and returns true once the image is complete. The first pass computes
+//  every C_RefineStep'th pixel in X and Y, and sets the whole block of pixels that each one
+//  starts to its value. Each later pass halves the block size, and only computes the pixels
+//  that start the new blocks, as the others already have their values. So the complete image
+//  takes no more computation than ComputeInC(), and ends up exactly the same. If the image
+//  parameters have changed since the last call, any passes left for the old image are dropped,
+//  and a new image is started - unless the complete image has just been moved, in which case
+//  the pixels that have come into view are few enough to be computed in one go.
+
+bool MandelComputeHandler::ComputeInCProgressive ()
+{
+    if (_subdivide) {
+        ComputeInC();
+        return true;
+    }
+    RecomputeArgs();
+    if (ImageFromCache(IMAGE_CPU)) return true;
+    
+    std::vector<Strip> strips;
+    if (ShiftImage(IMAGE_CPU,strips)) {
+        for (const Strip& Area : strips) {
+            ComputeStripInC (_imageData,_nx,_ny,Area,_xCent,_yCent,_dx,_dy,_maxiter,
+                                                                             _interiorChecks);
+        }
+        NoteImage(IMAGE_CPU,0);
+        return true;
+    }
+    if (_imageSource != IMAGE_CPU || !SameImage()) NoteImage(IMAGE_CPU,C_RefineStep);
+    if (_imageStep > 0) {
+        bool FirstPass = (_imageStep == C_RefineStep);
+        NoteChanges();
+        ComputeRefineInC (_imageData,_nx,_ny,_imageStep,FirstPass,_xCent,_yCent,_dx,_dy,
+                                                                    _maxiter,_interiorChecks);
+        _imageStep /= 2;
+        if (_imageStep == 0) CacheImage();
+    }
+    return (_imageStep == 0);
+}
+
+//  MoveCentre() moves the centre of the image by the whole number of pixels closest to the
+//  given offset in Mandelbrot coordinates. When the image is dragged, this lets the next image
+//  be made by shifting the last one and computing only the pixels that have come into view.
+//  Whatever is left over is added to the offset for the next call, so a drag made up of many
+//  small moves still ends up where it should.
+
+void MandelComputeHandler::MoveCentre (double XOffset,double YOffset)
+{
+    RecomputeArgs();
+    double XMove = XOffset + _xMoveLeft;
+    double YMove = YOffset + _yMoveLeft;
+    double XWhole = std::round(XMove / _dx) * _dx;
+    double YWhole = std::round(YMove / _dy) * _dy;
+    _xMoveLeft = XMove - XWhole;
+    _yMoveLeft = YMove - YWhole;
+    OffsetCentre(XWhole,YWhole);
+}
+
+//  OffsetCentre() moves the centre of the image by the given offset in Mandelbrot coordinates.
+//  The centre is held as a DoubleDouble, so this keeps the offset in full even when it is far
+//  smaller than the precision of a double at the centre, as it is at high magnifications.
+
+void MandelComputeHandler::OffsetCentre (double XOffset,double YOffset)
+{
+    DoubleDouble XCent = DoubleDouble(_xCent,_xCentLo) + XOffset;
+    DoubleDouble YCent = DoubleDouble(_yCent,_yCentLo) + YOffset;
+    _xCent = XCent.Hi;
+    _xCentLo = XCent.Lo;
+    _yCent = YCent.Hi;
+    _yCentLo = YCent.Lo;
+}
+
+//  NoteImage() records how the image in the buffer was computed, and its parameters. Step is
+//  the block size for the next pass of ComputeInCProgressive() - zero if the image is complete,
+//  in which case it is also added to the image cache.
+
+void MandelComputeHandler::NoteImage (ImageSource Source,int Step)
+{
+    if (_changesShifted) _changesShifted = false;
+    else NoteChanges();
+    _imageSource = Source;
+    _imageStep = Step;
+    _imageXCent = _xCent;
+    _imageYCent = _yCent;
+    _imageXCentLo = _xCentLo;
+    _imageYCentLo = _yCentLo;
+    _imageDx = _dx;
+    _imageDy = _dy;
+    _imageMaxIter = _maxiter;
+    if (Step == 0 && Source != IMAGE_NONE) CacheImage();
+}
+
+//  FindCachedImage() returns the entry in the image cache for the image with the current
+//  parameters computed using Source, or the end of the cache if there isn't one.
+
+std::list<MandelComputeHandler::CachedImage>::iterator MandelComputeHandler::FindCachedImage (
+                                                                          ImageSource Source)
+{
+    auto image = _imageCache.begin();
+    while (image != _imageCache.end()) {
+        if (image->Source == Source && image->XCent == _xCent && image->YCent == _yCent &&
+               image->XCentLo == _xCentLo && image->YCentLo == _yCentLo && image->Dx == _dx &&
+                                        image->Dy == _dy && image->MaxIter == _maxiter) break;
+        image++;
+    }
+    return image;
+}
+
+//  ImageFromCache() checks the image cache for the image with the current parameters computed
+//  using Source. If it's there, it copies it into the image buffer and returns true.
+
+bool MandelComputeHandler::ImageFromCache (ImageSource Source)
+{
+    auto image = FindCachedImage(Source);
+    if (image == _imageCache.end()) return false;
+    MsecTimer copyTimer;
+    memcpy(_imageData,image->Data.data(),image->Data.size() * sizeof(uint32_t));
+    NoteImage(Source,0);
+    _imageCacheHits++;
+    _debug.Logf("Timing","Image taken from cache in %.3f msec",copyTimer.ElapsedMsec());
+    return true;
+}
+
+//  CacheImage() adds the complete image in the image buffer to the image cache, unless it's
+//  already there, in which case it becomes the most recently used. The cache is a list kept
+//  in order of use, most recent first, so when it's full, the image at the end is dropped,
+//  and its storage is reused for the new one. All the images are the same size, as the cache
+//  is cleared when the size changes.
+
+void MandelComputeHandler::CacheImage (void)
+{
+    long bytes = long(_nx) * long(_ny) * long(sizeof(uint32_t));
+    if (bytes == 0 || bytes > _imageCacheLimit) return;
+    auto image = FindCachedImage(_imageSource);
+    if (image != _imageCache.end()) {
+        _imageCache.splice(_imageCache.begin(),_imageCache,image);
+        return;
+    }
+    std::vector<uint32_t> data;
+    while (!_imageCache.empty() && long(_imageCache.size() + 1) * bytes > _imageCacheLimit) {
+        data.swap(_imageCache.back().Data);
+        _imageCache.pop_back();
+    }
+    data.assign(_imageData,_imageData + size_t(_nx) * size_t(_ny));
+    _imageCache.push_front({_imageSource,_xCent,_yCent,_xCentLo,_yCentLo,_dx,_dy,_maxiter,
+                                                                             std::move(data)});
+}
+
+//  SameImage() returns true if the current parameters are those of the image in the buffer.
+
+bool MandelComputeHandler::SameImage (void)
+{
+    return (_imageXCent == _xCent && _imageYCent == _yCent && _imageXCentLo == _xCentLo &&
+                _imageYCentLo == _yCentLo && _imageDx == _dx && _imageDy == _dy &&
+                                                                 _imageMaxIter == _maxiter);
+}
+
+//  ShiftImage() checks whether the image now wanted is the complete image last computed using
+//  Source, moved by a whole number of pixels with nothing else changed, as it is when the image
+//  is dragged using MoveCentre(). If so, it moves the image data to match and returns true,
+//  with Strips set to the parts of the image that have come into view and still need computing
+//  - none, if the image hasn't moved at all. Otherwise, it returns false, and the whole image
+//  needs computing. The move is recorded for GetImageChanges().
+
+bool MandelComputeHandler::ShiftImage (ImageSource Source,std::vector<Strip>& Strips)
+{
+    Strips.clear();
+    if (Source != _imageSource || _imageStep != 0) return false;
+    if (_imageDx != _dx || _imageDy != _dy || _imageMaxIter != _maxiter) return false;
+    
+    //  The new pixel (Ix,Iy) is the old pixel (Ix + ShiftX,Iy + ShiftY). Rounding error means
+    //  the shifts won't be exact whole numbers, but they should be very close. The high parts of
+    //  the centres are close enough that subtracting them is exact.
+    
+    double ShiftX = ((_xCent - _imageXCent) + (_xCentLo - _imageXCentLo)) / _dx;
+    double ShiftY = ((_yCent - _imageYCent) + (_yCentLo - _imageYCentLo)) / _dy;
+    if (fabs(ShiftX) >= double(_nx) || fabs(ShiftY) >= double(_ny)) return false;
+    int Sx = int(std::round(ShiftX));
+    int Sy = int(std::round(ShiftY));
+    if (fabs(ShiftX - Sx) > C_ShiftTolerance || fabs(ShiftY - Sy) > C_ShiftTolerance) return false;
+    _changesShifted = true;
+    if (Sx == 0 && Sy == 0) return true;
+    
+    //  The rows that have come into view are computed in full, and then the columns that have
+    //  come into view for the rest of the rows.
+    
+    ShiftInC(_imageData,_nx,_ny,Sx,Sy);
+    int Iyst = 0;
+    int Iyen = _ny;
+    if (Sy > 0) {
+        Strips.push_back({0,_nx,_ny - Sy,_ny});
+        Iyen = _ny - Sy;
+    } else if (Sy < 0) {
+        Strips.push_back({0,_nx,0,-Sy});
+        Iyst = -Sy;
+    }
+    if (Sx > 0) Strips.push_back({_nx - Sx,_nx,Iyst,Iyen});
+    else if (Sx < 0) Strips.push_back({0,-Sx,Iyst,Iyen});
+    NoteChanges(Sx,Sy,Strips);
+    return true;
+}
+
+//  NoteChanges() records how the image has just changed, for GetImageChanges(). Without
+//  arguments, the whole image is new. Otherwise the last image has been moved by ShiftX,ShiftY
+//  pixels, and only Areas are new. If an earlier change hasn't been collected yet, the two
+//  aren't combined - the whole image is just taken as new.
+
+void MandelComputeHandler::NoteChanges (void)
+{
+    _changesPending = true;
+    _changesAll = true;
+    _changeAreas.clear();
+}
+
+void MandelComputeHandler::NoteChanges (int ShiftX,int ShiftY,const std::vector<Strip>& Areas)
+{
+    if (_changesPending) {
+        NoteChanges();
+        return;
+    }
+    _changesPending = true;
+    _changesAll = false;
+    _changeShiftX = ShiftX;
+    _changeShiftY = ShiftY;
+    _changeAreas = Areas;
+}
+
+//  StripRegions() returns the regions of the image buffer that hold the given strips, for
+//  SyncBufferRegions(). A strip the full width of the image is one contiguous region, and
+//  any other needs a region for each row.
+
+std::vector<KVVulkanFramework::KVBufferRegion> MandelComputeHandler::StripRegions (
+                                                          const std::vector<Strip>& Strips)
+{
+    std::vector<KVVulkanFramework::KVBufferRegion> regions;
+    for (const Strip& Area : Strips) {
+        VkDeviceSize width = VkDeviceSize(Area.Ixen - Area.Ixst) * sizeof(uint32_t);
+        VkDeviceSize rowBytes = VkDeviceSize(_nx) * sizeof(uint32_t);
+        VkDeviceSize offset = VkDeviceSize(Area.Iyst) * rowBytes + Area.Ixst * sizeof(uint32_t);
+        if (Area.Ixst == 0 && Area.Ixen == _nx) {
+            regions.push_back({offset,VkDeviceSize(Area.Iyen - Area.Iyst) * rowBytes});
+        } else {
+            for (int Iy = Area.Iyst; Iy < Area.Iyen; Iy++) {
+                regions.push_back({offset,width});
+                offset += rowBytes;
+            }
+        }
+    }
+    return regions;
+}
+
+//  ShiftInC() moves the image data so that the new pixel (Ix,Iy) has the value of the old pixel
+//  (Ix + ShiftX,Iy + ShiftY), wherever that is in the image. The rows are gone through in the
+//  order that moves each before it is overwritten.
+
+void MandelComputeHandler::ShiftInC (uint32_t* Data,int Nx,int Ny,int ShiftX,int ShiftY)
+{
+    int IxFrom = std::max(0,ShiftX);
+    int IxTo = std::max(0,-ShiftX);
+    size_t Bytes = size_t(Nx - std::abs(ShiftX)) * sizeof(uint32_t);
+    if (ShiftY >= 0) {
+        for (int Iy = 0; Iy < Ny - ShiftY; Iy++) {
+            memmove(Data + size_t(Iy) * Nx + IxTo,Data + size_t(Iy + ShiftY) * Nx + IxFrom,Bytes);
+        }
+    } else {
+        for (int Iy = Ny - 1; Iy >= -ShiftY; Iy--) {
+            memmove(Data + size_t(Iy) * Nx + IxTo,Data + size_t(Iy + ShiftY) * Nx + IxFrom,Bytes);
+        }
+    }
+}
+
+void MandelComputeHandler::ComputeInCThreads (
+        uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
+                 prec Dx,prec Dy,int MaxIter,bool Checks,ThreadPool* Pool,CycleProfile* Profile)
+{
+    //  The rows are divided between the threads of the shared pool, which are created once
+    //  and then reused, rather than creating a new set of threads for each image. Some parts
+    //  of the image take far longer than others - points in the set take every iteration -
+    //  so rather than giving each thread a fixed band of rows, the rows are handed out a few
+    //  at a time, each thread taking the next few as soon as it has finished the last, so all
+    //  the threads finish at about the same time. (So the range ParallelFor() gives each
+    //  thread isn't used, only the number of threads.) An image being computed ahead by
+    //  StartCPUImage() uses a pool of its own, passed as Pool. If Profile is not null, the
+    //  time taken by each few rows is recorded in it.
+    
+    if (Pool == nullptr) Pool = &ThreadPool::Shared();
+    int Tiles = (Iyen - Iyst + C_CPUTileRows - 1) / C_CPUTileRows;
+    std::atomic<int> NextTile(0);
+    Pool->ParallelFor(0,Tiles,[&](int,int) {
+        for (int Tile = NextTile++; Tile < Tiles; Tile = NextTile++) {
+            int First = Iyst + Tile * C_CPUTileRows;
+            int Last = std::min(Iyen,First + C_CPUTileRows);
+            CycleScope TileTime(Profile,uint64_t(Last - First));
+            ComputeRangeInC(Data,Nx,Ny,First,Last,Xcent,Ycent,Dx,Dy,MaxIter,Checks);
+        }
+    });
+}
+
+//  PointInC() returns the image value for the point (x0,y0), used by all the CPU code. Points
+//  in the set take all MaxIter iterations, and usually make up most of the work, so if Checks
+//  is set, two shortcuts are used for them. Points in the main cardioid or the period-2 bulb,
+//  which have a closed form, aren't iterated at all. For the rest, the orbit is compared with
+//  a point saved from it, which is replaced at iterations 1,2,4,8... (Brent's method). If the
+//  orbit ever gets back to that point exactly, it is cycling, and can never escape. Neither
+//  changes the result, so Checks can be cleared to see what they save.
+
+static inline uint32_t PointInC (prec x0,prec y0,int MaxIter,bool Checks)
+{
+    if (Checks) {
+        prec xq = x0 - 0.25;
+        prec q = xq * xq + y0 * y0;
+        if (q * (q + xq) <= 0.25 * y0 * y0) return 0.0;
+        if ((x0 + 1.0) * (x0 + 1.0) + y0 * y0 <= 0.0625) return 0.0;
+    }
+
+    // Implement Mandelbrot set
+   
+    prec x = 0.0;
+    prec y = 0.0;
+    int iteration = 0;
+    prec xtmp = 0.0;
+    prec xSaved = 0.0;
+    prec ySaved = 0.0;
+    int count = 0;
+    int limit = 1;
+    while (((x * x) + (y * y) <= 4.0) && (iteration < MaxIter))
+    {
+        xtmp = (x + y) * (x - y) + x0;
+        y = (2.0 * x * y) + y0;
+        x = xtmp;
+        iteration += 1;
+        if (Checks) {
+            if (x == xSaved && y == ySaved) return 0.0;
+            if (++count == limit) {
+                xSaved = x;
+                ySaved = y;
+                count = 0;
+                limit *= 2;
+            }
+        }
+    }
+
+    // Treat iteration result as a colour value for the image.
+    uint32_t colour = uint32_t(iteration);
+    if (iteration == MaxIter) colour = 0;
+    return colour;
+}
+
+//                               I n c l u d e  F i l e s
+//
+//  Needed for the vector versions of the CPU code.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MANDEL_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define MANDEL_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+//  The CPU code computes the image a row at a time, or, for ComputeRefineInC(), a row of
+//  evenly spaced points at a time, using one of the following 'row' routines. The scalar
+//  version just calls PointInC() for each point. The vector versions do exactly the same, but
+//  for 4 (AVX2), 8 (AVX-512) or 2 (NEON) points at a time, one in each lane of a vector of
+//  doubles. Each lane has a mask saying whether its point is still being iterated. A lane
+//  drops out when its point escapes - when its value is set to the iteration count - or when
+//  the interior checks show it is in the set, and once all the lanes have dropped out, the
+//  next set of points is started. Brent's periodicity check saves the orbit at the same
+//  iterations for every point, so the lanes can share that schedule. The operations are the
+//  same as those in PointInC(), in the same order, so the results are the same. Any points
+//  left over at the end of a row are handled one at a time. These all assume 'prec' is double.
+//  With gcc and clang, the x86 versions are compiled for their instruction sets using the
+//  'target' attribute, rather than by compiling the whole program for them, so the program
+//  still runs on older CPUs - they just never get called there. See SelectRowRoutine(). (AVX-512
+//  includes fused multiply-add, and gcc would otherwise fuse the multiplies and adds, which
+//  changes the rounding, so it is told not to.)
+
+static void RowInC (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,prec GridXcent,
+                                                  prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    for (int I = 0; I < Count; I++) {
+        prec x0 = Xcent + (prec(Ixst + I * IxStep) - GridXcent) * Dx;
+        Values[I] = PointInC(x0,y0,MaxIter,Checks);
+    }
+}
+
+#if defined(MANDEL_X86_SIMD) && defined(__clang__)
+#define MANDEL_TARGET(Isa) __attribute__((target(Isa)))
+#elif defined(MANDEL_X86_SIMD) && defined(__GNUC__)
+#define MANDEL_TARGET(Isa) __attribute__((target(Isa),optimize("fp-contract=off")))
+#else
+#define MANDEL_TARGET(Isa)
+#endif
+
+#ifdef MANDEL_X86_SIMD
+
+MANDEL_TARGET("avx2")
+static void RowUsingAVX2 (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                 prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    const __m256d Zero = _mm256_setzero_pd();
+    const __m256d Two = _mm256_set1_pd(2.0);
+    const __m256d Four = _mm256_set1_pd(4.0);
+    const __m256d Y0 = _mm256_set1_pd(y0);
+    const __m256d Y0Sq = _mm256_set1_pd(y0 * y0);
+    const __m256d Y0SqQuarter = _mm256_set1_pd(0.25 * y0 * y0);
+    int I = 0;
+    for (; I + 4 <= Count; I += 4) {
+        int Ix = Ixst + I * IxStep;
+        __m256d X0 = _mm256_add_pd(_mm256_set1_pd(Xcent),_mm256_mul_pd(_mm256_sub_pd(
+               _mm256_setr_pd(Ix,Ix + IxStep,Ix + 2 * IxStep,Ix + 3 * IxStep),
+                                      _mm256_set1_pd(GridXcent)),_mm256_set1_pd(Dx)));
+        __m256d Active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        if (Checks) {
+            __m256d Xq = _mm256_sub_pd(X0,_mm256_set1_pd(0.25));
+            __m256d Q = _mm256_add_pd(_mm256_mul_pd(Xq,Xq),Y0Sq);
+            __m256d Cardioid = _mm256_cmp_pd(_mm256_mul_pd(Q,_mm256_add_pd(Q,Xq)),
+                                                                 Y0SqQuarter,_CMP_LE_OQ);
+            __m256d Xp = _mm256_add_pd(X0,_mm256_set1_pd(1.0));
+            __m256d Bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(Xp,Xp),Y0Sq),
+                                                     _mm256_set1_pd(0.0625),_CMP_LE_OQ);
+            Active = _mm256_andnot_pd(_mm256_or_pd(Cardioid,Bulb),Active);
+        }
+        __m256d X = Zero;
+        __m256d Y = Zero;
+        __m256d XSaved = Zero;
+        __m256d YSaved = Zero;
+        __m256d Result = Zero;
+        int SaveCount = 0;
+        int SaveLimit = 1;
+        for (int Iter = 1; Iter < MaxIter && _mm256_movemask_pd(Active) != 0; Iter++) {
+            __m256d XTmp = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(X,Y),
+                                                           _mm256_sub_pd(X,Y)),X0);
+            Y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(Two,X),Y),Y0);
+            X = XTmp;
+            __m256d Escaped = _mm256_and_pd(_mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(X,X),
+                                            _mm256_mul_pd(Y,Y)),Four,_CMP_GT_OQ),Active);
+            Result = _mm256_blendv_pd(Result,_mm256_set1_pd(double(Iter)),Escaped);
+            Active = _mm256_andnot_pd(Escaped,Active);
+            if (Checks) {
+                __m256d Cycling = _mm256_and_pd(_mm256_cmp_pd(X,XSaved,_CMP_EQ_OQ),
+                                                      _mm256_cmp_pd(Y,YSaved,_CMP_EQ_OQ));
+                Active = _mm256_andnot_pd(Cycling,Active);
+                if (++SaveCount == SaveLimit) {
+                    XSaved = X;
+                    YSaved = Y;
+                    SaveCount = 0;
+                    SaveLimit *= 2;
+                }
+            }
+        }
+        _mm_storeu_si128((__m128i*)(Values + I),_mm256_cvtpd_epi32(Result));
+    }
+    RowInC(Values + I,Count - I,Ixst + I * IxStep,IxStep,Xcent,GridXcent,Dx,y0,MaxIter,Checks);
+}
+
+MANDEL_TARGET("avx512f")
+static void RowUsingAVX512 (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                   prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    const __m512d Zero = _mm512_setzero_pd();
+    const __m512d Two = _mm512_set1_pd(2.0);
+    const __m512d Four = _mm512_set1_pd(4.0);
+    const __m512d Y0 = _mm512_set1_pd(y0);
+    const __m512d Y0Sq = _mm512_set1_pd(y0 * y0);
+    const __m512d Y0SqQuarter = _mm512_set1_pd(0.25 * y0 * y0);
+    const __m512d Lanes = _mm512_setr_pd(0.0,1.0,2.0,3.0,4.0,5.0,6.0,7.0);
+    int I = 0;
+    for (; I + 8 <= Count; I += 8) {
+        int Ix = Ixst + I * IxStep;
+        __m512d X0 = _mm512_add_pd(_mm512_set1_pd(Xcent),_mm512_mul_pd(_mm512_sub_pd(
+                   _mm512_add_pd(_mm512_set1_pd(Ix),_mm512_mul_pd(Lanes,_mm512_set1_pd(IxStep))),
+                                      _mm512_set1_pd(GridXcent)),_mm512_set1_pd(Dx)));
+        __mmask8 Active = 0xff;
+        if (Checks) {
+            __m512d Xq = _mm512_sub_pd(X0,_mm512_set1_pd(0.25));
+            __m512d Q = _mm512_add_pd(_mm512_mul_pd(Xq,Xq),Y0Sq);
+            __mmask8 Cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(Q,_mm512_add_pd(Q,Xq)),
+                                                                 Y0SqQuarter,_CMP_LE_OQ);
+            __m512d Xp = _mm512_add_pd(X0,_mm512_set1_pd(1.0));
+            __mmask8 Bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(Xp,Xp),Y0Sq),
+                                                     _mm512_set1_pd(0.0625),_CMP_LE_OQ);
+            Active &= ~(Cardioid | Bulb);
+        }
+        __m512d X = Zero;
+        __m512d Y = Zero;
+        __m512d XSaved = Zero;
+        __m512d YSaved = Zero;
+        __m512d Result = Zero;
+        int SaveCount = 0;
+        int SaveLimit = 1;
+        for (int Iter = 1; Iter < MaxIter && Active != 0; Iter++) {
+            __m512d XTmp = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(X,Y),
+                                                           _mm512_sub_pd(X,Y)),X0);
+            Y = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(Two,X),Y),Y0);
+            X = XTmp;
+            __mmask8 Escaped = _mm512_mask_cmp_pd_mask(Active,_mm512_add_pd(
+                       _mm512_mul_pd(X,X),_mm512_mul_pd(Y,Y)),Four,_CMP_GT_OQ);
+            Result = _mm512_mask_blend_pd(Escaped,Result,_mm512_set1_pd(double(Iter)));
+            Active &= ~Escaped;
+            if (Checks) {
+                Active &= ~(_mm512_cmp_pd_mask(X,XSaved,_CMP_EQ_OQ) &
+                                                  _mm512_cmp_pd_mask(Y,YSaved,_CMP_EQ_OQ));
+                if (++SaveCount == SaveLimit) {
+                    XSaved = X;
+                    YSaved = Y;
+                    SaveCount = 0;
+                    SaveLimit *= 2;
+                }
+            }
+        }
+        _mm256_storeu_si256((__m256i*)(Values + I),_mm512_cvtpd_epi32(Result));
+    }
+    RowInC(Values + I,Count - I,Ixst + I * IxStep,IxStep,Xcent,GridXcent,Dx,y0,MaxIter,Checks);
+}
+
+#endif
+
+#ifdef MANDEL_NEON_SIMD
+
+static void RowUsingNEON (uint32_t* Values,int Count,int Ixst,int IxStep,prec Xcent,
+                                 prec GridXcent,prec Dx,prec y0,int MaxIter,bool Checks)
+{
+    const float64x2_t Zero = vdupq_n_f64(0.0);
+    const float64x2_t Two = vdupq_n_f64(2.0);
+    const float64x2_t Four = vdupq_n_f64(4.0);
+    const float64x2_t Y0 = vdupq_n_f64(y0);
+    const float64x2_t Y0Sq = vdupq_n_f64(y0 * y0);
+    const float64x2_t Y0SqQuarter = vdupq_n_f64(0.25 * y0 * y0);
+    int I = 0;
+    for (; I + 2 <= Count; I += 2) {
+        int Ix = Ixst + I * IxStep;
+        const double Indices[2] = {double(Ix),double(Ix + IxStep)};
+        float64x2_t X0 = vaddq_f64(vdupq_n_f64(Xcent),vmulq_f64(vsubq_f64(vld1q_f64(Indices),
+                                                vdupq_n_f64(GridXcent)),vdupq_n_f64(Dx)));
+        uint64x2_t Active = vdupq_n_u64(~uint64_t(0));
+        if (Checks) {
+            float64x2_t Xq = vsubq_f64(X0,vdupq_n_f64(0.25));
+            float64x2_t Q = vaddq_f64(vmulq_f64(Xq,Xq),Y0Sq);
+            uint64x2_t Cardioid = vcleq_f64(vmulq_f64(Q,vaddq_f64(Q,Xq)),Y0SqQuarter);
+            float64x2_t Xp = vaddq_f64(X0,vdupq_n_f64(1.0));
+            uint64x2_t Bulb = vcleq_f64(vaddq_f64(vmulq_f64(Xp,Xp),Y0Sq),vdupq_n_f64(0.0625));
+            Active = vbicq_u64(Active,vorrq_u64(Cardioid,Bulb));
+        }
+        float64x2_t X = Zero;
+        float64x2_t Y = Zero;
+        float64x2_t XSaved = Zero;
+        float64x2_t YSaved = Zero;
+        float64x2_t Result = Zero;
+        int SaveCount = 0;
+        int SaveLimit = 1;
+        for (int Iter = 1; Iter < MaxIter &&
+                    (vgetq_lane_u64(Active,0) | vgetq_lane_u64(Active,1)) != 0; Iter++) {
+            float64x2_t XTmp = vaddq_f64(vmulq_f64(vaddq_f64(X,Y),vsubq_f64(X,Y)),X0);
+            Y = vaddq_f64(vmulq_f64(vmulq_f64(Two,X),Y),Y0);
+            X = XTmp;
+            uint64x2_t Escaped = vandq_u64(vcgtq_f64(vaddq_f64(vmulq_f64(X,X),
+                                                       vmulq_f64(Y,Y)),Four),Active);
+            Result = vbslq_f64(Escaped,vdupq_n_f64(double(Iter)),Result);
+            Active = vbicq_u64(Active,Escaped);
+            if (Checks) {
+                Active = vbicq_u64(Active,vandq_u64(vceqq_f64(X,XSaved),vceqq_f64(Y,YSaved)));
+                if (++SaveCount == SaveLimit) {
+                    XSaved = X;
+                    YSaved = Y;
+                    SaveCount = 0;
+                    SaveLimit *= 2;
+                }
+            }
+        }
+        vst1_u32(Values + I,vmovn_u64(vcvtq_u64_f64(Result)));
+    }
+    RowInC(Values + I,Count - I,Ixst + I * IxStep,IxStep,Xcent,GridXcent,Dx,y0,MaxIter,Checks);
+}
+
+#endif
+
+//  CPUSupports() returns true if the CPU being used supports a given set of vector instructions,
+//  "AVX2", "AVX512" or "NEON". (NEON is a standard part of 64-bit ARM, so is always there.)
+
+[[maybe_unused]] static bool CPUSupports(const std::string& Isa)
+{
+    bool Supported = false;
+#ifdef MANDEL_X86_SIMD
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (Isa == "AVX2") Supported = __builtin_cpu_supports("avx2");
+    if (Isa == "AVX512") Supported = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER)
+    
+    //  CPUID leaf 7 gives the instruction set bits, but the operating system also has to be
+    //  saving the wider registers, which _xgetbv() shows (bits 1,2 for AVX, 5-7 for AVX-512).
+    
+    int Info[4];
+    __cpuid(Info,0);
+    if (Info[0] >= 7) {
+        __cpuidex(Info,7,0);
+        bool HasAVX2 = (Info[1] & (1 << 5)) != 0;
+        bool HasAVX512 = (Info[1] & (1 << 16)) != 0;
+        __cpuid(Info,1);
+        bool OSSaves = (Info[2] & (1 << 27)) != 0;
+        unsigned long long XCR0 = OSSaves ? _xgetbv(0) : 0;
+        if (Isa == "AVX2") Supported = HasAVX2 && ((XCR0 & 0x6) == 0x6);
+        if (Isa == "AVX512") Supported = HasAVX512 && ((XCR0 & 0xe6) == 0xe6);
+    }
+#endif
+#endif
+#ifdef MANDEL_NEON_SIMD
+    if (Isa == "NEON") Supported = true;
+#endif
+    return Supported;
+}
+
+//  SelectRowRoutine() returns the row routine to use - the one with the widest vectors the CPU
+//  supports - and sets Name to the instruction set it uses. It only checks the CPU once.
+
+static RowRoutine SelectRowRoutine(const char** Name)
+{
+    static const char* RoutineName = "Scalar";
+    static const RowRoutine Routine = [](){
+        RowRoutine Selected = RowInC;
+#ifdef MANDEL_X86_SIMD
+        if (CPUSupports("AVX512")) {
+            Selected = RowUsingAVX512;
+            RoutineName = "AVX512";
+        } else if (CPUSupports("AVX2")) {
+            Selected = RowUsingAVX2;
+            RoutineName = "AVX2";
+        }
+#endif
+#ifdef MANDEL_NEON_SIMD
+        if (CPUSupports("NEON")) {
+            Selected = RowUsingNEON;
+            RoutineName = "NEON";
+        }
+#endif
+        return Selected;
+    }();
+    if (Name) *Name = RoutineName;
+    return Routine;
+}
+
+void MandelComputeHandler::ComputeRangeInC (
+       uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
+                                             prec Dx,prec Dy,int MaxIter,bool Checks)
+{
+    //  Each row is computed by the row routine for this CPU, using vector instructions if it
+    //  has them.
+    
+    RowRoutine Row = SelectRowRoutine();
+    Data += Iyst * Nx;
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+        Row(Data,Nx,0,1,Xcent,gridXcent,Dx,y0,MaxIter,Checks);
+        Data += Nx;
+    }
+
+}
+
+//  ComputeRefineInC() performs one pass of ComputeInCProgressive(), for blocks Step pixels
+//  square. Unless this is the first pass, the pixels that start the blocks of the previous
+//  pass - those on multiples of 2 * Step in both X and Y - already have their values, as do
+//  the blocks they start, and are skipped.
+
+void MandelComputeHandler::ComputeRefineInC (
+        uint32_t* Data,int Nx,int Ny,int Step,bool FirstPass,prec Xcent,prec Ycent,
+                                             prec Dx,prec Dy,int MaxIter,bool Checks)
+{
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    int Done = 2 * Step;
+    
+    //  The rows of blocks are divided between the threads of the shared pool, each thread
+    //  taking the next row of blocks as soon as it has finished the last, as for
+    //  ComputeInCThreads(). A block only covers rows in its own row of blocks, so no two
+    //  threads write to the same pixels. The points to compute in a row are evenly spaced -
+    //  every Step pixels, or, in a row done by the previous pass, every 2 * Step pixels
+    //  starting at Step - so the row routine for this CPU can compute them all, before they are
+    //  spread over their blocks.
+    
+    RowRoutine RowValues = SelectRowRoutine();
+    int BlockRows = (Ny + Step - 1) / Step;
+    std::atomic<int> NextBlockRow(0);
+    ThreadPool::Shared().ParallelFor(0,BlockRows,[&](int,int) {
+        std::vector<uint32_t> Values(Nx);
+        for (int Ib = NextBlockRow++; Ib < BlockRows; Ib = NextBlockRow++) {
+            int Iy = Ib * Step;
+            int Iyen = std::min(Ny,Iy + Step);
+            bool DoneRow = !FirstPass && (Iy % Done) == 0;
+            prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+            int Ixst = DoneRow ? Step : 0;
+            int IxStep = DoneRow ? Done : Step;
+            int Count = (Nx - Ixst + IxStep - 1) / IxStep;
+            if (Count <= 0) continue;
+            RowValues(Values.data(),Count,Ixst,IxStep,Xcent,gridXcent,Dx,y0,MaxIter,Checks);
+            for (int I = 0; I < Count; I++) {
+                int Ix = Ixst + I * IxStep;
+                int Ixen = std::min(Nx,Ix + Step);
+                for (int Jy = Iy; Jy < Iyen; Jy++) {
+                    uint32_t* Row = Data + size_t(Jy) * size_t(Nx);
+                    for (int Jx = Ix; Jx < Ixen; Jx++) Row[Jx] = Values[I];
+                }
+            }
+        }
+    });
+}
+
+//  ComputeStripInC() computes the pixels in one strip of the image. The pixels of the strip
+//  are divided between the threads of the shared pool as a single range, as a strip may only
+//  be a row or two deep.
+
+void MandelComputeHandler::ComputeStripInC (
+        uint32_t* Data,int Nx,int Ny,const Strip& Area,prec Xcent,prec Ycent,
+                                          prec Dx,prec Dy,int MaxIter,bool Checks)
+{
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    int Width = Area.Ixen - Area.Ixst;
+    int Pixels = Width * (Area.Iyen - Area.Iyst);
+    ThreadPool::Shared().ParallelFor(0,Pixels,[&](int Ist,int Ien) {
+        for (int I = Ist; I < Ien; I++) {
+            int Ix = Area.Ixst + I % Width;
+            int Iy = Area.Iyst + I / Width;
+            prec x0 = Xcent + (prec(Ix) - gridXcent) * Dx;
+            prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+            Data[size_t(Iy) * Nx + Ix] = PointInC(x0,y0,MaxIter,Checks);
+        }
+    });
+}
+
+//  ComputeSubdividedInC() computes rows Iyst up to (not including) Iyen of the image using the
+//  Mariani-Silver method - see the notes in the header. The rows are divided into tiles
+//  C_SubdivideCPUTile pixels square, which the threads of the pool (the shared pool if Pool is
+//  null) take as they become free, as in ComputeInCThreads(). Each thread computes the border
+//  of its tile, and SubdivideInC() deals with the rest. It returns the number of pixels that
+//  were actually computed, rather than filled.
+
+long MandelComputeHandler::ComputeSubdividedInC (
+        uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,prec Xcent,prec Ycent,
+                                   prec Dx,prec Dy,int MaxIter,bool Checks,ThreadPool* Pool)
+{
+    if (Pool == nullptr) Pool = &ThreadPool::Shared();
+    RowRoutine Row = SelectRowRoutine();
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    int TilesX = (Nx + C_SubdivideCPUTile - 1) / C_SubdivideCPUTile;
+    int TilesY = (Iyen - Iyst + C_SubdivideCPUTile - 1) / C_SubdivideCPUTile;
+    int Tiles = TilesX * TilesY;
+    std::atomic<int> NextTile(0);
+    std::atomic<long> Computed(0);
+    Pool->ParallelFor(0,Tiles,[&](int,int) {
+        for (int Tile = NextTile++; Tile < Tiles; Tile = NextTile++) {
+            Strip Area;
+            Area.Ixst = (Tile % TilesX) * C_SubdivideCPUTile;
+            Area.Ixen = std::min(Nx,Area.Ixst + C_SubdivideCPUTile);
+            Area.Iyst = Iyst + (Tile / TilesX) * C_SubdivideCPUTile;
+            Area.Iyen = std::min(Iyen,Area.Iyst + C_SubdivideCPUTile);
+            int Width = Area.Ixen - Area.Ixst;
+            for (int Iy : {Area.Iyst,Area.Iyen - 1}) {
+                prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+                Row(Data + size_t(Iy) * Nx + Area.Ixst,Width,Area.Ixst,1,Xcent,gridXcent,Dx,y0,
+                                                                               MaxIter,Checks);
+            }
+            for (int Iy = Area.Iyst + 1; Iy < Area.Iyen - 1; Iy++) {
+                prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+                for (int Ix : {Area.Ixst,Area.Ixen - 1}) {
+                    prec x0 = Xcent + (prec(Ix) - gridXcent) * Dx;
+                    Data[size_t(Iy) * Nx + Ix] = PointInC(x0,y0,MaxIter,Checks);
+                }
+            }
+            long Border = 2 * long(Width) + 2 * long(std::max(Area.Iyen - Area.Iyst - 2,0));
+            Computed += Border + SubdivideInC(Data,Nx,Ny,Area,Xcent,Ycent,Dx,Dy,MaxIter,Checks);
+        }
+    });
+    return Computed;
+}
+
+//  SubdivideInC() completes a rectangle of the image whose border has already been computed.
+//  If every pixel on the border has the same value, the inside of the rectangle is filled with
+//  it. Otherwise, if the inside is small, it is computed in full, and if not, the row and the
+//  column through the middle of the rectangle are computed, which completes the borders of
+//  its four quarters, and each quarter is done in the same way. It returns the number of
+//  pixels computed.
+
+long MandelComputeHandler::SubdivideInC (
+        uint32_t* Data,int Nx,int Ny,const Strip& Area,prec Xcent,prec Ycent,
+                                          prec Dx,prec Dy,int MaxIter,bool Checks)
+{
+    int Ixst = Area.Ixst + 1;
+    int Ixen = Area.Ixen - 1;
+    int Iyst = Area.Iyst + 1;
+    int Iyen = Area.Iyen - 1;
+    if (Ixst >= Ixen || Iyst >= Iyen) return 0;
+    
+    uint32_t* Top = Data + size_t(Area.Iyst) * Nx;
+    uint32_t* Bottom = Data + size_t(Area.Iyen - 1) * Nx;
+    uint32_t Value = Top[Area.Ixst];
+    bool Uniform = true;
+    for (int Ix = Area.Ixst; Uniform && Ix < Area.Ixen; Ix++) {
+        Uniform = (Top[Ix] == Value && Bottom[Ix] == Value);
+    }
+    for (int Iy = Iyst; Uniform && Iy < Iyen; Iy++) {
+        uint32_t* Row = Data + size_t(Iy) * Nx;
+        Uniform = (Row[Area.Ixst] == Value && Row[Area.Ixen - 1] == Value);
+    }
+    if (Uniform) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            std::fill(Data + size_t(Iy) * Nx + Ixst,Data + size_t(Iy) * Nx + Ixen,Value);
+        }
+        return 0;
+    }
+    
+    RowRoutine Row = SelectRowRoutine();
+    prec gridXcent = Nx * 0.5;
+    prec gridYcent = Ny * 0.5;
+    if (Ixen - Ixst < C_SubdivideMin || Iyen - Iyst < C_SubdivideMin) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+            Row(Data + size_t(Iy) * Nx + Ixst,Ixen - Ixst,Ixst,1,Xcent,gridXcent,Dx,y0,
+                                                                               MaxIter,Checks);
+        }
+        return long(Ixen - Ixst) * long(Iyen - Iyst);
+    }
+    
+    int Xmid = (Area.Ixst + Area.Ixen) / 2;
+    int Ymid = (Area.Iyst + Area.Iyen) / 2;
+    prec yMid = Ycent + (prec(Ymid) - gridYcent) * Dy;
+    Row(Data + size_t(Ymid) * Nx + Ixst,Ixen - Ixst,Ixst,1,Xcent,gridXcent,Dx,yMid,
+                                                                               MaxIter,Checks);
+    prec xMid = Xcent + (prec(Xmid) - gridXcent) * Dx;
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        if (Iy == Ymid) continue;
+        prec y0 = Ycent + (prec(Iy) - gridYcent) * Dy;
+        Data[size_t(Iy) * Nx + Xmid] = PointInC(xMid,y0,MaxIter,Checks);
+    }
+    long Computed = long(Ixen - Ixst) + long(Iyen - Iyst - 1);
+    Strip Quarters[4] = {{Area.Ixst,Xmid + 1,Area.Iyst,Ymid + 1},
+                         {Xmid,Area.Ixen,Area.Iyst,Ymid + 1},
+                         {Area.Ixst,Xmid + 1,Ymid,Area.Iyen},
+                         {Xmid,Area.Ixen,Ymid,Area.Iyen}};
+    for (const Strip& Quarter : Quarters) {
+        Computed += SubdivideInC(Data,Nx,Ny,Quarter,Xcent,Ycent,Dx,Dy,MaxIter,Checks);
+    }
+    return Computed;
+}
+
+//  ReferenceOrbitInC() computes the orbit of the point (X0,Y0) in DoubleDouble precision, for
+//  use as the reference orbit by ComputePerturbed(), setting Orbit to the X,Y pairs of the
+//  orbit rounded to double, starting with (0,0). The orbit stops after MaxIter iterations, or
+//  once it diverges, and the number of points in it is returned.
+
+int MandelComputeHandler::ReferenceOrbitInC (
+   const DoubleDouble& X0,const DoubleDouble& Y0,int MaxIter,std::vector<double>& Orbit)
+{
+    Orbit.resize(size_t(MaxIter + 1) * 2);
+    Orbit[0] = Orbit[1] = 0.0;
+    DoubleDouble x = 0.0;
+    DoubleDouble y = 0.0;
+    int Points = 1;
+    while (Points <= MaxIter) {
+        DoubleDouble xtmp = (x + y) * (x - y) + X0;
+        y = x * y * 2.0 + Y0;
+        x = xtmp;
+        double xd = x.ToDouble();
+        double yd = y.ToDouble();
+        Orbit[Points * 2] = xd;
+        Orbit[Points * 2 + 1] = yd;
+        Points++;
+        if ((xd * xd) + (yd * yd) > 4.0) break;
+    }
+    return Points;
+}
+
+bool MandelComputeHandler::FloatOKatXY(int Ix,int Iy)
+{
+    //  This checks whether floating point rounding error will not show up at a given
+    //  point in the image (given by its pixel coordinates). It calculates the position
+    //  in the Mandelbrot set for this pixel given the current X and Y center and the
+    //  magnification, then offsets this by roughly the equivalent in image pixel
+    //  coordinates of a pixel in the display and recalculates the position. If floating
+    //  point precision is such that these two positions appear the same due to rounding
+    //  error, then it returns false. Strictly, there still will be rounding error, but
+    //  it probably won't be visible with the current display settings.
+    
+    float Xinc = float(_nx) / float(_width);
+    float X0 = float(_xCent + (float(Ix) - _nx * 0.5) * _dx);
+    float X1 = float(_xCent + (float(Ix) + Xinc - _nx * 0.5) * _dx);
+    float Yinc = float(_ny) / float(_height);
+    float Y0 = float(_yCent + (float(Iy) - _ny * 0.5) * _dy);
+    float Y1 = float(_yCent + (float(Iy) + Yinc - _ny * 0.5) * _dy);
+
+    return ((Y1 - Y0) > 0.0f) && ((X1 - X0) > 0.0f);
+}
+
+bool MandelComputeHandler::FloatOK(void)
+{
+    //  This runs a quick test for floating point accuracy at the current display settings
+    //  at a set of points that cover the range of the image in both X and Y.
+    
+    int Ix = 0;
+    int Iy = 0;
+    int Ixinc = _nx / 10;
+    int Iyinc = _ny / 10;
+    for (int I = 0; I < 10; I++) {
+        if (!FloatOKatXY(Ix,Iy)) return false;
+        Ix += Ixinc;
+        Iy += Iyinc;
+    }
+    return true;
+}
+
+bool MandelComputeHandler::DoubleOKatXY(int Ix,int Iy)
+{
+    //  The same as FloatOKatXY(), bur using double precision.
+    
+    double Xinc = double(_nx) / double(_width);
+    double X0 = _xCent + (double(Ix) - _nx * 0.5) * _dx;
+    double X1 = _xCent + (double(Ix) + Xinc - _nx * 0.5) * _dx;
+    double Yinc = double(_ny) / double(_height);
+    double Y0 = _yCent + (double(Iy) - _ny * 0.5) * _dy;
+    double Y1 = _yCent + (double(Iy) + Yinc - _ny * 0.5) * _dy;
+    //if (((Y1 - Y0) <= 0.0) || ((X1 - X0) <= 0.0)) printf ("%g %g\n",Y1 - Y0,X1 - X0);
+    return ((Y1 - Y0) > 0.0) && ((X1 - X0) > 0.0);
+}
+
+bool MandelComputeHandler::DoubleOK(void)
+{
+    //  The same as FloatOK() but uses double precision.
+    
+    int Ix = 0;
+    int Iy = 0;
+    int Ixinc = _nx / 10;
+    int Iyinc = _ny / 10;
+    for (int I = 0; I < 10; I++) {
+        if (!DoubleOKatXY(Ix,Iy)) return false;
+        Ix += Ixinc;
+        Iy += Iyinc;
+    }
+    return true;
+}
+
+//  FloatFloat() returns a value rounded to the precision of a float-float - the sum of its
+//  value rounded to a float and the remainder rounded to a float.
+
+double MandelComputeHandler::FloatFloat(double Value)
+{
+    float Hi = float(Value);
+    float Lo = float(Value - double(Hi));
+    return double(Hi) + double(Lo);
+}
+
+bool MandelComputeHandler::FloatFloatOKatXY(int Ix,int Iy)
+{
+    //  The same as FloatOKatXY(), but using float-float precision.
+    
+    double Xinc = double(_nx) / double(_width);
+    double X0 = FloatFloat(_xCent + (double(Ix) - _nx * 0.5) * _dx);
+    double X1 = FloatFloat(_xCent + (double(Ix) + Xinc - _nx * 0.5) * _dx);
+    double Yinc = double(_ny) / double(_height);
+    double Y0 = FloatFloat(_yCent + (double(Iy) - _ny * 0.5) * _dy);
+    double Y1 = FloatFloat(_yCent + (double(Iy) + Yinc - _ny * 0.5) * _dy);
+    return ((Y1 - Y0) > 0.0) && ((X1 - X0) > 0.0);
+}
+
+bool MandelComputeHandler::FloatFloatOK(void)
+{
+    //  The same as FloatOK() but uses float-float precision.
+    
+    int Ix = 0;
+    int Iy = 0;
+    int Ixinc = _nx / 10;
+    int Iyinc = _ny / 10;
+    for (int I = 0; I < 10; I++) {
+        if (!FloatFloatOKatXY(Ix,Iy)) return false;
+        Ix += Ixinc;
+        Iy += Iyinc;
+    }
+    return true;
+}
+
+//  PerturbedOK() is the equivalent of FloatOK() and DoubleOK() for ComputePerturbed(). The
+//  offsets of the pixels from the centre are small enough to be held accurately, but the centre
+//  itself is only held to the precision of a DoubleDouble, and once a pixel is within a factor
+//  100 or so of that, rounding error will start to show.
+
+bool MandelComputeHandler::PerturbedOK(void)
+{
+    RecomputeArgs();
+    double Scale = std::max(1.0,std::max(fabs(_xCent),fabs(_yCent)));
+    double Limit = Scale * C_DoubleDoubleEpsilon * 100.0;
+    return (fabs(_dx) > Limit && fabs(_dy) > Limit);
 }
 
 #ifdef MANDEL_COMPUTE_TEST
@@ -556,19 +3029,19 @@ int main()
     Handler.SetImageSize(1024,1024);
     Handler.SetCentre(0.270925,0.004725);
     Handler.SetMagnification(15000.0);
-    float* Image = Handler.GetImageData();
-    if (Image) { for (int I = 0; I < 1024 * 1024; Image[I++] = 42.0);}
+    uint32_t* Image = Handler.GetImageData();
+    if (Image) { for (int I = 0; I < 1024 * 1024; Image[I++] = 42);}
     Handler.Compute();
     if (Image) {
-        float Vmin = 4096.0;
-        float Vmax = 0.0;
+        uint32_t Vmin = 4096;
+        uint32_t Vmax = 0;
         for (int I = 0; I < 1024 * 1024; I++) {
-            if (I < 50) printf ("[%d] = %f ",I,Image[I]);
+            if (I < 50) printf ("[%d] = %u ",I,Image[I]);
             if (I == 50) printf ("\n");
             if (Image[I] > Vmax) Vmax = Image[I];
             if (Image[I] < Vmin) Vmin = Image[I];
         }
-        printf ("Min = %f, max = %f\n",Vmin,Vmax);
+        printf ("Min = %u, max = %u\n",Vmin,Vmax);
     }
     return 0;
 }
@@ -21,6 +21,97 @@
 //  be obtained using GetImageData() and the image will then be written out or displayed in
 //  some way.
 //
+//  ComputeInC() can take a while at high magnifications, so ComputeInCProgressive() can be
+//  used instead to compute the image a pass at a time, coarse to fine - first every 8th pixel,
+//  filling the 8 by 8 block each one starts, then every 4th, every 2nd and finally every pixel,
+//  reusing the pixels already computed. Each call does one pass, and returns true once the
+//  image is complete, so the image can be displayed as it builds up. If the image parameters
+//  change before it is complete, the remaining passes are dropped and a new image is started.
+//
+//  At a high magnification and iteration limit, a single GPU image can take seconds, so
+//  ComputeChunked() can be used in the same way to have the GPU compute the image in bands of
+//  rows, a few bands to each submission. Each call runs bands for a limited time, and returns
+//  true once the image is complete. CancelImage(), which can be called from any thread, has the
+//  bands not yet run dropped, and the next call starts a new image, which it reports, so the
+//  caller can tell which calls an image took.
+//
+//  When an image is dragged, MoveCentre() can be used instead of SetCentre() to move the
+//  centre by a whole number of pixels. If the only change since the last complete image is such
+//  a move, and the image is computed the same way - GPU, GPU double precision, or CPU - the
+//  existing image is shifted and only the strips that have come into view are computed.
+//
+//  Beyond a magnification of around 1e13, even double precision can't tell neighbouring
+//  pixels apart - DoubleOK() returns false - and ComputePerturbed() can be used instead. This
+//  computes the orbit of the centre point of the image using the CPU, in the extended
+//  precision of a DoubleDouble, and passes it to the GPU, which then only has to compute the
+//  small differences between each pixel's orbit and that reference orbit. The centre is held
+//  to the same precision, so the image should be moved using OffsetCentre() or MoveCentre(),
+//  which take offsets from the current centre, rather than SetCentre(). PerturbedOK() returns
+//  false once even this precision is no longer enough.
+//
+//  Short of that, on GPUs that don't support double precision, ComputeFloatFloat() can be
+//  used. This holds each quantity as the sum of two floats, a high and a low part, which
+//  gives around 48 bits of mantissa - not quite double precision, but a lot closer to it than
+//  a single float, at a cost of a few times as many float operations. FloatFloatOK() is its
+//  equivalent of FloatOK() and DoubleOK().
+//
+//  Whether single precision is enough depends on the spacing of the pixels relative to their
+//  coordinates, so at some views it fails at one side of the image but not the other - near
+//  the real axis, say, a long way from the origin. ComputeMixed() divides the image into tiles,
+//  works out which of single precision, float-float and double precision each tile needs, and
+//  has the GPU compute each list of tiles with the matching shader, all in the one submission,
+//  so the slower arithmetic is only used where it's needed. CountTilePrecisions() returns how
+//  many tiles need each, so a caller can tell whether this will save anything.
+//
+//  At those magnifications, the GPU is much slower than it is in single precision, and
+//  ComputeHybrid() can be used to have the CPU compute part of the image while the GPU computes
+//  the rest. The split between the two is adjusted from image to image so that both finish at
+//  about the same time.
+//
+//  When the next image is known in advance - when zooming, for example - StartGPUImage() can
+//  be used to have the GPU start computing it, into a second image buffer, while the current
+//  image is displayed. FinishGPUImage() then waits for it and makes it the current image, so
+//  long as nothing has changed in the meantime. This works for perturbation images as well, as
+//  the reference orbit can be computed before the GPU is started. StartCPUImage() and
+//  FinishCPUImage() do the same for an image computed by the CPU, which is computed by a
+//  background thread using a thread pool of its own, leaving a CPU thread free to display
+//  the current image.
+//
+//  Complete images are kept in an image cache, up to a memory limit set by SetImageCacheLimit(),
+//  and an image the cache already holds, computed the same way, is copied from the cache
+//  rather than being computed again.
+//
+//  SetTileQueue() changes the way Compute() shares out the image between the GPU's threads.
+//  Rather than launching a workgroup for each tile of the image, it launches a fixed number
+//  of workgroups that each take tiles from a queue until the image is done. This can even out
+//  the load when some parts of the image take much longer than others.
+//
+//  SetSubdivide() has Compute() and ComputeInC() skip the parts of the image that are all
+//  the same, using the Mariani-Silver method. Only the border of a rectangle is computed at
+//  first, and if every pixel on it has the same value, the rest of the rectangle is just
+//  filled with that value. Otherwise, the CPU code divides the rectangle into four and does
+//  the same for each, while the GPU uses its workgroup tiles as the rectangles. Large areas
+//  inside the set, which take the most iterations, are filled almost for nothing. The set is
+//  connected, so these fills are exact, but a rectangle whose border escapes at a single
+//  iteration count can very occasionally hide some detail, so the image may differ slightly
+//  from the one computed in full.
+//
+//  GetImageChanges() tells a caller displaying the images how much of the current image is new
+//  since it last asked. Usually that's all of it, but an image that has just been dragged is
+//  the last one moved by a whole number of pixels, with only the strips that have come into
+//  view computed. Only those strips are copied back from the GPU if the image buffer is staged,
+//  and a renderer can use them to avoid going over the whole image again.
+//
+//  If the 'Stats' debug level is active, Compute() uses an instrumented version of its shader,
+//  MandelStats.comp, which also records the iterations run by each workgroup. From these it
+//  logs how unevenly the work was shared between the workgroups - the load imbalance, the
+//  ratio of the longest workgroup to the average - and how much of the time the invocations
+//  within a subgroup spent waiting for the slowest of them - the divergence. If the device
+//  supports subgroup arithmetic, the shader uses it, which is quicker and also allows the
+//  divergence within each subgroup to be measured. GetWorkGroupStats() returns the figures for
+//  the last image computed this way. These show how well the shape of the workgroups suits the
+//  image, and whether the tile queue is likely to help.
+//
 //  The image is generated in a float array, Nx by Ny. Although a float array is used, each
 //  pixel in the image will be the number of iterations that it took the code to decide
 //  whether the point lies within the Mandelbrot set or not. If the code runs more than
@@ -62,6 +153,34 @@
 //     23rd Aug 2024. Added support for GetDebugOptions(). KS.
 //     27th Aug 2024. Added Validate parameter to Initialise(). KS.
 //     14th Sep 2024. Modified following renaming of Framework routines and types. KS.
+//     15th Oct 2026. Added ComputeInCProgressive(). KS.
+//                    Added MoveCentre(), and shifting of moved images. KS.
+//                    Added ComputeFloatFloat() and FloatFloatOK(). KS.
+//                    Added SetInteriorChecks() and GetInteriorChecks(). KS.
+//                    Added SetTileQueue() and GetTileQueue(). KS.
+//                    Added ComputeHybrid(). KS.
+//                    Added StartGPUImage() and FinishGPUImage(). KS.
+//                    Added the image cache, with SetImageCacheLimit(), GetImageCacheLimit()
+//                    and GetImageCacheHits(). KS.
+//                    StartGPUImage() can now start perturbation images. KS.
+//                    The image is now an array of uint32_t iteration counts, not floats. KS.
+//                    Added GetImageBuffer(). KS.
+//                    Added StartCPUImage() and FinishCPUImage(). KS.
+//                    Added the 'Profile' debug level, with CPUProfile() and
+//                    ReportCPUProfile(). KS.
+//                    Added the 'Stats' debug level, with WorkGroupStats and
+//                    GetWorkGroupStats(). KS.
+//                    Added GetImageReadyPoints(), with _imageSemaphore and the values it
+//                    signals. KS.
+//                    Added SetSubdivide() and GetSubdivide(). KS.
+//                    Added GetImageChanges(), with NoteChanges() and the changes it records.
+//                    Strip is now public, as GetImageChanges() returns them. KS.
+//                    Added ComputeMixed() and CountTilePrecisions(). ComputeStrips() now
+//                    uses ComputeStripSets(). KS.
+//                    Added ComputeFrames(), with FrameDetails, GetFrameData(),
+//                    MaxBatchFrames() and the frame buffers they use. KS.
+//                    Added ComputeChunked() and CancelImage(). KS.
+//                    ComputeChunked() now says whether it started a new image. KS.
 
 #ifndef __MandelComputeHandlerVulkan__
 #define __MandelComputeHandlerVulkan__
@@ -69,6 +188,14 @@
 #include "KVVulkanFramework.h"
 #include "MsecTimer.h"
 #include "DebugHandler.h"
+#include "CycleTimer.h"
+#include "DoubleDouble.h"
+
+#include <list>
+#include <cstdint>
+#include <thread>
+
+class ThreadPool;
 
 #define prec double
 
@@ -83,23 +210,88 @@
 class MandelComputeHandler
 {
     public:
+        //  The precisions in which StartGPUImage() can have the GPU compute an image.
+        enum GPUPrecision {GPU_FLOAT,GPU_DOUBLE,GPU_FLOAT_FLOAT,GPU_PERTURBED};
+        //  The workgroup statistics for an image, as returned by GetWorkGroupStats(). The
+        //  'cost' of a workgroup is the total number of iterations run by its invocations.
+        //  Imbalance is MaxCost / MeanCost, 1.0 if every workgroup did the same work.
+        //  GroupEfficiency is the average, over the workgroups, of the cost divided by what it
+        //  would be if every pixel took as long as the slowest in the workgroup. Efficiency is
+        //  the same, but for each subgroup, which is what actually runs in lockstep, and is
+        //  zero if subgroup operations weren't available to measure it.
+        struct WorkGroupStats {
+            int Groups;
+            double TotalIter;
+            double MeanCost;
+            double MaxCost;
+            double Imbalance;
+            uint32_t MaxIter;
+            double GroupEfficiency;
+            double Efficiency;
+        };
+        //  A strip of the image, from (Ixst,Iyst) up to (not including) (Ixen,Iyen).
+        struct Strip {
+            int Ixst;
+            int Ixen;
+            int Iyst;
+            int Iyen;
+        };
+        //  One frame of a batch computed by ComputeFrames(), with the precision to use for it.
+        struct FrameDetails {
+            double XCent;
+            double YCent;
+            double Magnification;
+            GPUPrecision Precision;
+        };
         MandelComputeHandler(void*);
         ~MandelComputeHandler();
         void Initialise(bool Validate,const std::string& DebugLevels);
         void SetImageSize (int Nx, int Ny);
         void SetCentre(double XCent,double YCent);
+        void MoveCentre(double XOffset,double YOffset);
+        void OffsetCentre(double XOffset,double YOffset);
         void SetMagnification(double Magnification);
         void SetAspect(double Width, double Height);
         void SetMaxIter(int MaxIter);
+        void SetInteriorChecks(bool Enable);
+        bool GetInteriorChecks();
+        void SetTileQueue(bool Enable);
+        bool GetTileQueue();
+        void SetSubdivide(bool Enable);
+        bool GetSubdivide();
+        void SetImageCacheLimit(long Bytes);
+        long GetImageCacheLimit();
+        long GetImageCacheHits();
+        bool GetWorkGroupStats(WorkGroupStats* Stats);
         double GetMagnification();
         bool FloatOK();
         bool DoubleOK();
+        bool FloatFloatOK();
+        bool PerturbedOK();
         bool GPUSupportsDouble();
         void GetCentre(double* XCent,double* YCent);
         void Compute();
         void ComputeDouble();
+        void ComputeFloatFloat();
+        void ComputePerturbed();
+        void ComputeHybrid();
+        void ComputeMixed();
+        void CountTilePrecisions(int* FloatTiles,int* FloatFloatTiles,int* DoubleTiles);
+        bool ComputeFrames(const std::vector<FrameDetails>& Frames);
+        uint32_t* GetFrameData(int Frame);
+        static int MaxBatchFrames(void);
+        bool StartGPUImage(GPUPrecision Precision);
+        bool FinishGPUImage(GPUPrecision Precision);
+        bool StartCPUImage();
+        bool FinishCPUImage();
         void ComputeInC();
-        float* GetImageData();
+        bool ComputeInCProgressive();
+        bool ComputeChunked(GPUPrecision Precision,bool* Started);
+        void CancelImage();
+        uint32_t* GetImageData();
+        bool GetImageChanges(int* ShiftX,int* ShiftY,std::vector<Strip>& Areas);
+        KVVulkanFramework::KVBufferHandle GetImageBuffer();
+        std::vector<KVVulkanFramework::KVTimelinePoint> GetImageReadyPoints();
         static std::string GetDebugOptions (void);
     private:
         //  Single structure to pass the arguments to the compute kernel on the GPU.
@@ -107,7 +299,8 @@ class MandelComputeHandler
         //  of alignment and size issues. There are two versions of each of the floating
         //  point quantities, one single and one double precision. Not all GPUs support
         //  double precision, so a shader that only supports single precsion will use
-        //  the single precision quantities.
+        //  the single precision quantities. The float-float shader adds the low parts
+        //  given by xCentLo etc. to the single precision quantities.
         struct MandelArgs {
             float xCent;
             float yCent;
@@ -116,39 +309,153 @@ class MandelComputeHandler
             int maxIter;
             int nx;
             int ny;
-            int padding;
+            int ixOrigin;
+            int iyOrigin;
+            int ixEnd;
+            int iyEnd;
+            float xCentLo;
+            float yCentLo;
+            float dXLo;
+            float dYLo;
+            int checks;
             double xCentD;
             double yCentD;
             double dXD;
             double dYD;
         };
+        //  The arguments for the perturbation shaders, which only need the pixel scale, again
+        //  in both single and double precision, and the length of the reference orbit.
+        struct PerturbArgs {
+            float dX;
+            float dY;
+            int maxIter;
+            int nx;
+            int ny;
+            int refLen;
+            double dXD;
+            double dYD;
+        };
         static const std::string _debugOptions;
-        static void ComputeInCThreads (float* Data,int Nx,int Ny,prec Xcent,prec Ycent,
-                                                          prec Dx,prec Dy,int MaxIter);
-        static void ComputeRangeInC (float* Data,int Nx,int Ny,int Iyst,int Iyen,
-                                     prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter);
+        static void ComputeInCThreads (uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,
+                 prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks,
+                         ThreadPool* Pool = nullptr,CycleProfile* Profile = nullptr);
+        static void ComputeRangeInC (uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        static void ComputeRefineInC (uint32_t* Data,int Nx,int Ny,int Step,bool FirstPass,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        //  How the image in the buffer was computed.
+        enum ImageSource {IMAGE_NONE,IMAGE_GPU,IMAGE_GPU_D,IMAGE_GPU_P,IMAGE_GPU_FF,IMAGE_HYBRID,
+                                                                  IMAGE_GPU_MIXED,IMAGE_CPU};
+        //  A set of strips of the image to be computed by the GPU using the same pipeline.
+        struct StripSet {
+            VkPipeline Pipeline;
+            VkPipelineLayout PipelineLayout;
+            std::vector<Strip> Strips;
+        };
+        //  An image held in the image cache, with how it was computed and its parameters.
+        struct CachedImage {
+            ImageSource Source;
+            double XCent;
+            double YCent;
+            double XCentLo;
+            double YCentLo;
+            double Dx;
+            double Dy;
+            int MaxIter;
+            std::vector<uint32_t> Data;
+        };
+        static int ReferenceOrbitInC (const DoubleDouble& X0,const DoubleDouble& Y0,int MaxIter,
+                                                                  std::vector<double>& Orbit);
+        static void ComputeStripInC (uint32_t* Data,int Nx,int Ny,const Strip& Area,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        static long ComputeSubdividedInC (uint32_t* Data,int Nx,int Ny,int Iyst,int Iyen,
+                 prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks,
+                                                               ThreadPool* Pool = nullptr);
+        static long SubdivideInC (uint32_t* Data,int Nx,int Ny,const Strip& Area,
+                         prec Xcent,prec Ycent,prec Dx,prec Dy,int MaxIter,bool Checks);
+        static void ShiftInC (uint32_t* Data,int Nx,int Ny,int ShiftX,int ShiftY);
+        bool ShiftImage(ImageSource Source,std::vector<Strip>& Strips);
+        void NoteImage(ImageSource Source,int Step);
+        void NoteChanges(void);
+        void NoteChanges(int ShiftX,int ShiftY,const std::vector<Strip>& Areas);
+        std::vector<KVVulkanFramework::KVBufferRegion> StripRegions(
+                                                          const std::vector<Strip>& Strips);
+        bool SameImage();
+        std::list<CachedImage>::iterator FindCachedImage(ImageSource Source);
+        bool ImageFromCache(ImageSource Source);
+        void CacheImage();
+        static ImageSource GPUSource(GPUPrecision Precision);
+        void ComputeStrips(VkPipeline Pipeline,VkPipelineLayout PipelineLayout,
+                                                         const std::vector<Strip>& Strips);
+        void ComputeStripSets(const std::vector<StripSet>& Sets,const std::vector<Strip>& Areas);
+        GPUPrecision TilePrecision(const Strip& Tile);
+        void ClassifyTiles(const Strip& Area,std::vector<Strip> Tiles[3]);
+        void ComputeWithTileQueue();
+        void ComputeSubdivided();
+        void ComputeWithStats();
+        void ReduceWorkGroupStats(uint32_t Groups);
+        int HybridSplit();
+        void DropNextImage();
+        void SwapNextImage();
+        void NoteHybridRates(int Split,float GPUMsec,float CPUMsec);
+        int PrepareOrbit();
         void InitialiseVulkanItems();
+        void SetupFrameBuffers(int Frames);
+        void SetupChunks(VkPipeline Pipeline,VkPipelineLayout PipelineLayout);
         bool FloatOKatXY(int Ix,int Iy);
         bool DoubleOKatXY(int Ix,int Iy);
+        bool FloatFloatOKatXY(int Ix,int Iy);
+        static double FloatFloat(double Value);
         void RecomputeArgs();
+        CycleProfile* CPUProfile();
+        void ReportCPUProfile();
         bool _statusOK;
         KVVulkanFramework* _vulkanFramework;
         DebugHandler _debug;
         bool _frameworkIsLocal;
-        KVVulkanFramework::KVBufferHandle _uniformBufferHndl;
         KVVulkanFramework::KVBufferHandle _imageBufferHndl;
-        void* _uniformBufferAddr;
         double _xCent;
         double _yCent;
+        //  The low parts of the centre, which with _xCent and _yCent make up DoubleDouble
+        //  values, and the part of the offsets passed to MoveCentre() not yet applied.
+        double _xCentLo;
+        double _yCentLo;
+        double _xMoveLeft;
+        double _yMoveLeft;
         double _magnification;
         double _width;
         double _height;
         double _dx;
         double _dy;
-        float* _imageData;
+        uint32_t* _imageData;
         int _maxiter;
+        //  True if the checks that save iterating points inside the set are to be used.
+        bool _interiorChecks;
         int _nx;
         int _ny;
+        //  How the image in the buffer was computed, the block size for the next pass of
+        //  ComputeInCProgressive() - zero if the image is complete - and its parameters.
+        ImageSource _imageSource;
+        int _imageStep;
+        double _imageXCent;
+        double _imageYCent;
+        double _imageXCentLo;
+        double _imageYCentLo;
+        double _imageDx;
+        double _imageDy;
+        int _imageMaxIter;
+        //  How the current image differs from the one current when GetImageChanges() was last
+        //  called - see NoteChanges(). _changesPending is false if there is no new image since
+        //  then, and _changesAll is true if the whole image has to be taken as changed.
+        //  Otherwise it is the last image moved by (_changeShiftX,_changeShiftY), with the
+        //  strips in _changeAreas new. _changesShifted is set by ShiftImage() so NoteImage()
+        //  leaves its changes alone.
+        bool _changesPending;
+        bool _changesAll;
+        bool _changesShifted;
+        int _changeShiftX;
+        int _changeShiftY;
+        std::vector<Strip> _changeAreas;
         MandelArgs _currentArgs;
         VkQueue _computeQueue;
         VkCommandPool _commandPool;
@@ -162,6 +469,113 @@ class MandelComputeHandler
         bool _doubleSupportInGPU;
         VkPipelineLayout _computePipelineLayoutD;
         VkPipeline _computePipelineD;
+        VkPipelineLayout _computePipelineLayoutFF;
+        VkPipeline _computePipelineFF;
+        //  The perturbation pipelines use a separate descriptor set, which adds the reference
+        //  orbit buffer. _orbitBytes is the current size of that buffer, and _descriptorSetPOK
+        //  is false if the descriptor set needs to be set up again.
+        KVVulkanFramework::KVBufferHandle _orbitBufferHndl;
+        void* _orbitData;
+        long _orbitBytes;
+        bool _descriptorSetPOK;
+        std::vector<double> _orbit;
+        VkDescriptorSetLayout _setLayoutP;
+        VkDescriptorPool _descriptorPoolP;
+        VkDescriptorSet _descriptorSetP;
+        VkPipelineLayout _computePipelineLayoutP;
+        VkPipeline _computePipelineP;
+        VkPipelineLayout _computePipelineLayoutPD;
+        VkPipeline _computePipelinePD;
+        //  The second image buffer, used by StartGPUImage(), with its mapped address and the
+        //  descriptor sets and command buffer that go with it. _nextTicket is the submission
+        //  of the image being computed into it, if any, and _nextPrecision, _nextArgs and the
+        //  low parts of the centre are what it was computed with. If StartCPUImage() is
+        //  computing the image instead, _nextThread is the thread doing it, using the threads
+        //  of _aheadPool.
+        KVVulkanFramework::KVBufferHandle _nextBufferHndl;
+        uint32_t* _nextImageData;
+        VkDescriptorSet _nextDescriptorSet;
+        VkDescriptorSet _nextDescriptorSetP;
+        bool _nextDescriptorSetPOK;
+        VkCommandBuffer _nextCommandBuffer;
+        KVVulkanFramework::KVSubmitTicket _nextTicket;
+        //  The timeline semaphore signalled by the submissions of StartGPUImage(), if the device
+        //  supports them, and the last value signalled. _nextReadyValue is the value signalled
+        //  for the image in the second buffer, and _imageReadyValue the one for the current
+        //  image, or zero if it has nothing to wait for.
+        VkSemaphore _imageSemaphore;
+        uint64_t _imageSemaphoreValue;
+        uint64_t _imageReadyValue;
+        uint64_t _nextReadyValue;
+        GPUPrecision _nextPrecision;
+        MandelArgs _nextArgs;
+        double _nextXCentLo;
+        double _nextYCentLo;
+        std::thread _nextThread;
+        ThreadPool* _aheadPool;
+        //  The average rates, in rows a msec, at which the GPU and the CPU have computed their
+        //  parts of the images computed by ComputeHybrid(). Zero if not yet known.
+        double _hybridGPURate;
+        double _hybridCPURate;
+        //  True if Compute() is to use the tile queue pipeline, which has its own descriptor
+        //  set, adding the buffer with the counter used as the queue, mapped at _queueData.
+        bool _tileQueue;
+        KVVulkanFramework::KVBufferHandle _queueBufferHndl;
+        int* _queueData;
+        bool _descriptorSetQOK;
+        VkDescriptorSetLayout _setLayoutQ;
+        VkDescriptorPool _descriptorPoolQ;
+        VkDescriptorSet _descriptorSetQ;
+        VkPipelineLayout _computePipelineLayoutQ;
+        VkPipeline _computePipelineQ;
+        //  True if Compute(), ComputeInC() and StartCPUImage() are to skip uniform areas of the
+        //  image. The GPU uses the subdivision pipeline, with the usual descriptor sets.
+        bool _subdivide;
+        VkPipelineLayout _computePipelineLayoutMS;
+        VkPipeline _computePipelineMS;
+        //  The workgroup statistics pipeline, used by Compute() if the 'Stats' debug level is
+        //  active, with its own descriptor set adding the statistics buffer, mapped at
+        //  _statsData, which is _statsBytes long. _statsSubgroups is true if the pipeline uses
+        //  subgroup arithmetic, and _lastStats holds the figures for the last image, if
+        //  _lastStatsOK is set.
+        DebugHandler::LevelBits _statsDebug;
+        KVVulkanFramework::KVBufferHandle _statsBufferHndl;
+        uint32_t* _statsData;
+        long _statsBytes;
+        bool _statsSubgroups;
+        bool _descriptorSetSOK;
+        VkDescriptorSetLayout _setLayoutS;
+        VkDescriptorPool _descriptorPoolS;
+        VkDescriptorSet _descriptorSetS;
+        VkPipelineLayout _computePipelineLayoutS;
+        VkPipeline _computePipelineS;
+        WorkGroupStats _lastStats;
+        bool _lastStatsOK;
+        //  The image cache, most recently used image first, the most memory in bytes it can
+        //  use, and the number of images taken from it so far.
+        std::list<CachedImage> _imageCache;
+        long _imageCacheLimit;
+        long _imageCacheHits;
+        //  The bit for the 'Profile' debug level, and the times taken by the CPU tiles of the
+        //  image being computed, recorded when that level is active.
+        DebugHandler::LevelBits _profileDebug;
+        CycleProfile _cpuProfile;
+        //  The image buffers used by ComputeFrames(), one for each frame of the largest batch
+        //  so far, with their mapped addresses and their descriptor sets, which come from a
+        //  pool of their own. _frameNx and _frameNy are the image size they were sized for.
+        std::vector<KVVulkanFramework::KVBufferHandle> _frameBufferHndls;
+        std::vector<uint32_t*> _frameData;
+        std::vector<VkDescriptorSet> _frameDescriptorSets;
+        VkDescriptorPool _descriptorPoolF;
+        int _frameNx;
+        int _frameNy;
+        //  The bands of rows of the image being computed by ComputeChunked(), with the shader
+        //  arguments for each, which the dispatches point to, and the index of the next band to
+        //  run. _cancelFlag is set by CancelImage() to have the bands not yet run dropped.
+        std::vector<KVVulkanFramework::KVDispatch> _chunks;
+        std::vector<MandelArgs> _chunkArgs;
+        int _nextChunk;
+        KVVulkanFramework::KVCancelFlag _cancelFlag;
 };
 
 #endif
@@ -184,5 +598,7 @@ class MandelComputeHandler
     o   On GPUs that only support single precision, a shader that uses 'double' will not
         load. A single precision shader can just ignore the double quantities at the end
         of the MandelArgs structure - that's why they're at the end. The single int called
-        padding is just to get the alignment right for those final doubles.
+        checks, which says whether the interior checks are to be used, also gets the
+        alignment right for those final doubles. It and the low parts used by the
+        float-float shader come before them, so they are seen by every shader.
 */
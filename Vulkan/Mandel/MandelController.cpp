@@ -36,12 +36,175 @@
 //                  maximum iterations will not be changed after initially being set in the
 //                  Initialise() call, and the controller handles changes to centre and
 //                  magnification in response to cursor and key events. KS.
+//     15 Oct 2026. When not zooming, images computed using the CPU are now drawn a pass at a
+//                  time, coarse to fine, using ComputeInCProgressive(), so a slow image doesn't
+//                  freeze the display. Draw() keeps asking for a redraw until it's complete. KS.
+//                  Dragging the image now moves its centre using MoveCentre(). KS.
+//                  Beyond the magnifications double precision can handle, images are now
+//                  computed on the GPU using ComputePerturbed(). Zooming, dragging and 'j' now
+//                  move the centre by an offset, so it keeps its full precision. KS.
+//                  On GPUs without double precision, auto mode now uses the float-float
+//                  ComputeFloatFloat() before falling back on the CPU, as does GPU mode. KS.
+//                  Added the 'b' key, to toggle the interior checks. KS.
+//                  Added the 'q' key, to toggle the GPU tile queue. Zoom timings now say
+//                  whether GPU images used it. KS.
+//                  Where auto mode used GPU double precision or float-float, it now shares
+//                  each image between the GPU and the CPU, using ComputeHybrid(). The 'y' key
+//                  toggles this. Added USE_HYBRID and its zoom counts. KS.
+//                  When zooming, the GPU now computes the next image while the current one is
+//                  being drawn, using StartGPUImage(). Added SelectMode(), GPUPrecisionFor()
+//                  and the 'u' key, which toggles this. KS.
+//                  Added the 'k' key, to toggle the compute handler's image cache. When it's
+//                  in use, a timed zoom now retraces its way in on the way out, so it can
+//                  reuse the cached images, and reports how many it used. KS.
+//                  Perturbation images are now also computed ahead when zooming. KS.
+//                  Added the 'n' key, which toggles an automatic iteration limit, set by
+//                  AdjustIterations() from the histogram of the last image drawn. KS.
+//                  Added the 'v' key, which toggles an interactive mode, where images are
+//                  computed at reduced resolution while the user drags or scrolls, chosen by
+//                  InteractiveScale() to keep up with the display, and at full resolution once
+//                  the input has been idle for a moment. KS.
+//                  Added the 'f' key, which runs a benchmark along a zoom path read from a
+//                  file, with a fixed number of frames, writing the timings and compute mode
+//                  for each frame to a CSV file. KS.
+//                  Image data from the compute handler is now uint32_t. KS.
+//                  Added the '.' key, which switches the renderer between drawing the image
+//                  as a single quad and as a triangle strip. KS.
+//                  If the compute handler and renderer share a device, the renderer now draws
+//                  the image straight from the compute handler's buffer, so the image doesn't
+//                  have to be copied by the CPU. KS.
+//                  The render times and frame intervals in a zoom, and the input to present
+//                  latencies, are now collected in MsecStats, and reported as distributions
+//                  rather than just averages. KS.
+//                  The latency from each drag or scroll to the drawing of the first image that
+//                  reflects it is now measured, and the ',' key reports statistics on it. KS.
+//                  The view coordinates of a Mandelbrot path are now converted into arrays
+//                  allocated along with the path, rather than ones allocated for each redraw. KS.
+//                  When zooming with the CPU, the next image is now started ahead by the
+//                  compute handler's StartCPUImage(), as it already was for the GPU, so the
+//                  CPU computes each image while the one before is coloured and presented. KS.
+//                  Added the '/' key, which starts and stops the renderer capturing each
+//                  frame drawn to a file, for making videos. KS.
+//                  Added the '=' key, which toggles a mode where the image size follows the
+//                  size of the view, so each pixel computed is one pixel displayed. KS.
+//                  The renderer is now passed the timeline semaphore values to wait for
+//                  before reading the image from the compute handler's buffer, in case it
+//                  was computed on a separate compute queue. KS.
+//                  Added the ';' key, which toggles the compute handler's subdivision of
+//                  uniform areas. GPU images aren't computed ahead while it's enabled. KS.
+//                  Draw() now passes the renderer the changes to the image from the compute
+//                  handler's GetImageChanges(), so a dragged image only has the strips that
+//                  came into view gone through for its histogram. KS.
+//                  The image computed for each memory is now kept on disk by a MemoryCache,
+//                  and when a memory is recalled, any cached image for it is drawn at once.
+//                  It stays on display until the real image has been computed - for the CPU,
+//                  the passes of the progressive image aren't drawn. KS.
+//                  Added the '-' key, which toggles adaptive quality, where AdaptQuality()
+//                  steps the image size, the iteration limit and the precision tier used while
+//                  the view is moving up and down, to keep the frame time near a target. KS.
+//                  Where single precision isn't enough for the whole image, but is for parts
+//                  of it, or float-float is, the GPU now uses ComputeMixed(), which computes
+//                  each tile of the image in the cheapest precision that will do for it,
+//                  rather than using the slowest one for the whole image. Added USE_GPU_MIXED,
+//                  MixedPays() and the mixed precision zoom counts. KS.
+//                  Added the '[' key, which toggles the renderer's stable colour mode, where
+//                  the GPU colours each image from a histogram smoothed over the frames. KS.
+//                  A benchmark run now counts the CPU hardware events for each frame the CPU
+//                  computes, using PerfCounters where the system allows it, and adds the
+//                  instructions per cycle and the misses for each pixel to the CSV file. KS.
+//                  When not zooming, a GPU image expected to take longer than C_ChunkedMsec is
+//                  now computed by ComputeChunked(), a few bands of rows each frame, and a drag
+//                  or scroll has NoteInput() cancel the bands still to run, so a slow image no
+//                  longer holds up the response to the input. Added _ChunkedMsec. KS.
+//                  The route arrays are now freed by the destructor. If the renderer can work
+//                  out a Mandelbrot path on the GPU, SetRoute() now just records its start,
+//                  and Draw() has the renderer write the path straight into the overlay. KS.
+//                  _ChunkedMsec is now reset when a chunked image is cancelled or a new one
+//                  started, so it no longer includes the time for bands of an abandoned image. KS.
 
 #include "MandelController.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cctype>
+#include <cstdlib>
 
-MandelController::MandelController (void)
+//  The range of iteration limits AdjustIterations() can set. It raises the limit by a factor
+//  C_AutoIterRaise if more than a fraction C_AutoIterNear of the pixels only escaped in the
+//  top part of the range, above a fraction C_AutoIterTop of the limit. The lowest limit it
+//  will set is C_AutoIterMin multiplied by one more than the log of the magnification.
+
+static const int C_AutoIterMin = 64;
+static const int C_AutoIterMax = 65536;
+static const double C_AutoIterRaise = 1.5;
+static const double C_AutoIterNear = 0.001;
+static const double C_AutoIterTop = 0.875;
+
+//  In interactive mode, the image size is reduced by up to a factor C_InteractiveMaxScale in
+//  each dimension, to bring the compute time below C_InteractiveMsec, until there has been no
+//  drag or scroll input for C_InteractiveIdleMsec.
+
+static const int C_InteractiveMaxScale = 8;
+static const float C_InteractiveMsec = 16.0;
+static const float C_InteractiveIdleMsec = 250.0;
+
+//  When not zooming, a GPU image expected to take longer than C_ChunkedMsec is computed a few
+//  bands of rows at a time, each frame, so input is still handled while it builds up.
+
+static const float C_ChunkedMsec = 100.0;
+
+//  With adaptive quality, while the view is moving, AdaptQuality() aims to keep the frame time
+//  close to C_AdaptTargetMsec by stepping through the levels in C_AdaptSteps, each cheaper than
+//  the last. It moves to a cheaper level if the average frame time is above the target by a
+//  factor C_AdaptHigh, and back to the level before if the time that would take, estimated
+//  using AdaptCost(), is below the target by a factor C_AdaptLow. After a change, it waits for
+//  C_AdaptSettleFrames frames before changing again. A level halves the iteration limit
+//  IterShift times, but never below C_AdaptMinIter, and drops PrecisionSteps precision tiers -
+//  see AdaptMode().
+
+static const float C_AdaptTargetMsec = 16.6f;
+static const float C_AdaptHigh = 1.1f;
+static const float C_AdaptLow = 0.8f;
+static const int C_AdaptSettleFrames = 6;
+static const int C_AdaptMinIter = 64;
+
+struct AdaptStep {
+    int Scale;
+    int IterShift;
+    int PrecisionSteps;
+};
+static const AdaptStep C_AdaptSteps[] = {
+    {1,0,0},{2,0,0},{2,1,0},{4,1,0},{4,1,1},{4,2,1},{8,2,1},{8,2,2},{8,3,2}
+};
+static const int C_AdaptMaxLevel = int(sizeof(C_AdaptSteps) / sizeof(C_AdaptSteps[0])) - 1;
+
+//  AdaptCost() is a rough estimate of the time for a frame at a given adaptive quality level, as
+//  a fraction of the time at full quality, taking the time as proportional to the number of
+//  pixels and to the iteration limit, and as doubling with each precision tier.
+
+static float AdaptCost (int Level)
+{
+    const AdaptStep& Step = C_AdaptSteps[Level];
+    return 1.0f / float((Step.Scale * Step.Scale) << (Step.IterShift + Step.PrecisionSteps));
+}
+
+//  A benchmark run draws C_BenchFrames frames along the zoom path read from C_BenchPathFile,
+//  writing the timings to C_BenchCsvFile.
+
+static const int C_BenchFrames = 600;
+static const char* const C_BenchPathFile = "MandelPath.txt";
+static const char* const C_BenchCsvFile = "MandelBench.csv";
+
+//  The '/' key captures the frames drawn to files whose names start with C_CapturePrefix.
+
+static const char* const C_CapturePrefix = "MandelFrame";
+
+//  The images computed for the memories are cached in files whose names start with
+//  C_MemoryCachePrefix.
+
+static const char* const C_MemoryCachePrefix = "MandelMemory";
+
+MandelController::MandelController (void) : _MemoryCache(C_MemoryCachePrefix)
 {
     //  Set the instance variables to default values.
     
@@ -60,21 +223,65 @@ MandelController::MandelController (void)
     _ZoomFramesCPU = 0;
     _ZoomFramesGPU = 0;
     _ZoomFramesGPU_D = 0.0;
+    _ZoomFramesGPU_P = 0;
+    _ZoomFramesGPU_FF = 0;
+    _ZoomFramesHybrid = 0;
+    _ZoomFramesMixed = 0;
     _LastZoomMsec = 0.0;
     _TotalComputeMsecCPU = 0.0;
     _TotalComputeMsecGPU = 0.0;
     _TotalComputeMsecGPU_D = 0.0;
-    _TotalRenderMsec = 0.0;
+    _TotalComputeMsecGPU_P = 0.0;
+    _TotalComputeMsecGPU_FF = 0.0;
+    _TotalComputeMsecHybrid = 0.0;
+    _TotalComputeMsecMixed = 0.0;
     _ComputeMode = AUTO_MODE;
     _GPUSupportsDouble = false;
     _ScaleMagByTime = true;
+    _Hybrid = true;
+    _ComputeAhead = true;
+    _ImageCacheLimit = 0;
+    _AutoIter = false;
+    _CurrentIter = 1024;
+    _Interactive = false;
+    _QuadDraw = true;
+    _StableColours = false;
+    _Capturing = false;
+    _FollowView = false;
+    _ViewResized = false;
+    _SharedDevice = false;
+    _InputPending = false;
+    _ImageNx = 1024;
+    _ImageNy = 1024;
+    _ImageScale = 1;
+    _FullResMsec = 0.0;
+    _ChunkedMsec = -1.0;
+    _ComputedMagnification = 0.0;
+    _ZoomCacheHits = 0;
+    _BenchFrame = 0;
+    _BenchFile = nullptr;
+    _BenchTotalMsec = 0.0;
+    _BenchCacheLimit = 0;
     _RouteX = nullptr;
     _RouteY = nullptr;
+    _RouteAtX = nullptr;
+    _RouteAtY = nullptr;
     _RouteN = 0;
+    _RouteX0 = 0.0;
+    _RouteY0 = 0.0;
     _InDrag = false;
-    _DragImageX = 0.0;
-    _DragImageY = 0.0;
+    _DragFrameX = 0.0;
+    _DragFrameY = 0.0;
     _Drawing = false;
+    _MemoryRecalled = -1;
+    _MemoryCached = false;
+    _MemoryShown = false;
+    _AdaptQuality = false;
+    _Adapting = false;
+    _AdaptReduced = false;
+    _AdaptLevel = 0;
+    _AdaptFrames = 0;
+    _AdaptMsec = 0.0;
     SetMemoriesToDefault();
 }
 
@@ -85,6 +292,7 @@ void MandelController::Initialise(MandelComputeDevice* ComputeDevice,
     //  Create the compute handler and renderer, and initialise them.
     
     _View = View;
+    _SharedDevice = ((void*)ComputeDevice == (void*)RendererDevice);
     _ComputeHandler = new MandelComputeHandler(ComputeDevice);
     _Renderer = new Renderer(RendererDevice);
     if (_ComputeHandler) {
@@ -103,10 +311,13 @@ void MandelController::Initialise(MandelComputeDevice* ComputeDevice,
     
     _RouteX = (double*) malloc(Iter * sizeof(double));
     _RouteY = (double*) malloc(Iter * sizeof(double));
+    _RouteAtX = (float*) malloc(Iter * sizeof(float));
+    _RouteAtY = (float*) malloc(Iter * sizeof(float));
     
     //  Set the default image size and iteration count to the passed values.
     
     _Iter = Iter;
+    _CurrentIter = Iter;
     _BaseNx = Nx;
     _BaseNy = Ny;
     SetImageSize(Nx,Ny);
@@ -116,8 +327,13 @@ void MandelController::Initialise(MandelComputeDevice* ComputeDevice,
 
 MandelController::~MandelController()
 {
+    if (_BenchFile) fclose(_BenchFile);
     if (_Renderer) delete(_Renderer);
     if (_ComputeHandler) delete(_ComputeHandler);
+    if (_RouteX) free(_RouteX);
+    if (_RouteY) free(_RouteY);
+    if (_RouteAtX) free(_RouteAtX);
+    if (_RouteAtY) free(_RouteAtY);
 }
 
 //  Introduce the controller to its request handler.
@@ -130,10 +346,67 @@ void MandelController::SetAppContact (MandelAppContact* Contact)
 //  Set the image size to be used by the compute handler, and notify the renderer.
 void MandelController::SetImageSize(int Nx, int Ny)
 {
+    _ImageNx = Nx;
+    _ImageNy = Ny;
+    _ImageScale = 1;
+    _ComputedMagnification = 0.0;
+    if (_ComputeHandler) _ComputeHandler->SetImageSize(Nx,Ny);
+    if (_Renderer) _Renderer->SetImageSize(Nx,Ny);
+}
+
+//  Have the compute handler work at the image size reduced by a factor Scale in each dimension.
+//  The renderer stretches whatever size of image it is given to fill the view, so it just needs
+//  to know the new size.
+void MandelController::SetImageScale(int Scale)
+{
+    _ImageScale = Scale;
+    int Nx = std::max(_ImageNx / Scale,16);
+    int Ny = std::max(_ImageNy / Scale,16);
     if (_ComputeHandler) _ComputeHandler->SetImageSize(Nx,Ny);
     if (_Renderer) _Renderer->SetImageSize(Nx,Ny);
 }
 
+//  InteractiveScale() returns the smallest factor by which reducing the image size in each
+//  dimension should bring the compute time within the target frame time, using the estimated
+//  time for a full resolution image.
+int MandelController::InteractiveScale()
+{
+    int Scale = 1;
+    while (Scale < C_InteractiveMaxScale &&
+                           _FullResMsec > C_InteractiveMsec * float(Scale * Scale)) Scale *= 2;
+    return Scale;
+}
+
+//  NoteInput() is called for each drag or scroll. It restarts the timer used to tell when the
+//  input has gone idle and, unless an earlier input is still waiting to be drawn, starts the
+//  timer for the latency from this input to the first image drawn after it - see Draw(). The
+//  view has changed, so any image the compute handler is part way through computing with
+//  ComputeChunked() is cancelled, and the time taken for it so far is no longer a guide.
+void MandelController::NoteInput()
+{
+    _ComputeHandler->CancelImage();
+    _ChunkedMsec = -1.0;
+    _InputTimer.Restart();
+    if (!_InputPending) {
+        _LatencyTimer.Restart();
+        _InputPending = true;
+    }
+}
+
+//  ReportLatency() outputs statistics on the latencies from drags or scrolls to the images that
+//  reflect them being drawn, collected since the last time it was called. The latency ends when
+//  the renderer has handed the frame to be presented, so how long it then waits for the display
+//  depends on the presentation mode and the number of swap chain images.
+void MandelController::ReportLatency()
+{
+    if (_LatencyStats.Count() == 0) {
+        printf ("No input to present latencies recorded since the last report\n");
+        return;
+    }
+    _LatencyStats.Report("Input to present latency");
+    _LatencyStats.Clear();
+}
+
 //  This specifies the dimensions of the view. The renderer needs to know these.
 //  The compute handler does not need to know the actual dimensions, but it does need
 //  to know the aspect ratio that will be used to display the image. This will be called
@@ -144,16 +417,32 @@ void MandelController::SetViewSize(double Width, double Height)
     _FrameY = float(Height);
     if (_ComputeHandler) _ComputeHandler->SetAspect(Width,Height);
     if (_Renderer) _Renderer->SetDrawableSize(float(Width),float(Height));
+    _ViewResized = true;
     _NeedToRedraw = true;
 }
 
+//  If the image size is to follow the view, set it to the view size. This is called by Draw(),
+//  rather than by SetViewSize(), so a run of resizes while a window is dragged to a new size
+//  only changes the image size once for each frame. Most changes cost very little, since the
+//  compute handler and renderer only reallocate their buffers when they need to grow.
+void MandelController::FollowViewSize()
+{
+    if (_FollowView && _ViewResized) {
+        int Nx = std::max(int(_FrameX),16);
+        int Ny = std::max(int(_FrameY),16);
+        if (Nx != _ImageNx || Ny != _ImageNy) SetImageSize(Nx,Ny);
+    }
+    _ViewResized = false;
+}
+
 //  Called whenever the scroll wheel has been moved.
 void MandelController::ScrollWheel (float DeltaX, float DeltaY, float AtX, float AtY)
 {
+    if (_ZoomMode == ZOOM_PATH) return;
     if (_ComputeHandler && DeltaY != 0.0) {
-        double XCoord = 0.0;
-        double YCoord = 0.0;
-        FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
+        double XOffset = 0.0;
+        double YOffset = 0.0;
+        FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
         double Magnification = _ComputeHandler->GetMagnification();
         double NewMagnification = Magnification;
         if (DeltaY > 0.0) NewMagnification = Magnification * (1.0 + 0.01 * DeltaY);
@@ -162,24 +451,16 @@ void MandelController::ScrollWheel (float DeltaX, float DeltaY, float AtX, float
         _ComputeHandler->SetMagnification(Magnification);
         RedisplayTitle();
         
-        //  With the new magnification, this reworks the calculation done
-        //  by frameToImageCoord to work out what new center coordinates
-        //  will keep the point currently under the cursor at the same
-        //  point in screen coordinates.
+        //  With the new magnification, the point under the cursor is at a different offset
+        //  from the centre. Moving the centre by the difference puts it back under the
+        //  cursor. (Working with offsets, rather than with the coordinates themselves, keeps
+        //  the full precision of the centre at high magnifications.)
         
-        double CoordRangeInX = 2.0;
-        double FrameWidth = _FrameX;
-        double DistFromFrameCentX = FrameWidth * 0.5 - AtX;
-        double XCoordFromCent =
-             DistFromFrameCentX * CoordRangeInX / (FrameWidth * Magnification);
-        double xCent = XCoord + XCoordFromCent;
-        double FrameHeight = _FrameY;
-        double CoordRangeInY = 2.0 * FrameHeight / FrameWidth;
-        double DistFromFrameCentY = FrameHeight * 0.5 - AtY;
-        double YCoordFromCent =
-             DistFromFrameCentY * CoordRangeInY / (FrameHeight * Magnification);
-        double yCent = YCoord + YCoordFromCent;
-        _ComputeHandler->SetCentre(xCent,yCent);
+        double NewXOffset = 0.0;
+        double NewYOffset = 0.0;
+        FrameToImageOffset(AtX,AtY,&NewXOffset,&NewYOffset);
+        _ComputeHandler->OffsetCentre(XOffset - NewXOffset,YOffset - NewYOffset);
+        NoteInput();
         _NeedToRedraw = true;
     }
 }
@@ -203,6 +484,18 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
     
     if (*Key == 'h') PrintHelp();
     
+    //  A benchmark run has to follow its path undisturbed, so 'f', which cancels it, is the
+    //  only other key that has any effect while one is in progress.
+    
+    if (_ZoomMode == ZOOM_PATH) {
+        if (*Key == 'f') EndBenchmark(false);
+        return;
+    }
+    
+    //  Start a benchmark run.
+    
+    if (*Key == 'f' && _ComputeHandler) StartBenchmark();
+    
     if (_ComputeHandler) {
         double Magnification = _ComputeHandler->GetMagnification();
         
@@ -248,10 +541,10 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
         //  Center the image on the point under the cursor.
         
         if (*Key == 'j') {
-            double XCoord = 0.0;
-            double YCoord = 0.0;
-            FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
-            _ComputeHandler->SetCentre(XCoord,YCoord);
+            double XOffset = 0.0;
+            double YOffset = 0.0;
+            FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
+            _ComputeHandler->OffsetCentre(XOffset,YOffset);
             _NeedToRedraw = true;
         }
         
@@ -277,37 +570,62 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
                 _ZoomMode = ZOOM_NONE;
                 float Msec = _ZoomTimer.ElapsedMsec();
                 printf ("Zoom mode cancelled, frame rate = %.2f frames/sec\n",
-                        float(_ZoomFramesCPU + _ZoomFramesGPU_D + _ZoomFramesGPU) * 1000.0 /Msec);
+                        float(_ZoomFramesCPU + _ZoomFramesGPU_D + _ZoomFramesGPU +
+                                   _ZoomFramesGPU_P + _ZoomFramesGPU_FF +
+                                   _ZoomFramesHybrid + _ZoomFramesMixed) * 1000.0 /Msec);
             } else {
                 _ZoomMode = ZOOM_TIMED;
                 _ZoomTimer.Restart();
+                _ZoomPath.clear();
+                _ZoomCacheHits = _ComputeHandler->GetImageCacheHits();
                 _ZoomFramesCPU = 0;
                 _ZoomFramesGPU = 0;
                 _ZoomFramesGPU_D = 0;
+                _ZoomFramesGPU_P = 0;
+                _ZoomFramesGPU_FF = 0;
+                _ZoomFramesHybrid = 0;
+                _ZoomFramesMixed = 0;
                 _TotalComputeMsecCPU = 0.0;
                 _TotalComputeMsecGPU = 0.0;
                 _TotalComputeMsecGPU_D = 0.0;
-                _TotalRenderMsec = 0.0;
+                _TotalComputeMsecGPU_P = 0.0;
+                _TotalComputeMsecGPU_FF = 0.0;
+                _TotalComputeMsecHybrid = 0.0;
+                _TotalComputeMsecMixed = 0.0;
+                _RenderStats.Clear();
+                _FrameStats.Clear();
                 _NeedToRedraw = true;
             }
         }
         if (*Key == 'i' || *Key == 'o') {
             if (_ZoomMode == ZOOM_NONE || _ZoomMode == ZOOM_TIMED) {
                 _ZoomTimer.Restart();
+                _ZoomCacheHits = _ComputeHandler->GetImageCacheHits();
                 _ZoomFramesCPU = 0;
                 _ZoomFramesGPU = 0;
                 _ZoomFramesGPU_D = 0;
+                _ZoomFramesGPU_P = 0;
+                _ZoomFramesGPU_FF = 0;
+                _ZoomFramesHybrid = 0;
+                _ZoomFramesMixed = 0;
                 _TotalComputeMsecCPU = 0.0;
                 _TotalComputeMsecGPU = 0.0;
                 _TotalComputeMsecGPU_D = 0.0;
-                _TotalRenderMsec = 0.0;
+                _TotalComputeMsecGPU_P = 0.0;
+                _TotalComputeMsecGPU_FF = 0.0;
+                _TotalComputeMsecHybrid = 0.0;
+                _TotalComputeMsecMixed = 0.0;
+                _RenderStats.Clear();
+                _FrameStats.Clear();
                 _NeedToRedraw = true;
             }
             if (*Key == 'i') _ZoomMode = ZOOM_IN;
             else _ZoomMode = ZOOM_OUT;
         }
         
-        //  Use a memory setting ('0'..'9')
+        //  Use a memory setting ('0'..'9'). If the image for it is in the cache, it is drawn
+        //  straight away by the next Draw(), and the one after starts computing it afresh.
+        //  (Only at full resolution - the cached images are all full size.)
         
         int NKey = *Key - '0';
         if (NKey >= 0 && NKey <= 9) {
@@ -316,17 +634,41 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
             double Magnification = _Memories[NKey].Magnification;
             _ComputeHandler->SetCentre(XCent,YCent);
             _ComputeHandler->SetMagnification(Magnification);
+            _MemoryRecalled = NKey;
+            _MemoryShown = false;
+            _MemoryImage.clear();
+            _MemoryCached = (_ImageScale == 1 &&
+                               _MemoryCache.Load(NKey,MemoryDetails(NKey),_MemoryImage));
             RedisplayTitle();
             _NeedToRedraw = true;
         }
         
         //  Allows the image size to be changed, showing the effect on resolution.
         
+        //  Any of these stops the image size following the view size.
+        
+        if (*Key == 'l' || *Key == 'm' || *Key == 's' || *Key == 't') _FollowView = false;
         if (*Key == 'l') { SetImageSize(_BaseNx * 2,_BaseNy * 2); _NeedToRedraw = true; }
         if (*Key == 'm') { SetImageSize(_BaseNx,_BaseNy); _NeedToRedraw = true; }
         if (*Key == 's') { SetImageSize(_BaseNx / 2,_BaseNy / 2); _NeedToRedraw = true; }
         if (*Key == 't') { SetImageSize(_BaseNx / 4,_BaseNy / 4); _NeedToRedraw = true; }
         
+        //  Toggle having the image size follow the view size, so the number of pixels computed
+        //  matches the number displayed, instead of stretching an image of fixed size.
+        
+        if (*Key == '=') {
+            _FollowView = !_FollowView;
+            if (_FollowView) {
+                _ViewResized = true;
+                FollowViewSize();
+                printf ("Image size now follows the view, %d by %d\n",_ImageNx,_ImageNy);
+            } else {
+                SetImageSize(_BaseNx,_BaseNy);
+                printf ("Image size now fixed at %d by %d\n",_ImageNx,_ImageNy);
+            }
+            _NeedToRedraw = true;
+        }
+        
         //  Enable or disable the weighting of the magnification during zoom to compensate
         //  for the time for the computation.
         
@@ -337,14 +679,147 @@ void MandelController::KeyDown (const char* Key, long Flags, float AtX, float At
             else printf ("disabled\n");
         }
         
+        //  Toggle the checks that save iterating points inside the set, for benchmarking.
+        
+        if (*Key == 'b') {
+            bool Checks = !_ComputeHandler->GetInteriorChecks();
+            _ComputeHandler->SetInteriorChecks(Checks);
+            printf ("Cardioid, bulb and periodicity checks %s\n",Checks ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle the automatic iteration limit. When it's turned off, the limit goes back to
+        //  the one the program started with.
+        
+        if (*Key == 'n') {
+            _AutoIter = !_AutoIter;
+            if (!_AutoIter) SetIterations(_Iter);
+            printf ("Automatic iteration limit %s\n",_AutoIter ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle interactive mode. When it's turned off, any reduced image goes back to full
+        //  resolution.
+        
+        if (*Key == 'v') {
+            _Interactive = !_Interactive;
+            printf ("Reduced resolution while dragging or scrolling %s\n",
+                                                     _Interactive ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle adaptive quality. When it's turned off, the image goes back to full quality.
+        
+        if (*Key == '-') {
+            _AdaptQuality = !_AdaptQuality;
+            _AdaptLevel = 0;
+            _AdaptFrames = 0;
+            if (_AdaptQuality) {
+                printf ("Adaptive quality enabled, aiming for %.1f msec frames while moving\n",
+                                                                         C_AdaptTargetMsec);
+            } else {
+                printf ("Adaptive quality disabled\n");
+            }
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle between drawing the image as a single quad and as a triangle strip.
+        
+        if (*Key == '.' && _Renderer) {
+            _QuadDraw = !_QuadDraw;
+            bool Quad = _Renderer->SetQuadDraw(_QuadDraw);
+            printf ("Image drawn as %s\n",Quad ? "a single quad" : "a triangle strip");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle the stable colour mode, where the colours come from a histogram smoothed
+        //  over the frames of a zoom rather than from that of each image alone.
+        
+        if (*Key == '[' && _Renderer) {
+            _StableColours = !_StableColours;
+            bool Stable = _Renderer->SetStableColours(_StableColours);
+            if (_StableColours && !Stable) {
+                printf ("Stable colours need the GPU to colour the image\n");
+            } else {
+                printf ("Stable colours %s\n",Stable ? "enabled" : "disabled");
+            }
+            _NeedToRedraw = true;
+        }
+        
+        //  Report the input to present latency statistics.
+        
+        if (*Key == ',') ReportLatency();
+        
+        //  Start or stop capturing the frames drawn to files. Drawing isn't held up to do this,
+        //  so if the files can't be written quickly enough some frames are dropped.
+        
+        if (*Key == '/' && _Renderer) {
+            if (_Capturing) {
+                int Frames = 0;
+                int Dropped = 0;
+                _Renderer->StopCapture(&Frames,&Dropped);
+                _Capturing = false;
+                printf ("Frame capture stopped, %d frames written to %s_*.ppm, %d dropped\n",
+                                                               Frames,C_CapturePrefix,Dropped);
+            } else if (_Renderer->StartCapture(C_CapturePrefix)) {
+                _Capturing = true;
+                printf ("Capturing frames to %s_*.ppm\n",C_CapturePrefix);
+            } else {
+                printf ("Frame capture is not supported\n");
+            }
+        }
+        
+        //  Toggle the sharing of images between the GPU and CPU in auto mode.
+        
+        if (*Key == 'y') {
+            _Hybrid = !_Hybrid;
+            printf ("Sharing of images between GPU and CPU %s\n",_Hybrid ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle the computing of the next zoom image while the current one is drawn.
+        
+        if (*Key == 'u') {
+            _ComputeAhead = !_ComputeAhead;
+            printf ("Computing zoom images ahead %s\n",
+                                                     _ComputeAhead ? "enabled" : "disabled");
+        }
+        
+        //  Toggle the image cache. Its limit is kept while it's disabled, so it can be restored.
+        
+        if (*Key == 'k') {
+            long Limit = _ComputeHandler->GetImageCacheLimit();
+            _ComputeHandler->SetImageCacheLimit(_ImageCacheLimit);
+            _ImageCacheLimit = Limit;
+            printf ("Image cache %s\n",Limit == 0 ? "enabled" : "disabled");
+        }
+        
+        //  Toggle the GPU tile queue, also for benchmarking - compare 'z' timings with it
+        //  enabled and disabled.
+        
+        if (*Key == 'q') {
+            bool Queue = !_ComputeHandler->GetTileQueue();
+            _ComputeHandler->SetTileQueue(Queue);
+            printf ("GPU tile queue %s\n",Queue ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
+        //  Toggle the skipping of uniform areas of the image, on both the GPU and the CPU.
+        
+        if (*Key == ';') {
+            bool Subdivide = !_ComputeHandler->GetSubdivide();
+            _ComputeHandler->SetSubdivide(Subdivide);
+            printf ("Subdivision of uniform areas %s\n",Subdivide ? "enabled" : "disabled");
+            _NeedToRedraw = true;
+        }
+        
         //  Calculate the track of a Mandelbrot calculation from the point under the cursor.
         
         if (*Key == 'd') {
             double XCoord = 0.0;
             double YCoord = 0.0;
             FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
-            int NPosns = CalcRoute(XCoord,YCoord,_RouteX,_RouteY,_Iter);
-            _RouteN = NPosns;
+            SetRoute(XCoord,YCoord);
             _NeedToRedraw = true;
         }
     }
@@ -367,6 +842,20 @@ int MandelController::CalcRoute (double X0,double Y0,double* XPosns,double* YPos
     return Iter;
 }
 
+//  SetRoute() sets the Mandelbrot path from (X0,Y0) as the one to be drawn. If the renderer
+//  can work out the path on the GPU when it draws it, only the starting point is needed.
+
+void MandelController::SetRoute (double X0,double Y0)
+{
+    _RouteX0 = X0;
+    _RouteY0 = Y0;
+    if (_Renderer && _Renderer->OverlayOrbitOnGPU()) {
+        _RouteN = _Iter;
+    } else {
+        _RouteN = CalcRoute(X0,Y0,_RouteX,_RouteY,_Iter);
+    }
+}
+
 //  Called whenever the user releases a key on the keyboard.
 void MandelController::KeyUp (const char* Key, long Flags, float AtX, float AtY)
 {
@@ -377,21 +866,36 @@ void MandelController::KeyUp (const char* Key, long Flags, float AtX, float AtY)
         //  The only key releases we care about are the 'i' and 'o' keys, which
         //  cancel the zoom in/out modes.
         
-        if (*Key == 'i' || *Key == 'o') {
+        if ((*Key == 'i' || *Key == 'o') && _ZoomMode != ZOOM_PATH) {
             _ZoomMode = ZOOM_NONE;
             float Msec = _ZoomTimer.ElapsedMsec();
-            int ZoomFrames = _ZoomFramesGPU + + _ZoomFramesGPU_D + _ZoomFramesCPU;
+            int ZoomFrames = _ZoomFramesGPU + + _ZoomFramesGPU_D + _ZoomFramesGPU_P +
+                                                       _ZoomFramesGPU_FF + _ZoomFramesHybrid +
+                                                     _ZoomFramesMixed + _ZoomFramesCPU;
             printf ("Frame rate = %.2f frames/sec\n",float(ZoomFrames) * 1000.0 /Msec);
             printf ("Average compute time:");
-            if (_ZoomFramesGPU > 0) printf (" %.2f msec (GPU)",
-                                            _TotalComputeMsecGPU / float(_ZoomFramesGPU));
+            if (_ZoomFramesGPU > 0) printf (" %.2f msec (GPU%s%s)",
+                                            _TotalComputeMsecGPU / float(_ZoomFramesGPU),
+                                   _ComputeHandler->GetTileQueue() ? ", tile queue" : "",
+                                   _ComputeHandler->GetSubdivide() ? ", subdivided" : "");
             if (_ZoomFramesGPU_D > 0) printf (" %.2f msec (GPU-D)",
                                             _TotalComputeMsecGPU_D / float(_ZoomFramesGPU_D));
+            if (_ZoomFramesGPU_P > 0) printf (" %.2f msec (GPU-P)",
+                                            _TotalComputeMsecGPU_P / float(_ZoomFramesGPU_P));
+            if (_ZoomFramesGPU_FF > 0) printf (" %.2f msec (GPU-FF)",
+                                            _TotalComputeMsecGPU_FF / float(_ZoomFramesGPU_FF));
+            if (_ZoomFramesHybrid > 0) printf (" %.2f msec (GPU+CPU)",
+                                            _TotalComputeMsecHybrid / float(_ZoomFramesHybrid));
+            if (_ZoomFramesMixed > 0) printf (" %.2f msec (GPU-M)",
+                                            _TotalComputeMsecMixed / float(_ZoomFramesMixed));
             if (_ZoomFramesCPU > 0) printf (" %.2f msec (CPU)",
                                             _TotalComputeMsecCPU / float(_ZoomFramesCPU));
             printf ("\n");
-            if (ZoomFrames > 0) printf ("Average render time: %.2f msec\n",
-                                                    _TotalRenderMsec / float(ZoomFrames));
+            if (ZoomFrames > 0) {
+                printf ("Average render time: %.2f msec\n",_RenderStats.Mean());
+                _RenderStats.Report("Render time");
+                _FrameStats.Report("Frame interval");
+            }
         }
     }
 }
@@ -404,30 +908,33 @@ void MandelController::MouseMoved (float AtX, float AtY)
     if (_InDrag) {
         
         //  Calculate the image coordinate difference between the image point below the
-        //  cursor and the image point where the drag started. This is the correction to
-        //  the image center needed to reposition the image so the cursor is now above
-        //  that start point in the image.
+        //  cursor and the image point below it when it last moved. This is the correction to
+        //  the image center needed to reposition the image so the cursor is still above
+        //  the same point in the image. The centre moves by a whole number of pixels, so
+        //  the compute handler can shift the last image and only compute what comes into view.
+        //  (Working with offsets from the centre, rather than the image coordinates, keeps
+        //  the full precision of the centre at high magnifications.)
         
-        FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
-        double XOffset = _DragImageX - XCoord;
-        double YOffset = _DragImageY - YCoord;
-        double XCent,YCent;
-        _ComputeHandler->GetCentre(&XCent,&YCent);
-        _ComputeHandler->SetCentre(XCent + XOffset,YCent + YOffset);
+        double LastXOffset,LastYOffset,XOffset,YOffset;
+        FrameToImageOffset(_DragFrameX,_DragFrameY,&LastXOffset,&LastYOffset);
+        FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
+        _ComputeHandler->MoveCentre(LastXOffset - XOffset,LastYOffset - YOffset);
+        _DragFrameX = AtX;
+        _DragFrameY = AtY;
+        NoteInput();
         _NeedToRedraw = true;
     }
     if (_Drawing) {
         
         //  Calculate the Mandelbrot path from the mouse position, and set it as
-        //  the overlay arrays, _RouteX, _RouteY and _RouteN. (It's important to
+        //  the overlay, using SetRoute(). (It's important to
         //  call FrameToImageCoord() here rather than just at the start of this routine,
         //  because if we're dragging and drawing at the same time, the change in image
         //  centre will have a minor effect on the calculated position and the path is
         //  very position-sensitive - that's the whole point of the Mandelbrot set!)
         
         FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
-        int NPosns = CalcRoute(XCoord,YCoord,_RouteX,_RouteY,_Iter);
-        _RouteN = NPosns;
+        SetRoute(XCoord,YCoord);
         _NeedToRedraw = true;
     }
 }
@@ -441,13 +948,10 @@ void MandelController::MouseUp (float AtX, float AtY)
 //  Called whenever the user clicks down on the mouse with the cursor in the view.
 void MandelController::MouseDown (float AtX, float AtY)
 {
-    if (_ComputeHandler) {
-        double XCoord = 0.0;
-        double YCoord = 0.0;
-        FrameToImageCoord(AtX,AtY,&XCoord,&YCoord);
+    if (_ComputeHandler && _ZoomMode != ZOOM_PATH) {
         _InDrag = true;
-        _DragImageX = XCoord;
-        _DragImageY = YCoord;
+        _DragFrameX = AtX;
+        _DragFrameY = AtY;
     }
 }
 
@@ -481,6 +985,124 @@ void MandelController::SetMemoriesToDefault()
     SetMemory(9,0.270925,0.004725,15000.0);
 }
 
+//  MemoryDetails() returns the details that determine the image for a memory - its centre and
+//  magnification, and the current iteration limit, image size and view aspect ratio - which
+//  are what the memory cache checks its images against.
+
+MemoryCache::Details MandelController::MemoryDetails (int Memory)
+{
+    MemoryCache::Details Details;
+    Details.XCent = _Memories[Memory].XCent;
+    Details.YCent = _Memories[Memory].YCent;
+    Details.Magnification = _Memories[Memory].Magnification;
+    Details.Aspect = double(_FrameX) / double(_FrameY);
+    Details.Iter = _CurrentIter;
+    Details.Nx = _ImageNx;
+    Details.Ny = _ImageNy;
+    return Details;
+}
+
+//  AtMemory() returns true if the compute handler's centre and magnification are still those of
+//  the given memory - ie if the view hasn't been moved or zoomed since it was recalled.
+
+bool MandelController::AtMemory (int Memory)
+{
+    double XCent = 0.0,YCent = 0.0;
+    _ComputeHandler->GetCentre(&XCent,&YCent);
+    return XCent == _Memories[Memory].XCent && YCent == _Memories[Memory].YCent &&
+                    _ComputeHandler->GetMagnification() == _Memories[Memory].Magnification;
+}
+
+//  SelectMode() returns the way the image should be computed using the current settings.
+
+MandelController::UseMode MandelController::SelectMode()
+{
+    //  Use either the CPU or GPU. In auto mode, use the GPU unless floating point
+    //  rounding error at the current settings will be a problem, in which case use
+    //  double precision on the GPU if it has it, or float-float arithmetic on the GPU if
+    //  that's good enough, or the CPU. Those GPU modes are much slower than single precision,
+    //  so unless disabled, auto mode shares those images between the GPU and the CPU. Once
+    //  even double precision isn't enough, use the GPU again, but computing perturbations
+    //  from a reference orbit, both in auto mode and when the GPU has been selected. FloatOK()
+    //  and the others only say whether a precision will do for the whole image, and often a
+    //  cheaper one will do for much of it, in which case the GPU computes each part of the
+    //  image in the precision it needs - see MixedPays().
+    
+    bool FloatOK = _ComputeHandler->FloatOK();
+    bool DoubleOK = FloatOK || _ComputeHandler->DoubleOK();
+    UseMode ModeToUse = USE_NONE;
+    if (_ComputeMode == AUTO_MODE) {
+        if (FloatOK) {
+            ModeToUse = USE_GPU;
+        } else if (!DoubleOK) {
+            ModeToUse = USE_GPU_P;
+        } else if (MixedPays(_Hybrid)) {
+            ModeToUse = USE_GPU_MIXED;
+        } else {
+            if (_GPUSupportsDouble) {
+                ModeToUse = USE_GPU_D;
+            } else if (_ComputeHandler->FloatFloatOK()) {
+                ModeToUse = USE_GPU_FF;
+            } else {
+                ModeToUse = USE_CPU;
+            }
+            if (_Hybrid && ModeToUse != USE_CPU) ModeToUse = USE_HYBRID;
+        }
+    } else if (_ComputeMode == CPU_MODE) {
+        ModeToUse = USE_CPU;
+    } else {
+        ModeToUse = USE_GPU;
+        if (!DoubleOK) {
+            ModeToUse = USE_GPU_P;
+        } else if (!FloatOK) {
+            if (MixedPays(false)) {
+                ModeToUse = USE_GPU_MIXED;
+            } else {
+                ModeToUse = _GPUSupportsDouble ? USE_GPU_D : USE_GPU_FF;
+            }
+        }
+    }
+    return ModeToUse;
+}
+
+//  MixedPays() returns true if computing the image with the compute handler's ComputeMixed()
+//  should be quicker than using the one precision that would do for the whole image - if some
+//  tiles of the image can use a cheaper precision than the rest, and the GPU can compute the
+//  rest. (Without double precision on the GPU, that means none of them needing it.) If the
+//  alternative is sharing the image with the CPU, at least half the tiles need to be cheaper,
+//  as otherwise the GPU will still spend most of its time on the slow tiles, and the CPU would
+//  have taken some of those off its hands.
+
+bool MandelController::MixedPays (bool Hybrid)
+{
+    int FloatTiles = 0,FloatFloatTiles = 0,DoubleTiles = 0;
+    _ComputeHandler->CountTilePrecisions(&FloatTiles,&FloatFloatTiles,&DoubleTiles);
+    int Tiles = FloatTiles + FloatFloatTiles + DoubleTiles;
+    int CheapTiles = FloatTiles;
+    if (_GPUSupportsDouble) {
+        CheapTiles += FloatFloatTiles;
+    } else if (DoubleTiles > 0) {
+        return false;
+    }
+    if (CheapTiles == 0) return false;
+    if (Hybrid && CheapTiles * 2 < Tiles) return false;
+    return true;
+}
+
+//  GPUPrecisionFor() returns true if the given mode computes the image using the GPU alone, in
+//  which case the image can be started ahead of time, and sets the precision for that mode.
+
+bool MandelController::GPUPrecisionFor (
+                            UseMode Mode,MandelComputeHandler::GPUPrecision* Precision)
+{
+    if (Mode == USE_GPU) *Precision = MandelComputeHandler::GPU_FLOAT;
+    else if (Mode == USE_GPU_D) *Precision = MandelComputeHandler::GPU_DOUBLE;
+    else if (Mode == USE_GPU_FF) *Precision = MandelComputeHandler::GPU_FLOAT_FLOAT;
+    else if (Mode == USE_GPU_P) *Precision = MandelComputeHandler::GPU_PERTURBED;
+    else return false;
+    return true;
+}
+
 //  Invoked when the view needs to be drawn or redrawn. This will be called first as soon
 //  as the program starts up and the window and view are created. Then it will be called
 //  at whatever frame rate the program has set - usually 60 frames/sec. It is possible to
@@ -491,48 +1113,154 @@ void MandelController::Draw()
 {
     //  Most of the time, there's nothing that needs doing. If anything has changed that
     //  will have an effect on the image (zooming, changing image center, for example),
-    //  _NeedToRedraw should have been set.
+    //  _NeedToRedraw should have been set. In interactive mode, an image computed at reduced
+    //  resolution while the user was dragging or scrolling has to be replaced by one at full
+    //  resolution once the input has been idle for a while. So does one computed at reduced
+    //  quality by adaptive quality, once the view has stopped moving.
+    
+    FollowViewSize();
+    
+    bool Idle = _InputTimer.ElapsedMsec() > C_InteractiveIdleMsec;
+    bool Moving = !Idle || _ZoomMode == ZOOM_IN || _ZoomMode == ZOOM_OUT ||
+                                                                    _ZoomMode == ZOOM_TIMED;
+    if (_ImageScale > 1 && (Idle || !(_Interactive || _AdaptQuality))) _NeedToRedraw = true;
+    if (_AdaptReduced && !Moving) _NeedToRedraw = true;
     
     if (_NeedToRedraw && _Renderer && _ComputeHandler) {
         
-        //  Get the compute handler to recompute the image using the current settings,
-        //  using either the CPU or GPU. In auto mode, use the GPU unless floating point
-        //  rounding error at the current settings will be a problem, in which case use
-        //  the CPU.
+        //  In interactive mode, while input keeps arriving, the image is computed at a size
+        //  reduced enough to keep up with it. (Not when zooming, where the image changes
+        //  with every frame anyway, and the frame rates at full resolution are of interest.)
         
-        bool FloatOK = _ComputeHandler->FloatOK();
-        UseMode ModeToUse = USE_NONE;
-        if (_ComputeMode == AUTO_MODE) {
-            if (FloatOK) {
-                ModeToUse = USE_GPU;
-            } else {
-                if (_GPUSupportsDouble) {
-                    ModeToUse = USE_GPU_D;
-                } else {
-                    ModeToUse = USE_CPU;
-                }
-            }
-        } else if (_ComputeMode == CPU_MODE) {
-            ModeToUse = USE_CPU;
-        } else {
-            ModeToUse = USE_GPU;
-            if (!FloatOK && _GPUSupportsDouble) {
-                ModeToUse = USE_GPU_D;
-            }
+        //  With adaptive quality, while the view is moving, the image size, iteration limit and
+        //  precision are those of the current adaptive level - see AdaptQuality().
+        
+        int Scale = 1;
+        if (_Interactive && !Idle && _ZoomMode == ZOOM_NONE) Scale = InteractiveScale();
+        _Adapting = _AdaptQuality && Moving;
+        if (_Adapting) Scale = std::max(Scale,C_AdaptSteps[_AdaptLevel].Scale);
+        bool Resized = (Scale != _ImageScale);
+        if (Resized) SetImageScale(Scale);
+        int Iter = _CurrentIter;
+        if (_Adapting) {
+            Iter = std::max(_CurrentIter >> C_AdaptSteps[_AdaptLevel].IterShift,
+                                                          std::min(C_AdaptMinIter,_CurrentIter));
+        }
+        _ComputeHandler->SetMaxIter(Iter);
+        _Renderer->SetMaxIter(Iter);
+        
+        //  If a memory has just been recalled and its image was in the cache, just draw that
+        //  for now. _NeedToRedraw is left set, so the image is computed from the next call on.
+        
+        if (!_MemoryImage.empty()) {
+            bool SameSize = (_ImageScale == 1 &&
+                              _MemoryImage.size() == size_t(_ImageNx) * size_t(_ImageNy));
+            if (SameSize) _Renderer->Draw(_View,_MemoryImage.data());
+            _MemoryImage.clear();
+            _MemoryShown = SameSize;
+            if (SameSize) return;
         }
+        
+        //  Work out how the image is to be computed, and get the compute handler to compute
+        //  it. If the GPU was started on this image while the last one was being drawn (see
+        //  below), it just has to be waited for.
+        
+        UseMode ModeToUse = AdaptMode(SelectMode());
+        _AdaptReduced = _Adapting && (Iter != _CurrentIter || ModeToUse != SelectMode());
+        
+        //  When the CPU is used, and we aren't zooming, the image is computed a pass at a time,
+        //  starting with every 8th pixel, and each pass is drawn as it is completed, so that
+        //  the display keeps up with the user. If the view changes before the image is
+        //  complete, the compute handler starts again with a new image. (When zooming, the
+        //  image changes with every frame anyway, and the frame rates are of interest, so
+        //  the full image is always computed.)
+        
+        //  Similarly, when the GPU alone is used, and we aren't zooming, an image expected to
+        //  take longer than C_ChunkedMsec is computed a few bands of rows at a time, and drawn
+        //  as it builds up. A drag or scroll cancels the bands still to run - see NoteInput().
+        
+        bool ImageComplete = true;
+        bool Started = false;
+        MsecTimer FrameTimer;
         MsecTimer ComputeTimer;
-        if (ModeToUse == USE_GPU) {
-            _ComputeHandler->Compute();
+        bool Ahead = false;
+        bool Counted = false;
+        MandelComputeHandler::GPUPrecision Precision;
+        if (GPUPrecisionFor(ModeToUse,&Precision)) {
+            Ahead = _ComputeHandler->FinishGPUImage(Precision);
+        }
+        bool Chunked = (!Ahead && _ZoomMode == ZOOM_NONE && ModeToUse != USE_GPU_P &&
+                         GPUPrecisionFor(ModeToUse,&Precision) &&
+                                 _FullResMsec > C_ChunkedMsec * float(_ImageScale * _ImageScale));
+        if (Chunked) {
+            ImageComplete = _ComputeHandler->ComputeChunked(Precision,&Started);
+            if (ModeToUse == USE_GPU) _TotalComputeMsecGPU += ComputeTimer.ElapsedMsec();
+            if (ModeToUse == USE_GPU_D) _TotalComputeMsecGPU_D += ComputeTimer.ElapsedMsec();
+            if (ModeToUse == USE_GPU_FF) _TotalComputeMsecGPU_FF += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_GPU) {
+            if (!Ahead) _ComputeHandler->Compute();
             _TotalComputeMsecGPU += ComputeTimer.ElapsedMsec();
         } else if (ModeToUse == USE_GPU_D) {
-            _ComputeHandler->ComputeDouble();
+            if (!Ahead) _ComputeHandler->ComputeDouble();
             _TotalComputeMsecGPU_D += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_GPU_P) {
+            if (!Ahead) _ComputeHandler->ComputePerturbed();
+            _TotalComputeMsecGPU_P += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_GPU_FF) {
+            if (!Ahead) _ComputeHandler->ComputeFloatFloat();
+            _TotalComputeMsecGPU_FF += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_HYBRID) {
+            _ComputeHandler->ComputeHybrid();
+            _TotalComputeMsecHybrid += ComputeTimer.ElapsedMsec();
+        } else if (ModeToUse == USE_GPU_MIXED) {
+            _ComputeHandler->ComputeMixed();
+            _TotalComputeMsecMixed += ComputeTimer.ElapsedMsec();
         } else if (ModeToUse == USE_CPU) {
-            _ComputeHandler->ComputeInC();
+            if (_ZoomMode == ZOOM_NONE) {
+                ImageComplete = _ComputeHandler->ComputeInCProgressive();
+            } else {
+                Ahead = _ComputeHandler->FinishCPUImage();
+                Counted = (_ZoomMode == ZOOM_PATH && !Ahead && _BenchCounters.IsOpen());
+                if (Counted) {
+                    _BenchCounters.Clear();
+                    _BenchCounters.Start();
+                }
+                if (!Ahead) _ComputeHandler->ComputeInC();
+                if (Counted) _BenchCounters.Stop();
+            }
             _TotalComputeMsecCPU += ComputeTimer.ElapsedMsec();
         } else {
             printf ("**Internal error, compute mode unspecified**\n");
         }
+        float ComputeMsec = ComputeTimer.ElapsedMsec();
+        
+        //  The time taken gives an estimate of the time for a full resolution image, which sets
+        //  the image size to use next time the user drags or scrolls. Only images computed in
+        //  full are any guide - not those computed a pass at a time, or those where a drag
+        //  let the compute handler shift the last image and just fill in the edges. (A change
+        //  in magnification or image size rules that out.) An image computed in bands is a
+        //  guide once complete, using the time all its calls took, kept in _ChunkedMsec, which
+        //  starts afresh with the call that started it. One that came from the cache or was
+        //  shifted is no guide.
+        
+        double Magnification = _ComputeHandler->GetMagnification();
+        bool Progressive = (ModeToUse == USE_CPU && _ZoomMode == ZOOM_NONE);
+        bool NewView = (Resized || Magnification != _ComputedMagnification);
+        if (Chunked) {
+            if (Started) {
+                _ChunkedMsec = 0.0;
+            } else if (NewView) {
+                _ChunkedMsec = -1.0;
+            }
+            if (_ChunkedMsec >= 0.0) _ChunkedMsec += ComputeMsec;
+            if (ImageComplete && _ChunkedMsec >= 0.0) {
+                _FullResMsec = _ChunkedMsec * float(_ImageScale * _ImageScale);
+            }
+            if (ImageComplete) _ChunkedMsec = -1.0;
+        } else if (!Progressive && !Ahead && NewView) {
+            _FullResMsec = ComputeMsec * float(_ImageScale * _ImageScale);
+        }
+        _ComputedMagnification = Magnification;
                 
         //  If the mode (CPU/GPU) has changed, we need to show this in the window title.
         //  Note that RedisplayTitle() uses _LastUsedMode so this has to be set before
@@ -547,31 +1275,33 @@ void MandelController::Draw()
         //  this as the overlay for the Renderer. The Renderer works in window frame
         //  coordinates and the path is in Mandelbrot coordinates, and the conversion
         //  between the two changes, probably with each redraw, so has to be redone at
-        //  this point.
-        
-        if (_RouteN > 0) {
-            float* XPosns = (float*)malloc(_Iter * sizeof(float));
-            float* YPosns = (float*)malloc(_Iter * sizeof(float));
-            ImageToFrameCoord(_RouteX,_RouteY,XPosns,YPosns,_RouteN);
-            _Renderer->SetOverlay(XPosns,YPosns,_RouteN);
-            free (XPosns);
-            free (YPosns);
-        } else {
+        //  this point. If the renderer can work out the path on the GPU, it is passed the
+        //  conversion instead - the frame position of the image centre, and the frame pixels
+        //  per unit in Mandelbrot coordinates, as used by ImageToFrameCoord(). Should that
+        //  fail, the path is calculated here after all.
+        
+        bool RouteOnGPU = false;
+        if (_RouteN > 0 && _Renderer->OverlayOrbitOnGPU()) {
+            double XCent,YCent;
+            _ComputeHandler->GetCentre(&XCent,&YCent);
+            double Scale = _FrameX * _ComputeHandler->GetMagnification() * 0.5;
+            RouteOnGPU = _Renderer->SetOverlayOrbit(_RouteX0,_RouteY0,_RouteN,XCent,YCent,
+                                                        _FrameX * 0.5,_FrameY * 0.5,Scale);
+            if (!RouteOnGPU) _RouteN = CalcRoute(_RouteX0,_RouteY0,_RouteX,_RouteY,_Iter);
+        }
+        if (_RouteN > 0 && !RouteOnGPU) {
+            ImageToFrameCoord(_RouteX,_RouteY,_RouteAtX,_RouteAtY,_RouteN);
+            _Renderer->SetOverlay(_RouteAtX,_RouteAtY,_RouteN);
+        } else if (_RouteN == 0) {
             _Renderer->SetOverlay(nullptr,nullptr,0);
         }
         
-        //  Get the renderer to draw the new image into the view, getting its address
-        //  from the compute handler.
-        
-        float* ImageData = _ComputeHandler->GetImageData();
-        MsecTimer RenderTimer;
-        _Renderer->Draw(_View,ImageData);
-        _TotalRenderMsec += RenderTimer.ElapsedMsec();
-        _NeedToRedraw = false;
+        _NeedToRedraw = !ImageComplete;
         
-        //  Handle Zoom mode by changing the magnification for the next frame.
+        //  Handle Zoom mode by changing the magnification for the next frame. (A benchmark run
+        //  moves on to its next frame once this one has been drawn and timed - see below.)
         
-        if (_ZoomMode != ZOOM_NONE) {
+        if (_ZoomMode != ZOOM_NONE && _ZoomMode != ZOOM_PATH) {
             double Magnification =_ComputeHandler->GetMagnification();
             float Msec = _ZoomTimer.ElapsedMsec();
             
@@ -584,7 +1314,16 @@ void MandelController::Draw()
             if (_ZoomMode == ZOOM_TIMED) {
                 if (Msec > 10000.0) {
                     printf ("Zoom mode ends, frame rate = %.2f frames/sec\n",
-                       float(_ZoomFramesCPU + _ZoomFramesGPU + _ZoomFramesGPU_D) * 1000.0 /Msec);
+                       float(_ZoomFramesCPU + _ZoomFramesGPU + _ZoomFramesGPU_D +
+                                   _ZoomFramesGPU_P + _ZoomFramesGPU_FF +
+                                   _ZoomFramesHybrid + _ZoomFramesMixed) * 1000.0 /Msec);
+                    if (_ZoomFramesGPU > 0) {
+                        printf ("Average GPU compute time = %.2f msec%s\n",
+                                _TotalComputeMsecGPU / float(_ZoomFramesGPU),
+                                _ComputeHandler->GetTileQueue() ? " (tile queue)" : "");
+                    }
+                    long Hits = _ComputeHandler->GetImageCacheHits() - _ZoomCacheHits;
+                    if (Hits > 0) printf ("%ld images were taken from the image cache\n",Hits);
                     _ZoomMode = ZOOM_NONE;
                 } else {
                     if (Msec < 5000.0) IncreaseMag = true;
@@ -611,13 +1350,31 @@ void MandelController::Draw()
             //  we're running at exactly 60fps, FrameSecs will be exactly 1.0/60.0)
             
             double MagFactor = pow(2.0,(1.0 / 60.0));
-            int ZoomFrames = _ZoomFramesGPU + _ZoomFramesGPU_D + _ZoomFramesCPU;
+            int ZoomFrames = _ZoomFramesGPU + _ZoomFramesGPU_D + _ZoomFramesGPU_P +
+                                                       _ZoomFramesGPU_FF + _ZoomFramesHybrid +
+                                                     _ZoomFramesMixed + _ZoomFramesCPU;
+            if (ZoomFrames > 0) _FrameStats.Record(Msec - _LastZoomMsec);
             if (ZoomFrames > 0 && _ScaleMagByTime) {
                 float FrameSec = (Msec - _LastZoomMsec) * 0.001f;
                 MagFactor = pow(2.0,FrameSec);
             }
-            if (IncreaseMag) Magnification = Magnification * MagFactor;
-            if (DecreaseMag) Magnification = Magnification / MagFactor;
+            //  In ZOOM_TIMED mode, if the compute handler is caching images, the way out
+            //  retraces the magnifications used on the way in, so the images still in the
+            //  cache can be reused. Once those run out, it carries on as usual.
+            
+            bool Retrace = (_ZoomMode == ZOOM_TIMED && _ComputeHandler->GetImageCacheLimit() > 0);
+            if (IncreaseMag) {
+                if (Retrace) _ZoomPath.push_back(Magnification);
+                Magnification = Magnification * MagFactor;
+            }
+            if (DecreaseMag) {
+                if (Retrace && !_ZoomPath.empty()) {
+                    Magnification = _ZoomPath.back();
+                    _ZoomPath.pop_back();
+                } else {
+                    Magnification = Magnification / MagFactor;
+                }
+            }
             
             //  Display the new magnification and apply it,  and remember the time so we can
             //  allow for the frame rate next time round.
@@ -626,11 +1383,358 @@ void MandelController::Draw()
             RedisplayTitle();
             if (ModeToUse == USE_GPU) _ZoomFramesGPU++;
             else if (ModeToUse == USE_GPU_D) _ZoomFramesGPU_D++;
+            else if (ModeToUse == USE_GPU_P) _ZoomFramesGPU_P++;
+            else if (ModeToUse == USE_GPU_FF) _ZoomFramesGPU_FF++;
+            else if (ModeToUse == USE_HYBRID) _ZoomFramesHybrid++;
+            else if (ModeToUse == USE_GPU_MIXED) _ZoomFramesMixed++;
             else _ZoomFramesCPU++;
             _LastZoomMsec = Msec;
             _NeedToRedraw = true;
+            
+            //  The next image is now known, so if it will be computed by the GPU alone, start
+            //  the GPU on it now, so it computes it while this one is being drawn. (Not with the
+            //  tile queue, which is there to compare GPU compute times.) If it will be computed
+            //  by the CPU alone, the compute handler starts a background thread on it instead.
+            
+            if (_ZoomMode != ZOOM_NONE && _ComputeAhead) {
+                UseMode NextMode = AdaptMode(SelectMode());
+                if (NextMode == USE_CPU) {
+                    _ComputeHandler->StartCPUImage();
+                } else if (!_ComputeHandler->GetTileQueue() && !_ComputeHandler->GetSubdivide()
+                                                 && GPUPrecisionFor(NextMode,&Precision)) {
+                    _ComputeHandler->StartGPUImage(Precision);
+                }
+            }
+        }
+        
+        //  Get the renderer to draw the new image into the view, getting its address
+        //  from the compute handler. This is the image just computed, even if the GPU is
+        //  now computing the next one. If they share a device, the renderer can read the
+        //  image directly from the buffer the compute handler holds it in, having the GPU
+        //  wait for the compute queue to finish writing it, if that's a different queue.
+        
+        //  If the image is the last one moved, with only the strips that came into view new, the
+        //  renderer is told, so it can save going over the whole image. But while a cached
+        //  memory image is displayed, the passes of a progressive image aren't drawn over it -
+        //  just the complete image - and since the renderer's last image is the cached one, it
+        //  can't be told about the changes since the compute handler's last image.
+        
+        bool Refining = (_MemoryShown && _MemoryRecalled >= 0 && AtMemory(_MemoryRecalled));
+        uint32_t* ImageData = _ComputeHandler->GetImageData();
+        int ShiftX,ShiftY;
+        std::vector<MandelComputeHandler::Strip> Strips;
+        bool Changes = _ComputeHandler->GetImageChanges(&ShiftX,&ShiftY,Strips);
+        if (Refining && !ImageComplete) return;
+        _MemoryShown = false;
+        if (Changes && !Refining) {
+            std::vector<ImageArea> Areas;
+            for (const MandelComputeHandler::Strip& Area : Strips) {
+                Areas.push_back({Area.Ixst,Area.Ixen,Area.Iyst,Area.Iyen});
+            }
+            _Renderer->SetImageChanges(ShiftX,ShiftY,Areas);
+        }
+        MsecTimer RenderTimer;
+        if (_SharedDevice) {
+            _Renderer->Draw(_View,ImageData,_ComputeHandler->GetImageBuffer(),
+                                                     _ComputeHandler->GetImageReadyPoints());
+        } else {
+            _Renderer->Draw(_View,ImageData);
+        }
+        _RenderStats.Record(RenderTimer.ElapsedMsec());
+        
+        //  With adaptive quality, the time for this frame decides the quality of the next.
+        
+        if (_Adapting) AdaptQuality(FrameTimer.ElapsedMsec());
+        
+        //  Once the image for a memory just recalled has been computed, it goes into the cache,
+        //  unless it was already there. (If the view has moved since, it isn't the memory's.)
+        
+        if (ImageComplete && _MemoryRecalled >= 0) {
+            if (!_MemoryCached && _ImageScale == 1 && !_AdaptReduced &&
+                                                                AtMemory(_MemoryRecalled)) {
+                _MemoryCache.Save(_MemoryRecalled,MemoryDetails(_MemoryRecalled),ImageData);
+            }
+            _MemoryRecalled = -1;
+        }
+        
+        //  If this is the first image drawn since a drag or scroll, that input has now reached
+        //  the display - or at least, the renderer has handed the frame over to be presented.
+        
+        if (_InputPending) {
+            _LatencyStats.Record(_LatencyTimer.ElapsedMsec());
+            _InputPending = false;
+        }
+        
+        //  With the automatic iteration limit, the histogram of the image just drawn is used
+        //  to set the limit for the next one. If that changes, the view needs computing again,
+        //  and any image the GPU has started ahead is wasted.
+        
+        if (_AutoIter && ImageComplete && AdjustIterations()) {
+            _NeedToRedraw = true;
+            RedisplayTitle();
+        }
+        
+        //  In a benchmark run, write out the timings for this frame and move on to the next.
+        
+        if (_ZoomMode == ZOOM_PATH) {
+            float ColourMsec = 0.0;
+            float PresentMsec = 0.0;
+            _Renderer->GetDrawTimes(&ColourMsec,&PresentMsec);
+            float TotalMsec = FrameTimer.ElapsedMsec();
+            double XCent = 0.0,YCent = 0.0;
+            _ComputeHandler->GetCentre(&XCent,&YCent);
+            fprintf (_BenchFile,"%d,%.16g,%.16g,%.10g,%d,%s,%.3f,%.3f,%.3f,%.3f,",_BenchFrame,
+                     XCent,YCent,_ComputeHandler->GetMagnification(),_CurrentIter,
+                     ModeName(ModeToUse),ComputeMsec,ColourMsec,PresentMsec,TotalMsec);
+            
+            //  The counter columns are left empty for frames the CPU didn't compute, and for
+            //  any event that couldn't be counted.
+            
+            double Values[3] = {-1.0,-1.0,-1.0};
+            if (Counted) {
+                double Pixels = double(std::max(_ImageNx / _ImageScale,16)) *
+                                                   double(std::max(_ImageNy / _ImageScale,16));
+                PerfCounters::Counts Totals = _BenchCounters.GetCounts();
+                Values[0] = PerfCounters::Ipc(Totals);
+                Values[1] = PerfCounters::PerPixel(Totals,PerfCounters::CacheMisses,Pixels);
+                Values[2] = PerfCounters::PerPixel(Totals,PerfCounters::BranchMisses,Pixels);
+            }
+            for (int Index = 0; Index < 3; Index++) {
+                if (Values[Index] >= 0.0) fprintf (_BenchFile,"%.5g",Values[Index]);
+                fputs (Index < 2 ? "," : "\n",_BenchFile);
+            }
+            _BenchTotalMsec += TotalMsec;
+            if (++_BenchFrame < C_BenchFrames) {
+                SetBenchmarkFrame(_BenchFrame);
+                _NeedToRedraw = true;
+            } else {
+                EndBenchmark(true);
+            }
+        }
+    }
+}
+
+//  AdaptQuality() is passed the time taken by a frame drawn while the view was moving with
+//  adaptive quality enabled, and moves to a cheaper or more expensive adaptive level if the
+//  average time of recent frames calls for it - see C_AdaptSteps. The new level is used from
+//  the next frame on. (So if the GPU or CPU has already started on the next image, that work is
+//  wasted, but the level changes rarely enough for that not to matter.)
+
+void MandelController::AdaptQuality (float FrameMsec)
+{
+    if (_AdaptFrames == 0) _AdaptMsec = FrameMsec;
+    else _AdaptMsec = _AdaptMsec * 0.75f + FrameMsec * 0.25f;
+    if (++_AdaptFrames < C_AdaptSettleFrames) return;
+    int Level = _AdaptLevel;
+    if (_AdaptMsec > C_AdaptTargetMsec * C_AdaptHigh) {
+        if (Level < C_AdaptMaxLevel) Level++;
+    } else if (Level > 0) {
+        float Estimate = _AdaptMsec * AdaptCost(Level - 1) / AdaptCost(Level);
+        if (Estimate < C_AdaptTargetMsec * C_AdaptLow) Level--;
+    }
+    if (Level != _AdaptLevel) {
+        _AdaptLevel = Level;
+        _AdaptFrames = 0;
+    }
+}
+
+//  AdaptMode() returns the mode to use in place of the one SelectMode() picked, allowing for
+//  the precision tiers the current adaptive level drops, if adaptive quality is in use for
+//  this frame. The tiers are single precision, float-float and double precision, with the CPU,
+//  sharing with the CPU and mixed precision counted as double precision. Perturbation is left
+//  alone - no other mode can do anything useful at those magnifications - as is the CPU if it
+//  was selected.
+
+MandelController::UseMode MandelController::AdaptMode (UseMode Mode)
+{
+    int Steps = _Adapting ? C_AdaptSteps[_AdaptLevel].PrecisionSteps : 0;
+    if (Steps == 0 || Mode == USE_GPU_P || Mode == USE_GPU || _ComputeMode == CPU_MODE) {
+        return Mode;
+    }
+    if (Mode == USE_GPU_FF || Steps > 1) return USE_GPU;
+    return USE_GPU_FF;
+}
+
+//  StartBenchmark() starts a benchmark run, which draws a fixed number of frames along a zoom
+//  path given by a set of keyframes read from a file, writing the time taken by each, and how
+//  it was computed, to a CSV file, so runs on different drivers or hardware can be compared.
+//  If there's no path file, it zooms from the starting view to preset 3, which goes through
+//  most of the compute modes. The image cache is disabled during the run, so every frame is
+//  computed, and nothing is computed ahead, so each frame's compute time is its own. Where the
+//  system allows it, the CPU hardware counters are opened, so the frames the CPU computes can
+//  show whether it's limited by memory, by branches or by the arithmetic.
+
+void MandelController::StartBenchmark (void)
+{
+    _BenchPath.clear();
+    if (!ReadZoomPath(C_BenchPathFile,&_BenchPath)) {
+        printf ("No %s zoom path file, using default path to preset 3\n",C_BenchPathFile);
+        _BenchPath.push_back(_Memories[0]);
+        _BenchPath.push_back(_Memories[3]);
+    }
+    if (_BenchPath.size() < 2) {
+        printf ("Zoom path in %s needs at least two keyframes\n",C_BenchPathFile);
+        return;
+    }
+    _BenchFile = fopen(C_BenchCsvFile,"w");
+    if (_BenchFile == nullptr) {
+        printf ("Unable to create benchmark file %s\n",C_BenchCsvFile);
+        return;
+    }
+    fprintf (_BenchFile,"Frame,XCent,YCent,Magnification,Iterations,Mode,");
+    fprintf (_BenchFile,"ComputeMsec,ColourMsec,PresentMsec,TotalMsec,");
+    fprintf (_BenchFile,"Ipc,LlcMissesPerPixel,BranchMissesPerPixel\n");
+    if (!_BenchCounters.Open()) {
+        printf ("CPU hardware counters not available: %s\n",_BenchCounters.Error().c_str());
+    }
+    printf ("Benchmark: %d frames along a zoom path with %d keyframes\n",
+                                                        C_BenchFrames,int(_BenchPath.size()));
+    _BenchCacheLimit = _ComputeHandler->GetImageCacheLimit();
+    _ComputeHandler->SetImageCacheLimit(0);
+    _BenchFrame = 0;
+    _BenchTotalMsec = 0.0;
+    _ZoomMode = ZOOM_PATH;
+    SetBenchmarkFrame(0);
+    _NeedToRedraw = true;
+}
+
+//  EndBenchmark() closes the timings file at the end of a benchmark run, or when it's cancelled.
+
+void MandelController::EndBenchmark (bool Completed)
+{
+    if (_BenchFile) fclose(_BenchFile);
+    _BenchFile = nullptr;
+    _BenchCounters.Close();
+    _ComputeHandler->SetImageCacheLimit(_BenchCacheLimit);
+    _ZoomMode = ZOOM_NONE;
+    if (Completed) {
+        printf ("Benchmark ends, average frame time %.2f msec, timings written to %s\n",
+                                  _BenchTotalMsec / float(_BenchFrame),C_BenchCsvFile);
+    } else {
+        printf ("Benchmark cancelled after %d frames\n",_BenchFrame);
+    }
+}
+
+//  SetBenchmarkFrame() sets the view for a frame of a benchmark run. The frames are spread
+//  evenly over the sections between keyframes, with the magnification changing by the same
+//  factor each frame within a section. The centre moves so that the point being zoomed towards
+//  stays put in the view, which means its offset from the final centre has to shrink in step
+//  with the magnification, rather than linearly.
+
+void MandelController::SetBenchmarkFrame (int Frame)
+{
+    int Sections = int(_BenchPath.size()) - 1;
+    double Posn = double(Frame) * double(Sections) / double(C_BenchFrames - 1);
+    int Section = std::min(int(Posn),Sections - 1);
+    double Fraction = Posn - double(Section);
+    const Setting& From = _BenchPath[Section];
+    const Setting& To = _BenchPath[Section + 1];
+    double Ratio = To.Magnification / From.Magnification;
+    double Magnification = From.Magnification * pow(Ratio,Fraction);
+    double Move = Fraction;
+    if (fabs(Ratio - 1.0) > 1.0e-9) {
+        Move = (1.0 - From.Magnification / Magnification) / (1.0 - 1.0 / Ratio);
+    }
+    _ComputeHandler->SetCentre(From.XCent + (To.XCent - From.XCent) * Move,
+                               From.YCent + (To.YCent - From.YCent) * Move);
+    _ComputeHandler->SetMagnification(Magnification);
+    RedisplayTitle();
+}
+
+//  ReadZoomPath() reads the keyframes of a zoom path from a file. Each line gives the X and Y
+//  coordinates of the centre and the magnification. Any words on the line are ignored, so
+//  the output from the 'p' key can be used as it is. Lines starting with '#' are comments.
+
+bool MandelController::ReadZoomPath (const char* FileName,std::vector<Setting>* Path)
+{
+    FILE* File = fopen(FileName,"r");
+    if (File == nullptr) return false;
+    char Line[1024];
+    while (fgets(Line,sizeof(Line),File)) {
+        if (Line[0] == '#') continue;
+        double Values[3];
+        int NValues = 0;
+        char* Ptr = Line;
+        while (*Ptr && NValues < 3) {
+            while (*Ptr && (isspace(*Ptr) || *Ptr == ',')) Ptr++;
+            char* End = Ptr;
+            double Value = strtod(Ptr,&End);
+            if (End != Ptr && (*End == '\0' || isspace(*End) || *End == ',')) {
+                Values[NValues++] = Value;
+            } else {
+                while (*End && !isspace(*End) && *End != ',') End++;
+            }
+            Ptr = End;
+        }
+        if (NValues == 3 && Values[2] > 0.0) Path->push_back({Values[0],Values[1],Values[2]});
+    }
+    fclose(File);
+    return true;
+}
+
+//  ModeName() returns the short name used for a compute mode.
+
+const char* MandelController::ModeName (UseMode Mode)
+{
+    if (Mode == USE_CPU) return "CPU";
+    if (Mode == USE_GPU) return "GPU";
+    if (Mode == USE_GPU_D) return "GPU-D";
+    if (Mode == USE_GPU_P) return "GPU-P";
+    if (Mode == USE_GPU_FF) return "GPU-FF";
+    if (Mode == USE_HYBRID) return "GPU+CPU";
+    if (Mode == USE_GPU_MIXED) return "GPU-M";
+    return "None";
+}
+
+//  AdjustIterations() sets the iteration limit to suit the image, using the histogram of pixel
+//  values the renderer built for the image just drawn. If more than a small fraction of the
+//  pixels only escaped in the top eighth of the limit, there is detail at the edge of the set
+//  that more iterations would show, and the limit is raised. If even the slowest pixel to
+//  escape took less than half the limit, most of the iterations spent on the pixels inside
+//  the set are wasted, and the limit is lowered to twice that. The limit is kept above a floor
+//  that grows with the magnification, and it is left alone if no pixels escaped at all, as
+//  there's nothing to go on. It returns true if it changed the limit.
+
+bool MandelController::AdjustIterations (void)
+{
+    const std::vector<int>& Hist = _Renderer->GetHistogram();
+    int Limit = int(Hist.size());
+    if (Limit != _CurrentIter) return false;
+    
+    long Pixels = Hist[0];
+    long NearPixels = 0;
+    int MaxValue = 0;
+    int NearValue = int(double(Limit) * C_AutoIterTop);
+    for (int I = 1; I < Limit; I++) {
+        if (Hist[I] > 0) {
+            Pixels += Hist[I];
+            MaxValue = I;
+            if (I >= NearValue) NearPixels += Hist[I];
         }
     }
+    if (MaxValue == 0) return false;
+    
+    int NewLimit = Limit;
+    if (double(NearPixels) > double(Pixels) * C_AutoIterNear) {
+        NewLimit = int(double(Limit) * C_AutoIterRaise);
+    } else if (MaxValue < Limit / 2) {
+        NewLimit = MaxValue * 2;
+    }
+    double Magnification = _ComputeHandler->GetMagnification();
+    int Floor = int(double(C_AutoIterMin) * (1.0 + log10(std::max(Magnification,1.0))));
+    NewLimit = std::min(std::max(NewLimit,Floor),C_AutoIterMax);
+    if (NewLimit == Limit) return false;
+    SetIterations(NewLimit);
+    return true;
+}
+
+//  SetIterations() sets the iteration limit used by the compute handler and the renderer.
+
+void MandelController::SetIterations (int Iter)
+{
+    _CurrentIter = Iter;
+    _ComputeHandler->SetMaxIter(Iter);
+    _Renderer->SetMaxIter(Iter);
 }
 
 //  Format the magnification into a suitable window title.
@@ -651,6 +1755,34 @@ std::string MandelController::FormatMagnification (double Magnification)
         } else {
             Device = "*GPU-D*";
         }
+    } else if (_LastUsedMode == USE_GPU_P) {
+        if (_ComputeHandler->PerturbedOK()) {
+            Device = "GPU-P";
+        } else {
+            Device = "*GPU-P*";
+        }
+    } else if (_LastUsedMode == USE_GPU_FF) {
+        if (_ComputeHandler->FloatFloatOK()) {
+            Device = "GPU-FF";
+        } else {
+            Device = "*GPU-FF*";
+        }
+    } else if (_LastUsedMode == USE_HYBRID) {
+        bool PrecisionOK = _GPUSupportsDouble ? _ComputeHandler->DoubleOK() :
+                                                        _ComputeHandler->FloatFloatOK();
+        if (PrecisionOK) {
+            Device = "GPU+CPU";
+        } else {
+            Device = "*GPU+CPU*";
+        }
+    } else if (_LastUsedMode == USE_GPU_MIXED) {
+        bool PrecisionOK = _GPUSupportsDouble ? _ComputeHandler->DoubleOK() :
+                                                        _ComputeHandler->FloatFloatOK();
+        if (PrecisionOK) {
+            Device = "GPU-M";
+        } else {
+            Device = "*GPU-M*";
+        }
     } else {
        if (_ComputeHandler->DoubleOK()) {
             Device = "CPU";
@@ -679,6 +1811,7 @@ std::string MandelController::FormatMagnification (double Magnification)
     snprintf (Number,sizeof(Number),"%.3g",Value);
     std::string TitleString = Number;
     TitleString += (" " + Units + " (" + Device + ")");
+    if (_AutoIter) TitleString += (" " + std::to_string(_CurrentIter) + " iterations");
     return TitleString;
 }
 
@@ -688,21 +1821,34 @@ void MandelController::FrameToImageCoord(float AtX, float AtY,double* XCoord,dou
     if (_ComputeHandler) {
         double XCent,YCent;
         _ComputeHandler->GetCentre(&XCent,&YCent);
+        double XOffset,YOffset;
+        FrameToImageOffset(AtX,AtY,&XOffset,&YOffset);
+        *XCoord = XCent + XOffset;
+        *YCoord = YCent + YOffset;
+    }
+
+}
+
+//  Convert from view coordinates to an offset in Mandelbrot set coordinates from the centre
+//  of the image. At high magnifications, adding this to the centre loses most of it, so
+//  anything that moves the centre should work with the offset.
+void MandelController::FrameToImageOffset(float AtX, float AtY,double* XOffset,double* YOffset)
+{
+    if (_ComputeHandler) {
         double Magnification = _ComputeHandler->GetMagnification();
         double CoordRangeInX = 2.0;
         double FrameWidth = _FrameX;
         double DistFromFrameCentX = FrameWidth * 0.5 - AtX;
         double XCoordFromCent =
              DistFromFrameCentX * CoordRangeInX / (FrameWidth * Magnification);
-        *XCoord = XCent - XCoordFromCent;
+        *XOffset = -XCoordFromCent;
         double FrameHeight = _FrameY;
         double CoordRangeInY = 2.0 * FrameHeight / FrameWidth;
         double DistFromFrameCentY = FrameHeight * 0.5 - AtY;
         double YCoordFromCent =
              DistFromFrameCentY * CoordRangeInY / (FrameHeight * Magnification);
-        *YCoord = YCent - YCoordFromCent;
+        *YOffset = -YCoordFromCent;
     }
-
 }
 
 //  Convert from Mandelbrot set coordinates to view coordinates.
@@ -744,8 +1890,10 @@ void MandelController::PrintHelp()
             "    errors would cause pixelation.";
     } else {
         DoublePrecText =
-            "    This GPU does not support double precision floating point and at magnifications\n"
-            "    above about 100,000, single precision floating point will cause pixelation.";
+            "    This GPU does not support double precision floating point, so at magnifications\n"
+            "    above about 100,000, where single precision floating point errors would cause\n"
+            "    pixelation, it uses pairs of single precision values, which are good to about\n"
+            "    10 trillion. Beyond that, auto mode uses the CPU.";
     }
     
     //  Output what I hope is useful help information.
@@ -764,6 +1912,9 @@ void MandelController::PrintHelp()
     printf ("\n");
     printf ("Hitting certain keyboard keys has an effect:\n");
     printf ("'0'..'9' select pre-determined settings for centre point and magnification.\n");
+    printf ("    The image last computed for each is kept in %s*.cache, and shown at once\n",
+                                                                       C_MemoryCachePrefix);
+    printf ("    when it is selected again, while the image is recomputed.\n");
     printf ("'r' resets the display to its starting point\n");
     printf ("'i' hold down the 'i' key to zoom in\n");
     printf ("'o' hold down the 'o' key to zoom out\n");
@@ -773,13 +1924,44 @@ void MandelController::PrintHelp()
     printf ("'e' toggles a continuous display of the Mandelbrot path as the cursor moves.\n");
     printf ("'x' clears any Mandelbrot path from the display\n");
     printf ("'z' does a zoom test. It zooms in for 5 seconds, then out for 5 seconds\n");
+    printf ("'f' runs a benchmark of %d frames along the zoom path in %s, one\n",
+                                                                 C_BenchFrames,C_BenchPathFile);
+    printf ("    'p' output line per keyframe, writing frame timings to %s\n",C_BenchCsvFile);
     printf ("'a' sets auto mode - the program uses the GPU so long as its floating point\n");
     printf ("    support is accurate enough at the current magnification.\n");
     printf ("'c' forces the program to use the CPU - all available cores.\n");
     printf ("'g' forces the program to use the GPU at all magnifications.\n");
     printf ("%s\n",DoublePrecText.c_str());
-    printf ("    (Above about 100 trillion even double precision has problems.)\n");
+    printf ("    Above about 100 trillion, where even double precision has problems, the GPU\n");
+    printf ("    computes small differences from a reference orbit calculated by the CPU.\n");
     printf ("'w' toggles magnification rate compensation for slow compute times during zoom\n");
+    printf ("'u' toggles having the GPU or CPU compute the next zoom image while the current\n");
+    printf ("    one is drawn (enabled by default)\n");
+    printf ("'k' toggles the image cache, which saves recomputing images already seen,\n");
+    printf ("    and makes the 'z' zoom test retrace its way in (enabled by default)\n");
+    printf ("'y' toggles sharing of images between GPU and CPU where auto mode would use\n");
+    printf ("    GPU double precision or pairs of floats (enabled by default)\n");
+    printf ("'n' toggles an automatic iteration limit, set to suit each image\n");
+    printf ("'v' toggles computing images at reduced resolution while dragging or scrolling,\n");
+    printf ("    going back to full resolution once the image is left alone\n");
+    printf ("'-' toggles adaptive quality, which lowers the image size, iteration limit and\n");
+    printf ("    precision while the view moves, to keep each frame within %.1f msec\n",
+                                                                         C_AdaptTargetMsec);
+    printf ("'b' toggles the checks that skip points inside the set (for benchmarking)\n");
+    printf ("'q' toggles the GPU tile queue, where a fixed number of workgroups take\n");
+    printf ("    tiles of the image as they become free (for benchmarking)\n");
+    printf ("';' toggles subdivision, where only the borders of uniform areas of the image\n");
+    printf ("    are computed, and the rest filled in\n");
+    printf ("'.' toggles drawing the image as a single quad, coloured by the fragment\n");
+    printf ("    shader, or as a triangle strip with two triangles for each pixel\n");
+    printf ("'[' toggles stable colours, where the GPU sets the colours from a histogram\n");
+    printf ("    smoothed over the frames, so they don't flicker during a zoom\n");
+    printf ("',' reports the latency from dragging or scrolling to the image being drawn\n");
+    printf ("'/' starts or stops writing each frame drawn to %s_nnnnnn.ppm, for\n",
+                                                                            C_CapturePrefix);
+    printf ("    making videos - frames are dropped if they can't be written fast enough\n");
+    printf ("'=' toggles making the image size follow the size of the view, so each pixel\n");
+    printf ("    computed is one pixel displayed\n");
     printf ("'l' sets size of images to %d by %d (large)\n",_BaseNx * 2,_BaseNy * 2);
     printf ("'m' sets size of images to %d by %d (medium - default)\n",_BaseNx,_BaseNy);
     printf ("'s' sets size of images to %d by %d (small)\n",_BaseNx / 2,_BaseNy / 2);
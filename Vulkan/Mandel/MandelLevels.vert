@@ -0,0 +1,70 @@
+#version 450
+
+//  This is the vertex shader the renderer uses when it draws the image as a triangle strip and
+//  the CPU has coloured the image. The CPU only sets the colour level - the index into the
+//  256-entry colour table - for each pixel, as a single byte, and this looks up the colour of
+//  each vertex in the colour table, which is set once when the renderer is set up. As in
+//  MandelStrip.vert, the position of each vertex is worked out from gl_VertexIndex and the image
+//  dimensions, so there are no vertex buffers at all. The vertices are as SetVertexPositions()
+//  would set them, and each gets the colour SetVertexDefaultColours() would give it: the first
+//  5 vertices in each line belong to its first pixel, then there are 2 for each other pixel,
+//  and the final one, which ends the line, is always black.
+
+layout(location = 0) out vec3 fragColor;
+
+//  The image dimensions, set by the CPU whenever they change.
+
+layout(binding = 0) readonly buffer gridParams
+{
+   int nx;
+   int ny;
+};
+
+//  The colour level for each pixel, one byte per pixel, packed four to a uint.
+
+layout(binding = 1) readonly buffer levels
+{
+   uint levelData[];
+};
+
+//  The R,G,B colour for each of the 256 colour levels. This is declared as a float array,
+//  since an array of vec3 would be padded to 16 bytes an element.
+
+layout(binding = 2) readonly buffer palette
+{
+   float paletteData[];
+};
+
+void main() {
+    int lineVertices = (nx - 1) * 2 + 6;
+    int iy = gl_VertexIndex / lineVertices;
+    int vertex = gl_VertexIndex - iy * lineVertices;
+    float yinc = 2.0 / float(ny);
+    float xinc = 2.0 / float(nx);
+    float y = float(iy) * yinc - 1.0;
+    float yp1 = y - yinc;
+    yp1 *= -1.0;
+    y *= -1.0;
+    vec2 position;
+    if (vertex < 2) {
+        position = vec2(-1.0, y);
+    } else if (vertex == 2) {
+        position = vec2(-1.0, yp1);
+    } else {
+        int edge = min(vertex - 3, nx * 2 - 1);
+        float xp1 = float(edge / 2 + 1) * xinc - 1.0;
+        position = vec2(xp1, ((edge & 1) == 0) ? y : yp1);
+    }
+    gl_Position = vec4(position, 0.0, 1.0);
+
+    if (vertex == lineVertices - 1) {
+        fragColor = vec3(0.0, 0.0, 0.0);
+    } else {
+        int ix = 0;
+        if (vertex >= 5) ix = (vertex - 5) / 2 + 1;
+        uint pixel = uint(iy) * uint(nx) + uint(ix);
+        uint level = (levelData[pixel >> 2] >> ((pixel & 3u) * 8u)) & 0xffu;
+        fragColor = vec3(paletteData[level * 3u], paletteData[level * 3u + 1u],
+                                                               paletteData[level * 3u + 2u]);
+    }
+}
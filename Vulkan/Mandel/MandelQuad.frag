@@ -0,0 +1,58 @@
+#version 450
+
+//  This is the fragment shader the renderer uses when it draws the image as a single quad. It
+//  looks up the image value for the pixel being drawn, and then looks up the colour for that
+//  value in the table set up from the histogram of the image. The image and the colour table
+//  are the same buffers used by the colouring compute shader, MandelColour.comp. If the image
+//  is larger than the drawable, that shader will already have downsampled it to the size of
+//  the drawable, and this just looks up the colour of the pixel in the downsampled image.
+
+layout(location = 0) in vec2 fragPosition;
+
+layout(location = 0) out vec4 outColor;
+
+//  The image, as iteration counts.
+
+layout(binding = 0) readonly buffer image
+{
+   uint imageData[];
+};
+
+//  The R,G,B colour for each value up to the iteration limit, set by the CPU.
+
+layout(binding = 3) readonly buffer lut
+{
+   float lutData[];
+};
+
+//  The image dimensions and the iteration limit.
+
+layout(binding = 4) readonly buffer params
+{
+   int nx;
+   int ny;
+   int iterLimit;
+   int downsampled;
+   int width;
+   int height;
+};
+
+//  The downsampled image, with the colour of each drawable pixel packed into a uint.
+
+layout(binding = 5) readonly buffer down
+{
+   uint downData[];
+};
+
+void main() {
+    if (downsampled != 0) {
+        int dx = clamp(int(fragPosition.x * float(width)), 0, width - 1);
+        int dy = clamp(int(fragPosition.y * float(height)), 0, height - 1);
+        outColor = unpackUnorm4x8(downData[dy * width + dx]);
+        return;
+    }
+    int ix = clamp(int(fragPosition.x * float(nx)), 0, nx - 1);
+    int iy = clamp(int(fragPosition.y * float(ny)), 0, ny - 1);
+    uint value = min(imageData[iy * nx + ix], uint(iterLimit - 1));
+    outColor = vec4(lutData[value * 3], lutData[value * 3 + 1], lutData[value * 3 + 2], 1.0);
+}
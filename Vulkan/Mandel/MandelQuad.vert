@@ -0,0 +1,16 @@
+#version 450
+
+//  This is the vertex shader the renderer uses when it draws the image as a single quad rather
+//  than as a triangle strip with two triangles for each pixel. There are no vertex buffers -
+//  the three vertices are generated from gl_VertexIndex, and make one triangle big enough to
+//  cover the whole view. fragPosition is the position in the image, from 0 to 1 in each
+//  direction, with image row 0 at the bottom of the view, as for the triangle strip.
+
+layout(location = 0) out vec2 fragPosition;
+
+void main() {
+    vec2 position = vec2(float((gl_VertexIndex << 1) & 2) * 2.0 - 1.0,
+                                                  float(gl_VertexIndex & 2) * 2.0 - 1.0);
+    gl_Position = vec4(position, 0.0, 1.0);
+    fragPosition = vec2((position.x + 1.0) * 0.5, (1.0 - position.y) * 0.5);
+}
@@ -0,0 +1,49 @@
+#version 450
+
+//  This is the vertex shader the renderer uses when it draws the image as a triangle strip, with
+//  two triangles for each pixel. It works out the position of each vertex from gl_VertexIndex
+//  and the image dimensions, so there's no need for a buffer of vertex positions - only the
+//  colours come from a vertex buffer. The positions are exactly those SetVertexPositions() would
+//  set: each line starts with 5 vertices for its first pixel, the first two the same to make a
+//  zero-area triangle, then has 2 for each other pixel, then a final one that repeats the last
+//  to make the zero-area triangle that ends the line.
+
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+//  The image dimensions, set by the CPU whenever they change.
+
+layout(binding = 0) readonly buffer gridParams
+{
+   int nx;
+   int ny;
+};
+
+void main() {
+    int lineVertices = (nx - 1) * 2 + 6;
+    int iy = gl_VertexIndex / lineVertices;
+    int vertex = gl_VertexIndex - iy * lineVertices;
+    float yinc = 2.0 / float(ny);
+    float xinc = 2.0 / float(nx);
+    float y = float(iy) * yinc - 1.0;
+    float yp1 = y - yinc;
+    yp1 *= -1.0;
+    y *= -1.0;
+    vec2 position;
+    if (vertex < 2) {
+        position = vec2(-1.0, y);
+    } else if (vertex == 2) {
+        position = vec2(-1.0, yp1);
+    } else {
+
+        //  From here on the vertices alternate between the top and bottom of the right-hand
+        //  edge of each pixel in turn. The final repeated vertex is the same as the one before.
+
+        int edge = min(vertex - 3, nx * 2 - 1);
+        float xp1 = float(edge / 2 + 1) * xinc - 1.0;
+        position = vec2(xp1, ((edge & 1) == 0) ? y : yp1);
+    }
+    gl_Position = vec4(position, 0.0, 1.0);
+    fragColor = inColor;
+}
@@ -0,0 +1,935 @@
+//
+//                     M a n d e l  T i l e s  -  m a i n . c p p    ( Vulkan )
+//
+//  This is the main routine for a headless version of the Mandelbrot program, intended for
+//  images far larger than could ever be displayed in a window - posters, say, 32k pixels
+//  square - or for sequences of animation frames, generated on machines that may not have a
+//  display at all. It uses the same MandelComputeHandler as the interactive program, but
+//  never calls the Vulkan framework's EnableGraphics(), so needs neither GLFW nor a window.
+//
+//  The image is computed in tiles, each small enough to fit comfortably in device memory,
+//  and each tile is treated as an ordinary image by the compute handler, with its centre and
+//  magnification set so that its pixels fall exactly onto the grid of the full image. As each
+//  tile is computed it is handed to a writer thread which copies it into the output file while
+//  the next tile is being computed. If more than one suitable GPU is available, the tiles can
+//  be spread over them, with a thread and a compute handler (with its own Vulkan framework)
+//  for each GPU, each taking the next tile to be done from a TileQueue as it becomes free.
+//  The output file is memory mapped, using a MappedFile (see TiledImage.h), so each tile is
+//  copied straight into its place in the file, and the image never has to fit in memory.
+//
+//  For the largest posters and movies, the tiles can also be shared between the GPUs of many
+//  machines. One MandelTiles, the coordinator, is run with Serve set to a port number. Others,
+//  the workers, are run on the other machines with Worker set to the coordinator's host and
+//  that port, and connect to it over TCP, once for each of their GPUs. The coordinator hands
+//  out the tiles to its own GPUs and to the workers' as each becomes free, and writes the ones
+//  the workers send back into the output file. The workers set up their GPUs once, and then
+//  compute whatever tiles they are sent, for every frame, until the coordinator is done. A
+//  worker that fails, or takes longer than Timeout seconds over a tile, is dropped and its tile
+//  given to another, and towards the end of a frame a tile still being worked on may be given
+//  to an idle worker as well, so one slow GPU doesn't hold up the frame. See TileFarm.h.
+//
+//  For movies whose frames fit in a single tile, the frames can instead be computed in
+//  batches. Each GPU takes Batch consecutive frames at a time and has its compute handler
+//  compute them all in one submission, each with its own arguments and its own buffer, so the
+//  GPU goes straight from one frame to the next rather than waiting for the CPU between them.
+//  Each frame is then written to its file by a writer thread of its own, which carries on while
+//  the GPU computes the next batch.
+//
+//  The output file is either a 16-bit binary PGM file, if its name ends in ".pgm", with the
+//  iteration counts clipped to 65535, or otherwise simply the raw iteration counts as 32-bit
+//  unsigned integers, row by row, with no header.
+//
+//  Running:
+//      ./MandelTiles <Nx> <Ny> <XCent> <YCent> <Magnification> <Iter> <Output> <Tile>
+//                            <GPUs> <Frames> <Zoom> <Validate> <Debug>
+//                            <Serve> <Workers> <Worker> <Timeout> <Spin> <Batch>
+//
+//  where:
+//      Nx        (integer) is the size of the complete image in X. Default 8192.
+//      Ny        (integer) is the size of the complete image in Y. Default 8192.
+//      XCent     (real) is the X-coordinate of the centre of the image. Default -0.5.
+//      YCent     (real) is the Y-coordinate of the centre of the image. Default 0.0.
+//      Magnification (real) is the magnification, 1.0 showing the range -1..1 in X. Default 1.
+//      Iter      (integer) is the maximum number of iterations for the calculation. Default 1024.
+//      Output    (string) is the name of the output file. Default "Mandel.pgm".
+//      Tile      (integer) is the size in X and Y of the tiles computed. Default 4096.
+//      GPUs      (integer) is the maximum number of GPUs to use. Default 1. This can be 0
+//                for a coordinator, which then leaves all the tiles to its workers.
+//      Frames    (integer) is the number of frames to generate. Default 1.
+//      Zoom      (real) is the factor by which the magnification changes each frame. Default 1.1.
+//      Validate  (boolean) is true to enable the Vulkan validation layers. Default false.
+//      Debug     (string) is a comma-separated list of hierarchical debugging options. Default "".
+//      Serve     (integer) is the port on which a coordinator listens for workers. Default 0,
+//                which means this isn't a coordinator.
+//      Workers   (integer) is the number of workers a coordinator waits for before starting.
+//                Default 0. Workers that connect later join in from the next frame.
+//      Worker    (string) is the host:port of the coordinator, for a worker. Default "", which
+//                means this isn't a worker. A worker ignores all but GPUs, Timeout, Validate
+//                and Debug, as the coordinator sends it the details of each tile.
+//      Timeout   (real) is the longest, in seconds, a coordinator waits for a worker to finish a
+//                tile, and a worker waits for the coordinator to start. Default 300.
+//      Spin      (integer) is the time, in microseconds, for which each GPU's waits for its
+//                dispatches to complete poll before blocking. With small tiles, the time it
+//                takes to wake a blocked thread can be a noticeable part of each tile. Default
+//                0, which blocks at once. The number of waits and the time they took are listed
+//                for each GPU at the end, so the two can be compared.
+//      Batch     (integer) is the number of frames each GPU computes in one submission. Default
+//                1, which computes one at a time. Batches can only be used when the image fits
+//                in a single tile, and not by a coordinator or a worker. A frame that needs
+//                perturbation, or the CPU, is still computed on its own. At most 16.
+//
+//  If more than one frame is generated, the frame number is added to the output file name,
+//  just before any extension, eg Mandel_0000.pgm, Mandel_0001.pgm, etc.
+//
+//  History:
+//      15th Oct 2026. Original version. KS.
+//                     Tiles now hold the uint32_t iteration counts from the handler. KS.
+//                     Now uses TileGrid and TileQueue, and writes the tiles into a memory
+//                     mapped output file. KS.
+//                     Added the coordinator and worker modes, with the Serve, Workers, Worker
+//                     and Timeout parameters, using FarmQueue and FarmLink from TileFarm.h. KS.
+//                     Added the Spin parameter, and the listing of the GPU waits. KS.
+//                     Added the Batch parameter, with ComputeBatches() computing each batch of
+//                     frames in one submission. ComputeTile() now uses PlaceTile(). KS.
+
+#include "MandelComputeHandlerVulkan.h"
+#include "KVVulkanFramework.h"
+#include "CommandHandler.h"
+#include "MsecTimer.h"
+#include "TiledImage.h"
+#include "TileFarm.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <memory>
+
+//  The maximum number of computed tiles allowed to wait for the writer, per GPU.
+
+static const int C_TilesQueuedPerGPU = 2;
+
+//  How often, in msec, a coordinator waiting for a worker's tile checks whether another copy of
+//  the tile has been finished, and its listening socket checks for new workers.
+
+static const unsigned int C_FarmPollMsec = 100;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  T i l e  W r i t e r
+//
+//  A TileWriter writes the tiles of an image into the output file, in a thread of its own. The
+//  compute threads pass it tiles using Queue(), which blocks if too many tiles are already
+//  waiting to be written, so the amount of memory used stays bounded however large the image.
+//  The file is memory mapped, so writing a tile is just a matter of converting its values into
+//  their places in the file, which the system then writes back in its own time.
+
+class TileWriter
+{
+public:
+    TileWriter(const std::string& FileName,int Nx,int Ny,int MaxQueued);
+    ~TileWriter();
+    //  Returns true if the output file was created successfully.
+    bool IsOpen(void) { return _file.Address() != nullptr; }
+    //  Returns an explanation of any problem with the output file.
+    const std::string& GetError(void) const { return _file.GetError(); }
+    //  Queues a tile of TileNx by TileNy pixels, to be written at (Ix,Iy) in the image.
+    void Queue(const uint32_t* Data,int Ix,int Iy,int TileNx,int TileNy);
+    //  Waits for all queued tiles to be written, closes the file, and returns true if all was OK.
+    bool Finish(void);
+private:
+    struct Tile {
+        int Ix,Iy,Nx,Ny;
+        std::vector<uint32_t> Data;
+    };
+    void WriteTiles(void);
+    void WriteTile(const Tile& TheTile);
+    MappedFile _file;
+    bool _pgm;
+    size_t _headerBytes;
+    int _nx;
+    int _ny;
+    int _maxQueued;
+    bool _finished;
+    bool _writeOK;
+    std::deque<Tile> _tiles;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+};
+
+TileWriter::TileWriter(const std::string& FileName,int Nx,int Ny,int MaxQueued)
+{
+    _nx = Nx;
+    _ny = Ny;
+    _maxQueued = MaxQueued;
+    _finished = false;
+    _writeOK = true;
+    _headerBytes = 0;
+    std::string Ext = FileName.size() > 4 ? FileName.substr(FileName.size() - 4) : "";
+    std::transform(Ext.begin(),Ext.end(),Ext.begin(),::tolower);
+    _pgm = (Ext == ".pgm");
+    std::string Header = "";
+    if (_pgm) {
+        Header = "P5\n" + std::to_string(Nx) + " " + std::to_string(Ny) + "\n65535\n";
+    }
+    _headerBytes = Header.size();
+    uint64_t Bytes = _headerBytes + uint64_t(Nx) * uint64_t(Ny) * (_pgm ? 2 : 4);
+    if (_file.Create(FileName,Bytes)) {
+        memcpy(_file.Address(),Header.data(),_headerBytes);
+        _thread = std::thread(&TileWriter::WriteTiles,this);
+    }
+}
+
+TileWriter::~TileWriter()
+{
+    Finish();
+}
+
+void TileWriter::Queue(const uint32_t* Data,int Ix,int Iy,int TileNx,int TileNy)
+{
+    std::unique_lock<std::mutex> Lock(_mutex);
+    _condition.wait(Lock,[this]{ return int(_tiles.size()) < _maxQueued; });
+    _tiles.push_back(Tile{Ix,Iy,TileNx,TileNy,
+                          std::vector<uint32_t>(Data,Data + size_t(TileNx) * TileNy)});
+    _condition.notify_all();
+}
+
+bool TileWriter::Finish(void)
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lock(_mutex);
+            _finished = true;
+        }
+        _condition.notify_all();
+        _thread.join();
+    }
+    if (_file.Address()) {
+        if (!_file.Close()) _writeOK = false;
+    }
+    return _writeOK;
+}
+
+void TileWriter::WriteTiles(void)
+{
+    for (;;) {
+        Tile TheTile;
+        {
+            std::unique_lock<std::mutex> Lock(_mutex);
+            _condition.wait(Lock,[this]{ return _finished || !_tiles.empty(); });
+            if (_tiles.empty()) break;
+            TheTile = std::move(_tiles.front());
+            _tiles.pop_front();
+        }
+        _condition.notify_all();
+        WriteTile(TheTile);
+    }
+}
+
+void TileWriter::WriteTile(const Tile& TheTile)
+{
+    //  Only the part of the tile that lies inside the image is written - tiles along the right
+    //  and bottom edges usually extend beyond it. PGM values are big-endian.
+
+    int Cols = std::min(TheTile.Nx,_nx - TheTile.Ix);
+    int Rows = std::min(TheTile.Ny,_ny - TheTile.Iy);
+    int PixelBytes = _pgm ? 2 : 4;
+    for (int Iy = 0; Iy < Rows; Iy++) {
+        const uint32_t* Values = TheTile.Data.data() + size_t(Iy) * TheTile.Nx;
+        char* Row = _file.Address() + _headerBytes +
+                        (size_t(TheTile.Iy + Iy) * _nx + TheTile.Ix) * PixelBytes;
+        if (_pgm) {
+            for (int Ix = 0; Ix < Cols; Ix++) {
+                uint32_t Value = std::min(Values[Ix],uint32_t(65535));
+                Row[Ix * 2] = char(Value >> 8);
+                Row[Ix * 2 + 1] = char(Value & 0xff);
+            }
+        } else {
+            memcpy(Row,Values,size_t(Cols) * PixelBytes);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                      G P U  T i l e s
+//
+//  ComputeTiles() is run in a separate thread for each GPU in use, with its own compute handler.
+//  It takes tiles from the shared tile queue until all have been done, computing each with
+//  ComputeTile(). A tile may also have been given to a worker, in which case only the copy
+//  finished first is written.
+
+struct TileJob {
+    int Nx,Ny;              // Dimensions of the full image.
+    double XCent,YCent;     // Centre of the full image.
+    double Magnification;   // Magnification of the full image.
+    int TileSize;           // Dimension of each (square) tile.
+    int Iter;               // Iteration limit.
+    int Frame;              // Frame number.
+    unsigned int TimeoutMsec; // Longest to wait for a worker's tile.
+    const TileGrid* Grid;   // The tiles of the image.
+    FarmQueue* Queue;       // Hands out the tiles to be done.
+    TileWriter* Writer;
+};
+
+//  TileDetails() returns the details of a tile as they are sent to a worker. ComputeTile() works
+//  from these for all tiles, so a worker computes a tile just as the coordinator would.
+
+FarmJob TileDetails(const TileJob* Job,int Tile)
+{
+    ImageTile TheTile = Job->Grid->Tile(Tile);
+    FarmJob Details;
+    Details.Magic = FarmLink::C_Magic;
+    Details.Frame = Job->Frame;
+    Details.Tile = Tile;
+    Details.Nx = Job->Nx;
+    Details.Ny = Job->Ny;
+    Details.TileSize = Job->TileSize;
+    Details.Ix = TheTile.X;
+    Details.Iy = TheTile.Y;
+    Details.Iter = Job->Iter;
+    Details.XCent = Job->XCent;
+    Details.YCent = Job->YCent;
+    Details.Magnification = Job->Magnification;
+    return Details;
+}
+
+//  PlaceTile() sets the compute handler's centre and magnification for a tile. The handler's
+//  image size has to match the tile size.
+
+void PlaceTile(MandelComputeHandler* Handler,const FarmJob& Details)
+{
+    int TileSize = Details.TileSize;
+    double Dx = 2.0 / (Details.Magnification * Details.Nx);
+    Handler->SetMagnification(Details.Magnification * double(Details.Nx) / double(TileSize));
+
+    //  The shaders put the centre of the image at pixel (Nx/2,Ny/2), so the centre of the
+    //  tile is offset from that of the full image by the distance between the two in pixels.
+    //  The handler always computes a full square tile, even where the grid's tile is cut
+    //  short by the edge of the image - the writer ignores the part outside it.
+
+    Handler->SetCentre(Details.XCent,Details.YCent);
+    Handler->OffsetCentre((Details.Ix + TileSize * 0.5 - Details.Nx * 0.5) * Dx,
+                          (Details.Iy + TileSize * 0.5 - Details.Ny * 0.5) * Dx);
+}
+
+//  ComputeTile() computes a tile with the fastest precision that is good enough at the
+//  magnification of the image.
+
+void ComputeTile(MandelComputeHandler* Handler,const FarmJob& Details)
+{
+    PlaceTile(Handler,Details);
+    if (Handler->FloatOK()) {
+        Handler->Compute();
+    } else if (Handler->DoubleOK() && Handler->GPUSupportsDouble()) {
+        Handler->ComputeDouble();
+    } else if (Handler->FloatFloatOK()) {
+        Handler->ComputeFloatFloat();
+    } else if (Handler->PerturbedOK()) {
+        Handler->ComputePerturbed();
+    } else {
+        Handler->ComputeInC();
+    }
+}
+
+void ComputeTiles(MandelComputeHandler* Handler,TileJob* Job,int* TileCount)
+{
+    int Tile;
+    while (Job->Queue->Next(&Tile)) {
+        FarmJob Details = TileDetails(Job,Tile);
+        ComputeTile(Handler,Details);
+        if (Job->Queue->Done(Tile)) {
+            Job->Writer->Queue(Handler->GetImageData(),Details.Ix,Details.Iy,
+                                                             Job->TileSize,Job->TileSize);
+            (*TileCount)++;
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  F r a m e  B a t c h e s
+//
+//  With Batch set, ComputeBatches() is run in a separate thread for each GPU instead of
+//  ComputeTiles(). Each frame is a single tile, and it takes batches of consecutive frames from
+//  a queue, having the compute handler compute all those it can in one submission, using
+//  ComputeFrames(). Each frame gets a TileWriter of its own, and the writers for a batch are
+//  only finished once the next batch has been computed, so writing the files overlaps the GPU's
+//  work on the next frames.
+
+struct BatchJob {
+    TileJob Frame;          // The details common to every frame. Frame.Frame is not used.
+    double Zoom;            // Zoom factor for each frame.
+    int Frames;             // Number of frames.
+    int Batch;              // Number of frames in each batch.
+    std::string Output;     // The output file name, before the frame number is added.
+    TileQueue* Queue;       // Hands out the batches.
+    std::atomic<bool> Failed; // Set if any frame couldn't be computed or written.
+};
+
+//  A frame's output file name, and the writer writing the frame into it.
+
+struct FrameWriter {
+    std::string FileName;
+    std::unique_ptr<TileWriter> Writer;
+};
+
+//  FrameFileName() returns the name of the output file for a frame. If there is more than one
+//  frame, the frame number is added to the name, just before any extension.
+
+std::string FrameFileName(const std::string& Output,int Frame,int Frames)
+{
+    std::string FileName = Output;
+    if (Frames > 1) {
+        char Number[16];
+        snprintf(Number,sizeof(Number),"_%04d",Frame);
+        size_t Dot = FileName.find_last_of('.');
+        if (Dot == std::string::npos || FileName.find_last_of("/\\") > Dot) {
+            Dot = FileName.size();
+        }
+        FileName.insert(Dot,Number);
+    }
+    return FileName;
+}
+
+//  BatchPrecision() returns the precision ComputeTile() would use for the tile the handler has
+//  been set up for by PlaceTile(), if it's one ComputeFrames() can use, and false if not.
+
+bool BatchPrecision(MandelComputeHandler* Handler,MandelComputeHandler::GPUPrecision* Precision)
+{
+    if (Handler->FloatOK()) {
+        *Precision = MandelComputeHandler::GPU_FLOAT;
+    } else if (Handler->DoubleOK() && Handler->GPUSupportsDouble()) {
+        *Precision = MandelComputeHandler::GPU_DOUBLE;
+    } else if (Handler->FloatFloatOK()) {
+        *Precision = MandelComputeHandler::GPU_FLOAT_FLOAT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//  FinishFrames() waits for the given writers to finish writing their frames, and clears them.
+
+void FinishFrames(BatchJob* Job,std::vector<FrameWriter>& Writers)
+{
+    for (FrameWriter& Frame : Writers) {
+        if (!Frame.Writer->Finish()) {
+            printf ("Error writing to output file '%s'.\n",Frame.FileName.c_str());
+            Job->Failed = true;
+        }
+    }
+    Writers.clear();
+}
+
+void ComputeBatches(MandelComputeHandler* Handler,BatchJob* Job,int* FrameCount)
+{
+    const TileJob& Common = Job->Frame;
+    std::vector<FrameWriter> LastWriters;
+    int Batch;
+    while (!Job->Failed && Job->Queue->Next(&Batch)) {
+        int First = Batch * Job->Batch;
+        int Last = std::min(First + Job->Batch,Job->Frames);
+        std::vector<FrameWriter> Writers;
+        std::vector<MandelComputeHandler::FrameDetails> Frames;
+        std::vector<TileWriter*> BatchedWriters;
+        for (int Frame = First; Frame < Last; Frame++) {
+            FrameWriter Output;
+            Output.FileName = FrameFileName(Job->Output,Frame,Job->Frames);
+            Output.Writer.reset(new TileWriter(Output.FileName,Common.Nx,Common.Ny,1));
+            if (!Output.Writer->IsOpen()) {
+                printf ("Unable to create output file: %s.\n",
+                                                      Output.Writer->GetError().c_str());
+                Job->Failed = true;
+                break;
+            }
+            FarmJob Details = TileDetails(&Common,0);
+            Details.Frame = Frame;
+            Details.Magnification = Common.Magnification * pow(Job->Zoom,Frame);
+            
+            //  A frame ComputeFrames() can't handle is computed now, on its own.
+            
+            MandelComputeHandler::GPUPrecision Precision;
+            PlaceTile(Handler,Details);
+            if (BatchPrecision(Handler,&Precision)) {
+                MandelComputeHandler::FrameDetails Batched;
+                Handler->GetCentre(&Batched.XCent,&Batched.YCent);
+                Batched.Magnification = Handler->GetMagnification();
+                Batched.Precision = Precision;
+                Frames.push_back(Batched);
+                BatchedWriters.push_back(Output.Writer.get());
+            } else {
+                ComputeTile(Handler,Details);
+                Output.Writer->Queue(Handler->GetImageData(),0,0,Common.TileSize,
+                                                                           Common.TileSize);
+            }
+            Writers.push_back(std::move(Output));
+        }
+        if (!Job->Failed && !Frames.empty()) {
+            if (Handler->ComputeFrames(Frames)) {
+                for (size_t I = 0; I < BatchedWriters.size(); I++) {
+                    BatchedWriters[I]->Queue(Handler->GetFrameData(int(I)),0,0,
+                                                           Common.TileSize,Common.TileSize);
+                }
+            } else {
+                printf ("Unable to compute frames %d to %d.\n",First,Last - 1);
+                Job->Failed = true;
+            }
+        }
+        if (!Job->Failed) *FrameCount += int(Writers.size());
+        FinishFrames(Job,LastWriters);
+        LastWriters = std::move(Writers);
+    }
+    FinishFrames(Job,LastWriters);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                   R e m o t e  T i l e s
+//
+//  RemoteTiles() is the coordinator's equivalent of ComputeTiles() for one worker's GPU, run in
+//  a thread of its own. It sends the worker each tile it takes from the queue and waits for the
+//  result - unless another copy of the tile is finished first. If the link fails, or the tile
+//  takes too long, the tile is handed back to be retried, and the worker is dropped.
+
+void RemoteTiles(FarmLink* Link,TileJob* Job,int* TileCount)
+{
+    std::vector<uint32_t> Data;
+    int Tile;
+    while (Job->Queue->Next(&Tile,true)) {
+        FarmJob Details = TileDetails(Job,Tile);
+        bool Finished = Link->SendJob(Details) &&
+                            Link->ReadResult(Details,Data,Job->TimeoutMsec,C_FarmPollMsec,
+                                               [&]{ return Job->Queue->IsDone(Tile); });
+        if (Finished) {
+            if (Job->Queue->Done(Tile)) {
+                Job->Writer->Queue(Data.data(),Details.Ix,Details.Iy,
+                                                             Job->TileSize,Job->TileSize);
+                (*TileCount)++;
+            }
+        } else {
+            Job->Queue->Retry(Tile);
+            if (!Link->IsOpen()) {
+                printf ("Worker %s dropped: %s.\n",Link->Peer().c_str(),
+                                                                  Link->GetError().c_str());
+                return;
+            }
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 F a r m  W o r k e r s
+//
+//  The coordinator accepts workers' connections at any time, using AcceptWorkers() in a thread
+//  of its own. Each connection is one worker GPU. Links that have failed are removed by
+//  ActiveWorkers(), which returns those left at the start of each frame.
+
+struct FarmWorkers {
+    int ListenFd;
+    std::atomic<bool> Stop;
+    std::vector<FarmLink*> Links;
+    std::mutex Mutex;
+    std::condition_variable Condition;
+};
+
+void AcceptWorkers(FarmWorkers* Workers)
+{
+    while (!Workers->Stop) {
+        FarmLink* Link = FarmLink::Accept(Workers->ListenFd,C_FarmPollMsec);
+        if (Link) {
+            std::lock_guard<std::mutex> Lock(Workers->Mutex);
+            Workers->Links.push_back(Link);
+            printf ("Worker %s connected.\n",Link->Peer().c_str());
+            Workers->Condition.notify_all();
+        }
+    }
+}
+
+std::vector<FarmLink*> ActiveWorkers(FarmWorkers* Workers)
+{
+    std::lock_guard<std::mutex> Lock(Workers->Mutex);
+    std::vector<FarmLink*> Active;
+    for (FarmLink* Link : Workers->Links) {
+        if (Link->IsOpen()) Active.push_back(Link);
+        else delete Link;
+    }
+    Workers->Links = Active;
+    return Active;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  R u n  W o r k e r
+//
+//  RunWorker() is run by a worker in a separate thread for each of its GPUs. It connects to the
+//  coordinator - trying again every second until TimeoutMsec is up, in case the coordinator
+//  hasn't started yet - and computes each tile it is sent, until the coordinator says there
+//  are no more, or goes away. The compute handler's image size and iteration limit only change
+//  if the coordinator's do.
+
+void RunWorker(MandelComputeHandler* Handler,std::string Address,unsigned int TimeoutMsec,
+                                                                              int* TileCount)
+{
+    FarmLink* Link = nullptr;
+    std::string Error;
+    for (unsigned int Waited = 0; Link == nullptr; Waited += 1000) {
+        Link = FarmLink::Connect(Address,Error);
+        if (Link == nullptr) {
+            if (Waited >= TimeoutMsec) {
+                printf ("%s.\n",Error.c_str());
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+    int TileSize = 0;
+    int Iter = 0;
+    FarmJob Details;
+    while (Link->ReadJob(&Details) && Details.Tile >= 0) {
+        if (Details.TileSize != TileSize) {
+            TileSize = Details.TileSize;
+            Handler->SetImageSize(TileSize,TileSize);
+            Handler->SetAspect(TileSize,TileSize);
+        }
+        if (Details.Iter != Iter) {
+            Iter = Details.Iter;
+            Handler->SetMaxIter(Iter);
+        }
+        ComputeTile(Handler,Details);
+        if (!Link->SendResult(Details,Handler->GetImageData())) break;
+        (*TileCount)++;
+    }
+    if (!Link->IsOpen()) printf ("Link to coordinator lost: %s.\n",Link->GetError().c_str());
+    delete Link;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                       M a i n
+//
+//  The main routine gets the values of the command line parameters, sets up a Vulkan framework
+//  and a compute handler for each GPU to be used, and then has them work through the tiles of
+//  each frame in turn, with the results written out by a TileWriter. A coordinator's workers
+//  join in, each with a RemoteTiles() thread for each of its GPUs. A worker just has its GPUs
+//  compute the tiles it is sent.
+
+int main(int Argc,char* Argv[])
+{
+    CmdHandler TheHandler("MandelTiles");
+    int Posn = 1;
+    IntArg NxArg(TheHandler,"Nx",Posn++,"",8192,16,1024*1024,"X-dimension of complete image");
+    IntArg NyArg(TheHandler,"Ny",Posn++,"",8192,16,1024*1024,"Y-dimension of complete image");
+    RealArg XCentArg(TheHandler,"XCent",Posn++,"",-0.5,-2.0,2.0,"X-coordinate of image centre");
+    RealArg YCentArg(TheHandler,"YCent",Posn++,"",0.0,-2.0,2.0,"Y-coordinate of image centre");
+    RealArg MagArg(TheHandler,"Magnification",Posn++,"",1.0,1.0e-3,1.0e30,"Magnification");
+    IntArg IterArg(TheHandler,"Iter",Posn++,"",1024,16,1024*1024,"Iteration limit");
+    StringArg OutputArg(TheHandler,"Output",Posn++,"","Mandel.pgm","Output file");
+    IntArg TileArg(TheHandler,"Tile",Posn++,"",4096,64,16384,"Dimension of each tile");
+    IntArg GPUsArg(TheHandler,"GPUs",Posn++,"",1,0,64,"Maximum number of GPUs to use");
+    IntArg FramesArg(TheHandler,"Frames",Posn++,"",1,1,100000,"Number of frames");
+    RealArg ZoomArg(TheHandler,"Zoom",Posn++,"",1.1,0.1,10.0,"Zoom factor for each frame");
+    BoolArg ValidateArg(TheHandler,"Validate",0,"",false,"Enable Vulkan validation layers");
+    StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
+    IntArg ServeArg(TheHandler,"Serve",0,"",0,0,65535,"Port on which to listen for workers");
+    IntArg WorkersArg(TheHandler,"Workers",0,"",0,0,4096,"Number of workers to wait for");
+    StringArg WorkerArg(TheHandler,"Worker",0,"","","Coordinator host:port, for a worker");
+    RealArg TimeoutArg(TheHandler,"Timeout",0,"",300.0,1.0,1.0e5,"Timeout for a tile, in sec");
+    IntArg SpinArg(TheHandler,"Spin",0,"",0,0,1000000,"Usec to poll GPU before blocking");
+    IntArg BatchArg(TheHandler,"Batch",0,"",1,1,MandelComputeHandler::MaxBatchFrames(),
+                                                             "Frames per GPU submission");
+    if (TheHandler.IsInteractive()) TheHandler.ReadPrevious();
+    std::string Error = "";
+
+    //  Parse the command line and get the various parameter values.
+
+    bool Ok = TheHandler.ParseArgs(Argc,Argv);
+    int Nx = NxArg.GetValue(&Ok,&Error);
+    int Ny = NyArg.GetValue(&Ok,&Error);
+    double XCent = XCentArg.GetValue(&Ok,&Error);
+    double YCent = YCentArg.GetValue(&Ok,&Error);
+    double Magnification = MagArg.GetValue(&Ok,&Error);
+    int Iter = IterArg.GetValue(&Ok,&Error);
+    std::string Output = OutputArg.GetValue(&Ok,&Error);
+    int TileSize = TileArg.GetValue(&Ok,&Error);
+    int MaxGPUs = GPUsArg.GetValue(&Ok,&Error);
+    int Frames = FramesArg.GetValue(&Ok,&Error);
+    double Zoom = ZoomArg.GetValue(&Ok,&Error);
+    bool Validate = ValidateArg.GetValue(&Ok,&Error);
+    std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
+    int ServePort = ServeArg.GetValue(&Ok,&Error);
+    int WaitWorkers = WorkersArg.GetValue(&Ok,&Error);
+    std::string Coordinator = WorkerArg.GetValue(&Ok,&Error);
+    double Timeout = TimeoutArg.GetValue(&Ok,&Error);
+    int Spin = SpinArg.GetValue(&Ok,&Error);
+    int Batch = BatchArg.GetValue(&Ok,&Error);
+
+    if (!Ok) {
+        if (!TheHandler.ExitRequested()) {
+            printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
+        }
+        return 1;
+    }
+    if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
+    if (MaxGPUs == 0 && ServePort == 0) {
+        printf ("Only a coordinator can be run with no GPUs.\n");
+        return 1;
+    }
+    if (ServePort > 0 && Coordinator != "") {
+        printf ("A program can be a coordinator or a worker, but not both.\n");
+        return 1;
+    }
+    unsigned int TimeoutMsec = (unsigned int)(Timeout * 1000.0);
+
+    //  A worker or a coordinator shouldn't be killed by SIGPIPE when the other end of a link
+    //  goes away. The failed write is noticed instead.
+
+    if (ServePort > 0 || Coordinator != "") signal(SIGPIPE,SIG_IGN);
+
+    //  There's no point in a tile larger than the image. Tiles are square, so the scale of
+    //  their pixels is the same in X and Y, as it is for the full image.
+
+    TileSize = std::min(TileSize,std::max(Nx,Ny));
+    if (Batch > 1 && (TileSize < std::max(Nx,Ny) || ServePort > 0 || Coordinator != "")) {
+        printf ("Batch can only be used if the image fits in one tile, without workers.\n");
+        return 1;
+    }
+
+    //  Find out how many suitable GPUs there are, then create a framework for each of those to
+    //  be used, each with its own logical device and each driven by its own compute handler.
+    //  No graphics are involved, so EnableGraphics() is never called.
+
+    bool StatusOK = true;
+    int NumberGPUs = 0;
+    if (MaxGPUs > 0) {
+        KVVulkanFramework Probe;
+        Probe.SetDebugSystemName("VulkanProbe");
+        Probe.CreateVulkanInstance(StatusOK);
+        if (StatusOK) NumberGPUs = std::min(MaxGPUs,Probe.CountSuitableDevices(StatusOK));
+        NumberGPUs = std::max(NumberGPUs,1);
+        Probe.CleanupVulkan();
+    }
+    std::vector<KVVulkanFramework*> Frameworks;
+    std::vector<MandelComputeHandler*> Handlers;
+    for (int Rank = 0; StatusOK && Rank < NumberGPUs; Rank++) {
+        KVVulkanFramework* Framework = new KVVulkanFramework;
+        Framework->SetDebugSystemName("VulkanCompute" + std::to_string(Rank));
+        Framework->SetDebugLevels(DebugLevels);
+        Framework->EnableValidation(Validate);
+        Framework->CreateVulkanInstance(StatusOK);
+        Framework->FindSuitableDevice(Rank,StatusOK);
+        Framework->CreateLogicalDevice(StatusOK);
+        Framework->SetWaitSpin(unsigned(Spin));
+        Frameworks.push_back(Framework);
+        if (StatusOK) {
+            MandelComputeHandler* Handler = new MandelComputeHandler(Framework);
+            Handler->Initialise(Validate,DebugLevels);
+            Handler->SetImageSize(TileSize,TileSize);
+            Handler->SetAspect(TileSize,TileSize);
+            Handler->SetMaxIter(Iter);
+            Handler->SetImageCacheLimit(0);
+            Handlers.push_back(Handler);
+        }
+    }
+    if (!StatusOK) printf ("Unable to set up Vulkan for all the GPUs requested.\n");
+
+    //  A worker has each of its GPUs connect to the coordinator and compute the tiles it sends,
+    //  and that's all.
+
+    if (StatusOK && Coordinator != "") {
+        std::vector<int> TileCounts(Handlers.size(),0);
+        std::vector<std::thread> Threads;
+        for (size_t I = 0; I < Handlers.size(); I++) {
+            Threads.push_back(std::thread(RunWorker,Handlers[I],Coordinator,TimeoutMsec,
+                                                                           &TileCounts[I]));
+        }
+        for (auto& Thread : Threads) Thread.join();
+        printf ("Worker for %s finished.",Coordinator.c_str());
+        for (size_t I = 0; I < Handlers.size(); I++) {
+            printf (" GPU %d: %d tiles",int(I),TileCounts[I]);
+        }
+        printf ("\n");
+        Frames = 0;
+    }
+
+    //  A coordinator starts listening for workers, and waits for as many as it was told to
+    //  expect. More can join at any time.
+
+    FarmWorkers Workers;
+    Workers.ListenFd = -1;
+    Workers.Stop = false;
+    std::thread Acceptor;
+    if (StatusOK && ServePort > 0) {
+        std::string ListenError;
+        Workers.ListenFd = FarmLink::Listen(ServePort,ListenError);
+        if (Workers.ListenFd < 0) {
+            printf ("%s.\n",ListenError.c_str());
+            StatusOK = false;
+        } else {
+            Acceptor = std::thread(AcceptWorkers,&Workers);
+            if (WaitWorkers > 0) {
+                printf ("Waiting for %d workers on port %d.\n",WaitWorkers,ServePort);
+                std::unique_lock<std::mutex> Lock(Workers.Mutex);
+                Workers.Condition.wait(Lock,[&]{
+                    return int(Workers.Links.size()) >= WaitWorkers; });
+            }
+        }
+    }
+
+    //  With Batch set, the frames are computed in batches, the batches being shared between
+    //  the GPUs, and that's all.
+
+    TileGrid Grid(Nx,Ny,TileSize,TileSize);
+    if (StatusOK && Batch > 1) {
+        BatchJob Job;
+        Job.Frame.Nx = Nx;
+        Job.Frame.Ny = Ny;
+        Job.Frame.XCent = XCent;
+        Job.Frame.YCent = YCent;
+        Job.Frame.Magnification = Magnification;
+        Job.Frame.TileSize = TileSize;
+        Job.Frame.Iter = Iter;
+        Job.Frame.Frame = 0;
+        Job.Frame.TimeoutMsec = TimeoutMsec;
+        Job.Frame.Grid = &Grid;
+        Job.Frame.Queue = nullptr;
+        Job.Frame.Writer = nullptr;
+        Job.Zoom = Zoom;
+        Job.Frames = Frames;
+        Job.Batch = Batch;
+        Job.Output = Output;
+        TileQueue Queue((Frames + Batch - 1) / Batch);
+        Job.Queue = &Queue;
+        Job.Failed = false;
+        MsecTimer Timer;
+        std::vector<int> FrameCounts(Handlers.size(),0);
+        std::vector<std::thread> Threads;
+        for (size_t I = 0; I < Handlers.size(); I++) {
+            Threads.push_back(std::thread(ComputeBatches,Handlers[I],&Job,&FrameCounts[I]));
+        }
+        for (auto& Thread : Threads) Thread.join();
+        if (Job.Failed) StatusOK = false;
+        printf ("%d frames of %d x %d, in batches of %d, %.1f sec.",Frames,Nx,Ny,Batch,
+                                                                 Timer.ElapsedMsec() * 0.001);
+        if (Handlers.size() > 1) {
+            for (size_t I = 0; I < Handlers.size(); I++) {
+                printf (" GPU %d: %d",int(I),FrameCounts[I]);
+            }
+        }
+        printf ("\n");
+        Frames = 0;
+    }
+
+    //  Otherwise, compute each frame in turn, the tiles of each being shared between the GPUs.
+
+    for (int Frame = 0; StatusOK && Frame < Frames; Frame++) {
+        std::vector<FarmLink*> Links;
+        if (Workers.ListenFd >= 0) Links = ActiveWorkers(&Workers);
+        int Computers = int(Handlers.size() + Links.size());
+        if (Computers == 0) {
+            printf ("There are no GPUs left to compute the tiles.\n");
+            StatusOK = false;
+            break;
+        }
+        std::string FileName = FrameFileName(Output,Frame,Frames);
+        TileWriter Writer(FileName,Nx,Ny,C_TilesQueuedPerGPU * Computers);
+        if (!Writer.IsOpen()) {
+            printf ("Unable to create output file: %s.\n",Writer.GetError().c_str());
+            StatusOK = false;
+            break;
+        }
+        TileJob Job;
+        Job.Nx = Nx;
+        Job.Ny = Ny;
+        Job.XCent = XCent;
+        Job.YCent = YCent;
+        Job.Magnification = Magnification * pow(Zoom,Frame);
+        Job.TileSize = TileSize;
+        Job.Iter = Iter;
+        Job.Frame = Frame;
+        Job.TimeoutMsec = TimeoutMsec;
+        FarmQueue Queue(Grid.Count());
+        Job.Grid = &Grid;
+        Job.Queue = &Queue;
+        Job.Writer = &Writer;
+        MsecTimer Timer;
+        std::vector<int> TileCounts(Computers,0);
+        std::vector<std::thread> Threads;
+        for (size_t I = 0; I < Handlers.size(); I++) {
+            Threads.push_back(std::thread(ComputeTiles,Handlers[I],&Job,&TileCounts[I]));
+        }
+        for (size_t I = 0; I < Links.size(); I++) {
+            Threads.push_back(std::thread(RemoteTiles,Links[I],&Job,
+                                                         &TileCounts[Handlers.size() + I]));
+        }
+        for (auto& Thread : Threads) Thread.join();
+        if (!Queue.IsDone()) {
+            printf ("Not all the tiles could be computed - all the workers failed.\n");
+            StatusOK = false;
+        }
+        if (!Writer.Finish()) {
+            printf ("Error writing to output file '%s'.\n",FileName.c_str());
+            StatusOK = false;
+        }
+        printf ("%s: %d x %d, magnification %g, %d tiles, %.1f sec.",FileName.c_str(),
+                      Nx,Ny,Job.Magnification,Grid.Count(),Timer.ElapsedMsec() * 0.001);
+        if (Computers > 1) {
+            for (size_t I = 0; I < Handlers.size(); I++) {
+                printf (" GPU %d: %d",int(I),TileCounts[I]);
+            }
+            for (size_t I = 0; I < Links.size(); I++) {
+                printf (" %s: %d",Links[I]->Peer().c_str(),TileCounts[Handlers.size() + I]);
+            }
+        }
+        printf ("\n");
+    }
+
+    //  A coordinator tells its workers there are no more tiles, and stops listening.
+
+    if (Acceptor.joinable()) {
+        Workers.Stop = true;
+        Acceptor.join();
+        FarmJob Stop = FarmJob();
+        Stop.Tile = -1;
+        for (FarmLink* Link : ActiveWorkers(&Workers)) {
+            Link->SendJob(Stop);
+            delete Link;
+        }
+        Workers.Links.clear();
+    }
+    if (Workers.ListenFd >= 0) close(Workers.ListenFd);
+
+    //  List the waits each GPU made for its dispatches, so blocking and polling can be compared.
+
+    for (size_t I = 0; I < Frameworks.size(); I++) {
+        KVVulkanFramework::KVWaitStats WaitStats;
+        Frameworks[I]->GetWaitStats(&WaitStats);
+        if (WaitStats.Waits == 0) continue;
+        printf ("GPU %d waits: %d, mean %.1f usec, max %.1f usec",int(I),int(WaitStats.Waits),
+                               WaitStats.TotalUsec / double(WaitStats.Waits),WaitStats.MaxUsec);
+        if (Spin > 0) {
+            printf (", %d finished while polling for %d usec",int(WaitStats.Spun),Spin);
+        }
+        printf ("\n");
+    }
+
+    //  The compute handlers release their Vulkan resources through their frameworks, so must be
+    //  deleted before the frameworks are cleaned up.
+
+    for (auto Handler : Handlers) delete Handler;
+    for (auto Framework : Frameworks) {
+        Framework->CleanupVulkan();
+        delete Framework;
+    }
+    return StatusOK ? 0 : 1;
+}
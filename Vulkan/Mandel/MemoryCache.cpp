@@ -0,0 +1,123 @@
+//
+//                            M e m o r y  C a c h e . c p p
+//
+//  The implementation of the MemoryCache class. See MemoryCache.h for an overview.
+//
+//  15th Oct 2026. First version. KS.
+
+#include "MemoryCache.h"
+
+#include <cstdio>
+
+//  Each file starts with this header, followed by the number of runs given in the header, each
+//  a count followed by the value repeated that many times.
+
+struct MemoryCacheHeader {
+    uint32_t Magic;
+    int32_t Iter;
+    int32_t Nx,Ny;
+    double XCent,YCent;
+    double Magnification;
+    double Aspect;
+    uint32_t Runs;
+};
+
+static const uint32_t C_Magic = 0x4D4D4331;
+
+MemoryCache::MemoryCache(const std::string& FilePrefix)
+{
+    _filePrefix = FilePrefix;
+}
+
+std::string MemoryCache::FileName(int Memory)
+{
+    return _filePrefix + std::to_string(Memory) + ".cache";
+}
+
+bool MemoryCache::Save(int Memory,const Details& ImageDetails,const uint32_t* Image)
+{
+    if (Image == nullptr || ImageDetails.Nx <= 0 || ImageDetails.Ny <= 0) return false;
+
+    //  Encode the image as (count,value) pairs.
+
+    std::vector<uint32_t> Runs;
+    size_t Pixels = size_t(ImageDetails.Nx) * size_t(ImageDetails.Ny);
+    size_t Index = 0;
+    while (Index < Pixels) {
+        uint32_t Value = Image[Index];
+        size_t End = Index + 1;
+        while (End < Pixels && Image[End] == Value && End - Index < 0xffffffff) End++;
+        Runs.push_back(uint32_t(End - Index));
+        Runs.push_back(Value);
+        Index = End;
+    }
+    MemoryCacheHeader Header;
+    Header.Magic = C_Magic;
+    Header.Iter = ImageDetails.Iter;
+    Header.Nx = ImageDetails.Nx;
+    Header.Ny = ImageDetails.Ny;
+    Header.XCent = ImageDetails.XCent;
+    Header.YCent = ImageDetails.YCent;
+    Header.Magnification = ImageDetails.Magnification;
+    Header.Aspect = ImageDetails.Aspect;
+    Header.Runs = uint32_t(Runs.size() / 2);
+
+    //  Write it under a temporary name, and then replace any existing file with it. (On some
+    //  systems, rename() won't replace an existing file.)
+
+    std::string Name = FileName(Memory);
+    std::string TempName = Name + ".tmp";
+    FILE* File = fopen(TempName.c_str(),"wb");
+    if (File == nullptr) return false;
+    bool WriteOK = (fwrite(&Header,sizeof(Header),1,File) == 1);
+    if (WriteOK) {
+        WriteOK = (fwrite(Runs.data(),sizeof(uint32_t),Runs.size(),File) == Runs.size());
+    }
+    if (fclose(File) != 0) WriteOK = false;
+    if (WriteOK && rename(TempName.c_str(),Name.c_str()) != 0) {
+        remove(Name.c_str());
+        WriteOK = (rename(TempName.c_str(),Name.c_str()) == 0);
+    }
+    if (!WriteOK) remove(TempName.c_str());
+    return WriteOK;
+}
+
+bool MemoryCache::Load(int Memory,const Details& ImageDetails,std::vector<uint32_t>& Image)
+{
+    Image.clear();
+    FILE* File = fopen(FileName(Memory).c_str(),"rb");
+    if (File == nullptr) return false;
+
+    //  The details have to match exactly - these are the values the image was computed with.
+
+    MemoryCacheHeader Header;
+    bool ReadOK = (fread(&Header,sizeof(Header),1,File) == 1);
+    ReadOK = ReadOK && Header.Magic == C_Magic && Header.Iter == ImageDetails.Iter &&
+          Header.Nx == ImageDetails.Nx && Header.Ny == ImageDetails.Ny &&
+          Header.XCent == ImageDetails.XCent && Header.YCent == ImageDetails.YCent &&
+          Header.Magnification == ImageDetails.Magnification &&
+          Header.Aspect == ImageDetails.Aspect;
+
+    //  Decode the runs, checking they add up to exactly the whole image.
+
+    if (ReadOK) {
+        size_t Pixels = size_t(Header.Nx) * size_t(Header.Ny);
+        std::vector<uint32_t> Runs;
+        ReadOK = (Header.Runs <= Pixels);
+        if (ReadOK) {
+            Runs.resize(size_t(Header.Runs) * 2);
+            ReadOK = (fread(Runs.data(),sizeof(uint32_t),Runs.size(),File) == Runs.size());
+        }
+        if (ReadOK) {
+            Image.reserve(Pixels);
+            for (size_t Run = 0; Run < Runs.size() && ReadOK; Run += 2) {
+                if (Runs[Run] > Pixels - Image.size()) ReadOK = false;
+                else Image.insert(Image.end(),Runs[Run],Runs[Run + 1]);
+            }
+            if (Image.size() != Pixels) ReadOK = false;
+        }
+    }
+    fclose(File);
+    if (!ReadOK) Image.clear();
+    return ReadOK;
+}
@@ -0,0 +1,61 @@
+//
+//                             M e m o r y  C a c h e . h
+//
+//  A MemoryCache keeps the image computed for each of the Mandel controller's memory settings -
+//  the views recalled by the '0' to '9' keys - in a file on disk, so when a memory is recalled
+//  its image can be drawn at once, while the real image is computed. At high magnifications,
+//  particularly when the CPU has to be used, that can take seconds.
+//
+//  Each file holds one image, as iteration counts, together with everything that determines
+//  it: the centre, the magnification, the iteration limit, the image dimensions and the aspect
+//  ratio of the view. Load() only returns an image if all of these match the ones asked for,
+//  so a file left over from a different memory setting, window size or iteration limit is
+//  just ignored, and replaced when the new image has been computed. The images are run length
+//  encoded, which suits the large areas of the same value most Mandelbrot images have - the
+//  interior of the set, in particular.
+//
+//  The files are written to the default directory, named using a prefix and the memory number.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __MemoryCache__
+#define __MemoryCache__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class MemoryCache
+{
+public:
+    //  Everything that determines the image for a memory.
+    struct Details {
+        double XCent,YCent;         // Centre of the image.
+        double Magnification;
+        double Aspect;              // Width over height of the view.
+        int Iter;                   // Iteration limit.
+        int Nx,Ny;                  // Image dimensions.
+    };
+    //  The files are named FilePrefix followed by the memory number and ".cache".
+    MemoryCache(const std::string& FilePrefix);
+    //  Writes the image for a memory, returning false if it can't.
+    bool Save(int Memory,const Details& ImageDetails,const uint32_t* Image);
+    //  Reads the image for a memory into Image, returning false if there is no file for it, or
+    //  the file is for an image with different details.
+    bool Load(int Memory,const Details& ImageDetails,std::vector<uint32_t>& Image);
+private:
+    std::string FileName(int Memory);
+    std::string _filePrefix;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The files are written as the data is held in memory, so they are only meant to be
+        read by the same program on the same machine. The magic number at the start catches a
+        file written by something else.
+
+    o   A new file is written under a temporary name and then renamed, so a program that is
+        stopped part way through writing one never leaves a damaged file behind.
+*/
@@ -4,11 +4,23 @@
 //  This provides a very basic timing facility. Essientially, you can create a
 //  MsecTimer and then call its ElapsedMsec() method to get the time in msec
 //  since it was created. You can also restart its timer by calling Restart().
-//  And that's it.
+//  ElapsedNsec() gives the same time as a whole number of nanoseconds.
 //
-//  This version uses gettimeofday() on UNIX-based systems, and used the
-//  facilities provided by the GLFW window system on other systems, like
-//  Windows. See Programming notes at the end.
+//  It also provides MsecStats, which collects a series of times - one for each
+//  pass of a repeat loop, say - and reports their distribution: the minimum,
+//  mean, median, 95th and 99th percentiles and the maximum. An average alone
+//  hides the occasional slow pass, and the first pass is often much slower
+//  than the rest. SetWarmup() has it ignore the first few times recorded, so
+//  these warm-up passes don't distort the figures.
+//
+//  A fixed number of warm-up passes may not be enough, though - a GPU can take
+//  a good many passes to raise its clocks from idle - and MsecSettle is for
+//  running passes until their times settle down. Each time is passed to it in
+//  turn, and it says when the spread of the last few is small enough, with no
+//  sign of them still getting faster, or when a time limit is reached.
+//
+//  This version uses std::chrono::steady_clock on all systems. See Programming
+//  notes at the end.
 //
 //  22nd Feb 2024. First commented version using GLFW. KS.
 //  23rd Feb 2024. Minor change - cast added - to placate VisualStudio compiler. KS.
@@ -16,13 +28,21 @@
 //                 for GLFW on MacOS and Linux. KS.
 //   4th Oct 2024. Replaced the GLFW code with Windows-specific code and a dummy
 //                 for cases where we don't recognise the system. KS.
+//  15th Oct 2026. Now uses std::chrono::steady_clock, which is monotonic, and
+//                 holds the time in integer nanoseconds. ElapsedMsec() now
+//                 returns a double. Added ElapsedNsec() and MsecStats. KS.
+//                 Added MsecStats::SetWarmup(). KS.
+//                 Added MsecSettle, and MsecStats::AddWarmup() and Spread(). KS.
 
 #ifndef __MsecTimer__
 #define __MsecTimer__
 
-#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
-
-#include <sys/time.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 
 class MsecTimer
 {
@@ -30,79 +50,180 @@ public:
     MsecTimer() { Restart(); }
     ~MsecTimer() {}
     void Restart(void) {
-        gettimeofday (&_startTime,NULL);
+        _startTime = std::chrono::steady_clock::now();
+    }
+    int64_t ElapsedNsec(void) {
+        return int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - _startTime).count());
     }
-    float ElapsedMsec(void) {
-        struct timeval endTime;
-        gettimeofday (&endTime,NULL);
-        float Msec = (endTime.tv_sec - _startTime.tv_sec) * 1000.0 +
-                    (endTime.tv_usec - _startTime.tv_usec) * 0.001;
-        return Msec;
+    double ElapsedMsec(void) {
+        return double(ElapsedNsec()) * 1.0e-6;
     }
 private:
-    struct timeval _startTime;
+    std::chrono::steady_clock::time_point _startTime;
 };
 
-#elif defined (_WIN32)
-
-//  This version is for Windows.
-
-//  Annoyingly, windows.h defines max and min unless you tell it not to. Actually, it's
-//  rather a shame to have a general-purpose include file like this that includes
-//  Windows.h. Perhaps, at least on Windows, the code should be in a separate file,
-//  and the FILETIME variable could be replaced by a double with the start msec time.
-
-#define NOMINMAX
-#include <windows.h>
-
-class MsecTimer
+class MsecStats
 {
 public:
-    MsecTimer() { Restart(); }
-    ~MsecTimer() {}
-    void Restart(void) {
-        GetSystemTimePreciseAsFileTime(&_startTime);
+    MsecStats() {}
+    ~MsecStats() {}
+    //  Sets the number of times recorded, from the start or the last Clear(), to ignore.
+    void SetWarmup(int Passes) { _warmup = Passes; }
+    int Warmup(void) const { return _warmup; }
+    //  Counts Passes more warm-up passes, run before any times were recorded - while waiting
+    //  for the times to settle, say - so that Warmup() includes them.
+    void AddWarmup(int Passes) {
+        _warmup += Passes;
+        _ignored += Passes;
+    }
+    //  Adds a time, in msec, to those collected, unless it's a warm-up pass.
+    void Record(double Msec) {
+        if (_ignored < _warmup) {
+            _ignored++;
+            return;
+        }
+        _samples.push_back(Msec);
+        _sorted = false;
+    }
+    //  Discards all the times collected so far.
+    void Clear(void) {
+        _samples.clear();
+        _sorted = true;
+        _ignored = 0;
+    }
+    int Count(void) const { return int(_samples.size()); }
+    double Min(void) { return Percentile(0.0); }
+    double Max(void) { return Percentile(100.0); }
+    double Mean(void) const {
+        if (_samples.empty()) return 0.0;
+        double Total = 0.0;
+        for (double Msec : _samples) Total += Msec;
+        return Total / double(_samples.size());
     }
-    float ElapsedMsec(void) {
-        FILETIME currentTime;
-        GetSystemTimePreciseAsFileTime(&currentTime);
-        ULARGE_INTEGER start100nsec;
-        ULARGE_INTEGER current100nsec;
-        start100nsec.LowPart = _startTime.dwLowDateTime;
-        start100nsec.HighPart = _startTime.dwHighDateTime;
-        current100nsec.LowPart = currentTime.dwLowDateTime;
-        current100nsec.HighPart = currentTime.dwHighDateTime;
-        float Msec = float(current100nsec.QuadPart - start100nsec.QuadPart) / 10000.0f;
-        return Msec;
+    //  Returns the standard deviation of the times as a fraction of their mean.
+    double Spread(void) const { return SpreadOf(_samples.begin(),_samples.end()); }
+    //  Returns the spread, as for Spread(), of a range of times.
+    template <class Iter>
+    static double SpreadOf(Iter First,Iter Last) {
+        double Count = 0.0,Total = 0.0,Squares = 0.0;
+        for (Iter Time = First; Time != Last; ++Time) {
+            Count += 1.0;
+            Total += *Time;
+            Squares += *Time * *Time;
+        }
+        if (Count < 2.0 || Total <= 0.0) return 0.0;
+        double Mean = Total / Count;
+        double Variance = (Squares - Total * Mean) / (Count - 1.0);
+        return (Variance > 0.0) ? sqrt(Variance) / Mean : 0.0;
+    }
+    //  Returns the time Percent percent of the times are no greater than (the nearest rank).
+    double Percentile(double Percent) {
+        if (_samples.empty()) return 0.0;
+        if (!_sorted) {
+            std::sort(_samples.begin(),_samples.end());
+            _sorted = true;
+        }
+        size_t N = _samples.size();
+        size_t Rank = size_t(Percent * 0.01 * double(N) + 0.999999);
+        if (Rank < 1) Rank = 1;
+        if (Rank > N) Rank = N;
+        return _samples[Rank - 1];
+    }
+    //  Prints the distribution of the times collected, described as What.
+    void Report(const char* What) {
+        if (_samples.empty()) return;
+        printf ("%s over %d: min %.3f, mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f msec\n",
+                  What,Count(),Min(),Mean(),Percentile(50.0),Percentile(95.0),Percentile(99.0),
+                                                                                       Max());
     }
 private:
-    FILETIME _startTime;
+    std::vector<double> _samples;
+    bool _sorted = true;
+    int _warmup = 0;
+    int _ignored = 0;
 };
 
-#else
-
-//  This is a dummy, only used if we can't recognise the system. It doesn't
-//  work - it returns a negative elapsed time - but will will compile and link.
-
-class MsecTimer
+class MsecSettle
 {
 public:
-    MsecTimer() {}
-    ~MsecTimer() {}
-    void Restart(void) {}
-    float ElapsedMsec(void) { return -1.0; }
+    //  Settles once the last Window times have a spread - see MsecStats::Spread() - of no
+    //  more than Spread, and the later half of them are on average no more than Spread
+    //  faster than the earlier half, or once LimitMsec have passed since it was created.
+    MsecSettle(double LimitMsec,int Window = 8,double Spread = 0.03) :
+        _limitMsec(LimitMsec), _window(Window < 4 ? 4 : Window), _spread(Spread) {}
+    ~MsecSettle() {}
+    //  Adds the time of a pass, in msec. Returns true once the times have settled, or the
+    //  time limit has been reached, when no more passes are needed.
+    bool Record(double Msec) {
+        _times.push_back(Msec);
+        if (int(_times.size()) > _window) _times.erase(_times.begin());
+        if (int(_times.size()) == _window) {
+            size_t Half = _times.size() / 2;
+            double Spread = MsecStats::SpreadOf(_times.begin(),_times.end());
+            double Earlier = 0.0,Later = 0.0;
+            for (size_t I = 0; I < Half; I++) Earlier += _times[I];
+            for (size_t I = Half; I < _times.size(); I++) Later += _times[I];
+            Earlier /= double(Half);
+            Later /= double(_times.size() - Half);
+            _settled = (Spread <= _spread && Later >= Earlier * (1.0 - _spread));
+        }
+        _passes++;
+        return Done();
+    }
+    //  Returns true once no more passes are needed.
+    bool Done(void) { return _settled || _timer.ElapsedMsec() >= _limitMsec; }
+    //  Returns true if the times settled before the time limit was reached.
+    bool Settled(void) const { return _settled; }
+    //  Returns the number of times recorded.
+    int Passes(void) const { return _passes; }
+    //  Returns the spread of the last Window times, or of all of them if there are fewer.
+    double Spread(void) const { return MsecStats::SpreadOf(_times.begin(),_times.end()); }
+    //  Returns the time since it was created.
+    double ElapsedMsec(void) { return _timer.ElapsedMsec(); }
+    //  Prints the number of passes it took, and the spread of the last few, described as What.
+    void Report(const char* What) {
+        printf ("%s: %d passes in %.1f msec, ",What,_passes,ElapsedMsec());
+        if (_settled) printf ("times settled to a spread of %.2f%%\n",100.0 * Spread());
+        else printf ("times not settled in %.0f msec, spread %.2f%%\n",_limitMsec,
+                                                                           100.0 * Spread());
+    }
+private:
+    MsecTimer _timer;
+    double _limitMsec;
+    int _window;
+    double _spread;
+    std::vector<double> _times;
+    int _passes = 0;
+    bool _settled = false;
 };
 
-
-#endif
-
 #endif
 
 /*                       P r o g r a m m i n g   N o t e s
- 
+
     o   This was originally written for MacOS and Linux, using gettimeofday().
         Then I discovered this didn't work on Windows and introduced a version
         using GLFW code, which was portable, but it was a nuisance to depend on
-        GLFW and eventually I reworked it with specific Windows and *nix code.	
- 
+        GLFW and eventually I reworked it with specific Windows and *nix code.
+
+    o   gettimeofday() and GetSystemTimePreciseAsFileTime() both give the time
+        of day, which can be stepped by the system - by NTP, for example - in
+        the middle of a timing, and gettimeofday() only has microsecond
+        resolution. std::chrono::steady_clock is monotonic, and is built on
+        clock_gettime(CLOCK_MONOTONIC) or mach_absolute_time() on Linux and
+        MacOS, and on QueryPerformanceCounter() on Windows, so all the systems
+        can now share the one version. A float holding msec only has about
+        seven significant figures, which isn't enough for a long run timed to
+        a microsecond, so the time is held as integer nanoseconds and returned
+        as a double.
+
+    o   A small spread on its own isn't enough for MsecSettle, since a GPU
+        can sit at a low clock for a while and give steady, but slow, times
+        before it steps up. So it also checks that the later half of the
+        window isn't faster than the earlier half. The limit stops it
+        waiting forever on a system whose times never settle to within the
+        spread asked for - a busy one, or one with a very short pass, where
+        the timer's own jitter is a large part of each time.
+
 */
@@ -32,10 +32,80 @@
 //     23rd Aug 2024. Changed the names of the shader files used. KS.
 //      7th Sep 2024. Moved shaders into default directory, to match the Metal version. KS.
 //     14th Sep 2024. Modified following renaming of Framework routines and types. KS.
+//     15th Oct 2026. The histogram of pixel values is now kept, and returned by
+//                    GetHistogram(). Values beyond the iteration limit are now drawn in the
+//                    colour for the highest value. KS.
+//                    Draw() now times the colouring and the drawing of each frame, returned
+//                    by GetDrawTimes(). KS.
+//                    Image data is now passed as uint32_t iteration counts. KS.
+//                    The image is now coloured by a compute shader, MandelColour.comp, using
+//                    SetColourDataGPU(), if the pipeline for it can be set up. The histogram
+//                    equalisation itself is now done by BuildColourIndex(). KS.
+//                    Added a mode, selected by SetQuadDraw(), that draws the image as a
+//                    single quad, with the fragment shader, MandelQuad.frag, looking up the
+//                    colour of each pixel in the image and the colour table used by the
+//                    colouring shader. This is the default if it can be set up. KS.
+//                    Added a version of Draw() that is passed the handle of a buffer already
+//                    holding the image on the GPU - the compute handler's own image buffer,
+//                    if it uses the same Framework - which the GPU colouring then reads
+//                    directly, instead of the CPU copying the image into a buffer. KS.
+//                    SetColourDataHistEq() now builds the histogram and sets the colours
+//                    using the shared ThreadPool, and the colour index and the partial
+//                    histograms are now kept from one frame to the next. KS.
+//                    The number of frames in flight is now set by the Framework's
+//                    SetFramesInFlight(), rather than being fixed at two, and each frame has
+//                    its own command buffer, sync objects and colours buffer for the CPU
+//                    colouring to write to. KS.
+//                    The triangle strip is now drawn using a vertex shader, MandelStrip.vert,
+//                    that works out the vertex positions from the vertex index and the image
+//                    dimensions, if the pipeline for it can be set up. There is then no
+//                    positions buffer, so a change of image size no longer has to set one up
+//                    and copy it to the GPU. KS.
+//                    SetOverlay() now enlarges the overlay buffers if a path has more points
+//                    than they can hold. They were sized for the default iteration limit, as
+//                    Initialise() is called before SetMaxIter(), so long paths were cut off. KS.
+//                    When the CPU colours the image, it now only sets a one-byte colour level
+//                    for each pixel, and a vertex shader, MandelLevels.vert, looks up the
+//                    colour of each vertex in the colour table, which is set just once. This
+//                    replaces setting three floats for each of the two or more vertices of each
+//                    pixel, if the pipeline for it can be set up. KS.
+//                    Added a frame capture mode, started by StartCapture(), where each frame is
+//                    copied as it is drawn into one of a ring of readback buffers, and written
+//                    to a PPM file by a FrameWriter, in a thread of its own. The copy is
+//                    collected when the frame's number comes round again and its fence has
+//                    to be waited for anyway, so capturing never makes the CPU wait. KS.
+//                    Added a version of Draw() that is also passed timeline semaphore values
+//                    to wait for before the image buffer is read, for an image computed on a
+//                    different queue. The GPU colouring and the frame itself wait for them. KS.
+//                    Added SetImageChanges(), which passes on which areas of the next image are
+//                    new. When the CPU colours the image, UpdateHistogram() then updates the
+//                    histogram from just those areas, and a frame whose colours or levels
+//                    buffer already holds an unchanged image doesn't set them again. KS.
+//                    An image larger than the drawable - supersampled - is now downsampled to
+//                    the drawable size by a new stage of MandelColour.comp, which averages the
+//                    colours of the image pixels each drawable pixel covers, and is then drawn
+//                    as a quad, whether or not SetQuadDraw() asked for one. Drawing it as a
+//                    triangle strip had two triangles for every image pixel. KS.
+//                    Added a stable colour mode, set by SetStableColours(), where a new stage
+//                    of MandelColour.comp sets the colour table on the GPU from a histogram
+//                    smoothed from frame to frame, so colours don't flicker during a zoom, and
+//                    the histogram, colour table and colours are all done in one submission,
+//                    with nothing for the CPU to work out in between. KS.
+//                    Added SetOverlayOrbit(), which has a compute shader, MandelOrbit.comp,
+//                    work out the path for a point and write it straight into the overlay
+//                    positions buffer, if the GPU supports double precision. The resizing of
+//                    the overlay buffers is now done by SizeOverlay(). KS.
 
 #include "RendererVulkan.h"
+#include "ThreadPool.h"
 
 #include <string>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdio>
 #include <math.h>
 
 //  _debugOptions is the comma-separated list of all the diagnostic levels that the built-in debug
@@ -44,6 +114,198 @@
 
 const std::string Renderer::_debugOptions = "Setup,Timing";
 
+//  The arguments for MandelColour.comp, passed as push constants. This must match the layout
+//  of the ColourArgs structure in the shader.
+
+typedef struct {
+    int Stage;
+    int Nx;
+    int Ny;
+    int IterLimit;
+    int Width;
+    int Height;
+    float Weight;
+} ColourArgs;
+
+//  The arguments for MandelOrbit.comp, passed as push constants. This must match the layout
+//  of the OrbitArgs structure in the shader.
+
+typedef struct {
+    double X0;
+    double Y0;
+    double XCent;
+    double YCent;
+    float XOffset;
+    float YOffset;
+    float XScale;
+    float YScale;
+    int Iter;
+} OrbitArgs;
+
+//  The workgroup size used by MandelColour.comp, and the most workgroups SetColourDataGPU()
+//  dispatches - the shader loops over any pixels beyond those it has threads for.
+
+static const int C_ColourGroupSize = 256;
+static const int C_ColourMaxGroups = 4096;
+
+//  In the stable colour mode, the weight given to each new histogram when it is blended into
+//  the smoothed histogram, and the time after which the next frame starts it afresh, as it's
+//  a new image rather than the next frame of a zoom - see SetStableColours().
+
+static const float C_StableColourWeight = 0.15f;
+static const double C_StableColourGapMsec = 500.0;
+
+//  The number of capture buffers, beyond one for each frame in flight, that can hold frames
+//  waiting to be written - see StartCapture().
+
+static const int C_CaptureSpareBuffers = 3;
+
+//  SizeBuffer() creates a buffer, or resizes it if it already exists, and returns its address.
+
+static void* SizeBuffer (KVVulkanFramework* FrameworkPtr,
+                  KVVulkanFramework::KVBufferHandle BufferHndl,long Bytes,bool& StatusOK)
+{
+    if (!FrameworkPtr->IsBufferCreated(BufferHndl,StatusOK)) {
+        FrameworkPtr->CreateBuffer(BufferHndl,Bytes,StatusOK);
+    } else {
+        FrameworkPtr->ResizeBuffer(BufferHndl,Bytes,StatusOK);
+    }
+    long MappedBytes;
+    return FrameworkPtr->MapBuffer(BufferHndl,&MappedBytes,StatusOK);
+}
+
+//  A FrameWriter writes the frames captured by the renderer to a series of PPM files, named
+//  using a prefix and the frame number, in a thread of its own, so the renderer never waits for
+//  a file to be written. Each frame is passed as the index of the capture buffer holding it, and
+//  that buffer is busy - see IsBusy() - until the frame has been written.
+
+class FrameWriter
+{
+public:
+    FrameWriter(const std::string& FilePrefix,int Buffers);
+    ~FrameWriter();
+    //  Queues the frame in a capture buffer, whose pixels are four bytes each, to be written.
+    void Queue(int Buffer,const uint8_t* Data,int Width,int Height,bool BGR);
+    //  Returns true if a capture buffer holds a frame that has still to be written.
+    bool IsBusy(int Buffer);
+    //  Waits for all queued frames to be written, and returns the numbers written and failed.
+    void Finish(int* Written,int* Failed);
+private:
+    struct Frame {
+        int Buffer;
+        int Number;
+        const uint8_t* Data;
+        int Width,Height;
+        bool BGR;
+    };
+    void WriteFrames(void);
+    bool WriteFrame(const Frame& TheFrame);
+    std::string _filePrefix;
+    int _queued;
+    int _written;
+    int _failed;
+    bool _finished;
+    std::vector<bool> _busy;
+    std::deque<Frame> _frames;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+};
+
+FrameWriter::FrameWriter(const std::string& FilePrefix,int Buffers)
+{
+    _filePrefix = FilePrefix;
+    _queued = 0;
+    _written = 0;
+    _failed = 0;
+    _finished = false;
+    _busy.assign(Buffers,false);
+    _thread = std::thread(&FrameWriter::WriteFrames,this);
+}
+
+FrameWriter::~FrameWriter()
+{
+    int Written,Failed;
+    Finish(&Written,&Failed);
+}
+
+void FrameWriter::Queue(int Buffer,const uint8_t* Data,int Width,int Height,bool BGR)
+{
+    {
+        std::lock_guard<std::mutex> Lock(_mutex);
+        _busy[Buffer] = true;
+        _frames.push_back(Frame{Buffer,++_queued,Data,Width,Height,BGR});
+    }
+    _condition.notify_all();
+}
+
+bool FrameWriter::IsBusy(int Buffer)
+{
+    std::lock_guard<std::mutex> Lock(_mutex);
+    return _busy[Buffer];
+}
+
+void FrameWriter::Finish(int* Written,int* Failed)
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lock(_mutex);
+            _finished = true;
+        }
+        _condition.notify_all();
+        _thread.join();
+    }
+    *Written = _written;
+    *Failed = _failed;
+}
+
+void FrameWriter::WriteFrames(void)
+{
+    for (;;) {
+        Frame TheFrame;
+        {
+            std::unique_lock<std::mutex> Lock(_mutex);
+            _condition.wait(Lock,[this]{ return _finished || !_frames.empty(); });
+            if (_frames.empty()) break;
+            TheFrame = _frames.front();
+            _frames.pop_front();
+        }
+        bool WriteOK = WriteFrame(TheFrame);
+        std::lock_guard<std::mutex> Lock(_mutex);
+        if (WriteOK) _written++;
+        else _failed++;
+        _busy[TheFrame.Buffer] = false;
+    }
+}
+
+bool FrameWriter::WriteFrame(const Frame& TheFrame)
+{
+    //  A binary PPM file has a short text header, then the R,G,B bytes for each pixel, row by
+    //  row from the top - which is the order the swap chain image is copied in. The alpha
+    //  byte of each pixel is dropped.
+    
+    char FileName[1024];
+    snprintf(FileName,sizeof(FileName),"%s_%06d.ppm",_filePrefix.c_str(),TheFrame.Number);
+    FILE* File = fopen(FileName,"wb");
+    if (File == nullptr) return false;
+    bool WriteOK = (fprintf(File,"P6\n%d %d\n255\n",TheFrame.Width,TheFrame.Height) > 0);
+    int Red = TheFrame.BGR ? 2 : 0;
+    int Blue = TheFrame.BGR ? 0 : 2;
+    std::vector<uint8_t> Row(size_t(TheFrame.Width) * 3);
+    for (int Iy = 0; Iy < TheFrame.Height && WriteOK; Iy++) {
+        const uint8_t* Pixel = TheFrame.Data + size_t(Iy) * TheFrame.Width * 4;
+        for (int Ix = 0; Ix < TheFrame.Width; Ix++) {
+            Row[Ix * 3] = Pixel[Red];
+            Row[Ix * 3 + 1] = Pixel[1];
+            Row[Ix * 3 + 2] = Pixel[Blue];
+            Pixel += 4;
+        }
+        WriteOK = (fwrite(Row.data(),1,Row.size(),File) == Row.size());
+    }
+    if (fclose(File) != 0) WriteOK = false;
+    return WriteOK;
+}
+
 Renderer::Renderer(KVVulkanFramework* FrameworkPtr)
 {
     //  Constructor. For this Vulkan-based version, the setup argument must be the address
@@ -56,8 +318,12 @@ Renderer::Renderer(KVVulkanFramework* FrameworkPtr)
     _viewHeight = 512.0;
     _frameworkPtr = FrameworkPtr;
     _frames = 0;
+    _colourMsec = 0.0;
+    _presentMsec = 0.0;
     _iterLimit = 1024;
     _imageCount = 0;
+    _framesInFlight = 0;
+    _colourSlice = 0;
     _maxOverVerts = 0;
     _overVerts = 0;
     _pipeline = VK_NULL_HANDLE;
@@ -73,6 +339,73 @@ Renderer::Renderer(KVVulkanFramework* FrameworkPtr)
     _positionsIndex = 0;
     _coloursIndex = 1;
     _currentImage = 0;
+    _gpuColouring = false;
+    _colourPipeline = VK_NULL_HANDLE;
+    _colourPipelineLayout = VK_NULL_HANDLE;
+    _colourSetLayout = VK_NULL_HANDLE;
+    _colourDescriptorPool = VK_NULL_HANDLE;
+    _colourDescriptorSet = VK_NULL_HANDLE;
+    _colourCommandBuffer = VK_NULL_HANDLE;
+    _imageHndl = 0;
+    _histHndl = 0;
+    _lutHndl = 0;
+    _imageMemAddr = nullptr;
+    _histMemAddr = nullptr;
+    _lutMemAddr = nullptr;
+    _colourPixels = 0;
+    _colourLevels = 0;
+    _colourImageHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    _quadAvailable = false;
+    _quadDraw = true;
+    _quadVertexShader = VK_NULL_HANDLE;
+    _quadFragmentShader = VK_NULL_HANDLE;
+    _quadPipeline = VK_NULL_HANDLE;
+    _quadPipelineLayout = VK_NULL_HANDLE;
+    _quadSetLayout = VK_NULL_HANDLE;
+    _quadDescriptorPool = VK_NULL_HANDLE;
+    _quadDescriptorSet = VK_NULL_HANDLE;
+    _quadParamsHndl = 0;
+    _quadParamsMemAddr = nullptr;
+    _downHndl = 0;
+    _downPixels = 0;
+    _stableColours = false;
+    _stableReset = true;
+    _colourPaletteHndl = 0;
+    _smoothHndl = 0;
+    _stripAvailable = false;
+    _stripVertexShader = VK_NULL_HANDLE;
+    _stripPipeline = VK_NULL_HANDLE;
+    _stripPipelineLayout = VK_NULL_HANDLE;
+    _stripSetLayout = VK_NULL_HANDLE;
+    _stripDescriptorPool = VK_NULL_HANDLE;
+    _stripDescriptorSet = VK_NULL_HANDLE;
+    _stripParamsHndl = 0;
+    _stripParamsMemAddr = nullptr;
+    _levelsAvailable = false;
+    _levelsVertexShader = VK_NULL_HANDLE;
+    _levelsPipeline = VK_NULL_HANDLE;
+    _levelsPipelineLayout = VK_NULL_HANDLE;
+    _levelsSetLayout = VK_NULL_HANDLE;
+    _levelsDescriptorPool = VK_NULL_HANDLE;
+    _paletteHndl = 0;
+    _gpuOrbit = false;
+    _orbitPipeline = VK_NULL_HANDLE;
+    _orbitPipelineLayout = VK_NULL_HANDLE;
+    _orbitSetLayout = VK_NULL_HANDLE;
+    _orbitDescriptorPool = VK_NULL_HANDLE;
+    _orbitDescriptorSet = VK_NULL_HANDLE;
+    _orbitCommandBuffer = VK_NULL_HANDLE;
+    _orbitVerts = 0;
+    _overlayWhiteVerts = 0;
+    _frameWriter = nullptr;
+    _droppedFrames = 0;
+    _changesKnown = false;
+    _changeShiftX = 0;
+    _changeShiftY = 0;
+    _histOffsetX = 0;
+    _histOffsetY = 0;
+    _histImageOK = false;
+    _imageVersion = 0;
     _debug.SetSubSystem("Renderer");
     _debug.LevelsList(_debugOptions);
 }
@@ -92,11 +425,19 @@ void Renderer::Initialise(const std::string& DebugLevels)
     _frameworkPtr->CreateRenderPass(StatusOK);
     _frameworkPtr->CreateFramebuffers(StatusOK);
     _frameworkPtr->CreateCommandPool(&_commandPool,StatusOK);
-    _frameworkPtr->CreateCommandBuffers(_commandPool,_imageCount,_commandBuffers,StatusOK);
+    
+    //  Each frame that can be in flight at once needs its own command buffer and sync objects.
+    //  There's no point having more frames in flight than there are swap chain images.
+    
+    _framesInFlight = std::max(std::min(_frameworkPtr->GetFramesInFlight(),_imageCount),1);
+    _debug.Logf("Setup","Using %d frames in flight, %d swap chain images.",
+                                                                 _framesInFlight,_imageCount);
+    _frameworkPtr->CreateCommandBuffers(_commandPool,_framesInFlight,_commandBuffers,StatusOK);
     std::vector<VkSemaphore> ImageSemaphores;
     std::vector<VkSemaphore> RenderSemaphores;
     std::vector<VkFence> Fences;
-    _frameworkPtr->CreateSyncObjects(_imageCount,ImageSemaphores,RenderSemaphores,Fences,StatusOK);
+    _frameworkPtr->CreateSyncObjects(_framesInFlight,ImageSemaphores,RenderSemaphores,Fences,
+                                                                                   StatusOK);
     if (StatusOK) StatusOK = BuildShaders();
     
     //  Setup main image positions buffer
@@ -110,10 +451,11 @@ void Renderer::Initialise(const std::string& DebugLevels)
     _frameworkPtr->SetVertexBufferDetails(PosnsHndl,Stride,true,1,
                                          Locations,FormatStrings,Offsets,StatusOK);
     
-    //  Now the main image colours buffer
+    //  Now the main image colours buffer. This is written by the colouring compute shader, if
+    //  it's used, so it has to be usable as a storage buffer as well.
     
     KVVulkanFramework::KVBufferHandle ColoursHndl = _frameworkPtr->SetBufferDetails(
-                                                         1,"VERTEX","SHARED",StatusOK);
+                                                   1,"VERTEX_STORAGE","SHARED",StatusOK);
     Locations[0] = 1;
     FormatStrings[0] = "vec3";
     Offsets[0] = 0;
@@ -125,13 +467,28 @@ void Renderer::Initialise(const std::string& DebugLevels)
     _bufferHandles[_positionsIndex] = PosnsHndl;
     _bufferHandles[_coloursIndex] = ColoursHndl;
     
-    //  And the overlay positions buffer
+    //  When the CPU colours the image, it writes the colours for each frame into a separate
+    //  buffer, so it never has to wait for a frame still in flight to finish with them. The
+    //  first of these is the colours buffer just set up, which is the one the GPU colouring
+    //  always uses.
+    
+    _frameColourHndls.assign(1,ColoursHndl);
+    for (int Frame = 1; Frame < _framesInFlight; Frame++) {
+        KVVulkanFramework::KVBufferHandle FrameHndl = _frameworkPtr->SetBufferDetails(
+                                                   1,"VERTEX_STORAGE","SHARED",StatusOK);
+        _frameworkPtr->SetVertexBufferDetails(FrameHndl,Stride,true,1,
+                                         Locations,FormatStrings,Offsets,StatusOK);
+        _frameColourHndls.push_back(FrameHndl);
+    }
+    _frameColoursMemAddrs.assign(_frameColourHndls.size(),nullptr);
+    
+    //  And the overlay positions buffer, which the orbit pipeline can also write.
     
     Locations[0] = 0;
     FormatStrings[0] = "vec2";
     Stride = sizeof(PositionVec);
     KVVulkanFramework::KVBufferHandle OverlayPosnsHndl = _frameworkPtr->SetBufferDetails(
-                                                             0,"VERTEX","SHARED",StatusOK);
+                                                     0,"VERTEX_STORAGE","SHARED",StatusOK);
     _frameworkPtr->SetVertexBufferDetails(OverlayPosnsHndl,Stride,true,1,
                                                  Locations,FormatStrings,Offsets,StatusOK);
     //  And the overlay colours buffer
@@ -172,11 +529,33 @@ void Renderer::Initialise(const std::string& DebugLevels)
     _frameworkPtr->CreateGraphicsPipeline(_vertexShader,"main",_fragmentShader,"main",
                         "TRIANGLE_STRIP",_bufferHandles,&PipelineLayout,&_pipeline,StatusOK);
     
+    //  And the one that draws the same triangle strip without needing the positions buffer.
+    
+    if (StatusOK) _stripAvailable = BuildStripPipeline();
+    
+    //  And the one that draws it with the colours looked up by the vertex shader, which uses
+    //  the same buffer of image dimensions.
+    
+    if (StatusOK && _stripAvailable) _levelsAvailable = BuildLevelsPipeline();
+    
     //  And the overlay pipeline
     
     _frameworkPtr->CreateGraphicsPipeline(_vertexShader,"main",_fragmentShader,"main",
             "LINE_STRIP",_overlayBufferHandles,&PipelineLayout,&_overlayPipeline,StatusOK);
     
+    //  And the compute pipeline used to colour the image using the GPU.
+    
+    if (StatusOK) _gpuColouring = BuildColourPipeline();
+    
+    //  And the pipeline that draws the image as a single quad, which needs the image and the
+    //  colour table set up by the colouring pipeline.
+    
+    if (StatusOK && _gpuColouring) _quadAvailable = BuildQuadPipeline();
+    
+    //  And the compute pipeline that works out a path for the overlay, which needs doubles.
+    
+    if (StatusOK && _frameworkPtr->DeviceSupportsDouble()) _gpuOrbit = BuildOrbitPipeline();
+    
     if (StatusOK) _debug.Log("Setup","Basic Vulkan Setup complete");
     
     SetImageSize(1024,1024);
@@ -185,6 +564,10 @@ void Renderer::Initialise(const std::string& DebugLevels)
 
 Renderer::~Renderer()
 {
+    //  Any frames still queued are written, but any still being drawn are lost, as the
+    //  Framework may be closing down too.
+    
+    if (_frameWriter) delete _frameWriter;
 }
 
 void Renderer::SetImageSize (int Nx, int Ny)
@@ -208,9 +591,150 @@ void Renderer::SetDrawableSize (float width, float height)
 
 void Renderer::SetMaxIter (int MaxIter)
 {
+    if (MaxIter != _iterLimit) _histImageOK = false;
     _iterLimit = MaxIter;
 }
 
+//  SetImageChanges() says how the image passed to the next Draw() differs from the one passed
+//  to the last: it is the last image moved so that the new pixel (Ix,Iy) has the value of the
+//  old pixel (Ix + ShiftX,Iy + ShiftY), with only the pixels in Areas new. (No shift and no
+//  areas means the image hasn't changed.) It only applies to the next Draw(), and if it isn't
+//  called, the whole image is taken as new. The colours depend on the histogram of the whole
+//  image, and a moved image has every pixel in a new place, so the colours still have to be
+//  set for every pixel, but the histogram can be updated from just the new areas - see
+//  UpdateHistogram() - and if the image hasn't changed, its colours needn't be set again.
+
+void Renderer::SetImageChanges (int ShiftX,int ShiftY,const std::vector<ImageArea>& Areas)
+{
+    _changesKnown = true;
+    _changeShiftX = ShiftX;
+    _changeShiftY = ShiftY;
+    _changeAreas = Areas;
+}
+
+//  GetHistogram() returns the histogram of the pixel values of the last image drawn, built by
+//  SetColourDataHistEq() or SetColourDataGPU(). It has an entry for each value from 0 up to
+//  the iteration limit the image was drawn with, less one, giving the number of pixels with
+//  that value. Entry 0 is the number of pixels inside the set. It is empty if no image has
+//  been drawn yet.
+
+const std::vector<int>& Renderer::GetHistogram (void)
+{
+    return _hist;
+}
+
+//  GetDrawTimes() returns the times taken by the last call to Draw(): the time spent setting
+//  the vertex colours from the image data, and the time spent then drawing and presenting the
+//  frame. The frame is presented before Draw() returns, so it includes the wait for that.
+
+void Renderer::GetDrawTimes (float* ColourMsec,float* PresentMsec)
+{
+    *ColourMsec = _colourMsec;
+    *PresentMsec = _presentMsec;
+}
+
+//  SetQuadDraw() selects how the image is drawn. If UseQuad is true, it is drawn as a single quad
+//  covering the view, with the fragment shader looking up the colour for each pixel. If false,
+//  it is drawn as a triangle strip, with two triangles for each image pixel, whose vertex
+//  colours are set by the CPU or by the colouring compute shader. The quad needs the GPU to be
+//  colouring the image, and if it can't be used the triangle strip is used anyway. This
+//  returns true if the quad will be used. (An image larger than the drawable is downsampled by
+//  the GPU and drawn as a quad anyway, if it can be - see Downsampling().)
+
+bool Renderer::SetQuadDraw (bool UseQuad)
+{
+    _quadDraw = UseQuad;
+    return _quadDraw && _quadAvailable && _gpuColouring;
+}
+
+//  SetStableColours() selects how the GPU colours the image. Normally, the histogram of each
+//  image is read back by the CPU, which works out the colour for each value from it. In the
+//  stable colour mode, the colouring shader does that itself, from a histogram that blends the
+//  histogram of each new image into that of the frames before. The colours then change
+//  smoothly during a zoom rather than flickering as the histogram equalisation jumps from one
+//  frame to the next, and the whole of the colouring is one submission to the GPU. A frame
+//  drawn more than C_StableColourGapMsec after the last - unless frames are being captured -
+//  starts the smoothing afresh, so an image that stays on display has its own colours. This
+//  needs the GPU to be colouring the image, and returns true if the stable colours will be used.
+
+bool Renderer::SetStableColours (bool Stable)
+{
+    if (Stable && !_stableColours) _stableReset = true;
+    _stableColours = Stable;
+    return _stableColours && _gpuColouring;
+}
+
+//  Downsampling() returns true if an Nx by Ny image will be downsampled to the size of the
+//  drawable before it is drawn. This is done if it is larger than the drawable in either
+//  direction - usually because it is being supersampled - so long as the GPU is colouring it
+//  and the quad can be drawn. Stage 3 of the colouring shader then sets the colour of each
+//  drawable pixel to the average of those of the image pixels it covers, and the quad's
+//  fragment shader just looks that up. Otherwise, the quad would only show one of those image
+//  pixels, and the triangle strip would draw all of them, as triangles too small to see.
+
+bool Renderer::Downsampling (int Nx,int Ny)
+{
+    return _gpuColouring && _quadAvailable && (Nx > int(_viewWidth) || Ny > int(_viewHeight));
+}
+
+//  StartCapture() starts capturing every frame drawn, writing each to a PPM file whose name is
+//  FilePrefix followed by '_', the frame number, starting from 1, and ".ppm". Each frame is
+//  copied into a buffer by the GPU as it is drawn, and that buffer is handed to a FrameWriter,
+//  which writes it in a thread of its own, once the frame has been drawn. If the writer falls
+//  behind, and all the buffers are waiting to be written, frames are dropped rather than
+//  holding up the drawing. It returns false if the frames can't be captured. It does nothing,
+//  and returns true, if frames are already being captured.
+
+bool Renderer::StartCapture (const std::string& FilePrefix)
+{
+    if (_frameWriter) return true;
+    if (!_frameworkPtr->FrameCaptureSupported()) {
+        _debug.Log("Setup","The swap chain does not support frame capture.");
+        return false;
+    }
+    
+    //  The buffers are created by CaptureFrame() when they're first used, once the size of the
+    //  frames is known.
+    
+    bool StatusOK = true;
+    int Buffers = _framesInFlight + C_CaptureSpareBuffers;
+    _captureHndls.clear();
+    for (int Buffer = 0; Buffer < Buffers; Buffer++) {
+        _captureHndls.push_back(_frameworkPtr->SetBufferDetails(0,"STORAGE","READBACK",StatusOK));
+    }
+    _captureMemAddrs.assign(Buffers,nullptr);
+    _captureBytes.assign(Buffers,0);
+    _captureBuffers.assign(_framesInFlight,-1);
+    _droppedFrames = 0;
+    if (StatusOK) _frameWriter = new FrameWriter(FilePrefix,Buffers);
+    return StatusOK;
+}
+
+//  StopCapture() stops capturing frames, waiting for the frames already drawn to be written,
+//  and returns the number of frames written and the number that were dropped or couldn't be
+//  written.
+
+void Renderer::StopCapture (int* Frames,int* Dropped)
+{
+    *Frames = 0;
+    *Dropped = 0;
+    if (_frameWriter == nullptr) return;
+    for (int Frame = 0; Frame < int(_captureBuffers.size()); Frame++) CollectCapture(Frame);
+    int Failed = 0;
+    _frameWriter->Finish(Frames,&Failed);
+    *Dropped = _droppedFrames + Failed;
+    delete _frameWriter;
+    _frameWriter = nullptr;
+    bool StatusOK = true;
+    for (KVVulkanFramework::KVBufferHandle CaptureHndl : _captureHndls) {
+        _frameworkPtr->DeleteBuffer(CaptureHndl,StatusOK);
+    }
+    _captureHndls.clear();
+    _captureMemAddrs.clear();
+    _captureBytes.clear();
+    _captureBuffers.clear();
+}
+
 //  GetDebugOptions() returns the comma-separated list of the various diagnostic levels supported
 //  by the renderer. Note that this is a static routine; it can be convenient for a program to
 //  have this list available before the renderer is constructed, and it is in any case a fixed
@@ -221,7 +745,7 @@ std::string Renderer::GetDebugOptions(void)
     return _debugOptions;
 }
 
-void Renderer::SetColourData (float* imageData, int Nx, int Ny)
+void Renderer::SetColourData (uint32_t* imageData, int Nx, int Ny)
 {
     //  This was my first attempt at setting a suitable set of colours for the images,
     //  based on scaling over a given percentile range of data, but I decided this didn't
@@ -259,7 +783,7 @@ void Renderer::SetColourData (float* imageData, int Nx, int Ny)
     //printf ("Setting colours took %.2f msec\n",theTimer.ElapsedMsec());
 }
 
-void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
+void Renderer::SetColourDataHistEq (uint32_t* imageData, int Nx, int Ny)
 {
     MsecTimer theTimer;
     
@@ -269,6 +793,15 @@ void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
     
     _nx = Nx;
     _ny = Ny;
+    
+    //  The colours - or the colour levels - go into the buffer for the frame about to be
+    //  drawn. The last frame to use that buffer may still be in flight, and has to finish
+    //  with it first.
+    
+    bool StatusOK = true;
+    _colourSlice = _currentImage;
+    _frameworkPtr->WaitForGraphicsFrame(_colourSlice,StatusOK);
+    if (!_levelsAvailable) _coloursMemAddr = _frameColoursMemAddrs[_colourSlice];
             
     //  This is made easier by the fact that we know all the values in imageData will
     //  be positive integers. Also, note that we expect a very large number of the
@@ -287,23 +820,155 @@ void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
     //  zero, because this is black in this colour table, and this usually looks best for
     //  displaying the pixels actually in the Mandelbrot set. We then want to distribute
     //  the rest of the available 255 colour index values as evenly as possible amongst
-    //  only those data values that actually occur in the current data.
+    //  only those data values that actually occur in the current data. (The colour index
+    //  array is kept in _colourIndex, so it isn't allocated afresh for each frame.)
     
-    int* ColourIndex = (int*) malloc(_iterLimit * sizeof(int));
+    _colourIndex.resize(_iterLimit);
+    int* ColourIndex = _colourIndex.data();
     
     //  Now the second array. Hist will be the histogram of the data values. Hist[0] will
     //  be the count of pixels within the Mandelbrot set, and Hist[i] is the count of pixels
     //  with value i. We will use the distribution of actual values in the data to allocate
-    //  the colour table indices amongst the data values.
+    //  the colour table indices amongst the data values. This is kept in _hist, so that
+    //  GetHistogram() can return it.
+    //
+    //  The image is split into bands of rows, one for each thread in the shared pool, and
+    //  each band gets its own partial histogram in _bandHists, so the threads never update
+    //  the same counts. These are then added together to give the full histogram.
+    //
+    //  If SetImageChanges() has said which parts of the image are new, UpdateHistogram() may
+    //  be able to update the histogram from just those. If not, but the changes are known,
+    //  each thread also copies its band into _histImage, so it can next time.
+    
+    ThreadPool& Pool = ThreadPool::Shared();
+    int Levels = _iterLimit;
+    bool Changed = true;
+    bool Updated = _changesKnown && UpdateHistogram(imageData,Nx,Ny,&Changed);
+    if (!Updated) {
+        bool KeepImage = _changesKnown;
+        if (KeepImage) _histImage.resize(size_t(Nx) * size_t(Ny));
+        uint32_t* HistImage = _histImage.data();
+        int Bands = std::max(std::min(Pool.Threads(),Ny),1);
+        _bandHists.assign(size_t(Bands) * _iterLimit,0);
+        int* BandHists = _bandHists.data();
+        Pool.ParallelFor(0,Bands,[=](int First,int Last) {
+            for (int Band = First; Band < Last; Band++) {
+                int* BandHist = BandHists + size_t(Band) * Levels;
+                long Start = long(Ny) * Band / Bands * Nx;
+                long End = long(Ny) * (Band + 1) / Bands * Nx;
+                for (long iptr = Start; iptr < End; iptr++) {
+                    int iData = int(imageData[iptr]);
+                    if (iData >= 0 && iData < Levels) BandHist[iData]++;
+                }
+                if (KeepImage) {
+                    memcpy(HistImage + Start,imageData + Start,(End - Start) * sizeof(uint32_t));
+                }
+            }
+        });
+        _hist.assign(BandHists,BandHists + Levels);
+        int* Hist = _hist.data();
+        for (int Band = 1; Band < Bands; Band++) {
+            const int* BandHist = BandHists + size_t(Band) * Levels;
+            for (int I = 0; I < Levels; I++) Hist[I] += BandHist[I];
+        }
+        _histOffsetX = 0;
+        _histOffsetY = 0;
+        _histImageOK = KeepImage;
+    }
+    _changesKnown = false;
     
-    int* Hist = (int*) malloc(_iterLimit * sizeof(int));
+    //  If the image hasn't changed, and this frame's buffer already has its colours or levels,
+    //  there's nothing more to do.
     
-    for (int I = 0; I < _iterLimit; I++) Hist[I] = 0;
-    for (int iptr = 0; iptr < (Nx * Ny); iptr++) {
-        int iData = int(imageData[iptr]);
-        if (iData >= 0 && iData < _iterLimit) Hist[iData]++;
+    if (Changed) _imageVersion++;
+    if (_sliceVersions.size() != size_t(_framesInFlight)) {
+        _sliceVersions.assign(size_t(_framesInFlight),-1);
     }
+    if (_sliceVersions[_colourSlice] == _imageVersion) return;
+    _sliceVersions[_colourSlice] = _imageVersion;
       
+    //  Turn the histogram into the lookup table of colour levels for each data value.
+    
+    BuildColourIndex(ColourIndex);
+    
+    //  ColourIndex[i] now represents the colour level to be used for data of value i.
+    
+    //  If the vertex shader looks up the colours, all that's needed is the colour level for
+    //  each pixel. The frame's descriptor set only has to be set up again if the levels buffer
+    //  has changed size since it was last used, and the frame has now finished with it.
+    
+    if (_levelsAvailable) {
+        long Pixels = long(Nx) * long(Ny);
+        if (_levelsPixels[_colourSlice] != Pixels) {
+            std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                              {_stripParamsHndl,_frameLevelHndls[_colourSlice],_paletteHndl};
+            _frameworkPtr->SetupVulkanDescriptorSet(Handles,_levelsDescriptorSets[_colourSlice],
+                                                                                   StatusOK);
+            _levelsPixels[_colourSlice] = Pixels;
+        }
+        uint8_t* PixelLevels = _frameLevelsMemAddrs[_colourSlice];
+        Pool.ParallelFor(0,Ny,[=](int FirstLine,int LastLine) {
+            long Last = long(LastLine) * Nx;
+            for (long iptr = long(FirstLine) * Nx; iptr < Last; iptr++) {
+                int idata = int(imageData[iptr]);
+                if (idata >= Levels) idata = Levels - 1;
+                PixelLevels[iptr] = uint8_t(ColourIndex[idata]);
+            }
+        });
+        _frameworkPtr->FlushBuffer(_frameLevelHndls[_colourSlice],StatusOK);
+        return;
+    }
+    
+    ColourVec* colours = _coloursMemAddr;
+
+    //  The colours need to match the vertices as set up by BuildBuffers(). See comments 
+    //  there about the number of vertices needed for each image line. Since every line has
+    //  the same number of vertices, each line's colours can be set independently, and the
+    //  lines are shared out between the threads.
+    
+    int LineVertices = (Nx - 1) * 2 + 6;
+    Pool.ParallelFor(0,Ny,[=](int FirstLine,int LastLine) {
+        for (int Iy = FirstLine; Iy < LastLine; Iy++) {
+            long iptr = long(Iy) * Nx;
+            long cptr = long(Iy) * LineVertices;
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                int idata = int(imageData[iptr++]);
+                if (idata >= Levels) idata = Levels - 1;
+                int index = ColourIndex[idata];
+                float R,G,B;
+                GetRGB (index,&R,&G,&B);
+                ColourVec RGB = {R,G,B};
+                if (Ix == 0) {
+                    for (int I = 0; I < 5; I++) { colours[cptr++] = RGB; }
+                } else {
+                    colours[cptr++] = RGB;
+                    colours[cptr++] = RGB;
+                }
+            }
+            colours[cptr++] = { 0.0,0.0,0.0 };
+        }
+    });
+    
+    //  If the colours buffer is shared, it needs explicit synchronisation when modified.
+    //  See comments in BuildBuffers() - this is a null operation for buffers that don't need it.
+
+    VkQueue queueHndl;
+    KVVulkanFramework::KVBufferHandle ColoursHandle = _frameColourHndls[_colourSlice];
+    _frameworkPtr->GetDeviceQueue(&queueHndl,StatusOK);
+    _frameworkPtr->SyncBuffer(ColoursHandle,_commandPool,queueHndl,StatusOK);
+
+    //printf("Full colour handling took %.2f msec\n", theTimer.ElapsedMsec());
+}
+
+//  BuildColourIndex() sets the lookup table ColourIndex, which must have an entry for each data
+//  value up to the iteration limit, to the colour level to be used for each value, using the
+//  histogram in _hist. This is the histogram equalisation used by both SetColourDataHistEq()
+//  and SetColourDataGPU(), so the two colour an image in exactly the same way.
+
+void Renderer::BuildColourIndex (int* ColourIndex)
+{
+    const int* Hist = _hist.data();
+    
     //  Determine the range of actual data values, ignoring the zero values pixels
     //  inside the Mandelbrot set. We can do this just by starting at each end of
     //  the data histogram and seeing when we first hit a non-zero count.
@@ -369,49 +1034,277 @@ void Renderer::SetColourDataHistEq (float* imageData, int Nx, int Ny)
             if (ColourIndex[I] >= LevelsAvailable) ColourIndex[I] = LevelsAvailable - 1;
         }
     }
+}
+
+//  UpdateHistogram() is used by SetColourDataHistEq() when SetImageChanges() has said how the
+//  image differs from the last one. If _histImage holds the last image, it brings _hist and
+//  _histImage up to date by going through just the new areas, and returns true, with Changed
+//  set false if the image hasn't changed at all. Each new pixel takes the place in _histImage
+//  of a pixel that has moved out of the image, since its offsets move with the image, so its
+//  old value there is the one that has to come out of the histogram. If _histImage isn't up to
+//  date, or the new areas are big enough that going through the whole image in parallel would
+//  be quicker, it returns false, and _hist has to be built from scratch.
+
+bool Renderer::UpdateHistogram (uint32_t* imageData,int Nx,int Ny,bool* Changed)
+{
+    *Changed = true;
+    if (!_histImageOK || _histImage.size() != size_t(Nx) * size_t(Ny)) return false;
+    if (_hist.size() != size_t(_iterLimit)) return false;
+    long NewPixels = 0;
+    for (const ImageArea& Area : _changeAreas) {
+        NewPixels += long(Area.Ixen - Area.Ixst) * long(Area.Iyen - Area.Iyst);
+    }
+    if (NewPixels > long(Nx) * long(Ny) / 4) return false;
+    if (NewPixels == 0 && _changeShiftX == 0 && _changeShiftY == 0) {
+        *Changed = false;
+        return true;
+    }
+    _histOffsetX = ((_histOffsetX + _changeShiftX) % Nx + Nx) % Nx;
+    _histOffsetY = ((_histOffsetY + _changeShiftY) % Ny + Ny) % Ny;
+    uint32_t Levels = uint32_t(_iterLimit);
+    int* Hist = _hist.data();
+    for (const ImageArea& Area : _changeAreas) {
+        for (int Iy = Area.Iyst; Iy < Area.Iyen; Iy++) {
+            const uint32_t* Row = imageData + size_t(Iy) * Nx;
+            uint32_t* Cells = _histImage.data() + size_t((Iy + _histOffsetY) % Ny) * Nx;
+            for (int Ix = Area.Ixst; Ix < Area.Ixen; Ix++) {
+                int Cx = (Ix + _histOffsetX) % Nx;
+                uint32_t Old = Cells[Cx];
+                uint32_t New = Row[Ix];
+                if (Old < Levels) Hist[Old]--;
+                if (New < Levels) Hist[New]++;
+                Cells[Cx] = New;
+            }
+        }
+    }
+    return true;
+}
+
+//  SetColourDataGPU() does the same job as SetColourDataHistEq(), but uses the compute shader
+//  in MandelColour.comp to build the histogram and set the vertex colours, which are the parts
+//  that have to look at every pixel. The image is copied into a buffer of the renderer's own,
+//  since the compute handler may be using a different Framework, and so a different device -
+//  unless ImageHndl is passed as a buffer that already holds the image (see Draw()), in which
+//  case that is used as it is. Only the histogram comes back to the CPU, which turns it into a
+//  table of the colour for each data value using BuildColourIndex(), so the result is the same
+//  as for the CPU version. In the stable colour mode, the shader sets that table itself - see
+//  SetStableColours() - and every stage is dispatched in the one submission.
+
+void Renderer::SetColourDataGPU (uint32_t* imageData, int Nx, int Ny,
+                                                   KVVulkanFramework::KVBufferHandle ImageHndl,
+                           const std::vector<KVVulkanFramework::KVTimelinePoint>& WaitPoints)
+{
+    if (_coloursMemAddr == nullptr || imageData == nullptr) return;
     
-    //  ColourIndex[i] now represents the colour level to be used for data of value i.
+    _nx = Nx;
+    _ny = Ny;
     
-    int cptr = 0;
-    int iptr = 0;
+    //  The colouring shader always writes to the first colours buffer. It can, since the
+    //  colouring waits for everything already queued to finish, including earlier frames.
     
-    ColourVec* colours = _coloursMemAddr;
-
-    //  The colours need to match the vertices as set up by BuildBuffers(). See comments 
-    //  there about the number of vertices needed for each image line.
+    _colourSlice = 0;
+    _coloursMemAddr = _frameColoursMemAddrs[0];
+    
+    //  The GPU builds the histogram from the whole image, so the CPU's copy of the last image
+    //  falls out of date, and the first colours buffer will no longer hold the CPU's colours.
+    
+    _changesKnown = false;
+    _histImageOK = false;
+    _sliceVersions.assign(size_t(_framesInFlight),-1);
+    
+    bool StatusOK = true;
+    long Pixels = long(Nx) * long(Ny);
+    
+    //  If the image is to be downsampled, the downsampled image is the size of the drawable.
+    //  Otherwise its buffer is left at a token size, as the descriptor sets still need it.
+    
+    bool Down = Downsampling(Nx,Ny);
+    int Width = int(_viewWidth);
+    int Height = int(_viewHeight);
+    long DownPixels = Down ? long(Width) * long(Height) : 1;
+    
+    //  The image buffer depends on the image size, the downsampled image on the drawable size,
+    //  and the histogram and colour table on the iteration limit. If any of them change, or the
+    //  image is to come from a different buffer, the descriptor sets have to be set up again.
+    //  (BuildBuffers() zeros _colourPixels, as it may have reallocated the colours buffer.)
+    
+    KVVulkanFramework::KVBufferHandle SourceHndl = _imageHndl;
+    if (ImageHndl != KVVulkanFramework::KV_NULL_HANDLE) SourceHndl = ImageHndl;
+    if (Pixels != _colourPixels || _iterLimit != _colourLevels || SourceHndl != _colourImageHndl
+                                                             || DownPixels != _downPixels) {
+        if (SourceHndl == _imageHndl) {
+            _imageMemAddr = (uint32_t*)SizeBuffer(_frameworkPtr,_imageHndl,
+                                                       Pixels * sizeof(uint32_t),StatusOK);
+        }
+        _histMemAddr = (uint32_t*)SizeBuffer(_frameworkPtr,_histHndl,
+                                                   _iterLimit * sizeof(uint32_t),StatusOK);
+        _lutMemAddr = (float*)SizeBuffer(_frameworkPtr,_lutHndl,
+                                                  _iterLimit * 3 * sizeof(float),StatusOK);
         
-    for (int Iy = 0; Iy < Ny; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            int idata = int(imageData[iptr++]);
-            int index = ColourIndex[idata];
-            float R,G,B;
-            GetRGB (index,&R,&G,&B);
-            ColourVec RGB = {R,G,B};
-            if (Ix == 0) {
-                for (int I = 0; I < 5; I++) { colours[cptr++] = RGB; }
-            } else {
-                colours[cptr++] = RGB;
-                colours[cptr++] = RGB;
-            }
+        //  The downsampled image and the smoothed histogram are only used by the GPU, so they
+        //  aren't mapped. The smoothed histogram has to start again if anything changes.
+        
+        if (!_frameworkPtr->IsBufferCreated(_downHndl,StatusOK)) {
+            _frameworkPtr->CreateBuffer(_downHndl,DownPixels * sizeof(uint32_t),StatusOK);
+        } else {
+            _frameworkPtr->ResizeBuffer(_downHndl,DownPixels * sizeof(uint32_t),StatusOK);
+        }
+        if (!_frameworkPtr->IsBufferCreated(_smoothHndl,StatusOK)) {
+            _frameworkPtr->CreateBuffer(_smoothHndl,_iterLimit * sizeof(float),StatusOK);
+        } else {
+            _frameworkPtr->ResizeBuffer(_smoothHndl,_iterLimit * sizeof(float),StatusOK);
         }
-        colours[cptr++] = { 0.0,0.0,0.0 };
+        _stableReset = true;
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                   {SourceHndl,_bufferHandles[_coloursIndex],_histHndl,_lutHndl,_downHndl,
+                                                                _colourPaletteHndl,_smoothHndl};
+        _frameworkPtr->SetupVulkanDescriptorSet(Handles,_colourDescriptorSet,StatusOK);
+        if (_quadAvailable) {
+            Handles = {SourceHndl,_lutHndl,_quadParamsHndl,_downHndl};
+            _frameworkPtr->SetupVulkanDescriptorSet(Handles,_quadDescriptorSet,StatusOK);
+        }
+        _downPixels = DownPixels;
+        _colourPixels = Pixels;
+        _colourLevels = _iterLimit;
+        _colourImageHndl = SourceHndl;
+    }
+    if (StatusOK && SourceHndl == _imageHndl) {
+        memcpy(_imageMemAddr,imageData,Pixels * sizeof(uint32_t));
+        _frameworkPtr->FlushBuffer(_imageHndl,StatusOK);
     }
     
-    //  If the colours buffer is shared, it needs explicit synchronisation when modified.
-    //  See comments in BuildBuffers() - this is a null operation for buffers that don't need it.
-
-    bool StatusOK = true;
-    VkQueue queueHndl;
-    KVVulkanFramework::KVBufferHandle ColoursHandle = _bufferHandles[_coloursIndex];
-    _frameworkPtr->GetDeviceQueue(&queueHndl,StatusOK);
-    _frameworkPtr->SyncBuffer(ColoursHandle,_commandPool,queueHndl,StatusOK);
-
-    free (Hist);
-    free (ColourIndex);
-    //printf("Full colour handling took %.2f msec\n", theTimer.ElapsedMsec());
+    //  Each stage of the shader loops over as many pixels as it needs to, so the number of
+    //  workgroups can be limited.
+    
+    uint32_t PixelGroups = uint32_t(std::min((Pixels + C_ColourGroupSize - 1) / C_ColourGroupSize,
+                                                                       long(C_ColourMaxGroups)));
+    uint32_t LevelGroups = uint32_t((_iterLimit + C_ColourGroupSize - 1) / C_ColourGroupSize);
+    uint32_t DownGroups = uint32_t(std::min((DownPixels + C_ColourGroupSize - 1) /
+                                                  C_ColourGroupSize,long(C_ColourMaxGroups)));
+    //  In the stable colour mode, the weight is that given to this image's histogram in the
+    //  smoothed histogram. If the smoothing is starting afresh, it is given all the weight.
+    
+    bool Stable = _stableColours;
+    bool Quad = (_quadDraw || Down) && _quadAvailable;
+    float Weight = 1.0f;
+    if (Stable) {
+        if (!_stableReset && (_frameWriter || _stableTimer.ElapsedMsec() < C_StableColourGapMsec)) {
+            Weight = C_StableColourWeight;
+        }
+        _stableReset = false;
+        _stableTimer.Restart();
+    }
+    ColourArgs Args[5];
+    for (int Stage = 0; Stage < 5; Stage++) {
+        Args[Stage] = {Stage,Nx,Ny,_iterLimit,Width,Height,Weight};
+    }
+    KVVulkanFramework::KVDispatch Dispatch;
+    Dispatch.PipelineHndl = _colourPipeline;
+    Dispatch.PipelineLayoutHndl = _colourPipelineLayout;
+    Dispatch.DescriptorSetHndl = _colourDescriptorSet;
+    Dispatch.WorkGroupCounts[1] = 1;
+    Dispatch.WorkGroupCounts[2] = 1;
+    Dispatch.PushConstantSize = sizeof(ColourArgs);
+    std::vector<KVVulkanFramework::KVBufferHandle> NoBuffers;
+    VkQueue QueueHndl;
+    _frameworkPtr->GetDeviceQueue(&QueueHndl,StatusOK);
+    
+    //  First, clear the histogram and build it, and read it back. This is the first use of the
+    //  image, so if it was computed on another queue, this is what waits for it on the GPU.
+    //  In the stable colour mode, the same submission then has a single workgroup set the
+    //  colour table, and goes on to set the colours, just as below.
+    
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches;
+    Dispatch.WorkGroupCounts[0] = LevelGroups;
+    Dispatch.PushConstants = &Args[0];
+    Dispatches.push_back(Dispatch);
+    Dispatch.WorkGroupCounts[0] = PixelGroups;
+    Dispatch.PushConstants = &Args[1];
+    Dispatches.push_back(Dispatch);
+    if (Stable) {
+        Dispatch.WorkGroupCounts[0] = 1;
+        Dispatch.PushConstants = &Args[4];
+        Dispatches.push_back(Dispatch);
+        if (!Quad) {
+            Dispatch.WorkGroupCounts[0] = PixelGroups;
+            Dispatch.PushConstants = &Args[2];
+            Dispatches.push_back(Dispatch);
+        } else if (Down) {
+            Dispatch.WorkGroupCounts[0] = DownGroups;
+            Dispatch.PushConstants = &Args[3];
+            Dispatches.push_back(Dispatch);
+        }
+    }
+    _frameworkPtr->RecordComputeBatch(_colourCommandBuffer,Dispatches,NoBuffers,NoBuffers,
+                                                                                   StatusOK);
+    if (WaitPoints.size() > 0) {
+        std::vector<KVVulkanFramework::KVTimelinePoint> NoSignalPoints;
+        KVVulkanFramework::KVSubmitTicket Ticket = _frameworkPtr->SubmitCommandBuffer(QueueHndl,
+                   _colourCommandBuffer,WaitPoints,VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                                                   NoSignalPoints,StatusOK);
+        _frameworkPtr->WaitFor(Ticket,StatusOK);
+    } else {
+        _frameworkPtr->RunCommandBuffer(QueueHndl,_colourCommandBuffer,StatusOK);
+    }
+    _frameworkPtr->InvalidateBuffer(_histHndl,StatusOK);
+    
+    //  Then work out the colour for each data value, and have the shader set the colours -
+    //  unless the image is being drawn as a quad, when the fragment shader looks them up, or
+    //  downsampled, when the shader sets the colours of the downsampled image instead. In the
+    //  stable colour mode this has all been done, but the histogram is still kept for
+    //  GetHistogram().
+    
+    if (StatusOK) _hist.assign(_histMemAddr,_histMemAddr + _iterLimit);
+    if (StatusOK && !Stable) {
+        _colourIndex.resize(_iterLimit);
+        int* ColourIndex = _colourIndex.data();
+        BuildColourIndex(ColourIndex);
+        for (int I = 0; I < _iterLimit; I++) {
+            GetRGB(ColourIndex[I],&_lutMemAddr[I * 3],&_lutMemAddr[I * 3 + 1],
+                                                                   &_lutMemAddr[I * 3 + 2]);
+        }
+        _frameworkPtr->FlushBuffer(_lutHndl,StatusOK);
+    }
+    if (Quad) {
+        if (StatusOK) {
+            _quadParamsMemAddr[0] = Nx;
+            _quadParamsMemAddr[1] = Ny;
+            _quadParamsMemAddr[2] = _iterLimit;
+            _quadParamsMemAddr[3] = Down ? 1 : 0;
+            _quadParamsMemAddr[4] = Width;
+            _quadParamsMemAddr[5] = Height;
+            _frameworkPtr->FlushBuffer(_quadParamsHndl,StatusOK);
+        }
+        if (Down && !Stable) {
+            Dispatches.clear();
+            Dispatch.WorkGroupCounts[0] = DownGroups;
+            Dispatch.PushConstants = &Args[3];
+            Dispatches.push_back(Dispatch);
+            _frameworkPtr->RecordComputeBatch(_colourCommandBuffer,Dispatches,NoBuffers,
+                                                                         NoBuffers,StatusOK);
+            _frameworkPtr->RunCommandBuffer(QueueHndl,_colourCommandBuffer,StatusOK);
+        }
+    } else if (!Stable) {
+        Dispatches.clear();
+        Dispatch.WorkGroupCounts[0] = PixelGroups;
+        Dispatch.PushConstants = &Args[2];
+        Dispatches.push_back(Dispatch);
+        _frameworkPtr->RecordComputeBatch(_colourCommandBuffer,Dispatches,NoBuffers,NoBuffers,
+                                                                                   StatusOK);
+        _frameworkPtr->RunCommandBuffer(QueueHndl,_colourCommandBuffer,StatusOK);
+    }
+    
+    //  If anything went wrong, go back to using the CPU from now on.
+    
+    if (!StatusOK) {
+        _debug.Log("Setup","Colouring the image using the GPU failed. Reverting to the CPU.");
+        _gpuColouring = false;
+        _stableReset = true;
+        SetColourDataHistEq(imageData,Nx,Ny);
+    }
 }
 
-void Renderer::PercentileRange (float* imageData,int Nx,int Ny,float Percentile,
+void Renderer::PercentileRange (uint32_t* imageData,int Nx,int Ny,float Percentile,
                                                  float* rangeMin,float* rangeMax)
 {
     //  This is made easier by the fact that we know all the values in imageData will
@@ -480,6 +1373,212 @@ bool Renderer::BuildShaders()
     return StatusOK;
 }
 
+//  BuildColourPipeline() sets up the compute pipeline used by SetColourDataGPU(), together with
+//  the buffers it uses, apart from the colours buffer which is shared with the graphics
+//  pipeline. The buffers aren't created until SetColourDataGPU() knows how big they need to
+//  be. It returns false if this can't be done - for example if MandelColourComp.spv can't be
+//  found - in which case the CPU is used to colour the image instead.
+
+bool Renderer::BuildColourPipeline()
+{
+    bool StatusOK = true;
+    
+    //  The CPU writes the image and the colour table, and reads the histogram.
+    
+    _imageHndl = _frameworkPtr->SetBufferDetails(0,"STORAGE","SHARED",StatusOK);
+    _histHndl = _frameworkPtr->SetBufferDetails(2,"STORAGE","READBACK",StatusOK);
+    _lutHndl = _frameworkPtr->SetBufferDetails(3,"STORAGE","SHARED",StatusOK);
+    
+    //  The downsampled image is written and read only by the GPU, as is the smoothed histogram
+    //  used by the stable colour mode. The palette that mode sets the colour table from has
+    //  the R,G,B values for each of the 256 levels in GetRGB()'s table, and is set once, here.
+    
+    _downHndl = _frameworkPtr->SetBufferDetails(5,"STORAGE","LOCAL",StatusOK);
+    _smoothHndl = _frameworkPtr->SetBufferDetails(7,"STORAGE","LOCAL",StatusOK);
+    const int LevelsAvailable = 256;
+    _colourPaletteHndl = _frameworkPtr->SetBufferDetails(6,"STORAGE","SHARED",StatusOK);
+    float* Palette = (float*)SizeBuffer(_frameworkPtr,_colourPaletteHndl,
+                                            LevelsAvailable * 3 * sizeof(float),StatusOK);
+    if (StatusOK) {
+        for (int I = 0; I < LevelsAvailable; I++) {
+            GetRGB(I,&Palette[I * 3],&Palette[I * 3 + 1],&Palette[I * 3 + 2]);
+        }
+        _frameworkPtr->FlushBuffer(_colourPaletteHndl,StatusOK);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                   {_imageHndl,_bufferHandles[_coloursIndex],_histHndl,_lutHndl,_downHndl,
+                                                                _colourPaletteHndl,_smoothHndl};
+    _frameworkPtr->CreateVulkanDescriptorSetLayout(Handles,&_colourSetLayout,StatusOK);
+    _frameworkPtr->CreateVulkanDescriptorPool(Handles,1,&_colourDescriptorPool,StatusOK);
+    _frameworkPtr->AllocateVulkanDescriptorSet(_colourSetLayout,_colourDescriptorPool,
+                                                           &_colourDescriptorSet,StatusOK);
+    std::vector<uint32_t> NoConstants;
+    _frameworkPtr->CreateComputePipeline("MandelColourComp.spv","main",&_colourSetLayout,
+            &_colourPipelineLayout,&_colourPipeline,NoConstants,sizeof(ColourArgs),StatusOK);
+    _frameworkPtr->CreateComputeCommandBuffer(_commandPool,&_colourCommandBuffer,StatusOK);
+    if (StatusOK) {
+        _debug.Log("Setup","Colouring pipeline created using MandelColourComp.spv.");
+    } else {
+        _debug.Log("Setup","Unable to set up the colouring pipeline. The CPU will be used.");
+    }
+    return StatusOK;
+}
+
+//  BuildOrbitPipeline() sets up the compute pipeline used by SetOverlayOrbit(), which writes
+//  the overlay positions buffer. Its descriptor set is set up when it's first used, as the
+//  buffer may have been enlarged by then. It returns false if this can't be done - for example
+//  if MandelOrbitComp.spv can't be found - in which case the controller works out the paths.
+
+bool Renderer::BuildOrbitPipeline()
+{
+    bool StatusOK = true;
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                                                      {_overlayBufferHandles[_positionsIndex]};
+    _frameworkPtr->CreateVulkanDescriptorSetLayout(Handles,&_orbitSetLayout,StatusOK);
+    _frameworkPtr->CreateVulkanDescriptorPool(Handles,1,&_orbitDescriptorPool,StatusOK);
+    _frameworkPtr->AllocateVulkanDescriptorSet(_orbitSetLayout,_orbitDescriptorPool,
+                                                            &_orbitDescriptorSet,StatusOK);
+    std::vector<uint32_t> NoConstants;
+    _frameworkPtr->CreateComputePipeline("MandelOrbitComp.spv","main",&_orbitSetLayout,
+               &_orbitPipelineLayout,&_orbitPipeline,NoConstants,sizeof(OrbitArgs),StatusOK);
+    _frameworkPtr->CreateComputeCommandBuffer(_commandPool,&_orbitCommandBuffer,StatusOK);
+    _orbitVerts = 0;
+    if (StatusOK) {
+        _debug.Log("Setup","Path pipeline created using MandelOrbitComp.spv.");
+    } else {
+        _debug.Log("Setup","Unable to set up the path pipeline. The CPU will be used.");
+    }
+    return StatusOK;
+}
+
+//  BuildQuadPipeline() sets up the graphics pipeline used to draw the image as a single quad.
+//  This has no vertex buffers, but its fragment shader reads the image, colour table and
+//  downsampled image buffers used by the colouring pipeline, and a small buffer with the image
+//  and drawable dimensions. It returns
+//  false if this can't be done - for example if the shaders can't be found - in which case the
+//  image is always drawn as a triangle strip.
+
+bool Renderer::BuildQuadPipeline()
+{
+    bool StatusOK = true;
+    
+    _quadParamsHndl = _frameworkPtr->SetBufferDetails(4,"STORAGE","SHARED",StatusOK);
+    _quadParamsMemAddr = (int*)SizeBuffer(_frameworkPtr,_quadParamsHndl,8 * sizeof(int),StatusOK);
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                                              {_imageHndl,_lutHndl,_quadParamsHndl,_downHndl};
+    _frameworkPtr->CreateVulkanDescriptorSetLayout(Handles,&_quadSetLayout,StatusOK);
+    _frameworkPtr->CreateVulkanDescriptorPool(Handles,1,&_quadDescriptorPool,StatusOK);
+    _frameworkPtr->AllocateVulkanDescriptorSet(_quadSetLayout,_quadDescriptorPool,
+                                                             &_quadDescriptorSet,StatusOK);
+    _frameworkPtr->CreateShaderModuleFromFile("MandelQuadVert.spv",&_quadVertexShader,StatusOK);
+    _frameworkPtr->CreateShaderModuleFromFile("MandelQuadFrag.spv",&_quadFragmentShader,StatusOK);
+    std::vector<KVVulkanFramework::KVBufferHandle> NoBuffers;
+    _frameworkPtr->CreateGraphicsPipeline(_quadVertexShader,"main",_quadFragmentShader,"main",
+            "TRIANGLE_LIST",NoBuffers,&_quadSetLayout,&_quadPipelineLayout,&_quadPipeline,
+                                                                                   StatusOK);
+    if (StatusOK) {
+        _debug.Log("Setup","Quad drawing pipeline created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the quad drawing pipeline.");
+    }
+    return StatusOK;
+}
+
+//  BuildStripPipeline() sets up the graphics pipeline used to draw the image as a triangle strip
+//  with the vertex positions worked out by the vertex shader. Its only vertex buffer is the
+//  colours buffer, and the shader reads the image dimensions from a small buffer set by
+//  BuildBuffers(). It returns false if this can't be done, in which case the triangle strip is
+//  drawn using the positions buffer set up by BuildBuffers().
+
+bool Renderer::BuildStripPipeline()
+{
+    bool StatusOK = true;
+    
+    _stripParamsHndl = _frameworkPtr->SetBufferDetails(0,"STORAGE","SHARED",StatusOK);
+    _stripParamsMemAddr = (int*)SizeBuffer(_frameworkPtr,_stripParamsHndl,2 * sizeof(int),
+                                                                                   StatusOK);
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles = {_stripParamsHndl};
+    _frameworkPtr->CreateVulkanDescriptorSetLayout(Handles,&_stripSetLayout,StatusOK);
+    _frameworkPtr->CreateVulkanDescriptorPool(Handles,1,&_stripDescriptorPool,StatusOK);
+    _frameworkPtr->AllocateVulkanDescriptorSet(_stripSetLayout,_stripDescriptorPool,
+                                                             &_stripDescriptorSet,StatusOK);
+    _frameworkPtr->SetupVulkanDescriptorSet(Handles,_stripDescriptorSet,StatusOK);
+    _frameworkPtr->CreateShaderModuleFromFile("MandelStripVert.spv",&_stripVertexShader,StatusOK);
+    std::vector<KVVulkanFramework::KVBufferHandle> ColourBuffers =
+                                                         {_bufferHandles[_coloursIndex]};
+    _frameworkPtr->CreateGraphicsPipeline(_stripVertexShader,"main",_fragmentShader,"main",
+            "TRIANGLE_STRIP",ColourBuffers,&_stripSetLayout,&_stripPipelineLayout,
+                                                                  &_stripPipeline,StatusOK);
+    if (StatusOK) {
+        _debug.Log("Setup","Triangle strip pipeline without a positions buffer created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the triangle strip pipeline. Positions are used.");
+    }
+    return StatusOK;
+}
+
+//  BuildLevelsPipeline() sets up the graphics pipeline used to draw the triangle strip when the
+//  CPU colours the image. This has no vertex buffers. Its vertex shader reads the image
+//  dimensions from the buffer used by the triangle strip pipeline, the colour level of each
+//  pixel from the levels buffer for the frame being drawn, and the colour for that level from
+//  a colour table that is set here, once. The levels buffers aren't created until BuildBuffers()
+//  knows the image size. It returns false if this can't be done, in which case the CPU sets
+//  the vertex colours in the colours buffers.
+
+bool Renderer::BuildLevelsPipeline()
+{
+    bool StatusOK = true;
+    
+    //  The colour table has the R,G,B values for each of the 256 levels in GetRGB()'s table.
+    
+    const int LevelsAvailable = 256;
+    _paletteHndl = _frameworkPtr->SetBufferDetails(2,"STORAGE","SHARED",StatusOK);
+    float* Palette = (float*)SizeBuffer(_frameworkPtr,_paletteHndl,
+                                            LevelsAvailable * 3 * sizeof(float),StatusOK);
+    if (StatusOK) {
+        for (int I = 0; I < LevelsAvailable; I++) {
+            GetRGB(I,&Palette[I * 3],&Palette[I * 3 + 1],&Palette[I * 3 + 2]);
+        }
+        _frameworkPtr->FlushBuffer(_paletteHndl,StatusOK);
+    }
+    
+    //  Each frame in flight has its own levels buffer and descriptor set, and the pool has to
+    //  have room for the buffers of all of them.
+    
+    _frameLevelHndls.clear();
+    std::vector<KVVulkanFramework::KVBufferHandle> PoolHandles;
+    for (int Frame = 0; Frame < _framesInFlight; Frame++) {
+        KVVulkanFramework::KVBufferHandle LevelsHndl =
+                            _frameworkPtr->SetBufferDetails(1,"STORAGE","SHARED",StatusOK);
+        _frameLevelHndls.push_back(LevelsHndl);
+        PoolHandles.insert(PoolHandles.end(),{_stripParamsHndl,LevelsHndl,_paletteHndl});
+    }
+    _frameLevelsMemAddrs.assign(_frameLevelHndls.size(),nullptr);
+    _levelsPixels.assign(_frameLevelHndls.size(),0);
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                                         {_stripParamsHndl,_frameLevelHndls[0],_paletteHndl};
+    _frameworkPtr->CreateVulkanDescriptorSetLayout(Handles,&_levelsSetLayout,StatusOK);
+    _frameworkPtr->CreateVulkanDescriptorPool(PoolHandles,_framesInFlight,
+                                                           &_levelsDescriptorPool,StatusOK);
+    _levelsDescriptorSets.assign(_framesInFlight,VK_NULL_HANDLE);
+    for (int Frame = 0; Frame < _framesInFlight; Frame++) {
+        _frameworkPtr->AllocateVulkanDescriptorSet(_levelsSetLayout,_levelsDescriptorPool,
+                                                    &_levelsDescriptorSets[Frame],StatusOK);
+    }
+    _frameworkPtr->CreateShaderModuleFromFile("MandelLevelsVert.spv",&_levelsVertexShader,
+                                                                                   StatusOK);
+    std::vector<KVVulkanFramework::KVBufferHandle> NoBuffers;
+    _frameworkPtr->CreateGraphicsPipeline(_levelsVertexShader,"main",_fragmentShader,"main",
+            "TRIANGLE_STRIP",NoBuffers,&_levelsSetLayout,&_levelsPipelineLayout,
+                                                                 &_levelsPipeline,StatusOK);
+    if (StatusOK) {
+        _debug.Log("Setup","Colour level drawing pipeline created.");
+    } else {
+        _debug.Log("Setup","Unable to set up the colour level pipeline. Colours are used.");
+    }
+    return StatusOK;
+}
+
 void Renderer::BuildBuffers()
 {
     //  This is called when the initial size of the image to display is first known, and is then
@@ -508,24 +1607,55 @@ void Renderer::BuildBuffers()
     MsecTimer theTimer;
     
     long NumVertices = ((Nx - 1) * 2 + 6) * Ny;
-     
-    long PosnsSizeInBytes = sizeof(PositionVec) * NumVertices;
+    
+    //  If the vertex shader works out the vertex positions, all it needs is the image size,
+    //  and there's no positions buffer at all.
+    
     KVVulkanFramework::KVBufferHandle PosnsHandle = _bufferHandles[_positionsIndex];
-    if (!_frameworkPtr->IsBufferCreated(PosnsHandle,StatusOK)) {
-        _frameworkPtr->CreateBuffer(PosnsHandle,PosnsSizeInBytes,StatusOK);
+    if (_stripAvailable) {
+        _stripParamsMemAddr[0] = Nx;
+        _stripParamsMemAddr[1] = Ny;
+        _frameworkPtr->FlushBuffer(_stripParamsHndl,StatusOK);
     } else {
-        _frameworkPtr->ResizeBuffer(PosnsHandle,PosnsSizeInBytes,StatusOK);
-    }
-    _positionsMemAddr = (PositionVec*)_frameworkPtr->MapBuffer(
+        long PosnsSizeInBytes = sizeof(PositionVec) * NumVertices;
+        if (!_frameworkPtr->IsBufferCreated(PosnsHandle,StatusOK)) {
+            _frameworkPtr->CreateBuffer(PosnsHandle,PosnsSizeInBytes,StatusOK);
+        } else {
+            _frameworkPtr->ResizeBuffer(PosnsHandle,PosnsSizeInBytes,StatusOK);
+        }
+        _positionsMemAddr = (PositionVec*)_frameworkPtr->MapBuffer(
                                                     PosnsHandle,&_positionsBytes,StatusOK);
+    }
+    //  If the CPU colouring only sets the colour levels, only the first colours buffer - the one
+    //  the GPU colouring uses - is needed, and each frame has a levels buffer instead. These
+    //  hold one byte per pixel, but are read by the shader as uints, so are rounded up.
+    
+    size_t ColourFrames = _frameColourHndls.size();
+    if (_levelsAvailable) ColourFrames = 1;
     long ColoursSizeInBytes = sizeof(ColourVec) * NumVertices;
-    KVVulkanFramework::KVBufferHandle ColoursHandle = _bufferHandles[_coloursIndex];
-    if (!_frameworkPtr->IsBufferCreated(ColoursHandle,StatusOK)) {
-        _frameworkPtr->CreateBuffer(ColoursHandle,ColoursSizeInBytes,StatusOK);
-    } else {
-        _frameworkPtr->ResizeBuffer(ColoursHandle,ColoursSizeInBytes,StatusOK);
+    for (size_t Frame = 0; Frame < ColourFrames; Frame++) {
+        KVVulkanFramework::KVBufferHandle ColoursHandle = _frameColourHndls[Frame];
+        if (!_frameworkPtr->IsBufferCreated(ColoursHandle,StatusOK)) {
+            _frameworkPtr->CreateBuffer(ColoursHandle,ColoursSizeInBytes,StatusOK);
+        } else {
+            _frameworkPtr->ResizeBuffer(ColoursHandle,ColoursSizeInBytes,StatusOK);
+        }
+        _frameColoursMemAddrs[Frame] = (ColourVec*)_frameworkPtr->MapBuffer(ColoursHandle,
+                                                                   &_coloursBytes,StatusOK);
+    }
+    if (_levelsAvailable) {
+        long LevelsSizeInBytes = ((long(Nx) * long(Ny) + 3) / 4) * 4;
+        for (size_t Frame = 0; Frame < _frameLevelHndls.size(); Frame++) {
+            _frameLevelsMemAddrs[Frame] = (uint8_t*)SizeBuffer(_frameworkPtr,
+                                         _frameLevelHndls[Frame],LevelsSizeInBytes,StatusOK);
+        }
+        _levelsPixels.assign(_frameLevelHndls.size(),0);
     }
-    _coloursMemAddr = (ColourVec*)_frameworkPtr->MapBuffer(ColoursHandle,&_coloursBytes,StatusOK);
+    _colourSlice = 0;
+    _coloursMemAddr = _frameColoursMemAddrs[0];
+    _colourPixels = 0;
+    _histImageOK = false;
+    _sliceVersions.assign(size_t(_framesInFlight),-1);
 
     _debug.Logf("Timing","Resized renderer buffers at %.2f msec",theTimer.ElapsedMsec());
 
@@ -543,9 +1673,11 @@ void Renderer::BuildBuffers()
     //  size of the image has not changed, but new image data requires that the colour values
     //  for each pixel be recalculated.
         
-    //  Create scratch arrays to fill with the positions and colours for the vertices.
+    //  Create scratch arrays to fill with the positions and colours for the vertices. The
+    //  positions are only needed if there's a positions buffer.
     
-    PositionVec *positions = new PositionVec[NumVertices];
+    PositionVec *positions = nullptr;
+    if (!_stripAvailable) positions = new PositionVec[NumVertices];
     ColourVec *colours = new ColourVec[NumVertices];
  
     //  Set the fixed positions for each vertex, and then set the default colours for
@@ -553,7 +1685,7 @@ void Renderer::BuildBuffers()
     //  goes wrong, but it helps to have something visually meaningful, if only for
     //  testing.
     
-    SetVertexPositions(positions,Nx,Ny);
+    if (positions) SetVertexPositions(positions,Nx,Ny);
     SetVertexDefaultColours(colours,Nx,Ny);
     _debug.Logf("Timing","Recalculated vertices & colours at %.2f msec",theTimer.ElapsedMsec());
 
@@ -563,8 +1695,10 @@ void Renderer::BuildBuffers()
     //  efficient to do the buffer copies in one memcpy() call. Or that may be extra
     //  overhead. In any case, it's only done once.
     
-    memcpy(_positionsMemAddr,positions,_positionsBytes);
-    memcpy(_coloursMemAddr,colours,_coloursBytes);
+    if (positions) memcpy(_positionsMemAddr,positions,_positionsBytes);
+    for (size_t Frame = 0; Frame < ColourFrames; Frame++) {
+        memcpy(_frameColoursMemAddrs[Frame],colours,_coloursBytes);
+    }
 
     //  This code is only needed if the positions and colours buffers have been set up as
     //  staged buffers (which need explicit synchronisation) rather than as shared buffers.
@@ -573,8 +1707,10 @@ void Renderer::BuildBuffers()
     
     VkQueue queueHndl;
     _frameworkPtr->GetDeviceQueue(&queueHndl,StatusOK);
-    _frameworkPtr->SyncBuffer(PosnsHandle,_commandPool,queueHndl,StatusOK);
-    _frameworkPtr->SyncBuffer(ColoursHandle,_commandPool,queueHndl,StatusOK);
+    if (positions) _frameworkPtr->SyncBuffer(PosnsHandle,_commandPool,queueHndl,StatusOK);
+    for (size_t Frame = 0; Frame < ColourFrames; Frame++) {
+        _frameworkPtr->SyncBuffer(_frameColourHndls[Frame],_commandPool,queueHndl,StatusOK);
+    }
 
     _debug.Logf("Timing","Copied data to renderer buffers at %.2f msec",theTimer.ElapsedMsec());
     
@@ -672,8 +1808,35 @@ void Renderer::SetVertexDefaultColours (ColourVec colours[],int Nx,int Ny)
     }
 }
 
+//  SizeOverlay() enlarges the overlay buffers, if need be, so they can hold a path of NPosns
+//  points. It returns false if they can't.
+
+bool Renderer::SizeOverlay(int NPosns)
+{
+    if (NPosns > _maxOverVerts) {
+        
+        //  Resizing the buffers waits for any frames in flight, but this only happens the
+        //  first time a path is longer than any before it.
+        
+        bool StatusOK = true;
+        KVVulkanFramework::KVBufferHandle PosnsHandle = _overlayBufferHandles[_positionsIndex];
+        _frameworkPtr->ResizeBuffer(PosnsHandle,NPosns * sizeof(PositionVec),StatusOK);
+        _overlayPositionsMemAddr = (PositionVec*)_frameworkPtr->MapBuffer(
+                                       PosnsHandle,&_overlayPositionsBytes,StatusOK);
+        KVVulkanFramework::KVBufferHandle ColoursHandle = _overlayBufferHandles[_coloursIndex];
+        _frameworkPtr->ResizeBuffer(ColoursHandle,NPosns * sizeof(ColourVec),StatusOK);
+        _overlayColoursMemAddr = (ColourVec*)_frameworkPtr->MapBuffer(
+                                       ColoursHandle,&_overlayColoursBytes,StatusOK);
+        _maxOverVerts = 0;
+        _overlayWhiteVerts = 0;
+        if (StatusOK) _maxOverVerts = NPosns;
+    }
+    return (NPosns <= _maxOverVerts);
+}
+
 void Renderer::SetOverlay(float* xPosns,float* yPosns,int nPosns)
 {
+    SizeOverlay(nPosns);
     if (nPosns > 0) {
         if (nPosns > _maxOverVerts) nPosns = _maxOverVerts;
         float xScale = 2.0 / _viewWidth;
@@ -684,20 +1847,141 @@ void Renderer::SetOverlay(float* xPosns,float* yPosns,int nPosns)
             _overlayPositionsMemAddr[i] = {x,y};
             _overlayColoursMemAddr[i] = {1.0,1.0,1.0};
         }
+        if (nPosns > _overlayWhiteVerts) _overlayWhiteVerts = nPosns;
     }
     _overVerts = nPosns;
 }
 
-void Renderer::Draw(void* /*pView*/, float* imageData )
+//  OverlayOrbitOnGPU() returns true if SetOverlayOrbit() can be used.
+
+bool Renderer::OverlayOrbitOnGPU(void)
+{
+    return _gpuOrbit;
+}
+
+//  SetOverlayOrbit() sets the overlay to the path of the Mandelbrot calculation for the point
+//  (X0,Y0), having MandelOrbit.comp work it out and write it straight into the overlay
+//  positions buffer. NPosns is the number of vertices drawn - the iteration limit for the
+//  path - and a point (X,Y) in the path is drawn at (CentAtX + (X - XCent) * Scale,
+//  CentAtY + (Y - YCent) * Scale) in window frame coordinates, which is where SetOverlay()
+//  would draw it given that position. It returns false if the GPU can't be used, when the
+//  caller should work out the path itself and pass it to SetOverlay().
+
+bool Renderer::SetOverlayOrbit(double X0,double Y0,int NPosns,double XCent,double YCent,
+                                                    float CentAtX,float CentAtY,double Scale)
+{
+    if (!_gpuOrbit) return false;
+    SizeOverlay(NPosns);
+    if (NPosns > _maxOverVerts) NPosns = _maxOverVerts;
+    if (NPosns <= 0) {
+        _overVerts = 0;
+        return true;
+    }
+    
+    //  The descriptor set only needs setting up again if the positions buffer was enlarged.
+    //  The colours are all white, so only any not yet set need setting.
+    
+    bool StatusOK = true;
+    if (_orbitVerts != _maxOverVerts) {
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                                                      {_overlayBufferHandles[_positionsIndex]};
+        _frameworkPtr->SetupVulkanDescriptorSet(Handles,_orbitDescriptorSet,StatusOK);
+        _orbitVerts = _maxOverVerts;
+    }
+    for (int I = _overlayWhiteVerts; I < NPosns; I++) {
+        _overlayColoursMemAddr[I] = {1.0,1.0,1.0};
+    }
+    if (NPosns > _overlayWhiteVerts) _overlayWhiteVerts = NPosns;
+    
+    //  The conversion to normalised device coordinates is the one SetOverlay() does.
+    
+    float XScale = 2.0 / _viewWidth;
+    float YScale = 2.0 / _viewHeight;
+    OrbitArgs Args = {X0,Y0,XCent,YCent,CentAtX * XScale - 1.0f,1.0f - CentAtY * YScale,
+                                           float(Scale * XScale),-float(Scale * YScale),NPosns};
+    KVVulkanFramework::KVDispatch Dispatch;
+    Dispatch.PipelineHndl = _orbitPipeline;
+    Dispatch.PipelineLayoutHndl = _orbitPipelineLayout;
+    Dispatch.DescriptorSetHndl = _orbitDescriptorSet;
+    Dispatch.WorkGroupCounts[0] = 1;
+    Dispatch.WorkGroupCounts[1] = 1;
+    Dispatch.WorkGroupCounts[2] = 1;
+    Dispatch.PushConstants = &Args;
+    Dispatch.PushConstantSize = sizeof(OrbitArgs);
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches = {Dispatch};
+    std::vector<KVVulkanFramework::KVBufferHandle> NoBuffers;
+    _frameworkPtr->RecordComputeBatch(_orbitCommandBuffer,Dispatches,NoBuffers,NoBuffers,
+                                                                                   StatusOK);
+    VkQueue QueueHndl;
+    _frameworkPtr->GetDeviceQueue(&QueueHndl,StatusOK);
+    _frameworkPtr->RunCommandBuffer(QueueHndl,_orbitCommandBuffer,StatusOK);
+    
+    //  If anything went wrong, leave the paths to the CPU from now on.
+    
+    if (!StatusOK) {
+        _debug.Log("Setup","Drawing the path using the GPU failed. Reverting to the CPU.");
+        _gpuOrbit = false;
+        _overVerts = 0;
+        return false;
+    }
+    _overVerts = NPosns;
+    return true;
+}
+
+void Renderer::Draw(void* pView, uint32_t* imageData )
+{
+    Draw(pView,imageData,KVVulkanFramework::KV_NULL_HANDLE);
+}
+
+//  This version of Draw() is also passed the handle of a buffer that already holds the image on
+//  the GPU - normally the one the compute handler computed it in, which is only possible if the
+//  compute handler uses the same Framework. If the GPU colours the image, it reads it straight
+//  from that buffer, so the image never has to be copied by the CPU. imageData must still be
+//  the image, as the CPU colours it if the GPU can't. Since the owner of the buffer may write to
+//  it again as soon as this returns, this waits for the frame to be drawn if it used the buffer.
+
+void Renderer::Draw(void* pView, uint32_t* imageData,
+                                                   KVVulkanFramework::KVBufferHandle ImageHndl)
+{
+    std::vector<KVVulkanFramework::KVTimelinePoint> NoWaitPoints;
+    Draw(pView,imageData,ImageHndl,NoWaitPoints);
+}
+
+//  This version of Draw() is also passed timeline semaphore values that have to be reached
+//  before the GPU reads the image from the ImageHndl buffer - normally the values signalled by
+//  the compute handler's submission that computed the image, if that was run on a different
+//  queue, such as a separate compute queue. Both the colouring and the drawing of the frame
+//  wait for them. (Once the values have been reached, waiting for them again costs nothing.)
+
+void Renderer::Draw(void* /*pView*/, uint32_t* imageData,
+                                             KVVulkanFramework::KVBufferHandle ImageHndl,
+                           const std::vector<KVVulkanFramework::KVTimelinePoint>& WaitPoints)
 {
     MsecTimer theTimer;
     
-    SetColourDataHistEq(imageData,_nx,_ny);
+    //  The wait points only matter if the image is read from ImageHndl.
+    
+    std::vector<KVVulkanFramework::KVTimelinePoint> ImageWaitPoints;
+    if (_gpuColouring && ImageHndl != KVVulkanFramework::KV_NULL_HANDLE) {
+        ImageWaitPoints = WaitPoints;
+    }
+    
+    if (_gpuColouring) {
+        SetColourDataGPU(imageData,_nx,_ny,ImageHndl,ImageWaitPoints);
+    } else {
+        SetColourDataHistEq(imageData,_nx,_ny);
+    }
+    _colourMsec = theTimer.ElapsedMsec();
 
     int Nx = _nx;
     int Ny = _ny;
     int NumVertices = ((Nx - 1) * 2 + 6) * Ny;
     
+    //  The quad can only be used if the GPU coloured the image - see SetColourDataGPU(). It is
+    //  always used for a downsampled image.
+    
+    bool Quad = (_quadDraw || Downsampling(Nx,Ny)) && _quadAvailable && _gpuColouring;
+    
     //MsecTimer theTimer;
 
     bool StatusOK = true;
@@ -711,18 +1995,50 @@ void Renderer::Draw(void* /*pView*/, float* imageData )
         //  associated buffer sets and vertex counts, but we need to set up the arrays that
         //  describe all this. Whether the second elements of the arrays are used depends on
         //  the number of Stages specified, set to 2 for image and overlay, 1 just for image.
+        //  If the image is drawn as a quad, its first stage is just the three vertices of
+        //  the triangle covering the view, made by the vertex shader, and the descriptor set
+        //  that gives the fragment shader the image and the colour table. If the vertex shader
+        //  works out the positions for the triangle strip, it only needs the colours buffer
+        //  and the descriptor set that gives it the image size - or, if the CPU coloured the
+        //  image, no buffers at all, just the descriptor set that also gives it the frame's
+        //  colour levels and the colour table.
         
         int VertexCounts[2] = {NumVertices,_overVerts};
         VkPipeline Pipelines[2] = {_pipeline,_overlayPipeline};
         std::vector<KVVulkanFramework::KVBufferHandle> BufferHandleSets[2] =
                                                        {_bufferHandles,_overlayBufferHandles};
+        BufferHandleSets[0][_coloursIndex] = _frameColourHndls[_colourSlice];
+        VkPipelineLayout PipelineLayouts[2] = {VK_NULL_HANDLE,VK_NULL_HANDLE};
+        VkDescriptorSet DescriptorSets[2] = {VK_NULL_HANDLE,VK_NULL_HANDLE};
+        if (Quad) {
+            VertexCounts[0] = 3;
+            Pipelines[0] = _quadPipeline;
+            BufferHandleSets[0].clear();
+            PipelineLayouts[0] = _quadPipelineLayout;
+            DescriptorSets[0] = _quadDescriptorSet;
+        } else if (_levelsAvailable && !_gpuColouring) {
+            Pipelines[0] = _levelsPipeline;
+            BufferHandleSets[0].clear();
+            PipelineLayouts[0] = _levelsPipelineLayout;
+            DescriptorSets[0] = _levelsDescriptorSets[_colourSlice];
+        } else if (_stripAvailable) {
+            Pipelines[0] = _stripPipeline;
+            BufferHandleSets[0] = {_frameColourHndls[_colourSlice]};
+            PipelineLayouts[0] = _stripPipelineLayout;
+            DescriptorSets[0] = _stripDescriptorSet;
+        }
         int Stages = 1;
         if (_overVerts > 0) Stages = 2;
+        if (_frameWriter) CaptureFrame();
         _frameworkPtr->DrawGraphicsFrame(_currentImage,_commandBuffers[_currentImage],Stages,
-                                          VertexCounts,BufferHandleSets,Pipelines,StatusOK);
+                VertexCounts,BufferHandleSets,Pipelines,PipelineLayouts,DescriptorSets,
+                                                                   ImageWaitPoints,StatusOK);
+        if (_gpuColouring && ImageHndl != KVVulkanFramework::KV_NULL_HANDLE) {
+            _frameworkPtr->WaitForGraphicsFrame(_currentImage,StatusOK);
+        }
     }
-    if (_currentImage == 1) _currentImage = 0;
-    else _currentImage = 1;
+    _presentMsec = theTimer.ElapsedMsec() - _colourMsec;
+    _currentImage = (_currentImage + 1) % _framesInFlight;
 
     _frames++;
     if (_frames % 1000 == 0) {
@@ -732,6 +2048,72 @@ void Renderer::Draw(void* /*pView*/, float* imageData )
     }
 }
 
+//  CaptureFrame() is called by Draw() when frames are being captured, just before it draws the
+//  frame with number _currentImage. First, any frame captured the last time that number was
+//  drawn is handed to the FrameWriter - DrawGraphicsFrame() is about to wait for that frame to
+//  complete anyway. Then a buffer that isn't waiting to be written or being copied into by
+//  another frame is picked, and the Framework is asked to copy the frame into it.
+
+void Renderer::CaptureFrame()
+{
+    int Frame = _currentImage;
+    CollectCapture(Frame);
+    int Buffer = -1;
+    for (int Index = 0; Index < int(_captureHndls.size()); Index++) {
+        if (!_frameWriter->IsBusy(Index) &&
+               std::find(_captureBuffers.begin(),_captureBuffers.end(),Index) ==
+                                                                   _captureBuffers.end()) {
+            Buffer = Index;
+            break;
+        }
+    }
+    if (Buffer < 0) {
+        _droppedFrames++;
+        return;
+    }
+    
+    //  Creating a buffer, or enlarging it, waits for the GPU to be idle, but this only happens
+    //  the first few frames, and if the window gets larger.
+    
+    bool StatusOK = true;
+    int Width,Height;
+    _frameworkPtr->GetSwapChainExtent(&Width,&Height);
+    long Bytes = long(Width) * long(Height) * 4;
+    if (_captureBytes[Buffer] < Bytes) {
+        _captureMemAddrs[Buffer] = (uint8_t*)SizeBuffer(_frameworkPtr,_captureHndls[Buffer],
+                                                                             Bytes,StatusOK);
+        _captureBytes[Buffer] = StatusOK ? Bytes : 0;
+    }
+    _frameworkPtr->CaptureGraphicsFrame(Frame,_captureHndls[Buffer],StatusOK);
+    if (StatusOK) {
+        _captureBuffers[Frame] = Buffer;
+    } else {
+        _droppedFrames++;
+    }
+}
+
+//  CollectCapture() hands any frame copied the last time frame number Frame was drawn to the
+//  FrameWriter, waiting for that frame to complete if it hasn't already.
+
+void Renderer::CollectCapture(int Frame)
+{
+    int Buffer = _captureBuffers[Frame];
+    if (Buffer < 0) return;
+    _captureBuffers[Frame] = -1;
+    bool StatusOK = true;
+    _frameworkPtr->WaitForGraphicsFrame(Frame,StatusOK);
+    int Width,Height;
+    bool BGR;
+    if (StatusOK && _frameworkPtr->GetCapturedFrame(Frame,&Width,&Height,&BGR)) {
+        _frameworkPtr->InvalidateBuffer(_captureHndls[Buffer],StatusOK);
+        if (StatusOK) {
+            _frameWriter->Queue(Buffer,_captureMemAddrs[Buffer],Width,Height,BGR);
+            return;
+        }
+    }
+    _droppedFrames++;
+}
+
 void Renderer::GetRGB (int Index, float* R, float* G, float* B) {
     
     //  This is the Figaro default colour table, initially provided by John Tonry.
@@ -849,9 +2231,11 @@ void Renderer::GetRGB (int Index, float* R, float* G, float* B) {
         two triangles for each pixel, making up a square, originally meaning there were 
         Nx * Ny * 2 * 3 vertices that had to be specified. Using triangle strips cuts that
         down to ((Nx - 1) * 2 + 6) * Ny (see BuildBuffer() comments for just where that
-        comes from). It may be that using just two triangles to form a rectangle covering
-        the whole image and using a texture would be even faster, but in any case, the time
-        taken for the rendering is generally small compared to that required for the computation.
+        comes from). Drawing a single quad covering the whole image, with the fragment shader
+        looking up the colour for each pixel, is now an option - see SetQuadDraw(). This
+        doesn't use a texture, since the Framework doesn't support images and samplers, but
+        reads the image and colour table directly from storage buffers, which for a lookup
+        of the nearest pixel comes to the same thing.
  
     o   The code in SetColourDataHistEq() that sets the colour buffer values used to have:
 
@@ -40,6 +40,33 @@
 //     23rd Aug 2024. Added use of a debug handler. KS.
 //     23rd Aug 2024. Added support for GetDebugOptions(). KS.
 //     14th Sep 2024. Modified following renaming of Framework routines and types. KS.
+//     15th Oct 2026. Added GetHistogram(). KS.
+//                    Added GetDrawTimes(). KS.
+//                    Image data is now passed as uint32_t iteration counts. KS.
+//                    Added SetColourDataGPU(), BuildColourIndex() and BuildColourPipeline(),
+//                    so the image can be coloured by a compute shader. KS.
+//                    Added SetQuadDraw() and BuildQuadPipeline(), so the image can be drawn
+//                    as a single quad coloured by the fragment shader. KS.
+//                    Added a version of Draw() that is passed the buffer already holding the
+//                    image on the GPU. KS.
+//                    Added _colourIndex and _bandHists. KS.
+//                    Added _framesInFlight, _colourSlice, _frameColourHndls and
+//                    _frameColoursMemAddrs. KS.
+//                    Added BuildStripPipeline(), so the triangle strip can be drawn without a
+//                    buffer of vertex positions. KS.
+//                    Added BuildLevelsPipeline(), so the CPU colouring only has to set a
+//                    colour level for each pixel. KS.
+//                    Added StartCapture(), StopCapture(), CaptureFrame(), CollectCapture() and
+//                    the FrameWriter class they use. KS.
+//                    Added a version of Draw() that is also passed timeline semaphore values
+//                    to wait for, and passed them on to SetColourDataGPU(). KS.
+//                    Added SetImageChanges() and UpdateHistogram(), with ImageArea. KS.
+//                    Added Downsampling(), _downHndl and _downPixels, so an image larger than
+//                    the drawable can be downsampled by the GPU before it is drawn. KS.
+//                    Added SetStableColours(), _stableColours, _stableReset, _stableTimer,
+//                    _colourPaletteHndl and _smoothHndl. KS.
+//                    Added SetOverlayOrbit(), OverlayOrbitOnGPU(), BuildOrbitPipeline() and
+//                    SizeOverlay(), with the orbit pipeline variables. KS.
 
 #ifndef __RendererVulkan__
 #define __RendererVulkan__
@@ -48,6 +75,13 @@
 #include "MsecTimer.h"
 #include "DebugHandler.h"
 
+#include <cstdint>
+
+//  The FrameWriter writes captured frames to disk - see StartCapture(). It's only used
+//  internally by the Renderer.
+
+class FrameWriter;
+
 //  The MandelRenderDevice type is defined here so a controller can know what sort
 //  of argument is expected by the constructor. (A Metal version of the controller,
 //  for example, actually does expect a Metal device, whereas this Vulkan version
@@ -75,6 +109,16 @@ typedef struct {
     float B;
 } ColourVec;
 
+//  An image area is a rectangle of pixels, from (Ixst,Iyst) up to (not including) (Ixen,Iyen),
+//  used to tell the renderer which parts of an image are new - see SetImageChanges().
+
+typedef struct {
+    int Ixst;
+    int Ixen;
+    int Iyst;
+    int Iyen;
+} ImageArea;
+
 class Renderer
 {
     public:
@@ -87,24 +131,53 @@ class Renderer
         void SetImageSize (int Nx, int Ny);
         void SetDrawableSize (float width, float height);
         void SetMaxIter (int MaxIter);
+        const std::vector<int>& GetHistogram();
+        void GetDrawTimes(float* ColourMsec,float* PresentMsec);
         void SetOverlay(float* XPosns,float* YPosns,int NPosns);
-        void Draw(void* pView, float* imageData);
+        bool OverlayOrbitOnGPU(void);
+        bool SetOverlayOrbit(double X0,double Y0,int NPosns,double XCent,double YCent,
+                                                   float CentAtX,float CentAtY,double Scale);
+        bool SetQuadDraw(bool UseQuad);
+        bool SetStableColours(bool Stable);
+        void SetImageChanges(int ShiftX,int ShiftY,const std::vector<ImageArea>& Areas);
+        void Draw(void* pView, uint32_t* imageData);
+        void Draw(void* pView, uint32_t* imageData, KVVulkanFramework::KVBufferHandle ImageHndl);
+        void Draw(void* pView, uint32_t* imageData, KVVulkanFramework::KVBufferHandle ImageHndl,
+                           const std::vector<KVVulkanFramework::KVTimelinePoint>& WaitPoints);
+        bool StartCapture(const std::string& FilePrefix);
+        void StopCapture(int* Frames,int* Dropped);
         static std::string GetDebugOptions(void);
     private:
-        void SetColourData(float* imageData,int Nx,int Ny);
-        void SetColourDataHistEq(float* imageData,int Nx,int Ny);
+        void SetColourData(uint32_t* imageData,int Nx,int Ny);
+        void SetColourDataHistEq(uint32_t* imageData,int Nx,int Ny);
+        void SetColourDataGPU(uint32_t* imageData,int Nx,int Ny,
+                                                  KVVulkanFramework::KVBufferHandle ImageHndl,
+                           const std::vector<KVVulkanFramework::KVTimelinePoint>& WaitPoints);
+        void BuildColourIndex(int* ColourIndex);
+        bool UpdateHistogram(uint32_t* imageData,int Nx,int Ny,bool* Changed);
         bool BuildShaders();
+        bool BuildColourPipeline();
+        bool BuildQuadPipeline();
+        bool Downsampling(int Nx,int Ny);
+        bool BuildStripPipeline();
+        bool BuildLevelsPipeline();
+        bool BuildOrbitPipeline();
+        bool SizeOverlay(int NPosns);
         void BuildBuffers();
+        void CaptureFrame();
+        void CollectCapture(int Frame);
         void SetVertexPositions (PositionVec positions[],int Nx,int Ny);
         void SetVertexDefaultColours (ColourVec colours[],int Nx,int Ny);
         void GetRGB (int Index, float* R, float* G, float* B);
-        void PercentileRange (float* imageData,int Nx,int Ny,float Percentile,
+        void PercentileRange (uint32_t* imageData,int Nx,int Ny,float Percentile,
                           float* rangeMin,float* rangeMax);
         static const std::string _debugOptions;
         MsecTimer _frameTimer;
         KVVulkanFramework* _frameworkPtr;
         DebugHandler _debug;
         int _imageCount;
+        //  The number of frames that can be in flight at once, and the one to be drawn next.
+        int _framesInFlight;
         int _currentImage;
         std::vector<VkCommandBuffer> _commandBuffers;
         VkPipeline _pipeline;
@@ -122,6 +195,12 @@ class Renderer
         long _positionsBytes;
         ColourVec* _coloursMemAddr;
         long _coloursBytes;
+        //  The colours buffer for each frame in flight, and their addresses. The first is the
+        //  main colours buffer, in _bufferHandles. _coloursMemAddr is the address of the one
+        //  with index _colourSlice, which has the colours for the image being drawn.
+        std::vector<KVVulkanFramework::KVBufferHandle> _frameColourHndls;
+        std::vector<ColourVec*> _frameColoursMemAddrs;
+        int _colourSlice;
         PositionVec* _overlayPositionsMemAddr;
         ColourVec* _overlayColoursMemAddr;
         long _overlayPositionsBytes;
@@ -130,8 +209,140 @@ class Renderer
         float _viewHeight;
         int _frames;
         int _iterLimit;
+        //  The histogram of the pixel values of the last image drawn - see GetHistogram().
+        std::vector<int> _hist;
+        //  Scratch arrays used in colouring an image, kept from one frame to the next: the
+        //  colour level for each pixel value, and the partial histograms of the bands of rows
+        //  handled by each thread in SetColourDataHistEq().
+        std::vector<int> _colourIndex;
+        std::vector<int> _bandHists;
+        //  The changes to the image to be drawn next, if SetImageChanges() has said what they
+        //  are: the shift of the last image, and the areas that are new.
+        bool _changesKnown;
+        int _changeShiftX;
+        int _changeShiftY;
+        std::vector<ImageArea> _changeAreas;
+        //  A copy of the last image coloured by the CPU, kept once its changes are being passed
+        //  so UpdateHistogram() knows the values the new pixels replace. Rather than being
+        //  moved with the image, it wraps around, with pixel (Ix,Iy) at ((Ix + _histOffsetX)
+        //  % Nx,(Iy + _histOffsetY) % Ny). _histImageOK is false if it isn't up to date.
+        std::vector<uint32_t> _histImage;
+        int _histOffsetX;
+        int _histOffsetY;
+        bool _histImageOK;
+        //  A count of the images coloured by the CPU, and for each frame in flight, the count
+        //  for the image whose colours are in its colours or levels buffer, or -1 if unknown.
+        long _imageVersion;
+        std::vector<long> _sliceVersions;
+        //  The times taken by the last Draw() - see GetDrawTimes().
+        float _colourMsec;
+        float _presentMsec;
         int _nx;
         int _ny;
+        //  The compute pipeline used by SetColourDataGPU(), and the buffers it uses as well
+        //  as the colours buffer. _gpuColouring is false if this couldn't be set up.
+        bool _gpuColouring;
+        VkPipeline _colourPipeline;
+        VkPipelineLayout _colourPipelineLayout;
+        VkDescriptorSetLayout _colourSetLayout;
+        VkDescriptorPool _colourDescriptorPool;
+        VkDescriptorSet _colourDescriptorSet;
+        VkCommandBuffer _colourCommandBuffer;
+        KVVulkanFramework::KVBufferHandle _imageHndl;
+        KVVulkanFramework::KVBufferHandle _histHndl;
+        KVVulkanFramework::KVBufferHandle _lutHndl;
+        uint32_t* _imageMemAddr;
+        uint32_t* _histMemAddr;
+        float* _lutMemAddr;
+        //  The number of pixels and of levels the colouring buffers are currently sized for,
+        //  and the image buffer the descriptor sets currently use.
+        long _colourPixels;
+        int _colourLevels;
+        KVVulkanFramework::KVBufferHandle _colourImageHndl;
+        //  The graphics pipeline used to draw the image as a single quad, and the buffer with
+        //  the image dimensions for its fragment shader. _quadAvailable is false if this
+        //  couldn't be set up, and _quadDraw is true if it's to be used - see SetQuadDraw().
+        bool _quadAvailable;
+        bool _quadDraw;
+        VkShaderModule _quadVertexShader;
+        VkShaderModule _quadFragmentShader;
+        VkPipeline _quadPipeline;
+        VkPipelineLayout _quadPipelineLayout;
+        VkDescriptorSetLayout _quadSetLayout;
+        VkDescriptorPool _quadDescriptorPool;
+        VkDescriptorSet _quadDescriptorSet;
+        KVVulkanFramework::KVBufferHandle _quadParamsHndl;
+        int* _quadParamsMemAddr;
+        //  The image downsampled to the drawable size, written by the colouring pipeline and
+        //  read by the quad's fragment shader, and the number of pixels it's sized for - one if
+        //  the image isn't being downsampled. See Downsampling().
+        KVVulkanFramework::KVBufferHandle _downHndl;
+        long _downPixels;
+        //  The stable colour mode - see SetStableColours(). _stableReset is set when the
+        //  smoothed histogram has to start afresh, and _stableTimer times the gap since the
+        //  last frame. The colouring pipeline sets the colour table from the palette, with the
+        //  colours for the 256 levels, and the smoothed histogram, which only the GPU uses.
+        bool _stableColours;
+        bool _stableReset;
+        MsecTimer _stableTimer;
+        KVVulkanFramework::KVBufferHandle _colourPaletteHndl;
+        KVVulkanFramework::KVBufferHandle _smoothHndl;
+        //  The graphics pipeline used to draw the triangle strip with the vertex positions
+        //  worked out by the vertex shader, and the buffer with the image dimensions it uses.
+        //  _stripAvailable is false if this couldn't be set up, in which case the positions
+        //  buffer in _bufferHandles is used instead.
+        bool _stripAvailable;
+        VkShaderModule _stripVertexShader;
+        VkPipeline _stripPipeline;
+        VkPipelineLayout _stripPipelineLayout;
+        VkDescriptorSetLayout _stripSetLayout;
+        VkDescriptorPool _stripDescriptorPool;
+        VkDescriptorSet _stripDescriptorSet;
+        KVVulkanFramework::KVBufferHandle _stripParamsHndl;
+        int* _stripParamsMemAddr;
+        //  The graphics pipeline used to draw the triangle strip when the CPU colours the
+        //  image, with the vertex shader looking up the colour of each vertex in the colour
+        //  table from the colour level of its pixel. Each frame in flight has its own buffer of
+        //  levels, one byte per pixel, and its own descriptor set, which has to be set up again
+        //  if the image size changes - _levelsPixels has the number of pixels each was set up
+        //  for. _levelsAvailable is false if this couldn't be set up, in which case the CPU
+        //  sets the colours buffers instead.
+        bool _levelsAvailable;
+        VkShaderModule _levelsVertexShader;
+        VkPipeline _levelsPipeline;
+        VkPipelineLayout _levelsPipelineLayout;
+        VkDescriptorSetLayout _levelsSetLayout;
+        VkDescriptorPool _levelsDescriptorPool;
+        std::vector<VkDescriptorSet> _levelsDescriptorSets;
+        std::vector<long> _levelsPixels;
+        std::vector<KVVulkanFramework::KVBufferHandle> _frameLevelHndls;
+        std::vector<uint8_t*> _frameLevelsMemAddrs;
+        KVVulkanFramework::KVBufferHandle _paletteHndl;
+        //  The compute pipeline used by SetOverlayOrbit() to work out the path for a point and
+        //  write it straight into the overlay positions buffer. _gpuOrbit is false if this
+        //  couldn't be set up - it needs double precision. Its descriptor set has to be set up
+        //  again if the overlay buffers are enlarged - _orbitVerts has the number of vertices
+        //  it was set up for. _overlayWhiteVerts is the number of overlay colours that have
+        //  been set, all white.
+        bool _gpuOrbit;
+        VkPipeline _orbitPipeline;
+        VkPipelineLayout _orbitPipelineLayout;
+        VkDescriptorSetLayout _orbitSetLayout;
+        VkDescriptorPool _orbitDescriptorPool;
+        VkDescriptorSet _orbitDescriptorSet;
+        VkCommandBuffer _orbitCommandBuffer;
+        int _orbitVerts;
+        int _overlayWhiteVerts;
+        //  Frame capture - see StartCapture(). _frameWriter is null if frames aren't being
+        //  captured. The frames are copied into a ring of buffers, each with its address and
+        //  the number of bytes it can hold. _captureBuffers has, for each frame in flight, the
+        //  index of the buffer its frame is being copied into, or -1 if it isn't.
+        FrameWriter* _frameWriter;
+        std::vector<KVVulkanFramework::KVBufferHandle> _captureHndls;
+        std::vector<uint8_t*> _captureMemAddrs;
+        std::vector<long> _captureBytes;
+        std::vector<int> _captureBuffers;
+        int _droppedFrames;
 };
 
 #endif
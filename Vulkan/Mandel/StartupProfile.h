@@ -0,0 +1,142 @@
+//
+//                         S t a r t u p  P r o f i l e . h
+//
+//  This records how long each stage of a program's start-up takes - creating the Vulkan
+//  instance, finding and opening the GPU device, reading shader files, creating buffers,
+//  descriptors and pipelines, reading an input file - up to the point where it starts the
+//  work it's really there to do. For a short run, that start-up can easily take longer than
+//  the computation itself. The "Setup" debug level logs the elapsed time as each stage ends,
+//  but doesn't show how long each stage took, or which ran at the same time as which, which
+//  matters once some of them are run in parallel (see KVVulkanFramework::StartDeviceSetup()).
+//
+//  There is just the one, global, StartupProfile, returned by StartupProfile::Global(). A
+//  program calls Start() as early as it can, which sets the time that everything is measured
+//  from. Record() records a stage given its start and end times, and a StartupPhase records
+//  the time from its creation until it goes out of scope, or until its End() is called. Both
+//  can be used from any thread. Nothing is recorded until Enable() is called, so the calls can
+//  be left in place, and nothing is recorded after Finish(), which the program calls when its
+//  start-up is over - so a stage repeated later, for a second image size, say, isn't counted.
+//  Report() lists the stages in the order they started, with the thread each ran on.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __StartupProfile__
+#define __StartupProfile__
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+class StartupProfile
+{
+public:
+    //  Returns the one global profile.
+    static StartupProfile& Global(void) {
+        static StartupProfile TheProfile;
+        return TheProfile;
+    }
+    //  Sets the time from which everything is measured to now.
+    void Start(void) {
+        std::lock_guard<std::mutex> Lock(_mutex);
+        _startTime = std::chrono::steady_clock::now();
+        _phases.clear();
+        _finishMsec = 0.0;
+    }
+    //  Enables or disables recording. Nothing is recorded until this is called.
+    void Enable(bool On) { _enabled = On; }
+    bool Enabled(void) const { return _enabled; }
+    //  Returns the time in msec since Start() was called.
+    double NowMsec(void) const {
+        return double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - _startTime).count()) * 1.0e-6;
+    }
+    //  Records a stage called Name that ran from StartMsec to EndMsec, on the calling thread.
+    void Record(const std::string& Name,double StartMsec,double EndMsec) {
+        if (!_enabled) return;
+        std::lock_guard<std::mutex> Lock(_mutex);
+        if (_finishMsec > 0.0) return;
+        int Thread = ThreadNumber();
+        _phases.push_back({Name,StartMsec,EndMsec,Thread});
+    }
+    //  Marks the end of start-up. Stages recorded after this are ignored. Returns true only
+    //  for the first call made while recording is enabled, so the caller knows to Report().
+    bool Finish(void) {
+        if (!_enabled) return false;
+        std::lock_guard<std::mutex> Lock(_mutex);
+        if (_finishMsec > 0.0) return false;
+        _finishMsec = NowMsec();
+        return true;
+    }
+    //  Lists the stages recorded, in the order they started.
+    void Report(void) {
+        std::lock_guard<std::mutex> Lock(_mutex);
+        if (_phases.empty()) return;
+        std::vector<Phase> Sorted = _phases;
+        std::stable_sort(Sorted.begin(),Sorted.end(),
+                     [](const Phase& A,const Phase& B) { return A.StartMsec < B.StartMsec; });
+        printf ("\nStart-up profile (msec from program start):\n");
+        printf ("   %-36s %10s %10s %10s  %s\n","Stage","Start","End","Took","Thread");
+        for (const Phase& Stage : Sorted) {
+            printf ("   %-36s %10.3f %10.3f %10.3f  %d\n",Stage.Name.c_str(),Stage.StartMsec,
+                           Stage.EndMsec,Stage.EndMsec - Stage.StartMsec,Stage.Thread);
+        }
+        if (_finishMsec > 0.0) printf ("   Start-up complete at %.3f msec\n",_finishMsec);
+        printf ("\n");
+    }
+private:
+    StartupProfile() : _startTime(std::chrono::steady_clock::now()) {}
+    //  Returns the number of the calling thread - 0 for the first to record a stage, usually the
+    //  main thread, 1 for the next, and so on. Called with the mutex locked.
+    int ThreadNumber(void) {
+        std::thread::id Id = std::this_thread::get_id();
+        auto Iter = _threads.find(Id);
+        if (Iter != _threads.end()) return Iter->second;
+        int Number = int(_threads.size());
+        _threads[Id] = Number;
+        return Number;
+    }
+    //  The details kept for each stage.
+    struct Phase {
+        std::string Name;
+        double StartMsec;
+        double EndMsec;
+        int Thread;
+    };
+    std::chrono::steady_clock::time_point _startTime;
+    bool _enabled = false;
+    double _finishMsec = 0.0;
+    std::vector<Phase> _phases;
+    std::map<std::thread::id,int> _threads;
+    std::mutex _mutex;
+};
+
+//  A StartupPhase records the time from its creation until End() is called, or it goes out of
+//  scope, as a stage of the global StartupProfile.
+
+class StartupPhase
+{
+public:
+    StartupPhase(const std::string& Name) {
+        _name = Name;
+        _ended = !StartupProfile::Global().Enabled();
+        if (!_ended) _startMsec = StartupProfile::Global().NowMsec();
+    }
+    ~StartupPhase() { End(); }
+    void End(void) {
+        if (_ended) return;
+        StartupProfile& Profile = StartupProfile::Global();
+        Profile.Record(_name,_startMsec,Profile.NowMsec());
+        _ended = true;
+    }
+private:
+    std::string _name;
+    double _startMsec = 0.0;
+    bool _ended;
+};
+
+#endif
@@ -37,6 +37,11 @@
 //      3rd Oct 2024. Split off Unix-specific routines to allow the rest
 //                    (mostly string-processing routines) to be used under
 //                    other systems like Windows. KS.
+//     15th Oct 2026. ReadTSC() now reads the counter on 64-bit Intel and ARM systems
+//                    too. Added InvariantTSC(). KS.
+//                    Added ReadSocketDataV() and WriteSocketDataV(), using
+//                    readv() and writev(). The wait for data to be ready is
+//                    now in WaitToRead(), used by both read routines. KS.
 //
 //    Copyright (c)  Anglo-Australian Telescope Board, 2005-2024.
 //    Permission granted for use for non-commercial purposes.
@@ -643,9 +648,14 @@ void TcsUtil::Tokenize(
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/mman.h>
+#include <limits.h>
 #include <sys/utsname.h>
 #include <strings.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 
 // -----------------------------------------------------------------------------
 
@@ -691,6 +701,54 @@ bool TcsUtil::TransientError (void)
 
 // -----------------------------------------------------------------------------
 
+//                         W a i t  T o  R e a d
+//
+//   WaitToRead() is used by ReadSocketData() and ReadSocketDataV() to wait
+//   for data to be ready on a socket, for up to a timeout in msec. It returns
+//   true once data is ready, and false - with ErrorText set - on a timeout
+//   or an error.
+
+static bool WaitToRead (
+   int SocketFd,                        // Socket file descriptor
+   unsigned int TimeoutMsec,            // Timeout in msec.
+   std::string& ErrorText)              // Unchanged except on error
+{
+   //  select() allows a timeout to be supplied.
+   
+   fd_set TestDescriptors;               // Used to test file descriptors
+   struct timeval Timeout;
+   bool DataReady = false;
+   FD_ZERO(&TestDescriptors);
+   FD_SET(SocketFd,&TestDescriptors);
+   Timeout.tv_sec = TimeoutMsec / 1000;
+   Timeout.tv_usec = (TimeoutMsec % 1000) * 1000;
+   
+   //  This loop, potentially repeating the select call, allows for the
+   //  possibility that select() is interrupted. We come out of it
+   //  either on a non-transient error or when data is ready.
+   
+   while (!DataReady) {
+      int Status = select(SocketFd + 1,
+                           &TestDescriptors,NULL,NULL,&Timeout);
+      if (Status == 0) {
+         ErrorText = "Timeout error waiting to read from socket fd "
+                                      + TcsUtil::FormatInt(SocketFd);
+         break;
+      } else if (Status < 0) {
+         if (!TcsUtil::TransientError()) {
+            ErrorText = "Select error waiting to read from socket fd "
+                                      + TcsUtil::FormatInt(SocketFd);
+            break;
+         }
+      } else {
+         DataReady = true;
+      }
+   }
+   return DataReady;
+}
+
+// -----------------------------------------------------------------------------
+
 //                     R e a d  S o c k e t  D a t a
 /*!
  *   Reading from a socket requires slightly more than just issuing a
@@ -751,47 +809,11 @@ int TcsUtil::ReadSocketData (           // Returns bytes read, or -1
     
    while (BytesToRead > 0) {
    
-      if (TimeoutMsec > 0) {
+      //  If a timeout was specified, wait for data to be ready on the socket.
       
-         //  A timeout was specified, so use select() to wait for data to
-         //  be ready on the socket. This allows a timeout to be supplied.
-         
-         fd_set TestDescriptors;               // Used to test file descriptors
-         struct timeval Timeout;
-         bool DataReady = false;
-         FD_ZERO(&TestDescriptors);
-         FD_SET(SocketFd,&TestDescriptors);
-         Timeout.tv_sec = TimeoutMsec / 1000;
-         Timeout.tv_usec = (TimeoutMsec % 1000) * 1000;
-         
-         //  This loop, potentially repeating the select call, allows for the
-         //  possibility that select() is interrupted. We come out of it
-         //  either on a non-transient error or when data is ready.
-         
-         while (!DataReady) {
-            int Status = select(SocketFd + 1,
-                                 &TestDescriptors,NULL,NULL,&Timeout);
-            if (Status == 0) {
-               ErrorText = "Timeout error waiting to read from socket fd "
-                                                      + FormatInt(SocketFd);
-               break;
-            } else if (Status < 0) {
-               if (!TransientError()) {
-                  ErrorText = "Select error waiting to read from socket fd "
-                                                      + FormatInt(SocketFd);
-                  break;
-               }
-            } else {
-               DataReady = true;
-            }
-         }
-         
-         //  If data wasn't ready, then we've had an error or timeout.
-         
-         if (!DataReady) {
-            ReturnValue = -1;
-            break;
-         }
+      if (TimeoutMsec > 0 && !WaitToRead(SocketFd,TimeoutMsec,ErrorText)) {
+         ReturnValue = -1;
+         break;
       }
       
       //  Now read as much of the data as we have available.
@@ -875,14 +897,199 @@ int TcsUtil::WriteSocketData (          // Returns bytes written, or -1
 
 // -----------------------------------------------------------------------------
 
+//                        S e g m e n t  V e c t o r
+//
+//   Used by ReadSocketDataV() and WriteSocketDataV(). SegmentVector() sets
+//   up the iovec structures readv() and writev() need for a set of
+//   SocketSegments, leaving out any that are empty (so a return value of zero
+//   can only mean end of file), and sets Total to the number of bytes in all
+//   of them. AdvanceSegments() allows for Bytes having been transferred,
+//   starting from the First of the iovecs still to be used. It returns the
+//   index of the first iovec still to be used, which will be the number of
+//   iovecs once they have all been used. The iovec part way through is changed
+//   to cover only what is left of it.
+
+static std::vector<struct iovec> SegmentVector (
+   const TcsUtil::SocketSegment* Segments,
+   int Count,
+   long* Total)
+{
+   std::vector<struct iovec> Iovecs;
+   *Total = 0;
+   for (int I = 0; I < Count; I++) {
+      if (Segments[I].Bytes > 0) {
+         struct iovec Iovec;
+         Iovec.iov_base = Segments[I].Buffer;
+         Iovec.iov_len = Segments[I].Bytes;
+         Iovecs.push_back(Iovec);
+         *Total += long(Segments[I].Bytes);
+      }
+   }
+   return Iovecs;
+}
+
+static size_t AdvanceSegments (
+   std::vector<struct iovec>& Iovecs,
+   size_t First,
+   size_t Bytes)
+{
+   while (Bytes > 0 && First < Iovecs.size()) {
+      if (Bytes >= Iovecs[First].iov_len) {
+         Bytes -= Iovecs[First].iov_len;
+         First++;
+      } else {
+         Iovecs[First].iov_base = (char*)Iovecs[First].iov_base + Bytes;
+         Iovecs[First].iov_len -= Bytes;
+         Bytes = 0;
+      }
+   }
+   return First;
+}
+
+//  The most iovecs that can be passed to one readv() or writev() call.
+
+#ifdef IOV_MAX
+static const size_t MaxIovecs = IOV_MAX;
+#else
+static const size_t MaxIovecs = 16;
+#endif
+
+// -----------------------------------------------------------------------------
+
+//                    R e a d  S o c k e t  D a t a  V
+/*!
+ *   ReadSocketDataV() is a scatter version of ReadSocketData(). It reads
+ *   the data arriving on a socket into a set of separate buffers, filling
+ *   each in turn before the next, using readv(), so the data goes straight
+ *   to where it is needed - a header into one structure and the rest into,
+ *   say, memory mapped by a GPU - without being read into a temporary buffer
+ *   and copied, and without a separate read() call for each buffer. It
+ *   handles interrupted and partial reads just as ReadSocketData() does, and
+ *   the buffers can be of any size, not limited to an unsigned int.
+ *
+ *   \param  SocketFd    Gives the file descriptor open on the socket.
+ *   \param  Segments    The address and size of each buffer, in order.
+ *   \param  Count       The number of buffers.
+ *   \param  TimeoutMsec A timeout value in milliseconds, which applies to
+ *                       each read separately, as for ReadSocketData(). If a
+ *                       timeout of zero is specified, the routine waits
+ *                       indefinitely.
+ *   \param  ErrorText   A string left unchanged unless there is an error. If
+ *                       an error occurs, ErrorText is set to a description
+ *                       of the error.
+ *
+ *   \return The number of bytes read, if all went well (which will always
+ *           be the total size of the buffers). If an error occurs, -1 is
+ *           returned.
+ *
+ *   \author Keith Shortridge, AAO.
+ */
+
+long TcsUtil::ReadSocketDataV (         // Returns bytes read, or -1
+   int SocketFd,                        // Socket file descriptor
+   const SocketSegment* Segments,       // The buffers to read into
+   int Count,                           // Number of buffers
+   unsigned int TimeoutMsec,            // Timeout in msec. (0 => indefinite)
+   std::string& ErrorText)              // Unchanged except on error
+{
+   long ReturnValue = 0;
+   std::vector<struct iovec> Iovecs = SegmentVector(Segments,Count,&ReturnValue);
+   size_t First = 0;
+   while (First < Iovecs.size()) {
+      if (TimeoutMsec > 0 && !WaitToRead(SocketFd,TimeoutMsec,ErrorText)) {
+         ReturnValue = -1;
+         break;
+      }
+      size_t Number = std::min(Iovecs.size() - First,MaxIovecs);
+      ssize_t BytesRead = readv (SocketFd,&Iovecs[First],int(Number));
+      if (BytesRead == 0) {
+         ErrorText = "End of file on socket fd " + FormatInt(SocketFd);
+         ReturnValue = -1;
+         break;
+      } else if (BytesRead < 0) {
+         if (TransientError()) {
+            BytesRead = 0;
+         } else {
+            ErrorText = "Error reading " + FormatUlonglong(Iovecs[First].iov_len) +
+                      " bytes from socket fd " + FormatInt(SocketFd);
+            ReturnValue = -1;
+            break;
+         }
+      }
+      First = AdvanceSegments(Iovecs,First,size_t(BytesRead));
+   }
+   return ReturnValue;
+}
+
+// -----------------------------------------------------------------------------
+
+//                   W r i t e  S o c k e t  D a t a  V
+/*!
+ *   WriteSocketDataV() is a gather version of WriteSocketData(). It writes
+ *   the data in a set of separate buffers to a socket, one after the other,
+ *   using writev(), so a message made up of a header and a large body - say
+ *   an image in memory mapped by a GPU - can be sent without first copying
+ *   the two into one buffer, and without a separate write() call, and
+ *   possibly a separate network packet, for the header. It handles
+ *   interrupted and partial writes just as WriteSocketData() does, and the
+ *   buffers can be of any size. The buffers are not changed, even though
+ *   SocketSegment has a non-const address.
+ *
+ *   \param  SocketFd    Gives the file descriptor open on the socket.
+ *   \param  Segments    The address and size of each buffer, in order.
+ *   \param  Count       The number of buffers.
+ *   \param  ErrorText   A string left unchanged unless there is an error. If
+ *                       an error occurs, ErrorText is set to a description
+ *                       of the error.
+ *
+ *   \return The number of bytes written, if all went well (which will always
+ *           be the total size of the buffers). If an error occurs, -1 is
+ *           returned.
+ *
+ *   \author Keith Shortridge, AAO.
+ */
+
+long TcsUtil::WriteSocketDataV (        // Returns bytes written, or -1
+   int SocketFd,                        // Socket file descriptor
+   const SocketSegment* Segments,       // The buffers to write from
+   int Count,                           // Number of buffers
+   std::string& ErrorText)              // Unchanged except on error
+{
+   long ReturnValue = 0;
+   std::vector<struct iovec> Iovecs = SegmentVector(Segments,Count,&ReturnValue);
+   size_t First = 0;
+   while (First < Iovecs.size()) {
+      size_t Number = std::min(Iovecs.size() - First,MaxIovecs);
+      ssize_t BytesWritten = writev (SocketFd,&Iovecs[First],int(Number));
+      if (BytesWritten < 0) {
+         if (TransientError()) {
+            BytesWritten = 0;
+         } else {
+            ErrorText = "Error writing " + FormatUlonglong(Iovecs[First].iov_len) +
+                        " bytes to socket fd " + FormatInt(SocketFd);
+            ReturnValue = -1;
+            break;
+         }
+      }
+      First = AdvanceSegments(Iovecs,First,size_t(BytesWritten));
+   }
+   return ReturnValue;
+}
+
+// -----------------------------------------------------------------------------
+
 //                         R e a d  T S C
 /*!
  *   All modern Intel PC architecture systems support a time stamp counter,
  *   the TSC, which is incremented by one for each tick of the system clock.
  *   So for a 1Ghz system, the TSC goes up by one each nanosecond. This
  *   can provide a very accurate way of measuring short intervals. This
- *   routine returns the current value of the TSC. On systems that do not
- *   have a TSC, it returns a plausible imitation. 
+ *   routine returns the current value of the TSC. On 64-bit ARM systems, it
+ *   returns the virtual count of the generic timer instead, which ticks at a
+ *   fixed rate, often much lower than the clock rate. On systems that have
+ *   neither, it returns a plausible imitation. Modern TSCs tick at a fixed
+ *   rate whatever the current clock speed, but older ones don't - see
+ *   InvariantTSC().
  *
  *   \return An unsigned long long value giving the current TSC.
  *
@@ -899,9 +1106,11 @@ unsigned long long TcsUtil::ReadTSC (void)
 //  cpp -dM), and we generate the necessary assembler instruction to read
 //  the TCS. For other systems, which will be running in simulation and
 //  where extreme accuracy will not really be an issue, we fall back on
-//  using gettimeofday().
+//  using gettimeofday(). 64-bit Intel systems have the same instruction, but
+//  the "=A" constraint doesn't give the two 32-bit halves there, and 64-bit
+//  ARM systems have a counter register that serves the same purpose.
 
-#ifdef __i386__
+#if defined(__i386__)
 {
    //  This code snippet comes from the realfeel() code as distributed by
    //  Andrew Morton. Realfeel was originally written by Mark Hahn - I don't
@@ -911,6 +1120,18 @@ unsigned long long TcsUtil::ReadTSC (void)
     __asm__ __volatile__("rdtsc" : "=A" (tsc));
     return tsc;
 }
+#elif defined(__x86_64__)
+{
+   unsigned int Low,High;
+   __asm__ __volatile__("rdtsc" : "=a" (Low), "=d" (High));
+   return ((unsigned long long)High << 32) | Low;
+}
+#elif defined(__aarch64__)
+{
+   unsigned long long Count;
+   __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (Count));
+   return Count;
+}
 #else
 {
    //  For non-PC systems, we use gettimeofday(), which provides a value in
@@ -935,6 +1156,48 @@ unsigned long long TcsUtil::ReadTSC (void)
 
 // -----------------------------------------------------------------------------
 
+//                      I n v a r i a n t  T S C
+/*!
+ *   InvariantTSC() returns true if the counter read by ReadTSC() ticks at a
+ *   constant rate, whatever the clock speed of the CPU and whether or not
+ *   it is idle, so a difference between two values read from it can be
+ *   turned into a time. On Intel systems, this is the 'invariant TSC' bit
+ *   reported by the CPUID instruction. The ARM generic timer always ticks
+ *   at a fixed rate. The imitation used on other systems is based on the
+ *   time of day, which isn't fine enough to count as a counter at all.
+ *
+ *   
+eturn True if ReadTSC() gives a counter with a constant rate.
+ *
+ *   uthor Keith Shortridge, AAO.
+ */
+
+bool TcsUtil::InvariantTSC (void)
+
+#if defined(__i386__) || defined(__x86_64__)
+{
+   //  Leaf 0x80000007 of CPUID reports an invariant TSC in bit 8 of EDX, if
+   //  the CPU has that leaf at all.
+   
+   unsigned int Eax,Ebx,Ecx,Edx;
+   if (!__get_cpuid(0x80000000,&Eax,&Ebx,&Ecx,&Edx) || Eax < 0x80000007) {
+      return false;
+   }
+   __get_cpuid(0x80000007,&Eax,&Ebx,&Ecx,&Edx);
+   return (Edx & (1 << 8)) != 0;
+}
+#elif defined(__aarch64__)
+{
+   return true;
+}
+#else
+{
+   return false;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+
 //          S e t  A s  R e a l  T i m e  H i g h  P r i o r i t y
 /*!
  *   SetAsRealTimeHighPriority() allows a suitably priveleged task to
@@ -1084,6 +1347,8 @@ int main ()
    cout << "TSC was " << TcsUtil::FormatUlonglong(TSC) << '\n';
    cout << "1 sec later, TSC was " << TcsUtil::FormatUlonglong(TSC1) << '\n';
    cout << "A change of " << TcsUtil::FormatUlonglong(TSC1 - TSC) << '\n';
+   cout << "The TSC is " << (TcsUtil::InvariantTSC() ? "" : "not ")
+                                                          << "invariant\n";
    if (TcsUtil::MatchCaseBlind("abcd","AbCd")) {
       cout << "Correct: abcd matches AbCd\n";
    } else {
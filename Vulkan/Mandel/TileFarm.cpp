@@ -0,0 +1,292 @@
+//
+//                              T i l e  F a r m . c p p
+//
+//  The implementation of FarmQueue and FarmLink. See TileFarm.h for an overview.
+//
+//  15th Oct 2026. First version. KS.
+
+#include "TileFarm.h"
+#include "TcsUtil.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+//  The most bytes passed to one TcsUtil read or write, which take an unsigned int count.
+
+static const size_t C_MaxTransfer = 64 * 1024 * 1024;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  F a r m  Q u e u e
+
+FarmQueue::FarmQueue(int Count)
+{
+    _count = Count;
+    _next = 0;
+    _done = 0;
+    _states.assign(size_t(Count),WAITING);
+    _copies.assign(size_t(Count),0);
+}
+
+//  A tile being retried comes first, then the next one not yet handed out, and then, if Backup
+//  is set, a second copy of the first tile still only being worked on once.
+
+bool FarmQueue::Next(int* Index,bool Backup)
+{
+    std::unique_lock<std::mutex> Lock(_mutex);
+    for (;;) {
+        if (_done >= _count) return false;
+        int Tile = -1;
+        if (!_retries.empty()) {
+            Tile = _retries.front();
+            _retries.pop_front();
+        } else if (_next < _count) {
+            Tile = _next++;
+        } else if (Backup) {
+            for (int I = 0; I < _count; I++) {
+                if (_states[I] == ACTIVE && _copies[I] == 1) {
+                    Tile = I;
+                    break;
+                }
+            }
+        }
+        if (Tile >= 0) {
+            _states[Tile] = ACTIVE;
+            _copies[Tile]++;
+            *Index = Tile;
+            return true;
+        }
+        _condition.wait(Lock);
+    }
+}
+
+bool FarmQueue::Done(int Index)
+{
+    std::lock_guard<std::mutex> Lock(_mutex);
+    _copies[Index]--;
+    bool First = (_states[Index] != DONE);
+    if (First) {
+        _states[Index] = DONE;
+        _done++;
+        _condition.notify_all();
+    }
+    return First;
+}
+
+//  A tile handed back is only given out again if no other copy of it is still being worked on.
+
+void FarmQueue::Retry(int Index)
+{
+    std::lock_guard<std::mutex> Lock(_mutex);
+    _copies[Index]--;
+    if (_states[Index] != DONE && _copies[Index] == 0) {
+        _states[Index] = WAITING;
+        _retries.push_back(Index);
+    }
+    _condition.notify_all();
+}
+
+bool FarmQueue::IsDone(int Index)
+{
+    std::lock_guard<std::mutex> Lock(_mutex);
+    if (Index < 0) return _done >= _count;
+    return _states[Index] == DONE;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                   F a r m  L i n k
+//
+//  Each link is a blocking TCP socket, with Nagle's algorithm turned off, as the jobs are small
+//  messages that want to go at once.
+
+FarmLink::FarmLink(int Fd,const std::string& Peer)
+{
+    _fd = Fd;
+    _abandoned = 0;
+    _peer = Peer;
+    _error = "";
+    int Flag = 1;
+    setsockopt(_fd,IPPROTO_TCP,TCP_NODELAY,&Flag,sizeof(Flag));
+}
+
+FarmLink::~FarmLink()
+{
+    Close();
+}
+
+int FarmLink::Listen(int Port,std::string& Error)
+{
+    int Fd = socket(AF_INET,SOCK_STREAM,0);
+    if (Fd < 0) {
+        Error = "Unable to create socket: " + TcsUtil::GetErrnoText();
+        return -1;
+    }
+    int Flag = 1;
+    setsockopt(Fd,SOL_SOCKET,SO_REUSEADDR,&Flag,sizeof(Flag));
+    struct sockaddr_in Address;
+    memset(&Address,0,sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_ANY);
+    Address.sin_port = htons(uint16_t(Port));
+    if (bind(Fd,(struct sockaddr*)&Address,sizeof(Address)) != 0 || listen(Fd,64) != 0) {
+        Error = "Unable to listen on port " + std::to_string(Port) + ": " +
+                                                                  TcsUtil::GetErrnoText();
+        close(Fd);
+        return -1;
+    }
+    return Fd;
+}
+
+FarmLink* FarmLink::Accept(int ListenFd,unsigned int TimeoutMsec)
+{
+    fd_set TestDescriptors;
+    FD_ZERO(&TestDescriptors);
+    FD_SET(ListenFd,&TestDescriptors);
+    struct timeval Timeout;
+    Timeout.tv_sec = TimeoutMsec / 1000;
+    Timeout.tv_usec = (TimeoutMsec % 1000) * 1000;
+    if (select(ListenFd + 1,&TestDescriptors,NULL,NULL,&Timeout) <= 0) return nullptr;
+    struct sockaddr_storage Address;
+    socklen_t Length = sizeof(Address);
+    int Fd = accept(ListenFd,(struct sockaddr*)&Address,&Length);
+    if (Fd < 0) return nullptr;
+    char Host[NI_MAXHOST];
+    char Service[NI_MAXSERV];
+    std::string Peer = "fd " + std::to_string(Fd);
+    if (getnameinfo((struct sockaddr*)&Address,Length,Host,sizeof(Host),Service,
+                                   sizeof(Service),NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+        Peer = std::string(Host) + ":" + Service;
+    }
+    return new FarmLink(Fd,Peer);
+}
+
+FarmLink* FarmLink::Connect(const std::string& Address,std::string& Error)
+{
+    size_t Colon = Address.find_last_of(':');
+    if (Colon == std::string::npos || Colon == 0 || Colon + 1 >= Address.size()) {
+        Error = "Coordinator address '" + Address + "' should be given as host:port";
+        return nullptr;
+    }
+    std::string Host = Address.substr(0,Colon);
+    std::string Port = Address.substr(Colon + 1);
+    struct addrinfo Hints;
+    memset(&Hints,0,sizeof(Hints));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* Results = nullptr;
+    int Status = getaddrinfo(Host.c_str(),Port.c_str(),&Hints,&Results);
+    if (Status != 0) {
+        Error = "Unable to find coordinator '" + Address + "': " + gai_strerror(Status);
+        return nullptr;
+    }
+    int Fd = -1;
+    for (struct addrinfo* Result = Results; Result; Result = Result->ai_next) {
+        Fd = socket(Result->ai_family,Result->ai_socktype,Result->ai_protocol);
+        if (Fd < 0) continue;
+        if (connect(Fd,Result->ai_addr,Result->ai_addrlen) == 0) break;
+        close(Fd);
+        Fd = -1;
+    }
+    freeaddrinfo(Results);
+    if (Fd < 0) {
+        Error = "Unable to connect to coordinator '" + Address + "': " +
+                                                                  TcsUtil::GetErrnoText();
+        return nullptr;
+    }
+    return new FarmLink(Fd,Address);
+}
+
+bool FarmLink::SendJob(const FarmJob& Job)
+{
+    FarmJob Message = Job;
+    Message.Magic = C_Magic;
+    return WriteData((const char*)&Message,sizeof(Message));
+}
+
+bool FarmLink::ReadJob(FarmJob* Job)
+{
+    if (!ReadData((char*)Job,sizeof(FarmJob),0)) return false;
+    if (Job->Magic != C_Magic) return Failed("Invalid job message");
+    return true;
+}
+
+bool FarmLink::SendResult(const FarmJob& Job,const uint32_t* Data)
+{
+    FarmResult Header = {C_Magic,Job.Frame,Job.Tile,Job.TileSize};
+    if (!WriteData((const char*)&Header,sizeof(Header))) return false;
+    size_t Bytes = size_t(Job.TileSize) * size_t(Job.TileSize) * sizeof(uint32_t);
+    return WriteData((const char*)Data,Bytes);
+}
+
+void FarmLink::Close(void)
+{
+    if (_fd >= 0) close(_fd);
+    _fd = -1;
+}
+
+//  WaitReadable() returns true if there is something to read within TimeoutMsec. If select()
+//  fails, other than by being interrupted, the link is closed.
+
+bool FarmLink::WaitReadable(unsigned int TimeoutMsec)
+{
+    fd_set TestDescriptors;
+    FD_ZERO(&TestDescriptors);
+    FD_SET(_fd,&TestDescriptors);
+    struct timeval Timeout;
+    Timeout.tv_sec = TimeoutMsec / 1000;
+    Timeout.tv_usec = (TimeoutMsec % 1000) * 1000;
+    int Status = select(_fd + 1,&TestDescriptors,NULL,NULL,&Timeout);
+    if (Status < 0 && !TcsUtil::TransientError()) {
+        Failed("Select error: " + TcsUtil::GetErrnoText());
+    }
+    return Status > 0;
+}
+
+//  ReadData() and WriteData() pass large transfers to TcsUtil in pieces, and close the link if
+//  anything goes wrong. The timeout applies to each wait for more data.
+
+bool FarmLink::ReadData(char* Buffer,size_t Bytes,unsigned int TimeoutMsec)
+{
+    while (Bytes > 0) {
+        if (_fd < 0) return false;
+        size_t Piece = std::min(Bytes,C_MaxTransfer);
+        std::string Error;
+        if (TcsUtil::ReadSocketData(_fd,Buffer,(unsigned int)Piece,TimeoutMsec,Error) < 0) {
+            return Failed(Error);
+        }
+        Buffer += Piece;
+        Bytes -= Piece;
+    }
+    return true;
+}
+
+bool FarmLink::WriteData(const char* Buffer,size_t Bytes)
+{
+    while (Bytes > 0) {
+        if (_fd < 0) return false;
+        size_t Piece = std::min(Bytes,C_MaxTransfer);
+        std::string Error;
+        if (TcsUtil::WriteSocketData(_fd,Buffer,(unsigned int)Piece,Error) < 0) {
+            return Failed(Error);
+        }
+        Buffer += Piece;
+        Bytes -= Piece;
+    }
+    return true;
+}
+
+bool FarmLink::Failed(const std::string& Error)
+{
+    _error = Error;
+    Close();
+    return false;
+}
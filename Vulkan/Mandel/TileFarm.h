@@ -0,0 +1,202 @@
+//
+//                               T i l e  F a r m . h
+//
+//  This provides what MandelTiles needs to share the tiles of an image between processes on
+//  different machines - a rack of GPU nodes, say - as well as between the GPUs of one machine.
+//  One process, the coordinator, hands out the tiles and writes the image. The others, the
+//  workers, each connect to it over TCP, once for each of their GPUs, and then compute whatever
+//  tiles they are sent, for as many frames as the coordinator has, so their GPUs are set up
+//  only once.
+//
+//  A FarmQueue hands out the tiles, as a TileQueue does, but a tile isn't finished with until
+//  Done() is called for it. A worker that fails - whose connection is lost, or that takes too
+//  long over a tile - hands its tile back using Retry(), and it is given to the next thread
+//  that asks for one. Once all the tiles have been handed out, a thread that can give up on a
+//  tile - one waiting for a worker - may be given a second copy of one still being worked on,
+//  so a slow GPU can't hold up the end of a frame. Whichever copy finishes first is used.
+//
+//  A FarmLink is one connection between the coordinator and a worker, used to send FarmJob
+//  messages one way and the computed tiles the other. The socket reads and writes use the
+//  TcsUtil routines, which allow for the reads and writes being interrupted or broken up.
+//
+//  This is only supported on UNIX-like systems, which is where MandelTiles is built.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __TileFarm__
+#define __TileFarm__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class FarmQueue
+{
+public:
+    FarmQueue(int Count);
+    //  Sets Index to the next tile to be done, waiting if all the tiles have been handed out
+    //  but some aren't yet done, and returning false once they are all done. If Backup is set,
+    //  the tile may be a second copy of one already being worked on.
+    bool Next(int* Index,bool Backup = false);
+    //  Notes that a tile has been computed, returning true if this is the first copy to be
+    //  finished, which should be used, and false if another copy has already been used.
+    bool Done(int Index);
+    //  Hands back a tile that wasn't computed, so it is given out again.
+    void Retry(int Index);
+    //  Returns true if the given tile has been done, and true for all of them if Index is -1.
+    bool IsDone(int Index = -1);
+private:
+    enum TileState {WAITING,ACTIVE,DONE};
+    int _count;
+    int _next;
+    int _done;
+    std::vector<TileState> _states;
+    std::vector<int> _copies;
+    std::deque<int> _retries;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+};
+
+//  The details of one tile, sent by the coordinator to a worker. A Tile of -1 tells the worker
+//  there are no more. The worker positions the tile in the full image just as the coordinator
+//  would, so gets the same result for it.
+
+struct FarmJob {
+    uint32_t Magic;
+    int32_t Frame;
+    int32_t Tile;
+    int32_t Nx,Ny;              // Dimensions of the full image.
+    int32_t TileSize;           // Dimension of each (square) tile.
+    int32_t Ix,Iy;              // Position of the tile in the full image.
+    int32_t Iter;               // Iteration limit.
+    double XCent,YCent;         // Centre of the full image.
+    double Magnification;       // Magnification of the full image.
+};
+
+//  The header sent by a worker before the TileSize by TileSize iteration counts of a tile.
+
+struct FarmResult {
+    uint32_t Magic;
+    int32_t Frame;
+    int32_t Tile;
+    int32_t TileSize;
+};
+
+class FarmLink
+{
+public:
+    //  The value the messages start with, to catch a link that has lost its place or a worker
+    //  that doesn't match the coordinator.
+    static const uint32_t C_Magic = 0x4D544631;
+    //  Sets up a socket listening on the given port, returning its file descriptor, or -1 with
+    //  Error set if it can't.
+    static int Listen(int Port,std::string& Error);
+    //  Waits up to TimeoutMsec for a connection on the listening socket, returning a link for
+    //  it, or null if there is none.
+    static FarmLink* Accept(int ListenFd,unsigned int TimeoutMsec);
+    //  Connects to a coordinator at Address, given as host:port, returning a link, or null with
+    //  Error set if it can't.
+    static FarmLink* Connect(const std::string& Address,std::string& Error);
+    ~FarmLink();
+    //  A description of the other end of the link, for messages.
+    const std::string& Peer(void) const { return _peer; }
+    //  Returns true until the link has failed or been closed.
+    bool IsOpen(void) const { return _fd >= 0; }
+    //  Sends a job, returning false if the link has failed.
+    bool SendJob(const FarmJob& Job);
+    //  Reads the next job, waiting for it as long as it takes.
+    bool ReadJob(FarmJob* Job);
+    //  Sends a computed tile.
+    bool SendResult(const FarmJob& Job,const uint32_t* Data);
+    //  Waits up to TimeoutMsec for the result of Job, reading it into Data. Any results left
+    //  over from abandoned jobs are read and ignored first. Every PollMsec, Abandon() is called,
+    //  and if that returns true the wait is given up and false returned, with the link left
+    //  open and the result noted as one to ignore.
+    template <class Check> bool ReadResult(const FarmJob& Job,std::vector<uint32_t>& Data,
+                 unsigned int TimeoutMsec,unsigned int PollMsec,Check Abandon);
+    //  Closes the link.
+    void Close(void);
+    //  Returns an explanation of the last error.
+    const std::string& GetError(void) const { return _error; }
+private:
+    FarmLink(int Fd,const std::string& Peer);
+    bool WaitReadable(unsigned int TimeoutMsec);
+    bool ReadData(char* Buffer,size_t Bytes,unsigned int TimeoutMsec);
+    bool WriteData(const char* Buffer,size_t Bytes);
+    bool Failed(const std::string& Error);
+    int _fd;
+    int _abandoned;
+    std::string _peer;
+    std::string _error;
+};
+
+//  ReadResult() is a template, so the caller can pass any sort of check, usually a lambda.
+
+template <class Check> bool FarmLink::ReadResult(const FarmJob& Job,
+      std::vector<uint32_t>& Data,unsigned int TimeoutMsec,unsigned int PollMsec,Check Abandon)
+{
+    unsigned int Waited = 0;
+    for (;;) {
+        if (!IsOpen()) return false;
+        if (!WaitReadable(PollMsec)) {
+            if (!IsOpen()) return false;
+            if (Abandon()) {
+                _abandoned++;
+                return false;
+            }
+            Waited += PollMsec;
+            if (TimeoutMsec > 0 && Waited >= TimeoutMsec) {
+                return Failed("No result for tile " + std::to_string(Job.Tile) + " in " +
+                                                   std::to_string(Waited / 1000) + " sec");
+            }
+            continue;
+        }
+        FarmResult Header;
+        if (!ReadData((char*)&Header,sizeof(Header),TimeoutMsec)) return false;
+        if (Header.Magic != C_Magic || Header.TileSize <= 0) {
+            return Failed("Invalid result header");
+        }
+        Data.resize(size_t(Header.TileSize) * size_t(Header.TileSize));
+        if (!ReadData((char*)Data.data(),Data.size() * sizeof(uint32_t),TimeoutMsec)) {
+            return false;
+        }
+        if (_abandoned > 0) {
+            _abandoned--;
+            continue;
+        }
+        if (Header.Frame != Job.Frame || Header.Tile != Job.Tile ||
+                                                   Header.TileSize != Job.TileSize) {
+            return Failed("Result doesn't match tile " + std::to_string(Job.Tile));
+        }
+        return true;
+    }
+}
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The messages are sent as they are held in memory, so the coordinator and the workers
+        are assumed to share the same byte order and structure layout, which they will if
+        they run the same build on the same sort of machine, as the nodes of a rack usually
+        do. The magic number catches most mismatches.
+
+    o   A worker computes its jobs one at a time, in the order they are sent, so when the
+        coordinator gives up waiting for a result - because another copy of the tile has been
+        finished - that result is still on its way, and is the next thing the link will read.
+        The link just counts the results it has abandoned, and discards that many before
+        reading the one it wants.
+
+    o   A tile is only given out a second time once every tile has been handed out and there
+        are none waiting to be retried, and never more than twice at once. This costs nothing
+        while there is other work to do, and near the end of a frame it uses GPUs that would
+        otherwise be idle. Only the threads waiting for workers take second copies, as they can
+        stop waiting as soon as the other copy is done. A thread computing a tile on its own
+        GPU can't stop part way, and could end up holding up the frame itself.
+
+    o   A worker that fails has its link closed and is dropped; it isn't sent any more tiles.
+        Closing the link also tells the worker, which then exits.
+*/
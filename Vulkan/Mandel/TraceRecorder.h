@@ -0,0 +1,197 @@
+//
+//                          T r a c e  R e c o r d e r . h
+//
+//  This provides a way for the test programs, and the Vulkan Framework, to record a timeline of
+//  what they did, and write it out as a trace file that can be loaded into chrome://tracing or
+//  into Perfetto (ui.perfetto.dev). The "Setup" and "Timing" debug levels print the elapsed time
+//  at each stage, which is fine for spotting something slow, but it's very hard to see from
+//  them where two things overlapped, or where nothing was happening at all. A timeline shows
+//  that at a glance.
+//
+//  There is just the one, global, TraceRecorder, returned by TraceRecorder::Global(). It does
+//  nothing until Enable() is called, and each call made while it is disabled just tests a flag,
+//  so the calls can be left in place in code being timed. The events it records are:
+//
+//     o Begin() and End() mark the start and end of a stage on the calling thread. Stages on the
+//       same thread must nest properly. A TraceScope does this for a block of code - it calls
+//       Begin() when it's created and End() when it goes out of scope.
+//     o AsyncBegin() and AsyncEnd() mark the start and end of something - a submission to the
+//       GPU, say - that may start and end on different threads, or overlap other such things.
+//       The two calls are matched by their name and an Id.
+//     o Complete() records a stage whose start and duration are already known. This is used for
+//       times measured by the GPU itself, which are shown on a separate "GPU" track.
+//
+//  Each thread that records an event is given a small number as its thread ID, in the order in
+//  which they first record something, and SetThreadName() can give the calling thread a name.
+//  Times are in microseconds from when the recorder was created. Write() writes everything
+//  recorded so far to a file in the Chrome trace event JSON format. WriteOnExit() instead has
+//  the file written when the program exits, however it gets there.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __TraceRecorder__
+#define __TraceRecorder__
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+class TraceRecorder
+{
+public:
+    //  The thread ID used for the GPU track.
+    static const int GpuTrack = 0;
+    //  Returns the one global recorder.
+    static TraceRecorder& Global(void) {
+        static TraceRecorder TheRecorder;
+        return TheRecorder;
+    }
+    //  Enables or disables recording. Nothing is recorded until this is called.
+    void Enable(bool On) { _enabled = On; }
+    bool Enabled(void) const { return _enabled; }
+    //  Returns the current time in microseconds, on the same scale as the events recorded.
+    double NowUsec(void) const {
+        return double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - _startTime).count()) * 0.001;
+    }
+    //  Names the calling thread in the trace.
+    void SetThreadName(const std::string& Name) {
+        std::lock_guard<std::mutex> Lock(_mutex);
+        _threadNames[ThreadId()] = Name;
+    }
+    //  Marks the start of a stage on the calling thread.
+    void Begin(const char* Name,const char* Category) {
+        if (_enabled) Add('B',Name,Category,NowUsec(),0.0,0,-1);
+    }
+    //  Marks the end of the stage last started by Begin() on the calling thread.
+    void End(const char* Name,const char* Category) {
+        if (_enabled) Add('E',Name,Category,NowUsec(),0.0,0,-1);
+    }
+    //  Marks the start of an asynchronous event, identified by Name and Id.
+    void AsyncBegin(const char* Name,const char* Category,uint64_t Id) {
+        if (_enabled) Add('b',Name,Category,NowUsec(),0.0,Id,-1);
+    }
+    //  Marks the end of the asynchronous event started by AsyncBegin() with the same Name and Id.
+    void AsyncEnd(const char* Name,const char* Category,uint64_t Id) {
+        if (_enabled) Add('e',Name,Category,NowUsec(),0.0,Id,-1);
+    }
+    //  Records a stage that started at StartUsec (see NowUsec()) and lasted DurUsec, on Track -
+    //  by default the GPU track.
+    void Complete(const char* Name,const char* Category,double StartUsec,double DurUsec,
+                                                                       int Track = GpuTrack) {
+        if (_enabled) Add('X',Name,Category,StartUsec,DurUsec,0,Track);
+    }
+    //  Has the events written to FileName when the program exits.
+    void WriteOnExit(const std::string& FileName) { _exitFile = FileName; }
+    //  Writes all the events recorded so far to FileName, as a Chrome trace JSON file.
+    bool Write(const std::string& FileName) {
+        std::lock_guard<std::mutex> Lock(_mutex);
+        FILE* File = fopen(FileName.c_str(),"w");
+        if (File == nullptr) {
+            printf ("Unable to write trace to %s\n",FileName.c_str());
+            return false;
+        }
+        fprintf (File,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf (File,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,",GpuTrack);
+        fprintf (File,"\"args\":{\"name\":\"GPU\"}}");
+        for (const auto& Entry : _threadIds) {
+            int Tid = Entry.second;
+            std::string Name = "Thread " + std::to_string(Tid);
+            if (_threadNames.count(Tid)) Name = _threadNames[Tid];
+            fprintf (File,",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,",Tid);
+            fprintf (File,"\"args\":{\"name\":%s}}",Quoted(Name).c_str());
+        }
+        for (const Event& E : _events) {
+            fprintf (File,",\n{\"name\":%s,\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,",
+                                             Quoted(E.Name).c_str(),E.Category,E.Phase,E.Usec);
+            fprintf (File,"\"pid\":1,\"tid\":%d",E.Tid);
+            if (E.Phase == 'X') fprintf (File,",\"dur\":%.3f",E.DurUsec);
+            if (E.Phase == 'b' || E.Phase == 'e') {
+                fprintf (File,",\"id\":\"0x%llx\"",(unsigned long long)E.Id);
+            }
+            fprintf (File,"}");
+        }
+        fprintf (File,"\n]}\n");
+        fclose(File);
+        printf ("Trace of %d events written to %s\n",int(_events.size()),FileName.c_str());
+        return true;
+    }
+private:
+    TraceRecorder() {
+        _enabled = false;
+        _nextTid = GpuTrack + 1;
+        _startTime = std::chrono::steady_clock::now();
+    }
+    ~TraceRecorder() {
+        if (_exitFile != "") Write(_exitFile);
+    }
+    //  The details of each event recorded.
+    struct Event {
+        char Phase;
+        std::string Name;
+        const char* Category;
+        double Usec;
+        double DurUsec;
+        uint64_t Id;
+        int Tid;
+    };
+    //  Records an event, on the calling thread if Track is negative.
+    void Add(char Phase,const char* Name,const char* Category,double Usec,double DurUsec,
+                                                                        uint64_t Id,int Track) {
+        std::lock_guard<std::mutex> Lock(_mutex);
+        _events.push_back({Phase,Name,Category,Usec,DurUsec,Id,Track < 0 ? ThreadId() : Track});
+    }
+    //  Returns the ID for the calling thread. The mutex must already be locked.
+    int ThreadId(void) {
+        std::thread::id Id = std::this_thread::get_id();
+        auto Iter = _threadIds.find(Id);
+        if (Iter != _threadIds.end()) return Iter->second;
+        int Tid = _nextTid++;
+        _threadIds[Id] = Tid;
+        return Tid;
+    }
+    //  Returns Text quoted for JSON.
+    static std::string Quoted(const std::string& Text) {
+        std::string Result = "\"";
+        for (char C : Text) {
+            if (C == '"' || C == '\\') Result += '\\';
+            if (C == '\n') Result += "\\n";
+            else Result += C;
+        }
+        return Result + "\"";
+    }
+    std::atomic<bool> _enabled;
+    std::chrono::steady_clock::time_point _startTime;
+    std::mutex _mutex;
+    std::vector<Event> _events;
+    std::map<std::thread::id,int> _threadIds;
+    std::map<int,std::string> _threadNames;
+    int _nextTid;
+    std::string _exitFile;
+};
+
+//  A TraceScope records a stage lasting from its creation until it goes out of scope.
+
+class TraceScope
+{
+public:
+    TraceScope(const char* Name,const char* Category) {
+        _name = Name;
+        _category = Category;
+        TraceRecorder::Global().Begin(Name,Category);
+    }
+    ~TraceScope() {
+        TraceRecorder::Global().End(_name,_category);
+    }
+private:
+    const char* _name;
+    const char* _category;
+};
+
+#endif
@@ -18,6 +18,14 @@
 //     23rd Feb 2024. Minor tweak to get a clean compilation under Windows. KS.
 //      5th Sep 2024. Split MouseCallback() into MouseButtonCallback() and
 //                    MouseMovedCallback(). KS.
+//     15th Oct 2026. A fast trackpad can deliver many mouse moves and scrolls for each frame,
+//                    each of which could have the display code recalculate its state. These
+//                    are now queued, with a move replacing the move before it and a scroll
+//                    at the same position adding to the one before it, and FlushInput() passes
+//                    them on just before each frame is drawn. A key press or mouse click
+//                    flushes the queue first, so events are still seen in order. MainLoop()
+//                    now only draws once the frame interval has passed, handling any events
+//                    that arrive before then, rather than drawing after every event. KS.
 
 #include "WindowHandler.h"
 
@@ -174,15 +182,24 @@ void WindowHandler::SetScrollCallback(void (*RoutinePtr)(
 
 void WindowHandler::MainLoop()
 {
+    //  Events that arrive before the next frame is due are handled as they come, which just
+    //  queues any mouse moves and scrolls. Once the frame is due, these are passed on and the
+    //  frame is drawn, so a slow frame only delays the handling of the events that arrive
+    //  while it's being drawn, and these are then merged.
+    
     float TickMsec = 1000.0f/C_MaxFramesPerSec;
     while (!glfwWindowShouldClose(I_Window)) {
         float NowMsec = I_Timer.ElapsedMsec();
         float MsecSinceLast = NowMsec - I_LastDrawMsec;
         float WaitMsec = TickMsec - MsecSinceLast;
-        if (WaitMsec < 0.0) WaitMsec = 0.0;
-        glfwWaitEventsTimeout(WaitMsec / 1000.0);
-        I_LastDrawMsec = I_Timer.ElapsedMsec();
-        DrawFrame();
+        if (WaitMsec > 0.0) {
+            glfwWaitEventsTimeout(WaitMsec / 1000.0);
+        } else {
+            glfwPollEvents();
+            I_LastDrawMsec = I_Timer.ElapsedMsec();
+            FlushInput();
+            DrawFrame();
+        }
     }
 }
 
@@ -219,6 +236,7 @@ void WindowHandler::WindowResized(int NewWidth,int NewHeight)
     }
     I_Width = Width;
     I_Height = Height;
+    FlushInput();
     DrawFrame();
 }
 
@@ -232,6 +250,7 @@ void WindowHandler::KeypressCallback(GLFWwindow* Window,int Key,int Scancode,int
 
 void WindowHandler::Keypress(int Key,int Scancode,int Action,int Mods,double Xpos,double Ypos)
 {
+    FlushInput();
     if (I_KeyCallbackPtr) {
         Ypos = double(I_Height) - Ypos;
         (*I_KeyCallbackPtr)(Key,Scancode,Action,Mods,Xpos,Ypos,I_KeyCallbackData);
@@ -248,6 +267,7 @@ void WindowHandler::MouseButtonCallback(GLFWwindow* Window,int Button,int Action
 
 void WindowHandler::MouseButton(int Button,int Action,int Mods,double Xpos,double Ypos)
 {
+    FlushInput();
     if (I_MouseButtonCallbackPtr) {
         Ypos = double(I_Height) - Ypos;
         (*I_MouseButtonCallbackPtr)(Xpos,Ypos,Button,Action,I_KeyCallbackData);
@@ -265,7 +285,12 @@ void WindowHandler::MouseMoved(double Xpos,double Ypos)
     if (I_MouseMovedCallbackPtr) {
         if (Xpos >= 0.0 && Xpos <= I_Width && Ypos >= 0.0 && Ypos <= I_Height) {
             Ypos = double(I_Height) - Ypos;
-            (*I_MouseMovedCallbackPtr)(Xpos,Ypos,I_KeyCallbackData);
+            if (!I_PendingInput.empty() && !I_PendingInput.back().IsScroll) {
+                I_PendingInput.back().Xpos = Xpos;
+                I_PendingInput.back().Ypos = Ypos;
+            } else {
+                I_PendingInput.push_back({false,Xpos,Ypos,0.0,0.0});
+            }
         }
     }
 }
@@ -282,8 +307,29 @@ void WindowHandler::Scroll(double XOffset,double YOffset,double XPos,double YPos
 {
     if (I_ScrollCallbackPtr) {
         YPos = double(I_Height) - YPos;
-        (*I_ScrollCallbackPtr)(XOffset,YOffset,XPos,YPos,I_ScrollCallbackData);
+        if (!I_PendingInput.empty() && I_PendingInput.back().IsScroll &&
+                 I_PendingInput.back().Xpos == XPos && I_PendingInput.back().Ypos == YPos) {
+            I_PendingInput.back().DeltaX += XOffset;
+            I_PendingInput.back().DeltaY += YOffset;
+        } else {
+            I_PendingInput.push_back({true,XPos,YPos,XOffset,YOffset});
+        }
+    }
+}
+
+void WindowHandler::FlushInput()
+{
+    //  Passes on any queued mouse moves and scrolls, in the order they arrived.
+    
+    for (const PendingInput& Input : I_PendingInput) {
+        if (Input.IsScroll) {
+            (*I_ScrollCallbackPtr)(Input.DeltaX,Input.DeltaY,Input.Xpos,Input.Ypos,
+                                                                     I_ScrollCallbackData);
+        } else {
+            (*I_MouseMovedCallbackPtr)(Input.Xpos,Input.Ypos,I_KeyCallbackData);
+        }
     }
+    I_PendingInput.clear();
 }
 
 /*
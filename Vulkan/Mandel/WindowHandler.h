@@ -32,6 +32,9 @@
 //                    of the code that tries to keep to a specified frame rate. KS.
 //      5th Sep 2024. Split MouseCallback() into MouseButtonCallback() and
 //                    MouseMovedCallback(). KS.
+//     15th Oct 2026. Mouse moves and scrolls are now queued and merged, and passed on once
+//                    a frame, just before it is drawn. MainLoop() now draws at a steady rate,
+//                    handling events in between. Added FlushInput() and I_PendingInput. KS.
 
 #ifndef __WindowHandler__
 #define __WindowHandler__
@@ -78,6 +81,16 @@ private:
     void MouseMoved(double Xpos,double Ypos);
     static void ScrollCallback(GLFWwindow* Window,double XOffset,double YOffset);
     void Scroll(double XOffset,double YOffset,double XPos,double YPos);
+    void FlushInput();
+    //  A mouse move or scroll waiting to be passed on by FlushInput(). Positions have already
+    //  been converted to have Y increasing upwards.
+    struct PendingInput {
+        bool IsScroll;
+        double Xpos;
+        double Ypos;
+        double DeltaX;
+        double DeltaY;
+    };
     GLFWwindow* I_Window;
     VkSurfaceKHR I_Surface;
     VkInstance I_Instance;
@@ -99,6 +112,7 @@ private:
     void (*I_ScrollCallbackPtr)(
                     double DeltaX, double DeltaY, double AtX, double AtY,void* UserData);
     void* I_ScrollCallbackData;
+    std::vector<PendingInput> I_PendingInput;
 };
 
 #endif
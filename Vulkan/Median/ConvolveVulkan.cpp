@@ -0,0 +1,1354 @@
+//
+//                   C o n v o l v e . c p p     ( V u l k a n   V e r s i o n )
+//
+//  This program is a companion to Median. Where Median runs a median filter through an image,
+//  this convolves the image with a smoothing kernel - a Gaussian, a boxcar or a disk - using a
+//  GPU, programmed in C++ using Vulkan. It allows the user to perform the same operation using
+//  the CPU and compare the timings, and checks the results. The input image is read from a FITS
+//  file whose name is given as a command line parameter, and the result written to a copy of
+//  it, just as for Median, with whose code it is built, sharing the same command line handling
+//  and the same Vulkan Framework.
+//
+//  A convolution with a Size by Size kernel takes Size * Size multiply-adds for each pixel, but
+//  the Gaussian and the boxcar are separable - each weight is the product of a weight for its
+//  column and one for its row - and for those the same result can be had from Size multiply-
+//  adds along each row, followed by Size down each column of the result. So there are two
+//  versions of the GPU code: a separable one, in two passes (ConvolveSeparable.comp), each of
+//  which first copies the part of the image its workgroup needs into a shared memory tile, and
+//  a direct one (Convolve.comp, the convolution used by Median's 'Chain'), which works for any
+//  kernel. The CPU code has the same two versions, each built on one inner loop, run over a
+//  whole row at a time using the widest vector instructions the CPU supports.
+//
+//  Invocation:
+//     Convolve <File> <Size> <Nrpt> <Threads> <cpu> <gpu> <Nx> <Ny> <debug>
+//
+//  Where:
+//     File    is the name of an existing FITS file containing the image.
+//     Size    is the number of pixels across the square kernel - an odd number, up to 31.
+//     Nrpt    is the number of times the operation is to be repeated.
+//     Threads if the CPU is used, the number of CPU threads to be used.
+//
+//     File,Size,Nrpt,Threads are positional parameters, and can be specified either by just
+//     providing values for them on the command line in the order above, or explicitly
+//     by name and value, with an optional '=' sign. If Threads is zero, the maximum number
+//     of CPU threads available will be used.
+//
+//     Kernel  is the kernel to use - "Gaussian" (the default), "Boxcar" or "Disk". A disk is
+//             all the pixels within Size/2 + 1/2 of the center, which isn't separable.
+//     Sigma   is the standard deviation, in pixels, of a Gaussian kernel. Default 1.0. The
+//             kernel is cut off at Size, so Size should be at least about 6 * Sigma.
+//
+//             The weights of each kernel add up to one, so the result is a weighted mean.
+//
+//     Cpu     specifies that the operation is to be carried out using the CPU.
+//     Gpu     specifies that the operation is to be carried out using the GPU.
+//
+//     Cpu and Gpu are boolean values that can be specified explicitly, eg Cpu = true,
+//     or just by appearing in the command line, optionally negated, for example as 'cpu'
+//     or 'nogpu'. They are not mutually exclusive. By default both are false, but if neither
+//     are specified the program will use the GPU.
+//
+//     If File is specified as blank, then the program will not read data from a file,
+//     but will generate dummy data for test purposes, Nx by Ny. If File is non-blank, Nx and
+//     Ny are ignored. Any blank pixels in the file - given by its BLANK keyword, or NaNs - are
+//     left out of the sums, which are scaled up to allow for the weights left out, as
+//     Convolve.comp explains. The separable versions can't do that, so for an image with
+//     blank pixels both the GPU and CPU use the direct versions.
+//
+//     Nx      is the X dimension of the image, if no file is given.
+//     Ny      is the Y dimension of the image, if no file is given.
+//
+//     Direct  has both the GPU and CPU use the direct versions of the code even for a
+//             separable kernel, for comparison.
+//
+//     Simd    selects the vector instructions used by the CPU code - one of "Auto" (the
+//             default), "Scalar", "AVX2", "AVX512" or "NEON", as for Reduce.
+//
+//     Validate specifies that Vulkan validation is to be enabled.
+//
+//     Warmup  is the number of passes at the start left out of the timing statistics.
+//     Report  is the name of a file (.csv or .json) to which the timings are appended.
+//
+//     Debug   is a string that can be used to control debug output, as for Median.
+//
+//     The command line is processed by the command line handler used for all these GPU
+//     examples, which also supports the flags 'list', 'prompt', 'reset' and 'help'.
+//
+//  Example:
+//     ./Convolve n6770.fits 9 20 0 cpu gpu Sigma=1.5
+//
+//  Checking:
+//     Each set of results is checked against a double precision convolution of a sample of
+//     the pixels, spread over the whole image and including its edges and corners, and if
+//     both the GPU and the CPU are used, their results are also compared pixel by pixel. The
+//     sums are in single precision, in slightly different orders by the different versions,
+//     so they are only expected to agree to within their rounding errors.
+//
+//  History:
+//      15th Oct 2026. First version, based on Median. KS.
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              I n c l u d e  F i l e s
+//
+//  Needed to allow multi-threading of the CPU code.
+
+#include <thread>
+
+//  The file handling code uses C++17's std::filesystem
+
+#include <filesystem>
+
+//  Needed for exp(), fabs() and NAN.
+
+#include <math.h>
+
+//  Needed for std::max() and std::min().
+
+#include <algorithm>
+
+//  The same utility code as Median. A Command Handler provides a flexible way of handling
+//  command line parameters. An MsecTimer provides a very simple way of timing blocks of code,
+//  and an MsecStats collects the times for each pass. A Debug Handler provides control over
+//  debug output, and a BenchReport collects the timings to be written out for 'Report'. The
+//  StartupProfile records the start-up stages listed for 'Startup'.
+
+#include "CommandHandler.h"
+#include "MsecTimer.h"
+#include "BenchReport.h"
+#include "ThreadPool.h"
+#include "StartupProfile.h"
+#include "DebugHandler.h"
+
+//  The image read from a FITS file is held in memory allocated by the Vulkan Framework, so the
+//  GPU can access it without a copy.
+
+#include "KVVulkanFramework.h"
+
+//  FITS file access uses the cfitsio library.
+
+#ifndef NO_CFITSIO
+#define USE_CFITSIO
+#include "fitsio.h"
+#else
+typedef void fitsfile;
+typedef long long LONGLONG;
+#endif
+
+//  Required on some systems for strncpy().
+
+#include <string.h>
+
+//  This provides a global Debug Handler that all the routines here can use.
+
+DebugHandler TheDebugHandler;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//               F o r w a r d  D e f i n i t i o n s  &  S t r u c t u r e s
+
+//  Structure used to collect details passed around during the program, mostly about the
+//  input FITS file and the various data arrays, as Median's MedianDetails.
+
+struct ConvolveDetails {
+    fitsfile* Fptr = nullptr;           //  Cfitsio routines access the output file through this.
+    float* InputData = nullptr;         //  The input image, in importable memory.
+    float* GPUOutputData = nullptr;     //  The GPU's result, once noted.
+    float* CPUOutputData = nullptr;     //  The CPU's result, once noted.
+    std::string OutputFileName = "";    //  Name of the output FITS file.
+    bool HasBlanks = false;             //  True if the image has blank (NaN) pixels.
+};
+
+//  The kernel. Weights has the Size * Size weights, row by row, and for a separable kernel
+//  Weights1D has the Size weights each of those is the product of two of.
+
+struct ConvolveKernel {
+    std::string Name = "";
+    int Size = 0;
+    bool Separable = false;
+    std::vector<float> Weights;
+    std::vector<float> Weights1D;
+};
+
+//  The largest kernel that can be used. This has to match MAX_HALO in ConvolveSeparable.comp,
+//  and is the largest Convolve.comp allows for (see ImageGraph::C_MaxConvolveSize).
+
+static const int C_MaxKernelSize = 31;
+
+//  Set up the weights for the kernel named.
+bool MakeKernel(const std::string& Name,int Size,double Sigma,ConvolveKernel* Kernel);
+//  Read the data from the FITS file.
+bool ReadFitsFile(const std::string& Filename,int* Nx,int* Ny,ConvolveDetails* Details);
+//  Perform the convolution using the GPU
+void ComputeUsingGPU(int Nx,int Ny,const ConvolveKernel& Kernel,bool Direct,int Nrpt,
+                    bool Validate,const std::string& DebugLevels,int Warmup,BenchReport& Bench,
+                                                                     ConvolveDetails* Details);
+//  Perform the convolution using the CPU
+void ComputeUsingCPU(int Threads,int Nx,int Ny,const ConvolveKernel& Kernel,bool Direct,
+                    int Nrpt,const std::string& Simd,int Warmup,BenchReport& Bench,
+                                                                     ConvolveDetails* Details);
+//  Set initial values for the input array.
+void SetInputArray(float* Input,int Nx,int Ny);
+//  Check a set of results, and keep them for the output file
+bool NoteResults(const float* Output,bool FromGPU,int Nx,int Ny,const ConvolveKernel& Kernel,
+                                                                     ConvolveDetails* Details);
+//  Write the result to the output FITS file.
+bool WriteFitsFile(int Nx,int Ny,ConvolveDetails* Details);
+//  Release the image memory and close any open file.
+void Shutdown(ConvolveDetails* Details);
+//  Mark the end of start-up, and list its stages if 'Startup' debugging is enabled
+void EndOfStartup(void);
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             D e b u g  A r g  H e l p e r
+//
+//  This provides a way for the program to give some additional help to the command line handler
+//  for the 'Debug' parameter, just as in Median.
+
+class DebugArgHelper : public CmdArgHelper {
+public:
+    bool CheckValidity(const std::string& Value,std::string* Reason);
+    std::string HelpText(void);
+};
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    M a i n
+//
+//  Most of the code in the main routine is taken up with getting the values for the various
+//  command line parameters. It then reads the image, or makes a test image, and invokes either
+//  the CPU or the GPU (or both) to convolve it, writing the result to a file if it came from one.
+
+int main (int Argc, char* Argv[]) {
+
+    //  Start-up stages are timed from here.
+
+    StartupProfile::Global().Start();
+
+    //  Set up the various levels for the Debug handler
+
+    TheDebugHandler.LevelsList("Timing,Setup,Checks,Fits,Startup");
+
+    //  Set up the Handler and the argument instances for the various command line arguments.
+
+    int Posn = 1;
+    CmdHandler TheHandler("Convolve");
+    FileArg FilenameArg(TheHandler,"File",Posn++,"MustExist,NullOk","",
+                                                            "FITS file containing image");
+    IntArg SizeArg(TheHandler,"Size",Posn++,"",5,1,C_MaxKernelSize,
+                                    "Size of kernel in pixels - should be an odd number");
+    IntArg NrptArg(TheHandler,"Nrpt",Posn++,"",1,0,5000,"Repeat count for operation");
+    int DefaultThreads = 1;
+    int MaxThreads = std::thread::hardware_concurrency();
+    if (MaxThreads < 0) { MaxThreads = 0; DefaultThreads = 0; }
+    IntArg ThreadsArg(TheHandler,"Threads",Posn++,"",DefaultThreads,0,MaxThreads,
+                                                                   "CPU threads to use");
+    IntArg NxArg(TheHandler,"Nx",0,"",1024,2,1024*1024,"X-dimension of image");
+    IntArg NyArg(TheHandler,"Ny",0,"",1024,2,1024*1024,"Y-dimension of image");
+    StringArg KernelArg(TheHandler,"Kernel",0,"","Gaussian","Kernel (Gaussian,Boxcar,Disk)");
+    RealArg SigmaArg(TheHandler,"Sigma",0,"",1.0,0.01,100.0,"Gaussian sigma in pixels");
+    BoolArg CpuArg(TheHandler,"Cpu",0,"",false,"Perform computation using CPU");
+    BoolArg GpuArg(TheHandler,"Gpu",0,"",false,"Perform computation using GPU");
+    BoolArg DirectArg(TheHandler,"Direct",0,"",false,"Convolve in 2D even if kernel separates");
+    StringArg SimdArg(TheHandler,"Simd",0,"","Auto","CPU vector code (Auto,Scalar,AVX2,...)");
+    BoolArg ValidateArg(TheHandler,"Validate",0,"",false,"Enable Vulkan validation layers");
+    IntArg WarmupArg(TheHandler,"Warmup",0,"",0,0,5000,"Passes left out of the timings");
+    StringArg ReportArg(TheHandler,"Report",0,"","","File for timings (.csv or .json)");
+    StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
+    DebugArgHelper DebugHelper;
+    DebugArg.SetHelper(&DebugHelper);
+
+    //  Now get the values for each of the command line arguments. The ReadPrevious() and
+    //  SaveCurrent() calls allow the handler to remember the argument values used the last
+    //  time the program was run.
+
+    std::string Error = "";
+    if (TheHandler.IsInteractive()) TheHandler.ReadPrevious();
+    bool Ok = TheHandler.ParseArgs(Argc,Argv);
+    std::string Filename = FilenameArg.GetValue(&Ok,&Error);
+    int Nx = 0,Ny = 0;
+    if (Filename == "") {
+        Nx = NxArg.GetValue(&Ok,&Error);
+        Ny = NyArg.GetValue(&Ok,&Error);
+    }
+    int Size = SizeArg.GetValue(&Ok,&Error);
+    int Nrpt = NrptArg.GetValue(&Ok,&Error);
+    int Threads = ThreadsArg.GetValue(&Ok,&Error);
+    std::string KernelName = KernelArg.GetValue(&Ok,&Error);
+    double Sigma = SigmaArg.GetValue(&Ok,&Error);
+    bool UseCPU = CpuArg.GetValue(&Ok,&Error);
+    bool UseGPU = GpuArg.GetValue(&Ok,&Error);
+    bool Direct = DirectArg.GetValue(&Ok,&Error);
+    std::string Simd = SimdArg.GetValue(&Ok,&Error);
+    bool Validate = ValidateArg.GetValue(&Ok,&Error);
+    int Warmup = WarmupArg.GetValue(&Ok,&Error);
+    std::string Report = ReportArg.GetValue(&Ok,&Error);
+    std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
+
+    //  Check the argument parsing went OK, and didn't end with an exit being requested.
+
+    ConvolveKernel Kernel;
+    if (!Ok) {
+        if (!TheHandler.ExitRequested()) {
+            printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
+        }
+    } else if ((Size % 2) == 0) {
+        printf ("Error in 'Size': %d should be an odd number\n",Size);
+    } else if (!MakeKernel(KernelName,Size,Sigma,&Kernel)) {
+        printf ("Error in 'Kernel': '%s' should be Gaussian, Boxcar or Disk\n",
+                                                                         KernelName.c_str());
+    } else {
+        if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
+
+        //  Set the active levels for the Debug handler as specified on the command line.
+
+        TheDebugHandler.SetLevels(DebugLevels);
+
+        //  With 'Startup', record the start-up stages, the first being the command line.
+
+        if (TheDebugHandler.Active("Startup")) {
+            StartupProfile::Global().Enable(true);
+            StartupProfile::Global().Record("Command line",0.0,StartupProfile::Global().NowMsec());
+        }
+
+        //  If neither CPU not GPU were specified on the command line, use GPU.
+
+        if (!UseGPU && !UseCPU) UseGPU = true;
+
+        //  Get the image, either from the file or made up. Either way, it's in memory the GPU
+        //  can import, and the GPU and CPU both work from it.
+
+        ConvolveDetails Details;
+        bool ImageOK = true;
+        if (Filename != "") {
+            ImageOK = ReadFitsFile(Filename,&Nx,&Ny,&Details);
+        } else {
+            Details.InputData = (float*)KVVulkanFramework::AllocateImportableMemory(
+                                                       size_t(Nx) * size_t(Ny) * sizeof(float));
+            if (Details.InputData) SetInputArray(Details.InputData,Nx,Ny);
+            else ImageOK = false;
+        }
+        if (ImageOK) {
+            bool UseDirect = Direct || !Kernel.Separable || Details.HasBlanks;
+            printf ("\nPerforming 'Convolve' test, image of %d rows, %d columns, %s kernel "
+                   "%d by %d (%s). Repeat count %d.\n\n",Ny,Nx,Kernel.Name.c_str(),Size,Size,
+                                                    UseDirect ? "direct" : "separable",Nrpt);
+            if (Details.HasBlanks && Kernel.Separable && !Direct) {
+                printf ("The image has blank pixels, so the direct code is used.\n\n");
+            }
+            BenchReport Bench;
+            if (UseGPU) {
+                ComputeUsingGPU(Nx,Ny,Kernel,UseDirect,Nrpt,Validate,DebugLevels,Warmup,Bench,
+                                                                                    &Details);
+            }
+            if (UseCPU) {
+                ComputeUsingCPU(Threads,Nx,Ny,Kernel,UseDirect,Nrpt,Simd,Warmup,Bench,&Details);
+            }
+
+            //  Write out the result, if it came from a file, and any timings for 'Report'.
+
+            if (Details.Fptr && (Details.GPUOutputData || Details.CPUOutputData)) {
+                WriteFitsFile(Nx,Ny,&Details);
+            }
+            if (Report != "" && Bench.Rows() > 0) Bench.Write(Report);
+        }
+        Shutdown(&Details);
+    }
+    return 0;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 M a k e  K e r n e l
+//
+//  Sets up the weights for a kernel, given its name - the comparison ignores case - and its
+//  size. Sigma is only used for a Gaussian. The weights are normalised to add up to one. The
+//  Gaussian and the boxcar are separable, and for those the 2D weights are made from the 1D
+//  ones, so the two versions of the code use exactly the same kernel. Returns false if the
+//  kernel name isn't recognised.
+
+bool MakeKernel(const std::string& Name,int Size,double Sigma,ConvolveKernel* Kernel)
+{
+    std::string Upper = Name;
+    for (char& Char : Upper) Char = toupper(Char);
+    int Half = Size / 2;
+    Kernel->Size = Size;
+    Kernel->Weights.assign(size_t(Size) * size_t(Size),0.0f);
+    Kernel->Weights1D.clear();
+    if (Upper == "GAUSSIAN" || Upper == "BOXCAR") {
+        Kernel->Name = (Upper == "GAUSSIAN") ? "Gaussian" : "Boxcar";
+        Kernel->Separable = true;
+        double Total = 0.0;
+        std::vector<double> Values(Size);
+        for (int I = 0; I < Size; I++) {
+            double Offset = double(I - Half) / Sigma;
+            Values[I] = (Upper == "GAUSSIAN") ? exp(-0.5 * Offset * Offset) : 1.0;
+            Total += Values[I];
+        }
+        for (int I = 0; I < Size; I++) Kernel->Weights1D.push_back(float(Values[I] / Total));
+        for (int Ky = 0; Ky < Size; Ky++) {
+            for (int Kx = 0; Kx < Size; Kx++) {
+                Kernel->Weights[Ky * Size + Kx] = Kernel->Weights1D[Ky] * Kernel->Weights1D[Kx];
+            }
+        }
+    } else if (Upper == "DISK") {
+        Kernel->Name = "Disk";
+        Kernel->Separable = false;
+        double Limit = (double(Half) + 0.5) * (double(Half) + 0.5);
+        int Count = 0;
+        for (int Ky = 0; Ky < Size; Ky++) {
+            for (int Kx = 0; Kx < Size; Kx++) {
+                double Dx = Kx - Half;
+                double Dy = Ky - Half;
+                if (Dx * Dx + Dy * Dy <= Limit) Count++;
+            }
+        }
+        for (int Ky = 0; Ky < Size; Ky++) {
+            for (int Kx = 0; Kx < Size; Kx++) {
+                double Dx = Kx - Half;
+                double Dy = Ky - Half;
+                if (Dx * Dx + Dy * Dy <= Limit) {
+                    Kernel->Weights[Ky * Size + Kx] = 1.0f / float(Count);
+                }
+            }
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             R e a d  F i t s  F i l e
+//
+//  Reads the main image of a FITS file into importable memory, and creates the output file,
+//  a "Convolve_" copy of the input, with a copy of its header, just as Median's ReadFitsFile()
+//  does, but without its faster paths for mapped, compressed or 16-bit images. Blank pixels
+//  are read as NaNs.
+
+bool ReadFitsFile(const std::string& Filename,int* Nx,int* Ny,ConvolveDetails* Details)
+{
+
+#ifdef USE_CFITSIO
+
+    char Error[80];
+    int Status = 0;
+
+    std::filesystem::path InputPath(Filename);
+    std::string OutputFile =
+                (InputPath.parent_path() / ("Convolve_" + InputPath.filename().string())).string();
+    TheDebugHandler.Logf("Fits","Reading input file %s, output will go to new file %s",
+                                                       Filename.c_str(),OutputFile.c_str());
+
+    fitsfile* InFptr = nullptr;
+    if (fits_open_image(&InFptr,Filename.c_str(),READONLY,&Status)) {
+        fits_get_errstatus (Status,Error);
+    } else {
+        long Naxes[2] = {0,0};
+        int Nfound = 0;
+        if (fits_get_img_dim(InFptr,&Nfound,&Status) ||
+                          (Nfound == 2 && fits_get_img_size(InFptr,2,Naxes,&Status))) {
+            fits_get_errstatus (Status,Error);
+        } else if (Nfound != 2) {
+            strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+            Status = 1;
+        } else {
+            LONGLONG NPixels = LONGLONG(Naxes[0]) * LONGLONG(Naxes[1]);
+            float* Data = (float*)KVVulkanFramework::AllocateImportableMemory(
+                                                            size_t(NPixels) * sizeof(float));
+            long Fpixel = 1;
+            float Nullval = NAN;
+            int Anynull = 0;
+            if (Data == nullptr) {
+                strncpy(Error,"Unable to allocate memory for the image",sizeof(Error));
+                Status = 1;
+            } else if (fits_read_img(InFptr,TFLOAT,Fpixel,NPixels,&Nullval,Data,&Anynull,
+                                                                                   &Status)) {
+                fits_get_errstatus (Status,Error);
+                KVVulkanFramework::FreeImportableMemory(Data);
+            } else {
+                Details->InputData = Data;
+                Details->HasBlanks = (Anynull != 0);
+                if (Details->HasBlanks) TheDebugHandler.Log("Fits","Image has blank pixels");
+                *Nx = Naxes[0];
+                *Ny = Naxes[1];
+                TheDebugHandler.Logf("Fits","File opened, 2D data array %d by %d",*Nx,*Ny);
+                std::string CreateName = "!" + OutputFile;
+                fitsfile* Fptr = nullptr;
+                if (fits_create_file(&Fptr,CreateName.c_str(),&Status)) {
+                    fits_get_errstatus (Status,Error);
+                } else {
+                    Details->Fptr = Fptr;
+                    int CompStatus = 0;
+                    if (fits_is_compressed_image(InFptr,&CompStatus)) {
+                        fits_img_decompress_header(InFptr,Fptr,&Status);
+                    } else {
+                        fits_copy_header(InFptr,Fptr,&Status);
+                    }
+                    if (Status) fits_get_errstatus (Status,Error);
+                }
+            }
+        }
+        int CloseStatus = 0;
+        if (fits_close_file(InFptr,&CloseStatus) && Status == 0) {
+            Status = CloseStatus;
+            fits_get_errstatus (Status,Error);
+        }
+    }
+    if (Status == 0) Details->OutputFileName = OutputFile;
+    if (Status) printf ("Error reading FITS file: %s\n",Error);
+    return (Status == 0);
+
+#else
+
+    printf ("Cannot read FITS file, program was built without Cfitsio support\n");
+    return false;
+
+#endif
+
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    G P U  c o d e
+//
+//  ComputeUsingGPU() convolves the image in Details->InputData using the GPU, Nrpt times, and
+//  passes the result to NoteResults(). For a separable kernel, unless Direct is set, this uses
+//  ConvolveSeparable.spv, in two passes - along the rows, into a temporary image that only
+//  lives on the GPU, and down the columns of that - which are the same pipeline with different
+//  push constants, recorded into one command buffer by RecordComputeBatch(), which puts a
+//  barrier between them. Otherwise it uses Convolve.spv, in one pass, with the 2D weights.
+//  Either way, the weights are in a small storage buffer.
+
+//                                  C o n s t a n t s
+//
+//  These have to match the values used by the shaders. Both have the input at binding 1 and the
+//  output at 2. ConvolveSeparable.comp has the temporary image at 3 and the weights at 4, and
+//  Convolve.comp has the weights at 3.
+
+static const int C_InputBufferBinding = 1;
+static const int C_OutputBufferBinding = 2;
+static const int C_TempBufferBinding = 3;
+static const int C_SeparableWeightsBinding = 4;
+static const int C_DirectWeightsBinding = 3;
+static const uint32_t C_WorkGroupSize = 16;
+static const char* const C_SeparableShader = "ConvolveSeparable.spv";
+static const char* const C_DirectShader = "Convolve.spv";
+
+//  The push constants for each shader, which must match SeparableArgs in ConvolveSeparable.comp
+//  and ConvolveArgs in Convolve.comp.
+
+struct SeparableArgs {
+    int Nx;
+    int Ny;
+    int Size;
+    int Pass;
+};
+
+struct DirectArgs {
+    int Nx;
+    int Ny;
+    int Size;
+    float WeightTotal;
+};
+
+void ComputeUsingGPU(int Nx,int Ny,const ConvolveKernel& Kernel,bool Direct,int Nrpt,
+                    bool Validate,const std::string& DebugLevels,int Warmup,BenchReport& Bench,
+                                                                     ConvolveDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU setup starting");
+
+    //  The basic Vulkan initialisation sequence, as for Median.
+
+    StartupPhase DevicePhase("GPU device");
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    TheDebugHandler.Logf("Setup","GPU device created at %.3f msec",SetupTimer.ElapsedMsec());
+    DevicePhase.End();
+
+    //  The input image is imported, the output is "READBACK", and for the separable version
+    //  the temporary image is "LOCAL". As for Median, the whole image has to fit in one storage
+    //  buffer.
+
+    StartupPhase BufferPhase("GPU buffers");
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    if (StatusOK && Length > Framework.GetMaxStorageBufferRange()) {
+        printf ("An image of %llu bytes is larger than the GPU's largest storage buffer "
+                "(%llu bytes).\n\n",(unsigned long long)Length,
+                                     (unsigned long long)Framework.GetMaxStorageBufferRange());
+        StatusOK = false;
+    }
+    KVVulkanFramework::KVBufferHandle InputBufferHndl =
+               Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE","IMPORTED",StatusOK);
+    Framework.ImportBuffer(InputBufferHndl,Details->InputData,Length,StatusOK);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl =
+               Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE","READBACK",StatusOK);
+    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+    VkDeviceSize Bytes;
+    float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles = {InputBufferHndl,OutputBufferHndl};
+    const std::vector<float>& Weights = Direct ? Kernel.Weights : Kernel.Weights1D;
+    KVVulkanFramework::KVBufferHandle WeightsBufferHndl = Framework.SetBufferDetails(
+        Direct ? C_DirectWeightsBinding : C_SeparableWeightsBinding,"STORAGE","SHARED",StatusOK);
+    Framework.CreateBuffer(WeightsBufferHndl,Weights.size() * sizeof(float),StatusOK);
+    float* WeightsAddr = (float*)Framework.MapBuffer(WeightsBufferHndl,&Bytes,StatusOK);
+    if (StatusOK && WeightsAddr) memcpy(WeightsAddr,Weights.data(),Weights.size() * sizeof(float));
+    if (!Direct) {
+        KVVulkanFramework::KVBufferHandle TempBufferHndl =
+                   Framework.SetBufferDetails(C_TempBufferBinding,"STORAGE","LOCAL",StatusOK);
+        Framework.CreateBuffer(TempBufferHndl,Length,StatusOK);
+        Handles.push_back(TempBufferHndl);
+    }
+    Handles.push_back(WeightsBufferHndl);
+    BufferPhase.End();
+
+    //  The descriptor set, queue and command buffer, as usual.
+
+    StartupPhase PipelinePhase("GPU pipeline");
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    Framework.SetCommandBufferReusable(CommandBuffer,true,StatusOK);
+
+    //  ConvolveSeparable.comp has its workgroup size fixed, as it sizes its shared memory tile,
+    //  but Convolve.comp takes it as specialization constants 0 and 1.
+
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants;
+    uint32_t PushSize = uint32_t(sizeof(SeparableArgs));
+    if (Direct) {
+        SpecConstants = {C_WorkGroupSize,C_WorkGroupSize};
+        PushSize = uint32_t(sizeof(DirectArgs));
+    }
+    Framework.CreateComputePipeline(Direct ? C_DirectShader : C_SeparableShader,"main",
+          &SetLayout,&ComputePipelineLayout,&ComputePipeline,SpecConstants,PushSize,StatusOK);
+    TheDebugHandler.Logf("Setup","GPU pipeline using %s created at %.3f msec",
+                     Direct ? C_DirectShader : C_SeparableShader,SetupTimer.ElapsedMsec());
+    PipelinePhase.End();
+
+    //  One dispatch for the direct version, two for the separable one, each with one
+    //  invocation for each pixel. The push constants have to stay in place until the batch
+    //  is recorded.
+
+    std::vector<SeparableArgs> PassArgs = {{Nx,Ny,Kernel.Size,0},{Nx,Ny,Kernel.Size,1}};
+    float WeightTotal = 0.0;
+    for (float Weight : Kernel.Weights) WeightTotal += Weight;
+    DirectArgs TheDirectArgs = {Nx,Ny,Kernel.Size,WeightTotal};
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches;
+    for (int Pass = 0; Pass < (Direct ? 1 : 2); Pass++) {
+        KVVulkanFramework::KVDispatch Dispatch{};
+        Dispatch.PipelineHndl = ComputePipeline;
+        Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+        Dispatch.DescriptorSetHndl = DescriptorSet;
+        Dispatch.WorkGroupCounts[0] = (uint32_t(Nx) + C_WorkGroupSize - 1) / C_WorkGroupSize;
+        Dispatch.WorkGroupCounts[1] = (uint32_t(Ny) + C_WorkGroupSize - 1) / C_WorkGroupSize;
+        Dispatch.WorkGroupCounts[2] = 1;
+        if (Direct) {
+            Dispatch.PushConstants = &TheDirectArgs;
+        } else {
+            Dispatch.PushConstants = &PassArgs[Pass];
+        }
+        Dispatch.PushConstantSize = PushSize;
+        Dispatches.push_back(Dispatch);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {OutputBufferHndl};
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+
+    //  The repeat loop runs all the passes each time, and the kernel time is that of all of
+    //  them. The command buffer is reusable, so it's only recorded the first time.
+
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecStats LoopStats;
+    MsecStats KernelStats;
+    LoopStats.SetWarmup(Warmup);
+    KernelStats.SetWarmup(Warmup);
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer LoopTimer;
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        Framework.InvalidateBuffer(OutputBufferHndl,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            TheDebugHandler.Logf("Timing","GPU kernel took %.3f msec",DispatchMsec);
+            KernelMsec += DispatchMsec;
+            KernelStats.Record(DispatchMsec);
+            KernelTimed = true;
+        }
+        if (!StatusOK) break;
+        LoopStats.Record(LoopTimer.ElapsedMsec());
+    }
+
+    //  Report on the timing, and note the results.
+
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        const char* Version = Direct ? "direct" : "separable";
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            printf ("GPU (%s) took %.3f msec\n",Version,Msec);
+            printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+            LoopStats.Report("GPU iterations");
+            if (KernelTimed) {
+                printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+            }
+            if (LoopStats.Count() > 0) {
+                std::string Device,Driver;
+                Framework.GetDeviceDescription(&Device,&Driver);
+                Bench.SetContext("Convolve","Vulkan",Device,Driver);
+                Bench.AddRow(std::string("GPU ") + Version,Nx,Ny,LoopStats,
+                                                          KernelTimed ? &KernelStats : nullptr);
+            }
+            if (NoteResults(OutputBufferAddr,true,Nx,Ny,Kernel,Details)) {
+                printf ("GPU completed OK, all values computed as expected.\n");
+            } else {
+                printf ("** GPU completes, but with errors **\n");
+            }
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    C P U  c o d e
+//
+//  ComputeUsingCPU() convolves the image using the CPU, in the same two ways as the GPU code,
+//  sharing the rows out between the threads of the shared pool. Both ways are built on one
+//  inner loop, AddScaledRow(), which adds a row of values, each multiplied by the same weight,
+//  to a row of running sums:
+//
+//  o  The separable version takes two passes. In the first, each thread copies each of its
+//     rows into a padded row, with Size/2 copies of the edge value at each end, and adds it to
+//     its sums once for each weight, each time offset by one more pixel, writing the sums into
+//     a temporary image. In the second, each thread adds Size rows of the temporary image - the
+//     ones around its row, with the edge rows repeated - to its sums, one for each weight.
+//  o  The direct version adds Size * Size rows to each row of sums: for each row of the kernel
+//     the corresponding image row is padded, and added once for each weight in the kernel row.
+//
+//  Either way the sums for each pixel are in the same order as on the GPU. An image with blank
+//  pixels can't be done a row at a time, as each sum has to leave out the blanks in its own
+//  box, so for that ConvolvePixel() is used for each pixel, just as Convolve.comp does it.
+
+//                               I n c l u d e  F i l e s
+//
+//  Needed for the vector versions of the CPU code.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CONVOLVE_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define CONVOLVE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+#include <ctype.h>
+
+//  The scalar AddScaledRow(), which the compiler may well vectorise for itself, and versions
+//  that use AVX2, AVX-512 and NEON explicitly. As in Reduce, the x86 versions are compiled for
+//  their instruction sets using the 'target' attribute with gcc and clang, so the program still
+//  runs on older CPUs.
+
+void AddScaledRow(float* Sums,const float* Values,int Nx,float Weight)
+{
+    for (int Ix = 0; Ix < Nx; Ix++) Sums[Ix] += Weight * Values[Ix];
+}
+
+#if defined(CONVOLVE_X86_SIMD) && defined(__GNUC__)
+#define CONVOLVE_TARGET(Isa) __attribute__((target(Isa)))
+#else
+#define CONVOLVE_TARGET(Isa)
+#endif
+
+#ifdef CONVOLVE_X86_SIMD
+
+CONVOLVE_TARGET("avx2")
+void AddScaledRowAVX2(float* Sums,const float* Values,int Nx,float Weight)
+{
+    const __m256 Weights = _mm256_set1_ps(Weight);
+    int Ix = 0;
+    for (; Ix + 8 <= Nx; Ix += 8) {
+        __m256 Sum = _mm256_loadu_ps(Sums + Ix);
+        Sum = _mm256_add_ps(Sum,_mm256_mul_ps(Weights,_mm256_loadu_ps(Values + Ix)));
+        _mm256_storeu_ps(Sums + Ix,Sum);
+    }
+    for (; Ix < Nx; Ix++) Sums[Ix] += Weight * Values[Ix];
+}
+
+CONVOLVE_TARGET("avx512f")
+void AddScaledRowAVX512(float* Sums,const float* Values,int Nx,float Weight)
+{
+    const __m512 Weights = _mm512_set1_ps(Weight);
+    int Ix = 0;
+    for (; Ix + 16 <= Nx; Ix += 16) {
+        __m512 Sum = _mm512_loadu_ps(Sums + Ix);
+        Sum = _mm512_add_ps(Sum,_mm512_mul_ps(Weights,_mm512_loadu_ps(Values + Ix)));
+        _mm512_storeu_ps(Sums + Ix,Sum);
+    }
+    for (; Ix < Nx; Ix++) Sums[Ix] += Weight * Values[Ix];
+}
+
+#endif
+
+#ifdef CONVOLVE_NEON_SIMD
+
+void AddScaledRowNEON(float* Sums,const float* Values,int Nx,float Weight)
+{
+    const float32x4_t Weights = vdupq_n_f32(Weight);
+    int Ix = 0;
+    for (; Ix + 4 <= Nx; Ix += 4) {
+        float32x4_t Sum = vld1q_f32(Sums + Ix);
+        Sum = vaddq_f32(Sum,vmulq_f32(Weights,vld1q_f32(Values + Ix)));
+        vst1q_f32(Sums + Ix,Sum);
+    }
+    for (; Ix < Nx; Ix++) Sums[Ix] += Weight * Values[Ix];
+}
+
+#endif
+
+//  All the versions have the same arguments, so the convolution code can be passed whichever
+//  is to be used.
+
+typedef void (*CPURowRoutine)(float* Sums,const float* Values,int Nx,float Weight);
+
+//  CPUSupports() returns true if the CPU being used supports a given set of vector instructions,
+//  "AVX2", "AVX512" or "NEON", as in Reduce.
+
+bool CPUSupports(const std::string& Isa)
+{
+    bool Supported = false;
+#ifdef CONVOLVE_X86_SIMD
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (Isa == "AVX2") Supported = __builtin_cpu_supports("avx2");
+    if (Isa == "AVX512") Supported = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER)
+    int Info[4];
+    __cpuid(Info,0);
+    if (Info[0] >= 7) {
+        __cpuidex(Info,7,0);
+        bool HasAVX2 = (Info[1] & (1 << 5)) != 0;
+        bool HasAVX512 = (Info[1] & (1 << 16)) != 0;
+        __cpuid(Info,1);
+        bool OSSaves = (Info[2] & (1 << 27)) != 0;
+        unsigned long long XCR0 = OSSaves ? _xgetbv(0) : 0;
+        if (Isa == "AVX2") Supported = HasAVX2 && ((XCR0 & 0x6) == 0x6);
+        if (Isa == "AVX512") Supported = HasAVX512 && ((XCR0 & 0xe6) == 0xe6);
+    }
+#endif
+#endif
+#ifdef CONVOLVE_NEON_SIMD
+    if (Isa == "NEON") Supported = true;
+#endif
+    return Supported;
+}
+
+//  SelectCPURow() returns the version of AddScaledRow() to use, given the value of the 'Simd'
+//  command line parameter, and sets Name to the instruction set it uses, just as Reduce's
+//  SelectCPURange() does.
+
+CPURowRoutine SelectCPURow(const std::string& Simd,std::string* Name)
+{
+    std::string Requested = Simd;
+    for (char& Char : Requested) Char = toupper(Char);
+    if (Requested == "") Requested = "AUTO";
+    if (Requested != "AUTO" && Requested != "SCALAR" && !CPUSupports(Requested)) {
+        printf ("Warning: '%s' vector code is not supported on this CPU, using 'Auto'.\n",
+                                                                                Simd.c_str());
+        Requested = "AUTO";
+    }
+    CPURowRoutine Routine = AddScaledRow;
+    *Name = "Scalar";
+#ifdef CONVOLVE_X86_SIMD
+    if ((Requested == "AUTO" && CPUSupports("AVX512")) || Requested == "AVX512") {
+        Routine = AddScaledRowAVX512;
+        *Name = "AVX512";
+    } else if ((Requested == "AUTO" && CPUSupports("AVX2")) || Requested == "AVX2") {
+        Routine = AddScaledRowAVX2;
+        *Name = "AVX2";
+    }
+#endif
+#ifdef CONVOLVE_NEON_SIMD
+    if (Requested == "AUTO" || Requested == "NEON") {
+        Routine = AddScaledRowNEON;
+        *Name = "NEON";
+    }
+#endif
+    return Routine;
+}
+
+//  PadRow() copies a row of Nx values into Padded, with Half copies of the first value before
+//  it and Half copies of the last after it, so Padded[Ix + K] is the value K - Half pixels from
+//  Ix, with the edge values repeated, as on the GPU.
+
+static void PadRow(const float* Row,int Nx,int Half,float* Padded)
+{
+    for (int I = 0; I < Half; I++) Padded[I] = Row[0];
+    memcpy(Padded + Half,Row,size_t(Nx) * sizeof(float));
+    for (int I = 0; I < Half; I++) Padded[Half + Nx + I] = Row[Nx - 1];
+}
+
+//  ConvolvePixel() works out one pixel of the result allowing for blank pixels, exactly as
+//  Convolve.comp does. It's used by the CPU code for images with blanks, and in double
+//  precision (as Accumulate) by CheckSample().
+
+template <typename Accumulate>
+static float ConvolvePixel(const float* Input,int Nx,int Ny,int Ix,int Iy,
+                                                                  const ConvolveKernel& Kernel)
+{
+    int Size = Kernel.Size;
+    int Half = Size / 2;
+    Accumulate Sum = 0.0;
+    Accumulate Used = 0.0;
+    Accumulate Total = 0.0;
+    int Valid = 0;
+    int Blanks = 0;
+    for (int Ky = 0; Ky < Size; Ky++) {
+        int Jy = std::min(std::max(Iy + Ky - Half,0),Ny - 1);
+        const float* Row = Input + size_t(Jy) * size_t(Nx);
+        for (int Kx = 0; Kx < Size; Kx++) {
+            int Jx = std::min(std::max(Ix + Kx - Half,0),Nx - 1);
+            Accumulate Weight = Kernel.Weights[Ky * Size + Kx];
+            Total += Weight;
+            if (isnan(Row[Jx])) {
+                Blanks++;
+            } else {
+                Sum += Weight * Accumulate(Row[Jx]);
+                Used += Weight;
+                Valid++;
+            }
+        }
+    }
+    if (Valid == 0) return NAN;
+    if (Blanks > 0) Sum = Sum * (Total / Used);
+    return float(Sum);
+}
+
+//  ConvolveUsingCPU() performs one pass through the whole image, with the threads of the shared
+//  pool each taking a band of rows, and returns the number of threads used. Temp is needed for
+//  the separable version, and is the size of the image.
+
+int ConvolveUsingCPU(int Threads,const float* Input,float* Output,float* Temp,int Nx,int Ny,
+                      const ConvolveKernel& Kernel,bool Direct,bool Blanks,CPURowRoutine AddRow)
+{
+    int Size = Kernel.Size;
+    int Half = Size / 2;
+    size_t RowLength = size_t(Nx);
+    if (Blanks) {
+        return ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    Output[Iy * RowLength + Ix] =
+                                        ConvolvePixel<float>(Input,Nx,Ny,Ix,Iy,Kernel);
+                }
+            }
+        },Threads);
+    }
+    if (Direct) {
+        return ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            std::vector<float> Padded(RowLength + 2 * Half);
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                float* Sums = Output + Iy * RowLength;
+                for (int Ix = 0; Ix < Nx; Ix++) Sums[Ix] = 0.0f;
+                for (int Ky = 0; Ky < Size; Ky++) {
+                    int Jy = std::min(std::max(Iy + Ky - Half,0),Ny - 1);
+                    PadRow(Input + Jy * RowLength,Nx,Half,Padded.data());
+                    for (int Kx = 0; Kx < Size; Kx++) {
+                        AddRow(Sums,Padded.data() + Kx,Nx,Kernel.Weights[Ky * Size + Kx]);
+                    }
+                }
+            }
+        },Threads);
+    }
+
+    //  The separable version needs all the row sums to be done before any column sums can be.
+
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        std::vector<float> Padded(RowLength + 2 * Half);
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            float* Sums = Temp + Iy * RowLength;
+            for (int Ix = 0; Ix < Nx; Ix++) Sums[Ix] = 0.0f;
+            PadRow(Input + Iy * RowLength,Nx,Half,Padded.data());
+            for (int K = 0; K < Size; K++) {
+                AddRow(Sums,Padded.data() + K,Nx,Kernel.Weights1D[K]);
+            }
+        }
+    },Threads);
+    return ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            float* Sums = Output + Iy * RowLength;
+            for (int Ix = 0; Ix < Nx; Ix++) Sums[Ix] = 0.0f;
+            for (int K = 0; K < Size; K++) {
+                int Jy = std::min(std::max(Iy + K - Half,0),Ny - 1);
+                AddRow(Sums,Temp + Jy * RowLength,Nx,Kernel.Weights1D[K]);
+            }
+        }
+    },Threads);
+}
+
+void ComputeUsingCPU(int Threads,int Nx,int Ny,const ConvolveKernel& Kernel,bool Direct,
+                    int Nrpt,const std::string& Simd,int Warmup,BenchReport& Bench,
+                                                                     ConvolveDetails* Details)
+{
+    //  See how many threads the hardware supports. If Threads was passed as zero, use this
+    //  maximum number of threads. Otherwise use the number passed in Threads, if that many
+    //  are available.
+
+    int MaxThreads = std::thread::hardware_concurrency();
+    if (MaxThreads <= 0) MaxThreads = 1;
+    if (Threads <= 0) Threads = MaxThreads;
+    if (Threads > MaxThreads) Threads = MaxThreads;
+    TheDebugHandler.Logf("Setup","CPU using %d threads out of maximum of %d",Threads,MaxThreads);
+
+    std::string SimdName;
+    CPURowRoutine AddRow = SelectCPURow(Simd,&SimdName);
+    TheDebugHandler.Logf("Setup","CPU using %s code",SimdName.c_str());
+
+    size_t Pixels = size_t(Nx) * size_t(Ny);
+    float* Output = (float*)malloc(Pixels * sizeof(float));
+    float* Temp = Direct ? nullptr : (float*)malloc(Pixels * sizeof(float));
+    if (Output == nullptr || (!Direct && Temp == nullptr)) {
+        printf ("Unable to allocate memory for the CPU results.\n\n");
+        Nrpt = 0;
+    }
+
+    MsecStats LoopStats;
+    LoopStats.SetWarmup(Warmup);
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer LoopTimer;
+        Threads = ConvolveUsingCPU(Threads,Details->InputData,Output,Temp,Nx,Ny,Kernel,Direct,
+                                                                   Details->HasBlanks,AddRow);
+        TheDebugHandler.Logf("Timing","CPU pass took %.3f msec",LoopTimer.ElapsedMsec());
+        LoopStats.Record(LoopTimer.ElapsedMsec());
+    }
+
+    //  Report on results, and on timing.
+
+    float Msec = ComputeTimer.ElapsedMsec();
+    if (Nrpt <= 0) {
+        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    } else {
+        const char* Version = Details->HasBlanks ? "per pixel" : Direct ? "direct" : "separable";
+        printf ("CPU (%s) took %.3f msec\n",Version,Msec);
+        printf ("Average msec per iteration for CPU = %.3f (%d thread(s), %s)\n",
+                                               Msec / float(Nrpt),Threads,SimdName.c_str());
+        LoopStats.Report("CPU iterations");
+        if (LoopStats.Count() > 0) {
+            Bench.SetContext("Convolve","CPU",SimdName,"");
+            Bench.AddRow("CPU " + std::to_string(Threads) + " thread(s)",Nx,Ny,LoopStats);
+        }
+        if (NoteResults(Output,false,Nx,Ny,Kernel,Details)) {
+            printf ("CPU completed OK, all values computed as expected.\n");
+        } else {
+            printf ("** CPU completes, but with errors **\n");
+        }
+    }
+    printf ("\n");
+    if (Temp) free(Temp);
+    if (Output) free(Output);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    S e t  I n p u t  A r r a y
+//
+//  This sets the values of the test image used if no file is given: a sloping background, with
+//  a pattern of small variations, and a bright point every 64 pixels in each direction, which
+//  the convolution spreads out into a copy of the kernel, so any error in the weights shows.
+
+void SetInputArray(float* Input,int Nx,int Ny)
+{
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            float* Row = Input + size_t(Iy) * size_t(Nx);
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                float Value = 100.0f + 0.01f * float(Ix + Iy);
+                Value += 0.1f * float((Ix * 7 + Iy * 13) % 97);
+                if ((Ix % 64) == 32 && (Iy % 64) == 32) Value += 1000.0f;
+                Row[Ix] = Value;
+            }
+        }
+    });
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                N o t e  R e s u l t s
+//
+//  Checks a set of results from the GPU or CPU, and keeps a copy of them, for WriteFitsFile()
+//  and for comparison with the results of the other. The results are first checked against
+//  CheckSample(), and if the other's results are already there, the two are compared pixel by
+//  pixel. Both checks allow for the rounding errors of a single precision sum: a sum of values
+//  each multiplied by a weight is within a small multiple of the float precision of the sum of
+//  the magnitudes of its terms, and since the weights are positive and add up to one, that's
+//  at most the largest magnitude in the image. Blank pixels have to match.
+
+static const double C_RelTolerance = 1.0e-5;
+static const int C_SampleSteps = 64;
+static const int C_MaxErrorsListed = 10;
+
+//  CheckSample() checks a grid of C_SampleSteps by C_SampleSteps pixels spread over the image,
+//  always including the edges, against ConvolvePixel() in double precision, and returns the
+//  number that are out by more than Tolerance.
+
+static long CheckSample(const float* Input,const float* Output,int Nx,int Ny,
+                                              const ConvolveKernel& Kernel,double Tolerance)
+{
+    long Errors = 0;
+    for (int Sy = 0; Sy <= C_SampleSteps; Sy++) {
+        int Iy = int((long(Ny - 1) * Sy) / C_SampleSteps);
+        for (int Sx = 0; Sx <= C_SampleSteps; Sx++) {
+            int Ix = int((long(Nx - 1) * Sx) / C_SampleSteps);
+            float Expected = ConvolvePixel<double>(Input,Nx,Ny,Ix,Iy,Kernel);
+            float Value = Output[size_t(Iy) * size_t(Nx) + Ix];
+            bool Match = (isnan(Expected) && isnan(Value)) ||
+                                             fabs(double(Value) - double(Expected)) <= Tolerance;
+            if (!Match) {
+                if (Errors++ < C_MaxErrorsListed) {
+                    printf ("Error at [%d][%d], value %g, expected %g\n",Iy,Ix,Value,Expected);
+                }
+            }
+        }
+    }
+    return Errors;
+}
+
+bool NoteResults(const float* Output,bool FromGPU,int Nx,int Ny,const ConvolveKernel& Kernel,
+                                                                     ConvolveDetails* Details)
+{
+    if (Output == nullptr) return false;
+    size_t Pixels = size_t(Nx) * size_t(Ny);
+
+    //  The tolerance, from the largest magnitude in the image, and the weights' magnitudes
+    //  and number, as explained above.
+
+    double MaxAbs = 0.0;
+    for (size_t Index = 0; Index < Pixels; Index++) {
+        float Value = Details->InputData[Index];
+        if (!isnan(Value) && fabs(Value) > MaxAbs) MaxAbs = fabs(Value);
+    }
+    double Tolerance = C_RelTolerance * MaxAbs * sqrt(double(Kernel.Weights.size()));
+    TheDebugHandler.Logf("Checks","Tolerance %g, largest value %g",Tolerance,MaxAbs);
+
+    long Errors = CheckSample(Details->InputData,Output,Nx,Ny,Kernel,Tolerance);
+    if (Errors > 0) {
+        printf ("%ld of the %d pixels checked are in error\n",Errors,
+                                                 (C_SampleSteps + 1) * (C_SampleSteps + 1));
+    }
+
+    //  Compare with the other's results, if we have them. An image with blanks can have pixels
+    //  scaled up a lot to allow for the weights left out, so those are allowed the same
+    //  relative error of their value as well.
+
+    const float* Other = FromGPU ? Details->CPUOutputData : Details->GPUOutputData;
+    if (Other) {
+        long Differences = 0;
+        for (size_t Index = 0; Index < Pixels; Index++) {
+            float Value = Output[Index];
+            float OtherValue = Other[Index];
+            double Diff = fabs(double(Value) - double(OtherValue));
+            bool Match = (isnan(Value) && isnan(OtherValue)) || Diff <= Tolerance ||
+                        Diff <= C_RelTolerance * std::max(fabs(Value),fabs(OtherValue));
+            if (!Match) {
+                if (Differences++ < C_MaxErrorsListed) {
+                    printf ("GPU and CPU differ at [%d][%d], %g and %g\n",int(Index / Nx),
+                           int(Index % Nx),FromGPU ? Value : OtherValue,
+                                                               FromGPU ? OtherValue : Value);
+                }
+            }
+        }
+        if (Differences > 0) {
+            printf ("GPU and CPU results differ for %ld pixels\n",Differences);
+            Errors += Differences;
+        } else {
+            printf ("GPU and CPU results agree to within %g\n",Tolerance);
+        }
+    }
+
+    //  Keep a copy of the results.
+
+    float** Saved = FromGPU ? &Details->GPUOutputData : &Details->CPUOutputData;
+    if (*Saved == nullptr) *Saved = (float*)malloc(Pixels * sizeof(float));
+    if (*Saved) memcpy(*Saved,Output,Pixels * sizeof(float));
+    return (Errors == 0);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             W r i t e  F i t s  F i l e
+//
+//  Writes the result - the GPU's, if there is one, otherwise the CPU's - to the output file
+//  created by ReadFitsFile(), as Median's WriteFitsFile() does.
+
+bool WriteFitsFile(int Nx,int Ny,ConvolveDetails* Details)
+{
+
+#ifdef USE_CFITSIO
+
+    int Status = 0;
+    char Error[80];
+    fitsfile* Fptr = Details->Fptr;
+    float* OutputImage = Details->GPUOutputData;
+    if (OutputImage == nullptr) OutputImage = Details->CPUOutputData;
+    if (Fptr == nullptr) {
+        strncpy(Error,"No output file open",sizeof(Error));
+        Status = 1;
+    } else if (OutputImage == nullptr) {
+        strncpy (Error,"No output image calculated",sizeof(Error));
+        Status = 1;
+    } else {
+        long Fpixel = 1;
+        LONGLONG NPixels = LONGLONG(Nx) * LONGLONG(Ny);
+        if (fits_write_img(Fptr,TFLOAT,Fpixel,NPixels,OutputImage,&Status)) {
+            fits_get_errstatus (Status,Error);
+        }
+    }
+    int CloseStatus = 0;
+    if (Fptr && fits_close_file(Fptr,&CloseStatus)) {
+        if (Status == 0) fits_get_errstatus (CloseStatus,Error);
+    }
+    Details->Fptr = nullptr;
+    if (Status) printf ("Error writing to FITS file: %s\n",Error);
+    else printf("Output image written OK to %s\n",Details->OutputFileName.c_str());
+    return (Status == 0);
+
+#else
+
+    printf ("Cannot write a FITS file. Program was built without Cfitsio support\n");
+    return false;
+
+#endif
+
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                S h u t d o w n
+//
+//  Closes any output file still open - one that was never written - and releases the images.
+
+void Shutdown(ConvolveDetails* Details)
+{
+#ifdef USE_CFITSIO
+    if (Details->Fptr) {
+        int Status = 0;
+        fits_close_file(Details->Fptr,&Status);
+        Details->Fptr = nullptr;
+    }
+#endif
+    if (Details->InputData) KVVulkanFramework::FreeImportableMemory(Details->InputData);
+    if (Details->GPUOutputData) free(Details->GPUOutputData);
+    if (Details->CPUOutputData) free(Details->CPUOutputData);
+    Details->InputData = Details->GPUOutputData = Details->CPUOutputData = nullptr;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              E n d  O f  S t a r t u p
+//
+//  Called once the GPU is set up and ready to run. This marks the end of the start-up recorded
+//  by the StartupProfile and, with the 'Startup' debug level set, lists the stages recorded.
+
+void EndOfStartup(void)
+{
+    if (StartupProfile::Global().Finish()) StartupProfile::Global().Report();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              D e b u g  A r g  H e l p e r  ::  C h e c k  V a l i d i t y
+//
+//  Checks that all the levels given for 'Debug' are recognised either by TheDebugHandler or
+//  by the Vulkan Framework's own handler. See the Adder code for a fuller explanation.
+
+bool DebugArgHelper::CheckValidity(const std::string& Value,std::string* Reason)
+{
+    bool Valid = true;
+    std::string Unrecognised = TheDebugHandler.CheckLevels(Value);
+    if (Unrecognised != "") {
+        DebugHandler VulkanStandInHandler("Vulkan");
+        VulkanStandInHandler.LevelsList(KVVulkanFramework::GetDebugOptions());
+        Unrecognised = VulkanStandInHandler.CheckLevels(Unrecognised);
+    }
+    if (Unrecognised != "") {
+        *Reason = "'" + Unrecognised + "' not recognised";
+        Valid = false;
+    }
+    return Valid;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                D e b u g  A r g  H e l p e r  ::  H e l p  T e x t
+//
+//  Provides additional details about the available options for the Debug argument. The command
+//  line code uses this when the user responds to a prompt for the argument value with '?'
+
+std::string DebugArgHelper::HelpText(void)
+{
+    std::string Text = "";
+    Text += "Top level options: " + TheDebugHandler.ListLevels() + "\n" +
+            "Vulkan level options: " + KVVulkanFramework::GetDebugOptions() + "\n" +
+            "(Should be a comma-separated list of options. '*' acts as a wildcard).";
+    return Text;
+}
+
+//  ------------------------------------------------------------------------------------------------
+
+//                            P r o g r a m m i n g   N o t e s
+/*
+    o   The separable version does 2 * Size multiply-adds for each pixel rather than Size *
+        Size, but reads and writes the image twice, so for the smallest kernels the direct
+        version can be as fast. 'Direct' is there to find out where that changes over.
+
+    o   AddScaledRow() works along a whole row for each weight, rather than along the kernel
+        for each pixel, so every vector load and store is of neighbouring pixels, and there's
+        no horizontal sum at the end. The running sums for a row stay in the cache between
+        weights, and for the separable version so do the few temporary rows being summed.
+
+    o   The tolerance allows for the different orders in which the versions sum, and for the
+        GPU being free to fuse a multiply and an add where the CPU code doesn't. The square
+        root of the number of weights is the usual estimate for how rounding errors grow.
+*/
@@ -0,0 +1,264 @@
+//
+//                            H u g e  P a g e s . h
+//
+//  This lets the programs back their large CPU arrays with huge pages - 2 MBytes each on
+//  most Linux systems - rather than the usual 4 KBytes. An image of several hundred MBytes
+//  covers tens of thousands of ordinary pages, far more than the TLB can map at once, so a
+//  pass through it keeps missing in the TLB. With huge pages it's a few hundred.
+//
+//  Allocate() returns memory aligned to a 2 MByte boundary, its size rounded up to a
+//  multiple of 2 MBytes, and asks the system for huge pages for it:
+//
+//     Linux    First tries an explicit huge page mapping (MAP_HUGETLB), which only works if
+//              the system has huge pages reserved for it (vm.nr_hugepages). Failing that, it
+//              maps ordinary memory and asks for transparent huge pages with madvise(). The
+//              kernel may or may not grant these, depending on its settings and on how much
+//              contiguous memory it can find when the pages are first written.
+//     Windows  Tries large pages (MEM_LARGE_PAGES). These need the 'Lock pages in memory'
+//              privilege, which Allocate() enables if the account has been given it. Failing
+//              that, it uses ordinary pages.
+//     MacOS    Has no way of asking for them, so the memory is ordinary pages.
+//
+//  Since the system can quietly decline, GrantedBytes() and Describe() say how much of an
+//  allocation actually ended up in huge pages, for the programs to report. The alignment is
+//  also enough for ImportBuffer() in the Vulkan Framework, so the same memory can be used by
+//  the GPU as an "IMPORTED" buffer. Free() releases it.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __HugePages__
+#define __HugePages__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+class HugePages
+{
+public:
+    //  Allocates memory for at least Bytes, in huge pages if the system will provide them.
+    //  Returns nullptr if the memory couldn't be allocated at all.
+    static void* Allocate(size_t Bytes) {
+        if (Bytes == 0) return nullptr;
+        size_t Rounded = RoundUp(Bytes,C_HugePageBytes);
+        void* Address = nullptr;
+        Kind Type = Ordinary;
+#if defined(_WIN32)
+        SIZE_T LargeBytes = GetLargePageMinimum();
+        if (LargeBytes > 0 && EnableLockMemory()) {
+            size_t LargeRounded = RoundUp(Bytes,size_t(LargeBytes));
+            Address = VirtualAlloc(nullptr,LargeRounded,
+                                  MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,PAGE_READWRITE);
+            if (Address) {
+                Rounded = LargeRounded;
+                Type = Explicit;
+            }
+        }
+        if (Address == nullptr) {
+            Address = VirtualAlloc(nullptr,Rounded,MEM_RESERVE | MEM_COMMIT,PAGE_READWRITE);
+        }
+        if (Address == nullptr) return nullptr;
+#else
+#ifdef MAP_HUGETLB
+        void* Map = mmap(nullptr,Rounded,PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+        if (Map != MAP_FAILED) {
+            Address = Map;
+            Type = Explicit;
+        }
+#endif
+        if (Address == nullptr) Address = MapAligned(Rounded,&Type);
+        if (Address == nullptr) return nullptr;
+#endif
+        std::lock_guard<std::mutex> Lock(Mutex());
+        Blocks()[Address] = {Bytes,Rounded,Type};
+        return Address;
+    }
+    //  Releases memory from Allocate(). Returns false, doing nothing, for any other address,
+    //  so a caller can pass on memory that came from somewhere else. Nullptr is ignored.
+    static bool Free(void* Address) {
+        if (Address == nullptr) return false;
+        Block Details;
+        {
+            std::lock_guard<std::mutex> Lock(Mutex());
+            auto Entry = Blocks().find(Address);
+            if (Entry == Blocks().end()) return false;
+            Details = Entry->second;
+            Blocks().erase(Entry);
+        }
+#if defined(_WIN32)
+        VirtualFree(Address,0,MEM_RELEASE);
+#else
+        munmap(Address,Details.Rounded);
+#endif
+        return true;
+    }
+    //  Returns the number of bytes of an allocation that are in huge pages. Transparent huge
+    //  pages are only given to memory when it's first written, so this should be called once
+    //  the memory has been initialised.
+    static size_t GrantedBytes(void* Address) {
+        Block Details;
+        if (!Find(Address,&Details)) return 0;
+        if (Details.Type == Explicit) return Details.Bytes;
+        if (Details.Type != Transparent) return 0;
+        uintptr_t Start = uintptr_t(Address);
+        size_t Granted = TransparentBytes(Start,Start + Details.Rounded);
+        return (Granted < Details.Bytes) ? Granted : Details.Bytes;
+    }
+    //  Returns a description of an allocation and how much of it is in huge pages, for a
+    //  program to report, eg "512.0 MBytes, 100% in transparent huge pages".
+    static std::string Describe(void* Address) {
+        Block Details;
+        if (!Find(Address,&Details)) return "not allocated by HugePages";
+        double MBytes = double(Details.Bytes) / (1024.0 * 1024.0);
+        size_t Granted = GrantedBytes(Address);
+        const char* What = (Details.Type == Explicit) ? "explicit huge pages" :
+                                                                   "transparent huge pages";
+        char Text[128];
+        if (Granted == 0) {
+            snprintf(Text,sizeof(Text),"%.1f MBytes, not in huge pages (%s)",MBytes,
+                   Details.Type == Ordinary ? "none available" : "the system declined them");
+        } else {
+            snprintf(Text,sizeof(Text),"%.1f MBytes, %d%% in %s",MBytes,
+                                  int((100.0 * double(Granted)) / double(Details.Bytes)),What);
+        }
+        return Text;
+    }
+private:
+    //  How the memory was allocated - ordinary pages, huge pages allocated as such, or ordinary
+    //  memory that has been marked as a candidate for transparent huge pages.
+    enum Kind { Ordinary, Explicit, Transparent };
+    //  The details of each allocation: the size asked for, the size allocated, and how.
+    struct Block {
+        size_t Bytes;
+        size_t Rounded;
+        Kind Type;
+    };
+    static const size_t C_HugePageBytes = 2 * 1024 * 1024;
+    static size_t RoundUp(size_t Bytes,size_t Unit) {
+        return ((Bytes + Unit - 1) / Unit) * Unit;
+    }
+    //  The allocations made, and the mutex that protects them, as function statics so this
+    //  can stay a header.
+    static std::mutex& Mutex(void) {
+        static std::mutex TheMutex;
+        return TheMutex;
+    }
+    static std::map<void*,Block>& Blocks(void) {
+        static std::map<void*,Block> TheBlocks;
+        return TheBlocks;
+    }
+    static bool Find(void* Address,Block* Details) {
+        std::lock_guard<std::mutex> Lock(Mutex());
+        auto Entry = Blocks().find(Address);
+        if (Entry == Blocks().end()) return false;
+        *Details = Entry->second;
+        return true;
+    }
+#if defined(_WIN32)
+    //  Large pages need the 'Lock pages in memory' privilege to be enabled for the process,
+    //  which it can only do if the account has been given it. This is only tried once.
+    static bool EnableLockMemory(void) {
+        static int Enabled = -1;
+        if (Enabled < 0) {
+            Enabled = 0;
+            HANDLE Token;
+            if (OpenProcessToken(GetCurrentProcess(),TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY,
+                                                                                     &Token)) {
+                TOKEN_PRIVILEGES Privileges;
+                Privileges.PrivilegeCount = 1;
+                Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+                if (LookupPrivilegeValue(nullptr,SE_LOCK_MEMORY_NAME,
+                                                            &Privileges.Privileges[0].Luid) &&
+                        AdjustTokenPrivileges(Token,FALSE,&Privileges,0,nullptr,nullptr) &&
+                                                        GetLastError() == ERROR_SUCCESS) {
+                    Enabled = 1;
+                }
+                CloseHandle(Token);
+            }
+        }
+        return Enabled == 1;
+    }
+    static size_t TransparentBytes(uintptr_t,uintptr_t) { return 0; }
+#else
+    //  Maps ordinary memory on a huge page boundary, by mapping an extra huge page's worth
+    //  and unmapping what's either side of the boundary, then - where the system has them -
+    //  asks for transparent huge pages for it.
+    static void* MapAligned(size_t Rounded,Kind* Type) {
+        size_t Span = Rounded + C_HugePageBytes;
+        void* Map = mmap(nullptr,Span,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if (Map == MAP_FAILED) return nullptr;
+        char* Base = (char*)Map;
+        char* Start = (char*)((uintptr_t(Base) + C_HugePageBytes - 1) &
+                                                                ~uintptr_t(C_HugePageBytes - 1));
+        if (Start > Base) munmap(Base,size_t(Start - Base));
+        size_t Tail = size_t((Base + Span) - (Start + Rounded));
+        if (Tail > 0) munmap(Start + Rounded,Tail);
+        *Type = Ordinary;
+#ifdef MADV_HUGEPAGE
+        if (madvise(Start,Rounded,MADV_HUGEPAGE) == 0) *Type = Transparent;
+#endif
+        return Start;
+    }
+    //  Adds up the 'AnonHugePages' for the mappings that overlap a range of addresses, as
+    //  listed in /proc/self/smaps. A mapping that also covers memory outside the range is
+    //  only counted up to the size of its overlap.
+    static size_t TransparentBytes(uintptr_t Start,uintptr_t End) {
+        size_t Total = 0;
+        FILE* Smaps = fopen("/proc/self/smaps","r");
+        if (Smaps == nullptr) return 0;
+        char Line[512];
+        size_t Overlap = 0;
+        while (fgets(Line,sizeof(Line),Smaps)) {
+            unsigned long long From = 0;
+            unsigned long long To = 0;
+            unsigned long long KBytes = 0;
+            if (sscanf(Line,"%llx-%llx ",&From,&To) == 2) {
+                uintptr_t Low = (uintptr_t(From) > Start) ? uintptr_t(From) : Start;
+                uintptr_t High = (uintptr_t(To) < End) ? uintptr_t(To) : End;
+                Overlap = (High > Low) ? size_t(High - Low) : 0;
+            } else if (Overlap > 0 && sscanf(Line,"AnonHugePages: %llu kB",&KBytes) == 1) {
+                size_t Bytes = size_t(KBytes) * 1024;
+                Total += (Bytes < Overlap) ? Bytes : Overlap;
+            }
+        }
+        fclose(Smaps);
+        return Total;
+    }
+#endif
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   Transparent huge pages depend on the kernel setting in
+        /sys/kernel/mm/transparent_hugepage/enabled. With "always" every large mapping is a
+        candidate anyway, with "madvise" only those marked by madvise() are, and with "never"
+        none are - though madvise() still succeeds. So Describe() is the only way to know.
+
+    o   The huge pages for a transparent mapping are allocated as the memory is first
+        written, and on a machine with more than one NUMA node they go on the node of the
+        thread that writes them, just as ordinary pages do. So first-touch placement by the
+        threads that will use the memory works the same way. Each huge page is 512 ordinary
+        pages, though, so a band of rows should be a good many MBytes for that to matter.
+
+    o   Explicit huge pages are taken from a pool reserved in advance, eg with
+        'sysctl vm.nr_hugepages=512', and aren't swapped. If the pool is too small the
+        mapping fails, and Allocate() falls back on transparent huge pages.
+
+    o   Allocate() rounds the size up to a whole number of huge pages, so it's only worth
+        using for arrays of many MBytes. The programs use it only when asked to.
+*/
@@ -0,0 +1,495 @@
+//
+//                           I m a g e  G r a p h . c p p
+//
+//  The implementation of the ImageGraph class, which runs a chain of image processing
+//  operations on the GPU, keeping the intermediate images there. See ImageGraph.h.
+//
+//  15th Oct 2026. First version. KS.
+//                 Buffer sizes are now VkDeviceSize, so large images don't overflow. KS.
+//                 The intermediate buffers are now created as transient buffers by the
+//                 Framework, which shares their memory, rather than shared out here. KS.
+
+#include "ImageGraph.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+//  The workgroup shape used for all the nodes.
+
+static const uint32_t C_GraphWorkGroupSize = 16;
+
+//  Median.comp has fixed size code for boxes up to 11 by 11 (see BoxNpix() in MedianVulkan.cpp).
+
+static const int C_MaxFixedNpix = 11;
+
+//  The bindings used by the shaders. The uniform buffer is only used by Median.comp, and the
+//  second input - the weights for a convolution - only by the others.
+
+static const long C_UniformBinding = 0;
+static const long C_InputBinding = 1;
+static const long C_OutputBinding = 2;
+static const long C_SecondBinding = 3;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               C o n s t r u c t o r
+
+ImageGraph::ImageGraph(KVVulkanFramework& Framework)
+{
+    I_Framework = &Framework;
+    I_Output = C_NoImage;
+    I_Built = false;
+    I_Nx = 0;
+    I_Ny = 0;
+    I_Error = "";
+    I_InputHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    I_OutputHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    I_OutputAddr = nullptr;
+    I_TransientBytes = 0;
+    I_MedianLayout = VK_NULL_HANDLE;
+    I_OtherLayout = VK_NULL_HANDLE;
+    I_OpsPipelineLayout = VK_NULL_HANDLE;
+    I_OpsPipeline = VK_NULL_HANDLE;
+    I_ConvolvePipelineLayout = VK_NULL_HANDLE;
+    I_ConvolvePipeline = VK_NULL_HANDLE;
+    I_Queue = VK_NULL_HANDLE;
+    I_CommandPool = VK_NULL_HANDLE;
+    I_CommandBuffer = VK_NULL_HANDLE;
+    I_KernelMsec = 0.0;
+    I_KernelTimed = false;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 N o d e s
+//
+//  Each of these fills in the details of a node and has AddNode() check and add it. They
+//  return the image the node produces, or C_NoImage if it can't be added.
+
+ImageGraph::Image ImageGraph::Median(Image In,int Npix)
+{
+    if (Npix < 1 || Npix > C_MaxMedianNpix || (Npix % 2) == 0) {
+        I_Error = "Median box size " + std::to_string(Npix) + " should be an odd number from 1 to "
+                                                              + std::to_string(C_MaxMedianNpix);
+        return C_NoImage;
+    }
+    Node NewNode{};
+    NewNode.Type = NODE_MEDIAN;
+    NewNode.InputA = In;
+    NewNode.InputB = C_NoImage;
+    NewNode.Npix = Npix;
+    return AddNode(NewNode);
+}
+
+ImageGraph::Image ImageGraph::Convolve(Image In,const std::vector<float>& Weights,int Size)
+{
+    if (Size < 1 || Size > C_MaxConvolveSize || (Size % 2) == 0 ||
+                                                       Weights.size() != size_t(Size * Size)) {
+        I_Error = "Convolution size " + std::to_string(Size) + " should be an odd number from 1 "
+                                  "to " + std::to_string(C_MaxConvolveSize) + ", with " +
+                                  std::to_string(Size * Size) + " weights";
+        return C_NoImage;
+    }
+    Node NewNode{};
+    NewNode.Type = NODE_CONVOLVE;
+    NewNode.InputA = In;
+    NewNode.InputB = C_NoImage;
+    NewNode.Npix = Size;
+    NewNode.Weights = Weights;
+    for (float Weight : Weights) NewNode.Conv.WeightTotal = NewNode.Conv.WeightTotal + Weight;
+    return AddNode(NewNode);
+}
+
+ImageGraph::Image ImageGraph::Combine(Image A,float ScaleA,Image B,float ScaleB,float Offset)
+{
+    Node NewNode{};
+    NewNode.Type = NODE_COMBINE;
+    NewNode.InputA = A;
+    NewNode.InputB = B;
+    NewNode.ScaleA = ScaleA;
+    NewNode.ScaleB = (B == C_NoImage) ? 0.0 : ScaleB;
+    NewNode.Offset = Offset;
+    return AddNode(NewNode);
+}
+
+ImageGraph::Image ImageGraph::AddNode(const Node& NewNode)
+{
+    Image Next = Image(I_Nodes.size()) + 1;
+    if (I_Built) {
+        I_Error = "Nodes can't be added to a graph once it has been built";
+        return C_NoImage;
+    }
+    if (NewNode.InputA < 0 || NewNode.InputA >= Next ||
+                              NewNode.InputB < C_NoImage || NewNode.InputB >= Next) {
+        I_Error = "Node input is not an image already in the graph";
+        return C_NoImage;
+    }
+    I_Nodes.push_back(NewNode);
+    I_Nodes.back().Live = false;
+    I_Nodes.back().LastUse = -1;
+    I_Nodes.back().Buffer = -1;
+    I_Nodes.back().ArgsHndl = KVVulkanFramework::KV_NULL_HANDLE;
+    I_Nodes.back().DescriptorSet = VK_NULL_HANDLE;
+    return Next;
+}
+
+//  SetOutput() also works out which nodes the output depends on, working back from it, and
+//  notes for each of those the last of them to use its output.
+
+void ImageGraph::SetOutput(Image Out)
+{
+    if (I_Built) return;
+    I_Output = Out;
+    for (Node& TheNode : I_Nodes) {
+        TheNode.Live = false;
+        TheNode.LastUse = -1;
+    }
+    if (Out < 1 || Out > Image(I_Nodes.size())) return;
+    I_Nodes[Out - 1].Live = true;
+    for (int Index = Out - 1; Index >= 0; Index--) {
+        Node& TheNode = I_Nodes[Index];
+        if (!TheNode.Live) continue;
+        for (Image In : {TheNode.InputA,TheNode.InputB}) {
+            if (In < 1) continue;
+            Node& Producer = I_Nodes[In - 1];
+            Producer.Live = true;
+            Producer.LastUse = std::max(Producer.LastUse,Index);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                   B u i l d
+//
+//  Works out when each intermediate image is needed, creates the buffers, the descriptor sets
+//  and the pipelines, and sets up the list of dispatches that Run() records.
+
+void ImageGraph::Build(int Nx,int Ny,bool Blanks,KVVulkanFramework::KVBufferHandle InputHndl,
+                                                                               bool& StatusOK)
+{
+    if (!StatusOK) return;
+    if (I_Built) {
+        I_Error = "Graph has already been built";
+        StatusOK = false;
+        return;
+    }
+    int NumberNodes = int(I_Nodes.size());
+    if (I_Output < 1 || I_Output > NumberNodes) {
+        I_Error = "Graph output is not the result of one of its nodes";
+        StatusOK = false;
+        return;
+    }
+    SetOutput(I_Output);
+    I_Nx = Nx;
+    I_Ny = Ny;
+    I_InputHndl = InputHndl;
+    int OutputNode = I_Output - 1;
+
+    //  Give each node a buffer for its output, except the output node, which writes the
+    //  output buffer. Each is needed from the node that writes it to the last node that reads
+    //  it, and the Framework shares the memory of buffers not needed at the same time. A node's
+    //  inputs are still needed when it runs, so a node never writes a buffer it reads.
+
+    VkDeviceSize Bytes = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    std::vector<KVVulkanFramework::KVTransientBuffer> Transients;
+    for (int Index = 0; Index < OutputNode; Index++) {
+        Node& TheNode = I_Nodes[Index];
+        if (!TheNode.Live) continue;
+        TheNode.Buffer = int(I_Buffers.size());
+        KVVulkanFramework::KVBufferHandle Hndl =
+                   I_Framework->SetBufferDetails(C_OutputBinding,"STORAGE","LOCAL",StatusOK);
+        I_Buffers.push_back(Hndl);
+        Transients.push_back({Hndl,Bytes,Index,std::max(TheNode.LastUse,Index)});
+    }
+    I_TransientBytes = I_Framework->CreateTransientBuffers(Transients,StatusOK);
+    I_OutputHndl = I_Framework->SetBufferDetails(C_OutputBinding,"STORAGE","READBACK",StatusOK);
+    I_Framework->CreateBuffer(I_OutputHndl,Bytes,StatusOK);
+    VkDeviceSize MappedBytes = 0;
+    I_OutputAddr = (float*)I_Framework->MapBuffer(I_OutputHndl,&MappedBytes,StatusOK);
+
+    //  The two descriptor set layouts are created from handles that are never given any
+    //  memory, with the types and bindings the shaders expect.
+
+    I_MedianLayoutHndls.push_back(
+               I_Framework->SetBufferDetails(C_UniformBinding,"UNIFORM","SHARED",StatusOK));
+    I_MedianLayoutHndls.push_back(
+               I_Framework->SetBufferDetails(C_InputBinding,"STORAGE","LOCAL",StatusOK));
+    I_MedianLayoutHndls.push_back(
+               I_Framework->SetBufferDetails(C_OutputBinding,"STORAGE","LOCAL",StatusOK));
+    I_OtherLayoutHndls.push_back(I_MedianLayoutHndls[1]);
+    I_OtherLayoutHndls.push_back(I_MedianLayoutHndls[2]);
+    I_OtherLayoutHndls.push_back(
+               I_Framework->SetBufferDetails(C_SecondBinding,"STORAGE","LOCAL",StatusOK));
+    I_Framework->CreateVulkanDescriptorSetLayout(I_MedianLayoutHndls,&I_MedianLayout,StatusOK);
+    I_Framework->CreateVulkanDescriptorSetLayout(I_OtherLayoutHndls,&I_OtherLayout,StatusOK);
+
+    //  Now the arguments, descriptor set, pipeline and dispatch for each node. The median
+    //  nodes have their arguments in a uniform buffer, laid out as MedianArgs in Median.comp,
+    //  for the whole image - firstRow and inputFirstRow zero, and rows equal to Ny. The
+    //  convolutions have their weights in a storage buffer.
+
+    uint32_t WorkGroupCounts[3];
+    WorkGroupCounts[0] = (uint32_t(Nx) + C_GraphWorkGroupSize - 1) / C_GraphWorkGroupSize;
+    WorkGroupCounts[1] = (uint32_t(Ny) + C_GraphWorkGroupSize - 1) / C_GraphWorkGroupSize;
+    WorkGroupCounts[2] = 1;
+    std::vector<uint32_t> SpecConstants = {C_GraphWorkGroupSize,C_GraphWorkGroupSize};
+    for (int Index = 0; Index <= OutputNode && StatusOK; Index++) {
+        Node& TheNode = I_Nodes[Index];
+        if (!TheNode.Live) continue;
+        KVVulkanFramework::KVBufferHandle InHndl = BufferFor(TheNode.InputA);
+        KVVulkanFramework::KVBufferHandle OutHndl = BufferFor(Index + 1);
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+        std::vector<long> Bindings;
+        std::vector<KVVulkanFramework::KVBufferHandle>* LayoutHndls = &I_OtherLayoutHndls;
+        VkDescriptorSetLayout Layout = I_OtherLayout;
+        KVVulkanFramework::KVDispatch Dispatch{};
+        if (TheNode.Type == NODE_MEDIAN) {
+            int MedianArgs[8] = {Nx,Ny,TheNode.Npix,0,Ny,0,Blanks ? 1 : 0,0};
+            TheNode.ArgsHndl = I_Framework->SetBufferDetails(C_UniformBinding,"UNIFORM",
+                                                                           "SHARED",StatusOK);
+            I_Framework->CreateBuffer(TheNode.ArgsHndl,sizeof(MedianArgs),StatusOK);
+            void* Addr = I_Framework->MapBuffer(TheNode.ArgsHndl,&MappedBytes,StatusOK);
+            if (StatusOK && Addr) memcpy(Addr,MedianArgs,sizeof(MedianArgs));
+            Handles = {TheNode.ArgsHndl,InHndl,OutHndl};
+            Bindings = {C_UniformBinding,C_InputBinding,C_OutputBinding};
+            LayoutHndls = &I_MedianLayoutHndls;
+            Layout = I_MedianLayout;
+            MedianPipeline(TheNode.Npix,&Dispatch.PipelineLayoutHndl,&Dispatch.PipelineHndl,
+                                                                                    StatusOK);
+        } else if (TheNode.Type == NODE_CONVOLVE) {
+            long WeightBytes = long(TheNode.Weights.size() * sizeof(float));
+            TheNode.ArgsHndl = I_Framework->SetBufferDetails(C_SecondBinding,"STORAGE",
+                                                                           "SHARED",StatusOK);
+            I_Framework->CreateBuffer(TheNode.ArgsHndl,WeightBytes,StatusOK);
+            void* Addr = I_Framework->MapBuffer(TheNode.ArgsHndl,&MappedBytes,StatusOK);
+            if (StatusOK && Addr) memcpy(Addr,TheNode.Weights.data(),WeightBytes);
+            TheNode.Conv.Nx = Nx;
+            TheNode.Conv.Ny = Ny;
+            TheNode.Conv.Size = TheNode.Npix;
+            Handles = {InHndl,OutHndl,TheNode.ArgsHndl};
+            Bindings = {C_InputBinding,C_OutputBinding,C_SecondBinding};
+            if (I_ConvolvePipeline == VK_NULL_HANDLE) {
+                I_Framework->CreateComputePipeline("Convolve.spv","main",&I_OtherLayout,
+                                    &I_ConvolvePipelineLayout,&I_ConvolvePipeline,SpecConstants,
+                                                   uint32_t(sizeof(ConvolveArgs)),StatusOK);
+            }
+            Dispatch.PipelineLayoutHndl = I_ConvolvePipelineLayout;
+            Dispatch.PipelineHndl = I_ConvolvePipeline;
+            Dispatch.PushConstants = &TheNode.Conv;
+            Dispatch.PushConstantSize = uint32_t(sizeof(ConvolveArgs));
+        } else {
+
+            //  With no second input, the first is bound in its place, but never read.
+
+            bool HasB = (TheNode.InputB != C_NoImage);
+            TheNode.Ops = {Nx,Ny,TheNode.ScaleA,TheNode.ScaleB,TheNode.Offset,HasB ? 1 : 0};
+            Handles = {InHndl,OutHndl,BufferFor(HasB ? TheNode.InputB : TheNode.InputA)};
+            Bindings = {C_InputBinding,C_OutputBinding,C_SecondBinding};
+            if (I_OpsPipeline == VK_NULL_HANDLE) {
+                I_Framework->CreateComputePipeline("ImageOps.spv","main",&I_OtherLayout,
+                                    &I_OpsPipelineLayout,&I_OpsPipeline,SpecConstants,
+                                                        uint32_t(sizeof(OpsArgs)),StatusOK);
+            }
+            Dispatch.PipelineLayoutHndl = I_OpsPipelineLayout;
+            Dispatch.PipelineHndl = I_OpsPipeline;
+            Dispatch.PushConstants = &TheNode.Ops;
+            Dispatch.PushConstantSize = uint32_t(sizeof(OpsArgs));
+        }
+        VkDescriptorPool Pool;
+        I_Framework->CreateVulkanDescriptorPool(*LayoutHndls,1,&Pool,StatusOK);
+        I_Framework->AllocateVulkanDescriptorSet(Layout,Pool,&TheNode.DescriptorSet,StatusOK);
+        I_Framework->SetupVulkanDescriptorSet(Handles,Bindings,TheNode.DescriptorSet,StatusOK);
+        Dispatch.DescriptorSetHndl = TheNode.DescriptorSet;
+        for (int Dim = 0; Dim < 3; Dim++) Dispatch.WorkGroupCounts[Dim] = WorkGroupCounts[Dim];
+        I_Dispatches.push_back(Dispatch);
+    }
+
+    //  And the queue and command buffer. The command buffer is reusable, so it's only recorded
+    //  the first time Run() is called.
+
+    I_Framework->GetDeviceQueue(&I_Queue,StatusOK);
+    I_Framework->CreateCommandPool(&I_CommandPool,StatusOK);
+    I_Framework->CreateComputeCommandBuffer(I_CommandPool,&I_CommandBuffer,StatusOK);
+    I_Framework->SetCommandBufferReusable(I_CommandBuffer,true,StatusOK);
+    if (!StatusOK && I_Error == "") I_Error = "Unable to create the GPU resources for the graph";
+    I_Built = StatusOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               M e d i a n  P i p e l i n e
+//
+//  Median.comp's specialization constant 2 is the box size, for the sizes it has fixed size
+//  code for, and zero otherwise, so there is a pipeline for each of those sizes used, and one
+//  for all the larger ones.
+
+void ImageGraph::MedianPipeline(int Npix,VkPipelineLayout* Layout,VkPipeline* Pipeline,
+                                                                              bool& StatusOK)
+{
+    if (!StatusOK) return;
+    int BoxNpix = (Npix <= C_MaxFixedNpix) ? Npix : 0;
+    auto Iter = I_MedianPipelines.find(BoxNpix);
+    if (Iter == I_MedianPipelines.end()) {
+        std::vector<uint32_t> SpecConstants =
+                              {C_GraphWorkGroupSize,C_GraphWorkGroupSize,uint32_t(BoxNpix)};
+        VkPipelineLayout NewLayout = VK_NULL_HANDLE;
+        VkPipeline NewPipeline = VK_NULL_HANDLE;
+        I_Framework->CreateComputePipeline("Median.spv","main",&I_MedianLayout,&NewLayout,
+                                                          &NewPipeline,SpecConstants,StatusOK);
+        if (!StatusOK) return;
+        Iter = I_MedianPipelines.insert({BoxNpix,{NewLayout,NewPipeline}}).first;
+    }
+    *Layout = Iter->second.first;
+    *Pipeline = Iter->second.second;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                B u f f e r  F o r
+//
+//  Returns the buffer holding an image: the input buffer for the input image, the output
+//  buffer for the output, and otherwise the transient buffer created for the node that
+//  produced it.
+
+KVVulkanFramework::KVBufferHandle ImageGraph::BufferFor(Image Img) const
+{
+    if (Img == 0) return I_InputHndl;
+    if (Img == I_Output) return I_OutputHndl;
+    int Buffer = I_Nodes[Img - 1].Buffer;
+    return (Buffer >= 0) ? I_Buffers[Buffer] : KVVulkanFramework::KV_NULL_HANDLE;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    R u n
+//
+//  Runs all the dispatches in the one command buffer. If the input buffer is staged, it is
+//  synchronised first, and the output buffer is synchronised after. Only the output buffer
+//  needs to be made visible to the CPU.
+
+void ImageGraph::Run(bool& StatusOK)
+{
+    if (!StatusOK) return;
+    if (!I_Built) {
+        I_Error = "Graph has not been built";
+        StatusOK = false;
+        return;
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {I_InputHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {I_OutputHndl};
+    I_Framework->RecordComputeBatch(I_CommandBuffer,I_Dispatches,SyncBefore,SyncAfter,StatusOK);
+    I_Framework->RunCommandBuffer(I_Queue,I_CommandBuffer,StatusOK);
+    I_Framework->InvalidateBuffer(I_OutputHndl,StatusOK);
+    I_KernelTimed = I_Framework->GetDispatchTimes(nullptr,&I_KernelMsec,nullptr,StatusOK);
+}
+
+bool ImageGraph::GetKernelMsec(float* Msec) const
+{
+    if (I_KernelTimed) *Msec = I_KernelMsec;
+    return I_KernelTimed;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               D e s c r i p t i o n
+
+std::string ImageGraph::Description(void) const
+{
+    const char* Names[] = {"median","convolve","combine"};
+    std::string Text = "";
+    int Run = 0;
+    for (const Node& TheNode : I_Nodes) {
+        if (!TheNode.Live) continue;
+        if (Run++ > 0) Text += ", ";
+        Text += Names[TheNode.Type];
+        if (TheNode.Type != NODE_COMBINE) Text += " " + std::to_string(TheNode.Npix);
+    }
+    char Summary[160];
+    snprintf (Summary,sizeof(Summary),
+                     " - %d node(s) of %d run, %d intermediate buffer(s) sharing %.1f MBytes",
+                     Run,int(I_Nodes.size()),int(I_Buffers.size()),
+                                                    double(I_TransientBytes) / (1024.0 * 1024.0));
+    return Text + Summary;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 E v a l u a t e
+//
+//  Runs the graph on the CPU. This is only for checking the GPU results, so it just keeps
+//  each image it needs in its own array, but it does leave out the nodes the output doesn't
+//  need, which SetOutput() has marked. The median filter is left to the routine passed. This
+//  doesn't need the graph to have been built, so can be used without a GPU.
+
+void ImageGraph::Evaluate(const float* Input,float* Output,int Nx,int Ny,bool Blanks,
+                                                             const MedianFilter& Filter) const
+{
+    if (I_Output < 1 || I_Output > Image(I_Nodes.size())) return;
+    size_t Elements = size_t(Nx) * size_t(Ny);
+    std::vector<std::vector<float>> Images(I_Nodes.size() + 1);
+    auto ImageData = [&](Image Img) -> const float* {
+        return (Img == 0) ? Input : (Img > 0 ? Images[Img].data() : nullptr);
+    };
+    for (int Index = 0; Index < I_Output; Index++) {
+        const Node& TheNode = I_Nodes[Index];
+        if (!TheNode.Live) continue;
+        Images[Index + 1].resize(Elements);
+        float* Out = Images[Index + 1].data();
+        if (TheNode.Type == NODE_MEDIAN) {
+            Filter(ImageData(TheNode.InputA),Out,Nx,Ny,TheNode.Npix,Blanks);
+        } else {
+            EvaluateNode(TheNode,ImageData(TheNode.InputA),ImageData(TheNode.InputB),Out,Nx,Ny);
+        }
+    }
+    memcpy(Output,Images[I_Output].data(),Elements * sizeof(float));
+}
+
+//  EvaluateNode() does the same for a convolution or a combination as Convolve.comp and
+//  ImageOps.comp, with the arithmetic in the same order, so that the results are the same.
+
+void ImageGraph::EvaluateNode(const Node& TheNode,const float* A,const float* B,float* Out,
+                                                                          int Nx,int Ny) const
+{
+    if (TheNode.Type == NODE_COMBINE) {
+        size_t Elements = size_t(Nx) * size_t(Ny);
+        for (size_t Index = 0; Index < Elements; Index++) {
+            float Value = A[Index] * TheNode.ScaleA;
+            if (B) Value = Value + B[Index] * TheNode.ScaleB;
+            Out[Index] = Value + TheNode.Offset;
+        }
+        return;
+    }
+    int Size = TheNode.Npix;
+    int Halo = Size / 2;
+    const float* Weights = TheNode.Weights.data();
+    float Total = TheNode.Conv.WeightTotal;
+    for (int Iy = 0; Iy < Ny; Iy++) {
+        for (int Ix = 0; Ix < Nx; Ix++) {
+            float Sum = 0.0;
+            float Used = 0.0;
+            int Valid = 0;
+            int BlankCount = 0;
+            for (int Ky = 0; Ky < Size; Ky++) {
+                int Jy = std::min(std::max(Iy + Ky - Halo,0),Ny - 1);
+                for (int Kx = 0; Kx < Size; Kx++) {
+                    int Jx = std::min(std::max(Ix + Kx - Halo,0),Nx - 1);
+                    float Value = A[size_t(Jy) * size_t(Nx) + Jx];
+                    float Weight = Weights[Ky * Size + Kx];
+                    if (Value != Value) {
+                        BlankCount++;
+                    } else {
+                        Sum = Sum + Weight * Value;
+                        Used = Used + Weight;
+                        Valid++;
+                    }
+                }
+            }
+            if (Valid == 0) Sum = NAN;
+            else if (BlankCount > 0) Sum = Sum * (Total / Used);
+            Out[size_t(Iy) * size_t(Nx) + Ix] = Sum;
+        }
+    }
+}
@@ -0,0 +1,203 @@
+//
+//                             I m a g e  G r a p h . h
+//
+//  An ImageGraph runs a chain of image processing operations on the GPU - median filters,
+//  convolutions and element-wise arithmetic - keeping all the intermediate images on the GPU,
+//  so that only the final result is read back. A typical reduction, such as subtracting a
+//  bias level, estimating the background with a large median filter, subtracting that, and
+//  scaling the result, would otherwise need the image read back to the CPU and loaded into
+//  the GPU again for each step. Here all the steps are recorded into one command buffer, with
+//  a barrier between each, and submitted together.
+//
+//  The graph is described by calling the node routines, each of which is given the images it
+//  uses and returns the image it produces. Input() is the image the graph is given, and
+//  SetOutput() says which image is the result. For example:
+//
+//     ImageGraph Graph(Framework);
+//     ImageGraph::Image Image = Graph.Offset(Graph.Input(),-Bias);
+//     Image = Graph.Subtract(Image,Graph.Median(Image,31));
+//     Graph.SetOutput(Graph.Scale(Image,Gain));
+//     Graph.Build(Nx,Ny,Blanks,InputHndl,StatusOK);
+//     Graph.Run(StatusOK);
+//     float* Result = Graph.Output();
+//
+//  Since an image can only be used by nodes created after the one that produced it, the nodes
+//  are always in an order in which they can be run. SetOutput() picks out the nodes the output
+//  depends on - the others are left out - and works out, for each intermediate image, which
+//  is the last node to use it. Each intermediate image has its own GPU buffer, created by
+//  the Framework's CreateTransientBuffers() as needed from the node that writes it to the last
+//  node that reads it, and the Framework binds buffers not needed at the same time to the same
+//  memory, so a long chain only needs the memory for a few images. (A node's output is never
+//  bound to the same memory as one of its own inputs, as both are needed while it runs.) Each
+//  node's descriptor set gives the bindings explicitly, using the Framework's version of
+//  SetupVulkanDescriptorSet() that takes them. The intermediate buffers are "LOCAL", so they
+//  never need to be visible to the CPU, and the output buffer is "READBACK".
+//
+//  The median nodes use Median.spv, exactly as ComputeUsingGPU() does in MedianVulkan.cpp,
+//  each with its own uniform buffer giving the image and box sizes. The convolution nodes use
+//  Convolve.spv and the element-wise nodes ImageOps.spv, both of which take their arguments
+//  as push constants.
+//
+//  Evaluate() runs the same graph on the CPU, for checking the GPU results. It is given a
+//  routine that applies a median filter, so it can use the same CPU code as the rest of the
+//  program. It doesn't need Build() to have been called, so the Framework passed to the
+//  constructor need not have been set up if the graph is only to be run on the CPU.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __ImageGraph__
+#define __ImageGraph__
+
+#include "KVVulkanFramework.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class ImageGraph
+{
+public:
+    //  An image in the graph. These are just numbers - 0 is the input image, and each node
+    //  produces the next.
+    typedef int Image;
+    //  Used for a node with no second input.
+    static const Image C_NoImage = -1;
+    //  The largest box that can be given for a median node, or for a convolution.
+    static const int C_MaxMedianNpix = 31;
+    static const int C_MaxConvolveSize = 31;
+    //  A routine that median filters an Nx by Ny image with an Npix by Npix box, as used by
+    //  Evaluate(). Blanks is true if the image might have blank (NaN) pixels.
+    typedef std::function<void(const float* Input,float* Output,int Nx,int Ny,int Npix,
+                                                                   bool Blanks)> MedianFilter;
+    //  The graph uses the Framework passed, whose device must have been created by the time
+    //  Build() is called.
+    ImageGraph(KVVulkanFramework& Framework);
+    //  The image the graph is given.
+    Image Input(void) const { return 0; }
+    //  A median filter, with an Npix by Npix box.
+    Image Median(Image In,int Npix);
+    //  A convolution with the Size by Size Weights, given row by row.
+    Image Convolve(Image In,const std::vector<float>& Weights,int Size);
+    //  A * ScaleA + B * ScaleB + Offset, element by element. B can be C_NoImage.
+    Image Combine(Image A,float ScaleA,Image B,float ScaleB,float Offset);
+    //  Some common cases of Combine().
+    Image Scale(Image In,float Factor) { return Combine(In,Factor,C_NoImage,0.0,0.0); }
+    Image Offset(Image In,float Value) { return Combine(In,1.0,C_NoImage,0.0,Value); }
+    Image Subtract(Image A,Image B) { return Combine(A,1.0,B,-1.0,0.0); }
+    //  Sets the image that is the result of the graph, and finds the nodes needed for it. This
+    //  should be called once all the nodes have been added.
+    void SetOutput(Image Out);
+    //  Creates everything needed to run the graph for an Nx by Ny image held in the storage
+    //  buffer InputHndl, which must already have been created. Blanks is true if the image
+    //  might have blank (NaN) pixels. The graph can't be changed once this has been called.
+    void Build(int Nx,int Ny,bool Blanks,KVVulkanFramework::KVBufferHandle InputHndl,
+                                                                              bool& StatusOK);
+    //  Runs the whole graph on the GPU and waits for it to finish.
+    void Run(bool& StatusOK);
+    //  Returns the address of the output image, once Run() has been called.
+    float* Output(void) const { return I_OutputAddr; }
+    //  Returns the time the last Run() took on the GPU, if dispatch timing is enabled.
+    bool GetKernelMsec(float* Msec) const;
+    //  Runs the graph on the CPU, for an Nx by Ny image, putting the result in Output. Does
+    //  nothing if there is no output set.
+    void Evaluate(const float* Input,float* Output,int Nx,int Ny,bool Blanks,
+                                                            const MedianFilter& Filter) const;
+    //  Returns a description of the graph as built - nodes run, buffers and memory used.
+    std::string Description(void) const;
+    //  Returns an explanation of the last error, if a node couldn't be added or Build() failed.
+    const std::string& GetError(void) const { return I_Error; }
+private:
+    //  The push constants for ImageOps.spv and Convolve.spv.
+    struct OpsArgs {
+        int Nx;
+        int Ny;
+        float ScaleA;
+        float ScaleB;
+        float Offset;
+        int HasB;
+    };
+    struct ConvolveArgs {
+        int Nx;
+        int Ny;
+        int Size;
+        float WeightTotal;
+    };
+    //  The kinds of node.
+    enum NodeType { NODE_MEDIAN, NODE_CONVOLVE, NODE_COMBINE };
+    //  The details of each node. Its output is image number (index + 1).
+    struct Node {
+        NodeType Type;
+        Image InputA;
+        Image InputB;
+        int Npix;                            // Box size, for a median or convolution.
+        float ScaleA;                        // Coefficients, for a combination.
+        float ScaleB;
+        float Offset;
+        std::vector<float> Weights;          // Weights, for a convolution.
+        bool Live;                           // True if the output depends on this node.
+        int LastUse;                         // The last node to use its output.
+        int Buffer;                          // Index in I_Buffers of the buffer it writes.
+        KVVulkanFramework::KVBufferHandle ArgsHndl;    // Uniform or weights buffer, if any.
+        VkDescriptorSet DescriptorSet;
+        OpsArgs Ops;                         // Push constants, for a combination.
+        ConvolveArgs Conv;                   // Push constants, for a convolution.
+    };
+    //  Adds a node, checking its inputs exist, and returns its output.
+    Image AddNode(const Node& NewNode);
+    //  Returns the buffer holding a given image, once the buffers have been assigned.
+    KVVulkanFramework::KVBufferHandle BufferFor(Image Img) const;
+    //  Returns the median pipeline for a box size, creating it if need be.
+    void MedianPipeline(int Npix,VkPipelineLayout* Layout,VkPipeline* Pipeline,bool& StatusOK);
+    //  Applies one convolution or combination node on the CPU.
+    void EvaluateNode(const Node& TheNode,const float* A,const float* B,float* Out,
+                                                                         int Nx,int Ny) const;
+    KVVulkanFramework* I_Framework;
+    std::vector<Node> I_Nodes;
+    Image I_Output;
+    bool I_Built;
+    int I_Nx;
+    int I_Ny;
+    std::string I_Error;
+    //  The input buffer, the buffers for the intermediate images, and the output buffer.
+    KVVulkanFramework::KVBufferHandle I_InputHndl;
+    std::vector<KVVulkanFramework::KVBufferHandle> I_Buffers;
+    KVVulkanFramework::KVBufferHandle I_OutputHndl;
+    //  The memory the intermediate buffers share, in bytes.
+    VkDeviceSize I_TransientBytes;
+    float* I_OutputAddr;
+    //  The descriptor set layouts - one for the median nodes, with a uniform buffer at binding
+    //  0 and storage buffers at 1 and 2, and one for the others, with storage buffers at 1, 2
+    //  and 3 - and the dummy buffer handles they are created from.
+    std::vector<KVVulkanFramework::KVBufferHandle> I_MedianLayoutHndls;
+    std::vector<KVVulkanFramework::KVBufferHandle> I_OtherLayoutHndls;
+    VkDescriptorSetLayout I_MedianLayout;
+    VkDescriptorSetLayout I_OtherLayout;
+    //  The pipelines, with a median pipeline for each box size used.
+    std::map<int,std::pair<VkPipelineLayout,VkPipeline>> I_MedianPipelines;
+    VkPipelineLayout I_OpsPipelineLayout;
+    VkPipeline I_OpsPipeline;
+    VkPipelineLayout I_ConvolvePipelineLayout;
+    VkPipeline I_ConvolvePipeline;
+    //  The dispatches, in the order they run.
+    std::vector<KVVulkanFramework::KVDispatch> I_Dispatches;
+    VkQueue I_Queue;
+    VkCommandPool I_CommandPool;
+    VkCommandBuffer I_CommandBuffer;
+    float I_KernelMsec;
+    bool I_KernelTimed;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The node index is the 'step' each transient buffer is given to the Framework, so a
+        buffer is in use from the node that writes it to the last node that reads it. Since
+        those include the node writing the next buffer, the two are never bound to the same
+        memory. The barrier RecordComputeBatch() puts between dispatches covers both a node
+        reading what the last one wrote, and a node overwriting memory an earlier one read.
+
+    o   All the Vulkan objects are created through the Framework, and released when it closes
+        down, so an ImageGraph must not outlive its Framework.
+*/
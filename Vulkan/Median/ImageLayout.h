@@ -0,0 +1,125 @@
+//
+//                            I m a g e  L a y o u t . h
+//
+//  This provides the index calculations for holding an image in memory in something other than
+//  the usual row-major order, and the code to repack a row-major image into such a layout. It is
+//  used by Median's 'Layout' option. A median filter - or any stencil calculation, such as a
+//  convolution - reads a square box of pixels around each output pixel. In row-major order each
+//  row of the box is in a different part of memory, so a box Npix wide touches Npix separate
+//  cache lines (or more), however small it is. Holding the image as small square blocks keeps
+//  a box within a few blocks, so it needs fewer cache lines, and neighbouring boxes share more
+//  of them.
+//
+//  The layouts are:
+//
+//  Rows     The usual row-major order, pixel (Ix,Iy) at Iy * Nx + Ix. Median uses this, through
+//           the same index calculation as the others, as the baseline they are measured against.
+//  Blocked  The image is divided into 8 by 8 blocks, one after the other in row-major order of
+//           blocks, with the pixels of each block in row-major order within it. A block of
+//           floats is 256 bytes - a couple of GPU cache lines, or four of a CPU's.
+//  Morton   The image is divided into 64 by 64 blocks, again in row-major order of blocks, with
+//           the pixels of each block in Z-order (Morton order) within it: the index within the
+//           block interleaves the bits of the X and Y offsets, so any 2 by 2, 4 by 4, 8 by 8
+//           ... square aligned on its own size is contiguous. A full Z-order of the whole image
+//           would need it padded out to a square whose side is a power of two, which can almost
+//           quadruple its size, so the Z-order is only within blocks of 16 KBytes.
+//
+//  Either way, the image is padded out to a whole number of blocks in each direction, so
+//  Size() can be a little more than Nx * Ny. The padding is never read.
+//
+//  The index calculation here is matched by inputIndex() in Median.comp, and the layout codes
+//  returned by ShaderCode() are the values of the shader's specialization constant for it.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __ImageLayout__
+#define __ImageLayout__
+
+#include <string>
+#include <stddef.h>
+#include <ctype.h>
+
+#include "ThreadPool.h"
+
+class ImageLayout
+{
+public:
+    //  None means the image isn't repacked at all, and the usual code is used.
+    enum Mode { None, Rows, Blocked, Morton };
+
+    //  Sets up the layout for an Nx by Ny image.
+    ImageLayout(Mode TheMode = None,int Nx = 0,int Ny = 0) {
+        _mode = TheMode;
+        _nx = Nx;
+        _ny = Ny;
+        _shift = (TheMode == Blocked) ? 3 : ((TheMode == Morton) ? 6 : 0);
+        _mask = (1 << _shift) - 1;
+        _blocksX = (Nx + _mask) >> _shift;
+        _blocksY = (Ny + _mask) >> _shift;
+    }
+    //  Sets TheMode from its name (case doesn't matter), returning false if it isn't one.
+    //  A blank name is None.
+    static bool Parse(const std::string& Name,Mode* TheMode) {
+        std::string Upper = Name;
+        for (char& Char : Upper) Char = toupper(Char);
+        if (Upper == "" || Upper == "NONE") *TheMode = None;
+        else if (Upper == "ROWS") *TheMode = Rows;
+        else if (Upper == "BLOCKED") *TheMode = Blocked;
+        else if (Upper == "MORTON") *TheMode = Morton;
+        else return false;
+        return true;
+    }
+    //  The name of a layout, as used in reports.
+    static const char* Name(Mode TheMode) {
+        static const char* const Names[] = {"none","rows","blocked","morton"};
+        return Names[TheMode];
+    }
+    Mode GetMode(void) const { return _mode; }
+    //  True if the image is to be repacked - any layout but None, including Rows.
+    bool Active(void) const { return _mode != None; }
+    //  The value used for the layout by Median.comp's specialization constant.
+    int ShaderCode(void) const { return (_mode == Blocked) ? 1 : ((_mode == Morton) ? 2 : 0); }
+    //  The number of values needed to hold the image in this layout, including any padding.
+    size_t Size(void) const {
+        if (_shift == 0) return size_t(_nx) * size_t(_ny);
+        return (size_t(_blocksX) * size_t(_blocksY)) << (2 * _shift);
+    }
+    //  The index of pixel (Ix,Iy) in an image held in this layout.
+    size_t Index(int Ix,int Iy) const {
+        if (_shift == 0) return size_t(Iy) * size_t(_nx) + size_t(Ix);
+        size_t Block = size_t(Iy >> _shift) * size_t(_blocksX) + size_t(Ix >> _shift);
+        unsigned int Bx = unsigned(Ix & _mask);
+        unsigned int By = unsigned(Iy & _mask);
+        unsigned int Within = (_mode == Morton) ? (Spread(Bx) | (Spread(By) << 1)) :
+                                                                       ((By << _shift) | Bx);
+        return (Block << (2 * _shift)) + Within;
+    }
+    //  Copies a row-major Nx by Ny Image into Packed, which must hold Size() values, sharing the
+    //  rows between up to Threads threads of the shared pool (all of them, if Threads is zero).
+    void Pack(const float* Image,float* Packed,int Threads = 0) const {
+        ThreadPool::Shared().ParallelFor(0,_ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = Image + size_t(Iy) * size_t(_nx);
+                for (int Ix = 0; Ix < _nx; Ix++) Packed[Index(Ix,Iy)] = Row[Ix];
+            }
+        },Threads);
+    }
+private:
+    //  Spreads the bits of a block offset (up to 16 bits) out to the even bit positions.
+    static unsigned int Spread(unsigned int Value) {
+        Value = (Value | (Value << 8)) & 0x00ff00ffu;
+        Value = (Value | (Value << 4)) & 0x0f0f0f0fu;
+        Value = (Value | (Value << 2)) & 0x33333333u;
+        Value = (Value | (Value << 1)) & 0x55555555u;
+        return Value;
+    }
+    Mode _mode;
+    int _nx;
+    int _ny;
+    int _shift;
+    int _mask;
+    int _blocksX;
+    int _blocksY;
+};
+
+#endif
@@ -0,0 +1,167 @@
+//
+//                           J o b  S c h e d u l e r . h
+//
+//  A JobScheduler decides which of several devices - typically the GPU and the CPU's pool of
+//  threads - should run each job of a batch, using the times the devices have actually taken
+//  for earlier jobs. Which is quicker depends on the size of the job: the GPU has a fixed cost
+//  for each job - the submission, and getting the data to and from it - that a small image
+//  doesn't make up for, while for a large image its speed wins easily. Where the cross-over
+//  comes depends on the machine, the kernel and even the box size, so rather than guess, the
+//  scheduler measures it as the batch runs.
+//
+//  For each device, and each kind of job (the 'kernel' - for example "Median5", for a median
+//  filter with a 5 by 5 box), the scheduler keeps a model of the time a job takes as a fixed
+//  cost plus a cost for each unit of size (each pixel, say), fitted by least squares to the
+//  times measured so far. The fit weights each earlier job by Decay for each job since, so
+//  the model follows any change in the device's speed - the GPU clocking up, say, or the CPU
+//  being shared with something else. Until a device has run jobs of two different sizes, a
+//  job is taken to need the same time as those, if it's larger, or a proportionately shorter
+//  time if it's smaller. That is as flattering to the device as the times allow, so it gets
+//  tried again, on a different size - taking the time as proportional to the size could write
+//  off a GPU for good on the strength of one small image, and taking it as fixed could do the
+//  same to the CPU after one large one.
+//
+//  A program adds its devices, then for each job calls Choose(), which returns the device
+//  that should finish the job soonest - allowing for any job it is still busy with, as given
+//  by Started() - and, once the job is done, Finished() with the time it took. If a device
+//  has never run the kernel, Choose() picks it, so every device gets measured. Description()
+//  summarises the models, and the number of jobs each device ran.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __JobScheduler__
+#define __JobScheduler__
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+class JobScheduler
+{
+public:
+    //  Creates a scheduler whose models give each earlier job Decay times the weight of the
+    //  one after it.
+    JobScheduler(double Decay = 0.8) { _decay = Decay; }
+    ~JobScheduler() {}
+    //  Adds a device, returning its index, as used by the other routines.
+    int AddDevice(const std::string& Name) {
+        Device NewDevice;
+        NewDevice.Name = Name;
+        NewDevice.BusyUntil = 0.0;
+        NewDevice.Jobs = 0;
+        _devices.push_back(NewDevice);
+        return int(_devices.size()) - 1;
+    }
+    //  Returns the predicted time for a device to run a job of the given kernel and size, or
+    //  a negative value if it hasn't run that kernel yet.
+    double Predict(int Index,const std::string& Kernel,double Size) const {
+        auto Found = _devices[Index].Fits.find(Kernel);
+        if (Found == _devices[Index].Fits.end()) return -1.0;
+        return Found->second.Predict(Size);
+    }
+    //  Returns the device that should finish a job soonest, given the time now, in the same
+    //  units as those passed to Started(). Predicted is set to the predicted time for the job
+    //  on that device, or a negative value if the device is being tried for the first time.
+    int Choose(const std::string& Kernel,double Size,double Now,double* Predicted) const {
+        int Best = -1;
+        double BestFinish = 0.0;
+        *Predicted = -1.0;
+        for (int Index = 0; Index < int(_devices.size()); Index++) {
+            double Msec = Predict(Index,Kernel,Size);
+            if (Msec < 0.0) return Index;
+            double Finish = std::max(Now,_devices[Index].BusyUntil) + Msec;
+            if (Best < 0 || Finish < BestFinish) {
+                Best = Index;
+                BestFinish = Finish;
+                *Predicted = Msec;
+            }
+        }
+        return Best;
+    }
+    //  Notes that a device has been given a job it should finish at time Until.
+    void Started(int Index,double Until) {
+        _devices[Index].BusyUntil = Until;
+    }
+    //  Notes that a device took Msec to run a job, updating its model for the kernel.
+    void Finished(int Index,const std::string& Kernel,double Size,double Msec) {
+        Device& TheDevice = _devices[Index];
+        TheDevice.Fits[Kernel].Add(Size,Msec,_decay);
+        TheDevice.Jobs++;
+    }
+    //  Returns the number of jobs a device has run.
+    int Jobs(int Index) const { return _devices[Index].Jobs; }
+    //  Returns a line for each device and kernel, giving its jobs and model, with the cost
+    //  for each unit of size given per million units.
+    std::string Description(void) const {
+        std::string Text;
+        for (const Device& TheDevice : _devices) {
+            char Line[256];
+            snprintf(Line,sizeof(Line),"%s: %d jobs\n",TheDevice.Name.c_str(),TheDevice.Jobs);
+            Text += Line;
+            for (const auto& Entry : TheDevice.Fits) {
+                double Fixed,PerUnit;
+                Entry.second.Coefficients(&Fixed,&PerUnit);
+                snprintf(Line,sizeof(Line),"   %s: %.3f msec + %.3f msec per million\n",
+                                                   Entry.first.c_str(),Fixed,PerUnit * 1.0e6);
+                Text += Line;
+            }
+        }
+        return Text;
+    }
+private:
+    //  A weighted least squares fit of Msec = Fixed + PerUnit * Size, kept as the weighted
+    //  sums it needs, each of which is multiplied by the decay factor as a job is added.
+    struct Fit {
+        double W = 0.0,Sx = 0.0,Sy = 0.0,Sxx = 0.0,Sxy = 0.0;
+        void Add(double X,double Y,double Decay) {
+            W = W * Decay + 1.0;
+            Sx = Sx * Decay + X;
+            Sy = Sy * Decay + Y;
+            Sxx = Sxx * Decay + X * X;
+            Sxy = Sxy * Decay + X * Y;
+        }
+        //  True unless the sizes are all the same (to within rounding), which leaves the fit
+        //  undetermined.
+        bool Determined(void) const {
+            return (W * Sxx - Sx * Sx) > 1.0e-9 * W * Sxx;
+        }
+        //  The costs, neither of which can be negative. If the fit is undetermined, this gives
+        //  the mean time as a fixed cost.
+        void Coefficients(double* Fixed,double* PerUnit) const {
+            double Det = W * Sxx - Sx * Sx;
+            *Fixed = (W > 0.0) ? Sy / W : 0.0;
+            *PerUnit = 0.0;
+            if (Determined()) {
+                double Slope = (W * Sxy - Sx * Sy) / Det;
+                double Intercept = (Sy - Slope * Sx) / W;
+                if (Slope < 0.0) {
+                    //  Leave it all as fixed cost.
+                } else if (Intercept < 0.0) {
+                    *Fixed = 0.0;
+                    *PerUnit = Sxy / Sxx;
+                } else {
+                    *Fixed = Intercept;
+                    *PerUnit = Slope;
+                }
+            }
+        }
+        double Predict(double X) const {
+            if (!Determined()) return (Sx > 0.0 && X * W < Sx) ? Sy * X / Sx : Sy / W;
+            double Fixed,PerUnit;
+            Coefficients(&Fixed,&PerUnit);
+            return Fixed + PerUnit * X;
+        }
+    };
+    struct Device {
+        std::string Name;
+        double BusyUntil;
+        int Jobs;
+        std::map<std::string,Fit> Fits;
+    };
+    double _decay;
+    std::vector<Device> _devices;
+};
+
+#endif
@@ -67,6 +67,161 @@
 //                    This has been disabled unless these are going to be explicitly listed
 //                    for diagnostics. Some tests now have to allow for the possibility that
 //                    the property names are unknown. LogWarning() added. KS.
+//     14th Oct 2026. Buffer memory is now sub-allocated from large blocks of device memory,
+//                    one set of blocks for each memory type, instead of each Vulkan buffer
+//                    having its own vkAllocateMemory() call. See AllocateBlockMemory(). KS.
+//                    Added SubmitCommandBuffer(), IsComplete() and WaitFor() to allow command
+//                    buffers to run asynchronously, using fences taken from a recycled pool.
+//                    RunCommandBuffer() is now implemented using these. KS.
+//                    SyncBuffer() now re-uses a pre-recorded command buffer for each buffer.
+//                    Added SubmitSyncBuffer() and CreateVulkanSemaphore() so syncs can be
+//                    chained asynchronously, and a version of RecordComputeCommandBuffer()
+//                    that includes the sync copies in the compute command buffer itself. KS.
+//                    Added EnableSeparateQueues() and versions of GetDeviceQueue() and
+//                    CreateCommandPool() that take a queue type, so transfers and compute can
+//                    use dedicated queue families, together with ReleaseBufferOwnership() and
+//                    AcquireBufferOwnership() for buffers that move between them. KS.
+//                    All pipelines are now created using a pipeline cache that is saved to
+//                    disk by CleanupVulkan() and reloaded by CreateLogicalDevice(). Added
+//                    SetPipelineCacheDirectory(). KS.
+//                    Added SyncBufferRange() and SyncBufferRegions() so only the changed parts
+//                    of a staged buffer need be copied. KS.
+//                    ResizeBuffer() now grows a buffer's capacity geometrically when it has to
+//                    be reallocated, so repeated small increases rarely reallocate. KS.
+//                    Added a version of CreateComputePipeline() that takes specialization
+//                    constants, DestroyComputePipeline() and AutotuneWorkGroupSize(). KS.
+//                    Added GPU timestamp support: EnableDispatchTiming() and GetDispatchTimes()
+//                    for the command buffers set up by RecordComputeCommandBuffer(), and
+//                    CreateTimestampQueries(), ResetTimestamps(), WriteTimestamp() and
+//                    GetTimestampMsec() for general use. KS.
+//                    Added versions of CreateComputePipeline() and RecordComputeCommandBuffer()
+//                    that support push constants. KS.
+//                    Added RecordComputeBatch() and KVDispatch, to record a number of dispatches
+//                    into one command buffer. RecordComputeCommandBuffer() now uses this. KS.
+//                    Added SetCommandBufferReusable() and InvalidateRecordings(), so a compute
+//                    command buffer is only re-recorded when what it does changes. KS.
+//                    FindSuitableDevice() can now select a device by rank, and added
+//                    CountSuitableDevices() and PartitionRows() for multi-GPU programs. KS.
+//                    RateDevice() now also considers memory heaps, subgroup size and workgroup
+//                    limits. Added EnableDeviceBenchmark(), which ranks devices by a cached
+//                    bandwidth benchmark. KS.
+//                    Added the "IMPORTED" buffer access, ImportBuffer(), GetHostImportAlignment(),
+//                    AllocateImportableMemory() and FreeImportableMemory(), so a buffer can use
+//                    existing host memory through VK_EXT_external_memory_host. KS.
+//                    Added CreateUploadRing(), AllocateUpload() and SubmitUploads(), which
+//                    provide a ring of host-visible staging memory for streaming uploads into
+//                    "LOCAL" and "STAGED_CPU" buffers, batched into a single submission. KS.
+//                    Added the "READBACK" buffer access and InvalidateBuffer(). Memory types are
+//                    now chosen using preferred as well as required properties, so data read
+//                    by the CPU goes into cached memory where possible, and non-coherent
+//                    memory is explicitly flushed or invalidated when buffers are synched. KS.
+//                    If the device supports VK_KHR_buffer_device_address, it is now enabled, and
+//                    GetBufferAddress() returns the GPU address of a storage buffer, which can be
+//                    passed to a shader in push constants instead of through a descriptor. KS.
+//                    The Framework can now be used from a number of threads. Its own bookkeeping
+//                    is protected by a mutex, WaitFor() doesn't hold this while it waits, and
+//                    GetThreadCommandPool() provides each thread with its own command pools,
+//                    so threads can record and submit command buffers independently. KS.
+//                    If the device supports VK_KHR_timeline_semaphore, it is now enabled, and
+//                    timeline semaphores can be created, waited for and signalled with values,
+//                    including by the graphics submission made by DrawGraphicsFrame(). KS.
+//                    Added MeasureDeviceBandwidth(), which gives programs a measured peak
+//                    memory bandwidth to compare their own results with. KS.
+//                    If the device supports 16-bit storage buffer access, this is now enabled,
+//                    and DeviceSupports16BitStorage() reports whether it was. KS.
+//                    Added a version of AutotuneWorkGroupSize() that passes the shader extra
+//                    specialization constants, for shaders that use them for more than just
+//                    the workgroup shape. KS.
+//     15th Oct 2026. Added FlushBuffer(), for a CPU that writes into a mapped buffer the GPU
+//                    also writes. KS.
+//                    Added the "VERTEX_STORAGE" buffer type. KS.
+//                    Graphics pipelines can now use a descriptor set, through a version of
+//                    CreateGraphicsPipeline() that takes a descriptor set layout and a version
+//                    of DrawGraphicsFrame() that binds descriptor sets. Descriptor set layouts
+//                    now make their buffers visible to fragment shaders as well. KS.
+//                    Added WaitForGraphicsFrame(). KS.
+//                    Added SetPresentMode() and SetSwapChainImages(), so a program can choose
+//                    the presentation mode and the number of swap chain images, and
+//                    GetPresentMode(). PickSwapPresentMode() now actually gets the list of
+//                    modes the device supports, which it never did before. KS.
+//                    Added SetFramesInFlight() and GetFramesInFlight(). KS.
+//                    Descriptor set layouts now make their buffers visible to vertex shaders
+//                    too, so a vertex shader can read its parameters from a buffer. KS.
+//                    Added CaptureGraphicsFrame() and GetCapturedFrame(), which have a frame
+//                    copied into a buffer as part of drawing it, together with
+//                    FrameCaptureSupported() and GetSwapChainExtent(). Swap chain images are
+//                    now created so they can be copied, if the surface allows it, and
+//                    "READBACK" buffers can now be the destination of a copy. KS.
+//                    Added GetDeviceDescription(), so programs can say what their timings
+//                    were measured on. KS.
+//                    CreateBuffer(), SyncBuffer(), RunCommandBuffer() and DrawGraphicsFrame()
+//                    now record themselves in a TraceRecorder, and each submission to the GPU
+//                    is recorded from when it's submitted until it's seen to complete. KS.
+//                    Added StartDeviceSetup() and WaitForDeviceSetup(), which create the
+//                    instance and device in a separate thread, and PreloadShaderFile(). The
+//                    main setup stages are recorded in the StartupProfile. KS.
+//                    Added GetMemoryStats(), which reports the memory allocated and used in
+//                    each heap, along with the budget for it from VK_EXT_memory_budget if the
+//                    device supports that. AllocateBlockMemory() now keeps new blocks within
+//                    that budget, using a smaller block or another heap if it has to, and
+//                    explains the problem if it can't. KS.
+//                    Added DeviceSupportsSubgroupArithmetic(), so a program can choose a shader
+//                    that uses subgroup operations if the device allows it. KS.
+//                    Added a version of SetupVulkanDescriptorSet() that is given the binding
+//                    for each buffer, so one buffer can be bound differently in different
+//                    descriptor sets. KS.
+//                    The subgroup size and the subgroup operations compute shaders can use
+//                    are now recorded when the device is selected, alongside the support for
+//                    double precision, and DeviceSupportsSubgroupOperations() reports them
+//                    for any combination of operations. DeviceSupportsSubgroupArithmetic()
+//                    now uses it. KS.
+//                    Buffer sizes and offsets are now VkDeviceSize throughout, since long is
+//                    only 32 bits under Windows, and the error checks on them allow for their
+//                    being unsigned. The device's maxStorageBufferRange is now recorded, and
+//                    SetupVulkanDescriptorSet() reports a storage buffer larger than it rather
+//                    than let Vulkan quietly misbehave. Added GetMaxStorageBufferRange() and
+//                    a MapBuffer() that returns the size as a VkDeviceSize. KS.
+//                    Added the "SPARSE" buffer access, for a buffer that reserves a large
+//                    virtual size but has device memory committed to it only for the ranges
+//                    passed to CommitBufferRange(), using sparse binding through the main
+//                    queue. If the device and the main queue family support it, sparse
+//                    residency buffers are now enabled, and SparseBuffersSupported() reports
+//                    whether they were. Added ReleaseBufferRange() and GetSparseDetails(). KS.
+//                    Added SetBufferConcurrent(), so a buffer used by queues from different
+//                    families - eg a compute queue and the graphics queue - can be created with
+//                    concurrent sharing, rather than needing ownership transfers. KS.
+//                    Added EmbedShader(), so SPIR-V code built into the program is used
+//                    instead of reading its file. CreateComputePipeline() and
+//                    CreateShaderModuleFromFile() now get their modules from the new
+//                    GetShaderModule(), which creates a module only once for the same code,
+//                    rather than once for each pipeline. KS.
+//                    Added SetWaitSpin(), which has WaitFor() and WaitForSemaphoreValue()
+//                    poll for up to a given time before blocking, as waking a blocked thread
+//                    can take longer than a small dispatch. Added GetWaitStats(), and the
+//                    internal RecordWait(), which times the waits. KS.
+//                    Added QueuesShareFamily(), so a program can tell whether a buffer can
+//                    pass between two of its queues without an ownership transfer. KS.
+//                    Added CreateTransientBuffers(), which creates a set of "LOCAL" buffers
+//                    each used only between two steps of a sequence, with those whose steps
+//                    don't overlap bound to the same memory, so the memory needed is that of
+//                    the largest set in use at once rather than of all of them. KS.
+//                    Added SetComputeQueueCount(), which has CreateLogicalDevice() set up more
+//                    than one queue from the compute family where the device has them, and
+//                    GetComputeQueueCount() and GetComputeQueue() to get at them, so a program
+//                    can submit to several queues from separate threads. KS.
+//                    If the device supports pipeline statistics queries, they are now enabled,
+//                    and EnablePipelineStatistics() has RecordComputeBatch() count the compute
+//                    shader invocations it dispatches, returned by GetDispatchInvocations(), so
+//                    a program can see how many are only padding. Added
+//                    PipelineStatisticsSupported() and LeastPaddedWorkGroupSize(). KS.
+//                    "SHARED" uniform buffers, and storage buffers passed to the new
+//                    SetBufferHostWriteOnly(), now go into memory that is both device-local
+//                    and host-visible where the device has it (eg with resizable BAR) and it
+//                    has room, so the GPU doesn't read them over PCIe on every dispatch. The
+//                    internal LogBufferMemory() reports which heap each buffer is in. KS.
+//                    Added RunComputeChunks(), which runs a long computation split into chunks
+//                    a few at a time, checking a KVCancelFlag between submissions, so it can be
+//                    dropped part way through and no one submission runs for long. KS.
 //
 //  Copyright (c) Knave and Varlet (K&V), (2024).
 //  Significant portions of this code are based closely on code from the Vulkan-tutorial website,
@@ -101,8 +256,10 @@
 #include <array>
 #include <string>
 #include <stdexcept>
+#include <system_error>
 #include <cmath>
 #include <cstdint>
+#include <cctype>
 #include <algorithm>
 #include <iostream>
 #include <stdio.h>
@@ -113,6 +270,14 @@
 
 #include "MsecTimer.h"
 
+//  The main calls, and each submission to the GPU, are recorded if a program enables tracing.
+
+#include "TraceRecorder.h"
+
+//  And the main setup stages are recorded if a program wants a profile of its start-up.
+
+#include "StartupProfile.h"
+
 using std::cout;
 using std::cerr;
 
@@ -127,6 +292,89 @@ using std::cerr;
 const std::string KVVulkanFramework::I_DebugOptions =
                                "Progress,Instance,Device,Buffers,Swapchain,Properties";
 
+//  C_BufferGrowthFactor is the factor by which ResizeBuffer() increases the capacity of a buffer
+//  when it has to be reallocated.
+
+static const double C_BufferGrowthFactor = 1.5;
+
+//  C_BenchmarkBytes is the size of the buffers used by the device benchmark (see the routine
+//  EnableDeviceBenchmark()), and C_RankingCacheName is the name of the file in which the
+//  benchmark results are cached.
+
+static const VkDeviceSize C_BenchmarkBytes = 64 * 1024 * 1024;
+static const char* const C_RankingCacheName = "KVDeviceRanking.txt";
+
+//  C_HostImportAlignment is the alignment used by AllocateImportableMemory(). That routine can be
+//  called before any device has been selected, so it can't use the device's own requirement for
+//  imported host memory (minImportedHostPointerAlignment). This value is at least as large as
+//  that for any device we know of (4096 bytes is usual) and must be a power of two.
+
+static const VkDeviceSize C_HostImportAlignment = 64 * 1024;
+
+//  C_UploadAlignment is the alignment of each range allocated from the upload ring by
+//  AllocateUpload(). Buffer copies don't need any particular alignment, but this keeps the
+//  CPU's writes into the ring naturally aligned for any data type.
+
+static const VkDeviceSize C_UploadAlignment = 16;
+
+//  C_HeapBudgetFraction is the fraction of a memory heap that the Framework assumes it can use
+//  if the device doesn't support VK_EXT_memory_budget, so can't say how much is really available.
+//  Other programs and the system itself will usually be using some of it, so it would be
+//  optimistic to count on all of it.
+
+static const double C_HeapBudgetFraction = 0.8;
+
+//  HeapRoom() returns the number of bytes left in the budget for a memory heap, given the
+//  details for it returned by GetHeapStats().
+
+static VkDeviceSize HeapRoom(const KVVulkanFramework::KVHeapStats& Stats)
+{
+    return (Stats.Budget > Stats.Usage) ? Stats.Budget - Stats.Usage : 0;
+}
+
+//  C_HostLocalFraction limits the size of a buffer that will be put into memory that is both
+//  device-local and host-visible, as a fraction of the heap in question. Without resizable BAR
+//  that heap is usually only 256 MBytes, and the driver may need some of it for itself.
+
+static const VkDeviceSize C_HostLocalFraction = 4;
+
+//  MemoryFlagString() returns a description of a set of memory property flags, such as
+//  "DeviceLocal HostVisible HostCoherent ", for diagnostic output.
+
+static std::string MemoryFlagString(VkMemoryPropertyFlags Flags)
+{
+    std::string FlagString = "";
+    if (Flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) FlagString += "DeviceLocal ";
+    if (Flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) FlagString += "HostVisible ";
+    if (Flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) FlagString += "HostCoherent ";
+    if (Flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) FlagString += "HostCached ";
+    if (Flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) FlagString += "LazilyAllocated ";
+    if (Flags & VK_MEMORY_PROPERTY_PROTECTED_BIT) FlagString += "PropertyProtected ";
+    /* Support for these seems to vary, so for now the safe thing to do is comment them out.
+    if (Flags & VK_MEMORY_PROPERTY_DEVICE_COHERENT_BIT_AMD) FlagString += "DeviceCoherentAMD ";
+    if (Flags & VK_MEMORY_PROPERTY_DEVICE_UNCACHED_BIT_AMD) FlagString += "DeviceUncachedAMD ";
+    if (Flags & VK_MEMORY_PROPERTY_RDMA_CAPABLE_BIT_NV) FlagString += "RDMACapableNV ";
+    */
+    return FlagString;
+}
+
+//  EmbeddedShaders() returns the SPIR-V code given to EmbedShader(), with its length in bytes,
+//  indexed by the name of the file it replaces, and EmbeddedShaderMutex() the mutex that
+//  protects it. They are function statics, as EmbedShader() is usually called during static
+//  initialisation, possibly before any static defined in this file would have been set up.
+
+static std::map<std::string,std::pair<const uint32_t*,size_t>>& EmbeddedShaders(void)
+{
+    static std::map<std::string,std::pair<const uint32_t*,size_t>> Shaders;
+    return Shaders;
+}
+
+static std::mutex& EmbeddedShaderMutex(void)
+{
+    static std::mutex Mutex;
+    return Mutex;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                          N e c e s s a r y  d e f i n i t i o n s
@@ -154,6 +402,8 @@ KVVulkanFramework::KVVulkanFramework(void)
     I_SelectedDevice = VK_NULL_HANDLE;
     I_DeviceHasPortabilitySubset = false;
     I_DeviceSupportsDouble = false;
+    I_SubgroupSize = 0;
+    I_SubgroupOperations = 0;
     I_EnableValidationErrors = false;
     I_EnableValidationWarnings = false;
     I_EnableValidationInformation = false;
@@ -164,12 +414,64 @@ KVVulkanFramework::KVVulkanFramework(void)
     I_FrameBufferHeight = 0;
     I_SwapChainExtent = {0,0};
     I_ImageCount = 0;
+    I_RequestedImageCount = 0;
+    I_RequestedPresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+    I_PresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    I_FramesInFlight = 2;
     I_SwapChain = VK_NULL_HANDLE;
     I_SwapChainImageFormat = VK_FORMAT_UNDEFINED;
+    I_CaptureSupported = false;
+    I_CaptureBGR = false;
     I_RenderPass = VK_NULL_HANDLE;
     I_LogicalDevice = VK_NULL_HANDLE;
     I_DiagnosticsEnabled = false;
     I_QueueFamilyIndex = 0;
+    I_SeparateComputeQueue = false;
+    I_SeparateTransferQueue = false;
+    I_ComputeQueueFamilyIndex = 0;
+    I_ComputeQueueIndex = 0;
+    I_ComputeQueuesWanted = 1;
+    I_TransferQueueFamilyIndex = 0;
+    I_TransferQueueIndex = 0;
+    I_PipelineCacheHndl = VK_NULL_HANDLE;
+    I_PipelineCacheDirectory = ".";
+    I_PipelineCacheLoadedSize = 0;
+    I_BenchmarkDevices = false;
+    I_TimestampQueryPoolHndl = VK_NULL_HANDLE;
+    I_TimestampQueryCount = 0;
+    I_DispatchQueryPoolHndl = VK_NULL_HANDLE;
+    I_StatisticsQueryPoolHndl = VK_NULL_HANDLE;
+    I_TimestampPeriod = 0.0;
+    I_TimestampValidBits = 0;
+    I_RecordingGeneration = 0;
+    I_HostImportSupported = false;
+    I_HostImportAlignment = C_HostImportAlignment;
+    I_GetMemoryHostPointerProperties = nullptr;
+    I_BufferAddressSupported = false;
+    I_GetBufferDeviceAddress = nullptr;
+    I_TimelineSupported = false;
+    I_16BitStorageSupported = false;
+    I_MemoryBudgetSupported = false;
+    I_SparseSupported = false;
+    I_StatisticsSupported = false;
+    I_WaitSemaphores = nullptr;
+    I_GetSemaphoreCounterValue = nullptr;
+    I_UploadRingBufferHndl = VK_NULL_HANDLE;
+    I_UploadRingMemoryHndl = VK_NULL_HANDLE;
+    I_UploadRingAllocation = {-1,0,0};
+    I_UploadRingAddress = nullptr;
+    I_UploadRingSize = 0;
+    I_UploadRingHead = 0;
+    I_UploadRingTail = 0;
+    I_UploadRingUsed = 0;
+    I_UploadPendingBytes = 0;
+    I_MemoryBlockSize = 64 * 1024 * 1024;
+    I_BufferImageGranularity = 1;
+    I_NonCoherentAtomSize = 1;
+    I_MaxStorageBufferRange = 0;
+    I_LastTicket = KV_NULL_TICKET;
+    I_WaitSpinUsec = 0;
+    I_WaitStats = {0,0,0.0,0.0};
     
     //  This is to emphasise that we start with no Vulkan extensions that this code requires.
     //  If another part of the program - such as a windowing system like GLFW - requires specific
@@ -185,6 +487,10 @@ KVVulkanFramework::KVVulkanFramework(void)
     //  section above.
     
     I_Debug.LevelsList(I_DebugOptions);
+    
+    //  Nothing has been read by PreloadShaderFile(), and StartDeviceSetup() hasn't been called.
+    
+    I_DeviceSetupOK = true;
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -196,6 +502,7 @@ KVVulkanFramework::KVVulkanFramework(void)
 KVVulkanFramework::~KVVulkanFramework()
 {
     I_Debug.Log("Progress","Called KVVulkanFramework destructor.");
+    if (I_DeviceSetupThread.joinable()) I_DeviceSetupThread.join();
     CleanupVulkan();
 }
 
@@ -390,6 +697,7 @@ bool KVVulkanFramework::AllOK (bool& StatusOK)
 void KVVulkanFramework::CreateVulkanInstance (bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
+    StartupPhase Phase("Vulkan instance");
 
     //  In this context, 'diagnostics' refers to using the Vulkan validation layers. If any of
     //  the levels are enabled, the validation layers will be activated when the instance is
@@ -684,6 +992,147 @@ void KVVulkanFramework::EnableGraphics(VkSurfaceKHR SurfaceHndl,bool& StatusOK)
     }
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                          E n a b l e  S e p a r a t e  Q u e u e s
+//
+//  By default, the Framework uses just one queue, from a family that supports compute and
+//  (if enabled) graphics, and everything - computation, graphics and buffer copies - is
+//  submitted to that one queue. Many discrete GPUs also provide queue families that only
+//  support transfers (these usually map onto dedicated DMA engines) and families that support
+//  compute but not graphics (which can run alongside graphics work). This routine asks that,
+//  when the logical device is created, separate queues be set up for transfers and/or for
+//  computation, using such dedicated families where they exist. These can then be obtained
+//  using the versions of GetDeviceQueue() and CreateCommandPool() that take a queue type.
+//  If the device has no suitable dedicated family, a second queue from the main family is used
+//  if one is available, and failing that the main queue itself is used, so a program that asks
+//  for separate queues will still work - it just won't gain any overlap.
+//
+//  Parameters:
+//     SeparateTransfer (bool) True if a separate queue is wanted for transfers.
+//     SeparateCompute  (bool) True if a separate queue is wanted for computation.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     This must be called before CreateLogicalDevice().
+//
+//  Note:
+//     A buffer used by queues from two different families needs its ownership passed from one
+//     family to the other. See ReleaseBufferOwnership() and AcquireBufferOwnership().
+
+void KVVulkanFramework::EnableSeparateQueues(
+                                      bool SeparateTransfer,bool SeparateCompute,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    if (I_LogicalDevice != VK_NULL_HANDLE) {
+        LogError("Separate queues must be requested before the logical device is created.");
+        StatusOK = false;
+    } else {
+        I_SeparateTransferQueue = SeparateTransfer;
+        I_SeparateComputeQueue = SeparateCompute;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       S e t  C o m p u t e  Q u e u e  C o u n t
+//
+//  A queue family will often have several queues, but by default the Framework only uses one
+//  from each family. This asks for a number of queues from the family used for compute - the
+//  main family, or the one chosen for a separate compute queue if EnableSeparateQueues() asked
+//  for that - so that a program can submit work to them from separate threads, and the GPU
+//  can run it concurrently if it is able to. The first of these is the "COMPUTE" queue
+//  returned by GetDeviceQueue(). If the family has fewer queues, only those it has are used.
+//  GetComputeQueueCount() returns the number actually set up, and GetComputeQueue() returns
+//  each one.
+//
+//  Parameters:
+//     Count         (int) The number of compute queues wanted. The default is 1.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     This must be called before CreateLogicalDevice().
+//
+//  Note:
+//     All the queues are from the same family, so command buffers allocated from a "COMPUTE"
+//     command pool can be submitted to any of them, and buffers need no ownership transfers.
+
+void KVVulkanFramework::SetComputeQueueCount(int Count,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    if (I_LogicalDevice != VK_NULL_HANDLE) {
+        LogError("Compute queues must be requested before the logical device is created.");
+        StatusOK = false;
+    } else if (Count < 1) {
+        LogError("Invalid number of compute queues (%d) requested.",Count);
+        StatusOK = false;
+    } else {
+        I_ComputeQueuesWanted = Count;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                    S e t  P i p e l i n e  C a c h e  D i r e c t o r y
+//
+//  Creating a pipeline involves the driver compiling the SPIR-V shader code into code for the
+//  actual GPU, and this can take a significant time. The Framework uses a Vulkan pipeline
+//  cache for all the pipelines it creates, and this cache is saved to disk when the Framework
+//  closes down and loaded again when the logical device is next created, so later runs of a
+//  program can skip most of that compilation. This routine specifies the directory used for
+//  the cache file. The default is the current directory. The cache file name includes the
+//  pipeline cache UUID and the driver version reported by the device, so different devices and
+//  driver versions each get their own file, and a stale cache is never offered to a driver.
+//
+//  Parameters:
+//     Directory     (const std::string&) The directory in which to keep the pipeline cache
+//                   file. If this is blank, the pipeline cache is neither loaded nor saved,
+//                   although a cache is still used while the program runs.
+//
+//  Pre-requisites:
+//     This must be called before CreateLogicalDevice() if it is to have any effect.
+//
+//  Note:
+//     The cached device benchmark results (see EnableDeviceBenchmark()) are kept in the same
+//     directory.
+
+void KVVulkanFramework::SetPipelineCacheDirectory(const std::string& Directory)
+{
+    I_PipelineCacheDirectory = Directory;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        E n a b l e  D e v i c e  B e n c h m a r k
+//
+//  Normally, FindSuitableDevice() ranks the available devices using the scores assigned by
+//  RateDevice(), which are based only on the reported capabilities of each device. These can
+//  be misleading - a laptop's discrete GPU isn't always faster than its integrated GPU, for
+//  example. If this routine has been called, each suitable device is instead ranked by the
+//  result of a short memory bandwidth benchmark, run by creating a temporary logical device and
+//  timing the filling and copying of a pair of device-local buffers. The results are cached in
+//  a file in the pipeline cache directory (see SetPipelineCacheDirectory()), keyed by device
+//  and driver version, so the benchmark only needs to be run once for each device.
+//
+//  Parameters:
+//     Enable        (bool) True if devices are to be ranked by the benchmark.
+//
+//  Pre-requisites:
+//     This must be called before FindSuitableDevice() or CountSuitableDevices().
+//
+//  Note:
+//     If the benchmark fails for a device, a warning is logged and the device is ranked by
+//     the score from RateDevice(), scaled to put it below any device that ran the benchmark.
+
+void KVVulkanFramework::EnableDeviceBenchmark(bool Enable)
+{
+    I_BenchmarkDevices = Enable;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                        S e t  F r a m e  B u f f e r  S i z e
@@ -749,10 +1198,197 @@ void KVVulkanFramework::SetFrameBufferSize(int Width,int Height,bool& StatusOK)
 //      then AddGraphicsExtensions() should have been called.
 
 void KVVulkanFramework::FindSuitableDevice (bool& StatusOK)
+{
+    FindSuitableDevice(0,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                   F i n d  S u i t a b l e  D e v i c e   (selecting by rank)
+//
+//  This version of FindSuitableDevice() allows a program to use a device other than the most
+//  highly rated. All the suitable devices are ranked in order of the score given to them by
+//  RateDevice(), and this selects the device with the specified rank - 0 being the best, as
+//  selected by the simpler version of FindSuitableDevice(). Since each Framework instance
+//  manages just one logical device, a program that wants to use several GPUs at once can
+//  create one Framework for each, calling this with ranks 0 up to one less than the number
+//  returned by CountSuitableDevices(), and can then split its work between them using
+//  PartitionRows().
+//
+//  Parameters:
+//     Rank          (int) The rank of the device to be selected, with 0 being the best.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Pre-requisites:
+//      As for the simpler version of FindSuitableDevice().
+
+void KVVulkanFramework::FindSuitableDevice (int Rank,bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
+    StartupPhase Phase("GPU device selection");
     I_Debug.Log ("Device","Searching for suitable GPU device.");
     
+    std::vector<VkPhysicalDevice> Devices;
+    std::vector<bool> Portability;
+    RankSuitableDevices(Devices,Portability,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    if (Rank < 0 || Rank >= int(Devices.size())) {
+        if (Devices.size() == 0) {
+            LogError("Unable to find a suitable GPU.");
+        } else {
+            LogError("Cannot select GPU ranked %d, only %d suitable GPUs found.",Rank,
+                                                                          int(Devices.size()));
+        }
+        StatusOK = false;
+    } else {
+            
+        //  Record the device we selected and record whether or not it supports double
+        //  precision (that's useful for computation) and if it supports (and therefore
+        //  requires) the portability subset (mainly the case for Macs). We also record its
+        //  subgroup size and the subgroup operations compute shaders can use, which need
+        //  Vulkan 1.1 to query.
+        
+        VkPhysicalDevice SelectedDevice = Devices[Rank];
+        I_SelectedDevice = SelectedDevice;
+        I_DeviceHasPortabilitySubset = Portability[Rank];
+        VkPhysicalDeviceFeatures Features;
+        vkGetPhysicalDeviceFeatures(SelectedDevice,&Features);
+        I_DeviceSupportsDouble = Features.shaderFloat64;
+        VkPhysicalDeviceProperties Properties;
+        vkGetPhysicalDeviceProperties(SelectedDevice,&Properties);
+        I_SubgroupSize = 0;
+        I_SubgroupOperations = 0;
+        if (Properties.apiVersion >= VK_API_VERSION_1_1) {
+            VkPhysicalDeviceSubgroupProperties SubgroupProperties{};
+            SubgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+            VkPhysicalDeviceProperties2 Properties2{};
+            Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            Properties2.pNext = &SubgroupProperties;
+            vkGetPhysicalDeviceProperties2(SelectedDevice,&Properties2);
+            I_SubgroupSize = SubgroupProperties.subgroupSize;
+            if (SubgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) {
+                I_SubgroupOperations = SubgroupProperties.supportedOperations;
+            }
+        }
+        if (I_Debug.Active("Device")) {
+            I_Debug.Logf("Device","Selected Device: %s (rank %d)",Properties.deviceName,Rank);
+            I_Debug.Logf("Device","Subgroup size %u, compute operations 0x%x",I_SubgroupSize,
+                                                              unsigned(I_SubgroupOperations));
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         C o u n t  S u i t a b l e  D e v i c e s
+//
+//  Returns the number of GPU devices that pass the tests applied by FindSuitableDevice(). If
+//  this is more than one, FindSuitableDevice() can be called with a rank to select any of them.
+//
+//  Parameters:
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (int)         The number of suitable devices.
+//
+//  Pre-requisites:
+//      As for FindSuitableDevice().
+
+int KVVulkanFramework::CountSuitableDevices (bool& StatusOK)
+{
+    std::vector<VkPhysicalDevice> Devices;
+    std::vector<bool> Portability;
+    RankSuitableDevices(Devices,Portability,StatusOK);
+    return int(Devices.size());
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               P a r t i t i o n  R o w s
+//
+//  A utility for programs that split a 2D computation between a number of GPUs, each managed by
+//  its own Framework instance. This divides the rows of an image into contiguous bands, one for
+//  each device, with the number of rows in each band proportional to a weight for that device.
+//  Usually the weights will be the measured throughput of each device - for example the inverse
+//  of the time each took to process a trial band (see EnableDispatchTiming()) - so the faster
+//  devices get more of the work and all finish at about the same time.
+//
+//  Parameters:
+//     Ny            (uint32_t) The total number of rows to be divided up.
+//     Weights       (const std::vector<double>&) A weight for each device. Negative weights are
+//                   treated as zero, and if all the weights are zero, the rows are divided up
+//                   equally.
+//     RowMultiple   (uint32_t) If greater than 1, the band boundaries are rounded to a multiple
+//                   of this, usually the Y dimension of the workgroup. (The final band takes
+//                   whatever rows remain.)
+//     Bands         (std::vector<KVRowBand>&) Returned with one band for each weight, giving
+//                   its first row and its number of rows. A band may have no rows at all.
+//
+//  Note:
+//     This is a static routine, as it doesn't relate to any one device.
+
+void KVVulkanFramework::PartitionRows(uint32_t Ny,const std::vector<double>& Weights,
+                                             uint32_t RowMultiple,std::vector<KVRowBand>& Bands)
+{
+    Bands.clear();
+    size_t NumberBands = Weights.size();
+    if (NumberBands == 0) return;
+    
+    double TotalWeight = 0.0;
+    for (double Weight : Weights) if (Weight > 0.0) TotalWeight += Weight;
+    
+    //  Work out the cumulative boundary of each band, and round it to the required multiple.
+    //  Working from the cumulative weight rather than band by band means rounding errors
+    //  don't accumulate.
+    
+    double CumulativeWeight = 0.0;
+    uint32_t FirstRow = 0;
+    for (size_t Index = 0; Index < NumberBands; Index++) {
+        if (TotalWeight > 0.0) {
+            if (Weights[Index] > 0.0) CumulativeWeight += Weights[Index];
+        } else {
+            CumulativeWeight += 1.0;
+        }
+        double Fraction = CumulativeWeight / (TotalWeight > 0.0 ? TotalWeight : NumberBands);
+        uint32_t EndRow = uint32_t(Fraction * double(Ny) + 0.5);
+        if (RowMultiple > 1) EndRow = ((EndRow + RowMultiple / 2) / RowMultiple) * RowMultiple;
+        if (Index == NumberBands - 1 || EndRow > Ny) EndRow = Ny;
+        if (EndRow < FirstRow) EndRow = FirstRow;
+        KVRowBand Band;
+        Band.FirstRow = FirstRow;
+        Band.NumberRows = EndRow - FirstRow;
+        Bands.push_back(Band);
+        FirstRow = EndRow;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                    R a n k  S u i t a b l e  D e v i c e s   (Internal routine)
+//
+//  This is the search used by FindSuitableDevice() and CountSuitableDevices(). It looks at all
+//  the physical devices available, and returns those that are suitable for use, ranked in order
+//  of the score given to them by RateDevice(), best first.
+//
+//  Parameters:
+//     Devices       (std::vector<VkPhysicalDevice>&) Returned with the suitable devices, in
+//                   order of decreasing score.
+//     Portability   (std::vector<bool>&) Returned with a flag for each device in Devices that
+//                   is true if the device supports the portability subset.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+
+void KVVulkanFramework::RankSuitableDevices (std::vector<VkPhysicalDevice>& Devices,
+                                             std::vector<bool>& Portability,bool& StatusOK)
+{
+    Devices.clear();
+    Portability.clear();
+    if (!AllOK(StatusOK)) return;
+    
     if (I_Instance != VK_NULL_HANDLE) {
     
         //  We can use the Vulkan instance to get a list of all the physical devices available.
@@ -766,9 +1402,14 @@ void KVVulkanFramework::FindSuitableDevice (bool& StatusOK)
         //  extensions (if any) is in I_RequiredGraphicsExtensions, and a program may have
         //  supplemented these if necessary by calling AddGraphicsExtensions().
                 
-        int HighestScore = 0;
-        VkPhysicalDevice SelectedDevice = nullptr;
-        bool HasPortabilitySubset = false;
+        std::vector<double> Scores;
+        
+        //  If the devices are to be ranked by benchmark, get any results cached from earlier runs.
+        
+        std::vector<std::string> CachedKeys;
+        std::vector<double> CachedRates;
+        bool CacheChanged = false;
+        if (I_BenchmarkDevices) ReadRankingCache(CachedKeys,CachedRates);
         
         //  Find out how many devices there are
         
@@ -778,9 +1419,9 @@ void KVVulkanFramework::FindSuitableDevice (bool& StatusOK)
             
             //  Work through every device in turn.
             
-            std::vector<VkPhysicalDevice> Devices(NumberDevices);
-            vkEnumeratePhysicalDevices(I_Instance,&NumberDevices,Devices.data());
-            for (VkPhysicalDevice Device : Devices) {
+            std::vector<VkPhysicalDevice> AllDevices(NumberDevices);
+            vkEnumeratePhysicalDevices(I_Instance,&NumberDevices,AllDevices.data());
+            for (VkPhysicalDevice Device : AllDevices) {
                 
                 if (I_Debug.Active("Device")) ShowDeviceDetails(Device);
                 
@@ -811,41 +1452,48 @@ void KVVulkanFramework::FindSuitableDevice (bool& StatusOK)
                     //  requirements. Trying to gauge its suitablity for the task in hand is
                     //  going to depend on the details of what we want it to do, so we offload
                     //  that to a RateDevices() routine that in principle could be overriden
-                    //  for a specific application. We keep track of which device is most
-                    //  highly rated. Since at this point we have access to its list of extensions,
-                    //  we also check for the portability subset - when we set up the device later
-                    //  we will need to know if it supports this.
+                    //  for a specific application. We insert each device into the list so
+                    //  the most highly rated come first (devices with equal scores stay in the
+                    //  order Vulkan lists them). Since at this point we have access to its list
+                    //  of extensions, we also check for the portability subset - when we set up
+                    //  the device later we will need to know if it supports this.
                     
-                    int Score = RateDevice(Device);
-                    if (Score > HighestScore) {
-                        HighestScore = Score;
-                        SelectedDevice = Device;
-                        HasPortabilitySubset = DeviceHasPortabilitySubset(DeviceExtensions);
+                    double Score = double(RateDevice(Device));
+                    if (Score > 0.0 && I_BenchmarkDevices) {
+                        bool Portable = DeviceHasPortabilitySubset(DeviceExtensions);
+                        std::string Key = DeviceKey(Device);
+                        double Rate = 0.0;
+                        for (size_t I = 0; I < CachedKeys.size(); I++) {
+                            if (CachedKeys[I] == Key) Rate = CachedRates[I];
+                        }
+                        if (Rate <= 0.0) {
+                            Rate = BenchmarkDevice(Device,Portable);
+                            if (Rate > 0.0) {
+                                CachedKeys.push_back(Key);
+                                CachedRates.push_back(Rate);
+                                CacheChanged = true;
+                            }
+                        }
+                        I_Debug.Logf("Device","Device benchmark %.0f MBytes/sec",Rate);
+                        
+                        //  Benchmark rates are all well above the capability scores, so any
+                        //  device for which the benchmark failed ranks below those that ran it.
+                        
+                        if (Rate > 0.0) Score = 1000.0 + Rate;
+                    }
+                    if (Score > 0.0) {
+                        size_t Posn = 0;
+                        while (Posn < Scores.size() && Scores[Posn] >= Score) Posn++;
+                        Scores.insert(Scores.begin() + Posn,Score);
+                        Devices.insert(Devices.begin() + Posn,Device);
+                        Portability.insert(Portability.begin() + Posn,
+                                               DeviceHasPortabilitySubset(DeviceExtensions));
                     }
                 }
                 
             }
         }
-        if (SelectedDevice) {
-            
-            //  Record the device we selected and record whether or not it supports double
-            //  precision (that's useful for computation) and if it supports (and therefore
-            //  requires) the portability subset (mainly the case for Macs).
-            
-            I_SelectedDevice = SelectedDevice;
-            I_DeviceHasPortabilitySubset = HasPortabilitySubset;
-            VkPhysicalDeviceFeatures Features;
-            vkGetPhysicalDeviceFeatures(SelectedDevice,&Features);
-            I_DeviceSupportsDouble = Features.shaderFloat64;
-            if (I_Debug.Active("Device")) {
-                VkPhysicalDeviceProperties Properties;
-                vkGetPhysicalDeviceProperties(SelectedDevice,&Properties);
-                I_Debug.Logf("Device","Selected Device: %s",Properties.deviceName);
-            }
-        } else {
-            LogError("Unable to find a suitable GPU.");
-            StatusOK = false;
-        }
+        if (CacheChanged) WriteRankingCache(CachedKeys,CachedRates);
     }
 }
 
@@ -874,99 +1522,563 @@ bool KVVulkanFramework::DeviceSupportsDouble (void)
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                           C r e a t e  L o g i c a l  D e v i c e
+//                    D e v i c e  S u p p o r t s  1 6  B i t  S t o r a g e
 //
-//  This is part of the basic initialisation sequence needed for Vulkan, which is essentially
-//  CreateVulkanInstance(), FindSuitableDevice() and CreateLogicalDevice(). Once a physical
-//  device has been selected, a logical device needs to be created and this is what we use
-//  to interact with the physical device through Vulkan. This involves enabling extensions,
-//  and setting up queues for use with the device. Queues in Vulkan are complicated, and this
-//  routine sets up the logical device with a very basic queue configuration - just one queue
-//  that supports compute and (if enabled) graphics.
+//  Can be used to find out if shaders run on the selected GPU can use 16-bit values - in
+//  particular half-precision floats, float16_t in GLSL - in storage buffers. If so, the
+//  storageBuffer16BitAccess feature will have been enabled when the logical device was created,
+//  and shaders can use the GL_EXT_shader_16bit_storage extension. Most current GPUs support
+//  this, but not all.
+//
+//  Returns:
+//      (bool)  True if 16-bit storage buffer access is supported, and has been enabled.
 //
-//  Parameters:
-//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
-//                   this routine returns immediately. If something goes wrong, the variable
-//                   will be set false.
 //  Pre-requisites:
-//      The physical device to use must have been selected through a call to FindSuitableDevice(),
-//      which in turn means CreateVulkanInstance() must have been called, together with any other
-//      optional routines such as EnableGraphics().
+//      CreateLogicalDevice() must have been called.
 
-void KVVulkanFramework::CreateLogicalDevice (bool& StatusOK)
+bool KVVulkanFramework::DeviceSupports16BitStorage (void)
 {
-    if (!AllOK(StatusOK)) return;
-    I_Debug.Log ("Progress","Creating Logical Device.");
-
-    //  Setting up the logical device - which is what we use to interact with the physical device -
-    //  once we've identified the physical device to use - involves specifically enabling any
-    //  extensions we need, and setting up any queues we are going to use. Eventually, we're
-    //  going to create the logical device with a call to VkCreateDevice(), and we pass most of
-    //  what's needed in a VkDeviceCreateInfo struture.
+    //  Pre-requisites:
+    //      CreateLogicalDevice() must have been called.
     
-    VkDeviceCreateInfo DeviceCreateInfo{};
-    DeviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    return I_16BitStorageSupported;
+}
 
-    //  We asssume we don't need any of the more complicated device features, and just pass a
-    //  default structure that doesn't enable anything fancy. However, if the device supports
-    //  double precision, we enable that.
-    
-    VkPhysicalDeviceFeatures EnabledDeviceFeatures{};
-    if (I_DeviceSupportsDouble) EnabledDeviceFeatures.shaderFloat64 = VK_TRUE;
-    DeviceCreateInfo.pEnabledFeatures = &EnabledDeviceFeatures;
-    
-    //  Queues are more complicated. Devices support multiple queues, bundled up into queue
-    //  'families' in which each member has the same capabilities (ie can do graphics, can
-    //  do compute, can do other things like memory transfers). Each queue family has its own
-    //  index number. The CreateInfo structure we pass to vkCreateDevice() includes an array of
-    //  VkDeviceQueueCreateInfo structures, one for each queue family we will use. Each of these
-    //  specifies the index number for the queue family, and the number of queues from that
-    //  family that we will use. A relatively simple program can use just one queue from a
-    //  family that supports both compute and graphics, or a compute-only program can use just
-    //  one queue that supports compute. A more complex program can submit multiple operations
-    //  to multiple queues in multiple families. It depends on the program, so a general-purpose
-    //  solution is tricky.
-    
-    //  For the moment, we look for just one queue family that supports both graphics (if enabled)
-    //  and compute.
-    
-    bool UseGraphics = I_GraphicsEnabled;
-    bool UseCompute = true;
-    I_QueueFamilyIndex = GetIndexForQueueFamilyToUse(UseGraphics,UseCompute,StatusOK);
-    
-    //  Now we can fill in the single VkDeviceQueueCreateInfo structure for this family, and
-    //  indicate that we'll only use one queue from that family. (Should test StatusOK ****)
-    
-    VkDeviceQueueCreateInfo QueueCreateInfo = {};
-    QueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    QueueCreateInfo.queueFamilyIndex = I_QueueFamilyIndex;
-    QueueCreateInfo.queueCount = 1;
-    
-    //  And we set that single structure into the overall CreateInfo structure. We need to specify
-    //  relative priorities for the queues we're using, but since there's only one, that doesn't
-    //  matter very much, and the priority array we submit is just one float value.
-    
-    DeviceCreateInfo.queueCreateInfoCount = 1;
-    DeviceCreateInfo.pQueueCreateInfos = &QueueCreateInfo;
-    float QueuePriorities = 1.0;
-    QueueCreateInfo.pQueuePriorities = &QueuePriorities;
+//  ------------------------------------------------------------------------------------------------
+//
+//                    S p a r s e  B u f f e r s  S u p p o r t e d
+//
+//  Can be used to find out if "SPARSE" buffers can be used on the selected GPU. A sparse buffer
+//  reserves a range of addresses for the GPU, but only has device memory for the parts of that
+//  range passed to CommitBufferRange(). This needs the sparseBinding and sparseResidencyBuffer
+//  features, which will have been enabled when the logical device was created if the device
+//  supports them and its main queue family can do sparse binding.
+//
+//  Returns:
+//      (bool)  True if sparse buffers are supported, and have been enabled.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called.
 
-    //  There may be specific extensions we need to enable. If all we want is compute capability,
-    //  that's there in all devices. There may be devices that don't actually support anything
-    //  more than compute, and if we want to actually use our GPU for graphics we may need to
-    //  enable extensions like VK_KHR_swapchain.
+bool KVVulkanFramework::SparseBuffersSupported (void)
+{
+    return I_SparseSupported;
+}
 
-    std::vector<const char *> EnabledExtensions;
-    I_Debug.Log ("Device","Using Required Graphics Extensions.");
-    for (const char* Extension : I_RequiredGraphicsExtensions) {
-        EnabledExtensions.push_back(Extension);
-    }
-    
+//  ------------------------------------------------------------------------------------------------
+//
+//               P i p e l i n e  S t a t i s t i c s  S u p p o r t e d
+//
+//  Can be used to find out if EnablePipelineStatistics() can count the compute shader
+//  invocations run by a command buffer on the selected GPU. This needs the pipelineStatisticsQuery
+//  feature, which will have been enabled when the logical device was created if the device
+//  supports it.
+//
+//  Returns:
+//      (bool)  True if pipeline statistics queries are supported, and have been enabled.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called.
+
+bool KVVulkanFramework::PipelineStatisticsSupported (void)
+{
+    return I_StatisticsSupported;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//             D e v i c e  S u p p o r t s  S u b g r o u p  A r i t h m e t i c
+//
+//  Can be used to find out if compute shaders run on the selected GPU can use the subgroup
+//  arithmetic operations - subgroupAdd(), subgroupMax() and so on, from the
+//  GL_KHR_shader_subgroup_arithmetic extension - which combine a value across all the
+//  invocations of a subgroup without going through shared memory. These are part of Vulkan 1.1,
+//  but a device needn't support them, or needn't support them in compute shaders.
+//
+//  Parameters:
+//
+//      (<) SubgroupSize (uint32_t*) If not null, receives the device's subgroup size - the
+//                       number of invocations that run in lockstep. Zero if not known.
+//
+//  Returns:
+//      (bool)  True if subgroup arithmetic can be used in compute shaders.
+//
+//  Pre-requisites:
+//      FindSuitableDevice() must have been called to select a physical device.
+
+bool KVVulkanFramework::DeviceSupportsSubgroupArithmetic (uint32_t* SubgroupSize)
+{
+    //  Pre-requisites:
+    //      FindSuitableDevice() must have been called to select a physical device.
+    
+    return DeviceSupportsSubgroupOperations(VK_SUBGROUP_FEATURE_ARITHMETIC_BIT,SubgroupSize);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//             D e v i c e  S u p p o r t s  S u b g r o u p  O p e r a t i o n s
+//
+//  The general form of DeviceSupportsSubgroupArithmetic(). A shader that uses subgroup
+//  operations declares the SPIR-V capabilities they need, and a pipeline can't be created from
+//  it unless the device supports them, so a program that has a subgroup version of a shader
+//  uses this to decide whether it can use it. Each class of operation has its own bit in
+//  VkSubgroupFeatureFlags, and its own GLSL extension: for example VK_SUBGROUP_FEATURE_VOTE_BIT
+//  for subgroupAny() and subgroupAll(), from GL_KHR_shader_subgroup_vote. The values are
+//  recorded when the device is selected.
+//
+//  Parameters:
+//
+//      (>) Operations   (VkSubgroupFeatureFlags) The operations needed, combined with '|'.
+//      (<) SubgroupSize (uint32_t*) If not null, receives the device's subgroup size - the
+//                       number of invocations that run in lockstep. Zero if not known.
+//
+//  Returns:
+//      (bool)  True if all the operations can be used in compute shaders.
+//
+//  Pre-requisites:
+//      FindSuitableDevice() must have been called to select a physical device.
+
+bool KVVulkanFramework::DeviceSupportsSubgroupOperations (VkSubgroupFeatureFlags Operations,
+                                                                      uint32_t* SubgroupSize)
+{
+    //  Pre-requisites:
+    //      FindSuitableDevice() must have been called to select a physical device.
+    
+    if (SubgroupSize) *SubgroupSize = I_SubgroupSize;
+    if (I_SelectedDevice == VK_NULL_HANDLE || I_SubgroupOperations == 0) return false;
+    return (I_SubgroupOperations & Operations) == Operations;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       G e t  D e v i c e  D e s c r i p t i o n
+//
+//  Returns the name of the selected GPU, and a description of the version of Vulkan it supports
+//  and of its driver, for a program to record along with timings made using it. Vulkan leaves
+//  the way the driver version is encoded up to the vendor, but most follow the Vulkan scheme,
+//  and NVIDIA's own scheme is the one exception that really matters.
+//
+//  Parameters:
+//      Name    (std::string*) Receives the name of the device.
+//      Driver  (std::string*) Receives the Vulkan and driver versions, eg "Vulkan 1.3.277,
+//                             driver 550.54.14".
+//
+//  Pre-requisites:
+//      FindSuitableDevice() must have been called.
+
+void KVVulkanFramework::GetDeviceDescription (std::string* Name,std::string* Driver)
+{
+    VkPhysicalDeviceProperties Properties;
+    vkGetPhysicalDeviceProperties(I_SelectedDevice,&Properties);
+    *Name = Properties.deviceName;
+    uint32_t Api = Properties.apiVersion;
+    uint32_t Version = Properties.driverVersion;
+    uint32_t Major = VK_API_VERSION_MAJOR(Version);
+    uint32_t Minor = VK_API_VERSION_MINOR(Version);
+    uint32_t Patch = VK_API_VERSION_PATCH(Version);
+    if (Properties.vendorID == 0x10DE) {
+        Major = (Version >> 22) & 0x3ff;
+        Minor = (Version >> 14) & 0x0ff;
+        Patch = (Version >> 6) & 0x0ff;
+    }
+    char Text[64];
+    snprintf(Text,sizeof(Text),"Vulkan %u.%u.%u, driver %u.%u.%u",VK_API_VERSION_MAJOR(Api),
+                             VK_API_VERSION_MINOR(Api),VK_API_VERSION_PATCH(Api),Major,Minor,Patch);
+    *Driver = Text;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          G e t  M e m o r y  S t a t s
+//
+//  Returns the memory use of each of the selected device's memory heaps - how much the Framework
+//  has allocated from it, how much of that is being used by buffers (the rest is free space in
+//  the pooled memory blocks), and the budget for it. If the device supports VK_EXT_memory_budget,
+//  the budget and the usage are as reported by the driver, and allow for other programs using
+//  the same GPU. If not, the budget is taken as a fixed fraction of the heap size, and the usage
+//  as what the Framework has allocated. A program can use this to see whether a large image will
+//  fit, or to explain why it didn't.
+//
+//  Parameters:
+//      Stats      (std::vector<KVHeapStats>*) Receives the details for each heap, in heap order.
+//      StatusOK   (bool&) A reference to an inherited status variable. If passed false,
+//                 this routine returns immediately. If something goes wrong, the variable
+//                 will be set false.
+//
+//  Pre-requisites:
+//      FindSuitableDevice() must have been called, and CreateLogicalDevice() too if the budget
+//      is to come from the driver.
+//
+//  Note:
+//      Memory imported from the host by ImportBuffer() isn't included in the Framework's own
+//      figures, as it belongs to the program, but the driver may include it in its usage.
+
+void KVVulkanFramework::GetMemoryStats(std::vector<KVHeapStats>* Stats,bool& StatusOK)
+{
+    Stats->clear();
+    if (!AllOK(StatusOK)) return;
+    
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    if (I_SelectedDevice == VK_NULL_HANDLE) {
+        LogError("Cannot get memory statistics, no device has been selected.");
+        StatusOK = false;
+        return;
+    }
+    GetHeapStats(Stats);
+    for (const KVHeapStats& Heap : *Stats) {
+        I_Debug.Logf("Buffers","Heap %u%s: size %llu, allocated %llu, used %llu, budget %llu, "
+                 "usage %llu%s",Heap.HeapIndex,Heap.DeviceLocal ? " (device local)" : "",
+                 (unsigned long long)Heap.HeapSize,(unsigned long long)Heap.Allocated,
+                 (unsigned long long)Heap.Used,(unsigned long long)Heap.Budget,
+                 (unsigned long long)Heap.Usage,Heap.BudgetReported ? "" : " (estimated)");
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     M e a s u r e  D e v i c e  B a n d w i d t h
+//
+//  Measures the memory bandwidth of the selected GPU, using the same fill and copy test as
+//  is used to rank devices when device benchmarking is enabled. For a program whose shaders
+//  are limited by memory bandwidth, this gives a practical peak to compare against - one
+//  that is usually rather more realistic than a figure calculated from the memory clock and
+//  bus width, which Vulkan doesn't provide in any case.
+//
+//  Parameters:
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Returns:
+//     (double)      The measured bandwidth in GBytes/sec (units of 10^9 bytes), counting
+//                   both bytes read and bytes written. Returns zero if it couldn't be measured.
+//
+//  Pre-requisites:
+//      FindSuitableDevice() must have been called to select a physical GPU device.
+//
+//  Note:
+//      The test runs on a temporary logical device of its own, so it doesn't interfere with
+//      anything already set up, but it does take a little time. A failure of the test itself
+//      only produces a warning and a zero result, and doesn't set StatusOK false.
+
+double KVVulkanFramework::MeasureDeviceBandwidth (bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return 0.0;
+    
+    if (I_SelectedDevice == VK_NULL_HANDLE) {
+        LogError("Cannot measure bandwidth, no device has been selected.");
+        StatusOK = false;
+        return 0.0;
+    }
+    double MBytesPerSec = BenchmarkDevice(I_SelectedDevice,I_DeviceHasPortabilitySubset);
+    double GBytesPerSec = MBytesPerSec * 1024.0 * 1024.0 / 1.0e9;
+    I_Debug.Logf("Device","Measured device bandwidth %.2f GBytes/sec",GBytesPerSec);
+    return GBytesPerSec;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           C r e a t e  L o g i c a l  D e v i c e
+//
+//  This is part of the basic initialisation sequence needed for Vulkan, which is essentially
+//  CreateVulkanInstance(), FindSuitableDevice() and CreateLogicalDevice(). Once a physical
+//  device has been selected, a logical device needs to be created and this is what we use
+//  to interact with the physical device through Vulkan. This involves enabling extensions,
+//  and setting up queues for use with the device. Queues in Vulkan are complicated, and this
+//  routine sets up the logical device with a very basic queue configuration - just one queue
+//  that supports compute and (if enabled) graphics.
+//
+//  Parameters:
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Pre-requisites:
+//      The physical device to use must have been selected through a call to FindSuitableDevice(),
+//      which in turn means CreateVulkanInstance() must have been called, together with any other
+//      optional routines such as EnableGraphics().
+
+void KVVulkanFramework::CreateLogicalDevice (bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    StartupPhase Phase("GPU logical device");
+    I_Debug.Log ("Progress","Creating Logical Device.");
+
+    //  Setting up the logical device - which is what we use to interact with the physical device -
+    //  once we've identified the physical device to use - involves specifically enabling any
+    //  extensions we need, and setting up any queues we are going to use. Eventually, we're
+    //  going to create the logical device with a call to VkCreateDevice(), and we pass most of
+    //  what's needed in a VkDeviceCreateInfo struture.
+    
+    VkDeviceCreateInfo DeviceCreateInfo{};
+    DeviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+
+    //  We asssume we don't need any of the more complicated device features, and just pass a
+    //  default structure that doesn't enable anything fancy. However, if the device supports
+    //  double precision, we enable that.
+    
+    VkPhysicalDeviceFeatures EnabledDeviceFeatures{};
+    if (I_DeviceSupportsDouble) EnabledDeviceFeatures.shaderFloat64 = VK_TRUE;
+    DeviceCreateInfo.pEnabledFeatures = &EnabledDeviceFeatures;
+    
+    //  Queues are more complicated. Devices support multiple queues, bundled up into queue
+    //  'families' in which each member has the same capabilities (ie can do graphics, can
+    //  do compute, can do other things like memory transfers). Each queue family has its own
+    //  index number. The CreateInfo structure we pass to vkCreateDevice() includes an array of
+    //  VkDeviceQueueCreateInfo structures, one for each queue family we will use. Each of these
+    //  specifies the index number for the queue family, and the number of queues from that
+    //  family that we will use. A relatively simple program can use just one queue from a
+    //  family that supports both compute and graphics, or a compute-only program can use just
+    //  one queue that supports compute. A more complex program can submit multiple operations
+    //  to multiple queues in multiple families. It depends on the program, so a general-purpose
+    //  solution is tricky.
+    
+    //  We always look for one main queue family that supports both graphics (if enabled) and
+    //  compute. If EnableSeparateQueues() has been called, we may also want queues for compute
+    //  and for transfers, preferably from families dedicated to those operations.
+    
+    bool UseGraphics = I_GraphicsEnabled;
+    bool UseCompute = true;
+    I_QueueFamilyIndex = GetIndexForQueueFamilyToUse(UseGraphics,UseCompute,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    uint32_t NumberFamilies;
+    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,nullptr);
+    std::vector<VkQueueFamilyProperties> QueueFamilies(NumberFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,QueueFamilies.data());
+    std::vector<uint32_t> QueuesUsed(NumberFamilies,0);
+    QueuesUsed[I_QueueFamilyIndex] = 1;
+    
+    //  By default, compute and transfers use the main queue, which is queue 0 of the main family.
+    
+    I_ComputeQueueFamilyIndex = I_TransferQueueFamilyIndex = I_QueueFamilyIndex;
+    I_ComputeQueueIndex = I_TransferQueueIndex = 0;
+    
+    //  "SPARSE" buffers need the sparseBinding and sparseResidencyBuffer features, and the
+    //  Framework binds their memory through the main queue, so its family has to support sparse
+    //  binding as well. If all that is available, the two features are enabled. (Most discrete
+    //  GPUs provide them, but MoltenVK and many integrated GPUs do not.)
+    
+    I_SparseSupported = false;
+    I_StatisticsSupported = false;
+    VkPhysicalDeviceFeatures SupportedFeatures;
+    vkGetPhysicalDeviceFeatures(I_SelectedDevice,&SupportedFeatures);
+    if (SupportedFeatures.sparseBinding && SupportedFeatures.sparseResidencyBuffer &&
+            (QueueFamilies[I_QueueFamilyIndex].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT)) {
+        EnabledDeviceFeatures.sparseBinding = VK_TRUE;
+        EnabledDeviceFeatures.sparseResidencyBuffer = VK_TRUE;
+        I_SparseSupported = true;
+        I_Debug.Log("Device","Sparse residency buffers supported.");
+    }
+    
+    //  Pipeline statistics queries - used by EnablePipelineStatistics() - need a feature of
+    //  their own. Nearly every desktop GPU has it, but some mobile ones don't.
+    
+    if (SupportedFeatures.pipelineStatisticsQuery) {
+        EnabledDeviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+        I_StatisticsSupported = true;
+        I_Debug.Log("Device","Pipeline statistics queries supported.");
+    }
+    if (I_SeparateComputeQueue) {
+        SelectSeparateQueue(VK_QUEUE_COMPUTE_BIT,VK_QUEUE_GRAPHICS_BIT,QueueFamilies,QueuesUsed,
+                                              &I_ComputeQueueFamilyIndex,&I_ComputeQueueIndex);
+        I_Debug.Logf("Device","Compute queue: family %d, queue %d",
+                                                    I_ComputeQueueFamilyIndex,I_ComputeQueueIndex);
+    }
+    if (I_SeparateTransferQueue) {
+        SelectSeparateQueue(VK_QUEUE_TRANSFER_BIT,VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT,
+                     QueueFamilies,QueuesUsed,&I_TransferQueueFamilyIndex,&I_TransferQueueIndex);
+        I_Debug.Logf("Device","Transfer queue: family %d, queue %d",
+                                                  I_TransferQueueFamilyIndex,I_TransferQueueIndex);
+    }
+    
+    //  If SetComputeQueueCount() asked for more than one compute queue, the others are taken
+    //  from whatever the compute family has left once the separate queues have been chosen.
+    
+    I_ComputeQueueIndices.assign(1,I_ComputeQueueIndex);
+    uint32_t ComputeFamily = I_ComputeQueueFamilyIndex;
+    while (int(I_ComputeQueueIndices.size()) < I_ComputeQueuesWanted &&
+                         QueuesUsed[ComputeFamily] < QueueFamilies[ComputeFamily].queueCount) {
+        I_ComputeQueueIndices.push_back(QueuesUsed[ComputeFamily]++);
+    }
+    if (I_ComputeQueuesWanted > 1) {
+        I_Debug.Logf("Device","%d compute queues requested, %d available from family %d",
+                          I_ComputeQueuesWanted,int(I_ComputeQueueIndices.size()),ComputeFamily);
+    }
+    
+    //  Now we can fill in a VkDeviceQueueCreateInfo structure for each family we're using,
+    //  giving the number of queues we'll use from that family. We need to specify relative
+    //  priorities for the queues, but we give them all the same priority, so the one priority
+    //  array will do for all of them.
+    
+    std::vector<VkDeviceQueueCreateInfo> QueueCreateInfos;
+    uint32_t MaxQueues = 1;
+    for (uint32_t Family = 0; Family < NumberFamilies; Family++) {
+        if (QueuesUsed[Family] > MaxQueues) MaxQueues = QueuesUsed[Family];
+    }
+    std::vector<float> QueuePriorities(MaxQueues,1.0);
+    for (uint32_t Family = 0; Family < NumberFamilies; Family++) {
+        if (QueuesUsed[Family] > 0) {
+            VkDeviceQueueCreateInfo QueueCreateInfo = {};
+            QueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            QueueCreateInfo.queueFamilyIndex = Family;
+            QueueCreateInfo.queueCount = QueuesUsed[Family];
+            QueueCreateInfo.pQueuePriorities = QueuePriorities.data();
+            QueueCreateInfos.push_back(QueueCreateInfo);
+        }
+    }
+    DeviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(QueueCreateInfos.size());
+    DeviceCreateInfo.pQueueCreateInfos = QueueCreateInfos.data();
+
+    //  There may be specific extensions we need to enable. If all we want is compute capability,
+    //  that's there in all devices. There may be devices that don't actually support anything
+    //  more than compute, and if we want to actually use our GPU for graphics we may need to
+    //  enable extensions like VK_KHR_swapchain.
+
+    std::vector<const char *> EnabledExtensions;
+    I_Debug.Log ("Device","Using Required Graphics Extensions.");
+    for (const char* Extension : I_RequiredGraphicsExtensions) {
+        EnabledExtensions.push_back(Extension);
+    }
+    
     //  And if the device supports it, we have to enable the VK_KHR_portability_subset. See the
     //  comments in DeviceHasPortabilitySubset() for the gory details.
     
     if (I_DeviceHasPortabilitySubset) EnabledExtensions.push_back("VK_KHR_portability_subset");
 
+    //  If the device supports VK_EXT_external_memory_host, we enable it, so that ImportBuffer()
+    //  can have the GPU use host memory allocated by the program directly, without a copy. We
+    //  also need to know the alignment the device requires for such memory.
+    
+    I_HostImportSupported = false;
+    I_HostImportAlignment = C_HostImportAlignment;
+    uint32_t NumberExtensions;
+    vkEnumerateDeviceExtensionProperties(I_SelectedDevice,nullptr,&NumberExtensions,nullptr);
+    std::vector<VkExtensionProperties> DeviceExtensions(NumberExtensions);
+    vkEnumerateDeviceExtensionProperties(I_SelectedDevice,nullptr,&NumberExtensions,
+                                                                      DeviceExtensions.data());
+    for (const VkExtensionProperties& Property : DeviceExtensions) {
+        if (!strcmp(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,Property.extensionName)) {
+            VkPhysicalDeviceExternalMemoryHostPropertiesEXT HostProperties{};
+            HostProperties.sType =
+                          VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 Properties2{};
+            Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            Properties2.pNext = &HostProperties;
+            vkGetPhysicalDeviceProperties2(I_SelectedDevice,&Properties2);
+            if (HostProperties.minImportedHostPointerAlignment > 0) {
+                I_HostImportAlignment = HostProperties.minImportedHostPointerAlignment;
+            }
+            EnabledExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+            I_HostImportSupported = true;
+            I_Debug.Logf("Device","Host memory import supported, alignment %ld bytes",
+                                                                 long(I_HostImportAlignment));
+            break;
+        }
+    }
+    
+    //  If the device supports VK_EXT_memory_budget, we enable that too. It lets GetHeapStats()
+    //  find out how much of each memory heap the driver thinks this program can use, and how
+    //  much it is using, which allows for memory used by other programs, and by the driver.
+    
+    I_MemoryBudgetSupported = false;
+    for (const VkExtensionProperties& Property : DeviceExtensions) {
+        if (!strcmp(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,Property.extensionName)) {
+            EnabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            I_MemoryBudgetSupported = true;
+            I_Debug.Log("Device","Memory budget reporting supported.");
+            break;
+        }
+    }
+    
+    //  Similarly, if the device supports VK_KHR_buffer_device_address, and its bufferDeviceAddress
+    //  feature, we enable both, so that GetBufferAddress() can provide the GPU address of a
+    //  storage buffer. A shader given that address - usually in a push constant - can access the
+    //  buffer without it having to be bound through a descriptor set. (This is core in Vulkan 1.2,
+    //  but the Framework asks for 1.1, so the extension is needed.) The feature structure is
+    //  passed to vkCreateDevice() through the pNext chain, so has to stay in scope until then.
+    //  FeatureChain is the head of that chain, as other features may be added to it.
+    
+    void* FeatureChain = nullptr;
+    I_BufferAddressSupported = false;
+    VkPhysicalDeviceBufferDeviceAddressFeaturesKHR AddressFeatures{};
+    AddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+    for (const VkExtensionProperties& Property : DeviceExtensions) {
+        if (!strcmp(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,Property.extensionName)) {
+            VkPhysicalDeviceFeatures2 Features2{};
+            Features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            Features2.pNext = &AddressFeatures;
+            vkGetPhysicalDeviceFeatures2(I_SelectedDevice,&Features2);
+            if (AddressFeatures.bufferDeviceAddress) {
+                AddressFeatures.bufferDeviceAddressCaptureReplay = VK_FALSE;
+                AddressFeatures.bufferDeviceAddressMultiDevice = VK_FALSE;
+                AddressFeatures.pNext = FeatureChain;
+                FeatureChain = &AddressFeatures;
+                EnabledExtensions.push_back(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+                I_BufferAddressSupported = true;
+                I_Debug.Log("Device","Buffer device addresses supported.");
+            }
+            break;
+        }
+    }
+    
+    //  And the same goes for VK_KHR_timeline_semaphore and its timelineSemaphore feature. A
+    //  timeline semaphore holds a 64-bit value that only ever increases, and a submission can
+    //  wait until it reaches a given value, so one semaphore can order a whole sequence of
+    //  submissions - say, the compute and then the rendering of successive frames - entirely
+    //  on the GPU. The CPU can also wait for, or read, the value. (Also core in Vulkan 1.2.)
+    
+    I_TimelineSupported = false;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR TimelineFeatures{};
+    TimelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    for (const VkExtensionProperties& Property : DeviceExtensions) {
+        if (!strcmp(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,Property.extensionName)) {
+            VkPhysicalDeviceFeatures2 Features2{};
+            Features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            Features2.pNext = &TimelineFeatures;
+            vkGetPhysicalDeviceFeatures2(I_SelectedDevice,&Features2);
+            if (TimelineFeatures.timelineSemaphore) {
+                TimelineFeatures.pNext = FeatureChain;
+                FeatureChain = &TimelineFeatures;
+                EnabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+                I_TimelineSupported = true;
+                I_Debug.Log("Device","Timeline semaphores supported.");
+            }
+            break;
+        }
+    }
+    
+    //  16-bit storage is a little different. VK_KHR_16bit_storage is core in Vulkan 1.1, which is
+    //  what the Framework asks for, so the feature can be queried whether the extension is listed
+    //  or not - but the extension is still enabled if it is, for the benefit of older drivers. If
+    //  storageBuffer16BitAccess is supported, shaders can hold half-precision values in storage
+    //  buffers, converting them to and from 32-bit floats as they load and store them. That halves
+    //  the memory traffic for code that can live with the loss of precision. (Doing arithmetic
+    //  in half precision needs a separate feature, shaderFloat16, which isn't asked for here.)
+    
+    I_16BitStorageSupported = false;
+    VkPhysicalDevice16BitStorageFeatures StorageFeatures{};
+    StorageFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+    VkPhysicalDeviceFeatures2 StorageFeatures2{};
+    StorageFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    StorageFeatures2.pNext = &StorageFeatures;
+    vkGetPhysicalDeviceFeatures2(I_SelectedDevice,&StorageFeatures2);
+    if (StorageFeatures.storageBuffer16BitAccess) {
+        StorageFeatures.uniformAndStorageBuffer16BitAccess = VK_FALSE;
+        StorageFeatures.storagePushConstant16 = VK_FALSE;
+        StorageFeatures.storageInputOutput16 = VK_FALSE;
+        StorageFeatures.pNext = FeatureChain;
+        FeatureChain = &StorageFeatures;
+        for (const VkExtensionProperties& Property : DeviceExtensions) {
+            if (!strcmp(VK_KHR_16BIT_STORAGE_EXTENSION_NAME,Property.extensionName)) {
+                EnabledExtensions.push_back(VK_KHR_16BIT_STORAGE_EXTENSION_NAME);
+                break;
+            }
+        }
+        I_16BitStorageSupported = true;
+        I_Debug.Log("Device","16-bit storage buffer access supported.");
+    }
+    DeviceCreateInfo.pNext = FeatureChain;
+
     //  Now we can set the details of the required device entensions in the information structure.
     
     DeviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(EnabledExtensions.size());
@@ -995,32 +2107,178 @@ void KVVulkanFramework::CreateLogicalDevice (bool& StatusOK)
         StatusOK = false;
     } else {
         I_Debug.Log("Progress","Vulkan logical device created OK.");
+        
+        //  The buffer memory allocation code needs to know the device's buffer/image granularity,
+        //  which limits how closely different types of resource can be packed into a single block
+        //  of device memory. See AllocateBlockMemory().
+        
+        VkPhysicalDeviceProperties DeviceProperties;
+        vkGetPhysicalDeviceProperties(I_SelectedDevice,&DeviceProperties);
+        I_BufferImageGranularity = DeviceProperties.limits.bufferImageGranularity;
+        if (I_BufferImageGranularity < 1) I_BufferImageGranularity = 1;
+        
+        //  Flushing or invalidating non-coherent memory has to be done in whole 'atoms'.
+        //  See SyncMappedMemory().
+        
+        I_NonCoherentAtomSize = DeviceProperties.limits.nonCoherentAtomSize;
+        if (I_NonCoherentAtomSize < 1) I_NonCoherentAtomSize = 1;
+        
+        //  A descriptor can describe no more than this much of a storage buffer - often 4 GBytes
+        //  less one, sometimes only 128 MBytes. See SetupVulkanDescriptorSet().
+        
+        I_MaxStorageBufferRange = DeviceProperties.limits.maxStorageBufferRange;
+        
+        //  vkGetMemoryHostPointerPropertiesEXT() is an extension routine, so has to be looked up.
+        
+        if (I_HostImportSupported) {
+            I_GetMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)
+                 vkGetDeviceProcAddr(I_LogicalDevice,"vkGetMemoryHostPointerPropertiesEXT");
+            if (I_GetMemoryHostPointerProperties == nullptr) I_HostImportSupported = false;
+        }
+        
+        //  So is vkGetBufferDeviceAddressKHR(), used by GetBufferAddress().
+        
+        if (I_BufferAddressSupported) {
+            I_GetBufferDeviceAddress = (PFN_vkGetBufferDeviceAddressKHR)
+                 vkGetDeviceProcAddr(I_LogicalDevice,"vkGetBufferDeviceAddressKHR");
+            if (I_GetBufferDeviceAddress == nullptr) I_BufferAddressSupported = false;
+        }
+        
+        //  As are the timeline semaphore routines used by WaitForSemaphoreValue() and
+        //  GetSemaphoreValue().
+        
+        if (I_TimelineSupported) {
+            I_WaitSemaphores = (PFN_vkWaitSemaphoresKHR)
+                 vkGetDeviceProcAddr(I_LogicalDevice,"vkWaitSemaphoresKHR");
+            I_GetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)
+                 vkGetDeviceProcAddr(I_LogicalDevice,"vkGetSemaphoreCounterValueKHR");
+            if (I_WaitSemaphores == nullptr || I_GetSemaphoreCounterValue == nullptr) {
+                I_TimelineSupported = false;
+            }
+        }
+        
+        //  And we can set up the pipeline cache, loading anything saved by a previous run.
+        
+        LoadPipelineCache(StatusOK);
     }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                             S e t  B u f f e r  D e t a i l s
+//                            S t a r t  D e v i c e  S e t u p
 //
-//  Handling buffers is complicated, and is one place where the Framework provides a bit more
-//  help than just acting as a wrapper for Vulkan calls. It keeps track of all the details
-//  relating to a buffer internally, and provides its own opaque 'handle' for the calling program
-//  to use when dealing with the buffer. SetBufferDetails() should be the first routine called
-//  when a new buffer is to be created. It sets up the internal housekeeping to keep track of the
-//  buffer and returns the new handle associated with that buffer. Vulkan pipelines need to know
-//  many details of the buffers they will use, and these have to be set up in advance. A pipeline
-//  needs to know in advance what sort of buffers it will be handling, but creation of the actual
-//  buffers and allocation of the memory they will use can be deferred until later. And a pipeline
-//  can be re-used with different actual buffers, so long as they match the way it was set up.
-//  The code that actually runs on the GPU will use a 'binding' number to identify the buffer,
-//  and the number supplied in this call must match that used by the GPU code (in the layout
-//  specification in the GLSL file). The buffer details also have to describe the type of
-//  buffer and the way it is accessed. Note that the size of the buffer does not have to specified
-//  at this point, all that's needed are its type and the way it will be accessed. If the buffer
-//  is to be used to hold vertices for graphical purposes, SetVertexBufferDetails() should be
-//  called after SetBufferDetails() to add the needed vertex layout information.
+//  Creating the Vulkan instance and the logical device can take a good fraction of a second -
+//  longer than many programs spend on the GPU - most of it in the Vulkan loader and the driver,
+//  and none of it needs anything from the program beyond the options it has already set. This
+//  routine starts a separate thread that calls CreateVulkanInstance(), FindSuitableDevice() and
+//  CreateLogicalDevice(), and returns at once, so the program can get on with other things -
+//  reading its input file, say, or calling PreloadShaderFile() - while that goes on. It must
+//  then call WaitForDeviceSetup() before it makes any other Framework call that needs the
+//  device. If the thread can't be started, the setup is simply done before this returns.
 //
-//  Parameters:
+//  Pre-requisites:
+//     Anything that needs to be set before CreateVulkanInstance() or CreateLogicalDevice() are
+//     called - EnableValidation(), SetDebugLevels(), AddInstanceExtensions() and so on - must
+//     have been called first. This can't be used with EnableGraphics(), as the windowing system
+//     usually expects to be used from the main thread.
+
+void KVVulkanFramework::StartDeviceSetup (void)
+{
+    if (I_DeviceSetupThread.joinable()) return;
+    I_DeviceSetupOK = true;
+    auto Setup = [this]() {
+        if (TraceRecorder::Global().Enabled()) {
+            TraceRecorder::Global().SetThreadName("Device setup");
+        }
+        CreateVulkanInstance(I_DeviceSetupOK);
+        FindSuitableDevice(I_DeviceSetupOK);
+        CreateLogicalDevice(I_DeviceSetupOK);
+    };
+    try {
+        I_DeviceSetupThread = std::thread(Setup);
+    } catch (const std::system_error&) {
+        I_Debug.Log("Progress","Unable to start device setup thread, setting up now.");
+        Setup();
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          W a i t  F o r  D e v i c e  S e t u p
+//
+//  Waits for the setup started by StartDeviceSetup() to finish. If that setup failed, the
+//  StatusOK variable is set false. It's harmless to call this if StartDeviceSetup() wasn't called,
+//  or to call it more than once.
+//
+//  Parameters:
+//     StatusOK      (bool&) A reference to an inherited status variable. If the setup failed,
+//                   the variable will be set false.
+
+void KVVulkanFramework::WaitForDeviceSetup (bool& StatusOK)
+{
+    if (I_DeviceSetupThread.joinable()) I_DeviceSetupThread.join();
+    if (!I_DeviceSetupOK) StatusOK = false;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           P r e l o a d  S h a d e r  F i l e
+//
+//  Reads a file of SPIR-V shader code, and keeps it, so that when a pipeline is created from
+//  that file - by CreateComputePipeline(), say - it doesn't have to be read then. This lets a
+//  program read the shader files it's going to need while StartDeviceSetup() is creating the
+//  device, or just lets the time spent reading them be measured separately. Reading a file
+//  that has already been preloaded does nothing.
+//
+//  Parameters:
+//     Filename      (const std::string&) The name of the file containing the SPIR-V code.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Pre-requisites:
+//     None. This makes no Vulkan calls, so can be called at any time, from any thread.
+
+void KVVulkanFramework::PreloadShaderFile (const std::string& Filename,bool& StatusOK)
+{
+    if (!StatusOK) return;
+    {
+        std::lock_guard<std::mutex> Lock(I_PreloadMutex);
+        if (I_PreloadedShaders.count(Filename) > 0) return;
+    }
+    long LengthInBytes = 0;
+    uint32_t* Code = ReadSpirVFile(Filename,&LengthInBytes,StatusOK);
+    if (Code) {
+        long LengthInUint32s = (LengthInBytes + sizeof(uint32_t) - 1)/sizeof(uint32_t);
+        std::lock_guard<std::mutex> Lock(I_PreloadMutex);
+        I_PreloadedShaders[Filename] =
+                  std::make_pair(LengthInBytes,std::vector<uint32_t>(Code,Code + LengthInUint32s));
+        delete[] Code;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             S e t  B u f f e r  D e t a i l s
+//
+//  Handling buffers is complicated, and is one place where the Framework provides a bit more
+//  help than just acting as a wrapper for Vulkan calls. It keeps track of all the details
+//  relating to a buffer internally, and provides its own opaque 'handle' for the calling program
+//  to use when dealing with the buffer. SetBufferDetails() should be the first routine called
+//  when a new buffer is to be created. It sets up the internal housekeeping to keep track of the
+//  buffer and returns the new handle associated with that buffer. Vulkan pipelines need to know
+//  many details of the buffers they will use, and these have to be set up in advance. A pipeline
+//  needs to know in advance what sort of buffers it will be handling, but creation of the actual
+//  buffers and allocation of the memory they will use can be deferred until later. And a pipeline
+//  can be re-used with different actual buffers, so long as they match the way it was set up.
+//  The code that actually runs on the GPU will use a 'binding' number to identify the buffer,
+//  and the number supplied in this call must match that used by the GPU code (in the layout
+//  specification in the GLSL file). The buffer details also have to describe the type of
+//  buffer and the way it is accessed. Note that the size of the buffer does not have to specified
+//  at this point, all that's needed are its type and the way it will be accessed. If the buffer
+//  is to be used to hold vertices for graphical purposes, SetVertexBufferDetails() should be
+//  called after SetBufferDetails() to add the needed vertex layout information.
+//
+//  Parameters:
 //     Binding       (long) A number that must match the binding specified for the buffer in
 //                   the 'layout' statement in the GLSL code that will use this buffer.
 //     Type          (std::string&) A string describing the type of the buffer. One of:
@@ -1028,15 +2286,28 @@ void KVVulkanFramework::CreateLogicalDevice (bool& StatusOK)
 //                             GPU code. Often used to pass parameter values.
 //                   "STORAGE" The buffer contains general-purpose data, often arrays.
 //                   "VERTEX"  The buffer contains vertex data (used by graphics programs).
+//                   "VERTEX_STORAGE" The buffer contains vertex data that is written by a
+//                             compute shader, so it can also be used as a "STORAGE" buffer.
 //     Access        (std::string&) A string describing the way the GPU accesses the buffer.
 //                   "LOCAL"      The buffer data is local to the GPU. This is usually fast for the
 //                                GPU to access, but the CPU cannot see it at all.
 //                   "SHARED"     The buffer data can be accessed by both CPU and GPU. This may
-//                                introduce overheads in accessing it.
+//                                introduce overheads in accessing it. A "UNIFORM" buffer with
+//                                this access goes into device-local memory if the CPU can
+//                                see any - see SetBufferHostWriteOnly().
 //                   "STAGED_CPU" The buffer data is written into a CPU buffer and then transferred
 //                                to a buffer on the GPU when it is needed.
 //                   "STAGED_GPU" The buffer data is written into a GPU buffer and then transferred
 //                                to a buffer on the CPU when it is needed.
+//                   "IMPORTED"   The buffer uses memory already allocated by the program. It has
+//                                to be created using ImportBuffer() rather than CreateBuffer().
+//                   "READBACK"   Like "SHARED", but for data written by the GPU and read by the
+//                                CPU. Cached memory is used if there is any, since CPU reads from
+//                                uncached memory are slow. SyncBuffer() should be called once the
+//                                GPU has written the data, before the CPU reads it.
+//                   "SPARSE"     Like "LOCAL", but CreateBuffer() only reserves the address range
+//                                for the buffer, and device memory is committed to parts of it
+//                                by CommitBufferRange(). See SparseBuffersSupported().
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
@@ -1048,6 +2319,11 @@ void KVVulkanFramework::CreateLogicalDevice (bool& StatusOK)
 //     a handle to them without making any Vulkan calls at all.
 //
 //  Notes:
+//     o Where a memory type with all the properties that suit the access is not available, the
+//     Framework will settle for one that has the essential properties. For example, "READBACK"
+//     and "STAGED_GPU" need memory the CPU can see, and prefer it to be cached, while the CPU
+//     side of a "STAGED_CPU" buffer is only written by the CPU, and prefers coherent memory,
+//     which is often uncached 'write-combined' memory that is fast for the CPU to fill.
 //     o Although in principle you don't need to know this, the handle is merely an integer that
 //     serves as an index into a vector of structures maintained by the Framework that describe
 //     all the allocated buffers. The index starts from 1, allowing 0 to indicate an invalid
@@ -1064,12 +2340,14 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
     //  details are stored, plus 1 (so that a zero handle indicates an invalid or null handle).
     
     if (!AllOK(StatusOK)) return 0;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
 
     I_Debug.Logf ("Buffers", "Setting new buffer details, binding %d, type %s, access %s",
                                                        Binding,Type.c_str(),Access.c_str());
     KVBufferHandle ReturnedHandle = 0;
     VkBufferUsageFlags UsageFlags = 0;
     VkMemoryPropertyFlags PropertyFlags = 0;
+    VkMemoryPropertyFlags PreferredFlags = 0;
     VkBufferUsageFlags SecondaryUsageFlags = 0;
     VkMemoryPropertyFlags SecondaryPropertyFlags = 0;
     KVBufferType BufferType = TYPE_UNKNOWN;
@@ -1079,18 +2357,31 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
         BufferType = TYPE_UNIFORM;
     } else if (Type == "STORAGE") {
         UsageFlags |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        
+        //  If we can, we make storage buffers addressable, so GetBufferAddress() can be used.
+        
+        if (I_BufferAddressSupported) UsageFlags |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
         BufferType = TYPE_STORAGE;
     } else if (Type == "VERTEX") {
         UsageFlags |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
         BufferType = TYPE_VERTEX;
+    } else if (Type == "VERTEX_STORAGE") {
+        
+        //  As far as descriptor sets are concerned, this is a storage buffer. Its vertex layout
+        //  is set by SetVertexBufferDetails() as for any vertex buffer.
+        
+        UsageFlags |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        BufferType = TYPE_STORAGE;
     } else {
         LogError ("Invalid buffer type '%s' specified.",Type.c_str());
         StatusOK = false;
     }
     if (Access == "LOCAL") {
         
-        //  Just one buffer, and it's a local one, visible to the GPU but not the CPU.
+        //  Just one buffer, and it's a local one, visible to the GPU but not the CPU. It can
+        //  be the destination of a copy, so that AllocateUpload() can be used to fill it.
         
+        UsageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
         PropertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
         BufferAccess = ACCESS_LOCAL;
         
@@ -1104,6 +2395,17 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
                  VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
         BufferAccess = ACCESS_SHARED;
         
+        //  A uniform buffer is small, written by the CPU and read by every invocation on the
+        //  GPU, so it's better off in device-local memory the CPU can see, if there is any.
+        //  It doesn't need to be cached, since the CPU doesn't read it.
+        
+        if (BufferType == TYPE_UNIFORM) {
+            PropertyFlags =
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            PreferredFlags =
+                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        }
+        
     } else if (Access == "STAGED_CPU") {
         
         //  Two buffers, the main one filled by the CPU and then its data transferred explicitly
@@ -1115,9 +2417,12 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                  VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
          */
-        PropertyFlags |=
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                 VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        //  The CPU only writes this buffer, so it doesn't need to be cached, and the first
+        //  coherent type is usually write-combined memory, which suits this well. If it isn't
+        //  coherent, SyncBuffer() flushes it before the copy.
+        
+        PropertyFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        PreferredFlags |= VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         SecondaryUsageFlags = UsageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
         SecondaryPropertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
         BufferAccess = ACCESS_STAGED_CPU;
@@ -1129,14 +2434,51 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
         //  filled by the GPU, the data can be explicitly transferred to the main, CPU-visible,
         //  buffer.
         
+        //  The CPU reads this buffer, so we want it cached if possible. If it isn't coherent,
+        //  SyncBuffer() invalidates it after the copy.
+        
         UsageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-        PropertyFlags |=
-                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                 VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        PropertyFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        PreferredFlags |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         SecondaryUsageFlags = UsageFlags | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
         SecondaryPropertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
         BufferAccess = ACCESS_STAGED_GPU;
         
+    } else if (Access == "IMPORTED") {
+        
+        //  Just one buffer, whose memory is host memory supplied by the program. If the device
+        //  can't import it, ImportBuffer() falls back to treating this as a shared buffer, so
+        //  the property flags are the same as for "SHARED".
+        
+        PropertyFlags |=
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        BufferAccess = ACCESS_IMPORTED;
+        
+    } else if (Access == "READBACK") {
+        
+        //  Just one buffer, visible to both CPU and GPU, but written by the GPU and read by the
+        //  CPU. The CPU reads will be much faster from cached memory, and if the memory isn't
+        //  coherent, SyncBuffer() invalidates it before the CPU reads it.
+        
+        //  The GPU may also write it by copying into it - see CaptureGraphicsFrame().
+        
+        UsageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        PropertyFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        PreferredFlags |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        BufferAccess = ACCESS_READBACK;
+        
+    } else if (Access == "SPARSE") {
+        
+        //  Just one buffer, local to the GPU, whose memory is bound a range at a time by
+        //  CommitBufferRange(). Like "LOCAL", it can be filled using AllocateUpload(). It isn't
+        //  given a device address, since that would have to stay fixed as memory comes and goes.
+        
+        UsageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        UsageFlags &= ~VkBufferUsageFlags(VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR);
+        PropertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        BufferAccess = ACCESS_SPARSE;
+        
     } else {
         LogError ("Invalid buffer access '%s' specified",Access.c_str());
         StatusOK = false;
@@ -1187,14 +2529,25 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
         BufferDetails.MainBufferMemoryHndl = VK_NULL_HANDLE;
         BufferDetails.MainUsageFlags = UsageFlags;
         BufferDetails.MainPropertyFlags = PropertyFlags;
+        BufferDetails.MainPreferredFlags = PreferredFlags;
         BufferDetails.SecondaryBufferHndl = VK_NULL_HANDLE;
         BufferDetails.SecondaryBufferMemoryHndl = VK_NULL_HANDLE;
         BufferDetails.SecondaryUsageFlags = SecondaryUsageFlags;
         BufferDetails.SecondaryPropertyFlags = SecondaryPropertyFlags;
+        BufferDetails.MainAllocation = {-1,0,0};
+        BufferDetails.SecondaryAllocation = {-1,0,0};
+        BufferDetails.SyncCommandBufferHndl = VK_NULL_HANDLE;
+        BufferDetails.SyncCommandPoolHndl = VK_NULL_HANDLE;
+        BufferDetails.SyncRecorded = false;
+        BufferDetails.SyncTicket = KV_NULL_TICKET;
         //  These are simply null values for the binding descriptor.
         BufferDetails.BindingDescr.binding = 0;
         BufferDetails.BindingDescr.stride = 0;
         BufferDetails.BindingDescr.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        BufferDetails.SparsePageSize = 0;
+        BufferDetails.SparseMemoryTypeBits = 0;
+        BufferDetails.Concurrent = false;
+        BufferDetails.TransientGroup = -1;
         I_BufferDetails[Index] = BufferDetails;
     }
     I_Debug.Logf ("Buffers","Buffer handle returned as %p",ReturnedHandle);
@@ -1222,7 +2575,7 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
 //  Parameters:
 //     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
 //                   as returned by SetBufferDetails().
-//     SizeInBytes   (long) The size of the buffer in bytes.
+//     SizeInBytes   (VkDeviceSize) The size of the buffer in bytes.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
@@ -1234,22 +2587,45 @@ KVVulkanFramework::KVBufferHandle KVVulkanFramework::SetBufferDetails (
 //     how the buffer will be used and to return the buffer handle that is passed to this
 //     routine. The buffer should not have already been created - to change the size of an
 //     existing buffer, use ResizeBuffer().
+//
+//  Note:
+//     For a "SPARSE" buffer, this only reserves SizeInBytes of address space for the buffer,
+//     and allocates no memory. See CommitBufferRange().
 
-void KVVulkanFramework::CreateBuffer (KVBufferHandle BufferHandle,long SizeInBytes,bool& StatusOK)
+void KVVulkanFramework::CreateBuffer (KVBufferHandle BufferHandle,VkDeviceSize SizeInBytes,
+                                                                                bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
+    TraceScope Trace("CreateBuffer","Vulkan");
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
     int Index = BufferIndexFromHandle(BufferHandle,StatusOK);
     if (AllOK(StatusOK)) {
-        if (SizeInBytes <= 0) {
-            LogError ("Invalid buffer size (%d bytes) specified",SizeInBytes);
+        if (SizeInBytes == 0) {
+            LogError ("Invalid buffer size (0 bytes) specified");
+            StatusOK = false;
+        }
+    }
+    if (AllOK(StatusOK)) {
+        if (I_BufferDetails[Index].BufferAccess == ACCESS_IMPORTED) {
+            LogError ("An \"IMPORTED\" buffer has to be created using ImportBuffer()");
             StatusOK = false;
         }
     }
     if (AllOK(StatusOK)) {
         if (I_BufferDetails[Index].MainBufferHndl != VK_NULL_HANDLE) {
-            LogError ("Attempt to create already existing buffer of %d bytes",SizeInBytes);
+            LogError ("Attempt to create already existing buffer of %llu bytes",
+                                                               (unsigned long long)SizeInBytes);
             StatusOK = false;
             //  We could simply extend the existing buffer - should we?
+        } else if (I_BufferDetails[Index].BufferAccess == ACCESS_SPARSE) {
+            
+            //  A sparse buffer is quite different, and has a routine of its own.
+            
+            CreateSparseBuffer(Index,SizeInBytes,StatusOK);
+            
         } else {
             
             //  Create the main (and perhaps the only) actual vulkan buffer.
@@ -1258,14 +2634,18 @@ void KVVulkanFramework::CreateBuffer (KVBufferHandle BufferHandle,long SizeInByt
             VkDeviceMemory BufferMemory;
             VkBufferUsageFlags UsageFlags = I_BufferDetails[Index].MainUsageFlags;
             VkMemoryPropertyFlags PropertyFlags = I_BufferDetails[Index].MainPropertyFlags;
-            CreateVulkanBuffer(SizeInBytes,UsageFlags,PropertyFlags,&Buffer,
-                                                      &BufferMemory,StatusOK);
+            VkMemoryPropertyFlags PreferredFlags = I_BufferDetails[Index].MainPreferredFlags;
+            CreateVulkanBuffer(SizeInBytes,UsageFlags,PropertyFlags,PreferredFlags,&Buffer,
+                            &BufferMemory,&I_BufferDetails[Index].MainAllocation,StatusOK,
+                                                              I_BufferDetails[Index].Concurrent);
             if (AllOK(StatusOK)) {
-                I_Debug.Logf ("Buffers","VkBuffer %p created, size %ld bytes.",Buffer,SizeInBytes);
+                I_Debug.Logf ("Buffers","VkBuffer %p created, size %llu bytes.",Buffer,
+                                                               (unsigned long long)SizeInBytes);
                 I_BufferDetails[Index].SizeInBytes = SizeInBytes;
                 I_BufferDetails[Index].MemorySizeInBytes = SizeInBytes;
                 I_BufferDetails[Index].MainBufferHndl = Buffer;
                 I_BufferDetails[Index].MainBufferMemoryHndl = BufferMemory;
+                LogBufferMemory(Index,false);
                 
                 //  If the buffer is staged, we need to create the secondary buffer
                 
@@ -1273,13 +2653,14 @@ void KVVulkanFramework::CreateBuffer (KVBufferHandle BufferHandle,long SizeInByt
                            I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) {
                     UsageFlags = I_BufferDetails[Index].SecondaryUsageFlags;
                     PropertyFlags = I_BufferDetails[Index].SecondaryPropertyFlags;
-                    CreateVulkanBuffer(SizeInBytes,UsageFlags,PropertyFlags,&Buffer,
-                                                            &BufferMemory,StatusOK);
+                    CreateVulkanBuffer(SizeInBytes,UsageFlags,PropertyFlags,0,&Buffer,
+                        &BufferMemory,&I_BufferDetails[Index].SecondaryAllocation,StatusOK);
                     if (AllOK(StatusOK)) {
-                        I_Debug.Logf ("Buffers","Secondary VkBuffer %p created, size %ld bytes",
-                                                                             Buffer,SizeInBytes);
+                        I_Debug.Logf ("Buffers","Secondary VkBuffer %p created, size %llu bytes",
+                                                       Buffer,(unsigned long long)SizeInBytes);
                         I_BufferDetails[Index].SecondaryBufferHndl = Buffer;
                         I_BufferDetails[Index].SecondaryBufferMemoryHndl = BufferMemory;
+                        LogBufferMemory(Index,true);
                     }
                     
                 }
@@ -1311,27 +2692,41 @@ void KVVulkanFramework::CreateBuffer (KVBufferHandle BufferHandle,long SizeInByt
 void KVVulkanFramework::DeleteBuffer (KVBufferHandle BufferHndl,bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
     int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
     if (AllOK(StatusOK)) {
         
+        //  Release the command buffer used for syncing a staged buffer, if there is one.
+        
+        ReleaseSyncCommandBuffer(Index,StatusOK);
+        
         //  If the buffer is still mapped, unmap it before deleting it.
         
         if (I_BufferDetails[Index].MappedAddress) {
-            vkUnmapMemory(I_LogicalDevice,I_BufferDetails[Index].MainBufferMemoryHndl);
+            UnmapBlockMemory(I_BufferDetails[Index].MainAllocation);
             I_BufferDetails[Index].MappedAddress = nullptr;
         }
         
-        //  Delete the Vulkan buffer and the actual memory associated with it.  The same for the
-        //  secondary buffer, if the buffer is a staged buffer implemented using two Vulkan
-        //  buffers.
+        //  A transient buffer's memory is shared, and is only freed with the last buffer.
         
-        vkFreeMemory(I_LogicalDevice,I_BufferDetails[Index].MainBufferMemoryHndl,nullptr);
-        vkDestroyBuffer(I_LogicalDevice,I_BufferDetails[Index].MainBufferHndl,nullptr);
-        if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
-                  I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU ) {
-            vkFreeMemory(I_LogicalDevice,I_BufferDetails[Index].SecondaryBufferMemoryHndl,nullptr);
-            vkDestroyBuffer(I_LogicalDevice,I_BufferDetails[Index].SecondaryBufferHndl,nullptr);
-        }
+        ReleaseTransientBuffer(Index);
+        
+        //  Delete the Vulkan buffer and return the memory associated with it to the pool.  The
+        //  same for the secondary buffer, if the buffer is a staged buffer implemented using two
+        //  Vulkan buffers. (DestroyVulkanBuffer() is a null operation for a null buffer handle.)
+        
+        DestroyVulkanBuffer(&I_BufferDetails[Index].MainBufferHndl,
+                &I_BufferDetails[Index].MainBufferMemoryHndl,&I_BufferDetails[Index].MainAllocation);
+        DestroyVulkanBuffer(&I_BufferDetails[Index].SecondaryBufferHndl,
+                                          &I_BufferDetails[Index].SecondaryBufferMemoryHndl,
+                                          &I_BufferDetails[Index].SecondaryAllocation);
+        
+        //  A sparse buffer's memory can only be released once the buffer itself has gone.
+        
+        ReleaseSparseCommits(Index);
         I_BufferDetails[Index].InUse = false;
     }
 }
@@ -1360,6 +2755,7 @@ bool KVVulkanFramework::IsBufferCreated (KVBufferHandle BufferHndl,bool& StatusO
 {
     bool IsCreated = false;
     if (!AllOK(StatusOK)) return IsCreated;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
     if (AllOK(StatusOK)) {
         if (I_BufferDetails[Index].MainBufferHndl != VK_NULL_HANDLE) IsCreated = true;
@@ -1367,6 +2763,209 @@ bool KVVulkanFramework::IsBufferCreated (KVBufferHandle BufferHndl,bool& StatusO
     return IsCreated;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                        C r e a t e  T r a n s i e n t  B u f f e r s
+//
+//  A program that runs a sequence of steps on the GPU - a chain of filters, say - often needs
+//  a buffer for each intermediate result, but each of those is only in use from the step that
+//  writes it to the last step that reads it. Created with CreateBuffer(), they would all hold
+//  their memory for the whole run. This routine creates a set of such buffers together, each
+//  described by the steps it is first and last used in, and binds them all within one range of
+//  pooled memory, with buffers whose steps don't overlap at the same offsets. So the memory
+//  needed is that of the largest set of buffers in use at any one step, rather than the total.
+//
+//  The offsets are found the usual way for this sort of packing: the buffers are placed
+//  largest first, each at the lowest offset where it doesn't overlap any buffer already placed
+//  whose steps overlap its own. That isn't always the smallest possible arrangement, but it's
+//  close, and exact for buffers all of one size.
+//
+//  Parameters:
+//     Buffers       (const std::vector<KVTransientBuffer>&) The buffers to create. Each gives
+//                   the handle returned by SetBufferDetails(), the size in bytes, and the first
+//                   and last steps that use the buffer. The steps are just numbers - the index
+//                   of a dispatch in a batch, for example - and only their order matters.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (VkDeviceSize) The number of bytes of memory the buffers share, zero if they could not
+//                   be created.
+//
+//  Pre-requisites:
+//     As for CreateBuffer(). The buffers must all be "LOCAL" buffers, described by
+//     SetBufferDetails() but not yet created, and not set for concurrent sharing.
+//
+//  Notes:
+//     o Two buffers that share memory don't keep their contents from one to the other. It is up
+//     to the program to make sure each step has finished with a buffer before a later step
+//     writes another bound to the same memory, which the barrier RecordComputeBatch() puts
+//     between dispatches does.
+//     o Once created, the buffers are used just like any others, except that they can't be
+//     resized. Deleting one doesn't free any memory until all the others in the set have gone.
+
+VkDeviceSize KVVulkanFramework::CreateTransientBuffers(
+                                 const std::vector<KVTransientBuffer>& Buffers,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return 0;
+    TraceScope Trace("CreateTransientBuffers","Vulkan");
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
+    
+    //  Check all the buffers first, so nothing is created unless they can all be.
+    
+    size_t Count = Buffers.size();
+    std::vector<int> Indices(Count);
+    for (size_t Buffer = 0; Buffer < Count && AllOK(StatusOK); Buffer++) {
+        const KVTransientBuffer& Transient = Buffers[Buffer];
+        Indices[Buffer] = BufferIndexFromHandle(Transient.Handle,StatusOK);
+        if (!AllOK(StatusOK)) break;
+        const T_BufferDetails& Details = I_BufferDetails[Indices[Buffer]];
+        if (Details.BufferAccess != ACCESS_LOCAL || Details.Concurrent) {
+            LogError ("Transient buffers must be \"LOCAL\" buffers without concurrent sharing");
+            StatusOK = false;
+        } else if (Details.MainBufferHndl != VK_NULL_HANDLE) {
+            LogError ("Transient buffer with handle %ld has already been created",
+                                                                      long(Transient.Handle));
+            StatusOK = false;
+        } else if (Transient.SizeInBytes == 0 || Transient.LastUse < Transient.FirstUse) {
+            LogError ("Transient buffer with handle %ld has a zero size or its last use is "
+                                               "before its first",long(Transient.Handle));
+            StatusOK = false;
+        }
+    }
+    if (!AllOK(StatusOK) || Count == 0) return 0;
+    
+    //  Create the Vulkan buffers, without memory, and find what memory will suit them all -
+    //  a type all of them can use, aligned for the most demanding.
+    
+    std::vector<VkBuffer> BufferHndls(Count,VK_NULL_HANDLE);
+    std::vector<VkMemoryRequirements> Requirements(Count);
+    VkMemoryRequirements Shared{};
+    Shared.alignment = 1;
+    Shared.memoryTypeBits = ~uint32_t(0);
+    for (size_t Buffer = 0; Buffer < Count; Buffer++) {
+        VkBufferCreateInfo BufferInfo{};
+        BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        BufferInfo.size = Buffers[Buffer].SizeInBytes;
+        BufferInfo.usage = I_BufferDetails[Indices[Buffer]].MainUsageFlags;
+        BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkResult Result = vkCreateBuffer(I_LogicalDevice,&BufferInfo,nullptr,
+                                                                      &BufferHndls[Buffer]);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to create transient buffer","vkCreateBuffer",Result);
+            StatusOK = false;
+            break;
+        }
+        vkGetBufferMemoryRequirements(I_LogicalDevice,BufferHndls[Buffer],
+                                                                    &Requirements[Buffer]);
+        Shared.memoryTypeBits &= Requirements[Buffer].memoryTypeBits;
+        Shared.alignment = std::max(Shared.alignment,Requirements[Buffer].alignment);
+    }
+    if (AllOK(StatusOK) && Shared.memoryTypeBits == 0) {
+        LogError ("There is no memory type all the transient buffers can use");
+        StatusOK = false;
+    }
+    
+    //  Place the buffers, largest first. Each goes at the lowest offset, aligned as it needs,
+    //  that is clear of every buffer already placed that is in use at the same time. Trying
+    //  the end of each of those buffers in turn is enough to find that offset.
+    
+    std::vector<VkDeviceSize> Offsets(Count,0);
+    if (AllOK(StatusOK)) {
+        std::vector<size_t> Order(Count);
+        for (size_t Buffer = 0; Buffer < Count; Buffer++) Order[Buffer] = Buffer;
+        std::stable_sort(Order.begin(),Order.end(),[&](size_t A,size_t B) {
+            return Requirements[A].size > Requirements[B].size;
+        });
+        std::vector<size_t> Placed;
+        for (size_t Buffer : Order) {
+            VkDeviceSize Size = Requirements[Buffer].size;
+            VkDeviceSize Align = std::max(Requirements[Buffer].alignment,VkDeviceSize(1));
+            std::vector<size_t> Live;
+            for (size_t Other : Placed) {
+                if (Buffers[Other].FirstUse <= Buffers[Buffer].LastUse &&
+                              Buffers[Buffer].FirstUse <= Buffers[Other].LastUse) {
+                    Live.push_back(Other);
+                }
+            }
+            std::vector<VkDeviceSize> Candidates = {0};
+            for (size_t Other : Live) {
+                VkDeviceSize End = Offsets[Other] + Requirements[Other].size;
+                Candidates.push_back((End + Align - 1) / Align * Align);
+            }
+            std::sort(Candidates.begin(),Candidates.end());
+            for (VkDeviceSize Offset : Candidates) {
+                bool Clear = true;
+                for (size_t Other : Live) {
+                    if (Offset < Offsets[Other] + Requirements[Other].size &&
+                                                         Offsets[Other] < Offset + Size) {
+                        Clear = false;
+                        break;
+                    }
+                }
+                if (Clear) {
+                    Offsets[Buffer] = Offset;
+                    break;
+                }
+            }
+            Placed.push_back(Buffer);
+            Shared.size = std::max(Shared.size,Offsets[Buffer] + Size);
+        }
+    }
+    
+    //  Get the memory for all of them, and bind each buffer at its offset within it.
+    
+    T_TransientGroup Group;
+    Group.Allocation = {-1,0,0};
+    Group.Buffers = 0;
+    if (AllOK(StatusOK)) {
+        T_BufferDetails& First = I_BufferDetails[Indices[0]];
+        AllocateBlockMemory(Shared,First.MainPropertyFlags,First.MainPreferredFlags,
+                                                                 &Group.Allocation,StatusOK);
+    }
+    for (size_t Buffer = 0; Buffer < Count && AllOK(StatusOK); Buffer++) {
+        VkDeviceMemory MemoryHndl = I_MemoryBlocks[Group.Allocation.BlockIndex].MemoryHndl;
+        VkResult Result = vkBindBufferMemory(I_LogicalDevice,BufferHndls[Buffer],MemoryHndl,
+                                                     Group.Allocation.Offset + Offsets[Buffer]);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to bind transient buffer memory","vkBindBufferMemory",
+                                                                                     Result);
+            StatusOK = false;
+        }
+    }
+    if (!AllOK(StatusOK)) {
+        for (VkBuffer BufferHndl : BufferHndls) {
+            if (BufferHndl != VK_NULL_HANDLE) vkDestroyBuffer(I_LogicalDevice,BufferHndl,nullptr);
+        }
+        FreeBlockMemory(&Group.Allocation);
+        return 0;
+    }
+    
+    //  The buffers don't own their memory - the group does. They have the block's memory handle,
+    //  like any other buffer, but no allocation of their own.
+    
+    int GroupIndex = int(I_TransientGroups.size());
+    Group.Buffers = int(Count);
+    I_TransientGroups.push_back(Group);
+    for (size_t Buffer = 0; Buffer < Count; Buffer++) {
+        T_BufferDetails& Details = I_BufferDetails[Indices[Buffer]];
+        Details.MainBufferHndl = BufferHndls[Buffer];
+        Details.MainBufferMemoryHndl = I_MemoryBlocks[Group.Allocation.BlockIndex].MemoryHndl;
+        Details.MainAllocation = {-1,0,0};
+        Details.SizeInBytes = Buffers[Buffer].SizeInBytes;
+        Details.MemorySizeInBytes = Buffers[Buffer].SizeInBytes;
+        Details.TransientGroup = GroupIndex;
+    }
+    VkDeviceSize Total = 0;
+    for (const KVTransientBuffer& Transient : Buffers) Total += Transient.SizeInBytes;
+    I_Debug.Logf ("Buffers","%d transient buffers created, %llu bytes sharing %llu bytes.",
+                 int(Count),(unsigned long long)Total,(unsigned long long)Shared.size);
+    return Shared.size;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                R e s i z e  B u f f e r
@@ -1377,7 +2976,7 @@ bool KVVulkanFramework::IsBufferCreated (KVBufferHandle BufferHndl,bool& StatusO
 //  Parameters:
 //     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
 //                   as returned by SetBufferDetails().
-//     SizeInBytes   (long) The new size of the buffer in bytes.
+//     SizeInBytes   (VkDeviceSize) The new size of the buffer in bytes.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
@@ -1390,26 +2989,54 @@ bool KVVulkanFramework::IsBufferCreated (KVBufferHandle BufferHndl,bool& StatusO
 //     routine and the buffer should already have been created using CreateBuffer().
 //
 //  Post-requisites:
-//     If the buffer had been mapped using MapBuffer(), then changing the size will invalidate
-//     the mapping and it will need to be re-mapped. This routine will unmap an already mapped
-//     buffer, so there is no need to call UnmapBuffer().
+//     If the buffer had been mapped using MapBuffer(), then changing the size may invalidate
+//     the mapping, and the buffer should be re-mapped. This routine will unmap an already mapped
+//     buffer if it has to reallocate it, so there is no need to call UnmapBuffer(). If the
+//     buffer isn't reallocated, MapBuffer() will return the same address as before, cheaply.
 //
 //  Note:
-//     As currently implemented, reducing the size of a buffer will not release the memory
-//     it uses. It simply leaves some unused, and if a later call increases the size up to
-//     the original size, it will simply be reused. Only if the call increases the size of
-//     the buffer beyond the original allocation will the memory be released and reallocated.
-
-void KVVulkanFramework::ResizeBuffer (KVBufferHandle BufferHndl,long NewSizeInBytes,bool& StatusOK)
+//     o A buffer has a capacity - the size of the Vulkan buffer and memory actually allocated -
+//     as well as its size as seen by the caller. Reducing the size of a buffer does not release
+//     any memory, and increasing it up to the capacity simply re-uses the existing allocation.
+//     Only an increase beyond the capacity causes the buffer to be reallocated, and this is
+//     expensive, since it has to wait for the device to be idle. So when the buffer does have
+//     to grow, its capacity is increased geometrically - by half as much again - so that a
+//     sequence of small increases, such as happens when a window edge is dragged, only causes
+//     an occasional reallocation.
+//     o A buffer created using ImportBuffer() cannot be resized, as its memory belongs to the
+//     calling program.
+//     o Nor can a "SPARSE" buffer, which should be created with the largest size it will need.
+
+void KVVulkanFramework::ResizeBuffer (KVBufferHandle BufferHndl,VkDeviceSize NewSizeInBytes,
+                                                                                bool& StatusOK)
 {
     //  Note that a buffer should always be remapped after being resized.
     
     if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
     int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (I_BufferDetails[Index].BufferAccess == ACCESS_IMPORTED) {
+            LogError ("The size of an imported buffer cannot be changed");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].BufferAccess == ACCESS_SPARSE) {
+            LogError ("The size of a sparse buffer cannot be changed");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].TransientGroup >= 0) {
+            LogError ("The size of a transient buffer cannot be changed");
+            StatusOK = false;
+        }
+    }
     if (AllOK(StatusOK)) {
         //  If the memory actually allocated for the buffer is large enough, then we can
         //  simply pretend to resize it. Any call to MapBuffer() will simply see that the
         //  buffer is already mapped and return efficiently.
+        //  Either way, any pre-recorded sync command buffer will need to be re-recorded, as it
+        //  has the size of the copy built in to it.
+        I_BufferDetails[Index].SyncRecorded = false;
         if (I_BufferDetails[Index].MemorySizeInBytes >= NewSizeInBytes) {
             I_BufferDetails[Index].SizeInBytes = NewSizeInBytes;
         } else {
@@ -1423,28 +3050,18 @@ void KVVulkanFramework::ResizeBuffer (KVBufferHandle BufferHndl,long NewSizeInBy
             //  the I_BufferDetails[Index] structure. We allow for the possibility that the buffer
             //  does not actually exist (in which case, the caller should really have used
             //  CreateBuffer(), but we'll let them get away with it).
+            //  Note that the memory goes back to the pooled memory blocks, so recreating the
+            //  buffer will usually re-use it (or part of it) without a new vkAllocateMemory() call.
             if (I_BufferDetails[Index].MappedAddress) {
-                vkUnmapMemory(I_LogicalDevice,I_BufferDetails[Index].MainBufferMemoryHndl);
+                UnmapBlockMemory(I_BufferDetails[Index].MainAllocation);
                 I_BufferDetails[Index].MappedAddress = nullptr;
             }
-            if (I_BufferDetails[Index].MainBufferMemoryHndl != VK_NULL_HANDLE) {
-                vkFreeMemory(I_LogicalDevice,I_BufferDetails[Index].MainBufferMemoryHndl,nullptr);
-                I_BufferDetails[Index].MainBufferMemoryHndl = VK_NULL_HANDLE;
-            }
-            if (I_BufferDetails[Index].MainBufferHndl != VK_NULL_HANDLE) {
-                vkDestroyBuffer(I_LogicalDevice,I_BufferDetails[Index].MainBufferHndl,nullptr);
-                I_BufferDetails[Index].MainBufferHndl = VK_NULL_HANDLE;
-            }
-            //  These only apply to staged buffers, but need checking.
-            if (I_BufferDetails[Index].SecondaryBufferMemoryHndl != VK_NULL_HANDLE) {
-                vkFreeMemory(I_LogicalDevice,I_BufferDetails[Index].SecondaryBufferMemoryHndl,
-                                                                                         nullptr);
-                I_BufferDetails[Index].SecondaryBufferMemoryHndl = VK_NULL_HANDLE;
-            }
-            if (I_BufferDetails[Index].SecondaryBufferHndl != VK_NULL_HANDLE) {
-                vkDestroyBuffer(I_LogicalDevice,I_BufferDetails[Index].SecondaryBufferHndl,nullptr);
-                I_BufferDetails[Index].SecondaryBufferHndl = VK_NULL_HANDLE;
-            }
+            DestroyVulkanBuffer(&I_BufferDetails[Index].MainBufferHndl,
+                &I_BufferDetails[Index].MainBufferMemoryHndl,&I_BufferDetails[Index].MainAllocation);
+            //  This only applies to staged buffers, but needs checking.
+            DestroyVulkanBuffer(&I_BufferDetails[Index].SecondaryBufferHndl,
+                                              &I_BufferDetails[Index].SecondaryBufferMemoryHndl,
+                                              &I_BufferDetails[Index].SecondaryAllocation);
 
             //  Now create a new buffer and the associated memory. Note that you can't simply
             //  change the binding of an existing buffer.
@@ -1454,14 +3071,21 @@ void KVVulkanFramework::ResizeBuffer (KVBufferHandle BufferHndl,long NewSizeInBy
             VkDeviceMemory BufferMemoryHndl;
             VkBufferUsageFlags UsageFlags = I_BufferDetails[Index].MainUsageFlags;
             VkMemoryPropertyFlags PropertyFlags = I_BufferDetails[Index].MainPropertyFlags;
-            I_Debug.Log ("Buffers","Creating new buffer.");
-            CreateVulkanBuffer(NewSizeInBytes,UsageFlags,PropertyFlags,&BufferHndl,
-                                                                   &BufferMemoryHndl,StatusOK);
+            VkMemoryPropertyFlags PreferredFlags = I_BufferDetails[Index].MainPreferredFlags;
+            VkDeviceSize NewCapacity = VkDeviceSize(
+                        double(I_BufferDetails[Index].MemorySizeInBytes) * C_BufferGrowthFactor);
+            if (NewCapacity < NewSizeInBytes) NewCapacity = NewSizeInBytes;
+            I_Debug.Logf ("Buffers","Creating new buffer, capacity %llu bytes.",
+                                                              (unsigned long long)NewCapacity);
+            CreateVulkanBuffer(NewCapacity,UsageFlags,PropertyFlags,PreferredFlags,&BufferHndl,
+                        &BufferMemoryHndl,&I_BufferDetails[Index].MainAllocation,StatusOK,
+                                                              I_BufferDetails[Index].Concurrent);
             if (AllOK(StatusOK)) {
                 I_BufferDetails[Index].MainBufferHndl = BufferHndl;
                 I_BufferDetails[Index].MainBufferMemoryHndl = BufferMemoryHndl;
-                I_BufferDetails[Index].MemorySizeInBytes = NewSizeInBytes;
+                I_BufferDetails[Index].MemorySizeInBytes = NewCapacity;
                 I_BufferDetails[Index].SizeInBytes = NewSizeInBytes;
+                LogBufferMemory(Index,false);
             
                 //  If we have a staged buffer, also need to recreate the secondary buffer.
             
@@ -1470,11 +3094,12 @@ void KVVulkanFramework::ResizeBuffer (KVBufferHandle BufferHndl,long NewSizeInBy
                     I_Debug.Log ("Buffers","Creating new secondary buffer.");
                     UsageFlags = I_BufferDetails[Index].SecondaryUsageFlags;
                     PropertyFlags = I_BufferDetails[Index].SecondaryPropertyFlags;
-                    CreateVulkanBuffer(NewSizeInBytes,UsageFlags,PropertyFlags,&BufferHndl,
-                                       &BufferMemoryHndl,StatusOK);
+                    CreateVulkanBuffer(NewCapacity,UsageFlags,PropertyFlags,0,&BufferHndl,
+                        &BufferMemoryHndl,&I_BufferDetails[Index].SecondaryAllocation,StatusOK);
                     if (AllOK(StatusOK)) {
                         I_BufferDetails[Index].SecondaryBufferHndl = BufferHndl;
                         I_BufferDetails[Index].SecondaryBufferMemoryHndl = BufferMemoryHndl;
+                        LogBufferMemory(Index,true);
                     }
                 }
             }
@@ -1484,2194 +3109,7835 @@ void KVVulkanFramework::ResizeBuffer (KVBufferHandle BufferHndl,long NewSizeInBy
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                   C r e a t e  V u l k a n  B u f f e r   (Internal routine)
+//                                I m p o r t  B u f f e r
 //
-//  This internal routine creates a single Vulkan buffer and allocates the memory for it. It
-//  needs to know the buffer usage type (storage, uniform, vertex) and its properties (mostly
-//  to do with sharing, ie shared, local, etc). These are set by SetBufferDetails() when the
-//  initial details of the buffer are supplied. It also needs to know the buffer size in bytes.
-//  It returns the Vulkan handles for the buffer and for its associated memory. Note that
-//  what Vulkan calls a 'buffer' - something it references using a VkBuffer handle - and what
-//  the Framework calls a 'buffer' are rather different; the Framework treats a buffer and its
-//  memory as a signle item, and even treats a staged buffer (implemented through two Vulkan
-//  buffers, one local to the CPU and one local to the GPU) as a single item. This routine
-//  needs to be called twice for a staged buffer.
+//  This routine creates a buffer previously described in a call to SetBufferDetails() with an
+//  access of "IMPORTED", using host memory that has already been allocated and filled by the
+//  calling program, rather than having the Framework allocate the memory. If the device supports
+//  the VK_EXT_external_memory_host extension, the GPU then accesses that memory directly, and
+//  there is no need for the program to copy its data into a buffer at all - which for a large
+//  image read from a file can be a significant saving. If the device doesn't support this, or
+//  if the memory is not suitably aligned, the buffer is created as a "SHARED" buffer and the
+//  data is copied into it, so the calling code works either way.
 //
 //  Parameters:
-//     SizeInBytes   (long) The size of the buffer in bytes.
-//     UsageFlags    (VkBufferUsageFlags) Describes the usage of the buffer - uniform, storage, etc.
-//     PropertyFlags (VkMemoryPropertyFlags) Describes the memory properties for the buffer,
-//                   GPU local, shared, etc. that the buffer needs to have.
-//     BufferHndlPtr (VkBuffer*) Receives the buffer handle used by Vulkan to access the buffer.
-//     BufferMemoryHandlPtr (VkDeviceMemory*) Receives the memory handle used by Vulkan to access
-//                   the memory for the buffer.
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     HostAddress   (void*) The address of the host memory to be used for the buffer. This should
+//                   be aligned to the value returned by GetHostImportAlignment(), and the memory
+//                   should extend to the next multiple of that value beyond SizeInBytes - the
+//                   simplest way to arrange both is to use AllocateImportableMemory().
+//     SizeInBytes   (VkDeviceSize) The size of the buffer in bytes.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
 //
 //  Pre-requisites:
-//     CreateLogicalDevice() must have been called to create the logical device and set its
-//     handle in I_LogicalDevice. (I_SelectedDevice also needs to have been set to the handle
-//     of the selected physical device - this is needed to determine the supported memory
-//     types - but this is a necessary precursor to CreateLogicalDevice() anyway.)
-
-void KVVulkanFramework::CreateVulkanBuffer(
-        VkDeviceSize SizeInBytes,VkBufferUsageFlags UsageFlags,VkMemoryPropertyFlags PropertyFlags,
-                        VkBuffer* BufferHndlPtr,VkDeviceMemory* BufferMemoryHndlPtr,bool& StatusOK)
+//     CreateLogicalDevice() must have been called, and SetBufferDetails() must have been called
+//     with an access of "IMPORTED" to return the buffer handle passed to this routine. The
+//     buffer should not already have been created.
+//
+//  Note:
+//     o The host memory must remain allocated until the buffer has been deleted, either by
+//     DeleteBuffer() or by CleanupVulkan().
+//     o The program should always use the address returned by MapBuffer() to access the buffer
+//     data. If the memory was imported this is simply HostAddress, but if the Framework had to
+//     fall back on a copy, it is the address of the copy.
+//     o An imported buffer cannot be resized.
+
+void KVVulkanFramework::ImportBuffer (KVBufferHandle BufferHndl,void* HostAddress,
+                                                     VkDeviceSize SizeInBytes,bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
     
-    //  The VkBuffer type is an opaque handle to a data buffer. You create one with a call to
-    //  vkCreateBuffer(), which returns a 'handle' that identifies the buffer and which you can
-    //  use in calls to other Vulkan routines. You shouldn't make any assumptions about what
-    //  this handle is (it's probably an address, but it could be an index into an internal
-    //  table maintained by Vulkan). But you can use a value of VK_NULL_HANDLE to indicate that
-    //  it hasn't been set yet. Creating a buffer with vkCreateBuffer() doesn't actually create
-    //  the memory for the data in the buffer. You have to do that separately, by calling
-    //  vkAllocateMemory(), which returns another handle value identifying the memory, and then
-    //  bind that memory to the buffer. The BufferHndlPtr parameter is the address of a buffer
-    //  handle which will be set by this routine, hence the name.
-        
-    *BufferHndlPtr = VK_NULL_HANDLE;
-    *BufferMemoryHndlPtr = VK_NULL_HANDLE;
-    
-    //  First though, we do have to create the buffer.
-    
-    //  It's assumed that the buffer's sharing mode will be VK_SHARING_MODE_EXCLUSIVE (the buffer
-    //  will only be used by one queue family. The only alternative, VK_SHARING_MODE_CONCURRENT,
-    //  is more complex to set up and needs a list of queue families to be provided in the
-    //  BufferInfo structure (and so in the call to this routine).
-    
-    VkBufferCreateInfo BufferInfo{};
-    BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    BufferInfo.size = SizeInBytes;
-    BufferInfo.usage = UsageFlags;
-    BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    I_Debug.Log ("Buffers","Creating Vulkan buffer.");
-    VkResult Result;
-    Result = vkCreateBuffer(I_LogicalDevice,&BufferInfo,nullptr,BufferHndlPtr);
-    if (Result == VK_SUCCESS) {
-                
-        //  Before we allocate the memory needed for the buffer, we have to determine what type of
-        //  memory we need. Vulkan devices provide different types of memory, and different buffer
-        //  types have different memory requirements. Now that we have set up our VkBuffer, and
-        //  have its address in BufferHndlPtr, we can find out what it actually requires.
-        
-        VkMemoryRequirements MemoryRequirements;
-        vkGetBufferMemoryRequirements(I_LogicalDevice,*BufferHndlPtr,&MemoryRequirements);
+    I_RecordingGeneration++;
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (SizeInBytes == 0 || HostAddress == nullptr) {
+            LogError ("Invalid host memory (%llu bytes at %p) specified for import",
+                                                (unsigned long long)SizeInBytes,HostAddress);
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].BufferAccess != ACCESS_IMPORTED) {
+            LogError ("ImportBuffer() can only be used for an \"IMPORTED\" buffer");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].MainBufferHndl != VK_NULL_HANDLE) {
+            LogError ("Attempt to import already existing buffer of %llu bytes",
+                                                               (unsigned long long)SizeInBytes);
+            StatusOK = false;
+        }
+    }
+    if (AllOK(StatusOK)) {
         
-        //  Then we can find out which of the various memory types will do for our buffer.
+        //  See if the memory can be imported directly, which needs device support and suitable
+        //  alignment. A misaligned address suggests the program didn't use
+        //  AllocateImportableMemory(), so that gets a warning.
         
-        uint32_t MemoryTypeIndex = GetMemoryTypeIndex(MemoryRequirements,PropertyFlags,StatusOK);
-        if (AllOK(StatusOK)) {
-            
-            //  Finally, we can allocate some of the required memory, using vkAllocateMemory(),
-            //  which will set up a VkDeviceMemory - this is another opaque handle, whose
-            //  address we've set in BufferMemoryHndlPtr - so that we can refer to it.
-            
-            VkMemoryAllocateInfo AllocateInfo{};
-            AllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            AllocateInfo.allocationSize = MemoryRequirements.size;
-            AllocateInfo.memoryTypeIndex = MemoryTypeIndex;
-            I_Debug.Logf ("Buffers","Memory type index = %d",AllocateInfo.memoryTypeIndex);
-
-            Result = vkAllocateMemory(I_LogicalDevice,&AllocateInfo,nullptr,BufferMemoryHndlPtr);
-            if (Result == VK_SUCCESS) {
-                            
-                //  And having done that, we can bind the memory to our buffer.
-                
-                vkBindBufferMemory(I_LogicalDevice,*BufferHndlPtr,*BufferMemoryHndlPtr,0);
+        bool Imported = false;
+        if (I_HostImportSupported) {
+            if ((uintptr_t)HostAddress % I_HostImportAlignment != 0) {
+                LogWarning ("Host memory at %p is not aligned to %ld bytes, and will be copied",
+                                                         HostAddress,long(I_HostImportAlignment));
             } else {
-                LogVulkanError ("Failed to allocate buffer memory","vkAllocateMemory",Result);
-                StatusOK = false;
+                Imported = ImportHostBuffer(Index,HostAddress,SizeInBytes);
             }
+        } else {
+            I_Debug.Log ("Buffers","Device cannot import host memory, buffer will be copied.");
         }
         
-    } else {
-        LogVulkanError ("Failed to create buffer","vkCreateBuffer",Result);
-        StatusOK = false;
-    }
-    
-    //  If things went wrong, release anything that was allocated before the problem was spotted.
-    
-    if (!AllOK(StatusOK)) {
-        if (*BufferMemoryHndlPtr != VK_NULL_HANDLE) {
-            vkFreeMemory(I_LogicalDevice,*BufferMemoryHndlPtr,nullptr);
-        }
-        if (*BufferHndlPtr != VK_NULL_HANDLE) {
-            vkDestroyBuffer(I_LogicalDevice,*BufferHndlPtr,nullptr);
+        //  If not, this becomes an ordinary shared buffer, and the data gets copied into it.
+        
+        if (!Imported) {
+            I_BufferDetails[Index].BufferAccess = ACCESS_SHARED;
+            CreateBuffer(BufferHndl,SizeInBytes,StatusOK);
+            VkDeviceSize Bytes;
+            void* MappedAddress = MapBuffer(BufferHndl,&Bytes,StatusOK);
+            if (AllOK(StatusOK) && MappedAddress) {
+                memcpy(MappedAddress,HostAddress,size_t(SizeInBytes));
+            }
         }
     }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//               C r e a t e  V u l k a n  D e s c r i p t o r  S e t  L a y o u t
+//                          C o m m i t  B u f f e r  R a n g e
+//
+//  A "SPARSE" buffer is created by CreateBuffer() with no memory behind it at all. This routine
+//  allocates device memory for a range of such a buffer and binds it to that range, after which
+//  the GPU can use that part of the buffer just as it would a "LOCAL" buffer. This allows a
+//  buffer to be created large enough to hold, say, the whole of a large mosaic, while only
+//  taking up device memory for the parts of it that actually hold data.
 //
-//  A computation is run as part of a pipeline, and a pipeline has to be set up in detail before
-//  it can be run. It will access a set of one or more buffers, and it needs to know how these
-//  are defined. To do this, it needs a 'descriptor set' which describes the bindings and the types
-//  of the buffers. But before you can create a descriptor set, you have to specify its layout,
-//  which reflects the details of the various buffers. This routine performs that initial step of
-//  creating the necessary descriptor set. It is passed a vector containing the Framework buffer
-//  handles for all the buffers involved, creates the descriptor set and returns a Vulkan handle
-//  to the set.
-
 //  Parameters:
-//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
-//                   Framework handles for each buffer, as returned by SetBufferDetails().
-//     SetLayoutHndlPtr (VkDescriptorSetLayout*) Receives the opaque Vulkan handle for the
-//                   created descriptor set layout.
+//     BufferHndl    (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     Offset        (VkDeviceSize) The offset in bytes of the start of the range.
+//     Length        (VkDeviceSize) The length of the range in bytes.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
 //
 //  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
-//     The details of each buffer in question must have been set using SetBufferDetails() and
-//     the vector (BufferHandles) containing the handles for each buffer must have been created
-//     and filled.
+//     The buffer must be a "SPARSE" buffer, and must have been created using CreateBuffer().
 //
 //  Note:
-//     The list of buffers passed in BufferHandles is used to specify the number and type of each
-//     buffer, so the buffer layout cannot be changed without creating a new descriptor set layout
-//     (and new versions of everything based on that layout), but the sizes of the individual
-//     buffers are only finally fixed when the set is fully sepecified using the routine
-//     SetupVulkanDescriptorSet().
-
-void KVVulkanFramework::CreateVulkanDescriptorSetLayout(
-                    std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
-                                            VkDescriptorSetLayout* SetLayoutHndlPtr,bool& StatusOK)
+//     o Memory is committed in whole pages - see GetSparseDetails() - so the range is extended
+//     outwards to page boundaries. Any parts of it already committed are left as they are, and
+//     memory is only allocated for the rest, as one allocation for each uncommitted stretch.
+//     o The memory comes from the same pooled memory blocks as other buffers use, so it shows
+//     up in the figures returned by GetMemoryStats().
+//     o This waits for the memory to be bound before it returns, so the range can be used by
+//     anything submitted to the GPU afterwards. The contents of newly committed memory are
+//     undefined.
+
+void KVVulkanFramework::CommitBufferRange (KVBufferHandle BufferHndl,VkDeviceSize Offset,
+                                                       VkDeviceSize Length,bool& StatusOK)
 {
-    //  Pre-requisites:
-    //     CreateLogicalDevice() must have been called to create the logical device and set its
-    //     handle in I_LogicalDevice.
-    
     if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    //  This sets up a descriptor set layout with the entries set up to match the specifications
-    //  for the buffers as listed in BufferHandles. If any handles are invalid, we don't quit
-    //  immediately - instead we continue on to check the rest of the handles. Might as well.
-    
-    std::vector<VkDescriptorSetLayoutBinding> LayoutBindings{};
-    for (KVBufferHandle Handle : BufferHandles) {
-        int Index = BufferIndexFromHandle(Handle,StatusOK);
-        if (!AllOK(StatusOK)) continue;
-        VkDescriptorSetLayoutBinding Binding;
-        Binding.binding = I_BufferDetails[Index].Binding;
-        Binding.descriptorCount = 1;
-        if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) {
-            I_Debug.Logf ("Buffers","Setting for uniform buffer, binding %d",Binding.binding);
-            Binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            Binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDeviceSize Start = 0;
+    VkDeviceSize End = 0;
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        T_BufferDetails& Details = I_BufferDetails[Index];
+        if (Details.BufferAccess != ACCESS_SPARSE) {
+            LogError ("CommitBufferRange() can only be used for a \"SPARSE\" buffer");
+            StatusOK = false;
+        } else if (Details.MainBufferHndl == VK_NULL_HANDLE) {
+            LogError ("CommitBufferRange() called for a buffer that has not been created");
+            StatusOK = false;
+        } else if (Length == 0 || Offset > Details.SizeInBytes ||
+                                                     Length > Details.SizeInBytes - Offset) {
+            LogError ("Range of %llu bytes at offset %llu is outside buffer of %llu bytes",
+                             (unsigned long long)Length,(unsigned long long)Offset,
+                                                  (unsigned long long)Details.SizeInBytes);
+            StatusOK = false;
+        } else {
+            VkDeviceSize Page = Details.SparsePageSize;
+            Start = (Offset / Page) * Page;
+            End = ((Offset + Length + Page - 1) / Page) * Page;
+            if (End > Details.MemorySizeInBytes) End = Details.MemorySizeInBytes;
         }
-        if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) {
-            I_Debug.Logf ("Buffers","Setting for storage buffer, binding %d",Binding.binding);
-            Binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            Binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    if (!AllOK(StatusOK)) return;
+    T_BufferDetails& Details = I_BufferDetails[Index];
+    
+    //  Find the parts of the range that aren't already committed. The commits are kept in
+    //  order of offset, so this is just a matter of working through the ones that overlap the
+    //  range and noting the gaps between them. Each gap gets its memory from the pool, aligned
+    //  to a page boundary, as Vulkan requires.
+    
+    std::vector<T_SparseCommit> NewCommits;
+    VkDeviceSize Position = Start;
+    for (size_t Commit = 0; Commit <= Details.SparseCommits.size(); Commit++) {
+        VkDeviceSize GapEnd = End;
+        VkDeviceSize CommitEnd = End;
+        if (Commit < Details.SparseCommits.size()) {
+            GapEnd = Details.SparseCommits[Commit].Offset;
+            CommitEnd = GapEnd + Details.SparseCommits[Commit].Size;
+            if (CommitEnd <= Position) continue;
+            if (GapEnd > End) GapEnd = End;
         }
-        Binding.pImmutableSamplers = nullptr;
-        LayoutBindings.push_back(Binding);
+        if (GapEnd > Position) {
+            VkMemoryRequirements Requirements;
+            Requirements.size = GapEnd - Position;
+            Requirements.alignment = Details.SparsePageSize;
+            Requirements.memoryTypeBits = Details.SparseMemoryTypeBits;
+            T_SparseCommit NewCommit;
+            NewCommit.Offset = Position;
+            NewCommit.Size = GapEnd - Position;
+            AllocateBlockMemory(Requirements,Details.MainPropertyFlags,0,
+                                                           &NewCommit.Allocation,StatusOK);
+            if (!AllOK(StatusOK)) break;
+            NewCommits.push_back(NewCommit);
+        }
+        if (CommitEnd >= End) break;
+        Position = CommitEnd;
     }
-
+    
+    //  Bind all the new memory in one operation, then add the new commits to the list, in
+    //  order. If anything went wrong, the memory goes back to the pool.
+    
+    if (NewCommits.size() > 0) BindSparseMemory(Index,NewCommits,true,StatusOK);
     if (AllOK(StatusOK)) {
-        VkDescriptorSetLayoutCreateInfo LayoutInfo{};
-        LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        LayoutInfo.bindingCount = int(BufferHandles.size());
-        LayoutInfo.pBindings = LayoutBindings.data();
-
-        VkResult Result;
-        Result = vkCreateDescriptorSetLayout(I_LogicalDevice,&LayoutInfo,nullptr,SetLayoutHndlPtr);
-        if (Result != VK_SUCCESS) {
-            LogVulkanError("Failed to create compute descriptor set layout",
-                                                    "vkCreateDescriptorSetLayout",Result);
-            StatusOK = false;
-        } else {
-            I_Debug.Logf("Progress","Compute descriptor set created with %d buffer bindings",
-                                                                         BufferHandles.size());
+        for (const T_SparseCommit& NewCommit : NewCommits) {
+            auto Iter = Details.SparseCommits.begin();
+            while (Iter != Details.SparseCommits.end() && Iter->Offset < NewCommit.Offset) Iter++;
+            Details.SparseCommits.insert(Iter,NewCommit);
         }
+        I_Debug.Logf ("Buffers","Committed %d new range(s) to sparse buffer handle %ld",
+                                                        int(NewCommits.size()),long(BufferHndl));
+    } else {
+        for (T_SparseCommit& NewCommit : NewCommits) FreeBlockMemory(&NewCommit.Allocation);
     }
-        
-    //  If the layout was created successfully, save the value of its handle so it can be
-    //  destroyed during cleanup.
-        
-    if (AllOK(StatusOK)) I_DescriptorSetLayoutHndls.push_back(*SetLayoutHndlPtr);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                   B u f f e r  I n d e x  F r o m  H a n d l e  (Internal routine)
+//                         R e l e a s e  B u f f e r  R a n g e
 //
-//  This internal routine returns the index into the I_BufferDetails vector that corresponds to
-//  the Framework handle for the buffer as returned by SetBufferDetails(). It also checks that
-//  the handle is valid and returns bad status if it isn't.
+//  This is the reverse of CommitBufferRange(). It unbinds the memory committed to a range of
+//  a "SPARSE" buffer and returns it to the pooled memory blocks, so it can be used for another
+//  range, or another buffer.
 //
 //  Parameters:
-//     Handle        (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//     BufferHndl    (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
 //                   as returned by SetBufferDetails().
+//     Offset        (VkDeviceSize) The offset in bytes of the start of the range.
+//     Length        (VkDeviceSize) The length of the range in bytes.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
 //
 //  Pre-requisites:
-//     The buffer must have had its details set using SetBufferDetails(), which will have
-//     returned the buffer handle.
+//     The buffer must be a "SPARSE" buffer, and must have been created using CreateBuffer().
+//     Nothing submitted to the GPU that uses the range may still be executing.
 //
 //  Note:
-//     This routine makes use of the fact that a KVBufferHandle is actually an int. It's an
-//     index into the I_BufferDetails vector, but with 1 added to it so that 0 can be used
-//     as an invalid index number. It isn't a foolproof scheme
-
-int KVVulkanFramework::BufferIndexFromHandle (KVBufferHandle Handle,bool& StatusOK)
+//     o Memory is released a whole commit at a time - the memory allocated by one call to
+//     CommitBufferRange() for one uncommitted stretch of the buffer - and only commits that lie
+//     entirely within the range, extended outwards to page boundaries, are released. Releasing
+//     the same ranges that were committed always works as expected.
+//     o The GPU must not use the released range until it has been committed again.
+
+void KVVulkanFramework::ReleaseBufferRange (KVBufferHandle BufferHndl,VkDeviceSize Offset,
+                                                       VkDeviceSize Length,bool& StatusOK)
 {
-    if (!AllOK(StatusOK)) return 0;
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    int Index = Handle - 1;
-    if (Index < 0 || Index >= int(I_BufferDetails.size())) {
-        LogError ("Buffer handle value %d is out of range",Handle);
-        Index = 0;
-        StatusOK = false;
-    } else {
-        if (!I_BufferDetails[Index].InUse) {
-            LogError ("Buffer handle value %d is no longer in use",Handle);
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (I_BufferDetails[Index].BufferAccess != ACCESS_SPARSE) {
+            LogError ("ReleaseBufferRange() can only be used for a \"SPARSE\" buffer");
             StatusOK = false;
         }
     }
-    return Index;
+    if (!AllOK(StatusOK)) return;
+    T_BufferDetails& Details = I_BufferDetails[Index];
+    if (Details.SparsePageSize == 0) return;
+    
+    VkDeviceSize Page = Details.SparsePageSize;
+    VkDeviceSize Start = (Offset / Page) * Page;
+    VkDeviceSize End = ((Offset + Length + Page - 1) / Page) * Page;
+    std::vector<T_SparseCommit> Released;
+    std::vector<T_SparseCommit> Kept;
+    for (const T_SparseCommit& Commit : Details.SparseCommits) {
+        if (Commit.Offset >= Start && Commit.Offset + Commit.Size <= End) {
+            Released.push_back(Commit);
+        } else {
+            Kept.push_back(Commit);
+        }
+    }
+    if (Released.size() > 0) {
+        BindSparseMemory(Index,Released,false,StatusOK);
+        if (AllOK(StatusOK)) {
+            for (T_SparseCommit& Commit : Released) FreeBlockMemory(&Commit.Allocation);
+            Details.SparseCommits = Kept;
+            I_Debug.Logf ("Buffers","Released %d range(s) of sparse buffer handle %ld",
+                                                          int(Released.size()),long(BufferHndl));
+        }
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       C r e a t e  C o m p u t e  P i p e l i n e
+//                           G e t  S p a r s e  D e t a i l s
 //
-//  This routine creates a relatively simple Vulkan pipeline that will run a specified GPU
-//  program (written in GLSL), operating on a specified layout of Vulkan data buffers. At this
-//  point, the sizes of the various buffers do not need to be known, but their type (uniform,
-//  storage, etc) and the way they are accessed (local, shared, etc) must be known. The details
-//  of the buffer layout is encapsulated in a descriptor set layout as created by the routine
-//  CreateVulkanDescriptorSetLayout(). The GPU program is specified by giving this routine the
-//  name of a file containing its SPIR-V semi-compiled code. This routine creates both a layout
-//  for the pipeline and then the pipeline itself, and returns Vulkan handles for both.
+//  Returns the size of the pages in which memory is committed to a "SPARSE" buffer, and the
+//  total number of bytes currently committed to it.
 //
 //  Parameters:
-//     ShaderFilename (const std::string&) The name of file containing the SPIR-V code for the
-//                   GPU program to be run by the pipeline.
-//     StageName     (const std::string&) The entry name of the routine in the CPU code to be
-//                   run by the pipeline (often this will be 'main', but it does not have to be).
-//     SetLayoutHndlPtr (VkDescriptorSetLayout*) The address of the opaque Vulkan handle for the
-//                   descriptor set layout, as returned by CreateVulkanDescriptorSetLayout().
-//                   Do note that this is passed as the address of the handle, not the handle
-//                   itself - although this routine does not change the handle.
-//     PipelineLayoutHndlPtr (VkPipelineLayout*) Receives the opaque Vulkan handle for the
-//                   created pipeline layout.
-//     PipelineHndlPtr (VkPipeline*) Receives the opaque Vulkan handle for the created pipeline.
+//     BufferHndl    (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     PageSize      (VkDeviceSize*) Receives the page size in bytes. Ranges are best committed
+//                   in multiples of this, aligned on it.
+//     Committed     (VkDeviceSize*) Receives the number of bytes of the buffer that have memory
+//                   committed to them.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
 //
 //  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
-//     The descriptor set layout for the buffers must have been created by a call to the routine
-//     CreateVulkanDescriptorSetLayout(). The file name specified must be a string that can be
-//     passed to fopen(), and the file should contain valid code.
-//
-//  Note:
-//     o Usually in Vulkan the SPIR_V GPU code in the specified file will have been written in GLSL
-//     and converted (semi-compiled) into SPIR-V using glslc. However, the SPIR-V code could have
-//     been created in other ways - it could have been hand-written, although takes a braver soul
-//     than I, or compiled from another language. All that matters here is that the file contains
-//     valid SPIR-V code.
-//     o Some valid SPIR-V code may be rejected if the GPU in use does not support it. For example,
-//     an Apple GPU cannot run code that uses double precision GPU values, and this will be
-//     spotted when this routine tries to process the code.
-//     o The SetLayoutHndlPtr parameter is a pointer to the handle, as the name suggests, rather
-//     than the handle itself. This is only because the pipeline can be created with a number of
-//     different set layouts, passed to Vulkan as an array, and doing it this way makes it look
-//     like an array with 1 element.
+//     The buffer must be a "SPARSE" buffer, and must have been created using CreateBuffer().
 
-void KVVulkanFramework::CreateComputePipeline(
-    const std::string& ShaderFilename,const std::string& StageName,
-    VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
-                                        VkPipeline* PipelineHndlPtr,bool& StatusOK)
+void KVVulkanFramework::GetSparseDetails (KVBufferHandle BufferHndl,VkDeviceSize* PageSize,
+                                                    VkDeviceSize* Committed,bool& StatusOK)
 {
+    *PageSize = 0;
+    *Committed = 0;
     if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    *PipelineLayoutHndlPtr = VK_NULL_HANDLE;
-    *PipelineHndlPtr = VK_NULL_HANDLE;
-
-    //  Read the SPIR_V code from the file, and create the required shader module.
-    
-    long LengthInBytes;
-    uint32_t* ShaderCode = nullptr;
-    ShaderCode = ReadSpirVFile(ShaderFilename,&LengthInBytes,StatusOK);
-
-    VkShaderModule ShaderModule = CreateShaderModule(ShaderCode,LengthInBytes,StatusOK);
-    
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
     if (AllOK(StatusOK)) {
-
-        //  Set up the pipeline layout
-        
-        VkPipelineShaderStageCreateInfo ShaderStageInfo{};
-        ShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        ShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-        ShaderStageInfo.module = ShaderModule;
-        ShaderStageInfo.pName = StageName.c_str();
-
-        VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
-        PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        PipelineLayoutInfo.setLayoutCount = 1;
-        PipelineLayoutInfo.pSetLayouts = SetLayoutHndlPtr;
-
-        VkResult Result;
-        Result = vkCreatePipelineLayout(I_LogicalDevice,&PipelineLayoutInfo,nullptr,
-                                                                  PipelineLayoutHndlPtr);
-        if (Result != VK_SUCCESS) {
-            LogVulkanError ("Failed to create compute pipeline layout","vkCreatePipelineLayout",
-                                                                                         Result);
+        if (I_BufferDetails[Index].BufferAccess != ACCESS_SPARSE) {
+            LogError ("GetSparseDetails() can only be used for a \"SPARSE\" buffer");
             StatusOK = false;
         } else {
-        
-            //  And now create the actual pipeline.
-            
-            VkComputePipelineCreateInfo PipelineInfo{};
-            PipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-            PipelineInfo.layout = *PipelineLayoutHndlPtr;
-            PipelineInfo.stage = ShaderStageInfo;
-
-            Result = vkCreateComputePipelines(I_LogicalDevice,VK_NULL_HANDLE,1,
-                                              &PipelineInfo,nullptr,PipelineHndlPtr);
-            if (Result != VK_SUCCESS) {
-                LogVulkanError ("Failed to create compute pipeline","vkCreateComputePipelines",
-                                                                                       Result);
-                StatusOK = false;
+            *PageSize = I_BufferDetails[Index].SparsePageSize;
+            for (const T_SparseCommit& Commit : I_BufferDetails[Index].SparseCommits) {
+                *Committed += Commit.Size;
             }
         }
     }
-
-    //  The ShaderCode buffer and the shader module are no longer needed, even if all went well.
-    //  Release them if they have been created.
-    
-    if (ShaderCode) delete[] ShaderCode;
-
-    if (ShaderModule != VK_NULL_HANDLE) {
-        vkDestroyShaderModule(I_LogicalDevice,ShaderModule,nullptr);
-    }
-    
-    //  If the pipeline and its layout were created and bound successfully, record the details
-    //  so they can be shut down properly at the end of the program. If things went wrong,
-    //  release these if they were allocated before the problem was spotted.
-    
-    if (AllOK(StatusOK)) {
-        T_PipelineDetails PipelineDetails;
-        PipelineDetails.PipelineHndl = *PipelineHndlPtr;
-        PipelineDetails.PipelineLayoutHndl = *PipelineLayoutHndlPtr;
-        I_PipelineDetails.push_back(PipelineDetails);
-        I_Debug.Log("Progress","Compute pipeline created.");
-    } else {
-        if (*PipelineLayoutHndlPtr != VK_NULL_HANDLE) {
-            vkDestroyPipelineLayout(I_LogicalDevice,*PipelineLayoutHndlPtr,nullptr);
-        }
-        if (*PipelineHndlPtr != VK_NULL_HANDLE) {
-            vkDestroyPipeline(I_LogicalDevice,*PipelineHndlPtr,nullptr);
-        }
-    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                   C r e a t e  V u l k a n  D e s c r i p t o r  P o o l
+//                             G e t  B u f f e r  A d d r e s s
 //
-//  A Vulkan descriptor set needs to be created for the set of buffers to be used for a calculation.
-//  Vulkan uses a descriptor pool to provide descriptor sets as required, and this routine creates
-//  such a pool. Each pool provides descriptor sets with a particular layout, and this is provided
-//  to this routine by passing it a vector containing all the Framework handles for all the buffers
-//  in question, as returned by SetBufferDetails().
+//  Returns the 64-bit address the GPU uses for a storage buffer. This can be passed to a shader -
+//  most conveniently as a push constant - and a shader that declares the buffer using the
+//  GL_EXT_buffer_reference extension can then access the data through that address, without the
+//  buffer being bound through a descriptor set. This means that one pipeline can work on
+//  different buffers on successive dispatches simply by being given different addresses, and a
+//  buffer that is resized doesn't need its descriptor set rebuilt.
 //
 //  Parameters:
-//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
-//                   Framework handles for each buffer, as returned by SetBufferDetails().
-//     MaxSets       (int) The maximum number of descriptor sets that the pool is to provide.
-//     PoolHndlPtr   (VkDescriptorPool*) Receives the opaque Vulkan handle for the created pool.
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
 //
+//  Returns:
+//     (VkDeviceAddress) The GPU address of the buffer, or zero if it doesn't have one.
+//
 //  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
-//     The details of each buffer in question must have been set using SetBufferDetails() and
-//     the vector (BufferHandles) containing the handles for each buffer must have been created
-//     and filled.
-
-void KVVulkanFramework::CreateVulkanDescriptorPool(
-            std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
-                        int MaxSets,VkDescriptorPool* PoolHndlPtr,bool& StatusOK)
-{
-    if (!AllOK(StatusOK)) return;
- 
-    //  At the moment, this only supports uniform buffers and storage buffers. See how many we
-    //  have of each.
-
-    int UniformBuffers = 0;
-    int StorageBuffers = 0;
-    for (KVBufferHandle Handle : BufferHandles) {
-        int Index = BufferIndexFromHandle(Handle,StatusOK);
-        if (!AllOK(StatusOK)) break;
-        if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) UniformBuffers++;
-        if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) StorageBuffers++;
-    }
+//     The buffer must have been created, and must be a "STORAGE" buffer. The device must support
+//     buffer device addresses - see BufferAddressSupported().
+//
+//  Notes:
+//     o For staged buffers, this is the address of the buffer that the GPU uses, the one that
+//     would otherwise have been bound to the descriptor set.
+//     o The address changes if the buffer is resized by ResizeBuffer(), or deleted and created
+//     again, so it should be obtained again after either.
 
+VkDeviceAddress KVVulkanFramework::GetBufferAddress(KVBufferHandle BufferHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return 0;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    VkDeviceAddress Address = 0;
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
     if (AllOK(StatusOK)) {
-        
-        //  Since we support two buffer types (storage and uniform) we set up their details
-        //  in an array that we will pass to vkCreateDescriptorPool(). If only one type is
-        //  actually being used, NumberPoolTypes will be 1 and the second element of PoolSizes
-        //  won't end up being used. All that PoolSizes is used for is to tell Vulkan how
-        //  many buffers of each type will be used for each set and it can allocate the descriptor
-        //  pool on that basis - together with the number of sets that will be used (MaxSets).
-        
-        std::array<VkDescriptorPoolSize,2> PoolSizes{};
-        int NumberPoolTypes = 0;
-        if (UniformBuffers > 0) NumberPoolTypes++;
-        if (StorageBuffers > 0) NumberPoolTypes++;
-
-        int Index = 0;
-        if (UniformBuffers > 0) {
-            PoolSizes[Index].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            PoolSizes[Index].descriptorCount = UniformBuffers;
-            Index++;
-        }
-        if (StorageBuffers > 0) {
-            PoolSizes[Index].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            PoolSizes[Index].descriptorCount = StorageBuffers;
-            Index++;
-        }
-
-        VkDescriptorPoolCreateInfo PoolInfo{};
-        PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        PoolInfo.poolSizeCount = NumberPoolTypes;
-        PoolInfo.pPoolSizes = PoolSizes.data();
-        PoolInfo.maxSets = MaxSets;
-
-        VkResult Result;
-        Result = vkCreateDescriptorPool(I_LogicalDevice,&PoolInfo,nullptr,PoolHndlPtr);
-        if (Result != VK_SUCCESS) {
-            LogVulkanError ("Failed to create descriptor pool","vkCreateDescriptorPool",Result);
+        if (!I_BufferAddressSupported) {
+            LogError ("Device does not support buffer device addresses.");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].BufferType != TYPE_STORAGE) {
+            LogError ("Buffer device addresses are only available for storage buffers.");
             StatusOK = false;
         } else {
-            I_DescriptorPoolHndls.push_back(*PoolHndlPtr);
+            VkBuffer VulkanBufferHndl = I_BufferDetails[Index].MainBufferHndl;
+            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+                I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU ) {
+                VulkanBufferHndl = I_BufferDetails[Index].SecondaryBufferHndl;
+            }
+            if (VulkanBufferHndl == VK_NULL_HANDLE) {
+                LogError ("Buffer has not been created, so has no device address.");
+                StatusOK = false;
+            } else {
+                VkBufferDeviceAddressInfoKHR AddressInfo{};
+                AddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+                AddressInfo.buffer = VulkanBufferHndl;
+                Address = I_GetBufferDeviceAddress(I_LogicalDevice,&AddressInfo);
+                I_Debug.Logf ("Buffers","Buffer handle %ld has device address 0x%llx",
+                                                   long(BufferHndl),(unsigned long long)Address);
+            }
         }
     }
+    return Address;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                   A l l o c a t e  V u l k a n  D e s c r i p t o r  S e t
+//                        B u f f e r  A d d r e s s  S u p p o r t e d
 //
-//  A Vulkan descriptor set needs to be created for the set of buffers to be used for a calculation,
-//  and this routine allocates such a set from an already created Vulkan descriptor pool.
+//  Returns true if the logical device supports buffer device addresses, in which case
+//  GetBufferAddress() can be used. This is only meaningful once the logical device has been
+//  created.
 //
-//  Parameters:
-//     SetLayoutHndl (VkDescriptorSetLayout) The Vulkan handle for the created descriptor set
-//                   layout, as returned by CreateVulkanDescriptorSetLayout().
-//     PoolHndl      (VkDescriptorPool*) The Vulkan handle for the pool, as returned by
-//                   CreateVulkanDescriptorPool().
-//     SetHndlPtr    (VkDescriptorSet*) Receives the opaque Vulkan handle for the allocated set.
-//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
-//                   this routine returns immediately. If something goes wrong, the variable
-//                   will be set false.
+//  Returns:
+//     (bool)        True if buffer device addresses are supported.
+
+bool KVVulkanFramework::BufferAddressSupported (void)
+{
+    return I_BufferAddressSupported;
+}
+
+//  ------------------------------------------------------------------------------------------------
 //
-//  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
-//     The descriptor set layout for the buffers must have been created by a call to the routine
-//     CreateVulkanDescriptorSetLayout(). The pool must have been created by a call to the routine
-//     CreateVulkanDescriptorPool().
+//                      G e t  H o s t  I m p o r t  A l i g n m e n t
+//
+//  Returns the alignment, in bytes, required for host memory passed to ImportBuffer(). If the
+//  logical device has been created and supports importing host memory, this is the device's
+//  own requirement. Otherwise, it is the (larger) alignment used by AllocateImportableMemory().
+//
+//  Returns:
+//     (long)        The required alignment in bytes.
 
-void KVVulkanFramework::AllocateVulkanDescriptorSet(
-    VkDescriptorSetLayout SetLayoutHandl,
-                    VkDescriptorPool PoolHndl,VkDescriptorSet* SetHndlPtr, bool& StatusOK)
+long KVVulkanFramework::GetHostImportAlignment (void)
 {
-    if (!AllOK(StatusOK)) return;
-    
-    //  First, allocate a single descriptor set from the pool. (Worth mentioning at this point
-    //  that this set doesn't need explicitly destroying - it's destroyed when the pool is
-    //  destroyed.)
-    
-    VkDescriptorSetLayout LocalSetLayoutHandl = SetLayoutHandl;
-    VkDescriptorSetAllocateInfo AllocInfo{};
-    AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    AllocInfo.descriptorPool = PoolHndl;
-    AllocInfo.descriptorSetCount = 1;
-    AllocInfo.pSetLayouts = &LocalSetLayoutHandl;
+    return long(I_HostImportAlignment);
+}
 
-    VkResult Result;
-    Result = vkAllocateDescriptorSets(I_LogicalDevice,&AllocInfo,SetHndlPtr);
-    if (Result != VK_SUCCESS) {
-        LogVulkanError ("Failed to allocate descriptor sets","vkAllocateDescriptorSets",Result);
-        StatusOK = false;
-    }
+//  ------------------------------------------------------------------------------------------------
+//
+//                     G e t  M a x  S t o r a g e  B u f f e r  R a n g e
+//
+//  Returns the largest storage buffer, in bytes, that can be described by a descriptor set -
+//  the device's maxStorageBufferRange limit. A program working with larger data has to split
+//  it between several buffers, or work through it in pieces. It returns zero if no device has
+//  been set up.
+//
+//  Returns:
+//     (VkDeviceSize) The largest storage buffer range in bytes.
+
+VkDeviceSize KVVulkanFramework::GetMaxStorageBufferRange (void)
+{
+    return I_MaxStorageBufferRange;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                   S e t u p  V u l k a n  D e s c r i p t o r  S e t
+//                     A l l o c a t e  I m p o r t a b l e  M e m o r y
 //
-//  A Vulkan descriptor set describes the various buffers used for a calculation. Such a set (and
-//  the pool from which it has to be allocated) can be created given only the initial details of
-//  the number of buffers involved, their types and access details, before the buffers themselves
-//  are actually created. Once the buffers have been created (by calls to CreateBuffer()), the
-//  setup of the descriptor set can be completed. In particular, up until now, the sizes of the
-//  buffers have not been included in the descriptor set.
+//  This static routine allocates host memory that is suitably aligned to be passed to
+//  ImportBuffer(). It rounds the size of the allocation up to a multiple of the alignment, as
+//  Vulkan requires for imported memory. Since it doesn't need a device, it can be used before
+//  the Framework has even been set up - for example, by code that reads an image from a file
+//  before any GPU processing starts. Memory allocated by this routine must be released using
+//  FreeImportableMemory().
 //
 //  Parameters:
-//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
-//                   Framework handles for each buffer, as returned by SetBufferDetails().
-//     SetHndl       (VkDescriptorSet) The Vulkan handle for the descriptor set, as returned
-//                   by CreateVulkanDescriptorSet().
-//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
-//                   this routine returns immediately. If something goes wrong, the variable
-//                   will be set false.
+//     SizeInBytes   (VkDeviceSize) The number of bytes needed.
 //
-//  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
-//     The descriptor set for the buffers must have been created by a call to the routine
-//     CreateVulkanDescriptorSet(). The details of each buffer in question must have been set
-//     using SetBufferDetails(), the vector (BufferHandles) containing the handles for each buffer
-//     must have been created and filled, and all the buffers themselves must now have been
-//     created by calls to CreateBuffer().
+//  Returns:
+//     (void*)       The address of the allocated memory, or nullptr if it couldn't be allocated.
 
-void KVVulkanFramework::SetupVulkanDescriptorSet(
-        std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
-                                        VkDescriptorSet SetHndl, bool& StatusOK)
+void* KVVulkanFramework::AllocateImportableMemory (VkDeviceSize SizeInBytes)
 {
-    if (!AllOK(StatusOK)) return;
-    
-    //  We need to know how many active buffers we have to handle, in order to allocate
-    //  a large enough array to pass to vkUpdateDescriptorSets().
-    
-    int BufferCount = 0;
-    for (KVBufferHandle Handle : BufferHandles) {
-        int Index = BufferIndexFromHandle(Handle,StatusOK);
-        if (!AllOK(StatusOK)) continue;
-        if (I_BufferDetails[Index].InUse) {
-            if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) BufferCount++;
-            if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) BufferCount++;
-        }
-    }
-
-    if (AllOK(StatusOK)) {
-        
-        //  What we pass to vkUpdateDescriptorSets() is an array of VkWriteDescriptorSets,
-        //  which contain things like the binding (which binds the actual buffer we created
-        //  to the buffer referred to by the GPU code) and the type, and also a pointer to
-        //  a VkDescriptorBufferInfo structure that contain things like the VkBuffer handle
-        //  for the buffer and its size. So we also need an arrray of these as well.
-                
-        std::vector<VkWriteDescriptorSet> WriteDescriptors{};
-        WriteDescriptors.resize(BufferCount);
-        std::vector<VkDescriptorBufferInfo> BufferInfo{};
-        BufferInfo.resize(BufferCount);
-
-        int WriteIndex = 0;
-        for (KVBufferHandle Handle : BufferHandles) {
-            
-            //  For each buffer we deal with, first check this is a buffer we know how to handle.
-            //  Just in case. If it's not, we skip to the next buffer.
-            
-            int Index = BufferIndexFromHandle(Handle,StatusOK);
-
-            if (!AllOK(StatusOK)) break;
-            VkDescriptorType Type;
-            if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) {
-                Type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            } else if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) {
-                Type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            } else {
-                continue;
-            }
-            
-            //  Set up the Buffer information structure first
-            
-            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
-                I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU ) {
-                BufferInfo[WriteIndex].buffer = I_BufferDetails[Index].SecondaryBufferHndl;
-            } else {
-                BufferInfo[WriteIndex].buffer = I_BufferDetails[Index].MainBufferHndl;
-            }
-            BufferInfo[WriteIndex].offset = 0;
-            BufferInfo[WriteIndex].range = I_BufferDetails[Index].SizeInBytes;
+    //  This uses malloc() and does its own alignment, rather than use one of the various aligned
+    //  allocation routines, which differ between systems. The address actually returned by
+    //  malloc() is saved just before the aligned address, so FreeImportableMemory() can find it.
+    
+    if (SizeInBytes == 0 || SizeInBytes > VkDeviceSize(SIZE_MAX / 2)) return nullptr;
+    uintptr_t Alignment = uintptr_t(C_HostImportAlignment);
+    size_t RoundedSize = ((size_t(SizeInBytes) + Alignment - 1) / Alignment) * Alignment;
+    char* Base = (char*)malloc(RoundedSize + Alignment + sizeof(void*));
+    if (Base == nullptr) return nullptr;
+    uintptr_t Start = uintptr_t(Base + sizeof(void*));
+    uintptr_t Aligned = (Start + Alignment - 1) & ~(Alignment - 1);
+    ((void**)Aligned)[-1] = Base;
+    return (void*)Aligned;
+}
 
-            //  Then set up the write descriptor set, including a pointer to the Buffer
-            //  information set. (It's OK that the buffer information set will go out of
-            //  scope at the end of this routine - vkUpdateDescriptorSets() will copy
-            //  what it needs from it, and doesn't need it to hang around.)
-            
-            WriteDescriptors[WriteIndex].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            WriteDescriptors[WriteIndex].dstSet = SetHndl;
-            WriteDescriptors[WriteIndex].dstBinding = I_BufferDetails[Index].Binding;
-            WriteDescriptors[WriteIndex].dstArrayElement = 0;
-            WriteDescriptors[WriteIndex].descriptorType = Type;
-            WriteDescriptors[WriteIndex].descriptorCount = 1;
-            WriteDescriptors[WriteIndex].pBufferInfo = &BufferInfo[WriteIndex];
-            WriteIndex++;
-        }
+//  ------------------------------------------------------------------------------------------------
+//
+//                        F r e e  I m p o r t a b l e  M e m o r y
+//
+//  This static routine releases memory allocated by AllocateImportableMemory(). Any buffer
+//  that imported the memory must have been deleted first.
+//
+//  Parameters:
+//     Address       (void*) The address returned by AllocateImportableMemory(). This may be
+//                   nullptr, in which case this routine does nothing.
 
-        //  And now we do the work we came here to do.
-        
-        vkUpdateDescriptorSets(I_LogicalDevice,BufferCount,WriteDescriptors.data(),0,nullptr);
-    }
+void KVVulkanFramework::FreeImportableMemory (void* Address)
+{
+    if (Address) free(((void**)Address)[-1]);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                           C r e a t e  C o m m a n d  P o o l
+//                    I m p o r t  H o s t  B u f f e r   (Internal routine)
 //
-//  A Vulkan command pool is needed to supply the command buffers that can be used to run pipelines
-//  on the GPU. This routine creates such a pool.
+//  This internal routine does the actual work of creating a Vulkan buffer that uses imported
+//  host memory, for ImportBuffer(). The memory is allocated as a dedicated allocation of its
+//  own, rather than coming from the pooled memory blocks used by CreateVulkanBuffer(), and is
+//  marked as such by having no block allocation (a block index of -1), so DestroyVulkanBuffer()
+//  knows to free it. If anything goes wrong, it tidies up and returns false, in which case
+//  ImportBuffer() falls back on copying the data - so problems are logged as warnings rather
+//  than being treated as errors.
 //
 //  Parameters:
-//     CommandPoolHndlPtr (VkCommandPool*) Receives the Vulkan handle for the command pool.
-//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
-//                   this routine returns immediately. If something goes wrong, the variable
-//                   will be set false.
+//     Index         (int) The index into I_BufferDetails for the buffer.
+//     HostAddress   (void*) The address of the host memory, suitably aligned.
+//     SizeInBytes   (VkDeviceSize) The size of the buffer in bytes.
+//
+//  Returns:
+//     (bool)        True if the buffer was created and uses the imported memory.
 //
 //  Pre-requisites:
-//      CreateLogicalDevice() must have been called to create the Vulkan logical device.
+//     The device must support VK_EXT_external_memory_host, as indicated by I_HostImportSupported.
 
-void KVVulkanFramework::CreateCommandPool(VkCommandPool* CommandPoolHndlPtr,bool& StatusOK)
+bool KVVulkanFramework::ImportHostBuffer (int Index,void* HostAddress,VkDeviceSize SizeInBytes)
 {
-    //   CreateLogicalDevice() will have created the logical device and set its handle in
-    //   I_LogicalDevice, and will have identified the command queue family to be used
-    //   and set its index in I_QueueFamilyIndex.
+    //  Imported memory has to be a multiple of the alignment in size.
     
-    if (!AllOK(StatusOK)) return;
+    VkDeviceSize ImportSize = ((VkDeviceSize(SizeInBytes) + I_HostImportAlignment - 1) /
+                                                I_HostImportAlignment) * I_HostImportAlignment;
     
-    VkCommandPoolCreateInfo PoolInfo{};
-    PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    PoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    PoolInfo.queueFamilyIndex = I_QueueFamilyIndex;
+    //  Find which memory types can be used with this host memory.
     
-    //  Note that you don't have to specify the number of command buffers in the pool. The pool
-    //  doesn't contain the buffers it will be asked to allocate, it just coordinates them.
+    VkMemoryHostPointerPropertiesEXT PointerProperties{};
+    PointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    VkResult Result = I_GetMemoryHostPointerProperties(I_LogicalDevice,
+                 VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,HostAddress,&PointerProperties);
+    if (Result != VK_SUCCESS) {
+        LogWarning ("Unable to get host pointer properties: %s",string_VkResult(Result));
+        return false;
+    }
     
-    VkResult Result;
-    Result = vkCreateCommandPool(I_LogicalDevice,&PoolInfo,nullptr,CommandPoolHndlPtr);
+    //  Create the buffer, saying it will use external host memory.
+    
+    VkExternalMemoryBufferCreateInfo ExternalInfo{};
+    ExternalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    ExternalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    VkBufferCreateInfo BufferInfo{};
+    BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    BufferInfo.pNext = &ExternalInfo;
+    BufferInfo.size = VkDeviceSize(SizeInBytes);
+    BufferInfo.usage = I_BufferDetails[Index].MainUsageFlags;
+    BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer BufferHndl = VK_NULL_HANDLE;
+    Result = vkCreateBuffer(I_LogicalDevice,&BufferInfo,nullptr,&BufferHndl);
     if (Result != VK_SUCCESS) {
-        LogVulkanError ("Failed to create command pool","vkCreateCommandPool",Result);
-        StatusOK = false;
-    } else {
-        I_Debug.Log ("Progress","Created new command pool.");
-        I_CommandPoolHndls.push_back(*CommandPoolHndlPtr);
+        LogWarning ("Unable to create buffer for imported memory: %s",string_VkResult(Result));
+        return false;
     }
-}
-
+    
+    //  The memory type has to suit both the buffer and the host memory, and be visible to the
+    //  CPU. (GetMemoryTypeIndex() treats not finding one as an error, so we don't use it here.)
+    
+    VkMemoryRequirements MemoryRequirements;
+    vkGetBufferMemoryRequirements(I_LogicalDevice,BufferHndl,&MemoryRequirements);
+    uint32_t TypeBits = MemoryRequirements.memoryTypeBits & PointerProperties.memoryTypeBits;
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice,&MemoryProperties);
+    bool TypeOK = false;
+    uint32_t MemoryTypeIndex = 0;
+    if (MemoryRequirements.size <= ImportSize) {
+        for (uint32_t I = 0; I < MemoryProperties.memoryTypeCount; I++) {
+            if ((TypeBits & (1 << I)) && (MemoryProperties.memoryTypes[I].propertyFlags &
+                                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+                MemoryTypeIndex = I;
+                TypeOK = true;
+                break;
+            }
+        }
+    }
+    VkDeviceMemory MemoryHndl = VK_NULL_HANDLE;
+    if (TypeOK) {
+        
+        //  Allocate the memory, passing the host address to be imported, and bind it.
+        
+        VkImportMemoryHostPointerInfoEXT ImportInfo{};
+        ImportInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+        ImportInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+        ImportInfo.pHostPointer = HostAddress;
+        VkMemoryAllocateFlagsInfo AllocateFlags{};
+        AllocateFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        AllocateFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+        if (I_BufferAddressSupported) ImportInfo.pNext = &AllocateFlags;
+        VkMemoryAllocateInfo AllocInfo{};
+        AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        AllocInfo.pNext = &ImportInfo;
+        AllocInfo.allocationSize = ImportSize;
+        AllocInfo.memoryTypeIndex = MemoryTypeIndex;
+        Result = vkAllocateMemory(I_LogicalDevice,&AllocInfo,nullptr,&MemoryHndl);
+        if (Result != VK_SUCCESS) {
+            LogWarning ("Unable to import host memory: %s",string_VkResult(Result));
+            MemoryHndl = VK_NULL_HANDLE;
+        } else {
+            Result = vkBindBufferMemory(I_LogicalDevice,BufferHndl,MemoryHndl,0);
+            if (Result != VK_SUCCESS) {
+                LogWarning ("Unable to bind imported memory: %s",string_VkResult(Result));
+                vkFreeMemory(I_LogicalDevice,MemoryHndl,nullptr);
+                MemoryHndl = VK_NULL_HANDLE;
+            }
+        }
+    } else {
+        LogWarning ("No memory type is suitable for importing host memory at %p",HostAddress);
+    }
+    if (MemoryHndl == VK_NULL_HANDLE) {
+        vkDestroyBuffer(I_LogicalDevice,BufferHndl,nullptr);
+        return false;
+    }
+    
+    //  The memory is already visible to the CPU at the host address, so it counts as mapped.
+    
+    I_Debug.Logf ("Buffers","VkBuffer %p created using %llu bytes of host memory at %p",
+                                    BufferHndl,(unsigned long long)SizeInBytes,HostAddress);
+    I_BufferDetails[Index].SizeInBytes = SizeInBytes;
+    I_BufferDetails[Index].MemorySizeInBytes = SizeInBytes;
+    I_BufferDetails[Index].MainBufferHndl = BufferHndl;
+    I_BufferDetails[Index].MainBufferMemoryHndl = MemoryHndl;
+    I_BufferDetails[Index].MainAllocation = {-1,0,0};
+    I_BufferDetails[Index].MappedAddress = HostAddress;
+    return true;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
-//                     C r e a t e  C o m p u t e  C o m m a n d  B u f f e r
+//                   C r e a t e  V u l k a n  B u f f e r   (Internal routine)
 //
-//  This routine creates a single Vulkan command buffer, which may be enough for a simple compute
-//  program that may only need a single such buffer.
+//  This internal routine creates a single Vulkan buffer and allocates the memory for it. It
+//  needs to know the buffer usage type (storage, uniform, vertex) and its properties (mostly
+//  to do with sharing, ie shared, local, etc). These are set by SetBufferDetails() when the
+//  initial details of the buffer are supplied. It also needs to know the buffer size in bytes.
+//  It returns the Vulkan handles for the buffer and for its associated memory. Note that
+//  what Vulkan calls a 'buffer' - something it references using a VkBuffer handle - and what
+//  the Framework calls a 'buffer' are rather different; the Framework treats a buffer and its
+//  memory as a signle item, and even treats a staged buffer (implemented through two Vulkan
+//  buffers, one local to the CPU and one local to the GPU) as a single item. This routine
+//  needs to be called twice for a staged buffer.
 //
 //  Parameters:
-//     CommandPoolHndl (VkCommandPool) The Vulkan handle for the command pool, as returned by
-//                     CreateCommandPool().
-//     CommandBufferHndlPtr  (VkCommandBuffer*) Receives the Vulkan handle for the command buffer.
-//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
-//                     this routine returns immediately. If something goes wrong, the variable
-//                     will be set false.
+//     SizeInBytes   (VkDeviceSize) The size of the buffer in bytes.
+//     UsageFlags    (VkBufferUsageFlags) Describes the usage of the buffer - uniform, storage, etc.
+//     PropertyFlags (VkMemoryPropertyFlags) Describes the memory properties for the buffer,
+//                   GPU local, shared, etc. that the buffer needs to have.
+//     PreferredFlags (VkMemoryPropertyFlags) Additional memory properties that the buffer would
+//                   prefer to have, if there is a suitable memory type. Can be zero.
+//     BufferHndlPtr (VkBuffer*) Receives the buffer handle used by Vulkan to access the buffer.
+//     BufferMemoryHandlPtr (VkDeviceMemory*) Receives the memory handle used by Vulkan to access
+//                   the memory for the buffer. This is the handle for the whole of the pooled
+//                   memory block that the buffer's memory is part of.
+//     AllocationPtr (T_MemoryAllocation*) Receives the details of the range of the pooled memory
+//                   block used by the buffer. This has to be passed to DestroyVulkanBuffer()
+//                   when the buffer is no longer needed.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//     Concurrent    (bool) If true, and more than one queue family is in use, the buffer is
+//                   created for concurrent use by all of them. Defaults to false.
 //
 //  Pre-requisites:
-//      CreateLogicalDevice() must have been called to create the Vulkan logical device,
-//      and CreateCommandPool() must have been called to create the command pool.
+//     CreateLogicalDevice() must have been called to create the logical device and set its
+//     handle in I_LogicalDevice. (I_SelectedDevice also needs to have been set to the handle
+//     of the selected physical device - this is needed to determine the supported memory
+//     types - but this is a necessary precursor to CreateLogicalDevice() anyway.)
 //
 //  Note:
-//     This was originally provided by an early version for the Framework and is retained for
-//     backwards compatability and perhaps some convenience. Command buffers are the same for
-//     both compute and graphics pipelines, and this is now just a simple wrapper around
-//     CreateCommandBuffers()
+//     Originally, this routine called vkAllocateMemory() for each buffer. It now gets the memory
+//     from AllocateBlockMemory(), which sub-allocates it from a much larger block of device
+//     memory, and so the buffer memory is bound at a non-zero offset within that block.
 
-void KVVulkanFramework::CreateComputeCommandBuffer(
-        VkCommandPool CommandPoolHndl, VkCommandBuffer* CommandBufferHndlPtr,bool& StatusOK)
+void KVVulkanFramework::CreateVulkanBuffer(
+        VkDeviceSize SizeInBytes,VkBufferUsageFlags UsageFlags,VkMemoryPropertyFlags PropertyFlags,
+                        VkMemoryPropertyFlags PreferredFlags,VkBuffer* BufferHndlPtr,VkDeviceMemory* BufferMemoryHndlPtr,
+                                T_MemoryAllocation* AllocationPtr,bool& StatusOK,bool Concurrent)
 {
     if (!AllOK(StatusOK)) return;
-    std::vector<VkCommandBuffer> CommandBuffers;
-    CreateCommandBuffers (CommandPoolHndl,1,CommandBuffers,StatusOK);
-    *CommandBufferHndlPtr = CommandBuffers[0];
+    
+    //  The VkBuffer type is an opaque handle to a data buffer. You create one with a call to
+    //  vkCreateBuffer(), which returns a 'handle' that identifies the buffer and which you can
+    //  use in calls to other Vulkan routines. You shouldn't make any assumptions about what
+    //  this handle is (it's probably an address, but it could be an index into an internal
+    //  table maintained by Vulkan). But you can use a value of VK_NULL_HANDLE to indicate that
+    //  it hasn't been set yet. Creating a buffer with vkCreateBuffer() doesn't actually create
+    //  the memory for the data in the buffer. You have to do that separately, by calling
+    //  vkAllocateMemory(), which returns another handle value identifying the memory, and then
+    //  bind that memory to the buffer. The BufferHndlPtr parameter is the address of a buffer
+    //  handle which will be set by this routine, hence the name.
+        
+    *BufferHndlPtr = VK_NULL_HANDLE;
+    *BufferMemoryHndlPtr = VK_NULL_HANDLE;
+    *AllocationPtr = {-1,0,0};
+    
+    //  First though, we do have to create the buffer.
+    
+    //  Normally, the buffer's sharing mode will be VK_SHARING_MODE_EXCLUSIVE (the buffer will
+    //  only be used by one queue family at a time, and has to be passed explicitly from one to
+    //  another). The alternative, VK_SHARING_MODE_CONCURRENT, needs a list of the queue families
+    //  that will use it, which is only worth having if Concurrent is set and there really is
+    //  more than one family in use. (Vulkan doesn't allow a list of just one family.)
+    
+    VkBufferCreateInfo BufferInfo{};
+    BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    BufferInfo.size = SizeInBytes;
+    BufferInfo.usage = UsageFlags;
+    BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    std::vector<uint32_t> Families;
+    if (Concurrent) {
+        for (uint32_t Family : {I_QueueFamilyIndex,I_ComputeQueueFamilyIndex,
+                                                                 I_TransferQueueFamilyIndex}) {
+            if (std::find(Families.begin(),Families.end(),Family) == Families.end()) {
+                Families.push_back(Family);
+            }
+        }
+        if (Families.size() > 1) {
+            BufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            BufferInfo.queueFamilyIndexCount = uint32_t(Families.size());
+            BufferInfo.pQueueFamilyIndices = Families.data();
+        }
+    }
+
+    I_Debug.Log ("Buffers","Creating Vulkan buffer.");
+    VkResult Result;
+    Result = vkCreateBuffer(I_LogicalDevice,&BufferInfo,nullptr,BufferHndlPtr);
+    if (Result == VK_SUCCESS) {
+                
+        //  Before we allocate the memory needed for the buffer, we have to determine what type of
+        //  memory we need. Vulkan devices provide different types of memory, and different buffer
+        //  types have different memory requirements. Now that we have set up our VkBuffer, and
+        //  have its address in BufferHndlPtr, we can find out what it actually requires.
+        
+        VkMemoryRequirements MemoryRequirements;
+        vkGetBufferMemoryRequirements(I_LogicalDevice,*BufferHndlPtr,&MemoryRequirements);
+        
+        //  Then we get a suitably aligned range of memory of the right type from one of the
+        //  pooled memory blocks. AllocateBlockMemory() works out which memory type will do,
+        //  and allocates a new block of that type if none of the existing ones has room.
+        
+        AllocateBlockMemory(MemoryRequirements,PropertyFlags,PreferredFlags,AllocationPtr,
+                                                                                    StatusOK);
+        if (AllOK(StatusOK)) {
+            
+            //  And having done that, we can bind that part of the block memory to our buffer.
+            
+            T_MemoryBlock& Block = I_MemoryBlocks[AllocationPtr->BlockIndex];
+            *BufferMemoryHndlPtr = Block.MemoryHndl;
+            Result = vkBindBufferMemory(I_LogicalDevice,*BufferHndlPtr,*BufferMemoryHndlPtr,
+                                                                        AllocationPtr->Offset);
+            if (Result != VK_SUCCESS) {
+                LogVulkanError ("Failed to bind buffer memory","vkBindBufferMemory",Result);
+                StatusOK = false;
+            }
+        }
+        
+    } else {
+        LogVulkanError ("Failed to create buffer","vkCreateBuffer",Result);
+        StatusOK = false;
+    }
+    
+    //  If things went wrong, release anything that was allocated before the problem was spotted.
+    
+    if (!AllOK(StatusOK)) {
+        DestroyVulkanBuffer(BufferHndlPtr,BufferMemoryHndlPtr,AllocationPtr);
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                         C r e a t e  C o m m a n d  B u f f e r s
+//                 D e s t r o y  V u l k a n  B u f f e r   (Internal routine)
 //
-//  This routine creates a specified number of the Vulkan command buffers that used to run
-//  pipelines. A simple compute program may only need a single such buffer, but a graphics
-//  program running a swap chain may need one buffer for each image being used.
+//  This internal routine is the reverse of CreateVulkanBuffer(). It destroys a single Vulkan
+//  buffer and returns the range of pooled block memory it was using so that it can be re-used
+//  by another buffer. It then clears the buffer and memory handles and the allocation details,
+//  so it is safe to call it more than once for the same buffer, or for a buffer that was
+//  never created (in which case it does nothing).
 //
 //  Parameters:
-//     CommandPoolHndl (VkCommandPool) The Vulkan handle for the command pool, as returned by
-//                     CreateCommandPool().
-//     NumberBuffers   (int) The number of command buffers to be created.
-//     CommandBuffers  (std::vector<VkCommandBuffer>&) Returns the set of command buffers
-//                     requested.
-//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
-//                     this routine returns immediately. If something goes wrong, the variable
-//                     will be set false.
+//     BufferHndlPtr (VkBuffer*) The address of the buffer handle returned by CreateVulkanBuffer().
+//     BufferMemoryHandlPtr (VkDeviceMemory*) The address of the memory handle returned by
+//                   CreateVulkanBuffer().
+//     AllocationPtr (T_MemoryAllocation*) The address of the memory allocation details returned
+//                   by CreateVulkanBuffer().
 //
 //  Pre-requisites:
-//      CreateLogicalDevice() must have been called to create the Vulkan logical device,
-//      and CreateCommandPool() must have been called to create the command pool.
+//     If the buffer had been mapped, UnmapBlockMemory() should already have been called for it.
+//
+//  Note:
+//     A buffer created by ImportHostBuffer() has its own dedicated memory allocation, which is
+//     freed here. No block memory is involved.
 
-void KVVulkanFramework::CreateCommandBuffers(
-        VkCommandPool CommandPoolHndl, int NumberBuffers,
-                            std::vector<VkCommandBuffer>& CommandBuffers,bool& StatusOK)
+void KVVulkanFramework::DestroyVulkanBuffer(VkBuffer* BufferHndlPtr,
+                        VkDeviceMemory* BufferMemoryHndlPtr,T_MemoryAllocation* AllocationPtr)
 {
-    if (!AllOK(StatusOK)) return;
-        
-    VkCommandBufferAllocateInfo AllocInfo{};
-    AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    AllocInfo.commandPool = CommandPoolHndl;
-    AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    AllocInfo.commandBufferCount = NumberBuffers;
-    
-    CommandBuffers.resize(NumberBuffers);
-
-    VkResult Result;
-    Result = vkAllocateCommandBuffers(I_LogicalDevice,&AllocInfo,CommandBuffers.data());
-    if (Result != VK_SUCCESS) {
-        LogVulkanError("Failed to allocate command buffers","vkAllocateCommandBuffers",Result);
-        StatusOK = false;
+    if (*BufferHndlPtr != VK_NULL_HANDLE) {
+        vkDestroyBuffer(I_LogicalDevice,*BufferHndlPtr,nullptr);
+        *BufferHndlPtr = VK_NULL_HANDLE;
     }
     
-    if (AllOK(StatusOK)) I_Debug.Logf ("Progress","Allocated %d command buffers.",NumberBuffers);
+    //  Memory that isn't part of a pooled block is imported host memory, which has its own
+    //  dedicated allocation. See ImportHostBuffer().
+    
+    if (AllocationPtr->BlockIndex < 0 && *BufferMemoryHndlPtr != VK_NULL_HANDLE) {
+        vkFreeMemory(I_LogicalDevice,*BufferMemoryHndlPtr,nullptr);
+    }
+    FreeBlockMemory(AllocationPtr);
+    *BufferMemoryHndlPtr = VK_NULL_HANDLE;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                         R e c o r d  C o m p u t e  C o m m a n d  B u f f e r
+//              R e l e a s e  T r a n s i e n t  B u f f e r   (Internal routine)
 //
-//  This routine sets up a command buffer with the details of the operation it is to perform.
-//  This includes binding the buffer to the pipeline to be used, and to the descriptor sets
-//  that describe how it is to use the various data buffers. It also need to be told how to
-//  distribute the calculations across the various workgroups that are to be used - this depends
-//  on both the dimensions of the data being processed and the details of the shader code to
-//  be run by the pipeline.
+//  This internal routine destroys the Vulkan buffer for a buffer created by
+//  CreateTransientBuffers(), and frees the memory it shares with the others created with it
+//  once none of them are left. It does nothing for any other buffer, and it leaves the buffer's
+//  handles cleared, so a following call to DestroyVulkanBuffer() does nothing either.
 //
-//  This is the final thing to be done before the buffer can be submitted for execution using
-//  RunCommandBuffer(), and everything must have been set up properly at this point - the
-//  pipeline must be set up, and the descriptor set must describe the buffers, which must all
-//  have been created.
+//  Parameters:
+//     Index         (int) The index of the buffer in I_BufferDetails.
+
+void KVVulkanFramework::ReleaseTransientBuffer(int Index)
+{
+    T_BufferDetails& Details = I_BufferDetails[Index];
+    int GroupIndex = Details.TransientGroup;
+    if (GroupIndex < 0 || GroupIndex >= int(I_TransientGroups.size())) return;
+    if (Details.MainBufferHndl != VK_NULL_HANDLE) {
+        vkDestroyBuffer(I_LogicalDevice,Details.MainBufferHndl,nullptr);
+        Details.MainBufferHndl = VK_NULL_HANDLE;
+    }
+    Details.MainBufferMemoryHndl = VK_NULL_HANDLE;
+    Details.TransientGroup = -1;
+    T_TransientGroup& Group = I_TransientGroups[GroupIndex];
+    if (--Group.Buffers <= 0) FreeBlockMemory(&Group.Allocation);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 C r e a t e  S p a r s e  B u f f e r   (Internal routine)
+//
+//  This internal routine does the work of CreateBuffer() for a "SPARSE" buffer. It creates the
+//  Vulkan buffer with the sparse binding and sparse residency flags, which allows memory to be
+//  bound to it page by page, and with none bound at all to begin with. It records the page size
+//  and the memory types that can be used, which CommitBufferRange() needs.
 //
 //  Parameters:
-//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
-//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
-//     PipelineHndl    (VkPipeline) The Vulkan handle for the pipeline to be run, as returned by
-//                     CreateComputePipeline().
-//     DescriptorSetHndlPtr (VkDescriptorSet*) The address of the descriptor set that contains
-//                     details of the buffers to be used by the calculation. This must have been
-//                     set by AllocateVulkanDescriptorSet(). Note that this is passed by
-//                     address, not by value.
-//     WorkGroupCounts (uint32_t[3]) The 3-D layout of the workgroups to be used. This is an
-//                     array set up on the basis of the dimensions of the data, but also has
-//                     to take into account the coding of the shader program that will process
-//                     the data.
-//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
-//                     this routine returns immediately. If something goes wrong, the variable
-//                     will be set false.
+//     Index         (int) The index into I_BufferDetails of the buffer.
+//     SizeInBytes   (VkDeviceSize) The size of the buffer in bytes - the size of the address
+//                   range reserved, not of any memory.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
-//  Pre-requisites:
-//      The command buffer must have been created by either CreateCommandBuffers() or by
-//      CreateComputeCommandBuffer(). The pipeline must have been created by CreateComputePipeline()
-//      and the descriptor set must have been allocated by AllocateVulkanDescriptorSet and set up
-//      by SetupVulkanDescriptorSet().  all the various pre-requisites for those routines must have
-//      been fulfilled as well.
+//  Note:
+//     The buffer can be no larger than the device's sparseAddressSpaceSize limit, usually far
+//     larger than any device memory. Each descriptor set still only describes as much of it as
+//     maxStorageBufferRange allows.
 
-void KVVulkanFramework::RecordComputeCommandBuffer(
-    VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
-    VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
-    uint32_t WorkGroupCounts[3],bool& StatusOK)
+void KVVulkanFramework::CreateSparseBuffer (int Index,VkDeviceSize SizeInBytes,bool& StatusOK)
 {
-    //  Note that the calculation of the values in WorkGroupCounts[] has to take into account
-    //  the 3D dimensions of the data to be processed by the GPU shader (which will depend on
-    //  the nature of the data itself, which will be known to the calling program) and on the
-    //  3D dimensions of the local workgroup (which are set explicitly by the shader code, and
-    //  appear not to be accessible by the CPU code).
-    
     if (!AllOK(StatusOK)) return;
     
-    //  'Record' here means setting up the command buffer with the details of the operation
-    //  to be performed. In particular the command buffer has to be bound to both the pipeline
-    //  to be used and the descriptor sets that describe how it is to use the various data buffers.
-    
-    VkCommandBufferBeginInfo BeginInfo{};
-    BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-    VkResult Result;
-    Result = vkBeginCommandBuffer(CommandBufferHndl,&BeginInfo);
+    if (!I_SparseSupported) {
+        LogError ("The device does not support sparse buffers.");
+        StatusOK = false;
+        return;
+    }
+    T_BufferDetails& Details = I_BufferDetails[Index];
+    VkBufferCreateInfo BufferInfo{};
+    BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    BufferInfo.flags = VK_BUFFER_CREATE_SPARSE_BINDING_BIT | VK_BUFFER_CREATE_SPARSE_RESIDENCY_BIT;
+    BufferInfo.size = SizeInBytes;
+    BufferInfo.usage = Details.MainUsageFlags;
+    BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer Buffer = VK_NULL_HANDLE;
+    VkResult Result = vkCreateBuffer(I_LogicalDevice,&BufferInfo,nullptr,&Buffer);
     if (Result != VK_SUCCESS) {
-        LogVulkanError ("Failed to begin recording compute command buffer","vkBeginCommandBuffer",
-                                                                                           Result);
+        LogVulkanError ("Failed to create sparse buffer","vkCreateBuffer",Result);
         StatusOK = false;
     } else {
-
-        //  Note that the next three calls don't return a status, so we can't test to see
-        //  if anything went wrong. The best we can do is use AllOK() to see if the validation
-        //  layers reported an error.
-        
-        vkCmdBindPipeline(CommandBufferHndl,VK_PIPELINE_BIND_POINT_COMPUTE,PipelineHndl);
-        
-        vkCmdBindDescriptorSets(CommandBufferHndl,VK_PIPELINE_BIND_POINT_COMPUTE,
-                                          PipelineLayoutHndl,0,1,DescriptorSetHndlPtr,0,nullptr);
-        
-        //  This adds the 'dispatch' stage to the compute pipeline, and will start it
-        //  running the compute shader when the command buffer is finally submitted for
-        //  execution. It needs to be told the number of the work groups (in 3D) that
-        //  will be run. The total number of threads run will be the number of work groups
-        //  specified here multiplied by the local size of the work groups as set up in
-        //  the shader code. (Note that this is different to the scheme used by Metal,
-        //  where both sizes are set - in a slightly different way - in the CPU code. As
-        //  far as I can see, there is no way in Vulkan for the CPU code to reliably find
-        //  out the local sizes set in the shader code - they may be the same as the
-        //  subgroup size but that can't be relied on.)
-                
-        vkCmdDispatch(CommandBufferHndl,WorkGroupCounts[0],WorkGroupCounts[1],
-                                       WorkGroupCounts[2]);
         
-        //  Now finish off the command buffer.
+        //  For a sparse buffer, the alignment given by the memory requirements is the page
+        //  size, and the size is the buffer size rounded up to a whole number of pages.
         
-        Result = vkEndCommandBuffer(CommandBufferHndl);
-        if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
-            LogVulkanError ("Failed to complete Vulkan command buffer","vkEndCommandBuffer",Result);
-            StatusOK = false;
-        }
+        VkMemoryRequirements MemoryRequirements;
+        vkGetBufferMemoryRequirements(I_LogicalDevice,Buffer,&MemoryRequirements);
+        Details.MainBufferHndl = Buffer;
+        Details.MainBufferMemoryHndl = VK_NULL_HANDLE;
+        Details.MainAllocation = {-1,0,0};
+        Details.SizeInBytes = SizeInBytes;
+        Details.MemorySizeInBytes = MemoryRequirements.size;
+        Details.SparsePageSize = MemoryRequirements.alignment;
+        if (Details.SparsePageSize < 1) Details.SparsePageSize = 1;
+        Details.SparseMemoryTypeBits = MemoryRequirements.memoryTypeBits;
+        Details.SparseCommits.clear();
+        I_Debug.Logf ("Buffers","Sparse VkBuffer %p created, size %llu bytes, page %llu bytes.",
+                     Buffer,(unsigned long long)SizeInBytes,
+                                                (unsigned long long)Details.SparsePageSize);
     }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                             G e t  D e v i c e  Q u e u e
+//                   B i n d  S p a r s e  M e m o r y   (Internal routine)
 //
-//  This returns a queue that can be used to submit a command buffer to the GPU for processing.
+//  This internal routine binds the memory for a number of ranges of a "SPARSE" buffer, or
+//  unbinds it, using a single vkQueueBindSparse() call on the main queue, and waits for that to
+//  complete.
 //
 //  Parameters:
-//     QueueHndlPtr    (VkQueue*) Receives the Vulkan handle for the queue.
-//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
-//                     this routine returns immediately. If something goes wrong, the variable
-//                     will be set false.
+//     Index         (int) The index into I_BufferDetails of the buffer.
+//     Commits       (const std::vector<T_SparseCommit>&) The ranges, and the pooled memory for
+//                   each.
+//     Bind          (bool) True to bind the memory, false to unbind it.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
-//  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//  Note:
+//     Sparse binding operations aren't ordered with respect to command buffers submitted to the
+//     same queue, which is why this waits for them to complete rather than leave the caller to
+//     synchronise with them using semaphores.
 
-void KVVulkanFramework::GetDeviceQueue(VkQueue* QueueHndlPtr,bool& StatusOK)
+void KVVulkanFramework::BindSparseMemory (int Index,const std::vector<T_SparseCommit>& Commits,
+                                                                   bool Bind,bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
     
-    //  I_LogicalDevice and I_QueueFamilyIndex will have been set by CreateLogicalDevice().
-
-    vkGetDeviceQueue(I_LogicalDevice,I_QueueFamilyIndex,0,QueueHndlPtr);
-    
-    //  vkGetDeviceQueue() returns void, with no error indications. If validation layers are
-    //  on they may catch an error, but otherwise the best bet seems to be test the returned
-    //  queue handle.
-    
-    if (QueueHndlPtr == nullptr || *QueueHndlPtr == VK_NULL_HANDLE) {
-        LogError("Failed to get device queue. vkGetDeviceQueue returns null handle.");
+    std::vector<VkSparseMemoryBind> Binds;
+    for (const T_SparseCommit& Commit : Commits) {
+        VkSparseMemoryBind MemoryBind{};
+        MemoryBind.resourceOffset = Commit.Offset;
+        MemoryBind.size = Commit.Size;
+        if (Bind) {
+            MemoryBind.memory = I_MemoryBlocks[Commit.Allocation.BlockIndex].MemoryHndl;
+            MemoryBind.memoryOffset = Commit.Allocation.Offset;
+        } else {
+            MemoryBind.memory = VK_NULL_HANDLE;
+            MemoryBind.memoryOffset = 0;
+        }
+        Binds.push_back(MemoryBind);
+    }
+    VkSparseBufferMemoryBindInfo BufferBindInfo{};
+    BufferBindInfo.buffer = I_BufferDetails[Index].MainBufferHndl;
+    BufferBindInfo.bindCount = uint32_t(Binds.size());
+    BufferBindInfo.pBinds = Binds.data();
+    VkBindSparseInfo BindInfo{};
+    BindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+    BindInfo.bufferBindCount = 1;
+    BindInfo.pBufferBinds = &BufferBindInfo;
+    
+    VkQueue QueueHndl = VK_NULL_HANDLE;
+    GetDeviceQueue(&QueueHndl,StatusOK);
+    VkFence Fence = GetPooledFence(StatusOK);
+    if (!AllOK(StatusOK)) return;
+    VkResult Result = vkQueueBindSparse(QueueHndl,1,&BindInfo,Fence);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to bind sparse buffer memory","vkQueueBindSparse",Result);
+        StatusOK = false;
+        I_FreeFenceHndls.push_back(Fence);
+        return;
+    }
+    Result = vkWaitForFences(I_LogicalDevice,1,&Fence,VK_TRUE,UINT64_MAX);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed waiting for sparse binding","vkWaitForFences",Result);
         StatusOK = false;
     }
+    if (vkResetFences(I_LogicalDevice,1,&Fence) == VK_SUCCESS) {
+        I_FreeFenceHndls.push_back(Fence);
+    } else {
+        vkDestroyFence(I_LogicalDevice,Fence,nullptr);
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                             R u n  C o m m a n d  B u f f e r
+//              R e l e a s e  S p a r s e  C o m m i t s   (Internal routine)
 //
-//  Submits a command buffer to a queue on the GPU for processing and waits until it has completed.
-//  This is what all the long series of calls to set up a GPU computation have been leading to.
+//  This internal routine returns all the memory committed to a "SPARSE" buffer to the pooled
+//  memory blocks. It is used when the buffer is deleted, and should be called once the Vulkan
+//  buffer has been destroyed, so there is no need to unbind the memory. It does nothing for
+//  any other type of buffer.
 //
 //  Parameters:
-//     QueueHndl       (VkQueue) The Vulkan handle for the queue, as returned by GetDeviceQueue().
-//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
-//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
-//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
-//                     this routine returns immediately. If something goes wrong, the variable
-//                     will be set false.
+//     Index         (int) The index into I_BufferDetails of the buffer.
+
+void KVVulkanFramework::ReleaseSparseCommits (int Index)
+{
+    for (T_SparseCommit& Commit : I_BufferDetails[Index].SparseCommits) {
+        FreeBlockMemory(&Commit.Allocation);
+    }
+    I_BufferDetails[Index].SparseCommits.clear();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 A l l o c a t e  B l o c k  M e m o r y   (Internal routine)
+//
+//  This internal routine finds a range of device memory that meets the requirements of a
+//  Vulkan buffer, and which has the specified memory properties. The range is taken from one of
+//  the large pooled memory blocks maintained in I_MemoryBlocks, and if none of the existing
+//  blocks of a suitable memory type has a large enough free range, a new block is allocated.
+//  A buffer that is larger than half the standard block size gets a 'dedicated' block of its
+//  own, which will be released when the buffer is destroyed.
+//
+//  Parameters:
+//     MemoryRequirements (const VkMemoryRequirements&) The memory requirements for the buffer,
+//                    as returned by vkGetBufferMemoryRequirements(). This gives the size needed,
+//                    the required alignment, and the memory types that can be used.
+//     PropertyFlags  (VkMemoryPropertyFlags) Describes the memory properties for the buffer,
+//                    GPU local, shared, etc. that the buffer needs to have.
+//     PreferredFlags (VkMemoryPropertyFlags) Memory properties the buffer would prefer to have.
+//     AllocationPtr  (T_MemoryAllocation*) Receives the details of the allocated range - the
+//                    index of the block, and the offset and size of the range within the block.
+//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
+//                    this routine returns immediately. If something goes wrong, the variable
+//                    will be set false.
 //
 //  Pre-requisites:
-//     The CommandBuffer must have been set up by RecordCommandBuffer(), the queue must have been
-//     obtained from GetDeviceQueue(), and all their pre-requisites must have been completed.
+//     CreateLogicalDevice() must have been called to create the logical device.
 //
 //  Note:
-//     The command buffer must be re-recorded before it can be re-used, but so long as the layout
-//     of the buffers remains unchanged, the data in them can be modified and the command buffer
-//     re-recorded and re-run without other changes being needed.
-
-void KVVulkanFramework::RunCommandBuffer(
-    VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,bool& StatusOK)
+//     o Vulkan requires that buffers and 'optimal' images (and the framework only uses images
+//     for the swap chain, and doesn't allocate memory for those) that share a block of memory
+//     are kept bufferImageGranularity bytes apart. The framework only puts buffers into these
+//     blocks, but being conservative, it rounds both the offset and the size of every range up
+//     to a multiple of the granularity. On most devices this is small enough not to matter.
+//     o The free ranges in each block are searched in order of offset and the first range that
+//     is large enough is used. This is simple and - given the small number of buffers these
+//     programs use - quite good enough.
+
+void KVVulkanFramework::AllocateBlockMemory(const VkMemoryRequirements& MemoryRequirements,
+            VkMemoryPropertyFlags PropertyFlags,VkMemoryPropertyFlags PreferredFlags,
+                                          T_MemoryAllocation* AllocationPtr,bool& StatusOK)
 {
+    *AllocationPtr = {-1,0,0};
     if (!AllOK(StatusOK)) return;
     
-    VkCommandBuffer LocalCommandBufferHndl = CommandBufferHndl;
-    VkSubmitInfo SubmitInfo = {};
-    SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    SubmitInfo.commandBufferCount = 1;
-    SubmitInfo.pCommandBuffers = &LocalCommandBufferHndl;
-
-    //  We need to set up a fence so we can wait on it for the computation to complete.
+    //  A buffer the CPU writes and the GPU reads may prefer memory that is both device-local
+    //  and host-visible - see SetBufferHostWriteOnly(). That's something of an all-or-nothing
+    //  preference: a type with it is usually uncached, and if it can't be had, cached host
+    //  memory is the better choice. So rather than leave it to GetMemoryTypeIndex(), which just
+    //  counts the preferred flags each type has, we see if there's such a type with a heap big
+    //  enough for the buffer and room left in its budget. If there is, we insist on it, and if
+    //  not, we drop the preference.
+    
+    if ((PreferredFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) &&
+                                      !(PropertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+        VkPhysicalDeviceMemoryProperties LocalProperties;
+        vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice,&LocalProperties);
+        std::vector<KVHeapStats> LocalStats;
+        GetHeapStats(&LocalStats);
+        VkMemoryPropertyFlags LocalFlags = PropertyFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        int LocalHeap = -1;
+        for (uint32_t Type = 0; Type < LocalProperties.memoryTypeCount; Type++) {
+            if (!(MemoryRequirements.memoryTypeBits & (1 << Type))) continue;
+            VkMemoryPropertyFlags TypeFlags = LocalProperties.memoryTypes[Type].propertyFlags;
+            if ((TypeFlags & LocalFlags) != LocalFlags) continue;
+            uint32_t Heap = LocalProperties.memoryTypes[Type].heapIndex;
+            if (MemoryRequirements.size > LocalProperties.memoryHeaps[Heap].size /
+                                                                     C_HostLocalFraction) continue;
+            if (MemoryRequirements.size > HeapRoom(LocalStats[Heap])) continue;
+            LocalHeap = int(Heap);
+            break;
+        }
+        if (LocalHeap >= 0) {
+            I_Debug.Logf ("Properties","Buffer of %llu bytes can use device-local host-visible "
+                       "memory, in heap %d",(unsigned long long)MemoryRequirements.size,LocalHeap);
+            PropertyFlags = LocalFlags;
+        } else {
+            I_Debug.Logf ("Properties","No room in device-local host-visible memory for buffer "
+                              "of %llu bytes",(unsigned long long)MemoryRequirements.size);
+        }
+        PreferredFlags &= ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
     
-    VkFence Fence;
-    VkFenceCreateInfo FenceCreateInfo = {};
-    FenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    FenceCreateInfo.flags = 0;
-    VkResult Result;
-    Result = vkCreateFence(I_LogicalDevice,&FenceCreateInfo,nullptr,&Fence);
-    if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
-        LogVulkanError("Failed to set up fence","vkCreateFence",Result);
-        StatusOK = false;
-    } else {
-
-        //  Submit the command buffer to the queue, together with the fence.
+    //  First, find out which of the various memory types will do for our buffer.
+    
+    uint32_t MemoryTypeIndex = GetMemoryTypeIndex(MemoryRequirements,PropertyFlags,
+                                                                     PreferredFlags,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    //  Work out the alignment needed, and the size of the range to reserve. Alignments are always
+    //  powers of two, so the larger of the two alignment values is a multiple of the smaller.
+    
+    VkDeviceSize Alignment = MemoryRequirements.alignment;
+    if (Alignment < I_BufferImageGranularity) Alignment = I_BufferImageGranularity;
+    if (Alignment < 1) Alignment = 1;
+    VkDeviceSize Size = ((MemoryRequirements.size + Alignment - 1) / Alignment) * Alignment;
+    
+    //  We don't want a single block to take up too much of a small memory heap, so the block
+    //  size used is limited to an eighth of the size of the heap in question.
+    
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice,&MemoryProperties);
+    uint32_t HeapIndex = MemoryProperties.memoryTypes[MemoryTypeIndex].heapIndex;
+    VkDeviceSize BlockSize = I_MemoryBlockSize;
+    if (BlockSize > MemoryProperties.memoryHeaps[HeapIndex].size / 8) {
+        BlockSize = MemoryProperties.memoryHeaps[HeapIndex].size / 8;
+    }
+    bool Dedicated = (Size > BlockSize / 2);
+    
+    //  Unless this is going to need a dedicated block, look through the existing blocks of the
+    //  right memory type for a free range that's large enough, allowing for the alignment.
+    
+    int BlockIndex = -1;
+    VkDeviceSize Offset = 0;
+    if (!Dedicated) {
+        for (int Index = 0; Index < int(I_MemoryBlocks.size()); Index++) {
+            T_MemoryBlock& Block = I_MemoryBlocks[Index];
+            if (Block.MemoryHndl == VK_NULL_HANDLE || Block.Dedicated) continue;
+            if (Block.MemoryTypeIndex != MemoryTypeIndex) continue;
+            for (size_t Range = 0; Range < Block.FreeRanges.size(); Range++) {
+                VkDeviceSize Start = Block.FreeRanges[Range].Offset;
+                VkDeviceSize End = Start + Block.FreeRanges[Range].Size;
+                VkDeviceSize Aligned = ((Start + Alignment - 1) / Alignment) * Alignment;
+                if (Aligned + Size <= End) {
+                    
+                    //  This range will do. Take what we need from it, leaving whatever is left
+                    //  before and after the part we use in the free list.
+                    
+                    Block.FreeRanges.erase(Block.FreeRanges.begin() + Range);
+                    if (Aligned + Size < End) {
+                        Block.FreeRanges.insert(Block.FreeRanges.begin() + Range,
+                                                           {Aligned + Size,End - Aligned - Size});
+                    }
+                    if (Aligned > Start) {
+                        Block.FreeRanges.insert(Block.FreeRanges.begin() + Range,
+                                                                      {Start,Aligned - Start});
+                    }
+                    BlockIndex = Index;
+                    Offset = Aligned;
+                    break;
+                }
+            }
+            if (BlockIndex >= 0) break;
+        }
+    }
+    
+    //  If there wasn't room, we need a new block. Re-use an empty slot in I_MemoryBlocks if
+    //  there is one (they're left behind when dedicated blocks are released).
+    
+    if (BlockIndex < 0) {
+        T_MemoryBlock NewBlock;
+        NewBlock.MemoryHndl = VK_NULL_HANDLE;
+        NewBlock.MemoryTypeIndex = MemoryTypeIndex;
+        NewBlock.SizeInBytes = Dedicated ? MemoryRequirements.size : BlockSize;
+        NewBlock.Dedicated = Dedicated;
+        NewBlock.Allocations = 0;
+        NewBlock.MappedAddress = nullptr;
+        NewBlock.MapCount = 0;
         
-        Result = vkQueueSubmit(QueueHndl,1,&SubmitInfo,Fence);
-        if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
-                LogVulkanError("Failed to submit compute queue","vkQueueSubmit",Result);
-            StatusOK = false;
-        } else {
-
-            //  And wait for it to complete.
-            
-            Result = vkWaitForFences(I_LogicalDevice,1,&Fence,VK_TRUE,100000000000);
-            if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
-                LogVulkanError ("Failed to wait for compute to complete","vkWaitForFences",Result);
+        //  Finally, we can allocate some of the required memory, using vkAllocateMemory(),
+        //  which will set up a VkDeviceMemory - this is another opaque handle - so that we
+        //  can refer to it.
+        
+        //  Before that, though, make sure the new block will fit in what's left of the budget
+        //  for its heap. Failing that, a pooled block can be made smaller, as long as the buffer
+        //  still fits. If the buffer itself won't fit, we can use a different memory type, from
+        //  another heap with room for it, that still has the properties the buffer needs - if
+        //  not the preferred ones. (Typically, GPU local memory is preferred but any shared
+        //  memory will do.) If there's no such heap, there's no point asking for the memory,
+        //  and it's better to explain why, rather than just report an allocation failure.
+        
+        std::vector<KVHeapStats> Stats;
+        GetHeapStats(&Stats);
+        VkDeviceSize Room = HeapRoom(Stats[HeapIndex]);
+        if (NewBlock.SizeInBytes > Room && Size <= Room) {
+            I_Debug.Logf ("Buffers","Only %llu bytes left in budget for heap %u, block reduced",
+                                                             (unsigned long long)Room,HeapIndex);
+            NewBlock.SizeInBytes = Size;
+        } else if (Size > Room) {
+            bool Found = false;
+            for (uint32_t Type = 0; Type < MemoryProperties.memoryTypeCount; Type++) {
+                if (!(MemoryRequirements.memoryTypeBits & (1 << Type))) continue;
+                VkMemoryPropertyFlags TypeFlags = MemoryProperties.memoryTypes[Type].propertyFlags;
+                if ((TypeFlags & PropertyFlags) != PropertyFlags) continue;
+                uint32_t OtherHeap = MemoryProperties.memoryTypes[Type].heapIndex;
+                if (OtherHeap == HeapIndex || HeapRoom(Stats[OtherHeap]) < Size) continue;
+                LogWarning ("Heap %u has only %llu bytes left in its budget, so %llu bytes are "
+                            "being allocated from heap %u instead",HeapIndex,
+                            (unsigned long long)Room,(unsigned long long)Size,OtherHeap);
+                MemoryTypeIndex = Type;
+                HeapIndex = OtherHeap;
+                NewBlock.MemoryTypeIndex = Type;
+                NewBlock.SizeInBytes = Dedicated ? MemoryRequirements.size : Size;
+                Found = true;
+                break;
+            }
+            if (!Found) {
+                LogError ("A buffer needs %llu bytes, but heap %u has only %llu bytes left of its "
+                       "%s budget of %llu bytes (%llu allocated by the Framework)",
+                       (unsigned long long)Size,HeapIndex,(unsigned long long)Room,
+                       Stats[HeapIndex].BudgetReported ? "reported" : "estimated",
+                       (unsigned long long)Stats[HeapIndex].Budget,
+                       (unsigned long long)Stats[HeapIndex].Allocated);
                 StatusOK = false;
+                return;
             }
         }
         
-        //  And we don't need the fence any more.
+        VkMemoryAllocateInfo AllocateInfo{};
+        AllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        AllocateInfo.allocationSize = NewBlock.SizeInBytes;
+        AllocateInfo.memoryTypeIndex = MemoryTypeIndex;
         
-        vkDestroyFence(I_LogicalDevice,Fence,nullptr);
+        //  A buffer whose device address is wanted needs memory allocated with the device address
+        //  flag. A block may be shared by many buffers, so if addresses are supported at all, we
+        //  set the flag for every block.
+        
+        VkMemoryAllocateFlagsInfo AllocateFlags{};
+        AllocateFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        AllocateFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+        if (I_BufferAddressSupported) AllocateInfo.pNext = &AllocateFlags;
+        I_Debug.Logf ("Buffers","Allocating %s memory block of %llu bytes, memory type index = %d",
+                                       Dedicated ? "dedicated" : "pooled",
+                                       (unsigned long long)NewBlock.SizeInBytes,MemoryTypeIndex);
+        VkResult Result = vkAllocateMemory(I_LogicalDevice,&AllocateInfo,nullptr,
+                                                                         &NewBlock.MemoryHndl);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to allocate buffer memory","vkAllocateMemory",Result);
+            StatusOK = false;
+        } else {
+            if (!Dedicated && Size < NewBlock.SizeInBytes) {
+                NewBlock.FreeRanges.push_back({Size,NewBlock.SizeInBytes - Size});
+            }
+            for (int Index = 0; Index < int(I_MemoryBlocks.size()); Index++) {
+                if (I_MemoryBlocks[Index].MemoryHndl == VK_NULL_HANDLE) {
+                    BlockIndex = Index;
+                    break;
+                }
+            }
+            if (BlockIndex < 0) {
+                BlockIndex = int(I_MemoryBlocks.size());
+                I_MemoryBlocks.push_back(NewBlock);
+            } else {
+                I_MemoryBlocks[BlockIndex] = NewBlock;
+            }
+            Offset = 0;
+            if (Dedicated) Size = NewBlock.SizeInBytes;
+        }
+    }
+    
+    if (AllOK(StatusOK)) {
+        I_MemoryBlocks[BlockIndex].Allocations++;
+        AllocationPtr->BlockIndex = BlockIndex;
+        AllocationPtr->Offset = Offset;
+        AllocationPtr->Size = Size;
+        I_Debug.Logf ("Buffers","Using %llu bytes at offset %llu in memory block %d",
+                     (unsigned long long)Size,(unsigned long long)Offset,BlockIndex);
     }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       R e a d  S p i r V  F i l e  (Internal routine)
+//                     F r e e  B l o c k  M e m o r y   (Internal routine)
 //
-//  This internal routine reads SPIR-V code from a specified file into memory, and returns the
-//  address of the start of that memory and the length of the code in bytes.
+//  This internal routine returns a range of memory obtained from AllocateBlockMemory() to the
+//  free list of the block it came from, merging it with any adjacent free ranges. If the block
+//  was a dedicated block, used for just one large buffer, the block itself is released.
 //
 //  Parameters:
-//     ShaderFilename (const std::string&) The name of file containing the SPIR-V code for the
-//                    GPU program to be run by the pipeline.
-//     LengthInBytes  (long*) Receives the length of the SPIR-V code in bytes.
-//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
-//                    this routine returns immediately. If something goes wrong, the variable
-//                    will be set false.
-//  Returns:
-//     (uint32_t*)    The address of the start of the memory into which the code has been read.
-//                    This memory will have been allocated using new[] and should be deleted
-//                    (using delete[]) by the calling routine once it is no longer needed. If
-//                    there is an error, this routine will return a null pointer, so the caller
-//                    needs to test for that rather than blindly run delete[] on a null pointer.
-//  Pre-requisites:
-//     The file name specified must be a string that can be passed to fopen(), and the file should
-//     contain valid SPIR-V code. This routine uses no Vulkan calls, so could in principle be
-//     called before any Vulkan initialisation.
-                                                   
-uint32_t* KVVulkanFramework::ReadSpirVFile(
-        const std::string& Filename,long* LengthInBytes,bool& StatusOK)
-{
-    if (!AllOK(StatusOK)) return nullptr;
-    
-    //  This is complicated slightly by the Vulkan specification requiring that SPIR-V binary code
-    //  be presented to vkCreateShaderModule() - as it is here in CreateShaderModule() - as a
-    //  pointer to an array of uint32_t values. In this routine we determine the size of the code
-    //  in the specified file, allocate an array to hold it, and read into that array. However,
-    //  we have to allow for the case where the file size is not a round number of uint32_t
-    //  values. (In practice, any valid SPIR-V file will be, but we need to allow for any file
-    //  we might be passed. But we should be able to handle any file at this point. If it's not
-    //  a valid file, it's up to vkCreateShaderModule() to spot that later - which it will do,
-    //  and will explain why if validation is enabled.)
-    
-    uint32_t* Buffer = nullptr;
-    
-    FILE* SpirVFile = fopen(Filename.c_str(), "rb");
-    if (SpirVFile == nullptr) {
-        LogError("Could not find or open file: %s.",Filename.c_str());
-        StatusOK = false;
-    } else {
+//     AllocationPtr  (T_MemoryAllocation*) The details of the allocated range, as returned by
+//                    AllocateBlockMemory(). This is cleared on return, and if it does not refer
+//                    to an allocated range, this routine does nothing.
 
-        //  Get the file size by seeking to the end and getting our file position.
-        
-        fseek(SpirVFile,0,SEEK_END);
-        *LengthInBytes = ftell(SpirVFile);
-    
-        //  Round up the size to a whole number of uint32_t values and allocate an array of that
-        //  size. We zero out the last value, because if there is any padding it's probably nice
-        //  not to leave it as random values. Then we read from the file. Note that we allow
-        //  for a zero length file.
-        
-        if (*LengthInBytes > 0) {
-            long LengthInUint32s = (*LengthInBytes + sizeof(uint32_t) - 1)/sizeof(uint32_t);
-            Buffer = new uint32_t[LengthInUint32s];
-            Buffer[LengthInUint32s - 1] = 0;
-            fseek(SpirVFile,0,SEEK_SET);
-            long Length = fread(Buffer,sizeof(char),*LengthInBytes,SpirVFile);
-            if (Length != *LengthInBytes) {
-                LogError("Error reading from file: %s.",Filename.c_str());
-                LogError("Read %ld bytes, expected to read %ld bytes.",Length,*LengthInBytes);
-                StatusOK = false;
-            } else {
-                I_Debug.Logf("Progress","Read shader code from '%s'",Filename.c_str());
+void KVVulkanFramework::FreeBlockMemory(T_MemoryAllocation* AllocationPtr)
+{
+    int BlockIndex = AllocationPtr->BlockIndex;
+    if (BlockIndex >= 0 && BlockIndex < int(I_MemoryBlocks.size())) {
+        T_MemoryBlock& Block = I_MemoryBlocks[BlockIndex];
+        Block.Allocations--;
+        if (Block.Dedicated) {
+            if (Block.MappedAddress) vkUnmapMemory(I_LogicalDevice,Block.MemoryHndl);
+            vkFreeMemory(I_LogicalDevice,Block.MemoryHndl,nullptr);
+            Block.MemoryHndl = VK_NULL_HANDLE;
+            Block.MappedAddress = nullptr;
+            Block.MapCount = 0;
+            Block.Allocations = 0;
+        } else {
+            
+            //  Find where the range goes in the ordered free list, then see if it can be
+            //  merged with the range that follows it and the range that precedes it.
+            
+            VkDeviceSize Offset = AllocationPtr->Offset;
+            VkDeviceSize Size = AllocationPtr->Size;
+            size_t Range = 0;
+            while (Range < Block.FreeRanges.size() && Block.FreeRanges[Range].Offset < Offset) {
+                Range++;
+            }
+            Block.FreeRanges.insert(Block.FreeRanges.begin() + Range,{Offset,Size});
+            if (Range + 1 < Block.FreeRanges.size() &&
+                          Block.FreeRanges[Range + 1].Offset == Offset + Size) {
+                Block.FreeRanges[Range].Size += Block.FreeRanges[Range + 1].Size;
+                Block.FreeRanges.erase(Block.FreeRanges.begin() + Range + 1);
+            }
+            if (Range > 0 && Block.FreeRanges[Range - 1].Offset +
+                                  Block.FreeRanges[Range - 1].Size == Offset) {
+                Block.FreeRanges[Range - 1].Size += Block.FreeRanges[Range].Size;
+                Block.FreeRanges.erase(Block.FreeRanges.begin() + Range);
             }
         }
-        fclose(SpirVFile);
     }
-    return Buffer;
+    *AllocationPtr = {-1,0,0};
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       C r e a t e  S h a d e r  M o d u l e  (Internal routine)
+//                       G e t  H e a p  S t a t s   (Internal routine)
 //
-//  This internal routine is passed the memory address of some SPIR-V code (which probably comes
-//  from a from a specified file, as read using ReadSpirVFile()), creates a Vulkan shader module
-//  from the SPIR-V code, and returns the Vulkan handle for that shader module. The shader module
-//  can then be used in a pipeline, either for computation or for graphics.
+//  This internal routine does the work for GetMemoryStats(), and is also used by
+//  AllocateBlockMemory() to check that a new memory block will be within the budget for its
+//  heap. The Framework's own figures come from the pooled memory blocks in I_MemoryBlocks - a
+//  block counts as allocated in full, and as used apart from its free ranges. The budget and
+//  usage come from VK_EXT_memory_budget if it has been enabled, and are estimated otherwise.
 //
 //  Parameters:
-//     Code           (uint32t*) The memory address of the start of the code (usually this
-//                    will have been returned by ReadSpirVFile()).
-//     LengthInBytes  (long) The length of the SPIR-V code in bytes.
-//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
-//                    this routine returns immediately. If something goes wrong, the variable
-//                    will be set false.
-//  Returns:
-//     (VkShaderModule) The Vulkan handle for the newly created shader module.
+//      Stats      (std::vector<KVHeapStats>*) Receives the details for each heap, in heap order.
 //
 //  Pre-requisites:
-//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
-//     Code and LengthInBytes should describe valid SPIR-V code.
+//      FindSuitableDevice() must have been called to set I_SelectedDevice.
 
-VkShaderModule KVVulkanFramework::CreateShaderModule(
-                                        uint32_t* Code,long LengthInBytes,bool& StatusOK)
+void KVVulkanFramework::GetHeapStats(std::vector<KVHeapStats>* Stats)
 {
-    if (!AllOK(StatusOK)) return VK_NULL_HANDLE;
-    
-    VkShaderModuleCreateInfo CreateInfo{};
-    CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    CreateInfo.codeSize = LengthInBytes;
-    CreateInfo.pCode = Code;
-
-    VkShaderModule ShaderModule;
-    VkResult Result;
-    Result = vkCreateShaderModule(I_LogicalDevice,&CreateInfo,nullptr,&ShaderModule);
-    if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
-        LogVulkanError("Failed to create shader module","vkCreateShaderModule",Result);
-        ShaderModule = VK_NULL_HANDLE;
-        StatusOK = false;
+    Stats->clear();
+    
+    //  The budget details are returned through the pNext chain of the memory properties.
+    
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT BudgetProperties{};
+    BudgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 Properties2{};
+    Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    if (I_MemoryBudgetSupported) Properties2.pNext = &BudgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(I_SelectedDevice,&Properties2);
+    const VkPhysicalDeviceMemoryProperties& Properties = Properties2.memoryProperties;
+    
+    for (uint32_t Heap = 0; Heap < Properties.memoryHeapCount; Heap++) {
+        KVHeapStats HeapStats;
+        HeapStats.HeapIndex = Heap;
+        HeapStats.DeviceLocal =
+                   (Properties.memoryHeaps[Heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        HeapStats.HeapSize = Properties.memoryHeaps[Heap].size;
+        HeapStats.Allocated = 0;
+        HeapStats.Used = 0;
+        HeapStats.Budget = 0;
+        HeapStats.Usage = 0;
+        HeapStats.BudgetReported = false;
+        Stats->push_back(HeapStats);
+    }
+    for (const T_MemoryBlock& Block : I_MemoryBlocks) {
+        if (Block.MemoryHndl == VK_NULL_HANDLE) continue;
+        uint32_t Heap = Properties.memoryTypes[Block.MemoryTypeIndex].heapIndex;
+        VkDeviceSize Free = 0;
+        for (const T_MemoryRange& Range : Block.FreeRanges) Free += Range.Size;
+        (*Stats)[Heap].Allocated += Block.SizeInBytes;
+        (*Stats)[Heap].Used += Block.SizeInBytes - Free;
+    }
+    for (KVHeapStats& HeapStats : *Stats) {
+        if (I_MemoryBudgetSupported) {
+            HeapStats.Budget = BudgetProperties.heapBudget[HeapStats.HeapIndex];
+            HeapStats.Usage = BudgetProperties.heapUsage[HeapStats.HeapIndex];
+            HeapStats.BudgetReported = true;
+        } else {
+            HeapStats.Budget = VkDeviceSize(double(HeapStats.HeapSize) * C_HeapBudgetFraction);
+            HeapStats.Usage = HeapStats.Allocated;
+        }
     }
-    return ShaderModule;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       G e t  M e m o r y  T y p e  I n d e x  (Internal routine)
+//                      M a p  B l o c k  M e m o r y   (Internal routine)
 //
-//  This is an internal utility used by CreateVulkanBuffer(). A GPU typically provides a number of
-//  different types of memory, each with different properties - some will be local to the GPU (and
-//  so fast for it to access), some will be visible to the CPU, some won't, etc. Which type a
-//  program should use for any given purpose depends on the details of just what properties it
-//  would prefer the memory to have.
+//  This internal routine returns the CPU address of the range of a pooled memory block used by
+//  a buffer. Vulkan does not allow a block of device memory to be mapped more than once at a
+//  time, so the whole block is mapped the first time any buffer in it needs mapping, and it
+//  stays mapped until all such buffers have been unmapped through calls to UnmapBlockMemory().
 //
 //  Parameters:
-//     MemoryRequirements  (VkMemoryRequirements) The memory requirements for the buffer, as
-//                    returned by vkGetBufferMemoryRequirements().
-//     PropertyFlags  (VkMemoryPropertyFlags) Describes the memory properties for the buffer,
-//                    GPU local, shared, etc. that the buffer needs to have, as specified by
-//                    the program in its call to SetBufferDetails().
+//     Allocation     (const T_MemoryAllocation&) The details of the allocated range, as returned
+//                    by AllocateBlockMemory().
 //     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
 //                    this routine returns immediately. If something goes wrong, the variable
 //                    will be set false.
 //  Returns:
-//     (uint32_t)     An index into the set of memory types available. This routine has determined
-//                    that this index specifies a suitable memory type to use for the buffer.
+//     (void*)        The CPU address of the start of the range, or nullptr if it can't be mapped.
 //
 //  Pre-requisites:
-//     FindSuitableDevice() must have been called to select the GPU device to be used.
-//
-//  Note:
-//     This routine isn't trying to find the most suitable memory type - that would need much
-//     closer interaction with the higher levels of the program. It merely returns the index of
-//     the first memory type that meets the requirements.
+//     The block must be of a memory type that is visible to the CPU.
 
-uint32_t KVVulkanFramework::GetMemoryTypeIndex(
-    VkMemoryRequirements MemoryRequirements,VkMemoryPropertyFlags PropertyFlags,bool& StatusOK)
+void* KVVulkanFramework::MapBlockMemory(const T_MemoryAllocation& Allocation,bool& StatusOK)
 {
-    //  The physical device must have been identified and its handle set in I_SelectedDevice.
-    
-    if (!AllOK(StatusOK)) return 0;
+    if (!AllOK(StatusOK)) return nullptr;
     
-    bool Found = false;
-        
-    //  The VkMemoryRequirements structure for a resource has a field memoryTypeBits that works
-    //  with the list of memory types returned by vkGetPhysicalDeviceMemoryProperties(). Each bit
-    //  of memoryTypeBits indicates whether the corresponding memory type returned by that routine
-    //  is supported for the resource. (In this case, the resource is the buffer itself, with
-    //  its requirements passed in MemoryRequirements.)
-    
-    uint32_t Index = 0;
-    uint32_t SupportedMemoryTypeMask = MemoryRequirements.memoryTypeBits;
-    
-    //  We get the set of memory properties for each memory type supported by the device,
-    //  and will check each one against what we need.
-    
-    VkPhysicalDeviceMemoryProperties MemoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice, &MemoryProperties);
-    
-    if (I_Debug.Active("Properties")) ListMemoryProperties(&MemoryProperties);
-
-    for (uint32_t I = 0; I < MemoryProperties.memoryTypeCount; I++) {
-        
-        //  First, is this memory type supported by the resource in question? (See above.)
-        
-        if (SupportedMemoryTypeMask & (1 << I)) {
-            
-            //  If so, are all the properties we've asked for provided by this memory type?
-            //  (The test checks that all the bits in PropertyFlags are set in the property
-            //  flags for the memory type, ignoring flags we don't care about.)
-            
-            if ((MemoryProperties.memoryTypes[I].propertyFlags & PropertyFlags) == PropertyFlags) {
-                Index = I;
-                Found = true;
-                break;
+    void* MappedAddress = nullptr;
+    int BlockIndex = Allocation.BlockIndex;
+    if (BlockIndex < 0 || BlockIndex >= int(I_MemoryBlocks.size())) {
+        LogError ("Attempt to map a buffer that has no memory allocated.");
+        StatusOK = false;
+    } else {
+        T_MemoryBlock& Block = I_MemoryBlocks[BlockIndex];
+        if (Block.MappedAddress == nullptr) {
+            VkResult Result = vkMapMemory(I_LogicalDevice,Block.MemoryHndl,0,VK_WHOLE_SIZE,0,
+                                                                         &Block.MappedAddress);
+            if (Result != VK_SUCCESS) {
+                LogVulkanError ("Failed to map buffer memory","vkMapMemory",Result);
+                Block.MappedAddress = nullptr;
+                StatusOK = false;
             }
         }
+        if (AllOK(StatusOK)) {
+            Block.MapCount++;
+            MappedAddress = (char*)Block.MappedAddress + Allocation.Offset;
+        }
     }
-    
-    if (!Found) {
-        LogError ("Unable to find a memory type that meets requirements.");
-        StatusOK = false;
-    }
-    return Index;
+    return MappedAddress;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       L i s t  M e m o r y  P r o p e r t i e s  (Internal routine)
+//                    U n m a p  B l o c k  M e m o r y   (Internal routine)
 //
-//  This is an internal diagnostic utility that can be used to list the properties of the
-//  various memory types supported by the selected GPU (see GetMmeoryTypeIndex() for a little
-//  more context).
+//  This internal routine is called when a buffer no longer needs the memory block it uses to be
+//  mapped. The block is actually unmapped only when no other buffer in it needs it mapped.
 //
 //  Parameters:
-//     Properties     (VkPhysicalDeviceMemoryProperties*) A structure describing all the memory
-//                    types supported by the device. This should have been returned by a call to
-//                    vkGetPhysicalDeviceMemoryProperties().
-//  Output:
-//     A listing of the available memory types and their properties.
-//
-//  Pre-requisites:
-//     Strictly, none, although in practice, Properties will have been returned by a call to
-//     vkGetPhysicalDeviceMemoryProperties().
+//     Allocation     (const T_MemoryAllocation&) The details of the allocated range, as returned
+//                    by AllocateBlockMemory().
 
-void KVVulkanFramework::ListMemoryProperties(const VkPhysicalDeviceMemoryProperties* Properties)
+void KVVulkanFramework::UnmapBlockMemory(const T_MemoryAllocation& Allocation)
 {
-    I_Debug.Log ("Properties","Memory properties:");
-    
-    //  A device has one or more memory 'heaps'. List them first. Some heaps are much larger
-    //  than others and can support much larger memory allocations.
-    
-    I_Debug.Logf ("Properties","Heaps: %d",Properties->memoryHeapCount);
-    for (unsigned int Heap = 0; Heap < Properties->memoryHeapCount; Heap++) {
-        std::string FlagString = "";
-        VkMemoryHeapFlags Flags = Properties->memoryHeaps[Heap].flags;
-        if (Flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) FlagString += "DeviceLocal ";
-        if (Flags & VK_MEMORY_HEAP_MULTI_INSTANCE_BIT) FlagString += "MultiInstance ";
-        I_Debug.Logf ("Properties","Heap %d size %d %s",Heap,
-                                             Properties->memoryHeaps[Heap].size,FlagString.c_str());
-    }
-    
-    //  It also has a number of memory types, each associated with a specific heap and
-    //  with its own specific properties.
-    
-    I_Debug.Logf ("Properties","Memory types: %d",Properties->memoryTypeCount);
-    for (unsigned int Type = 0; Type < Properties->memoryTypeCount; Type++) {
-        std::string FlagString = "";
-        VkMemoryPropertyFlags Flags = Properties->memoryTypes[Type].propertyFlags;
-        if (Flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) FlagString += "DeviceLocal ";
-        if (Flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) FlagString += "HostVisible ";
-        if (Flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) FlagString += "HostCoherent ";
-        if (Flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) FlagString += "HostCached ";
-        if (Flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) FlagString += "LazilyAllocated ";
-        if (Flags & VK_MEMORY_PROPERTY_PROTECTED_BIT) FlagString += "PropertyProtected ";
-        /* Support for these seems to vary, so for now the safe thing to do is comment them out.
-        if (Flags & VK_MEMORY_PROPERTY_DEVICE_COHERENT_BIT_AMD) FlagString += "DeviceCoherentAMD ";
-        if (Flags & VK_MEMORY_PROPERTY_DEVICE_UNCACHED_BIT_AMD) FlagString += "DeviceUncachedAMD ";
-        if (Flags & VK_MEMORY_PROPERTY_RDMA_CAPABLE_BIT_NV) FlagString += "RDMACapableNV ";
-        */
-        I_Debug.Logf ("Properties","Type %d Heap %d %s",Type,
-                                       Properties->memoryTypes[Type].heapIndex,FlagString.c_str());
+    int BlockIndex = Allocation.BlockIndex;
+    if (BlockIndex >= 0 && BlockIndex < int(I_MemoryBlocks.size())) {
+        T_MemoryBlock& Block = I_MemoryBlocks[BlockIndex];
+        if (Block.MapCount > 0) Block.MapCount--;
+        if (Block.MapCount == 0 && Block.MappedAddress) {
+            vkUnmapMemory(I_LogicalDevice,Block.MemoryHndl);
+            Block.MappedAddress = nullptr;
+        }
     }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//          G e t  I n d e x  F o r  Q u e u e  F a m i l y  T o  U s e  (Internal routine)
+//                  R e l e a s e  M e m o r y  B l o c k s   (Internal routine)
 //
-//  This is an internal utility used by CreateLogicalDevice(). Devices support multiple queues,
-//  bundled up into queue 'families' in which each member has the same capabilities (ie can do
-//  graphics, can do compute, can do other things like memory transfers). Each queue family has
-//  its own index number. This routine selects a queue family to use for the sort of general
-//  application the Framework is designed to handle, and returns its index so CreateLogicalDevice()
-//  can use it.
+//  This internal routine releases all the pooled memory blocks, unmapping any that are still
+//  mapped. It is called by CleanupVulkan() once all the buffers have been destroyed.
+
+void KVVulkanFramework::ReleaseMemoryBlocks(void)
+{
+    for (T_MemoryBlock& Block : I_MemoryBlocks) {
+        if (Block.MemoryHndl != VK_NULL_HANDLE) {
+            if (Block.MappedAddress) vkUnmapMemory(I_LogicalDevice,Block.MemoryHndl);
+            vkFreeMemory(I_LogicalDevice,Block.MemoryHndl,nullptr);
+        }
+    }
+    I_MemoryBlocks.clear();
+}
+
+//  ------------------------------------------------------------------------------------------------
 //
+//               C r e a t e  V u l k a n  D e s c r i p t o r  S e t  L a y o u t
+//
+//  A computation is run as part of a pipeline, and a pipeline has to be set up in detail before
+//  it can be run. It will access a set of one or more buffers, and it needs to know how these
+//  are defined. To do this, it needs a 'descriptor set' which describes the bindings and the types
+//  of the buffers. But before you can create a descriptor set, you have to specify its layout,
+//  which reflects the details of the various buffers. This routine performs that initial step of
+//  creating the necessary descriptor set. It is passed a vector containing the Framework buffer
+//  handles for all the buffers involved, creates the descriptor set and returns a Vulkan handle
+//  to the set.
+
 //  Parameters:
-//     UseGraphics    (bool) Set true if the application needs to use graphics.
-//     UseCompute     (bool) Set true if the application needs to use the GPU for computation.
-//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
-//                    this routine returns immediately. If something goes wrong, the variable
-//                    will be set false.
-//  Returns:
-//     (uint32_t)     An index into the set of queue families available. This routine has
-//                    determined that this index specifies a suitable family to use.
+//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
+//                   Framework handles for each buffer, as returned by SetBufferDetails().
+//     SetLayoutHndlPtr (VkDescriptorSetLayout*) Receives the opaque Vulkan handle for the
+//                   created descriptor set layout.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
 //  Pre-requisites:
-//     FindSuitableDevice() must have been called to select the GPU device to be used.
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//     The details of each buffer in question must have been set using SetBufferDetails() and
+//     the vector (BufferHandles) containing the handles for each buffer must have been created
+//     and filled.
 //
 //  Note:
-//     This routine isn't trying to find the most suitable queue family - that would need much
-//     closer interaction with the higher levels of the program. It merely returns the index of
-//     the first family that meets the requirements.
+//     The list of buffers passed in BufferHandles is used to specify the number and type of each
+//     buffer, so the buffer layout cannot be changed without creating a new descriptor set layout
+//     (and new versions of everything based on that layout), but the sizes of the individual
+//     buffers are only finally fixed when the set is fully sepecified using the routine
+//     SetupVulkanDescriptorSet().
 
-uint32_t KVVulkanFramework::GetIndexForQueueFamilyToUse(
-               bool UseGraphics,bool UseCompute,bool& StatusOK)
+void KVVulkanFramework::CreateVulkanDescriptorSetLayout(
+                    std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+                                            VkDescriptorSetLayout* SetLayoutHndlPtr,bool& StatusOK)
 {
-    if (!AllOK(StatusOK)) return 0;
-    
-    bool ListQueueProperties = true;
-    
-    uint32_t FamilyIndex = 0;
+    //  Pre-requisites:
+    //     CreateLogicalDevice() must have been called to create the logical device and set its
+    //     handle in I_LogicalDevice.
     
-    //  Get the details of all the queue families supported by the device.
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    uint32_t NumberFamilies;
-    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,nullptr);
-    std::vector<VkQueueFamilyProperties> QueueFamilies(NumberFamilies);
-    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,QueueFamilies.data());
-
-    //  This section lists the details of what each queue family supports. It gives an idea of
-    //  what might be tested for (possibly even at the point when the device is selected, for
-    //  programs that have specifically heavy requirements).
+    //  This sets up a descriptor set layout with the entries set up to match the specifications
+    //  for the buffers as listed in BufferHandles. If any handles are invalid, we don't quit
+    //  immediately - instead we continue on to check the rest of the handles. Might as well.
     
-    if (ListQueueProperties) {
-        int Index = 0;
-        for (const VkQueueFamilyProperties& Props : QueueFamilies) {
-            std::string PropString = "";
-            if (Props.queueFlags & VK_QUEUE_GRAPHICS_BIT) PropString += " Graphics";
-            if (Props.queueFlags & VK_QUEUE_COMPUTE_BIT) PropString += " Compute";
-            if (Props.queueFlags & VK_QUEUE_TRANSFER_BIT) PropString += " Transfer";
-            if (Props.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) PropString += " Binding";
-            if (UseGraphics) {
-                VkBool32 PresentSupport = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(I_SelectedDevice,Index,I_Surface,
-                                                                         &PresentSupport);
-                if (PresentSupport) PropString += " Present";
-            }
-            I_Debug.Logf("Properties","Queue family index %d Queues %d %s",Index,
-                                                            Props.queueCount,PropString.c_str());
-            Index++;
+    std::vector<VkDescriptorSetLayoutBinding> LayoutBindings{};
+    for (KVBufferHandle Handle : BufferHandles) {
+        int Index = BufferIndexFromHandle(Handle,StatusOK);
+        if (!AllOK(StatusOK)) continue;
+        VkDescriptorSetLayoutBinding Binding;
+        Binding.binding = I_BufferDetails[Index].Binding;
+        Binding.descriptorCount = 1;
+        if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) {
+            I_Debug.Logf ("Buffers","Setting for uniform buffer, binding %d",Binding.binding);
+            Binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            Binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT |
+                                                           VK_SHADER_STAGE_FRAGMENT_BIT;
         }
+        if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) {
+            I_Debug.Logf ("Buffers","Setting for storage buffer, binding %d",Binding.binding);
+            Binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            Binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT |
+                                                           VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+        Binding.pImmutableSamplers = nullptr;
+        LayoutBindings.push_back(Binding);
     }
 
-    //  Now we look for a suitable queue family. We just take the first one that actually has
-    //  queues and which supports both compute and graphics, if that's what's been asked for.
-    //  If we're using graphics, we want present support as well. Do we really expect all
-    //  graphics queues to support present, or might we need a separate present queue?
-    
-    bool Found = false;
-    int Index = 0;
-    for (const VkQueueFamilyProperties &Props : QueueFamilies) {
-        bool Suitable = true;
-        if (Props.queueCount > 0) {
-            if (UseGraphics && (Props.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) Suitable = false;
-            if (UseCompute && (Props.queueFlags & VK_QUEUE_COMPUTE_BIT) == 0) Suitable = false;
-            if (UseGraphics) {
-                VkBool32 PresentSupport = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(I_SelectedDevice,Index,I_Surface,
-                                                                              &PresentSupport);
-                if (!PresentSupport) Suitable = false;
-            }
-            if (Suitable) {
-                I_Debug.Logf("Properties","Selected queue at index: %d",Index);
-                FamilyIndex = Index;
-                Found = true;
-                break;
-            }
+    if (AllOK(StatusOK)) {
+        VkDescriptorSetLayoutCreateInfo LayoutInfo{};
+        LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        LayoutInfo.bindingCount = int(BufferHandles.size());
+        LayoutInfo.pBindings = LayoutBindings.data();
+
+        VkResult Result;
+        Result = vkCreateDescriptorSetLayout(I_LogicalDevice,&LayoutInfo,nullptr,SetLayoutHndlPtr);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError("Failed to create compute descriptor set layout",
+                                                    "vkCreateDescriptorSetLayout",Result);
+            StatusOK = false;
+        } else {
+            I_Debug.Logf("Progress","Compute descriptor set created with %d buffer bindings",
+                                                                         BufferHandles.size());
         }
-        Index++;
     }
-    
-    //  You can imagine being clever if we don't find a suitable queue, expecially if we have
-    //  more unusual requirements - we could return two different queue families, with different
-    //  capabilities, but then we'd need a slightly different calling sequence just to get that
-    //  more nuanced information returned. We might need to use separate graphics and present
-    //  queues (which is what the Vulkan tutorial does).
-
-    if (!Found) StatusOK = false;
-    return FamilyIndex;
+        
+    //  If the layout was created successfully, save the value of its handle so it can be
+    //  destroyed during cleanup.
+        
+    if (AllOK(StatusOK)) I_DescriptorSetLayoutHndls.push_back(*SetLayoutHndlPtr);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       R a t e  D e v i c e  (Internal routine)
+//                   B u f f e r  I n d e x  F r o m  H a n d l e  (Internal routine)
 //
-//  This is an internal utility used by FindSuitableDevice(). If a machine has multiple GPU
-//  devices, we need to pick one for use. This routine assigns a rough score to each device
-//  based on its capabilities. Since we don't really have much detail about what the program
-//  intends to do with the device, this routine looks mostly for what might be expected to be
-//  the most powerful device.
+//  This internal routine returns the index into the I_BufferDetails vector that corresponds to
+//  the Framework handle for the buffer as returned by SetBufferDetails(). It also checks that
+//  the handle is valid and returns bad status if it isn't.
 //
 //  Parameters:
-//     DeviceHndl     (VkPhysicalDevice) A Vulkan handle for the physical device in question.
-//
-//  Returns:
-//     (int)          A rough score. FindSuitableDevice() will assume zero indicates an unusable
-//                    device, and will simply select the device given the highest score.
+//     Handle        (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
 //  Pre-requisites:
-//     FindSuitableDevice() must have been called to select the GPU device to be used.
+//     The buffer must have had its details set using SetBufferDetails(), which will have
+//     returned the buffer handle.
 //
 //  Note:
-//      This is more of an example than anything, but it's a reasonable way of scoring a physical
-//      GPU device. We assume that if this routine has been called at all, then the device has
-//      passed basic tests like those for support for the required extensions, so is suitable for
-//      use. A score of zero implies unusable, so we give it more than that. We give it 1 in most
-//      cases, another 10 if it's a discrete GPU, and another 10 if it supports double precision.
-//      Anything fancier requires application-specific code.
+//     This routine makes use of the fact that a KVBufferHandle is actually an int. It's an
+//     index into the I_BufferDetails vector, but with 1 added to it so that 0 can be used
+//     as an invalid index number. It isn't a foolproof scheme
 
-int KVVulkanFramework::RateDevice (VkPhysicalDevice DeviceHndl)
+int KVVulkanFramework::BufferIndexFromHandle (KVBufferHandle Handle,bool& StatusOK)
 {
-    int Score = 1;
-    VkPhysicalDeviceProperties Properties;
-    vkGetPhysicalDeviceProperties(DeviceHndl,&Properties);
-    if (Properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) Score += 10;
-    VkPhysicalDeviceFeatures Features;
-    vkGetPhysicalDeviceFeatures(DeviceHndl,&Features);
-    if (Features.shaderFloat64) Score += 10;
+    if (!AllOK(StatusOK)) return 0;
+    
+    int Index = Handle - 1;
+    if (Index < 0 || Index >= int(I_BufferDetails.size())) {
+        LogError ("Buffer handle value %d is out of range",Handle);
+        Index = 0;
+        StatusOK = false;
+    } else {
+        if (!I_BufferDetails[Index].InUse) {
+            LogError ("Buffer handle value %d is no longer in use",Handle);
+            StatusOK = false;
+        }
+    }
+    return Index;
+}
 
-    return Score;
+//  ------------------------------------------------------------------------------------------------
+//
+//                       C r e a t e  C o m p u t e  P i p e l i n e
+//
+//  This routine creates a relatively simple Vulkan pipeline that will run a specified GPU
+//  program (written in GLSL), operating on a specified layout of Vulkan data buffers. At this
+//  point, the sizes of the various buffers do not need to be known, but their type (uniform,
+//  storage, etc) and the way they are accessed (local, shared, etc) must be known. The details
+//  of the buffer layout is encapsulated in a descriptor set layout as created by the routine
+//  CreateVulkanDescriptorSetLayout(). The GPU program is specified by giving this routine the
+//  name of a file containing its SPIR-V semi-compiled code. This routine creates both a layout
+//  for the pipeline and then the pipeline itself, and returns Vulkan handles for both.
+//
+//  Parameters:
+//     ShaderFilename (const std::string&) The name of file containing the SPIR-V code for the
+//                   GPU program to be run by the pipeline.
+//     StageName     (const std::string&) The entry name of the routine in the CPU code to be
+//                   run by the pipeline (often this will be 'main', but it does not have to be).
+//     SetLayoutHndlPtr (VkDescriptorSetLayout*) The address of the opaque Vulkan handle for the
+//                   descriptor set layout, as returned by CreateVulkanDescriptorSetLayout().
+//                   Do note that this is passed as the address of the handle, not the handle
+//                   itself - although this routine does not change the handle.
+//     PipelineLayoutHndlPtr (VkPipelineLayout*) Receives the opaque Vulkan handle for the
+//                   created pipeline layout.
+//     PipelineHndlPtr (VkPipeline*) Receives the opaque Vulkan handle for the created pipeline.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//     The descriptor set layout for the buffers must have been created by a call to the routine
+//     CreateVulkanDescriptorSetLayout(). The file name specified must be a string that can be
+//     passed to fopen(), and the file should contain valid code.
+//
+//  Note:
+//     o Usually in Vulkan the SPIR_V GPU code in the specified file will have been written in GLSL
+//     and converted (semi-compiled) into SPIR-V using glslc. However, the SPIR-V code could have
+//     been created in other ways - it could have been hand-written, although takes a braver soul
+//     than I, or compiled from another language. All that matters here is that the file contains
+//     valid SPIR-V code.
+//     o Some valid SPIR-V code may be rejected if the GPU in use does not support it. For example,
+//     an Apple GPU cannot run code that uses double precision GPU values, and this will be
+//     spotted when this routine tries to process the code.
+//     o The SetLayoutHndlPtr parameter is a pointer to the handle, as the name suggests, rather
+//     than the handle itself. This is only because the pipeline can be created with a number of
+//     different set layouts, passed to Vulkan as an array, and doing it this way makes it look
+//     like an array with 1 element.
+
+void KVVulkanFramework::CreateComputePipeline(
+    const std::string& ShaderFilename,const std::string& StageName,
+    VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
+                                        VkPipeline* PipelineHndlPtr,bool& StatusOK)
+{
+    std::vector<uint32_t> NoConstants;
+    CreateComputePipeline(ShaderFilename,StageName,SetLayoutHndlPtr,PipelineLayoutHndlPtr,
+                                                      PipelineHndlPtr,NoConstants,StatusOK);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       D e v i c e  E x t e n s i o n s  O K   (Internal routine)
+//          C r e a t e  C o m p u t e  P i p e l i n e   (with specialization constants)
 //
-//  This is an internal utility used by FindSuitableDevice(). Vulkan makes use of a number of
-//  'extensions'; for example, a program using the GPU for display will need to support an
-//  extension called 'VK_KHR_swapchain'. This routine checks a list of named extensions supported
-//  by a given physical device against a list of those required by the program and returns
-//  true if the device supports all those required.
+//  This version of CreateComputePipeline() also supplies values for specialization constants
+//  declared in the shader code. These are constants whose values are fixed when the pipeline
+//  is created rather than when the shader is compiled. The most useful are the local workgroup
+//  dimensions - a shader that declares 'layout (local_size_x_id = 0, local_size_y_id = 1) in;'
+//  can have its workgroup shape set here instead of having it hard-coded.
 //
 //  Parameters:
-//     GraphicsExtensions (const std::vector<const char*>&) The set of named extensions required
-//                        by the program.
-//     DeviceExtensions   (const std::vector<VkExtensionProperties>&) The set of extensions
-//                        supported by the device - these details include their names.
+//     ShaderFilename, StageName, SetLayoutHndlPtr, PipelineLayoutHndlPtr, PipelineHndlPtr
+//                   As for the simpler version of CreateComputePipeline().
+//     SpecConstants (const std::vector<uint32_t>&) The values for the specialization constants
+//                   with constant IDs 0,1,2... in order. The shader must declare each of these
+//                   as a 32-bit (int, uint or bool) value. If this is empty, the default values
+//                   given in the shader code are used.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
-//  Returns:
-//     (bool)      True if the device supports all the required extensions, false otherwise.
+//  Pre-requisites:
+//     As for the simpler version of CreateComputePipeline().
+
+void KVVulkanFramework::CreateComputePipeline(
+    const std::string& ShaderFilename,const std::string& StageName,
+    VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
+    VkPipeline* PipelineHndlPtr,const std::vector<uint32_t>& SpecConstants,bool& StatusOK)
+{
+    CreateComputePipeline(ShaderFilename,StageName,SetLayoutHndlPtr,PipelineLayoutHndlPtr,
+                                                  PipelineHndlPtr,SpecConstants,0,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              C r e a t e  C o m p u t e  P i p e l i n e   (with push constants)
+//
+//  This version of CreateComputePipeline() also allows the shader to be passed a small block
+//  of parameters as push constants. Push constants are recorded into the command buffer along
+//  with the dispatch (see the version of RecordComputeCommandBuffer() that takes push constant
+//  data), so parameters that change from one dispatch to the next don't need a uniform buffer,
+//  a descriptor binding for it, and a write into shared memory before each dispatch. The shader
+//  declares the block using 'layout(push_constant) uniform', with no binding number.
+//
+//  Parameters:
+//     ShaderFilename, StageName, SetLayoutHndlPtr, PipelineLayoutHndlPtr, PipelineHndlPtr
+//                   As for the simpler version of CreateComputePipeline().
+//     SpecConstants (const std::vector<uint32_t>&) The values for any specialization constants,
+//                   as for the version of CreateComputePipeline() that takes these. May be empty.
+//     PushConstantSize (uint32_t) The size in bytes of the push constant block used by the
+//                   shader. This must be a multiple of 4, and no more than the device limit
+//                   (which is always at least 128 bytes). Zero means no push constants.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     As for the simpler version of CreateComputePipeline().
 //
+//  Note:
+//     Push constant blocks use std430 layout rules by default, not the std140 rules usual for
+//     uniform buffers. For a structure made up of scalars, with any doubles aligned on 8 byte
+//     boundaries, these are the same, but a block containing arrays or vectors may need care.
 
-bool KVVulkanFramework::DeviceExtensionsOK(const std::vector<const char*>& GraphicsExtensions,
-                          const std::vector<VkExtensionProperties>& DeviceExtensions)
+void KVVulkanFramework::CreateComputePipeline(
+    const std::string& ShaderFilename,const std::string& StageName,
+    VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
+    VkPipeline* PipelineHndlPtr,const std::vector<uint32_t>& SpecConstants,
+                                                     uint32_t PushConstantSize,bool& StatusOK)
 {
-    bool AllPresent = true;
-    for (const char* NamePtr : GraphicsExtensions) {
-        I_Debug.Logf("Device","Checking for extension %s",NamePtr);
-        bool Found = false;
-        for (const VkExtensionProperties& Property : DeviceExtensions) {
-            if (!strcmp(NamePtr,Property.extensionName)) {
-                Found = true;
-                break;
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    StartupPhase Phase("Pipeline for " + ShaderFilename);
+    
+    *PipelineLayoutHndlPtr = VK_NULL_HANDLE;
+    *PipelineHndlPtr = VK_NULL_HANDLE;
+    
+    //  Check that any push constant block is one the device can handle.
+    
+    if (PushConstantSize > 0) {
+        VkPhysicalDeviceProperties DeviceProperties;
+        vkGetPhysicalDeviceProperties(I_SelectedDevice,&DeviceProperties);
+        uint32_t MaxSize = DeviceProperties.limits.maxPushConstantsSize;
+        if ((PushConstantSize % 4) != 0 || PushConstantSize > MaxSize) {
+            LogError("Push constant size %u invalid. Must be a multiple of 4, maximum %u.",
+                                                                    PushConstantSize,MaxSize);
+            StatusOK = false;
+            return;
+        }
+    }
+
+    //  Get the shader module for the SPIR-V code in the file. This is only created the first
+    //  time the code is used.
+    
+    VkShaderModule ShaderModule = GetShaderModule(ShaderFilename,StatusOK);
+    
+    if (AllOK(StatusOK)) {
+
+        //  Set up the pipeline layout
+        
+        VkPipelineShaderStageCreateInfo ShaderStageInfo{};
+        ShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        ShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        ShaderStageInfo.module = ShaderModule;
+        ShaderStageInfo.pName = StageName.c_str();
+        
+        //  Any specialization constants are passed as one block of data, with a map entry for
+        //  each giving its constant ID and where it is in the block.
+        
+        std::vector<VkSpecializationMapEntry> MapEntries(SpecConstants.size());
+        for (size_t Index = 0; Index < SpecConstants.size(); Index++) {
+            MapEntries[Index].constantID = static_cast<uint32_t>(Index);
+            MapEntries[Index].offset = static_cast<uint32_t>(Index * sizeof(uint32_t));
+            MapEntries[Index].size = sizeof(uint32_t);
+        }
+        VkSpecializationInfo SpecInfo{};
+        SpecInfo.mapEntryCount = static_cast<uint32_t>(MapEntries.size());
+        SpecInfo.pMapEntries = MapEntries.data();
+        SpecInfo.dataSize = SpecConstants.size() * sizeof(uint32_t);
+        SpecInfo.pData = SpecConstants.data();
+        if (SpecConstants.size() > 0) ShaderStageInfo.pSpecializationInfo = &SpecInfo;
+
+        VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
+        PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        PipelineLayoutInfo.setLayoutCount = 1;
+        PipelineLayoutInfo.pSetLayouts = SetLayoutHndlPtr;
+        
+        //  Any push constants form a single range, starting at offset zero, used by the
+        //  compute stage.
+        
+        VkPushConstantRange PushConstantRange{};
+        PushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        PushConstantRange.offset = 0;
+        PushConstantRange.size = PushConstantSize;
+        if (PushConstantSize > 0) {
+            PipelineLayoutInfo.pushConstantRangeCount = 1;
+            PipelineLayoutInfo.pPushConstantRanges = &PushConstantRange;
+        }
+
+        VkResult Result;
+        Result = vkCreatePipelineLayout(I_LogicalDevice,&PipelineLayoutInfo,nullptr,
+                                                                  PipelineLayoutHndlPtr);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to create compute pipeline layout","vkCreatePipelineLayout",
+                                                                                         Result);
+            StatusOK = false;
+        } else {
+        
+            //  And now create the actual pipeline.
+            
+            VkComputePipelineCreateInfo PipelineInfo{};
+            PipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            PipelineInfo.layout = *PipelineLayoutHndlPtr;
+            PipelineInfo.stage = ShaderStageInfo;
+
+            Result = vkCreateComputePipelines(I_LogicalDevice,I_PipelineCacheHndl,1,
+                                              &PipelineInfo,nullptr,PipelineHndlPtr);
+            if (Result != VK_SUCCESS) {
+                LogVulkanError ("Failed to create compute pipeline","vkCreateComputePipelines",
+                                                                                       Result);
+                StatusOK = false;
             }
         }
-        if (!Found) {
-            I_Debug.Logf("Device","Device does not support required extension '%s'.",NamePtr);
-            AllPresent = false;
-            break;
+    }
+
+    //  The shader module is kept by GetShaderModule() for any other pipeline that uses the same
+    //  code, and is released when the Framework closes down.
+    
+    //  If the pipeline and its layout were created and bound successfully, record the details
+    //  so they can be shut down properly at the end of the program. If things went wrong,
+    //  release these if they were allocated before the problem was spotted.
+    
+    if (AllOK(StatusOK)) {
+        T_PipelineDetails PipelineDetails;
+        PipelineDetails.PipelineHndl = *PipelineHndlPtr;
+        PipelineDetails.PipelineLayoutHndl = *PipelineLayoutHndlPtr;
+        I_PipelineDetails.push_back(PipelineDetails);
+        I_Debug.Log("Progress","Compute pipeline created.");
+    } else {
+        if (*PipelineLayoutHndlPtr != VK_NULL_HANDLE) {
+            vkDestroyPipelineLayout(I_LogicalDevice,*PipelineLayoutHndlPtr,nullptr);
+        }
+        if (*PipelineHndlPtr != VK_NULL_HANDLE) {
+            vkDestroyPipeline(I_LogicalDevice,*PipelineHndlPtr,nullptr);
         }
     }
-    return AllPresent;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                     S h o w  D e v i c e  D e t a i l s   (Internal routine)
+//                       D e s t r o y  C o m p u t e  P i p e l i n e
 //
-//  This is an internal utility used by FindSuitableDevice() which may call it as a diagnostic.
-//  The details listed may be useful when testing a program. However, the main reason for having
-//  this code here is to show just a little of the information that's available about a GPU.
-//  What's listed here is just a subset. The full list of device properties can be found in
-//  mind-boggling detail in the Vulkan documentation.
+//  Pipelines created by CreateComputePipeline() are normally released when the Framework closes
+//  down, but a program that creates pipelines it only needs briefly can release them sooner
+//  using this routine.
 //
 //  Parameters:
-//     DeviceHndl     (VkPhysicalDevice) A Vulkan handle for the physical device in question.
+//     PipelineLayoutHndl (VkPipelineLayout) The Vulkan handle for the pipeline layout, as
+//                   returned by CreateComputePipeline().
+//     PipelineHndl  (VkPipeline) The Vulkan handle for the pipeline.
 //
-//  Output:
-//     Some possibly interesting details about the device.
+//  Pre-requisites:
+//     The pipeline must not be in use by a command buffer that has not completed.
 
-void KVVulkanFramework::ShowDeviceDetails (VkPhysicalDevice DeviceHndl)
+void KVVulkanFramework::DestroyComputePipeline(
+                                  VkPipelineLayout PipelineLayoutHndl,VkPipeline PipelineHndl)
 {
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    VkPhysicalDeviceProperties Properties;
-    vkGetPhysicalDeviceProperties(DeviceHndl,&Properties);
-    I_Debug.Logf("Device","Device: %s",Properties.deviceName);
-    I_Debug.Logf("Device","Max compute workgroup count: %d, %d, %d",
-             Properties.limits.maxComputeWorkGroupCount[0],
-             Properties.limits.maxComputeWorkGroupCount[1],
-             Properties.limits.maxComputeWorkGroupCount[2]);
-    I_Debug.Logf("Device","Max compute workgroup invocations: %d",
-             Properties.limits.maxComputeWorkGroupInvocations);
-    I_Debug.Logf("Device","Max compute workgroup size: %d %d %d",
-             Properties.limits.maxComputeWorkGroupSize[0],
-             Properties.limits.maxComputeWorkGroupSize[1],
-             Properties.limits.maxComputeWorkGroupSize[2]);
-    I_Debug.Logf("Device","Max storage buffer range: %d",
-             Properties.limits.maxStorageBufferRange);
-    VkPhysicalDeviceFeatures Features;
-    vkGetPhysicalDeviceFeatures(DeviceHndl,&Features);
-    I_Debug.Logf("Device","Double precision support: %s",
-             ((Features.shaderFloat64) ? "Yes" : "No"));
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
+    
+    for (auto Iter = I_PipelineDetails.begin(); Iter != I_PipelineDetails.end(); Iter++) {
+        if (Iter->PipelineHndl == PipelineHndl && Iter->PipelineLayoutHndl == PipelineLayoutHndl) {
+            vkDestroyPipelineLayout(I_LogicalDevice,PipelineLayoutHndl,nullptr);
+            vkDestroyPipeline(I_LogicalDevice,PipelineHndl,nullptr);
+            I_PipelineDetails.erase(Iter);
+            break;
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                      A u t o t u n e  W o r k  G r o u p  S i z e
+//
+//  The best shape for the local workgroup used by a compute shader depends on the GPU and on the
+//  shader - a shader that needs a lot of private memory for each thread may do better with
+//  quite small workgroups - and is hard to predict. This routine times a compute shader using
+//  a number of candidate workgroup shapes, on the actual device and for the actual problem size,
+//  and returns the one that runs fastest. The shader must take its workgroup dimensions from
+//  specialization constants 0 and 1 (see the version of CreateComputePipeline() that takes
+//  specialization constants). The candidates are 2-D shapes with power of two dimensions and
+//  from 64 to 1024 threads, restricted to those the device supports.
+//
+//  Parameters:
+//     ShaderFilename (const std::string&) The name of file containing the SPIR-V code.
+//     StageName     (const std::string&) The entry name of the routine in the shader code.
+//     SetLayoutHndlPtr (VkDescriptorSetLayout*) The address of the Vulkan handle for the
+//                   descriptor set layout, as for CreateComputePipeline().
+//     DescriptorSetHndlPtr (VkDescriptorSet*) The address of the descriptor set to use for
+//                   the trial runs. The buffers it describes should already be set up, ideally
+//                   with realistic data, as the shader will be run on them a number of times.
+//     Nx            (uint32_t) The X dimension of the problem - the number of threads needed.
+//     Ny            (uint32_t) The Y dimension of the problem.
+//     CommandPoolHndl (VkCommandPool) The command pool to use for the trial runs.
+//     QueueHndl     (VkQueue) The queue to use for the trial runs.
+//     WorkGroupSize (uint32_t[2]) Receives the X and Y dimensions of the fastest shape found.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     As for CreateComputePipeline() and RecordComputeCommandBuffer().
+//
+//  Note:
+//     Each candidate is run once to warm up and then timed over a few runs, taking the fastest.
+//     The times are wall-clock times for submission and completion, so very small problems will
+//     mostly be measuring overheads. The trial pipelines are released before this returns.
+
+void KVVulkanFramework::AutotuneWorkGroupSize(
+    const std::string& ShaderFilename,const std::string& StageName,
+    VkDescriptorSetLayout* SetLayoutHndlPtr,VkDescriptorSet* DescriptorSetHndlPtr,
+    uint32_t Nx,uint32_t Ny,VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
+                                                    uint32_t WorkGroupSize[2],bool& StatusOK)
+{
+    std::vector<uint32_t> NoConstants;
+    AutotuneWorkGroupSize(ShaderFilename,StageName,SetLayoutHndlPtr,DescriptorSetHndlPtr,Nx,Ny,
+                        CommandPoolHndl,QueueHndl,NoConstants,WorkGroupSize,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//       A u t o t u n e  W o r k  G r o u p  S i z e   (with specialization constants)
+//
+//  This version of AutotuneWorkGroupSize() is for shaders that use specialization constants
+//  for more than just the workgroup shape. The shape still goes in constants 0 and 1, and the
+//  values passed here go in constants 2 onwards, so each candidate is timed with the same
+//  pipeline, apart from its shape, that the caller will go on to create.
+//
+//  Parameters:
+//     ShaderFilename, StageName, SetLayoutHndlPtr, DescriptorSetHndlPtr, Nx, Ny,
+//     CommandPoolHndl, QueueHndl
+//                   As for the simpler version of AutotuneWorkGroupSize().
+//     ExtraSpecConstants (const std::vector<uint32_t>&) The values for the specialization
+//                   constants with constant IDs 2,3,4... in order. This can be empty.
+//     WorkGroupSize (uint32_t[2]) Receives the X and Y dimensions of the fastest shape found.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     As for the simpler version of AutotuneWorkGroupSize().
+
+void KVVulkanFramework::AutotuneWorkGroupSize(
+    const std::string& ShaderFilename,const std::string& StageName,
+    VkDescriptorSetLayout* SetLayoutHndlPtr,VkDescriptorSet* DescriptorSetHndlPtr,
+    uint32_t Nx,uint32_t Ny,VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
+    const std::vector<uint32_t>& ExtraSpecConstants,uint32_t WorkGroupSize[2],bool& StatusOK)
+{
+    WorkGroupSize[0] = WorkGroupSize[1] = 1;
+    if (!AllOK(StatusOK)) return;
+    
+    //  Work out the candidate shapes the device can handle.
+    
+    VkPhysicalDeviceProperties DeviceProperties;
+    vkGetPhysicalDeviceProperties(I_SelectedDevice,&DeviceProperties);
+    const VkPhysicalDeviceLimits& Limits = DeviceProperties.limits;
+    std::vector<std::array<uint32_t,2>> Candidates;
+    for (uint32_t X = 1; X <= 1024; X *= 2) {
+        for (uint32_t Y = 1; Y <= 1024; Y *= 2) {
+            uint32_t Threads = X * Y;
+            if (Threads >= 64 && Threads <= 1024 &&
+                Threads <= Limits.maxComputeWorkGroupInvocations &&
+                X <= Limits.maxComputeWorkGroupSize[0] && Y <= Limits.maxComputeWorkGroupSize[1]) {
+                Candidates.push_back({X,Y});
+            }
+        }
+    }
+    
+    VkCommandBuffer CommandBufferHndl;
+    CreateComputeCommandBuffer(CommandPoolHndl,&CommandBufferHndl,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    const int TimedRuns = 5;
+    float BestMsec = 0.0;
+    for (const std::array<uint32_t,2>& Candidate : Candidates) {
+        VkPipelineLayout PipelineLayoutHndl;
+        VkPipeline PipelineHndl;
+        std::vector<uint32_t> SpecConstants = {Candidate[0],Candidate[1]};
+        SpecConstants.insert(SpecConstants.end(),ExtraSpecConstants.begin(),
+                                                                    ExtraSpecConstants.end());
+        CreateComputePipeline(ShaderFilename,StageName,SetLayoutHndlPtr,&PipelineLayoutHndl,
+                                                    &PipelineHndl,SpecConstants,StatusOK);
+        if (!AllOK(StatusOK)) break;
+        uint32_t WorkGroupCounts[3];
+        WorkGroupCounts[0] = (Nx + Candidate[0] - 1) / Candidate[0];
+        WorkGroupCounts[1] = (Ny + Candidate[1] - 1) / Candidate[1];
+        WorkGroupCounts[2] = 1;
+        float CandidateMsec = 0.0;
+        if (WorkGroupCounts[0] <= Limits.maxComputeWorkGroupCount[0] &&
+            WorkGroupCounts[1] <= Limits.maxComputeWorkGroupCount[1]) {
+            RecordComputeCommandBuffer(CommandBufferHndl,PipelineHndl,PipelineLayoutHndl,
+                                            DescriptorSetHndlPtr,WorkGroupCounts,StatusOK);
+            RunCommandBuffer(QueueHndl,CommandBufferHndl,StatusOK);
+            for (int Run = 0; Run < TimedRuns && AllOK(StatusOK); Run++) {
+                MsecTimer Timer;
+                RunCommandBuffer(QueueHndl,CommandBufferHndl,StatusOK);
+                float Msec = Timer.ElapsedMsec();
+                if (Run == 0 || Msec < CandidateMsec) CandidateMsec = Msec;
+            }
+            if (AllOK(StatusOK)) {
+                I_Debug.Logf("Progress","Workgroup %u x %u: %.3f msec",
+                                                   Candidate[0],Candidate[1],CandidateMsec);
+                if (BestMsec == 0.0 || CandidateMsec < BestMsec) {
+                    BestMsec = CandidateMsec;
+                    WorkGroupSize[0] = Candidate[0];
+                    WorkGroupSize[1] = Candidate[1];
+                }
+            }
+        }
+        DestroyComputePipeline(PipelineLayoutHndl,PipelineHndl);
+        if (!AllOK(StatusOK)) break;
+    }
+    vkFreeCommandBuffers(I_LogicalDevice,CommandPoolHndl,1,&CommandBufferHndl);
+    
+    if (AllOK(StatusOK) && BestMsec == 0.0) {
+        LogError("Unable to find a usable workgroup size for '%s'",ShaderFilename.c_str());
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                  L e a s t  P a d d e d  W o r k  G r o u p  S i z e
+//
+//  A dispatch covering an Nx by Ny problem with workgroups of X by Y invocations runs
+//  ceil(Nx/X) * X by ceil(Ny/Y) * Y invocations, and the extra ones past the edges only return.
+//  For awkward sizes, or narrow problems, a different shape with the same number of threads can
+//  need far fewer of them. (The number is exactly what GetDispatchInvocations() counts for a
+//  single dispatch.) This routine is passed the shape a program would normally use, and returns
+//  the shape with the same number of threads that needs fewest invocations. The candidates are
+//  2-D shapes with power of two dimensions that the device supports, at least as wide as the
+//  subgroup size, so that neighbouring invocations still read neighbouring values along a row.
+//  The shape passed is kept unless another needs fewer invocations, and of two shapes that need
+//  the same number, the one closer to square is preferred.
+//
+//  Parameters:
+//     Nx            (uint32_t) The X dimension of the problem - the number of threads needed.
+//     Ny            (uint32_t) The Y dimension of the problem.
+//     WorkGroupSize (uint32_t[2]) Passed the X and Y dimensions of the preferred shape, and
+//                   receives those of the least padded one.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     FindSuitableDevice() must have been called to select the GPU device to be used.
+
+void KVVulkanFramework::LeastPaddedWorkGroupSize(
+                            uint32_t Nx,uint32_t Ny,uint32_t WorkGroupSize[2],bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    VkPhysicalDeviceProperties DeviceProperties;
+    vkGetPhysicalDeviceProperties(I_SelectedDevice,&DeviceProperties);
+    const VkPhysicalDeviceLimits& Limits = DeviceProperties.limits;
+    uint32_t Threads = WorkGroupSize[0] * WorkGroupSize[1];
+    uint32_t MinWidth = std::min(std::max(I_SubgroupSize,uint32_t(1)),Threads);
+    auto Invocations = [Nx,Ny](uint32_t X,uint32_t Y) {
+        return uint64_t((Nx + X - 1) / X) * X * uint64_t((Ny + Y - 1) / Y) * Y;
+    };
+    auto Squareness = [](uint32_t X,uint32_t Y) { return X > Y ? X / Y : Y / X; };
+    uint64_t Best = Invocations(WorkGroupSize[0],WorkGroupSize[1]);
+    for (uint32_t X = MinWidth; X <= Threads; X *= 2) {
+        if (Threads % X != 0) continue;
+        uint32_t Y = Threads / X;
+        if (X > Limits.maxComputeWorkGroupSize[0] || Y > Limits.maxComputeWorkGroupSize[1]) {
+            continue;
+        }
+        if ((Nx + X - 1) / X > Limits.maxComputeWorkGroupCount[0] ||
+            (Ny + Y - 1) / Y > Limits.maxComputeWorkGroupCount[1]) continue;
+        uint64_t Count = Invocations(X,Y);
+        if (Count < Best || (Count == Best && X != WorkGroupSize[0] &&
+                     Squareness(X,Y) < Squareness(WorkGroupSize[0],WorkGroupSize[1]))) {
+            I_Debug.Logf("Progress","Workgroup %u x %u: %llu invocations",X,Y,
+                                                                   (unsigned long long)Count);
+            Best = Count;
+            WorkGroupSize[0] = X;
+            WorkGroupSize[1] = Y;
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                   C r e a t e  V u l k a n  D e s c r i p t o r  P o o l
+//
+//  A Vulkan descriptor set needs to be created for the set of buffers to be used for a calculation.
+//  Vulkan uses a descriptor pool to provide descriptor sets as required, and this routine creates
+//  such a pool. Each pool provides descriptor sets with a particular layout, and this is provided
+//  to this routine by passing it a vector containing all the Framework handles for all the buffers
+//  in question, as returned by SetBufferDetails().
+//
+//  Parameters:
+//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
+//                   Framework handles for each buffer, as returned by SetBufferDetails().
+//     MaxSets       (int) The maximum number of descriptor sets that the pool is to provide.
+//     PoolHndlPtr   (VkDescriptorPool*) Receives the opaque Vulkan handle for the created pool.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//     The details of each buffer in question must have been set using SetBufferDetails() and
+//     the vector (BufferHandles) containing the handles for each buffer must have been created
+//     and filled.
+
+void KVVulkanFramework::CreateVulkanDescriptorPool(
+            std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+                        int MaxSets,VkDescriptorPool* PoolHndlPtr,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+ 
+    //  At the moment, this only supports uniform buffers and storage buffers. See how many we
+    //  have of each.
+
+    int UniformBuffers = 0;
+    int StorageBuffers = 0;
+    for (KVBufferHandle Handle : BufferHandles) {
+        int Index = BufferIndexFromHandle(Handle,StatusOK);
+        if (!AllOK(StatusOK)) break;
+        if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) UniformBuffers++;
+        if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) StorageBuffers++;
+    }
+
+    if (AllOK(StatusOK)) {
+        
+        //  Since we support two buffer types (storage and uniform) we set up their details
+        //  in an array that we will pass to vkCreateDescriptorPool(). If only one type is
+        //  actually being used, NumberPoolTypes will be 1 and the second element of PoolSizes
+        //  won't end up being used. All that PoolSizes is used for is to tell Vulkan how
+        //  many buffers of each type will be used for each set and it can allocate the descriptor
+        //  pool on that basis - together with the number of sets that will be used (MaxSets).
+        
+        std::array<VkDescriptorPoolSize,2> PoolSizes{};
+        int NumberPoolTypes = 0;
+        if (UniformBuffers > 0) NumberPoolTypes++;
+        if (StorageBuffers > 0) NumberPoolTypes++;
+
+        int Index = 0;
+        if (UniformBuffers > 0) {
+            PoolSizes[Index].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            PoolSizes[Index].descriptorCount = UniformBuffers;
+            Index++;
+        }
+        if (StorageBuffers > 0) {
+            PoolSizes[Index].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            PoolSizes[Index].descriptorCount = StorageBuffers;
+            Index++;
+        }
+
+        VkDescriptorPoolCreateInfo PoolInfo{};
+        PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        PoolInfo.poolSizeCount = NumberPoolTypes;
+        PoolInfo.pPoolSizes = PoolSizes.data();
+        PoolInfo.maxSets = MaxSets;
+
+        VkResult Result;
+        Result = vkCreateDescriptorPool(I_LogicalDevice,&PoolInfo,nullptr,PoolHndlPtr);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to create descriptor pool","vkCreateDescriptorPool",Result);
+            StatusOK = false;
+        } else {
+            I_DescriptorPoolHndls.push_back(*PoolHndlPtr);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                   A l l o c a t e  V u l k a n  D e s c r i p t o r  S e t
+//
+//  A Vulkan descriptor set needs to be created for the set of buffers to be used for a calculation,
+//  and this routine allocates such a set from an already created Vulkan descriptor pool.
+//
+//  Parameters:
+//     SetLayoutHndl (VkDescriptorSetLayout) The Vulkan handle for the created descriptor set
+//                   layout, as returned by CreateVulkanDescriptorSetLayout().
+//     PoolHndl      (VkDescriptorPool*) The Vulkan handle for the pool, as returned by
+//                   CreateVulkanDescriptorPool().
+//     SetHndlPtr    (VkDescriptorSet*) Receives the opaque Vulkan handle for the allocated set.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//     The descriptor set layout for the buffers must have been created by a call to the routine
+//     CreateVulkanDescriptorSetLayout(). The pool must have been created by a call to the routine
+//     CreateVulkanDescriptorPool().
+
+void KVVulkanFramework::AllocateVulkanDescriptorSet(
+    VkDescriptorSetLayout SetLayoutHandl,
+                    VkDescriptorPool PoolHndl,VkDescriptorSet* SetHndlPtr, bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    //  First, allocate a single descriptor set from the pool. (Worth mentioning at this point
+    //  that this set doesn't need explicitly destroying - it's destroyed when the pool is
+    //  destroyed.)
+    
+    VkDescriptorSetLayout LocalSetLayoutHandl = SetLayoutHandl;
+    VkDescriptorSetAllocateInfo AllocInfo{};
+    AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    AllocInfo.descriptorPool = PoolHndl;
+    AllocInfo.descriptorSetCount = 1;
+    AllocInfo.pSetLayouts = &LocalSetLayoutHandl;
+
+    VkResult Result;
+    Result = vkAllocateDescriptorSets(I_LogicalDevice,&AllocInfo,SetHndlPtr);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to allocate descriptor sets","vkAllocateDescriptorSets",Result);
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                   S e t u p  V u l k a n  D e s c r i p t o r  S e t
+//
+//  A Vulkan descriptor set describes the various buffers used for a calculation. Such a set (and
+//  the pool from which it has to be allocated) can be created given only the initial details of
+//  the number of buffers involved, their types and access details, before the buffers themselves
+//  are actually created. Once the buffers have been created (by calls to CreateBuffer()), the
+//  setup of the descriptor set can be completed. In particular, up until now, the sizes of the
+//  buffers have not been included in the descriptor set.
+//
+//  Parameters:
+//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
+//                   Framework handles for each buffer, as returned by SetBufferDetails().
+//     SetHndl       (VkDescriptorSet) The Vulkan handle for the descriptor set, as returned
+//                   by CreateVulkanDescriptorSet().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//     The descriptor set for the buffers must have been created by a call to the routine
+//     CreateVulkanDescriptorSet(). The details of each buffer in question must have been set
+//     using SetBufferDetails(), the vector (BufferHandles) containing the handles for each buffer
+//     must have been created and filled, and all the buffers themselves must now have been
+//     created by calls to CreateBuffer().
+
+void KVVulkanFramework::SetupVulkanDescriptorSet(
+        std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+                                        VkDescriptorSet SetHndl, bool& StatusOK)
+{
+    SetupVulkanDescriptorSet(BufferHandles,std::vector<long>(),SetHndl,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 S e t u p  V u l k a n  D e s c r i p t o r  S e t  (with bindings)
+//
+//  This is a version of SetupVulkanDescriptorSet() that puts each buffer at a binding given by
+//  the caller, rather than at the binding given when its details were set. This lets the same
+//  buffer be used at different bindings in different descriptor sets - for example, when the
+//  output of one shader is the input of the next. The types of the buffers must still match
+//  those expected by the descriptor set's layout at the bindings used.
+//
+//  Parameters:
+//     BufferHandles (std::vector<KVVulkanFramework::KVBufferHandle>&) a vector containing the
+//                   Framework handles for each buffer, as returned by SetBufferDetails().
+//     Bindings      (const std::vector<long>&) the binding to use for each buffer, in the same
+//                   order as BufferHandles. If this is empty, the bindings given to
+//                   SetBufferDetails() are used.
+//     SetHndl       (VkDescriptorSet) The Vulkan handle for the descriptor set, as returned
+//                   by CreateVulkanDescriptorSet().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     As for the version that uses the buffers' own bindings.
+
+void KVVulkanFramework::SetupVulkanDescriptorSet(
+        const std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+        const std::vector<long>& Bindings,VkDescriptorSet SetHndl, bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    if (!Bindings.empty() && Bindings.size() != BufferHandles.size()) {
+        LogError("Descriptor set has %d buffers but %d bindings.",
+                                               int(BufferHandles.size()),int(Bindings.size()));
+        StatusOK = false;
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
+    
+    //  We need to know how many active buffers we have to handle, in order to allocate
+    //  a large enough array to pass to vkUpdateDescriptorSets().
+    
+    int BufferCount = 0;
+    for (KVBufferHandle Handle : BufferHandles) {
+        int Index = BufferIndexFromHandle(Handle,StatusOK);
+        if (!AllOK(StatusOK)) continue;
+        if (I_BufferDetails[Index].InUse) {
+            if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) BufferCount++;
+            if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) BufferCount++;
+        }
+    }
+
+    if (AllOK(StatusOK)) {
+        
+        //  What we pass to vkUpdateDescriptorSets() is an array of VkWriteDescriptorSets,
+        //  which contain things like the binding (which binds the actual buffer we created
+        //  to the buffer referred to by the GPU code) and the type, and also a pointer to
+        //  a VkDescriptorBufferInfo structure that contain things like the VkBuffer handle
+        //  for the buffer and its size. So we also need an arrray of these as well.
+                
+        std::vector<VkWriteDescriptorSet> WriteDescriptors{};
+        WriteDescriptors.resize(BufferCount);
+        std::vector<VkDescriptorBufferInfo> BufferInfo{};
+        BufferInfo.resize(BufferCount);
+
+        int WriteIndex = 0;
+        for (size_t Item = 0; Item < BufferHandles.size(); Item++) {
+            
+            //  For each buffer we deal with, first check this is a buffer we know how to handle.
+            //  Just in case. If it's not, we skip to the next buffer.
+            
+            int Index = BufferIndexFromHandle(BufferHandles[Item],StatusOK);
+
+            if (!AllOK(StatusOK)) break;
+            VkDescriptorType Type;
+            if (I_BufferDetails[Index].BufferType == TYPE_UNIFORM) {
+                Type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            } else if (I_BufferDetails[Index].BufferType == TYPE_STORAGE) {
+                Type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                
+                //  A descriptor can't describe more of a storage buffer than the device's
+                //  limit, and a shader would simply not see the rest. A program with data that
+                //  large has to split it between buffers, or work through it in pieces.
+                
+                if (I_BufferDetails[Index].SizeInBytes > I_MaxStorageBufferRange) {
+                    LogError("Storage buffer of %llu bytes exceeds the device limit of %llu bytes.",
+                                  (unsigned long long)I_BufferDetails[Index].SizeInBytes,
+                                                (unsigned long long)I_MaxStorageBufferRange);
+                    StatusOK = false;
+                    break;
+                }
+            } else {
+                continue;
+            }
+            
+            //  Set up the Buffer information structure first
+            
+            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+                I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU ) {
+                BufferInfo[WriteIndex].buffer = I_BufferDetails[Index].SecondaryBufferHndl;
+            } else {
+                BufferInfo[WriteIndex].buffer = I_BufferDetails[Index].MainBufferHndl;
+            }
+            BufferInfo[WriteIndex].offset = 0;
+            BufferInfo[WriteIndex].range = I_BufferDetails[Index].SizeInBytes;
+
+            //  Then set up the write descriptor set, including a pointer to the Buffer
+            //  information set. (It's OK that the buffer information set will go out of
+            //  scope at the end of this routine - vkUpdateDescriptorSets() will copy
+            //  what it needs from it, and doesn't need it to hang around.)
+            
+            WriteDescriptors[WriteIndex].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            WriteDescriptors[WriteIndex].dstSet = SetHndl;
+            WriteDescriptors[WriteIndex].dstBinding =
+                        Bindings.empty() ? I_BufferDetails[Index].Binding : Bindings[Item];
+            WriteDescriptors[WriteIndex].dstArrayElement = 0;
+            WriteDescriptors[WriteIndex].descriptorType = Type;
+            WriteDescriptors[WriteIndex].descriptorCount = 1;
+            WriteDescriptors[WriteIndex].pBufferInfo = &BufferInfo[WriteIndex];
+            WriteIndex++;
+        }
+
+        //  And now we do the work we came here to do.
+        
+        if (AllOK(StatusOK)) {
+            vkUpdateDescriptorSets(I_LogicalDevice,BufferCount,WriteDescriptors.data(),0,nullptr);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           C r e a t e  C o m m a n d  P o o l
+//
+//  A Vulkan command pool is needed to supply the command buffers that can be used to run pipelines
+//  on the GPU. This routine creates such a pool.
+//
+//  Parameters:
+//     CommandPoolHndlPtr (VkCommandPool*) Receives the Vulkan handle for the command pool.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called to create the Vulkan logical device.
+
+void KVVulkanFramework::CreateCommandPool(VkCommandPool* CommandPoolHndlPtr,bool& StatusOK)
+{
+    CreateCommandPool("GRAPHICS",CommandPoolHndlPtr,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 C r e a t e  C o m m a n d  P o o l   (for a given queue type)
+//
+//  Command buffers can only be submitted to queues from the family used by the pool they were
+//  allocated from. This version of CreateCommandPool() creates a pool for a specified type of
+//  queue, as returned by the corresponding version of GetDeviceQueue().
+//
+//  Parameters:
+//     QueueType     (const std::string&) The type of queue - "GRAPHICS", "COMPUTE" or
+//                   "TRANSFER". See GetDeviceQueue().
+//     CommandPoolHndlPtr (VkCommandPool*) Receives the Vulkan handle for the command pool.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called to create the Vulkan logical device.
+
+void KVVulkanFramework::CreateCommandPool(
+               const std::string& QueueType,VkCommandPool* CommandPoolHndlPtr,bool& StatusOK)
+{
+    //   CreateLogicalDevice() will have created the logical device and set its handle in
+    //   I_LogicalDevice, and will have identified the command queue families to be used
+    //   and set their indices in I_QueueFamilyIndex etc.
+    
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    KVQueueType Type = QueueTypeFromString(QueueType,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    VkCommandPoolCreateInfo PoolInfo{};
+    PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    PoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    PoolInfo.queueFamilyIndex = QueueFamilyForType(Type);
+    
+    //  Note that you don't have to specify the number of command buffers in the pool. The pool
+    //  doesn't contain the buffers it will be asked to allocate, it just coordinates them.
+    
+    VkResult Result;
+    Result = vkCreateCommandPool(I_LogicalDevice,&PoolInfo,nullptr,CommandPoolHndlPtr);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to create command pool","vkCreateCommandPool",Result);
+        StatusOK = false;
+    } else {
+        I_Debug.Log ("Progress","Created new command pool.");
+        I_CommandPoolHndls.push_back(*CommandPoolHndlPtr);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        G e t  T h r e a d  C o m m a n d  P o o l
+//
+//  Vulkan requires access to a command pool - and to all the command buffers allocated from it -
+//  to be synchronised by the program, so two threads can't safely record command buffers from
+//  the same pool at the same time. The simplest way round this is for each thread to have its
+//  own pools, and this routine returns a command pool for the calling thread, for a given type
+//  of queue, creating it the first time it is asked for. Command buffers allocated from it, eg
+//  by CreateComputeCommandBuffer(), can then be recorded and submitted by that thread without
+//  getting in the way of any others.
+//
+//  Parameters:
+//     QueueType     (const std::string&) The type of queue - "GRAPHICS", "COMPUTE" or
+//                   "TRANSFER". See GetDeviceQueue().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Returns:
+//     (VkCommandPool) The Vulkan handle for the command pool, or VK_NULL_HANDLE if it could
+//                   not be created.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called to create the Vulkan logical device.
+//
+//  Notes:
+//     o The Framework's own bookkeeping - buffers, memory blocks, submissions, pipelines and
+//     so on - is protected by a mutex, so the other Framework routines can be called from any
+//     thread. What the Framework can't do is coordinate access to the Vulkan objects a program
+//     uses directly: each command buffer, and each buffer being synched with SyncBuffer() (which
+//     records into the pool it is passed), should be used by one thread at a time.
+//     o Submitting to a queue is also protected by the mutex, so threads can share a queue.
+//     o The pools are released when the Framework closes down. A worker thread that finishes
+//     earlier can release its pools using ReleaseThreadCommandPools().
+
+VkCommandPool KVVulkanFramework::GetThreadCommandPool(
+                                                 const std::string& QueueType,bool& StatusOK)
+{
+    VkCommandPool CommandPoolHndl = VK_NULL_HANDLE;
+    if (!AllOK(StatusOK)) return CommandPoolHndl;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    KVQueueType Type = QueueTypeFromString(QueueType,StatusOK);
+    if (!AllOK(StatusOK)) return CommandPoolHndl;
+    
+    std::thread::id ThreadId = std::this_thread::get_id();
+    for (const T_ThreadPool& ThreadPool : I_ThreadPools) {
+        if (ThreadPool.ThreadId == ThreadId && ThreadPool.QueueType == Type) {
+            return ThreadPool.CommandPoolHndl;
+        }
+    }
+    
+    //  There isn't one yet. CreateCommandPool() adds it to I_CommandPoolHndls, so it will be
+    //  released by CleanupVulkan() along with all the others.
+    
+    CreateCommandPool(QueueType,&CommandPoolHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        T_ThreadPool ThreadPool;
+        ThreadPool.ThreadId = ThreadId;
+        ThreadPool.QueueType = Type;
+        ThreadPool.CommandPoolHndl = CommandPoolHndl;
+        I_ThreadPools.push_back(ThreadPool);
+        I_Debug.Logf ("Progress","Created %s command pool for thread, %d thread pools now in use",
+                                                  QueueType.c_str(),int(I_ThreadPools.size()));
+    } else {
+        CommandPoolHndl = VK_NULL_HANDLE;
+    }
+    return CommandPoolHndl;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                    R e l e a s e  T h r e a d  C o m m a n d  P o o l s
+//
+//  Releases any command pools created for the calling thread by GetThreadCommandPool(), together
+//  with all the command buffers allocated from them. This is intended for a worker thread that
+//  is about to finish, and which would otherwise leave its pools around until the Framework
+//  closes down.
+//
+//  Parameters:
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     None of the command buffers allocated from the thread's pools can still be executing.
+
+void KVVulkanFramework::ReleaseThreadCommandPools(bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    std::thread::id ThreadId = std::this_thread::get_id();
+    for (auto Iter = I_ThreadPools.begin(); Iter != I_ThreadPools.end(); ) {
+        if (Iter->ThreadId == ThreadId) {
+            VkCommandPool CommandPoolHndl = Iter->CommandPoolHndl;
+            
+            //  Any reusable command buffers from the pool will no longer exist, and their
+            //  handles could be re-used, so they will have to be recorded again.
+            
+            I_RecordingGeneration++;
+            I_CommandPoolHndls.erase(std::remove(I_CommandPoolHndls.begin(),
+                            I_CommandPoolHndls.end(),CommandPoolHndl),I_CommandPoolHndls.end());
+            vkDestroyCommandPool(I_LogicalDevice,CommandPoolHndl,nullptr);
+            Iter = I_ThreadPools.erase(Iter);
+        } else {
+            Iter++;
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     C r e a t e  C o m p u t e  C o m m a n d  B u f f e r
+//
+//  This routine creates a single Vulkan command buffer, which may be enough for a simple compute
+//  program that may only need a single such buffer.
+//
+//  Parameters:
+//     CommandPoolHndl (VkCommandPool) The Vulkan handle for the command pool, as returned by
+//                     CreateCommandPool().
+//     CommandBufferHndlPtr  (VkCommandBuffer*) Receives the Vulkan handle for the command buffer.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called to create the Vulkan logical device,
+//      and CreateCommandPool() must have been called to create the command pool.
+//
+//  Note:
+//     This was originally provided by an early version for the Framework and is retained for
+//     backwards compatability and perhaps some convenience. Command buffers are the same for
+//     both compute and graphics pipelines, and this is now just a simple wrapper around
+//     CreateCommandBuffers()
+
+void KVVulkanFramework::CreateComputeCommandBuffer(
+        VkCommandPool CommandPoolHndl, VkCommandBuffer* CommandBufferHndlPtr,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::vector<VkCommandBuffer> CommandBuffers;
+    CreateCommandBuffers (CommandPoolHndl,1,CommandBuffers,StatusOK);
+    *CommandBufferHndlPtr = CommandBuffers[0];
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         C r e a t e  C o m m a n d  B u f f e r s
+//
+//  This routine creates a specified number of the Vulkan command buffers that used to run
+//  pipelines. A simple compute program may only need a single such buffer, but a graphics
+//  program running a swap chain may need one buffer for each image being used.
+//
+//  Parameters:
+//     CommandPoolHndl (VkCommandPool) The Vulkan handle for the command pool, as returned by
+//                     CreateCommandPool().
+//     NumberBuffers   (int) The number of command buffers to be created.
+//     CommandBuffers  (std::vector<VkCommandBuffer>&) Returns the set of command buffers
+//                     requested.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//      CreateLogicalDevice() must have been called to create the Vulkan logical device,
+//      and CreateCommandPool() must have been called to create the command pool.
+
+void KVVulkanFramework::CreateCommandBuffers(
+        VkCommandPool CommandPoolHndl, int NumberBuffers,
+                            std::vector<VkCommandBuffer>& CommandBuffers,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+        
+    VkCommandBufferAllocateInfo AllocInfo{};
+    AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    AllocInfo.commandPool = CommandPoolHndl;
+    AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    AllocInfo.commandBufferCount = NumberBuffers;
+    
+    CommandBuffers.resize(NumberBuffers);
+
+    VkResult Result;
+    Result = vkAllocateCommandBuffers(I_LogicalDevice,&AllocInfo,CommandBuffers.data());
+    if (Result != VK_SUCCESS) {
+        LogVulkanError("Failed to allocate command buffers","vkAllocateCommandBuffers",Result);
+        StatusOK = false;
+    }
+    
+    if (AllOK(StatusOK)) I_Debug.Logf ("Progress","Allocated %d command buffers.",NumberBuffers);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         R e c o r d  C o m p u t e  C o m m a n d  B u f f e r
+//
+//  This routine sets up a command buffer with the details of the operation it is to perform.
+//  This includes binding the buffer to the pipeline to be used, and to the descriptor sets
+//  that describe how it is to use the various data buffers. It also need to be told how to
+//  distribute the calculations across the various workgroups that are to be used - this depends
+//  on both the dimensions of the data being processed and the details of the shader code to
+//  be run by the pipeline.
+//
+//  This is the final thing to be done before the buffer can be submitted for execution using
+//  RunCommandBuffer(), and everything must have been set up properly at this point - the
+//  pipeline must be set up, and the descriptor set must describe the buffers, which must all
+//  have been created.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     PipelineHndl    (VkPipeline) The Vulkan handle for the pipeline to be run, as returned by
+//                     CreateComputePipeline().
+//     DescriptorSetHndlPtr (VkDescriptorSet*) The address of the descriptor set that contains
+//                     details of the buffers to be used by the calculation. This must have been
+//                     set by AllocateVulkanDescriptorSet(). Note that this is passed by
+//                     address, not by value.
+//     WorkGroupCounts (uint32_t[3]) The 3-D layout of the workgroups to be used. This is an
+//                     array set up on the basis of the dimensions of the data, but also has
+//                     to take into account the coding of the shader program that will process
+//                     the data.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//      The command buffer must have been created by either CreateCommandBuffers() or by
+//      CreateComputeCommandBuffer(). The pipeline must have been created by CreateComputePipeline()
+//      and the descriptor set must have been allocated by AllocateVulkanDescriptorSet and set up
+//      by SetupVulkanDescriptorSet().  all the various pre-requisites for those routines must have
+//      been fulfilled as well.
+
+void KVVulkanFramework::RecordComputeCommandBuffer(
+    VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
+    VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
+    uint32_t WorkGroupCounts[3],bool& StatusOK)
+{
+    //  This is just the version that can include buffer syncs, but with no buffers to sync.
+    
+    std::vector<KVBufferHandle> NoBuffers;
+    RecordComputeCommandBuffer(CommandBufferHndl,PipelineHndl,PipelineLayoutHndl,
+                         DescriptorSetHndlPtr,WorkGroupCounts,NoBuffers,NoBuffers,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//         R e c o r d  C o m p u t e  C o m m a n d  B u f f e r   (with buffer syncs)
+//
+//  This version of RecordComputeCommandBuffer() also includes in the command buffer the copy
+//  operations needed to sync any staged buffers, together with the memory barriers needed to
+//  make sure these happen in the right order with respect to the computation itself. Buffers
+//  listed in SyncBefore are synched before the computation runs - these will usually be
+//  STAGED_CPU buffers containing input data - and those listed in SyncAfter are synched once it
+//  completes - these will usually be STAGED_GPU buffers containing results. This means that a
+//  complete iteration - upload, compute, readback - needs just one submission and one wait,
+//  instead of separate calls to SyncBuffer() each waiting for its own transfer to complete.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     PipelineHndl    (VkPipeline) The Vulkan handle for the pipeline to be run, as returned by
+//                     CreateComputePipeline().
+//     PipelineLayoutHndl (VkPipelineLayout) The Vulkan handle for the pipeline layout, as
+//                     returned by CreateComputePipeline().
+//     DescriptorSetHndlPtr (VkDescriptorSet*) The address of the descriptor set that contains
+//                     details of the buffers to be used by the calculation.
+//     WorkGroupCounts (uint32_t[3]) The 3-D layout of the workgroups to be used.
+//     SyncBefore      (const std::vector<KVBufferHandle>&) Buffers to be synched before the
+//                     computation. Unstaged buffers are ignored, and the vector may be empty.
+//     SyncAfter       (const std::vector<KVBufferHandle>&) Buffers to be synched after the
+//                     computation. Unstaged buffers are ignored, and the vector may be empty.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//      As for the simpler version of RecordComputeCommandBuffer().
+//
+//  Note:
+//      As with the copies recorded by SyncBuffer(), the size of each copy is the size of the
+//      buffer at the time the command buffer is recorded.
+
+void KVVulkanFramework::RecordComputeCommandBuffer(
+    VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
+    VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
+    uint32_t WorkGroupCounts[3],const std::vector<KVBufferHandle>& SyncBefore,
+    const std::vector<KVBufferHandle>& SyncAfter,bool& StatusOK)
+{
+    //  This is just the version that can include push constants, but without any.
+    
+    RecordComputeCommandBuffer(CommandBufferHndl,PipelineHndl,PipelineLayoutHndl,
+      DescriptorSetHndlPtr,WorkGroupCounts,SyncBefore,SyncAfter,nullptr,0,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//       R e c o r d  C o m p u t e  C o m m a n d  B u f f e r   (with push constants)
+//
+//  This version of RecordComputeCommandBuffer() also records a block of push constant data
+//  into the command buffer, for use by a pipeline created using the version of the routine
+//  CreateComputePipeline() that specifies a push constant size. The data is copied when the
+//  command buffer is recorded, so the caller can change it as soon as this routine returns,
+//  and the parameters for each dispatch travel with its command buffer.
+//
+//  Parameters:
+//     CommandBufferHndl, PipelineHndl, PipelineLayoutHndl, DescriptorSetHndlPtr,
+//     WorkGroupCounts, SyncBefore, SyncAfter
+//                     As for the version of RecordComputeCommandBuffer() with buffer syncs.
+//     PushConstants   (const void*) The address of the push constant data. If this is
+//                     nullptr, no push constants are recorded.
+//     PushConstantSize (uint32_t) The number of bytes of push constant data. This must not
+//                     be greater than the size specified when the pipeline was created.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//      As for the simpler version of RecordComputeCommandBuffer().
+
+void KVVulkanFramework::RecordComputeCommandBuffer(
+    VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
+    VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
+    uint32_t WorkGroupCounts[3],const std::vector<KVBufferHandle>& SyncBefore,
+    const std::vector<KVBufferHandle>& SyncAfter,const void* PushConstants,
+                                                     uint32_t PushConstantSize,bool& StatusOK)
+{
+    //  This is just a batch containing a single dispatch.
+    
+    KVDispatch Dispatch;
+    Dispatch.PipelineHndl = PipelineHndl;
+    Dispatch.PipelineLayoutHndl = PipelineLayoutHndl;
+    Dispatch.DescriptorSetHndl = VK_NULL_HANDLE;
+    if (DescriptorSetHndlPtr) Dispatch.DescriptorSetHndl = *DescriptorSetHndlPtr;
+    for (int I = 0; I < 3; I++) Dispatch.WorkGroupCounts[I] = WorkGroupCounts[I];
+    Dispatch.PushConstants = PushConstants;
+    Dispatch.PushConstantSize = PushConstantSize;
+    std::vector<KVDispatch> Dispatches = {Dispatch};
+    RecordComputeBatch(CommandBufferHndl,Dispatches,SyncBefore,SyncAfter,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          R e c o r d  C o m p u t e  B a t c h
+//
+//  This is a generalisation of RecordComputeCommandBuffer() that records a sequence of
+//  dispatches into the one command buffer, each with its own pipeline, descriptor set, work
+//  group counts and (optionally) push constants. A memory barrier is recorded between each
+//  dispatch and the next, so each sees all the results written by those before it. This allows
+//  a number of repeats of a calculation, or the stages of a multi-stage calculation, to be
+//  submitted to the GPU as a single command buffer, with one submission and one wait, rather
+//  than one of each per dispatch. As with RecordComputeCommandBuffer(), staged buffers can be
+//  synched before the first dispatch and after the last.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     Dispatches      (const std::vector<KVDispatch>&) The dispatches to be recorded, in the
+//                     order in which they are to run. Each gives the pipeline and pipeline layout
+//                     (as returned by CreateComputePipeline()), the descriptor set, the 3-D work
+//                     group counts, and the address and size of any push constant data (nullptr
+//                     and zero if there is none).
+//     SyncBefore      (const std::vector<KVBufferHandle>&) Buffers to be synched before the
+//                     first dispatch. Unstaged buffers are ignored, and the vector may be empty.
+//     SyncAfter       (const std::vector<KVBufferHandle>&) Buffers to be synched after the
+//                     last dispatch. Unstaged buffers are ignored, and the vector may be empty.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//      As for RecordComputeCommandBuffer(), for each of the dispatches.
+//
+//  Note:
+//      o If dispatch timing is enabled (see EnableDispatchTiming()), the dispatch time returned
+//      by GetDispatchTimes() covers all the dispatches in the batch. So does the count of
+//      invocations returned by GetDispatchInvocations(), if EnablePipelineStatistics() was used.
+//      o If the command buffer has been marked as reusable by SetCommandBufferReusable() and
+//      it was last recorded with exactly the same details, it is left as it is rather than
+//      being recorded again.
+
+void KVVulkanFramework::RecordComputeBatch(VkCommandBuffer CommandBufferHndl,
+    const std::vector<KVDispatch>& Dispatches,const std::vector<KVBufferHandle>& SyncBefore,
+                                const std::vector<KVBufferHandle>& SyncAfter,bool& StatusOK)
+{
+    //  Note that the calculation of the values in WorkGroupCounts[] has to take into account
+    //  the 3D dimensions of the data to be processed by the GPU shader (which will depend on
+    //  the nature of the data itself, which will be known to the calling program) and on the
+    //  3D dimensions of the local workgroup (which are set explicitly by the shader code, and
+    //  appear not to be accessible by the CPU code).
+    
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    //  If this is a reusable command buffer that already has these details recorded, there's
+    //  nothing to do.
+    
+    int RecordingIndex = RecordingIndexFor(CommandBufferHndl);
+    if (RecordingIndex >= 0) {
+        if (RecordingUnchanged(RecordingIndex,Dispatches,SyncBefore,SyncAfter)) {
+            I_Debug.Log("Progress","Reusable command buffer unchanged, not re-recorded.");
+            return;
+        }
+        I_RecordingDetails[RecordingIndex].Recorded = false;
+    }
+    
+    //  'Record' here means setting up the command buffer with the details of the operation
+    //  to be performed. In particular the command buffer has to be bound to both the pipeline
+    //  to be used and the descriptor sets that describe how it is to use the various data buffers.
+    
+    VkCommandBufferBeginInfo BeginInfo{};
+    BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    VkResult Result;
+    Result = vkBeginCommandBuffer(CommandBufferHndl,&BeginInfo);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to begin recording compute command buffer","vkBeginCommandBuffer",
+                                                                                           Result);
+        StatusOK = false;
+    } else {
+        
+        //  If dispatch timing is enabled, the timestamp queries are reset and the first
+        //  timestamp written. See EnableDispatchTiming().
+        
+        bool Timing = (I_DispatchQueryPoolHndl != VK_NULL_HANDLE);
+        if (Timing) {
+            vkCmdResetQueryPool(CommandBufferHndl,I_DispatchQueryPoolHndl,0,4);
+            vkCmdWriteTimestamp(CommandBufferHndl,VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                                                  I_DispatchQueryPoolHndl,0);
+        }
+        
+        //  Similarly, if pipeline statistics are enabled, the query that counts the shader
+        //  invocations is reset, ready to be begun just before the dispatches.
+        
+        bool Counting = (I_StatisticsQueryPoolHndl != VK_NULL_HANDLE);
+        if (Counting) vkCmdResetQueryPool(CommandBufferHndl,I_StatisticsQueryPoolHndl,0,1);
+        
+        //  Any copies needed to bring the GPU side of staged input buffers into step with the
+        //  CPU side, followed by a barrier so the shader doesn't start reading until they're done.
+        
+        bool Copied = false;
+        for (KVBufferHandle BufferHndl : SyncBefore) {
+            int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+            if (!AllOK(StatusOK)) break;
+            if (RecordSyncCopy(Index,CommandBufferHndl)) Copied = true;
+        }
+        if (Copied) {
+            RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+        if (Timing) {
+            vkCmdWriteTimestamp(CommandBufferHndl,VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                                  I_DispatchQueryPoolHndl,1);
+        }
+
+        //  Note that the next few calls don't return a status, so we can't test to see
+        //  if anything went wrong. The best we can do is use AllOK() to see if the validation
+        //  layers reported an error.
+        
+        if (Counting) vkCmdBeginQuery(CommandBufferHndl,I_StatisticsQueryPoolHndl,0,0);
+        VkPipeline BoundPipelineHndl = VK_NULL_HANDLE;
+        for (size_t Index = 0; Index < Dispatches.size(); Index++) {
+            const KVDispatch& Dispatch = Dispatches[Index];
+            
+            //  Each dispatch after the first has to wait until the writes made by the
+            //  previous one are complete and visible.
+            
+            if (Index > 0) {
+                RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_SHADER_WRITE_BIT,VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            }
+            if (Dispatch.PipelineHndl != BoundPipelineHndl) {
+                vkCmdBindPipeline(CommandBufferHndl,VK_PIPELINE_BIND_POINT_COMPUTE,
+                                                                         Dispatch.PipelineHndl);
+                BoundPipelineHndl = Dispatch.PipelineHndl;
+            }
+            
+            vkCmdBindDescriptorSets(CommandBufferHndl,VK_PIPELINE_BIND_POINT_COMPUTE,
+                        Dispatch.PipelineLayoutHndl,0,1,&Dispatch.DescriptorSetHndl,0,nullptr);
+        
+            if (Dispatch.PushConstants && Dispatch.PushConstantSize > 0) {
+                vkCmdPushConstants(CommandBufferHndl,Dispatch.PipelineLayoutHndl,
+                            VK_SHADER_STAGE_COMPUTE_BIT,0,Dispatch.PushConstantSize,
+                                                                       Dispatch.PushConstants);
+            }
+        
+            //  This adds the 'dispatch' stage to the compute pipeline, and will start it
+            //  running the compute shader when the command buffer is finally submitted for
+            //  execution. It needs to be told the number of the work groups (in 3D) that
+            //  will be run. The total number of threads run will be the number of work groups
+            //  specified here multiplied by the local size of the work groups as set up in
+            //  the shader code. (Note that this is different to the scheme used by Metal,
+            //  where both sizes are set - in a slightly different way - in the CPU code. As
+            //  far as I can see, there is no way in Vulkan for the CPU code to reliably find
+            //  out the local sizes set in the shader code - they may be the same as the
+            //  subgroup size but that can't be relied on.)
+                
+            vkCmdDispatch(CommandBufferHndl,Dispatch.WorkGroupCounts[0],
+                                    Dispatch.WorkGroupCounts[1],Dispatch.WorkGroupCounts[2]);
+        }
+        if (Counting) vkCmdEndQuery(CommandBufferHndl,I_StatisticsQueryPoolHndl,0);
+        if (Timing) {
+            vkCmdWriteTimestamp(CommandBufferHndl,VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                                  I_DispatchQueryPoolHndl,2);
+        }
+        
+        //  And any copies needed to bring the CPU side of staged output buffers into step with
+        //  the results, with barriers so the copies wait for the shader to finish writing, and
+        //  so the copied data is visible to the CPU.
+        
+        bool NeedCopies = false;
+        for (KVBufferHandle BufferHndl : SyncAfter) {
+            int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+            if (!AllOK(StatusOK)) break;
+            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+                I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) NeedCopies = true;
+        }
+        if (!NeedCopies && AllOK(StatusOK)) {
+            
+            //  With no copies, the CPU reads what the shader wrote directly, and the writes
+            //  still have to be made visible to it.
+            
+            RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_SHADER_WRITE_BIT,VK_PIPELINE_STAGE_HOST_BIT,VK_ACCESS_HOST_READ_BIT);
+        }
+        if (NeedCopies && AllOK(StatusOK)) {
+            RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,VK_PIPELINE_STAGE_TRANSFER_BIT,VK_ACCESS_TRANSFER_READ_BIT);
+            for (KVBufferHandle BufferHndl : SyncAfter) {
+                RecordSyncCopy(BufferIndexFromHandle(BufferHndl,StatusOK),CommandBufferHndl);
+            }
+            RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,VK_PIPELINE_STAGE_HOST_BIT,VK_ACCESS_HOST_READ_BIT);
+        }
+        if (Timing) {
+            vkCmdWriteTimestamp(CommandBufferHndl,VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                                  I_DispatchQueryPoolHndl,3);
+        }
+        
+        //  Now finish off the command buffer.
+        
+        Result = vkEndCommandBuffer(CommandBufferHndl);
+        if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
+            LogVulkanError ("Failed to complete Vulkan command buffer","vkEndCommandBuffer",Result);
+            StatusOK = false;
+        }
+    }
+    
+    //  For a reusable command buffer, keep a note of what was recorded.
+    
+    if (RecordingIndex >= 0 && AllOK(StatusOK)) {
+        NoteRecording(RecordingIndex,Dispatches,SyncBefore,SyncAfter);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     S e t  C o m m a n d  B u f f e r  R e u s a b l e
+//
+//  Normally, RecordComputeCommandBuffer() and RecordComputeBatch() record a command buffer
+//  from scratch each time they are called, even if the pipeline, descriptor set and workgroup
+//  counts are just the same as last time. In a loop that runs the same computation over and
+//  over again, this recording cost is wasted. Once a command buffer has been marked as
+//  reusable, the Framework remembers the details it was last recorded with, and these routines
+//  only record it again if these change. Otherwise, the existing recording is simply
+//  resubmitted by RunCommandBuffer() or SubmitCommandBuffer().
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                   either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     Reusable      (bool) True if the command buffer can be reused, false to go back to having
+//                   it recorded afresh each time.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Note:
+//     o The details compared include the contents of any push constants, so changing these
+//     forces the command buffer to be recorded again.
+//     o Any change the Framework knows would leave a recording out of date - creating, resizing
+//     or deleting a buffer, updating a descriptor set through SetupVulkanDescriptorSet(),
+//     destroying a pipeline, or enabling or disabling dispatch timing - forces all reusable
+//     command buffers to be recorded again the next time they are used. If the calling code
+//     changes anything else the recording depends on, it should call InvalidateRecordings().
+//     o A reusable command buffer must not be resubmitted until the previous execution of it
+//     has completed.
+
+void KVVulkanFramework::SetCommandBufferReusable(
+                           VkCommandBuffer CommandBufferHndl,bool Reusable,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    int Index = RecordingIndexFor(CommandBufferHndl);
+    if (Reusable && Index < 0) {
+        T_RecordingDetails Details;
+        Details.CommandBufferHndl = CommandBufferHndl;
+        Details.Recorded = false;
+        Details.Generation = 0;
+        I_RecordingDetails.push_back(Details);
+    } else if (!Reusable && Index >= 0) {
+        I_RecordingDetails.erase(I_RecordingDetails.begin() + Index);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          I n v a l i d a t e  R e c o r d i n g s
+//
+//  Forces all the command buffers marked as reusable by SetCommandBufferReusable() to be
+//  recorded again the next time RecordComputeCommandBuffer() or RecordComputeBatch() is called
+//  for them. The Framework does this itself for the changes it knows about, but a program that
+//  changes something else a recording depends on - for example by updating a descriptor set
+//  directly - should call this.
+
+void KVVulkanFramework::InvalidateRecordings(void)
+{
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    I_RecordingGeneration++;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     R e c o r d i n g  I n d e x  F o r   (Internal routine)
+//
+//  Returns the index in I_RecordingDetails of the entry for a reusable command buffer, or -1
+//  if the command buffer has not been marked as reusable.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer.
+//  Returns:
+//     (int)         The index into I_RecordingDetails, or -1.
+
+int KVVulkanFramework::RecordingIndexFor(VkCommandBuffer CommandBufferHndl)
+{
+    int Index = -1;
+    for (size_t I = 0; I < I_RecordingDetails.size(); I++) {
+        if (I_RecordingDetails[I].CommandBufferHndl == CommandBufferHndl) {
+            Index = int(I);
+            break;
+        }
+    }
+    return Index;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     R e c o r d i n g  U n c h a n g e d   (Internal routine)
+//
+//  Returns true if a reusable command buffer is already recorded with a given set of
+//  dispatches and buffer syncs, and nothing has happened since that would invalidate that
+//  recording.
+//
+//  Parameters:
+//     Index         (int) The index in I_RecordingDetails for the command buffer.
+//     Dispatches    (const std::vector<KVDispatch>&) The dispatches to be recorded.
+//     SyncBefore    (const std::vector<KVBufferHandle>&) Buffers to be synched beforehand.
+//     SyncAfter     (const std::vector<KVBufferHandle>&) Buffers to be synched afterwards.
+//  Returns:
+//     (bool)        True if the existing recording can be reused as it is.
+
+bool KVVulkanFramework::RecordingUnchanged(int Index,const std::vector<KVDispatch>& Dispatches,
+        const std::vector<KVBufferHandle>& SyncBefore,const std::vector<KVBufferHandle>& SyncAfter)
+{
+    const T_RecordingDetails& Details = I_RecordingDetails[Index];
+    if (!Details.Recorded) return false;
+    if (Details.Generation != I_RecordingGeneration) return false;
+    if (Details.SyncBefore != SyncBefore || Details.SyncAfter != SyncAfter) return false;
+    if (Details.Dispatches.size() != Dispatches.size()) return false;
+    for (size_t I = 0; I < Dispatches.size(); I++) {
+        const KVDispatch& Old = Details.Dispatches[I];
+        const KVDispatch& New = Dispatches[I];
+        if (Old.PipelineHndl != New.PipelineHndl) return false;
+        if (Old.PipelineLayoutHndl != New.PipelineLayoutHndl) return false;
+        if (Old.DescriptorSetHndl != New.DescriptorSetHndl) return false;
+        for (int J = 0; J < 3; J++) {
+            if (Old.WorkGroupCounts[J] != New.WorkGroupCounts[J]) return false;
+        }
+        uint32_t NewSize = New.PushConstants ? New.PushConstantSize : 0;
+        if (Details.PushData[I].size() != NewSize) return false;
+        if (NewSize > 0 && memcmp(Details.PushData[I].data(),New.PushConstants,NewSize) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          N o t e  R e c o r d i n g   (Internal routine)
+//
+//  Records the details used to record a reusable command buffer, so RecordingUnchanged() can
+//  tell if it needs to be recorded again. The push constant data is copied, as the caller's
+//  copy may change.
+//
+//  Parameters:
+//     Index         (int) The index in I_RecordingDetails for the command buffer.
+//     Dispatches    (const std::vector<KVDispatch>&) The dispatches that were recorded.
+//     SyncBefore    (const std::vector<KVBufferHandle>&) Buffers synched beforehand.
+//     SyncAfter     (const std::vector<KVBufferHandle>&) Buffers synched afterwards.
+
+void KVVulkanFramework::NoteRecording(int Index,const std::vector<KVDispatch>& Dispatches,
+        const std::vector<KVBufferHandle>& SyncBefore,const std::vector<KVBufferHandle>& SyncAfter)
+{
+    T_RecordingDetails& Details = I_RecordingDetails[Index];
+    Details.Dispatches = Dispatches;
+    Details.SyncBefore = SyncBefore;
+    Details.SyncAfter = SyncAfter;
+    Details.PushData.resize(Dispatches.size());
+    for (size_t I = 0; I < Dispatches.size(); I++) {
+        const uint8_t* Data = static_cast<const uint8_t*>(Dispatches[I].PushConstants);
+        uint32_t Size = Data ? Dispatches[I].PushConstantSize : 0;
+        Details.PushData[I].assign(Data,Data + Size);
+        Details.Dispatches[I].PushConstants = nullptr;
+    }
+    Details.Generation = I_RecordingGeneration;
+    Details.Recorded = true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          E n a b l e  D i s p a t c h  T i m i n g
+//
+//  Timing a computation on the CPU, for example by timing a call to RunCommandBuffer(), measures
+//  the overheads of submitting the command buffer and waiting for its fence as well as the time
+//  actually spent on the GPU. Once this routine has been called, RecordComputeCommandBuffer()
+//  also records GPU timestamps at the start of the command buffer, after any buffer syncs that
+//  precede the computation, after the computation itself, and at the end of the command buffer.
+//  Once the command buffer has been run, GetDispatchTimes() returns the GPU execution times
+//  for each of these sections.
+//
+//  Parameters:
+//     Enable        (bool) True to enable dispatch timing, false to disable it.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called. Any command buffer to be timed must be
+//     recorded after this is called.
+//
+//  Note:
+//     If the device or its queue family doesn't support timestamps, a warning is logged and
+//     dispatch timing remains disabled. This isn't treated as an error.
+
+void KVVulkanFramework::EnableDispatchTiming(bool Enable,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
+    
+    if (!Enable) {
+        if (I_DispatchQueryPoolHndl != VK_NULL_HANDLE) {
+            vkDeviceWaitIdle(I_LogicalDevice);
+            vkDestroyQueryPool(I_LogicalDevice,I_DispatchQueryPoolHndl,nullptr);
+            I_DispatchQueryPoolHndl = VK_NULL_HANDLE;
+        }
+    } else if (I_DispatchQueryPoolHndl == VK_NULL_HANDLE) {
+        VkQueryPool PoolHndl = CreateTimestampQueryPool(4,StatusOK);
+        if (AllOK(StatusOK)) I_DispatchQueryPoolHndl = PoolHndl;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G e t  D i s p a t c h  T i m e s
+//
+//  Once a command buffer recorded by RecordComputeCommandBuffer() with dispatch timing enabled
+//  has been run, this returns the GPU execution times measured by the timestamps it recorded.
+//
+//  Parameters:
+//     SyncBeforeMsec (float*) Receives the time in milliseconds taken by any buffer syncs that
+//                   preceded the computation. May be nullptr if not needed.
+//     DispatchMsec  (float*) Receives the time in milliseconds taken by the computation itself.
+//     SyncAfterMsec (float*) Receives the time in milliseconds taken by any buffer syncs that
+//                   followed the computation. May be nullptr if not needed.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (bool)        True if the times were available, false if dispatch timing isn't enabled.
+//
+//  Pre-requisites:
+//     EnableDispatchTiming() must have been called before the command buffer was recorded, and
+//     the command buffer must have completed, for example through RunCommandBuffer().
+
+bool KVVulkanFramework::GetDispatchTimes(
+                float* SyncBeforeMsec,float* DispatchMsec,float* SyncAfterMsec,bool& StatusOK)
+{
+    if (SyncBeforeMsec) *SyncBeforeMsec = 0.0;
+    if (DispatchMsec) *DispatchMsec = 0.0;
+    if (SyncAfterMsec) *SyncAfterMsec = 0.0;
+    if (!AllOK(StatusOK)) return false;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    if (I_DispatchQueryPoolHndl == VK_NULL_HANDLE) return false;
+    
+    uint64_t Ticks[4];
+    ReadTimestamps(I_DispatchQueryPoolHndl,0,4,Ticks,StatusOK);
+    if (!AllOK(StatusOK)) return false;
+    if (SyncBeforeMsec) *SyncBeforeMsec = TicksToMsec(Ticks[0],Ticks[1]);
+    if (DispatchMsec) *DispatchMsec = TicksToMsec(Ticks[1],Ticks[2]);
+    if (SyncAfterMsec) *SyncAfterMsec = TicksToMsec(Ticks[2],Ticks[3]);
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     E n a b l e  P i p e l i n e  S t a t i s t i c s
+//
+//  A dispatch runs whole workgroups, so unless the problem dimensions are multiples of the
+//  workgroup dimensions, some invocations - the padding past the edges of the problem - do
+//  nothing but test their position and return. Once this routine has been called,
+//  RecordComputeBatch() (and so RecordComputeCommandBuffer()) also records a pipeline
+//  statistics query around the dispatches, and once the command buffer has been run,
+//  GetDispatchInvocations() returns the number of compute shader invocations it actually
+//  ran, which a program can compare with the number it needed.
+//
+//  Parameters:
+//     Enable        (bool) True to enable the counting, false to disable it.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called. Any command buffer to be counted must be
+//     recorded after this is called.
+//
+//  Note:
+//     If the device doesn't support pipeline statistics queries (see
+//     PipelineStatisticsSupported()), a warning is logged and the counting remains disabled.
+//     This isn't treated as an error.
+
+void KVVulkanFramework::EnablePipelineStatistics(bool Enable,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    //  Any reusable command buffers will need re-recording. See SetCommandBufferReusable().
+    
+    I_RecordingGeneration++;
+    
+    if (!Enable) {
+        if (I_StatisticsQueryPoolHndl != VK_NULL_HANDLE) {
+            vkDeviceWaitIdle(I_LogicalDevice);
+            vkDestroyQueryPool(I_LogicalDevice,I_StatisticsQueryPoolHndl,nullptr);
+            I_StatisticsQueryPoolHndl = VK_NULL_HANDLE;
+        }
+    } else if (I_StatisticsQueryPoolHndl == VK_NULL_HANDLE) {
+        if (!I_StatisticsSupported) {
+            LogWarning("Pipeline statistics queries are not supported by this device.");
+        } else {
+            VkQueryPoolCreateInfo PoolInfo{};
+            PoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            PoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            PoolInfo.queryCount = 1;
+            PoolInfo.pipelineStatistics =
+                                     VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+            VkResult Result = vkCreateQueryPool(I_LogicalDevice,&PoolInfo,nullptr,
+                                                                   &I_StatisticsQueryPoolHndl);
+            if (Result != VK_SUCCESS) {
+                LogVulkanError("Failed to create pipeline statistics query pool",
+                                                                   "vkCreateQueryPool",Result);
+                I_StatisticsQueryPoolHndl = VK_NULL_HANDLE;
+                StatusOK = false;
+            }
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        G e t  D i s p a t c h  I n v o c a t i o n s
+//
+//  Once a command buffer recorded by RecordComputeBatch() with pipeline statistics enabled has
+//  been run, this returns the number of compute shader invocations it ran, counting every
+//  invocation of every workgroup of every dispatch in the command buffer.
+//
+//  Parameters:
+//     Invocations   (uint64_t*) Receives the number of compute shader invocations.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (bool)        True if the count was available, false if pipeline statistics aren't
+//                   enabled.
+//
+//  Pre-requisites:
+//     EnablePipelineStatistics() must have been called before the command buffer was recorded,
+//     and the command buffer must have completed, for example through RunCommandBuffer().
+
+bool KVVulkanFramework::GetDispatchInvocations(uint64_t* Invocations,bool& StatusOK)
+{
+    *Invocations = 0;
+    if (!AllOK(StatusOK)) return false;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    if (I_StatisticsQueryPoolHndl == VK_NULL_HANDLE) return false;
+    
+    VkResult Result = vkGetQueryPoolResults(I_LogicalDevice,I_StatisticsQueryPoolHndl,0,1,
+                 sizeof(uint64_t),Invocations,sizeof(uint64_t),
+                                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError("Failed to read pipeline statistics","vkGetQueryPoolResults",Result);
+        StatusOK = false;
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                      C r e a t e  T i m e s t a m p  Q u e r i e s
+//
+//  For programs that record their own command buffers, or want to time sections of a command
+//  buffer other than those timed by EnableDispatchTiming(), the Framework can manage a pool of
+//  timestamp queries. This routine creates that pool, with a specified number of queries.
+//  A command buffer should reset the queries it uses with ResetTimestamps(), and can then
+//  record timestamps at any point using WriteTimestamp(). Once the command buffer has completed,
+//  GetTimestampMsec() returns the GPU time between any two of the timestamps.
+//
+//  Parameters:
+//     Count         (uint32_t) The number of timestamp queries needed.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called.
+//
+//  Note:
+//     If this is called again, the previous pool is released. If the device doesn't support
+//     timestamps, a warning is logged, no pool is created, and the other timestamp routines do
+//     nothing - GetTimestampMsec() returns zero.
+
+void KVVulkanFramework::CreateTimestampQueries(uint32_t Count,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    if (I_TimestampQueryPoolHndl != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(I_LogicalDevice);
+        vkDestroyQueryPool(I_LogicalDevice,I_TimestampQueryPoolHndl,nullptr);
+        I_TimestampQueryPoolHndl = VK_NULL_HANDLE;
+        I_TimestampQueryCount = 0;
+    }
+    VkQueryPool PoolHndl = CreateTimestampQueryPool(Count,StatusOK);
+    if (AllOK(StatusOK) && PoolHndl != VK_NULL_HANDLE) {
+        I_TimestampQueryPoolHndl = PoolHndl;
+        I_TimestampQueryCount = Count;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             R e s e t  T i m e s t a m p s
+//
+//  Records into a command buffer the reset of all the timestamp queries created by
+//  CreateTimestampQueries(). Queries have to be reset before they can be written again, and
+//  this must be recorded before any WriteTimestamp() calls in the same command buffer.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) A command buffer in the recording state.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateTimestampQueries() must have been called. This must not be called inside a
+//     render pass.
+
+void KVVulkanFramework::ResetTimestamps(VkCommandBuffer CommandBufferHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    if (I_TimestampQueryPoolHndl != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(CommandBufferHndl,I_TimestampQueryPoolHndl,0,I_TimestampQueryCount);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             W r i t e  T i m e s t a m p
+//
+//  Records into a command buffer the writing of a GPU timestamp into one of the queries created
+//  by CreateTimestampQueries(). The timestamp is written once all the commands previously
+//  recorded in the command buffer have completed.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) A command buffer in the recording state.
+//     Index         (uint32_t) The index of the query to write, from 0 up to one less than the
+//                   number of queries created.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateTimestampQueries() must have been called, and ResetTimestamps() recorded in the
+//     same command buffer.
+
+void KVVulkanFramework::WriteTimestamp(VkCommandBuffer CommandBufferHndl,uint32_t Index,
+                                                                              bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    if (I_TimestampQueryPoolHndl != VK_NULL_HANDLE) {
+        if (Index >= I_TimestampQueryCount) {
+            LogError("Timestamp index %u is invalid, only %u queries created.",Index,
+                                                                       I_TimestampQueryCount);
+            StatusOK = false;
+        } else {
+            vkCmdWriteTimestamp(CommandBufferHndl,VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                              I_TimestampQueryPoolHndl,Index);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G e t  T i m e s t a m p  M s e c
+//
+//  Returns the GPU time in milliseconds between two of the timestamps written using
+//  WriteTimestamp(). This waits for the timestamps to be available, so should only be called
+//  once the command buffer that wrote them has been submitted.
+//
+//  Parameters:
+//     StartIndex    (uint32_t) The index of the earlier timestamp.
+//     EndIndex      (uint32_t) The index of the later timestamp.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (float)       The time between the two timestamps in milliseconds, or zero if timestamps
+//                   are not supported.
+
+float KVVulkanFramework::GetTimestampMsec(uint32_t StartIndex,uint32_t EndIndex,bool& StatusOK)
+{
+    float Msec = 0.0;
+    if (!AllOK(StatusOK)) return Msec;
+    if (I_TimestampQueryPoolHndl != VK_NULL_HANDLE) {
+        if (StartIndex >= I_TimestampQueryCount || EndIndex >= I_TimestampQueryCount) {
+            LogError("Timestamp indices %u, %u invalid, only %u queries created.",
+                                                   StartIndex,EndIndex,I_TimestampQueryCount);
+            StatusOK = false;
+        } else {
+            uint64_t StartTicks,EndTicks;
+            ReadTimestamps(I_TimestampQueryPoolHndl,StartIndex,1,&StartTicks,StatusOK);
+            ReadTimestamps(I_TimestampQueryPoolHndl,EndIndex,1,&EndTicks,StatusOK);
+            if (AllOK(StatusOK)) Msec = TicksToMsec(StartTicks,EndTicks);
+        }
+    }
+    return Msec;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//             C r e a t e  T i m e s t a m p  Q u e r y  P o o l   (Internal routine)
+//
+//  Creates a Vulkan query pool for a given number of timestamp queries, first checking that the
+//  device supports timestamps on the main queue family, and noting the timestamp period and the
+//  number of valid bits, which are needed to convert the timestamps into times.
+//
+//  Parameters:
+//     Count         (uint32_t) The number of queries.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (VkQueryPool) The Vulkan handle for the pool, or VK_NULL_HANDLE if timestamps are not
+//                   supported (which is only reported as a warning).
+
+VkQueryPool KVVulkanFramework::CreateTimestampQueryPool(uint32_t Count,bool& StatusOK)
+{
+    VkQueryPool PoolHndl = VK_NULL_HANDLE;
+    if (!AllOK(StatusOK)) return PoolHndl;
+    
+    VkPhysicalDeviceProperties DeviceProperties;
+    vkGetPhysicalDeviceProperties(I_SelectedDevice,&DeviceProperties);
+    uint32_t NumberFamilies;
+    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,nullptr);
+    std::vector<VkQueueFamilyProperties> QueueFamilies(NumberFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,QueueFamilies.data());
+    I_TimestampValidBits = QueueFamilies[I_QueueFamilyIndex].timestampValidBits;
+    I_TimestampPeriod = DeviceProperties.limits.timestampPeriod;
+    
+    if (I_TimestampValidBits == 0 || I_TimestampPeriod <= 0.0) {
+        LogWarning("GPU timestamps are not supported by this device.");
+    } else {
+        VkQueryPoolCreateInfo PoolInfo{};
+        PoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        PoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        PoolInfo.queryCount = Count;
+        VkResult Result = vkCreateQueryPool(I_LogicalDevice,&PoolInfo,nullptr,&PoolHndl);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError("Failed to create timestamp query pool","vkCreateQueryPool",Result);
+            PoolHndl = VK_NULL_HANDLE;
+            StatusOK = false;
+        } else {
+            I_Debug.Logf("Device","Timestamp query pool created, %u queries, period %.3f nsec",
+                                                                    Count,I_TimestampPeriod);
+        }
+    }
+    return PoolHndl;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       R e a d  T i m e s t a m p s   (Internal routine)
+//
+//  Reads the values of a number of consecutive timestamp queries, waiting for them to become
+//  available if necessary.
+//
+//  Parameters:
+//     PoolHndl      (VkQueryPool) The query pool.
+//     First         (uint32_t) The index of the first query to read.
+//     Count         (uint32_t) The number of queries to read.
+//     Ticks         (uint64_t*) Receives the timestamp values, in device ticks.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+
+void KVVulkanFramework::ReadTimestamps(VkQueryPool PoolHndl,uint32_t First,uint32_t Count,
+                                                                uint64_t* Ticks,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    VkResult Result = vkGetQueryPoolResults(I_LogicalDevice,PoolHndl,First,Count,
+                 Count * sizeof(uint64_t),Ticks,sizeof(uint64_t),
+                                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError("Failed to read timestamps","vkGetQueryPoolResults",Result);
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         T i c k s  T o  M s e c   (Internal routine)
+//
+//  Converts the difference between two timestamps into milliseconds, allowing for the number
+//  of valid bits in the timestamps (the counter may wrap round) and the timestamp period.
+//
+//  Parameters:
+//     StartTicks    (uint64_t) The earlier timestamp.
+//     EndTicks      (uint64_t) The later timestamp.
+//  Returns:
+//     (float)       The time between the two, in milliseconds.
+
+float KVVulkanFramework::TicksToMsec(uint64_t StartTicks,uint64_t EndTicks)
+{
+    uint64_t Mask = ~uint64_t(0);
+    if (I_TimestampValidBits < 64) Mask = (uint64_t(1) << I_TimestampValidBits) - 1;
+    uint64_t Ticks = (EndTicks - StartTicks) & Mask;
+    return float(double(Ticks) * I_TimestampPeriod * 1.0e-6);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G e t  D e v i c e  Q u e u e
+//
+//  This returns a queue that can be used to submit a command buffer to the GPU for processing.
+//
+//  Parameters:
+//     QueueHndlPtr    (VkQueue*) Receives the Vulkan handle for the queue.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+
+void KVVulkanFramework::GetDeviceQueue(VkQueue* QueueHndlPtr,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    //  I_LogicalDevice and I_QueueFamilyIndex will have been set by CreateLogicalDevice().
+
+    vkGetDeviceQueue(I_LogicalDevice,I_QueueFamilyIndex,0,QueueHndlPtr);
+    
+    //  vkGetDeviceQueue() returns void, with no error indications. If validation layers are
+    //  on they may catch an error, but otherwise the best bet seems to be test the returned
+    //  queue handle.
+    
+    if (QueueHndlPtr == nullptr || *QueueHndlPtr == VK_NULL_HANDLE) {
+        LogError("Failed to get device queue. vkGetDeviceQueue returns null handle.");
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 G e t  D e v i c e  Q u e u e   (for a given queue type)
+//
+//  This returns a queue of a specified type. "GRAPHICS" is the main queue, the one returned by
+//  the simpler version of GetDeviceQueue(); this supports compute, and graphics if that has
+//  been enabled. "COMPUTE" and "TRANSFER" return the separate compute and transfer queues set
+//  up if EnableSeparateQueues() was called before the logical device was created. If they were
+//  not requested, or the device could not provide them, these are the main queue.
+//
+//  Parameters:
+//     QueueType       (const std::string&) The type of queue - "GRAPHICS", "COMPUTE" or
+//                     "TRANSFER".
+//     QueueHndlPtr    (VkQueue*) Receives the Vulkan handle for the queue.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//
+//  Note:
+//     Command buffers submitted to a queue must come from a pool created for the same type of
+//     queue, using the corresponding version of CreateCommandPool().
+
+void KVVulkanFramework::GetDeviceQueue(
+                          const std::string& QueueType,VkQueue* QueueHndlPtr,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    KVQueueType Type = QueueTypeFromString(QueueType,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    uint32_t QueueIndex = 0;
+    if (Type == QUEUE_COMPUTE) QueueIndex = I_ComputeQueueIndex;
+    if (Type == QUEUE_TRANSFER) QueueIndex = I_TransferQueueIndex;
+    vkGetDeviceQueue(I_LogicalDevice,QueueFamilyForType(Type),QueueIndex,QueueHndlPtr);
+    
+    if (QueueHndlPtr == nullptr || *QueueHndlPtr == VK_NULL_HANDLE) {
+        LogError("Failed to get %s device queue. vkGetDeviceQueue returns null handle.",
+                                                                            QueueType.c_str());
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       G e t  C o m p u t e  Q u e u e  C o u n t
+//
+//  Returns the number of compute queues set up when the logical device was created. This is
+//  the number requested by SetComputeQueueCount(), unless the compute family had fewer queues
+//  available, and is always at least 1 once the device exists.
+//
+//  Returns:
+//     (int)           The number of compute queues, which GetComputeQueue() numbers from 0.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called, since that is when the queues are chosen.
+
+int KVVulkanFramework::GetComputeQueueCount(void)
+{
+    return int(I_ComputeQueueIndices.size());
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G e t  C o m p u t e  Q u e u e
+//
+//  This returns one of the compute queues set up because of a call to SetComputeQueueCount().
+//  Queue 0 is the same as the "COMPUTE" queue returned by GetDeviceQueue().
+//
+//  Parameters:
+//     Index           (int) The number of the queue, from 0 up to GetComputeQueueCount() - 1.
+//     QueueHndlPtr    (VkQueue*) Receives the Vulkan handle for the queue.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//
+//  Note:
+//     Command buffers submitted to any of these queues come from a "COMPUTE" command pool.
+
+void KVVulkanFramework::GetComputeQueue(int Index,VkQueue* QueueHndlPtr,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    if (Index < 0 || Index >= int(I_ComputeQueueIndices.size())) {
+        LogError("Compute queue %d requested, but only %d are available.",Index,
+                                                             int(I_ComputeQueueIndices.size()));
+        StatusOK = false;
+        return;
+    }
+    vkGetDeviceQueue(I_LogicalDevice,I_ComputeQueueFamilyIndex,I_ComputeQueueIndices[Index],
+                                                                                 QueueHndlPtr);
+    if (QueueHndlPtr == nullptr || *QueueHndlPtr == VK_NULL_HANDLE) {
+        LogError("Failed to get compute queue %d. vkGetDeviceQueue returns null handle.",Index);
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           Q u e u e s  S h a r e  F a m i l y
+//
+//  This returns true if two types of queue, as returned by the version of GetDeviceQueue() that
+//  takes a queue type, come from the same queue family. If they do, a buffer can be used by one
+//  and then the other, ordered by semaphores, without its ownership having to be passed between
+//  them. That matters for staged buffers in particular, since the copies SyncBuffer() and
+//  SubmitSyncBuffer() make are recorded by the Framework, and can't include the ownership
+//  barriers - so they can only be run on a queue that shares the family of the queue that uses
+//  the buffer.
+//
+//  Parameters:
+//     FirstType       (const std::string&) The type of the first queue - "GRAPHICS", "COMPUTE"
+//                     or "TRANSFER".
+//     SecondType      (const std::string&) The type of the second queue.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (bool)          True if the two queues are from the same family.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called, since that is when the families are chosen.
+
+bool KVVulkanFramework::QueuesShareFamily(
+             const std::string& FirstType,const std::string& SecondType,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return false;
+    
+    KVQueueType First = QueueTypeFromString(FirstType,StatusOK);
+    KVQueueType Second = QueueTypeFromString(SecondType,StatusOK);
+    if (!AllOK(StatusOK)) return false;
+    
+    return QueueFamilyForType(First) == QueueFamilyForType(Second);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       R e l e a s e  B u f f e r  O w n e r s h i p
+//
+//  Vulkan buffers are created for exclusive use by one queue family at a time. If a buffer is
+//  written by one queue and then used by a queue from a different family - for example, if
+//  input data is uploaded using a dedicated transfer queue and then used by a shader running
+//  on the main queue - ownership of the buffer has to be explicitly passed from one family to
+//  the other. This takes two matching barriers, a 'release' recorded in a command buffer run
+//  on the source queue, and an 'acquire' recorded in a command buffer run on the destination
+//  queue. This routine records the release. If the two queue types use the same family, no
+//  transfer is needed and this does nothing.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) A command buffer, in the recording state, that will
+//                     be submitted to the source queue after the buffer has been used by it.
+//     BufferHndl      (KVBufferHandle) The Framework handle for the buffer.
+//     SrcQueueType    (const std::string&) The type of queue - "GRAPHICS", "COMPUTE" or
+//                     "TRANSFER" - that currently owns the buffer.
+//     DstQueueType    (const std::string&) The type of queue that is to acquire it.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//     The buffer must have been created using CreateBuffer().
+//
+//  Note:
+//     The submission containing the acquire must not start until the one containing the
+//     release has completed, so it should wait on a semaphore signalled by it. See the version
+//     of SubmitCommandBuffer() that takes semaphores. For staged buffers, the barrier applies
+//     to the GPU side of the buffer, the one used by shaders.
+
+void KVVulkanFramework::ReleaseBufferOwnership(VkCommandBuffer CommandBufferHndl,
+      KVBufferHandle BufferHndl,const std::string& SrcQueueType,const std::string& DstQueueType,
+                                                                                bool& StatusOK)
+{
+    RecordOwnershipBarrier(CommandBufferHndl,BufferHndl,SrcQueueType,DstQueueType,true,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       A c q u i r e  B u f f e r  O w n e r s h i p
+//
+//  This records the 'acquire' half of a queue family ownership transfer for a buffer, matching
+//  a 'release' recorded by ReleaseBufferOwnership(), which has details. If the two queue types
+//  use the same family, no transfer is needed and this does nothing.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) A command buffer, in the recording state, that will
+//                     be submitted to the destination queue before the buffer is used by it.
+//     BufferHndl      (KVBufferHandle) The Framework handle for the buffer.
+//     SrcQueueType    (const std::string&) The type of queue - "GRAPHICS", "COMPUTE" or
+//                     "TRANSFER" - that released the buffer.
+//     DstQueueType    (const std::string&) The type of queue that is acquiring it.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//     The buffer must have been created using CreateBuffer().
+
+void KVVulkanFramework::AcquireBufferOwnership(VkCommandBuffer CommandBufferHndl,
+      KVBufferHandle BufferHndl,const std::string& SrcQueueType,const std::string& DstQueueType,
+                                                                                bool& StatusOK)
+{
+    RecordOwnershipBarrier(CommandBufferHndl,BufferHndl,SrcQueueType,DstQueueType,false,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          S e t  B u f f e r  C o n c u r r e n t
+//
+//  Normally a buffer belongs to one queue family at a time, and if it is used by queues from two
+//  different families, ownership has to be passed between them using ReleaseBufferOwnership()
+//  and AcquireBufferOwnership(). For a buffer that goes back and forth every frame - eg one
+//  written by a compute queue and read by the graphics queue - that can be more trouble than
+//  it's worth. This routine has the buffer created instead for concurrent use by all the queue
+//  families in use, so no ownership transfers are needed, at the cost of some possible loss of
+//  performance on some GPUs. The queues still have to be synchronised by semaphores. If only one
+//  queue family is in use this makes no difference.
+//
+//  Parameters:
+//     BufferHndl    (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     The buffer must have been set up by SetBufferDetails(), but not yet created by
+//     CreateBuffer(). CreateLogicalDevice() must have been called, with separate queues
+//     enabled by EnableSeparateQueues() if they are to be used.
+//
+//  Note:
+//     This is only supported for buffers with a single Vulkan buffer - not for staged buffers,
+//     nor for "SPARSE" or "IMPORTED" buffers, which are created differently.
+
+void KVVulkanFramework::SetBufferConcurrent(KVBufferHandle BufferHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (I_BufferDetails[Index].MainBufferHndl != VK_NULL_HANDLE) {
+            LogError ("SetBufferConcurrent() must be called before the buffer is created");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].BufferAccess == ACCESS_SPARSE ||
+                   I_BufferDetails[Index].BufferAccess == ACCESS_IMPORTED ||
+                   I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+                   I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) {
+            LogError ("SetBufferConcurrent() can't be used for staged, sparse or imported buffers");
+            StatusOK = false;
+        } else {
+            I_BufferDetails[Index].Concurrent = true;
+            I_Debug.Logf ("Buffers","Buffer handle %ld set for concurrent sharing.",
+                                                                             long(BufferHndl));
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       S e t  B u f f e r  H o s t  W r i t e  O n l y
+//
+//  A "SHARED" buffer normally goes into cached host memory, since that's fast for the CPU to
+//  both read and write. But on a discrete GPU that memory is in the host's RAM, and the GPU
+//  reads it over PCIe every time a shader uses it. Many discrete GPUs - all of them, with
+//  resizable BAR - have some memory that is both device-local and host-visible, which is fast
+//  for the GPU to read and for the CPU to write, but usually uncached, so very slow for the CPU
+//  to read. This routine says that the CPU only writes a "SHARED" buffer - an input for the
+//  GPU, say - and never reads it back, so the Framework can put it into that memory, as long as
+//  there's enough of it. If there isn't, the buffer goes into cached host memory as usual.
+//  "SHARED" uniform buffers are treated like this anyway.
+//
+//  Parameters:
+//     BufferHndl    (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     The buffer must have been set up by SetBufferDetails() with an access of "SHARED", but not
+//     yet created by CreateBuffer().
+//
+//  Note:
+//     The heap each buffer ends up in is logged under the "Properties" debug level. Only buffers
+//     up to a quarter of the size of the heap are put there, so the small 256 MByte heap most
+//     GPUs have without resizable BAR is only used for fairly small buffers.
+
+void KVVulkanFramework::SetBufferHostWriteOnly(KVBufferHandle BufferHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (I_BufferDetails[Index].MainBufferHndl != VK_NULL_HANDLE) {
+            LogError ("SetBufferHostWriteOnly() must be called before the buffer is created");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].BufferAccess != ACCESS_SHARED) {
+            LogError ("SetBufferHostWriteOnly() can only be used for \"SHARED\" buffers");
+            StatusOK = false;
+        } else {
+            I_BufferDetails[Index].MainPropertyFlags =
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            I_BufferDetails[Index].MainPreferredFlags =
+                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            I_Debug.Logf ("Buffers","Buffer handle %ld set as written only by the CPU.",
+                                                                             long(BufferHndl));
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        L o g  B u f f e r  M e m o r y  (Internal routine)
+//
+//  This is an internal routine that reports, under the "Properties" debug level, the memory
+//  type and heap that a newly created buffer has been given, and that type's properties. This
+//  is the only way to tell, for example, whether a "SHARED" buffer ended up in device-local
+//  memory or in the host's RAM.
+//
+//  Parameters:
+//     Index         (int) The index into I_BufferDetails for the buffer.
+//     Secondary     (bool) True to report the secondary buffer of a staged buffer, false for
+//                   the main buffer.
+
+void KVVulkanFramework::LogBufferMemory(int Index,bool Secondary)
+{
+    if (!I_Debug.Active("Properties")) return;
+    const T_MemoryAllocation& Allocation = Secondary ?
+                 I_BufferDetails[Index].SecondaryAllocation : I_BufferDetails[Index].MainAllocation;
+    if (Allocation.BlockIndex < 0) return;
+    uint32_t TypeIndex = I_MemoryBlocks[Allocation.BlockIndex].MemoryTypeIndex;
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice,&MemoryProperties);
+    I_Debug.Logf ("Properties","Buffer handle %ld%s, %llu bytes, memory type %u, heap %u, %s",
+                  long(I_BufferDetails[Index].Handle),Secondary ? " (secondary)" : "",
+                  (unsigned long long)Allocation.Size,TypeIndex,
+                  MemoryProperties.memoryTypes[TypeIndex].heapIndex,
+                  MemoryFlagString(MemoryProperties.memoryTypes[TypeIndex].propertyFlags).c_str());
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 R e c o r d  O w n e r s h i p  B a r r i e r  (Internal routine)
+//
+//  This is the internal routine that records the buffer memory barrier used for either half
+//  of a queue family ownership transfer. The source and destination family indices must be the
+//  same in both halves. The release half only needs to make the source queue's writes
+//  available, and the acquire half only needs to make them visible to the destination queue,
+//  so each half only specifies the stage and access flags for its own queue.
+//
+//  Parameters:
+//     CommandBufferHndl (VkCommandBuffer) The command buffer being recorded.
+//     BufferHndl      (KVBufferHandle) The Framework handle for the buffer.
+//     SrcQueueType    (const std::string&) The type of queue giving up ownership.
+//     DstQueueType    (const std::string&) The type of queue taking ownership.
+//     Release         (bool) True for the release half, false for the acquire half.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+
+void KVVulkanFramework::RecordOwnershipBarrier(VkCommandBuffer CommandBufferHndl,
+      KVBufferHandle BufferHndl,const std::string& SrcQueueType,const std::string& DstQueueType,
+                                                                   bool Release,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    KVQueueType SrcType = QueueTypeFromString(SrcQueueType,StatusOK);
+    KVQueueType DstType = QueueTypeFromString(DstQueueType,StatusOK);
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    
+    uint32_t SrcFamily = QueueFamilyForType(SrcType);
+    uint32_t DstFamily = QueueFamilyForType(DstType);
+    if (SrcFamily == DstFamily) return;
+    
+    //  The buffer that moves between queues is the one the GPU works with - for a staged buffer
+    //  that's the secondary buffer, which is the one set in the descriptor sets.
+    
+    VkBuffer BufferToTransfer = I_BufferDetails[Index].MainBufferHndl;
+    if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+        I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) {
+        BufferToTransfer = I_BufferDetails[Index].SecondaryBufferHndl;
+    }
+    
+    //  The stage and access flags depend on what the queue at our end of the transfer does.
+    
+    KVQueueType OurType = Release ? SrcType : DstType;
+    VkPipelineStageFlags StageFlags = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT;
+    VkAccessFlags AccessFlags = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    if (OurType == QUEUE_TRANSFER) {
+        StageFlags = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        AccessFlags = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    } else if (OurType == QUEUE_COMPUTE) {
+        StageFlags = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        AccessFlags = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    
+    VkBufferMemoryBarrier Barrier{};
+    Barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    Barrier.srcQueueFamilyIndex = SrcFamily;
+    Barrier.dstQueueFamilyIndex = DstFamily;
+    Barrier.buffer = BufferToTransfer;
+    Barrier.offset = 0;
+    Barrier.size = VK_WHOLE_SIZE;
+    if (Release) {
+        Barrier.srcAccessMask = AccessFlags;
+        Barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(CommandBufferHndl,StageFlags,VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                           0,0,nullptr,1,&Barrier,0,nullptr);
+    } else {
+        Barrier.srcAccessMask = 0;
+        Barrier.dstAccessMask = AccessFlags;
+        vkCmdPipelineBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,StageFlags,
+                                                           0,0,nullptr,1,&Barrier,0,nullptr);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 Q u e u e  T y p e  F r o m  S t r i n g  (Internal routine)
+//
+//  Converts one of the queue type strings used by the public interface - "GRAPHICS", "COMPUTE"
+//  or "TRANSFER" - into the corresponding internal KVQueueType value.
+//
+//  Parameters:
+//     QueueType       (const std::string&) The queue type string.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (KVQueueType)   The corresponding queue type. QUEUE_GRAPHICS is returned on error.
+
+KVVulkanFramework::KVQueueType KVVulkanFramework::QueueTypeFromString(
+                                                   const std::string& QueueType,bool& StatusOK)
+{
+    KVQueueType Type = QUEUE_GRAPHICS;
+    if (!AllOK(StatusOK)) return Type;
+    if (QueueType == "COMPUTE") {
+        Type = QUEUE_COMPUTE;
+    } else if (QueueType == "TRANSFER") {
+        Type = QUEUE_TRANSFER;
+    } else if (QueueType != "GRAPHICS") {
+        LogError("Invalid queue type '%s' specified.",QueueType.c_str());
+        StatusOK = false;
+    }
+    return Type;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                   Q u e u e  F a m i l y  F o r  T y p e  (Internal routine)
+//
+//  Returns the index of the queue family used for a given type of queue.
+//
+//  Parameters:
+//     Type            (KVQueueType) The queue type.
+//  Returns:
+//     (uint32_t)      The index of the queue family set up for that type by CreateLogicalDevice().
+
+uint32_t KVVulkanFramework::QueueFamilyForType(KVQueueType Type)
+{
+    uint32_t Family = I_QueueFamilyIndex;
+    if (Type == QUEUE_COMPUTE) Family = I_ComputeQueueFamilyIndex;
+    if (Type == QUEUE_TRANSFER) Family = I_TransferQueueFamilyIndex;
+    return Family;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             R u n  C o m m a n d  B u f f e r
+//
+//  Submits a command buffer to a queue on the GPU for processing and waits until it has completed.
+//  This is what all the long series of calls to set up a GPU computation have been leading to.
+//
+//  Parameters:
+//     QueueHndl       (VkQueue) The Vulkan handle for the queue, as returned by GetDeviceQueue().
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Pre-requisites:
+//     The CommandBuffer must have been set up by RecordCommandBuffer(), the queue must have been
+//     obtained from GetDeviceQueue(), and all their pre-requisites must have been completed.
+//
+//  Note:
+//     The command buffer must be re-recorded before it can be re-used, but so long as the layout
+//     of the buffers remains unchanged, the data in them can be modified and the command buffer
+//     re-recorded and re-run without other changes being needed.
+
+void KVVulkanFramework::RunCommandBuffer(
+    VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    TraceScope Trace("RunCommandBuffer","Vulkan");
+    
+    //  This used to create a fence, submit the command buffer, wait on the fence and then
+    //  destroy it. It's now just a submission followed by an immediate wait, which means the
+    //  fence used comes from the pool of recycled fences maintained by SubmitCommandBuffer().
+    
+    KVSubmitTicket Ticket = SubmitCommandBuffer(QueueHndl,CommandBufferHndl,StatusOK);
+    WaitFor(Ticket,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            R u n  C o m p u t e  C h u n k s
+//
+//  Runs a long computation that has been split into a sequence of smaller dispatches - chunks,
+//  such as bands of rows of an image - a few chunks at a time. Each group of chunks is recorded
+//  into the command buffer using RecordComputeBatch(), submitted, and waited for before the
+//  next is recorded. Between submissions, a cancel flag is checked, so a program that has
+//  lost interest in the result - because the view it was computing has changed, say - can have
+//  the chunks still to run dropped, rather than waiting for the whole computation to finish.
+//  And since no one submission runs for much longer than a target time, none comes near the
+//  limit that some operating systems impose on how long the GPU can be kept busy by one
+//  submission before it is reset. A time budget can also be set, after which this returns
+//  with chunks still to run, so a program can draw what it has and handle its input before
+//  calling this again to carry on from where it stopped.
+//
+//  Parameters:
+//     QueueHndl       (VkQueue) The Vulkan handle for the queue, as returned by GetDeviceQueue().
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer to use, as
+//                     returned by either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     Chunks          (const std::vector<KVDispatch>&) The dispatches that make up the whole
+//                     computation, in the order in which they are to run.
+//     FirstChunk      (int) The index in Chunks of the first chunk to run - zero to start the
+//                     computation, or the value returned by a previous call to carry on with it.
+//     SyncAfter       (const std::vector<KVBufferHandle>&) Buffers to be synched after the
+//                     last chunk has run. Unstaged buffers are ignored, and the vector may be
+//                     empty.
+//     TargetMsec      (float) The time each submission should aim to take, in msec. The first
+//                     submission is a single chunk, and the number of chunks in each after that
+//                     is set from the time the chunks so far have taken.
+//     BudgetMsec      (float) The time after which no more submissions are made, in msec. Zero
+//                     or negative means no limit - the chunks are run until all are done, or
+//                     the computation is cancelled.
+//     CancelPtr       (const KVCancelFlag*) The address of a flag that is set - by any thread -
+//                     to cancel the computation. May be nullptr, in which case it can't be.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (int) The index of the first chunk not yet run. This will be the number of chunks if the
+//                     computation is complete.
+//
+//  Note:
+//     o A submission that has started can't be stopped, so a cancelled computation still takes
+//     up to about TargetMsec to return. The cancel flag is not cleared by this routine - that is
+//     up to the program, once it has noted the cancellation.
+//     o The chunks must not depend on any chunk after them, since the later ones may never run.
+//     o If dispatch timing is enabled (see EnableDispatchTiming()), GetDispatchTimes() returns
+//     the times for the last submission made.
+
+int KVVulkanFramework::RunComputeChunks(VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+    const std::vector<KVDispatch>& Chunks,int FirstChunk,
+    const std::vector<KVBufferHandle>& SyncAfter,float TargetMsec,float BudgetMsec,
+                                                   const KVCancelFlag* CancelPtr,bool& StatusOK)
+{
+    int NextChunk = std::max(FirstChunk,0);
+    if (!AllOK(StatusOK)) return NextChunk;
+    TraceScope Trace("RunComputeChunks","Vulkan");
+    
+    int NumberChunks = int(Chunks.size());
+    int GroupSize = 1;
+    std::vector<KVDispatch> Group;
+    std::vector<KVBufferHandle> NoSyncs;
+    MsecTimer BudgetTimer;
+    while (NextChunk < NumberChunks && AllOK(StatusOK)) {
+        if (CancelPtr && CancelPtr->load()) {
+            I_Debug.Logf("Progress","Chunked computation cancelled, %d of %d chunks run.",
+                                                                       NextChunk,NumberChunks);
+            break;
+        }
+        if (BudgetMsec > 0.0 && NextChunk > FirstChunk &&
+                                          BudgetTimer.ElapsedMsec() >= BudgetMsec) break;
+        
+        //  The group submitted is the next GroupSize chunks. The buffers to be synched after
+        //  the computation are only synched after the group with the last chunk in it.
+        
+        int GroupEnd = std::min(NextChunk + GroupSize,NumberChunks);
+        Group.assign(Chunks.begin() + NextChunk,Chunks.begin() + GroupEnd);
+        MsecTimer GroupTimer;
+        RecordComputeBatch(CommandBufferHndl,Group,NoSyncs,
+                                      GroupEnd == NumberChunks ? SyncAfter : NoSyncs,StatusOK);
+        RunCommandBuffer(QueueHndl,CommandBufferHndl,StatusOK);
+        if (!AllOK(StatusOK)) break;
+        
+        //  The time each chunk took sets the number in the next group - never more than
+        //  double, in case the chunks so far happened to be unusually quick ones.
+        
+        double ChunkMsec = GroupTimer.ElapsedMsec() / double(GroupEnd - NextChunk);
+        int Wanted = (ChunkMsec > 0.0) ? int(TargetMsec / ChunkMsec) : GroupSize * 2;
+        GroupSize = std::max(1,std::min(Wanted,GroupSize * 2));
+        NextChunk = GroupEnd;
+    }
+    return NextChunk;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           S u b m i t  C o m m a n d  B u f f e r
+//
+//  Submits a command buffer to a queue on the GPU for processing, but - unlike RunCommandBuffer()
+//  - does not wait for it to complete. Instead, it returns a 'ticket' that can be passed to
+//  IsComplete() to see if the command buffer has finished executing, or to WaitFor() to wait
+//  until it has. This allows the CPU to get on with something else while the GPU is working,
+//  and allows a program to have a number of command buffers in flight at the same time.
+//
+//  Parameters:
+//     QueueHndl       (VkQueue) The Vulkan handle for the queue, as returned by GetDeviceQueue().
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer().
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (KVSubmitTicket) A ticket identifying the submission. This will be KV_NULL_TICKET if the
+//                     submission failed.
+//
+//  Pre-requisites:
+//     The CommandBuffer must have been set up by RecordCommandBuffer(), the queue must have been
+//     obtained from GetDeviceQueue(), and all their pre-requisites must have been completed.
+//
+//  Note:
+//     o Completion is tracked using a fence. Fences are taken from a pool maintained by the
+//     Framework and returned to it once IsComplete() or WaitFor() sees the submission has
+//     completed, so repeated submissions don't keep creating and destroying fences. Every
+//     ticket should eventually be passed to either WaitFor() or IsComplete() (until that returns
+//     true), otherwise its fence isn't recycled until the Framework closes down.
+//     o A command buffer must not be re-recorded or re-submitted until the submission that is
+//     using it has completed.
+
+KVVulkanFramework::KVSubmitTicket KVVulkanFramework::SubmitCommandBuffer(
+    VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,bool& StatusOK)
+{
+    std::vector<VkSemaphore> NoSemaphores;
+    return SubmitCommandBuffer(QueueHndl,CommandBufferHndl,NoSemaphores,
+                                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,NoSemaphores,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 S u b m i t  C o m m a n d  B u f f e r   (with semaphores)
+//
+//  This version of SubmitCommandBuffer() also allows the submission to wait for a set of
+//  semaphores to be signalled before it starts, and to signal another set of semaphores when
+//  it completes. This allows submissions - for example a buffer sync set up by SubmitSyncBuffer()
+//  and a compute command buffer - to be ordered on the GPU, without the CPU having to wait for
+//  each to complete before submitting the next.
+//
+//  Parameters:
+//     QueueHndl       (VkQueue) The Vulkan handle for the queue, as returned by GetDeviceQueue().
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, as returned by
+//                     either CreateCommandBuffers() or by CreateComputeCommandBuffer(). This can
+//                     be VK_NULL_HANDLE, in which case the submission just waits on and signals
+//                     the semaphores.
+//     WaitSemaphoreHndls (const std::vector<VkSemaphore>&) Semaphores to wait for. May be empty.
+//     WaitStageFlags  (VkPipelineStageFlags) The pipeline stage at which the wait takes place,
+//                     eg VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT for a compute command buffer that
+//                     needs data copied by an earlier transfer.
+//     SignalSemaphoreHndls (const std::vector<VkSemaphore>&) Semaphores to be signalled when the
+//                     submission completes. May be empty.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (KVSubmitTicket) A ticket identifying the submission. This will be KV_NULL_TICKET if the
+//                     submission failed.
+//
+//  Pre-requisites:
+//     As for the simpler version of SubmitCommandBuffer(). Semaphores can be created using
+//     CreateVulkanSemaphore().
+
+KVVulkanFramework::KVSubmitTicket KVVulkanFramework::SubmitCommandBuffer(
+    VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+    const std::vector<VkSemaphore>& WaitSemaphoreHndls,VkPipelineStageFlags WaitStageFlags,
+    const std::vector<VkSemaphore>& SignalSemaphoreHndls,bool& StatusOK)
+{
+    KVSubmitTicket Ticket = KV_NULL_TICKET;
+    if (!AllOK(StatusOK)) return Ticket;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    VkCommandBuffer LocalCommandBufferHndl = CommandBufferHndl;
+    VkSubmitInfo SubmitInfo = {};
+    SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (CommandBufferHndl != VK_NULL_HANDLE) {
+        SubmitInfo.commandBufferCount = 1;
+        SubmitInfo.pCommandBuffers = &LocalCommandBufferHndl;
+    }
+    
+    //  Each wait semaphore needs its own stage flags value, even though we use the same one
+    //  for all of them.
+    
+    std::vector<VkPipelineStageFlags> WaitStages(WaitSemaphoreHndls.size(),WaitStageFlags);
+    SubmitInfo.waitSemaphoreCount = uint32_t(WaitSemaphoreHndls.size());
+    SubmitInfo.pWaitSemaphores = WaitSemaphoreHndls.data();
+    SubmitInfo.pWaitDstStageMask = WaitStages.data();
+    SubmitInfo.signalSemaphoreCount = uint32_t(SignalSemaphoreHndls.size());
+    SubmitInfo.pSignalSemaphores = SignalSemaphoreHndls.data();
+
+    //  We need a fence so we can tell when the computation has completed. Use one from the
+    //  pool of unsignalled fences if there is one, otherwise create a new one.
+    
+    VkFence Fence = GetPooledFence(StatusOK);
+    if (AllOK(StatusOK)) {
+
+        //  Submit the command buffer to the queue, together with the fence.
+        
+        VkResult Result = vkQueueSubmit(QueueHndl,1,&SubmitInfo,Fence);
+        if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
+            LogVulkanError("Failed to submit compute queue","vkQueueSubmit",Result);
+            StatusOK = false;
+            
+            //  The fence won't have been signalled, so it can go straight back into the pool.
+            
+            I_FreeFenceHndls.push_back(Fence);
+        } else {
+            
+            //  Record the submission, so IsComplete() and WaitFor() can find its fence.
+            
+            T_SubmitDetails SubmitDetails;
+            SubmitDetails.Ticket = ++I_LastTicket;
+            TraceRecorder::Global().AsyncBegin("GPU submission","Vulkan",SubmitDetails.Ticket);
+            SubmitDetails.FenceHndl = Fence;
+            I_Submissions.push_back(SubmitDetails);
+            Ticket = SubmitDetails.Ticket;
+        }
+    }
+    return Ticket;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              S u b m i t  C o m m a n d  B u f f e r   (with timeline semaphores)
+//
+//  This version of SubmitCommandBuffer() takes timeline semaphores - see
+//  CreateTimelineSemaphore() - each with a value. The submission waits until each of the wait
+//  semaphores has reached its value before it starts, and sets each of the signal semaphores to
+//  its value when it completes.
+//
+//  Parameters:
+//     QueueHndl       (VkQueue) The Vulkan handle for the queue, as returned by GetDeviceQueue().
+//     CommandBufferHndl (VkCommandBuffer) The Vulkan handle for the command buffer, or
+//                     VK_NULL_HANDLE, as for the version of SubmitCommandBuffer() that takes
+//                     binary semaphores.
+//     WaitPoints      (const std::vector<KVTimelinePoint>&) Semaphores and the values to wait
+//                     for. May be empty.
+//     WaitStageFlags  (VkPipelineStageFlags) The pipeline stage at which the wait takes place.
+//     SignalPoints    (const std::vector<KVTimelinePoint>&) Semaphores and the values they are to
+//                     be set to when the submission completes. May be empty.
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (KVSubmitTicket) A ticket identifying the submission. This will be KV_NULL_TICKET if the
+//                     submission failed.
+//
+//  Note:
+//     The values signalled for a given semaphore must always increase. Vulkan allows a wait to
+//     be submitted before the matching signal, so long as the signal does eventually happen.
+
+KVVulkanFramework::KVSubmitTicket KVVulkanFramework::SubmitCommandBuffer(
+    VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+    const std::vector<KVTimelinePoint>& WaitPoints,VkPipelineStageFlags WaitStageFlags,
+    const std::vector<KVTimelinePoint>& SignalPoints,bool& StatusOK)
+{
+    KVSubmitTicket Ticket = KV_NULL_TICKET;
+    if (!AllOK(StatusOK)) return Ticket;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    if (!I_TimelineSupported) {
+        LogError ("Device does not support timeline semaphores.");
+        StatusOK = false;
+        return Ticket;
+    }
+    
+    //  The semaphores and their values go into separate arrays. The values are passed using a
+    //  VkTimelineSemaphoreSubmitInfo structure chained to the submit information.
+    
+    std::vector<VkSemaphore> WaitSemaphoreHndls;
+    std::vector<uint64_t> WaitValues;
+    for (const KVTimelinePoint& Point : WaitPoints) {
+        WaitSemaphoreHndls.push_back(Point.SemaphoreHndl);
+        WaitValues.push_back(Point.Value);
+    }
+    std::vector<VkSemaphore> SignalSemaphoreHndls;
+    std::vector<uint64_t> SignalValues;
+    for (const KVTimelinePoint& Point : SignalPoints) {
+        SignalSemaphoreHndls.push_back(Point.SemaphoreHndl);
+        SignalValues.push_back(Point.Value);
+    }
+    VkTimelineSemaphoreSubmitInfoKHR TimelineInfo{};
+    TimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    TimelineInfo.waitSemaphoreValueCount = uint32_t(WaitValues.size());
+    TimelineInfo.pWaitSemaphoreValues = WaitValues.data();
+    TimelineInfo.signalSemaphoreValueCount = uint32_t(SignalValues.size());
+    TimelineInfo.pSignalSemaphoreValues = SignalValues.data();
+    
+    VkCommandBuffer LocalCommandBufferHndl = CommandBufferHndl;
+    VkSubmitInfo SubmitInfo = {};
+    SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    SubmitInfo.pNext = &TimelineInfo;
+    if (CommandBufferHndl != VK_NULL_HANDLE) {
+        SubmitInfo.commandBufferCount = 1;
+        SubmitInfo.pCommandBuffers = &LocalCommandBufferHndl;
+    }
+    std::vector<VkPipelineStageFlags> WaitStages(WaitSemaphoreHndls.size(),WaitStageFlags);
+    SubmitInfo.waitSemaphoreCount = uint32_t(WaitSemaphoreHndls.size());
+    SubmitInfo.pWaitSemaphores = WaitSemaphoreHndls.data();
+    SubmitInfo.pWaitDstStageMask = WaitStages.data();
+    SubmitInfo.signalSemaphoreCount = uint32_t(SignalSemaphoreHndls.size());
+    SubmitInfo.pSignalSemaphores = SignalSemaphoreHndls.data();
+    
+    //  From here on, this is just as for the other versions, with a pooled fence so that the
+    //  ticket can be passed to IsComplete() or WaitFor().
+    
+    VkFence Fence = GetPooledFence(StatusOK);
+    if (AllOK(StatusOK)) {
+        VkResult Result = vkQueueSubmit(QueueHndl,1,&SubmitInfo,Fence);
+        if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
+            LogVulkanError("Failed to submit compute queue","vkQueueSubmit",Result);
+            StatusOK = false;
+            I_FreeFenceHndls.push_back(Fence);
+        } else {
+            T_SubmitDetails SubmitDetails;
+            SubmitDetails.Ticket = ++I_LastTicket;
+            TraceRecorder::Global().AsyncBegin("GPU submission","Vulkan",SubmitDetails.Ticket);
+            SubmitDetails.FenceHndl = Fence;
+            I_Submissions.push_back(SubmitDetails);
+            Ticket = SubmitDetails.Ticket;
+        }
+    }
+    return Ticket;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 I s  C o m p l e t e
+//
+//  Tests whether a submission made using SubmitCommandBuffer() has completed execution. This
+//  does not wait - it returns immediately.
+//
+//  Parameters:
+//     Ticket          (KVSubmitTicket) The ticket returned by SubmitCommandBuffer().
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (bool)          True if the submission has completed, false if it is still executing.
+//
+//  Note:
+//     Once a submission has been seen to be complete, its fence is returned to the pool, and
+//     any later call to IsComplete() (or WaitFor()) for the same ticket will simply return
+//     immediately. KV_NULL_TICKET is treated as referring to a completed submission.
+
+bool KVVulkanFramework::IsComplete(KVSubmitTicket Ticket,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return false;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    bool Complete = true;
+    int Index = SubmissionIndexFromTicket(Ticket,StatusOK);
+    if (AllOK(StatusOK) && Index >= 0) {
+        VkResult Result = vkGetFenceStatus(I_LogicalDevice,I_Submissions[Index].FenceHndl);
+        if (Result == VK_NOT_READY) {
+            Complete = false;
+        } else if (Result == VK_SUCCESS) {
+            ReleaseSubmission(Index);
+        } else {
+            LogVulkanError("Failed to get completion status","vkGetFenceStatus",Result);
+            StatusOK = false;
+        }
+    }
+    return Complete;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    W a i t  F o r
+//
+//  Waits until a submission made using SubmitCommandBuffer() has completed execution.
+//
+//  Parameters:
+//     Ticket          (KVSubmitTicket) The ticket returned by SubmitCommandBuffer().
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//
+//  Notes:
+//     o The wait times out - with an error - after 100 seconds, which is the same timeout that
+//     RunCommandBuffer() used to use. Passing KV_NULL_TICKET is allowed, and returns at once.
+//     o Different threads can wait for different submissions at the same time, but a given
+//     ticket should only be waited for by one thread.
+//     o If SetWaitSpin() has been called, the fence is polled for up to the time it set before
+//     the wait blocks. Each wait is timed for GetWaitStats().
+
+void KVVulkanFramework::WaitFor(KVSubmitTicket Ticket,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::unique_lock<std::recursive_mutex> Lock(I_Mutex);
+    
+    //  The lock is released during the actual wait, so other threads can carry on submitting
+    //  work (and waiting for it) in the meantime. That means I_Submissions may change during
+    //  the wait, so the submission has to be looked up again afterwards.
+    
+    int Index = SubmissionIndexFromTicket(Ticket,StatusOK);
+    if (AllOK(StatusOK) && Index >= 0) {
+        VkFence FenceHndl = I_Submissions[Index].FenceHndl;
+        unsigned int SpinUsec = I_WaitSpinUsec;
+        Lock.unlock();
+        MsecTimer WaitTimer;
+        VkResult Result = VK_NOT_READY;
+        if (SpinUsec > 0) {
+            do {
+                Result = vkGetFenceStatus(I_LogicalDevice,FenceHndl);
+            } while (Result == VK_NOT_READY && WaitTimer.ElapsedNsec() < int64_t(SpinUsec) * 1000);
+        }
+        bool Spun = (Result == VK_SUCCESS);
+        if (Result == VK_NOT_READY) {
+            Result = vkWaitForFences(I_LogicalDevice,1,&FenceHndl,VK_TRUE,100000000000);
+        }
+        double WaitUsec = WaitTimer.ElapsedMsec() * 1000.0;
+        Lock.lock();
+        RecordWait(WaitUsec,Spun);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to wait for compute to complete","vkWaitForFences",Result);
+            StatusOK = false;
+        } else {
+            Index = SubmissionIndexFromTicket(Ticket,StatusOK);
+            if (Index >= 0) ReleaseSubmission(Index);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                S e t  W a i t  S p i n
+//
+//  When WaitFor() - and so RunCommandBuffer() - or WaitForSemaphoreValue() blocks, the thread
+//  sleeps in the driver until the GPU signals completion, and it can then take the system tens
+//  of microseconds to wake it up again. For a large dispatch that doesn't matter, but for a
+//  small one - a small image, or one tile of a larger one - it can be a large part of the time
+//  the whole pass takes. This sets a time for which the waits instead poll the fence or
+//  semaphore, keeping the CPU busy, before blocking if it still hasn't completed. Which is
+//  better depends on the workload and the system, so GetWaitStats() reports how long the
+//  waits take, and how many finished while still polling, and a program can compare them.
+//
+//  Parameters:
+//     Usec          (unsigned int) The longest time for which to poll, in microseconds. Zero,
+//                   the default, blocks at once, as the waits always used to.
+
+void KVVulkanFramework::SetWaitSpin(unsigned int Usec)
+{
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    I_WaitSpinUsec = Usec;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               G e t  W a i t  S t a t s
+//
+//  Returns the number of waits made by WaitFor() - including those made by RunCommandBuffer()
+//  - and WaitForSemaphoreValue(), how many of them finished while still polling, as set by
+//  SetWaitSpin(), and the time they took, measured from the start of the wait to the return
+//  from it. That includes the time the GPU was still working, as well as the time it took to
+//  notice it had finished.
+//
+//  Parameters:
+//     Stats         (KVWaitStats*) Receives the counts and times for the waits since the
+//                   Framework was created, or since the counts were last reset.
+//     Reset         (bool) If true, the counts and times are reset to zero once they have been
+//                   returned. Default false.
+
+void KVVulkanFramework::GetWaitStats(KVWaitStats* Stats,bool Reset)
+{
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    *Stats = I_WaitStats;
+    if (Reset) I_WaitStats = {0,0,0.0,0.0};
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          R e c o r d  W a i t   (Internal routine)
+//
+//  This internal routine adds a wait made by WaitFor() or WaitForSemaphoreValue() to the
+//  counts returned by GetWaitStats().
+//
+//  Parameters:
+//     Usec          (double) The time the wait took, in microseconds.
+//     Spun          (bool) True if the wait finished while still polling.
+
+void KVVulkanFramework::RecordWait(double Usec,bool Spun)
+{
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    I_WaitStats.Waits++;
+    if (Spun) I_WaitStats.Spun++;
+    I_WaitStats.TotalUsec += Usec;
+    if (Usec > I_WaitStats.MaxUsec) I_WaitStats.MaxUsec = Usec;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              S u b m i s s i o n  I n d e x  F r o m  T i c k e t   (Internal routine)
+//
+//  This internal routine returns the index in I_Submissions of the details of the submission
+//  identified by a ticket returned by SubmitCommandBuffer(). If the submission is already known
+//  to have completed, it will no longer be in I_Submissions and this routine returns -1. It
+//  also returns -1 for KV_NULL_TICKET, which is returned by SubmitSyncBuffer() when it has
+//  nothing to submit.
+//
+//  Parameters:
+//     Ticket          (KVSubmitTicket) The ticket returned by SubmitCommandBuffer().
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (int)           The index into I_Submissions, or -1 if the submission has completed.
+
+int KVVulkanFramework::SubmissionIndexFromTicket(KVSubmitTicket Ticket,bool& StatusOK)
+{
+    int Index = -1;
+    if (!AllOK(StatusOK)) return Index;
+    
+    if (Ticket == KV_NULL_TICKET) {
+        Index = -1;
+    } else if (Ticket > I_LastTicket) {
+        LogError ("Invalid submission ticket (%llu) specified",(unsigned long long)Ticket);
+        StatusOK = false;
+    } else {
+        for (int I = 0; I < int(I_Submissions.size()); I++) {
+            if (I_Submissions[I].Ticket == Ticket) {
+                Index = I;
+                break;
+            }
+        }
+    }
+    return Index;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     R e l e a s e  S u b m i s s i o n   (Internal routine)
+//
+//  This internal routine is called once a submission is known to have completed. It resets the
+//  fence used by the submission and returns it to the pool of free fences, and removes the
+//  submission from I_Submissions.
+//
+//  Parameters:
+//     Index           (int) The index of the submission in I_Submissions.
+
+void KVVulkanFramework::ReleaseSubmission(int Index)
+{
+    TraceRecorder::Global().AsyncEnd("GPU submission","Vulkan",I_Submissions[Index].Ticket);
+    VkFence Fence = I_Submissions[Index].FenceHndl;
+    if (vkResetFences(I_LogicalDevice,1,&Fence) == VK_SUCCESS) {
+        I_FreeFenceHndls.push_back(Fence);
+    } else {
+        vkDestroyFence(I_LogicalDevice,Fence,nullptr);
+    }
+    I_Submissions.erase(I_Submissions.begin() + Index);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        G e t  P o o l e d  F e n c e   (Internal routine)
+//
+//  This internal routine returns an unsignalled fence, taken from the pool of recycled fences
+//  if there is one available, and otherwise newly created.
+//
+//  Parameters:
+//     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
+//                     this routine returns immediately. If something goes wrong, the variable
+//                     will be set false.
+//  Returns:
+//     (VkFence)       The Vulkan handle for the fence.
+
+VkFence KVVulkanFramework::GetPooledFence(bool& StatusOK)
+{
+    VkFence Fence = VK_NULL_HANDLE;
+    if (!AllOK(StatusOK)) return Fence;
+    
+    if (I_FreeFenceHndls.size() > 0) {
+        Fence = I_FreeFenceHndls.back();
+        I_FreeFenceHndls.pop_back();
+    } else {
+        VkFenceCreateInfo FenceCreateInfo = {};
+        FenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        FenceCreateInfo.flags = 0;
+        VkResult Result = vkCreateFence(I_LogicalDevice,&FenceCreateInfo,nullptr,&Fence);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError("Failed to set up fence","vkCreateFence",Result);
+            Fence = VK_NULL_HANDLE;
+            StatusOK = false;
+        } else {
+            I_Debug.Logf("Buffers","New submission fence created, %d now in flight",
+                                                                int(I_Submissions.size()) + 1);
+        }
+    }
+    return Fence;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                      L o a d  P i p e l i n e  C a c h e  (Internal routine)
+//
+//  This is an internal routine called by CreateLogicalDevice() once the logical device exists.
+//  It creates the pipeline cache used by CreateComputePipeline() and CreateGraphicsPipeline(),
+//  initialising it from the cache file saved by an earlier run if there is one. The file is
+//  only used if its header matches the vendor, device and pipeline cache UUID of the selected
+//  device. If the file is missing or unusable, the cache simply starts empty - none of this
+//  is treated as an error, since a program works perfectly well without a saved cache.
+//
+//  Parameters:
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have created the logical device.
+
+void KVVulkanFramework::LoadPipelineCache(bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    std::vector<char> CacheData;
+    std::string Filename = PipelineCacheFilename();
+    if (Filename != "") {
+        FILE* CacheFile = fopen(Filename.c_str(),"rb");
+        if (CacheFile) {
+            fseek(CacheFile,0,SEEK_END);
+            long Length = ftell(CacheFile);
+            if (Length > 0) {
+                CacheData.resize(Length);
+                fseek(CacheFile,0,SEEK_SET);
+                if (long(fread(CacheData.data(),sizeof(char),Length,CacheFile)) != Length) {
+                    CacheData.clear();
+                }
+            }
+            fclose(CacheFile);
+        }
+    }
+    
+    //  The data starts with a standard header (VK_PIPELINE_CACHE_HEADER_VERSION_ONE) giving
+    //  the header length, the header version, the vendor and device IDs, and the 16 byte
+    //  pipeline cache UUID. Drivers are supposed to reject data that doesn't match, but not
+    //  all of them are as careful as they might be, so we check it here too.
+    
+    if (CacheData.size() > 0) {
+        VkPhysicalDeviceProperties DeviceProperties;
+        vkGetPhysicalDeviceProperties(I_SelectedDevice,&DeviceProperties);
+        bool Valid = false;
+        if (CacheData.size() >= 16 + VK_UUID_SIZE) {
+            uint32_t Header[4];
+            memcpy(Header,CacheData.data(),sizeof(Header));
+            Valid = Header[0] >= 16 + VK_UUID_SIZE &&
+                    Header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                    Header[2] == DeviceProperties.vendorID &&
+                    Header[3] == DeviceProperties.deviceID &&
+                    memcmp(CacheData.data() + 16,DeviceProperties.pipelineCacheUUID,
+                                                                            VK_UUID_SIZE) == 0;
+        }
+        if (!Valid) {
+            I_Debug.Logf("Device","Ignoring unusable pipeline cache file '%s'",Filename.c_str());
+            CacheData.clear();
+        }
+    }
+    
+    VkPipelineCacheCreateInfo CacheInfo{};
+    CacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    CacheInfo.initialDataSize = CacheData.size();
+    CacheInfo.pInitialData = CacheData.size() > 0 ? CacheData.data() : nullptr;
+    VkResult Result = vkCreatePipelineCache(I_LogicalDevice,&CacheInfo,nullptr,&I_PipelineCacheHndl);
+    if (Result != VK_SUCCESS && CacheData.size() > 0) {
+        
+        //  If the driver didn't like the saved data, we try again with an empty cache.
+        
+        CacheData.clear();
+        CacheInfo.initialDataSize = 0;
+        CacheInfo.pInitialData = nullptr;
+        Result = vkCreatePipelineCache(I_LogicalDevice,&CacheInfo,nullptr,&I_PipelineCacheHndl);
+    }
+    if (Result != VK_SUCCESS) {
+        LogVulkanError("Failed to create pipeline cache","vkCreatePipelineCache",Result);
+        I_PipelineCacheHndl = VK_NULL_HANDLE;
+        StatusOK = false;
+    } else {
+        I_PipelineCacheLoadedSize = CacheData.size();
+        I_Debug.Logf("Device","Pipeline cache created, %ld bytes loaded from '%s'",
+                                      long(I_PipelineCacheLoadedSize),Filename.c_str());
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                      S a v e  P i p e l i n e  C a c h e  (Internal routine)
+//
+//  This is an internal routine called by CleanupVulkan(). It writes the contents of the
+//  pipeline cache to the cache file, so they can be loaded by LoadPipelineCache() on the next
+//  run, and then destroys the cache. The data is written to a temporary file which is then
+//  renamed, so a number of copies of a program running at once can't leave a partly written
+//  file for another to read. If the cache hasn't grown since it was loaded, which will be the
+//  usual case once a program has been run once, the file is left as it is.
+//
+//  Pre-requisites:
+//     LoadPipelineCache() should have created the cache. If it hasn't, this does nothing.
+
+void KVVulkanFramework::SavePipelineCache(void)
+{
+    if (I_PipelineCacheHndl == VK_NULL_HANDLE) return;
+    
+    size_t DataSize = 0;
+    std::string Filename = PipelineCacheFilename();
+    if (Filename != "") {
+        VkResult Result = vkGetPipelineCacheData(I_LogicalDevice,I_PipelineCacheHndl,
+                                                                          &DataSize,nullptr);
+        if (Result == VK_SUCCESS && DataSize > 0 && DataSize != I_PipelineCacheLoadedSize) {
+            std::vector<char> CacheData(DataSize);
+            Result = vkGetPipelineCacheData(I_LogicalDevice,I_PipelineCacheHndl,
+                                                                  &DataSize,CacheData.data());
+            if (Result == VK_SUCCESS) {
+                std::string TempFilename = Filename + ".tmp";
+                FILE* CacheFile = fopen(TempFilename.c_str(),"wb");
+                if (CacheFile == nullptr) {
+                    LogWarning("Unable to write pipeline cache file '%s'",TempFilename.c_str());
+                } else {
+                    bool Written = (fwrite(CacheData.data(),sizeof(char),DataSize,CacheFile)
+                                                                                   == DataSize);
+                    if (fclose(CacheFile) != 0) Written = false;
+                    if (Written) {
+                        if (rename(TempFilename.c_str(),Filename.c_str()) != 0) {
+                            
+                            //  Not every system allows rename() to replace an existing file.
+                            
+                            remove(Filename.c_str());
+                            if (rename(TempFilename.c_str(),Filename.c_str()) != 0) {
+                                Written = false;
+                            }
+                        }
+                    }
+                    if (Written) {
+                        I_Debug.Logf("Device","Saved %ld bytes of pipeline cache to '%s'",
+                                                                long(DataSize),Filename.c_str());
+                    } else {
+                        LogWarning("Error writing pipeline cache file '%s'",Filename.c_str());
+                        remove(TempFilename.c_str());
+                    }
+                }
+            }
+        }
+    }
+    vkDestroyPipelineCache(I_LogicalDevice,I_PipelineCacheHndl,nullptr);
+    I_PipelineCacheHndl = VK_NULL_HANDLE;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                  P i p e l i n e  C a c h e  F i l e n a m e  (Internal routine)
+//
+//  Returns the full name of the file used to save the pipeline cache for the selected device.
+//  The name includes the vendor and device IDs, the driver version and the pipeline cache UUID,
+//  so the cache for a given device is automatically discarded when its driver is updated.
+//
+//  Returns:
+//     (std::string) The file name, or a blank string if no pipeline cache file is to be used.
+//
+//  Pre-requisites:
+//     FindSuitableDevice() must have been called to select the GPU device to be used.
+
+std::string KVVulkanFramework::PipelineCacheFilename(void)
+{
+    std::string Filename = "";
+    if (I_PipelineCacheDirectory != "" && I_SelectedDevice != VK_NULL_HANDLE) {
+        Filename = I_PipelineCacheDirectory + "/KVPipelineCache_" +
+                                                          DeviceKey(I_SelectedDevice) + ".bin";
+    }
+    return Filename;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             D e v i c e  K e y   (Internal routine)
+//
+//  Returns a string that identifies a physical device and its driver version, made up of the
+//  vendor and device IDs, the driver version and the pipeline cache UUID, all in hex. This is
+//  used to name the pipeline cache file and to key the cached device benchmark results.
+//
+//  Parameters:
+//     DeviceHndl    (VkPhysicalDevice) The physical device.
+//  Returns:
+//     (std::string) The key for the device.
+
+std::string KVVulkanFramework::DeviceKey(VkPhysicalDevice DeviceHndl)
+{
+    VkPhysicalDeviceProperties DeviceProperties;
+    vkGetPhysicalDeviceProperties(DeviceHndl,&DeviceProperties);
+    char Key[64];
+    snprintf(Key,sizeof(Key),"%04x_%04x_%08x_",DeviceProperties.vendorID,
+                             DeviceProperties.deviceID,DeviceProperties.driverVersion);
+    std::string KeyString = Key;
+    for (uint32_t I = 0; I < VK_UUID_SIZE; I++) {
+        snprintf(Key,sizeof(Key),"%02x",DeviceProperties.pipelineCacheUUID[I]);
+        KeyString += Key;
+    }
+    return KeyString;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       R e a d  S p i r V  F i l e  (Internal routine)
+//
+//  This internal routine reads SPIR-V code from a specified file into memory, and returns the
+//  address of the start of that memory and the length of the code in bytes.
+//
+//  Parameters:
+//     ShaderFilename (const std::string&) The name of file containing the SPIR-V code for the
+//                    GPU program to be run by the pipeline.
+//     LengthInBytes  (long*) Receives the length of the SPIR-V code in bytes.
+//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
+//                    this routine returns immediately. If something goes wrong, the variable
+//                    will be set false.
+//  Returns:
+//     (uint32_t*)    The address of the start of the memory into which the code has been read.
+//                    This memory will have been allocated using new[] and should be deleted
+//                    (using delete[]) by the calling routine once it is no longer needed. If
+//                    there is an error, this routine will return a null pointer, so the caller
+//                    needs to test for that rather than blindly run delete[] on a null pointer.
+//  Pre-requisites:
+//     The file name specified must be a string that can be passed to fopen(), and the file should
+//     contain valid SPIR-V code. This routine uses no Vulkan calls, so could in principle be
+//     called before any Vulkan initialisation.
+                                                   
+uint32_t* KVVulkanFramework::ReadSpirVFile(
+        const std::string& Filename,long* LengthInBytes,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return nullptr;
+    
+    //  If the file was read by PreloadShaderFile(), all that's needed is a copy of its code.
+    
+    {
+        std::lock_guard<std::mutex> Lock(I_PreloadMutex);
+        auto Preloaded = I_PreloadedShaders.find(Filename);
+        if (Preloaded != I_PreloadedShaders.end()) {
+            const std::vector<uint32_t>& Code = Preloaded->second.second;
+            *LengthInBytes = Preloaded->second.first;
+            if (Code.empty()) return nullptr;
+            uint32_t* Buffer = new uint32_t[Code.size()];
+            memcpy(Buffer,Code.data(),Code.size() * sizeof(uint32_t));
+            return Buffer;
+        }
+    }
+    
+    //  Nor is the file read if its code is built into the program - see EmbedShader().
+    
+    {
+        std::lock_guard<std::mutex> Lock(EmbeddedShaderMutex());
+        auto Embedded = EmbeddedShaders().find(Filename);
+        if (Embedded != EmbeddedShaders().end()) {
+            *LengthInBytes = long(Embedded->second.second);
+            long LengthInUint32s = (*LengthInBytes + sizeof(uint32_t) - 1)/sizeof(uint32_t);
+            if (LengthInUint32s == 0) return nullptr;
+            uint32_t* Buffer = new uint32_t[LengthInUint32s];
+            memcpy(Buffer,Embedded->second.first,LengthInUint32s * sizeof(uint32_t));
+            I_Debug.Logf("Progress","Using shader code for '%s' built into the program",
+                                                                           Filename.c_str());
+            return Buffer;
+        }
+    }
+    StartupPhase Phase("Read " + Filename);
+    
+    //  This is complicated slightly by the Vulkan specification requiring that SPIR-V binary code
+    //  be presented to vkCreateShaderModule() - as it is here in CreateShaderModule() - as a
+    //  pointer to an array of uint32_t values. In this routine we determine the size of the code
+    //  in the specified file, allocate an array to hold it, and read into that array. However,
+    //  we have to allow for the case where the file size is not a round number of uint32_t
+    //  values. (In practice, any valid SPIR-V file will be, but we need to allow for any file
+    //  we might be passed. But we should be able to handle any file at this point. If it's not
+    //  a valid file, it's up to vkCreateShaderModule() to spot that later - which it will do,
+    //  and will explain why if validation is enabled.)
+    
+    uint32_t* Buffer = nullptr;
+    
+    FILE* SpirVFile = fopen(Filename.c_str(), "rb");
+    if (SpirVFile == nullptr) {
+        LogError("Could not find or open file: %s.",Filename.c_str());
+        StatusOK = false;
+    } else {
+
+        //  Get the file size by seeking to the end and getting our file position.
+        
+        fseek(SpirVFile,0,SEEK_END);
+        *LengthInBytes = ftell(SpirVFile);
+    
+        //  Round up the size to a whole number of uint32_t values and allocate an array of that
+        //  size. We zero out the last value, because if there is any padding it's probably nice
+        //  not to leave it as random values. Then we read from the file. Note that we allow
+        //  for a zero length file.
+        
+        if (*LengthInBytes > 0) {
+            long LengthInUint32s = (*LengthInBytes + sizeof(uint32_t) - 1)/sizeof(uint32_t);
+            Buffer = new uint32_t[LengthInUint32s];
+            Buffer[LengthInUint32s - 1] = 0;
+            fseek(SpirVFile,0,SEEK_SET);
+            long Length = fread(Buffer,sizeof(char),*LengthInBytes,SpirVFile);
+            if (Length != *LengthInBytes) {
+                LogError("Error reading from file: %s.",Filename.c_str());
+                LogError("Read %ld bytes, expected to read %ld bytes.",Length,*LengthInBytes);
+                StatusOK = false;
+            } else {
+                I_Debug.Logf("Progress","Read shader code from '%s'",Filename.c_str());
+            }
+        }
+        fclose(SpirVFile);
+    }
+    return Buffer;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       C r e a t e  S h a d e r  M o d u l e  (Internal routine)
+//
+//  This internal routine is passed the memory address of some SPIR-V code (which probably comes
+//  from a from a specified file, as read using ReadSpirVFile()), creates a Vulkan shader module
+//  from the SPIR-V code, and returns the Vulkan handle for that shader module. The shader module
+//  can then be used in a pipeline, either for computation or for graphics.
+//
+//  Parameters:
+//     Code           (uint32t*) The memory address of the start of the code (usually this
+//                    will have been returned by ReadSpirVFile()).
+//     LengthInBytes  (long) The length of the SPIR-V code in bytes.
+//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
+//                    this routine returns immediately. If something goes wrong, the variable
+//                    will be set false.
+//  Returns:
+//     (VkShaderModule) The Vulkan handle for the newly created shader module.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//     Code and LengthInBytes should describe valid SPIR-V code.
+
+VkShaderModule KVVulkanFramework::CreateShaderModule(
+                                        uint32_t* Code,long LengthInBytes,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return VK_NULL_HANDLE;
+    
+    VkShaderModuleCreateInfo CreateInfo{};
+    CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    CreateInfo.codeSize = LengthInBytes;
+    CreateInfo.pCode = Code;
+
+    VkShaderModule ShaderModule;
+    VkResult Result;
+    Result = vkCreateShaderModule(I_LogicalDevice,&CreateInfo,nullptr,&ShaderModule);
+    if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
+        LogVulkanError("Failed to create shader module","vkCreateShaderModule",Result);
+        ShaderModule = VK_NULL_HANDLE;
+        StatusOK = false;
+    }
+    return ShaderModule;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       G e t  S h a d e r  M o d u l e  (Internal routine)
+//
+//  This internal routine returns a shader module for the SPIR-V code for a given shader file,
+//  read using ReadSpirVFile(), so it may come from the file, from a preloaded copy, or from
+//  code built into the program. The modules are kept, indexed by a hash of their code, so
+//  building another pipeline from the same code - autotuning tries several, and a program
+//  may rebuild its pipelines when a window is resized - reuses the module rather than creating
+//  another. Keying on the code rather than the file name means a file that changes while
+//  the program runs still gets a new module. The modules are released when the Framework
+//  closes down, so the caller must not destroy the module returned.
+//
+//  Parameters:
+//     Filename       (const std::string&) The name of the file containing the SPIR-V code.
+//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
+//                    this routine returns immediately. If something goes wrong, the variable
+//                    will be set false.
+//  Returns:
+//     (VkShaderModule) The Vulkan handle for the shader module, or VK_NULL_HANDLE if it
+//                    couldn't be created.
+//
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+
+VkShaderModule KVVulkanFramework::GetShaderModule(const std::string& Filename,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return VK_NULL_HANDLE;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    long LengthInBytes = 0;
+    uint32_t* Code = ReadSpirVFile(Filename,&LengthInBytes,StatusOK);
+    if (Code == nullptr) {
+        StatusOK = false;
+        return VK_NULL_HANDLE;
+    }
+    
+    //  The hash is 64-bit FNV-1a, over the bytes of the code and then its length.
+    
+    uint64_t Hash = 14695981039346656037ULL;
+    const unsigned char* Bytes = (const unsigned char*)Code;
+    for (long Index = 0; Index < LengthInBytes; Index++) {
+        Hash = (Hash ^ Bytes[Index]) * 1099511628211ULL;
+    }
+    Hash = (Hash ^ uint64_t(LengthInBytes)) * 1099511628211ULL;
+    
+    VkShaderModule ShaderModule = VK_NULL_HANDLE;
+    auto Cached = I_ShaderModuleCache.find(Hash);
+    if (Cached != I_ShaderModuleCache.end()) {
+        ShaderModule = Cached->second;
+        I_Debug.Logf("Progress","Reusing shader module for '%s'",Filename.c_str());
+    } else {
+        ShaderModule = CreateShaderModule(Code,LengthInBytes,StatusOK);
+        if (ShaderModule != VK_NULL_HANDLE) {
+            I_ShaderModuleCache[Hash] = ShaderModule;
+            I_ShaderModuleHndls.push_back(ShaderModule);
+        }
+    }
+    delete[] Code;
+    return ShaderModule;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               E m b e d  S h a d e r
+//
+//  This routine supplies the SPIR-V code for a shader file from code built into the program,
+//  so the file itself is not needed at run time, and isn't read. From then on, any Framework
+//  asked for that file - by CreateComputePipeline(), CreateShaderModuleFromFile() or
+//  PreloadShaderFile() - uses this code instead. It is a static routine, as the code belongs
+//  to the program, not to any one Framework, and is usually called before main() starts by
+//  the constructor of a static KVEmbeddedShader, in a file generated at build time by SpvEmbed.
+//  The code is not copied, so must remain in memory - as a static array will.
+//
+//  Parameters:
+//     Filename       (const std::string&) The name of the shader file the code replaces.
+//     Code           (const uint32_t*) The SPIR-V code.
+//     LengthInBytes  (size_t) The length of the code in bytes.
+//
+//  Pre-requisites:
+//     None. This makes no Vulkan calls, so can be called at any time, from any thread.
+
+void KVVulkanFramework::EmbedShader(
+                        const std::string& Filename,const uint32_t* Code,size_t LengthInBytes)
+{
+    std::lock_guard<std::mutex> Lock(EmbeddedShaderMutex());
+    EmbeddedShaders()[Filename] = std::make_pair(Code,LengthInBytes);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       G e t  M e m o r y  T y p e  I n d e x  (Internal routine)
+//
+//  This is an internal utility used by CreateVulkanBuffer(). A GPU typically provides a number of
+//  different types of memory, each with different properties - some will be local to the GPU (and
+//  so fast for it to access), some will be visible to the CPU, some won't, etc. Which type a
+//  program should use for any given purpose depends on the details of just what properties it
+//  would prefer the memory to have.
+//
+//  Parameters:
+//     MemoryRequirements  (VkMemoryRequirements) The memory requirements for the buffer, as
+//                    returned by vkGetBufferMemoryRequirements().
+//     PropertyFlags  (VkMemoryPropertyFlags) Describes the memory properties for the buffer,
+//                    GPU local, shared, etc. that the buffer needs to have, as specified by
+//                    the program in its call to SetBufferDetails().
+//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
+//                    this routine returns immediately. If something goes wrong, the variable
+//                    will be set false.
+//  Returns:
+//     (uint32_t)     An index into the set of memory types available. This routine has determined
+//                    that this index specifies a suitable memory type to use for the buffer.
+//
+//  Pre-requisites:
+//     FindSuitableDevice() must have been called to select the GPU device to be used.
+//
+//  Note:
+//     This routine isn't trying to find the most suitable memory type - that would need much
+//     closer interaction with the higher levels of the program. It merely returns the index of
+//     the first memory type that meets the requirements. The second form of the routine also
+//     takes a set of preferred properties, and returns the first memory type that meets the
+//     requirements and has as many of the preferred properties as possible.
+
+uint32_t KVVulkanFramework::GetMemoryTypeIndex(
+    VkMemoryRequirements MemoryRequirements,VkMemoryPropertyFlags PropertyFlags,bool& StatusOK)
+{
+    return GetMemoryTypeIndex(MemoryRequirements,PropertyFlags,0,StatusOK);
+}
+
+uint32_t KVVulkanFramework::GetMemoryTypeIndex(
+    VkMemoryRequirements MemoryRequirements,VkMemoryPropertyFlags PropertyFlags,
+                                          VkMemoryPropertyFlags PreferredFlags,bool& StatusOK)
+{
+    //  The physical device must have been identified and its handle set in I_SelectedDevice.
+    
+    if (!AllOK(StatusOK)) return 0;
+    
+    bool Found = false;
+        
+    //  The VkMemoryRequirements structure for a resource has a field memoryTypeBits that works
+    //  with the list of memory types returned by vkGetPhysicalDeviceMemoryProperties(). Each bit
+    //  of memoryTypeBits indicates whether the corresponding memory type returned by that routine
+    //  is supported for the resource. (In this case, the resource is the buffer itself, with
+    //  its requirements passed in MemoryRequirements.)
+    
+    uint32_t Index = 0;
+    int BestMatches = 0;
+    uint32_t SupportedMemoryTypeMask = MemoryRequirements.memoryTypeBits;
+    
+    //  We get the set of memory properties for each memory type supported by the device,
+    //  and will check each one against what we need.
+    
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice, &MemoryProperties);
+    
+    if (I_Debug.Active("Properties")) ListMemoryProperties(&MemoryProperties);
+
+    for (uint32_t I = 0; I < MemoryProperties.memoryTypeCount; I++) {
+        
+        //  First, is this memory type supported by the resource in question? (See above.)
+        
+        if (SupportedMemoryTypeMask & (1 << I)) {
+            
+            //  If so, are all the properties we've asked for provided by this memory type?
+            //  (The test checks that all the bits in PropertyFlags are set in the property
+            //  flags for the memory type, ignoring flags we don't care about.)
+            
+            //  If so, it's a candidate, and we keep the first one with the most preferred
+            //  properties.
+            
+            VkMemoryPropertyFlags TypeFlags = MemoryProperties.memoryTypes[I].propertyFlags;
+            if ((TypeFlags & PropertyFlags) == PropertyFlags) {
+                int Matches = 0;
+                for (VkMemoryPropertyFlags Bit = 1; Bit != 0 && Bit <= PreferredFlags; Bit <<= 1) {
+                    if ((PreferredFlags & Bit) && (TypeFlags & Bit)) Matches++;
+                }
+                if (!Found || Matches > BestMatches) {
+                    Index = I;
+                    BestMatches = Matches;
+                    Found = true;
+                }
+            }
+        }
+    }
+    
+    if (!Found) {
+        LogError ("Unable to find a memory type that meets requirements.");
+        StatusOK = false;
+    }
+    return Index;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       L i s t  M e m o r y  P r o p e r t i e s  (Internal routine)
+//
+//  This is an internal diagnostic utility that can be used to list the properties of the
+//  various memory types supported by the selected GPU (see GetMmeoryTypeIndex() for a little
+//  more context).
+//
+//  Parameters:
+//     Properties     (VkPhysicalDeviceMemoryProperties*) A structure describing all the memory
+//                    types supported by the device. This should have been returned by a call to
+//                    vkGetPhysicalDeviceMemoryProperties().
+//  Output:
+//     A listing of the available memory types and their properties.
+//
+//  Pre-requisites:
+//     Strictly, none, although in practice, Properties will have been returned by a call to
+//     vkGetPhysicalDeviceMemoryProperties().
+
+void KVVulkanFramework::ListMemoryProperties(const VkPhysicalDeviceMemoryProperties* Properties)
+{
+    I_Debug.Log ("Properties","Memory properties:");
+    
+    //  A device has one or more memory 'heaps'. List them first. Some heaps are much larger
+    //  than others and can support much larger memory allocations.
+    
+    I_Debug.Logf ("Properties","Heaps: %d",Properties->memoryHeapCount);
+    for (unsigned int Heap = 0; Heap < Properties->memoryHeapCount; Heap++) {
+        std::string FlagString = "";
+        VkMemoryHeapFlags Flags = Properties->memoryHeaps[Heap].flags;
+        if (Flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) FlagString += "DeviceLocal ";
+        if (Flags & VK_MEMORY_HEAP_MULTI_INSTANCE_BIT) FlagString += "MultiInstance ";
+        I_Debug.Logf ("Properties","Heap %d size %d %s",Heap,
+                                             Properties->memoryHeaps[Heap].size,FlagString.c_str());
+    }
+    
+    //  It also has a number of memory types, each associated with a specific heap and
+    //  with its own specific properties.
+    
+    I_Debug.Logf ("Properties","Memory types: %d",Properties->memoryTypeCount);
+    for (unsigned int Type = 0; Type < Properties->memoryTypeCount; Type++) {
+        std::string FlagString =
+                            MemoryFlagString(Properties->memoryTypes[Type].propertyFlags);
+        I_Debug.Logf ("Properties","Type %d Heap %d %s",Type,
+                                       Properties->memoryTypes[Type].heapIndex,FlagString.c_str());
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//          G e t  I n d e x  F o r  Q u e u e  F a m i l y  T o  U s e  (Internal routine)
+//
+//  This is an internal utility used by CreateLogicalDevice(). Devices support multiple queues,
+//  bundled up into queue 'families' in which each member has the same capabilities (ie can do
+//  graphics, can do compute, can do other things like memory transfers). Each queue family has
+//  its own index number. This routine selects a queue family to use for the sort of general
+//  application the Framework is designed to handle, and returns its index so CreateLogicalDevice()
+//  can use it.
+//
+//  Parameters:
+//     UseGraphics    (bool) Set true if the application needs to use graphics.
+//     UseCompute     (bool) Set true if the application needs to use the GPU for computation.
+//     StatusOK       (bool&) A reference to an inherited status variable. If passed false,
+//                    this routine returns immediately. If something goes wrong, the variable
+//                    will be set false.
+//  Returns:
+//     (uint32_t)     An index into the set of queue families available. This routine has
+//                    determined that this index specifies a suitable family to use.
+//
+//  Pre-requisites:
+//     FindSuitableDevice() must have been called to select the GPU device to be used.
+//
+//  Note:
+//     This routine isn't trying to find the most suitable queue family - that would need much
+//     closer interaction with the higher levels of the program. It merely returns the index of
+//     the first family that meets the requirements.
+
+uint32_t KVVulkanFramework::GetIndexForQueueFamilyToUse(
+               bool UseGraphics,bool UseCompute,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return 0;
+    
+    bool ListQueueProperties = true;
+    
+    uint32_t FamilyIndex = 0;
+    
+    //  Get the details of all the queue families supported by the device.
+    
+    uint32_t NumberFamilies;
+    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,nullptr);
+    std::vector<VkQueueFamilyProperties> QueueFamilies(NumberFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(I_SelectedDevice,&NumberFamilies,QueueFamilies.data());
+
+    //  This section lists the details of what each queue family supports. It gives an idea of
+    //  what might be tested for (possibly even at the point when the device is selected, for
+    //  programs that have specifically heavy requirements).
+    
+    if (ListQueueProperties) {
+        int Index = 0;
+        for (const VkQueueFamilyProperties& Props : QueueFamilies) {
+            std::string PropString = "";
+            if (Props.queueFlags & VK_QUEUE_GRAPHICS_BIT) PropString += " Graphics";
+            if (Props.queueFlags & VK_QUEUE_COMPUTE_BIT) PropString += " Compute";
+            if (Props.queueFlags & VK_QUEUE_TRANSFER_BIT) PropString += " Transfer";
+            if (Props.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) PropString += " Binding";
+            if (UseGraphics) {
+                VkBool32 PresentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(I_SelectedDevice,Index,I_Surface,
+                                                                         &PresentSupport);
+                if (PresentSupport) PropString += " Present";
+            }
+            I_Debug.Logf("Properties","Queue family index %d Queues %d %s",Index,
+                                                            Props.queueCount,PropString.c_str());
+            Index++;
+        }
+    }
+
+    //  Now we look for a suitable queue family. We just take the first one that actually has
+    //  queues and which supports both compute and graphics, if that's what's been asked for.
+    //  If we're using graphics, we want present support as well. Do we really expect all
+    //  graphics queues to support present, or might we need a separate present queue?
+    
+    bool Found = false;
+    int Index = 0;
+    for (const VkQueueFamilyProperties &Props : QueueFamilies) {
+        bool Suitable = true;
+        if (Props.queueCount > 0) {
+            if (UseGraphics && (Props.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) Suitable = false;
+            if (UseCompute && (Props.queueFlags & VK_QUEUE_COMPUTE_BIT) == 0) Suitable = false;
+            if (UseGraphics) {
+                VkBool32 PresentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(I_SelectedDevice,Index,I_Surface,
+                                                                              &PresentSupport);
+                if (!PresentSupport) Suitable = false;
+            }
+            if (Suitable) {
+                I_Debug.Logf("Properties","Selected queue at index: %d",Index);
+                FamilyIndex = Index;
+                Found = true;
+                break;
+            }
+        }
+        Index++;
+    }
+    
+    //  You can imagine being clever if we don't find a suitable queue, expecially if we have
+    //  more unusual requirements - we could return two different queue families, with different
+    //  capabilities, but then we'd need a slightly different calling sequence just to get that
+    //  more nuanced information returned. We might need to use separate graphics and present
+    //  queues (which is what the Vulkan tutorial does).
+
+    if (!Found) StatusOK = false;
+    return FamilyIndex;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                  S e l e c t  S e p a r a t e  Q u e u e  (Internal routine)
+//
+//  This is an internal utility used by CreateLogicalDevice() when EnableSeparateQueues() has
+//  asked for separate compute or transfer queues. It looks first for a queue family that
+//  supports the required operations but none of the operations in a specified set - so, for
+//  example, a transfer-only family, which will usually be a dedicated DMA engine - that still
+//  has a queue not yet allocated. Failing that, it takes an unallocated queue from any family
+//  that supports the required operations, which can include the main family. If all else fails,
+//  it falls back on the main queue (queue 0 of the main family).
+//
+//  Parameters:
+//     RequiredFlags  (VkQueueFlags) The operations the queue must support.
+//     AvoidFlags     (VkQueueFlags) Operations a dedicated family would not support.
+//     QueueFamilies  (const std::vector<VkQueueFamilyProperties>&) The queue families supported
+//                    by the device, as returned by vkGetPhysicalDeviceQueueFamilyProperties().
+//     QueuesUsed     (std::vector<uint32_t>&) The number of queues already allocated from each
+//                    family. This is updated if a new queue is allocated.
+//     FamilyIndexPtr (uint32_t*) Receives the index of the selected queue family.
+//     QueueIndexPtr  (uint32_t*) Receives the index of the selected queue within that family.
+//
+//  Pre-requisites:
+//     FindSuitableDevice() must have been called to select the GPU device to be used, and
+//     I_QueueFamilyIndex must have been set to the index of the main queue family.
+//
+//  Note:
+//     Any family that supports graphics or compute also supports transfers, even if it
+//     doesn't set VK_QUEUE_TRANSFER_BIT, so that is allowed for in the fallback.
+
+void KVVulkanFramework::SelectSeparateQueue(VkQueueFlags RequiredFlags,VkQueueFlags AvoidFlags,
+    const std::vector<VkQueueFamilyProperties>& QueueFamilies,std::vector<uint32_t>& QueuesUsed,
+                                                uint32_t* FamilyIndexPtr,uint32_t* QueueIndexPtr)
+{
+    VkQueueFlags ImpliedFlags = RequiredFlags;
+    if (RequiredFlags & VK_QUEUE_TRANSFER_BIT) {
+        ImpliedFlags |= VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+    }
+    uint32_t NumberFamilies = static_cast<uint32_t>(QueueFamilies.size());
+    for (int Pass = 0; Pass < 2; Pass++) {
+        for (uint32_t Family = 0; Family < NumberFamilies; Family++) {
+            VkQueueFlags Flags = QueueFamilies[Family].queueFlags;
+            bool Suitable;
+            if (Pass == 0) {
+                Suitable = ((Flags & RequiredFlags) == RequiredFlags) && ((Flags & AvoidFlags) == 0);
+            } else {
+                Suitable = ((Flags & RequiredFlags) == RequiredFlags) || (Flags & ImpliedFlags);
+            }
+            if (Suitable && QueueFamilies[Family].queueCount > QueuesUsed[Family]) {
+                *FamilyIndexPtr = Family;
+                *QueueIndexPtr = QueuesUsed[Family]++;
+                return;
+            }
+        }
+    }
+    I_Debug.Log("Device","No separate queue available, using the main queue.");
+    *FamilyIndexPtr = I_QueueFamilyIndex;
+    *QueueIndexPtr = 0;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       R a t e  D e v i c e  (Internal routine)
+//
+//  This is an internal utility used by FindSuitableDevice(). If a machine has multiple GPU
+//  devices, we need to pick one for use. This routine assigns a rough score to each device
+//  based on its capabilities. Since we don't really have much detail about what the program
+//  intends to do with the device, this routine looks mostly for what might be expected to be
+//  the most powerful device.
+//
+//  Parameters:
+//     DeviceHndl     (VkPhysicalDevice) A Vulkan handle for the physical device in question.
+//
+//  Returns:
+//     (int)          A rough score. FindSuitableDevice() will assume zero indicates an unusable
+//                    device, and will simply select the device given the highest score.
+//
+//  Pre-requisites:
+//     FindSuitableDevice() must have been called to select the GPU device to be used.
+//
+//  Note:
+//      This is more of an example than anything, but it's a reasonable way of scoring a physical
+//      GPU device. We assume that if this routine has been called at all, then the device has
+//      passed basic tests like those for support for the required extensions, so is suitable for
+//      use. A score of zero implies unusable, so we give it more than that. We give it 1 in most
+//      cases, another 10 if it's a discrete GPU, and another 10 if it supports double precision.
+//      Since the device type alone can mislead - an integrated GPU with a large unified memory
+//      can outperform a small discrete one - we also add a point for each GByte of the largest
+//      device-local memory heap (up to 16), 5 if some of that memory is also host-visible (as
+//      with unified memory or a resizable BAR, which avoids staging copies), a point for each 16
+//      threads in a subgroup, and 2 if a workgroup can have at least 1024 invocations. Anything
+//      fancier requires application-specific code, or the benchmark - see EnableDeviceBenchmark().
+
+int KVVulkanFramework::RateDevice (VkPhysicalDevice DeviceHndl)
+{
+    int Score = 1;
+    VkPhysicalDeviceProperties Properties;
+    vkGetPhysicalDeviceProperties(DeviceHndl,&Properties);
+    if (Properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) Score += 10;
+    VkPhysicalDeviceFeatures Features;
+    vkGetPhysicalDeviceFeatures(DeviceHndl,&Features);
+    if (Features.shaderFloat64) Score += 10;
+    
+    //  The memory heaps.
+    
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(DeviceHndl,&MemoryProperties);
+    VkDeviceSize LargestLocalHeap = 0;
+    for (uint32_t I = 0; I < MemoryProperties.memoryHeapCount; I++) {
+        const VkMemoryHeap& Heap = MemoryProperties.memoryHeaps[I];
+        if ((Heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && Heap.size > LargestLocalHeap) {
+            LargestLocalHeap = Heap.size;
+        }
+    }
+    VkDeviceSize GByte = VkDeviceSize(1024) * 1024 * 1024;
+    Score += int(std::min(LargestLocalHeap / GByte,VkDeviceSize(16)));
+    VkMemoryPropertyFlags Wanted =
+                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    for (uint32_t I = 0; I < MemoryProperties.memoryTypeCount; I++) {
+        const VkMemoryType& Type = MemoryProperties.memoryTypes[I];
+        if ((Type.propertyFlags & Wanted) == Wanted &&
+                    MemoryProperties.memoryHeaps[Type.heapIndex].size >= 256 * 1024 * 1024) {
+            Score += 5;
+            break;
+        }
+    }
+    
+    //  The compute capabilities. (Subgroup properties need Vulkan 1.1, which is what the Framework
+    //  asks for when it creates the instance.)
+    
+    VkPhysicalDeviceSubgroupProperties SubgroupProperties{};
+    SubgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 Properties2{};
+    Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    Properties2.pNext = &SubgroupProperties;
+    if (Properties.apiVersion >= VK_API_VERSION_1_1) {
+        vkGetPhysicalDeviceProperties2(DeviceHndl,&Properties2);
+        Score += int(SubgroupProperties.subgroupSize / 16);
+    }
+    if (Properties.limits.maxComputeWorkGroupInvocations >= 1024) Score += 2;
+
+    I_Debug.Logf("Device","Device %s rated %d",Properties.deviceName,Score);
+    return Score;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       B e n c h m a r k  D e v i c e   (Internal routine)
+//
+//  Runs a short memory bandwidth benchmark on a physical device, for use when ranking devices.
+//  This creates a temporary logical device with a single queue, allocates two device-local
+//  buffers, and times a command buffer that fills one buffer and copies it to the other. This is
+//  run a few times and the best time is used. Since it only uses transfer commands, it needs no
+//  shader code, but device memory bandwidth is usually what limits the sort of computation
+//  done by the programs that use the Framework.
+//
+//  Parameters:
+//     DeviceHndl    (VkPhysicalDevice) The physical device to be tested.
+//     Portability   (bool) True if the device supports (and so needs) the portability subset.
+//  Returns:
+//     (double)      The measured bandwidth in MBytes/sec, or zero if the test failed.
+//
+//  Note:
+//     This does not use or affect any of the Framework's own device state, and failures are
+//     only logged as warnings.
+
+double KVVulkanFramework::BenchmarkDevice (VkPhysicalDevice DeviceHndl,bool Portability)
+{
+    double Rate = 0.0;
+    
+    //  Find a queue family that supports compute (which implies transfer).
+    
+    uint32_t NumberFamilies;
+    vkGetPhysicalDeviceQueueFamilyProperties(DeviceHndl,&NumberFamilies,nullptr);
+    std::vector<VkQueueFamilyProperties> Families(NumberFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(DeviceHndl,&NumberFamilies,Families.data());
+    uint32_t FamilyIndex = NumberFamilies;
+    for (uint32_t I = 0; I < NumberFamilies; I++) {
+        if (Families[I].queueFlags & VK_QUEUE_COMPUTE_BIT) { FamilyIndex = I; break; }
+    }
+    
+    //  And the first device-local memory type.
+    
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(DeviceHndl,&MemoryProperties);
+    uint32_t MemoryTypeIndex = MemoryProperties.memoryTypeCount;
+    for (uint32_t I = 0; I < MemoryProperties.memoryTypeCount; I++) {
+        if (MemoryProperties.memoryTypes[I].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+            MemoryTypeIndex = I;
+            break;
+        }
+    }
+    if (FamilyIndex >= NumberFamilies || MemoryTypeIndex >= MemoryProperties.memoryTypeCount) {
+        LogWarning("Device benchmark: no suitable queue family or memory type.");
+        return Rate;
+    }
+    
+    //  Create the temporary logical device.
+    
+    float Priority = 1.0;
+    VkDeviceQueueCreateInfo QueueInfo{};
+    QueueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    QueueInfo.queueFamilyIndex = FamilyIndex;
+    QueueInfo.queueCount = 1;
+    QueueInfo.pQueuePriorities = &Priority;
+    std::vector<const char*> Extensions;
+    if (Portability) Extensions.push_back("VK_KHR_portability_subset");
+    VkDeviceCreateInfo DeviceInfo{};
+    DeviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    DeviceInfo.queueCreateInfoCount = 1;
+    DeviceInfo.pQueueCreateInfos = &QueueInfo;
+    DeviceInfo.enabledExtensionCount = uint32_t(Extensions.size());
+    DeviceInfo.ppEnabledExtensionNames = Extensions.data();
+    VkDevice Device = VK_NULL_HANDLE;
+    VkResult Result = vkCreateDevice(DeviceHndl,&DeviceInfo,nullptr,&Device);
+    if (Result != VK_SUCCESS) {
+        LogWarning("Device benchmark: vkCreateDevice failed (%s).",string_VkResult(Result));
+        return Rate;
+    }
+    VkQueue Queue;
+    vkGetDeviceQueue(Device,FamilyIndex,0,&Queue);
+    
+    //  The two buffers, with their memory.
+    
+    VkBuffer Buffers[2] = {VK_NULL_HANDLE,VK_NULL_HANDLE};
+    VkDeviceMemory Memory[2] = {VK_NULL_HANDLE,VK_NULL_HANDLE};
+    bool OK = true;
+    for (int I = 0; I < 2 && OK; I++) {
+        VkBufferCreateInfo BufferInfo{};
+        BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        BufferInfo.size = C_BenchmarkBytes;
+        BufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        OK = (vkCreateBuffer(Device,&BufferInfo,nullptr,&Buffers[I]) == VK_SUCCESS);
+        if (OK) {
+            VkMemoryRequirements Requirements;
+            vkGetBufferMemoryRequirements(Device,Buffers[I],&Requirements);
+            uint32_t TypeIndex = MemoryTypeIndex;
+            for (uint32_t J = 0; J < MemoryProperties.memoryTypeCount; J++) {
+                if ((Requirements.memoryTypeBits & (1 << J)) && (MemoryProperties.memoryTypes[J]
+                                .propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                    TypeIndex = J;
+                    break;
+                }
+            }
+            VkMemoryAllocateInfo AllocInfo{};
+            AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            AllocInfo.allocationSize = Requirements.size;
+            AllocInfo.memoryTypeIndex = TypeIndex;
+            OK = (vkAllocateMemory(Device,&AllocInfo,nullptr,&Memory[I]) == VK_SUCCESS);
+            if (OK) OK = (vkBindBufferMemory(Device,Buffers[I],Memory[I],0) == VK_SUCCESS);
+        }
+    }
+    
+    //  A command pool and a command buffer that fills the first buffer and then copies it to
+    //  the second.
+    
+    VkCommandPool Pool = VK_NULL_HANDLE;
+    VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+    if (OK) {
+        VkCommandPoolCreateInfo PoolInfo{};
+        PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        PoolInfo.queueFamilyIndex = FamilyIndex;
+        OK = (vkCreateCommandPool(Device,&PoolInfo,nullptr,&Pool) == VK_SUCCESS);
+    }
+    if (OK) {
+        VkCommandBufferAllocateInfo AllocInfo{};
+        AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        AllocInfo.commandPool = Pool;
+        AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        AllocInfo.commandBufferCount = 1;
+        OK = (vkAllocateCommandBuffers(Device,&AllocInfo,&CommandBuffer) == VK_SUCCESS);
+    }
+    if (OK) {
+        VkCommandBufferBeginInfo BeginInfo{};
+        BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        vkBeginCommandBuffer(CommandBuffer,&BeginInfo);
+        vkCmdFillBuffer(CommandBuffer,Buffers[0],0,C_BenchmarkBytes,0x3f800000);
+        VkMemoryBarrier Barrier{};
+        Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        Barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(CommandBuffer,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT,0,1,&Barrier,0,nullptr,0,nullptr);
+        VkBufferCopy Region{};
+        Region.size = C_BenchmarkBytes;
+        vkCmdCopyBuffer(CommandBuffer,Buffers[0],Buffers[1],1,&Region);
+        OK = (vkEndCommandBuffer(CommandBuffer) == VK_SUCCESS);
+    }
+    
+    //  Run it a few times - the first run is a warm-up - and use the fastest time. The fill
+    //  writes the buffer once and the copy reads and writes it, so three buffers' worth of
+    //  data are moved.
+    
+    if (OK) {
+        float BestMsec = 0.0;
+        for (int Run = 0; Run < 4 && OK; Run++) {
+            VkSubmitInfo SubmitInfo{};
+            SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            SubmitInfo.commandBufferCount = 1;
+            SubmitInfo.pCommandBuffers = &CommandBuffer;
+            MsecTimer Timer;
+            OK = (vkQueueSubmit(Queue,1,&SubmitInfo,VK_NULL_HANDLE) == VK_SUCCESS);
+            if (OK) OK = (vkQueueWaitIdle(Queue) == VK_SUCCESS);
+            float Msec = Timer.ElapsedMsec();
+            if (Run > 0 && (BestMsec <= 0.0 || Msec < BestMsec)) BestMsec = Msec;
+        }
+        if (OK && BestMsec > 0.0) {
+            double MBytes = 3.0 * double(C_BenchmarkBytes) / (1024.0 * 1024.0);
+            Rate = MBytes / (double(BestMsec) * 0.001);
+        }
+    }
+    if (!OK) LogWarning("Device benchmark failed.");
+    
+    //  Release everything.
+    
+    if (Pool != VK_NULL_HANDLE) vkDestroyCommandPool(Device,Pool,nullptr);
+    for (int I = 0; I < 2; I++) {
+        if (Buffers[I] != VK_NULL_HANDLE) vkDestroyBuffer(Device,Buffers[I],nullptr);
+        if (Memory[I] != VK_NULL_HANDLE) vkFreeMemory(Device,Memory[I],nullptr);
+    }
+    vkDestroyDevice(Device,nullptr);
+    
+    return Rate;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       R e a d  R a n k i n g  C a c h e   (Internal routine)
+//
+//  Reads the device benchmark results cached from earlier runs. The cache is a text file in
+//  the pipeline cache directory with one line for each device, giving the key returned by
+//  DeviceKey() and the measured rate in MBytes/sec. A missing or unreadable file simply
+//  results in empty lists.
+//
+//  Parameters:
+//     Keys          (std::vector<std::string>&) Returned with the device keys.
+//     Rates         (std::vector<double>&) Returned with the corresponding rates.
+
+void KVVulkanFramework::ReadRankingCache(std::vector<std::string>& Keys,
+                                                                std::vector<double>& Rates)
+{
+    Keys.clear();
+    Rates.clear();
+    if (I_PipelineCacheDirectory == "") return;
+    std::string Filename = I_PipelineCacheDirectory + "/" + C_RankingCacheName;
+    FILE* File = fopen(Filename.c_str(),"r");
+    if (File) {
+        char Key[128];
+        double Rate;
+        while (fscanf(File,"%127s %lf",Key,&Rate) == 2) {
+            Keys.push_back(Key);
+            Rates.push_back(Rate);
+        }
+        fclose(File);
+        I_Debug.Logf("Device","Read %d cached device benchmark results from %s",
+                                                          int(Keys.size()),Filename.c_str());
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                      W r i t e  R a n k i n g  C a c h e   (Internal routine)
+//
+//  Writes out the device benchmark results, in the format read by ReadRankingCache().
+//
+//  Parameters:
+//     Keys          (const std::vector<std::string>&) The device keys.
+//     Rates         (const std::vector<double>&) The corresponding rates.
+
+void KVVulkanFramework::WriteRankingCache(const std::vector<std::string>& Keys,
+                                                           const std::vector<double>& Rates)
+{
+    if (I_PipelineCacheDirectory == "") return;
+    std::string Filename = I_PipelineCacheDirectory + "/" + C_RankingCacheName;
+    FILE* File = fopen(Filename.c_str(),"w");
+    if (File == nullptr) {
+        LogWarning("Unable to write device ranking cache %s",Filename.c_str());
+    } else {
+        for (size_t I = 0; I < Keys.size() && I < Rates.size(); I++) {
+            fprintf(File,"%s %.1f\n",Keys[I].c_str(),Rates[I]);
+        }
+        fclose(File);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       D e v i c e  E x t e n s i o n s  O K   (Internal routine)
+//
+//  This is an internal utility used by FindSuitableDevice(). Vulkan makes use of a number of
+//  'extensions'; for example, a program using the GPU for display will need to support an
+//  extension called 'VK_KHR_swapchain'. This routine checks a list of named extensions supported
+//  by a given physical device against a list of those required by the program and returns
+//  true if the device supports all those required.
+//
+//  Parameters:
+//     GraphicsExtensions (const std::vector<const char*>&) The set of named extensions required
+//                        by the program.
+//     DeviceExtensions   (const std::vector<VkExtensionProperties>&) The set of extensions
+//                        supported by the device - these details include their names.
+//
+//  Returns:
+//     (bool)      True if the device supports all the required extensions, false otherwise.
+//
+
+bool KVVulkanFramework::DeviceExtensionsOK(const std::vector<const char*>& GraphicsExtensions,
+                          const std::vector<VkExtensionProperties>& DeviceExtensions)
+{
+    bool AllPresent = true;
+    for (const char* NamePtr : GraphicsExtensions) {
+        I_Debug.Logf("Device","Checking for extension %s",NamePtr);
+        bool Found = false;
+        for (const VkExtensionProperties& Property : DeviceExtensions) {
+            if (!strcmp(NamePtr,Property.extensionName)) {
+                Found = true;
+                break;
+            }
+        }
+        if (!Found) {
+            I_Debug.Logf("Device","Device does not support required extension '%s'.",NamePtr);
+            AllPresent = false;
+            break;
+        }
+    }
+    return AllPresent;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     S h o w  D e v i c e  D e t a i l s   (Internal routine)
+//
+//  This is an internal utility used by FindSuitableDevice() which may call it as a diagnostic.
+//  The details listed may be useful when testing a program. However, the main reason for having
+//  this code here is to show just a little of the information that's available about a GPU.
+//  What's listed here is just a subset. The full list of device properties can be found in
+//  mind-boggling detail in the Vulkan documentation.
+//
+//  Parameters:
+//     DeviceHndl     (VkPhysicalDevice) A Vulkan handle for the physical device in question.
+//
+//  Output:
+//     Some possibly interesting details about the device.
+
+void KVVulkanFramework::ShowDeviceDetails (VkPhysicalDevice DeviceHndl)
+{
+    
+    VkPhysicalDeviceProperties Properties;
+    vkGetPhysicalDeviceProperties(DeviceHndl,&Properties);
+    I_Debug.Logf("Device","Device: %s",Properties.deviceName);
+    I_Debug.Logf("Device","Max compute workgroup count: %d, %d, %d",
+             Properties.limits.maxComputeWorkGroupCount[0],
+             Properties.limits.maxComputeWorkGroupCount[1],
+             Properties.limits.maxComputeWorkGroupCount[2]);
+    I_Debug.Logf("Device","Max compute workgroup invocations: %d",
+             Properties.limits.maxComputeWorkGroupInvocations);
+    I_Debug.Logf("Device","Max compute workgroup size: %d %d %d",
+             Properties.limits.maxComputeWorkGroupSize[0],
+             Properties.limits.maxComputeWorkGroupSize[1],
+             Properties.limits.maxComputeWorkGroupSize[2]);
+    I_Debug.Logf("Device","Max storage buffer range: %d",
+             Properties.limits.maxStorageBufferRange);
+    VkPhysicalDeviceFeatures Features;
+    vkGetPhysicalDeviceFeatures(DeviceHndl,&Features);
+    I_Debug.Logf("Device","Double precision support: %s",
+             ((Features.shaderFloat64) ? "Yes" : "No"));
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     C l e a n u p  V u l k a n  G r a p h i c s
+//
+//  This routine cleans up the graphics aspects of Vulkan. A program that used Vulkan for nothing
+//  other than computation does not need to call this routine. However, a program that uses
+//  Vulkan in conjunction with a windowing system like GFLW has to close both down in a careful
+//  sequence. This routine, CleanupVulkanGraphics() needs to be called before the graphics surface
+//  is destroyed, which will probably happen when the window system being used is cleaned up. So
+//  the cleanup sequence needs to be 1) CleanupVulkanGraphics(), 2) Cleanup Window System, 3)
+//  CleanupVulkan(). The Window system will usually need access to the Vulkan instance to do its
+//  cleanup, so can't be called after CleanupVulkan(), but Vulkan's use of graphics, particularly
+//  the swap chain, needs to be cleaned up before the surface is destroyed. Hence this three part
+//  cleanup sequence.
+
+void KVVulkanFramework::CleanupVulkanGraphics (void)
+{
+    //  The main thing we have to do is cleanup the swap chain. Otherwise the windowing system
+    //  will have problems deleting the display surface.
+    
+    CleanupSwapChain();
+    
+    //  And we can also get rid of the various other non-swap chain graphics resources - the
+    //  various semaphores and the fences.
+    
+    for (VkSemaphore Semaphore : I_ImageSemaphoreHndls) {
+        vkDestroySemaphore(I_LogicalDevice,Semaphore,nullptr);
+    }
+    I_ImageSemaphoreHndls.clear();
+    for (VkSemaphore Semaphore : I_RenderSemaphoreHndls) {
+        vkDestroySemaphore(I_LogicalDevice,Semaphore,nullptr);
+    }
+    I_RenderSemaphoreHndls.clear();
+    for (VkFence Fence : I_FenceHndls) {
+        vkDestroyFence(I_LogicalDevice,Fence,nullptr);
+    }
+    I_FenceHndls.clear();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               C l e a n u p  V u l k a n
+//
+//  This routine closes down Vulkan, having released all its resources. It can be called explicitly,
+//  by a program that no longer needs Vulkan, or left to be called automatically from the
+//  Framework's  destructor.
+//
+//  Note:
+//     If validation is enabled, the validation layers are very good at spotting resources that
+//     have not been closed down when the Vulkan instance is deleted.
+
+void KVVulkanFramework::CleanupVulkan (void)
+{
+    //  This may well be called twice, once explicitly and once from the destructor, so when
+    //  something is destroyed, either its handle must be set to null, or the vector that contains
+    //  it and other handles must be cleared so the code doesn't attempt to destroy already
+    //  deleted items the second time round.
+    
+    //  Make sure the Vulkan graphics resources have been released.
+    
+    CleanupVulkanGraphics();
+    
+    //  Now all the rest. Shader modules
+    
+    for (VkShaderModule ShaderModuleHndl : I_ShaderModuleHndls) {
+        if (ShaderModuleHndl != VK_NULL_HANDLE) {
+            vkDestroyShaderModule(I_LogicalDevice,ShaderModuleHndl,nullptr);
+        }
+    }
+    I_ShaderModuleHndls.clear();
+    I_ShaderModuleCache.clear();
+
+    //  Descriptor set layouts
+    
+    for (VkDescriptorSetLayout LayoutHndl : I_DescriptorSetLayoutHndls) {
+        vkDestroyDescriptorSetLayout(I_LogicalDevice,LayoutHndl,nullptr);
+    }
+    I_DescriptorSetLayoutHndls.clear();
+    
+    //  Descriptor pools and command pools.
+    
+    for (VkDescriptorPool PoolHndl : I_DescriptorPoolHndls) {
+        vkDestroyDescriptorPool(I_LogicalDevice,PoolHndl,nullptr);
+    }
+    I_DescriptorPoolHndls.clear();
+    
+    //  Fences used for submissions, both those in flight and those in the free pool. Any still in
+    //  flight have to be waited for, as the command buffers they track are about to be freed.
+    
+    for (T_SubmitDetails& Details : I_Submissions) {
+        vkWaitForFences(I_LogicalDevice,1,&Details.FenceHndl,VK_TRUE,100000000000);
+        vkDestroyFence(I_LogicalDevice,Details.FenceHndl,nullptr);
+    }
+    I_Submissions.clear();
+    for (VkFence Fence : I_FreeFenceHndls) {
+        vkDestroyFence(I_LogicalDevice,Fence,nullptr);
+    }
+    I_FreeFenceHndls.clear();
+    for (VkSemaphore Semaphore : I_SemaphoreHndls) {
+        vkDestroySemaphore(I_LogicalDevice,Semaphore,nullptr);
+    }
+    I_SemaphoreHndls.clear();
+    
+    for (VkCommandPool PoolHndl : I_CommandPoolHndls) {
+        vkDestroyCommandPool(I_LogicalDevice,PoolHndl,nullptr);
+    }
+    I_CommandPoolHndls.clear();
+    I_ThreadPools.clear();
+
+    //  All the buffers
+    
+    for (size_t Index = 0; Index < I_BufferDetails.size(); Index++) {
+        T_BufferDetails& Details = I_BufferDetails[Index];
+        if (Details.InUse) {
+            ReleaseTransientBuffer(int(Index));
+            DestroyVulkanBuffer(&Details.MainBufferHndl,&Details.MainBufferMemoryHndl,
+                                                                     &Details.MainAllocation);
+            DestroyVulkanBuffer(&Details.SecondaryBufferHndl,&Details.SecondaryBufferMemoryHndl,
+                                                                 &Details.SecondaryAllocation);
+            for (T_SparseCommit& Commit : Details.SparseCommits) {
+                FreeBlockMemory(&Commit.Allocation);
+            }
+            Details.SparseCommits.clear();
+        }
+    }
+    I_BufferDetails.clear();
+    I_TransientGroups.clear();
+    
+    //  The upload ring. Its command buffers went with the command pools, and the waits for the
+    //  submission fences above mean none of them can still be executing.
+    
+    if (I_UploadRingAddress) UnmapBlockMemory(I_UploadRingAllocation);
+    DestroyVulkanBuffer(&I_UploadRingBufferHndl,&I_UploadRingMemoryHndl,&I_UploadRingAllocation);
+    I_UploadRingAddress = nullptr;
+    I_UploadRingSize = I_UploadRingHead = I_UploadRingTail = I_UploadRingUsed = 0;
+    I_UploadPendingBytes = 0;
+    I_UploadSegments.clear();
+    I_PendingUploads.clear();
+    
+    //  And the pooled memory blocks the buffers used. (This unmaps any that are still mapped.)
+    
+    ReleaseMemoryBlocks();
+    
+    //  Pipelines
+    
+    for (T_PipelineDetails Details : I_PipelineDetails) {
+        vkDestroyPipelineLayout(I_LogicalDevice,Details.PipelineLayoutHndl,nullptr);
+        vkDestroyPipeline(I_LogicalDevice,Details.PipelineHndl,nullptr);
+    }
+    I_PipelineDetails.clear();
+    
+    //  Timestamp query pools.
+    
+    if (I_TimestampQueryPoolHndl != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(I_LogicalDevice,I_TimestampQueryPoolHndl,nullptr);
+        I_TimestampQueryPoolHndl = VK_NULL_HANDLE;
+    }
+    if (I_DispatchQueryPoolHndl != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(I_LogicalDevice,I_DispatchQueryPoolHndl,nullptr);
+        I_DispatchQueryPoolHndl = VK_NULL_HANDLE;
+    }
+    if (I_StatisticsQueryPoolHndl != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(I_LogicalDevice,I_StatisticsQueryPoolHndl,nullptr);
+        I_StatisticsQueryPoolHndl = VK_NULL_HANDLE;
+    }
+    
+    //  The pipeline cache, which is saved to disk first so the next run can use it.
+    
+    SavePipelineCache();
+
+    //  Render passes
+    
+    if (I_RenderPass != VK_NULL_HANDLE) vkDestroyRenderPass(I_LogicalDevice,I_RenderPass, nullptr);
+    I_RenderPass = VK_NULL_HANDLE;
+
+    //  Logical devices
+    
+    if (I_LogicalDevice != VK_NULL_HANDLE) vkDestroyDevice(I_LogicalDevice,nullptr);
+    I_LogicalDevice = VK_NULL_HANDLE;
+    
+    //  And, finally, the instance itself, together with any disgnostic layers
+    
+    if (I_Instance != VK_NULL_HANDLE) {
+        
+        //  Delete the VkDebugUtilsMessengerEXT object used for handling diagnostics. As with its
+        //  creation, we have to first locate the extension routine that can do this, and then
+        //  call it.
+        
+        if (I_DebugMessenger != VK_NULL_HANDLE) {
+            auto Function = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(I_Instance,
+                                                        "vkDestroyDebugUtilsMessengerEXT");
+            if (Function != nullptr) Function(I_Instance,I_DebugMessenger,nullptr);
+            I_DebugMessenger = VK_NULL_HANDLE;
+        }
+        
+        //  And now that we don't need the Vulkan instance any more, we can delete it.
+        //  The physical device (or at least, the Vulkan handle to it) is regarded as created
+        //  by the instance and is destroyed with it - we don't need to destroy I_PhysicalDevice.
+        
+        vkDestroyInstance(I_Instance,nullptr);
+        I_Instance = VK_NULL_HANDLE;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                 S e t u p  D e b u g  M e s s e n g e r  I n f o   (Internal routine)
+//
+//  This is an internal utility used by CreateVulkanInstance() which calls it as part of the
+//  process of enabling validation layers, should that be required. It is passed a structure
+//  of type VkDebugUtilsMessengerCreateInfoEXT, which is used to tell the validation layers
+//  which routine to call when they have something to report, and under what circumstances
+//  they should do so - basically what sort of validation and other messages should be reported.
+//  This sets the static routine DebugUtilsCallback() as the routine for the validation layers to
+//  call.
+//
+//  Parameters:
+//     DebugInfo  (VkDebugUtilsMessengerCreateInfoEXT&) The structure to be set up.
+
+void KVVulkanFramework::SetupDebugMessengerInfo (VkDebugUtilsMessengerCreateInfoEXT& DebugInfo)
+{
+    //  This enables the most useful messages. The callback routine has to be a static routine,
+    //  as the Vulkan diagnostics have no idea of the KVVulkanFramework class, but the .pUserData
+    //  field can be used to pass the address of the current KVVulkanFramework object to the
+    //  callback routine. There are a often a lot of information messages generated, enabled by
+    //  the VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT being set, but these are suppressed by
+    //  default unless enabled explicitly using EnableValidationLevels().
+    
+    DebugInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    DebugInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    DebugInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    DebugInfo.pfnUserCallback = DebugUtilsCallback;
+    DebugInfo.pUserData = this;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         A d d  I n s t a n c e  E x t e n s i o n s
+//
+//  This routine is provided to enable the interaction between Vulkan and a windowing system being
+//  used to provide the display surface Vulkan needs for graphics output. Such a windowing system
+//  (such as GLFW) may - probably will - need Vulkan to support certain specific extensions, and
+//  these will need to be explicitly enabled when the initial Vulkan Instance is created. So this
+//  needs to be called before CreateVulkanInstance() if Vulkan graphics facilities are needed.
+//  It is passed a list of named Vulkan extensions that the windowing system requires. GLFW has
+//  a routine, glfwGetRequiredInstanceExtensions() that supplies the names needed for such a list.
+//
+//  Parameters:
+//     ExtensionNames  (const std::vector<const char*>&) The list of named extensions that need
+//                     to be enabled.
+//
+//  Note:
+//     This routine must be called before CreateVulkanInstance().
+
+void KVVulkanFramework::AddInstanceExtensions(
+        const std::vector<const char*>& ExtensionNames,bool& StatusOK)
+{
+    //  All we have to do is add these names to I_RequiredInstanceExtensions.
+    
+    if (!AllOK(StatusOK)) return;
+    I_Debug.Log ("Instance","Adding Required Instance Extensions.");
+    for (const char* NamePtr : ExtensionNames) I_RequiredInstanceExtensions.push_back(NamePtr);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        A d d  G r a p h i c s  E x t e n s i o n s
+//
+//  This routine is similar to AddInstanceExtensions() but whereas AddInstanceExtensions() is used
+//  to specify extensions that the Vulkan instance must support, AddGraphicsExtensions() is used
+//  to specify extensions that any physical GPU to be used must support. This is used internally
+//  to require swap chain support to be supported by any device to be used for graphics display,
+//  but could also be used if any windowing system were to have specific device-level extension
+//  requirements. (Note that GLFW does not have any such requirements.)
+//
+//  Parameters:
+//     ExtensionNames  (const std::vector<const char*>&) The list of named extensions that need
+//                     to be enabled.
+//  Note:
+//     This routine must be called before FindSuitableDevice().
+
+void KVVulkanFramework::AddGraphicsExtensions(
+    const std::vector<const char*>& ExtensionNames,bool& StatusOK)
+{
+    //  All we have to do is add these names to I_RequiredGraphicsExtensions.
+    
+    if (!AllOK(StatusOK)) return;
+    I_Debug.Log ("Instance","Adding to Required Graphics Extensions.");
+    for (const char* NamePtr : ExtensionNames) I_RequiredGraphicsExtensions.push_back(NamePtr);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                    G e t  D i a g n o s t i c  L a y e r s    (internal routine)
+//
+//  There are a couple of places where the code needs to know which diagnostic layers are to be
+//  enabled. This routine returns a vector of the names of the enabled layers.
+//
+//  Parameters: None.
+//
+//  Returns:
+//     (const std::vector<const char*>&)  The list of diagnostic layers to be enabled.
+
+const std::vector<const char*>& KVVulkanFramework::GetDiagnosticLayers(void)
+{
+    //  If we are enabling diagnostics, we will aim to use the VK_LAYER_KHRONOS_validation
+    //  layer, if it is available. This is described as providing all the useful standard
+    //  validation. For the moment at least, this name is hard-coded here.
+
+    static const std::vector<const char*> LayerNames = {"VK_LAYER_KHRONOS_validation"};
+    return LayerNames;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       L o g  V a l i d a t i o n  E r r o r    (internal routine)
+//
+//  This is the default routine called by DebugUtilsCallback() to log an error message.
+//  It simply outputs it to the error stream, prefaced by a string to indicate that it
+//  represents an error.
+//
+//  Parameters:
+//     Message     (const char*) The address of a nul-terminated error string.
+//
+//  Note:
+//     The message is ignored unless error messages have been enabled through EnableValidation()
+//     which enables them by default, or through EnableValidationLevels() which provides more
+//     explicit control.
+
+void KVVulkanFramework::LogValidationError(const char* Message)
+{
+    if (I_EnableValidationErrors) std::cerr << "*** Error: " << Message << '\n';
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       L o g  V a l i d a t i o n  W a r n i n g    (internal routine)
+//
+//  This is the default routine called by DebugUtilsCallback() to log a warning message.
+//  It simply outputs it to the error stream, prefaced by a string to indicate that it
+//  represents a warning.
+//
+//  Parameters:
+//     Message     (const char*) The address of a nul-terminated warning.
+//
+//  Note:
+//     The message is ignored unless warnings have been enabled through EnableValidation()
+//     which enables them by default, or through EnableValidationLevels() which provides more
+//     explicit control.
+
+void KVVulkanFramework::LogValidationWarning(const char* Message)
+{
+    if (I_EnableValidationWarnings) std::cerr << "* Warning: " << Message << '\n';
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         L o g  V a l i d a t i o n  I n f o    (internal routine)
+//
+//  This is the default routine called by DebugUtilsCallback() to log a informational message.
+//  It simply outputs it to the output stream, prefaced by a string to indicate that it
+//  represents an informational message.
+//
+//  Parameters:
+//     Message     (const char*) The address of a nul-terminated warning.
+//
+//  Note:
+//     The message is ignored unless informational messages have been enabled explicitly through
+//     EnableValidationLevels().
+
+void KVVulkanFramework::LogValidationInfo(const char* Message)
+{
+    if (I_EnableValidationInformation) std::cout << "Information: " << Message << '\n';
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         D e b u g  U t i l s  C a l l b a c k    (internal routine)
+//
+//  This is the static routine set up to be called by the validation layers when they have
+//  something to report. The calling sequence for this is defined by Vulkan.
+//
+//  Parameters:
+//     MessageSeverity   (VkDebugUtilsMessageSeverityFlagBitsEXT) A Vulkan code indicating
+//                       how the message has been classed - error, warning, information, etc.
+//     MessageType       (VkDebugUtilsMessageTypeFlagsEXT) A Vulkan code indicating the type
+//                       of the message - this is currently ignored by this routine. (It is
+//                       used to indicate the sort of occurrence that has triggered the
+//                       message - a violation of Vulkan rules, sub-optimal usage, etc...)
+//     CallbackData      (const VkDebugUtilsMessengerCallbackDataEXT*) A Vulkan structure that
+//                       includes the text of the message.
+//     UserData          (void*) User-supplied data. This must the the address of the Framework,
+//                       to allow Framework routines such as LogValidationError() to be called by
+//                       this static routine.
+//
+//  Returns:
+//     (VkBool)          Returned as VK_TRUE if the Vulkan call that triggered the message
+//                       should be aborted, and VK_FALSE if not.
+
+VKAPI_ATTR VkBool32 VKAPI_CALL KVVulkanFramework::DebugUtilsCallback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT MessageSeverity,
+    VkDebugUtilsMessageTypeFlagsEXT /*MessageType*/,
+    const VkDebugUtilsMessengerCallbackDataEXT* CallbackData,
+    void* UserData)
+ {
+    if (UserData) {
+        
+        //  Get the address of the Framework, and call the appropriate routine.
+        
+        KVVulkanFramework* FrameworkObject = (KVVulkanFramework*) UserData;
+        if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
+            FrameworkObject->LogValidationInfo(CallbackData->pMessage);
+        } else if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+            FrameworkObject->LogValidationInfo(CallbackData->pMessage);
+        } else if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+            FrameworkObject->LogValidationWarning(CallbackData->pMessage);
+        } else if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+            FrameworkObject->SetValidationError(true);
+            FrameworkObject->LogValidationError(CallbackData->pMessage);
+        } else {
+            
+            //  This catches any other message types, such as the vebose information type.
+            
+            FrameworkObject->LogValidationInfo(CallbackData->pMessage);
+        }
+    }
+    
+    //  The Vulkan tutorial says this should always return false - it's only when it's being used
+    //  to test the validation layers themselves that it should return true.
+    
+    return VK_FALSE;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           S e t  V a l i d a t i o n  E r r o r    (internal routine)
+//
+//  This routine exists solely to allow the static routine DebugUtilsCallback() to flag that
+//  the Vulcan validation layers have detected an error. It sets the Framework's internal flag
+//  that indicates this. (The parameter allows it to be set or cleared, but at the moment there's
+//  no call to have it cleared externally.) Technically this is not an internal routine, as it
+//  needs to be callable by DebugUtilsCallback(), but it is not intended to be called from
+//  outside the Framework code.
+//
+//  Parameters:
+//     Set           (bool) True if the internal 'validation error detected' flag is to be set.
+//                   False if it is to be cleared.
+
+void KVVulkanFramework::SetValidationError(bool Set)
+{
+    I_ValidationErrorFlagged = Set;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  L o g  E r r o r      (internal routine)
+//
+//  Logs an error message, formatting it like printf(). The supplied message will be formatted and
+//  output, with a new line character appended. This also sets the internal 'error' flag tested
+//  by AllOK().
+//
+//  Parameters:
+//     Format        (const char* const) A printf() style formatting string. This can be followed
+//                   by a variable number of additional arguments as required.
+
+
+void KVVulkanFramework::LogError (const char* const Format, ...)
+{
+    char Message[1024];
+    va_list Args;
+    va_start (Args,Format);
+    vsnprintf (Message,sizeof(Message),Format,Args);
+    cerr << "[" << I_Debug.GetSubSystem() << "] *** Error: " << Message << " ***\n";
+    I_ErrorFlagged = true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               L o g  W a r n i n g      (internal routine)
+//
+//  Logs a warning message, formatting it like printf(). The supplied message will be formatted and
+//  output, with a new line character appended.
+//
+//  Parameters:
+//     Format        (const char* const) A printf() style formatting string. This can be followed
+//                   by a variable number of additional arguments as required.
+
+
+void KVVulkanFramework::LogWarning (const char* const Format, ...)
+{
+    char Message[1024];
+    va_list Args;
+    va_start (Args,Format);
+    vsnprintf (Message,sizeof(Message),Format,Args);
+    cerr << "[" << I_Debug.GetSubSystem() << "] * Warning: " << Message << " *\n";
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             L o g  V u l k a n  E r r o r      (internal routine)
+//
+//  Should be called when a Vulkan routine returns an error. It logs the details of the error,
+//  including the name of the Vulkan routine and a readable version of the status it returned.
+//
+//  Parameters:
+//     Text        (const std::string&) The main text to be output. This should be used to
+//                 give some idea of the circumstances in which the error occurred.
+//     Routine     (const std::string&) The name of the Vulkan routine returning the error code.
+//     Result      (VkResult) The Vulkan status code returned by the routine.
+
+void KVVulkanFramework::LogVulkanError(
+        const std::string& Text,const std::string& Routine, VkResult Result)
+{
+    std::string ResultText(string_VkResult(Result));
+    std::string Message = Text + " " + Routine + " returned code " + ResultText + ".";
+    LogError(Message.c_str());
+    I_ErrorFlagged = true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              D e v i c e  H a s  P o r t a b i l i t y  S u b s e t    (internal routine)
+//
+//  A tricky issue is to do with the portability subset. Mostly this an issue for code running
+//  on Macintoshes using MoltenVK, but in principle it's more general. Vulkan allows for
+//  devices that support a limited set of features, the portability subset. MoltenVK is a layer
+//  that uses the Macintosh native Metal system to emulate Vulkan, and it implements the
+//  portability subset. Vulkan doesn't want people to be using devices that only support a
+//  subset to do so blindly - not realising they are using a limited implementation. So if
+//  a device only supports the portability subset, Vulkan requires that the code explicitly
+//  request that subset. That way, Vulkan assumes you know what you're doing. So we look to
+//  see if this is such a device, and if so (we're probably on a Mac) we will need to add it
+//  to the enabled extensions. This routine checks the list of extensions supported by the
+//  selected device and returns true if they include the portability subset.
+//
+//  Parameters:
+//     Extensions   (std::vector<VkExtensionProperties>&) Lists the details of the extensions
+//                  supported by the device, including their names.
+//
+//  Returns:
+//     (bool)        True if the list of device extensions includes the portability subset.
+
+bool KVVulkanFramework::DeviceHasPortabilitySubset(std::vector<VkExtensionProperties>& Extensions)
+{
+    bool Found = false;
+    for (const VkExtensionProperties& Property : Extensions) {
+        if (!strcmp("VK_KHR_portability_subset",Property.extensionName)) {
+            Found = true;
+            break;
+        }
+    }
+    return Found;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  M a p  B u f f e r
+//
+//  This routine maps the CPU memory allocated for a buffer and returns a pointer to it.
+//  The pointer will remain valid so long as the buffer remains unchanged. However, once
+//  the buffer is deleted, its address range will no longer be accessible. If the buffer
+//  is resized, it will generally be unmapped, and should be remapped before attempting
+//  to access its data. This routine can be called multiple times for a given buffer - the
+//  first call will result in a call to Vulkan to actually map the buffer, subsequent calls
+//  will simply return the mapped address. A buffer will be unmapped when the Framework is
+//  shut down or the buffer deleted, and can be explicitly unmapped through a call to
+//  UnmapBuffer().
+//
+//  Parameters:
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     SizeInBytes   (VkDeviceSize*) Receives the size of the buffer in bytes.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (void*)       The address of the mapped buffer.
+//
+//  Pre-requisites:
+//     SetBufferDetails() must have been called to describe how the buffer will be used
+//     and to return the buffer handle that is passed to this routine and the buffer and its
+//     associated memory should already have been created using CreateBuffer().
+//
+//  Note:
+//     o If the buffer is local to the GPU (ie if the call to SetBufferDetails() specified "LOCAL"
+//     as the access string), its data cannot be mapped and this routine will return with bad
+//     status.
+//     o For a buffer created by ImportBuffer(), this returns the imported host address, or the
+//     address of the copy if the memory could not be imported.
+
+void* KVVulkanFramework::MapBuffer(KVBufferHandle BufferHndl,VkDeviceSize* SizeInBytes,
+                                                                                bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return nullptr;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    *SizeInBytes = 0;
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    void* MappedAddress = nullptr;
+    if (AllOK(StatusOK)) {
+        
+        //  See if the buffer has already been mapped, in which case we know the mapped address.
+
+        if (I_BufferDetails[Index].MappedAddress) {
+            MappedAddress = I_BufferDetails[Index].MappedAddress;
+        } else {
+            
+            //  If not, we have to map it now. The buffer memory is part of a larger pooled
+            //  block, and Vulkan only allows a block to be mapped once, so what we actually
+            //  get is the address of the buffer's range within the mapped block. This covers
+            //  the whole of the allocated memory (which can be more than the current size of
+            //  the buffer, if the buffer was ever resized down).
+            
+            MappedAddress = MapBlockMemory(I_BufferDetails[Index].MainAllocation,StatusOK);
+            if (!AllOK(StatusOK)) {
+                MappedAddress = nullptr;
+            } else {
+                
+                //  Record the mapped address in the buffer details.
+                
+                I_BufferDetails[Index].MappedAddress = MappedAddress;
+            }
+        }
+        if (AllOK(StatusOK)) *SizeInBytes = I_BufferDetails[Index].SizeInBytes;
+    }
+    return MappedAddress;
+}
+
+//  This version of MapBuffer() returns the size as a long, as it always used to, which is fine
+//  for the buffers most programs use, but is only 32 bits under Windows. A buffer too large for
+//  that is reported as an error, rather than having its size quietly truncated.
+
+void* KVVulkanFramework::MapBuffer(KVBufferHandle BufferHndl,long* SizeInBytes,bool& StatusOK)
+{
+    VkDeviceSize Bytes = 0;
+    *SizeInBytes = 0;
+    void* MappedAddress = MapBuffer(BufferHndl,&Bytes,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (Bytes > VkDeviceSize(std::numeric_limits<long>::max())) {
+            LogError ("Buffer of %llu bytes is too large for its size to be returned as a long",
+                                                                     (unsigned long long)Bytes);
+            StatusOK = false;
+            MappedAddress = nullptr;
+        } else {
+            *SizeInBytes = long(Bytes);
+        }
+    }
+    return MappedAddress;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  U n m a p  B u f f e r
+//
+//  This routine unmaps the CPU memory allocated for a buffer. Following this, its address
+//  range as returned by MapBuffer() will no longer be accessible (although until the buffer is
+//  deleted it can always be remapped if necessary). A buffer will be unmapped automatically when
+//  the Framework is shut down or the buffer deleted, and this routine does not need to be called
+//  as a preliminary to deleting a buffer.
+//
+//  Parameters:
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Pre-requisites:
+//     MapBuffer() must previously have been called to map the buffer.
+//
+//  Note:
+//     If the buffer has not in fact been mapped, this routine returns without indicating an error.
+
+void KVVulkanFramework::UnmapBuffer(KVBufferHandle BufferHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        
+        //  Only unmap the buffer if it's actually been mapped. (The memory block it uses is
+        //  only unmapped once no other buffer in the same block needs it mapped.) An imported
+        //  buffer is simply host memory and stays accessible, so is left alone.
+        
+        if (I_BufferDetails[Index].MappedAddress &&
+                            I_BufferDetails[Index].BufferAccess != ACCESS_IMPORTED) {
+            UnmapBlockMemory(I_BufferDetails[Index].MainAllocation);
+            I_BufferDetails[Index].MappedAddress = nullptr;
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  S y n c  B u f f e r
+//
+//  This routine synchronizes a staged buffer. Such a buffer is implemented using two separate
+//  buffers of the same size, one local to the CPU and one local to the GPU, and the program
+//  using them is responsible for indicating when they need to be brought into sync. These are
+//  usually used when there are significant overheads associated with the use of shared buffers
+//  (ones that both the CPU and GPU can access, and which rely on the underlying system to ensure
+//  that the CPU and GPU both see the same data when they do access them). In such cases, a program
+//  may for example, create a 'staging' buffer on the CPU, write into it and then copy its contents
+//  in one go - presumably this is a relatively efficient process - to the corresponding GPU buffer.
+//  Alternatively, the GPU may be used to fill a buffer local to the GPU, and this can then be
+//  copied over to the corresponding CPU buffer. So the buffer handle passed should be that for
+//  a buffer created as either "STAGED_CPU" or "STAGED_GPU", and which was used will determine the
+//  direction of transfer set up by this routine - a "STAGED_CPU" buffer is synched by copying the
+//  CPU side buffer over to the GPU side buffer, and a "STAGED_GPU" buffer is synched by a transfer
+//  in the opposite direction.
+//
+//  Parameters:
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used
+//                   to set up the required transfer.
+//     QueueHandl    (VkQueue) A Vulkan handle specifying the queue to be used for the required
+//                   transfer.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Pre-requisites:
+//     o SetBufferDetails() must have been called to return the buffer handle that is passed to
+//     this routine, the buffer should have access "STAGED_GPU" or "STAGED_CPU" and the CPU and
+//     GPU buffers and their associated memory should already have been created using
+//     CreateBuffer().
+//     o The transfer is performed by setting up a transfer operation on the GPU, and this requires
+//     allocation of a command buffer from a pool, and a queue to run that command on. The command
+//     pool should be one created using CreatCommandPool(), and the queue should be obtained using
+//     by GetDeviceQueue().
+//
+//  Note:
+//     o If the buffer is not in fact a staged buffer, this routine returns without indicating an
+//     error. This makes it easier to experiment with the use of shared buffers as opposed to
+//     staged ones - just include the call to SyncBuffer() in both cases where needed, and this
+//     will work for either shared or staged buffers.
+//     o For a "READBACK" or "STAGED_GPU" buffer in memory that isn't coherent, this routine also
+//     invalidates the CPU's view of the memory, so it sees what the GPU wrote.
+//     o The command buffer used for the copy is recorded the first time it is needed and is then
+//     re-used for all subsequent syncs of the same buffer, until the buffer is resized.
+//     o This routine waits for the copy to complete. SubmitSyncBuffer() does the same copy
+//     without waiting, and RecordComputeCommandBuffer() can include the copies as part of a
+//     compute command buffer, so no separate submission is needed at all.
+
+void KVVulkanFramework::SyncBuffer(KVBufferHandle BufferHndl,VkCommandPool CommandPoolHndl,
+                                                           VkQueue QueueHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    TraceScope Trace("SyncBuffer","Vulkan");
+    
+    //  This is now just an asynchronous submission followed immediately by a wait. For an
+    //  unstaged buffer, SubmitSyncBuffer() returns a null ticket, which WaitFor() ignores.
+    
+    KVSubmitTicket Ticket = SubmitSyncBuffer(BufferHndl,CommandPoolHndl,QueueHndl,
+                                                     VK_NULL_HANDLE,VK_NULL_HANDLE,StatusOK);
+    WaitFor(Ticket,StatusOK);
+    
+    //  Data the CPU is about to read may need its mapped memory invalidated first.
+    
+    InvalidateBuffer(BufferHndl,StatusOK);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                     C l e a n u p  V u l k a n  G r a p h i c s
+//                            S y n c  B u f f e r  R a n g e
 //
-//  This routine cleans up the graphics aspects of Vulkan. A program that used Vulkan for nothing
-//  other than computation does not need to call this routine. However, a program that uses
-//  Vulkan in conjunction with a windowing system like GFLW has to close both down in a careful
-//  sequence. This routine, CleanupVulkanGraphics() needs to be called before the graphics surface
-//  is destroyed, which will probably happen when the window system being used is cleaned up. So
-//  the cleanup sequence needs to be 1) CleanupVulkanGraphics(), 2) Cleanup Window System, 3)
-//  CleanupVulkan(). The Window system will usually need access to the Vulkan instance to do its
-//  cleanup, so can't be called after CleanupVulkan(), but Vulkan's use of graphics, particularly
-//  the swap chain, needs to be cleaned up before the surface is destroyed. Hence this three part
-//  cleanup sequence.
+//  This routine synchronises just part of a staged buffer - a contiguous range of bytes - in
+//  the same way that SyncBuffer() synchronises the whole buffer. If only part of a buffer has
+//  been changed, only that part needs to be copied. Like SyncBuffer() it waits for the transfer
+//  to complete, and it does nothing for an unstaged buffer.
+//
+//  Parameters:
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     Offset        (VkDeviceSize) The offset in bytes from the start of the buffer of the
+//                   range to sync.
+//     Length        (VkDeviceSize) The length in bytes of the range to sync.
+//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used
+//                   to set up the required transfer.
+//     QueueHandl    (VkQueue) A Vulkan handle specifying the queue to be used for the required
+//                   transfer.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     As for SyncBuffer(). The range must lie within the buffer.
 
-void KVVulkanFramework::CleanupVulkanGraphics (void)
+void KVVulkanFramework::SyncBufferRange(KVBufferHandle BufferHndl,VkDeviceSize Offset,
+                                                                           VkDeviceSize Length,
+                            VkCommandPool CommandPoolHndl,VkQueue QueueHndl,bool& StatusOK)
 {
-    //  The main thing we have to do is cleanup the swap chain. Otherwise the windowing system
-    //  will have problems deleting the display surface.
-    
-    CleanupSwapChain();
-    
-    //  And we can also get rid of the various other non-swap chain graphics resources - the
-    //  various semaphores and the fences.
-    
-    for (VkSemaphore Semaphore : I_ImageSemaphoreHndls) {
-        vkDestroySemaphore(I_LogicalDevice,Semaphore,nullptr);
-    }
-    I_ImageSemaphoreHndls.clear();
-    for (VkSemaphore Semaphore : I_RenderSemaphoreHndls) {
-        vkDestroySemaphore(I_LogicalDevice,Semaphore,nullptr);
-    }
-    I_RenderSemaphoreHndls.clear();
-    for (VkFence Fence : I_FenceHndls) {
-        vkDestroyFence(I_LogicalDevice,Fence,nullptr);
-    }
-    I_FenceHndls.clear();
+    std::vector<KVBufferRegion> Regions(1);
+    Regions[0].Offset = Offset;
+    Regions[0].Length = Length;
+    SyncBufferRegions(BufferHndl,Regions,CommandPoolHndl,QueueHndl,StatusOK);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                               C l e a n u p  V u l k a n
+//                           S y n c  B u f f e r  R e g i o n s
 //
-//  This routine closes down Vulkan, having released all its resources. It can be called explicitly,
-//  by a program that no longer needs Vulkan, or left to be called automatically from the
-//  Framework's  destructor.
+//  This routine synchronises a number of separate regions of a staged buffer, all in a single
+//  copy command. For example, a few changed rows of an image, or a number of bands, can be
+//  transferred together without copying the rest of the buffer. Like SyncBuffer() it waits for
+//  the transfer to complete, and it does nothing for an unstaged buffer.
+//
+//  Parameters:
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     Regions       (const std::vector<KVBufferRegion>&) The regions of the buffer to sync, each
+//                   an offset and a length in bytes. They may be in any order and may overlap.
+//                   Zero-length regions are ignored.
+//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used
+//                   to set up the required transfer.
+//     QueueHandl    (VkQueue) A Vulkan handle specifying the queue to be used for the required
+//                   transfer.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     As for SyncBuffer(). All the regions must lie within the buffer.
 //
 //  Note:
-//     If validation is enabled, the validation layers are very good at spotting resources that
-//     have not been closed down when the Vulkan instance is deleted.
+//     Because the regions will usually change from one call to the next, this can't use the
+//     pre-recorded command buffer SyncBuffer() uses. Instead, it records a one-time command
+//     buffer for each call. The regions are sorted and any that overlap or touch are merged,
+//     since Vulkan doesn't allow the destination regions of a single copy to overlap.
 
-void KVVulkanFramework::CleanupVulkan (void)
+void KVVulkanFramework::SyncBufferRegions(KVBufferHandle BufferHndl,
+        const std::vector<KVBufferRegion>& Regions,VkCommandPool CommandPoolHndl,
+                                                           VkQueue QueueHndl,bool& StatusOK)
 {
-    //  This may well be called twice, once explicitly and once from the destructor, so when
-    //  something is destroyed, either its handle must be set to null, or the vector that contains
-    //  it and other handles must be cleared so the code doesn't attempt to destroy already
-    //  deleted items the second time round.
-    
-    //  Make sure the Vulkan graphics resources have been released.
-    
-    CleanupVulkanGraphics();
-    
-    //  Now all the rest. Shader modules
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    for (VkShaderModule ShaderModuleHndl : I_ShaderModuleHndls) {
-        if (ShaderModuleHndl != VK_NULL_HANDLE) {
-            vkDestroyShaderModule(I_LogicalDevice,ShaderModuleHndl,nullptr);
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (!AllOK(StatusOK)) return;
+    if (I_BufferDetails[Index].BufferAccess != ACCESS_STAGED_CPU &&
+        I_BufferDetails[Index].BufferAccess != ACCESS_STAGED_GPU) return;
+    
+    //  Check the regions, and sort and merge them into the set of copy regions needed.
+    
+    std::vector<KVBufferRegion> SortedRegions;
+    VkDeviceSize SizeInBytes = I_BufferDetails[Index].SizeInBytes;
+    for (const KVBufferRegion& Region : Regions) {
+        if (Region.Offset > SizeInBytes || Region.Length > SizeInBytes - Region.Offset) {
+            LogError("Sync region offset %llu, length %llu, is outside buffer of %llu bytes.",
+                           (unsigned long long)Region.Offset,(unsigned long long)Region.Length,
+                                                               (unsigned long long)SizeInBytes);
+            StatusOK = false;
+            return;
         }
+        if (Region.Length > 0) SortedRegions.push_back(Region);
     }
-    I_ShaderModuleHndls.clear();
-
-    //  Descriptor set layouts
-    
-    for (VkDescriptorSetLayout LayoutHndl : I_DescriptorSetLayoutHndls) {
-        vkDestroyDescriptorSetLayout(I_LogicalDevice,LayoutHndl,nullptr);
-    }
-    I_DescriptorSetLayoutHndls.clear();
-    
-    //  Descriptor pools and command pools.
-    
-    for (VkDescriptorPool PoolHndl : I_DescriptorPoolHndls) {
-        vkDestroyDescriptorPool(I_LogicalDevice,PoolHndl,nullptr);
-    }
-    I_DescriptorPoolHndls.clear();
-    for (VkCommandPool PoolHndl : I_CommandPoolHndls) {
-        vkDestroyCommandPool(I_LogicalDevice,PoolHndl,nullptr);
-    }
-    I_CommandPoolHndls.clear();
-
-    //  All the buffers
-    
-    for (T_BufferDetails Details : I_BufferDetails) {
-        if (Details.InUse) {
-            vkFreeMemory(I_LogicalDevice,Details.MainBufferMemoryHndl,nullptr);
-            vkDestroyBuffer(I_LogicalDevice,Details.MainBufferHndl,nullptr);
-            if (Details.BufferAccess == ACCESS_STAGED_CPU ||
-                Details.BufferAccess == ACCESS_STAGED_GPU ) {
-                vkFreeMemory(I_LogicalDevice,Details.SecondaryBufferMemoryHndl,nullptr);
-                vkDestroyBuffer(I_LogicalDevice,Details.SecondaryBufferHndl,nullptr);
-            }
+    std::sort(SortedRegions.begin(),SortedRegions.end(),
+              [](const KVBufferRegion& A,const KVBufferRegion& B) { return A.Offset < B.Offset; });
+    std::vector<VkBufferCopy> CopyRegions;
+    for (const KVBufferRegion& Region : SortedRegions) {
+        VkDeviceSize Start = Region.Offset;
+        VkDeviceSize End = Region.Offset + Region.Length;
+        if (CopyRegions.size() > 0 &&
+                        Start <= CopyRegions.back().srcOffset + CopyRegions.back().size) {
+            VkBufferCopy& Last = CopyRegions.back();
+            if (End > Last.srcOffset + Last.size) Last.size = End - Last.srcOffset;
+        } else {
+            VkBufferCopy CopyRegion{};
+            CopyRegion.srcOffset = CopyRegion.dstOffset = Start;
+            CopyRegion.size = End - Start;
+            CopyRegions.push_back(CopyRegion);
         }
     }
-    I_BufferDetails.clear();
+    if (CopyRegions.size() == 0) return;
+    I_Debug.Logf ("Buffers","Synching %d regions of buffer %ld",int(CopyRegions.size()),BufferHndl);
     
-    //  Pipelines
+    //  Record a one-time command buffer with the copy, and run it.
     
-    for (T_PipelineDetails Details : I_PipelineDetails) {
-        vkDestroyPipelineLayout(I_LogicalDevice,Details.PipelineLayoutHndl,nullptr);
-        vkDestroyPipeline(I_LogicalDevice,Details.PipelineHndl,nullptr);
+    VkCommandBufferAllocateInfo AllocInfo{};
+    AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    AllocInfo.commandPool = CommandPoolHndl;
+    AllocInfo.commandBufferCount = 1;
+    VkCommandBuffer CommandBufferHndl;
+    VkResult Result = vkAllocateCommandBuffers(I_LogicalDevice,&AllocInfo,&CommandBufferHndl);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to allocate sync command buffer","vkAllocateCommandBuffers",
+                                                                                        Result);
+        StatusOK = false;
+        return;
     }
-    I_PipelineDetails.clear();
-
-    //  Render passes
-    
-    if (I_RenderPass != VK_NULL_HANDLE) vkDestroyRenderPass(I_LogicalDevice,I_RenderPass, nullptr);
-    I_RenderPass = VK_NULL_HANDLE;
-
-    //  Logical devices
-    
-    if (I_LogicalDevice != VK_NULL_HANDLE) vkDestroyDevice(I_LogicalDevice,nullptr);
-    I_LogicalDevice = VK_NULL_HANDLE;
-    
-    //  And, finally, the instance itself, together with any disgnostic layers
-    
-    if (I_Instance != VK_NULL_HANDLE) {
-        
-        //  Delete the VkDebugUtilsMessengerEXT object used for handling diagnostics. As with its
-        //  creation, we have to first locate the extension routine that can do this, and then
-        //  call it.
-        
-        if (I_DebugMessenger != VK_NULL_HANDLE) {
-            auto Function = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(I_Instance,
-                                                        "vkDestroyDebugUtilsMessengerEXT");
-            if (Function != nullptr) Function(I_Instance,I_DebugMessenger,nullptr);
-            I_DebugMessenger = VK_NULL_HANDLE;
+    VkCommandBufferBeginInfo BeginInfo{};
+    BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    Result = vkBeginCommandBuffer(CommandBufferHndl,&BeginInfo);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to begin recording sync command buffer",
+                                                             "vkBeginCommandBuffer",Result);
+        StatusOK = false;
+    } else {
+        RecordSyncCopyRegions(Index,CommandBufferHndl,CopyRegions);
+        if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) {
+            RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_ACCESS_TRANSFER_WRITE_BIT,VK_PIPELINE_STAGE_HOST_BIT,
+                                VK_ACCESS_HOST_READ_BIT);
+        }
+        Result = vkEndCommandBuffer(CommandBufferHndl);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to record sync command buffer","vkEndCommandBuffer",Result);
+            StatusOK = false;
+        } else {
+            KVSubmitTicket Ticket = SubmitCommandBuffer(QueueHndl,CommandBufferHndl,StatusOK);
+            WaitFor(Ticket,StatusOK);
         }
-        
-        //  And now that we don't need the Vulkan instance any more, we can delete it.
-        //  The physical device (or at least, the Vulkan handle to it) is regarded as created
-        //  by the instance and is destroyed with it - we don't need to destroy I_PhysicalDevice.
-        
-        vkDestroyInstance(I_Instance,nullptr);
-        I_Instance = VK_NULL_HANDLE;
     }
+    vkFreeCommandBuffers(I_LogicalDevice,CommandPoolHndl,1,&CommandBufferHndl);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                 S e t u p  D e b u g  M e s s e n g e r  I n f o   (Internal routine)
+//                             I n v a l i d a t e  B u f f e r
 //
-//  This is an internal utility used by CreateVulkanInstance() which calls it as part of the
-//  process of enabling validation layers, should that be required. It is passed a structure
-//  of type VkDebugUtilsMessengerCreateInfoEXT, which is used to tell the validation layers
-//  which routine to call when they have something to report, and under what circumstances
-//  they should do so - basically what sort of validation and other messages should be reported.
-//  This sets the static routine DebugUtilsCallback() as the routine for the validation layers to
-//  call.
+//  This routine makes sure that the CPU sees the data the GPU has written into a buffer. If the
+//  buffer's memory is coherent, which it usually is, the CPU always sees the current data and
+//  there is nothing to do. Otherwise, the mapped memory range has to be invalidated once the GPU
+//  has finished writing it, before the CPU reads it. SyncBuffer() does this automatically, so
+//  this routine is only needed when a program relies on the copies recorded by
+//  RecordComputeCommandBuffer() or RecordComputeBatch() and doesn't call SyncBuffer().
 //
 //  Parameters:
-//     DebugInfo  (VkDebugUtilsMessengerCreateInfoEXT&) The structure to be set up.
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     The GPU work writing the buffer must have completed.
+//
+//  Note:
+//     This only does anything for "READBACK", "SHARED" and "STAGED_GPU" buffers that are mapped
+//     and in memory that isn't coherent. (For "STAGED_GPU" it is the CPU side that is
+//     invalidated.)
 
-void KVVulkanFramework::SetupDebugMessengerInfo (VkDebugUtilsMessengerCreateInfoEXT& DebugInfo)
+void KVVulkanFramework::InvalidateBuffer(KVBufferHandle BufferHndl,bool& StatusOK)
 {
-    //  This enables the most useful messages. The callback routine has to be a static routine,
-    //  as the Vulkan diagnostics have no idea of the KVVulkanFramework class, but the .pUserData
-    //  field can be used to pass the address of the current KVVulkanFramework object to the
-    //  callback routine. There are a often a lot of information messages generated, enabled by
-    //  the VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT being set, but these are suppressed by
-    //  default unless enabled explicitly using EnableValidationLevels().
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    DebugInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    DebugInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-    DebugInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-    DebugInfo.pfnUserCallback = DebugUtilsCallback;
-    DebugInfo.pUserData = this;
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        KVBufferAccess Access = I_BufferDetails[Index].BufferAccess;
+        if (Access == ACCESS_READBACK || Access == ACCESS_SHARED || Access == ACCESS_STAGED_GPU) {
+            SyncMappedMemory(Index,false,StatusOK);
+        }
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                         A d d  I n s t a n c e  E x t e n s i o n s
+//                                 F l u s h  B u f f e r
 //
-//  This routine is provided to enable the interaction between Vulkan and a windowing system being
-//  used to provide the display surface Vulkan needs for graphics output. Such a windowing system
-//  (such as GLFW) may - probably will - need Vulkan to support certain specific extensions, and
-//  these will need to be explicitly enabled when the initial Vulkan Instance is created. So this
-//  needs to be called before CreateVulkanInstance() if Vulkan graphics facilities are needed.
-//  It is passed a list of named Vulkan extensions that the windowing system requires. GLFW has
-//  a routine, glfwGetRequiredInstanceExtensions() that supplies the names needed for such a list.
+//  This routine makes sure that the GPU sees the data the CPU has written into a mapped buffer.
+//  Like InvalidateBuffer(), it only has anything to do if the buffer's memory isn't coherent.
+//  It is needed if the CPU changes part of a buffer that the GPU writes, such as a "READBACK"
+//  buffer, since invalidating memory the CPU has written but not flushed loses what it wrote.
 //
 //  Parameters:
-//     ExtensionNames  (const std::vector<const char*>&) The list of named extensions that need
-//                     to be enabled.
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     The CPU must have finished writing the buffer.
 //
 //  Note:
-//     This routine must be called before CreateVulkanInstance().
+//     This only does anything for "READBACK", "SHARED" and "STAGED_GPU" buffers that are mapped
+//     and in memory that isn't coherent. (For "STAGED_GPU" it is the CPU side that is flushed.
+//     The STAGED_CPU buffers are flushed by SyncBuffer().)
 
-void KVVulkanFramework::AddInstanceExtensions(
-        const std::vector<const char*>& ExtensionNames,bool& StatusOK)
+void KVVulkanFramework::FlushBuffer(KVBufferHandle BufferHndl,bool& StatusOK)
 {
-    //  All we have to do is add these names to I_RequiredInstanceExtensions.
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        KVBufferAccess Access = I_BufferDetails[Index].BufferAccess;
+        if (Access == ACCESS_READBACK || Access == ACCESS_SHARED || Access == ACCESS_STAGED_GPU) {
+            SyncMappedMemory(Index,true,StatusOK);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                     S y n c  M a p p e d  M e m o r y   (Internal routine)
+//
+//  This internal routine flushes or invalidates the mapped memory used by the main Vulkan
+//  buffer for a Framework buffer, if - and only if - that memory isn't coherent. Flushing makes
+//  CPU writes visible to the GPU, invalidating makes GPU writes visible to the CPU. Vulkan needs
+//  the range involved to start and end on multiples of the device's nonCoherentAtomSize, so the
+//  range covered may be slightly larger than the buffer itself.
+//
+//  Parameters:
+//     Index         (int) The index into I_BufferDetails for the buffer.
+//     Flush         (bool) True to flush the memory, false to invalidate it.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+
+void KVVulkanFramework::SyncMappedMemory(int Index,bool Flush,bool& StatusOK)
+{
     if (!AllOK(StatusOK)) return;
-    I_Debug.Log ("Instance","Adding Required Instance Extensions.");
-    for (const char* NamePtr : ExtensionNames) I_RequiredInstanceExtensions.push_back(NamePtr);
+    
+    //  Only mapped memory from the pooled blocks is involved. (Imported memory is unaffected,
+    //  and unmapped memory will be seen correctly when it is mapped.)
+    
+    const T_MemoryAllocation& Allocation = I_BufferDetails[Index].MainAllocation;
+    if (I_BufferDetails[Index].MappedAddress == nullptr) return;
+    if (Allocation.BlockIndex < 0 || Allocation.BlockIndex >= int(I_MemoryBlocks.size())) return;
+    T_MemoryBlock& Block = I_MemoryBlocks[Allocation.BlockIndex];
+    
+    VkPhysicalDeviceMemoryProperties MemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(I_SelectedDevice,&MemoryProperties);
+    VkMemoryPropertyFlags TypeFlags =
+                               MemoryProperties.memoryTypes[Block.MemoryTypeIndex].propertyFlags;
+    if (TypeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) return;
+    
+    VkDeviceSize Start = (Allocation.Offset / I_NonCoherentAtomSize) * I_NonCoherentAtomSize;
+    VkDeviceSize End = Allocation.Offset + Allocation.Size;
+    End = ((End + I_NonCoherentAtomSize - 1) / I_NonCoherentAtomSize) * I_NonCoherentAtomSize;
+    VkMappedMemoryRange Range{};
+    Range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    Range.memory = Block.MemoryHndl;
+    Range.offset = Start;
+    Range.size = (End >= Block.SizeInBytes) ? VK_WHOLE_SIZE : End - Start;
+    VkResult Result;
+    if (Flush) {
+        Result = vkFlushMappedMemoryRanges(I_LogicalDevice,1,&Range);
+    } else {
+        Result = vkInvalidateMappedMemoryRanges(I_LogicalDevice,1,&Range);
+    }
+    if (Result != VK_SUCCESS) {
+        LogVulkanError (Flush ? "Failed to flush buffer memory" : "Failed to invalidate buffer memory",
+             Flush ? "vkFlushMappedMemoryRanges" : "vkInvalidateMappedMemoryRanges",Result);
+        StatusOK = false;
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                        A d d  G r a p h i c s  E x t e n s i o n s
+//                              S u b m i t  S y n c  B u f f e r
 //
-//  This routine is similar to AddInstanceExtensions() but whereas AddInstanceExtensions() is used
-//  to specify extensions that the Vulkan instance must support, AddGraphicsExtensions() is used
-//  to specify extensions that any physical GPU to be used must support. This is used internally
-//  to require swap chain support to be supported by any device to be used for graphics display,
-//  but could also be used if any windowing system were to have specific device-level extension
-//  requirements. (Note that GLFW does not have any such requirements.)
+//  This routine performs the same synchronisation of a staged buffer as SyncBuffer(), but does
+//  not wait for the transfer to complete. It returns a ticket that can be passed to WaitFor()
+//  or IsComplete(). Optionally, the transfer can be made to wait for a semaphore to be signalled
+//  before it starts, and can signal a semaphore once it completes. This allows a sequence of
+//  transfers and computations to be ordered entirely on the GPU - for example, a STAGED_CPU
+//  buffer can be synched, signalling a semaphore that a compute submission waits on, which
+//  in turn signals a semaphore that the sync of a STAGED_GPU output buffer waits on - leaving
+//  the CPU to wait only on the ticket for the final transfer.
 //
 //  Parameters:
-//     ExtensionNames  (const std::vector<const char*>&) The list of named extensions that need
-//                     to be enabled.
+//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
+//                   as returned by SetBufferDetails().
+//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used
+//                   to set up the required transfer.
+//     QueueHandl    (VkQueue) A Vulkan handle specifying the queue to be used for the required
+//                   transfer.
+//     WaitSemaphoreHndl (VkSemaphore) A semaphore that must be signalled before the transfer
+//                   starts, or VK_NULL_HANDLE if the transfer need not wait.
+//     SignalSemaphoreHndl (VkSemaphore) A semaphore to be signalled once the transfer completes,
+//                   or VK_NULL_HANDLE if none is needed.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (KVSubmitTicket) A ticket identifying the submission. If the buffer is not staged and no
+//                   semaphores were specified, there is nothing to submit and this will be
+//                   KV_NULL_TICKET, which WaitFor() and IsComplete() treat as already complete.
+//
+//  Pre-requisites:
+//     As for SyncBuffer(). Semaphores can be created using CreateVulkanSemaphore().
+//
 //  Note:
-//     This routine must be called before FindSuitableDevice().
-
-void KVVulkanFramework::AddGraphicsExtensions(
-    const std::vector<const char*>& ExtensionNames,bool& StatusOK)
+//     If the buffer is not staged but semaphores are specified, an empty submission is made that
+//     just waits on and signals the semaphores, so that a chain of submissions set up for staged
+//     buffers still works with shared buffers. The buffer must not be resized while a sync
+//     submission for it is still executing.
+
+KVVulkanFramework::KVSubmitTicket KVVulkanFramework::SubmitSyncBuffer(KVBufferHandle BufferHndl,
+                        VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
+                        VkSemaphore WaitSemaphoreHndl,VkSemaphore SignalSemaphoreHndl,bool& StatusOK)
 {
-    //  All we have to do is add these names to I_RequiredGraphicsExtensions.
+    KVSubmitTicket Ticket = KV_NULL_TICKET;
+    if (!AllOK(StatusOK)) return Ticket;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    if (!AllOK(StatusOK)) return;
-    I_Debug.Log ("Instance","Adding to Required Graphics Extensions.");
-    for (const char* NamePtr : ExtensionNames) I_RequiredGraphicsExtensions.push_back(NamePtr);
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        std::vector<VkSemaphore> WaitSemaphores;
+        std::vector<VkSemaphore> SignalSemaphores;
+        if (WaitSemaphoreHndl != VK_NULL_HANDLE) WaitSemaphores.push_back(WaitSemaphoreHndl);
+        if (SignalSemaphoreHndl != VK_NULL_HANDLE) SignalSemaphores.push_back(SignalSemaphoreHndl);
+        
+        if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+            I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) {
+            
+            //  If the CPU side of a STAGED_CPU buffer isn't coherent, what the CPU wrote has to be
+            //  flushed before the copy.
+            
+            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU) {
+                SyncMappedMemory(Index,true,StatusOK);
+            }
+            
+            //  Get the pre-recorded command buffer for the copy, recording it if need be, and
+            //  submit it. We remember the ticket, because the command buffer can't be re-recorded
+            //  until this submission has completed.
+            
+            VkCommandBuffer CommandBuffer = GetSyncCommandBuffer(Index,CommandPoolHndl,StatusOK);
+            Ticket = SubmitCommandBuffer(QueueHndl,CommandBuffer,WaitSemaphores,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT,SignalSemaphores,StatusOK);
+            if (AllOK(StatusOK)) I_BufferDetails[Index].SyncTicket = Ticket;
+            
+        } else if (WaitSemaphores.size() > 0 || SignalSemaphores.size() > 0) {
+            
+            //  Nothing to copy, but we must keep the semaphore chain intact.
+            
+            Ticket = SubmitCommandBuffer(QueueHndl,VK_NULL_HANDLE,WaitSemaphores,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,SignalSemaphores,StatusOK);
+        }
+    }
+    return Ticket;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                    G e t  D i a g n o s t i c  L a y e r s    (internal routine)
+//                            C r e a t e  U p l o a d  R i n g
 //
-//  There are a couple of places where the code needs to know which diagnostic layers are to be
-//  enabled. This routine returns a vector of the names of the enabled layers.
+//  A program that streams data to the GPU - new vertex colours each frame, or a new band of an
+//  image for each job - could use a staged buffer for each destination and sync each one as it
+//  changes, but that means a separate submission and a wait for every upload. The Framework
+//  can instead manage a single 'upload ring': a host-visible buffer that is used as a circular
+//  staging area. AllocateUpload() returns space in the ring for the data for part of a
+//  destination buffer, which the caller fills in, and SubmitUploads() then copies everything
+//  allocated since the previous call into the destination buffers with a single submission.
+//  The ring space used by a submission is only reused once its fence shows it has completed,
+//  so the CPU can go on filling in the next set of uploads while the GPU performs the copy.
+//  This routine creates the ring.
 //
-//  Parameters: None.
+//  Parameters:
+//     SizeInBytes   (VkDeviceSize) The size of the ring in bytes. This needs to be large
+//                   enough to hold all the uploads for a couple of frames or jobs, so that
+//                   the CPU doesn't have to wait for the GPU to finish one set of copies
+//                   before starting the next.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
-//  Returns:
-//     (const std::vector<const char*>&)  The list of diagnostic layers to be enabled.
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called. Only one ring can be created, and it is
+//     released when the Framework closes down.
 
-const std::vector<const char*>& KVVulkanFramework::GetDiagnosticLayers(void)
+void KVVulkanFramework::CreateUploadRing(VkDeviceSize SizeInBytes,bool& StatusOK)
 {
-    //  If we are enabling diagnostics, we will aim to use the VK_LAYER_KHRONOS_validation
-    //  layer, if it is available. This is described as providing all the useful standard
-    //  validation. For the moment at least, this name is hard-coded here.
-
-    static const std::vector<const char*> LayerNames = {"VK_LAYER_KHRONOS_validation"};
-    return LayerNames;
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    if (I_UploadRingBufferHndl != VK_NULL_HANDLE) {
+        LogError ("The upload ring has already been created");
+        StatusOK = false;
+    } else if (SizeInBytes == 0) {
+        LogError ("Invalid upload ring size (0 bytes) specified");
+        StatusOK = false;
+    } else {
+        
+        //  The ring is only ever written by the CPU and read by transfers, and using coherent
+        //  memory means the CPU's writes never need to be explicitly flushed.
+        
+        VkMemoryPropertyFlags PropertyFlags =
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        CreateVulkanBuffer(SizeInBytes,VK_BUFFER_USAGE_TRANSFER_SRC_BIT,PropertyFlags,0,
+                  &I_UploadRingBufferHndl,&I_UploadRingMemoryHndl,&I_UploadRingAllocation,StatusOK);
+        I_UploadRingAddress = MapBlockMemory(I_UploadRingAllocation,StatusOK);
+        if (AllOK(StatusOK)) {
+            I_UploadRingSize = SizeInBytes;
+            I_UploadRingHead = I_UploadRingTail = I_UploadRingUsed = 0;
+            I_UploadPendingBytes = 0;
+            I_Debug.Logf ("Buffers","Upload ring of %llu bytes created",
+                                                               (unsigned long long)SizeInBytes);
+        } else {
+            DestroyVulkanBuffer(&I_UploadRingBufferHndl,&I_UploadRingMemoryHndl,
+                                                                     &I_UploadRingAllocation);
+            I_UploadRingAddress = nullptr;
+        }
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       L o g  V a l i d a t i o n  E r r o r    (internal routine)
+//                               A l l o c a t e  U p l o a d
 //
-//  This is the default routine called by DebugUtilsCallback() to log an error message.
-//  It simply outputs it to the error stream, prefaced by a string to indicate that it
-//  represents an error.
+//  This routine allocates space in the upload ring for data that is to be copied to part of a
+//  buffer, and returns the address where the caller should write that data. The copy itself is
+//  not made until SubmitUploads() is called. If the ring doesn't have enough free space, this
+//  waits for the oldest submitted uploads to complete until it does.
 //
 //  Parameters:
-//     Message     (const char*) The address of a nul-terminated error string.
+//     BufferHndl    (KVBufferHandle) An opaque handle used by the Framework to refer to the
+//                   destination buffer, as returned by SetBufferDetails(). This must be a
+//                   "LOCAL", "SPARSE" or "STAGED_CPU" buffer - the CPU can write directly into
+//                   a "SHARED" buffer. For a "STAGED_CPU" buffer, the data is copied into the
+//                   GPU side of the buffer, and for a "SPARSE" buffer, the range must have
+//                   had memory committed to it by CommitBufferRange().
+//     Offset        (VkDeviceSize) The offset in bytes in the destination buffer of the data.
+//     SizeInBytes   (VkDeviceSize) The number of bytes of data.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (void*)       The address in the upload ring where the data should be written, or
+//                   nullptr if something went wrong.
+//
+//  Pre-requisites:
+//     CreateUploadRing() must have been called, and the destination buffer created.
 //
 //  Note:
-//     The message is ignored unless error messages have been enabled through EnableValidation()
-//     which enables them by default, or through EnableValidationLevels() which provides more
-//     explicit control.
-
-void KVVulkanFramework::LogValidationError(const char* Message)
+//     o The address remains valid until SubmitUploads() is called.
+//     o All the uploads allocated between calls to SubmitUploads() have to fit into the ring
+//     at the same time. If they don't, this routine reports an error - the ring should either
+//     be made larger, or SubmitUploads() called more often.
+//     o For a "STAGED_CPU" buffer, a subsequent SyncBuffer() would overwrite the uploaded data
+//     with the contents of the CPU side of the buffer.
+
+void* KVVulkanFramework::AllocateUpload(KVBufferHandle BufferHndl,VkDeviceSize Offset,
+                                                        VkDeviceSize SizeInBytes,bool& StatusOK)
 {
-    if (I_EnableValidationErrors) std::cerr << "*** Error: " << Message << '\n';
+    if (!AllOK(StatusOK)) return nullptr;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (I_UploadRingBufferHndl == VK_NULL_HANDLE) {
+            LogError ("AllocateUpload() called before CreateUploadRing()");
+            StatusOK = false;
+        } else if (I_BufferDetails[Index].BufferAccess != ACCESS_LOCAL &&
+                               I_BufferDetails[Index].BufferAccess != ACCESS_SPARSE &&
+                               I_BufferDetails[Index].BufferAccess != ACCESS_STAGED_CPU) {
+            LogError (
+                 "Uploads can only be made to \"LOCAL\", \"SPARSE\" or \"STAGED_CPU\" buffers");
+            StatusOK = false;
+        } else if (SizeInBytes == 0 || Offset > I_BufferDetails[Index].SizeInBytes ||
+                                SizeInBytes > I_BufferDetails[Index].SizeInBytes - Offset) {
+            LogError ("Upload of %llu bytes at offset %llu is outside buffer of %llu bytes",
+                             (unsigned long long)SizeInBytes,(unsigned long long)Offset,
+                                     (unsigned long long)I_BufferDetails[Index].SizeInBytes);
+            StatusOK = false;
+        }
+    }
+    if (!AllOK(StatusOK)) return nullptr;
+    
+    VkDeviceSize Size = ((VkDeviceSize(SizeInBytes) + C_UploadAlignment - 1) / C_UploadAlignment)
+                                                                          * C_UploadAlignment;
+    if (Size > I_UploadRingSize) {
+        LogError ("Upload of %llu bytes is larger than the upload ring",
+                                                               (unsigned long long)SizeInBytes);
+        StatusOK = false;
+        return nullptr;
+    }
+    
+    //  First release the ring space used by any submissions that have already completed.
+    
+    while (I_UploadSegments.size() > 0 && IsComplete(I_UploadSegments[0].Ticket,StatusOK)) {
+        RetireUploadSegment(StatusOK);
+    }
+    
+    //  Then look for space. The used part of the ring runs from the tail to the head, possibly
+    //  wrapping round the end. If the space after the head isn't large enough, we can skip the
+    //  rest of the ring and start again at the beginning, if there's room there. If there still
+    //  isn't room, we wait for the oldest submission to complete and try again.
+    
+    VkDeviceSize RangeStart = 0;
+    VkDeviceSize Skipped = 0;
+    bool Found = false;
+    while (AllOK(StatusOK) && !Found) {
+        if (I_UploadRingUsed == 0) I_UploadRingHead = I_UploadRingTail = 0;
+        if (I_UploadRingUsed == 0 || I_UploadRingHead > I_UploadRingTail) {
+            if (I_UploadRingSize - I_UploadRingHead >= Size) {
+                RangeStart = I_UploadRingHead;
+                Skipped = 0;
+                Found = true;
+            } else if (I_UploadRingTail >= Size) {
+                RangeStart = 0;
+                Skipped = I_UploadRingSize - I_UploadRingHead;
+                Found = true;
+            }
+        } else if (I_UploadRingTail - I_UploadRingHead >= Size) {
+            RangeStart = I_UploadRingHead;
+            Skipped = 0;
+            Found = true;
+        }
+        if (!Found) {
+            if (I_UploadSegments.size() == 0) {
+                LogError ("Upload ring is full of unsubmitted uploads - call SubmitUploads()");
+                StatusOK = false;
+            } else {
+                I_Debug.Log ("Buffers","Waiting for upload ring space");
+                WaitFor(I_UploadSegments[0].Ticket,StatusOK);
+                RetireUploadSegment(StatusOK);
+            }
+        }
+    }
+    if (!AllOK(StatusOK)) return nullptr;
+    
+    I_UploadRingHead = RangeStart + Size;
+    I_UploadRingUsed += Skipped + Size;
+    I_UploadPendingBytes += Skipped + Size;
+    T_UploadCopy Copy;
+    Copy.BufferIndex = Index;
+    Copy.Region.srcOffset = RangeStart;
+    Copy.Region.dstOffset = VkDeviceSize(Offset);
+    Copy.Region.size = VkDeviceSize(SizeInBytes);
+    I_PendingUploads.push_back(Copy);
+    return (char*)I_UploadRingAddress + RangeStart;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                       L o g  V a l i d a t i o n  W a r n i n g    (internal routine)
+//                                S u b m i t  U p l o a d s
 //
-//  This is the default routine called by DebugUtilsCallback() to log a warning message.
-//  It simply outputs it to the error stream, prefaced by a string to indicate that it
-//  represents a warning.
+//  This routine copies all the data allocated by AllocateUpload() since the last call into the
+//  destination buffers, using a single command buffer submission. It does not wait for the
+//  copies to complete, but returns a ticket that can be passed to WaitFor() or IsComplete().
+//  Like SubmitSyncBuffer(), it can wait for a semaphore before starting and signal one once
+//  it completes. The copies are followed by a memory barrier, so later work submitted to the
+//  same queue will see the uploaded data.
 //
 //  Parameters:
-//     Message     (const char*) The address of a nul-terminated warning.
+//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used
+//                   for the command buffer.
+//     QueueHndl     (VkQueue) A Vulkan handle specifying the queue to be used for the copies.
+//     WaitSemaphoreHndl (VkSemaphore) A semaphore that must be signalled before the copies
+//                   start, or VK_NULL_HANDLE if they need not wait.
+//     SignalSemaphoreHndl (VkSemaphore) A semaphore to be signalled once the copies complete,
+//                   or VK_NULL_HANDLE if none is needed.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//  Returns:
+//     (KVSubmitTicket) A ticket identifying the submission. If there was nothing to upload and no
+//                   semaphores were specified, this will be KV_NULL_TICKET.
 //
-//  Note:
-//     The message is ignored unless warnings have been enabled through EnableValidation()
-//     which enables them by default, or through EnableValidationLevels() which provides more
-//     explicit control.
+//  Pre-requisites:
+//     CreateUploadRing() must have been called. The destination buffers must not be deleted
+//     or resized until the copies have completed.
 
-void KVVulkanFramework::LogValidationWarning(const char* Message)
+KVVulkanFramework::KVSubmitTicket KVVulkanFramework::SubmitUploads(VkCommandPool CommandPoolHndl,
+               VkQueue QueueHndl,VkSemaphore WaitSemaphoreHndl,VkSemaphore SignalSemaphoreHndl,
+                                                                               bool& StatusOK)
 {
-    if (I_EnableValidationWarnings) std::cerr << "* Warning: " << Message << '\n';
+    KVSubmitTicket Ticket = KV_NULL_TICKET;
+    if (!AllOK(StatusOK)) return Ticket;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    std::vector<VkSemaphore> WaitSemaphores;
+    std::vector<VkSemaphore> SignalSemaphores;
+    if (WaitSemaphoreHndl != VK_NULL_HANDLE) WaitSemaphores.push_back(WaitSemaphoreHndl);
+    if (SignalSemaphoreHndl != VK_NULL_HANDLE) SignalSemaphores.push_back(SignalSemaphoreHndl);
+    
+    if (I_PendingUploads.size() == 0) {
+        
+        //  Nothing to copy, but we must keep any semaphore chain intact.
+        
+        if (WaitSemaphores.size() > 0 || SignalSemaphores.size() > 0) {
+            Ticket = SubmitCommandBuffer(QueueHndl,VK_NULL_HANDLE,WaitSemaphores,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,SignalSemaphores,StatusOK);
+        }
+        return Ticket;
+    }
+    
+    VkCommandBuffer CommandBufferHndl = VK_NULL_HANDLE;
+    VkCommandBufferAllocateInfo AllocInfo{};
+    AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    AllocInfo.commandPool = CommandPoolHndl;
+    AllocInfo.commandBufferCount = 1;
+    VkResult Result = vkAllocateCommandBuffers(I_LogicalDevice,&AllocInfo,&CommandBufferHndl);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to allocate upload command buffer","vkAllocateCommandBuffers",
+                                                                                       Result);
+        StatusOK = false;
+        return Ticket;
+    }
+    VkCommandBufferBeginInfo BeginInfo{};
+    BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    Result = vkBeginCommandBuffer(CommandBufferHndl,&BeginInfo);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to begin recording upload command buffer",
+                                                             "vkBeginCommandBuffer",Result);
+        StatusOK = false;
+    } else {
+        
+        //  One copy command for each destination buffer, covering all the regions for it.
+        
+        std::vector<bool> Done(I_PendingUploads.size(),false);
+        for (size_t I = 0; I < I_PendingUploads.size(); I++) {
+            if (Done[I]) continue;
+            int Index = I_PendingUploads[I].BufferIndex;
+            std::vector<VkBufferCopy> Regions;
+            for (size_t J = I; J < I_PendingUploads.size(); J++) {
+                if (!Done[J] && I_PendingUploads[J].BufferIndex == Index) {
+                    Regions.push_back(I_PendingUploads[J].Region);
+                    Done[J] = true;
+                }
+            }
+            VkBuffer DestHndl = I_BufferDetails[Index].MainBufferHndl;
+            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU) {
+                DestHndl = I_BufferDetails[Index].SecondaryBufferHndl;
+            }
+            vkCmdCopyBuffer(CommandBufferHndl,I_UploadRingBufferHndl,DestHndl,
+                                                    uint32_t(Regions.size()),Regions.data());
+        }
+        RecordMemoryBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                                        VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+        Result = vkEndCommandBuffer(CommandBufferHndl);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to record upload command buffer","vkEndCommandBuffer",Result);
+            StatusOK = false;
+        } else {
+            Ticket = SubmitCommandBuffer(QueueHndl,CommandBufferHndl,WaitSemaphores,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT,SignalSemaphores,StatusOK);
+        }
+    }
+    if (!AllOK(StatusOK)) {
+        vkFreeCommandBuffers(I_LogicalDevice,CommandPoolHndl,1,&CommandBufferHndl);
+        return KV_NULL_TICKET;
+    }
+    
+    //  The ring space used by these uploads now belongs to this submission, and is released
+    //  - along with the command buffer - once the submission has completed.
+    
+    I_Debug.Logf ("Buffers","Submitted %d uploads, %ld bytes of ring",
+                                           int(I_PendingUploads.size()),long(I_UploadPendingBytes));
+    T_UploadSegment Segment;
+    Segment.Ticket = Ticket;
+    Segment.End = I_UploadRingHead;
+    Segment.Bytes = I_UploadPendingBytes;
+    Segment.CommandBufferHndl = CommandBufferHndl;
+    Segment.CommandPoolHndl = CommandPoolHndl;
+    I_UploadSegments.push_back(Segment);
+    I_PendingUploads.clear();
+    I_UploadPendingBytes = 0;
+    return Ticket;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                         L o g  V a l i d a t i o n  I n f o    (internal routine)
+//                 R e t i r e  U p l o a d  S e g m e n t   (Internal routine)
 //
-//  This is the default routine called by DebugUtilsCallback() to log a informational message.
-//  It simply outputs it to the output stream, prefaced by a string to indicate that it
-//  represents an informational message.
+//  This internal routine releases the upload ring space, and the command buffer, used by the
+//  oldest submission made by SubmitUploads(). It must only be called once that submission has
+//  been seen to complete.
 //
 //  Parameters:
-//     Message     (const char*) The address of a nul-terminated warning.
-//
-//  Note:
-//     The message is ignored unless informational messages have been enabled explicitly through
-//     EnableValidationLevels().
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 
-void KVVulkanFramework::LogValidationInfo(const char* Message)
+void KVVulkanFramework::RetireUploadSegment(bool& StatusOK)
 {
-    if (I_EnableValidationInformation) std::cout << "Information: " << Message << '\n';
+    if (!AllOK(StatusOK)) return;
+    
+    if (I_UploadSegments.size() > 0) {
+        T_UploadSegment& Segment = I_UploadSegments[0];
+        vkFreeCommandBuffers(I_LogicalDevice,Segment.CommandPoolHndl,1,
+                                                                 &Segment.CommandBufferHndl);
+        I_UploadRingTail = Segment.End;
+        I_UploadRingUsed -= Segment.Bytes;
+        I_UploadSegments.erase(I_UploadSegments.begin());
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                         D e b u g  U t i l s  C a l l b a c k    (internal routine)
+//              G e t  S y n c  C o m m a n d  B u f f e r   (Internal routine)
 //
-//  This is the static routine set up to be called by the validation layers when they have
-//  something to report. The calling sequence for this is defined by Vulkan.
+//  This internal routine returns the pre-recorded command buffer used to sync a staged buffer,
+//  allocating it from the specified command pool and recording it if this has not already been
+//  done, or if the buffer has been changed since it was recorded.
 //
 //  Parameters:
-//     MessageSeverity   (VkDebugUtilsMessageSeverityFlagBitsEXT) A Vulkan code indicating
-//                       how the message has been classed - error, warning, information, etc.
-//     MessageType       (VkDebugUtilsMessageTypeFlagsEXT) A Vulkan code indicating the type
-//                       of the message - this is currently ignored by this routine. (It is
-//                       used to indicate the sort of occurrence that has triggered the
-//                       message - a violation of Vulkan rules, sub-optimal usage, etc...)
-//     CallbackData      (const VkDebugUtilsMessengerCallbackDataEXT*) A Vulkan structure that
-//                       includes the text of the message.
-//     UserData          (void*) User-supplied data. This must the the address of the Framework,
-//                       to allow Framework routines such as LogValidationError() to be called by
-//                       this static routine.
-//
+//     Index         (int) The index of the buffer in I_BufferDetails.
+//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //  Returns:
-//     (VkBool)          Returned as VK_TRUE if the Vulkan call that triggered the message
-//                       should be aborted, and VK_FALSE if not.
+//     (VkCommandBuffer) The Vulkan handle for the recorded command buffer.
+//
+//  Note:
+//     The command buffer is recorded with the 'simultaneous use' flag set, so it can be
+//     resubmitted even if an earlier submission of it is still executing.
 
-VKAPI_ATTR VkBool32 VKAPI_CALL KVVulkanFramework::DebugUtilsCallback(
-    VkDebugUtilsMessageSeverityFlagBitsEXT MessageSeverity,
-    VkDebugUtilsMessageTypeFlagsEXT /*MessageType*/,
-    const VkDebugUtilsMessengerCallbackDataEXT* CallbackData,
-    void* UserData)
- {
-    if (UserData) {
-        
-        //  Get the address of the Framework, and call the appropriate routine.
-        
-        KVVulkanFramework* FrameworkObject = (KVVulkanFramework*) UserData;
-        if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
-            FrameworkObject->LogValidationInfo(CallbackData->pMessage);
-        } else if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
-            FrameworkObject->LogValidationInfo(CallbackData->pMessage);
-        } else if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-            FrameworkObject->LogValidationWarning(CallbackData->pMessage);
-        } else if (MessageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
-            FrameworkObject->SetValidationError(true);
-            FrameworkObject->LogValidationError(CallbackData->pMessage);
+VkCommandBuffer KVVulkanFramework::GetSyncCommandBuffer(
+                                      int Index,VkCommandPool CommandPoolHndl,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return VK_NULL_HANDLE;
+    
+    T_BufferDetails& Details = I_BufferDetails[Index];
+    
+    //  If the caller has switched to a different command pool, we can't use a command buffer
+    //  allocated from the old one - there's no guarantee the old pool will still be there.
+    
+    if (Details.SyncCommandBufferHndl != VK_NULL_HANDLE &&
+                                          Details.SyncCommandPoolHndl != CommandPoolHndl) {
+        ReleaseSyncCommandBuffer(Index,StatusOK);
+    }
+    if (Details.SyncCommandBufferHndl == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo AllocInfo{};
+        AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        AllocInfo.commandPool = CommandPoolHndl;
+        AllocInfo.commandBufferCount = 1;
+        VkResult Result = vkAllocateCommandBuffers(I_LogicalDevice,&AllocInfo,
+                                                               &Details.SyncCommandBufferHndl);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to allocate sync command buffer","vkAllocateCommandBuffers",
+                                                                                        Result);
+            Details.SyncCommandBufferHndl = VK_NULL_HANDLE;
+            StatusOK = false;
+        } else {
+            Details.SyncCommandPoolHndl = CommandPoolHndl;
+            Details.SyncRecorded = false;
+        }
+    }
+    
+    if (AllOK(StatusOK) && !Details.SyncRecorded) {
+        
+        //  Any previous submission has to have completed before we re-record.
+        
+        WaitFor(Details.SyncTicket,StatusOK);
+        Details.SyncTicket = KV_NULL_TICKET;
+        
+        I_Debug.Logf ("Buffers","Recording sync command buffer for buffer %ld",Details.Handle);
+        vkResetCommandBuffer(Details.SyncCommandBufferHndl,0);
+        VkCommandBufferBeginInfo BeginInfo{};
+        BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        VkResult Result = vkBeginCommandBuffer(Details.SyncCommandBufferHndl,&BeginInfo);
+        if (Result != VK_SUCCESS) {
+            LogVulkanError ("Failed to begin recording sync command buffer",
+                                                                 "vkBeginCommandBuffer",Result);
+            StatusOK = false;
         } else {
+            RecordSyncCopy(Index,Details.SyncCommandBufferHndl);
             
-            //  This catches any other message types, such as the vebose information type.
+            //  For a STAGED_GPU buffer the CPU is going to read the data once the copy
+            //  completes, so the transfer writes must be made visible to the host.
             
-            FrameworkObject->LogValidationInfo(CallbackData->pMessage);
+            if (Details.BufferAccess == ACCESS_STAGED_GPU) {
+                RecordMemoryBarrier(Details.SyncCommandBufferHndl,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                    VK_ACCESS_TRANSFER_WRITE_BIT,VK_PIPELINE_STAGE_HOST_BIT,
+                                    VK_ACCESS_HOST_READ_BIT);
+            }
+            Result = vkEndCommandBuffer(Details.SyncCommandBufferHndl);
+            if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
+                LogVulkanError ("Failed to record sync command buffer","vkEndCommandBuffer",
+                                                                                       Result);
+                StatusOK = false;
+            } else {
+                Details.SyncRecorded = true;
+            }
         }
     }
-    
-    //  The Vulkan tutorial says this should always return false - it's only when it's being used
-    //  to test the validation layers themselves that it should return true.
-    
-    return VK_FALSE;
+    return Details.SyncCommandBufferHndl;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                           S e t  V a l i d a t i o n  E r r o r    (internal routine)
+//           R e l e a s e  S y n c  C o m m a n d  B u f f e r   (Internal routine)
 //
-//  This routine exists solely to allow the static routine DebugUtilsCallback() to flag that
-//  the Vulcan validation layers have detected an error. It sets the Framework's internal flag
-//  that indicates this. (The parameter allows it to be set or cleared, but at the moment there's
-//  no call to have it cleared externally.) Technically this is not an internal routine, as it
-//  needs to be callable by DebugUtilsCallback(), but it is not intended to be called from
-//  outside the Framework code.
+//  This internal routine releases the pre-recorded command buffer used to sync a staged buffer,
+//  if one has been allocated, first waiting for any submission using it to complete.
 //
 //  Parameters:
-//     Set           (bool) True if the internal 'validation error detected' flag is to be set.
-//                   False if it is to be cleared.
+//     Index         (int) The index of the buffer in I_BufferDetails.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 
-void KVVulkanFramework::SetValidationError(bool Set)
+void KVVulkanFramework::ReleaseSyncCommandBuffer(int Index,bool& StatusOK)
 {
-    I_ValidationErrorFlagged = Set;
+    if (!AllOK(StatusOK)) return;
+    
+    T_BufferDetails& Details = I_BufferDetails[Index];
+    WaitFor(Details.SyncTicket,StatusOK);
+    Details.SyncTicket = KV_NULL_TICKET;
+    if (Details.SyncCommandBufferHndl != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(I_LogicalDevice,Details.SyncCommandPoolHndl,1,
+                                                               &Details.SyncCommandBufferHndl);
+    }
+    Details.SyncCommandBufferHndl = VK_NULL_HANDLE;
+    Details.SyncCommandPoolHndl = VK_NULL_HANDLE;
+    Details.SyncRecorded = false;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                  L o g  E r r o r      (internal routine)
+//                     R e c o r d  S y n c  C o p y   (Internal routine)
 //
-//  Logs an error message, formatting it like printf(). The supplied message will be formatted and
-//  output, with a new line character appended. This also sets the internal 'error' flag tested
-//  by AllOK().
+//  This internal routine adds the copy command needed to sync a staged buffer to a command buffer
+//  that is in the process of being recorded. It does nothing for an unstaged buffer.
 //
 //  Parameters:
-//     Format        (const char* const) A printf() style formatting string. This can be followed
-//                   by a variable number of additional arguments as required.
-
+//     Index         (int) The index of the buffer in I_BufferDetails.
+//     CommandBufferHndl (VkCommandBuffer) The command buffer being recorded.
+//  Returns:
+//     (bool)        True if a copy command was recorded, false if the buffer isn't staged.
 
-void KVVulkanFramework::LogError (const char* const Format, ...)
+bool KVVulkanFramework::RecordSyncCopy(int Index,VkCommandBuffer CommandBufferHndl)
 {
-    char Message[1024];
-    va_list Args;
-    va_start (Args,Format);
-    vsnprintf (Message,sizeof(Message),Format,Args);
-    cerr << "[" << I_Debug.GetSubSystem() << "] *** Error: " << Message << " ***\n";
-    I_ErrorFlagged = true;
+    //  The whole buffer is copied, so there's only one copy region involved.
+    
+    std::vector<VkBufferCopy> CopyRegions(1);
+    CopyRegions[0].size = I_BufferDetails[Index].SizeInBytes;
+    CopyRegions[0].srcOffset = 0;
+    CopyRegions[0].dstOffset = 0;
+    return RecordSyncCopyRegions(Index,CommandBufferHndl,CopyRegions);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                               L o g  W a r n i n g      (internal routine)
+//              R e c o r d  S y n c  C o p y  R e g i o n s   (Internal routine)
 //
-//  Logs a warning message, formatting it like printf(). The supplied message will be formatted and
-//  output, with a new line character appended.
+//  This internal routine adds a copy command for a set of regions of a staged buffer to a command
+//  buffer that is in the process of being recorded. It does nothing for an unstaged buffer.
 //
 //  Parameters:
-//     Format        (const char* const) A printf() style formatting string. This can be followed
-//                   by a variable number of additional arguments as required.
-
+//     Index         (int) The index of the buffer in I_BufferDetails.
+//     CommandBufferHndl (VkCommandBuffer) The command buffer being recorded.
+//     CopyRegions   (const std::vector<VkBufferCopy>&) The regions to be copied. The source and
+//                   destination offsets should be the same, and the regions should not overlap.
+//  Returns:
+//     (bool)        True if a copy command was recorded, false if the buffer isn't staged.
 
-void KVVulkanFramework::LogWarning (const char* const Format, ...)
+bool KVVulkanFramework::RecordSyncCopyRegions(int Index,VkCommandBuffer CommandBufferHndl,
+                                                 const std::vector<VkBufferCopy>& CopyRegions)
 {
-    char Message[1024];
-    va_list Args;
-    va_start (Args,Format);
-    vsnprintf (Message,sizeof(Message),Format,Args);
-    cerr << "[" << I_Debug.GetSubSystem() << "] * Warning: " << Message << " *\n";
+    bool Recorded = false;
+    if ((I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
+        I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) && CopyRegions.size() > 0) {
+        
+        //  The copy command needs the source and destination buffers involved, the number of bytes
+        //  to copy, and the offsets within each buffer. Which is the source buffer and which the
+        //  destination depends on the whether this is a buffer where the CPU creates the data which
+        //  then has to be copied to the GPU (STAGED_CPU) or where the GPU computes the data which
+        //  then has to be copied to the CPU (STAGED_GPU).
+        
+        VkBuffer SrcBufferHndl,DstBufferHndl;
+        if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU) {
+            SrcBufferHndl = I_BufferDetails[Index].MainBufferHndl;
+            DstBufferHndl = I_BufferDetails[Index].SecondaryBufferHndl;
+        } else {
+            SrcBufferHndl = I_BufferDetails[Index].SecondaryBufferHndl;
+            DstBufferHndl = I_BufferDetails[Index].MainBufferHndl;
+        }
+        vkCmdCopyBuffer(CommandBufferHndl,SrcBufferHndl,DstBufferHndl,
+                           static_cast<uint32_t>(CopyRegions.size()),CopyRegions.data());
+        Recorded = true;
+    }
+    return Recorded;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                             L o g  V u l k a n  E r r o r      (internal routine)
+//                  R e c o r d  M e m o r y  B a r r i e r   (Internal routine)
 //
-//  Should be called when a Vulkan routine returns an error. It logs the details of the error,
-//  including the name of the Vulkan routine and a readable version of the status it returned.
+//  This internal routine adds a global memory barrier to a command buffer that is in the process
+//  of being recorded, making memory accesses of the specified type by the specified 'source'
+//  pipeline stage available to accesses of the specified type by the 'destination' stage.
+//  The Framework only needs simple barriers, such as 'transfer writes must complete before
+//  the compute shader reads', so a global barrier is used rather than one for each buffer.
 //
 //  Parameters:
-//     Text        (const std::string&) The main text to be output. This should be used to
-//                 give some idea of the circumstances in which the error occurred.
-//     Routine     (const std::string&) The name of the Vulkan routine returning the error code.
-//     Result      (VkResult) The Vulkan status code returned by the routine.
-
-void KVVulkanFramework::LogVulkanError(
-        const std::string& Text,const std::string& Routine, VkResult Result)
+//     CommandBufferHndl (VkCommandBuffer) The command buffer being recorded.
+//     SrcStageFlags (VkPipelineStageFlags) The pipeline stage(s) that must complete first.
+//     SrcAccessFlags (VkAccessFlags) The memory accesses by those stages to be made available.
+//     DstStageFlags (VkPipelineStageFlags) The pipeline stage(s) that must wait.
+//     DstAccessFlags (VkAccessFlags) The memory accesses by those stages that must see the data.
+
+void KVVulkanFramework::RecordMemoryBarrier(VkCommandBuffer CommandBufferHndl,
+         VkPipelineStageFlags SrcStageFlags,VkAccessFlags SrcAccessFlags,
+         VkPipelineStageFlags DstStageFlags,VkAccessFlags DstAccessFlags)
 {
-    std::string ResultText(string_VkResult(Result));
-    std::string Message = Text + " " + Routine + " returned code " + ResultText + ".";
-    LogError(Message.c_str());
-    I_ErrorFlagged = true;
+    VkMemoryBarrier Barrier{};
+    Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    Barrier.srcAccessMask = SrcAccessFlags;
+    Barrier.dstAccessMask = DstAccessFlags;
+    vkCmdPipelineBarrier(CommandBufferHndl,SrcStageFlags,DstStageFlags,0,1,&Barrier,
+                                                                       0,nullptr,0,nullptr);
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//              D e v i c e  H a s  P o r t a b i l i t y  S u b s e t    (internal routine)
+//                          C r e a t e  V u l k a n  S e m a p h o r e
 //
-//  A tricky issue is to do with the portability subset. Mostly this an issue for code running
-//  on Macintoshes using MoltenVK, but in principle it's more general. Vulkan allows for
-//  devices that support a limited set of features, the portability subset. MoltenVK is a layer
-//  that uses the Macintosh native Metal system to emulate Vulkan, and it implements the
-//  portability subset. Vulkan doesn't want people to be using devices that only support a
-//  subset to do so blindly - not realising they are using a limited implementation. So if
-//  a device only supports the portability subset, Vulkan requires that the code explicitly
-//  request that subset. That way, Vulkan assumes you know what you're doing. So we look to
-//  see if this is such a device, and if so (we're probably on a Mac) we will need to add it
-//  to the enabled extensions. This routine checks the list of extensions supported by the
-//  selected device and returns true if they include the portability subset.
+//  This routine creates a Vulkan semaphore that can be used to order submissions on the GPU,
+//  for example using SubmitSyncBuffer() or SubmitCommandBuffer(). The Framework keeps track of
+//  the semaphores it creates and destroys them when it closes down.
 //
 //  Parameters:
-//     Extensions   (std::vector<VkExtensionProperties>&) Lists the details of the extensions
-//                  supported by the device, including their names.
+//     SemaphoreHndlPtr (VkSemaphore*) Receives the Vulkan handle for the created semaphore.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
 //
-//  Returns:
-//     (bool)        True if the list of device extensions includes the portability subset.
+//  Pre-requisites:
+//     CreateLogicalDevice() must have been called to set up the selected GPU as a Vulkan device.
+//
+//  Note:
+//     This isn't called CreateSemaphore() because under Windows that's defined as a macro.
 
-bool KVVulkanFramework::DeviceHasPortabilitySubset(std::vector<VkExtensionProperties>& Extensions)
+void KVVulkanFramework::CreateVulkanSemaphore(VkSemaphore* SemaphoreHndlPtr,bool& StatusOK)
 {
-    bool Found = false;
-    for (const VkExtensionProperties& Property : Extensions) {
-        if (!strcmp("VK_KHR_portability_subset",Property.extensionName)) {
-            Found = true;
-            break;
-        }
+    *SemaphoreHndlPtr = VK_NULL_HANDLE;
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    VkSemaphoreCreateInfo SemaphoreInfo{};
+    SemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkResult Result = vkCreateSemaphore(I_LogicalDevice,&SemaphoreInfo,nullptr,SemaphoreHndlPtr);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to create semaphore","vkCreateSemaphore",Result);
+        *SemaphoreHndlPtr = VK_NULL_HANDLE;
+        StatusOK = false;
+    } else {
+        I_SemaphoreHndls.push_back(*SemaphoreHndlPtr);
     }
-    return Found;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                  M a p  B u f f e r
+//                       C r e a t e  T i m e l i n e  S e m a p h o r e
 //
-//  This routine maps the CPU memory allocated for a buffer and returns a pointer to it.
-//  The pointer will remain valid so long as the buffer remains unchanged. However, once
-//  the buffer is deleted, its address range will no longer be accessible. If the buffer
-//  is resized, it will generally be unmapped, and should be remapped before attempting
-//  to access its data. This routine can be called multiple times for a given buffer - the
-//  first call will result in a call to Vulkan to actually map the buffer, subsequent calls
-//  will simply return the mapped address. A buffer will be unmapped when the Framework is
-//  shut down or the buffer deleted, and can be explicitly unmapped through a call to
-//  UnmapBuffer().
+//  This routine creates a timeline semaphore. Unlike the ordinary 'binary' semaphores created
+//  by CreateVulkanSemaphore(), which are either signalled or not, a timeline semaphore holds a
+//  64-bit value that can only increase. A submission made using the timeline version of
+//  SubmitCommandBuffer() can set the value when it completes, and another submission - which can
+//  be on a different queue - can wait until the value reaches a given point. So a program can
+//  signal value N when the compute for frame N completes, and have the graphics submission for
+//  frame N wait for value N, without the CPU having to wait for either. The CPU can wait for a
+//  value using WaitForSemaphoreValue(), or read the current value using GetSemaphoreValue().
+//  The Framework destroys the semaphore when it closes down.
 //
 //  Parameters:
-//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
-//                   as returned by SetBufferDetails().
+//     InitialValue  (uint64_t) The initial value of the semaphore, usually 0.
+//     SemaphoreHndlPtr (VkSemaphore*) Receives the Vulkan handle for the created semaphore.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
-//  Returns:
-//     (void*)       The address of the mapped buffer.
 //
 //  Pre-requisites:
-//     SetBufferDetails() must have been called to describe how the buffer will be used
-//     and to return the buffer handle that is passed to this routine and the buffer and its
-//     associated memory should already have been created using CreateBuffer().
-//
-//  Note:
-//     If the buffer is local to the GPU (ie if the call to SetBufferDetails() specified "LOCAL"
-//     as the access string), its data cannot be mapped and this routine will return with bad
-//     status.
+//     CreateLogicalDevice() must have been called, and the device must support timeline
+//     semaphores - see TimelineSemaphoresSupported().
 
-void* KVVulkanFramework::MapBuffer(KVBufferHandle BufferHndl,long* SizeInBytes,bool& StatusOK)
+void KVVulkanFramework::CreateTimelineSemaphore(uint64_t InitialValue,
+                                                VkSemaphore* SemaphoreHndlPtr,bool& StatusOK)
 {
-    if (!AllOK(StatusOK)) return nullptr;
+    *SemaphoreHndlPtr = VK_NULL_HANDLE;
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
-    *SizeInBytes = 0;
-    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
-    void* MappedAddress = nullptr;
-    if (AllOK(StatusOK)) {
-        
-        //  See if the buffer has already been mapped, in which case we know the mapped address.
-
-        if (I_BufferDetails[Index].MappedAddress) {
-            MappedAddress = I_BufferDetails[Index].MappedAddress;
-        } else {
-            
-            //  If not, we have to map it now. Note that we map the whole of the allocated
-            //  memory (which can be more than the current size of the buffer, if the buffer
-            //  was ever resized down).
-            
-            if (vkMapMemory(I_LogicalDevice,I_BufferDetails[Index].MainBufferMemoryHndl,0,
-                I_BufferDetails[Index].MemorySizeInBytes,0,&MappedAddress) != VK_SUCCESS) {
-                MappedAddress = nullptr;
-                StatusOK = false;
-            } else {
-                
-                //  Record the mapped address in the buffer details.
-                
-                I_BufferDetails[Index].MappedAddress = MappedAddress;
-            }
-        }
-        if (AllOK(StatusOK)) *SizeInBytes = I_BufferDetails[Index].SizeInBytes;
+    if (!I_TimelineSupported) {
+        LogError ("Device does not support timeline semaphores.");
+        StatusOK = false;
+        return;
+    }
+    VkSemaphoreTypeCreateInfoKHR TypeInfo{};
+    TypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    TypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    TypeInfo.initialValue = InitialValue;
+    VkSemaphoreCreateInfo SemaphoreInfo{};
+    SemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    SemaphoreInfo.pNext = &TypeInfo;
+    VkResult Result = vkCreateSemaphore(I_LogicalDevice,&SemaphoreInfo,nullptr,SemaphoreHndlPtr);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to create timeline semaphore","vkCreateSemaphore",Result);
+        *SemaphoreHndlPtr = VK_NULL_HANDLE;
+        StatusOK = false;
+    } else {
+        I_SemaphoreHndls.push_back(*SemaphoreHndlPtr);
     }
-    return MappedAddress;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                  U n m a p  B u f f e r
+//                   T i m e l i n e  S e m a p h o r e s  S u p p o r t e d
 //
-//  This routine unmaps the CPU memory allocated for a buffer. Following this, its address
-//  range as returned by MapBuffer() will no longer be accessible (although until the buffer is
-//  deleted it can always be remapped if necessary). A buffer will be unmapped automatically when
-//  the Framework is shut down or the buffer deleted, and this routine does not need to be called
-//  as a preliminary to deleting a buffer.
+//  Returns true if the logical device supports timeline semaphores, in which case
+//  CreateTimelineSemaphore() and the routines that use them are available. This is only
+//  meaningful once the logical device has been created.
+//
+//  Returns:
+//     (bool)        True if timeline semaphores are supported.
+
+bool KVVulkanFramework::TimelineSemaphoresSupported (void)
+{
+    return I_TimelineSupported;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        W a i t  F o r  S e m a p h o r e  V a l u e
+//
+//  Waits until a timeline semaphore reaches (at least) a given value.
 //
 //  Parameters:
-//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
-//                   as returned by SetBufferDetails().
+//     SemaphoreHndl (VkSemaphore) The timeline semaphore, as created by CreateTimelineSemaphore().
+//     Value         (uint64_t) The value to wait for.
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
-//  Pre-requisites:
-//     MapBuffer() must previously have been called to map the buffer.
 //
 //  Note:
-//     If the buffer has not in fact been mapped, this routine returns without indicating an error.
+//     As with WaitFor(), the wait times out - with an error - after 100 seconds. The Framework's
+//     mutex isn't held during the wait, so other threads can carry on using the Framework.
+//     Also as with WaitFor(), the value is polled for up to the time set by SetWaitSpin()
+//     before the wait blocks, and the wait is timed for GetWaitStats().
 
-void KVVulkanFramework::UnmapBuffer(KVBufferHandle BufferHndl,bool& StatusOK)
+void KVVulkanFramework::WaitForSemaphoreValue(VkSemaphore SemaphoreHndl,uint64_t Value,
+                                                                              bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
-    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
-    if (AllOK(StatusOK)) {
-        
-        //  Only unmap the buffer if it's actually been mapped.
-        
-        if (I_BufferDetails[Index].MappedAddress) {
-            vkUnmapMemory(I_LogicalDevice,I_BufferDetails[Index].MainBufferMemoryHndl);
-            I_BufferDetails[Index].MappedAddress = nullptr;
-        }
+    
+    if (!I_TimelineSupported) {
+        LogError ("Device does not support timeline semaphores.");
+        StatusOK = false;
+        return;
+    }
+    MsecTimer WaitTimer;
+    bool Spun = false;
+    VkResult Result = VK_SUCCESS;
+    unsigned int SpinUsec = I_WaitSpinUsec;
+    if (SpinUsec > 0) {
+        uint64_t Current = 0;
+        do {
+            Result = I_GetSemaphoreCounterValue(I_LogicalDevice,SemaphoreHndl,&Current);
+            Spun = (Result == VK_SUCCESS && Current >= Value);
+        } while (Result == VK_SUCCESS && !Spun &&
+                                            WaitTimer.ElapsedNsec() < int64_t(SpinUsec) * 1000);
+    }
+    if (Result == VK_SUCCESS && !Spun) {
+        VkSemaphoreWaitInfoKHR WaitInfo{};
+        WaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        WaitInfo.semaphoreCount = 1;
+        WaitInfo.pSemaphores = &SemaphoreHndl;
+        WaitInfo.pValues = &Value;
+        Result = I_WaitSemaphores(I_LogicalDevice,&WaitInfo,100000000000);
+    }
+    RecordWait(WaitTimer.ElapsedMsec() * 1000.0,Spun);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to wait for semaphore value","vkWaitSemaphoresKHR",Result);
+        StatusOK = false;
     }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                  S y n c  B u f f e r
+//                             G e t  S e m a p h o r e  V a l u e
 //
-//  This routine synchronizes a staged buffer. Such a buffer is implemented using two separate
-//  buffers of the same size, one local to the CPU and one local to the GPU, and the program
-//  using them is responsible for indicating when they need to be brought into sync. These are
-//  usually used when there are significant overheads associated with the use of shared buffers
-//  (ones that both the CPU and GPU can access, and which rely on the underlying system to ensure
-//  that the CPU and GPU both see the same data when they do access them). In such cases, a program
-//  may for example, create a 'staging' buffer on the CPU, write into it and then copy its contents
-//  in one go - presumably this is a relatively efficient process - to the corresponding GPU buffer.
-//  Alternatively, the GPU may be used to fill a buffer local to the GPU, and this can then be
-//  copied over to the corresponding CPU buffer. So the buffer handle passed should be that for
-//  a buffer created as either "STAGED_CPU" or "STAGED_GPU", and which was used will determine the
-//  direction of transfer set up by this routine - a "STAGED_CPU" buffer is synched by copying the
-//  CPU side buffer over to the GPU side buffer, and a "STAGED_GPU" buffer is synched by a transfer
-//  in the opposite direction.
+//  Returns the current value of a timeline semaphore. This does not wait.
 //
 //  Parameters:
-//     BufferHandle  (KVBufferHandle) An opaque handle used by the Framework to refer to the buffer,
-//                   as returned by SetBufferDetails().
-//     CommandPoolHndl (VkCommandPool) A Vulkan handle specifying the command pool to be used
-//                   to set up the required transfer.
-//     QueueHandl    (VkQueue) A Vulkan handle specifying the queue to be used for the required
-//                   transfer.
+//     SemaphoreHndl (VkSemaphore) The timeline semaphore, as created by CreateTimelineSemaphore().
 //     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
 //                   this routine returns immediately. If something goes wrong, the variable
 //                   will be set false.
-//  Pre-requisites:
-//     o SetBufferDetails() must have been called to return the buffer handle that is passed to
-//     this routine, the buffer should have access "STAGED_GPU" or "STAGED_CPU" and the CPU and
-//     GPU buffers and their associated memory should already have been created using
-//     CreateBuffer().
-//     o The transfer is performed by setting up a transfer operation on the GPU, and this requires
-//     allocation of a command buffer from a pool, and a queue to run that command on. The command
-//     pool should be one created using CreatCommandPool(), and the queue should be obtained using
-//     by GetDeviceQueue().
 //
-//  Note:
-//     If the buffer is not in fact a staged buffer, this routine returns without indicating an
-//     error. This makes it easier to experiment with the use of shared buffers as opposed to
-//     staged ones - just include the call to SyncBuffer() in both cases where needed, and this
-//     will work for either shared or staged buffers.
+//  Returns:
+//     (uint64_t)    The current value of the semaphore, or 0 if it can't be read.
 
-void KVVulkanFramework::SyncBuffer(KVBufferHandle BufferHndl,VkCommandPool CommandPoolHndl,
-                                                           VkQueue QueueHndl,bool& StatusOK)
+uint64_t KVVulkanFramework::GetSemaphoreValue(VkSemaphore SemaphoreHndl,bool& StatusOK)
 {
-    if (!AllOK(StatusOK)) return;
+    uint64_t Value = 0;
+    if (!AllOK(StatusOK)) return Value;
     
-    int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
-    if (AllOK(StatusOK)) {
-        
-        //  If this isn't a staged buffer, quietly do nothing - a sync is a null operation.
-        
-        if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU ||
-            I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_GPU) {
-            
-            //  The sync operation consists of a copy of data between the CPU-visible buffer and
-            //  the local buffer used by the GPU. Which way depends on whether the buffer access
-            //  type (STAGED_GPU or STAGED_CPU) - but that comes right at the end. First we need
-            //  a command buffer for the copy.
-            
-            VkCommandBufferAllocateInfo AllocInfo{};
-            AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            AllocInfo.commandPool = CommandPoolHndl;
-            AllocInfo.commandBufferCount = 1;
-            
-            VkCommandBuffer CommandBuffer;
-            vkAllocateCommandBuffers(I_LogicalDevice,&AllocInfo,&CommandBuffer);
-            
-            //  Then we need to set up the command buffer. All it's going to run is a copy
-            //  command. So we begin the command buffer setup..
-            
-            VkCommandBufferBeginInfo BeginInfo{};
-            BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-            
-            vkBeginCommandBuffer(CommandBuffer,&BeginInfo);
-            
-            //  Then we set up the details of the copy command. All this needs is the source and
-            //  destination buffers involved, the number of bytes to copy, and the offsets within
-            //  each buffer. Which is the source buffer and which the destination depends on the
-            //  whether this is a buffer where the CPU creates the data which then has to be
-            //  copied to the GPU (STAGED_CPU) or where the GPU computes the data which then has
-            //  to be copied to the CPU (STAGED_GPU). There's only one copy region involved.
-            
-            VkBufferCopy CopyRegion{};
-            CopyRegion.size = I_BufferDetails[Index].SizeInBytes;
-            CopyRegion.srcOffset = 0;
-            CopyRegion.dstOffset = 0;
-            VkBuffer SrcBufferHndl,DstBufferHndl;
-            if (I_BufferDetails[Index].BufferAccess == ACCESS_STAGED_CPU) {
-                SrcBufferHndl = I_BufferDetails[Index].MainBufferHndl;
-                DstBufferHndl = I_BufferDetails[Index].SecondaryBufferHndl;
-            } else {
-                SrcBufferHndl = I_BufferDetails[Index].SecondaryBufferHndl;
-                DstBufferHndl = I_BufferDetails[Index].MainBufferHndl;
-                
-            }
-            vkCmdCopyBuffer(CommandBuffer,SrcBufferHndl,DstBufferHndl,1,&CopyRegion);
-            
-            vkEndCommandBuffer(CommandBuffer);
-            
-            //  Then we submit the command buffer on the specified queue, and wait for the
-            //  copy to finish.
-            
-            VkSubmitInfo SubmitInfo{};
-            SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            SubmitInfo.commandBufferCount = 1;
-            SubmitInfo.pCommandBuffers = &CommandBuffer;
-            
-            vkQueueSubmit(QueueHndl,1,&SubmitInfo,VK_NULL_HANDLE);
-            vkQueueWaitIdle(QueueHndl);
-            
-            //  Remembering to release the command buffer once we've finished with it.
-            
-            vkFreeCommandBuffers(I_LogicalDevice,CommandPoolHndl,1,&CommandBuffer);
-            
-            //  Just to note that there hasn't been any status checking in this sequence, and
-            //  there really ought to be.
-        }
+    if (!I_TimelineSupported) {
+        LogError ("Device does not support timeline semaphores.");
+        StatusOK = false;
+        return Value;
     }
+    VkResult Result = I_GetSemaphoreCounterValue(I_LogicalDevice,SemaphoreHndl,&Value);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError ("Failed to get semaphore value","vkGetSemaphoreCounterValueKHR",Result);
+        StatusOK = false;
+        Value = 0;
+    }
+    return Value;
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -3720,6 +10986,75 @@ bool KVVulkanFramework::SwapChainSupportAdequate(VkPhysicalDevice DeviceHndl,boo
     return SwapChainAdequate;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                            S e t  P r e s e n t  M o d e
+//
+//  Normally, CreateSwapChain() picks the presentation mode itself, preferring MAILBOX mode if
+//  the device supports it - see PickSwapPresentMode(). This routine lets a program ask for a
+//  specific mode instead. Which is best depends on what the program is doing: IMMEDIATE and
+//  MAILBOX don't hold the program to the display refresh rate, which is what a benchmark
+//  wants, while FIFO (which every device supports) paces the program to the display, with
+//  the lowest latency if the swap chain has as few images as possible.
+//
+//  Parameters:
+//     Mode          (const std::string&) The presentation mode. This can be "FIFO",
+//                   "FIFO_RELAXED", "MAILBOX" or "IMMEDIATE", in any case, or blank to let
+//                   CreateSwapChain() choose.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     This must be called before CreateSwapChain() if it is to have any effect.
+//
+//  Note:
+//     If the device doesn't support the requested mode, a warning is logged when the swap
+//     chain is created and the mode is chosen as if this hadn't been called.
+
+void KVVulkanFramework::SetPresentMode(const std::string& Mode,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    std::string UpperMode = Mode;
+    for (char& Char : UpperMode) Char = toupper(Char);
+    if (UpperMode == "") {
+        I_RequestedPresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+    } else if (UpperMode == "FIFO") {
+        I_RequestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    } else if (UpperMode == "FIFO_RELAXED") {
+        I_RequestedPresentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    } else if (UpperMode == "MAILBOX") {
+        I_RequestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (UpperMode == "IMMEDIATE") {
+        I_RequestedPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else {
+        LogError("Invalid presentation mode '%s' specified.",Mode.c_str());
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        S e t  S w a p  C h a i n  I m a g e s
+//
+//  Normally, the number of images in the swap chain is the number the program asks for in its
+//  call to CreateSwapChain(). This routine allows that to be overridden - usually at the request
+//  of the user, for example to see the effect on latency or frame rate. The swap chain will
+//  still be limited to the range of image counts supported by the device.
+//
+//  Parameters:
+//     Images        (uint32_t) The number of images the swap chain should have. Zero means
+//                   the number passed to CreateSwapChain() is used.
+//
+//  Pre-requisites:
+//     This must be called before CreateSwapChain() if it is to have any effect.
+
+void KVVulkanFramework::SetSwapChainImages(uint32_t Images)
+{
+    I_RequestedImageCount = Images;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                             C r e a t e  S w a p  C h a i n
@@ -3739,7 +11074,8 @@ bool KVVulkanFramework::SwapChainSupportAdequate(VkPhysicalDevice DeviceHndl,boo
 //
 //  Parameters:
 //     RequestedImages (uint32_t) The number of images the caller would like the swap chain
-//                     to support.
+//                     to support. This is ignored if SetSwapChainImages() has specified a
+//                     number.
 //     StatusOK        (bool&) A reference to an inherited status variable. If passed false,
 //                     this routine returns immediately. If something goes wrong, the variable
 //                     will be set false.
@@ -3782,13 +11118,14 @@ uint32_t KVVulkanFramework::CreateSwapChain(uint32_t RequestedImages,bool& Statu
     //  queue of images.
     
     uint32_t ImageCount = RequestedImages;
+    if (I_RequestedImageCount > 0) ImageCount = I_RequestedImageCount;
     if (ImageCount == 0) ImageCount = Capabilities.minImageCount + 1;
     if (Capabilities.maxImageCount > 0 && ImageCount > Capabilities.maxImageCount) {
         ImageCount = Capabilities.maxImageCount;
     }
     if (ImageCount < Capabilities.minImageCount) ImageCount = Capabilities.minImageCount;
     I_Debug.Logf("Swapchain","Swap chain min image count: %d, max image count: %d",
-                                    Capabilities.minImageCount,Capabilities.minImageCount);
+                                    Capabilities.minImageCount,Capabilities.maxImageCount);
     I_Debug.Logf("Swapchain","Using swap chain imageCount = %d",ImageCount);
     I_ImageCount = ImageCount;
 
@@ -3803,6 +11140,17 @@ uint32_t KVVulkanFramework::CreateSwapChain(uint32_t RequestedImages,bool& Statu
     CreateInfo.imageExtent = Extent;
     CreateInfo.imageArrayLayers = 1;
     CreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    
+    //  If the surface allows it, and the images have four bytes per pixel in an order we know,
+    //  the images are also made usable as the source of a copy, so CaptureGraphicsFrame() can
+    //  copy them into a buffer.
+    
+    VkFormat Format = SurfaceFormat.format;
+    I_CaptureBGR = (Format == VK_FORMAT_B8G8R8A8_UNORM || Format == VK_FORMAT_B8G8R8A8_SRGB);
+    bool RGBA = (Format == VK_FORMAT_R8G8B8A8_UNORM || Format == VK_FORMAT_R8G8B8A8_SRGB);
+    I_CaptureSupported = (Capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) &&
+                                                                           (I_CaptureBGR || RGBA);
+    if (I_CaptureSupported) CreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
     //  If we end up using different queue families for graphics and present, then we need to
     //  specify the sharing mode as VK_SHARING_MODE_CONCURRENT and specify the queue families
@@ -3971,6 +11319,62 @@ VkSurfaceFormatKHR KVVulkanFramework::PickSwapSurfaceFormat(bool& StatusOK)
     return ChosenFormat;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G e t  P r e s e n t  M o d e
+//
+//  Returns the presentation mode used by the swap chain, as picked by PickSwapPresentMode() when
+//  the swap chain was created. The Vulkan utility routine string_VkPresentModeKHR() will turn
+//  this into a readable name.
+//
+//  Returns:
+//     (VkPresentModeKHR) The presentation mode in use.
+//
+//  Pre-requisites:
+//     CreateSwapChain() must have been called. If not, this returns VK_PRESENT_MODE_FIFO_KHR.
+
+VkPresentModeKHR KVVulkanFramework::GetPresentMode(void)
+{
+    return I_PresentMode;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          S e t  F r a m e s  I n  F l i g h t
+//
+//  DrawGraphicsFrame() doesn't wait for a frame to be drawn, only for the last frame drawn with
+//  the same frame number to finish, so a program that cycles through N frame numbers can have
+//  up to N frames in flight at once, each with its own command buffer and sync objects (see
+//  CreateSyncObjects()). Two is usual. More lets the CPU get further ahead of the GPU when
+//  the GPU is the bottleneck, at the cost of latency, and one keeps the CPU in step with the
+//  GPU. The Framework doesn't enforce this number itself - it simply records it, so that it
+//  can be set by a program's main routine and picked up by the code that does the drawing.
+//
+//  Parameters:
+//     Frames        (int) The number of frames to allow in flight at once. Values less than
+//                   one are taken as one.
+
+void KVVulkanFramework::SetFramesInFlight(int Frames)
+{
+    I_FramesInFlight = Frames < 1 ? 1 : Frames;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          G e t  F r a m e s  I n  F l i g h t
+//
+//  Returns the number of frames a program should let be in flight at once, as set by
+//  SetFramesInFlight(). This is 2 if SetFramesInFlight() hasn't been called. A program should
+//  not use more than the number of swap chain images.
+//
+//  Returns:
+//     (int)         The number of frames to allow in flight at once.
+
+int KVVulkanFramework::GetFramesInFlight(void)
+{
+    return I_FramesInFlight;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                P i c k  S w a p  P r e s e n t  M o d e   (internal routine)
@@ -3995,7 +11399,8 @@ VkSurfaceFormatKHR KVVulkanFramework::PickSwapSurfaceFormat(bool& StatusOK)
 //    must have been selected using FindSuitableDevice().
 //
 //  Note:
-//    More specialised applications may want more control over the mode than this provides.
+//    A program can ask for a specific mode using SetPresentMode(). If it has, and the device
+//    supports that mode, it is used.
 
 VkPresentModeKHR KVVulkanFramework::PickSwapPresentMode(bool& StatusOK)
 {
@@ -4005,13 +11410,16 @@ VkPresentModeKHR KVVulkanFramework::PickSwapPresentMode(bool& StatusOK)
     VkPresentModeKHR ChosenMode = VK_PRESENT_MODE_FIFO_KHR;
     if (!AllOK(StatusOK)) return ChosenMode;
     
-    //  Look at the modes available. If Mailbox mode is available, we'll take that. If not,
-    //  we just settle for the first one that's supported.
+    //  Look at the modes available. If a mode was requested using SetPresentMode() and it's
+    //  available, we use that. Otherwise, if Mailbox mode is available, we'll take that. If
+    //  not, we just settle for the first one that's supported.
     
-    uint32_t ModeCount;
+    uint32_t ModeCount = 0;
     vkGetPhysicalDeviceSurfacePresentModesKHR(I_SelectedDevice,I_Surface,&ModeCount,nullptr);
     if (ModeCount > 0) {
         std::vector<VkPresentModeKHR> PossibleModes(ModeCount);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(I_SelectedDevice,I_Surface,&ModeCount,
+                                                                        PossibleModes.data());
         ChosenMode = PossibleModes[0];
         if (I_Debug.Active("Swapchain")) {
             I_Debug.Logf("Swapchain","Device supports %d present mode(s)",ModeCount);
@@ -4019,14 +11427,31 @@ VkPresentModeKHR KVVulkanFramework::PickSwapPresentMode(bool& StatusOK)
                 I_Debug.Logf("Swapchain","Mode: %s",string_VkPresentModeKHR(Mode));
             }
         }
-        for (const auto& Mode : PossibleModes) {
-            if (Mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                ChosenMode = Mode;
-                break;
+        bool Requested = false;
+        if (I_RequestedPresentMode != VK_PRESENT_MODE_MAX_ENUM_KHR) {
+            for (const auto& Mode : PossibleModes) {
+                if (Mode == I_RequestedPresentMode) {
+                    ChosenMode = Mode;
+                    Requested = true;
+                    break;
+                }
+            }
+            if (!Requested) {
+                LogWarning("Presentation mode %s is not supported by the device",
+                                               string_VkPresentModeKHR(I_RequestedPresentMode));
+            }
+        }
+        if (!Requested) {
+            for (const auto& Mode : PossibleModes) {
+                if (Mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+                    ChosenMode = Mode;
+                    break;
+                }
             }
         }
         I_Debug.Logf("Swapchain","Chosen mode: %s",string_VkPresentModeKHR(ChosenMode));
     }
+    I_PresentMode = ChosenMode;
     return ChosenMode;
 }
 
@@ -4264,27 +11689,11 @@ void KVVulkanFramework::CreateShaderModuleFromFile(
         const std::string& ShaderFilename,VkShaderModule* ModuleHndlPtr,bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
-    VkShaderModule ShaderModuleHndl = VK_NULL_HANDLE;
-    uint32_t* ShaderCode = nullptr;
     
-    //  Read the SPIR-V code from the file (this will be into an array allocated using new[])
+    //  GetShaderModule() reads the SPIR-V code, creates the module from it if this code hasn't
+    //  been used before, and records the handle for the module so it can be deleted later.
     
-    long LengthInBytes;
-    ShaderCode = ReadSpirVFile(ShaderFilename,&LengthInBytes,StatusOK);
-    
-    //  Create the module from the code, and release the memory used for the code. Then record
-    //  the handle for the module so it can be deleted later.
-    
-    ShaderModuleHndl = CreateShaderModule(ShaderCode,LengthInBytes,StatusOK);
-    if (ShaderCode) delete[] ShaderCode;
-    if (AllOK(StatusOK)) {
-        I_ShaderModuleHndls.push_back(ShaderModuleHndl);
-    } else {
-        if (ShaderModuleHndl != VK_NULL_HANDLE) { vkDestroyShaderModule(I_LogicalDevice,ShaderModuleHndl,nullptr);
-            ShaderModuleHndl = VK_NULL_HANDLE;
-        }
-    }
-    *ModuleHndlPtr = ShaderModuleHndl;
+    *ModuleHndlPtr = GetShaderModule(ShaderFilename,StatusOK);
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -4332,6 +11741,42 @@ void KVVulkanFramework::CreateGraphicsPipeline(
     const std::string& VertexType,
     const std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
     VkPipelineLayout* PipelineLayoutHndlPtr,VkPipeline* PipelineHndlPtr,bool& StatusOK)
+{
+    CreateGraphicsPipeline(VertexShaderHndl,VertexStageName,FragmentShaderHndl,FragmentStageName,
+         VertexType,BufferHandles,nullptr,PipelineLayoutHndlPtr,PipelineHndlPtr,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//          C r e a t e  G r a p h i c s  P i p e l i n e   (with a descriptor set layout)
+//
+//  This version of CreateGraphicsPipeline() also lets the shaders use a descriptor set, whose
+//  layout is passed, so they can read buffers - storage or uniform buffers - other than the
+//  vertex buffers. A fragment shader can, for example, look up the colour for each pixel it
+//  draws in such a buffer. The descriptor set itself is bound when the frame is drawn, by
+//  the version of DrawGraphicsFrame() that takes descriptor set handles.
+//
+//  Parameters:
+//     VertexShaderHndl, VertexStageName, FragmentShaderHndl, FragmentStageName, VertexType,
+//                   BufferHandles - as for the simpler version of CreateGraphicsPipeline().
+//                   BufferHandles need list only the vertex buffers, and may be empty if
+//                   the vertex shader generates its own vertices.
+//     SetLayoutHndlPtr (VkDescriptorSetLayout*) The address of the handle for the descriptor set
+//                   layout, as created by CreateVulkanDescriptorSetLayout(). If this is nullptr,
+//                   the pipeline uses no descriptor sets.
+//     PipelineLayoutHndlPtr, PipelineHndlPtr, StatusOK - as for the simpler version of
+//                   CreateGraphicsPipeline().
+//
+//  Pre-requisites:
+//     As for the simpler version of CreateGraphicsPipeline().
+
+void KVVulkanFramework::CreateGraphicsPipeline(
+    VkShaderModule VertexShaderHndl,const std::string& VertexStageName,
+    VkShaderModule FragmentShaderHndl,const std::string& FragmentStageName,
+    const std::string& VertexType,
+    const std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+    VkDescriptorSetLayout* SetLayoutHndlPtr,
+    VkPipelineLayout* PipelineLayoutHndlPtr,VkPipeline* PipelineHndlPtr,bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
 
@@ -4463,6 +11908,10 @@ void KVVulkanFramework::CreateGraphicsPipeline(
         VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
         PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         PipelineLayoutInfo.setLayoutCount = 0;
+        if (SetLayoutHndlPtr) {
+            PipelineLayoutInfo.setLayoutCount = 1;
+            PipelineLayoutInfo.pSetLayouts = SetLayoutHndlPtr;
+        }
         PipelineLayoutInfo.pushConstantRangeCount = 0;
 
         VkResult Result;
@@ -4492,7 +11941,7 @@ void KVVulkanFramework::CreateGraphicsPipeline(
             PipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
             Result = vkCreateGraphicsPipelines(
-                    I_LogicalDevice,VK_NULL_HANDLE,1,&PipelineInfo,nullptr,PipelineHndlPtr);
+                    I_LogicalDevice,I_PipelineCacheHndl,1,&PipelineInfo,nullptr,PipelineHndlPtr);
             if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
                 LogVulkanError("Failed to create graphics pipeline.","vkCreateGraphicsPipelines",
                                                                                           Result);
@@ -4789,6 +12238,7 @@ void KVVulkanFramework::SetVertexBufferDetails(
     //  will allow the pipeline to be set up as needed to use the buffer.
     
     if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     
     int Index = BufferIndexFromHandle(BufferHndl,StatusOK);
     if (AllOK(StatusOK)) {
@@ -4872,12 +12322,99 @@ void KVVulkanFramework::SetVertexBufferDetails(
 void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer CommandBufferHndl,
    int Stages, int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
                                                 VkPipeline PipelineHndls[],bool& StatusOK)
+{
+    std::vector<KVTimelinePoint> NoWaitPoints;
+    DrawGraphicsFrame(CurrentFrame,CommandBufferHndl,Stages,VertexCounts,BufferSets,
+                                                    PipelineHndls,NoWaitPoints,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              D r a w  G r a p h i c s  F r a m e   (waiting for timeline semaphores)
+//
+//  This version of DrawGraphicsFrame() also has the graphics submission wait, on the GPU, until
+//  a number of timeline semaphores have reached given values. This lets the drawing of a frame
+//  depend on GPU work - typically a compute submission that produces the data being drawn - that
+//  signalled the semaphore, without the CPU having to wait for that work to complete.
+//
+//  Parameters:
+//     CurrentFrame, CommandBufferHndl, Stages, VertexCounts, BufferSets, PipelineHndls - as for
+//                       the simpler version of DrawGraphicsFrame().
+//     WaitPoints        (const std::vector<KVTimelinePoint>&) Timeline semaphores, and the values
+//                       they must reach before the frame is drawn. May be empty. The wait takes
+//                       place before any vertex data is read.
+//     StatusOK          (bool&) A reference to an inherited status variable. If passed false,
+//                       this routine returns immediately. If something goes wrong, the variable
+//                       will be set false.
+//
+//  Pre-requisites:
+//     As for the simpler version of DrawGraphicsFrame(). If WaitPoints is not empty, the device
+//     must support timeline semaphores - see TimelineSemaphoresSupported().
+
+void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer CommandBufferHndl,
+   int Stages, int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
+      VkPipeline PipelineHndls[],const std::vector<KVTimelinePoint>& WaitPoints,bool& StatusOK)
+{
+    DrawGraphicsFrame(CurrentFrame,CommandBufferHndl,Stages,VertexCounts,BufferSets,
+                                      PipelineHndls,nullptr,nullptr,WaitPoints,StatusOK);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              D r a w  G r a p h i c s  F r a m e   (binding descriptor sets)
+//
+//  This is the most general version of DrawGraphicsFrame(). As well as waiting for timeline
+//  semaphores, it binds a descriptor set for any stage whose pipeline was created using the
+//  version of CreateGraphicsPipeline() that takes a descriptor set layout.
+//
+//  Parameters:
+//     CurrentFrame, CommandBufferHndl, Stages, VertexCounts, BufferSets, PipelineHndls - as for
+//                       the simpler version of DrawGraphicsFrame().
+//     PipelineLayoutHndls (VkPipelineLayout[]) The Vulkan handles for the pipeline layouts, as
+//                       returned by CreateGraphicsPipeline(). May be nullptr if no stage
+//                       uses a descriptor set.
+//     DescriptorSetHndls (VkDescriptorSet[]) The descriptor set to be bound for each stage, or
+//                       VK_NULL_HANDLE for a stage that doesn't use one. May be nullptr if no
+//                       stage uses a descriptor set.
+//     WaitPoints        (const std::vector<KVTimelinePoint>&) As for the version of
+//                       DrawGraphicsFrame() that waits for timeline semaphores. May be empty.
+//     StatusOK          (bool&) A reference to an inherited status variable. If passed false,
+//                       this routine returns immediately. If something goes wrong, the variable
+//                       will be set false.
+//
+//  Pre-requisites:
+//     As for the simpler versions of DrawGraphicsFrame(). The descriptor sets should have been
+//     created by CreateVulkanDescriptorSet(), using the layout passed to CreateGraphicsPipeline().
+
+void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer CommandBufferHndl,
+   int Stages, int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
+      VkPipeline PipelineHndls[],VkPipelineLayout PipelineLayoutHndls[],
+      VkDescriptorSet DescriptorSetHndls[],const std::vector<KVTimelinePoint>& WaitPoints,
+      bool& StatusOK)
 {
     if (!AllOK(StatusOK)) return;
+    TraceScope Trace("DrawGraphicsFrame","Vulkan");
+    
+    if (WaitPoints.size() > 0 && !I_TimelineSupported) {
+        LogError ("Device does not support timeline semaphores.");
+        StatusOK = false;
+        return;
+    }
     
     MsecTimer Timer; // DEBUG
     vkWaitForFences(I_LogicalDevice,1,&I_FenceHndls[CurrentFrame],VK_TRUE,UINT64_MAX);
     
+    //  If this frame is to be copied into a buffer, that's a one-off request. Whatever the
+    //  last frame with this number copied is forgotten - the program should have collected it,
+    //  using GetCapturedFrame(), before drawing this one.
+    
+    KVBufferHandle CaptureHndl = 0;
+    if (CurrentFrame >= 0 && CurrentFrame < int(I_CaptureHndls.size())) {
+        CaptureHndl = I_CaptureHndls[CurrentFrame];
+        I_CaptureHndls[CurrentFrame] = 0;
+        I_CapturedExtents[CurrentFrame] = {0,0};
+    }
+    
     uint32_t ImageIndex;
     VkResult Result = vkAcquireNextImageKHR(I_LogicalDevice,I_SwapChain,UINT64_MAX,
                                 I_ImageSemaphoreHndls[CurrentFrame],VK_NULL_HANDLE,&ImageIndex);
@@ -4894,17 +12431,29 @@ void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer Comm
     
     //  The command buffer will need re-recording - they're only good for one submission.
     
-    RecordGraphicsCommandBuffer(CommandBufferHndl,Stages,PipelineHndls,ImageIndex,
-                                                        VertexCounts,BufferSets,StatusOK);
+    bool Captured = false;
+    RecordGraphicsCommandBuffer(CommandBufferHndl,Stages,PipelineHndls,ImageIndex,VertexCounts,
+              BufferSets,PipelineLayoutHndls,DescriptorSetHndls,CaptureHndl,&Captured,StatusOK);
+    if (Captured) I_CapturedExtents[CurrentFrame] = I_SwapChainExtent;
     
     VkSubmitInfo SubmitInfo{};
     SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     
-    VkSemaphore WaitSemaphores[] = {I_ImageSemaphoreHndls[CurrentFrame]};
-    VkPipelineStageFlags WaitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    SubmitInfo.waitSemaphoreCount = 1;
-    SubmitInfo.pWaitSemaphores = WaitSemaphores;
-    SubmitInfo.pWaitDstStageMask = WaitStages;
+    //  The first wait is always for the swap chain image to be available. Any timeline waits
+    //  follow it. Vulkan needs a value for every semaphore once any of them is a timeline
+    //  semaphore, but ignores the value given for the binary image semaphore.
+    
+    std::vector<VkSemaphore> WaitSemaphores = {I_ImageSemaphoreHndls[CurrentFrame]};
+    std::vector<VkPipelineStageFlags> WaitStages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    std::vector<uint64_t> WaitValues = {0};
+    for (const KVTimelinePoint& Point : WaitPoints) {
+        WaitSemaphores.push_back(Point.SemaphoreHndl);
+        WaitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+        WaitValues.push_back(Point.Value);
+    }
+    SubmitInfo.waitSemaphoreCount = uint32_t(WaitSemaphores.size());
+    SubmitInfo.pWaitSemaphores = WaitSemaphores.data();
+    SubmitInfo.pWaitDstStageMask = WaitStages.data();
     
     SubmitInfo.commandBufferCount = 1;
     SubmitInfo.pCommandBuffers = &CommandBufferHndl;
@@ -4913,9 +12462,19 @@ void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer Comm
     SubmitInfo.signalSemaphoreCount = 1;
     SubmitInfo.pSignalSemaphores = SignalSemaphores;
     
+    uint64_t SignalValues[] = {0};
+    VkTimelineSemaphoreSubmitInfoKHR TimelineInfo{};
+    TimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    TimelineInfo.waitSemaphoreValueCount = uint32_t(WaitValues.size());
+    TimelineInfo.pWaitSemaphoreValues = WaitValues.data();
+    TimelineInfo.signalSemaphoreValueCount = 1;
+    TimelineInfo.pSignalSemaphoreValues = SignalValues;
+    if (WaitPoints.size() > 0) SubmitInfo.pNext = &TimelineInfo;
+    
     VkQueue Queue;
     vkGetDeviceQueue(I_LogicalDevice,I_QueueFamilyIndex,0,&Queue);   //?? Is this the right place?
     
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
     Result = vkQueueSubmit(Queue,1,&SubmitInfo,I_FenceHndls[CurrentFrame]);
     if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
         LogVulkanError("Failed to submit draw command buffer","vkQueueSubmit",Result);
@@ -4945,6 +12504,157 @@ void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer Comm
     
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                       W a i t  F o r  G r a p h i c s  F r a m e
+//
+//  DrawGraphicsFrame() returns as soon as the frame has been submitted, and only waits for it to
+//  complete the next time the same frame number is drawn. This routine waits for the frame to
+//  complete now. This is needed if a buffer the frame reads is about to be changed by something
+//  that isn't ordered after the frame on the GPU - by the CPU, for example, or by a compute
+//  submission with no barrier between it and the frame.
+//
+//  Parameters:
+//     CurrentFrame      (int) The frame number, as passed to DrawGraphicsFrame().
+//     StatusOK          (bool&) A reference to an inherited status variable. If passed false,
+//                       this routine returns immediately. If something goes wrong, the variable
+//                       will be set false.
+//
+//  Pre-requisites:
+//     CreateSyncObjects() must have been called to create the fences used for each frame.
+
+void KVVulkanFramework::WaitForGraphicsFrame (int CurrentFrame,bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    
+    if (CurrentFrame < 0 || CurrentFrame >= int(I_FenceHndls.size())) {
+        LogError ("Frame number %d is out of range.",CurrentFrame);
+        StatusOK = false;
+        return;
+    }
+    VkResult Result = vkWaitForFences(I_LogicalDevice,1,&I_FenceHndls[CurrentFrame],
+                                                                         VK_TRUE,UINT64_MAX);
+    if (Result != VK_SUCCESS) {
+        LogVulkanError("Failed to wait for frame to complete","vkWaitForFences",Result);
+        StatusOK = false;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       F r a m e  C a p t u r e  S u p p o r t e d
+//
+//  Returns true if the swap chain images can be copied into a buffer by CaptureGraphicsFrame().
+//  This needs the surface to allow its images to be the source of a copy, and the images to have
+//  a format with one byte each for red, green, blue and alpha. It is false until the swap chain
+//  has been created.
+
+bool KVVulkanFramework::FrameCaptureSupported(void)
+{
+    return I_CaptureSupported;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          G e t  S w a p  C h a i n  E x t e n t
+//
+//  Returns the current dimensions, in pixels, of the swap chain images. These can change
+//  whenever the swap chain is recreated, usually because the window has been resized, and may
+//  not match the frame buffer size set by SetFrameBufferSize().
+//
+//  Parameters:
+//     Width         (int*) Returned with the width of the images.
+//     Height        (int*) Returned with the height of the images.
+
+void KVVulkanFramework::GetSwapChainExtent(int* Width,int* Height)
+{
+    *Width = int(I_SwapChainExtent.width);
+    *Height = int(I_SwapChainExtent.height);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                          C a p t u r e  G r a p h i c s  F r a m e
+//
+//  Has the next frame drawn by DrawGraphicsFrame() with a given frame number copied into a
+//  buffer, once it has been drawn. The copy is part of the frame's command buffer, so it adds
+//  nothing to the time the CPU spends drawing the frame, and the CPU never waits for it. Once
+//  the frame has completed - which the program will usually know because it is about to draw
+//  the next frame with the same number, and so has to wait for it anyway - GetCapturedFrame()
+//  says whether it was copied and what the image looks like.
+//
+//  Parameters:
+//     CurrentFrame  (int) The frame number that will be passed to DrawGraphicsFrame().
+//     BufferHndl    (KVBufferHandle) The buffer for the copy. This should be a "READBACK"
+//                   buffer, and needs four bytes for each pixel of the swap chain images -
+//                   see GetSwapChainExtent(). The rows of the image follow each other with no
+//                   padding. If it's too small, the frame is simply not copied.
+//     StatusOK      (bool&) A reference to an inherited status variable. If passed false,
+//                   this routine returns immediately. If something goes wrong, the variable
+//                   will be set false.
+//
+//  Pre-requisites:
+//     The swap chain must have been created, and FrameCaptureSupported() must be true.
+
+void KVVulkanFramework::CaptureGraphicsFrame(int CurrentFrame,KVBufferHandle BufferHndl,
+                                                                               bool& StatusOK)
+{
+    if (!AllOK(StatusOK)) return;
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    
+    if (!I_CaptureSupported) {
+        LogError ("The swap chain images cannot be copied into a buffer.");
+        StatusOK = false;
+        return;
+    }
+    if (CurrentFrame < 0) {
+        LogError ("Frame number %d is out of range.",CurrentFrame);
+        StatusOK = false;
+        return;
+    }
+    BufferIndexFromHandle(BufferHndl,StatusOK);
+    if (AllOK(StatusOK)) {
+        if (CurrentFrame >= int(I_CaptureHndls.size())) {
+            I_CaptureHndls.resize(CurrentFrame + 1,0);
+            I_CapturedExtents.resize(CurrentFrame + 1,{0,0});
+        }
+        I_CaptureHndls[CurrentFrame] = BufferHndl;
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G e t  C a p t u r e d  F r a m e
+//
+//  Returns the details of the image copied into a buffer the last time DrawGraphicsFrame() was
+//  called with a given frame number, following a call to CaptureGraphicsFrame(). The buffer
+//  can only be read once that frame has completed - see WaitForGraphicsFrame() - and, if the
+//  memory isn't coherent, after InvalidateBuffer() has been called for it. The details are
+//  forgotten when the frame number is next drawn.
+//
+//  Parameters:
+//     CurrentFrame  (int) The frame number that was passed to DrawGraphicsFrame().
+//     Width         (int*) Returned with the width of the image copied.
+//     Height        (int*) Returned with the height of the image copied.
+//     BGR           (bool*) Returned true if the bytes for each pixel are in the order blue,
+//                   green, red, alpha, and false if they are red, green, blue, alpha.
+//
+//  Returns:
+//     (bool)        True if the frame was copied. If not, Width and Height are returned zero.
+
+bool KVVulkanFramework::GetCapturedFrame(int CurrentFrame,int* Width,int* Height,bool* BGR)
+{
+    std::lock_guard<std::recursive_mutex> Lock(I_Mutex);
+    *Width = 0;
+    *Height = 0;
+    *BGR = I_CaptureBGR;
+    if (CurrentFrame >= 0 && CurrentFrame < int(I_CapturedExtents.size())) {
+        *Width = int(I_CapturedExtents[CurrentFrame].width);
+        *Height = int(I_CapturedExtents[CurrentFrame].height);
+    }
+    return (*Width > 0 && *Height > 0);
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //          R e c o r d  G r a p h i c s  C o m m a n d  B u f f e r   (internal routine)
@@ -4964,6 +12674,14 @@ void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer Comm
 //     BufferSets        (std::vector<KVVulkanFramework::KVBufferHandle>[]) an array of vectors of
 //                       buffer handles, each giving the Framework handles for each buffer used
 //                       by the corresponding pipeline, as returned by SetBufferDetails().
+//     PipelineLayoutHndls (VkPipelineLayout[]) The pipeline layouts, or nullptr if no stage
+//                       uses a descriptor set.
+//     DescriptorSetHndls (VkDescriptorSet[]) The descriptor set for each stage, VK_NULL_HANDLE
+//                       for a stage without one, or nullptr if no stage uses a descriptor set.
+//     CaptureHndl       (KVBufferHandle) A buffer the image drawn is to be copied into once it
+//                       has been drawn, or zero if it isn't to be copied.
+//     CapturedPtr       (bool*) Returned true if the copy was recorded. It isn't if the buffer
+//                       is too small for the image.
 //     StatusOK          (bool&) A reference to an inherited status variable. If passed false,
 //                       this routine returns immediately. If something goes wrong, the variable
 //                       will be set false.
@@ -4976,8 +12694,10 @@ void KVVulkanFramework::DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer Comm
 void KVVulkanFramework::RecordGraphicsCommandBuffer(
         VkCommandBuffer CommandBufferHndl,int Stages,VkPipeline PipelineHndls[],int ImageNumber,
         int VertexCounts[], const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
-        bool& StatusOK)
+        VkPipelineLayout PipelineLayoutHndls[],VkDescriptorSet DescriptorSetHndls[],
+        KVBufferHandle CaptureHndl,bool* CapturedPtr,bool& StatusOK)
 {
+    *CapturedPtr = false;
     if (!AllOK(StatusOK)) return;
     
     vkResetCommandBuffer(CommandBufferHndl,0);
@@ -5049,12 +12769,73 @@ void KVVulkanFramework::RecordGraphicsCommandBuffer(
             }
         }
         
+        //  A pipeline that reads buffers other than its vertex buffers has a descriptor set.
+        
+        if (PipelineLayoutHndls && DescriptorSetHndls &&
+                                         DescriptorSetHndls[Stage] != VK_NULL_HANDLE) {
+            vkCmdBindDescriptorSets(CommandBufferHndl,VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    PipelineLayoutHndls[Stage],0,1,&DescriptorSetHndls[Stage],0,nullptr);
+        }
+        
         //  This is the important command - it tells the command buffer to actually draw things.
         
         vkCmdDraw(CommandBufferHndl,VertexCounts[Stage],1,0,0);
     }
     vkCmdEndRenderPass(CommandBufferHndl);
     
+    //  If the image is to be copied into a buffer, it has to be changed from the layout it's
+    //  presented in to one it can be copied from, and back again, and the copy made visible to
+    //  the CPU once the frame's fence has signalled. The present waits for all this to finish,
+    //  but nothing else does - in particular, the CPU doesn't.
+    
+    if (CaptureHndl != 0) {
+        int Index = BufferIndexFromHandle(CaptureHndl,StatusOK);
+        VkDeviceSize ImageBytes =
+                         VkDeviceSize(I_SwapChainExtent.width) * I_SwapChainExtent.height * 4;
+        if (AllOK(StatusOK) && VkDeviceSize(I_BufferDetails[Index].SizeInBytes) >= ImageBytes) {
+            VkImageMemoryBarrier ImageBarrier{};
+            ImageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            ImageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            ImageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            ImageBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            ImageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            ImageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            ImageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            ImageBarrier.image = I_SwapChainImages[ImageNumber];
+            ImageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1};
+            vkCmdPipelineBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT,0,0,nullptr,0,nullptr,1,&ImageBarrier);
+            
+            VkBufferImageCopy Region{};
+            Region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT,0,0,1};
+            Region.imageOffset = {0,0,0};
+            Region.imageExtent = {I_SwapChainExtent.width,I_SwapChainExtent.height,1};
+            vkCmdCopyImageToBuffer(CommandBufferHndl,ImageBarrier.image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,I_BufferDetails[Index].MainBufferHndl,
+                                                                                1,&Region);
+            
+            ImageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            ImageBarrier.dstAccessMask = 0;
+            ImageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            ImageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            VkBufferMemoryBarrier BufferBarrier{};
+            BufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            BufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            BufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            BufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            BufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            BufferBarrier.buffer = I_BufferDetails[Index].MainBufferHndl;
+            BufferBarrier.offset = 0;
+            BufferBarrier.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(CommandBufferHndl,VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,0,
+                                             0,nullptr,1,&BufferBarrier,1,&ImageBarrier);
+            *CapturedPtr = true;
+        } else if (AllOK(StatusOK)) {
+            I_Debug.Log ("Buffers","Capture buffer too small for the frame. Frame not copied.");
+        }
+    }
+    
     Result = vkEndCommandBuffer(CommandBufferHndl);
     if (Result != VK_SUCCESS || !AllOK(StatusOK)) {
         LogVulkanError ("Failed to record command buffer.","vkEndCommandBuffer",Result);
@@ -5082,6 +12863,7 @@ void KVVulkanFramework::RecordGraphicsCommandBuffer(
         done that now.
  
     o   Sizes in bytes (lots of SizeInBytes variables used) should be size_t instead of long.
+        They're VkDeviceSize now, which is 64 bits everywhere - long isn't, under Windows.
  
     o   I think it's the case that the creation of the graphics pipeline only uses the layout
         and bindings of the vertex buffers. The actual buffers used can be replaced with others
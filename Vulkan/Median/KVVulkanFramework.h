@@ -46,6 +46,82 @@
 //     14th Sep 2024. Renamed to from VulkanFramework to KVVulkanFramework, which should make it
 //                    clear this isn't a standard part of Vulkan. Added formal copyright text. KS.
 //     23rd Oct 2024. Added LogWarning(). KS.
+//     14th Oct 2026. Buffer memory is now sub-allocated from large pooled memory blocks, so
+//                    added T_MemoryBlock, T_MemoryAllocation and the associated internal
+//                    routines. KS.
+//                    Added SubmitCommandBuffer(), IsComplete() and WaitFor(), and the
+//                    KVSubmitTicket type. KS.
+//                    Added SubmitSyncBuffer(), CreateVulkanSemaphore(), a version of
+//                    SubmitCommandBuffer() that takes semaphores, and a version of
+//                    RecordComputeCommandBuffer() that includes buffer syncs. KS.
+//                    Added EnableSeparateQueues(), versions of GetDeviceQueue() and
+//                    CreateCommandPool() that take a queue type, ReleaseBufferOwnership() and
+//                    AcquireBufferOwnership(), and the KVQueueType type. KS.
+//                    Added SetPipelineCacheDirectory() and the internal routines that load
+//                    and save the pipeline cache. KS.
+//                    Added SyncBufferRange(), SyncBufferRegions() and KVBufferRegion. KS.
+//                    The buffer details comments now distinguish size from capacity. KS.
+//                    Added a version of CreateComputePipeline() that takes specialization
+//                    constants, DestroyComputePipeline() and AutotuneWorkGroupSize(). KS.
+//                    Added the GPU timestamp routines. KS.
+//                    Added push constant support to CreateComputePipeline() and
+//                    RecordComputeCommandBuffer(). KS.
+//                    Added RecordComputeBatch() and KVDispatch. KS.
+//                    Added SetCommandBufferReusable() and InvalidateRecordings(). KS.
+//                    Added FindSuitableDevice() by rank, CountSuitableDevices(), PartitionRows()
+//                    and KVRowBand. KS.
+//                    Added EnableDeviceBenchmark(). KS.
+//                    Added ImportBuffer() and the "IMPORTED" buffer access. KS.
+//                    Added CreateUploadRing(), AllocateUpload() and SubmitUploads(). KS.
+//                    Added the "READBACK" buffer access and InvalidateBuffer(). KS.
+//                    Added GetBufferAddress() and BufferAddressSupported(). KS.
+//                    Added I_Mutex, GetThreadCommandPool() and ReleaseThreadCommandPools(). KS.
+//                    Added timeline semaphore support, KVTimelinePoint, and versions of
+//                    SubmitCommandBuffer() and DrawGraphicsFrame() that take timeline waits. KS.
+//                    Added MeasureDeviceBandwidth(). KS.
+//                    Added DeviceSupports16BitStorage(). KS.
+//                    Added a version of AutotuneWorkGroupSize() that passes the shader extra
+//                    specialization constants. KS.
+//     15th Oct 2026. Added FlushBuffer(). KS.
+//                    Added the "VERTEX_STORAGE" buffer type. KS.
+//                    Added versions of CreateGraphicsPipeline() and DrawGraphicsFrame() that
+//                    use descriptor sets. KS.
+//                    Added WaitForGraphicsFrame(). KS.
+//                    Added SetPresentMode(), SetSwapChainImages() and GetPresentMode(). KS.
+//                    Added SetFramesInFlight() and GetFramesInFlight(). KS.
+//                    Added FrameCaptureSupported(), GetSwapChainExtent(), CaptureGraphicsFrame()
+//                    and GetCapturedFrame(). KS.
+//                    Added GetDeviceDescription(). KS.
+//                    Added StartDeviceSetup(), WaitForDeviceSetup() and PreloadShaderFile(). KS.
+//                    Added GetMemoryStats() and KVHeapStats, and the internal GetHeapStats()
+//                    and I_MemoryBudgetSupported. KS.
+//                    Added DeviceSupportsSubgroupArithmetic(). KS.
+//                    Added a version of SetupVulkanDescriptorSet() that takes bindings. KS.
+//                    Added DeviceSupportsSubgroupOperations(), and the subgroup properties
+//                    I_SubgroupSize and I_SubgroupOperations, recorded with the device. KS.
+//                    Buffer sizes and offsets are now VkDeviceSize rather than long, which is
+//                    only 32 bits under Windows. Added GetMaxStorageBufferRange() and a
+//                    MapBuffer() that returns a VkDeviceSize. KS.
+//                    Added the "SPARSE" buffer access, with SparseBuffersSupported(),
+//                    CommitBufferRange(), ReleaseBufferRange() and GetSparseDetails(), and the
+//                    internal CreateSparseBuffer(), BindSparseMemory() and
+//                    ReleaseSparseCommits(). KS.
+//                    Added SetBufferConcurrent(), and the Concurrent parameter to
+//                    CreateVulkanBuffer(). KS.
+//                    Added EmbedShader() and KVEmbeddedShader, for SPIR-V code built into the
+//                    program, and the internal GetShaderModule() and I_ShaderModuleCache. KS.
+//                    Added SetWaitSpin(), GetWaitStats() and KVWaitStats, and the internal
+//                    RecordWait(). KS.
+//                    Added QueuesShareFamily(). KS.
+//                    Added CreateTransientBuffers() and KVTransientBuffer, and the internal
+//                    ReleaseTransientBuffer(), T_TransientGroup and I_TransientGroups. KS.
+//                    Added SetComputeQueueCount(), GetComputeQueueCount() and GetComputeQueue(),
+//                    and the internal I_ComputeQueuesWanted and I_ComputeQueueIndices. KS.
+//                    Added PipelineStatisticsSupported(), EnablePipelineStatistics(),
+//                    GetDispatchInvocations() and LeastPaddedWorkGroupSize(), and the internal
+//                    I_StatisticsSupported and I_StatisticsQueryPoolHndl. KS.
+//                    Added SetBufferHostWriteOnly(), and the internal LogBufferMemory(). KS.
+//                    Added RunComputeChunks() and KVCancelFlag. KS.
 //
 //  Copyright (c) Knave and Varlet (K&V), (2024).
 //  Significant portions of this code are based closely on code from the Vulkan-tutorial website,
@@ -74,6 +150,10 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <string.h>
 
 #include "DebugHandler.h"
@@ -83,6 +163,60 @@ public:
     //  Defines a useful constant - something to indicate an unallocated buffer.
     typedef long KVBufferHandle;
     static const KVBufferHandle KV_NULL_HANDLE = 0;
+    //  And a ticket identifying a command buffer submitted using SubmitCommandBuffer().
+    typedef uint64_t KVSubmitTicket;
+    static const KVSubmitTicket KV_NULL_TICKET = 0;
+    //  A region of a buffer, used by SyncBufferRegions().
+    typedef struct {
+        VkDeviceSize Offset;                  // Offset in bytes from the start of the buffer.
+        VkDeviceSize Length;                  // Length of the region in bytes.
+    } KVBufferRegion;
+    //  The details of one of the dispatches recorded by RecordComputeBatch().
+    typedef struct {
+        VkPipeline PipelineHndl;              // The pipeline to run.
+        VkPipelineLayout PipelineLayoutHndl;  // The layout for that pipeline.
+        VkDescriptorSet DescriptorSetHndl;    // The descriptor set describing its buffers.
+        uint32_t WorkGroupCounts[3];          // The 3-D work group counts.
+        const void* PushConstants;            // Push constant data, or nullptr if none.
+        uint32_t PushConstantSize;            // The size of the push constant data in bytes.
+    } KVDispatch;
+    //  A band of image rows, as returned by PartitionRows().
+    typedef struct {
+        uint32_t FirstRow;                    // The first row in the band.
+        uint32_t NumberRows;                  // The number of rows in the band.
+    } KVRowBand;
+    //  A flag set, by any thread, to cancel a computation run by RunComputeChunks().
+    typedef std::atomic<bool> KVCancelFlag;
+    //  A timeline semaphore and a value, waited for or signalled by a submission.
+    typedef struct {
+        VkSemaphore SemaphoreHndl;            // The timeline semaphore.
+        uint64_t Value;                       // The value to wait for, or to signal.
+    } KVTimelinePoint;
+    //  The memory use of one of the device's memory heaps, as returned by GetMemoryStats().
+    typedef struct {
+        uint32_t HeapIndex;                   // The index of the heap.
+        bool DeviceLocal;                     // True if the heap is memory local to the GPU.
+        VkDeviceSize HeapSize;                // The total size of the heap in bytes.
+        VkDeviceSize Allocated;               // Bytes allocated from the heap by the Framework.
+        VkDeviceSize Used;                    // Bytes of those in use by buffers.
+        VkDeviceSize Budget;                  // Bytes the program can expect to use in all.
+        VkDeviceSize Usage;                   // Bytes the program is using, as far as is known.
+        bool BudgetReported;                  // True if Budget and Usage came from the driver.
+    } KVHeapStats;
+    //  A buffer used only from one step to another of a sequence, for CreateTransientBuffers().
+    typedef struct {
+        KVBufferHandle Handle;                // The buffer, as returned by SetBufferDetails().
+        VkDeviceSize SizeInBytes;             // The size of the buffer in bytes.
+        int FirstUse;                         // The first step that uses the buffer.
+        int LastUse;                          // The last step that uses the buffer.
+    } KVTransientBuffer;
+    //  The waits for submissions and semaphore values, as returned by GetWaitStats().
+    typedef struct {
+        uint64_t Waits;                       // The number of waits.
+        uint64_t Spun;                        // How many finished while still polling.
+        double TotalUsec;                     // The total time spent waiting, in usec.
+        double MaxUsec;                       // The longest wait, in usec.
+    } KVWaitStats;
     
     //  Constructor and destructor.
     //  ---------------------------
@@ -106,6 +240,14 @@ public:
     //  --------------
     //  Enables graphics, if required, and supplies the windowing system surface to use.
     void EnableGraphics(VkSurfaceKHR SurfaceHndl,bool& StatusOK);
+    //  Requests separate queues for transfers and/or compute, from dedicated families if possible.
+    void EnableSeparateQueues(bool SeparateTransfer,bool SeparateCompute,bool& StatusOK);
+    //  Requests a number of queues from the compute family, for concurrent submission.
+    void SetComputeQueueCount(int Count,bool& StatusOK);
+    //  Sets the directory used to save the pipeline cache between runs. Blank disables this.
+    void SetPipelineCacheDirectory(const std::string& Directory);
+    //  Rank devices using a (cached) bandwidth benchmark rather than their capabilities.
+    void EnableDeviceBenchmark(bool Enable);
     //  Sets the size of the frame buffer used by the window in use. Can change with window size.
     void SetFrameBufferSize(int Width,int Height,bool& StatusOK);
     //  Specifies any required Vulkan instance extensions.
@@ -116,10 +258,34 @@ public:
     void CreateVulkanInstance (bool& StatusOK);
     //  Locate a suitable GPU device to be used.
     void FindSuitableDevice (bool& StatusOK);
+    //  Select the suitable GPU device with a given rank, 0 being the best.
+    void FindSuitableDevice (int Rank,bool& StatusOK);
+    //  Returns the number of suitable GPU devices available.
+    int CountSuitableDevices (bool& StatusOK);
+    //  Divide rows between devices in proportion to their weights (eg measured throughput).
+    static void PartitionRows(uint32_t Ny,const std::vector<double>& Weights,
+                                             uint32_t RowMultiple,std::vector<KVRowBand>& Bands);
     //  Create the 'logical device' used to interact with the actual GPU being used.
     void CreateLogicalDevice (bool& StatusOK);
+    //  Creates the instance, finds a device and creates the logical device, in another thread.
+    void StartDeviceSetup (void);
+    //  Waits for the setup started by StartDeviceSetup() to finish.
+    void WaitForDeviceSetup (bool& StatusOK);
+    //  Reads a SPIR-V file ahead of time, so creating a pipeline from it needn't read it then.
+    void PreloadShaderFile (const std::string& Filename,bool& StatusOK);
     //  Returns true if the selected GPU supports double precision floating point operations.
     bool DeviceSupportsDouble (void);
+    //  Returns true if shaders can use 16-bit (half-precision) values in storage buffers.
+    bool DeviceSupports16BitStorage (void);
+    //  Returns true if compute shaders can use subgroup arithmetic, and the subgroup size.
+    bool DeviceSupportsSubgroupArithmetic (uint32_t* SubgroupSize = nullptr);
+    //  Returns true if compute shaders can use all the subgroup operations given, and the size.
+    bool DeviceSupportsSubgroupOperations (VkSubgroupFeatureFlags Operations,
+                                                            uint32_t* SubgroupSize = nullptr);
+    //  Returns the name of the selected GPU and a description of its Vulkan and driver versions.
+    void GetDeviceDescription (std::string* Name,std::string* Driver);
+    //  Measure the memory bandwidth of the selected GPU, in GBytes/sec.
+    double MeasureDeviceBandwidth (bool& StatusOK);
     //  Returns the Vulkan instance being used.
     VkInstance GetInstance(void);
     
@@ -140,26 +306,89 @@ public:
                       long NumberAttributes,long Locations[],const char* FormatStrings[],
                                                            long Offsets[],bool& StatusOK);
     //  Create the actual Vulkan buffer and associated memory given a Framework handle.
-    void CreateBuffer (KVBufferHandle BufferHndl,long SizeInBytes,bool& StatusOK);
+    void CreateBuffer (KVBufferHandle BufferHndl,VkDeviceSize SizeInBytes,bool& StatusOK);
     //  Delete a buffer.
     void DeleteBuffer (KVBufferHandle BufferHndl,bool& StatusOK);
     //  True if CreateBuffer() has been called for a buffer.
     bool IsBufferCreated (KVBufferHandle BufferHndl,bool& StatusOK);
+    //  Create a set of "LOCAL" buffers, those not in use at the same time sharing memory.
+    VkDeviceSize CreateTransientBuffers(const std::vector<KVTransientBuffer>& Buffers,
+                                                                              bool& StatusOK);
     //  Synchronises a staged buffer - and is a null operation for an unstaged buffer.
     void SyncBuffer(KVBufferHandle BufferHndl,VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
                                                                                bool& StatusOK);
+    //  Synchronises part of a staged buffer.
+    void SyncBufferRange(KVBufferHandle BufferHndl,VkDeviceSize Offset,VkDeviceSize Length,
+                            VkCommandPool CommandPoolHndl,VkQueue QueueHndl,bool& StatusOK);
+    //  Synchronises a number of regions of a staged buffer, using a single copy command.
+    void SyncBufferRegions(KVBufferHandle BufferHndl,const std::vector<KVBufferRegion>& Regions,
+                            VkCommandPool CommandPoolHndl,VkQueue QueueHndl,bool& StatusOK);
+    //  Starts the synchronisation of a staged buffer without waiting for it to complete.
+    KVSubmitTicket SubmitSyncBuffer(KVBufferHandle BufferHndl,VkCommandPool CommandPoolHndl,
+                  VkQueue QueueHndl,VkSemaphore WaitSemaphoreHndl,VkSemaphore SignalSemaphoreHndl,
+                                                                               bool& StatusOK);
+    //  Makes sure the CPU sees what the GPU wrote to a buffer in non-coherent memory.
+    void InvalidateBuffer(KVBufferHandle BufferHndl,bool& StatusOK);
+    //  Makes sure the GPU sees what the CPU wrote to a buffer in non-coherent memory.
+    void FlushBuffer(KVBufferHandle BufferHndl,bool& StatusOK);
     //  Gets a pointer the CPU can use to access the data held in a buffer.
+    void* MapBuffer(KVBufferHandle BufferHndl,VkDeviceSize* SizeInBytes,bool& StatusOK);
+    //  The same, for a caller that keeps sizes as long - safe only for buffers under 2 GBytes.
     void* MapBuffer(KVBufferHandle BufferHndl,long* SizeInBytes,bool& StatusOK);
     //  Close down the mapping for a buffer.
     void UnmapBuffer(KVBufferHandle BufferHndl,bool& StatusOK);
     //  Change the size of a buffer and its associated memory.
-    void ResizeBuffer(KVBufferHandle BufferHndl,long NewSizeInBytes,bool& StatusOK);
+    void ResizeBuffer(KVBufferHandle BufferHndl,VkDeviceSize NewSizeInBytes,bool& StatusOK);
+    //  Create an "IMPORTED" buffer that uses existing host memory, without a copy if possible.
+    void ImportBuffer(KVBufferHandle BufferHndl,void* HostAddress,VkDeviceSize SizeInBytes,
+                                                                               bool& StatusOK);
+    //  Returns the GPU address of a storage buffer, for use without a descriptor set.
+    VkDeviceAddress GetBufferAddress(KVBufferHandle BufferHndl,bool& StatusOK);
+    //  Returns true if the device supports buffer device addresses.
+    bool BufferAddressSupported(void);
+    //  Returns the alignment required for host memory passed to ImportBuffer().
+    long GetHostImportAlignment(void);
+    //  Returns the largest storage buffer a descriptor set can describe, in bytes.
+    VkDeviceSize GetMaxStorageBufferRange(void);
+    //  Returns true if "SPARSE" buffers, with memory committed a range at a time, can be used.
+    bool SparseBuffersSupported(void);
+    //  Returns true if pipeline statistics queries - see EnablePipelineStatistics() - can be used.
+    bool PipelineStatisticsSupported(void);
+    //  Commit device memory to a range of a "SPARSE" buffer.
+    void CommitBufferRange(KVBufferHandle BufferHndl,VkDeviceSize Offset,VkDeviceSize Length,
+                                                                               bool& StatusOK);
+    //  Release the device memory committed to a range of a "SPARSE" buffer.
+    void ReleaseBufferRange(KVBufferHandle BufferHndl,VkDeviceSize Offset,VkDeviceSize Length,
+                                                                               bool& StatusOK);
+    //  Returns the page size of a "SPARSE" buffer, and the number of bytes committed to it.
+    void GetSparseDetails(KVBufferHandle BufferHndl,VkDeviceSize* PageSize,
+                                                  VkDeviceSize* Committed,bool& StatusOK);
+    //  Returns the memory allocated and used in each memory heap, and the budget for each.
+    void GetMemoryStats(std::vector<KVHeapStats>* Stats,bool& StatusOK);
+    //  Allocate host memory suitably aligned for ImportBuffer().
+    static void* AllocateImportableMemory(VkDeviceSize SizeInBytes);
+    //  Release memory allocated by AllocateImportableMemory().
+    static void FreeImportableMemory(void* Address);
+    
+    //  Streaming uploads.
+    //  ------------------
+    //  Create the ring of host-visible memory used to stage uploads.
+    void CreateUploadRing(VkDeviceSize SizeInBytes,bool& StatusOK);
+    //  Get space in the upload ring for data to be copied to part of a buffer.
+    void* AllocateUpload(KVBufferHandle BufferHndl,VkDeviceSize Offset,VkDeviceSize SizeInBytes,
+                                                                               bool& StatusOK);
+    //  Copy all the data allocated since the last call to its buffers, in one submission.
+    KVSubmitTicket SubmitUploads(VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
+                  VkSemaphore WaitSemaphoreHndl,VkSemaphore SignalSemaphoreHndl,bool& StatusOK);
     
     //  Creating shaders.
     //  -----------------
     //  Read a file containing shader code and create the shader.
     void CreateShaderModuleFromFile(const std::string& ShaderFilename,
                                     VkShaderModule* ModuleHndlPtr,bool& StatusOK);
+    //  Supply the SPIR-V code for a shader file, built into the program, to use instead of it.
+    static void EmbedShader(const std::string& Filename,const uint32_t* Code,
+                                                                     size_t LengthInBytes);
     
     //  Descriptor sets.
     //  ----------------
@@ -176,11 +405,22 @@ public:
     //  Fill in a descriptor set with the details of a set of buffers.
     void SetupVulkanDescriptorSet(std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
                                                         VkDescriptorSet SetHndl, bool& StatusOK);
+    //  As above, but with the binding for each buffer given explicitly.
+    void SetupVulkanDescriptorSet(
+                    const std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+                    const std::vector<long>& Bindings,VkDescriptorSet SetHndl, bool& StatusOK);
     
     //  Setting up and running computation on the GPU.
     //  ----------------------------------------------
     //  Create a pool that can be used to supply command buffers for execution on the GPU.
     void CreateCommandPool(VkCommandPool* CommandPoolHndlPtr,bool& StatusOK);
+    //  Create a command pool for a given type of queue - "GRAPHICS", "COMPUTE" or "TRANSFER".
+    void CreateCommandPool(const std::string& QueueType,VkCommandPool* CommandPoolHndlPtr,
+                                                                              bool& StatusOK);
+    //  Get this thread's own command pool for a given queue type, creating it if necessary.
+    VkCommandPool GetThreadCommandPool(const std::string& QueueType,bool& StatusOK);
+    //  Release the command pools created for this thread by GetThreadCommandPool().
+    void ReleaseThreadCommandPools(bool& StatusOK);
     //  Get a command buffer from a pool. (Could be dropped for CreateCommandBuffers()).
     void CreateComputeCommandBuffer(
             VkCommandPool CommandPoolHndl, VkCommandBuffer* CommandBufferHndlPtr,bool& StatusOK);
@@ -191,20 +431,148 @@ public:
     void CreateComputePipeline(const std::string& ShaderFilename,const std::string& StageName,
                  VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
                                                   VkPipeline* PipelineHndlPtr,bool& StatusOK);
+    //  As above, but supplying values for specialization constants 0,1,2...
+    void CreateComputePipeline(const std::string& ShaderFilename,const std::string& StageName,
+                 VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
+            VkPipeline* PipelineHndlPtr,const std::vector<uint32_t>& SpecConstants,bool& StatusOK);
+    //  As above, but also allowing for a block of push constants of a given size.
+    void CreateComputePipeline(const std::string& ShaderFilename,const std::string& StageName,
+                 VkDescriptorSetLayout* SetLayoutHndlPtr,VkPipelineLayout* PipelineLayoutHndlPtr,
+            VkPipeline* PipelineHndlPtr,const std::vector<uint32_t>& SpecConstants,
+                                                    uint32_t PushConstantSize,bool& StatusOK);
+    //  Release a compute pipeline before the Framework closes down.
+    void DestroyComputePipeline(VkPipelineLayout PipelineLayoutHndl,VkPipeline PipelineHndl);
+    //  Time a compute shader with various workgroup shapes and return the fastest.
+    void AutotuneWorkGroupSize(const std::string& ShaderFilename,const std::string& StageName,
+                  VkDescriptorSetLayout* SetLayoutHndlPtr,VkDescriptorSet* DescriptorSetHndlPtr,
+                  uint32_t Nx,uint32_t Ny,VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
+                                                 uint32_t WorkGroupSize[2],bool& StatusOK);
+    //  As above, but also passing values for specialization constants 2 onwards.
+    void AutotuneWorkGroupSize(const std::string& ShaderFilename,const std::string& StageName,
+                  VkDescriptorSetLayout* SetLayoutHndlPtr,VkDescriptorSet* DescriptorSetHndlPtr,
+                  uint32_t Nx,uint32_t Ny,VkCommandPool CommandPoolHndl,VkQueue QueueHndl,
+                  const std::vector<uint32_t>& ExtraSpecConstants,uint32_t WorkGroupSize[2],
+                                                                               bool& StatusOK);
+    //  Find the workgroup shape with a given number of threads that launches fewest invocations.
+    void LeastPaddedWorkGroupSize(uint32_t Nx,uint32_t Ny,uint32_t WorkGroupSize[2],
+                                                                              bool& StatusOK);
     //  Set up a compute command buffer given a pipeline and a buffer descriptor set.
     void RecordComputeCommandBuffer(
         VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
         VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
                                             uint32_t WorkGroupCounts[3],bool& StatusOK);
+    //  As above, but also including the syncs needed for staged buffers before and after.
+    void RecordComputeCommandBuffer(
+        VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
+        VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
+        uint32_t WorkGroupCounts[3],const std::vector<KVBufferHandle>& SyncBefore,
+                            const std::vector<KVBufferHandle>& SyncAfter,bool& StatusOK);
+    //  As above, but also recording push constant data for the shader.
+    void RecordComputeCommandBuffer(
+        VkCommandBuffer CommandBufferHndl,VkPipeline PipelineHndl,
+        VkPipelineLayout PipelineLayoutHndl,VkDescriptorSet* DescriptorSetHndlPtr,
+        uint32_t WorkGroupCounts[3],const std::vector<KVBufferHandle>& SyncBefore,
+        const std::vector<KVBufferHandle>& SyncAfter,const void* PushConstants,
+                                                    uint32_t PushConstantSize,bool& StatusOK);
+    //  Record a sequence of dispatches, with barriers between them, into one command buffer.
+    void RecordComputeBatch(VkCommandBuffer CommandBufferHndl,
+        const std::vector<KVDispatch>& Dispatches,const std::vector<KVBufferHandle>& SyncBefore,
+                                const std::vector<KVBufferHandle>& SyncAfter,bool& StatusOK);
+    //  Only re-record a command buffer when the details recorded in it change.
+    void SetCommandBufferReusable(VkCommandBuffer CommandBufferHndl,bool Reusable,
+                                                                              bool& StatusOK);
+    //  Force all reusable command buffers to be re-recorded when next used.
+    void InvalidateRecordings(void);
+    //  Have RecordComputeCommandBuffer() record GPU timestamps around the computation.
+    void EnableDispatchTiming(bool Enable,bool& StatusOK);
+    //  Get the GPU times measured for the last timed command buffer.
+    bool GetDispatchTimes(float* SyncBeforeMsec,float* DispatchMsec,float* SyncAfterMsec,
+                                                                              bool& StatusOK);
+    //  Have RecordComputeCommandBuffer() count the compute shader invocations it dispatches.
+    void EnablePipelineStatistics(bool Enable,bool& StatusOK);
+    //  Get the compute shader invocations counted for the last command buffer recorded.
+    bool GetDispatchInvocations(uint64_t* Invocations,bool& StatusOK);
+    //  Create a pool of timestamp queries for general use.
+    void CreateTimestampQueries(uint32_t Count,bool& StatusOK);
+    //  Record the reset of the general timestamp queries.
+    void ResetTimestamps(VkCommandBuffer CommandBufferHndl,bool& StatusOK);
+    //  Record the writing of one of the general timestamp queries.
+    void WriteTimestamp(VkCommandBuffer CommandBufferHndl,uint32_t Index,bool& StatusOK);
+    //  Get the GPU time in milliseconds between two general timestamps.
+    float GetTimestampMsec(uint32_t StartIndex,uint32_t EndIndex,bool& StatusOK);
     //  Get a queue to run a command buffer on the GPU.
     void GetDeviceQueue(VkQueue* QueueHndlPtr,bool& StatusOK);
+    //  Get a queue of a given type - "GRAPHICS", "COMPUTE" or "TRANSFER".
+    void GetDeviceQueue(const std::string& QueueType,VkQueue* QueueHndlPtr,bool& StatusOK);
+    //  Returns the number of compute queues actually set up - see SetComputeQueueCount().
+    int GetComputeQueueCount(void);
+    //  Get one of the compute queues. Queue 0 is the "COMPUTE" queue itself.
+    void GetComputeQueue(int Index,VkQueue* QueueHndlPtr,bool& StatusOK);
+    //  Returns true if two types of queue come from the same queue family.
+    bool QueuesShareFamily(const std::string& FirstType,const std::string& SecondType,
+                                                                              bool& StatusOK);
+    //  Record the release of a buffer by one queue family, for use by another.
+    void ReleaseBufferOwnership(VkCommandBuffer CommandBufferHndl,KVBufferHandle BufferHndl,
+        const std::string& SrcQueueType,const std::string& DstQueueType,bool& StatusOK);
+    //  Record the acquisition of a buffer released by another queue family.
+    void AcquireBufferOwnership(VkCommandBuffer CommandBufferHndl,KVBufferHandle BufferHndl,
+        const std::string& SrcQueueType,const std::string& DstQueueType,bool& StatusOK);
+    //  Have a buffer shared by all the queue families in use, with no ownership transfers.
+    void SetBufferConcurrent(KVBufferHandle BufferHndl,bool& StatusOK);
+    //  Say a "SHARED" buffer is only written by the CPU, so can go into device-local memory.
+    void SetBufferHostWriteOnly(KVBufferHandle BufferHndl,bool& StatusOK);
     //  Run a command buffer and wait for it to complete.
     void RunCommandBuffer(VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,bool& StatusOK);
+    //  Run a sequence of dispatches a few at a time, until done, cancelled or out of time.
+    int RunComputeChunks(VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+        const std::vector<KVDispatch>& Chunks,int FirstChunk,
+        const std::vector<KVBufferHandle>& SyncAfter,float TargetMsec,float BudgetMsec,
+                                                  const KVCancelFlag* CancelPtr,bool& StatusOK);
+    //  Submit a command buffer to run without waiting, returning a ticket for the submission.
+    KVSubmitTicket SubmitCommandBuffer(VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+                                                                              bool& StatusOK);
+    //  As above, but waiting for and signalling semaphores.
+    KVSubmitTicket SubmitCommandBuffer(VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+        const std::vector<VkSemaphore>& WaitSemaphoreHndls,VkPipelineStageFlags WaitStageFlags,
+                        const std::vector<VkSemaphore>& SignalSemaphoreHndls,bool& StatusOK);
+    //  Create a semaphore that can be used to order submissions on the GPU.
+    void CreateVulkanSemaphore(VkSemaphore* SemaphoreHndlPtr,bool& StatusOK);
+    //  Create a timeline semaphore, whose value increases as submissions signal it.
+    void CreateTimelineSemaphore(uint64_t InitialValue,VkSemaphore* SemaphoreHndlPtr,
+                                                                              bool& StatusOK);
+    //  Returns true if the device supports timeline semaphores.
+    bool TimelineSemaphoresSupported(void);
+    //  As for SubmitCommandBuffer(), but waiting for and signalling timeline semaphore values.
+    KVSubmitTicket SubmitCommandBuffer(VkQueue QueueHndl,VkCommandBuffer CommandBufferHndl,
+        const std::vector<KVTimelinePoint>& WaitPoints,VkPipelineStageFlags WaitStageFlags,
+                        const std::vector<KVTimelinePoint>& SignalPoints,bool& StatusOK);
+    //  Wait on the CPU until a timeline semaphore reaches a given value.
+    void WaitForSemaphoreValue(VkSemaphore SemaphoreHndl,uint64_t Value,bool& StatusOK);
+    //  Returns the current value of a timeline semaphore.
+    uint64_t GetSemaphoreValue(VkSemaphore SemaphoreHndl,bool& StatusOK);
+    //  Returns true if a submitted command buffer has completed.
+    bool IsComplete(KVSubmitTicket Ticket,bool& StatusOK);
+    //  Wait for a submitted command buffer to complete.
+    void WaitFor(KVSubmitTicket Ticket,bool& StatusOK);
+    //  Sets how long, in usec, the waits poll for completion before blocking. 0 never polls.
+    void SetWaitSpin(unsigned int Usec);
+    //  Returns the number of waits and the time they took, resetting the counts if asked.
+    void GetWaitStats(KVWaitStats* Stats,bool Reset = false);
     
     //  Setting up and running graphics on the GPU.
     //  -------------------------------------------
+    //  Selects the swap chain presentation mode - "FIFO", "FIFO_RELAXED", "MAILBOX" or "IMMEDIATE".
+    void SetPresentMode(const std::string& Mode,bool& StatusOK);
+    //  Sets the number of swap chain images, overriding the number CreateSwapChain() is passed.
+    void SetSwapChainImages(uint32_t Images);
     //  Create a chain of images for display on successive frames.
     uint32_t CreateSwapChain(uint32_t RequestedImages,bool& StatusOK);
+    //  Returns the presentation mode used by the swap chain.
+    VkPresentModeKHR GetPresentMode(void);
+    //  Sets the number of frames a program should let be in flight at once.
+    void SetFramesInFlight(int Frames);
+    //  Returns the number of frames a program should let be in flight at once.
+    int GetFramesInFlight(void);
     //  Sets up the various images in a swap chain.
     void CreateImageViews(bool& StatusOK);
     //  Create a simple 'render pass' descrining the processing by a graphics command buffer.
@@ -218,6 +586,14 @@ public:
         const std::string& VertexType,
         const std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
         VkPipelineLayout* PipelineLayoutHndlPtr,VkPipeline* PipelineHndlPtr,bool& StatusOK);
+    //  As above, but with the shaders also able to use a descriptor set with the given layout.
+    void CreateGraphicsPipeline(
+        VkShaderModule VertexShaderHndl,const std::string& VertexStageName,
+        VkShaderModule FragmentShaderHndl,const std::string& FragmentStageName,
+        const std::string& VertexType,
+        const std::vector<KVVulkanFramework::KVBufferHandle>& BufferHandles,
+        VkDescriptorSetLayout* SetLayoutHndlPtr,
+        VkPipelineLayout* PipelineLayoutHndlPtr,VkPipeline* PipelineHndlPtr,bool& StatusOK);
     //  Create the semaphores needed to synchronise operation of a swap chain of images.
     void CreateSyncObjects(int ImageCount,std::vector<VkSemaphore>& ImageSemaphores,
         std::vector<VkSemaphore>& RenderSemaphores,std::vector<VkFence>& Fences,bool& StatusOK);
@@ -229,6 +605,26 @@ public:
     void DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer CommandBufferHndl, int Stages,
         int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
                               VkPipeline PipelineHndls[],bool& StatusOK);
+    //  As above, but with the GPU waiting for timeline semaphore values before drawing.
+    void DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer CommandBufferHndl, int Stages,
+        int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
+        VkPipeline PipelineHndls[],const std::vector<KVTimelinePoint>& WaitPoints,bool& StatusOK);
+    //  As above, but also binding a descriptor set for each stage that uses one.
+    void DrawGraphicsFrame (int CurrentFrame,VkCommandBuffer CommandBufferHndl, int Stages,
+        int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
+        VkPipeline PipelineHndls[],VkPipelineLayout PipelineLayoutHndls[],
+        VkDescriptorSet DescriptorSetHndls[],const std::vector<KVTimelinePoint>& WaitPoints,
+        bool& StatusOK);
+    //  Wait for a frame submitted by DrawGraphicsFrame() to complete.
+    void WaitForGraphicsFrame(int CurrentFrame,bool& StatusOK);
+    //  True if the swap chain images can be copied into a buffer by CaptureGraphicsFrame().
+    bool FrameCaptureSupported(void);
+    //  Returns the current dimensions of the swap chain images.
+    void GetSwapChainExtent(int* Width,int* Height);
+    //  Have the next frame drawn with a given frame number copied into a buffer.
+    void CaptureGraphicsFrame(int CurrentFrame,KVBufferHandle BufferHndl,bool& StatusOK);
+    //  Returns the details of the image copied the last time a frame number was drawn, if any.
+    bool GetCapturedFrame(int CurrentFrame,int* Width,int* Height,bool* BGR);
 private:
     //  The framework is mostly a fairly transparent interface to Vulkan, but it does try to
     //  make buffer access a little higher level. In particular, it tries to hide a lot of the
@@ -262,9 +658,53 @@ private:
     //  needs to have the SynchBuffer() routine called once the CPU or GPU has done whatever
     //  it needs to do to the buffer.
     
+    //  Rather than making a separate call to vkAllocateMemory() for every Vulkan buffer, the
+    //  framework allocates device memory in large blocks (I_MemoryBlocks), each of one memory
+    //  type, and carves the memory for individual buffers out of these. Vulkan limits the number
+    //  of separate allocations a program can have (maxMemoryAllocationCount - as low as 4096 on
+    //  some discrete GPUs) and allocation can be slow. Each block keeps an ordered list of the
+    //  ranges within it that are free, and a T_MemoryAllocation describes the range within a
+    //  block being used by one Vulkan buffer. Blocks are only released when the framework closes
+    //  down, except for 'dedicated' blocks used for a single large buffer, which are released
+    //  as soon as that buffer is deleted.
+    typedef struct T_MemoryRange {
+        VkDeviceSize Offset;                  // Offset in bytes from the start of the block.
+        VkDeviceSize Size;                    // Size of the range in bytes.
+    } MemoryRange;
+    typedef struct T_MemoryBlock {
+        VkDeviceMemory MemoryHndl;            // Vulkan handle for the memory, null if unused.
+        uint32_t MemoryTypeIndex;             // The memory type of the block.
+        VkDeviceSize SizeInBytes;             // The total size of the block.
+        bool Dedicated;                       // True if the block holds only one large buffer.
+        int Allocations;                      // The number of buffers using the block.
+        void* MappedAddress;                  // CPU address of the start of the block, if mapped.
+        int MapCount;                         // The number of buffers that need it to be mapped.
+        std::vector<T_MemoryRange> FreeRanges;  // Unused ranges, in order of offset.
+    } MemoryBlock;
+    typedef struct T_MemoryAllocation {
+        int BlockIndex;                       // Index into I_MemoryBlocks, -1 if unallocated.
+        VkDeviceSize Offset;                  // Offset of the buffer memory within the block.
+        VkDeviceSize Size;                    // Size of the range reserved within the block.
+    } MemoryAllocation;
+    //  Each range of a "SPARSE" buffer that has memory committed to it by CommitBufferRange()
+    //  has a T_SparseCommit, giving the range of the buffer and the pooled memory bound to it.
+    typedef struct T_SparseCommit {
+        VkDeviceSize Offset;                  // Offset in bytes from the start of the buffer.
+        VkDeviceSize Size;                    // Size of the range in bytes.
+        T_MemoryAllocation Allocation;        // The memory bound to the range.
+    } SparseCommit;
+    //  The buffers created together by CreateTransientBuffers() share one range of pooled
+    //  memory, described by a T_TransientGroup, which is only freed once all of them are gone.
+    typedef struct T_TransientGroup {
+        T_MemoryAllocation Allocation;        // The range all the buffers are bound within.
+        int Buffers;                          // The number of buffers still using it.
+    } TransientGroup;
+
     typedef enum {TYPE_UNKNOWN,TYPE_UNIFORM,TYPE_STORAGE,TYPE_VERTEX} KVBufferType;
     typedef enum {ACCESS_UNKNOWN,ACCESS_LOCAL,ACCESS_SHARED,
-                                ACCESS_STAGED_CPU,ACCESS_STAGED_GPU} KVBufferAccess;
+            ACCESS_STAGED_CPU,ACCESS_STAGED_GPU,ACCESS_IMPORTED,ACCESS_READBACK,
+            ACCESS_SPARSE} KVBufferAccess;
+    typedef enum {QUEUE_GRAPHICS,QUEUE_COMPUTE,QUEUE_TRANSFER} KVQueueType;
     //  The framework uses a vector (I_BufferDetails) of structures of type T_BufferDetails to
     //  keep track of all the buffers currently in use.
     typedef struct T_BufferDetails {
@@ -279,9 +719,10 @@ private:
         //  Binding is specified by the application and has to match the shader setup.
         long Binding;
         //  The number of bytes of the buffer currently in use - may be less than those allocated.
-        long SizeInBytes;
-        //  The number of bytes actually allocated. (May allow for resizing without reallocation.)
-        long MemorySizeInBytes;
+        VkDeviceSize SizeInBytes;
+        //  The number of bytes actually allocated - the buffer's capacity. ResizeBuffer() only
+        //  reallocates if this is exceeded, and then grows it geometrically.
+        VkDeviceSize MemorySizeInBytes;
         //  The address the CPU can use to access a buffer visible to the CPU.
         void* MappedAddress;
         //  The Vulkan handle for the main vulkan buffer.
@@ -292,6 +733,8 @@ private:
         VkBufferUsageFlags MainUsageFlags;
         //  Property flags for the main buffer
         VkMemoryPropertyFlags MainPropertyFlags;
+        //  Property flags the main buffer would prefer to have, if possible
+        VkMemoryPropertyFlags MainPreferredFlags;
         //  The Vulkan handle for the secondary vulkan buffer (used for staged buffers)
         VkBuffer SecondaryBufferHndl;
         //  The Vulkan handle for the secondary vulkan buffer (used for staged buffers)
@@ -300,10 +743,32 @@ private:
         VkBufferUsageFlags SecondaryUsageFlags;
         //  Property flags for the secondary buffer (used for staged buffers)
         VkMemoryPropertyFlags SecondaryPropertyFlags;
+        //  Details of the range of a pooled memory block used by the main buffer.
+        T_MemoryAllocation MainAllocation;
+        //  Details of the range of a pooled memory block used by the secondary buffer.
+        T_MemoryAllocation SecondaryAllocation;
+        //  Command buffer used by SyncBuffer() for staged buffers, recorded once and re-used.
+        VkCommandBuffer SyncCommandBufferHndl;
+        //  The pool from which SyncCommandBufferHndl was allocated.
+        VkCommandPool SyncCommandPoolHndl;
+        //  True if SyncCommandBufferHndl has been recorded for the current buffer size.
+        bool SyncRecorded;
+        //  Ticket for the most recent submission of SyncCommandBufferHndl.
+        KVSubmitTicket SyncTicket;
         //  Binding description for the buffer as used by a graphics pipeline.
         VkVertexInputBindingDescription BindingDescr;
         //  Attribute description for the buffer as used by a graphics pipeline.
         std::vector<VkVertexInputAttributeDescription> AttributeDescrs;
+        //  For a "SPARSE" buffer, the size of the pages memory is committed in, the memory types
+        //  that can be used, and the committed ranges, in order of offset.
+        VkDeviceSize SparsePageSize;
+        uint32_t SparseMemoryTypeBits;
+        std::vector<T_SparseCommit> SparseCommits;
+        //  True if the buffer is to be shared concurrently by all the queue families in use.
+        bool Concurrent;
+        //  For a buffer created by CreateTransientBuffers(), the index in I_TransientGroups of
+        //  the memory it shares, otherwise -1.
+        int TransientGroup;
     } BufferDetails;
     //  Internally the framework keeps track of any pipelines that it sets up in a vector
     //  (I_PipelineDetails) of structures of type T_PipelineDetails. It needs to keep a
@@ -314,6 +779,50 @@ private:
         VkPipeline PipelineHndl;              // Handle to the pipeline.
         VkPipelineLayout PipelineLayoutHndl;  // Handle to the layout it uses.
     } PipelineDetails;
+    //  Each command buffer submitted using SubmitCommandBuffer() that has not yet been seen to
+    //  complete is recorded in I_Submissions using a T_SubmitDetails structure, which ties the
+    //  ticket returned to the caller to the fence that will be signalled on completion. Fences
+    //  are recycled through I_FreeFenceHndls once the submission has completed.
+    typedef struct T_SubmitDetails {
+        KVSubmitTicket Ticket;                // The ticket returned by SubmitCommandBuffer().
+        VkFence FenceHndl;                    // The fence signalled when the submission completes.
+    } SubmitDetails;
+    //  Each command pool created by GetThreadCommandPool() has an entry in I_ThreadPools
+    //  recording the thread it belongs to and the type of queue it is for.
+    typedef struct T_ThreadPool {
+        std::thread::id ThreadId;             // The thread that uses the pool.
+        KVQueueType QueueType;                // The type of queue the pool is for.
+        VkCommandPool CommandPoolHndl;        // Vulkan handle for the pool.
+    } ThreadPool;
+    //  Each command buffer marked as reusable by SetCommandBufferReusable() has an entry in
+    //  I_RecordingDetails giving the details it was last recorded with. Generation is the value
+    //  of I_RecordingGeneration at the time it was recorded - this is incremented by anything
+    //  that would make existing recordings out of date. The push constant data is copied into
+    //  PushData, so the PushConstants addresses in the saved Dispatches are not used.
+    typedef struct T_RecordingDetails {
+        VkCommandBuffer CommandBufferHndl;    // The reusable command buffer.
+        bool Recorded;                        // True if it currently holds a valid recording.
+        uint64_t Generation;                  // I_RecordingGeneration when recorded.
+        std::vector<KVDispatch> Dispatches;   // The dispatches recorded.
+        std::vector<std::vector<uint8_t>> PushData; // Copies of the push constant data.
+        std::vector<KVBufferHandle> SyncBefore; // Buffers synched before the dispatches.
+        std::vector<KVBufferHandle> SyncAfter;  // Buffers synched after the dispatches.
+    } RecordingDetails;
+    //  Each call to AllocateUpload() adds a T_UploadCopy to I_PendingUploads, giving the
+    //  destination buffer and the region to be copied from the upload ring. Each submission made
+    //  by SubmitUploads() then gets a T_UploadSegment in I_UploadSegments, in submission order,
+    //  which records the part of the ring it uses so this can be reused once it completes.
+    typedef struct T_UploadCopy {
+        int BufferIndex;                      // Index into I_BufferDetails of the destination.
+        VkBufferCopy Region;                  // Source (ring) and destination offsets, and size.
+    } UploadCopy;
+    typedef struct T_UploadSegment {
+        KVSubmitTicket Ticket;                // The ticket for the submission.
+        VkDeviceSize End;                     // The ring offset just past the segment.
+        VkDeviceSize Bytes;                   // The ring bytes used, including any skipped.
+        VkCommandBuffer CommandBufferHndl;    // The command buffer used for the copies.
+        VkCommandPool CommandPoolHndl;        // The pool it came from.
+    } UploadSegment;
 
     //  Error logging and handling
     //  This is the message callback set up when Vulkan validation is enabled.
@@ -365,26 +874,134 @@ private:
     const std::vector<const char*>& GetDiagnosticLayers(void);
     //  Attempts to classify the suitability of given GPU for the program in question.
     int RateDevice (VkPhysicalDevice DeviceHndl);
+    //  List the suitable GPU devices, best first.
+    void RankSuitableDevices (std::vector<VkPhysicalDevice>& Devices,
+                                            std::vector<bool>& Portability,bool& StatusOK);
     //  Select a suitable device queue family and return its index number.
     uint32_t GetIndexForQueueFamilyToUse(bool UseGraphics,bool UseCompute,bool& StatusOK);
     //  Select a memory type from those supported and return its index.
     uint32_t GetMemoryTypeIndex(VkMemoryRequirements MemoryRequirements,
                                       VkMemoryPropertyFlags PropertyFlags,bool& StatusOK);
+    //  As above, but favouring memory types with a set of preferred properties.
+    uint32_t GetMemoryTypeIndex(VkMemoryRequirements MemoryRequirements,
+      VkMemoryPropertyFlags PropertyFlags,VkMemoryPropertyFlags PreferredFlags,bool& StatusOK);
+    //  Get the memory use and budget for each memory heap.
+    void GetHeapStats(std::vector<KVHeapStats>* Stats);
+    //  Reports the memory type and heap a newly created buffer has been given.
+    void LogBufferMemory(int Index,bool Secondary);
     //  Read a shader file in SPIR-V format into memory.
     uint32_t* ReadSpirVFile(const std::string& Filename,long* LengthInBytes, bool& StatusOK);
     //  Create a Vulkan shader module from SPIR-V code in memory.
     VkShaderModule CreateShaderModule(uint32_t* Code,long LengthInBytes,bool& StatusOK);
+    //  Records a wait for a submission or a semaphore value, for GetWaitStats().
+    void RecordWait(double Usec,bool Spun);
+    //  Get the shader module for a file's code, creating it only if that code is new.
+    VkShaderModule GetShaderModule(const std::string& Filename,bool& StatusOK);
     //  Create a Vulkan buffer and its associated memory.
     void CreateVulkanBuffer(VkDeviceSize SizeInBytes,VkBufferUsageFlags UsageFlags,
-                           VkMemoryPropertyFlags PropertyFlags,VkBuffer* BufferHndlPtr,
-                                   VkDeviceMemory* BufferMemoryHndlPtr,bool& StatusOK);
+                           VkMemoryPropertyFlags PropertyFlags,VkMemoryPropertyFlags PreferredFlags,
+                                   VkBuffer* BufferHndlPtr,
+                                   VkDeviceMemory* BufferMemoryHndlPtr,
+                                   T_MemoryAllocation* AllocationPtr,bool& StatusOK,
+                                   bool Concurrent = false);
+    //  Create a Vulkan buffer that uses imported host memory.
+    bool ImportHostBuffer(int Index,void* HostAddress,VkDeviceSize SizeInBytes);
+    //  Create the Vulkan buffer for a "SPARSE" buffer, with no memory committed to it.
+    void CreateSparseBuffer(int Index,VkDeviceSize SizeInBytes,bool& StatusOK);
+    //  Bind - or unbind - the memory for a number of ranges of a "SPARSE" buffer.
+    void BindSparseMemory(int Index,const std::vector<T_SparseCommit>& Commits,bool Bind,
+                                                                               bool& StatusOK);
+    //  Release all the memory committed to a "SPARSE" buffer.
+    void ReleaseSparseCommits(int Index);
+    //  Destroy a Vulkan buffer and return its memory to the pooled memory blocks.
+    void DestroyVulkanBuffer(VkBuffer* BufferHndlPtr,VkDeviceMemory* BufferMemoryHndlPtr,
+                                                          T_MemoryAllocation* AllocationPtr);
+    //  Destroy a transient buffer, freeing the memory it shares once no other buffer uses it.
+    void ReleaseTransientBuffer(int Index);
+    //  Reserve a range of a pooled memory block that meets a set of memory requirements.
+    void AllocateBlockMemory(const VkMemoryRequirements& MemoryRequirements,
+            VkMemoryPropertyFlags PropertyFlags,VkMemoryPropertyFlags PreferredFlags,
+                                         T_MemoryAllocation* AllocationPtr,bool& StatusOK);
+    //  Return a range of a pooled memory block to the free list for that block.
+    void FreeBlockMemory(T_MemoryAllocation* AllocationPtr);
+    //  Get the CPU address of the memory range used by a buffer, mapping its block if needed.
+    void* MapBlockMemory(const T_MemoryAllocation& Allocation,bool& StatusOK);
+    //  Indicate a buffer no longer needs its block mapped.
+    void UnmapBlockMemory(const T_MemoryAllocation& Allocation);
+    //  Release all the pooled memory blocks.
+    void ReleaseMemoryBlocks(void);
     //  Record a graphics command buffer with a number of pipeline/buffer combinations.
     void RecordGraphicsCommandBuffer(
             VkCommandBuffer CommandBufferHndl,int Stages,VkPipeline PipelineHndls[],int ImageNumber,
             int VertexCounts[],const std::vector<KVVulkanFramework::KVBufferHandle> BufferSets[],
-            bool& StatusOK);
+            VkPipelineLayout PipelineLayoutHndls[],VkDescriptorSet DescriptorSetHndls[],
+            KVBufferHandle CaptureHndl,bool* CapturedPtr,bool& StatusOK);
     //  Given a buffer Handle, get its index into the internal vector of buffer details.
     int BufferIndexFromHandle (KVBufferHandle Handle,bool& StatusOK);
+    //  Given a submission ticket, get its index into the vector of outstanding submissions.
+    int SubmissionIndexFromTicket (KVSubmitTicket Ticket,bool& StatusOK);
+    //  Recycle the fence used by a completed submission and forget the submission.
+    void ReleaseSubmission(int Index);
+    //  Get an unsignalled fence from the pool, or create a new one.
+    VkFence GetPooledFence(bool& StatusOK);
+    //  Pick a queue for compute or transfers, preferring a family dedicated to those operations.
+    void SelectSeparateQueue(VkQueueFlags RequiredFlags,VkQueueFlags AvoidFlags,
+        const std::vector<VkQueueFamilyProperties>& QueueFamilies,std::vector<uint32_t>& QueuesUsed,
+                                               uint32_t* FamilyIndexPtr,uint32_t* QueueIndexPtr);
+    //  Record either half of a queue family ownership transfer for a buffer.
+    void RecordOwnershipBarrier(VkCommandBuffer CommandBufferHndl,KVBufferHandle BufferHndl,
+        const std::string& SrcQueueType,const std::string& DstQueueType,bool Release,
+                                                                              bool& StatusOK);
+    //  Convert a queue type string into a KVQueueType value.
+    KVQueueType QueueTypeFromString(const std::string& QueueType,bool& StatusOK);
+    //  Get the index of the queue family used for a given type of queue.
+    uint32_t QueueFamilyForType(KVQueueType Type);
+    //  Create the pipeline cache, loading it from the cache file if possible.
+    void LoadPipelineCache(bool& StatusOK);
+    //  Save the pipeline cache to the cache file, and destroy it.
+    void SavePipelineCache(void);
+    //  Get the name of the pipeline cache file for the selected device.
+    std::string PipelineCacheFilename(void);
+    //  Get a string identifying a device and its driver version.
+    std::string DeviceKey(VkPhysicalDevice DeviceHndl);
+    //  Measure the memory bandwidth of a device in MBytes/sec.
+    double BenchmarkDevice(VkPhysicalDevice DeviceHndl,bool Portability);
+    //  Read the cached device benchmark results.
+    void ReadRankingCache(std::vector<std::string>& Keys,std::vector<double>& Rates);
+    //  Write out the device benchmark results.
+    void WriteRankingCache(const std::vector<std::string>& Keys,const std::vector<double>& Rates);
+    //  Create a query pool for a number of timestamps.
+    VkQueryPool CreateTimestampQueryPool(uint32_t Count,bool& StatusOK);
+    //  Read a number of consecutive timestamps.
+    void ReadTimestamps(VkQueryPool PoolHndl,uint32_t First,uint32_t Count,uint64_t* Ticks,
+                                                                              bool& StatusOK);
+    //  Convert the difference between two timestamps into milliseconds.
+    float TicksToMsec(uint64_t StartTicks,uint64_t EndTicks);
+    //  Find the entry in I_RecordingDetails for a reusable command buffer.
+    int RecordingIndexFor(VkCommandBuffer CommandBufferHndl);
+    //  See if a reusable command buffer already holds a given recording.
+    bool RecordingUnchanged(int Index,const std::vector<KVDispatch>& Dispatches,
+        const std::vector<KVBufferHandle>& SyncBefore,const std::vector<KVBufferHandle>& SyncAfter);
+    //  Note the details used to record a reusable command buffer.
+    void NoteRecording(int Index,const std::vector<KVDispatch>& Dispatches,
+        const std::vector<KVBufferHandle>& SyncBefore,const std::vector<KVBufferHandle>& SyncAfter);
+    //  Get the pre-recorded command buffer used to sync a staged buffer, recording it if needed.
+    VkCommandBuffer GetSyncCommandBuffer(int Index,VkCommandPool CommandPoolHndl,bool& StatusOK);
+    //  Release the command buffer used to sync a staged buffer.
+    void ReleaseSyncCommandBuffer(int Index,bool& StatusOK);
+    //  Record the copy needed to sync a staged buffer. Returns false for an unstaged buffer.
+    bool RecordSyncCopy(int Index,VkCommandBuffer CommandBufferHndl);
+    //  Record the copy of a number of regions of a staged buffer.
+    bool RecordSyncCopyRegions(int Index,VkCommandBuffer CommandBufferHndl,
+                                                const std::vector<VkBufferCopy>& CopyRegions);
+    //  Flush or invalidate the mapped memory for a buffer, if it isn't coherent.
+    void SyncMappedMemory(int Index,bool Flush,bool& StatusOK);
+    //  Release the ring space used by the oldest (completed) upload submission.
+    void RetireUploadSegment(bool& StatusOK);
+    //  Record a global memory barrier between two pipeline stages.
+    void RecordMemoryBarrier(VkCommandBuffer CommandBufferHndl,
+            VkPipelineStageFlags SrcStageFlags,VkAccessFlags SrcAccessFlags,
+                           VkPipelineStageFlags DstStageFlags,VkAccessFlags DstAccessFlags);
 
     //   Instance variables.
     DebugHandler I_Debug;
@@ -395,6 +1012,10 @@ private:
     bool I_DeviceHasPortabilitySubset;
     bool I_GraphicsEnabled;
     bool I_DeviceSupportsDouble;
+    //  The selected device's subgroup size, and the subgroup operations (VkSubgroupFeatureFlags)
+    //  compute shaders can use - none if subgroups aren't supported in compute shaders.
+    uint32_t I_SubgroupSize;
+    VkSubgroupFeatureFlags I_SubgroupOperations;
     bool I_EnableValidationErrors;
     bool I_EnableValidationWarnings;
     bool I_EnableValidationInformation;
@@ -404,29 +1025,120 @@ private:
     uint32_t I_FrameBufferHeight;
     VkExtent2D I_SwapChainExtent;
     int I_ImageCount;
+    uint32_t I_RequestedImageCount;
+    VkPresentModeKHR I_RequestedPresentMode;
+    VkPresentModeKHR I_PresentMode;
+    int I_FramesInFlight;
     VkSwapchainKHR I_SwapChain;
     VkFormat I_SwapChainImageFormat;
     std::vector<VkImage> I_SwapChainImages;
     std::vector<VkImageView> I_SwapChainImageViews;
     std::vector<VkFramebuffer> I_SwapChainFramebuffers;
+    //  True if the swap chain images can be copied, and whether their format is B,G,R,A.
+    bool I_CaptureSupported;
+    bool I_CaptureBGR;
+    //  For each frame number, the buffer the next frame drawn is to be copied into, and the
+    //  dimensions of the image the last frame drawn was copied as - zero if it wasn't.
+    std::vector<KVBufferHandle> I_CaptureHndls;
+    std::vector<VkExtent2D> I_CapturedExtents;
     VkRenderPass I_RenderPass;
     VkDevice I_LogicalDevice;
     bool I_DiagnosticsEnabled;
-    uint32_t I_QueueFamilyIndex;  //  Note this assumes we only need one queue family.
+    uint32_t I_QueueFamilyIndex;  //  The main queue family, used for graphics and compute.
+    bool I_SeparateComputeQueue;
+    bool I_SeparateTransferQueue;
+    uint32_t I_ComputeQueueFamilyIndex;
+    uint32_t I_ComputeQueueIndex;
+    int I_ComputeQueuesWanted;    //  As set by SetComputeQueueCount().
+    std::vector<uint32_t> I_ComputeQueueIndices;  //  Indices in the compute family, first is
+                                                  //  I_ComputeQueueIndex.
+    uint32_t I_TransferQueueFamilyIndex;
+    uint32_t I_TransferQueueIndex;
+    VkPipelineCache I_PipelineCacheHndl;
+    std::string I_PipelineCacheDirectory;
+    size_t I_PipelineCacheLoadedSize;
+    bool I_BenchmarkDevices;
+    VkQueryPool I_TimestampQueryPoolHndl;
+    uint32_t I_TimestampQueryCount;
+    VkQueryPool I_DispatchQueryPoolHndl;
+    VkQueryPool I_StatisticsQueryPoolHndl;
+    float I_TimestampPeriod;
+    uint32_t I_TimestampValidBits;
+    std::vector<T_RecordingDetails> I_RecordingDetails;
+    uint64_t I_RecordingGeneration;
+    bool I_HostImportSupported;     //  True if VK_EXT_external_memory_host has been enabled.
+    VkDeviceSize I_HostImportAlignment;
+    PFN_vkGetMemoryHostPointerPropertiesEXT I_GetMemoryHostPointerProperties;
+    bool I_BufferAddressSupported;  //  True if VK_KHR_buffer_device_address has been enabled.
+    PFN_vkGetBufferDeviceAddressKHR I_GetBufferDeviceAddress;
+    bool I_TimelineSupported;       //  True if VK_KHR_timeline_semaphore has been enabled.
+    bool I_16BitStorageSupported;   //  True if 16-bit storage buffer access has been enabled.
+    bool I_MemoryBudgetSupported;   //  True if VK_EXT_memory_budget has been enabled.
+    bool I_SparseSupported;         //  True if sparse residency buffers have been enabled.
+    bool I_StatisticsSupported;     //  True if pipeline statistics queries have been enabled.
+    PFN_vkWaitSemaphoresKHR I_WaitSemaphores;
+    PFN_vkGetSemaphoreCounterValueKHR I_GetSemaphoreCounterValue;
+    VkBuffer I_UploadRingBufferHndl;
+    VkDeviceMemory I_UploadRingMemoryHndl;
+    T_MemoryAllocation I_UploadRingAllocation;
+    void* I_UploadRingAddress;
+    VkDeviceSize I_UploadRingSize;
+    VkDeviceSize I_UploadRingHead;
+    VkDeviceSize I_UploadRingTail;
+    VkDeviceSize I_UploadRingUsed;
+    VkDeviceSize I_UploadPendingBytes;
+    std::vector<T_UploadCopy> I_PendingUploads;
+    std::vector<T_UploadSegment> I_UploadSegments;
     std::vector<const char*> I_RequiredInstanceExtensions;
     std::vector<const char*> I_RequiredGraphicsExtensions;
     std::vector<T_BufferDetails> I_BufferDetails;
     std::vector<T_PipelineDetails> I_PipelineDetails;
+    std::vector<T_MemoryBlock> I_MemoryBlocks;
+    std::vector<T_TransientGroup> I_TransientGroups;
+    VkDeviceSize I_MemoryBlockSize;
+    VkDeviceSize I_BufferImageGranularity;
+    VkDeviceSize I_NonCoherentAtomSize;
+    VkDeviceSize I_MaxStorageBufferRange;
+    KVSubmitTicket I_LastTicket;
+    //  The time WaitFor() and WaitForSemaphoreValue() poll before blocking, and their waits.
+    unsigned int I_WaitSpinUsec;
+    KVWaitStats I_WaitStats;
+    std::vector<T_SubmitDetails> I_Submissions;
+    std::vector<VkFence> I_FreeFenceHndls;
+    std::vector<VkSemaphore> I_SemaphoreHndls;
     std::vector<VkSemaphore> I_ImageSemaphoreHndls;
     std::vector<VkSemaphore> I_RenderSemaphoreHndls;
     std::vector<VkFence> I_FenceHndls;
     std::vector<VkDescriptorSetLayout> I_DescriptorSetLayoutHndls;
     std::vector<VkDescriptorPool> I_DescriptorPoolHndls;
     std::vector<VkCommandPool> I_CommandPoolHndls;
+    std::vector<T_ThreadPool> I_ThreadPools;
+    //  Protects the Framework's bookkeeping when it is used by a number of threads. Recursive,
+    //  because the public routines call each other.
+    std::recursive_mutex I_Mutex;
     std::vector<VkShaderModule> I_ShaderModuleHndls;
+    //  The shader modules created by GetShaderModule(), indexed by a hash of their code. They
+    //  are also in I_ShaderModuleHndls, and are only destroyed when the Framework closes down.
+    std::map<uint64_t,VkShaderModule> I_ShaderModuleCache;
+    //  The thread started by StartDeviceSetup(), and the status that setup finished with.
+    std::thread I_DeviceSetupThread;
+    bool I_DeviceSetupOK;
+    //  The SPIR-V code read by PreloadShaderFile(), with its length in bytes, indexed by file
+    //  name. This has its own mutex, so files can be read while I_Mutex is held by the setup.
+    std::map<std::string,std::pair<long,std::vector<uint32_t>>> I_PreloadedShaders;
+    std::mutex I_PreloadMutex;
     static const std::string I_DebugOptions;
 };
 
+//  A program with its shaders built into it has a static KVEmbeddedShader for each one, which
+//  passes its code to EmbedShader() before main() starts. SpvEmbed generates these.
+
+struct KVEmbeddedShader {
+    KVEmbeddedShader(const char* Filename,const uint32_t* Code,size_t LengthInBytes) {
+        KVVulkanFramework::EmbedShader(Filename,Code,LengthInBytes);
+    }
+};
+
 #endif
 
 /*
@@ -444,8 +1156,9 @@ private:
  
     o   CreateComputePipeline() is passed a VkDescriptorSetLayout which is then used to create
         the pipeline layout to be used, which references the passed descriptor set layout.
-        CreateGraphicsPipeline() doesn't (at present) use any descriptor sets (would it if
-        it used uniform buffers, for example?), so isn't passed any such thing.
+        CreateGraphicsPipeline() originally didn't use any descriptor sets, but there is now a
+        version that is passed a descriptor set layout, for shaders that read storage or
+        uniform buffers as well as their vertex buffers.
  
     o   RecordGraphicsCommandBuffer() is passed the buffer handles, which I think makes it easy to
         let it use different buffers even though the pipeline is the same. I can see people
@@ -0,0 +1,167 @@
+//
+//                       M e d i a n  N e t w o r k s . h
+//
+//  Branch-free selection networks for the median of 9, 25 and 49 values - the number of pixels
+//  in a full 3x3, 5x5 or 7x7 median box. Each network is a fixed sequence of compare and
+//  exchange steps, so it has no data-dependent branches and only ever indexes its work array
+//  with constants. On a GPU this means every thread follows the same path, and the compiler
+//  can keep the whole work array in registers, neither of which is true of the quickselect
+//  used by CalcMedian(). On a CPU it avoids the mispredicted branches.
+//
+//  The same file is included by the C++, GLSL and Metal code, so it uses nothing but the
+//  preprocessor. Each network is a macro, MEDIAN_NETWORK_9, MEDIAN_NETWORK_25 or
+//  MEDIAN_NETWORK_49, that expands to a sequence of uses of three macros that the including
+//  code has to define, working on its own work array:
+//
+//     MEDIAN_SORT(a,b) sets element a to the smaller of elements a and b, and b to the larger.
+//     MEDIAN_MIN(a,b)  sets element a to the smaller of elements a and b. (b isn't needed.)
+//     MEDIAN_MAX(a,b)  sets element b to the larger of elements a and b. (a isn't needed.)
+//
+//  Once the network has run, the median is in the middle element - element 4, 12 or 24 -
+//  although the rest of the array is left only partly sorted.
+//
+//  14th Oct 2026. First version. KS.
+
+#ifndef __MedianNetworks__
+#define __MedianNetworks__
+
+//  The median of 9 values, in 19 steps. This is the well-known network published by Paeth
+//  (Graphics Gems, 1990), with the steps whose results are never used reduced to a single
+//  min or max.
+
+#define MEDIAN_NETWORK_9 \
+    MEDIAN_SORT(1,2) MEDIAN_SORT(4,5) MEDIAN_SORT(7,8) MEDIAN_SORT(0,1) MEDIAN_SORT(3,4) \
+    MEDIAN_SORT(6,7) MEDIAN_SORT(1,2) MEDIAN_SORT(4,5) MEDIAN_SORT(7,8) MEDIAN_MAX(0,3) \
+    MEDIAN_MIN(5,8) MEDIAN_SORT(4,7) MEDIAN_MAX(3,6) MEDIAN_MAX(1,4) MEDIAN_MIN(2,5) \
+    MEDIAN_MIN(4,7) MEDIAN_SORT(4,2) MEDIAN_MAX(6,4) MEDIAN_MIN(4,2)
+
+//  The medians of 25 and 49 values. These are Batcher's odd-even merge sorting networks for
+//  32 and 64 values, with the steps involving the unused upper elements removed (they would
+//  only ever compare a value with infinity) and then pruned back to just the steps that the
+//  middle element depends on. The result is 113 steps for 25 values and 319 for 49.
+
+#define MEDIAN_NETWORK_25 \
+    MEDIAN_SORT(0,1) MEDIAN_SORT(2,3) MEDIAN_SORT(4,5) MEDIAN_SORT(6,7) MEDIAN_SORT(8,9) \
+    MEDIAN_SORT(10,11) MEDIAN_SORT(12,13) MEDIAN_SORT(14,15) MEDIAN_SORT(16,17) \
+    MEDIAN_SORT(18,19) MEDIAN_SORT(20,21) MEDIAN_SORT(22,23) MEDIAN_SORT(0,2) \
+    MEDIAN_SORT(1,3) MEDIAN_SORT(4,6) MEDIAN_SORT(5,7) MEDIAN_SORT(8,10) MEDIAN_SORT(9,11) \
+    MEDIAN_SORT(12,14) MEDIAN_SORT(13,15) MEDIAN_SORT(16,18) MEDIAN_SORT(17,19) \
+    MEDIAN_SORT(20,22) MEDIAN_SORT(21,23) MEDIAN_SORT(1,2) MEDIAN_SORT(5,6) \
+    MEDIAN_SORT(9,10) MEDIAN_SORT(13,14) MEDIAN_SORT(17,18) MEDIAN_SORT(21,22) \
+    MEDIAN_SORT(0,4) MEDIAN_SORT(1,5) MEDIAN_SORT(2,6) MEDIAN_SORT(3,7) MEDIAN_SORT(8,12) \
+    MEDIAN_SORT(9,13) MEDIAN_SORT(10,14) MEDIAN_SORT(11,15) MEDIAN_SORT(16,20) \
+    MEDIAN_SORT(17,21) MEDIAN_SORT(18,22) MEDIAN_SORT(19,23) MEDIAN_SORT(2,4) \
+    MEDIAN_SORT(3,5) MEDIAN_SORT(10,12) MEDIAN_SORT(11,13) MEDIAN_SORT(18,20) \
+    MEDIAN_SORT(19,21) MEDIAN_SORT(1,2) MEDIAN_SORT(3,4) MEDIAN_SORT(5,6) MEDIAN_SORT(9,10) \
+    MEDIAN_SORT(11,12) MEDIAN_SORT(13,14) MEDIAN_SORT(17,18) MEDIAN_SORT(19,20) \
+    MEDIAN_SORT(21,22) MEDIAN_SORT(0,8) MEDIAN_SORT(1,9) MEDIAN_SORT(2,10) MEDIAN_SORT(3,11) \
+    MEDIAN_SORT(4,12) MEDIAN_SORT(5,13) MEDIAN_SORT(6,14) MEDIAN_MIN(7,15) \
+    MEDIAN_SORT(16,24) MEDIAN_SORT(4,8) MEDIAN_SORT(5,9) MEDIAN_SORT(6,10) MEDIAN_SORT(7,11) \
+    MEDIAN_SORT(20,24) MEDIAN_SORT(2,4) MEDIAN_SORT(3,5) MEDIAN_SORT(6,8) MEDIAN_SORT(7,9) \
+    MEDIAN_SORT(10,12) MEDIAN_SORT(11,13) MEDIAN_SORT(18,20) MEDIAN_SORT(19,21) \
+    MEDIAN_SORT(22,24) MEDIAN_SORT(1,2) MEDIAN_SORT(3,4) MEDIAN_SORT(5,6) MEDIAN_SORT(7,8) \
+    MEDIAN_SORT(9,10) MEDIAN_SORT(11,12) MEDIAN_MIN(13,14) MEDIAN_SORT(17,18) \
+    MEDIAN_SORT(19,20) MEDIAN_SORT(21,22) MEDIAN_SORT(23,24) MEDIAN_MAX(0,16) \
+    MEDIAN_MAX(1,17) MEDIAN_MAX(2,18) MEDIAN_MAX(3,19) MEDIAN_MAX(4,20) MEDIAN_MAX(5,21) \
+    MEDIAN_MIN(6,22) MEDIAN_MIN(7,23) MEDIAN_MIN(8,24) MEDIAN_MAX(8,16) MEDIAN_MAX(9,17) \
+    MEDIAN_MIN(10,18) MEDIAN_MIN(11,19) MEDIAN_MIN(12,20) MEDIAN_MIN(13,21) MEDIAN_MAX(6,10) \
+    MEDIAN_MAX(7,11) MEDIAN_MIN(12,16) MEDIAN_MIN(13,17) MEDIAN_MAX(10,12) MEDIAN_MIN(11,13) \
+    MEDIAN_MAX(11,12)
+
+#define MEDIAN_NETWORK_49 \
+    MEDIAN_SORT(0,1) MEDIAN_SORT(2,3) MEDIAN_SORT(4,5) MEDIAN_SORT(6,7) MEDIAN_SORT(8,9) \
+    MEDIAN_SORT(10,11) MEDIAN_SORT(12,13) MEDIAN_SORT(14,15) MEDIAN_SORT(16,17) \
+    MEDIAN_SORT(18,19) MEDIAN_SORT(20,21) MEDIAN_SORT(22,23) MEDIAN_SORT(24,25) \
+    MEDIAN_SORT(26,27) MEDIAN_SORT(28,29) MEDIAN_SORT(30,31) MEDIAN_SORT(32,33) \
+    MEDIAN_SORT(34,35) MEDIAN_SORT(36,37) MEDIAN_SORT(38,39) MEDIAN_SORT(40,41) \
+    MEDIAN_SORT(42,43) MEDIAN_SORT(44,45) MEDIAN_SORT(46,47) MEDIAN_SORT(0,2) \
+    MEDIAN_SORT(1,3) MEDIAN_SORT(4,6) MEDIAN_SORT(5,7) MEDIAN_SORT(8,10) MEDIAN_SORT(9,11) \
+    MEDIAN_SORT(12,14) MEDIAN_SORT(13,15) MEDIAN_SORT(16,18) MEDIAN_SORT(17,19) \
+    MEDIAN_SORT(20,22) MEDIAN_SORT(21,23) MEDIAN_SORT(24,26) MEDIAN_SORT(25,27) \
+    MEDIAN_SORT(28,30) MEDIAN_SORT(29,31) MEDIAN_SORT(32,34) MEDIAN_SORT(33,35) \
+    MEDIAN_SORT(36,38) MEDIAN_SORT(37,39) MEDIAN_SORT(40,42) MEDIAN_SORT(41,43) \
+    MEDIAN_SORT(44,46) MEDIAN_SORT(45,47) MEDIAN_SORT(1,2) MEDIAN_SORT(5,6) \
+    MEDIAN_SORT(9,10) MEDIAN_SORT(13,14) MEDIAN_SORT(17,18) MEDIAN_SORT(21,22) \
+    MEDIAN_SORT(25,26) MEDIAN_SORT(29,30) MEDIAN_SORT(33,34) MEDIAN_SORT(37,38) \
+    MEDIAN_SORT(41,42) MEDIAN_SORT(45,46) MEDIAN_SORT(0,4) MEDIAN_SORT(1,5) MEDIAN_SORT(2,6) \
+    MEDIAN_SORT(3,7) MEDIAN_SORT(8,12) MEDIAN_SORT(9,13) MEDIAN_SORT(10,14) \
+    MEDIAN_SORT(11,15) MEDIAN_SORT(16,20) MEDIAN_SORT(17,21) MEDIAN_SORT(18,22) \
+    MEDIAN_SORT(19,23) MEDIAN_SORT(24,28) MEDIAN_SORT(25,29) MEDIAN_SORT(26,30) \
+    MEDIAN_SORT(27,31) MEDIAN_SORT(32,36) MEDIAN_SORT(33,37) MEDIAN_SORT(34,38) \
+    MEDIAN_SORT(35,39) MEDIAN_SORT(40,44) MEDIAN_SORT(41,45) MEDIAN_SORT(42,46) \
+    MEDIAN_SORT(43,47) MEDIAN_SORT(2,4) MEDIAN_SORT(3,5) MEDIAN_SORT(10,12) \
+    MEDIAN_SORT(11,13) MEDIAN_SORT(18,20) MEDIAN_SORT(19,21) MEDIAN_SORT(26,28) \
+    MEDIAN_SORT(27,29) MEDIAN_SORT(34,36) MEDIAN_SORT(35,37) MEDIAN_SORT(42,44) \
+    MEDIAN_SORT(43,45) MEDIAN_SORT(1,2) MEDIAN_SORT(3,4) MEDIAN_SORT(5,6) MEDIAN_SORT(9,10) \
+    MEDIAN_SORT(11,12) MEDIAN_SORT(13,14) MEDIAN_SORT(17,18) MEDIAN_SORT(19,20) \
+    MEDIAN_SORT(21,22) MEDIAN_SORT(25,26) MEDIAN_SORT(27,28) MEDIAN_SORT(29,30) \
+    MEDIAN_SORT(33,34) MEDIAN_SORT(35,36) MEDIAN_SORT(37,38) MEDIAN_SORT(41,42) \
+    MEDIAN_SORT(43,44) MEDIAN_SORT(45,46) MEDIAN_SORT(0,8) MEDIAN_SORT(1,9) \
+    MEDIAN_SORT(2,10) MEDIAN_SORT(3,11) MEDIAN_SORT(4,12) MEDIAN_SORT(5,13) \
+    MEDIAN_SORT(6,14) MEDIAN_SORT(7,15) MEDIAN_SORT(16,24) MEDIAN_SORT(17,25) \
+    MEDIAN_SORT(18,26) MEDIAN_SORT(19,27) MEDIAN_SORT(20,28) MEDIAN_SORT(21,29) \
+    MEDIAN_SORT(22,30) MEDIAN_SORT(23,31) MEDIAN_SORT(32,40) MEDIAN_SORT(33,41) \
+    MEDIAN_SORT(34,42) MEDIAN_SORT(35,43) MEDIAN_SORT(36,44) MEDIAN_SORT(37,45) \
+    MEDIAN_SORT(38,46) MEDIAN_SORT(39,47) MEDIAN_SORT(4,8) MEDIAN_SORT(5,9) \
+    MEDIAN_SORT(6,10) MEDIAN_SORT(7,11) MEDIAN_SORT(20,24) MEDIAN_SORT(21,25) \
+    MEDIAN_SORT(22,26) MEDIAN_SORT(23,27) MEDIAN_SORT(36,40) MEDIAN_SORT(37,41) \
+    MEDIAN_SORT(38,42) MEDIAN_SORT(39,43) MEDIAN_SORT(2,4) MEDIAN_SORT(3,5) MEDIAN_SORT(6,8) \
+    MEDIAN_SORT(7,9) MEDIAN_SORT(10,12) MEDIAN_SORT(11,13) MEDIAN_SORT(18,20) \
+    MEDIAN_SORT(19,21) MEDIAN_SORT(22,24) MEDIAN_SORT(23,25) MEDIAN_SORT(26,28) \
+    MEDIAN_SORT(27,29) MEDIAN_SORT(34,36) MEDIAN_SORT(35,37) MEDIAN_SORT(38,40) \
+    MEDIAN_SORT(39,41) MEDIAN_SORT(42,44) MEDIAN_SORT(43,45) MEDIAN_SORT(1,2) \
+    MEDIAN_SORT(3,4) MEDIAN_SORT(5,6) MEDIAN_SORT(7,8) MEDIAN_SORT(9,10) MEDIAN_SORT(11,12) \
+    MEDIAN_SORT(13,14) MEDIAN_SORT(17,18) MEDIAN_SORT(19,20) MEDIAN_SORT(21,22) \
+    MEDIAN_SORT(23,24) MEDIAN_SORT(25,26) MEDIAN_SORT(27,28) MEDIAN_SORT(29,30) \
+    MEDIAN_SORT(33,34) MEDIAN_SORT(35,36) MEDIAN_SORT(37,38) MEDIAN_SORT(39,40) \
+    MEDIAN_SORT(41,42) MEDIAN_SORT(43,44) MEDIAN_SORT(45,46) MEDIAN_SORT(0,16) \
+    MEDIAN_SORT(1,17) MEDIAN_SORT(2,18) MEDIAN_SORT(3,19) MEDIAN_SORT(4,20) \
+    MEDIAN_SORT(5,21) MEDIAN_SORT(6,22) MEDIAN_SORT(7,23) MEDIAN_SORT(8,24) \
+    MEDIAN_SORT(9,25) MEDIAN_SORT(10,26) MEDIAN_SORT(11,27) MEDIAN_SORT(12,28) \
+    MEDIAN_SORT(13,29) MEDIAN_MIN(14,30) MEDIAN_MIN(15,31) MEDIAN_SORT(32,48) \
+    MEDIAN_SORT(8,16) MEDIAN_SORT(9,17) MEDIAN_SORT(10,18) MEDIAN_SORT(11,19) \
+    MEDIAN_SORT(12,20) MEDIAN_SORT(13,21) MEDIAN_SORT(14,22) MEDIAN_SORT(15,23) \
+    MEDIAN_SORT(40,48) MEDIAN_SORT(4,8) MEDIAN_SORT(5,9) MEDIAN_SORT(6,10) MEDIAN_SORT(7,11) \
+    MEDIAN_SORT(12,16) MEDIAN_SORT(13,17) MEDIAN_SORT(14,18) MEDIAN_SORT(15,19) \
+    MEDIAN_SORT(20,24) MEDIAN_SORT(21,25) MEDIAN_SORT(22,26) MEDIAN_SORT(23,27) \
+    MEDIAN_SORT(36,40) MEDIAN_SORT(37,41) MEDIAN_SORT(38,42) MEDIAN_SORT(39,43) \
+    MEDIAN_SORT(44,48) MEDIAN_SORT(2,4) MEDIAN_SORT(3,5) MEDIAN_SORT(6,8) MEDIAN_SORT(7,9) \
+    MEDIAN_SORT(10,12) MEDIAN_SORT(11,13) MEDIAN_SORT(14,16) MEDIAN_SORT(15,17) \
+    MEDIAN_SORT(18,20) MEDIAN_SORT(19,21) MEDIAN_SORT(22,24) MEDIAN_SORT(23,25) \
+    MEDIAN_SORT(26,28) MEDIAN_MIN(27,29) MEDIAN_SORT(34,36) MEDIAN_SORT(35,37) \
+    MEDIAN_SORT(38,40) MEDIAN_SORT(39,41) MEDIAN_SORT(42,44) MEDIAN_SORT(43,45) \
+    MEDIAN_SORT(46,48) MEDIAN_SORT(1,2) MEDIAN_SORT(3,4) MEDIAN_SORT(5,6) MEDIAN_SORT(7,8) \
+    MEDIAN_SORT(9,10) MEDIAN_SORT(11,12) MEDIAN_SORT(13,14) MEDIAN_SORT(15,16) \
+    MEDIAN_SORT(17,18) MEDIAN_SORT(19,20) MEDIAN_SORT(21,22) MEDIAN_SORT(23,24) \
+    MEDIAN_SORT(25,26) MEDIAN_MIN(27,28) MEDIAN_SORT(33,34) MEDIAN_SORT(35,36) \
+    MEDIAN_SORT(37,38) MEDIAN_SORT(39,40) MEDIAN_SORT(41,42) MEDIAN_SORT(43,44) \
+    MEDIAN_SORT(45,46) MEDIAN_SORT(47,48) MEDIAN_MAX(0,32) MEDIAN_MAX(1,33) MEDIAN_MAX(2,34) \
+    MEDIAN_MAX(3,35) MEDIAN_MAX(4,36) MEDIAN_MAX(5,37) MEDIAN_MAX(6,38) MEDIAN_MAX(7,39) \
+    MEDIAN_MAX(8,40) MEDIAN_MAX(9,41) MEDIAN_MAX(10,42) MEDIAN_MAX(11,43) MEDIAN_MIN(12,44) \
+    MEDIAN_MIN(13,45) MEDIAN_MIN(14,46) MEDIAN_MIN(15,47) MEDIAN_MIN(16,48) \
+    MEDIAN_MAX(16,32) MEDIAN_MAX(17,33) MEDIAN_MAX(18,34) MEDIAN_MAX(19,35) \
+    MEDIAN_MIN(20,36) MEDIAN_MIN(21,37) MEDIAN_MIN(22,38) MEDIAN_MIN(23,39) \
+    MEDIAN_MIN(24,40) MEDIAN_MIN(25,41) MEDIAN_MIN(26,42) MEDIAN_MIN(27,43) \
+    MEDIAN_MAX(12,20) MEDIAN_MAX(13,21) MEDIAN_MAX(14,22) MEDIAN_MAX(15,23) \
+    MEDIAN_MIN(24,32) MEDIAN_MIN(25,33) MEDIAN_MIN(26,34) MEDIAN_MIN(27,35) \
+    MEDIAN_MAX(20,24) MEDIAN_MAX(21,25) MEDIAN_MIN(22,26) MEDIAN_MIN(23,27) \
+    MEDIAN_MAX(22,24) MEDIAN_MIN(23,25) MEDIAN_MAX(23,24)
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The networks were generated and then checked by running them on every possible set of
+        9 or 25 zeros and ones - if a network of compare and exchange steps gets the right
+        answer for all of those, it gets it for any values at all. (This is the 0-1 principle
+        that applies to sorting networks, and to selection networks like these.) There are too
+        many sets of 49 for that, so the 49 value network was checked on some millions of sets
+        of random values, but since it is just a pruned version of a proven sorting network,
+        that is belt and braces.
+
+    o   These only work for a full box. A box at the edge of the image is cut short and has
+        fewer values - and may have an even number - so the code using these falls back on
+        CalcMedian() for those.
+
+    o   If the image has NaN values, the result will depend on how min() and max() treat them,
+        which differs between CPUs and GPUs, and between this and the quickselect code.
+*/
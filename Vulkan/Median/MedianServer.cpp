@@ -0,0 +1,416 @@
+//
+//                          M e d i a n  S e r v e r . c p p
+//
+//  The implementation of the MedianServer and MedianClient classes, which let a program that has
+//  set up the GPU filter images sent to it over a socket. See MedianServer.h.
+//
+//  15th Oct 2026. First version. KS.
+//                 ReadAll() and WriteAll() now use ReadSocketDataV() and WriteSocketDataV(),
+//                 and there's a WriteAll() for a header and body together. KS.
+
+#include "MedianServer.h"
+#include "TcsUtil.h"
+#include "MsecTimer.h"
+
+#include <string.h>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <unistd.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MEDIAN_SERVER_SOCKETS
+
+#endif
+
+//  How long the rest of a message can take to arrive, once its header has been read.
+
+static const unsigned int C_DataTimeoutMsec = 30000;
+
+//  The most RejectJob() reads at once, into the scratch buffer it throws away.
+
+static const size_t C_MaxTransfer = 16 * 1024 * 1024;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 M e d i a n  S e r v e r
+
+MedianServer::MedianServer(void)
+{
+    I_ListenFd = -1;
+    I_UnixPath = "";
+    I_JobsRun = 0;
+    I_Error = "";
+}
+
+MedianServer::~MedianServer()
+{
+#ifdef MEDIAN_SERVER_SOCKETS
+    if (I_ListenFd >= 0) close(I_ListenFd);
+    if (I_UnixPath != "") unlink(I_UnixPath.c_str());
+#endif
+}
+
+bool MedianServer::Listen(const std::string& Address)
+{
+    I_ListenFd = OpenSocket(Address,true,&I_Error);
+    if (I_ListenFd >= 0 && Address.find('/') != std::string::npos) I_UnixPath = Address;
+    return (I_ListenFd >= 0);
+}
+
+//  OpenSocket() does the work for both Listen() and MedianClient::Connect(). A server's TCP
+//  socket is bound to the loopback interface unless a host is given, so by default only local
+//  clients can connect. A server's Unix socket replaces any socket already at the path, since
+//  that will have been left behind by an earlier server, but not any other kind of file.
+
+int MedianServer::OpenSocket(const std::string& Address,bool Server,std::string* Error)
+{
+#ifdef MEDIAN_SERVER_SOCKETS
+
+    int SocketFd = -1;
+    if (Address.find('/') != std::string::npos) {
+        struct sockaddr_un UnixAddr;
+        memset(&UnixAddr,0,sizeof(UnixAddr));
+        UnixAddr.sun_family = AF_UNIX;
+        if (Address.size() >= sizeof(UnixAddr.sun_path)) {
+            *Error = "Socket path '" + Address + "' is too long";
+            return -1;
+        }
+        strncpy(UnixAddr.sun_path,Address.c_str(),sizeof(UnixAddr.sun_path) - 1);
+        SocketFd = socket(AF_UNIX,SOCK_STREAM,0);
+        if (SocketFd < 0) {
+            *Error = "Unable to create socket: " + TcsUtil::GetErrnoText();
+            return -1;
+        }
+        int Status;
+        if (Server) {
+            struct stat FileStat;
+            if (stat(Address.c_str(),&FileStat) == 0 && S_ISSOCK(FileStat.st_mode)) {
+                unlink(Address.c_str());
+            }
+            Status = bind(SocketFd,(struct sockaddr*)&UnixAddr,sizeof(UnixAddr));
+            if (Status == 0) Status = listen(SocketFd,4);
+        } else {
+            Status = connect(SocketFd,(struct sockaddr*)&UnixAddr,sizeof(UnixAddr));
+        }
+        if (Status != 0) {
+            *Error = "Unable to " + std::string(Server ? "listen on '" : "connect to '") +
+                                        Address + "': " + TcsUtil::GetErrnoText();
+            close(SocketFd);
+            return -1;
+        }
+    } else {
+
+        //  A TCP port, with or without a host name in front of it.
+
+        std::string Host = Server ? "127.0.0.1" : "localhost";
+        std::string Port = Address;
+        size_t Colon = Address.rfind(':');
+        if (Colon != std::string::npos) {
+            Host = Address.substr(0,Colon);
+            Port = Address.substr(Colon + 1);
+        }
+        struct addrinfo Hints;
+        memset(&Hints,0,sizeof(Hints));
+        Hints.ai_family = AF_UNSPEC;
+        Hints.ai_socktype = SOCK_STREAM;
+        if (Server) Hints.ai_flags = AI_PASSIVE;
+        struct addrinfo* AddrList = nullptr;
+        int Status = getaddrinfo(Host == "*" ? nullptr : Host.c_str(),Port.c_str(),
+                                                                         &Hints,&AddrList);
+        if (Status != 0) {
+            *Error = "Unable to look up '" + Address + "': " + gai_strerror(Status);
+            return -1;
+        }
+        std::string ErrnoText = "no address found";
+        for (struct addrinfo* Addr = AddrList; Addr; Addr = Addr->ai_next) {
+            SocketFd = socket(Addr->ai_family,Addr->ai_socktype,Addr->ai_protocol);
+            if (SocketFd < 0) continue;
+            int One = 1;
+            if (Server) {
+                setsockopt(SocketFd,SOL_SOCKET,SO_REUSEADDR,&One,sizeof(One));
+                Status = bind(SocketFd,Addr->ai_addr,Addr->ai_addrlen);
+                if (Status == 0) Status = listen(SocketFd,4);
+            } else {
+                Status = connect(SocketFd,Addr->ai_addr,Addr->ai_addrlen);
+            }
+            if (Status == 0) {
+
+                //  The headers are small, and each side waits for the other's, so Nagle's
+                //  algorithm would only add delay.
+
+                setsockopt(SocketFd,IPPROTO_TCP,TCP_NODELAY,&One,sizeof(One));
+                break;
+            }
+            ErrnoText = TcsUtil::GetErrnoText();
+            close(SocketFd);
+            SocketFd = -1;
+        }
+        freeaddrinfo(AddrList);
+        if (SocketFd < 0) {
+            *Error = "Unable to " + std::string(Server ? "listen on '" : "connect to '") +
+                                                             Address + "': " + ErrnoText;
+            return -1;
+        }
+    }
+
+    //  A client that goes away leaves the server writing to a closed socket, which should
+    //  just be an error, not a SIGPIPE that ends the program.
+
+    signal(SIGPIPE,SIG_IGN);
+    return SocketFd;
+
+#else
+
+    *Error = "Sockets for 'Serve' and 'Connect' are not supported on this system";
+    return -1;
+
+#endif
+}
+
+bool MedianServer::ReadAll(int SocketFd,void* Buffer,size_t Bytes,unsigned int TimeoutMsec,
+                                                                           std::string* Error)
+{
+#ifdef MEDIAN_SERVER_SOCKETS
+    TcsUtil::SocketSegment Segment = {Buffer,Bytes};
+    return (TcsUtil::ReadSocketDataV(SocketFd,&Segment,1,TimeoutMsec,*Error) >= 0);
+#else
+    (void)SocketFd; (void)Buffer; (void)Bytes; (void)TimeoutMsec;
+    *Error = "Sockets are not supported on this system";
+    return false;
+#endif
+}
+
+bool MedianServer::WriteAll(int SocketFd,const void* Buffer,size_t Bytes,std::string* Error)
+{
+    return WriteAll(SocketFd,Buffer,Bytes,nullptr,0,Error);
+}
+
+//  The segments only have non-const addresses because the same structure is used for reading,
+//  and WriteSocketDataV() doesn't change what they point to.
+
+bool MedianServer::WriteAll(int SocketFd,const void* Header,size_t HeaderBytes,
+                                      const void* Body,size_t BodyBytes,std::string* Error)
+{
+#ifdef MEDIAN_SERVER_SOCKETS
+    TcsUtil::SocketSegment Segments[2] = {{const_cast<void*>(Header),HeaderBytes},
+                                          {const_cast<void*>(Body),BodyBytes}};
+    return (TcsUtil::WriteSocketDataV(SocketFd,Segments,2,*Error) >= 0);
+#else
+    (void)SocketFd; (void)Header; (void)HeaderBytes; (void)Body; (void)BodyBytes;
+    *Error = "Sockets are not supported on this system";
+    return false;
+#endif
+}
+
+//  ServeConnection() is the server's main loop, for one client. Each job has its header read,
+//  with no timeout since the client can take as long as it likes between jobs, and then its
+//  image, which is read straight into the memory Dest provides. A header that can't be made
+//  sense of ends the connection, since the server can't tell where the next one starts.
+
+bool MedianServer::ServeConnection(const Destination& Dest,const Filter& Filter)
+{
+#ifdef MEDIAN_SERVER_SOCKETS
+
+    if (I_ListenFd < 0) {
+        I_Error = "Server is not listening";
+        return false;
+    }
+    int SocketFd = -1;
+    while (SocketFd < 0) {
+        SocketFd = accept(I_ListenFd,nullptr,nullptr);
+        if (SocketFd < 0 && !TcsUtil::TransientError()) {
+            I_Error = "Error accepting connection: " + TcsUtil::GetErrnoText();
+            close(I_ListenFd);
+            I_ListenFd = -1;
+            return false;
+        }
+    }
+
+    bool ConnectionOK = true;
+    for (;;) {
+        MessageHeader Job;
+        std::string ReadError;
+        if (TcsUtil::ReadSocketData(SocketFd,(char*)&Job,sizeof(Job),0,ReadError) < 0) {
+
+            //  The client closing the connection between jobs is how it normally ends.
+
+            break;
+        }
+        if (Job.Magic != C_Magic || Job.Version != C_Version) {
+            I_Error = (Job.Magic == C_Magic) ? "Job has the wrong protocol version" :
+                                   "Job has the wrong magic number - wrong byte order?";
+            ReplyError(SocketFd,I_Error);
+            ConnectionOK = false;
+            break;
+        }
+        int Nx = int(Job.Nx);
+        int Ny = int(Job.Ny);
+        if (Job.Nx == 0 || Job.Ny == 0 || Job.Nx > uint32_t(C_MaxPixels) ||
+                  Job.Ny > uint32_t(C_MaxPixels) || long(Nx) * long(Ny) > C_MaxPixels) {
+            if (!ReplyError(SocketFd,"Image dimensions are out of range")) {
+                ConnectionOK = false;
+                break;
+            }
+            continue;
+        }
+
+        //  Read the image into the memory Dest supplies, or reject the job if it can't.
+
+        float* Input = Dest(Nx,Ny);
+        if (Input == nullptr) {
+            if (!RejectJob(SocketFd,Job,"Server unable to allocate memory for the image")) {
+                ConnectionOK = false;
+                break;
+            }
+            continue;
+        }
+        size_t Bytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+        if (!ReadAll(SocketFd,Input,Bytes,C_DataTimeoutMsec,&I_Error)) {
+            ConnectionOK = false;
+            break;
+        }
+
+        //  Filter it, and send back the result.
+
+        MsecTimer JobTimer;
+        float KernelMsec = 0.0;
+        std::string FilterError = "";
+        const float* Output = Filter(Nx,Ny,int(Job.Npix),(Job.Flags & C_Blanks) != 0,
+                                                                   &KernelMsec,&FilterError);
+        if (Output == nullptr) {
+            if (FilterError == "") FilterError = "Server unable to filter the image";
+            if (!ReplyError(SocketFd,FilterError)) {
+                ConnectionOK = false;
+                break;
+            }
+            continue;
+        }
+        MessageHeader Reply = Job;
+        Reply.Flags = 0;
+        Reply.Status = 0;
+        Reply.ServerMsec = JobTimer.ElapsedMsec();
+        Reply.KernelMsec = KernelMsec;
+        if (!WriteAll(SocketFd,&Reply,sizeof(Reply),Output,Bytes,&I_Error)) {
+            ConnectionOK = false;
+            break;
+        }
+        I_JobsRun++;
+    }
+    close(SocketFd);
+    return ConnectionOK;
+
+#else
+
+    (void)Dest; (void)Filter;
+    I_Error = "Sockets are not supported on this system";
+    return false;
+
+#endif
+}
+
+bool MedianServer::RejectJob(int SocketFd,const MessageHeader& Job,const std::string& Reason)
+{
+    //  The image is read in chunks and thrown away, to get to the start of the next job.
+
+    std::vector<char> Scratch(C_MaxTransfer);
+    size_t Bytes = size_t(Job.Nx) * size_t(Job.Ny) * sizeof(float);
+    while (Bytes > 0) {
+        size_t Chunk = (Bytes < Scratch.size()) ? Bytes : Scratch.size();
+        if (!ReadAll(SocketFd,Scratch.data(),Chunk,C_DataTimeoutMsec,&I_Error)) return false;
+        Bytes -= Chunk;
+    }
+    return ReplyError(SocketFd,Reason);
+}
+
+bool MedianServer::ReplyError(int SocketFd,const std::string& Reason)
+{
+    MessageHeader Reply;
+    memset(&Reply,0,sizeof(Reply));
+    Reply.Magic = C_Magic;
+    Reply.Version = C_Version;
+    Reply.Status = uint32_t(Reason.size());
+    return WriteAll(SocketFd,&Reply,sizeof(Reply),Reason.data(),Reason.size(),&I_Error);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 M e d i a n  C l i e n t
+
+MedianClient::MedianClient(void)
+{
+    I_SocketFd = -1;
+    I_Error = "";
+}
+
+MedianClient::~MedianClient()
+{
+    Close();
+}
+
+bool MedianClient::Connect(const std::string& Address)
+{
+    Close();
+    I_SocketFd = MedianServer::OpenSocket(Address,false,&I_Error);
+    return (I_SocketFd >= 0);
+}
+
+void MedianClient::Close(void)
+{
+#ifdef MEDIAN_SERVER_SOCKETS
+    if (I_SocketFd >= 0) close(I_SocketFd);
+#endif
+    I_SocketFd = -1;
+}
+
+//  FilterImage() sends one job and waits for the reply. The server can take as long as it
+//  needs to filter the image, so there's no timeout on the reply header, only on what follows.
+
+bool MedianClient::FilterImage(const float* Input,float* Output,int Nx,int Ny,int Npix,
+                                            bool Blanks,float* ServerMsec,float* KernelMsec)
+{
+    if (I_SocketFd < 0) {
+        I_Error = "Not connected to a server";
+        return false;
+    }
+    MedianServer::MessageHeader Job;
+    memset(&Job,0,sizeof(Job));
+    Job.Magic = MedianServer::C_Magic;
+    Job.Version = MedianServer::C_Version;
+    Job.Nx = uint32_t(Nx);
+    Job.Ny = uint32_t(Ny);
+    Job.Npix = uint32_t(Npix);
+    Job.Flags = Blanks ? MedianServer::C_Blanks : 0;
+    size_t Bytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+    if (!MedianServer::WriteAll(I_SocketFd,&Job,sizeof(Job),Input,Bytes,&I_Error)) {
+        return false;
+    }
+    MedianServer::MessageHeader Reply;
+    if (!MedianServer::ReadAll(I_SocketFd,&Reply,sizeof(Reply),0,&I_Error)) return false;
+    if (Reply.Magic != MedianServer::C_Magic) {
+        I_Error = "Reply from server has the wrong magic number";
+        return false;
+    }
+    if (Reply.Status != 0) {
+        std::string Reason(Reply.Status,' ');
+        if (MedianServer::ReadAll(I_SocketFd,&Reason[0],Reason.size(),C_DataTimeoutMsec,
+                                                                               &I_Error)) {
+            I_Error = "Server: " + Reason;
+        }
+        return false;
+    }
+    if (!MedianServer::ReadAll(I_SocketFd,Output,Bytes,C_DataTimeoutMsec,&I_Error)) {
+        return false;
+    }
+    *ServerMsec = Reply.ServerMsec;
+    *KernelMsec = Reply.KernelMsec;
+    return true;
+}
@@ -0,0 +1,151 @@
+//
+//                            M e d i a n  S e r v e r . h
+//
+//  A MedianServer lets a program that has already set up the GPU filter images sent to it over
+//  a socket, so a client gets its result in the time the filter itself takes, instead of paying
+//  for creating the Vulkan instance and device, and building the pipelines, for every image.
+//  With 'Serve', the Median program sets up the GPU once and then waits for images. With
+//  'Connect', the program sends its image to such a server instead of using the GPU itself, and
+//  a MedianClient is what does the sending.
+//
+//  The server listens on either a TCP port or a Unix domain socket, depending on the address:
+//
+//     "5050"              TCP port 5050 on the loopback interface, so only for local clients.
+//     "host:5050"         TCP port 5050 on the interface for 'host' - "*:5050" for all of them.
+//     "/tmp/median.sock"  A Unix domain socket, used for any address that includes a '/'.
+//
+//  Each connection carries any number of jobs, one after the other. A job is a MessageHeader
+//  giving the image size, the box size and whether the image can have blank (NaN) pixels,
+//  followed by the image as Nx * Ny floats, row by row. The reply is a MessageHeader followed
+//  either by the filtered image, or by an error message if it couldn't be filtered. All values
+//  are sent in the machine's own byte order, so the client and server must agree on it - the
+//  magic number at the start of each header is there to catch any that don't.
+//
+//  ServeConnection() accepts one connection and works through its jobs until the client closes
+//  it. The server is given two routines to do the work: Destination, which is given the size
+//  of the next image and returns the memory it is to be read into - usually a GPU buffer, so
+//  the image goes straight from the socket to the buffer - and Filter, which then filters it
+//  and returns the address of the result, which again goes straight back to the socket. So
+//  this knows nothing about Vulkan, and the GPU code all stays in MedianVulkan.cpp.
+//
+//  The socket handling uses ReadSocketDataV() and WriteSocketDataV() from TcsUtil, and is only
+//  available on UNIX-like systems (including MacOS). Elsewhere Listen() and Connect() just
+//  return false, with an error saying so. A header and the image that follows it are written
+//  with the one writev() call, straight from where each is, so neither is copied on the way
+//  and the header doesn't go off in a packet of its own.
+//
+//  15th Oct 2026. First version. KS.
+//                 Headers and images are now written together, using WriteSocketDataV(). KS.
+
+#ifndef __MedianServer__
+#define __MedianServer__
+
+#include "TcsUtil.h"
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+class MedianServer
+{
+public:
+    //  The header that starts each job sent to the server, and each reply. In a job, Status,
+    //  ServerMsec and KernelMsec are zero. In a reply, Status is zero if the filtered image
+    //  follows, or the length of the error message that follows instead.
+    struct MessageHeader {
+        uint32_t Magic;                      // C_Magic, as sent.
+        uint32_t Version;                    // C_Version, as sent.
+        uint32_t Nx;                         // The image dimensions.
+        uint32_t Ny;
+        uint32_t Npix;                       // The box size.
+        uint32_t Flags;                      // C_Blanks if the image can have blank pixels.
+        uint32_t Status;                     // Zero, or the length of an error message.
+        float ServerMsec;                    // The time the server took for the job.
+        float KernelMsec;                    // The time the GPU kernel took, if known.
+        uint32_t Spare;
+    };
+    static const uint32_t C_Magic = 0x4d45444e;
+    static const uint32_t C_Version = 1;
+    static const uint32_t C_Blanks = 1;
+    //  The largest image a server will accept, in pixels.
+    static const long C_MaxPixels = 256L * 1024L * 1024L;
+    //  Returns the memory for an Nx by Ny image to be read into, or nullptr if it can't.
+    typedef std::function<float*(int Nx,int Ny)> Destination;
+    //  Filters the Nx by Ny image just read, returning the address of the result, or nullptr
+    //  with an explanation in Error. KernelMsec is set to the GPU kernel time, if known.
+    typedef std::function<const float*(int Nx,int Ny,int Npix,bool Blanks,float* KernelMsec,
+                                                                 std::string* Error)> Filter;
+    MedianServer(void);
+    ~MedianServer();
+    //  Starts listening on the Address given, as described above.
+    bool Listen(const std::string& Address);
+    //  True if the server is listening, and so ServeConnection() can be called.
+    bool Listening(void) const { return I_ListenFd >= 0; }
+    //  Waits for a client to connect, and runs its jobs until it closes the connection. This
+    //  returns false if the connection ended with an error, which GetError() then explains.
+    bool ServeConnection(const Destination& Dest,const Filter& Filter);
+    //  The number of jobs run since the server started.
+    long JobsRun(void) const { return I_JobsRun; }
+    //  Returns an explanation of the last error.
+    const std::string& GetError(void) const { return I_Error; }
+    //  Opens a socket listening on, or connected to, an address as described above, returning
+    //  its file descriptor or -1. Used by Listen() and by MedianClient.
+    static int OpenSocket(const std::string& Address,bool Server,std::string* Error);
+    //  Reads or writes a whole message body, of any size.
+    static bool ReadAll(int SocketFd,void* Buffer,size_t Bytes,unsigned int TimeoutMsec,
+                                                                        std::string* Error);
+    static bool WriteAll(int SocketFd,const void* Buffer,size_t Bytes,std::string* Error);
+    //  Writes a header and the body that follows it, with the one call.
+    static bool WriteAll(int SocketFd,const void* Header,size_t HeaderBytes,const void* Body,
+                                                          size_t BodyBytes,std::string* Error);
+private:
+    //  Reads the rest of a job whose image can't be used, and replies with an error.
+    bool RejectJob(int SocketFd,const MessageHeader& Job,const std::string& Reason);
+    //  Sends a reply with an error message.
+    bool ReplyError(int SocketFd,const std::string& Reason);
+    int I_ListenFd;
+    std::string I_UnixPath;
+    long I_JobsRun;
+    std::string I_Error;
+};
+
+//  The client end. Connect() opens a connection to a server, and each call to FilterImage()
+//  then sends an image to it and waits for the result.
+
+class MedianClient
+{
+public:
+    MedianClient(void);
+    ~MedianClient();
+    //  Connects to a server listening on the Address given, as described above.
+    bool Connect(const std::string& Address);
+    //  Has the server filter the Nx by Ny Input with an Npix by Npix box, putting the result
+    //  in Output. ServerMsec and KernelMsec are set to the times the server reports.
+    bool FilterImage(const float* Input,float* Output,int Nx,int Ny,int Npix,bool Blanks,
+                                                          float* ServerMsec,float* KernelMsec);
+    //  Closes the connection, as the destructor does.
+    void Close(void);
+    //  Returns an explanation of the last error.
+    const std::string& GetError(void) const { return I_Error; }
+private:
+    int I_SocketFd;
+    std::string I_Error;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The server only handles one connection at a time. There's only the one GPU, and one set
+        of buffers, so jobs from several clients would just have to queue for them anyway. A
+        client waiting to connect is kept waiting by the system until the one before it is done.
+
+    o   A job that can't be run - an image too large, or a box the GPU can't handle - still has
+        its image read, so the connection stays in step and the client just gets an error reply.
+        But a header with the wrong magic number or version means the rest of what was sent
+        can't be made sense of, so the connection is then closed.
+
+    o   The server waits as long as it has to for the next job on a connection, but once a job
+        has started the image has to keep arriving - C_DataTimeoutMsec in MedianServer.cpp - so
+        a client that stalls part way through can't hold up the server for ever.
+*/
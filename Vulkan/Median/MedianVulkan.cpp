@@ -25,7 +25,10 @@
 //     File,Npix,Nrpt,Threads are positional parameters, and can be specified either by just
 //     providing values for them on the command line in the order above, or explicitly
 //     by name and value, with an optional '=' sign. If Threads is zero, the maximum number
-//     of CPU threads available will be used. Pix should be an odd number.
+//     of CPU threads available will be used. Pix should be an odd number. Boxes larger
+//     than 11 by 11 are too big for the work arrays used to find the median, so the GPU code
+//     uses a slower bitwise search for them, up to 31 by 31, and the CPU uses the histogram
+//     median filter (see 'Histogram' below). Larger boxes can only be handled by the CPU.
 //
 //     Cpu     specifies that the operation is to be carried out using the CPU.
 //     Gpu     specifies that the operation is to be carried out using the GPU.
@@ -38,16 +41,323 @@
 //     If File is specified as blank, then the program will not read data from a file,
 //     but will generate dummy data for test purposes. In this case, it will need to
 //     know how large an array to generate, and this is provided by the optional
-//     Nx,Ny parameters. If File is non-blank, these are ignored.
+//     Nx,Ny parameters. If File is non-blank, these are ignored. Any blank pixels in the
+//     file - given by its BLANK keyword, or NaNs - are left out of the boxes, so each median
+//     is that of the valid pixels in its box, and a box with none gives a NaN.
+//
+//     If the file's image is a cube (NAXIS = 3), each plane is filtered separately, by the
+//     GPU, and the planes are passed through a ring of GPU buffers so that the reading and
+//     writing of one plane overlaps the filtering of others. The whole cube is never held in
+//     memory, so as with 'Stream' there's no CPU check, and 'Cpu', 'Nrpt', 'Half', 'InPlace',
+//     'Autotune', 'Native' and 'Scales' are ignored.
 //
 //     Nx      is the X dimension of the arrays in question.
 //     Ny      is the Y dimension of the arrays in question.
 //
+//     InPlace has the GPU filter the image in place, in a single buffer, using a small
+//             window buffer for the rows around each band being filtered, rather than having
+//             separate input and output buffers. This almost halves the GPU memory needed, so
+//             allows twice the image size. Because the image is overwritten, each repeat then
+//             filters the result of the last, and with 'InPlace' the CPU code does the same,
+//             so the two can still be compared. 'Autotune' is ignored with 'InPlace'.
+//
+//     Half    has the GPU hold the image in half precision, using a version of the shader
+//             (Median16.spv, built from Median.comp) whose buffers hold 16-bit floats. The
+//             image is converted to half precision as it is loaded into the GPU, and the
+//             results are converted back as they are read. This halves the memory traffic,
+//             at the cost of precision, so the GPU and CPU results are then only expected to
+//             agree to within the precision of half-precision values. This needs the GPU to
+//             support 16-bit storage - if it doesn't, 'Half' is ignored. 'InPlace' and
+//             'Autotune' are ignored with 'Half'.
+//
+//     Histogram has the CPU use a median filter based on histograms (see HistogramMedian.h),
+//             whose time per pixel hardly depends on the size of the box, instead of finding
+//             the median of all the values in each box. This scales the values into 16-bit
+//             bins, so its results are only within half a bin width of the true median, and
+//             they are checked against any GPU results allowing for that. This is always used
+//             for boxes larger than 11 by 11, which can be up to 255 by 255.
+//
+//     Simd    has the CPU run the selection networks for 3x3, 5x5 and 7x7 boxes on a block
+//             of adjacent pixels at once, one pixel in each lane of the vector registers,
+//             instead of one pixel at a time. Where the program was built with GCC or Clang
+//             for x86, this uses AVX-512 or AVX2 if the CPU has them, checked when it runs.
+//             The results are the same as without it. It has no effect on other box sizes,
+//             or with 'Histogram'.
+//
+//     Tiled   has the GPU use a version of the shader (MedianTiled.spv, or MedianTiled16.spv
+//             with 'Half', built from Median.comp) in which each workgroup first copies its
+//             part of the image, plus the Npix/2 pixels around it, into shared memory, and
+//             fills its boxes from there. This cuts the reads from GPU memory by about a
+//             factor of Npix squared, which matters most for the larger boxes. The results
+//             are the same as without it. If the device supports subgroup vote operations,
+//             MedianTiledSG.spv is used for a float image, which combines the threads' checks
+//             for blank pixels in each subgroup.
+//
+//     Bitonic has the GPU use another tiled version of the shader (MedianTiledBitonic.spv) in
+//             which 9x9 and 11x11 boxes, rather than each being filled into a work array and
+//             partitioned by one thread, are each sorted by all the threads of a subgroup
+//             together, using a bitonic sorting network. The values stay in the threads'
+//             registers and are exchanged between threads by subgroup shuffles, so there are no
+//             branches and no work array spilled to memory, but there are many more comparisons,
+//             so whether it is faster depends on the GPU. Other box sizes, the boxes at the
+//             edges of the image and those that may include blank pixels are filtered as usual,
+//             and the results are the same as without it. It needs the device to support
+//             subgroup shuffles, and is ignored with 'Half', 'InPlace' and 'Native', and by the
+//             options that filter several images or bands. 'Autotune' is ignored with it.
+//
+//     Files   is a list of FITS files to be filtered one after the other, separated by commas
+//             or spaces, where each name can use '*' as a wildcard, for example
+//             Files = "night1/*.fits". The GPU is set up just once, and the same buffers used
+//             for all the files (they are only resized if the image size changes), so a large
+//             number of files can be filtered with none of the setup time for each. The result
+//             for each file is written to a "Median_" copy of it, and with 'Cpu' each file is
+//             also filtered by the CPU and the results compared. 'File', 'Nrpt', 'Half',
+//             'InPlace' and 'Autotune' are ignored with 'Files'.
+//
+//     Schedule has the files given by 'Files' shared out between the GPU and the CPU threads,
+//             instead of all being filtered by the GPU, with the two working at the same time.
+//             Each file goes to whichever is expected to finish it first, judging by the time
+//             each has taken for the files so far, allowing for their sizes, so small images
+//             that aren't worth sending to the GPU stay on the CPU. Since each file is only
+//             filtered once, 'Cpu' is ignored. The time models arrived at are listed at the
+//             end. See JobScheduler.h.
+//
+//     Pipeline is the number of buffer sets the files given by 'Files' are rotated through,
+//             or zero (the default) to filter them one at a time. With three or more sets,
+//             the copy of one image to the GPU, the filtering of the one before and the copy
+//             back of the one before that all run at once, each set's stages ordered by
+//             semaphores, so the time per file approaches that of the slowest stage rather
+//             than the sum of all three. The copies use a separate transfer queue when the
+//             device has one that can share the buffers with the compute queue. Values of 1
+//             and 2 are taken as 3. 'Pipeline' is ignored with 'Schedule'.
+//
+//     Scales  is a list of up to four box sizes, eg Scales = "3,7,15", for which the image is
+//             to be filtered at the same time. The GPU uses a version of the shader
+//             (MedianScales.spv, built from Median.comp) in which each workgroup loads its tile
+//             of the image into shared memory once, and finds the median for each box size
+//             from it, writing all the results in one dispatch. The result for each size is
+//             written to its own copy of the input file, eg "Median7_name.fits", and with 'Cpu'
+//             the CPU filters the image with each size, for comparison. Npix is ignored, as
+//             are 'Half', 'InPlace' and 'Autotune'.
+//
+//     Chain   is a reduction to be applied to the image entirely on the GPU, as a list of steps
+//             applied in turn, for example Chain = "bias=100,background=31,scale=1.5". The
+//             steps can be 'bias=V', which subtracts the constant V, 'median=N', which median
+//             filters the image with an N by N box, 'background=N', which subtracts the result
+//             of such a filter from the image, 'smooth=N', which replaces each pixel by the mean
+//             of the N by N box around it, 'scale=F', which multiplies the image by F, and
+//             'offset=V', which adds V. The steps are run as one ImageGraph (see ImageGraph.h),
+//             in a single command buffer, with the intermediate images kept on the GPU, so only
+//             the final result is read back. It is written to a "Chain_" copy of the input file,
+//             and with 'Cpu' the CPU runs the same steps, for comparison. Npix is ignored, as
+//             are 'Half', 'InPlace', 'Autotune', 'Native' and 'Scales'.
+//
+//     Serve   has the program set up the GPU and then act as a server, filtering images sent to
+//             it over a socket by other runs of the program using 'Connect', until it is
+//             stopped. Setting up Vulkan and building the pipelines takes far longer than
+//             filtering a modest image, and the server does it just once, so each client only
+//             waits for the filter itself. The value is the address to listen on: a TCP port,
+//             eg Serve = 5050, which only accepts local connections, a host and port, eg
+//             Serve = "*:5050" for any interface, or, if it includes a '/', the path of a Unix
+//             domain socket, eg Serve = /tmp/median.sock. Npix gives the box size whose
+//             pipeline is built at the start - each client gives its own box size, and a
+//             pipeline is built for any other the first time it is asked for. 'Tiled' selects
+//             the shader used. The other options are ignored. See MedianServer.h.
+//
+//     Connect has the program send its image to a server started with 'Serve', at the address
+//             given, instead of using the GPU itself. The image is sent Nrpt times, and each
+//             round trip timed. The result is treated just as the GPU's would be - checked
+//             against the CPU's with 'Cpu', and written to the "Median_" file. 'Half',
+//             'InPlace', 'Autotune', 'Native' and 'WarmStart' are ignored with it.
+//
+//     Stream  has the GPU filter the FITS file given by 'File' a band of rows at a time, as it
+//             is read, writing each band to the "Median_" file as it is done. The reading and
+//             writing of the file overlap the filtering, and the memory needed depends on the
+//             size of the bands, not of the image, so this suits very large images. It only
+//             uses the GPU, since the CPU would need the whole image to check the results, and
+//             'Nrpt', 'Cpu', 'Half', 'InPlace', 'Autotune' and 'Scales' are ignored with it.
+//
+//     Tiles   has the GPU filter the FITS file given by 'File' in square tiles of the size
+//             given, eg Tiles = 4096, for an image too large for the GPU's memory, or even for
+//             main memory, such as a survey mosaic. Each tile is read with a halo of Npix/2
+//             pixels around it, so the result is the same as filtering the whole image. The
+//             tiles are shared between the GPUs, up to the number given by 'GPUs', each taking
+//             the next tile as it becomes free, and each GPU copies one tile in and the last
+//             one's results out while it filters another. The input and output files are
+//             memory mapped, so neither image is ever held in memory as a whole. The result
+//             goes to the "Median_" file, as usual. This needs an uncompressed, unscaled float
+//             image (BITPIX = -32). It only uses the GPU, and 'Nrpt', 'Cpu', 'Half', 'InPlace',
+//             'Autotune', 'Native', 'Stream' and 'Scales' are ignored with it. Default 0, for
+//             no tiling. See TiledImage.h.
+//
+//     GPUs    is the most GPUs to share the tiles between with 'Tiles'. Default 1.
+//
+//     Native  applies to a FITS file whose image is 16-bit integers (BITPIX = 16), usually
+//             with BSCALE and BZERO values. Normally cfitsio scales each pixel to a float as
+//             the file is read, on the CPU, and the GPU is given the floats. With 'Native',
+//             the integers are read just as they are in the file, the GPU is given those -
+//             half as many bytes - and the shader (MedianInt16.spv, or MedianTiledInt16.spv
+//             with 'Tiled') applies the scaling as it reads them. The results are the same as
+//             without it. It is ignored for other images, and with 'Half', 'InPlace', 'Files',
+//             'Stream' and 'Scales', and needs the GPU to support 16-bit storage.
+//
+//     Tolerance is the difference allowed between CPU and GPU results when both are computed,
+//             for example when the GPU code is being changed in a way that changes the rounding.
+//             It is zero by default, when the results have to be the same (apart from the
+//             allowances made for 'Half' and 'Histogram'). Either way, any differences are
+//             reported as the number of values that don't match, the largest difference, and
+//             the mean difference over the whole image.
+//
+//     Trace   is the name of a file to which a timeline of the run is written, in the Chrome
+//             trace format, so it can be viewed using chrome://tracing or Perfetto. It shows
+//             the reading and writing of the file, the setup, each pass and each submission to
+//             the GPU, the Vulkan Framework calls made, and the kernel times measured by the
+//             GPU. Default "", for no trace.
+//
+//     Pin     controls the CPUs the CPU threads run on, which can make CPU timings more
+//             repeatable. It can be "None", the default, which leaves it to the system,
+//             "PCores", which only uses the performance cores, "Physical", which uses one
+//             logical CPU of each physical core, or "Numa", which only uses the CPUs on the
+//             same NUMA node as the main thread. If Threads is zero, or more than the number
+//             of CPUs selected, one thread is used for each of them.
+//
+//     Priority raises the priority of the CPU threads. On Linux this needs permission to
+//             use real-time scheduling. The CPU topology and the placement used are listed
+//             if either 'Pin' or 'Priority' is given.
+//
+//     WarmStart has the Vulkan instance and GPU device created in a separate thread while the
+//             FITS file is read and the shader files are loaded, instead of one after the
+//             other, which can noticeably shorten a short run. It only affects the first
+//             image size, and is ignored with 'Half', 'InPlace', 'Files', 'Stream' and
+//             'Scales', and if the GPU isn't used.
+//
+//     Vary    runs the test for every combination of a set of values for Nx, Ny, Npix and
+//             Threads, all in the one run, eg Vary = "Nx=1024:8192:x2 Npix=3:11:2 Threads=1,4".
+//             Each parameter has a list of values, any of which can be a range Start:End:Step,
+//             where the Step is added, or as xN multiplies. The GPU device is set up once, as
+//             for 'WarmStart', and used for all of them, with the buffers released after each so
+//             their memory can be reused. 'Sizes' is ignored with 'Vary', as are Nx and Ny when
+//             filtering a file. It has the same restrictions as 'Sizes'. Default "".
+//
+//     GpuCheck has the GPU compare its result with the CPU's, when both are used, instead of
+//             having the CPU compare the two. The CPU then filters the image first, so its
+//             result is there for the GPU to compare with. The same differences are allowed as
+//             without it, and the number of values that don't match and the largest difference
+//             are reported, but not the mean difference. It is ignored with 'Half', 'InPlace'
+//             and 'Connect', and for the options that filter several images or bands.
+//
+//     Layout  has the image repacked into a different layout in memory before it is filtered,
+//             so the boxes can be filled from fewer cache lines - "Blocked", for 8 by 8 blocks,
+//             or "Morton", for 64 by 64 blocks with the pixels of each in Z-order. "Rows" keeps
+//             the usual row-major order, but goes through the same repacking and indexing code
+//             as the others, so is the baseline to measure them against. The GPU's shader reads
+//             the packed image through a matching index calculation. The CPU uses a simpler
+//             filter with it, finding the median of each box in turn without the SIMD or
+//             sliding window code, so its timings should only be compared with 'Layout=Rows'.
+//             The repacking is done once, before the timed passes. The results are the same.
+//             It is ignored with 'Half', 'InPlace', 'Native', 'Histogram' (and so by the CPU
+//             for boxes over 11 by 11) and the options that filter several images or bands.
+//             See ImageLayout.h. Default "", for no repacking.
+//
+//     Rank    turns the median filter into a more general rank filter, setting each pixel to a
+//             given percentile of the valid values in its box: "Min", the minimum (an erosion),
+//             "Max", the maximum (a dilation), or a percentile from 0 to 100, eg Rank = 10 or
+//             Rank = P90. "Median", or 50, is the usual median filter, as is the default, "".
+//             The minimum and maximum use the van Herk/Gil-Werman algorithm, whose cost per
+//             pixel doesn't depend on the box size, so the GPU can use any box size for them.
+//             Other percentiles select the value of the required rank from each box, on the GPU
+//             by the same bitwise search used for large median boxes, so are limited to boxes
+//             of up to 31 by 31 there. Unlike the median, a percentile is always one of the
+//             values in the box, never an average. The GPU uses RankFilter.spv and the CPU the
+//             code in RankFilter.h, and the two results are the same. The result is written to
+//             a copy of the input file named for the rank, eg "Min_name.fits" or "P10_name.fits".
+//             'Half', 'InPlace', 'Autotune', 'Native', 'Histogram', 'Simd', 'Tiled', 'Bitonic',
+//             'Layout', 'GpuCheck', 'Scales', 'Sizes' and 'Connect' are ignored with it, and it is
+//             ignored with 'Files', 'Tiles', 'Stream', 'Chain' and 'Serve', and for a cube.
+//
+//     Approx  has the image filtered with an approximation to the median, for a quick look,
+//             rather than the median itself: the median of the medians of each of the Npix rows
+//             of the box, which is done as a median filter of Npix values along the rows
+//             followed by one down the columns of the result. Its cost per pixel grows with
+//             Npix rather than with Npix squared, so for large boxes it is much faster, and the
+//             GPU can use any box size for it. The GPU uses SeparableMedian.spv and the CPU the
+//             code in SeparableMedian.h, and the two results are the same. The exact median is
+//             also found, once, by the CPU, and the approximation's differences from it are
+//             reported - how many values differ, the largest difference and the mean. (For
+//             boxes over 11 by 11 the exact median uses the histogram filter, so is only exact
+//             to within half its bin width.) The result is written to an "Approx_" copy of the
+//             input file. 'Half', 'InPlace', 'Autotune', 'Native', 'Histogram', 'Tiled',
+//             'Bitonic', 'Layout', 'GpuCheck', 'Scales', 'Sizes' and 'Connect' are ignored with
+//             it, and it is ignored with 'Rank', as well as with 'Files', 'Tiles', 'Stream',
+//             'Chain' and 'Serve', and for a cube.
+//
+//     Iterate is the most times the median filter is to be applied in turn, each pass filtering
+//             the result of the one before, as some cleaning steps do until the image stops
+//             changing. Each pass counts the pixels it changes, and once a pass changes no more
+//             than 'Converge' pixels, the rest are skipped. The GPU uses MedianIterate.spv,
+//             built from Median.comp, and records all the passes into one command buffer,
+//             going back and forth between two buffers on the GPU, so nothing comes back to the
+//             CPU until they are all done. With 'Cpu' the CPU runs the same passes, for
+//             comparison, but only for boxes up to 11 by 11, since the histogram filter's
+//             results would drift away from the GPU's over the passes. The number of pixels
+//             changed by each pass is listed. Each repeat starts again from the original image.
+//             'Half', 'InPlace', 'Autotune', 'Native', 'Histogram', 'Tiled', 'Bitonic',
+//             'Layout', 'GpuCheck', 'Scales', 'Sizes' and 'Connect' are ignored with it, and it
+//             is ignored with 'Rank' and 'Approx', as well as with 'Files', 'Tiles', 'Stream',
+//             'Chain' and 'Serve', and for a cube. Default 0, for a single pass as usual.
+//
+//     Converge is the number of changed pixels at or below which 'Iterate' stops. Default 0,
+//             so it stops once a pass changes nothing at all.
+//
+//     Compress has the output image written tile-compressed, as an extension following an
+//             empty primary image, using "Rice" or "GZIP" compression. Each row of the image is
+//             a tile, and the tiles are compressed in parallel by the CPU threads, then written
+//             out in order. Floating point values are quantised first, with dithering, to the
+//             level given by 'Quantize'. It is ignored with 'Tiles' and 'Stream', and for a
+//             cube. Default "", for an ordinary, uncompressed, image.
+//
+//     Quantize is the quantisation level for 'Compress': the values are quantised in steps of
+//             the noise level estimated for each tile divided by this. Larger values keep more
+//             precision, but compress less well. Zero keeps the values exactly, which only
+//             "GZIP" can do. Default 16.
+//
+//     HugePages backs the image arrays used by the CPU with huge pages - usually 2 MBytes
+//             rather than 4 KBytes - where the system will provide them, which cuts the TLB
+//             misses in a pass through a large image. An image read from a file, or made for
+//             both the GPU and CPU to use, is allocated this way too, and the GPU imports it
+//             as before. How much of each array actually ended up in huge pages is reported,
+//             since the system can decline. Default false.
+//
+//     Counters counts the cycles, instructions, last level cache misses and branch misses
+//             for the timed passes of the CPU median filter, leaving out the warm-up passes,
+//             using the Linux perf_event hardware counters. The instructions per cycle and the
+//             misses for each pixel are reported, and added to any 'Report' file, and show
+//             whether the filter is limited by memory, by branches or by its comparisons.
+//             Only available on Linux, where the kernel allows it. Default false.
+//
+//     Settle  is the longest time, in msec, for which the GPU median filter is run before
+//             the timed passes, until the times of the last few passes settle down - so the
+//             GPU has raised its clocks from idle and the driver has done any work it leaves
+//             until the first submissions. The number of passes this took, and how much the
+//             times spread, are reported, and they count as warm-up passes in any 'Report'
+//             file, which also gives the spread of the timed passes. Default 0, no settling.
+//
 //     Debug   is a string that can be used to control debug output. It must be specified
 //             explicitly by name, eg Debug = "timing". The '=' is optional, but the quotes
 //             are needed in some cases. 'Debug = timing,fits' is OK, but 'Debug = "*"' will
 //             need quotes. If you specify '?' for the value of Debug a list of the options
-//             will be provided.
+//             will be provided. 'Startup' lists how long each stage of the program's start-up
+//             took - reading the file, creating the Vulkan instance and device, reading the
+//             shader, creating buffers, descriptors and pipeline - and which overlapped.
+//             'Threads' logs the number of tiles each CPU thread filtered on each pass, and
+//             how long it took.
+//
+//     DebugLog has the debug output queued by each thread that logs it, and written out by
+//             a background thread, instead of being printed as it's logged, so threads that
+//             log at the same time - the CPU threads with 'Threads', say - don't wait for each
+//             other. Each message is written with the time it was logged, in msec, and the
+//             thread that logged it. It can be "stdout", or the name of a file to write the
+//             messages to. Default "", for the messages to be printed directly.
 //
 //     The command line is processed by the flexible but possibly quirky command line handler
 //     used for all these GPU examples. With luck you'll get used to it. It also supports the
@@ -94,6 +404,140 @@
 //      15th Oct 2024. Added SyncBuffer() calls so this works if buffers are staged. The setup
 //                     GPU code still makes them shared, but this makes the code work if the
 //                     setup code is modified experimentally to make them staged. KS.
+//      14th Oct 2026. The workgroup size is now passed to the shader as specialization
+//                     constants, and can be chosen by timing candidates with 'Autotune'. KS.
+//                     The GPU time spent in the shader itself is now measured using GPU
+//                     timestamps and reported along with the overall time. KS.
+//                     The image read from a FITS file is now held in memory allocated by the
+//                     Framework's AllocateImportableMemory() and used by the GPU directly as
+//                     an "IMPORTED" buffer, rather than being copied into a shared buffer. KS.
+//                     The output buffer is now a "READBACK" buffer, so it uses cached memory
+//                     where the device has it. KS.
+//                     The CPU code now uses a pool of threads created once, shared by all the
+//                     passes, instead of creating new threads for each pass. KS.
+//                     SetInputArray() and the result checks now run in the shared thread pool,
+//                     with loops that compile to vector code, and stop at the first bad row. KS.
+//                     Added 'InPlace', which filters the image in a single GPU buffer. KS.
+//                     Added 'Half', which holds the image on the GPU in half precision, using
+//                     Median16.spv, if the device supports 16-bit storage. KS.
+//                     Full 3x3, 5x5 and 7x7 boxes now use the branch-free selection networks
+//                     in MedianNetworks.h, on both the CPU and the GPU, where the shader has
+//                     them selected by specialization constant 2. KS.
+//                     Added 'Histogram', which has the CPU use the new HistogramMedian class,
+//                     and boxes of up to 255 by 255, which always use it. KS.
+//                     Added 'Tiled', which has the GPU fill the boxes from a tile of the image
+//                     loaded into shared memory, using MedianTiled.spv or MedianTiled16.spv. KS.
+//                     For box sizes without a selection network, the CPU now filters each row
+//                     by sliding a sorted window along it, rather than sorting each box. KS.
+//                     The shader's specialization constant 2 is now the box size for all
+//                     sizes, so full boxes of any size use fixed size code, and the CPU now
+//                     handles the full boxes in each row separately from those at the edges. KS.
+//                     The GPU can now handle boxes up to 31 by 31, using a bitwise search for the
+//                     median of boxes too large for its work array. KS.
+//                     Added 'Files', which filters a list of files using the one GPU setup.
+//                     The "Median_" copy of a file now goes in the same directory. KS.
+//                     Added 'Scales', which filters the image with several box sizes at once,
+//                     using MedianScales.spv. KS.
+//                     Blank pixels in a FITS file are now read as NaNs instead of zeros, and
+//                     both the CPU and GPU code leave them out of the boxes. KS.
+//                     Added 'Simd', which has the CPU run the selection networks on a block
+//                     of pixels at once, using AVX2 or AVX-512 where available. KS.
+//                     The output file is now created directly, with a copy of the input header,
+//                     instead of copying the whole input file and overwriting its image. KS.
+//                     Uncompressed float images are now read through a memory mapping of the
+//                     file, converting the data straight into the input array. KS.
+//                     Added 'Stream', which filters a file in bands as it is read, overlapping
+//                     the file I/O with the GPU computation. KS.
+//                     ReadFitsFile() can be given a Destination for the image, which 'Files'
+//                     uses to read each file straight into the GPU's input buffer. KS.
+//                     Added 'Native', which gives the GPU the raw integers of a BITPIX 16 image
+//                     and has the shader apply BSCALE and BZERO. KS.
+//                     'Files' now writes each result in the background, using a FitsWriter,
+//                     while the next file is filtered. KS.
+//                     ReadFitsFile() now finds the first image HDU, so handles tile-compressed
+//                     files, and decompresses bands of their tiles in parallel. KS.
+//                     NoteResults() now keeps the CPU result instead of copying it, checks
+//                     every value and reports the largest and mean differences. Added
+//                     'Tolerance'. KS.
+//                     A 3D image (a cube) is now filtered plane by plane, with the planes
+//                     passed through a ring of GPU buffers so the I/O overlaps the GPU. KS.
+//                     The CPU code now works through the image in cache-sized tiles, handed
+//                     out to the threads as they become free, indexing the image directly
+//                     instead of through the row addresses. KS.
+//      15th Oct 2026. The time for each pass of the GPU and CPU loops is now collected in an
+//                     MsecStats, and the distribution of the times reported. KS.
+//                     Added 'Warmup', 'Sizes' and 'Report', which use the new BenchReport to
+//                     run the tests over a list of sizes and append the timings, leaving out
+//                     the first passes, to a CSV or JSON file. KS.
+//                     The 'Timing' debug calls in the loops now test a bit looked up once. KS.
+//                     Added 'Trace', which writes a timeline of the run using the new
+//                     TraceRecorder. KS.
+//                     Added 'Pin' and 'Priority', which use the new ThreadPlacement to pin
+//                     the CPU threads to chosen CPUs and raise their priority. KS.
+//                     Added the 'Startup' debug level, which lists the start-up stages
+//                     recorded by the new StartupProfile, and 'WarmStart', which overlaps
+//                     the GPU device setup with reading the file. KS.
+//                     If the GPU buffers can't be created, the memory in use in each GPU heap
+//                     and the budget for it are now listed, as they are for 'Setup'. KS.
+//                     Added 'Chain', which runs a reduction made up of several steps on the
+//                     GPU as one ImageGraph, reading back only the final result. KS.
+//                     Added 'Serve' and 'Connect', which use the new MedianServer to keep the
+//                     GPU set up in a server that filters images sent to it over a socket. KS.
+//                     Added 'Schedule', which uses the new JobScheduler to share the files
+//                     given by 'Files' between the CPU and GPU, by their measured speeds. KS.
+//                     Added 'Tiles' and 'GPUs', which filter a memory mapped file in tiles,
+//                     shared between several GPUs, using the new TiledImage.h. KS.
+//                     The CPU's sliding median for 9x9 and 11x11 boxes now uses a version
+//                     instantiated for the box size, away from the top and bottom rows. KS.
+//                     ComputeUsingCPU() now filters an image already in memory where it is,
+//                     and if both the CPU and GPU are used, the test image is made once, in
+//                     importable memory, and shared by both. KS.
+//                     'Tiled' now uses MedianTiledSG.spv, which uses subgroup operations, if
+//                     the Framework reports that the device supports them. KS.
+//                     Image and buffer sizes are now VkDeviceSize, and pixel counts LONGLONG,
+//                     so they no longer overflow for images over 2 GBytes, and the GPU code
+//                     checks the image against the device's largest storage buffer, pointing
+//                     to 'Tiles' for images larger than that. KS.
+//                     Added 'GpuCheck', which has the GPU compare its result with the CPU's,
+//                     using the new MedianCheck.comp, reading back only a summary. KS.
+//                     Added 'Layout', which repacks the image into blocks or Z-order using the
+//                     new ImageLayout.h, for both the GPU and the CPU. KS.
+//                     Added 'Rank', which generalises the filter to the minimum, maximum or any
+//                     percentile, using the new RankFilter.h and RankFilter.comp. KS.
+//                     Added 'Bitonic', which has GPU subgroups sort 9x9 and 11x11 boxes using
+//                     MedianTiledBitonic.spv. KS.
+//                     Added 'Vary', which runs every combination of values for Nx, Ny, Npix
+//                     and Threads, using the one GPU device for all of them. KS.
+//                     Added 'Approx', a separable median of medians for a quick look, using
+//                     the new SeparableMedian.h and SeparableMedian.comp, with NoteResults()
+//                     reporting its differences from the exact median. KS.
+//                     Added 'Iterate' and 'Converge', which apply the filter repeatedly on the
+//                     GPU, with all the passes in one command buffer and the buffers swapped
+//                     between them, until few enough pixels change. KS.
+//                     Added 'Pipeline', which overlaps the upload, filtering and readback of
+//                     successive files given by 'Files', using rotating sets of staged
+//                     buffers. KS.
+//                     Added 'DebugLog', which has debug output written out by a background
+//                     thread, and the 'Threads' debug level, which logs the time each CPU
+//                     thread spent on each pass. KS.
+//                     The CPU code now divides the image into a band of rows of tiles for each
+//                     thread, using the new ForEachBand(). Each thread initialises the rows of
+//                     its band of the input and output arrays, so on a machine with more than
+//                     one NUMA node they are in memory local to it, and OnePassUsingCPU() has
+//                     each thread filter the tiles of its own band before helping with the
+//                     others, through the new ShareTilesUsingCPU(). KS.
+//                     Added 'Compress' and 'Quantize', which have WriteFitsFile() write the
+//                     output tile-compressed, the tiles compressed in parallel by the new
+//                     WriteCompressedFitsImage(). KS.
+//                     Added 'HugePages', which allocates the image arrays using the new
+//                     HugePages, through AllocateArray() and FreeArray(). KS.
+//                     With 'Layout', the packed input buffer is now put into device-local
+//                     memory the CPU can see, if there is any. KS.
+//                     Added 'Counters', which counts the CPU passes using PerfCounters. KS.
+//                     Added 'Settle', which runs the GPU median filter until its times settle
+//                     down, using the new MsecSettle, before the timed passes. KS.
+//                     'Stream' now keeps its window in device-local memory, uploading each
+//                     band's window through the Framework's upload ring. KS.
 
 //  ------------------------------------------------------------------------------------------------
 //
@@ -102,19 +546,88 @@
 //  Needed to allow multi-threading of the CPU code
 
 #include <thread>
+#include <atomic>
+
+//  And by FitsWriter, to write FITS files in the background.
+
+#include <mutex>
+#include <condition_variable>
 
 //  The file handling code uses C++17's std::filesystem
 
 #include <filesystem>
 
+//  ReadFitsFile() can be passed a std::function that supplies the memory for the image.
+
+#include <functional>
+
+//  And ComputeUsingGPU() takes over the Framework set up by StartWarmGPU() for 'WarmStart'.
+
+#include <memory>
+
 //  Some utility code. A Command Handler provides a flexible way of handling command line
 //  parameters, and simplifies the coding required for this. An MsecTimer provides a very simple
 //  way of timing blocks of code. A Debug Handler provides control over debug output, allowing
-//  various debug levels to be enabled from the command line.
+//  various debug levels to be enabled from the command line. HalfFloat.h has the conversions
+//  to and from half precision used for 'Half'. A BenchReport collects the timings to be written
+//  out for 'Report', and the TraceRecorder records the timeline written out for 'Trace'.
+//  A ThreadPlacement pins the CPU threads for 'Pin', the StartupProfile records the
+//  start-up stages listed for 'Startup', and HugePages allocates the arrays for 'HugePages'.
+//  PerfCounters counts the CPU hardware events for 'Counters'.
 
 #include "CommandHandler.h"
 #include "MsecTimer.h"
+#include "BenchReport.h"
+#include "TraceRecorder.h"
+#include "ThreadPool.h"
+#include "ThreadPlacement.h"
+#include "StartupProfile.h"
+#include "HugePages.h"
+#include "PerfCounters.h"
 #include "DebugHandler.h"
+#include "HalfFloat.h"
+
+//  WildcardMatch() is used to expand wildcards in the list of files given by 'Files'.
+
+#include "Wildcard.h"
+
+//  The histogram median filter used by the CPU for 'Histogram' and for large boxes.
+
+#include "HistogramMedian.h"
+
+//  The data read from a FITS file is held in memory allocated by the Vulkan Framework, so the
+//  GPU can access it without a copy.
+
+#include "KVVulkanFramework.h"
+
+//  An ImageGraph runs the steps of a reduction given by 'Chain' on the GPU, as one batch.
+
+#include "ImageGraph.h"
+
+//  A MedianServer filters images sent to it over a socket for 'Serve', and a MedianClient sends
+//  them for 'Connect'.
+
+#include "MedianServer.h"
+
+//  A JobScheduler shares out the files given by 'Files' between the CPU and GPU for 'Schedule'.
+
+#include "JobScheduler.h"
+
+//  TileGrid, TileQueue and MappedFile are used to filter an image in tiles for 'Tiles'.
+
+#include "TiledImage.h"
+
+//  An ImageLayout repacks the image into blocks, and indexes it, for 'Layout'.
+
+#include "ImageLayout.h"
+
+//  A RankFilter is the CPU's minimum, maximum or percentile filter, for 'Rank'.
+
+#include "RankFilter.h"
+
+//  A SeparableMedian is the CPU's approximate median filter, for 'Approx'.
+
+#include "SeparableMedian.h"
 
 //  FITS file access uses the cfitsio library.
 
@@ -124,17 +637,62 @@
 #include "fitsio.h"
 #else
 typedef void fitsfile;
+typedef long long LONGLONG;
 #define USING_CFITSIO false
 #endif
 
+//  On Unix-like systems, an uncompressed floating point image can be read by mapping the
+//  file into memory. See MapFitsImage().
+
+#if defined(USE_CFITSIO) && !defined(_WIN32)
+#define USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 //  Required on some systems for strncpy().
 
 #include <string.h>
 
+//  Needed for fabs(), used when checking half precision results.
+
+#include <math.h>
+
 //  This provides a global Debug Handler that all the routines here can use.
 
 DebugHandler TheDebugHandler;
 
+//  The bit for its 'Timing' level, set once the level names are known. The debug calls made on
+//  each pass of a timing loop test just this bit, rather than looking the level up by name.
+
+DebugHandler::LevelBits TimingDebug = 0;
+
+//  And the bit for its 'Threads' level, tested by each CPU thread on each pass.
+
+DebugHandler::LevelBits ThreadsDebug = 0;
+
+//  How WriteFitsFile() writes the output image, set from 'Compress' and 'Quantize' before any
+//  file is written: the cfitsio compression type, zero for an ordinary image, and the level
+//  floating point values are quantised to, zero for lossless compression.
+
+int FitsCompression = 0;
+float FitsQuantize = 0.0;
+
+//  Set by 'HugePages', to have AllocateArray() use huge pages for the image arrays.
+
+bool UseHugePages = false;
+
+//  Set by 'Counters', to have the CPU median filter passes counted with PerfCounters.
+
+bool UseCounters = false;
+
+//  Set by 'Settle', the most time the GPU median filter spends waiting for the times of its
+//  passes to settle before it starts timing them - zero if it doesn't.
+
+int SettleMsec = 0;
+
 //  ------------------------------------------------------------------------------------------------
 //
 //               F o r w a r d  D e f i n i t i o n s  &  S t r u c t u r e s
@@ -148,25 +706,148 @@ struct MedianDetails {
     float* GPUOutputData = nullptr;     //  Address of array used for GPU version of output data.
     float* CPUOutputData = nullptr;     //  Address of array used for CPU version of output data.
     std::string OutputFileName = "";    //  Name of the output FITS file.
+    bool GPUHalf = false;               //  True if the GPU held the image in half precision.
+    float HistogramTolerance = 0.0;     //  If the CPU used the histogram filter, its accuracy.
+    float CheckTolerance = 0.0;         //  Difference allowed between CPU and GPU results.
+    bool HasBlanks = false;             //  True if the image has blank (NaN) pixels.
+    bool OwnsInputData = true;          //  False if InputData belongs to the caller, eg a buffer.
+    short* RawData = nullptr;           //  With 'Native', a BITPIX 16 image as it is in the file.
+    float RawScale = 1.0;               //  The BSCALE value to apply to RawData.
+    float RawZero = 0.0;                //  The BZERO value to apply to RawData.
+    int RawBlank = 0;                   //  The BLANK value for RawData, if RawHasBlank is set.
+    bool RawHasBlank = false;           //  True if RawData has a BLANK value.
+    bool GPUCheck = false;              //  If the GPU is to check its result against the CPU's.
+    ImageLayout::Mode Layout = ImageLayout::None;   //  With 'Layout', the layout to repack into.
+    bool GPUBitonic = false;            //  With 'Bitonic', subgroups sort 9x9 and 11x11 boxes.
+    float* ExactData = nullptr;         //  With 'Approx', the exact median, to compare against.
 };
 
+//  The largest box that the GPU code and the CPU's MedianElement() can handle, set by the
+//  size of the work arrays they use (see NPIXSQ_MAX). Larger boxes need the histogram filter
+//  on the CPU, and a bitwise search on the GPU.
+
+static const int C_MaxWorkNpix = 11;
+
+//  The largest box the GPU is used for. Larger boxes use a bitwise search, which takes 33
+//  passes through the box to find each median, and beyond this it would take so long that
+//  the GPU driver might well decide the GPU had hung.
+
+static const int C_MaxGPUNpix = 31;
+
+//  The most box sizes that can be given with 'Scales', set by the size of the list of them
+//  passed to the GPU code.
+
+static const int C_MaxScales = 4;
+
 //  Read the data from the FITS file.
-bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details);
+bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details,
+                                             const std::string& Prefix = "Median_",
+                         const std::function<float*(int Nx,int Ny)>& Destination = nullptr,
+                                                                       bool Native = false);
 //  Perform the basic opetation using the GPU
-void ComputeUsingGPU(int Nx,int Ny,int Pix,int Nrpt,bool Validate,const std::string& DebugLevels,
-                                                                         MedianDetails* Details);
+void ComputeUsingGPU(int Nx,int Ny,int Pix,int Nrpt,bool Validate,bool Autotune,bool Tiled,
+                                      const std::string& DebugLevels,MedianDetails* Details,
+                                               int Warmup = 0,BenchReport* Bench = nullptr,
+                                  KVVulkanFramework* Prepared = nullptr,bool Keep = false);
+//  Start setting up the GPU for ComputeUsingGPU() in the background, for 'WarmStart'
+KVVulkanFramework* StartWarmGPU(bool Validate,bool Tiled,bool Native,
+                                                                const std::string& DebugLevels);
+//  List the GPU memory in use and the budget for it, if the buffers failed or for 'Setup'
+void ReportGPUMemory(KVVulkanFramework& Framework,bool BuffersOK);
+//  Perform the basic operation using the GPU, holding the image there in half precision
+bool ComputeUsingGPUHalf(int Nx,int Ny,int Pix,int Nrpt,bool Validate,bool Tiled,
+                                      const std::string& DebugLevels,MedianDetails* Details);
+//  Perform the basic operation using the GPU, filtering the image in place
+void ComputeUsingGPUInPlace(int Nx,int Ny,int Pix,int Nrpt,bool Validate,bool Tiled,
+                                      const std::string& DebugLevels,MedianDetails* Details);
+//  Filter each of a list of FITS files in turn, using the one GPU setup for all of them
+void ComputeBatchUsingGPU(const std::vector<std::string>& Files,int Npix,bool UseCPU,
+          int Threads,bool Histogram,bool Simd,float Tolerance,bool Validate,bool Tiled,
+                                                                 const std::string& DebugLevels);
+//  Filter a list of FITS files with their upload, filtering and readback overlapped
+void ComputeBatchPipelined(const std::vector<std::string>& Files,int Npix,int Sets,
+          bool UseCPU,int Threads,bool Histogram,bool Simd,float Tolerance,bool Validate,
+                                                   bool Tiled,const std::string& DebugLevels);
+//  Filter a FITS file a band at a time as it is read, using the GPU
+void ComputeStreamUsingGPU(const std::string& Filename,int Npix,bool Validate,bool Tiled,
+                                                                const std::string& DebugLevels);
+//  Filter each plane of a 3D FITS image, passing the planes through the GPU one after another
+void ComputeCubeUsingGPU(const std::string& Filename,int Npix,bool Validate,bool Tiled,
+                                                                const std::string& DebugLevels);
+//  Filter a FITS file too large for the GPU in tiles, shared between several GPUs
+void ComputeTiledUsingGPUs(const std::string& Filename,int Npix,int TileSize,int MaxGPUs,
+                                  bool Validate,bool Tiled,const std::string& DebugLevels);
+//  See if a FITS file's image is a 3D cube.
+bool IsFitsCube(const std::string& Filename);
+//  Perform the basic operation using the GPU, for several box sizes at once
+void ComputeScalesUsingGPU(int Nx,int Ny,const std::vector<int>& Scales,int Nrpt,bool Validate,
+                                        const std::string& DebugLevels,MedianDetails* Details);
+//  Parse the list of box sizes given by 'Scales'.
+bool ParseScales(const std::string& Text,std::vector<int>* Scales);
+//  Filter the image with the minimum, maximum or a percentile for 'Rank', using the GPU
+void ComputeRankUsingGPU(int Nx,int Ny,int Npix,int Percentile,int Nrpt,bool Validate,
+                                        const std::string& DebugLevels,MedianDetails* Details);
+//  Filter the image with the minimum, maximum or a percentile for 'Rank', using the CPU
+void ComputeRankUsingCPU(int Threads,int Nx,int Ny,int Npix,int Percentile,int Nrpt,
+                                                               int Warmup,MedianDetails* Details);
+//  Filter the image with the approximate separable median for 'Approx', using the GPU
+void ComputeApproxUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,
+                                        const std::string& DebugLevels,MedianDetails* Details);
+//  Filter the image with the approximate separable median for 'Approx', using the CPU
+void ComputeApproxUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,int Warmup,
+                                                                     MedianDetails* Details);
+//  Apply the filter repeatedly for 'Iterate', until it converges, using the GPU
+void ComputeIterateUsingGPU(int Nx,int Ny,int Npix,int Passes,int Threshold,int Nrpt,
+                         bool Validate,const std::string& DebugLevels,MedianDetails* Details);
+//  Apply the filter repeatedly for 'Iterate', until it converges, using the CPU
+void ComputeIterateUsingCPU(int Threads,int Nx,int Ny,int Npix,int Passes,int Threshold,
+                                  int Nrpt,bool Simd,int Warmup,MedianDetails* Details);
+//  One step of the reduction given by 'Chain' - its name, such as "median", and its value.
+struct ChainStep {
+    std::string Name;
+    double Value;
+};
+//  Parse the list of steps given by 'Chain'.
+bool ParseChain(const std::string& Text,std::vector<ChainStep>* Steps);
+//  Run the reduction given by 'Chain' as one ImageGraph, using the GPU, the CPU, or both
+void ComputeChain(int Nx,int Ny,const std::vector<ChainStep>& Steps,int Nrpt,bool UseGPU,
+                         bool UseCPU,int Threads,bool Validate,const std::string& DebugLevels,
+                                                                     MedianDetails* Details);
+//  Share a list of FITS files between the GPU and CPU, by their measured speeds
+void ComputeBatchScheduled(const std::vector<std::string>& Files,int Npix,int Threads,
+           bool Histogram,bool Simd,bool Validate,bool Tiled,const std::string& DebugLevels);
+//  Set up the GPU once and filter images sent over a socket, for 'Serve'
+void ServeUsingGPU(const std::string& Address,int Npix,bool Validate,bool Tiled,
+                                                                const std::string& DebugLevels);
+//  Have a server started with 'Serve' filter the image, for 'Connect'
+void ComputeUsingServer(const std::string& Address,int Nx,int Ny,int Npix,int Nrpt,
+                                                                    MedianDetails* Details);
+//  Expand the list of files given by 'Files', including any wildcards.
+std::vector<std::string> ExpandFileList(const std::string& Files);
 //  Perform the basic operation using the CPU
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Pix,int Nrpt,MedianDetails* Details);
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Pix,int Nrpt,bool InPlace,bool Histogram,
+                                                            bool Simd,MedianDetails* Details,
+                                               int Warmup = 0,BenchReport* Bench = nullptr);
 //  Set initial values for the input array.
-void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details);
+void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details,int Threads = 0);
+//  Call a function for the band of rows of the image each CPU thread works on.
+int ForEachBand(int Threads,int Ny,const std::function<void(int,int)>& Body);
 //  Check the results of the operation
-bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details);
+bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details,
+                                                                   float** Owner = nullptr);
 //  Utility to set up an array of row addresses to allow use of Array[Iy][Ix] syntax for access.
 float** CreateRowAddrs(float* Array,int Nx,int Ny);
-//  Write calculated output array to copy of input FITS file.
+//  Allocate the data for an image array, in huge pages with 'HugePages', and release it
+void* AllocateArray(size_t Bytes,bool Importable = false);
+void FreeArray(void* Address,bool Importable = false);
+//  Write calculated output array to the output FITS file.
 bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details);
+//  Get the cfitsio compression type for the value of 'Compress'.
+bool ParseCompression(const std::string& Name,int* Type);
 //  Shutdown program and release resources.
 void Shutdown(MedianDetails* Details);
+//  Mark the end of start-up, and list its stages if 'Startup' debugging is enabled
+void EndOfStartup(void);
 
 //  ------------------------------------------------------------------------------------------------
 //
@@ -203,15 +884,55 @@ public:
     std::string HelpText(void);
 };
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                                F i t s  W r i t e r
+//
+//  Writing out a result can take as long as filtering it, so when filtering a list of files the
+//  writing is done by a FitsWriter, which has its own thread for the purpose. Submit() hands it
+//  the MedianDetails for a file whose results have been noted, and it then owns them: the thread
+//  calls WriteFitsFile() and Shutdown() for them, while the caller gets on with the next file.
+//  It only holds one file's results at a time, so Submit() waits until any earlier one has been
+//  written. (That keeps the memory needed to two sets of results - the one being written, and
+//  the next one.) Finish() waits for the last write. The implementation is at the end of this
+//  file.
+
+class FitsWriter {
+public:
+    FitsWriter(void);
+    ~FitsWriter();
+    //  Takes over Details, leaving *Details as a new, empty, MedianDetails.
+    void Submit(int Nx,int Ny,MedianDetails* Details);
+    //  Waits for any write still going on, and stops the thread.
+    void Finish(void);
+private:
+    void Run(void);
+    std::mutex I_Mutex;
+    std::condition_variable I_Cond;
+    MedianDetails I_Details;
+    int I_Nx = 0;
+    int I_Ny = 0;
+    bool I_Pending = false;
+    bool I_Stop = false;
+    bool I_Background = false;
+    std::thread I_Thread;
+};
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    M a i n
 
 int main (int Argc, char* Argv[]) {
 
+    //  Start-up stages are timed from here.
+    
+    StartupProfile::Global().Start();
+    
     //  Set up the various levels for the Debug handler
     
-    TheDebugHandler.LevelsList("Timing,Setup,Checks,Fits");
+    TheDebugHandler.LevelsList("Timing,Setup,Checks,Fits,Startup,Threads");
+    TimingDebug = TheDebugHandler.Level("Timing");
+    ThreadsDebug = TheDebugHandler.Level("Threads");
 
     //  Get the values of the command line arguments. This uses a Command Handler class that
     //  provides a flexible way of dealing with a number of different arguments, for example
@@ -227,7 +948,7 @@ int main (int Argc, char* Argv[]) {
     CmdHandler TheHandler("Median");
     FileArg FilenameArg(TheHandler,"File",Posn++,"MustExist,NullOk","",
                                                             "FITS file containing image");
-    OddIntArg NpixArg(TheHandler,"Npix",Posn++,"",5,1,11,
+    OddIntArg NpixArg(TheHandler,"Npix",Posn++,"",5,1,HistogramMedian::C_MaxNpix,
                                "Size of median box in pixels - should be an odd number");
     IntArg NrptArg(TheHandler,"Nrpt",Posn++,"",1,0,5000,"Repeat count for operation");
     int DefaultThreads = 1;
@@ -240,7 +961,47 @@ int main (int Argc, char* Argv[]) {
     BoolArg CpuArg(TheHandler,"Cpu",0,"",false,"Perform computation using CPU");
     BoolArg GpuArg(TheHandler,"Gpu",0,"",false,"Perform computation using GPU");
     BoolArg ValidateArg(TheHandler,"Validate",0,"",false,"Enable Vulkan validation layers");
+    BoolArg AutotuneArg(TheHandler,"Autotune",0,"",false,"Time GPU workgroup shapes, use fastest");
+    BoolArg InPlaceArg(TheHandler,"InPlace",0,"",false,"Filter the image in place on the GPU");
+    BoolArg HalfArg(TheHandler,"Half",0,"",false,"Hold the image on the GPU in half precision");
+    BoolArg HistogramArg(TheHandler,"Histogram",0,"",false,"Use the histogram filter on the CPU");
+    BoolArg SimdArg(TheHandler,"Simd",0,"",false,"Run CPU networks on blocks of pixels");
+    BoolArg TiledArg(TheHandler,"Tiled",0,"",false,"Fill GPU boxes from shared memory tiles");
+    BoolArg StreamArg(TheHandler,"Stream",0,"",false,"Filter the file in bands as it is read");
+    IntArg TilesArg(TheHandler,"Tiles",0,"",0,0,65536,"Tile size to filter the file in, or 0");
+    IntArg GPUsArg(TheHandler,"GPUs",0,"",1,1,64,"Most GPUs to share the tiles between");
+    BoolArg NativeArg(TheHandler,"Native",0,"",false,"Give the GPU 16-bit images unscaled");
+    RealArg ToleranceArg(TheHandler,"Tolerance",0,"",0.0,0.0,1.0e30,
+                                          "Difference allowed between CPU and GPU results");
+    StringArg FilesArg(TheHandler,"Files",0,"NoSave","","FITS files to filter, may use '*'");
+    BoolArg ScheduleArg(TheHandler,"Schedule",0,"",false,"Share 'Files' between CPU and GPU");
+    IntArg PipelineArg(TheHandler,"Pipeline",0,"",0,0,8,"Buffer sets to overlap 'Files' with");
+    StringArg ScalesArg(TheHandler,"Scales",0,"NoSave","","Box sizes to filter with at once");
+    StringArg ChainArg(TheHandler,"Chain",0,"NoSave","","Reduction steps to run on the GPU");
+    StringArg ServeArg(TheHandler,"Serve",0,"NoSave","","Serve jobs on a port or socket path");
+    StringArg ConnectArg(TheHandler,"Connect",0,"NoSave","","Send the image to a 'Serve' server");
+    IntArg WarmupArg(TheHandler,"Warmup",0,"",0,0,5000,"Passes left out of the timings");
+    StringArg SizesArg(TheHandler,"Sizes",0,"","","Sizes to run in turn, eg 512,1024x512");
+    StringArg VaryArg(TheHandler,"Vary",0,"","","Values to run in turn, eg Npix=3:11:2");
+    StringArg ReportArg(TheHandler,"Report",0,"","","File for timings (.csv or .json)");
+    StringArg TraceArg(TheHandler,"Trace",0,"","","File for a timeline trace (.json)");
+    StringArg PinArg(TheHandler,"Pin",0,"","","Pin CPU threads (None,PCores,Physical,Numa)");
+    BoolArg PriorityArg(TheHandler,"Priority",0,"",false,"Raise the CPU threads' priority");
+    BoolArg WarmStartArg(TheHandler,"WarmStart",0,"",false,"Set up the GPU while reading the file");
+    BoolArg GpuCheckArg(TheHandler,"GpuCheck",0,"",false,"Compare CPU and GPU results on the GPU");
+    StringArg LayoutArg(TheHandler,"Layout",0,"","","Repack the image (Rows,Blocked,Morton)");
+    StringArg RankArg(TheHandler,"Rank",0,"","","Rank filter (Median, Min, Max or a percentile)");
+    BoolArg BitonicArg(TheHandler,"Bitonic",0,"",false,"Sort 9x9, 11x11 GPU boxes in subgroups");
+    BoolArg ApproxArg(TheHandler,"Approx",0,"",false,"Approximate median, for a quick look");
+    IntArg IterateArg(TheHandler,"Iterate",0,"",0,0,10000,"Most passes to iterate the filter");
+    IntArg ConvergeArg(TheHandler,"Converge",0,"",0,0,1 << 30,"Changes at which 'Iterate' stops");
+    StringArg CompressArg(TheHandler,"Compress",0,"","","Compress the output (Rice or GZIP)");
+    RealArg QuantizeArg(TheHandler,"Quantize",0,"",16.0,0.0,1.0e6,"Quantisation for 'Compress'");
+    BoolArg HugePagesArg(TheHandler,"HugePages",0,"",false,"Use huge pages for the image arrays");
+    BoolArg CountersArg(TheHandler,"Counters",0,"",false,"Count CPU cycles, instructions, misses");
+    IntArg SettleArg(TheHandler,"Settle",0,"",0,0,600000,"Most msec to let GPU times settle");
     StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
+    StringArg DebugLogArg(TheHandler,"DebugLog",0,"","","Write debug output in the background");
     DebugArgHelper DebugHelper;
     DebugArg.SetHelper(&DebugHelper);
 
@@ -263,7 +1024,70 @@ int main (int Argc, char* Argv[]) {
     bool UseCPU = CpuArg.GetValue(&Ok,&Error);
     bool UseGPU = GpuArg.GetValue(&Ok,&Error);
     bool Validate = ValidateArg.GetValue(&Ok,&Error);
+    bool Autotune = AutotuneArg.GetValue(&Ok,&Error);
+    bool InPlace = InPlaceArg.GetValue(&Ok,&Error);
+    bool Half = HalfArg.GetValue(&Ok,&Error);
+    bool Histogram = HistogramArg.GetValue(&Ok,&Error);
+    bool Simd = SimdArg.GetValue(&Ok,&Error);
+    bool Tiled = TiledArg.GetValue(&Ok,&Error);
+    bool Stream = StreamArg.GetValue(&Ok,&Error);
+    int Tiles = TilesArg.GetValue(&Ok,&Error);
+    int GPUs = GPUsArg.GetValue(&Ok,&Error);
+    bool Native = NativeArg.GetValue(&Ok,&Error);
+    float Tolerance = float(ToleranceArg.GetValue(&Ok,&Error));
     std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
+    std::string DebugLog = DebugLogArg.GetValue(&Ok,&Error);
+    std::string Files = FilesArg.GetValue(&Ok,&Error);
+    bool Schedule = ScheduleArg.GetValue(&Ok,&Error);
+    int Pipeline = PipelineArg.GetValue(&Ok,&Error);
+    std::string Scales = ScalesArg.GetValue(&Ok,&Error);
+    std::string Chain = ChainArg.GetValue(&Ok,&Error);
+    std::string Serve = ServeArg.GetValue(&Ok,&Error);
+    std::string Connect = ConnectArg.GetValue(&Ok,&Error);
+    int Warmup = WarmupArg.GetValue(&Ok,&Error);
+    std::string Sizes = SizesArg.GetValue(&Ok,&Error);
+    std::string Vary = VaryArg.GetValue(&Ok,&Error);
+    std::string Report = ReportArg.GetValue(&Ok,&Error);
+    std::string Trace = TraceArg.GetValue(&Ok,&Error);
+    std::string Pin = PinArg.GetValue(&Ok,&Error);
+    bool Priority = PriorityArg.GetValue(&Ok,&Error);
+    bool WarmStart = WarmStartArg.GetValue(&Ok,&Error);
+    bool GpuCheck = GpuCheckArg.GetValue(&Ok,&Error);
+    std::string LayoutName = LayoutArg.GetValue(&Ok,&Error);
+    std::string Rank = RankArg.GetValue(&Ok,&Error);
+    bool Bitonic = BitonicArg.GetValue(&Ok,&Error);
+    bool Approx = ApproxArg.GetValue(&Ok,&Error);
+    int Iterate = IterateArg.GetValue(&Ok,&Error);
+    int Converge = ConvergeArg.GetValue(&Ok,&Error);
+    std::string Compress = CompressArg.GetValue(&Ok,&Error);
+    float Quantize = float(QuantizeArg.GetValue(&Ok,&Error));
+    UseHugePages = HugePagesArg.GetValue(&Ok,&Error);
+    UseCounters = CountersArg.GetValue(&Ok,&Error);
+    SettleMsec = SettleArg.GetValue(&Ok,&Error);
+    
+    //  If 'Layout' was given, it has to be one of the layouts ImageLayout knows about.
+    
+    ImageLayout::Mode Layout = ImageLayout::None;
+    bool LayoutOK = ImageLayout::Parse(LayoutName,&Layout);
+    
+    //  If 'Rank' was given, it has to be a percentile RankFilter understands.
+    
+    int Percentile = RankFilter::C_Median;
+    bool RankOK = RankFilter::Parse(Rank,&Percentile);
+    
+    //  If 'Pin' was given, it has to be one of the placements ThreadPlacement knows about.
+    
+    ThreadPlacement Placement;
+    bool PinOK = Placement.SetMode(Pin);
+    
+    //  If 'Compress' was given, it has to be a compression type WriteFitsFile() can use.
+    //  Floating point values can only be compressed without quantising them using GZIP.
+    
+    bool CompressOK = ParseCompression(Compress,&FitsCompression);
+    FitsQuantize = Quantize;
+    int GzipType = 0;
+    ParseCompression("GZIP",&GzipType);
+    bool QuantizeOK = (FitsCompression == 0 || Quantize > 0.0 || FitsCompression == GzipType);
     
     //  Check the argument parsing went OK, and didn't end with an exit being requested.
     
@@ -271,6 +1095,16 @@ int main (int Argc, char* Argv[]) {
         if (!TheHandler.ExitRequested()) {
             printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
         }
+    } else if (!PinOK) {
+        printf ("Error in 'Pin': '%s' should be None, PCores, Physical or Numa\n",Pin.c_str());
+    } else if (!LayoutOK) {
+        printf ("Error in 'Layout': '%s' should be Rows, Blocked or Morton\n",LayoutName.c_str());
+    } else if (!RankOK) {
+        printf ("Error in 'Rank': '%s' should be Median, Min, Max or 0 to 100\n",Rank.c_str());
+    } else if (!CompressOK) {
+        printf ("Error in 'Compress': '%s' should be None, Rice or GZIP\n",Compress.c_str());
+    } else if (!QuantizeOK) {
+        printf ("Error in 'Quantize': only GZIP can compress the output without quantising\n");
     } else {
         if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
         
@@ -278,35 +1112,587 @@ int main (int Argc, char* Argv[]) {
 
         TheDebugHandler.SetLevels(DebugLevels);
         
-        //  If a file name was specified, make a copy of the file (which will become the output
-        //  file), get the image dimensions, and read in the main data array.
-
-        MedianDetails Details;
-        if (Filename != "") {
-            ReadFitsFile(Filename,&Nx,&Ny,&Details);
+        //  With 'DebugLog', the debug output is written out by a background thread.
+        
+        if (DebugLog != "" && !DebugLogSink::Global().Start(DebugLog)) {
+            printf ("Unable to create '%s' for 'DebugLog', debug output will be printed.\n",
+                                                                              DebugLog.c_str());
+        }
+        
+        //  With 'Startup', record the start-up stages, the first being the command line.
+        
+        if (TheDebugHandler.Active("Startup")) {
+            StartupProfile::Global().Enable(true);
+            StartupProfile::Global().Record("Command line",0.0,StartupProfile::Global().NowMsec());
+        }
+        
+        //  If a trace is wanted, start recording the timeline. It's written out however the
+        //  program finishes.
+        
+        if (Trace != "") {
+            TraceRecorder::Global().Enable(true);
+            TraceRecorder::Global().SetThreadName("Main");
+            TraceRecorder::Global().WriteOnExit(Trace);
+        }
+        
+        //  'Pin' and 'Priority' set up the threads of the shared pool used by the CPU code,
+        //  which include this main thread. The topology is listed so the CPU timings can
+        //  be related to the machine they were taken on.
+        
+        if (Pin != "" || Priority) {
+            printf ("\nCPU topology: %s\n",Placement.Topology().c_str());
+            std::string PlacementError;
+            if (!Placement.Apply(ThreadPool::Shared(),Priority,&PlacementError)) {
+                printf ("Warning: %s.\n",PlacementError.c_str());
+            }
+            printf ("CPU threads: %s%s\n",Placement.Description().c_str(),
+                                                   Priority ? ", raised priority" : "");
+            if (Placement.Threads() > 0 && (Threads <= 0 || Threads > Placement.Threads())) {
+                Threads = Placement.Threads();
+            }
+        }
+        
+        //  With 'Serve', the program sets up the GPU and then filters images sent to it by
+        //  clients until it is stopped, and that's all it does.
+        
+        if (Serve != "") {
+            if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used with 'Serve', as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nStarting GPU server. Initial median box is %d by %d.\n\n",
+                                                                                 Npix,Npix);
+                ServeUsingGPU(Serve,Npix,Validate,Tiled,DebugLevels);
+            }
+            return 0;
+        }
+        
+        //  If a list of files was given, they are all filtered by the GPU, one after the other,
+        //  keeping the same GPU setup for all of them, and that's all the program does. 'File'
+        //  and the options that have their own GPU code are ignored.
+        
+        if (Files != "") {
+            std::vector<std::string> FileList = ExpandFileList(Files);
+            if (!USING_CFITSIO) {
+                printf ("Cannot filter files, program was built without Cfitsio support\n");
+            } else if (FileList.empty()) {
+                printf ("No files to filter.\n");
+            } else if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used with 'Files', as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nFiltering %d files using the GPU. Median box is %d by %d.\n\n",
+                                                           int(FileList.size()),Npix,Npix);
+                if (Half || InPlace || Autotune || Native) {
+                    printf ("'Half', 'InPlace', 'Autotune' and 'Native' are ignored with "
+                                                                         "'Files'.\n\n");
+                }
+                if (Npix > C_MaxWorkNpix) Histogram = true;
+                if (Schedule) {
+                    if (UseCPU) printf ("'Cpu' is ignored with 'Schedule'.\n\n");
+                    if (Pipeline > 0) printf ("'Pipeline' is ignored with 'Schedule'.\n\n");
+                    ComputeBatchScheduled(FileList,Npix,Threads,Histogram,Simd,Validate,Tiled,
+                                                                               DebugLevels);
+                } else if (Pipeline > 0) {
+                    if (Pipeline < 3) Pipeline = 3;
+                    ComputeBatchPipelined(FileList,Npix,Pipeline,UseCPU,Threads,Histogram,Simd,
+                                                   Tolerance,Validate,Tiled,DebugLevels);
+                } else {
+                    ComputeBatchUsingGPU(FileList,Npix,UseCPU,Threads,Histogram,Simd,Tolerance,
+                                                                 Validate,Tiled,DebugLevels);
+                }
+            }
+            return 0;
+        }
+        
+        //  With 'Tiles', the file is filtered a tile at a time, by as many GPUs as 'GPUs'
+        //  allows, through memory mappings of the input and output files.
+        
+        if (Tiles > 0) {
+            if (!USING_CFITSIO) {
+                printf ("Cannot filter in tiles, program was built without Cfitsio support\n");
+            } else if (Filename == "") {
+                printf ("'Tiles' needs a FITS file, given by 'File'.\n");
+            } else if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used with 'Tiles', as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nFiltering %s in tiles of %d by %d using up to %d GPU%s. "
+                                "Median box is %d by %d.\n\n",Filename.c_str(),Tiles,Tiles,
+                                                       GPUs,GPUs == 1 ? "" : "s",Npix,Npix);
+                if (UseCPU || Half || InPlace || Autotune || Native || Stream || Nrpt != 1 ||
+                                                         Scales != "" || FitsCompression) {
+                    printf ("'Cpu', 'Nrpt', 'Half', 'InPlace', 'Autotune', 'Native', 'Stream', "
+                                     "'Scales' and 'Compress' are ignored with 'Tiles'.\n\n");
+                }
+                ComputeTiledUsingGPUs(Filename,Npix,Tiles,GPUs,Validate,Tiled,DebugLevels);
+            }
+            return 0;
+        }
+        
+        //  With 'Stream', the GPU filters the file a band at a time, overlapping the reading and
+        //  writing of the file with the computation, and never holding the whole image.
+        
+        if (Stream) {
+            if (!USING_CFITSIO) {
+                printf ("Cannot stream a file, program was built without Cfitsio support\n");
+            } else if (Filename == "") {
+                printf ("'Stream' needs a FITS file, given by 'File'.\n");
+            } else if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used with 'Stream', as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nStreaming %s through the GPU. Median box is %d by %d.\n\n",
+                                                                Filename.c_str(),Npix,Npix);
+                if (UseCPU || Half || InPlace || Autotune || Native || Nrpt != 1 ||
+                                                         Scales != "" || FitsCompression) {
+                    printf ("'Cpu', 'Nrpt', 'Half', 'InPlace', 'Autotune', 'Native', 'Scales' "
+                                                  "and 'Compress' are ignored with 'Stream'.\n\n");
+                }
+                ComputeStreamUsingGPU(Filename,Npix,Validate,Tiled,DebugLevels);
+            }
+            return 0;
+        }
+        
+        //  A 3D image - a cube - is filtered plane by plane, by the GPU, and that's all the
+        //  program does with it.
+        
+        if (Filename != "" && USING_CFITSIO && IsFitsCube(Filename)) {
+            if (Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be used for a cube, as they are "
+                               "too large for the GPU.\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            } else {
+                printf ("\nFiltering each plane of cube %s using the GPU. Median box is %d by %d."
+                                                        "\n\n",Filename.c_str(),Npix,Npix);
+                if (UseCPU || Half || InPlace || Autotune || Native || Nrpt != 1 ||
+                                                         Scales != "" || FitsCompression) {
+                    printf ("'Cpu', 'Nrpt', 'Half', 'InPlace', 'Autotune', 'Native', 'Scales' "
+                                                     "and 'Compress' are ignored for a cube.\n\n");
+                }
+                ComputeCubeUsingGPU(Filename,Npix,Validate,Tiled,DebugLevels);
+            }
+            return 0;
+        }
+        
+        //  If a reduction chain was given, the GPU runs all its steps as one ImageGraph, and
+        //  only the final result is read back, and written to a "Chain_" copy of the file.
+        
+        if (Chain != "") {
+            std::vector<ChainStep> Steps;
+            if (ParseChain(Chain,&Steps)) {
+                MedianDetails Details;
+                Details.CheckTolerance = Tolerance;
+                if (Filename != "") ReadFitsFile(Filename,&Nx,&Ny,&Details,"Chain_");
+                printf ("\nPerforming reduction chain, arrays of %d rows, %d columns. "
+                                                   "Repeat count %d.\n",Ny,Nx,Nrpt);
+                printf ("Steps are %s.\n\n",Chain.c_str());
+                if (Half || InPlace || Autotune || Native || Scales != "") {
+                    printf ("'Half', 'InPlace', 'Autotune', 'Native' and 'Scales' are ignored "
+                                                                     "with 'Chain'.\n\n");
+                }
+                if (!UseGPU && !UseCPU) UseGPU = true;
+                ComputeChain(Nx,Ny,Steps,Nrpt,UseGPU,UseCPU,Threads,Validate,DebugLevels,
+                                                                                   &Details);
+                if (Filename != "") WriteFitsFile(Nx,Ny,&Details);
+                Shutdown(&Details);
+            }
+            return 0;
+        }
+        
+        //  If a rank other than the median was given, the image is filtered with the minimum,
+        //  maximum or percentile by the RankFilter code, and written to a copy of the file
+        //  named for the rank, eg "Min_name.fits". The median carries on as usual.
+        
+        if (Percentile != RankFilter::C_Median) {
+            MedianDetails Details;
+            Details.CheckTolerance = Tolerance;
+            std::string Name = RankFilter::Name(Percentile);
+            if (Filename != "") ReadFitsFile(Filename,&Nx,&Ny,&Details,Name + "_");
+            printf ("\nPerforming '%s' rank filter test, arrays of %d rows, %d columns. "
+                                           "Repeat count %d.\n",Name.c_str(),Ny,Nx,Nrpt);
+            printf ("Box is %d by %d.\n\n",Npix,Npix);
+            if (Half || InPlace || Autotune || Native || Histogram || Simd || Tiled ||
+                 Bitonic || Layout != ImageLayout::None || GpuCheck || Scales != "" ||
+                                                               Sizes != "" || Connect != "") {
+                printf ("'Half', 'InPlace', 'Autotune', 'Native', 'Histogram', 'Simd', 'Tiled', "
+                           "'Bitonic', 'Layout', 'GpuCheck', 'Scales', 'Sizes' and 'Connect' "
+                                                                 "are ignored with 'Rank'.\n\n");
+            }
+            if (!UseGPU && !UseCPU) UseGPU = true;
+            if (UseGPU && !RankFilter::IsMinMax(Percentile) && Npix > C_MaxGPUNpix) {
+                printf ("The GPU can only find percentiles for boxes up to %d by %d.\n\n",
+                                                                   C_MaxGPUNpix,C_MaxGPUNpix);
+                UseGPU = false;
+            }
+            if (UseGPU) ComputeRankUsingGPU(Nx,Ny,Npix,Percentile,Nrpt,Validate,DebugLevels,
+                                                                                   &Details);
+            if (UseCPU) ComputeRankUsingCPU(Threads,Nx,Ny,Npix,Percentile,Nrpt,Warmup,&Details);
+            if (Filename != "") WriteFitsFile(Nx,Ny,&Details);
+            Shutdown(&Details);
+            return 0;
+        }
+        
+        //  With 'Approx', the image is filtered with the separable median of medians, and
+        //  written to an "Approx_" copy of the file. The exact median is found first, once, by
+        //  the CPU, and kept in Details->ExactData so NoteResults() can report how far the
+        //  approximation is from it.
+        
+        if (Approx) {
+            MedianDetails Details;
+            Details.CheckTolerance = Tolerance;
+            if (Filename != "") ReadFitsFile(Filename,&Nx,&Ny,&Details,"Approx_");
+            printf ("\nPerforming approximate 'Median' test, arrays of %d rows, %d columns. "
+                                                   "Repeat count %d.\n",Ny,Nx,Nrpt);
+            printf ("Box is %d by %d, median of %d row medians.\n\n",Npix,Npix,Npix);
+            if (Half || InPlace || Autotune || Native || Histogram || Tiled || Bitonic ||
+                          Layout != ImageLayout::None || GpuCheck || Scales != "" ||
+                                                               Sizes != "" || Connect != "") {
+                printf ("'Half', 'InPlace', 'Autotune', 'Native', 'Histogram', 'Tiled', "
+                           "'Bitonic', 'Layout', 'GpuCheck', 'Scales', 'Sizes' and 'Connect' "
+                                                              "are ignored with 'Approx'.\n\n");
+            }
+            if (!UseGPU && !UseCPU) UseGPU = true;
+            if (Nrpt > 0) {
+                MedianDetails ExactDetails;
+                ExactDetails.InputData = Details.InputData;
+                ExactDetails.OwnsInputData = false;
+                ExactDetails.HasBlanks = Details.HasBlanks;
+                printf ("Exact median, for comparison:\n");
+                ComputeUsingCPU(Threads,Nx,Ny,Npix,1,false,Npix > C_MaxWorkNpix,Simd,
+                                                                              &ExactDetails);
+                Details.ExactData = ExactDetails.CPUOutputData;
+                ExactDetails.CPUOutputData = nullptr;
+                Shutdown(&ExactDetails);
+            }
+            if (UseGPU) ComputeApproxUsingGPU(Nx,Ny,Npix,Nrpt,Validate,DebugLevels,&Details);
+            if (UseCPU) ComputeApproxUsingCPU(Threads,Nx,Ny,Npix,Nrpt,Warmup,&Details);
+            if (Filename != "") WriteFitsFile(Nx,Ny,&Details);
+            Shutdown(&Details);
+            return 0;
+        }
+        
+        //  With 'Iterate', the filter is applied repeatedly until it converges, by the GPU with
+        //  all the passes in one command buffer, and the final result written to the file.
+        
+        if (Iterate > 0) {
+            MedianDetails Details;
+            Details.CheckTolerance = Tolerance;
+            if (Filename != "") ReadFitsFile(Filename,&Nx,&Ny,&Details);
+            printf ("\nPerforming iterated 'Median' test, arrays of %d rows, %d columns. "
+                                                   "Repeat count %d.\n",Ny,Nx,Nrpt);
+            printf ("Box is %d by %d, up to %d passes, stopping at %d changes.\n\n",
+                                                               Npix,Npix,Iterate,Converge);
+            if (Half || InPlace || Autotune || Native || Histogram || Tiled || Bitonic ||
+                          Layout != ImageLayout::None || GpuCheck || Scales != "" ||
+                                                               Sizes != "" || Connect != "") {
+                printf ("'Half', 'InPlace', 'Autotune', 'Native', 'Histogram', 'Tiled', "
+                           "'Bitonic', 'Layout', 'GpuCheck', 'Scales', 'Sizes' and 'Connect' "
+                                                             "are ignored with 'Iterate'.\n\n");
+            }
+            if (!UseGPU && !UseCPU) UseGPU = true;
+            if (UseGPU && Npix > C_MaxGPUNpix) {
+                printf ("Boxes larger than %d by %d can't be iterated on the GPU.\n\n",
+                                                                   C_MaxGPUNpix,C_MaxGPUNpix);
+                UseGPU = false;
+            }
+            if (UseCPU && Npix > C_MaxWorkNpix) {
+                printf ("Boxes larger than %d by %d can't be iterated on the CPU.\n\n",
+                                                                 C_MaxWorkNpix,C_MaxWorkNpix);
+                UseCPU = false;
+            }
+            if (UseGPU) ComputeIterateUsingGPU(Nx,Ny,Npix,Iterate,Converge,Nrpt,Validate,
+                                                                      DebugLevels,&Details);
+            if (UseCPU) ComputeIterateUsingCPU(Threads,Nx,Ny,Npix,Iterate,Converge,Nrpt,Simd,
+                                                                           Warmup,&Details);
+            if (Filename != "") WriteFitsFile(Nx,Ny,&Details);
+            Shutdown(&Details);
+            return 0;
+        }
+        
+        //  If a list of box sizes was given, the GPU filters the image with all of them at once,
+        //  and the result for each size is written to its own copy of the input file, with the
+        //  size in its name, eg "Median7_name.fits". Each size has its own MedianDetails, so
+        //  the CPU results for each can be checked against the GPU's in the usual way.
+        
+        if (Scales != "") {
+            std::vector<int> ScaleList;
+            if (ParseScales(Scales,&ScaleList) && !ScaleList.empty()) {
+                std::vector<MedianDetails> ScaleDetails(ScaleList.size());
+                for (size_t Iscale = 0; Iscale < ScaleList.size(); Iscale++) {
+                    ScaleDetails[Iscale].CheckTolerance = Tolerance;
+                    if (Filename != "") {
+                        std::string Prefix = "Median" + std::to_string(ScaleList[Iscale]) + "_";
+                        ReadFitsFile(Filename,&Nx,&Ny,&ScaleDetails[Iscale],Prefix);
+                    }
+                }
+                printf ("\nPerforming multi-scale 'Median' test, arrays of %d rows, %d columns. "
+                                                   "Repeat count %d.\n",Ny,Nx,Nrpt);
+                printf ("Median boxes are %s.\n\n",Scales.c_str());
+                if (Half || InPlace || Autotune || Native) {
+                    printf ("'Half', 'InPlace', 'Autotune' and 'Native' are ignored with "
+                                                                        "'Scales'.\n\n");
+                }
+                if (!UseGPU && !UseCPU) UseGPU = true;
+                if (UseGPU) ComputeScalesUsingGPU(Nx,Ny,ScaleList,Nrpt,Validate,DebugLevels,
+                                                            ScaleDetails.data());
+                for (size_t Iscale = 0; Iscale < ScaleList.size(); Iscale++) {
+                    int ScaleNpix = ScaleList[Iscale];
+                    if (UseCPU) {
+                        printf ("Box %d by %d:\n",ScaleNpix,ScaleNpix);
+                        ComputeUsingCPU(Threads,Nx,Ny,ScaleNpix,Nrpt,false,
+                         Histogram || ScaleNpix > C_MaxWorkNpix,Simd,&ScaleDetails[Iscale]);
+                    }
+                    if (Filename != "") WriteFitsFile(Nx,Ny,&ScaleDetails[Iscale]);
+                    Shutdown(&ScaleDetails[Iscale]);
+                }
+            }
+            return 0;
+        }
+        
+        //  If 'Sizes' was given, and there's no file, the test is run for each of the sizes
+        //  listed instead of Nx,Ny.
+        
+        std::vector<int> SizesX(1,Nx),SizesY(1,Ny);
+        if (Sizes != "") {
+            if (Filename != "") {
+                printf ("\n'Sizes' is ignored when filtering a file.\n");
+            } else if (!BenchReport::Sizes(Sizes,SizesX,SizesY)) {
+                printf ("Error in 'Sizes': '%s' should be a list such as 512,1024x512\n",
+                                                                               Sizes.c_str());
+                return 0;
+            }
+        }
+        
+        //  If 'Vary' was given, the test is run instead for each combination of the values it
+        //  lists, which have to be in the ranges allowed for the parameters themselves. Either
+        //  way, the tests end up as a list of combinations of parameter values to run in turn.
+        
+        std::vector<BenchReport::Combination> Combinations;
+        if (Vary != "") {
+            std::string VaryError;
+            if (Sizes != "") printf ("\n'Sizes' is ignored with 'Vary'.\n");
+            if (!BenchReport::Sweep(Vary,"nx,ny,npix,threads",Combinations,&VaryError)) {
+                printf ("Error in 'Vary': %s\n",VaryError.c_str());
+                return 0;
+            }
+            for (const BenchReport::Combination& Combo : Combinations) {
+                long RunNx = BenchReport::Value(Combo,"nx",2);
+                long RunNy = BenchReport::Value(Combo,"ny",2);
+                long RunNpix = BenchReport::Value(Combo,"npix",Npix);
+                long RunThreads = BenchReport::Value(Combo,"threads",Threads);
+                if (RunNx < 2 || RunNx > 1024*1024 || RunNy < 2 || RunNy > 1024*1024 ||
+                        RunNpix < 1 || RunNpix > HistogramMedian::C_MaxNpix || RunNpix % 2 == 0 ||
+                                                 RunThreads < 0 || RunThreads > MaxThreads) {
+                    printf ("Error in 'Vary': '%s' is out of range, or Npix isn't odd\n",
+                                                            BenchReport::Describe(Combo).c_str());
+                    return 0;
+                }
+            }
+        } else {
+            for (size_t Size = 0; Size < SizesX.size(); Size++) {
+                Combinations.push_back({{"nx",SizesX[Size]},{"ny",SizesY[Size]}});
+            }
         }
         
-        printf ("\nPerforming 'Median' test, arrays of %d rows, %d columns. Repeat count %d.\n",
-                Ny,Nx,Nrpt);
-        printf ("Median box is %d by %d.\n\n",Npix,Npix);
+        printf ("\n");
+        if (Connect != "") {
+            printf ("Sending the image to the server at '%s' instead of using the GPU.\n\n",
+                                                                           Connect.c_str());
+            if (Half || InPlace || Autotune || Native || WarmStart) {
+                printf ("'Half', 'InPlace', 'Autotune', 'Native' and 'WarmStart' are ignored "
+                                                                   "with 'Connect'.\n\n");
+            }
+            Half = InPlace = Native = WarmStart = false;
+        }
+        bool ReadNative = Native && !Half && !InPlace;
+        if (Half && (InPlace || Autotune)) {
+            printf ("'InPlace' and 'Autotune' are ignored with 'Half'.\n\n");
+            InPlace = false;
+        }
+        if (InPlace) {
+            printf ("Filtering in place, so each repeat filters the result of the last.\n\n");
+        }
+        if (Native && !ReadNative) {
+            printf ("'Native' is ignored with 'Half' and 'InPlace'.\n\n");
+        }
+        if (Warmup >= Nrpt && Nrpt > 0) {
+            printf ("'Warmup' (%d) leaves none of the %d passes to be timed.\n\n",Warmup,Nrpt);
+        }
         
-        //  If neither CPU not GPU was specified on the command line, use GPU.
+        //  If neither CPU not GPU was specified on the command line, use GPU. But a box too
+        //  large for the GPU code can only be handled by the CPU, and a box too large for the
+        //  CPU's work array needs the histogram filter. (If 'Vary' gives the box sizes, that
+        //  is decided for each of them as it is run.)
         
+        bool VaryNpix = (Vary != "" && Combinations[0].count("npix") > 0);
         if (!UseGPU && !UseCPU) UseGPU = true;
+        if (Npix > C_MaxGPUNpix && UseGPU && !VaryNpix) {
+            printf ("Boxes larger than %d by %d need the CPU's histogram filter, so the GPU "
+                                            "isn't used.\n\n",C_MaxGPUNpix,C_MaxGPUNpix);
+            UseGPU = false;
+            UseCPU = true;
+        }
+        if (Npix > C_MaxWorkNpix && !VaryNpix) {
+            if (UseGPU) printf ("Boxes larger than %d by %d use a bitwise search for the median "
+                                         "on the GPU.\n\n",C_MaxWorkNpix,C_MaxWorkNpix);
+            Histogram = true;
+        }
+        if (Layout != ImageLayout::None && (Half || InPlace)) {
+            printf ("'Layout' is ignored with 'Half' and 'InPlace'.\n\n");
+            Layout = ImageLayout::None;
+        }
         
-        //  Perform the test using either CPU or GPU (or both). Both ComputeUsingGPU() and its CPU
-        //  equivalent, ComputeUsingCPU() are expected to create arrays of the size specified, call
-        //  SetInputArray() to initialise the input array, then perform the basic 'Median' operation
-        //  as specified.
+        //  With 'WarmStart', the GPU device is created in the background while the file is
+        //  read, and the shader files read ahead of time. ComputeUsingGPU() then picks up the
+        //  Framework that has been set up, for the first size only. 'Half' and 'InPlace' do
+        //  their own setup, so aren't affected. With 'Vary', the Framework is set up in the
+        //  same way, and is kept here and used for all the combinations, so the device is
+        //  only set up once. ComputeUsingGPU() releases its buffers and pipeline each time.
         
-        if (UseGPU) ComputeUsingGPU(Nx,Ny,Npix,Nrpt,Validate,DebugLevels,&Details);
+        KVVulkanFramework* WarmFramework = nullptr;
+        if (Vary != "" && UseGPU && !Half && !InPlace && Connect == "") {
+            WarmFramework = StartWarmGPU(Validate,Tiled,ReadNative,DebugLevels);
+        } else if (WarmStart) {
+            if (UseGPU && !Half && !InPlace) {
+                WarmFramework = StartWarmGPU(Validate,Tiled,ReadNative,DebugLevels);
+            } else {
+                printf ("'WarmStart' is ignored with 'Half' and 'InPlace', and without the "
+                                                                                "GPU.\n\n");
+            }
+        }
+        
+        //  With 'GpuCheck', the CPU filters the image first, so its result is there for
+        //  ComputeUsingGPU() to compare with on the GPU.
         
-        if (UseCPU) ComputeUsingCPU(Threads,Nx,Ny,Npix,Nrpt,&Details);
+        bool CPUFirst = false;
+        if (GpuCheck) {
+            if (UseCPU && UseGPU && !Half && !InPlace && Connect == "") {
+                CPUFirst = true;
+            } else {
+                printf ("'GpuCheck' needs both the CPU and GPU, and is ignored with 'Half', "
+                                                          "'InPlace' and 'Connect'.\n\n");
+            }
+        }
         
-        //  Write out the filtered array to the copy of the input FITS file and close program.
+        int BaseNx = Nx;
+        int BaseNy = Ny;
+        int BaseNpix = Npix;
+        int BaseThreads = Threads;
+        BenchReport Bench;
+        for (size_t Run = 0; Run < Combinations.size(); Run++) {
         
-        if (Filename != "") WriteFitsFile (Nx,Ny,&Details);
-        Shutdown(&Details);
+            //  Set the values for this combination, and for a box size from 'Vary', whether
+            //  the GPU can handle it, and whether the CPU needs the histogram filter.
+            
+            Npix = int(BenchReport::Value(Combinations[Run],"npix",BaseNpix));
+            Threads = int(BenchReport::Value(Combinations[Run],"threads",BaseThreads));
+            bool RunGPU = UseGPU;
+            bool RunCPU = UseCPU;
+            bool RunHistogram = Histogram;
+            if (Vary != "") {
+                printf ("Combination %d of %d: %s\n\n",int(Run + 1),int(Combinations.size()),
+                                                  BenchReport::Describe(Combinations[Run]).c_str());
+            }
+            if (VaryNpix && Npix > C_MaxGPUNpix && RunGPU) {
+                printf ("Boxes larger than %d by %d need the CPU's histogram filter, so the GPU "
+                                   "isn't used for this one.\n\n",C_MaxGPUNpix,C_MaxGPUNpix);
+                RunGPU = false;
+                RunCPU = true;
+            }
+            if (VaryNpix && Npix > C_MaxWorkNpix) RunHistogram = true;
+        
+            //  If a file name was specified, get the image dimensions, read in the main data
+            //  array, and create the output file with a copy of the file's header. With
+            //  'Native', a 16-bit integer image is read unscaled, but only ComputeUsingGPU()
+            //  can use that.
+
+            MedianDetails Details;
+            Details.CheckTolerance = Tolerance;
+            Details.GPUCheck = CPUFirst && RunGPU;
+            Details.Layout = Layout;
+            Details.GPUBitonic = Bitonic;
+            if (Filename != "") {
+                TraceScope ReadTrace("Read FITS file","Median");
+                StartupPhase ReadPhase("Read FITS file");
+                ReadFitsFile(Filename,&Nx,&Ny,&Details,"Median_",nullptr,ReadNative);
+            } else {
+                Nx = int(BenchReport::Value(Combinations[Run],"nx",BaseNx));
+                Ny = int(BenchReport::Value(Combinations[Run],"ny",BaseNy));
+                
+                //  If both the GPU and the CPU are to filter the test image, it's made just
+                //  once, in memory the GPU can import, as for an image read from a file, and
+                //  both work on that one copy.
+                
+                if (RunGPU && RunCPU) {
+                    float* Data = (float*)AllocateArray(size_t(Nx) * size_t(Ny) * sizeof(float),
+                                                                                         true);
+                    if (Data) {
+                        float** DataRows = CreateRowAddrs(Data,Nx,Ny);
+                        SetInputArray(DataRows,Nx,Ny,&Details);
+                        free(DataRows);
+                        Details.InputData = Data;
+                        if (UseHugePages) {
+                            printf ("Shared input array: %s\n",HugePages::Describe(Data).c_str());
+                        }
+                    }
+                }
+            }
+        
+            printf ("Performing 'Median' test, arrays of %d rows, %d columns. "
+                                                         "Repeat count %d.\n",Ny,Nx,Nrpt);
+            printf ("Median box is %d by %d.\n\n",Npix,Npix);
+        
+            //  Perform the test using either CPU or GPU (or both). Both ComputeUsingGPU() and
+            //  its CPU equivalent, ComputeUsingCPU() are expected to create arrays of the size
+            //  specified, call SetInputArray() to initialise the input array, then perform the
+            //  basic 'Median' operation as specified. They add their timings to Bench.
+        
+            //  'Half' has its own version of the GPU code. If the device turns out not to
+            //  support 16-bit storage, that returns false, and the normal code is used.
+        
+            if (CPUFirst) {
+                ComputeUsingCPU(Threads,Nx,Ny,Npix,Nrpt,InPlace,RunHistogram,Simd,&Details,
+                                                                               Warmup,&Bench);
+            }
+            if (RunGPU) {
+                if (Connect != "") {
+                    ComputeUsingServer(Connect,Nx,Ny,Npix,Nrpt,&Details);
+                } else if (Half &&
+                       ComputeUsingGPUHalf(Nx,Ny,Npix,Nrpt,Validate,Tiled,DebugLevels,&Details)) {
+                    //  All done, in half precision.
+                } else if (InPlace) {
+                    if (Autotune) printf ("'Autotune' is ignored with 'InPlace'.\n");
+                    ComputeUsingGPUInPlace(Nx,Ny,Npix,Nrpt,Validate,Tiled,DebugLevels,&Details);
+                } else {
+                    ComputeUsingGPU(Nx,Ny,Npix,Nrpt,Validate,Autotune,Tiled,DebugLevels,&Details,
+                                                 Warmup,&Bench,WarmFramework,Vary != "");
+                    if (Vary == "") WarmFramework = nullptr;
+                }
+            }
+        
+            if (RunCPU && !CPUFirst) {
+                ComputeUsingCPU(Threads,Nx,Ny,Npix,Nrpt,InPlace,RunHistogram,Simd,&Details,
+                                                                               Warmup,&Bench);
+            }
+        
+            //  Write out the filtered array to the output FITS file and close program.
+        
+            if (Filename != "") {
+                TraceScope WriteTrace("Write FITS file","Median");
+                WriteFitsFile (Nx,Ny,&Details);
+            }
+            Shutdown(&Details);
+        }
+        delete WarmFramework;
+        
+        //  'Report' appends the timings collected to a file. ('Half' and 'InPlace' have their
+        //  own GPU code, and don't add to these.)
+        
+        if (Report != "" && Bench.Rows() > 0) Bench.Write(Report);
+        
+        //  Make sure any debug output still queued is written out.
+        
+        DebugLogSink::Global().Stop();
     }
     return 0;
 }
@@ -315,7 +1701,9 @@ int main (int Argc, char* Argv[]) {
 //
 //                             R e a d  F i t s  F i l e
 
-bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
+bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details,
+   const std::string& Prefix,const std::function<float*(int Nx,int Ny)>& Destination,
+                                                                               bool Native)
 {
 
 #ifdef USE_CFITSIO
@@ -324,74 +1712,142 @@ bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
     char Error[80];
     int Status = 0;
     
-    //  First, we make a copy of the input file with "Median_" prepended to the filename,
-    //  and make sure the resulting file has write access. (This allows the FITS routines
-    //  to modify the new file even if the original was readonly.) If such a file exists
-    //  (it often will) overwrite it. Since we have to use C++17 anyway, we may as well
-    //  use the std::filesystem routines for this.
+    //  The output goes to a new file with "Median_" (or Prefix, if that's something else)
+    //  prepended to the filename, in the same directory as the original. If such a file
+    //  exists (it often will) it gets overwritten - the leading '!' in the name passed to
+    //  fits_create_file() tells cfitsio to do that. The new file gets a copy of the header of
+    //  the input file's main image, and WriteFitsFile() writes the filtered image to it. An
+    //  earlier version copied the whole input file and then overwrote its image, but for a
+    //  large file that was a complete extra read and write before anything else could start.
+    //  This way the input is read once and the output written once. (It does mean that any
+    //  extensions in the input file aren't carried over to the output.)
     
-    
-    std::string MedianFile = "Median_" + Filename;
-    TheDebugHandler.Logf("Fits","Copying input file %s to new output file %s",Filename.c_str(),
-                                                                            MedianFile.c_str());
+    std::filesystem::path InputPath(Filename);
+    std::string MedianFile =
+           (InputPath.parent_path() / (Prefix + InputPath.filename().string())).string();
+    TheDebugHandler.Logf("Fits","Reading input file %s, output will go to new file %s",
+                                                       Filename.c_str(),MedianFile.c_str());
     std::error_code ErrorCode;
     if (std::filesystem::exists(MedianFile,ErrorCode)) {
         TheDebugHandler.Logf("Fits","File %s already exists and will be overwritten",
                                                                    MedianFile.c_str());
     }
-    std::string Text;
-    if (!std::filesystem::copy_file(Filename,MedianFile,
-                            std::filesystem::copy_options::overwrite_existing,ErrorCode)) {
-        Text = "Unable to create new median file: " + ErrorCode.message();
-        Status = 1;
-    } else {
-        std::filesystem::permissions(MedianFile,std::filesystem::perms::owner_write,
-                                          std::filesystem::perm_options::add,ErrorCode);
-        if (ErrorCode) {
-            Text = "Unable to make new median file writeable: " + ErrorCode.message();
-            Status = 1;
-        }
-    }
-    if (Status) {
-        strncpy(Error,Text.c_str(),sizeof(Error) - 1);
+    
+    //  Open the input file, read-only, allocate a large enough block of memory to hold
+    //  the main image, and read it in. Then create the output file and copy the header
+    //  over. (This code is using cfitsio routines, which have their origins some time
+    //  back, and so have a bit of a different feel to the C++17 code used for the names.)
+    //  fits_open_image() moves to the first HDU that has an image, which for a tile-
+    //  compressed file is an extension, stored as a binary table. That's also why the
+    //  dimensions come from fits_get_img_size() and not from the NAXIS keywords, which for
+    //  a compressed image describe the table.
+    
+    fitsfile* InFptr = nullptr;
+    if (fits_open_image(&InFptr,Filename.c_str(),READONLY,&Status)) {
+        fits_get_errstatus (Status,Error);
     } else {
-        
-        //  Now open the copy of the original file, allocate a large enough block of memory
-        //  to hold the main image, and read it in. (This code is using cfitsio routines, which
-        //  have their origins some time back, and so have a bit of a different feel to the
-        //  C++17 code just used to do the file copy.)
-         
-        if (fits_open_file(&Fptr,MedianFile.c_str(),READWRITE,&Status)) {
+        long Naxes[2] = {0,0};
+        int Nfound = 0;
+        if (fits_get_img_dim(InFptr,&Nfound,&Status) ||
+                          (Nfound == 2 && fits_get_img_size(InFptr,2,Naxes,&Status))) {
             fits_get_errstatus (Status,Error);
         } else {
-            long Naxes[2];
-            int Nfound;
-            Details->Fptr = Fptr;
-            if (fits_read_keys_lng(Fptr,"NAXIS",1,2,Naxes,&Nfound,&Status)) {
-                fits_get_errstatus (Status,Error);
+            if (Nfound != 2) {
+                strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+                Status = 1;
             } else {
-                if (Nfound != 2) {
-                    strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+                //  The memory is allocated so that the GPU code can import it directly into
+                //  a Vulkan buffer, without having to copy it. See ComputeUsingGPU(). If the
+                //  caller already has somewhere for the image, it passes Destination, which is
+                //  given the dimensions and returns the address to read it into. The batch
+                //  code uses this to read each file straight into the GPU's input buffer.
+                //  With 'Native', a 16-bit integer image is read as it is, into RawData, by
+                //  ReadRawFitsImage(), and then there's no float data at all.
+                
+                bool ReadRawFitsImage(fitsfile* Fptr,LONGLONG NPixels,MedianDetails* Details,
+                                                                              int* Status);
+                LONGLONG NPixels = LONGLONG(Naxes[0]) * LONGLONG(Naxes[1]);
+                float* Data = nullptr;
+                bool Raw = Native && !Destination &&
+                                       ReadRawFitsImage(InFptr,NPixels,Details,&Status);
+                if (Raw) {
+                    TheDebugHandler.Log("Fits","Image read as unscaled 16-bit integers");
+                } else if (Destination) {
+                    Data = Destination(int(Naxes[0]),int(Naxes[1]));
+                    Details->OwnsInputData = false;
+                } else {
+                    Data = (float*)AllocateArray(size_t(NPixels) * sizeof(float),true);
+                }
+                
+                //  Blank pixels are read as NaNs, which the median code leaves out
+                //  of the boxes. (A Nullval of zero would read them as zeros.) Anynull
+                //  tells us if there were any, so the code can skip the checks if not.
+                //  Most images can be read straight from a memory mapping of the file,
+                //  which is faster, a compressed image can be decompressed in parallel, and
+                //  fits_read_img() is only needed for the others.
+                
+                bool MapFitsImage(const std::string& Filename,fitsfile* Fptr,LONGLONG NPixels,
+                                                                  float* Data,int* Anynull);
+                bool ReadCompressedFitsImage(const std::string& Filename,fitsfile* Fptr,
+                                       long Nx,long Ny,float* Data,int* Anynull,int* Status);
+                long Fpixel = 1;
+                float Nullval = NAN;
+                int Anynull = 0;
+                if (Raw) {
+                    //  Already read.
+                } else if (Data == nullptr) {
+                    strncpy(Error,"Unable to allocate memory for the image",sizeof(Error));
                     Status = 1;
+                } else if (MapFitsImage(Filename,InFptr,NPixels,Data,&Anynull)) {
+                    TheDebugHandler.Log("Fits","Image data read through a memory mapping");
+                } else if (ReadCompressedFitsImage(Filename,InFptr,Naxes[0],Naxes[1],Data,
+                                                                        &Anynull,&Status)) {
+                    TheDebugHandler.Log("Fits","Compressed image tiles read in parallel");
+                } else {
+                    fits_read_img(InFptr,TFLOAT,Fpixel,NPixels,&Nullval,Data,&Anynull,&Status);
+                }
+                if (Status) {
+                    if (Data || Raw) fits_get_errstatus (Status,Error);
                 } else {
-                    int NPixels = Naxes[0] * Naxes[1];
-                    float* Data = (float*)malloc(NPixels * sizeof(float));
-                    long Fpixel = 1;
-                    float Nullval = 0.0;
-                    int Anynull;
-                    if (fits_read_img(Fptr,TFLOAT,Fpixel,NPixels,&Nullval,Data,&Anynull,&Status)) {
+                    if (!Raw) {
+                        Details->InputData = Data;
+                        Details->HasBlanks = (Anynull != 0);
+                    }
+                    if (Details->HasBlanks) TheDebugHandler.Log("Fits","Image has blank pixels");
+                    *Nx = Naxes[0];
+                    *Ny = Naxes[1];
+                    TheDebugHandler.Logf("Fits","File opened, 2D data array %d by %d",*Nx,*Ny);
+                    std::string CreateName = "!" + MedianFile;
+                    if (fits_create_file(&Fptr,CreateName.c_str(),&Status)) {
                         fits_get_errstatus (Status,Error);
                     } else {
-                        Details->InputData = Data;
-                        *Nx = Naxes[0];
-                        *Ny = Naxes[1];
-                        TheDebugHandler.Logf("Fits","File opened, 2D data array %d by %d",*Nx,*Ny);
+                        
+                        //  A compressed image's header has to be turned back into that of
+                        //  an ordinary image, since that's what WriteFitsFile() writes.
+                        
+                        Details->Fptr = Fptr;
+                        int CompStatus = 0;
+                        if (fits_is_compressed_image(InFptr,&CompStatus)) {
+                            fits_img_decompress_header(InFptr,Fptr,&Status);
+                        } else {
+                            fits_copy_header(InFptr,Fptr,&Status);
+                        }
+                        if (Status) fits_get_errstatus (Status,Error);
                     }
                 }
             }
         }
-        if (Status == 0) Details->OutputFileName = MedianFile;
+        
+        //  The input file isn't needed any more. Don't let a close error replace the
+        //  description of an earlier one.
+        
+        int CloseStatus = 0;
+        if (fits_close_file(InFptr,&CloseStatus) && Status == 0) {
+            Status = CloseStatus;
+            fits_get_errstatus (Status,Error);
+        }
     }
+    if (Status == 0) Details->OutputFileName = MedianFile;
     if (Status) {
         if (TheDebugHandler.Active("Fits")) {
             TheDebugHandler.Logf("Fits","Error reading FITS file: %s",Error);
@@ -410,6 +1866,245 @@ bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
 
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                             M a p  F i t s  I m a g e
+//
+//  This is a fast path used by ReadFitsFile() for the usual case of an uncompressed image of
+//  32-bit floats (BITPIX = -32) with no scaling. Instead of fits_read_img() reading the data
+//  through cfitsio's own buffers and then converting it into Data, this maps the data unit of
+//  the file into memory and converts it from the big-endian FITS format straight into Data, so
+//  the data is only handled once, and reading it is little more than the cost of the page
+//  faults. It returns false, having done nothing, if the image isn't one it can handle, and
+//  the caller should then use fits_read_img(). The conversion matches the one cfitsio does
+//  when checking for nulls: NaNs and infinities are blank pixels, set to NaN and flagged in
+//  *Anynull, and values with a zero exponent (underflows) are set to zero.
+//
+//  (Data can't just be left pointing into the mapped file, even where no byte swap is needed,
+//  because the data unit starts at a multiple of 2880 bytes into the file, not on a page
+//  boundary, and the GPU has to be able to import the array as a buffer.)
+
+bool MapFitsImage(const std::string& Filename,fitsfile* Fptr,LONGLONG NPixels,float* Data,
+                                                                                 int* Anynull)
+{
+    bool Mapped = false;
+    
+#ifdef USE_MMAP
+
+    //  Anything cfitsio would have to do something clever with - a compressed image, a file
+    //  that isn't just a file on disk (eg a gzipped file cfitsio unpacks into memory, or a name
+    //  using cfitsio's extended syntax), or scaled data - is left to fits_read_img().
+    
+    int Status = 0;
+    int Bitpix = 0;
+    char UrlType[FLEN_FILENAME];
+    LONGLONG HeadStart = 0;
+    LONGLONG DataStart = 0;
+    LONGLONG DataEnd = 0;
+    fits_get_img_type(Fptr,&Bitpix,&Status);
+    int Compressed = fits_is_compressed_image(Fptr,&Status);
+    fits_url_type(Fptr,UrlType,&Status);
+    fits_get_hduaddrll(Fptr,&HeadStart,&DataStart,&DataEnd,&Status);
+    auto KeyValue = [Fptr](const char* Name,double Default) {
+        int KeyStatus = 0;
+        double Value = Default;
+        if (fits_read_key(Fptr,TDOUBLE,Name,&Value,nullptr,&KeyStatus)) Value = Default;
+        return Value;
+    };
+    size_t Bytes = size_t(NPixels) * sizeof(float);
+    std::error_code ErrorCode;
+    if (Status != 0 || Bitpix != FLOAT_IMG || Compressed || strcmp(UrlType,"file://") ||
+            KeyValue("BSCALE",1.0) != 1.0 || KeyValue("BZERO",0.0) != 0.0 ||
+            DataEnd - DataStart < LONGLONG(Bytes) ||
+            !std::filesystem::is_regular_file(Filename,ErrorCode)) return false;
+    
+    //  mmap() needs an offset that's a multiple of the page size, so the mapping may start a
+    //  little before the data.
+    
+    int Fd = open(Filename.c_str(),O_RDONLY);
+    if (Fd < 0) return false;
+    struct stat FileStat;
+    off_t MapStart = off_t(DataStart) - off_t(DataStart) % off_t(sysconf(_SC_PAGESIZE));
+    size_t MapLength = size_t(DataStart - MapStart) + Bytes;
+    if (fstat(Fd,&FileStat) == 0 && FileStat.st_size >= off_t(MapStart + MapLength)) {
+        void* Map = mmap(nullptr,MapLength,PROT_READ,MAP_PRIVATE,Fd,MapStart);
+        if (Map != MAP_FAILED) {
+            madvise(Map,MapLength,MADV_SEQUENTIAL);
+            
+            //  The data unit starts at a multiple of 2880 bytes, so the words are aligned.
+            //  The loop has no branches, so the compiler can vectorize it.
+            
+            const uint32_t* Words =
+                      (const uint32_t*)((const char*)Map + size_t(DataStart - MapStart));
+            const uint32_t One = 1;
+            bool Swap = (*(const unsigned char*)&One == 1);
+            uint32_t Blanks = 0;
+            for (LONGLONG I = 0; I < NPixels; I++) {
+                uint32_t Word = Words[I];
+                if (Swap) Word = (Word >> 24) | ((Word >> 8) & 0xff00) |
+                                                   ((Word << 8) & 0xff0000) | (Word << 24);
+                uint32_t Exponent = Word & 0x7f800000;
+                Blanks |= (Exponent == 0x7f800000);
+                Word = (Exponent == 0x7f800000) ? 0x7fc00000 : (Exponent == 0) ? 0 : Word;
+                memcpy(&Data[I],&Word,sizeof(float));
+            }
+            *Anynull = (Blanks != 0);
+            munmap(Map,MapLength);
+            Mapped = true;
+        }
+    }
+    close(Fd);
+
+#endif
+
+    return Mapped;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                  R e a d  C o m p r e s s e d  F i t s  I m a g e
+//
+//  Used by ReadFitsFile() for a tile-compressed image (Rice, GZIP etc). fits_read_img() would
+//  decompress the tiles one after another in the calling thread, and for a large image that
+//  decompression, not the disk, is what takes the time. This splits the image into bands of
+//  whole tile rows and has the shared thread pool read them at once, each band into its own
+//  part of Data, so each tile is only decompressed once. cfitsio doesn't let two threads use
+//  the same fitsfile, so each band opens the file for itself. That's only safe if cfitsio was
+//  built to be reentrant, so this returns false, having done nothing, if it wasn't, or if the
+//  image isn't compressed or has only one row of tiles, and the caller should then use
+//  fits_read_img(). Otherwise it returns true, with Anynull set as fits_read_img() would set
+//  it and any error returned in *Status.
+
+bool ReadCompressedFitsImage(const std::string& Filename,fitsfile* Fptr,long Nx,long Ny,
+                                                       float* Data,int* Anynull,int* Status)
+{
+
+#ifdef USE_CFITSIO
+
+    //  A file cfitsio has to unpack into memory (eg a gzipped file) would be unpacked again
+    //  by each band, so that's also left to fits_read_img().
+    
+    int CheckStatus = 0;
+    char UrlType[FLEN_FILENAME];
+    if (!fits_is_reentrant() || !fits_is_compressed_image(Fptr,&CheckStatus)) return false;
+    if (fits_url_type(Fptr,UrlType,&CheckStatus) || strcmp(UrlType,"file://")) return false;
+    if (ThreadPool::Shared().Threads() <= 1) return false;
+    
+    //  ZTILE2 is the number of image rows in each tile. Without it, each row is a tile.
+    
+    long TileRows = 1;
+    int HduNum = 0;
+    fits_get_hdu_num(Fptr,&HduNum);
+    if (fits_read_key(Fptr,TLONG,"ZTILE2",&TileRows,nullptr,&CheckStatus) || TileRows < 1) {
+        TileRows = 1;
+    }
+    int Tiles = int((Ny + TileRows - 1) / TileRows);
+    if (Tiles <= 1) return false;
+    
+    //  Each band reports blank pixels and errors through these. Only the first error is kept.
+    
+    std::atomic<int> AnyBlanks(0);
+    std::atomic<int> FirstError(0);
+    ThreadPool::Shared().ParallelFor(0,Tiles,[&](int First,int Last) {
+        int BandStatus = 0;
+        int BandNull = 0;
+        fitsfile* BandFptr = nullptr;
+        long FirstRow = First * TileRows;
+        long LastRow = Last * TileRows;
+        if (LastRow > Ny) LastRow = Ny;
+        float Nullval = NAN;
+        if (fits_open_file(&BandFptr,Filename.c_str(),READONLY,&BandStatus) == 0 &&
+                fits_movabs_hdu(BandFptr,HduNum,nullptr,&BandStatus) == 0) {
+            fits_read_img(BandFptr,TFLOAT,FirstRow * Nx + 1,(LastRow - FirstRow) * Nx,
+                                       &Nullval,Data + FirstRow * Nx,&BandNull,&BandStatus);
+        }
+        int CloseStatus = 0;
+        if (BandFptr) fits_close_file(BandFptr,&CloseStatus);
+        if (BandNull) AnyBlanks = 1;
+        int NoError = 0;
+        if (BandStatus) FirstError.compare_exchange_strong(NoError,BandStatus);
+    });
+    *Anynull = AnyBlanks;
+    if (FirstError != 0) *Status = FirstError;
+    TheDebugHandler.Logf("Fits","Compressed image, %d rows of tiles, each %ld rows high",
+                                                                         Tiles,TileRows);
+    return true;
+
+#else
+
+    return false;
+
+#endif
+
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                         R e a d  R a w  F i t s  I m a g e
+//
+//  Used by ReadFitsFile() for 'Native'. If the image is 16-bit integers (BITPIX = 16), this reads
+//  them into Details->RawData just as they are in the file, with none of the scaling to floats
+//  that fits_read_img() would normally do, and sets the BSCALE, BZERO and BLANK values in Details
+//  for whatever code converts them later - usually the GPU shader. Apart from the byte swap, the
+//  CPU does nothing with the data except check for blank pixels, and only if there's a BLANK
+//  keyword. It returns false, having done nothing, if the image isn't 16-bit integers or the
+//  memory for it can't be allocated, and the caller should read it as floats instead. Otherwise
+//  it returns true, and any error reading the image is returned in *Status.
+
+bool ReadRawFitsImage(fitsfile* Fptr,LONGLONG NPixels,MedianDetails* Details,int* Status)
+{
+
+#ifdef USE_CFITSIO
+
+    int TypeStatus = 0;
+    int Bitpix = 0;
+    if (fits_get_img_type(Fptr,&Bitpix,&TypeStatus) || Bitpix != SHORT_IMG) return false;
+    short* RawData =
+           (short*)KVVulkanFramework::AllocateImportableMemory(size_t(NPixels) * sizeof(short));
+    if (RawData == nullptr) return false;
+    
+    //  BSCALE and BZERO default to 1 and 0. BLANK is optional, and without it no pixel is blank.
+    
+    double Bscale = 1.0;
+    double Bzero = 0.0;
+    long Blank = 0;
+    int KeyStatus = 0;
+    if (fits_read_key(Fptr,TDOUBLE,"BSCALE",&Bscale,nullptr,&KeyStatus)) Bscale = 1.0;
+    KeyStatus = 0;
+    if (fits_read_key(Fptr,TDOUBLE,"BZERO",&Bzero,nullptr,&KeyStatus)) Bzero = 0.0;
+    KeyStatus = 0;
+    bool HasBlank = (fits_read_key(Fptr,TLONG,"BLANK",&Blank,nullptr,&KeyStatus) == 0) &&
+                                                           Blank >= -32768 && Blank <= 32767;
+    
+    //  With the scaling turned off, fits_read_img() only has to byte swap the values, and a
+    //  null Nulval means it doesn't look for blank values either.
+    
+    long Fpixel = 1;
+    int Anynull = 0;
+    fits_set_bscale(Fptr,1.0,0.0,Status);
+    fits_read_img(Fptr,TSHORT,Fpixel,NPixels,nullptr,RawData,&Anynull,Status);
+    if (*Status) {
+        KVVulkanFramework::FreeImportableMemory(RawData);
+    } else {
+        Details->RawData = RawData;
+        Details->RawScale = float(Bscale);
+        Details->RawZero = float(Bzero);
+        Details->RawBlank = int(Blank);
+        Details->RawHasBlank = HasBlank;
+        short* RawEnd = RawData + NPixels;
+        Details->HasBlanks = HasBlank && std::find(RawData,RawEnd,short(Blank)) != RawEnd;
+        TheDebugHandler.Logf("Fits","16-bit image, BSCALE %g, BZERO %g",Bscale,Bzero);
+    }
+    return true;
+
+#else
+
+    return false;
+
+#endif
+
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                    G P U  c o d e
@@ -430,26 +2125,100 @@ bool ReadFitsFile(std::string& Filename,int* Nx,int* Ny,MedianDetails* Details)
 
 //                               I n c l u d e  F i l e s
 //
-//  Needed for Vulkan
+//  Needed for Vulkan, and for std::min() and std::max() in the in place code. The check made
+//  for 'GpuCheck' runs as a KVComputeKernel.
 
 #include "KVVulkanFramework.h"
+#include "KVComputeKernel.h"
+#include <algorithm>
 
 //                                  C o n s t a n t s
 //
-//  These have to match the values used by the GPU shader code in Median.comp.
+//  These have to match the values used by the GPU shader code in Median.comp. (The workgroup
+//  size is passed to the shader as specialization constants, so this is really just the
+//  default used unless 'Autotune' is specified.)
 
 static const uint32_t C_WorkGroupSize = 32;
 static const int C_UniformBufferBinding = 0;
 static const int C_InputBufferBinding = 1;
 static const int C_OutputBufferBinding = 2;
 
-void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::string& DebugLevels,
-                                                                           MedianDetails* Details)
+//  When filtering in place, this is the target size for the window buffer that holds the
+//  original rows needed for each band of rows filtered. It is kept small, since the whole
+//  point is to save GPU memory, but large enough that there aren't too many bands.
+
+static const long C_InPlaceWindowBytes = 16 * 1024 * 1024;
+
+//  When streaming a file, this is the target size for each band of rows. Larger bands mean
+//  fewer dispatches, but more memory, and a longer wait for the first band to be read and the
+//  last to be written, which can't be overlapped with anything.
+
+static const long C_StreamBandBytes = 32 * 1024 * 1024;
+
+//  The number of windows the upload ring used by 'Stream' holds.
+
+static const int C_StreamRingWindows = 3;
+
+//  The number of planes of a cube that can be with the GPU at once. Three lets one plane be
+//  filtered while the results of another are read back and a third is uploaded.
+
+static const int C_CubeSlots = 3;
+
+//  The number of tiles each GPU can have at once with 'Tiles'. Two lets one tile be filtered
+//  while the results of the last are copied out and the next one copied in.
+
+static const int C_TileSlots = 2;
+
+//  The shader that compares the GPU's result with the CPU's for 'GpuCheck', which has the
+//  output buffer at the usual binding, and the CPU's result and the small buffer for the
+//  results of the check at the bindings given here.
+
+static const char* const C_CheckShader = "MedianCheck.spv";
+static const int C_ReferenceBufferBinding = 3;
+static const int C_CheckBufferBinding = 4;
+
+//  Compares the results of ComputeUsingGPU() with the CPU's on the GPU, for 'GpuCheck'.
+
+bool CompareResultsOnGPU(KVVulkanFramework& Framework,
+                    KVVulkanFramework::KVBufferHandle OutputBufferHndl,float** OutputArray,
+                                                         int Nx,int Ny,MedianDetails* Details);
+
+//  Median.comp's specialization constant 2 is the box size, which lets it use fixed size code
+//  - a selection network for 3x3, 5x5 and 7x7 boxes, and a loop with a constant trip count
+//  for the others - for the full boxes away from the edges. BoxNpix() returns the value to
+//  use for that constant, which is zero - use the general code everywhere - if the box is
+//  too big for the shader.
+
+static uint32_t BoxNpix(int Npix)
+{
+    return (Npix > 0 && Npix <= C_MaxWorkNpix) ? uint32_t(Npix) : 0;
+}
+
+//  There are six builds of Median.comp, for float or half precision buffers, or 16-bit integer
+//  input, with or without the image being loaded into shared memory tiles, and a seventh, for
+//  float buffers loaded into tiles using subgroup operations, if the device supports them. An
+//  eighth, for 'Bitonic', also has subgroups sort the 9x9 and 11x11 boxes. ShaderFile() returns
+//  the one to use. (A ninth, MedianIterate.spv, is only used by ComputeIterateUsingGPU().)
+
+static std::string ShaderFile(bool Half,bool Tiled,bool Int16 = false,bool Subgroups = false,
+                                                                        bool Bitonic = false)
+{
+    if (Bitonic && !Half && !Int16) return "MedianTiledBitonic.spv";
+    if (Tiled && Subgroups && !Half && !Int16) return "MedianTiledSG.spv";
+    return std::string(Tiled ? "MedianTiled" : "Median") + (Half ? "16" : "") +
+                                                            (Int16 ? "Int16" : "") + ".spv";
+}
+
+void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,bool Autotune,bool Tiled,
+                                        const std::string& DebugLevels,MedianDetails* Details,
+                  int Warmup,BenchReport* Bench,KVVulkanFramework* Prepared,bool Keep)
 {
     bool StatusOK = true;
 
     MsecTimer SetupTimer;
     TheDebugHandler.Log("Setup","GPU setup starting");
+    TraceRecorder& Tracer = TraceRecorder::Global();
+    Tracer.Begin("GPU setup","Median");
     
     //  To make things easier for the CPU code, we will create an array of the addresses of
     //  the rows of the input buffer - this allows the use of an ArrayRows[Iy][Ix] syntax when
@@ -469,16 +2238,91 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     //  This is a basic Vulkan initialisation sequence - it creates a Vulkan 'instance', used
     //  to interact with Vulkan, locates a suitable GPU device (with is often the only one
     //  available) and opens that, creating a 'logical device' that represents the selected GPU.
+    //  With 'WarmStart', StartWarmGPU() has already started all that in another thread, and
+    //  we're passed the Framework it set up, which we take over, and just wait for it. With
+    //  'Vary', Keep is set, and the caller keeps the Framework to use again.
     
-    KVVulkanFramework Framework;
-    Framework.SetDebugSystemName("Vulkan");
-    Framework.SetDebugLevels(DebugLevels);
-    Framework.EnableValidation(Validate);
-    Framework.CreateVulkanInstance(StatusOK);
-    Framework.FindSuitableDevice(StatusOK);
-    Framework.CreateLogicalDevice(StatusOK);
+    std::unique_ptr<KVVulkanFramework> Owned(Prepared ? nullptr : new KVVulkanFramework);
+    if (Prepared && !Keep) Owned.reset(Prepared);
+    KVVulkanFramework& Framework = Prepared ? *Prepared : *Owned;
+    if (Prepared) {
+        Framework.WaitForDeviceSetup(StatusOK);
+    } else {
+        Framework.SetDebugSystemName("Vulkan");
+        Framework.SetDebugLevels(DebugLevels);
+        Framework.EnableValidation(Validate);
+        Framework.CreateVulkanInstance(StatusOK);
+        Framework.FindSuitableDevice(StatusOK);
+        Framework.CreateLogicalDevice(StatusOK);
+    }
     TheDebugHandler.Logf("Setup","GPU setup device created at %.3f msec",SetupTimer.ElapsedMsec());
     
+    //  With 'Native', a 16-bit integer image is given to the GPU as it was read, and scaled by
+    //  the MedianInt16 shader. That needs 16-bit storage, and without it SetInputArray() has to
+    //  scale it on the CPU instead.
+    
+    bool Int16 = false;
+    if (Details->RawData && StatusOK) {
+        Int16 = Framework.DeviceSupports16BitStorage();
+        if (!Int16) printf ("GPU does not support 16-bit storage, so 'Native' is ignored.\n\n");
+    }
+    
+    //  With 'Tiled', the version of the shader that uses subgroup votes while loading the tile
+    //  is used if the device supports them in compute shaders.
+    
+    bool Subgroups = false;
+    if (Tiled && StatusOK) {
+        Subgroups = Framework.DeviceSupportsSubgroupOperations(VK_SUBGROUP_FEATURE_BASIC_BIT |
+                                                                 VK_SUBGROUP_FEATURE_VOTE_BIT);
+    }
+    
+    //  With 'Bitonic', MedianTiledBitonic.spv has each subgroup sort the 9x9 and 11x11 boxes
+    //  of its threads together. That needs subgroup shuffles as well, and a subgroup size that
+    //  divides both the 128 values sorted and the workgroup, so every subgroup is full. The
+    //  size is passed to the shader as specialization constant 4. The workgroup can't be
+    //  autotuned, as not every shape tried would be a whole number of subgroups.
+    
+    bool Bitonic = false;
+    uint32_t SubgroupSize = 0;
+    if (Details->GPUBitonic && StatusOK && !Int16) {
+        Bitonic = Framework.DeviceSupportsSubgroupOperations(VK_SUBGROUP_FEATURE_BASIC_BIT |
+                   VK_SUBGROUP_FEATURE_VOTE_BIT | VK_SUBGROUP_FEATURE_SHUFFLE_BIT,&SubgroupSize);
+        if (Bitonic && (SubgroupSize < 4 || SubgroupSize > 128 || (128 % SubgroupSize) != 0 ||
+                          (C_WorkGroupSize * C_WorkGroupSize) % SubgroupSize != 0)) {
+            Bitonic = false;
+        }
+        if (!Bitonic) {
+            printf ("GPU subgroups can't be used to sort the boxes, so 'Bitonic' is ignored.\n\n");
+        } else if (Autotune) {
+            printf ("'Autotune' is ignored with 'Bitonic'.\n\n");
+            Autotune = false;
+        }
+    }
+    
+    //  With 'Layout', the image is repacked into the layout given, and the shader reads it
+    //  through the matching index calculation, selected by specialization constant 3. The
+    //  16-bit integers given to the GPU for 'Native' aren't repacked.
+    
+    ImageLayout Layout(Int16 ? ImageLayout::None : Details->Layout,Nx,Ny);
+    if (Int16 && Details->Layout != ImageLayout::None) {
+        printf ("'Layout' is ignored with 'Native'.\n\n");
+    }
+    
+    //  A shader can only see as much of a storage buffer as the device's maxStorageBufferRange
+    //  - often 4 GBytes, sometimes much less - so a larger image can't be filtered in one go.
+    //  'Tiles' filters an image from a file a tile at a time, and doesn't have that problem.
+    //  (A repacked image can be a little larger, as it is padded out to whole blocks.)
+    
+    VkDeviceSize ImageBytes = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    VkDeviceSize PackedBytes = VkDeviceSize(Layout.Size()) * sizeof(float);
+    if (StatusOK && std::max(ImageBytes,PackedBytes) > Framework.GetMaxStorageBufferRange()) {
+        printf ("Image of %llu bytes is larger than the GPU's largest storage buffer "
+                "(%llu bytes). Use 'Tiles' to filter it in pieces.\n\n",
+                (unsigned long long)ImageBytes,
+                                     (unsigned long long)Framework.GetMaxStorageBufferRange());
+        StatusOK = false;
+    }
+    
     //  Create a device buffer to contain the input data array. The options specify that the
     //  buffer is to be used for storage (as opposed to uniform values) and 'shared', ie visible
     //  to both the GPU and the CPU (since we need to use the CPU to set its initial values.)
@@ -487,39 +2331,101 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     //  a call to SetInputArray(). We could use "STAGED_CPU" instead of "SHARED", which sets up
     //  a CPU-local buffer and a GPU-local buffer which have to be explicitly synched. This may
     //  provide better performance with some discrete GPUs.
+    //
+    //  If the data came from a FITS file, it is already in memory allocated by
+    //  AllocateImportableMemory(), and we use an "IMPORTED" buffer instead, which lets the GPU
+    //  use that memory as it is. (If the GPU can't do that, ImportBuffer() copies the data into
+    //  a shared buffer for us.) Either way, the data is already in place, so there's no need
+    //  to call SetInputArray(). The same goes for the 16-bit integers read for 'Native', which
+    //  is where the halving of the buffer size comes from.
+    //
+    //  With 'Layout', the input buffer holds the repacked image instead, so it is a "SHARED"
+    //  buffer of its own, and the image is packed into it from wherever it is. This is done
+    //  once, as the image is loaded, and isn't part of the timed passes. The CPU only writes
+    //  that buffer, so it can go into device-local memory if the CPU can see any.
     
-    int Length = Nx * Ny * sizeof(float);
+    StartupPhase BufferPhase("GPU buffers");
+    VkDeviceSize Length = ImageBytes;
+    VkDeviceSize Bytes;
     KVVulkanFramework::KVBufferHandle InputBufferHndl;
-    InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE","SHARED",StatusOK);
-    Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
-    
-    long Bytes;
-    float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
-    InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
-    SetInputArray(InputArray,Nx,Ny,Details);
+    if (Layout.Active()) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.SetBufferHostWriteOnly(InputBufferHndl,StatusOK);
+        Framework.CreateBuffer(InputBufferHndl,PackedBytes,StatusOK);
+        float* PackedAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+        float* ImageData = Details->InputData;
+        float* MadeData = nullptr;
+        if (!ImageData && StatusOK) {
+            MadeData = (float*)malloc(size_t(ImageBytes));
+            float** MadeRows = CreateRowAddrs(MadeData,Nx,Ny);
+            SetInputArray(MadeRows,Nx,Ny,Details);
+            free(MadeRows);
+            ImageData = MadeData;
+        }
+        if (StatusOK && PackedAddr && ImageData) {
+            MsecTimer PackTimer;
+            Layout.Pack(ImageData,PackedAddr);
+            printf ("Image repacked in %s layout for the GPU in %.3f msec\n",
+                         ImageLayout::Name(Layout.GetMode()),PackTimer.ElapsedMsec());
+        }
+        if (MadeData) free(MadeData);
+    } else if (Int16) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,Details->RawData,
+                                  VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(short),
+                                                                                   StatusOK);
+    } else {
+        if (Details->InputData) {
+            InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+            Framework.ImportBuffer(InputBufferHndl,Details->InputData,Length,StatusOK);
+        } else {
+            InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+            Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+        }
+        float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+        InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
+        if (!Details->InputData) SetInputArray(InputArray,Nx,Ny,Details);
+    }
     
     //  And now a device buffer for the output data array. This is essentially the same as for
     //  the input buffer. This will have to be accessed on the CPU side by CheckResults(),
-    //  so we use CreateRowAddrs() to set up for this. (Here, "SHARED" could be replaced by
-    //  "STAGED_GPU" for buffers that need explicit synch, as the GPU creates the data that
-    //  then has to be copied to the CPU.)
+    //  so we use CreateRowAddrs() to set up for this. It is a "READBACK" buffer, which is
+    //  shared, but is put into cached memory if possible, as the CPU reads from it. (Here,
+    //  "READBACK" could be replaced by "STAGED_GPU" for buffers that need explicit synch, as
+    //  the GPU creates the data that then has to be copied to the CPU.)
     
     KVVulkanFramework::KVBufferHandle OutputBufferHndl;
     OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
-                                                                            "SHARED",StatusOK);
+                                                                          "READBACK",StatusOK);
     Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
     float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
     OutputArray = CreateRowAddrs(OutputBufferAddr,Nx,Ny);
     
     //  Create a uniform buffer - visible to all the GPU threads - to hold parameters we want
-    //  to pass to the GPU code. In this case, the values of Nx, Ny and Npix. The layout of this
-    //  structure must match that defined in the Median.comp GPU shader code.
+    //  to pass to the GPU code. In this case, the values of Nx, Ny and Npix, and the details
+    //  of the band of rows to filter and of the rows in the input buffer, which here are the
+    //  whole image. The layout of this structure must match that defined in the Median.comp
+    //  GPU shader code. The scaling values at the end are only used by the MedianInt16 builds.
     
     struct MedianArgs {
         int Nx;
         int Ny;
         int Npix;
-    } Parameters = {Nx,Ny,Npix};
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+        float Bscale;
+        float Bzero;
+        int BlankValue;
+        int CheckBlank;
+    } Parameters = {Nx,Ny,Npix,0,Ny,0,Details->HasBlanks,0,Details->RawScale,Details->RawZero,
+                                                      Details->RawBlank,Details->RawHasBlank};
     
     long SizeInBytes = sizeof(MedianArgs);
     KVVulkanFramework::KVBufferHandle UniformBufferHndl;
@@ -530,10 +2436,13 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     if (StatusOK && UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,Bytes);
     
     TheDebugHandler.Logf("Setup","GPU setup buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+    ReportGPUMemory(Framework,StatusOK);
+    BufferPhase.End();
     
     //  Given the handles to those three buffer descriptions, we can specify the layout of the
     //  descriptor set that will be needed to describe them to the GPU shader.
     
+    StartupPhase DescriptorPhase("GPU descriptors");
     std::vector<KVVulkanFramework::KVBufferHandle> Handles;
     Handles.push_back(UniformBufferHndl);
     Handles.push_back(InputBufferHndl);
@@ -553,15 +2462,7 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
     Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
     TheDebugHandler.Logf("Setup","GPU descriptors created at %.3f msec",SetupTimer.ElapsedMsec());
-
-    //  And, given the set layout, we can specify the layout of the compute pipeline that will
-    //  run the shader, and we can create it.
-    
-    VkPipelineLayout ComputePipelineLayout;
-    VkPipeline ComputePipeline;
-    Framework.CreateComputePipeline("Median.spv","main",
-                                    &SetLayout,&ComputePipelineLayout,&ComputePipeline,StatusOK);
-    TheDebugHandler.Logf("Setup","GPU pipeline created at %.3f msec",SetupTimer.ElapsedMsec());
+    DescriptorPhase.End();
 
     //  We can also create the one compute queue we will need
     
@@ -575,16 +2476,46 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     Framework.CreateCommandPool(&CommandPool,StatusOK);
     Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
     
-    //  Tweaking the arrangement of GPU threads and thread groups can be tricky, but if
-    //  we assume the GPU shader code has set up a hard-coded local workgroup size of
-    //  {C_WorkGroupSize,C_WorkGroupSize,1}, then the following values for _workGroupCounts
-    //  cover the whole image (with some possible spillover at the edges that the shader
-    //  code has to allow for).
+    //  Tweaking the arrangement of GPU threads and thread groups can be tricky. By default we
+    //  use a local workgroup size of {C_WorkGroupSize,C_WorkGroupSize,1}, but each thread here
+    //  needs a sizeable private work array, and a smaller shape may well do better on some
+    //  GPUs. If autotuning was requested we let the Framework time the shader with a number
+    //  of different shapes on the actual image and use the fastest.
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    if (Autotune) {
+        std::vector<uint32_t> BoxConstant = {BoxNpix(Npix),uint32_t(Layout.ShaderCode())};
+        Framework.AutotuneWorkGroupSize(ShaderFile(false,Tiled,Int16,Subgroups),"main",&SetLayout,
+                &DescriptorSet,uint32_t(Nx),uint32_t(Ny),CommandPool,ComputeQueue,BoxConstant,
+                                                                     WorkGroupSize,StatusOK);
+        TheDebugHandler.Logf("Setup","Autotuned work group size %d, %d at %.3f msec",
+                                 WorkGroupSize[0],WorkGroupSize[1],SetupTimer.ElapsedMsec());
+    }
+    
+    //  And, given the set layout, we can specify the layout of the compute pipeline that will
+    //  run the shader, and we can create it, passing the workgroup size as specialization
+    //  constants, along with the constant that selects any selection network for the box,
+    //  the one for the layout of the input image, and for 'Bitonic' the subgroup size.
+    
+    VkPipelineLayout ComputePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline ComputePipeline = VK_NULL_HANDLE;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix),
+                                                                uint32_t(Layout.ShaderCode())};
+    if (Bitonic) SpecConstants.push_back(SubgroupSize);
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled,Int16,Subgroups,Bitonic),"main",
+               &SetLayout,&ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    TheDebugHandler.Logf("Setup","GPU pipeline created at %.3f msec",SetupTimer.ElapsedMsec());
+    
+    //  The following values for WorkGroupCounts cover the whole image (with some possible
+    //  spillover at the edges that the shader code has to allow for).
     
     uint32_t WorkGroupCounts[3];
-    WorkGroupCounts[0] = (uint32_t(Nx) + C_WorkGroupSize - 1)/C_WorkGroupSize;
-    WorkGroupCounts[1] = (uint32_t(Ny) + C_WorkGroupSize - 1)/C_WorkGroupSize;
+    WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
     WorkGroupCounts[2] = 1;
+    TheDebugHandler.Logf("Setup","Work group size %d, %d, %d",WorkGroupSize[0],WorkGroupSize[1],1);
+    Tracer.End("GPU setup","Median");
+    EndOfStartup();
     if (StatusOK) {
         TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
     } else {
@@ -595,27 +2526,77 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     //  This sets up the pipeline for the GPU calculation and runs it. Basically, we have to
     //  record the command buffer - command buffers are 'use once' - and run it. If we have
     //  staged buffers, they need to be synch'ed - the SyncBuffer() calls are null operations
-    //  for shared buffers.
+    //  for shared buffers. With dispatch timing enabled, the command buffer also records GPU
+    //  timestamps, so we can see how much of the time is spent in the shader itself.
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    
+    //  With 'Settle', the filter is run until its times settle down, using the kernel time
+    //  where the GPU records one. These passes count as warm-up passes, but aren't timed.
     
+    int SettlePasses = 0;
+    if (SettleMsec > 0 && Nrpt > 0 && StatusOK) {
+        MsecSettle Settle(SettleMsec);
+        bool Settling = true;
+        while (Settling && StatusOK) {
+            MsecTimer PassTimer;
+            Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+            Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+            Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+            float DispatchMsec;
+            bool Timed = Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK);
+            Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+            Settling = !Settle.Record(Timed ? DispatchMsec : PassTimer.ElapsedMsec());
+        }
+        Settle.Report("GPU warm-up");
+        SettlePasses = Settle.Passes();
+    }
+    
+    MsecStats LoopStats;
+    MsecStats KernelStats;
+    LoopStats.SetWarmup(Warmup);
+    KernelStats.SetWarmup(Warmup);
+    LoopStats.AddWarmup(SettlePasses);
+    KernelStats.AddWarmup(SettlePasses);
     MsecTimer ComputeTimer;
     
     for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
         
         MsecTimer LoopTimer;
+        TraceScope PassTrace("GPU pass","Median");
         
         Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
 
         Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
                                   ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
-        TheDebugHandler.Logf("Timing","Command buffer recorded at %.3f msec",
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"Command buffer recorded at %.3f msec",
                              LoopTimer.ElapsedMsec());
         
         Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        double DoneUsec = Tracer.NowUsec();
+        
+        //  The GPU kernel time is a duration, not a time on the CPU's clock, so the trace
+        //  shows it ending when the CPU saw the command buffer complete.
+        
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"GPU kernel took %.3f msec",DispatchMsec);
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+            KernelStats.Record(DispatchMsec);
+            Tracer.Complete("Median kernel","GPU",DoneUsec - DispatchMsec * 1000.0,
+                                                                          DispatchMsec * 1000.0);
+        }
         
         Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
 
-        TheDebugHandler.Logf("Timing","Compute complete at %.3f msec",LoopTimer.ElapsedMsec());
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
         if (!StatusOK) break;
+        LoopStats.Record(LoopTimer.ElapsedMsec());
     }
     
     //  Report on the timing, and check that we got it right.
@@ -624,11 +2605,35 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
         float Msec = ComputeTimer.ElapsedMsec();
         printf ("GPU took %.3f msec\n",Msec);
         printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        LoopStats.Report("GPU iterations");
+        if (SettlePasses > 0) {
+            printf ("GPU times spread %.2f%%",100.0 * LoopStats.Spread());
+            if (KernelStats.Count() > 0) printf (", kernel %.2f%%",100.0 * KernelStats.Spread());
+            printf (" (standard deviation / mean)\n");
+        }
+        if (Bench && LoopStats.Count() > 0) {
+            std::string Device,Driver;
+            Framework.GetDeviceDescription(&Device,&Driver);
+            Bench->SetContext("Median","Vulkan",Device,Driver);
+            std::string Test = "GPU " + std::to_string(Npix) + "x" + std::to_string(Npix);
+            if (Tiled) Test += " tiled";
+            if (Bitonic) Test += " bitonic";
+            if (Layout.Active()) Test += std::string(" ") + ImageLayout::Name(Layout.GetMode());
+            Bench->AddRow(Test,Nx,Ny,LoopStats,&KernelStats);
+        }
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
         bool FromGPU = true;
         if (Nrpt <= 0) {
             printf ("No values computed using GPU, as number of repeats set to zero.\n");
         } else {
-            NoteResults(OutputArray,FromGPU,Nx,Ny,Details);
+            bool Checked = false;
+            if (Details->GPUCheck && Details->CPUOutputData) {
+                Checked = CompareResultsOnGPU(Framework,OutputBufferHndl,OutputArray,Nx,Ny,Details);
+            }
+            if (!Checked) NoteResults(OutputArray,FromGPU,Nx,Ny,Details);
         }
     } else {
         if (Nrpt > 0) printf ("GPU execution failed.\n");
@@ -640,250 +2645,4768 @@ void ComputeUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,const std::st
     if (OutputArray) free(OutputArray);
     if (InputArray) free(InputArray);
     
-    //  The Framework destructor will release all the various Vulkan resources.
+    //  The Framework destructor will release all the various Vulkan resources - unless the
+    //  caller is keeping it, in which case the buffers and the pipeline are released now, so
+    //  their memory can be used for the next combination.
+    
+    if (Keep) {
+        for (KVVulkanFramework::KVBufferHandle Hndl : Handles) {
+            bool ReleaseOK = true;
+            Framework.DeleteBuffer(Hndl,ReleaseOK);
+        }
+        Framework.DestroyComputePipeline(ComputePipelineLayout,ComputePipeline);
+    }
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                    C P U  c o d e
+//                      C o m p a r e  R e s u l t s  O n  G P U
 //
-//  This code performs the 'Median' operation using the CPU, and is designed to do exactly what
-//  ComputeUsingGPU() does, but using the CPU. The main routine called is ComputeUsingCPU(). Just
-//  like ComputeUsingGPU(), it is passed the dimensions of the arrays to use. It allocates an array
-//  of floats, Nx by Ny, and calls SetInputArray() to initialise it. It also creates an output
-//  array of the same size and performs the basic 'Median' operation to set the output array values
-//  based on those of the input array. It has to be passed the size of the median box in pixels
-//  (Npix, which should be an odd number).It is also passed the repeat count for the operation
-//  (Nrpt) and performs the operation the number of times specified in Nrpt. After performing the
-//  operation for the final time, it calls NoteResults() to allow the main code to compare the
-//  results with those of the GPU and to save the result to any output FITS file. It needs to
-//  be passed the program's MedianDetails structure so it can pass this on in turn to NoteResults().
-//  The CPU code can make use of multiple CPU threads. If Threads is passed as zero, it uses the
-//  maximum available number of CPU threads. Otherwise, Threads is taken as the maximum number of
-//  CPU threads to use.
+//  This makes the comparison NoteResults() makes between the GPU's result and the CPU's, but on
+//  the GPU, using MedianCheck.spv, for 'GpuCheck'. For a large image, having the CPU work
+//  through both results can take longer than the filter itself, while on the GPU it costs
+//  little more than one pass through the image. The shader reduces the comparison to the
+//  number of values that don't match, the largest difference and the index of the first value
+//  that doesn't match, and those three values are all that has to be read back. The CPU only
+//  looks at the two results to report that one value.
 //
-//  The basic operation is performed by ComputeRangeUsingCPU() and you could do the whole thing
-//  just with one call to ComputeRangeUsingCPU() with the Y-range parameters Iyst and Iyen set
-//  to 0 and Ny respectively. That would handle the whole image using one CPU thread. However, as
-//  this operation will probably gain by using CPU multi-threading, the main routine actually
-//  calls OnePassUsingCPU() for each iteration. This then handles the threading, being able to
-//  split the job up so that multiple threads each handle a subset of the rows of the image (ie
-//  splitting up in Y). It starts up a number of threads, each running ComputeRangeUsingCPU()
-//  over a different set of image rows.
+//  It is passed the Framework used for the filter, the handle of its output buffer, the row
+//  addresses the CPU uses for that, and the program's MedianDetails, whose CPUOutputData has
+//  the CPU's result. It returns true once it has reported the result of the comparison, and
+//  false if it couldn't be made on the GPU, in which case the caller falls back on
+//  NoteResults(). As NoteResults() isn't then passed the GPU's result, the output file is
+//  written from the CPU's, which matches it to within the differences the check allows.
 
-void ComputeUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,MedianDetails* Details)
+bool CompareResultsOnGPU(KVVulkanFramework& Framework,
+                    KVVulkanFramework::KVBufferHandle OutputBufferHndl,float** OutputArray,
+                                                          int Nx,int Ny,MedianDetails* Details)
 {
-    //  Forward declaration for the routine that does most of the work.
-    
-    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray);
-    
-    //  Create the two arrays we need, one for the input data, one for the output. To make things
-    //  easier for ourselves, setup two arrays that contain the addresses of the start of the
-    //  rows for the two arrays. This lets us use an InputArray[Iy][Ix] syntax instead of
-    //  having to calculate offsets as ArrayData[Iy * Nx + Iy]. It means that InputArray is not
-    //  actually the address of the allocated memory for the array itself. It's the address of
-    //  the array of row addresses - this is the trick used by the C version of Numerical Methods,
-    //  and I've always found it very effective.
-    
-    float* InputArrayData = (float*)malloc(Nx * Ny * sizeof(float));
-    float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
-    float* OutputArrayData = (float*)malloc(Nx * Ny * sizeof(float));
-    float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
-    TheDebugHandler.Logf("Setup","CPU arrays created, %d by %d",Nx,Ny);
-    
-    //  Initialise the input array;
-    
-    SetInputArray(InputArray,Nx,Ny,Details);
-
-    //  See how many threads the hardware supports. If Threads was passed as zero, use this
-    //  maximum number of threads. Otherwise use the number passed in Threads, if that many
-    //  are available.
+    bool StatusOK = true;
     
-    int MaxThreads = std::thread::hardware_concurrency();
-    if (MaxThreads <= 0) MaxThreads = 1;
-    if (Threads <= 0) Threads = MaxThreads;
-    if (Threads > MaxThreads) Threads = MaxThreads;
-    TheDebugHandler.Logf("Setup","CPU using %d threads out of maximum of %d\n",Threads,MaxThreads);
+    //  The check runs as a KVComputeKernel that uses the existing output buffer as it is, and
+    //  adds the buffers for the CPU's result and the results of the check. The layout of the
+    //  arguments has to match that defined in MedianCheck.comp. The tolerance is the one used
+    //  by ResultsMatch() - this is only used for ComputeUsingGPU(), which never uses 'Half'.
     
-    MsecTimer LoopTimer;
+    struct CheckArgs {
+        int Nx;
+        int Ny;
+        float Tolerance;
+    } Args = {Nx,Ny,std::max(Details->HistogramTolerance,Details->CheckTolerance)};
     
-    //  Repeat a single pass through the whole image, as many times as specified by the repeat
-    //  count. OnePassUsingCPU is passed the number of threads specified (with zero meaning
-    //  use as many as are available) and returns the number actually used.
+    MsecTimer CheckTimer;
+    KVComputeKernel<CheckArgs> Kernel(Framework);
+    Kernel.UseBuffer(OutputBufferHndl,"IN");
     
-    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
-        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,Npix,OutputArray);
-    }
+    //  The CPU's result is in memory allocated by malloc(), which the GPU can import if it
+    //  happens to be suitably aligned. If it isn't, ImportBuffer() would copy it anyway, but
+    //  with a warning meant for memory that should have come from AllocateImportableMemory(),
+    //  so here the copy is made explicitly.
     
-    //  Report on the timing, and check that we got it right.
-
-    float Msec = LoopTimer.ElapsedMsec();
-    printf ("CPU took %.3f msec\n",Msec);
-    printf ("Average msec per iteration for CPU = %.3f (threads = %d)\n",
-                                                           Msec / float(Nrpt),Threads);
-    bool FromGPU = false;
-    if (Nrpt <= 0) {
-        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    float* Reference = Details->CPUOutputData;
+    VkDeviceSize Bytes = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    long Alignment = Framework.GetHostImportAlignment();
+    KVVulkanFramework::KVBufferHandle ReferenceHndl;
+    if (Alignment > 0 && uintptr_t(Reference) % uintptr_t(Alignment) == 0) {
+        ReferenceHndl = Kernel.AddBuffer(C_ReferenceBufferBinding,"STORAGE","IMPORTED","IN",
+                                                                                   StatusOK);
+        Framework.ImportBuffer(ReferenceHndl,Reference,Bytes,StatusOK);
     } else {
-        NoteResults(OutputArray,FromGPU,Nx,Ny,Details);
+        ReferenceHndl = Kernel.AddBuffer(C_ReferenceBufferBinding,"STORAGE","SHARED","IN",
+                                                                                   StatusOK);
+        void* ReferenceAddr = Kernel.SizeBuffer(ReferenceHndl,Bytes,StatusOK);
+        if (StatusOK && ReferenceAddr) memcpy(ReferenceAddr,Reference,size_t(Bytes));
     }
-    printf ("\n");
+    KVVulkanFramework::KVBufferHandle CheckBufferHndl =
+                      Kernel.AddBuffer(C_CheckBufferBinding,"STORAGE","SHARED","OUT",StatusOK);
+    uint32_t* Check = (uint32_t*)Kernel.SizeBuffer(CheckBufferHndl,3 * sizeof(uint32_t),StatusOK);
+    if (StatusOK && Check) {
+        Check[0] = 0;
+        Check[1] = 0;
+        Check[2] = 0xffffffff;
+    }
+    Kernel.Create(C_CheckShader,C_WorkGroupSize,C_WorkGroupSize,StatusOK);
+    Kernel.SetGrid(uint32_t(Nx),uint32_t(Ny));
+    Kernel.Run(Args,StatusOK);
+    if (!StatusOK || Check == nullptr) {
+        printf ("Unable to compare the results on the GPU, comparing them using the CPU.\n");
+        return false;
+    }
+    printf ("GPU check took %.3f msec\n",CheckTimer.ElapsedMsec());
     
-    //  Release the arrays used to hold the row addresses for the two arrays, and the array
-    //  data.
+    //  Report the results much as NoteResults() does, but with the first value that doesn't
+    //  match, rather than the one with the largest difference, which the GPU doesn't locate.
     
-    if (OutputArray) free(OutputArray);
-    if (InputArray) free(InputArray);
-    if (OutputArrayData) free(OutputArrayData);
-    if (InputArrayData) free(InputArrayData);
+    float MaxDiff;
+    memcpy(&MaxDiff,&Check[1],sizeof(float));
+    if (Check[0] > 0) {
+        int Iy = int(Check[2] / uint32_t(Nx));
+        int Ix = int(Check[2] % uint32_t(Nx));
+        printf ("Error: %u values differ, largest difference %g, first at [%d][%d] "
+                "%8.1f (GPU) v %8.1f (CPU)\n",Check[0],MaxDiff,Iy,Ix,OutputArray[Iy][Ix],
+                                                               Reference[size_t(Iy) * Nx + Ix]);
+    } else {
+        printf ("Data from CPU and GPU match OK\n");
+        if (MaxDiff > 0.0) printf ("Within tolerance, largest difference %g\n",MaxDiff);
+    }
+    return true;
 }
 
-//  ComputeRangeUsingCPU() performs the CPU median calculation over a range of lines of the
-//  image - specified by Iyst and Iyen (starting from 0) - but only once and using a single thread.
+//  ------------------------------------------------------------------------------------------------
+//
+//                           R e p o r t  G P U  M e m o r y
+//
+//  Lists the memory the Framework has allocated from each of the GPU's memory heaps, and how
+//  much of each heap's budget is in use. This is done if the GPU buffers couldn't be created -
+//  a large enough image simply won't fit, and this shows by how much - or with 'Setup' debug.
 
-void ComputeRangeUsingCPU(float** InputArray,int Nx,int Ny,int Iyst,
-                                   int Iyen,int Npix,float** OutputArray)
+void ReportGPUMemory(KVVulkanFramework& Framework,bool BuffersOK)
 {
-    //  Forward definition of routine to calculate median for a specific array location, Ix,Iy.
-    
-    float MedianElement(float** InputArray,int Nx,int Ny,int Ix,int Iy,int Npix);
-
-    for (int Iy = Iyst; Iy < Iyen; Iy++) {
-        for (int Ix = 0; Ix < Nx; Ix++) {
-            OutputArray[Iy][Ix] = MedianElement(InputArray,Nx,Ny,Ix,Iy,Npix);
-        }
+    if (BuffersOK && !TheDebugHandler.Active("Setup")) return;
+    bool StatsOK = true;
+    std::vector<KVVulkanFramework::KVHeapStats> Stats;
+    Framework.GetMemoryStats(&Stats,StatsOK);
+    const double MByte = 1024.0 * 1024.0;
+    for (const KVVulkanFramework::KVHeapStats& Heap : Stats) {
+        printf ("GPU memory heap %u%s: %.1f MB allocated, %.1f MB used, %.1f of %.1f MB "
+                "budget in use%s\n",Heap.HeapIndex,Heap.DeviceLocal ? " (local)" : "",
+                double(Heap.Allocated) / MByte,double(Heap.Used) / MByte,
+                double(Heap.Usage) / MByte,double(Heap.Budget) / MByte,
+                Heap.BudgetReported ? "" : " (estimated)");
     }
 }
 
-//  OnePassUsingCPU() performs the CPU median calculation over the whole image, only once, using
-//  up to a specified number (Threads) of CPU threads. If Threads is zero, it uses the maximum
-//  available number of threads. It returns the number of threads actually used.
+//  ------------------------------------------------------------------------------------------------
+//
+//                             S t a r t  W a r m  G P U
+//
+//  For 'WarmStart', this creates the Framework that ComputeUsingGPU() will use, and starts
+//  the creation of the Vulkan instance and the GPU device in another thread, so that can go on
+//  while the FITS file is read. It also reads the shader files ComputeUsingGPU() is going to
+//  need - which, with 'Native', may be either of two - since that too can be done before the
+//  device exists. The Framework returned should be passed to ComputeUsingGPU(), which takes
+//  it over and waits for the setup to finish.
 
-int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray)
+KVVulkanFramework* StartWarmGPU(bool Validate,bool Tiled,bool Native,
+                                                                 const std::string& DebugLevels)
 {
-    //  If we're only using one thread, do the calculation in the main thread, avoiding any
-    //  threading overheads.
+    KVVulkanFramework* Framework = new KVVulkanFramework;
+    Framework->SetDebugSystemName("Vulkan");
+    Framework->SetDebugLevels(DebugLevels);
+    Framework->EnableValidation(Validate);
+    Framework->StartDeviceSetup();
     
-    if (Threads == 1) {
-        ComputeRangeUsingCPU(InputArray,Nx,Ny,0,Ny,Npix,OutputArray);
-    } else {
-        
-        //  If threading, create the specified number of threads, and divide the image rows
-        //  between them.
-        
-        std::thread* ThreadList = new std::thread[Threads];
-        int Iy = 0;
-        int Iyinc = Ny / Threads;
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread] = std::thread (ComputeRangeUsingCPU,
-                                        InputArray,Nx,Ny,Iy,Iy+Iyinc,Npix,OutputArray);
-            Iy += Iyinc;
-        }
-        
-        //  Wait for all the threads to complete.
-        
-        for (int IThread = 0; IThread < Threads; IThread++) {
-            ThreadList[IThread].join();
-        }
-        
-        //  If there were rows left unhandled (because Ny was not a multiple of NThreads),
-        //  finish them off in the main thread.
-        
-        if (Iy < Ny) {
-            ComputeRangeUsingCPU(InputArray,Nx,Ny,Iy,Ny,Npix,OutputArray);
-        }
-
-	delete[] ThreadList;
-    }
-    return Threads;
+    //  A file that can't be read here is simply read again, and the error reported, when the
+    //  pipeline is created.
+    
+    bool ReadOK = true;
+    Framework->PreloadShaderFile(ShaderFile(false,Tiled),ReadOK);
+    ReadOK = true;
+    if (Native) Framework->PreloadShaderFile(ShaderFile(false,Tiled,true),ReadOK);
+    return Framework;
 }
 
 //  ------------------------------------------------------------------------------------------------
 //
-//                                    M e d i a n  c o d e
+//                         G P U  c o d e  ( h a l f  p r e c i s i o n )
 //
-//  These routines are essentially the same as the code run by the GPU to calculate the median
-//  values for the elements of the array. The CPU code above calls MedianElement() for each
-//  element of the array. It collects the values in the box surrounding that element and passes
-//  them to CalcMedian(), which works out the median of the values passed to it. Note that
+//  ComputeUsingGPUHalf() does the same as ComputeUsingGPU(), but holds the image on the GPU in
+//  half precision, using Median16.spv - Median.comp compiled with HALF_STORAGE defined - so
+//  each pixel is only two bytes. The image, whether read from a file or generated, is converted
+//  to half precision as it is loaded into the GPU buffer, and the results are converted back
+//  to floats as they are read. The conversions are timed separately from the GPU work. Since
+//  the shader reads each pixel many times, much of that will come from the GPU's caches, so the
+//  saving may not be as dramatic as for a purely bandwidth-limited operation, but the smaller
+//  image does make better use of those caches.
+//
+//  The median of the rounded values is just the rounded median, unless the box has an even
+//  number of pixels - as can happen at the edges - when it is the average of two values. The
+//  results are flagged as being half precision in the MedianDetails, so NoteResults() knows to
+//  allow for the loss of precision when comparing them with the CPU results.
+//
+//  This needs the device to support 16-bit storage buffer access. If it doesn't, this returns
+//  false without doing anything else, and the caller can fall back on ComputeUsingGPU(). It
+//  returns true otherwise, even if something went wrong, as any error will have been reported.
+
+bool ComputeUsingGPUHalf(int Nx,int Ny,int Npix,int Nrpt,bool Validate,bool Tiled,
+                                        const std::string& DebugLevels,MedianDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU half precision setup starting");
+    
+    //  The Vulkan initialisation is just as for ComputeUsingGPU(), but once the device has been
+    //  created we can find out if it supports 16-bit storage.
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    TheDebugHandler.Logf("Setup","GPU setup device created at %.3f msec",SetupTimer.ElapsedMsec());
+    if (StatusOK && !Framework.DeviceSupports16BitStorage()) {
+        printf ("GPU does not support 16-bit storage, so 'Half' is ignored.\n\n");
+        return false;
+    }
+    
+    //  The image as floats. If it came from a file it's already in memory, otherwise it has
+    //  to be generated, in a temporary array. The output goes into another temporary array,
+    //  once it has been converted back from half precision.
+    
+    size_t Elements = size_t(Nx) * size_t(Ny);
+    float* ImageData = Details->InputData;
+    float* GeneratedData = nullptr;
+    if (ImageData == nullptr) {
+        GeneratedData = (float*)malloc(Elements * sizeof(float));
+        ImageData = GeneratedData;
+    }
+    float* OutputData = (float*)malloc(Elements * sizeof(float));
+    if (ImageData == nullptr || OutputData == nullptr) {
+        printf ("Unable to allocate the %d by %d arrays in CPU memory.\n\n",Nx,Ny);
+        if (OutputData) free(OutputData);
+        if (GeneratedData) free(GeneratedData);
+        return true;
+    }
+    float** ImageArray = CreateRowAddrs(ImageData,Nx,Ny);
+    float** OutputArray = CreateRowAddrs(OutputData,Nx,Ny);
+    if (GeneratedData) SetInputArray(ImageArray,Nx,Ny,Details);
+    
+    //  The GPU buffers, just as for ComputeUsingGPU(), except that they're half the size, and
+    //  the input can't be imported, since it has to be converted.
+    
+    VkDeviceSize Length = VkDeviceSize(Elements) * sizeof(uint16_t);
+    VkDeviceSize Bytes;
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE","SHARED",StatusOK);
+    Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    uint16_t* InputBufferAddr = (uint16_t*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+    uint16_t* OutputBufferAddr = (uint16_t*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    } Parameters = {Nx,Ny,Npix,0,Ny,0,Details->HasBlanks,0};
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    void* UniformBufferAddr = Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    if (StatusOK && UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,Bytes);
+    TheDebugHandler.Logf("Setup","GPU setup buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+    ReportGPUMemory(Framework,StatusOK);
+    
+    //  Convert the image to half precision as it goes into the GPU buffer, sharing the rows
+    //  out between the pool threads. Real data may have values too large for half precision,
+    //  which become infinities, and we count those so we can warn about them.
+    
+    float UploadMsec = 0.0;
+    std::atomic<long> OutOfRange(0);
+    if (StatusOK && InputBufferAddr) {
+        MsecTimer UploadTimer;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            long Count = 0;
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = ImageArray[Iy];
+                uint16_t* Target = InputBufferAddr + size_t(Iy) * size_t(Nx);
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    Target[Ix] = FloatToHalf(Row[Ix]);
+                    Count += (Row[Ix] > C_HalfMax || Row[Ix] < -C_HalfMax);
+                }
+            }
+            OutOfRange += Count;
+        });
+        UploadMsec = UploadTimer.ElapsedMsec();
+    }
+    if (OutOfRange > 0) {
+        printf ("Warning: %ld pixel values are too large for half precision.\n",
+                                                                          OutOfRange.load());
+    }
+    
+    //  The descriptor set, pipeline and command buffer are set up just as in ComputeUsingGPU(),
+    //  except for the shader used.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles =
+                                           {UniformBufferHndl,InputBufferHndl,OutputBufferHndl};
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(true,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    TheDebugHandler.Logf("Setup","GPU pipeline created at %.3f msec",SetupTimer.ElapsedMsec());
+    uint32_t WorkGroupCounts[3];
+    WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+    WorkGroupCounts[2] = 1;
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    //  The repeat loop is just as for ComputeUsingGPU().
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        if (!StatusOK) break;
+    }
+    float Msec = ComputeTimer.ElapsedMsec();
+    
+    //  Convert the results back to floats.
+    
+    float ReadbackMsec = 0.0;
+    if (StatusOK && OutputBufferAddr && Nrpt > 0) {
+        MsecTimer ReadbackTimer;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const uint16_t* Source = OutputBufferAddr + size_t(Iy) * size_t(Nx);
+                float* Row = OutputArray[Iy];
+                for (int Ix = 0; Ix < Nx; Ix++) Row[Ix] = HalfToFloat(Source[Ix]);
+            }
+        });
+        ReadbackMsec = ReadbackTimer.ElapsedMsec();
+    }
+    
+    //  Report on the timing, and note the results.
+
+    if (StatusOK) {
+        printf ("GPU (half precision) took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        printf ("Conversion to half precision took %.3f msec, and back %.3f msec\n",
+                                                                      UploadMsec,ReadbackMsec);
+        bool FromGPU = true;
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            Details->GPUHalf = true;
+            NoteResults(OutputArray,FromGPU,Nx,Ny,Details);
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+
+    //  Release the arrays. NoteResults() has taken its own copy of the results. The Framework
+    //  destructor will release all the various Vulkan resources.
+    
+    free(OutputArray);
+    free(ImageArray);
+    free(OutputData);
+    if (GeneratedData) free(GeneratedData);
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G P U  c o d e  ( i n  p l a c e )
+//
+//  ComputeUsingGPUInPlace() does the same as ComputeUsingGPU(), except that it uses only one
+//  buffer the size of the image, and the filtered values replace the original ones. This can't
+//  be done in a single dispatch, since the value for each pixel depends on the original values
+//  of its neighbours, which other GPU threads would be overwriting as it read them. Instead,
+//  the image is filtered in bands of rows. Before each band is filtered, the original values
+//  of its rows, and of the Npix/2 rows either side of it (the 'halo'), are copied into a small
+//  window buffer. The shader reads from that and writes the results straight into the image.
+//  The rows above the band have already been overwritten by then, but they were in the window
+//  for the previous band, so the window is rolled down: its last rows are moved to the top,
+//  and only the rows below that are copied from the image, which haven't yet been changed.
+//
+//  The window needs only as many rows as a band plus the two halos, so the GPU memory used is
+//  little more than half of what ComputeUsingGPU() needs. The bands are filtered one after the
+//  other, with the CPU rolling the window between them, so this is slower, but makes it
+//  possible to filter much larger images. As the image is overwritten, each repeat filters the
+//  result of the previous one.
+
+void ComputeUsingGPUInPlace(int Nx,int Ny,int Npix,int Nrpt,bool Validate,bool Tiled,
+                                        const std::string& DebugLevels,MedianDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU in place setup starting");
+    
+    float** ImageArray = nullptr;
+    
+    //  The same initialisation sequence as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    TheDebugHandler.Logf("Setup","GPU setup device created at %.3f msec",SetupTimer.ElapsedMsec());
+    
+    //  Work out the size of a band. It has to be at least as many rows as the halo, since the
+    //  halo rows for one band come from the window used by the last. The window holds a band
+    //  plus a halo above and below it.
+    
+    int Halo = Npix / 2;
+    VkDeviceSize RowBytes = VkDeviceSize(Nx) * sizeof(float);
+    int BandRows = int(C_InPlaceWindowBytes / RowBytes) - 2 * Halo;
+    if (BandRows < Halo + 1) BandRows = Halo + 1;
+    if (BandRows > Ny) BandRows = Ny;
+    int WindowRows = BandRows + 2 * Halo;
+    TheDebugHandler.Logf("Setup","Bands of %d rows, window of %d rows",BandRows,WindowRows);
+    
+    //  The image buffer is the shader's output buffer. It has to be "SHARED", since the CPU
+    //  both sets its initial values and copies rows from it into the window. Even if the image
+    //  came from a FITS file, it is copied into this buffer rather than being imported, as
+    //  otherwise filtering it in place would overwrite the original data, which the CPU code
+    //  may need later.
+    
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    KVVulkanFramework::KVBufferHandle ImageBufferHndl;
+    ImageBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+    Framework.CreateBuffer(ImageBufferHndl,Length,StatusOK);
+    VkDeviceSize Bytes;
+    float* ImageBufferAddr = (float*)Framework.MapBuffer(ImageBufferHndl,&Bytes,StatusOK);
+    if (StatusOK) {
+        ImageArray = CreateRowAddrs(ImageBufferAddr,Nx,Ny);
+        SetInputArray(ImageArray,Nx,Ny,Details);
+    }
+    
+    //  The window buffer is the shader's input buffer, and is also written by the CPU.
+    
+    KVVulkanFramework::KVBufferHandle WindowBufferHndl;
+    WindowBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+    Framework.CreateBuffer(WindowBufferHndl,VkDeviceSize(WindowRows) * RowBytes,StatusOK);
+    float* WindowAddr = (float*)Framework.MapBuffer(WindowBufferHndl,&Bytes,StatusOK);
+    
+    //  The uniform buffer, as for ComputeUsingGPU(), but the band details change for each band.
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    } Parameters = {Nx,Ny,Npix,0,0,0,Details->HasBlanks,0};
+    
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    MedianArgs* UniformAddr = (MedianArgs*)Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    
+    TheDebugHandler.Logf("Setup","GPU setup buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+    ReportGPUMemory(Framework,StatusOK);
+    
+    //  The descriptor set, queue, command buffer and pipeline are just as for ComputeUsingGPU().
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(WindowBufferHndl);
+    Handles.push_back(ImageBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    
+    MsecTimer ComputeTimer;
+    
+    for (int Irpt = 0; Irpt < Nrpt && StatusOK; Irpt++) {
+        
+        MsecTimer LoopTimer;
+        
+        for (int FirstRow = 0; FirstRow < Ny && StatusOK; FirstRow += BandRows) {
+            
+            //  The window holds image rows starting Halo rows above the band. Rows outside
+            //  the image are never read by the shader, so just aren't copied. For the first
+            //  band, everything comes from the image. After that, the top Halo rows are the
+            //  last Halo rows of the previous band, which are still in the window, just
+            //  below where the window for this band starts.
+            
+            int Rows = std::min(BandRows,Ny - FirstRow);
+            int WindowFirst = FirstRow - Halo;
+            int CopyFrom = std::max(WindowFirst,0);
+            if (FirstRow > 0) {
+                memmove(WindowAddr,WindowAddr + size_t(BandRows) * size_t(Nx),
+                                                             size_t(Halo) * size_t(RowBytes));
+                CopyFrom = FirstRow;
+            }
+            int CopyTo = std::min(FirstRow + Rows + Halo,Ny);
+            if (CopyTo > CopyFrom) {
+                memcpy(WindowAddr + size_t(CopyFrom - WindowFirst) * size_t(Nx),
+                      ImageArray[CopyFrom],size_t(CopyTo - CopyFrom) * size_t(RowBytes));
+            }
+            Parameters.FirstRow = FirstRow;
+            Parameters.Rows = Rows;
+            Parameters.InputFirstRow = WindowFirst;
+            *UniformAddr = Parameters;
+            
+            uint32_t WorkGroupCounts[3];
+            WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+            WorkGroupCounts[1] = (uint32_t(Rows) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+            WorkGroupCounts[2] = 1;
+            Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+            Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+            
+            float DispatchMsec;
+            if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+                KernelMsec += DispatchMsec;
+                KernelTimed = true;
+            }
+        }
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+    }
+    
+    //  Report on the timing, and check that we got it right.
+
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for GPU = %.3f (in place)\n",Msec / float(Nrpt));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        bool FromGPU = true;
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            NoteResults(ImageArray,FromGPU,Nx,Ny,Details);
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+
+    if (ImageArray) free(ImageArray);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G P U  c o d e  ( b a t c h )
+//
+//  ComputeBatchUsingGPU() filters each of a list of FITS files in turn, writing each result to a
+//  "Median_" copy of the file as usual. Setting up the GPU - creating the Vulkan instance and
+//  device, loading the shader and building the pipeline - can easily take longer than filtering
+//  a modest image, and doing that again for each file of a night's data wastes most of the time.
+//  So this does all that just once, and keeps the same buffers and descriptor set for all the
+//  files. The buffers are only resized, and the descriptor set updated, when a file has different
+//  dimensions from the last one - ResizeBuffer() only has to allocate new memory if the image is
+//  larger than any seen so far. Each file is filtered once, just as ComputeUsingGPU() would do
+//  it, and if UseCPU is set the CPU filters it too, so the results can be checked.
+//
+//  The image from each file is read straight into the input buffer, by passing ReadFitsFile()
+//  a Destination that sizes the buffers for the image and returns the input buffer's address.
+//  (It can't be imported as ComputeUsingGPU() does, since an imported buffer can't be kept from
+//  one file to the next.) Each result is written out by a FitsWriter, in the background, while
+//  the next file is read and filtered.
+
+void ComputeBatchUsingGPU(const std::vector<std::string>& Files,int Npix,bool UseCPU,
+          int Threads,bool Histogram,bool Simd,float Tolerance,bool Validate,bool Tiled,
+                                                                 const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU batch setup starting");
+
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    //  The input and output buffers can't be created until the first file has been read and
+    //  its size is known, but their details can be set up now, and that's all that's needed
+    //  for the descriptor set layout. The input buffer is "SHARED", since the CPU copies each
+    //  image into it, and the output is "READBACK", as in ComputeUsingGPU().
+    
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                        "SHARED",StatusOK);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                      "READBACK",StatusOK);
+    
+    //  The uniform buffer has the same layout as in ComputeUsingGPU(), and is updated with
+    //  the dimensions of each image.
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    };
+    
+    VkDeviceSize Bytes;
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    void* UniformBufferAddr = Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    
+    //  The descriptor set is allocated now, but can only be set up once the buffers exist.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(OutputBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    
+    //  The queue, command pool and command buffer, and the pipeline, none of which depend on
+    //  the image size. This uses the default workgroup size.
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    Framework.EnableDispatchTiming(true,StatusOK);
+    EndOfStartup();
+    if (!StatusOK) {
+        printf("GPU setup failed.\n");
+        return;
+    }
+    printf ("GPU setup took %.3f msec, once for all %d files\n\n",SetupTimer.ElapsedMsec(),
+                                                                            int(Files.size()));
+    
+    //  Now work through the files. BufferBytes is the current size of the input and output
+    //  buffers, zero until they have been created.
+    
+    VkDeviceSize BufferBytes = 0;
+    float* InputBufferAddr = nullptr;
+    float* OutputBufferAddr = nullptr;
+    int FilesFiltered = 0;
+    float TotalGPUMsec = 0.0;
+    FitsWriter Writer;
+    MsecTimer BatchTimer;
+    
+    for (const std::string& File : Files) {
+        
+        //  Each file has its own MedianDetails, set up by ReadFitsFile() and released once the
+        //  result has been written.
+        
+        MedianDetails Details;
+        Details.CheckTolerance = Tolerance;
+        std::string Filename = File;
+        int Nx = 0,Ny = 0;
+        
+        //  ReadFitsFile() reads the image straight into the input buffer. Once the file has
+        //  been opened and its dimensions are known, it calls this to get the buffer address.
+        //  If the size has changed, this resizes the buffers (or creates them, the first time),
+        //  maps them again, and points the descriptor set at them.
+        
+        auto Destination = [&](int ImageNx,int ImageNy) -> float* {
+            VkDeviceSize Length = VkDeviceSize(ImageNx) * VkDeviceSize(ImageNy) * sizeof(float);
+            if (Length != BufferBytes) {
+                if (BufferBytes == 0) {
+                    Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+                    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+                } else {
+                    Framework.ResizeBuffer(InputBufferHndl,Length,StatusOK);
+                    Framework.ResizeBuffer(OutputBufferHndl,Length,StatusOK);
+                }
+                InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+                OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+                Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+                TheDebugHandler.Logf("Setup","GPU buffers set up for %d by %d image",
+                                                                          ImageNx,ImageNy);
+                BufferBytes = Length;
+            }
+            return StatusOK ? InputBufferAddr : nullptr;
+        };
+        if (!ReadFitsFile(Filename,&Nx,&Ny,&Details,"Median_",Destination)) {
+            Shutdown(&Details);
+            if (!StatusOK) {
+                printf ("GPU buffer setup failed for %s.\n",File.c_str());
+                break;
+            }
+            printf ("%s skipped.\n\n",File.c_str());
+            continue;
+        }
+        
+        //  Set the parameters for this image.
+        
+        MedianArgs Parameters = {Nx,Ny,Npix,0,Ny,0,Details.HasBlanks,0};
+        if (UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,sizeof(Parameters));
+        
+        uint32_t WorkGroupCounts[3];
+        WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+        WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+        WorkGroupCounts[2] = 1;
+        
+        //  Filter the image, just as for one pass of ComputeUsingGPU().
+        
+        MsecTimer ComputeTimer;
+        Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        float KernelMsec = 0.0;
+        bool KernelTimed =
+                     Framework.GetDispatchTimes(nullptr,&KernelMsec,nullptr,StatusOK);
+        Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        float Msec = ComputeTimer.ElapsedMsec();
+        
+        if (StatusOK) {
+            printf ("%s, %d by %d: GPU took %.3f msec",File.c_str(),Nx,Ny,Msec);
+            if (KernelTimed) printf (" (kernel %.3f msec)",KernelMsec);
+            printf ("\n");
+            TotalGPUMsec += Msec;
+            float** OutputArray = CreateRowAddrs(OutputBufferAddr,Nx,Ny);
+            NoteResults(OutputArray,true,Nx,Ny,&Details);
+            free(OutputArray);
+            if (UseCPU) ComputeUsingCPU(Threads,Nx,Ny,Npix,1,false,Histogram,Simd,&Details);
+            Writer.Submit(Nx,Ny,&Details);
+            FilesFiltered++;
+        } else {
+            printf ("GPU execution failed for %s.\n",File.c_str());
+        }
+        Shutdown(&Details);
+        if (!StatusOK) break;
+    }
+    Writer.Finish();
+    
+    printf ("\nFiltered %d of %d files in %.3f msec, of which the GPU took %.3f msec\n\n",
+                   FilesFiltered,int(Files.size()),BatchTimer.ElapsedMsec(),TotalGPUMsec);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                        G P U  c o d e  ( p i p e l i n e d  b a t c h )
+//
+//  ComputeBatchPipelined() is the version of ComputeBatchUsingGPU() used with 'Pipeline'. There,
+//  each file goes through the GPU in strict order - its image is made visible to the GPU, it is
+//  filtered, and the result is brought back - and only then is the next file read. Here there
+//  are a number of buffer sets (at least three), each with its own input, output and uniform
+//  buffers, descriptor set, command buffer and semaphores, and successive files are given to
+//  the sets in turn. Each set's three stages are submitted together and ordered on the GPU by
+//  semaphores - the input buffer's sync signals one that the filtering waits for, and that
+//  signals one that the output buffer's sync waits for - so the CPU need only wait for the
+//  last. By the time a set comes round again it has usually finished, and while the CPU reads
+//  the next file into it, the GPU is filtering the file before that and copying back the one
+//  before that. So the time per file approaches that of the slowest stage, rather than the sum
+//  of all three.
+//
+//  The input buffers are "STAGED_CPU" and the outputs "STAGED_GPU", so that the copies to and
+//  from the GPU are real stages of their own, run by the GPU, rather than the shader reading and
+//  writing shared memory as it goes. If the device has a transfer queue in the same family as
+//  the main queue, the copies are submitted to that, and can run alongside the filtering; if
+//  not, everything goes to the main queue, and the GPU overlaps what it can. (A dedicated
+//  transfer family would need ownership transfers recorded around the copies, which the
+//  Framework's own sync command buffers don't have.)
+//
+//  As in ComputeBatchUsingGPU(), each file's result is written out by a FitsWriter, in the
+//  background, and with UseCPU the CPU filters each file too, so the results can be checked.
+//  The GPU's dispatch timing can only time one submission at a time, so it isn't used here; the
+//  report is of how long the CPU spent reading the files and waiting for the GPU, which shows
+//  how much the stages overlapped.
+
+void ComputeBatchPipelined(const std::vector<std::string>& Files,int Npix,int Sets,
+          bool UseCPU,int Threads,bool Histogram,bool Simd,float Tolerance,bool Validate,
+                                                   bool Tiled,const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU pipelined batch setup starting");
+
+    //  The basic Vulkan initialisation sequence, as for ComputeBatchUsingGPU(), but asking for
+    //  a separate transfer queue as well.
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.EnableSeparateQueues(true,false,StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    };
+    
+    //  Everything that belongs to one buffer set, including the file it is working on, whose
+    //  MedianDetails are kept here until its result has been dealt with. BufferBytes is the
+    //  current size of its input and output buffers, zero until they have been created.
+    
+    struct PipelineSet {
+        KVVulkanFramework::KVBufferHandle UniformHndl;
+        KVVulkanFramework::KVBufferHandle InputHndl;
+        KVVulkanFramework::KVBufferHandle OutputHndl;
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+        void* UniformAddr = nullptr;
+        float* InputAddr = nullptr;
+        float* OutputAddr = nullptr;
+        VkDeviceSize BufferBytes = 0;
+        VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+        VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore Uploaded = VK_NULL_HANDLE;
+        VkSemaphore Filtered = VK_NULL_HANDLE;
+        KVVulkanFramework::KVSubmitTicket Tickets[3] = {};
+        bool Busy = false;
+        std::string File;
+        int Nx = 0;
+        int Ny = 0;
+        double StartMsec = 0.0;
+        MedianDetails Details;
+    };
+    std::vector<PipelineSet> PipeSets(Sets);
+    
+    //  The input and output buffers can't be created until the first file for each set has been
+    //  read, but their details are enough for the descriptor set layout, which all the sets
+    //  share. The descriptor pool has room for all the sets.
+    
+    VkDeviceSize Bytes;
+    for (PipelineSet& Set : PipeSets) {
+        Set.UniformHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                      "UNIFORM","SHARED",StatusOK);
+        Set.InputHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                    "STAGED_CPU",StatusOK);
+        Set.OutputHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                    "STAGED_GPU",StatusOK);
+        Framework.CreateBuffer(Set.UniformHndl,sizeof(MedianArgs),StatusOK);
+        Set.UniformAddr = Framework.MapBuffer(Set.UniformHndl,&Bytes,StatusOK);
+        Set.Handles = {Set.UniformHndl,Set.InputHndl,Set.OutputHndl};
+    }
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(PipeSets[0].Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(PipeSets[0].Handles,Sets,&DescriptorPool,StatusOK);
+    
+    //  The filtering runs on the main queue. The copies use the transfer queue if they can.
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    VkQueue CopyQueue = ComputeQueue;
+    VkCommandPool CopyPool = CommandPool;
+    bool SeparateCopies = Framework.QueuesShareFamily("TRANSFER","GRAPHICS",StatusOK);
+    if (SeparateCopies) {
+        Framework.GetDeviceQueue("TRANSFER",&CopyQueue,StatusOK);
+        Framework.CreateCommandPool("TRANSFER",&CopyPool,StatusOK);
+        SeparateCopies = (CopyQueue != ComputeQueue);
+    }
+    for (PipelineSet& Set : PipeSets) {
+        Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&Set.DescriptorSet,
+                                                                                  StatusOK);
+        Framework.CreateComputeCommandBuffer(CommandPool,&Set.CommandBuffer,StatusOK);
+        Framework.CreateVulkanSemaphore(&Set.Uploaded,StatusOK);
+        Framework.CreateVulkanSemaphore(&Set.Filtered,StatusOK);
+    }
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    EndOfStartup();
+    if (!StatusOK) {
+        printf("GPU setup failed.\n");
+        return;
+    }
+    printf ("GPU setup took %.3f msec, once for all %d files\n",SetupTimer.ElapsedMsec(),
+                                                                            int(Files.size()));
+    printf ("%d buffer sets, copies %s\n\n",Sets,
+                 SeparateCopies ? "on a separate transfer queue" : "on the main queue");
+    
+    int FilesFiltered = 0;
+    float ReadMsec = 0.0;
+    float WaitMsec = 0.0;
+    FitsWriter Writer;
+    MsecTimer BatchTimer;
+    
+    //  FinishSet() waits for a set's file to come back from the GPU if need be, and deals with
+    //  the result. The tickets for the earlier stages will have completed by then, but passing
+    //  them to WaitFor() lets the Framework recycle their fences.
+    
+    auto FinishSet = [&](PipelineSet& Set) {
+        MsecTimer WaitTimer;
+        for (KVVulkanFramework::KVSubmitTicket& Ticket : Set.Tickets) {
+            Framework.WaitFor(Ticket,StatusOK);
+            Ticket = KVVulkanFramework::KV_NULL_TICKET;
+        }
+        Framework.InvalidateBuffer(Set.OutputHndl,StatusOK);
+        WaitMsec += WaitTimer.ElapsedMsec();
+        if (StatusOK) {
+            printf ("%s, %d by %d: %.3f msec from reading to result\n",Set.File.c_str(),
+                                     Set.Nx,Set.Ny,BatchTimer.ElapsedMsec() - Set.StartMsec);
+            float** OutputArray = CreateRowAddrs(Set.OutputAddr,Set.Nx,Set.Ny);
+            NoteResults(OutputArray,true,Set.Nx,Set.Ny,&Set.Details);
+            free(OutputArray);
+            if (UseCPU) {
+                ComputeUsingCPU(Threads,Set.Nx,Set.Ny,Npix,1,false,Histogram,Simd,&Set.Details);
+            }
+            Writer.Submit(Set.Nx,Set.Ny,&Set.Details);
+            FilesFiltered++;
+        } else {
+            printf ("GPU execution failed for %s.\n",Set.File.c_str());
+        }
+        Shutdown(&Set.Details);
+        Set.Details = MedianDetails();
+        Set.Busy = false;
+    };
+    
+    //  Work round the sets, giving each the next file that can be read once it has finished
+    //  with its last one, until there are no more files and all the sets are done.
+    
+    size_t NextFile = 0;
+    int Busy = 0;
+    for (int Index = 0; (NextFile < Files.size() || Busy > 0) && StatusOK;
+                                                              Index = (Index + 1) % Sets) {
+        PipelineSet& Set = PipeSets[Index];
+        if (Set.Busy) {
+            FinishSet(Set);
+            Busy--;
+        }
+        
+        //  ReadFitsFile() reads the image straight into the CPU side of this set's input
+        //  buffer, resizing its buffers first if need be, just as in ComputeBatchUsingGPU().
+        //  (Growing a buffer beyond its capacity waits for the device to be idle, so the first
+        //  large file stalls the pipeline briefly.)
+        
+        bool Read = false;
+        while (!Read && NextFile < Files.size() && StatusOK) {
+            const std::string& File = Files[NextFile++];
+            std::string Filename = File;
+            Set.Details.CheckTolerance = Tolerance;
+            Set.StartMsec = BatchTimer.ElapsedMsec();
+            auto Destination = [&](int ImageNx,int ImageNy) -> float* {
+                VkDeviceSize Length =
+                            VkDeviceSize(ImageNx) * VkDeviceSize(ImageNy) * sizeof(float);
+                if (Length != Set.BufferBytes) {
+                    if (Set.BufferBytes == 0) {
+                        Framework.CreateBuffer(Set.InputHndl,Length,StatusOK);
+                        Framework.CreateBuffer(Set.OutputHndl,Length,StatusOK);
+                    } else {
+                        Framework.ResizeBuffer(Set.InputHndl,Length,StatusOK);
+                        Framework.ResizeBuffer(Set.OutputHndl,Length,StatusOK);
+                    }
+                    Set.InputAddr = (float*)Framework.MapBuffer(Set.InputHndl,&Bytes,StatusOK);
+                    Set.OutputAddr = (float*)Framework.MapBuffer(Set.OutputHndl,&Bytes,StatusOK);
+                    Framework.SetupVulkanDescriptorSet(Set.Handles,Set.DescriptorSet,StatusOK);
+                    TheDebugHandler.Logf("Setup","GPU buffer set %d set up for %d by %d image",
+                                                                       Index,ImageNx,ImageNy);
+                    Set.BufferBytes = Length;
+                }
+                return StatusOK ? Set.InputAddr : nullptr;
+            };
+            Read = ReadFitsFile(Filename,&Set.Nx,&Set.Ny,&Set.Details,"Median_",Destination);
+            ReadMsec += float(BatchTimer.ElapsedMsec() - Set.StartMsec);
+            if (!Read) {
+                Shutdown(&Set.Details);
+                Set.Details = MedianDetails();
+                if (StatusOK) printf ("%s skipped.\n\n",File.c_str());
+                else printf ("GPU buffer setup failed for %s.\n",File.c_str());
+            } else {
+                Set.File = File;
+            }
+        }
+        if (!Read) continue;
+        
+        //  Submit the three stages, chained by the set's semaphores, and move on.
+        
+        MedianArgs Parameters = {Set.Nx,Set.Ny,Npix,0,Set.Ny,0,Set.Details.HasBlanks,0};
+        if (Set.UniformAddr) memcpy(Set.UniformAddr,&Parameters,sizeof(Parameters));
+        uint32_t WorkGroupCounts[3];
+        WorkGroupCounts[0] = (uint32_t(Set.Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+        WorkGroupCounts[1] = (uint32_t(Set.Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+        WorkGroupCounts[2] = 1;
+        Framework.RecordComputeCommandBuffer(Set.CommandBuffer,ComputePipeline,
+                              ComputePipelineLayout,&Set.DescriptorSet,WorkGroupCounts,StatusOK);
+        Set.Tickets[0] = Framework.SubmitSyncBuffer(Set.InputHndl,CopyPool,CopyQueue,
+                                                     VK_NULL_HANDLE,Set.Uploaded,StatusOK);
+        std::vector<VkSemaphore> Waits = {Set.Uploaded};
+        std::vector<VkSemaphore> Signals = {Set.Filtered};
+        Set.Tickets[1] = Framework.SubmitCommandBuffer(ComputeQueue,Set.CommandBuffer,Waits,
+                                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,Signals,StatusOK);
+        Set.Tickets[2] = Framework.SubmitSyncBuffer(Set.OutputHndl,CopyPool,CopyQueue,
+                                                     Set.Filtered,VK_NULL_HANDLE,StatusOK);
+        if (!StatusOK) {
+            printf ("GPU execution failed for %s.\n",Set.File.c_str());
+            Shutdown(&Set.Details);
+            break;
+        }
+        Set.Busy = true;
+        Busy++;
+    }
+    
+    //  Anything still in a set if something failed still has to be waited for before the
+    //  Framework can release the buffers.
+    
+    for (PipelineSet& Set : PipeSets) {
+        bool WaitOK = true;
+        for (KVVulkanFramework::KVSubmitTicket Ticket : Set.Tickets) {
+            Framework.WaitFor(Ticket,WaitOK);
+        }
+        if (Set.Busy) Shutdown(&Set.Details);
+    }
+    Writer.Finish();
+    
+    printf ("\nFiltered %d of %d files in %.3f msec\n",FilesFiltered,int(Files.size()),
+                                                                   BatchTimer.ElapsedMsec());
+    printf ("Reading the files took %.3f msec, waiting for the GPU %.3f msec\n\n",
+                                                                          ReadMsec,WaitMsec);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                       B a t c h  c o d e  ( s c h e d u l e d )
+//
+//  ComputeBatchScheduled() is the version of ComputeBatchUsingGPU() used with 'Schedule'. Rather
+//  than the GPU filtering every file, each file goes to whichever of the GPU and the CPU threads
+//  a JobScheduler (see JobScheduler.h) expects to finish it soonest, judging by the times each
+//  has taken for the files so far - so small images, for which the GPU's fixed costs outweigh
+//  its speed, stay on the CPU, and large ones go to the GPU. The two run at the same time: the
+//  GPU's job is submitted with SubmitCommandBuffer(), and while it runs this thread reads the
+//  next files, and filters any the scheduler gives the CPU. The GPU is only waited for when it
+//  is given another file, or at the end.
+//
+//  The time recorded for a GPU job runs from copying the image into the input buffer to the
+//  end of the kernel. If the job had already finished when it was checked, the end is found
+//  from the kernel time measured by the GPU, so the CPU's work in the meantime isn't counted.
+//  A CPU job's time is that of OnePassUsingCPU(). Each result is written out by a FitsWriter,
+//  as in ComputeBatchUsingGPU(), and the scheduler's final models are listed at the end.
+
+void ComputeBatchScheduled(const std::vector<std::string>& Files,int Npix,int Threads,
+            bool Histogram,bool Simd,bool Validate,bool Tiled,const std::string& DebugLevels)
+{
+    //  Forward declaration for the routine that does the CPU filtering.
+    
+    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                         bool Histogram,bool Simd,bool Blanks,float* BinWidth);
+    
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU scheduled batch setup starting");
+
+    //  The GPU is set up exactly as for ComputeBatchUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                        "SHARED",StatusOK);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                      "READBACK",StatusOK);
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    };
+    
+    VkDeviceSize Bytes;
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    void* UniformBufferAddr = Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(OutputBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    Framework.EnableDispatchTiming(true,StatusOK);
+    EndOfStartup();
+    if (!StatusOK) {
+        printf("GPU setup failed.\n");
+        return;
+    }
+    printf ("GPU setup took %.3f msec, once for all %d files\n\n",SetupTimer.ElapsedMsec(),
+                                                                            int(Files.size()));
+    
+    //  The scheduler has the two devices, and the one kernel, since all the files use the
+    //  same box. Times are measured from the start of the batch.
+    
+    JobScheduler Scheduler;
+    int GPUDevice = Scheduler.AddDevice("GPU");
+    int CPUDevice = Scheduler.AddDevice("CPU");
+    std::string Kernel = "Median" + std::to_string(Npix);
+    
+    //  The file the GPU is working on, if any. Its MedianDetails are kept here until it's done.
+    
+    struct GPUJob {
+        bool Running = false;
+        std::string File;
+        int Nx = 0;
+        int Ny = 0;
+        double StartMsec = 0.0;
+        double SubmitMsec = 0.0;
+        double Predicted = 0.0;
+        KVVulkanFramework::KVSubmitTicket Ticket;
+        MedianDetails Details;
+    };
+    GPUJob Job;
+    
+    VkDeviceSize BufferBytes = 0;
+    float* InputBufferAddr = nullptr;
+    float* OutputBufferAddr = nullptr;
+    int FilesFiltered = 0;
+    FitsWriter Writer;
+    MsecTimer BatchTimer;
+    
+    //  FinishGPUJob() waits for the GPU's file if need be, tells the scheduler how long it
+    //  took, and passes the result on to be written out.
+    
+    auto FinishGPUJob = [&]() {
+        double CheckMsec = BatchTimer.ElapsedMsec();
+        bool Waited = !Framework.IsComplete(Job.Ticket,StatusOK);
+        if (Waited) Framework.WaitFor(Job.Ticket,StatusOK);
+        float KernelMsec = 0.0;
+        bool KernelTimed = Framework.GetDispatchTimes(nullptr,&KernelMsec,nullptr,StatusOK);
+        Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        double EndMsec = CheckMsec;
+        if (Waited) EndMsec = BatchTimer.ElapsedMsec();
+        else if (KernelTimed) EndMsec = std::min(CheckMsec,Job.SubmitMsec + KernelMsec);
+        double Msec = EndMsec - Job.StartMsec;
+        if (StatusOK) {
+            Scheduler.Finished(GPUDevice,Kernel,double(Job.Nx) * double(Job.Ny),Msec);
+            printf ("%s, %d by %d: GPU took %.3f msec",Job.File.c_str(),Job.Nx,Job.Ny,Msec);
+            if (Job.Predicted >= 0.0) printf (" (predicted %.3f)",Job.Predicted);
+            printf ("\n");
+            float** OutputArray = CreateRowAddrs(OutputBufferAddr,Job.Nx,Job.Ny);
+            NoteResults(OutputArray,true,Job.Nx,Job.Ny,&Job.Details);
+            free(OutputArray);
+            Writer.Submit(Job.Nx,Job.Ny,&Job.Details);
+            FilesFiltered++;
+        } else {
+            printf ("GPU execution failed for %s.\n",Job.File.c_str());
+        }
+        Shutdown(&Job.Details);
+        Job.Running = false;
+    };
+    
+    for (const std::string& File : Files) {
+        
+        //  If the GPU has finished its file while the CPU was busy, deal with that first, so
+        //  the scheduler knows it's free and has its latest time.
+        
+        if (Job.Running && Framework.IsComplete(Job.Ticket,StatusOK)) FinishGPUJob();
+        if (!StatusOK) break;
+        
+        MedianDetails Details;
+        std::string Filename = File;
+        int Nx = 0,Ny = 0;
+        if (!ReadFitsFile(Filename,&Nx,&Ny,&Details,"Median_")) {
+            Shutdown(&Details);
+            printf ("%s skipped.\n\n",File.c_str());
+            continue;
+        }
+        
+        double Size = double(Nx) * double(Ny);
+        double Predicted;
+        double NowMsec = BatchTimer.ElapsedMsec();
+        int Device = Scheduler.Choose(Kernel,Size,NowMsec,&Predicted);
+        
+        if (Device == GPUDevice) {
+            
+            //  The GPU can only work on one file at a time, so if it's still busy, this waits
+            //  for it. Then the buffers are resized if need be, just as in ComputeBatchUsingGPU(),
+            //  the image copied in, and the filter submitted.
+            
+            if (Job.Running) FinishGPUJob();
+            Job.StartMsec = BatchTimer.ElapsedMsec();
+            VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+            if (Length != BufferBytes) {
+                if (BufferBytes == 0) {
+                    Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+                    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+                } else {
+                    Framework.ResizeBuffer(InputBufferHndl,Length,StatusOK);
+                    Framework.ResizeBuffer(OutputBufferHndl,Length,StatusOK);
+                }
+                InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+                OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+                Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+                TheDebugHandler.Logf("Setup","GPU buffers set up for %d by %d image",Nx,Ny);
+                BufferBytes = Length;
+            }
+            if (!StatusOK) {
+                printf ("GPU buffer setup failed for %s.\n",File.c_str());
+                Shutdown(&Details);
+                break;
+            }
+            memcpy(InputBufferAddr,Details.InputData,Length);
+            MedianArgs Parameters = {Nx,Ny,Npix,0,Ny,0,Details.HasBlanks,0};
+            if (UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,sizeof(Parameters));
+            uint32_t WorkGroupCounts[3];
+            WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+            WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+            WorkGroupCounts[2] = 1;
+            Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+            Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+            Job.SubmitMsec = BatchTimer.ElapsedMsec();
+            Job.Ticket = Framework.SubmitCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+            if (!StatusOK) {
+                printf ("GPU execution failed for %s.\n",File.c_str());
+                Shutdown(&Details);
+                break;
+            }
+            Scheduler.Started(GPUDevice,
+                                 Predicted >= 0.0 ? Job.StartMsec + Predicted : Job.StartMsec);
+            Job.File = File;
+            Job.Nx = Nx;
+            Job.Ny = Ny;
+            Job.Predicted = Predicted;
+            Job.Details = Details;
+            Details = MedianDetails();
+            Job.Running = true;
+            
+        } else {
+            
+            //  The CPU filters the file here and now, while the GPU carries on.
+            
+            float* Output = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+            float** InputArray = CreateRowAddrs(Details.InputData,Nx,Ny);
+            float** OutputArray = CreateRowAddrs(Output,Nx,Ny);
+            float BinWidth = 0.0;
+            MsecTimer CPUTimer;
+            OnePassUsingCPU(Threads,InputArray,Nx,Ny,Npix,OutputArray,Histogram,Simd,
+                                                                  Details.HasBlanks,&BinWidth);
+            double Msec = CPUTimer.ElapsedMsec();
+            Scheduler.Finished(CPUDevice,Kernel,Size,Msec);
+            printf ("%s, %d by %d: CPU took %.3f msec",File.c_str(),Nx,Ny,Msec);
+            if (Predicted >= 0.0) printf (" (predicted %.3f)",Predicted);
+            printf ("\n");
+            NoteResults(OutputArray,false,Nx,Ny,&Details,&Output);
+            if (Output) free(Output);
+            free(OutputArray);
+            free(InputArray);
+            Writer.Submit(Nx,Ny,&Details);
+            Shutdown(&Details);
+            FilesFiltered++;
+        }
+    }
+    if (Job.Running) FinishGPUJob();
+    Writer.Finish();
+    
+    printf ("\nFiltered %d of %d files in %.3f msec, %d by the GPU and %d by the CPU\n",
+                   FilesFiltered,int(Files.size()),BatchTimer.ElapsedMsec(),
+                                      Scheduler.Jobs(GPUDevice),Scheduler.Jobs(CPUDevice));
+    printf ("Scheduler models:\n%s\n",Scheduler.Description().c_str());
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G P U  c o d e  ( s e r v e r )
+//
+//  ServeUsingGPU() is what 'Serve' runs. It sets up the GPU just as ComputeBatchUsingGPU() does,
+//  once, and then filters images sent to it by clients - other runs of this program, using
+//  'Connect' - for as long as it runs, so none of them pays for the setup. The buffers are
+//  resized, and the descriptor set updated, only when an image has different dimensions from
+//  the last, and a pipeline is built for each box size the first time it is asked for and kept
+//  from then on (the one for Npix is built at the start). Each image is read from the socket
+//  straight into the input buffer, and the result written to the socket straight from the
+//  output buffer. See MedianServer.h for the protocol.
+
+void ServeUsingGPU(const std::string& Address,int Npix,bool Validate,bool Tiled,
+                                                                 const std::string& DebugLevels)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU server setup starting");
+
+    MedianServer Server;
+    if (!Server.Listen(Address)) {
+        printf ("%s\n",Server.GetError().c_str());
+        return;
+    }
+
+    //  The basic Vulkan initialisation sequence, and the buffers and descriptor set, exactly
+    //  as for ComputeBatchUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                        "SHARED",StatusOK);
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                      "READBACK",StatusOK);
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    };
+    
+    VkDeviceSize Bytes;
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    void* UniformBufferAddr = Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(OutputBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    //  The pipelines, one for each value of the box size specialization constant, built as
+    //  they are needed. GetPipeline() returns false if one can't be built.
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    std::map<uint32_t,std::pair<VkPipelineLayout,VkPipeline>> Pipelines;
+    auto GetPipeline = [&](int BoxSize,VkPipelineLayout* Layout,VkPipeline* Pipeline) {
+        uint32_t Constant = BoxNpix(BoxSize);
+        auto Found = Pipelines.find(Constant);
+        if (Found == Pipelines.end()) {
+            bool PipelineOK = true;
+            std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],Constant};
+            Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                                                     Layout,Pipeline,SpecConstants,PipelineOK);
+            if (!PipelineOK) return false;
+            Pipelines[Constant] = std::make_pair(*Layout,*Pipeline);
+            TheDebugHandler.Logf("Setup","Pipeline built for %d by %d boxes",BoxSize,BoxSize);
+        } else {
+            *Layout = Found->second.first;
+            *Pipeline = Found->second.second;
+        }
+        return true;
+    };
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    if (StatusOK) StatusOK = GetPipeline(Npix,&ComputePipelineLayout,&ComputePipeline);
+    Framework.EnableDispatchTiming(true,StatusOK);
+    EndOfStartup();
+    if (!StatusOK) {
+        printf("GPU setup failed.\n");
+        return;
+    }
+    printf ("GPU setup took %.3f msec. Serving on '%s'.\n\n",SetupTimer.ElapsedMsec(),
+                                                                              Address.c_str());
+    
+    //  Dest sizes the buffers for each image, as the Destination in ComputeBatchUsingGPU()
+    //  does, and returns the input buffer's address.
+    
+    VkDeviceSize BufferBytes = 0;
+    float* InputBufferAddr = nullptr;
+    float* OutputBufferAddr = nullptr;
+    MedianServer::Destination Dest = [&](int Nx,int Ny) -> float* {
+        VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+        if (Length != BufferBytes) {
+            if (BufferBytes == 0) {
+                Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+                Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+            } else {
+                Framework.ResizeBuffer(InputBufferHndl,Length,StatusOK);
+                Framework.ResizeBuffer(OutputBufferHndl,Length,StatusOK);
+            }
+            InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+            OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+            Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+            TheDebugHandler.Logf("Setup","GPU buffers set up for %d by %d image",Nx,Ny);
+            BufferBytes = Length;
+        }
+        return StatusOK ? InputBufferAddr : nullptr;
+    };
+    
+    //  Filter runs one pass of the filter on the image just read, just as for one pass of
+    //  ComputeUsingGPU().
+    
+    MedianServer::Filter Filter = [&](int Nx,int Ny,int BoxSize,bool Blanks,
+                                        float* KernelMsec,std::string* Error) -> const float* {
+        if (BoxSize < 1 || (BoxSize % 2) == 0 || BoxSize > C_MaxGPUNpix) {
+            *Error = "Box size " + std::to_string(BoxSize) + " should be an odd number from 1 to "
+                                                                  + std::to_string(C_MaxGPUNpix);
+            return nullptr;
+        }
+        VkPipelineLayout Layout;
+        VkPipeline Pipeline;
+        if (!GetPipeline(BoxSize,&Layout,&Pipeline)) {
+            *Error = "Unable to build a pipeline for box size " + std::to_string(BoxSize);
+            return nullptr;
+        }
+        MedianArgs Parameters = {Nx,Ny,BoxSize,0,Ny,0,Blanks ? 1 : 0,0};
+        if (UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,sizeof(Parameters));
+        uint32_t WorkGroupCounts[3];
+        WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+        WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+        WorkGroupCounts[2] = 1;
+        MsecTimer ComputeTimer;
+        Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        Framework.RecordComputeCommandBuffer(CommandBuffer,Pipeline,Layout,&DescriptorSet,
+                                                                   WorkGroupCounts,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        Framework.GetDispatchTimes(nullptr,KernelMsec,nullptr,StatusOK);
+        Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        if (!StatusOK) {
+            *Error = "GPU execution failed";
+            return nullptr;
+        }
+        if (TimingDebug) {
+            printf ("Job %ld, %d by %d, box %d: GPU took %.3f msec (kernel %.3f msec)\n",
+                   Server.JobsRun() + 1,Nx,Ny,BoxSize,ComputeTimer.ElapsedMsec(),*KernelMsec);
+        }
+        return OutputBufferAddr;
+    };
+    
+    //  Serve one client after another. A failure on the GPU leaves it in an unknown state,
+    //  so that ends the server, as does losing the listening socket.
+    
+    while (StatusOK && Server.Listening()) {
+        if (!Server.ServeConnection(Dest,Filter)) {
+            printf ("Connection ended: %s\n",Server.GetError().c_str());
+        }
+    }
+    printf ("Server stopped after %ld jobs.\n",Server.JobsRun());
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              G P U  c o d e  ( c l i e n t )
+//
+//  ComputeUsingServer() is used in place of ComputeUsingGPU() with 'Connect'. It sends the image
+//  to a server started with 'Serve' and has it filter it Nrpt times, the result of the last being
+//  passed to NoteResults() as the GPU result, so it can be checked against the CPU's and written
+//  out in the usual way. The time reported for each pass is the full round trip - sending the
+//  image, filtering it and reading back the result - which is what a client actually waits for.
+
+void ComputeUsingServer(const std::string& Address,int Nx,int Ny,int Npix,int Nrpt,
+                                                                    MedianDetails* Details)
+{
+    //  The input image is the one read from the file, or a test image.
+    
+    std::vector<float> TestImage;
+    const float* Input = Details->InputData;
+    if (Input == nullptr) {
+        TestImage.resize(size_t(Nx) * size_t(Ny));
+        float** InputArray = CreateRowAddrs(TestImage.data(),Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+        free(InputArray);
+        Input = TestImage.data();
+    }
+    
+    MsecTimer ConnectTimer;
+    MedianClient Client;
+    if (!Client.Connect(Address)) {
+        printf ("%s\n\n",Client.GetError().c_str());
+        return;
+    }
+    printf ("Connected to server at '%s' in %.3f msec\n",Address.c_str(),
+                                                                 ConnectTimer.ElapsedMsec());
+    
+    std::vector<float> Output(size_t(Nx) * size_t(Ny));
+    MsecStats PassStats;
+    float ServerMsec = 0.0,KernelMsec = 0.0;
+    float TotalServerMsec = 0.0,TotalKernelMsec = 0.0;
+    bool ClientOK = true;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        TraceScope PassTrace("Server pass","Median");
+        MsecTimer PassTimer;
+        ClientOK = Client.FilterImage(Input,Output.data(),Nx,Ny,Npix,Details->HasBlanks,
+                                                                   &ServerMsec,&KernelMsec);
+        if (!ClientOK) break;
+        PassStats.Record(PassTimer.ElapsedMsec());
+        TotalServerMsec += ServerMsec;
+        TotalKernelMsec += KernelMsec;
+    }
+    if (ClientOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("Server round trips took %.3f msec\n",Msec);
+        if (Nrpt <= 0) {
+            printf ("No values computed using server, as number of repeats set to zero.\n");
+        } else {
+            printf ("Average msec per round trip = %.3f, of which the server took %.3f "
+                         "(kernel %.3f)\n",Msec / float(Nrpt),TotalServerMsec / float(Nrpt),
+                                                                TotalKernelMsec / float(Nrpt));
+            PassStats.Report("Server round trips");
+            float** OutputArray = CreateRowAddrs(Output.data(),Nx,Ny);
+            NoteResults(OutputArray,true,Nx,Ny,Details);
+            free(OutputArray);
+        }
+    } else {
+        printf ("Server job failed: %s\n",Client.GetError().c_str());
+    }
+    printf ("\n");
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G P U  c o d e  ( s c a l e s )
+//
+//  ComputeScalesUsingGPU() filters the image with each of the box sizes in Scales at once, using
+//  MedianScales.spv - Median.comp compiled with MULTI_SCALE defined. Each workgroup loads its
+//  tile of the image into shared memory just once, with a halo wide enough for the largest box,
+//  and every thread then finds the median for each box size from that tile, writing them to
+//  successive images in one output buffer. So finding, say, the 3x3, 7x7 and 15x15 medians
+//  needs one upload of the image, one dispatch and one readback, rather than one of each for
+//  each size. It is passed an array of MedianDetails, one for each scale, and the input image
+//  comes from the first of these. The results for each scale are passed to NoteResults() with
+//  the MedianDetails for that scale, so each can be checked and written out separately.
+
+void ComputeScalesUsingGPU(int Nx,int Ny,const std::vector<int>& Scales,int Nrpt,bool Validate,
+                                          const std::string& DebugLevels,MedianDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU multi-scale setup starting");
+    
+    int NScales = int(Scales.size());
+    float** InputArray = nullptr;
+    
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    //  The input buffer is just as for ComputeUsingGPU(), imported if the data came from a file.
+    //  The output buffer holds an image for each scale.
+    
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    if (Details[0].InputData) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,Details[0].InputData,Length,StatusOK);
+    } else {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    }
+    VkDeviceSize Bytes;
+    float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+    if (!Details[0].InputData && InputBufferAddr) {
+        InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,&Details[0]);
+    }
+    
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+    Framework.CreateBuffer(OutputBufferHndl,Length * NScales,StatusOK);
+    float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+    
+    //  The parameters have the box sizes added at the end, which must match the layout of the
+    //  MULTI_SCALE version of MedianArgs in Median.comp. The ivec4 of sizes has to start on a
+    //  16 byte boundary, which it does. Npix is set to the largest size, although the shader
+    //  doesn't actually use it.
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int Scales;
+        int ScaleNpix[C_MaxScales];
+    } Parameters = {Nx,Ny,0,0,Ny,0,Details[0].HasBlanks,NScales,{0}};
+    for (int Iscale = 0; Iscale < NScales; Iscale++) {
+        Parameters.ScaleNpix[Iscale] = Scales[Iscale];
+        Parameters.Npix = std::max(Parameters.Npix,Scales[Iscale]);
+    }
+    
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    void* UniformBufferAddr = Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    if (StatusOK && UniformBufferAddr) memcpy(UniformBufferAddr,&Parameters,Bytes);
+    
+    //  The descriptor set, queue, command buffer and pipeline, just as for ComputeUsingGPU().
+    //  There's no one box size for specialization constant 2, so that is left as zero.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(OutputBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],0};
+    Framework.CreateComputePipeline("MedianScales.spv","main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    
+    uint32_t WorkGroupCounts[3];
+    WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+    WorkGroupCounts[2] = 1;
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    //  The repeat loop is just as for ComputeUsingGPU(), each pass finding all the scales.
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        Framework.SyncBuffer(InputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        Framework.SyncBuffer(OutputBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        if (!StatusOK) break;
+    }
+    
+    //  Report on the timing, and note the results for each scale.
+    
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU took %.3f msec for %d box sizes\n",Msec,NScales);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            for (int Iscale = 0; Iscale < NScales; Iscale++) {
+                float** OutputArray = CreateRowAddrs(OutputBufferAddr +
+                                               size_t(Iscale) * size_t(Nx) * size_t(Ny),Nx,Ny);
+                NoteResults(OutputArray,true,Nx,Ny,&Details[Iscale]);
+                free(OutputArray);
+            }
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+    
+    if (InputArray) free(InputArray);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                           R a n k  F i l t e r  ( G P U  a n d  C P U )
+//
+//  ComputeRankUsingGPU() filters the image for 'Rank' with the minimum, maximum or a percentile,
+//  using RankFilter.spv. For the minimum and maximum that's the four passes of the van Herk/
+//  Gil-Werman filter - blocks along the rows, combining along the rows, blocks down the columns
+//  and combining down the columns - and for other percentiles a single selection pass. The
+//  passes are all the same pipeline with different push constants, recorded into one command
+//  buffer by RecordComputeBatch(), which puts a barrier between them. The image between the
+//  row and column filters, and the prefix and suffix images of the blocks, only ever live on
+//  the GPU. Only the minimum and maximum need them, so for other percentiles they are a token
+//  size, just so the descriptor set is complete. The result is passed to NoteResults() as usual.
+
+static const char* const C_RankShader = "RankFilter.spv";
+static const int C_RankTempBinding = 3;
+static const int C_RankPrefixBinding = 4;
+static const int C_RankSuffixBinding = 5;
+static const uint32_t C_RankWorkGroupSize = 16;
+
+void ComputeRankUsingGPU(int Nx,int Ny,int Npix,int Percentile,int Nrpt,bool Validate,
+                                         const std::string& DebugLevels,MedianDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU rank filter setup starting");
+    
+    float** InputArray = nullptr;
+    bool MinMax = RankFilter::IsMinMax(Percentile);
+    
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    //  The input and output buffers are just as for ComputeScalesUsingGPU(), for one image.
+    
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    if (Details->InputData) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,Details->InputData,Length,StatusOK);
+    } else {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    }
+    VkDeviceSize Bytes;
+    float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+    if (!Details->InputData && InputBufferAddr) {
+        InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+    }
+    
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+    float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+    
+    //  The rows and columns are padded by Npix/2 at the start and out to a whole number of
+    //  blocks at the end, and the prefix and suffix buffers have to hold the image with either
+    //  padded.
+    
+    int Half = Npix / 2;
+    int PaddedX = ((Nx + 2 * Half + Npix - 1) / Npix) * Npix;
+    int PaddedY = ((Ny + 2 * Half + Npix - 1) / Npix) * Npix;
+    VkDeviceSize BlockLength = std::max(VkDeviceSize(PaddedX) * VkDeviceSize(Ny),
+                                                  VkDeviceSize(PaddedY) * VkDeviceSize(Nx));
+    BlockLength *= sizeof(float);
+    if (!MinMax) BlockLength = Length = sizeof(float);
+    KVVulkanFramework::KVBufferHandle TempBufferHndl;
+    TempBufferHndl = Framework.SetBufferDetails(C_RankTempBinding,"STORAGE","LOCAL",StatusOK);
+    Framework.CreateBuffer(TempBufferHndl,Length,StatusOK);
+    KVVulkanFramework::KVBufferHandle PrefixBufferHndl;
+    PrefixBufferHndl = Framework.SetBufferDetails(C_RankPrefixBinding,"STORAGE","LOCAL",StatusOK);
+    Framework.CreateBuffer(PrefixBufferHndl,BlockLength,StatusOK);
+    KVVulkanFramework::KVBufferHandle SuffixBufferHndl;
+    SuffixBufferHndl = Framework.SetBufferDetails(C_RankSuffixBinding,"STORAGE","LOCAL",StatusOK);
+    Framework.CreateBuffer(SuffixBufferHndl,BlockLength,StatusOK);
+    
+    //  The descriptor set, queue and command buffer, as usual. The pipeline takes the pass
+    //  details as push constants, which must match RankArgs in RankFilter.comp.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(OutputBufferHndl);
+    Handles.push_back(TempBufferHndl);
+    Handles.push_back(PrefixBufferHndl);
+    Handles.push_back(SuffixBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    struct RankArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int Percentile;
+        int Pass;
+        int PaddedX;
+        int PaddedY;
+    };
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {C_RankWorkGroupSize,C_RankWorkGroupSize};
+    Framework.CreateComputePipeline(C_RankShader,"main",&SetLayout,&ComputePipelineLayout,
+                           &ComputePipeline,SpecConstants,uint32_t(sizeof(RankArgs)),StatusOK);
+    
+    //  The passes. Passes 0 and 2 have one invocation for each block along a row or down a
+    //  column, the others one for each pixel. The push constants for each have to stay in
+    //  place until the batch is recorded.
+    
+    std::vector<int> Passes = {4};
+    if (MinMax) Passes = {0,1,2,3};
+    std::vector<RankArgs> PassArgs;
+    for (int Pass : Passes) {
+        PassArgs.push_back({Nx,Ny,Npix,Percentile,Pass,PaddedX,PaddedY});
+    }
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches;
+    for (size_t Ipass = 0; Ipass < Passes.size(); Ipass++) {
+        uint32_t CountX = uint32_t((Passes[Ipass] == 0) ? PaddedX / Npix : Nx);
+        uint32_t CountY = uint32_t((Passes[Ipass] == 2) ? PaddedY / Npix : Ny);
+        KVVulkanFramework::KVDispatch Dispatch{};
+        Dispatch.PipelineHndl = ComputePipeline;
+        Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+        Dispatch.DescriptorSetHndl = DescriptorSet;
+        Dispatch.WorkGroupCounts[0] = (CountX + C_RankWorkGroupSize - 1) / C_RankWorkGroupSize;
+        Dispatch.WorkGroupCounts[1] = (CountY + C_RankWorkGroupSize - 1) / C_RankWorkGroupSize;
+        Dispatch.WorkGroupCounts[2] = 1;
+        Dispatch.PushConstants = &PassArgs[Ipass];
+        Dispatch.PushConstantSize = uint32_t(sizeof(RankArgs));
+        Dispatches.push_back(Dispatch);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {OutputBufferHndl};
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    //  The repeat loop runs the whole batch of passes each time, and the kernel time is that
+    //  of all of them.
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        Framework.InvalidateBuffer(OutputBufferHndl,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        if (!StatusOK) break;
+    }
+    
+    //  Report on the timing, and note the results.
+    
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU took %.3f msec, %d pass(es)\n",Msec,int(Passes.size()));
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            float** OutputArray = CreateRowAddrs(OutputBufferAddr,Nx,Ny);
+            NoteResults(OutputArray,true,Nx,Ny,Details);
+            free(OutputArray);
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+    
+    if (InputArray) free(InputArray);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ComputeRankUsingCPU() is the CPU counterpart, using a RankFilter, which works on the image
+//  where it is if it's already in memory, and otherwise on a copy made by SetInputArray(). The
+//  GPU and CPU results should be exactly the same.
+
+void ComputeRankUsingCPU(int Threads,int Nx,int Ny,int Npix,int Percentile,int Nrpt,
+                                                               int Warmup,MedianDetails* Details)
+{
+    float* InputArrayData = nullptr;
+    if (!Details->InputData) {
+        InputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+        float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+        free(InputArray);
+    }
+    float* OutputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+    RankFilter Filter(Details->InputData ? Details->InputData : InputArrayData,Nx,Ny,Npix,
+                                                                                 Percentile);
+    
+    MsecTimer LoopTimer;
+    MsecStats PassStats;
+    PassStats.SetWarmup(Warmup);
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer PassTimer;
+        TraceScope PassTrace("CPU pass","Rank");
+        Threads = Filter.Filter(OutputArrayData,Threads);
+        PassStats.Record(PassTimer.ElapsedMsec());
+    }
+    
+    float Msec = LoopTimer.ElapsedMsec();
+    const char* Engine = RankFilter::IsMinMax(Percentile) ? "van Herk/Gil-Werman" : "selection";
+    printf ("CPU (%s) took %.3f msec\n",Engine,Msec);
+    printf ("Average msec per iteration for CPU = %.3f (threads = %d)\n",
+                                                           Msec / float(Nrpt),Threads);
+    PassStats.Report("CPU iterations");
+    if (Nrpt <= 0) {
+        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    } else {
+        float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+        NoteResults(OutputArray,false,Nx,Ny,Details,&OutputArrayData);
+        free(OutputArray);
+    }
+    printf ("\n");
+    
+    if (OutputArrayData) free(OutputArrayData);
+    if (InputArrayData) free(InputArrayData);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                    S e p a r a b l e  M e d i a n  ( G P U  a n d  C P U )
+//
+//  ComputeApproxUsingGPU() filters the image for 'Approx' with the median of the medians of the
+//  rows of each box, using SeparableMedian.spv. That's two passes - the medians along the rows,
+//  into a temporary image that only lives on the GPU, and the medians down its columns - which
+//  are the same pipeline with different push constants, recorded into one command buffer by
+//  RecordComputeBatch(), which puts a barrier between them. The result is passed to
+//  NoteResults() as usual, which also compares it with the exact median.
+
+static const char* const C_SeparableShader = "SeparableMedian.spv";
+static const int C_SeparableTempBinding = 3;
+static const uint32_t C_SeparableWorkGroupSize = 16;
+
+void ComputeApproxUsingGPU(int Nx,int Ny,int Npix,int Nrpt,bool Validate,
+                                         const std::string& DebugLevels,MedianDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU approximate median setup starting");
+    
+    float** InputArray = nullptr;
+    
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    //  The input and output buffers are just as for ComputeRankUsingGPU(), and the temporary
+    //  image of row medians is the same size.
+    
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    if (Details->InputData) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,Details->InputData,Length,StatusOK);
+    } else {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    }
+    VkDeviceSize Bytes;
+    float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+    if (!Details->InputData && InputBufferAddr) {
+        InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+    }
+    
+    KVVulkanFramework::KVBufferHandle OutputBufferHndl;
+    OutputBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+    Framework.CreateBuffer(OutputBufferHndl,Length,StatusOK);
+    float* OutputBufferAddr = (float*)Framework.MapBuffer(OutputBufferHndl,&Bytes,StatusOK);
+    
+    KVVulkanFramework::KVBufferHandle TempBufferHndl;
+    TempBufferHndl = Framework.SetBufferDetails(C_SeparableTempBinding,"STORAGE","LOCAL",
+                                                                                     StatusOK);
+    Framework.CreateBuffer(TempBufferHndl,Length,StatusOK);
+    
+    //  The descriptor set, queue and command buffer, as usual. The pipeline takes the pass
+    //  details as push constants, which must match SeparableArgs in SeparableMedian.comp.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(OutputBufferHndl);
+    Handles.push_back(TempBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    struct SeparableArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int Pass;
+    };
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {C_SeparableWorkGroupSize,C_SeparableWorkGroupSize};
+    Framework.CreateComputePipeline(C_SeparableShader,"main",&SetLayout,&ComputePipelineLayout,
+                      &ComputePipeline,SpecConstants,uint32_t(sizeof(SeparableArgs)),StatusOK);
+    
+    //  The two passes each have one invocation for each pixel. The push constants for each
+    //  have to stay in place until the batch is recorded.
+    
+    std::vector<SeparableArgs> PassArgs = {{Nx,Ny,Npix,0},{Nx,Ny,Npix,1}};
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches;
+    for (SeparableArgs& Args : PassArgs) {
+        KVVulkanFramework::KVDispatch Dispatch{};
+        Dispatch.PipelineHndl = ComputePipeline;
+        Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+        Dispatch.DescriptorSetHndl = DescriptorSet;
+        Dispatch.WorkGroupCounts[0] =
+                        (uint32_t(Nx) + C_SeparableWorkGroupSize - 1) / C_SeparableWorkGroupSize;
+        Dispatch.WorkGroupCounts[1] =
+                        (uint32_t(Ny) + C_SeparableWorkGroupSize - 1) / C_SeparableWorkGroupSize;
+        Dispatch.WorkGroupCounts[2] = 1;
+        Dispatch.PushConstants = &Args;
+        Dispatch.PushConstantSize = uint32_t(sizeof(SeparableArgs));
+        Dispatches.push_back(Dispatch);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {OutputBufferHndl};
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    //  The repeat loop runs both passes each time, and the kernel time is that of both.
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        Framework.InvalidateBuffer(OutputBufferHndl,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        if (!StatusOK) break;
+    }
+    
+    //  Report on the timing, and note the results.
+    
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU (separable) took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            float** OutputArray = CreateRowAddrs(OutputBufferAddr,Nx,Ny);
+            NoteResults(OutputArray,true,Nx,Ny,Details);
+            free(OutputArray);
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+    
+    if (InputArray) free(InputArray);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ComputeApproxUsingCPU() is the CPU counterpart, using a SeparableMedian, which works on the
+//  image where it is if it's already in memory, and otherwise on a copy made by SetInputArray().
+//  The GPU and CPU results should be exactly the same.
+
+void ComputeApproxUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,int Warmup,
+                                                                      MedianDetails* Details)
+{
+    float* InputArrayData = nullptr;
+    if (!Details->InputData) {
+        InputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+        float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+        free(InputArray);
+    }
+    float* OutputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+    SeparableMedian Filter(Details->InputData ? Details->InputData : InputArrayData,Nx,Ny,Npix);
+    
+    MsecTimer LoopTimer;
+    MsecStats PassStats;
+    PassStats.SetWarmup(Warmup);
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer PassTimer;
+        TraceScope PassTrace("CPU pass","Approx");
+        Threads = Filter.Filter(OutputArrayData,Threads);
+        PassStats.Record(PassTimer.ElapsedMsec());
+    }
+    
+    float Msec = LoopTimer.ElapsedMsec();
+    printf ("CPU (separable) took %.3f msec\n",Msec);
+    printf ("Average msec per iteration for CPU = %.3f (threads = %d)\n",
+                                                           Msec / float(Nrpt),Threads);
+    PassStats.Report("CPU iterations");
+    if (Nrpt <= 0) {
+        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    } else {
+        float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+        NoteResults(OutputArray,false,Nx,Ny,Details,&OutputArrayData);
+        free(OutputArray);
+    }
+    printf ("\n");
+    
+    if (OutputArrayData) free(OutputArrayData);
+    if (InputArrayData) free(InputArrayData);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              I t e r a t e  ( G P U  a n d  C P U )
+//
+//  ComputeIterateUsingGPU() runs the median filter repeatedly for 'Iterate', each pass filtering
+//  the result of the one before, until a pass changes no more than Threshold pixels, or Passes
+//  passes have been run. All the passes are recorded into one command buffer, with a barrier
+//  between each and the next, and the image stays on the GPU throughout. It goes back and forth
+//  between two buffers, A and B, by having three descriptor sets - the input image to A for the
+//  first pass, then A to B and B to A in turn - so nothing is copied between passes. The shader
+//  (MedianIterate.spv) counts the pixels each pass changes in a small buffer, and a pass that
+//  finds the one before changed few enough does nothing, so there's no need for the CPU to look
+//  at the counts until the end. Only then are they read, to find how many passes did anything,
+//  and so which of A and B holds the result. Each repeat starts again from the input image.
+
+static const char* const C_IterateShader = "MedianIterate.spv";
+static const int C_ChangeBufferBinding = 3;
+
+//  Returns the number of passes that did anything, given the counts of the pixels they changed.
+//  The first pass always runs, and each after that only if the one before changed more than
+//  Threshold pixels.
+
+static int PassesRun(const uint32_t* Changes,int Passes,int Threshold)
+{
+    int Run = 1;
+    while (Run < Passes && Changes[Run - 1] > uint32_t(Threshold)) Run++;
+    return Run;
+}
+
+//  Lists the number of pixels changed by each pass that was run.
+
+static void ReportPasses(const char* Device,const uint32_t* Changes,int Run,int Passes,
+                                                                                int Threshold)
+{
+    printf ("%s ran %d of %d passes, %s. Pixels changed by each:",Device,Run,Passes,
+                 (Changes[Run - 1] <= uint32_t(Threshold)) ? "converged" : "not converged");
+    for (int Pass = 0; Pass < Run; Pass++) {
+        printf ("%s%u",(Pass % 10 == 0) ? "\n  " : " ",Changes[Pass]);
+    }
+    printf ("\n");
+}
+
+void ComputeIterateUsingGPU(int Nx,int Ny,int Npix,int Passes,int Threshold,int Nrpt,
+                         bool Validate,const std::string& DebugLevels,MedianDetails* Details)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU iterated filter setup starting");
+    
+    float** InputArray = nullptr;
+    
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+    
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    
+    //  The input buffer is just as for ComputeRankUsingGPU(), and is only read, by the first
+    //  pass, so the original image is kept for the CPU. A and B are both "READBACK", since
+    //  either can end up with the result.
+    
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    if (Details->InputData) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,Details->InputData,Length,StatusOK);
+    } else {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    }
+    VkDeviceSize Bytes;
+    float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+    if (!Details->InputData && InputBufferAddr) {
+        InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+    }
+    
+    KVVulkanFramework::KVBufferHandle BufferAHndl;
+    BufferAHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE","READBACK",StatusOK);
+    Framework.CreateBuffer(BufferAHndl,Length,StatusOK);
+    float* BufferAAddr = (float*)Framework.MapBuffer(BufferAHndl,&Bytes,StatusOK);
+    KVVulkanFramework::KVBufferHandle BufferBHndl;
+    BufferBHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE","READBACK",StatusOK);
+    Framework.CreateBuffer(BufferBHndl,Length,StatusOK);
+    float* BufferBAddr = (float*)Framework.MapBuffer(BufferBHndl,&Bytes,StatusOK);
+    
+    KVVulkanFramework::KVBufferHandle ChangeBufferHndl;
+    ChangeBufferHndl = Framework.SetBufferDetails(C_ChangeBufferBinding,"STORAGE","SHARED",
+                                                                                     StatusOK);
+    Framework.CreateBuffer(ChangeBufferHndl,VkDeviceSize(Passes) * sizeof(uint32_t),StatusOK);
+    uint32_t* Changes = (uint32_t*)Framework.MapBuffer(ChangeBufferHndl,&Bytes,StatusOK);
+    
+    //  The uniform buffer, as for ComputeUsingGPU(), for the whole image, which is the same for
+    //  every pass.
+    
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    } Parameters = {Nx,Ny,Npix,0,Ny,0,Details->HasBlanks,0};
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    MedianArgs* UniformAddr = (MedianArgs*)Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+    if (UniformAddr) *UniformAddr = Parameters;
+    ReportGPUMemory(Framework,StatusOK);
+    
+    //  The one layout serves all three descriptor sets, which differ only in which buffers are
+    //  at the input and output bindings.
+    
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(BufferAHndl);
+    Handles.push_back(ChangeBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    std::vector<long> Bindings = {C_UniformBufferBinding,C_InputBufferBinding,
+                                                  C_OutputBufferBinding,C_ChangeBufferBinding};
+    std::vector<KVVulkanFramework::KVBufferHandle> SetBuffers[3] = {
+        {UniformBufferHndl,InputBufferHndl,BufferAHndl,ChangeBufferHndl},
+        {UniformBufferHndl,BufferAHndl,BufferBHndl,ChangeBufferHndl},
+        {UniformBufferHndl,BufferBHndl,BufferAHndl,ChangeBufferHndl}};
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,3,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSets[3];
+    for (int Set = 0; Set < 3; Set++) {
+        Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSets[Set],
+                                                                                     StatusOK);
+        Framework.SetupVulkanDescriptorSet(SetBuffers[Set],Bindings,DescriptorSets[Set],
+                                                                                     StatusOK);
+    }
+    
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    
+    //  The pipeline takes the pass number and threshold as push constants, which must match
+    //  IterateArgs in Median.comp.
+    
+    struct IterateArgs {
+        int Pass;
+        int Threshold;
+    };
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {C_WorkGroupSize,C_WorkGroupSize,BoxNpix(Npix)};
+    Framework.CreateComputePipeline(C_IterateShader,"main",&SetLayout,&ComputePipelineLayout,
+                        &ComputePipeline,SpecConstants,uint32_t(sizeof(IterateArgs)),StatusOK);
+    
+    //  One dispatch for each pass, with the push constants for each kept in place until the
+    //  batch is recorded.
+    
+    std::vector<IterateArgs> PassArgs;
+    for (int Pass = 0; Pass < Passes; Pass++) PassArgs.push_back({Pass,Threshold});
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches;
+    for (int Pass = 0; Pass < Passes; Pass++) {
+        KVVulkanFramework::KVDispatch Dispatch{};
+        Dispatch.PipelineHndl = ComputePipeline;
+        Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+        Dispatch.DescriptorSetHndl = DescriptorSets[(Pass == 0) ? 0 : 2 - (Pass % 2)];
+        Dispatch.WorkGroupCounts[0] = (uint32_t(Nx) + C_WorkGroupSize - 1) / C_WorkGroupSize;
+        Dispatch.WorkGroupCounts[1] = (uint32_t(Ny) + C_WorkGroupSize - 1) / C_WorkGroupSize;
+        Dispatch.WorkGroupCounts[2] = 1;
+        Dispatch.PushConstants = &PassArgs[Pass];
+        Dispatch.PushConstantSize = uint32_t(sizeof(IterateArgs));
+        Dispatches.push_back(Dispatch);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl,
+                                                                          ChangeBufferHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {BufferAHndl,BufferBHndl,
+                                                                          ChangeBufferHndl};
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+    
+    //  The repeat loop clears the counts and runs the whole batch of passes each time, and the
+    //  kernel time is that of all of them.
+    
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecTimer ComputeTimer;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        memset(Changes,0,size_t(Passes) * sizeof(uint32_t));
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        if (!StatusOK) break;
+    }
+    
+    //  Report on the timing, and note the result, from A if an odd number of passes ran and
+    //  from B if an even number did.
+    
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+        }
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else {
+            Framework.InvalidateBuffer(ChangeBufferHndl,StatusOK);
+            int Run = PassesRun(Changes,Passes,Threshold);
+            ReportPasses("GPU",Changes,Run,Passes,Threshold);
+            KVVulkanFramework::KVBufferHandle ResultHndl = (Run % 2) ? BufferAHndl : BufferBHndl;
+            Framework.InvalidateBuffer(ResultHndl,StatusOK);
+            float** OutputArray = CreateRowAddrs((Run % 2) ? BufferAAddr : BufferBAddr,Nx,Ny);
+            NoteResults(OutputArray,true,Nx,Ny,Details);
+            free(OutputArray);
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n");
+    }
+    printf ("\n");
+    
+    if (InputArray) free(InputArray);
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ComputeIterateUsingCPU() is the CPU counterpart, which goes back and forth between two
+//  images of its own in the same way, counting the pixels each pass changes, and stopping
+//  under the same rule. Each pass is OnePassUsingCPU(), and the results should be the same as
+//  the GPU's. The histogram filter isn't used, since its results would drift away from the
+//  true median over the passes, so the main routine doesn't use the CPU for larger boxes.
+
+void ComputeIterateUsingCPU(int Threads,int Nx,int Ny,int Npix,int Passes,int Threshold,
+                                  int Nrpt,bool Simd,int Warmup,MedianDetails* Details)
+{
+    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                         bool Histogram,bool Simd,bool Blanks,float* BinWidth);
+    
+    size_t Bytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+    float* InputArrayData = nullptr;
+    if (!Details->InputData) {
+        InputArrayData = (float*)malloc(Bytes);
+        float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+        free(InputArray);
+    }
+    float* InputData = Details->InputData ? Details->InputData : InputArrayData;
+    float* ImageData[2] = {(float*)malloc(Bytes),(float*)malloc(Bytes)};
+    float** InputRows = CreateRowAddrs(InputData,Nx,Ny);
+    float** ImageRows[2] = {CreateRowAddrs(ImageData[0],Nx,Ny),CreateRowAddrs(ImageData[1],Nx,Ny)};
+    std::vector<uint32_t> Changes(Passes);
+    
+    MsecTimer LoopTimer;
+    MsecStats PassStats;
+    PassStats.SetWarmup(Warmup);
+    int Run = 0;
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer PassTimer;
+        TraceScope PassTrace("CPU pass","Iterate");
+        std::fill(Changes.begin(),Changes.end(),0);
+        for (Run = 0; Run < Passes; Run++) {
+            if (Run > 0 && Changes[Run - 1] <= uint32_t(Threshold)) break;
+            float** From = (Run == 0) ? InputRows : ImageRows[(Run + 1) % 2];
+            float** To = ImageRows[Run % 2];
+            float BinWidth;
+            Threads = OnePassUsingCPU(Threads,From,Nx,Ny,Npix,To,false,Simd,
+                                                                Details->HasBlanks,&BinWidth);
+            std::atomic<uint32_t> Changed(0);
+            ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+                uint32_t BandChanged = 0;
+                for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                    const float* Before = From[Iy];
+                    const float* After = To[Iy];
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        BandChanged += !((Before[Ix] == After[Ix]) |
+                                         ((Before[Ix] != Before[Ix]) & (After[Ix] != After[Ix])));
+                    }
+                }
+                Changed += BandChanged;
+            });
+            Changes[Run] = Changed;
+        }
+        PassStats.Record(PassTimer.ElapsedMsec());
+    }
+    
+    float Msec = LoopTimer.ElapsedMsec();
+    printf ("CPU took %.3f msec\n",Msec);
+    printf ("Average msec per iteration for CPU = %.3f (threads = %d)\n",
+                                                           Msec / float(Nrpt),Threads);
+    PassStats.Report("CPU iterations");
+    if (Nrpt <= 0) {
+        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    } else {
+        ReportPasses("CPU",Changes.data(),Run,Passes,Threshold);
+        NoteResults(ImageRows[(Run + 1) % 2],false,Nx,Ny,Details,&ImageData[(Run + 1) % 2]);
+    }
+    printf ("\n");
+    
+    for (int Image = 0; Image < 2; Image++) {
+        free(ImageRows[Image]);
+        if (ImageData[Image]) free(ImageData[Image]);
+    }
+    free(InputRows);
+    if (InputArrayData) free(InputArrayData);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              C h a i n  ( G P U  a n d  C P U )
+//
+//  ComputeChain() runs the reduction given by 'Chain' - a list of steps such as subtracting a
+//  bias level, subtracting a median filtered background and scaling - as one ImageGraph. On
+//  the GPU, every step is dispatched from the one command buffer, and the intermediate images
+//  stay in GPU memory, so the image is loaded once and only the final result is read back,
+//  rather than the image going back and forth between the CPU and GPU for each step. On the
+//  CPU, the same graph is run by ImageGraph::Evaluate(), with the median filters done by
+//  OnePassUsingCPU(), so the two results can be compared by NoteResults() in the usual way.
+//  Since the CPU has to use the histogram filter for boxes larger than C_MaxWorkNpix, the
+//  comparison then allows for its bin width, multiplied by any scaling that follows.
+
+void ComputeChain(int Nx,int Ny,const std::vector<ChainStep>& Steps,int Nrpt,bool UseGPU,
+                         bool UseCPU,int Threads,bool Validate,const std::string& DebugLevels,
+                                                                      MedianDetails* Details)
+{
+    //  Forward declaration for the routine that does the CPU median filters.
+    
+    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                         bool Histogram,bool Simd,bool Blanks,float* BinWidth);
+    
+    bool StatusOK = true;
+    
+    //  The Framework is only set up if the GPU is used, but the graph is always described.
+    
+    KVVulkanFramework Framework;
+    ImageGraph Graph(Framework);
+    ImageGraph::Image Current = Graph.Input();
+    float ScaleFactor = 1.0;
+    for (const ChainStep& Step : Steps) {
+        int Size = int(Step.Value);
+        float Value = float(Step.Value);
+        if (Step.Name == "bias") {
+            Current = Graph.Offset(Current,-Value);
+        } else if (Step.Name == "offset") {
+            Current = Graph.Offset(Current,Value);
+        } else if (Step.Name == "scale") {
+            Current = Graph.Scale(Current,Value);
+            ScaleFactor *= fabsf(Value);
+        } else if (Step.Name == "median") {
+            Current = Graph.Median(Current,Size);
+        } else if (Step.Name == "background") {
+            Current = Graph.Subtract(Current,Graph.Median(Current,Size));
+        } else if (Step.Name == "smooth") {
+            std::vector<float> Weights(size_t(Size * Size),1.0f / float(Size * Size));
+            Current = Graph.Convolve(Current,Weights,Size);
+        }
+    }
+    Graph.SetOutput(Current);
+    if (Current == ImageGraph::C_NoImage) {
+        printf ("Unable to set up the reduction: %s\n",Graph.GetError().c_str());
+        return;
+    }
+    
+    //  The input image is the one read from the file, or a test image.
+    
+    std::vector<float> TestImage;
+    const float* Input = Details->InputData;
+    if (Input == nullptr) {
+        TestImage.resize(size_t(Nx) * size_t(Ny));
+        float** InputArray = CreateRowAddrs(TestImage.data(),Nx,Ny);
+        SetInputArray(InputArray,Nx,Ny,Details);
+        free(InputArray);
+        Input = TestImage.data();
+    }
+    
+    if (UseGPU) {
+        MsecTimer SetupTimer;
+        TheDebugHandler.Log("Setup","GPU chain setup starting");
+        Framework.SetDebugSystemName("Vulkan");
+        Framework.SetDebugLevels(DebugLevels);
+        Framework.EnableValidation(Validate);
+        Framework.CreateVulkanInstance(StatusOK);
+        Framework.FindSuitableDevice(StatusOK);
+        Framework.CreateLogicalDevice(StatusOK);
+        
+        //  The input buffer is imported if the data came from a file, as for ComputeUsingGPU(),
+        //  and otherwise the test image is copied into a shared buffer.
+        
+        VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+        KVVulkanFramework::KVBufferHandle InputBufferHndl;
+        if (Details->InputData) {
+            InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+            Framework.ImportBuffer(InputBufferHndl,Details->InputData,Length,StatusOK);
+        } else {
+            InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+            Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+            VkDeviceSize Bytes;
+            void* InputBufferAddr = Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+            if (StatusOK && InputBufferAddr) memcpy(InputBufferAddr,Input,Length);
+        }
+        Graph.Build(Nx,Ny,Details->HasBlanks,InputBufferHndl,StatusOK);
+        EndOfStartup();
+        int Nloop = Nrpt;
+        if (StatusOK) {
+            TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+            printf ("GPU graph: %s\n",Graph.Description().c_str());
+        } else {
+            printf("GPU setup failed. %s\n",Graph.GetError().c_str());
+            Nloop = 0;
+        }
+        
+        //  Each pass runs the whole graph, from the input image to the result.
+        
+        Framework.EnableDispatchTiming(true,StatusOK);
+        float KernelMsec = 0.0;
+        bool KernelTimed = false;
+        MsecTimer ComputeTimer;
+        for (int Irpt = 0; Irpt < Nloop; Irpt++) {
+            TraceScope PassTrace("GPU pass","Median");
+            Graph.Run(StatusOK);
+            float DispatchMsec;
+            if (Graph.GetKernelMsec(&DispatchMsec)) {
+                KernelMsec += DispatchMsec;
+                KernelTimed = true;
+            }
+            if (!StatusOK) break;
+        }
+        if (StatusOK) {
+            float Msec = ComputeTimer.ElapsedMsec();
+            printf ("GPU took %.3f msec\n",Msec);
+            printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nloop));
+            if (KernelTimed) {
+                printf ("GPU kernels took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nloop));
+            }
+            if (Nloop <= 0) {
+                printf ("No values computed using GPU, as number of repeats set to zero.\n");
+            } else {
+                float** OutputArray = CreateRowAddrs(Graph.Output(),Nx,Ny);
+                NoteResults(OutputArray,true,Nx,Ny,Details);
+                free(OutputArray);
+            }
+        } else {
+            if (Nloop > 0) printf ("GPU execution failed.\n");
+        }
+        printf ("\n");
+    }
+    
+    if (UseCPU) {
+        
+        //  The median filters use the same CPU code as the normal test, noting the largest
+        //  bin width if any need the histogram filter.
+        
+        float BinWidth = 0.0;
+        ImageGraph::MedianFilter Filter = [&](const float* In,float* Out,int FilterNx,
+                                                 int FilterNy,int Npix,bool Blanks) {
+            float** InArray = CreateRowAddrs(const_cast<float*>(In),FilterNx,FilterNy);
+            float** OutArray = CreateRowAddrs(Out,FilterNx,FilterNy);
+            float Width = 0.0;
+            OnePassUsingCPU(Threads,InArray,FilterNx,FilterNy,Npix,OutArray,
+                                                  Npix > C_MaxWorkNpix,false,Blanks,&Width);
+            BinWidth = std::max(BinWidth,Width);
+            free(OutArray);
+            free(InArray);
+        };
+        std::vector<float> Output(size_t(Nx) * size_t(Ny));
+        MsecTimer LoopTimer;
+        for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+            TraceScope PassTrace("CPU pass","Median");
+            Graph.Evaluate(Input,Output.data(),Nx,Ny,Details->HasBlanks,Filter);
+        }
+        float Msec = LoopTimer.ElapsedMsec();
+        printf ("CPU took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for CPU = %.3f\n",Msec / float(Nrpt));
+        if (BinWidth > 0.0) {
+            Details->HistogramTolerance = BinWidth * ScaleFactor;
+            printf ("Histogram filter results are within %g of the median\n",BinWidth * 0.5);
+        }
+        if (Nrpt <= 0) {
+            printf ("No values computed using CPU, as number of repeats set to zero.\n");
+        } else {
+            float** OutputArray = CreateRowAddrs(Output.data(),Nx,Ny);
+            NoteResults(OutputArray,false,Nx,Ny,Details);
+            free(OutputArray);
+        }
+        printf ("\n");
+    }
+    
+    //  The Framework destructor will release all the various Vulkan resources.
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            G P U  c o d e  ( s t r e a m )
+//
+//  ComputeStreamUsingGPU() filters a FITS file a band of rows at a time, without ever holding
+//  the whole image. The other routines read the whole image, filter it, and then write it, so
+//  the program needs memory for about three copies of the image, and the GPU sits idle while
+//  the file is read and written. Here the input buffer is a window holding one band plus the
+//  Npix/2 rows of halo above and below it (just as for 'InPlace'), and the output buffer holds
+//  one band. While the GPU filters one band, submitted with SubmitCommandBuffer() rather than
+//  RunCommandBuffer(), the CPU writes the previous band to the output file and reads the rows
+//  the next band needs, so most of the file I/O is hidden behind the computation. Memory use
+//  is set by the band size, not the image size. Once the GPU has finished, the results are
+//  copied to a buffer for writing while the next band runs, and the new rows are copied into
+//  the window. Those copies are cheap compared with the reads and writes they let overlap.
+//  The window the CPU builds up is in ordinary memory, and the GPU's copy of it is a "LOCAL"
+//  buffer, so the shader reads it from device memory. Each band's window goes to the GPU
+//  through the Framework's upload ring - AllocateUpload() and SubmitUploads() - and the ring
+//  holds a few windows, so the space used by one band's upload is reused a few bands later.
+//
+//  The window's halo rows come from the previous window - the last 2 * Halo rows of one window
+//  are the first 2 * Halo rows of the next - so each row of the file is only read once. The
+//  output file is created with a copy of the input's header, as in ReadFitsFile(). Since the
+//  whole image is never in memory, there's nothing for the CPU code to check the results
+//  against, so this only uses the GPU.
+
+void ComputeStreamUsingGPU(const std::string& Filename,int Npix,bool Validate,bool Tiled,
+                                                                 const std::string& DebugLevels)
+{
+#ifdef USE_CFITSIO
+
+    bool StatusOK = true;
+    char Error[80];
+    int Status = 0;
+
+    //  Open the input file, get the image size, and create the output file, with the same
+    //  name as ReadFitsFile() would use.
+
+    std::filesystem::path InputPath(Filename);
+    std::string MedianFile =
+               (InputPath.parent_path() / ("Median_" + InputPath.filename().string())).string();
+    fitsfile* InFptr = nullptr;
+    fitsfile* OutFptr = nullptr;
+    int Naxis = 0;
+    long Naxes[2] = {0,0};
+    std::string CreateName = "!" + MedianFile;
+    if (fits_open_file(&InFptr,Filename.c_str(),READONLY,&Status) == 0 &&
+            fits_get_img_dim(InFptr,&Naxis,&Status) == 0 &&
+                    fits_get_img_size(InFptr,2,Naxes,&Status) == 0) {
+        if (Naxis != 2) {
+            strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+            Status = 1;
+        } else if (fits_create_file(&OutFptr,CreateName.c_str(),&Status) == 0) {
+            fits_copy_header(InFptr,OutFptr,&Status);
+        }
+    }
+    if (Status != 0) {
+        if (Status > 1) fits_get_errstatus (Status,Error);
+        printf ("Error reading FITS file: %s\n",Error);
+        int CloseStatus = 0;
+        if (OutFptr) fits_close_file(OutFptr,&CloseStatus);
+        CloseStatus = 0;
+        if (InFptr) fits_close_file(InFptr,&CloseStatus);
+        return;
+    }
+    int Nx = int(Naxes[0]);
+    int Ny = int(Naxes[1]);
+    TheDebugHandler.Logf("Fits","Streaming 2D data array %d by %d",Nx,Ny);
+
+    //  Reading and writing a set of rows. fits_read_pix() reads blank pixels as NaNs, and
+    //  notes if there were any, as fits_read_img() does in ReadFitsFile().
+
+    auto ReadRows = [&](int FirstRow,int Rows,float* Data,bool* Blanks) {
+        long Fpixel[2] = {1,long(FirstRow) + 1};
+        float Nullval = NAN;
+        int Anynull = 0;
+        fits_read_pix(InFptr,TFLOAT,Fpixel,long(Rows) * long(Nx),&Nullval,Data,&Anynull,&Status);
+        *Blanks = (Anynull != 0);
+    };
+    auto WriteRows = [&](int FirstRow,int Rows,float* Data) {
+        long Fpixel[2] = {1,long(FirstRow) + 1};
+        fits_write_pix(OutFptr,TFLOAT,Fpixel,long(Rows) * long(Nx),Data,&Status);
+    };
+
+    //  Work out the size of a band, and of the window that holds it and its halo.
+
+    int Halo = Npix / 2;
+    VkDeviceSize RowBytes = VkDeviceSize(Nx) * sizeof(float);
+    int BandRows = int(C_StreamBandBytes / RowBytes);
+    if (BandRows < 1) BandRows = 1;
+    if (BandRows > Ny) BandRows = Ny;
+    int WindowRows = BandRows + 2 * Halo;
+    TheDebugHandler.Logf("Setup","Bands of %d rows, window of %d rows",BandRows,WindowRows);
+
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+
+    MsecTimer SetupTimer;
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+
+    //  The window buffer is the shader's input, uploaded from Window, which the CPU builds up,
+    //  and the band buffer is its output, read back by the CPU. ReadBuffer and WriteBuffer are
+    //  ordinary memory, holding the rows being read for the next band and the results of the
+    //  last band being written.
+
+    VkDeviceSize Bytes;
+    VkDeviceSize WindowBytes = VkDeviceSize(WindowRows) * RowBytes;
+    KVVulkanFramework::KVBufferHandle WindowBufferHndl;
+    WindowBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                             "LOCAL",StatusOK);
+    Framework.CreateBuffer(WindowBufferHndl,WindowBytes,StatusOK);
+    Framework.CreateUploadRing(C_StreamRingWindows * WindowBytes,StatusOK);
+    std::vector<float> Window(size_t(WindowRows) * size_t(Nx));
+    float* WindowAddr = Window.data();
+    KVVulkanFramework::KVBufferHandle BandBufferHndl;
+    BandBufferHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+    Framework.CreateBuffer(BandBufferHndl,VkDeviceSize(BandRows) * RowBytes,StatusOK);
+    float* BandAddr = (float*)Framework.MapBuffer(BandBufferHndl,&Bytes,StatusOK);
+    std::vector<float> ReadBuffer(size_t(BandRows) * size_t(Nx));
+    std::vector<float> WriteBuffer(size_t(BandRows) * size_t(Nx));
+
+    //  The uniform buffer, as for ComputeUsingGPU(), but the band details change for each band.
+
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    } Parameters = {Nx,Ny,Npix,0,0,0,0,0};
+
+    KVVulkanFramework::KVBufferHandle UniformBufferHndl;
+    UniformBufferHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                   "UNIFORM","SHARED",StatusOK);
+    Framework.CreateBuffer(UniformBufferHndl,sizeof(MedianArgs),StatusOK);
+    MedianArgs* UniformAddr = (MedianArgs*)Framework.MapBuffer(UniformBufferHndl,&Bytes,StatusOK);
+
+    //  The descriptor set, queue, command buffer and pipeline are just as for ComputeUsingGPU().
+
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(UniformBufferHndl);
+    Handles.push_back(WindowBufferHndl);
+    Handles.push_back(BandBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+    Framework.EnableDispatchTiming(true,StatusOK);
+    EndOfStartup();
+    if (StatusOK) {
+        printf ("GPU setup took %.3f msec\n",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+    }
+
+    //  The first band's window is read directly. Its first Halo rows are above the top of the
+    //  image, so are never read by the shader. NextRow is the next row to be read from the file.
+    //  The shader only needs to allow for blanks if there are any in the window, and this is
+    //  the case if the last set of rows read with blanks extends into it. (Noting which rows
+    //  were read with any blanks is quicker than checking each window for them.)
+
+    MsecTimer StreamTimer;
+    float IOMsec = 0.0;
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    int Bands = 0;
+    bool SeenBlanks = false;
+    int LastBlankRow = 0;
+    int NextRow = std::min(BandRows + Halo,Ny);
+    if (StatusOK) {
+        bool Blanks = false;
+        MsecTimer IOTimer;
+        ReadRows(0,NextRow,WindowAddr + size_t(Halo) * size_t(Nx),&Blanks);
+        IOMsec += IOTimer.ElapsedMsec();
+        if (Blanks) {
+            SeenBlanks = true;
+            LastBlankRow = NextRow - 1;
+        }
+    }
+    int WriteFirst = 0;
+    int WriteRowsPending = 0;
+
+    for (int FirstRow = 0; FirstRow < Ny && Status == 0 && StatusOK; FirstRow += BandRows) {
+
+        //  Start the GPU on this band.
+
+        int Rows = std::min(BandRows,Ny - FirstRow);
+        int WindowFirst = FirstRow - Halo;
+        Parameters.FirstRow = FirstRow;
+        Parameters.Rows = Rows;
+        Parameters.InputFirstRow = WindowFirst;
+        Parameters.OutputFirstRow = FirstRow;
+        Parameters.Blanks = (SeenBlanks && LastBlankRow >= WindowFirst);
+        *UniformAddr = Parameters;
+
+        uint32_t WorkGroupCounts[3];
+        WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+        WorkGroupCounts[1] = (uint32_t(Rows) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+        WorkGroupCounts[2] = 1;
+
+        //  Upload the rows of the window that hold image data - not any above the top or below
+        //  the bottom of the image. The copy is submitted to the same queue as the dispatch,
+        //  and ends with a barrier, so the shader sees the new window.
+
+        int ValidFirst = std::max(0,-WindowFirst);
+        int ValidEnd = std::min(WindowRows,NextRow - WindowFirst);
+        if (ValidEnd > ValidFirst) {
+            VkDeviceSize UploadBytes = VkDeviceSize(ValidEnd - ValidFirst) * RowBytes;
+            void* UploadAddr = Framework.AllocateUpload(WindowBufferHndl,
+                                     VkDeviceSize(ValidFirst) * RowBytes,UploadBytes,StatusOK);
+            if (UploadAddr) {
+                memcpy(UploadAddr,WindowAddr + size_t(ValidFirst) * size_t(Nx),
+                                                                        size_t(UploadBytes));
+            }
+            Framework.SubmitUploads(CommandPool,ComputeQueue,VK_NULL_HANDLE,VK_NULL_HANDLE,
+                                                                                    StatusOK);
+        }
+        Framework.RecordComputeCommandBuffer(CommandBuffer,ComputePipeline,
+                                  ComputePipelineLayout,&DescriptorSet,WorkGroupCounts,StatusOK);
+        KVVulkanFramework::KVSubmitTicket Ticket =
+                             Framework.SubmitCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+
+        //  While it runs, write out the results for the last band, and read the rows the next
+        //  band will need that aren't already in the window.
+
+        MsecTimer IOTimer;
+        if (WriteRowsPending > 0) WriteRows(WriteFirst,WriteRowsPending,WriteBuffer.data());
+        int NextFirst = FirstRow + BandRows;
+        int ReadFirst = NextRow;
+        int ReadRowsCount = 0;
+        bool Blanks = false;
+        if (NextFirst < Ny) {
+            NextRow = std::min(NextFirst + BandRows + Halo,Ny);
+            ReadRowsCount = NextRow - ReadFirst;
+            if (ReadRowsCount > 0) ReadRows(ReadFirst,ReadRowsCount,ReadBuffer.data(),&Blanks);
+        }
+        IOMsec += IOTimer.ElapsedMsec();
+
+        //  Once the GPU has finished, take a copy of its results, ready to write out, and set
+        //  up the window for the next band. That keeps the last 2 * Halo rows of this window,
+        //  and adds the new rows after them.
+
+        Framework.WaitFor(Ticket,StatusOK);
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+        }
+        Framework.SyncBuffer(BandBufferHndl,CommandPool,ComputeQueue,StatusOK);
+        if (!StatusOK) break;
+        memcpy(WriteBuffer.data(),BandAddr,size_t(Rows) * size_t(RowBytes));
+        WriteFirst = FirstRow;
+        WriteRowsPending = Rows;
+        if (NextFirst < Ny) {
+            memmove(WindowAddr,WindowAddr + size_t(BandRows) * size_t(Nx),
+                                                       size_t(2 * Halo) * size_t(RowBytes));
+            if (ReadRowsCount > 0) {
+                memcpy(WindowAddr + size_t(ReadFirst - (NextFirst - Halo)) * size_t(Nx),
+                                ReadBuffer.data(),size_t(ReadRowsCount) * size_t(RowBytes));
+            }
+            if (Blanks) {
+                SeenBlanks = true;
+                LastBlankRow = NextRow - 1;
+            }
+        }
+        Bands++;
+    }
+
+    //  Write out the last band, and close the files. As in WriteFitsFile(), a close error
+    //  shouldn't replace the description of an earlier error.
+
+    if (WriteRowsPending > 0 && Status == 0 && StatusOK) {
+        MsecTimer IOTimer;
+        WriteRows(WriteFirst,WriteRowsPending,WriteBuffer.data());
+        IOMsec += IOTimer.ElapsedMsec();
+    }
+    if (Status > 1) fits_get_errstatus (Status,Error);
+    int CloseStatus = 0;
+    if (OutFptr && fits_close_file(OutFptr,&CloseStatus)) {
+        if (Status == 0) fits_get_errstatus (CloseStatus,Error);
+        if (Status == 0) Status = CloseStatus;
+    }
+    CloseStatus = 0;
+    if (InFptr) fits_close_file(InFptr,&CloseStatus);
+
+    if (Status != 0) {
+        printf ("Error streaming FITS file: %s\n",Error);
+    } else if (!StatusOK) {
+        printf ("GPU execution failed.\n");
+    } else {
+        printf ("Streamed %d by %d image in %d bands of up to %d rows in %.3f msec\n",
+                                          Nx,Ny,Bands,BandRows,StreamTimer.ElapsedMsec());
+        printf ("File I/O took %.3f msec",IOMsec);
+        if (KernelTimed) printf (", GPU kernels %.3f msec",KernelMsec);
+        printf ("\n");
+        printf ("Output image written OK to %s\n",MedianFile.c_str());
+    }
+    printf ("\n");
+
+    //  The Framework destructor will release all the various Vulkan resources.
+
+#else
+
+    printf ("Cannot stream a FITS file, program was built without Cfitsio support\n");
+
+#endif
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              G P U  c o d e  ( c u b e )
+//
+//  ComputeCubeUsingGPU() filters each plane of a 3D FITS image - a data cube, such as the output
+//  of an integral field unit - writing the result to a "Median_" copy of the file, as usual. The
+//  planes are quite independent, so a median box never reaches from one plane into the next.
+//  The GPU is set up just once, and the planes are passed through a small ring of C_CubeSlots
+//  'slots', each with its own input, output and uniform buffers, descriptor set and command
+//  buffer. Each slot's command buffer is recorded once, since it's the same for every plane, and
+//  only the blank pixel flag in its uniform buffer changes. For each plane the CPU waits for the
+//  slot that's next in turn to finish the plane it was given last time round, writes out that
+//  plane's result straight from the slot's output buffer, reads the new plane straight into the
+//  slot's input buffer, and submits it, without waiting. So while the CPU is reading and writing
+//  one plane, the GPU already has the next ones queued, and is kept busy for the whole cube.
+//
+//  As with 'Stream', the cube is never all in memory, so this only uses the GPU. The planes are
+//  read and written with fits_read_pix() and fits_write_pix(), and blank pixels are read as NaNs,
+//  as they are by ReadFitsFile().
+
+void ComputeCubeUsingGPU(const std::string& Filename,int Npix,bool Validate,bool Tiled,
+                                                                 const std::string& DebugLevels)
+{
+#ifdef USE_CFITSIO
+
+    bool StatusOK = true;
+    char Error[80];
+    int Status = 0;
+
+    //  Open the input file at its first image, get the cube's dimensions, and create the output
+    //  file, with the same name as ReadFitsFile() would use. A compressed cube's header has to be
+    //  turned back into that of an ordinary image.
+
+    std::filesystem::path InputPath(Filename);
+    std::string MedianFile =
+               (InputPath.parent_path() / ("Median_" + InputPath.filename().string())).string();
+    fitsfile* InFptr = nullptr;
+    fitsfile* OutFptr = nullptr;
+    int Naxis = 0;
+    long Naxes[3] = {0,0,0};
+    std::string CreateName = "!" + MedianFile;
+    if (fits_open_image(&InFptr,Filename.c_str(),READONLY,&Status) == 0 &&
+            fits_get_img_dim(InFptr,&Naxis,&Status) == 0 &&
+                    fits_get_img_size(InFptr,3,Naxes,&Status) == 0) {
+        if (Naxis != 3) {
+            strncpy(Error,"File main image is not 3-dimensional",sizeof(Error));
+            Status = 1;
+        } else if (fits_create_file(&OutFptr,CreateName.c_str(),&Status) == 0) {
+            int CompStatus = 0;
+            if (fits_is_compressed_image(InFptr,&CompStatus)) {
+                fits_img_decompress_header(InFptr,OutFptr,&Status);
+            } else {
+                fits_copy_header(InFptr,OutFptr,&Status);
+            }
+        }
+    }
+    if (Status != 0) {
+        if (Status > 1) fits_get_errstatus (Status,Error);
+        printf ("Error reading FITS file: %s\n",Error);
+        int CloseStatus = 0;
+        if (OutFptr) fits_close_file(OutFptr,&CloseStatus);
+        CloseStatus = 0;
+        if (InFptr) fits_close_file(InFptr,&CloseStatus);
+        return;
+    }
+    int Nx = int(Naxes[0]);
+    int Ny = int(Naxes[1]);
+    int Planes = int(Naxes[2]);
+    TheDebugHandler.Logf("Fits","Cube of %d planes, each %d by %d",Planes,Nx,Ny);
+
+    //  Reading and writing a plane.
+
+    auto ReadPlane = [&](int Plane,float* Data,bool* Blanks) {
+        long Fpixel[3] = {1,1,long(Plane) + 1};
+        float Nullval = NAN;
+        int Anynull = 0;
+        fits_read_pix(InFptr,TFLOAT,Fpixel,long(Nx) * long(Ny),&Nullval,Data,&Anynull,&Status);
+        *Blanks = (Anynull != 0);
+    };
+    auto WritePlane = [&](int Plane,float* Data) {
+        long Fpixel[3] = {1,1,long(Plane) + 1};
+        fits_write_pix(OutFptr,TFLOAT,Fpixel,long(Nx) * long(Ny),Data,&Status);
+    };
+
+    //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU().
+
+    MsecTimer SetupTimer;
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+
+    //  The uniform buffer has the same layout as in ComputeUsingGPU(), and each slot has its
+    //  own, since its Blanks flag is set for the plane it has.
+
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    };
+
+    //  Each slot's buffers. The input buffer is "SHARED", since the CPU reads each plane into
+    //  it, and the output is "READBACK", as in ComputeUsingGPU(). Plane is the plane the slot is
+    //  working on, or -1 if it has none.
+
+    struct CubeSlot {
+        KVVulkanFramework::KVBufferHandle UniformHndl;
+        KVVulkanFramework::KVBufferHandle InputHndl;
+        KVVulkanFramework::KVBufferHandle OutputHndl;
+        MedianArgs* UniformAddr = nullptr;
+        float* InputAddr = nullptr;
+        float* OutputAddr = nullptr;
+        VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+        VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+        KVVulkanFramework::KVSubmitTicket Ticket = KVVulkanFramework::KV_NULL_TICKET;
+        int Plane = -1;
+    };
+    CubeSlot Slots[C_CubeSlots];
+    VkDeviceSize PlaneBytes = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    VkDeviceSize Bytes;
+    std::vector<KVVulkanFramework::KVBufferHandle> AllHandles;
+    for (CubeSlot& Slot : Slots) {
+        Slot.UniformHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                          "UNIFORM","SHARED",StatusOK);
+        Framework.CreateBuffer(Slot.UniformHndl,sizeof(MedianArgs),StatusOK);
+        Slot.UniformAddr = (MedianArgs*)Framework.MapBuffer(Slot.UniformHndl,&Bytes,StatusOK);
+        Slot.InputHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                         "SHARED",StatusOK);
+        Framework.CreateBuffer(Slot.InputHndl,PlaneBytes,StatusOK);
+        Slot.InputAddr = (float*)Framework.MapBuffer(Slot.InputHndl,&Bytes,StatusOK);
+        Slot.OutputHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                       "READBACK",StatusOK);
+        Framework.CreateBuffer(Slot.OutputHndl,PlaneBytes,StatusOK);
+        Slot.OutputAddr = (float*)Framework.MapBuffer(Slot.OutputHndl,&Bytes,StatusOK);
+        AllHandles.push_back(Slot.UniformHndl);
+        AllHandles.push_back(Slot.InputHndl);
+        AllHandles.push_back(Slot.OutputHndl);
+    }
+
+    //  All the slots have the same descriptor set layout. The pool is sized from the buffers
+    //  of all the slots, so it has enough descriptors for all their sets.
+
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles(AllHandles.begin(),
+                                                                    AllHandles.begin() + 3);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(AllHandles,C_CubeSlots,&DescriptorPool,StatusOK);
+
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+
+    uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+    Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                         &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+
+    //  Now each slot's descriptor set and command buffer, which is recorded just this once.
+
+    uint32_t WorkGroupCounts[3];
+    WorkGroupCounts[0] = (uint32_t(Nx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+    WorkGroupCounts[1] = (uint32_t(Ny) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+    WorkGroupCounts[2] = 1;
+    for (int Islot = 0; Islot < C_CubeSlots; Islot++) {
+        CubeSlot& Slot = Slots[Islot];
+        std::vector<KVVulkanFramework::KVBufferHandle> SlotHandles(
+                         AllHandles.begin() + 3 * Islot,AllHandles.begin() + 3 * Islot + 3);
+        Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&Slot.DescriptorSet,
+                                                                                  StatusOK);
+        Framework.SetupVulkanDescriptorSet(SlotHandles,Slot.DescriptorSet,StatusOK);
+        Framework.CreateComputeCommandBuffer(CommandPool,&Slot.CommandBuffer,StatusOK);
+        Framework.RecordComputeCommandBuffer(Slot.CommandBuffer,ComputePipeline,
+                        ComputePipelineLayout,&Slot.DescriptorSet,WorkGroupCounts,StatusOK);
+    }
+    EndOfStartup();
+    if (StatusOK) {
+        printf ("GPU setup took %.3f msec, once for all %d planes\n",SetupTimer.ElapsedMsec(),
+                                                                                    Planes);
+    } else {
+        printf("GPU setup failed.\n");
+    }
+
+    //  Waiting for a slot to finish its plane, and writing out the result.
+
+    MsecTimer CubeTimer;
+    float IOMsec = 0.0;
+    float WaitMsec = 0.0;
+    auto FinishSlot = [&](CubeSlot& Slot) {
+        if (Slot.Plane < 0) return;
+        MsecTimer WaitTimer;
+        Framework.WaitFor(Slot.Ticket,StatusOK);
+        Framework.SyncBuffer(Slot.OutputHndl,CommandPool,ComputeQueue,StatusOK);
+        WaitMsec += WaitTimer.ElapsedMsec();
+        if (StatusOK && Status == 0) {
+            MsecTimer IOTimer;
+            WritePlane(Slot.Plane,Slot.OutputAddr);
+            IOMsec += IOTimer.ElapsedMsec();
+        }
+        Slot.Plane = -1;
+    };
+
+    for (int Plane = 0; Plane < Planes && Status == 0 && StatusOK; Plane++) {
+        CubeSlot& Slot = Slots[Plane % C_CubeSlots];
+        FinishSlot(Slot);
+        if (Status != 0 || !StatusOK) break;
+        bool Blanks = false;
+        MsecTimer IOTimer;
+        ReadPlane(Plane,Slot.InputAddr,&Blanks);
+        IOMsec += IOTimer.ElapsedMsec();
+        if (Status != 0) break;
+        MedianArgs Parameters = {Nx,Ny,Npix,0,Ny,0,Blanks,0};
+        *Slot.UniformAddr = Parameters;
+        Framework.SyncBuffer(Slot.InputHndl,CommandPool,ComputeQueue,StatusOK);
+        Slot.Ticket = Framework.SubmitCommandBuffer(ComputeQueue,Slot.CommandBuffer,StatusOK);
+        Slot.Plane = Plane;
+    }
+
+    //  The last planes are still with the GPU. They have to be waited for even after an error,
+    //  as their buffers mustn't be released while they're in use. The oldest comes first.
+
+    int FirstSlot = Planes % C_CubeSlots;
+    for (int Islot = 0; Islot < C_CubeSlots; Islot++) {
+        FinishSlot(Slots[(FirstSlot + Islot) % C_CubeSlots]);
+    }
+
+    //  Close the files. As in WriteFitsFile(), a close error shouldn't replace the description
+    //  of an earlier error.
+
+    if (Status > 1) fits_get_errstatus (Status,Error);
+    int CloseStatus = 0;
+    if (OutFptr && fits_close_file(OutFptr,&CloseStatus)) {
+        if (Status == 0) fits_get_errstatus (CloseStatus,Error);
+        if (Status == 0) Status = CloseStatus;
+    }
+    CloseStatus = 0;
+    if (InFptr) fits_close_file(InFptr,&CloseStatus);
+
+    if (Status != 0) {
+        printf ("Error filtering FITS cube: %s\n",Error);
+    } else if (!StatusOK) {
+        printf ("GPU execution failed.\n");
+    } else {
+        float Msec = CubeTimer.ElapsedMsec();
+        printf ("Filtered %d planes of %d by %d in %.3f msec (%.3f msec per plane)\n",
+                                          Planes,Nx,Ny,Msec,Msec / float(std::max(Planes,1)));
+        printf ("File I/O took %.3f msec, waiting for the GPU %.3f msec\n",IOMsec,WaitMsec);
+        printf ("Output cube written OK to %s\n",MedianFile.c_str());
+    }
+    printf ("\n");
+
+    //  The Framework destructor will release all the various Vulkan resources.
+
+#else
+
+    printf ("Cannot filter a FITS cube, program was built without Cfitsio support\n");
+
+#endif
+}
+
+//  IsFitsCube() is true if the first image in a FITS file has three dimensions. The main
+//  program uses it to send cubes to ComputeCubeUsingGPU().
+
+bool IsFitsCube(const std::string& Filename)
+{
+    int Naxis = 0;
+
+#ifdef USE_CFITSIO
+
+    int Status = 0;
+    fitsfile* Fptr = nullptr;
+    if (fits_open_image(&Fptr,Filename.c_str(),READONLY,&Status) == 0) {
+        fits_get_img_dim(Fptr,&Naxis,&Status);
+        int CloseStatus = 0;
+        fits_close_file(Fptr,&CloseStatus);
+    }
+    if (Status != 0) Naxis = 0;
+
+#endif
+
+    return (Naxis == 3);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             G P U  c o d e  ( t i l e s )
+//
+//  ComputeTiledUsingGPUs() filters an image too large for the GPU's memory - or for main memory
+//  - such as a full survey mosaic, splitting it into tiles (see TiledImage.h) and sharing them
+//  out between as many GPUs as there are, up to the number given by 'GPUs'. Each tile's input
+//  area includes a halo of Npix/2 pixels on each side, and is filtered as an image in its own
+//  right, which gives exactly the same result for the tile's own pixels as filtering the whole
+//  image would. There's a thread for each GPU, with its own Framework, and each takes the next
+//  tile from a shared TileQueue as it becomes free, so a faster GPU does more of them.
+//
+//  Neither image is ever read into memory as a whole. The input file's data unit is memory
+//  mapped, and each tile's rows are converted from the big-endian FITS format straight into
+//  the GPU's input buffer, much as MapFitsImage() does for a whole image. The output file is
+//  created by cfitsio, with a copy of the input header, and with its last pixel written so
+//  that cfitsio sizes the data unit, and then it too is mapped, and each tile's results are
+//  converted back and copied straight into their place in it. The system reads in the input
+//  and writes back the output as it needs to. So this only handles the usual uncompressed,
+//  unscaled float image (BITPIX = -32), as MapFitsImage() does.
+//
+//  As for a cube, each GPU has a small ring of C_TileSlots slots, each with its own buffers,
+//  descriptor set and command buffer, so while the GPU filters one tile the thread is copying
+//  the results of the last one out of one slot and the next tile into another. As with
+//  'Stream', the whole image is never in memory, so this only uses the GPU.
+
+void ComputeTiledUsingGPUs(const std::string& Filename,int Npix,int TileSize,int MaxGPUs,
+                                  bool Validate,bool Tiled,const std::string& DebugLevels)
+{
+#ifdef USE_CFITSIO
+
+    char Error[80];
+    int Status = 0;
+
+    //  Open the input file, check its image is one whose data unit can be used as it is, and
+    //  find where that starts. Then create the output file, with the same name as ReadFitsFile()
+    //  would use, and write its last pixel, so it has a full data unit to map.
+
+    std::filesystem::path InputPath(Filename);
+    std::string MedianFile =
+               (InputPath.parent_path() / ("Median_" + InputPath.filename().string())).string();
+    fitsfile* InFptr = nullptr;
+    fitsfile* OutFptr = nullptr;
+    int Naxis = 0;
+    long Naxes[2] = {0,0};
+    int Bitpix = 0;
+    char UrlType[FLEN_FILENAME];
+    LONGLONG HeadStart = 0;
+    LONGLONG InDataStart = 0;
+    LONGLONG OutDataStart = 0;
+    LONGLONG DataEnd = 0;
+    std::string CreateName = "!" + MedianFile;
+    if (fits_open_file(&InFptr,Filename.c_str(),READONLY,&Status) == 0 &&
+            fits_get_img_dim(InFptr,&Naxis,&Status) == 0 &&
+                fits_get_img_size(InFptr,2,Naxes,&Status) == 0 &&
+                    fits_get_img_type(InFptr,&Bitpix,&Status) == 0 &&
+                        fits_url_type(InFptr,UrlType,&Status) == 0 &&
+                            fits_get_hduaddrll(InFptr,&HeadStart,&InDataStart,&DataEnd,
+                                                                            &Status) == 0) {
+        auto KeyValue = [InFptr](const char* Name,double Default) {
+            int KeyStatus = 0;
+            double Value = Default;
+            if (fits_read_key(InFptr,TDOUBLE,Name,&Value,nullptr,&KeyStatus)) Value = Default;
+            return Value;
+        };
+        if (Naxis != 2) {
+            strncpy(Error,"File main image is not 2-dimensional",sizeof(Error));
+            Status = 1;
+        } else if (Bitpix != FLOAT_IMG || strcmp(UrlType,"file://") ||
+                      KeyValue("BSCALE",1.0) != 1.0 || KeyValue("BZERO",0.0) != 0.0 ||
+                        DataEnd - InDataStart < LONGLONG(Naxes[0]) * Naxes[1] * 4) {
+            strncpy(Error,"'Tiles' needs an uncompressed, unscaled float image",sizeof(Error));
+            Status = 1;
+        } else if (fits_create_file(&OutFptr,CreateName.c_str(),&Status) == 0 &&
+                        fits_copy_header(InFptr,OutFptr,&Status) == 0) {
+            long Lpixel[2] = {Naxes[0],Naxes[1]};
+            float Zero = 0.0;
+            fits_write_pix(OutFptr,TFLOAT,Lpixel,1,&Zero,&Status);
+            fits_get_hduaddrll(OutFptr,&HeadStart,&OutDataStart,&DataEnd,&Status);
+        }
+    }
+    if (Status > 1) fits_get_errstatus (Status,Error);
+    int CloseStatus = 0;
+    if (OutFptr && fits_close_file(OutFptr,&CloseStatus) && Status == 0) {
+        fits_get_errstatus (CloseStatus,Error);
+        Status = CloseStatus;
+    }
+    CloseStatus = 0;
+    if (InFptr) fits_close_file(InFptr,&CloseStatus);
+    if (Status != 0) {
+        printf ("Error reading FITS file: %s\n",Error);
+        return;
+    }
+    int Nx = int(Naxes[0]);
+    int Ny = int(Naxes[1]);
+    TheDebugHandler.Logf("Fits","Tiling 2D data array %d by %d",Nx,Ny);
+
+    //  Now map both files. The data unit of each starts at a multiple of 2880 bytes, so its
+    //  words are aligned.
+
+    MappedFile InputFile;
+    MappedFile OutputFile;
+    uint64_t DataBytes = uint64_t(Nx) * uint64_t(Ny) * sizeof(float);
+    if (!InputFile.Open(Filename) || InputFile.Bytes() < uint64_t(InDataStart) + DataBytes) {
+        printf ("Error mapping FITS file: %s\n",InputFile.GetError().c_str());
+        return;
+    }
+    if (!OutputFile.Open(MedianFile,true) ||
+                            OutputFile.Bytes() < uint64_t(OutDataStart) + DataBytes) {
+        printf ("Error mapping output file: %s\n",OutputFile.GetError().c_str());
+        return;
+    }
+    const uint32_t* InWords = (const uint32_t*)(InputFile.Address() + InDataStart);
+    uint32_t* OutWords = (uint32_t*)(OutputFile.Address() + OutDataStart);
+    const uint32_t One = 1;
+    bool Swap = (*(const unsigned char*)&One == 1);
+
+    //  Find how many GPUs there are to use, and split the image into tiles.
+
+    int NumberGPUs = 1;
+    {
+        bool ProbeOK = true;
+        KVVulkanFramework Probe;
+        Probe.SetDebugSystemName("VulkanProbe");
+        Probe.CreateVulkanInstance(ProbeOK);
+        if (ProbeOK) NumberGPUs = std::min(MaxGPUs,Probe.CountSuitableDevices(ProbeOK));
+        NumberGPUs = std::max(NumberGPUs,1);
+    }
+    TileGrid Grid(Nx,Ny,TileSize,TileSize,Npix / 2);
+    TileQueue Queue(Grid.Count());
+    int MaxInNx = Grid.MaxInNx();
+    int MaxInNy = Grid.MaxInNy();
+    TheDebugHandler.Logf("Setup","%d tiles, input areas up to %d by %d, %d GPUs",
+                                                     Grid.Count(),MaxInNx,MaxInNy,NumberGPUs);
+
+    //  What each GPU's thread reports back.
+
+    struct GPUResult {
+        bool StatusOK = true;
+        int Tiles = 0;
+        float SetupMsec = 0.0;
+        float KernelMsec = 0.0;
+        bool KernelTimed = false;
+    };
+    std::vector<GPUResult> Results(NumberGPUs);
+
+    //  The uniform buffer has the same layout as in ComputeUsingGPU().
+
+    struct MedianArgs {
+        int Nx;
+        int Ny;
+        int Npix;
+        int FirstRow;
+        int Rows;
+        int InputFirstRow;
+        int Blanks;
+        int OutputFirstRow;
+    };
+
+    //  The routine run by the thread for each GPU.
+
+    auto FilterTiles = [&](int Rank) {
+        GPUResult& Result = Results[Rank];
+        bool& StatusOK = Result.StatusOK;
+
+        //  The basic Vulkan initialisation sequence, as for ComputeUsingGPU(), but for the GPU
+        //  of the given rank.
+
+        MsecTimer SetupTimer;
+        KVVulkanFramework Framework;
+        Framework.SetDebugSystemName("Vulkan" + std::to_string(Rank));
+        Framework.SetDebugLevels(DebugLevels);
+        Framework.EnableValidation(Validate);
+        Framework.CreateVulkanInstance(StatusOK);
+        Framework.FindSuitableDevice(Rank,StatusOK);
+        Framework.CreateLogicalDevice(StatusOK);
+
+        //  Each slot's buffers, as for a cube, each big enough for the largest tile. Tile is
+        //  the tile the slot is working on, or -1 if it has none.
+
+        struct TileSlot {
+            KVVulkanFramework::KVBufferHandle UniformHndl;
+            KVVulkanFramework::KVBufferHandle InputHndl;
+            KVVulkanFramework::KVBufferHandle OutputHndl;
+            MedianArgs* UniformAddr = nullptr;
+            float* InputAddr = nullptr;
+            float* OutputAddr = nullptr;
+            VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+            VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+            KVVulkanFramework::KVSubmitTicket Ticket = KVVulkanFramework::KV_NULL_TICKET;
+            int Tile = -1;
+        };
+        TileSlot Slots[C_TileSlots];
+        VkDeviceSize TileBytes = VkDeviceSize(MaxInNx) * VkDeviceSize(MaxInNy) * sizeof(float);
+        VkDeviceSize Bytes;
+        std::vector<KVVulkanFramework::KVBufferHandle> AllHandles;
+        for (TileSlot& Slot : Slots) {
+            Slot.UniformHndl = Framework.SetBufferDetails(C_UniformBufferBinding,
+                                                              "UNIFORM","SHARED",StatusOK);
+            Framework.CreateBuffer(Slot.UniformHndl,sizeof(MedianArgs),StatusOK);
+            Slot.UniformAddr = (MedianArgs*)Framework.MapBuffer(Slot.UniformHndl,&Bytes,
+                                                                                  StatusOK);
+            Slot.InputHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                         "SHARED",StatusOK);
+            Framework.CreateBuffer(Slot.InputHndl,TileBytes,StatusOK);
+            Slot.InputAddr = (float*)Framework.MapBuffer(Slot.InputHndl,&Bytes,StatusOK);
+            Slot.OutputHndl = Framework.SetBufferDetails(C_OutputBufferBinding,"STORAGE",
+                                                                       "READBACK",StatusOK);
+            Framework.CreateBuffer(Slot.OutputHndl,TileBytes,StatusOK);
+            Slot.OutputAddr = (float*)Framework.MapBuffer(Slot.OutputHndl,&Bytes,StatusOK);
+            AllHandles.push_back(Slot.UniformHndl);
+            AllHandles.push_back(Slot.InputHndl);
+            AllHandles.push_back(Slot.OutputHndl);
+        }
+
+        //  The descriptor sets, queue and pipeline are set up just as for a cube, but the
+        //  command buffers are recorded for each tile, as the tiles at the edges are smaller.
+
+        std::vector<KVVulkanFramework::KVBufferHandle> Handles(AllHandles.begin(),
+                                                                    AllHandles.begin() + 3);
+        VkDescriptorSetLayout SetLayout;
+        Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+        VkDescriptorPool DescriptorPool;
+        Framework.CreateVulkanDescriptorPool(AllHandles,C_TileSlots,&DescriptorPool,StatusOK);
+        VkQueue ComputeQueue;
+        Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+        VkCommandPool CommandPool;
+        Framework.CreateCommandPool(&CommandPool,StatusOK);
+        uint32_t WorkGroupSize[2] = {C_WorkGroupSize,C_WorkGroupSize};
+        VkPipelineLayout ComputePipelineLayout;
+        VkPipeline ComputePipeline;
+        std::vector<uint32_t> SpecConstants = {WorkGroupSize[0],WorkGroupSize[1],BoxNpix(Npix)};
+        Framework.CreateComputePipeline(ShaderFile(false,Tiled),"main",&SetLayout,
+                             &ComputePipelineLayout,&ComputePipeline,SpecConstants,StatusOK);
+        for (int Islot = 0; Islot < C_TileSlots; Islot++) {
+            TileSlot& Slot = Slots[Islot];
+            std::vector<KVVulkanFramework::KVBufferHandle> SlotHandles(
+                         AllHandles.begin() + 3 * Islot,AllHandles.begin() + 3 * Islot + 3);
+            Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&Slot.DescriptorSet,
+                                                                                  StatusOK);
+            Framework.SetupVulkanDescriptorSet(SlotHandles,Slot.DescriptorSet,StatusOK);
+            Framework.CreateComputeCommandBuffer(CommandPool,&Slot.CommandBuffer,StatusOK);
+        }
+        Framework.EnableDispatchTiming(true,StatusOK);
+        Result.SetupMsec = SetupTimer.ElapsedMsec();
+
+        //  Waiting for a slot to finish its tile, and copying the tile's own pixels - not the
+        //  halo - into the output file, converted back to big-endian.
+
+        auto FinishSlot = [&](TileSlot& Slot) {
+            if (Slot.Tile < 0) return;
+            Framework.WaitFor(Slot.Ticket,StatusOK);
+            float DispatchMsec;
+            if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+                Result.KernelMsec += DispatchMsec;
+                Result.KernelTimed = true;
+            }
+            Framework.SyncBuffer(Slot.OutputHndl,CommandPool,ComputeQueue,StatusOK);
+            if (StatusOK) {
+                ImageTile TheTile = Grid.Tile(Slot.Tile);
+                for (int Iy = 0; Iy < TheTile.Ny; Iy++) {
+                    const uint32_t* From = (const uint32_t*)Slot.OutputAddr +
+                         size_t(TheTile.Y - TheTile.InY + Iy) * size_t(TheTile.InNx) +
+                                                                   (TheTile.X - TheTile.InX);
+                    uint32_t* To = OutWords + size_t(TheTile.Y + Iy) * size_t(Nx) + TheTile.X;
+                    for (int Ix = 0; Ix < TheTile.Nx; Ix++) {
+                        uint32_t Word = From[Ix];
+                        if (Swap) Word = (Word >> 24) | ((Word >> 8) & 0xff00) |
+                                                   ((Word << 8) & 0xff0000) | (Word << 24);
+                        To[Ix] = Word;
+                    }
+                }
+                Result.Tiles++;
+            }
+            Slot.Tile = -1;
+        };
+
+        //  Each tile's input area is converted into the next slot's input buffer, with the
+        //  same handling of blanks and underflows as MapFitsImage(), and then submitted,
+        //  without waiting, as a complete InNx by InNy image.
+
+        int Islot = 0;
+        int Tile;
+        while (StatusOK && Queue.Next(&Tile)) {
+            TileSlot& Slot = Slots[Islot];
+            FinishSlot(Slot);
+            if (!StatusOK) break;
+            ImageTile TheTile = Grid.Tile(Tile);
+            uint32_t Blanks = 0;
+            for (int Iy = 0; Iy < TheTile.InNy; Iy++) {
+                const uint32_t* From = InWords + size_t(TheTile.InY + Iy) * size_t(Nx) +
+                                                                                  TheTile.InX;
+                float* To = Slot.InputAddr + size_t(Iy) * size_t(TheTile.InNx);
+                for (int Ix = 0; Ix < TheTile.InNx; Ix++) {
+                    uint32_t Word = From[Ix];
+                    if (Swap) Word = (Word >> 24) | ((Word >> 8) & 0xff00) |
+                                                   ((Word << 8) & 0xff0000) | (Word << 24);
+                    uint32_t Exponent = Word & 0x7f800000;
+                    Blanks |= (Exponent == 0x7f800000);
+                    Word = (Exponent == 0x7f800000) ? 0x7fc00000 : (Exponent == 0) ? 0 : Word;
+                    memcpy(&To[Ix],&Word,sizeof(float));
+                }
+            }
+            MedianArgs Parameters = {TheTile.InNx,TheTile.InNy,Npix,0,TheTile.InNy,0,
+                                                                            Blanks != 0,0};
+            *Slot.UniformAddr = Parameters;
+            uint32_t WorkGroupCounts[3];
+            WorkGroupCounts[0] = (uint32_t(TheTile.InNx) + WorkGroupSize[0] - 1)/WorkGroupSize[0];
+            WorkGroupCounts[1] = (uint32_t(TheTile.InNy) + WorkGroupSize[1] - 1)/WorkGroupSize[1];
+            WorkGroupCounts[2] = 1;
+            Framework.SyncBuffer(Slot.InputHndl,CommandPool,ComputeQueue,StatusOK);
+            Framework.RecordComputeCommandBuffer(Slot.CommandBuffer,ComputePipeline,
+                        ComputePipelineLayout,&Slot.DescriptorSet,WorkGroupCounts,StatusOK);
+            Slot.Ticket = Framework.SubmitCommandBuffer(ComputeQueue,Slot.CommandBuffer,
+                                                                                  StatusOK);
+            Slot.Tile = Tile;
+            Islot = (Islot + 1) % C_TileSlots;
+        }
+
+        //  The last tiles are still with the GPU, and have to be waited for even after an
+        //  error, as their buffers mustn't be released while they're in use. The oldest is
+        //  in the slot that would have been used next.
+
+        for (int I = 0; I < C_TileSlots; I++) FinishSlot(Slots[(Islot + I) % C_TileSlots]);
+
+        //  The Framework destructor will release all the various Vulkan resources.
+    };
+
+    //  Run a thread for each GPU, and wait for them all to finish.
+
+    MsecTimer TilesTimer;
+    std::vector<std::thread> Threads;
+    for (int Rank = 0; Rank < NumberGPUs; Rank++) {
+        Threads.push_back(std::thread(FilterTiles,Rank));
+    }
+    for (auto& Thread : Threads) Thread.join();
+    float Msec = TilesTimer.ElapsedMsec();
+
+    //  Unmapping the output file writes it back. A GPU that fails stops taking tiles, and the
+    //  others carry on with the rest, but any tile it had already taken is left as zeros, so
+    //  that's reported as a failure.
+
+    bool WriteOK = OutputFile.Close();
+    InputFile.Close();
+    int TilesDone = 0;
+    for (const GPUResult& Result : Results) TilesDone += Result.Tiles;
+    if (!WriteOK) {
+        printf ("Error writing output file: %s\n",OutputFile.GetError().c_str());
+    } else if (TilesDone != Grid.Count()) {
+        printf ("GPU execution failed. %d of %d tiles were filtered.\n",TilesDone,Grid.Count());
+    } else {
+        printf ("Filtered %d by %d image in %d tiles of up to %d by %d, using %d GPU%s, "
+                   "in %.3f msec\n",Nx,Ny,Grid.Count(),std::min(TileSize,Nx),
+                   std::min(TileSize,Ny),NumberGPUs,NumberGPUs == 1 ? "" : "s",Msec);
+        for (int Rank = 0; Rank < NumberGPUs; Rank++) {
+            const GPUResult& Result = Results[Rank];
+            printf ("GPU %d: %d tiles, setup %.3f msec",Rank,Result.Tiles,Result.SetupMsec);
+            if (Result.KernelTimed) printf (", kernels %.3f msec",Result.KernelMsec);
+            if (!Result.StatusOK) printf (", failed");
+            printf ("\n");
+        }
+        printf ("Output image written OK to %s\n",MedianFile.c_str());
+    }
+    printf ("\n");
+
+#else
+
+    printf ("Cannot filter a FITS file in tiles, program was built without Cfitsio support\n");
+
+#endif
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    C P U  c o d e
+//
+//  This code performs the 'Median' operation using the CPU, and is designed to do exactly what
+//  ComputeUsingGPU() does, but using the CPU. The main routine called is ComputeUsingCPU(). Just
+//  like ComputeUsingGPU(), it is passed the dimensions of the arrays to use. It allocates an array
+//  of floats, Nx by Ny, and calls SetInputArray() to initialise it. It also creates an output
+//  array of the same size and performs the basic 'Median' operation to set the output array values
+//  based on those of the input array. It has to be passed the size of the median box in pixels
+//  (Npix, which should be an odd number).It is also passed the repeat count for the operation
+//  (Nrpt) and performs the operation the number of times specified in Nrpt. After performing the
+//  operation for the final time, it calls NoteResults() to allow the main code to compare the
+//  results with those of the GPU and to save the result to any output FITS file. It needs to
+//  be passed the program's MedianDetails structure so it can pass this on in turn to NoteResults().
+//  The CPU code can make use of multiple CPU threads. If Threads is passed as zero, it uses the
+//  maximum available number of CPU threads. Otherwise, Threads is taken as the maximum number of
+//  CPU threads to use. If the image is already in memory, in the MedianDetails, the CPU filters
+//  it there rather than in an array of its own, unless it is filtering in place.
+//
+//  The basic operation is performed by ComputeTileUsingCPU() and you could do the whole thing
+//  just with one call to ComputeTileUsingCPU() with the X and Y ranges set to cover the whole
+//  image. That would handle the whole image using one CPU thread. However, as this operation
+//  will probably gain by using CPU multi-threading, the main routine actually calls
+//  OnePassUsingCPU() for each iteration. This then handles the threading, splitting the image
+//  into tiles of C_CPUTileWidth columns by C_CPUTileRows rows, which the threads of the shared
+//  pool take one at a time, each running ComputeTileUsingCPU() on it, until none are left.
+
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Npix,int Nrpt,bool InPlace,bool Histogram,
+                                                             bool Simd,MedianDetails* Details,
+                                                                int Warmup,BenchReport* Bench)
+{
+    //  Forward declaration for the routine that does most of the work.
+    
+    int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                         bool Histogram,bool Simd,bool Blanks,float* BinWidth);
+    int OnePassUsingLayout(int Threads,const float* Packed,const ImageLayout& Layout,int Nx,
+                                           int Ny,int Npix,float** OutputArray,bool Blanks);
+    const char* SimdDescription(void);
+    
+    //  Create the two arrays we need, one for the input data, one for the output. To make things
+    //  easier for ourselves, setup two arrays that contain the addresses of the start of the
+    //  rows for the two arrays. This lets us use an InputArray[Iy][Ix] syntax instead of
+    //  having to calculate offsets as ArrayData[Iy * Nx + Iy]. It means that InputArray is not
+    //  actually the address of the allocated memory for the array itself. It's the address of
+    //  the array of row addresses - this is the trick used by the C version of Numerical Methods,
+    //  and I've always found it very effective.
+    
+    //  If the image is already in memory - read from the file, or made by the main routine for
+    //  both the GPU and CPU to use - the CPU filters it where it is, just as the GPU does when
+    //  it imports it, rather than working on a copy. Only filtering in place, which overwrites
+    //  the input, needs a copy of its own.
+    
+    bool SharedInput = (Details->InputData && !InPlace);
+    size_t ArrayBytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+    float* InputArrayData = nullptr;
+    if (!SharedInput) InputArrayData = (float*)AllocateArray(ArrayBytes);
+    float** InputArray = CreateRowAddrs(SharedInput ? Details->InputData : InputArrayData,Nx,Ny);
+    float* OutputArrayData = (float*)AllocateArray(ArrayBytes);
+    float** OutputArray = CreateRowAddrs(OutputArrayData,Nx,Ny);
+    TheDebugHandler.Logf("Setup","CPU arrays created, %d by %d%s",Nx,Ny,
+                                                   SharedInput ? ", using the shared input" : "");
+    
+    //  Initialise the input array, unless it's the shared one, and clear the output array.
+    //  Memory isn't given its physical pages until it's first written to, and on a machine with
+    //  more than one NUMA node, each page goes on the node of the thread that writes it. So both
+    //  are done a band at a time by the threads that will filter those bands - see
+    //  ForEachBand() - which puts each thread's part of the image in memory local to it.
+    
+    if (!SharedInput) SetInputArray(InputArray,Nx,Ny,Details,Threads);
+    ForEachBand(Threads,Ny,[&](int Iyst,int Iyen) {
+        memset(OutputArrayData + size_t(Iyst) * size_t(Nx),0,
+                                             size_t(Iyen - Iyst) * size_t(Nx) * sizeof(float));
+    });
+
+    //  See how many threads the hardware supports. If Threads was passed as zero, use this
+    //  maximum number of threads. Otherwise use the number passed in Threads, if that many
+    //  are available.
+    
+    int MaxThreads = std::thread::hardware_concurrency();
+    if (MaxThreads <= 0) MaxThreads = 1;
+    if (Threads <= 0) Threads = MaxThreads;
+    if (Threads > MaxThreads) Threads = MaxThreads;
+    TheDebugHandler.Logf("Setup","CPU using %d threads out of maximum of %d\n",Threads,MaxThreads);
+    
+    //  With 'Layout', the image is repacked into the layout given, once, before the timed
+    //  passes, and each pass filters the packed image using OnePassUsingLayout() instead.
+    //  The histogram filter works along rows, and has no version for the other layouts.
+    
+    ImageLayout Layout(Details->Layout,Nx,Ny);
+    if (Layout.Active() && Histogram) {
+        printf ("'Layout' is ignored by the CPU with the histogram filter.\n");
+        Layout = ImageLayout();
+    }
+    float* PackedData = nullptr;
+    if (Layout.Active()) {
+        PackedData = (float*)malloc(Layout.Size() * sizeof(float));
+        MsecTimer PackTimer;
+        Layout.Pack(InputArray[0],PackedData,Threads);
+        printf ("Image repacked in %s layout for the CPU in %.3f msec\n",
+                              ImageLayout::Name(Layout.GetMode()),PackTimer.ElapsedMsec());
+    }
+    
+    MsecTimer LoopTimer;
+    
+    //  Repeat a single pass through the whole image, as many times as specified by the repeat
+    //  count. OnePassUsingCPU is passed the number of threads specified (with zero meaning
+    //  use as many as are available) and returns the number actually used.
+    
+    //  If filtering in place, to match the GPU each repeat has to filter the result of the last.
+    //  The CPU doesn't need to save memory, so this just swaps the input and output arrays
+    //  between passes, which gives the same result.
+    
+    //  With 'Counters', the hardware counters count just the passes after the warm-up.
+    
+    PerfCounters Counters;
+    if (UseCounters && !Counters.Open()) {
+        printf ("CPU hardware counters not available: %s\n",Counters.Error().c_str());
+    }
+    
+    float BinWidth = 0.0;
+    MsecStats PassStats;
+    PassStats.SetWarmup(Warmup);
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer PassTimer;
+        TraceScope PassTrace("CPU pass","Median");
+        if (InPlace && Irpt > 0) std::swap(InputArray,OutputArray);
+        bool Counted = (Counters.IsOpen() && Irpt >= Warmup);
+        if (Counted) Counters.Start();
+        if (PackedData) {
+            Threads = OnePassUsingLayout(Threads,PackedData,Layout,Nx,Ny,Npix,OutputArray,
+                                                                          Details->HasBlanks);
+        } else {
+            Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,Npix,OutputArray,Histogram,Simd,
+                                                               Details->HasBlanks,&BinWidth);
+        }
+        if (Counted) Counters.Stop();
+        PassStats.Record(PassTimer.ElapsedMsec());
+    }
+    
+    //  Report on the timing, and check that we got it right.
+
+    float Msec = LoopTimer.ElapsedMsec();
+    std::string Engine = "";
+    if (Histogram) {
+        Engine = " (histogram filter)";
+    } else if (PackedData) {
+        Engine = std::string(" (") + ImageLayout::Name(Layout.GetMode()) + " layout)";
+    } else if (Simd && (Npix == 3 || Npix == 5 || Npix == 7)) {
+        Engine = std::string(" (SIMD, ") + SimdDescription() + ")";
+    }
+    printf ("CPU%s took %.3f msec\n",Engine.c_str(),Msec);
+    printf ("Average msec per iteration for CPU = %.3f (threads = %d)\n",
+                                                           Msec / float(Nrpt),Threads);
+    if (UseHugePages) {
+        if (InputArrayData) {
+            printf ("CPU input array: %s\n",HugePages::Describe(InputArrayData).c_str());
+        }
+        printf ("CPU output array: %s\n",HugePages::Describe(OutputArrayData).c_str());
+    }
+    PassStats.Report("CPU iterations");
+    double Pixels = double(Nx) * double(Ny);
+    if (Counters.IsOpen()) printf ("CPU counters: %s\n",Counters.Describe(Pixels).c_str());
+    if (Bench && PassStats.Count() > 0) {
+        Bench->SetContext("Median","CPU","","");
+        std::string Test = "CPU " + std::to_string(Npix) + "x" + std::to_string(Npix) + Engine +
+                                                    " " + std::to_string(Threads) + " thread(s)";
+        if (InPlace) Test += " in place";
+        Bench->AddRow(Test,Nx,Ny,PassStats);
+        if (Counters.IsOpen()) {
+            PerfCounters::Counts Totals = Counters.GetCounts();
+            Bench->AddCounters(PerfCounters::Ipc(Totals),
+                              PerfCounters::PerPixel(Totals,PerfCounters::CacheMisses,Pixels),
+                              PerfCounters::PerPixel(Totals,PerfCounters::BranchMisses,Pixels));
+        }
+    }
+    if (Histogram) printf ("Histogram filter results are within %g of the median\n",
+                                                                               BinWidth * 0.5);
+    bool FromGPU = false;
+    if (Nrpt <= 0) {
+        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    } else {
+        
+        //  The histogram filter results are within half a bin width of the exact ones. The
+        //  check allows a whole bin width, to allow for rounding.
+        
+        //  NoteResults() can keep the result array rather than copy it. After an odd number
+        //  of in place passes that's the one allocated as InputArrayData.
+        
+        if (Histogram) Details->HistogramTolerance = BinWidth;
+        float** Owner = (OutputArray[0] == OutputArrayData) ? &OutputArrayData : &InputArrayData;
+        NoteResults(OutputArray,FromGPU,Nx,Ny,Details,Owner);
+    }
+    printf ("\n");
+    
+    //  Release the arrays used to hold the row addresses for the two arrays, and the array
+    //  data.
+    
+    if (OutputArray) free(OutputArray);
+    if (InputArray) free(InputArray);
+    FreeArray(OutputArrayData);
+    FreeArray(InputArrayData);
+    if (PackedData) free(PackedData);
+}
+
+//  The CPU code works through the image in tiles. A tile's boxes only use the rows and columns
+//  of the tile and the Npix/2 around it, so for a box of up to 11 by 11 the part of the image a
+//  tile needs is about 40 rows of 520 values - 80 KBytes or so - which stays in a typical L2
+//  cache while the tile is worked on, however wide the image is. Working along whole rows of a
+//  wide image, the Npix rows the boxes need can be too large for the cache, so each value has
+//  to be fetched from memory again for every row that uses it. (The sliding median has to fill
+//  its box again at the start of each row of a tile, but with tiles this wide that's only a
+//  few percent more work.)
+
+static const int C_CPUTileWidth = 512;
+static const int C_CPUTileRows = 32;
+
+//  The rows of tiles are divided into a band for each thread, each of whole rows of tiles, so
+//  no page of the image is shared between bands unless the image is very narrow. ParallelFor()
+//  always gives the same sub-range to the same thread when called for the same range with the
+//  same number of threads, so with one band for each sub-range, a thread always gets the same
+//  band - and if the threads are pinned with 'Pin', so does each CPU. CPUBands() returns the
+//  number of bands, one for each of the threads that will be used.
+
+static int CPUBands(int Threads,int Ny)
+{
+    int TilesY = (Ny + C_CPUTileRows - 1) / C_CPUTileRows;
+    int Bands = ThreadPool::Shared().Threads();
+    if (Threads > 0 && Threads < Bands) Bands = Threads;
+    return std::max(1,std::min(Bands,TilesY));
+}
+
+//  BandRows() sets Iyst and Iyen to the rows in band Band of Bands, from Iyst up to (but not
+//  including) Iyen.
+
+static void BandRows(int Band,int Bands,int Ny,int* Iyst,int* Iyen)
+{
+    long TilesY = (Ny + C_CPUTileRows - 1) / C_CPUTileRows;
+    *Iyst = std::min(Ny,int((TilesY * Band) / Bands) * C_CPUTileRows);
+    *Iyen = std::min(Ny,int((TilesY * (Band + 1)) / Bands) * C_CPUTileRows);
+}
+
+//  ForEachBand() calls Body(Iyst,Iyen) for the rows of each band, in the thread that handles
+//  that band when the image is filtered using up to Threads threads (all of them if Threads is
+//  zero). It returns the number of threads used. Code that allocates an array the CPU will
+//  filter can use this to write it first, so each band's memory is local to its thread.
+
+int ForEachBand(int Threads,int Ny,const std::function<void(int,int)>& Body)
+{
+    int Bands = CPUBands(Threads,Ny);
+    return ThreadPool::Shared().ParallelFor(0,Bands,[&](int Band,int) {
+        int Iyst,Iyen;
+        BandRows(Band,Bands,Ny,&Iyst,&Iyen);
+        if (Iyen > Iyst) Body(Iyst,Iyen);
+    },Bands);
+}
+
+//  ShareTilesUsingCPU() calls TileBody(Ixst,Ixen,Iyst,Iyen) for each tile of the image, shared
+//  between up to Threads threads, and returns the number used. Each thread starts with the
+//  tiles of its own band, taking the next as soon as it has finished the last, and once there
+//  are none left it moves on to help with the bands that follow. So each thread mostly works
+//  on memory local to it, but a thread with slower tiles - more blanks, say, or the edges of
+//  the image - just does fewer of them, and all the threads finish at about the same time.
+
+int ShareTilesUsingCPU(int Threads,int Nx,int Ny,
+                                    const std::function<void(int,int,int,int)>& TileBody)
+{
+    //  Each band has a queue of tiles, which is just the next tile in it and the end of it.
+    
+    struct TileQueue {
+        std::atomic<int> Next;
+        int End;
+    };
+    int TilesX = (Nx + C_CPUTileWidth - 1) / C_CPUTileWidth;
+    int Bands = CPUBands(Threads,Ny);
+    std::vector<TileQueue> Queues(Bands);
+    for (int Band = 0; Band < Bands; Band++) {
+        int Iyst,Iyen;
+        BandRows(Band,Bands,Ny,&Iyst,&Iyen);
+        Queues[Band].Next = (Iyst / C_CPUTileRows) * TilesX;
+        Queues[Band].End = ((Iyen + C_CPUTileRows - 1) / C_CPUTileRows) * TilesX;
+    }
+    
+    //  With 'Threads' debugging, each thread logs how many tiles it took, how many of them
+    //  were from its own band, and how long they took.
+    
+    return ThreadPool::Shared().ParallelFor(0,Bands,[&](int Band,int) {
+        MsecTimer ThreadTimer;
+        int TilesDone = 0;
+        int OwnTiles = 0;
+        for (int Step = 0; Step < Bands; Step++) {
+            TileQueue& Queue = Queues[(Band + Step) % Bands];
+            for (int Tile = Queue.Next++; Tile < Queue.End; Tile = Queue.Next++) {
+                int Ixst = (Tile % TilesX) * C_CPUTileWidth;
+                int Iyst = (Tile / TilesX) * C_CPUTileRows;
+                TileBody(Ixst,std::min(Nx,Ixst + C_CPUTileWidth),Iyst,
+                                                         std::min(Ny,Iyst + C_CPUTileRows));
+                TilesDone++;
+            }
+            if (Step == 0) OwnTiles = TilesDone;
+        }
+        DEBUG_LOGF(TheDebugHandler,ThreadsDebug,
+                   "CPU thread filtered %d tiles, %d from its own band, in %.3f msec",
+                                               TilesDone,OwnTiles,ThreadTimer.ElapsedMsec());
+    },Bands);
+}
+
+//  ComputeTileUsingCPU() performs the CPU median calculation for a tile of the image - columns
+//  Ixst up to (not including) Ixen of rows Iyst up to Iyen, all starting from 0 - but only once
+//  and using a single thread. Input and Output are the image and result arrays, each Nx by Ny,
+//  with row Iy starting Iy * Nx values in. The box sizes with a selection network are fastest
+//  calculated pixel by pixel, which is done by NetworkMedianRow(), but for the others each row
+//  of the tile is filtered by SlidingMedianRow(), which updates the box as it moves along.
+//
+//  If the image has blank (NaN) pixels, which the networks can't leave out, BlankRows flags
+//  the rows that have any, and is otherwise null. SlidingMedianRow() always allows for them,
+//  but for NetworkMedianRow() each row of the tile checks the rows its boxes use, and the rows
+//  whose boxes include any blanks are done without the networks. The rows well away from any
+//  blanks still get the full speed of the networks. If Simd is set, NetworkMedianRow() runs
+//  the networks on blocks of pixels at once.
+
+void ComputeTileUsingCPU(const float* Input,int Nx,int Ny,int Ixst,int Ixen,int Iyst,int Iyen,
+                              int Npix,float* Output,const char* BlankRows,bool Simd)
+{
+    //  Forward definitions of the routines to calculate the medians for part of a row.
+    
+    void NetworkMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                     float* OutputRow,bool Blanks,bool Simd);
+    void SlidingMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                                           float* OutputRow);
+
+    bool Sliding = (Npix != 3 && Npix != 5 && Npix != 7);
+    int Npixby2 = Npix / 2;
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        float* OutputRow = Output + size_t(Iy) * size_t(Nx);
+        if (Sliding) SlidingMedianRow(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+        else {
+            bool RowBlanks = false;
+            if (BlankRows) {
+                int Jy = std::max(0,Iy - Npixby2);
+                int Jyen = std::min(Ny,Iy + Npixby2 + 1);
+                for (; Jy < Jyen && !RowBlanks; Jy++) RowBlanks = BlankRows[Jy];
+            }
+            NetworkMedianRow(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow,RowBlanks,Simd);
+        }
+    }
+}
+
+//  OnePassUsingCPU() performs the CPU median calculation over the whole image, only once, using
+//  up to a specified number (Threads) of CPU threads. If Threads is zero, it uses the maximum
+//  available number of threads. It returns the number of threads actually used. If Histogram
+//  is set, it uses the histogram median filter, and returns the filter's bin width in BinWidth.
+//  Blanks is set if the image has blank (NaN) pixels, and Simd if the selection networks are
+//  to be run on blocks of pixels at once. InputArray and OutputArray are row addresses set up
+//  by CreateRowAddrs(), so the data for each starts at its first row.
+
+int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,int Npix,float** OutputArray,
+                                          bool Histogram,bool Simd,bool Blanks,float* BinWidth)
+{
+    //  The histogram filter divides the rows into bands between the threads itself.
+    
+    if (Histogram) {
+        HistogramMedian Filter(InputArray,Nx,Ny,Npix,Threads);
+        *BinWidth = Filter.BinWidth();
+        return Filter.Filter(OutputArray,Threads);
+    }
+    const float* Input = InputArray[0];
+    float* Output = OutputArray[0];
+    
+    //  If there are blanks, and the networks might be used, first note which rows have any.
+    //  That's a quick scan of the image, not a second pass through the boxes.
+    
+    bool Sliding = (Npix != 3 && Npix != 5 && Npix != 7);
+    std::vector<char> BlankRows;
+    if (Blanks && !Sliding) {
+        BlankRows.resize(Ny);
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = Input + size_t(Iy) * size_t(Nx);
+                int Found = 0;
+                for (int Ix = 0; Ix < Nx; Ix++) Found |= (Row[Ix] != Row[Ix]);
+                BlankRows[Iy] = Found;
+            }
+        },Threads);
+    }
+    
+    //  The tiles are shared out between the threads of the shared pool, which are created once
+    //  and then reused for each pass, so creating threads isn't included in the timings. Each
+    //  thread starts on the band of the image it initialised - see ShareTilesUsingCPU(). If
+    //  only one thread is to be used, the work is just done in this thread.
+    
+    const char* RowFlags = BlankRows.empty() ? nullptr : BlankRows.data();
+    return ShareTilesUsingCPU(Threads,Nx,Ny,[&](int Ixst,int Ixen,int Iyst,int Iyen) {
+        ComputeTileUsingCPU(Input,Nx,Ny,Ixst,Ixen,Iyst,Iyen,Npix,Output,RowFlags,Simd);
+    });
+}
+
+//  OnePassUsingLayout() is the version of OnePassUsingCPU() used for 'Layout'. Packed is the
+//  image, repacked by Layout, and the result goes to OutputArray in the usual row-major order.
+//  The tiles are shared out between the threads in the same way, but each is filtered by
+//  LayoutTileUsingCPU(), which reads the image through the layout's index calculation.
+
+int OnePassUsingLayout(int Threads,const float* Packed,const ImageLayout& Layout,int Nx,int Ny,
+                                                    int Npix,float** OutputArray,bool Blanks)
+{
+    void LayoutTileUsingCPU(const float* Input,const ImageLayout& Layout,int Nx,int Ny,
+             int Ixst,int Ixen,int Iyst,int Iyen,int Npix,float* Output,bool Blanks);
+
+    float* Output = OutputArray[0];
+    return ShareTilesUsingCPU(Threads,Nx,Ny,[&](int Ixst,int Ixen,int Iyst,int Iyen) {
+        LayoutTileUsingCPU(Packed,Layout,Nx,Ny,Ixst,Ixen,Iyst,Iyen,Npix,Output,Blanks);
+    });
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    M e d i a n  c o d e
+//
+//  These routines are essentially the same as the code run by the GPU to calculate the median
+//  values for the elements of the array. The CPU code above calls MedianElement() for each
+//  element of the array. It collects the values in the box surrounding that element and passes
+//  them to CalcMedian(), which works out the median of the values passed to it. Note that
 //  on a normal CPU (as opposed to a GPU) this code could handle any size of median box, by
 //  dynamically allocating a work array of the size needed. But the GPU can't do that, and so
 //  has a fixed maximum size for the work array, and this code does the same.
 
-// Allow for values of Npix up to 11.
+// Allow for values of Npix up to 11.
+
+#define NPIXSQ_MAX 121
+
+//  This finds the median value in the array X, without recursion,
+//  using a quickselect algorithm which partially sorts X.
+
+float CalcMedian(float X[NPIXSQ_MAX], int len)
+{
+#define swap(a,b) {float t = X[a]; X[a] = X[b], X[b] = t;}
+    int left = 0, right = len - 1;
+    int cent = len/2;
+    float pivot;
+    int pos, i;
+    float median = 0.0;
+    
+    while (left < right) {
+        pivot = X[cent];
+        swap(cent, right);
+        for (i = pos = left; i < right; i++) {
+            if (X[i] < pivot) {
+                swap(i, pos);
+                pos++;
+            }
+        }
+        swap(right, pos);
+        if (pos == cent) break;
+        if (pos < cent) left = pos + 1;
+        else right = pos - 1;
+    }
+    median = X[cent];
+    
+    //  If the array has an odd number of elements, X[cent] will be the median
+    //  value, with all values greater than it in the upper partition and all
+    //  values less than it in the lower partition. (But no more sorted than that.)
+    //  If the array has an odd number of elements, we want the average of the two
+    //  central elements. X[cent] will be the higher of the two - remember that
+    //  the first element is X[0] - so we look for the highest value in the
+    //  lower part of the array and return the average of it and X[cent].
+    
+    if ((len % 2) == 0) {
+        float temp = X[cent - 1];
+        for (int i = 0; i < cent - 1; i++) {
+            if (X[i] > temp) temp = X[i];
+        }
+        median = (median+temp)*0.5;
+    }
+    
+    return median;
+}
+
+//  For the common box sizes - 3x3, 5x5 and 7x7 - a full box, one that doesn't run past the
+//  edge of the image, uses one of the branch-free selection networks in MedianNetworks.h
+//  instead of CalcMedian(), just as the GPU code does. BoxMedian() is instantiated for each
+//  of those sizes, so its loops have constant bounds and can be unrolled, and the network
+//  only indexes its work array with constants.
+
+#include "MedianNetworks.h"
+
+#define MEDIAN_SORT(a,b) { float t = std::min(w[a],w[b]); w[b] = std::max(w[a],w[b]); w[a] = t; }
+#define MEDIAN_MIN(a,b) { w[a] = std::min(w[a],w[b]); }
+#define MEDIAN_MAX(a,b) { w[b] = std::max(w[a],w[b]); }
+
+template <int W> float NetworkMedian(float* w);
+template <> inline float NetworkMedian<3>(float* w) { MEDIAN_NETWORK_9 return w[4]; }
+template <> inline float NetworkMedian<5>(float* w) { MEDIAN_NETWORK_25 return w[12]; }
+template <> inline float NetworkMedian<7>(float* w) { MEDIAN_NETWORK_49 return w[24]; }
+
+template <int W> float BoxMedian(const float* Input,int Nx,int Ix,int Iy)
+{
+    float w[W * W];
+    for (int j = 0; j < W; j++) {
+        const float* Row = Input + size_t(Iy + j - W / 2) * size_t(Nx) + Ix - W / 2;
+        for (int i = 0; i < W; i++) w[j * W + i] = Row[i];
+    }
+    return NetworkMedian<W>(w);
+}
+
+//  MedianElement() leaves blank (NaN) pixels out of the box, and returns a NaN if there are
+//  no valid pixels at all. If Blanks is set, the box may hold blanks, and the networks,
+//  which can't leave them out, aren't used. Like the other routines here, it is passed the
+//  start of the image data, whose rows are Nx values apart.
+
+float MedianElement(const float* Input,int Nx,int Ny,int Ix,int Iy,int Npix,bool Blanks = false)
+{
+    //  Use a selection network if there is one for this box size and the box is a full one.
+    
+    while (Npix * Npix > NPIXSQ_MAX) Npix--;
+    int npixby2 = Npix / 2;
+    if (!Blanks && Ix >= npixby2 && Ix + npixby2 < Nx && Iy >= npixby2 && Iy + npixby2 < Ny) {
+        if (Npix == 3) return BoxMedian<3>(Input,Nx,Ix,Iy);
+        if (Npix == 5) return BoxMedian<5>(Input,Nx,Ix,Iy);
+        if (Npix == 7) return BoxMedian<7>(Input,Nx,Ix,Iy);
+    }
+    
+    //  Otherwise, fill a work array with the input array elements in a box Pix wide around the
+    //  target element. Allow for the edges of the image. Each value goes into the next free
+    //  element, which only moves on if the value isn't a NaN, so the valid values are packed
+    //  together without a branch.
+    
+    float work[NPIXSQ_MAX];
+    int ixmin = Ix - npixby2;
+    int ixmax = Ix + npixby2;
+    int iymin = Iy - npixby2;
+    int iymax = Iy + npixby2;
+    if (ixmin < 0) ixmin = 0;
+    if (ixmax >= Nx) ixmax = Nx - 1;
+    if (iymin < 0) iymin = 0;
+    if (iymax >= Ny) iymax = Ny - 1;
+    int ipix = 0;
+    for (int yind = iymin; yind <= iymax; yind++) {
+        const float* Row = Input + size_t(yind) * size_t(Nx);
+        for (int xind = ixmin; xind <= ixmax; xind++) {
+            float Value = Row[xind];
+            work[ipix] = Value;
+            ipix += (Value == Value);
+        }
+    }
+    if (ipix == 0) return NAN;
+    return CalcMedian(work,ipix);
+}
+
+//  For 'Layout', the CPU filters an image repacked by an ImageLayout. LayoutBoxMedian() and
+//  LayoutMedianElement() are the versions of BoxMedian() and MedianElement() that read the
+//  image through the layout's index calculation, and LayoutTileUsingCPU() uses them to find the
+//  median of each box of a tile in turn. With 'Rows' the index is just the usual row-major
+//  one, so this gives the times to compare the blocked layouts with. Here Blanks is set if
+//  the image has any blanks at all, in which case the networks aren't used anywhere.
+
+template <int W> float LayoutBoxMedian(const float* Input,const ImageLayout& Layout,int Ix,
+                                                                                       int Iy)
+{
+    float w[W * W];
+    for (int j = 0; j < W; j++) {
+        for (int i = 0; i < W; i++) {
+            w[j * W + i] = Input[Layout.Index(Ix + i - W / 2,Iy + j - W / 2)];
+        }
+    }
+    return NetworkMedian<W>(w);
+}
+
+float LayoutMedianElement(const float* Input,const ImageLayout& Layout,int Nx,int Ny,int Ix,
+                                                                int Iy,int Npix,bool Blanks)
+{
+    int npixby2 = Npix / 2;
+    if (!Blanks && Ix >= npixby2 && Ix + npixby2 < Nx && Iy >= npixby2 && Iy + npixby2 < Ny) {
+        if (Npix == 3) return LayoutBoxMedian<3>(Input,Layout,Ix,Iy);
+        if (Npix == 5) return LayoutBoxMedian<5>(Input,Layout,Ix,Iy);
+        if (Npix == 7) return LayoutBoxMedian<7>(Input,Layout,Ix,Iy);
+    }
+    float work[NPIXSQ_MAX];
+    int ixmin = std::max(Ix - npixby2,0);
+    int ixmax = std::min(Ix + npixby2,Nx - 1);
+    int iymin = std::max(Iy - npixby2,0);
+    int iymax = std::min(Iy + npixby2,Ny - 1);
+    int ipix = 0;
+    for (int yind = iymin; yind <= iymax; yind++) {
+        for (int xind = ixmin; xind <= ixmax; xind++) {
+            float Value = Input[Layout.Index(xind,yind)];
+            work[ipix] = Value;
+            ipix += (Value == Value);
+        }
+    }
+    if (ipix == 0) return NAN;
+    return CalcMedian(work,ipix);
+}
+
+void LayoutTileUsingCPU(const float* Input,const ImageLayout& Layout,int Nx,int Ny,
+                  int Ixst,int Ixen,int Iyst,int Iyen,int Npix,float* Output,bool Blanks)
+{
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        float* OutputRow = Output + size_t(Iy) * size_t(Nx);
+        for (int Ix = Ixst; Ix < Ixen; Ix++) {
+            OutputRow[Ix] = LayoutMedianElement(Input,Layout,Nx,Ny,Ix,Iy,Npix,Blanks);
+        }
+    }
+}
+
+//  The code that handles the full boxes of a row a block of pixels at a time, for 'Simd'.
+//  See the SIMD median code section below.
+
+template <int W> void SimdMedianRun(const float* Input,int Nx,int Ixst,int Ixen,int Iy,
+                                                                            float* OutputRow);
+
+//  NetworkMedianRow() calculates the medians for columns Ixst up to (not including) Ixen of row
+//  Iy, written to OutputRow, for a box size with a selection network. The full boxes away from
+//  the edges of the image are handled by a loop that just calls BoxMedian(), with no checks or
+//  clamping, and only the boxes at the ends of the row - or all of them, for a row within
+//  Npix/2 of the top or bottom - go through MedianElement(). This is the same split the GPU
+//  code makes. If Blanks is set, the boxes for this row may hold blank pixels, and they all go
+//  through MedianElement(). If Simd is set, the full boxes are handled by SimdMedianRun()
+//  instead.
+
+void NetworkMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                      float* OutputRow,bool Blanks,bool Simd)
+{
+    if (Blanks) {
+        for (int Ix = Ixst; Ix < Ixen; Ix++) {
+            OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix,true);
+        }
+        return;
+    }
+    
+    //  Ixfull up to (not including) Ixfullen is the range of full boxes, if any.
+    
+    int npixby2 = Npix / 2;
+    int Ixfull = Ixen;
+    int Ixfullen = Ixen;
+    if (Iy >= npixby2 && Iy + npixby2 < Ny && Nx > 2 * npixby2) {
+        Ixfull = std::min(std::max(Ixst,npixby2),Ixen);
+        Ixfullen = std::max(Ixfull,std::min(Ixen,Nx - npixby2));
+    }
+    for (int Ix = Ixst; Ix < Ixfull; Ix++) {
+        OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix);
+    }
+    if (Simd && Npix == 3) {
+        SimdMedianRun<3>(Input,Nx,Ixfull,Ixfullen,Iy,OutputRow);
+    } else if (Simd && Npix == 5) {
+        SimdMedianRun<5>(Input,Nx,Ixfull,Ixfullen,Iy,OutputRow);
+    } else if (Simd && Npix == 7) {
+        SimdMedianRun<7>(Input,Nx,Ixfull,Ixfullen,Iy,OutputRow);
+    } else if (Npix == 3) {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) OutputRow[Ix] = BoxMedian<3>(Input,Nx,Ix,Iy);
+    } else if (Npix == 5) {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) OutputRow[Ix] = BoxMedian<5>(Input,Nx,Ix,Iy);
+    } else if (Npix == 7) {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) OutputRow[Ix] = BoxMedian<7>(Input,Nx,Ix,Iy);
+    } else {
+        for (int Ix = Ixfull; Ix < Ixfullen; Ix++) {
+            OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix);
+        }
+    }
+    for (int Ix = Ixfullen; Ix < Ixen; Ix++) {
+        OutputRow[Ix] = MedianElement(Input,Nx,Ny,Ix,Iy,Npix);
+    }
+}
+
+//  SlidingMedianRow() gives the same results as calling MedianElement() for each pixel from Ixst
+//  up to (not including) Ixen in row Iy, written to OutputRow, but it keeps the values in the
+//  box sorted, and as the box moves along the row it only has to remove the column that has
+//  left it and merge in the one that has entered it, instead of starting again for each pixel.
+//  (This is the idea behind Huang's running histogram median, but with the values themselves,
+//  so the result is exact.) Both are single passes through the sorted values, so this is much
+//  faster than CalcMedian() for the larger boxes, but the selection networks are faster still
+//  for the sizes they handle.
+//
+//  The work is done by SlidingMedianRowFor(), which is a template on the box size, W. For the
+//  sizes that come here - those without a selection network - up to 11, a row whose boxes are
+//  all W values high, at least W/2 rows from the top and bottom of the image, uses the version
+//  for that size, in which the number of values in each column, the number of columns kept,
+//  and so the loops that gather and sort each column, all have constant bounds, which the
+//  compiler can unroll. W of zero is the general version, which takes the size as Npix, and
+//  is used for the rows near the top and bottom and for any other size.
+
+//  The window is kept sorted in this order, which is the usual one except that NaNs come after
+//  everything else, so that they can be found again when they leave the box. Since they are
+//  all at the end, leaving them out of the median, as MedianElement() does, just means not
+//  counting them.
+
+static inline bool SortsBefore(float First,float Second)
+{
+    return First < Second || (Second != Second && First == First);
+}
+
+//  Sorts the Count values of a column of the box - never more than 11 - by insertion. If W is
+//  non-zero, Count is always W.
+
+template <int W> static void SortColumn(float* Values,int Count)
+{
+    if (W > 0) Count = W;
+    for (int I = 1; I < Count; I++) {
+        float Value = Values[I];
+        int J = I;
+        while (J > 0 && SortsBefore(Value,Values[J - 1])) {
+            Values[J] = Values[J - 1];
+            J--;
+        }
+        Values[J] = Value;
+    }
+}
+
+template <int W> void SlidingMedianRowFor(const float* Input,int Nx,int Ny,int Iy,int Npix,
+                                                      int Ixst,int Ixen,float* OutputRow)
+{
+    //  With W non-zero, these are all constants, since the caller has checked the row.
+    
+    if (W > 0) Npix = W;
+    while (Npix * Npix > NPIXSQ_MAX) Npix--;
+    int npixby2 = Npix / 2;
+    int iymin = (W > 0) ? Iy - W / 2 : std::max(0,Iy - npixby2);
+    int Rows = (W > 0) ? W : std::min(Ny - 1,Iy + npixby2) - iymin + 1;
+    
+    //  Window holds the values in the box, sorted, and Count is how many there are. Each
+    //  column is sorted as it enters the box, and kept in Columns until it leaves, in the
+    //  entry given by its X position modulo Npix, which the entering column then reuses.
+    
+    float Window[NPIXSQ_MAX];
+    float Columns[NPIXSQ_MAX];
+    int Count = 0;
+    int Blanks = 0;
+    
+    //  Adding a column merges it into the window, working back from the end so this can be
+    //  done in place. Removing one takes out the first value in the window matching each of
+    //  its values in turn, since both are sorted.
+    
+    auto AddColumn = [&](int xind) {
+        float* Column = Columns + (xind % Npix) * Rows;
+        for (int J = 0; J < Rows; J++) {
+            float Value = Input[size_t(iymin + J) * size_t(Nx) + xind];
+            Column[J] = Value;
+            Blanks += (Value != Value);
+        }
+        SortColumn<W>(Column,Rows);
+        int I = Count - 1;
+        int Out = Count + Rows - 1;
+        for (int J = Rows - 1; J >= 0; J--) {
+            while (I >= 0 && SortsBefore(Column[J],Window[I])) Window[Out--] = Window[I--];
+            Window[Out--] = Column[J];
+        }
+        Count += Rows;
+    };
+    auto RemoveColumn = [&](int xind) {
+        const float* Column = Columns + (xind % Npix) * Rows;
+        int Kept = 0;
+        int Next = 0;
+        for (int I = 0; I < Count; I++) {
+            if (Next < Rows && !SortsBefore(Window[I],Column[Next])) Next++;
+            else Window[Kept++] = Window[I];
+        }
+        for (int J = 0; J < Rows; J++) Blanks -= (Column[J] != Column[J]);
+        Count = Kept;
+    };
+    
+    //  The box for the first pixel needs columns up to Npix/2 either side of it.
+    
+    if (Ixst >= Ixen) return;
+    int xfirst = std::max(0,Ixst - npixby2);
+    int xlast = std::min(Nx - 1,Ixst + npixby2);
+    for (int xind = xfirst; xind <= xlast; xind++) AddColumn(xind);
+    for (int Ix = Ixst; Ix < Ixen; Ix++) {
+        if (Ix > Ixst) {
+            if (Ix - npixby2 - 1 >= 0) RemoveColumn(Ix - npixby2 - 1);
+            if (Ix + npixby2 < Nx) AddColumn(Ix + npixby2);
+        }
+        
+        //  As for CalcMedian(), an even number of values gives the average of the two
+        //  middle values. The NaNs at the end of the window aren't counted.
+        
+        int Valid = Count - Blanks;
+        int Cent = Valid / 2;
+        if (Valid == 0) OutputRow[Ix] = NAN;
+        else if (Valid % 2) OutputRow[Ix] = Window[Cent];
+        else OutputRow[Ix] = (Window[Cent] + Window[Cent - 1]) * 0.5;
+    }
+}
+
+//  SlidingMedianRow() picks the version of SlidingMedianRowFor() to use for a row.
+
+void SlidingMedianRow(const float* Input,int Nx,int Ny,int Iy,int Npix,int Ixst,int Ixen,
+                                                                            float* OutputRow)
+{
+    bool FullRow = (Iy >= Npix / 2 && Iy + Npix / 2 < Ny);
+    if (FullRow && Npix == 9) {
+        SlidingMedianRowFor<9>(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+    } else if (FullRow && Npix == 11) {
+        SlidingMedianRowFor<11>(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+    } else {
+        SlidingMedianRowFor<0>(Input,Nx,Ny,Iy,Npix,Ixst,Ixen,OutputRow);
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               S I M D  M e d i a n  c o d e
+//
+//  With 'Simd', the full boxes in a row are handled a block of L adjacent pixels at a time.
+//  Each value in the work array becomes a row of L values, one for each pixel in the block,
+//  and the network runs in a loop over the L pixels. The loop has no branches, and each
+//  iteration works on the next element of every row, so the compiler can vectorize it, with
+//  each vector register holding the same network value for a whole block of pixels, and each
+//  step of the network becoming a vector min and max. (This is sometimes called vertical
+//  SIMD - the lanes of a vector are different pixels, not different values in one box.) The
+//  remaining pixels at the end of the row, fewer than L of them, are just done one at a time.
+
+//  The instruction set for this code is chosen when the program runs, so one binary can use
+//  AVX2 or AVX-512 where the CPU has them. That needs GCC or Clang on x86, which can compile
+//  individual functions for a given target. Elsewhere - with MSVC, say, or on Apple silicon,
+//  where NEON is always available - it is compiled for the default target, with 8 lanes, which
+//  the compiler handles as pairs of 4-lane vector instructions. The routines called by the
+//  routines compiled for each target have to be inlined into them, or they would only be
+//  compiled for the default target.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MEDIAN_SIMD_DISPATCH
+#define MEDIAN_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define MEDIAN_SIMD_INLINE inline
+#endif
+
+//  The network steps, for lane l. These replace the definitions used above. (Running each
+//  step in its own loop over the lanes looks more like vector code, but then the compiler
+//  has to vectorize hundreds of tiny loops separately, and in practice it makes a poor job
+//  of it.)
+
+#undef MEDIAN_SORT
+#undef MEDIAN_MIN
+#undef MEDIAN_MAX
+
+#define MEDIAN_SORT(a,b) { \
+    float t = std::min(w[a][l],w[b][l]); w[b][l] = std::max(w[a][l],w[b][l]); w[a][l] = t; }
+#define MEDIAN_MIN(a,b) { w[a][l] = std::min(w[a][l],w[b][l]); }
+#define MEDIAN_MAX(a,b) { w[b][l] = std::max(w[a][l],w[b][l]); }
+
+//  SimdMedians() finds the medians of the W by W boxes for the L pixels starting at (Ix,Iy),
+//  all of which must be full boxes, and writes them to Output.
+
+template <int W,int L> MEDIAN_SIMD_INLINE void SimdMedians(const float* Input,int Nx,int Ix,
+                                                                        int Iy,float* Output)
+{
+    float w[W * W][L];
+    for (int j = 0; j < W; j++) {
+        for (int i = 0; i < W; i++) {
+            const float* Row = Input + size_t(Iy + j - W / 2) * size_t(Nx) + Ix + i - W / 2;
+            for (int l = 0; l < L; l++) w[j * W + i][l] = Row[l];
+        }
+    }
+    for (int l = 0; l < L; l++) {
+        if constexpr (W == 3) {
+            MEDIAN_NETWORK_9
+        } else if constexpr (W == 5) {
+            MEDIAN_NETWORK_25
+        } else {
+            MEDIAN_NETWORK_49
+        }
+    }
+    for (int l = 0; l < L; l++) Output[l] = w[W * W / 2][l];
+}
+
+//  Handles the full boxes from Ixst up to (not including) Ixen in row Iy, L pixels at a time.
+
+template <int W,int L> MEDIAN_SIMD_INLINE void SimdBlocks(const float* Input,int Nx,int Ixst,
+                                                            int Ixen,int Iy,float* OutputRow)
+{
+    int Ix = Ixst;
+    for (; Ix + L <= Ixen; Ix += L) SimdMedians<W,L>(Input,Nx,Ix,Iy,OutputRow + Ix);
+    for (; Ix < Ixen; Ix++) OutputRow[Ix] = BoxMedian<W>(Input,Nx,Ix,Iy);
+}
+
+//  The versions of SimdBlocks() compiled for each target. SimdLevel() returns the best one
+//  the CPU supports - 2 for AVX-512, 1 for AVX2, 0 for the default - checking just once.
+
+template <int W> void SimdBlocksDefault(const float* Input,int Nx,int Ixst,int Ixen,int Iy,
+                                                                             float* OutputRow)
+{
+    SimdBlocks<W,8>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
+#ifdef MEDIAN_SIMD_DISPATCH
+
+template <int W> __attribute__((target("avx2")))
+void SimdBlocksAVX2(const float* Input,int Nx,int Ixst,int Ixen,int Iy,float* OutputRow)
+{
+    SimdBlocks<W,8>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
+template <int W> __attribute__((target("avx512f")))
+void SimdBlocksAVX512(const float* Input,int Nx,int Ixst,int Ixen,int Iy,float* OutputRow)
+{
+    SimdBlocks<W,16>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+}
+
+#endif
 
-#define NPIXSQ_MAX 121
+static int SimdLevel(void)
+{
+#ifdef MEDIAN_SIMD_DISPATCH
+    static const int Level = __builtin_cpu_supports("avx512f") ? 2 :
+                                                        (__builtin_cpu_supports("avx2") ? 1 : 0);
+    return Level;
+#else
+    return 0;
+#endif
+}
 
-//  This finds the median value in the array X, without recursion,
-//  using a quickselect algorithm which partially sorts X.
+//  Describes the SIMD code that will be used, for the timing report.
 
-float CalcMedian(float X[NPIXSQ_MAX], int len)
+const char* SimdDescription(void)
 {
-#define swap(a,b) {float t = X[a]; X[a] = X[b], X[b] = t;}
-    int left = 0, right = len - 1;
-    int cent = len/2;
-    float pivot;
-    int pos, i;
-    float median = 0.0;
-    
-    while (left < right) {
-        pivot = X[cent];
-        swap(cent, right);
-        for (i = pos = left; i < right; i++) {
-            if (X[i] < pivot) {
-                swap(i, pos);
-                pos++;
-            }
-        }
-        swap(right, pos);
-        if (pos == cent) break;
-        if (pos < cent) left = pos + 1;
-        else right = pos - 1;
-    }
-    median = X[cent];
-    
-    //  If the array has an odd number of elements, X[cent] will be the median
-    //  value, with all values greater than it in the upper partition and all
-    //  values less than it in the lower partition. (But no more sorted than that.)
-    //  If the array has an odd number of elements, we want the average of the two
-    //  central elements. X[cent] will be the higher of the two - remember that
-    //  the first element is X[0] - so we look for the highest value in the
-    //  lower part of the array and return the average of it and X[cent].
-    
-    if ((len % 2) == 0) {
-        float temp = X[cent - 1];
-        for (int i = 0; i < cent - 1; i++) {
-            if (X[i] > temp) temp = X[i];
-        }
-        median = (median+temp)*0.5;
-    }
-    
-    return median;
+    int Level = SimdLevel();
+    if (Level == 2) return "AVX-512, 16 lanes";
+    if (Level == 1) return "AVX2, 8 lanes";
+    return "8 lanes";
 }
 
-float MedianElement(float** InputArray,int Nx,int Ny,int Ix,int Iy,int Npix)
+//  SimdMedianRun() is what NetworkMedianRow() calls, for the full boxes from Ixst up to (not
+//  including) Ixen in row Iy, and it uses the best version of SimdBlocks() for the CPU.
+
+template <int W> void SimdMedianRun(const float* Input,int Nx,int Ixst,int Ixen,int Iy,
+                                                                             float* OutputRow)
 {
-    //  Fill a work array with the input array elements in a box Pix wide around the
-    //  target element. Allow for the edges of the image.
-    
-    while (Npix * Npix > NPIXSQ_MAX) Npix--;
-    float work[NPIXSQ_MAX];
-    int npixby2 = Npix / 2;
-    int ixmin = Ix - npixby2;
-    int ixmax = Ix + npixby2;
-    int iymin = Iy - npixby2;
-    int iymax = Iy + npixby2;
-    if (ixmin < 0) ixmin = 0;
-    if (ixmax >= Nx) ixmax = Nx - 1;
-    if (iymin < 0) iymin = 0;
-    if (iymax >= Ny) iymax = Ny - 1;
-    int ipix = 0;
-    for (int yind = iymin; yind <= iymax; yind++) {
-        for (int xind = ixmin; xind <= ixmax; xind++) {
-            work[ipix++] = InputArray[yind][xind];
-        }
+#ifdef MEDIAN_SIMD_DISPATCH
+    int Level = SimdLevel();
+    if (Level == 2) {
+        SimdBlocksAVX512<W>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+        return;
     }
-    return CalcMedian(work,ipix);
+    if (Level == 1) {
+        SimdBlocksAVX2<W>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
+        return;
+    }
+#endif
+    SimdBlocksDefault<W>(Input,Nx,Ixst,Ixen,Iy,OutputRow);
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -894,26 +7417,53 @@ float MedianElement(float** InputArray,int Nx,int Ny,int Ix,int Iy,int Npix)
 //  by ComputeUsingCPU() and ComputeUsingGPU() once they have allocated memory for the input
 //  array. Note that it expects to be passed not the actual start of the input array, but
 //  the start of an array giving the address of the start of each row of the input array, which
-//  makes the indexing syntax much easier.
+//  makes the indexing syntax much easier. The rows are shared out between the threads in the
+//  bands the CPU code will filter them in, using up to Threads threads - see ForEachBand() - so
+//  a newly allocated array is first written by the threads that will use each part of it.
 
-void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details)
+void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details,int Threads)
 {
     //  If we have an opened FITS file and have read the data from it, copy that data into
     //  the input array. Note that InputArray[0] will hold the address of the start of the
     //  actual input array.
     
     if (Details->InputData) {
-        memcpy(InputArray[0],Details->InputData,Nx * Ny * sizeof(float));
+        ForEachBand(Threads,Ny,[&](int Iyst,int Iyen) {
+            memcpy(InputArray[Iyst],Details->InputData + size_t(Iyst) * size_t(Nx),
+                                             size_t(Iyen - Iyst) * size_t(Nx) * sizeof(float));
+        });
+    } else if (Details->RawData) {
+    
+        //  A 16-bit integer image read for 'Native' hasn't been scaled, so do that here, the
+        //  same way as the MedianInt16 shader does, for anything else that needs the image.
+        
+        float Scale = Details->RawScale;
+        float Zero = Details->RawZero;
+        int Blank = Details->RawHasBlank ? Details->RawBlank : 0x10000;
+        ForEachBand(Threads,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const short* RawRow = Details->RawData + size_t(Iy) * size_t(Nx);
+                float* Row = InputArray[Iy];
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    float Value = float(RawRow[Ix]) * Scale;
+                    Value += Zero;
+                    Row[Ix] = (RawRow[Ix] == Blank) ? NAN : Value;
+                }
+            }
+        });
     } else {
     
         //  Otherwise, we just make up some suitable values. The actual values don't matter
         //  too much.
         
-        for (int Iy = 0; Iy < Ny; Iy++) {
-            for (int Ix = 0; Ix < Nx; Ix++) {
-                InputArray[Iy][Ix] = float(Ny - Iy + Nx - Ix);
+        ForEachBand(Threads,Ny,[&](int Iyst,int Iyen) {
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                float* Row = InputArray[Iy];
+                for (int Ix = 0; Ix < Nx; Ix++) {
+                    Row[Ix] = float(Ny - Iy + Nx - Ix);
+                }
             }
-        }
+        });
     }
 }
 
@@ -922,7 +7472,7 @@ void SetInputArray(float** InputArray,int Nx,int Ny,MedianDetails* Details)
 //                             W r i t e  F i t s  F i l e
 //
 //  This routine writes the calculated image (saved by a call to NoteResults()) to the output
-//  file created by ReadFitsFile() as its main image, replacing the original unfiltered image.
+//  file created by ReadFitsFile() as its main image, following the header copied from the input.
 
 bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details)
 {
@@ -947,9 +7497,19 @@ bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details)
         if (OutputImage == nullptr) {
             strncpy (Error,"No output image calculated",sizeof(Error));
             Status = 1;
+        } else if (FitsCompression != 0) {
+        
+            //  With 'Compress', the image goes into a tile-compressed extension instead, in
+            //  a new file, which replaces Fptr.
+            
+            bool WriteCompressedFitsImage(MedianDetails* Details,int Nx,int Ny,
+                                                            const float* Image,int* Status);
+            WriteCompressedFitsImage(Details,Nx,Ny,OutputImage,&Status);
+            Fptr = Details->Fptr;
+            if (Status) fits_get_errstatus (Status,Error);
         } else {
             long Fpixel = 1;
-            int NPixels = Nx * Ny;
+            LONGLONG NPixels = LONGLONG(Nx) * LONGLONG(Ny);
             if (fits_write_img(Fptr,TFLOAT,Fpixel,NPixels,OutputImage,&Status)) {
                 fits_get_errstatus (Status,Error);
             }
@@ -984,6 +7544,428 @@ bool WriteFitsFile(int Nx,int Ny,MedianDetails* Details)
 
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                  W r i t e  C o m p r e s s e d  F i t s  I m a g e
+//
+//  Used by WriteFitsFile() for 'Compress'. A compressed image can't be a file's primary image,
+//  so the output file created by ReadFitsFile() is replaced by a new one with an empty primary
+//  image and the image in a tile-compressed extension, stored as a binary table with one row
+//  for each tile, with the keywords of the header ReadFitsFile() copied from the input. Each
+//  tile is one row of the image, cfitsio's default. fits_write_img() would compress the tiles
+//  one after another in the calling thread, and that, not the disk, is what takes the time. So,
+//  just as ReadCompressedFitsImage() does for reading, this splits the image into bands of
+//  whole rows of tiles and has the shared thread pool compress them at once, each into a
+//  compressed image of its own in a memory file, and then copies the compressed tiles of each
+//  band, in order, into the output table. The quantisation of floating point values adds a
+//  pseudo-random dither that depends on the tile's row in the table, so each band's dither
+//  seed is offset by its first tile, and every tile ends up just as fits_write_img() would have
+//  compressed it. If cfitsio wasn't built to be reentrant, or there is only one thread, the
+//  image is just written with fits_write_img(). Any error is returned in *Status, and
+//  Details->Fptr is the new output file, or null if it couldn't be created.
+
+bool WriteCompressedFitsImage(MedianDetails* Details,int Nx,int Ny,const float* Image,
+                                                                                 int* Status)
+{
+
+#ifdef USE_CFITSIO
+
+    //  The keywords of the copied header, except those describing the image's structure,
+    //  scaling and blank value, which are now cfitsio's business, and any checksums, which
+    //  would no longer match.
+    
+    fitsfile* Fptr = Details->Fptr;
+    std::vector<std::string> Cards;
+    int Nkeys = 0;
+    fits_get_hdrspace(Fptr,&Nkeys,nullptr,Status);
+    for (int Key = 1; *Status == 0 && Key <= Nkeys; Key++) {
+        char Card[FLEN_CARD];
+        if (fits_read_record(Fptr,Key,Card,Status)) break;
+        int Class = fits_get_keyclass(Card);
+        if (Class == TYP_STRUC_KEY || Class == TYP_CMPRS_KEY || Class == TYP_SCAL_KEY ||
+                                 Class == TYP_NULL_KEY || Class == TYP_CKSUM_KEY) continue;
+        Cards.push_back(Card);
+    }
+    
+    //  Replace the output file with a new one, and set it up for compression.
+    
+    int DeleteStatus = 0;
+    fits_delete_file(Fptr,&DeleteStatus);
+    Details->Fptr = Fptr = nullptr;
+    if (*Status) return false;
+    std::string CreateName = "!" + Details->OutputFileName;
+    const long TileRows = 1;
+    long TileDims[2] = {Nx,TileRows};
+    long Naxes[2] = {Nx,Ny};
+    auto SetCompression = [&](fitsfile* OutFptr,int Seed,int* OutStatus) {
+        fits_set_compression_type(OutFptr,FitsCompression,OutStatus);
+        fits_set_tile_dim(OutFptr,2,TileDims,OutStatus);
+        fits_set_quantize_level(OutFptr,FitsQuantize,OutStatus);
+        fits_set_dither_seed(OutFptr,Seed,OutStatus);
+    };
+    const int DitherSeed = 1;
+    if (fits_create_file(&Fptr,CreateName.c_str(),Status)) return false;
+    Details->Fptr = Fptr;
+    fits_create_img(Fptr,BYTE_IMG,0,nullptr,Status);
+    SetCompression(Fptr,DitherSeed,Status);
+    fits_create_img(Fptr,FLOAT_IMG,2,Naxes,Status);
+    for (std::string& Card : Cards) {
+        if (*Status == 0) fits_write_record(Fptr,Card.c_str(),Status);
+    }
+    if (*Status) return false;
+    
+    //  Unless the tiles can be compressed in parallel, that's all the setting up needed.
+    
+    int Tiles = int((Ny + TileRows - 1) / TileRows);
+    if (!fits_is_reentrant() || ThreadPool::Shared().Threads() <= 1 || Tiles <= 1) {
+        fits_write_img(Fptr,TFLOAT,1,LONGLONG(Nx) * LONGLONG(Ny),(void*)Image,Status);
+        return (*Status == 0);
+    }
+    
+    //  Each band's memory file is kept, indexed by its first tile, along with its last.
+    //  Only the first error is kept. NaNs are blank pixels, which cfitsio preserves when
+    //  it quantises the values.
+    
+    std::vector<fitsfile*> Bands(Tiles,nullptr);
+    std::vector<int> BandEnds(Tiles,0);
+    std::atomic<int> FirstError(0);
+    ThreadPool::Shared().ParallelFor(0,Tiles,[&](int First,int Last) {
+        int BandStatus = 0;
+        fitsfile* BandFptr = nullptr;
+        long FirstRow = First * TileRows;
+        long LastRow = std::min(long(Last) * TileRows,long(Ny));
+        long BandAxes[2] = {Nx,LastRow - FirstRow};
+        int Seed = ((DitherSeed - 1 + First) % 10000) + 1;
+        if (fits_create_file(&BandFptr,"mem://",&BandStatus) == 0) {
+            fits_create_img(BandFptr,BYTE_IMG,0,nullptr,&BandStatus);
+            SetCompression(BandFptr,Seed,&BandStatus);
+            fits_create_img(BandFptr,FLOAT_IMG,2,BandAxes,&BandStatus);
+            fits_write_img(BandFptr,TFLOAT,1,LONGLONG(Nx) * LONGLONG(LastRow - FirstRow),
+                                            (void*)(Image + FirstRow * Nx),&BandStatus);
+            Bands[First] = BandFptr;
+            BandEnds[First] = Last;
+        }
+        int NoError = 0;
+        if (BandStatus) FirstError.compare_exchange_strong(NoError,BandStatus);
+    });
+    if (FirstError != 0) *Status = FirstError;
+    
+    //  Now copy each band's tiles into the output table, in order, column by column. Each
+    //  compressed tile is a variable length array of bytes, and the scale and zero point
+    //  (and any blank value) for each tile are ordinary columns. A column only some tiles need
+    //  - the GZIP_COMPRESSED_DATA cfitsio uses for tiles it can't quantise - may be missing
+    //  from the output, and is added. The keywords cfitsio adds as it compresses the tiles,
+    //  such as ZBLANK, are copied over if the output doesn't have them yet.
+    
+    long OutRow = 1;
+    std::vector<unsigned char> Bytes;
+    std::vector<double> Values;
+    for (int First = 0; First < Tiles && Bands[First]; First = BandEnds[First]) {
+        fitsfile* BandFptr = Bands[First];
+        long Rows = 0;
+        int Cols = 0;
+        fits_get_num_rows(BandFptr,&Rows,Status);
+        fits_get_num_cols(BandFptr,&Cols,Status);
+        for (int Col = 1; *Status == 0 && Col <= Cols; Col++) {
+            char Key[FLEN_KEYWORD],Name[FLEN_VALUE],Form[FLEN_VALUE];
+            fits_make_keyn("TTYPE",Col,Key,Status);
+            fits_read_key(BandFptr,TSTRING,Key,Name,nullptr,Status);
+            int OutCol = 0;
+            int ColStatus = 0;
+            if (fits_get_colnum(Fptr,CASEINSEN,Name,&OutCol,&ColStatus)) {
+                int OutCols = 0;
+                fits_get_num_cols(Fptr,&OutCols,Status);
+                fits_make_keyn("TFORM",Col,Key,Status);
+                fits_read_key(BandFptr,TSTRING,Key,Form,nullptr,Status);
+                OutCol = OutCols + 1;
+                fits_insert_col(Fptr,OutCol,Name,Form,Status);
+            }
+            int TypeCode = 0;
+            long Repeat = 0,Width = 0;
+            fits_get_coltype(BandFptr,Col,&TypeCode,&Repeat,&Width,Status);
+            for (long Row = 1; *Status == 0 && Row <= Rows; Row++) {
+                int Anynull = 0;
+                if (TypeCode < 0) {
+                    LONGLONG Length = 0,Offset = 0;
+                    fits_read_descriptll(BandFptr,Col,Row,&Length,&Offset,Status);
+                    if (Length == 0) continue;
+                    Bytes.resize(size_t(Length));
+                    fits_read_col_byt(BandFptr,Col,Row,1,Length,0,Bytes.data(),&Anynull,Status);
+                    fits_write_col_byt(Fptr,OutCol,OutRow + Row - 1,1,Length,Bytes.data(),
+                                                                                     Status);
+                } else {
+                    Values.resize(size_t(Repeat));
+                    fits_read_col_dbl(BandFptr,Col,Row,1,Repeat,0.0,Values.data(),&Anynull,
+                                                                                     Status);
+                    fits_write_col_dbl(Fptr,OutCol,OutRow + Row - 1,1,Repeat,Values.data(),
+                                                                                     Status);
+                }
+            }
+        }
+        int BandKeys = 0;
+        fits_get_hdrspace(BandFptr,&BandKeys,nullptr,Status);
+        for (int Key = 1; *Status == 0 && Key <= BandKeys; Key++) {
+            char Card[FLEN_CARD],KeyName[FLEN_KEYWORD],Value[FLEN_VALUE];
+            int Length = 0,KeyStatus = 0;
+            fits_read_record(BandFptr,Key,Card,Status);
+            fits_get_keyname(Card,KeyName,&Length,Status);
+            if (KeyName[0] != 'Z' || !strcmp(KeyName,"ZDITHER0")) continue;
+            if (fits_read_keyword(Fptr,KeyName,Value,nullptr,&KeyStatus) == KEY_NO_EXIST) {
+                fits_write_record(Fptr,Card,Status);
+            }
+        }
+        OutRow += Rows;
+    }
+    for (fitsfile* BandFptr : Bands) {
+        int CloseStatus = 0;
+        if (BandFptr) fits_close_file(BandFptr,&CloseStatus);
+    }
+    
+    //  The dither seed in the output has to be the one the bands' seeds were offset from.
+    
+    fits_update_key(Fptr,TINT,"ZDITHER0",(void*)&DitherSeed,nullptr,Status);
+    TheDebugHandler.Logf("Fits","Compressed image written, %d tiles compressed in parallel",
+                                                                                     Tiles);
+    return (*Status == 0);
+
+#else
+
+    *Status = 1;
+    return false;
+
+#endif
+
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            P a r s e  C o m p r e s s i o n
+//
+//  Parses the value of 'Compress', returning the cfitsio compression type for it - zero for ""
+//  or "None", for an uncompressed image. It returns false if the name isn't one it knows.
+
+bool ParseCompression(const std::string& Name,int* Type)
+{
+    std::string Upper = Name;
+    for (char& Char : Upper) Char = toupper(Char);
+    *Type = 0;
+    if (Upper == "" || Upper == "NONE") return true;
+#ifdef USE_CFITSIO
+    if (Upper == "RICE") *Type = RICE_1;
+    if (Upper == "GZIP") *Type = GZIP_1;
+#endif
+    return (*Type != 0);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                F i t s  W r i t e r
+//
+//  The implementation of the FitsWriter class declared at the start of this file.
+
+FitsWriter::FitsWriter(void)
+{
+    //  cfitsio can only be used by two threads at once if it was built to be reentrant. If it
+    //  wasn't, the files are just written as they are submitted.
+    
+#ifdef USE_CFITSIO
+    I_Background = fits_is_reentrant();
+#endif
+    if (I_Background) I_Thread = std::thread(&FitsWriter::Run,this);
+}
+
+FitsWriter::~FitsWriter()
+{
+    Finish();
+}
+
+void FitsWriter::Submit(int Nx,int Ny,MedianDetails* Details)
+{
+    if (!I_Background) {
+        WriteFitsFile(Nx,Ny,Details);
+        Shutdown(Details);
+    } else {
+        std::unique_lock<std::mutex> Lock(I_Mutex);
+        I_Cond.wait(Lock,[this]{ return !I_Pending; });
+        I_Details = *Details;
+        I_Nx = Nx;
+        I_Ny = Ny;
+        I_Pending = true;
+        Lock.unlock();
+        I_Cond.notify_all();
+    }
+    *Details = MedianDetails();
+}
+
+void FitsWriter::Finish(void)
+{
+    if (I_Thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lock(I_Mutex);
+            I_Stop = true;
+        }
+        I_Cond.notify_all();
+        I_Thread.join();
+    }
+}
+
+//  The thread waits for a file to be submitted, and writes it. The file stays pending until it
+//  has been written and released, so Submit() can't overwrite it. When told to stop, it finishes
+//  any file still pending first.
+
+void FitsWriter::Run(void)
+{
+    std::unique_lock<std::mutex> Lock(I_Mutex);
+    for (;;) {
+        I_Cond.wait(Lock,[this]{ return I_Pending || I_Stop; });
+        if (!I_Pending) break;
+        Lock.unlock();
+        WriteFitsFile(I_Nx,I_Ny,&I_Details);
+        Shutdown(&I_Details);
+        Lock.lock();
+        I_Pending = false;
+        I_Cond.notify_all();
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                P a r s e  S c a l e s
+//
+//  Parses the value of the 'Scales' parameter, a list of box sizes separated by commas or
+//  spaces, eg "3,7,15". Each must be an odd number no larger than the GPU can handle, and
+//  there can be no more than C_MaxScales of them. Returns false, having reported the problem,
+//  if the list isn't valid.
+
+bool ParseScales(const std::string& Text,std::vector<int>* Scales)
+{
+    Scales->clear();
+    size_t Start = 0;
+    while (Start < Text.size()) {
+        size_t End = Text.find_first_of(", ",Start);
+        if (End == std::string::npos) End = Text.size();
+        std::string Entry = Text.substr(Start,End - Start);
+        Start = End + 1;
+        if (Entry == "") continue;
+        char* Rest = nullptr;
+        long Npix = strtol(Entry.c_str(),&Rest,10);
+        if (*Rest != '\0' || Npix < 1 || Npix > C_MaxGPUNpix || (Npix % 2) == 0) {
+            printf ("Invalid box size '%s' in 'Scales' - each should be an odd number "
+                                     "from 1 to %d.\n",Entry.c_str(),C_MaxGPUNpix);
+            return false;
+        }
+        Scales->push_back(int(Npix));
+    }
+    if (Scales->size() > size_t(C_MaxScales)) {
+        printf ("'Scales' can only list up to %d box sizes.\n",C_MaxScales);
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                P a r s e  C h a i n
+//
+//  Parses the value of the 'Chain' parameter, a list of steps separated by commas or spaces,
+//  each given as name=value with no spaces, eg "bias=100,background=31,scale=1.5". The steps
+//  'median', 'background' and 'smooth' take a box size, which must be an odd number no larger
+//  than the GPU can handle, and 'bias', 'scale' and 'offset' take any number. Returns false,
+//  having reported the problem, if the list isn't valid.
+
+bool ParseChain(const std::string& Text,std::vector<ChainStep>* Steps)
+{
+    Steps->clear();
+    size_t Start = 0;
+    while (Start < Text.size()) {
+        size_t End = Text.find_first_of(", ",Start);
+        if (End == std::string::npos) End = Text.size();
+        std::string Entry = Text.substr(Start,End - Start);
+        Start = End + 1;
+        if (Entry == "") continue;
+        size_t Equals = Entry.find('=');
+        std::string Name = Entry.substr(0,Equals);
+        for (char& Char : Name) Char = char(tolower(Char));
+        bool IsSize = (Name == "median" || Name == "background" || Name == "smooth");
+        if (!IsSize && Name != "bias" && Name != "scale" && Name != "offset") {
+            printf ("Invalid step '%s' in 'Chain' - each should be bias, median, background, "
+                                         "smooth, scale or offset, with a value.\n",Entry.c_str());
+            return false;
+        }
+        const char* ValueText = (Equals == std::string::npos) ? "" : Entry.c_str() + Equals + 1;
+        char* Rest = nullptr;
+        double Value = strtod(ValueText,&Rest);
+        if (*ValueText == '\0' || *Rest != '\0') {
+            printf ("Invalid step '%s' in 'Chain' - the value should be given as %s=value.\n",
+                                                                   Entry.c_str(),Name.c_str());
+            return false;
+        }
+        if (IsSize && (Value != double(int(Value)) || Value < 1 || Value > C_MaxGPUNpix ||
+                                                                    (int(Value) % 2) == 0)) {
+            printf ("Invalid box size in step '%s' in 'Chain' - it should be an odd number "
+                                     "from 1 to %d.\n",Entry.c_str(),C_MaxGPUNpix);
+            return false;
+        }
+        Steps->push_back({Name,Value});
+    }
+    if (Steps->empty()) {
+        printf ("'Chain' doesn't list any steps.\n");
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             E x p a n d  F i l e  L i s t
+//
+//  Expands the value of the 'Files' parameter into the list of files to filter. This can be a
+//  list of names separated by commas or spaces, and any name can use '*' as a wildcard in its
+//  final component, eg "data/night1/*.fits". The files matching each wildcard are listed in
+//  alphabetical order. Files whose names start with "Median_" are skipped by the wildcards, as
+//  they will be the results of earlier runs.
+
+std::vector<std::string> ExpandFileList(const std::string& Files)
+{
+    std::vector<std::string> FileList;
+    size_t Start = 0;
+    while (Start < Files.size()) {
+        size_t End = Files.find_first_of(", ",Start);
+        if (End == std::string::npos) End = Files.size();
+        std::string Entry = Files.substr(Start,End - Start);
+        Start = End + 1;
+        if (Entry == "") continue;
+        
+        //  Names without a wildcard are used as they are. If they don't exist, ReadFitsFile()
+        //  will say so.
+        
+        std::filesystem::path EntryPath(Entry);
+        std::string Pattern = EntryPath.filename().string();
+        if (Pattern.find('*') == std::string::npos) {
+            FileList.push_back(Entry);
+            continue;
+        }
+        
+        //  Otherwise, look through the directory for files that match.
+        
+        std::filesystem::path Directory = EntryPath.parent_path();
+        std::vector<std::string> Matches;
+        std::error_code ErrorCode;
+        std::filesystem::path Where = Directory.empty() ? std::filesystem::path(".") : Directory;
+        for (const auto& Item : std::filesystem::directory_iterator(Where,ErrorCode)) {
+            std::string Name = Item.path().filename().string();
+            if (Name.compare(0,7,"Median_") == 0) continue;
+            if (Item.is_regular_file(ErrorCode) && WildcardMatch(Pattern.c_str(),Name.c_str())) {
+                Matches.push_back((Directory / Name).string());
+            }
+        }
+        if (Matches.empty()) printf ("No files match '%s'\n",Entry.c_str());
+        std::sort(Matches.begin(),Matches.end());
+        FileList.insert(FileList.end(),Matches.begin(),Matches.end());
+    }
+    return FileList;
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                              C r e a t e  R o w  A d d r s
@@ -1002,6 +7984,32 @@ float** CreateRowAddrs(float* Array,int Nx,int Ny)
     return RowAddrs;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                          A l l o c a t e  A r r a y
+//
+//  Allocates the memory for the data of an image array. With 'HugePages' this comes from
+//  HugePages, in huge pages if the system will provide them. Otherwise it comes from malloc(),
+//  or - if Importable is set, because the GPU is to use it as an "IMPORTED" buffer - from the
+//  Vulkan Framework's AllocateImportableMemory(). (HugePages' alignment is enough for an import
+//  anyway.) FreeArray() releases it, and has to be passed the same Importable flag. Memory from
+//  HugePages is recognised as such, so FreeArray() can also be passed a result array taken
+//  over by NoteResults(), whichever way it was allocated.
+
+void* AllocateArray(size_t Bytes,bool Importable)
+{
+    if (UseHugePages) return HugePages::Allocate(Bytes);
+    if (Importable) return KVVulkanFramework::AllocateImportableMemory(Bytes);
+    return malloc(Bytes);
+}
+
+void FreeArray(void* Address,bool Importable)
+{
+    if (HugePages::Free(Address)) return;
+    if (Importable) KVVulkanFramework::FreeImportableMemory(Address);
+    else free(Address);
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //                                N o t e  R e s u l t s
@@ -1013,7 +8021,106 @@ float** CreateRowAddrs(float* Array,int Nx,int Ny)
 //  allows the single routines that comprise the GPU and CPU code to release the arrays they
 //  create, which keeps things simpler.)
 
-bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details)
+//  HalfClose() is used when the GPU held the image in half precision. A median is one of the
+//  values in the box, and rounding doesn't change their order, so usually the GPU result is
+//  just the CPU result rounded. But if the box has an even number of pixels the median is the
+//  average of two rounded values, rounded again - and Vulkan lets the GPU round either to
+//  nearest or towards zero. That can all add up to one and a half units in the last place of
+//  a half-precision value, so this allows for two. (Values too large for half precision end up
+//  as infinities, so those are accepted for anything out of range.)
+
+static bool HalfClose(float First,float Second)
+{
+    if (First == Second) return true;
+    float Magnitude = std::max(fabs(First),fabs(Second));
+    if (Magnitude > C_HalfMax) return fabs(First) >= C_HalfMax && fabs(Second) >= C_HalfMax;
+    uint16_t Half = FloatToHalf(Magnitude);
+    float Unit = HalfToFloat(uint16_t(Half + 1)) - HalfToFloat(Half);
+    return fabs(First - Second) <= 2.0 * Unit;
+}
+
+//  SameValue() is true if two results are equal, or both NaNs - the result for a box with only
+//  blank pixels. It has no branches, so the loop checking each row can still use vector code.
+
+static inline bool SameValue(float First,float Second)
+{
+    return (First == Second) | ((First != First) & (Second != Second));
+}
+
+//  ResultsMatch() compares a CPU and a GPU result. Normally they should be the same, but if
+//  the GPU held the image in half precision they only have to pass HalfClose(), and if the CPU
+//  used the histogram filter they only have to agree to within its tolerance. Any difference
+//  up to the one given by 'Tolerance' is also accepted.
+
+static bool ResultsMatch(float First,float Second,const MedianDetails* Details)
+{
+    if (SameValue(First,Second)) return true;
+    if (Details->GPUHalf && HalfClose(First,Second)) return true;
+    float Tolerance = std::max(Details->HistogramTolerance,Details->CheckTolerance);
+    return (Tolerance > 0.0 && fabs(First - Second) <= Tolerance);
+}
+
+//  ReportApproximation() compares an approximate result, for 'Approx', with the exact median
+//  in Details->ExactData, and reports how many values differ, the largest difference and
+//  where it is, and the mean difference over the pixels with a valid exact median. Unlike the
+//  check in NoteResults(), differences are expected here, so they aren't errors. The rows are
+//  shared out between the threads of the shared pool.
+
+static void ReportApproximation(float** OutputArray,int Nx,int Ny,const MedianDetails* Details,
+                                                                       const char* Device)
+{
+    std::mutex TotalsMutex;
+    long Differ = 0;
+    long Valid = 0;
+    double SumDiff = 0.0;
+    float MaxDiff = 0.0;
+    long MaxDiffIndex = -1;
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        long BandDiffer = 0;
+        long BandValid = 0;
+        double BandSum = 0.0;
+        float BandMax = 0.0;
+        long BandMaxIndex = -1;
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* Row = OutputArray[Iy];
+            const float* ExactRow = Details->ExactData + size_t(Iy) * size_t(Nx);
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                if (SameValue(Row[Ix],ExactRow[Ix])) continue;
+                BandDiffer++;
+                float Diff = fabsf(Row[Ix] - ExactRow[Ix]);
+                if (Diff != Diff) continue;
+                BandSum += Diff;
+                if (Diff > BandMax) {
+                    BandMax = Diff;
+                    BandMaxIndex = long(Iy) * long(Nx) + Ix;
+                }
+            }
+            for (int Ix = 0; Ix < Nx; Ix++) BandValid += (ExactRow[Ix] == ExactRow[Ix]);
+        }
+        std::lock_guard<std::mutex> Lock(TotalsMutex);
+        Differ += BandDiffer;
+        Valid += BandValid;
+        SumDiff += BandSum;
+        if (BandMax > MaxDiff) {
+            MaxDiff = BandMax;
+            MaxDiffIndex = BandMaxIndex;
+        }
+    });
+    double Total = double(Nx) * double(Ny);
+    printf ("Approximation (%s): %ld of %.0f values (%.1f%%) differ from the exact median",
+                                               Device,Differ,Total,100.0 * Differ / Total);
+    if (MaxDiffIndex >= 0) {
+        int MaxDiffRow = int(MaxDiffIndex / Nx);
+        int MaxDiffCol = int(MaxDiffIndex % Nx);
+        printf (",\n  largest difference %g at [%d][%d] %8.1f v %8.1f, mean difference %g",
+                MaxDiff,MaxDiffRow,MaxDiffCol,OutputArray[MaxDiffRow][MaxDiffCol],
+                Details->ExactData[MaxDiffIndex],Valid > 0 ? SumDiff / double(Valid) : 0.0);
+    }
+    printf ("\n");
+}
+
+bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* Details,
+                                                                              float** Owner)
 {
     bool AllOK = true;
     
@@ -1025,7 +8132,11 @@ bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* D
     //  Save the data we're being passed. See if we already have the data from the other device
     //  (ie the GPU if this data is from the CPU, or vice-versa). We only need to save the data
     //  from the first device that calls this routine. The data from both should be the same,
-    //  after all, and we only need to save one of the two to be able to check this.
+    //  after all, and we only need to save one of the two to be able to check this. If the
+    //  caller passed Owner, the data is in a block it allocated with malloc() or AllocateArray(),
+    //  which Shutdown() releases using FreeArray(), and rather than copy that, this takes it over
+    //  and clears *Owner so the caller doesn't release it. The second set of data is always
+    //  compared where it is, without a copy.
     
     const char* ThisDevice = FromGPU ? "GPU" : "CPU";
     const char* OtherDevice = FromGPU ? "CPU" : "GPU";
@@ -1033,41 +8144,135 @@ bool NoteResults(float** OutputArray,bool FromGPU,int Nx,int Ny,MedianDetails* D
     if (FromGPU) OtherData = Details->CPUOutputData;
     else OtherData = Details->GPUOutputData;
     if (OtherData == nullptr) {
-        TheDebugHandler.Logf("Checks","Saving %s data",ThisDevice);
-        int DataBytes = Nx * Ny * sizeof(float);
-        float* SavedData = (float*)malloc(DataBytes);
-        memcpy(SavedData,OutputArray[0],DataBytes);
+        float* SavedData = nullptr;
+        if (Owner && *Owner == OutputArray[0]) {
+            TheDebugHandler.Logf("Checks","Keeping %s data",ThisDevice);
+            SavedData = *Owner;
+            *Owner = nullptr;
+        } else {
+            TheDebugHandler.Logf("Checks","Saving %s data",ThisDevice);
+            size_t DataBytes = size_t(Nx) * size_t(Ny) * sizeof(float);
+            SavedData = (float*)malloc(DataBytes);
+            memcpy(SavedData,OutputArray[0],DataBytes);
+        }
         if (FromGPU) Details->GPUOutputData = SavedData;
         else Details->CPUOutputData = SavedData;
+        
+        //  With 'Approx', the first result is also compared with the exact median. Any second
+        //  result has to match the first, so it would have the same differences.
+        
+        if (Details->ExactData) ReportApproximation(OutputArray,Nx,Ny,Details,ThisDevice);
     }
     //  If we have the data from the other calculation (either GPU or GPU), compare the two.
     //  The code is checking two floating point values for equality, which is usually frowned
     //  upon, but in this case the values in question aren't being calculated (in which case
     //  rounding error might be a problem) but simply copied, so should be exactly the same.
+    //  The exceptions are if the GPU held the image in half precision, or the CPU used the
+    //  histogram filter, when the values can only be expected to agree to within the precision
+    //  of those, and any differences allowed by 'Tolerance' - see ResultsMatch().
+    //  For large images this check can take longer than the calculation, so the rows are
+    //  shared out between the threads in the shared pool. Each row is first checked with a loop
+    //  that just counts the values that don't match, with no branch, which the compiler can
+    //  turn into vector code. Rather than stop at the first bad value, every value is checked,
+    //  and the differences are summarised - how many values don't match, the largest difference
+    //  and where it is, and the mean difference. Where the values have to be equal, a row with
+    //  no bad values has no differences, so only the rows with bad values need the second loop
+    //  that measures them. (A blank pixel in only one of the results counts as an infinite
+    //  difference, but is left out of the mean.)
     
     if (OtherData) {
         TheDebugHandler.Logf ("Checks","Checking %s results against %s results",
                                                                   ThisDevice,OtherDevice);
         float** OtherArray = CreateRowAddrs(OtherData,Nx,Ny);
-        for (int Iy = 0; Iy < Ny; Iy++) {
-            for (int Ix = 0; Ix < Nx; Ix++) {
-                if (OutputArray[Iy][Ix] != OtherArray[Iy][Ix]) {
-                    if (DebugChecks) {
-                        TheDebugHandler.Logf("Checks","Error at [%d][%d] %8.1f (%s) != %8.1f (%s)",
-                              Iy,Ix,OutputArray[Iy][Ix],ThisDevice,OtherArray[Iy][Ix],OtherDevice);
-                    } else {
-                        printf ("Error at [%d][%d] %8.1f (%s) != %8.1f (%s)\n",
-                            Iy,Ix,OutputArray[Iy][Ix],ThisDevice,OtherArray[Iy][Ix],OtherDevice);
+        bool Approximate = Details->GPUHalf || Details->HistogramTolerance > 0.0 ||
+                                                             Details->CheckTolerance > 0.0;
+        std::mutex TotalsMutex;
+        long BadValues = 0;
+        double SumDiff = 0.0;
+        float MaxDiff = 0.0;
+        int MaxDiffRow = -1;
+        ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+            long BandBad = 0;
+            double BandSum = 0.0;
+            float BandMax = 0.0;
+            int BandMaxRow = -1;
+            for (int Iy = Iyst; Iy < Iyen; Iy++) {
+                const float* Row = OutputArray[Iy];
+                const float* OtherRow = OtherArray[Iy];
+                int Bad = 0;
+                if (Approximate) {
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        Bad += !ResultsMatch(Row[Ix],OtherRow[Ix],Details);
+                    }
+                } else {
+                    for (int Ix = 0; Ix < Nx; Ix++) Bad += !SameValue(Row[Ix],OtherRow[Ix]);
+                }
+                BandBad += Bad;
+                if (Bad || Approximate) {
+                    float RowMax = 0.0;
+                    double RowSum = 0.0;
+                    for (int Ix = 0; Ix < Nx; Ix++) {
+                        float Diff = fabsf(Row[Ix] - OtherRow[Ix]);
+                        if (SameValue(Row[Ix],OtherRow[Ix])) Diff = 0.0;
+                        else if (Diff != Diff) Diff = INFINITY;
+                        if (Diff < INFINITY) RowSum += Diff;
+                        if (Diff > RowMax) RowMax = Diff;
+                    }
+                    BandSum += RowSum;
+                    if (RowMax > BandMax) {
+                        BandMax = RowMax;
+                        BandMaxRow = Iy;
                     }
-                    AllOK = false;
-                    break;
                 }
             }
-            if (!AllOK) break;
+            std::lock_guard<std::mutex> Lock(TotalsMutex);
+            BadValues += BandBad;
+            SumDiff += BandSum;
+            if (BandMax > MaxDiff) {
+                MaxDiff = BandMax;
+                MaxDiffRow = BandMaxRow;
+            }
+        });
+        
+        //  Find where in its row the largest difference is.
+        
+        int MaxDiffCol = 0;
+        if (MaxDiffRow >= 0) {
+            float Largest = 0.0;
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                float Diff = fabsf(OutputArray[MaxDiffRow][Ix] - OtherArray[MaxDiffRow][Ix]);
+                if (SameValue(OutputArray[MaxDiffRow][Ix],OtherArray[MaxDiffRow][Ix])) {
+                    Diff = 0.0;
+                } else if (Diff != Diff) {
+                    Diff = INFINITY;
+                }
+                if (Diff > Largest) {
+                    Largest = Diff;
+                    MaxDiffCol = Ix;
+                }
+            }
+        }
+        double MeanDiff = SumDiff / (double(Nx) * double(Ny));
+        char Summary[256];
+        if (MaxDiffRow >= 0) {
+            snprintf (Summary,sizeof(Summary),"largest difference %g at [%d][%d] "
+                    "%8.1f (%s) v %8.1f (%s), mean difference %g",MaxDiff,MaxDiffRow,
+                    MaxDiffCol,OutputArray[MaxDiffRow][MaxDiffCol],ThisDevice,
+                    OtherArray[MaxDiffRow][MaxDiffCol],OtherDevice,MeanDiff);
         }
-        if (AllOK) {
-            if (DebugChecks) TheDebugHandler.Log("Checks","Data from CPU and GPU match OK");
-            else printf ("Data from CPU and GPU match OK\n");
+        if (BadValues > 0) {
+            AllOK = false;
+            if (DebugChecks) {
+                TheDebugHandler.Logf("Checks","Error: %ld values differ, %s",BadValues,Summary);
+            } else {
+                printf ("Error: %ld values differ, %s\n",BadValues,Summary);
+            }
+        } else if (DebugChecks) {
+            TheDebugHandler.Log("Checks","Data from CPU and GPU match OK");
+            if (MaxDiffRow >= 0) TheDebugHandler.Logf("Checks","Within tolerance, %s",Summary);
+        } else {
+            printf ("Data from CPU and GPU match OK\n");
+            if (MaxDiffRow >= 0) printf ("Within tolerance, %s\n",Summary);
         }
         free (OtherArray);
     }
@@ -1086,9 +8291,11 @@ void Shutdown(MedianDetails* Details)
 #ifdef USE_CFITSIO
     if (Details->Fptr) fits_close_file(Details->Fptr,&Status);
 #endif
-    if (Details->InputData) free(Details->InputData);
-    if (Details->GPUOutputData) free(Details->GPUOutputData);
-    if (Details->CPUOutputData) free(Details->CPUOutputData);
+    if (Details->OwnsInputData) FreeArray(Details->InputData,true);
+    KVVulkanFramework::FreeImportableMemory(Details->RawData);
+    FreeArray(Details->GPUOutputData);
+    FreeArray(Details->CPUOutputData);
+    FreeArray(Details->ExactData);
 }
 
 //  ------------------------------------------------------------------------------------------------
@@ -1144,6 +8351,19 @@ std::string OddIntArg::Requirement (void)
     return Text;
 }
 
+//  ------------------------------------------------------------------------------------------------
+//
+//                              E n d  O f  S t a r t u p
+//
+//  Called once the GPU is set up and ready to filter the image. This marks the end of the
+//  start-up recorded by the StartupProfile and, the first time it's called with the 'Startup'
+//  debug level set, lists the stages recorded.
+
+void EndOfStartup(void)
+{
+    if (StartupProfile::Global().Finish()) StartupProfile::Global().Report();
+}
+
 //  ------------------------------------------------------------------------------------------------
 //
 //              D e b u g  A r g  H e l p e r  ::  C h e c k  V a l i d i t y
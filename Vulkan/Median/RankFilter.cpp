@@ -0,0 +1,216 @@
+//
+//                         R a n k  F i l t e r . c p p
+//
+//  The implementation of the RankFilter class. See RankFilter.h for an overview.
+//
+//  15th Oct 2026. First version. KS.
+
+#include "RankFilter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <vector>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               R a n k  F i l t e r
+//
+//  The constructor just notes the details. Npix is kept to at least 1, and the percentile to
+//  the range 0 to 100.
+
+RankFilter::RankFilter(const float* Input,int Nx,int Ny,int Npix,int Percentile)
+{
+    I_Input = Input;
+    I_Nx = Nx;
+    I_Ny = Ny;
+    I_Npix = std::max(Npix,1);
+    I_Percentile = std::min(std::max(Percentile,C_Min),C_Max);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                     P a r s e
+//
+//  A number may be given with a leading 'P', as Name() gives it, so "P10" and "10" are the same.
+
+bool RankFilter::Parse(const std::string& Text,int* Percentile)
+{
+    std::string Upper = Text;
+    for (char& Char : Upper) Char = toupper(Char);
+    if (Upper == "" || Upper == "MEDIAN") *Percentile = C_Median;
+    else if (Upper == "MIN") *Percentile = C_Min;
+    else if (Upper == "MAX") *Percentile = C_Max;
+    else {
+        if (Upper[0] == 'P') Upper.erase(0,1);
+        if (Upper == "" || Upper.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        int Value = atoi(Upper.c_str());
+        if (Upper.size() > 3 || Value > C_Max) return false;
+        *Percentile = Value;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                      N a m e
+
+std::string RankFilter::Name(int Percentile)
+{
+    if (Percentile == C_Min) return "Min";
+    if (Percentile == C_Max) return "Max";
+    if (Percentile == C_Median) return "Median";
+    return "P" + std::to_string(Percentile);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                     F i l t e r
+
+int RankFilter::Filter(float* Output,int Threads) const
+{
+    if (I_Percentile == C_Min) return MinMaxFilter<false>(Output,Threads);
+    if (I_Percentile == C_Max) return MinMaxFilter<true>(Output,Threads);
+    return ThreadPool::Shared().ParallelFor(0,I_Ny,[&](int Iyst,int Iyen) {
+        SelectRows(Iyst,Iyen,Output);
+    },Threads);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                               M i n  M a x  F i l t e r
+//
+//  The van Herk/Gil-Werman filter, along the rows into a temporary image, and then down its
+//  columns into Output. Max selects the maximum filter rather than the minimum. Identity is the
+//  value that leaves the result unchanged, used for the padding and for blanks.
+
+template <bool Max> int RankFilter::MinMaxFilter(float* Output,int Threads) const
+{
+    const float Identity = Max ? -INFINITY : INFINITY;
+    auto Combine = [](float First,float Second) {
+        return Max ? std::max(First,Second) : std::min(First,Second);
+    };
+    int Npix = I_Npix;
+    int Half = Npix / 2;
+    size_t Nx = size_t(I_Nx);
+
+    //  The row filter. Each row is copied into a padded row buffer, with blanks replaced, then
+    //  the prefix and suffix are worked out for each block, and combined for each pixel.
+
+    std::vector<float> Temp(Nx * size_t(I_Ny));
+    int PaddedX = ((I_Nx + 2 * Half + Npix - 1) / Npix) * Npix;
+    Threads = ThreadPool::Shared().ParallelFor(0,I_Ny,[&](int Iyst,int Iyen) {
+        std::vector<float> Line(PaddedX),Prefix(PaddedX),Suffix(PaddedX);
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* InRow = I_Input + size_t(Iy) * Nx;
+            std::fill(Line.begin(),Line.end(),Identity);
+            for (int Ix = 0; Ix < I_Nx; Ix++) {
+                float Value = InRow[Ix];
+                Line[Ix + Half] = isnan(Value) ? Identity : Value;
+            }
+            for (int Block = 0; Block < PaddedX; Block += Npix) {
+                Prefix[Block] = Line[Block];
+                for (int Iq = Block + 1; Iq < Block + Npix; Iq++) {
+                    Prefix[Iq] = Combine(Prefix[Iq - 1],Line[Iq]);
+                }
+                Suffix[Block + Npix - 1] = Line[Block + Npix - 1];
+                for (int Iq = Block + Npix - 2; Iq >= Block; Iq--) {
+                    Suffix[Iq] = Combine(Suffix[Iq + 1],Line[Iq]);
+                }
+            }
+            float* TempRow = Temp.data() + size_t(Iy) * Nx;
+            for (int Ix = 0; Ix < I_Nx; Ix++) {
+                TempRow[Ix] = Combine(Suffix[Ix],Prefix[Ix + Npix - 1]);
+            }
+        }
+    },Threads);
+
+    //  The column filter works a row at a time, so the prefix and suffix are whole images,
+    //  in padded row coordinates. Each block of rows is independent, so the blocks are shared
+    //  between the threads. Padded row Iq is image row Iq - Half, or is padding.
+
+    int PaddedY = ((I_Ny + 2 * Half + Npix - 1) / Npix) * Npix;
+    int Blocks = PaddedY / Npix;
+    std::vector<float> Prefix(Nx * size_t(PaddedY)),Suffix(Nx * size_t(PaddedY));
+    std::vector<float> Padding(Nx,Identity);
+    auto TempRow = [&](int Iq) {
+        int Iy = Iq - Half;
+        return (Iy >= 0 && Iy < I_Ny) ? Temp.data() + size_t(Iy) * Nx : Padding.data();
+    };
+    ThreadPool::Shared().ParallelFor(0,Blocks,[&](int Ibst,int Iben) {
+        for (int Block = Ibst * Npix; Block < Iben * Npix; Block += Npix) {
+            std::copy(TempRow(Block),TempRow(Block) + Nx,Prefix.data() + size_t(Block) * Nx);
+            for (int Iq = Block + 1; Iq < Block + Npix; Iq++) {
+                const float* Last = Prefix.data() + size_t(Iq - 1) * Nx;
+                const float* Row = TempRow(Iq);
+                float* Result = Prefix.data() + size_t(Iq) * Nx;
+                for (size_t Ix = 0; Ix < Nx; Ix++) Result[Ix] = Combine(Last[Ix],Row[Ix]);
+            }
+            int End = Block + Npix - 1;
+            std::copy(TempRow(End),TempRow(End) + Nx,Suffix.data() + size_t(End) * Nx);
+            for (int Iq = End - 1; Iq >= Block; Iq--) {
+                const float* Next = Suffix.data() + size_t(Iq + 1) * Nx;
+                const float* Row = TempRow(Iq);
+                float* Result = Suffix.data() + size_t(Iq) * Nx;
+                for (size_t Ix = 0; Ix < Nx; Ix++) Result[Ix] = Combine(Next[Ix],Row[Ix]);
+            }
+        }
+    },Threads);
+
+    //  And the combination for each row of the output, with any box that had no valid pixels
+    //  set to a NaN.
+
+    ThreadPool::Shared().ParallelFor(0,I_Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* First = Suffix.data() + size_t(Iy) * Nx;
+            const float* Last = Prefix.data() + size_t(Iy + Npix - 1) * Nx;
+            float* OutRow = Output + size_t(Iy) * Nx;
+            for (size_t Ix = 0; Ix < Nx; Ix++) {
+                float Value = Combine(First[Ix],Last[Ix]);
+                OutRow[Ix] = (Value == Identity) ? NAN : Value;
+            }
+        }
+    },Threads);
+    return Threads;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                S e l e c t  R o w s
+//
+//  For each pixel, the valid values in its box, cut short at the image edges, are collected
+//  into a work array, and std::nth_element() finds the one with the required rank.
+
+void RankFilter::SelectRows(int Iyst,int Iyen,float* Output) const
+{
+    int Half = I_Npix / 2;
+    std::vector<float> Work(size_t(I_Npix) * size_t(I_Npix));
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        int Iymin = std::max(Iy - Half,0);
+        int Iymax = std::min(Iy + Half,I_Ny - 1);
+        float* OutRow = Output + size_t(Iy) * size_t(I_Nx);
+        for (int Ix = 0; Ix < I_Nx; Ix++) {
+            int Ixmin = std::max(Ix - Half,0);
+            int Ixmax = std::min(Ix + Half,I_Nx - 1);
+            int Count = 0;
+            for (int Iyb = Iymin; Iyb <= Iymax; Iyb++) {
+                const float* InRow = I_Input + size_t(Iyb) * size_t(I_Nx);
+                for (int Ixb = Ixmin; Ixb <= Ixmax; Ixb++) {
+                    float Value = InRow[Ixb];
+                    if (!isnan(Value)) Work[Count++] = Value;
+                }
+            }
+            if (Count == 0) {
+                OutRow[Ix] = NAN;
+            } else {
+                int Rank = RankFilter::Rank(Count,I_Percentile);
+                std::nth_element(Work.begin(),Work.begin() + Rank,Work.begin() + Count);
+                OutRow[Ix] = Work[Rank];
+            }
+        }
+    }
+}
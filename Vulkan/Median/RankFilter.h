@@ -0,0 +1,96 @@
+//
+//                            R a n k  F i l t e r . h
+//
+//  A rank filter for the CPU, which sets each pixel to a given percentile of the values in the
+//  Npix by Npix box around it: 0 for the minimum (an erosion), 100 for the maximum (a dilation),
+//  or anything in between, such as 10 or 90. (The median, 50, has all the specialised code in
+//  MedianVulkan.cpp, and doesn't come here.) It is used by Median's 'Rank' option, and the GPU
+//  version in RankFilter.comp gives the same results.
+//
+//  The minimum and maximum filters use the van Herk/Gil-Werman algorithm, whose cost for each
+//  pixel doesn't depend on the size of the box at all. A box filter of this kind is separable,
+//  so it is done as a filter along the rows followed by one down the columns, each of which
+//  takes the minimum (or maximum) of Npix values in a line. The line is divided into blocks of
+//  Npix values, and for each block a running minimum is kept from the start of the block - G,
+//  the prefix - and another from its end - H, the suffix. Any run of Npix values covers the end
+//  of one block and the start of the next, so its minimum is just the smaller of H at its first
+//  value and G at its last. That's three comparisons per value, whatever the box size.
+//
+//  The other percentiles have no such trick, and collect the valid values in each box and
+//  select the one with the required rank, using std::nth_element(), so they get slower with the
+//  square of the box size, as for the median.
+//
+//  The boxes are cut short at the edges of the image, and blank pixels - NaNs - are left out of
+//  them, both just as for the median filter, and a box with no valid pixels gives a NaN. The
+//  percentile of the n valid values in a box is the one of rank ((n - 1) * Percentile + 50)/100,
+//  counting from zero, which is always one of the values - there is no averaging of the two
+//  middle values as there is for the median.
+//
+//  A RankFilter is created for a given image, box size and percentile. Filter() then filters
+//  the whole image, sharing the work between the threads of the shared thread pool.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __RankFilter__
+#define __RankFilter__
+
+#include <string>
+
+class RankFilter
+{
+public:
+    //  The percentiles used for the minimum, the median and the maximum.
+    static constexpr int C_Min = 0;
+    static constexpr int C_Median = 50;
+    static constexpr int C_Max = 100;
+    //  Sets up to filter the Nx by Ny image at Input, using an Npix by Npix box.
+    RankFilter(const float* Input,int Nx,int Ny,int Npix,int Percentile);
+    //  Filters the whole image into Output, using up to Threads threads (all of them if zero),
+    //  returning the number used.
+    int Filter(float* Output,int Threads = 0) const;
+    //  Sets Percentile from a rank given as "Min", "Max", "Median" (case doesn't matter) or a
+    //  number from 0 to 100, returning false if it isn't one of those. A blank rank is the median.
+    static bool Parse(const std::string& Text,int* Percentile);
+    //  The name of a percentile, as used in messages and output file names, eg "Min" or "P10".
+    static std::string Name(int Percentile);
+    //  True if the percentile is the minimum or maximum, for which van Herk/Gil-Werman is used.
+    static bool IsMinMax(int Percentile) { return Percentile == C_Min || Percentile == C_Max; }
+    //  The rank, counting from zero, of the value selected from Count valid values.
+    static int Rank(int Count,int Percentile) { return ((Count - 1) * Percentile + 50) / 100; }
+private:
+    //  The van Herk/Gil-Werman filter, for the minimum or maximum.
+    template <bool Max> int MinMaxFilter(float* Output,int Threads) const;
+    //  Selects the percentile for rows Iyst up to (not including) Iyen.
+    void SelectRows(int Iyst,int Iyen,float* Output) const;
+    //  The image, and its dimensions.
+    const float* I_Input;
+    int I_Nx;
+    int I_Ny;
+    //  The box size and the percentile.
+    int I_Npix;
+    int I_Percentile;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   The blocks are laid out in padded coordinates, with Npix/2 values of padding before the
+        start of the line, so the box for pixel x covers padded values x to x + Npix - 1, and
+        the line is padded at the end to a whole number of blocks. The padding, and any NaNs,
+        are given the value that leaves a minimum unchanged - plus infinity - or, for the
+        maximum, minus infinity. That is how the boxes are cut short at the edges, and how the
+        blanks are left out, with no tests in the inner loops. A result that is still that
+        value had no valid pixels in its box, and becomes a NaN. (So would a box whose only
+        valid values were that same infinity, but images don't have those.)
+
+    o   The row filter works on one row at a time, each thread with its own row buffers. The
+        column filter works on whole rows at a time too - the prefix and suffix for a row of
+        the block are the element by element minimum of a row with the one before or after
+        it, which the compiler can vectorise - so it needs full size prefix and suffix images,
+        shared between the threads a block of rows at a time. That's three extra images in all,
+        including the one between the two passes.
+
+    o   The selection for the other percentiles uses a work array for each thread, big enough
+        for a full box, so any box size up to HistogramMedian::C_MaxNpix can be used, if slowly.
+*/
@@ -0,0 +1,103 @@
+//
+//                      S e p a r a b l e  M e d i a n . c p p
+//
+//  The implementation of the SeparableMedian class. See SeparableMedian.h for an overview.
+//
+//  15th Oct 2026. First version. KS.
+
+#include "SeparableMedian.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <vector>
+#include <math.h>
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                            S e p a r a b l e  M e d i a n
+//
+//  The constructor just notes the details. Npix is kept to at least 1.
+
+SeparableMedian::SeparableMedian(const float* Input,int Nx,int Ny,int Npix)
+{
+    I_Input = Input;
+    I_Nx = Nx;
+    I_Ny = Ny;
+    I_Npix = std::max(Npix,1);
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                L i n e  M e d i a n
+//
+//  The upper of the two middle values is found by std::nth_element(), which leaves all the
+//  values below it before it, so for an even count the lower one is the largest of those. The
+//  average is calculated just as CalcMedian() in MedianVulkan.cpp and the shaders do, so the
+//  results are the same to the bit.
+
+float SeparableMedian::LineMedian(float* Work,int Count)
+{
+    if (Count <= 0) return NAN;
+    int Cent = Count / 2;
+    std::nth_element(Work,Work + Cent,Work + Count);
+    float Median = Work[Cent];
+    if ((Count % 2) == 0) {
+        float Lower = *std::max_element(Work,Work + Cent);
+        Median = (Median + Lower) * 0.5;
+    }
+    return Median;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                     F i l t e r
+//
+//  The row filter, into a temporary image, and then the column filter, from that into Output.
+//  Each thread has its own work array for the values of one row segment or column segment.
+//  Each value goes into the next free element, which only moves on if the value isn't a NaN,
+//  so the valid values are packed together without a branch.
+
+int SeparableMedian::Filter(float* Output,int Threads) const
+{
+    int Half = I_Npix / 2;
+    size_t Nx = size_t(I_Nx);
+    std::vector<float> Temp(Nx * size_t(I_Ny));
+
+    Threads = ThreadPool::Shared().ParallelFor(0,I_Ny,[&](int Iyst,int Iyen) {
+        std::vector<float> Work(I_Npix);
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* InRow = I_Input + size_t(Iy) * Nx;
+            float* TempRow = Temp.data() + size_t(Iy) * Nx;
+            for (int Ix = 0; Ix < I_Nx; Ix++) {
+                int Ixmin = std::max(Ix - Half,0);
+                int Ixmax = std::min(Ix + Half,I_Nx - 1);
+                int Count = 0;
+                for (int Xind = Ixmin; Xind <= Ixmax; Xind++) {
+                    float Value = InRow[Xind];
+                    Work[Count] = Value;
+                    Count += (Value == Value);
+                }
+                TempRow[Ix] = LineMedian(Work.data(),Count);
+            }
+        }
+    },Threads);
+
+    ThreadPool::Shared().ParallelFor(0,I_Ny,[&](int Iyst,int Iyen) {
+        std::vector<float> Work(I_Npix);
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            int Iymin = std::max(Iy - Half,0);
+            int Iymax = std::min(Iy + Half,I_Ny - 1);
+            float* OutRow = Output + size_t(Iy) * Nx;
+            for (int Ix = 0; Ix < I_Nx; Ix++) {
+                int Count = 0;
+                for (int Yind = Iymin; Yind <= Iymax; Yind++) {
+                    float Value = Temp[size_t(Yind) * Nx + size_t(Ix)];
+                    Work[Count] = Value;
+                    Count += (Value == Value);
+                }
+                OutRow[Ix] = LineMedian(Work.data(),Count);
+            }
+        }
+    },Threads);
+    return Threads;
+}
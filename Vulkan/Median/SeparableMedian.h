@@ -0,0 +1,65 @@
+//
+//                       S e p a r a b l e  M e d i a n . h
+//
+//  An approximate median filter for the CPU, used by Median's 'Approx' option for a quick look
+//  at an image. Rather than find the median of all the Npix by Npix values in each box, it
+//  finds the median of each of the box's Npix rows, and then the median of those Npix row
+//  medians - the median of medians, or separable median. Since the row medians are shared by
+//  all the boxes that include the same row segment, this is done as a filter along the rows,
+//  into a temporary image, followed by a filter down its columns, each taking the median of
+//  just Npix values. So the cost per pixel grows with Npix rather than with Npix squared, and
+//  for large boxes it is far faster than the true median. The GPU version, in
+//  SeparableMedian.comp, gives the same results.
+//
+//  The result isn't the median of the box, but it is always one of the values between the
+//  smallest and largest row medians, and for most images it is close to the true median - it
+//  is certain to be at least as large as about a quarter of the values in the box, and no
+//  larger than about another quarter. Median reports how far it is from the true median, so
+//  the approximation can be judged for a given image and box size.
+//
+//  The rows and columns are cut short at the edges of the image, and blank pixels - NaNs - are
+//  left out of them, just as for the median filter. A row segment with no valid pixels gives a
+//  NaN row median, which is left out of the column in the same way, and a box with no valid
+//  pixels gives a NaN. As for the median, an even number of values gives the average of the
+//  two middle ones.
+//
+//  A SeparableMedian is created for a given image and box size. Filter() then filters the
+//  whole image, sharing the work between the threads of the shared thread pool.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __SeparableMedian__
+#define __SeparableMedian__
+
+class SeparableMedian
+{
+public:
+    //  Sets up to filter the Nx by Ny image at Input, using an Npix by Npix box.
+    SeparableMedian(const float* Input,int Nx,int Ny,int Npix);
+    //  Filters the whole image into Output, using up to Threads threads (all of them if zero),
+    //  returning the number used.
+    int Filter(float* Output,int Threads = 0) const;
+    //  The median of the Count values in Work, which it reorders, or a NaN if Count is zero.
+    static float LineMedian(float* Work,int Count);
+private:
+    //  The image, and its dimensions.
+    const float* I_Input;
+    int I_Nx;
+    int I_Ny;
+    //  The box size.
+    int I_Npix;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   Each median of Npix values is found with std::nth_element(), which takes time in
+        proportion to Npix. A sliding window, as used for the exact median in MedianVulkan.cpp,
+        could make that log(Npix), but the point of this filter is that it is already cheap,
+        and the selection keeps it simple.
+
+    o   The column filter takes each output row in turn and works along it, so the Npix values
+        it gathers for each pixel come from Npix different rows of the temporary image. Those
+        rows are the same for the whole of the output row, so they stay in the cache.
+*/
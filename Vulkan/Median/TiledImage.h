@@ -0,0 +1,255 @@
+//
+//                             T i l e d  I m a g e . h
+//
+//  This provides what a program needs to work through an image too large to hold in GPU memory
+//  - or in main memory - a tile at a time, sharing the tiles between several GPUs. It is used by
+//  MandelTiles, for poster-sized Mandelbrot images, and by Median's 'Tiles' option, which
+//  filters a whole mosaic that way.
+//
+//  A TileGrid splits an Nx by Ny image into tiles of a given size, the tiles along the right
+//  and bottom edges being smaller if the tile size doesn't divide the image exactly. Each tile
+//  can have a halo, for a calculation such as a median filter, where each output pixel depends
+//  on the input pixels around it: the input area of a tile is its output area extended by the
+//  halo on each side, but only as far as the edges of the image. A tile whose input area is
+//  processed as an image in its own right then gets the right answer for every pixel of its
+//  output area, since the halo supplies all the neighbours those pixels need, and where the
+//  input area stops at the edge of the image, that's an edge of the image for both.
+//
+//  A TileQueue hands out the tiles, in order, to as many threads as want them - usually one
+//  thread for each GPU - so a faster GPU simply ends up doing more of them.
+//
+//  A MappedFile maps a file into memory, so the tiles can be read from, or written straight
+//  into, their places in it. The system reads in only the parts of an input file that are used,
+//  and writes the output file back in its own time, so neither has to fit in memory, and there
+//  is no need for a separate thread to do the writing. Create() makes a new file of a given
+//  size, and Open() maps an existing one.
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __TiledImage__
+#define __TiledImage__
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+//  One tile of a TileGrid. X,Y,Nx,Ny give its output area, and InX,InY,InNx,InNy its input
+//  area, which includes the halo.
+
+struct ImageTile {
+    int Index;
+    int X;
+    int Y;
+    int Nx;
+    int Ny;
+    int InX;
+    int InY;
+    int InNx;
+    int InNy;
+};
+
+class TileGrid
+{
+public:
+    //  Splits an Nx by Ny image into TileNx by TileNy tiles, with a halo of Halo pixels.
+    TileGrid(int Nx,int Ny,int TileNx,int TileNy,int Halo = 0) {
+        _nx = Nx;
+        _ny = Ny;
+        _tileNx = std::max(1,std::min(TileNx,Nx));
+        _tileNy = std::max(1,std::min(TileNy,Ny));
+        _halo = std::max(0,Halo);
+        _tilesX = (Nx + _tileNx - 1) / _tileNx;
+        _tilesY = (Ny + _tileNy - 1) / _tileNy;
+    }
+    //  The number of tiles, and the number across and down the image.
+    int Count(void) const { return _tilesX * _tilesY; }
+    int TilesX(void) const { return _tilesX; }
+    int TilesY(void) const { return _tilesY; }
+    //  The largest input area of any tile, which sets the size of the buffers needed.
+    int MaxInNx(void) const { return std::min(_nx,_tileNx + 2 * _halo); }
+    int MaxInNy(void) const { return std::min(_ny,_tileNy + 2 * _halo); }
+    //  Returns the details of a tile. The tiles go across the image, row by row.
+    ImageTile Tile(int Index) const {
+        ImageTile TheTile;
+        TheTile.Index = Index;
+        TheTile.X = (Index % _tilesX) * _tileNx;
+        TheTile.Y = (Index / _tilesX) * _tileNy;
+        TheTile.Nx = std::min(_tileNx,_nx - TheTile.X);
+        TheTile.Ny = std::min(_tileNy,_ny - TheTile.Y);
+        TheTile.InX = std::max(0,TheTile.X - _halo);
+        TheTile.InY = std::max(0,TheTile.Y - _halo);
+        TheTile.InNx = std::min(_nx,TheTile.X + TheTile.Nx + _halo) - TheTile.InX;
+        TheTile.InNy = std::min(_ny,TheTile.Y + TheTile.Ny + _halo) - TheTile.InY;
+        return TheTile;
+    }
+private:
+    int _nx;
+    int _ny;
+    int _tileNx;
+    int _tileNy;
+    int _halo;
+    int _tilesX;
+    int _tilesY;
+};
+
+class TileQueue
+{
+public:
+    TileQueue(int Count) { _count = Count; _next = 0; }
+    //  Sets Index to the next tile to be done, returning false once they have all been taken.
+    bool Next(int* Index) {
+        int Tile = _next++;
+        if (Tile >= _count) return false;
+        *Index = Tile;
+        return true;
+    }
+private:
+    int _count;
+    std::atomic<int> _next;
+};
+
+class MappedFile
+{
+public:
+    MappedFile() { _address = nullptr; _bytes = 0; _error = ""; Clear(); }
+    ~MappedFile() { Close(); }
+    //  Creates a new file of the given size, replacing any existing one, and maps it for
+    //  writing. The contents start off as zeros.
+    bool Create(const std::string& FileName,uint64_t Bytes) {
+        return Map(FileName,Bytes,true,true);
+    }
+    //  Maps an existing file, for reading only unless Writable is set.
+    bool Open(const std::string& FileName,bool Writable = false) {
+        return Map(FileName,0,Writable,false);
+    }
+    //  The address at which the file is mapped, and its size.
+    char* Address(void) const { return _address; }
+    uint64_t Bytes(void) const { return _bytes; }
+    //  Unmaps the file, which writes back any changes, and closes it. Returns false if the
+    //  changes couldn't be written.
+    bool Close(void) {
+        bool CloseOK = true;
+#if defined(__unix__) || defined(__APPLE__)
+        if (_address) {
+            if (_writable && msync(_address,_bytes,MS_SYNC) != 0) CloseOK = false;
+            munmap(_address,_bytes);
+        }
+        if (_fd >= 0) close(_fd);
+#elif defined(_WIN32)
+        if (_address) {
+            if (_writable && !FlushViewOfFile(_address,0)) CloseOK = false;
+            UnmapViewOfFile(_address);
+        }
+        if (_mapping) CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#endif
+        if (!CloseOK) _error = "Unable to write back changes to the mapped file";
+        _address = nullptr;
+        _bytes = 0;
+        Clear();
+        return CloseOK;
+    }
+    //  Returns an explanation of the last error.
+    const std::string& GetError(void) const { return _error; }
+private:
+    void Clear(void) {
+        _writable = false;
+#if defined(__unix__) || defined(__APPLE__)
+        _fd = -1;
+#elif defined(_WIN32)
+        _file = INVALID_HANDLE_VALUE;
+        _mapping = NULL;
+#endif
+    }
+    bool Map(const std::string& FileName,uint64_t Bytes,bool Writable,bool Create) {
+        Close();
+        _error = "";
+        _writable = Writable;
+#if defined(__unix__) || defined(__APPLE__)
+        int Flags = Writable ? O_RDWR : O_RDONLY;
+        if (Create) Flags |= O_CREAT | O_TRUNC;
+        _fd = open(FileName.c_str(),Flags,0644);
+        if (_fd < 0) return Failed("Unable to open",FileName);
+        if (Create) {
+            if (ftruncate(_fd,off_t(Bytes)) != 0) return Failed("Unable to size",FileName);
+        } else {
+            struct stat FileStat;
+            if (fstat(_fd,&FileStat) != 0) return Failed("Unable to size",FileName);
+            Bytes = uint64_t(FileStat.st_size);
+        }
+        if (Bytes > 0) {
+            void* Map = mmap(nullptr,size_t(Bytes),
+                           Writable ? PROT_READ | PROT_WRITE : PROT_READ,MAP_SHARED,_fd,0);
+            if (Map == MAP_FAILED) return Failed("Unable to map",FileName);
+            _address = (char*)Map;
+        }
+#elif defined(_WIN32)
+        _file = CreateFileA(FileName.c_str(),Writable ? GENERIC_READ | GENERIC_WRITE :
+                    GENERIC_READ,FILE_SHARE_READ,NULL,Create ? CREATE_ALWAYS : OPEN_EXISTING,
+                                                                FILE_ATTRIBUTE_NORMAL,NULL);
+        if (_file == INVALID_HANDLE_VALUE) return Failed("Unable to open",FileName);
+        if (!Create) {
+            LARGE_INTEGER Size;
+            if (!GetFileSizeEx(_file,&Size)) return Failed("Unable to size",FileName);
+            Bytes = uint64_t(Size.QuadPart);
+        }
+        if (Bytes > 0) {
+            _mapping = CreateFileMappingA(_file,NULL,Writable ? PAGE_READWRITE : PAGE_READONLY,
+                                           DWORD(Bytes >> 32),DWORD(Bytes & 0xffffffff),NULL);
+            if (_mapping == NULL) return Failed("Unable to map",FileName);
+            _address = (char*)MapViewOfFile(_mapping,
+                                Writable ? FILE_MAP_WRITE : FILE_MAP_READ,0,0,size_t(Bytes));
+            if (_address == nullptr) return Failed("Unable to map",FileName);
+        }
+#else
+        (void) Bytes;
+        (void) Create;
+        return Failed("Memory mapped files are not supported for",FileName);
+#endif
+        _bytes = Bytes;
+        return true;
+    }
+    bool Failed(const std::string& What,const std::string& FileName) {
+        std::string Reason = What + " file '" + FileName + "'";
+        Close();
+        _error = Reason;
+        return false;
+    }
+    char* _address;
+    uint64_t _bytes;
+    bool _writable;
+    std::string _error;
+#if defined(__unix__) || defined(__APPLE__)
+    int _fd;
+#elif defined(_WIN32)
+    HANDLE _file;
+    HANDLE _mapping;
+#endif
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   A tile's halo takes its input area beyond its output area, so neighbouring tiles read
+        some of the same input pixels, but their output areas never overlap, so the threads
+        writing them into a mapped output file never write the same bytes.
+
+    o   Close() uses msync() (or FlushViewOfFile()) so a program knows the output has been
+        written when it finishes. Without that, the system would still write it back in
+        time, but an error in doing so would go unreported.
+*/
@@ -0,0 +1,307 @@
+//
+//                        B e n c h  C o m p a r e . c p p
+//
+//  BenchCompare is a small program used by the 'bench' and 'bench-baseline' targets of the
+//  Makefile, to spot when a change to the code, or to the driver, or to the machine, has made
+//  one of the test programs slower. It reads the timings a program writes when it's given a
+//  'Report' file ending in ".csv" - see BenchReport.h - and compares them with a baseline file
+//  of the same form, normally written by an earlier run on the same machine.
+//
+//  Invocation:
+//     BenchCompare <Results> <Baseline> <Tolerance> <MinMsec> <Update>
+//
+//  Where:
+//
+//     Results   is the CSV file with the timings to be checked.
+//     Baseline  is the CSV file with the baseline timings.
+//     Tolerance is the percentage by which a test can be slower than its baseline before it
+//               counts as a regression. Default 10.
+//     MinMsec   is the smallest slow-down, in msec, that counts as a regression, whatever the
+//               percentage. Very short tests can easily vary by more than Tolerance just from
+//               timer noise. Default 0.01 msec.
+//     Update    if set, the results are not checked, but are copied to become the new
+//               baseline. Update is a boolean, so can be given as just 'update'.
+//
+//  Each test is identified by its program, API, test name and image size. The median (P50)
+//  time for a pass as measured by the CPU is compared, and so is the median GPU kernel time,
+//  if both files have one. If a file has more than one row for a test, the last is used. The
+//  device and driver aren't part of what identifies a test - the point is to see the effect
+//  of changing them - but any difference is noted. Tests in only one of the files are listed,
+//  but aren't counted as failures. Tests that are faster than their baseline by more than
+//  Tolerance are listed too, as a hint that the baseline may need updating.
+//
+//  The exit status is 0 if there are no regressions, 1 if there are, and 2 if a file can't be
+//  read or written, so a failure stops 'make'.
+//
+//  15th Oct 2026. First version. KS.
+
+#include "CommandHandler.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//  The details of one test, as read from a results or baseline file. GpuP50 is negative if
+//  the test didn't have its GPU kernels timed.
+
+struct BenchRow {
+    std::string Device;
+    std::string Driver;
+    double HostP50;
+    double GpuP50;
+};
+
+//  The tests read from a file, indexed by the key that identifies each one. Keys lists the
+//  keys in the order the tests first appeared in the file.
+
+struct BenchResults {
+    std::map<std::string,BenchRow> Rows;
+    std::vector<std::string> Keys;
+};
+
+//  Routines used by the main routine.
+
+static bool ReadResults(const std::string& FileName,BenchResults* Results);
+static bool CopyResults(const std::string& From,const std::string& To);
+static std::vector<std::string> SplitCSV(const std::string& Line);
+static int CompareTimes(const std::string& Key,const char* What,double Base,double New,
+                                                                double Tolerance,double MinMsec);
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    M a i n
+
+int main (int Argc, char* Argv[]) {
+
+    CmdHandler TheHandler("BenchCompare");
+    FileArg ResultsArg(TheHandler,"Results",1,"MustExist","","Timings to be checked (.csv)");
+    FileArg BaselineArg(TheHandler,"Baseline",2,"","","Baseline timings (.csv)");
+    RealArg ToleranceArg(TheHandler,"Tolerance",3,"",10.0,0.0,1.0e6,
+                                                          "Percentage slow-down allowed");
+    RealArg MinMsecArg(TheHandler,"MinMsec",4,"",0.01,0.0,1.0e6,
+                                                  "Smallest slow-down counted, in msec");
+    BoolArg UpdateArg(TheHandler,"Update",0,"",false,"Make the results the new baseline");
+
+    std::string Error = "";
+    bool Ok = TheHandler.ParseArgs(Argc,Argv);
+    std::string Results = ResultsArg.GetValue(&Ok,&Error);
+    std::string Baseline = BaselineArg.GetValue(&Ok,&Error);
+    double Tolerance = ToleranceArg.GetValue(&Ok,&Error);
+    double MinMsec = MinMsecArg.GetValue(&Ok,&Error);
+    bool Update = UpdateArg.GetValue(&Ok,&Error);
+
+    if (!Ok) {
+        if (TheHandler.ExitRequested()) return 0;
+        printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
+        return 2;
+    }
+
+    //  With 'Update', all that's needed is a copy of the results.
+
+    if (Update) {
+        if (!CopyResults(Results,Baseline)) return 2;
+        printf ("Baseline %s updated from %s\n",Baseline.c_str(),Results.c_str());
+        return 0;
+    }
+
+    BenchResults New;
+    if (!ReadResults(Results,&New)) return 2;
+    BenchResults Base;
+    if (!ReadResults(Baseline,&Base)) {
+        printf ("There is no usable baseline in %s. 'make bench-baseline' will make one.\n",
+                                                                            Baseline.c_str());
+        return 2;
+    }
+
+    //  Go through the tests in the results, comparing each with its baseline.
+
+    printf ("\nComparing %s with baseline %s (tolerance %.1f%%, at least %.3f msec)\n\n",
+                                        Results.c_str(),Baseline.c_str(),Tolerance,MinMsec);
+    int Regressions = 0;
+    bool NotedDevice = false;
+    for (const std::string& Key : New.Keys) {
+        const BenchRow& NewRow = New.Rows[Key];
+        if (Base.Rows.count(Key) == 0) {
+            printf ("%-40s not in the baseline\n",Key.c_str());
+            continue;
+        }
+        const BenchRow& BaseRow = Base.Rows[Key];
+        if (!NotedDevice && (NewRow.Device != BaseRow.Device ||
+                                                          NewRow.Driver != BaseRow.Driver)) {
+            printf ("Note: baseline used '%s' '%s', these results '%s' '%s'\n",
+                    BaseRow.Device.c_str(),BaseRow.Driver.c_str(),NewRow.Device.c_str(),
+                                                                     NewRow.Driver.c_str());
+            NotedDevice = true;
+        }
+        Regressions += CompareTimes(Key,"host",BaseRow.HostP50,NewRow.HostP50,
+                                                                          Tolerance,MinMsec);
+        if (BaseRow.GpuP50 >= 0.0 && NewRow.GpuP50 >= 0.0) {
+            Regressions += CompareTimes(Key,"gpu",BaseRow.GpuP50,NewRow.GpuP50,
+                                                                          Tolerance,MinMsec);
+        }
+    }
+    for (const std::string& Key : Base.Keys) {
+        if (New.Rows.count(Key) == 0) printf ("%-40s not in the results\n",Key.c_str());
+    }
+
+    if (Regressions > 0) {
+        printf ("\n%d time(s) slower than the baseline allows.\n",Regressions);
+        return 1;
+    }
+    printf ("\nNo regressions.\n");
+    return 0;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              C o m p a r e  T i m e s
+//
+//  Prints the comparison of one time, in msec, with its baseline. Returns 1 if it's a
+//  regression - slower by more than both Tolerance percent and MinMsec - and 0 otherwise.
+
+static int CompareTimes(const std::string& Key,const char* What,double Base,double New,
+                                                                double Tolerance,double MinMsec)
+{
+    double Percent = (Base > 0.0) ? (New - Base) * 100.0 / Base : 0.0;
+    bool Slower = (Percent > Tolerance && New - Base > MinMsec);
+    bool Faster = (Percent < -Tolerance && Base - New > MinMsec);
+    printf ("%-40s %-4s %10.4f msec, baseline %10.4f msec, %+7.1f%%%s\n",Key.c_str(),What,
+                          New,Base,Percent,Slower ? "  REGRESSION" : (Faster ? "  faster" : ""));
+    return Slower ? 1 : 0;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              R e a d  R e s u l t s
+//
+//  Reads the tests from a CSV file written by BenchReport. The columns are found by name from
+//  the heading line, so files written by older or newer versions can still be compared.
+//  Returns false, having said why, if the file can't be read.
+
+static bool ReadResults(const std::string& FileName,BenchResults* Results)
+{
+    FILE* File = fopen(FileName.c_str(),"r");
+    if (File == nullptr) {
+        printf ("Unable to read benchmark results from %s\n",FileName.c_str());
+        return false;
+    }
+    const char* Names[] = {"Program","Api","Device","Driver","Test","Nx","Ny",
+                                                                  "HostP50Msec","GpuP50Msec"};
+    const int NumberNames = sizeof(Names) / sizeof(Names[0]);
+    int Columns[NumberNames];
+    bool HaveHeading = false;
+    char Buffer[4096];
+    while (fgets(Buffer,sizeof(Buffer),File)) {
+        std::string Line = Buffer;
+        while (Line.size() > 0 && (Line.back() == '\n' || Line.back() == '\r')) Line.pop_back();
+        if (Line == "") continue;
+        std::vector<std::string> Fields = SplitCSV(Line);
+        if (!HaveHeading) {
+            for (int Index = 0; Index < NumberNames; Index++) {
+                Columns[Index] = -1;
+                for (size_t Field = 0; Field < Fields.size(); Field++) {
+                    if (Fields[Field] == Names[Index]) Columns[Index] = int(Field);
+                }
+                if (Columns[Index] < 0 && Index < NumberNames - 1) {
+                    printf ("%s has no '%s' column\n",FileName.c_str(),Names[Index]);
+                    fclose(File);
+                    return false;
+                }
+            }
+            HaveHeading = true;
+            continue;
+        }
+        std::string Value[NumberNames];
+        for (int Index = 0; Index < NumberNames; Index++) {
+            int Column = Columns[Index];
+            if (Column >= 0 && Column < int(Fields.size())) Value[Index] = Fields[Column];
+        }
+        std::string Key = Value[0] + " " + Value[1] + " " + Value[4] + " " + Value[5] + "x" +
+                                                                                       Value[6];
+        BenchRow Row;
+        Row.Device = Value[2];
+        Row.Driver = Value[3];
+        Row.HostP50 = atof(Value[7].c_str());
+        Row.GpuP50 = (Value[8] != "") ? atof(Value[8].c_str()) : -1.0;
+        if (Results->Rows.count(Key) == 0) Results->Keys.push_back(Key);
+        Results->Rows[Key] = Row;
+    }
+    fclose(File);
+    if (Results->Keys.empty()) {
+        printf ("No benchmark results found in %s\n",FileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                S p l i t  C S V
+//
+//  Splits a line of a CSV file into its fields, allowing for fields in quotes, which is how
+//  BenchReport writes any that contain commas or quotes.
+
+static std::vector<std::string> SplitCSV(const std::string& Line)
+{
+    std::vector<std::string> Fields;
+    std::string Field;
+    bool InQuotes = false;
+    for (size_t Index = 0; Index < Line.size(); Index++) {
+        char Char = Line[Index];
+        if (InQuotes) {
+            if (Char == '"') {
+                if (Index + 1 < Line.size() && Line[Index + 1] == '"') {
+                    Field += '"';
+                    Index++;
+                } else {
+                    InQuotes = false;
+                }
+            } else {
+                Field += Char;
+            }
+        } else if (Char == '"') {
+            InQuotes = true;
+        } else if (Char == ',') {
+            Fields.push_back(Field);
+            Field = "";
+        } else {
+            Field += Char;
+        }
+    }
+    Fields.push_back(Field);
+    return Fields;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              C o p y  R e s u l t s
+//
+//  Copies the results file to the baseline file, replacing whatever was there.
+
+static bool CopyResults(const std::string& From,const std::string& To)
+{
+    FILE* Input = fopen(From.c_str(),"rb");
+    if (Input == nullptr) {
+        printf ("Unable to read benchmark results from %s\n",From.c_str());
+        return false;
+    }
+    FILE* Output = fopen(To.c_str(),"wb");
+    if (Output == nullptr) {
+        printf ("Unable to write baseline to %s\n",To.c_str());
+        fclose(Input);
+        return false;
+    }
+    char Buffer[4096];
+    size_t Bytes;
+    bool Ok = true;
+    while ((Bytes = fread(Buffer,1,sizeof(Buffer),Input)) > 0) {
+        if (fwrite(Buffer,1,Bytes,Output) != Bytes) Ok = false;
+    }
+    fclose(Input);
+    if (fclose(Output) != 0) Ok = false;
+    if (!Ok) printf ("Error writing baseline to %s\n",To.c_str());
+    return Ok;
+}
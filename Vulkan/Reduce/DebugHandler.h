@@ -0,0 +1,716 @@
+//
+//                                 D e b u g  H a n d l e r . h
+//
+//   Introduction:
+//
+//      This implements a simple but relatively flexible way of controlling debug output from a
+//      C++ program. This imagines that a program consists of a number of sub-systems, each given a
+//      name, and each sub-system supports varying levels of debug output, each of which is also
+//      given a name. The idea is that at any given time you may be interested in getting debug
+//      output from one or more particular sections of the program, but not from all. And sometimes
+//      you may not want debug output at all. The Debug handler code lets you associate a separate
+//      DebugHandler object with each subsystem of your code, and provides ways to enable or
+//      disable the various debug levels.
+//
+//   Overview:
+//
+//      Supply the sub-system name as a constructor argument, or using SetSubSystem().
+//      Set the various level names that will be recognised using SetLevelNames().
+//      Enable a set of levels using EnableLevels() or disable them using DisableLevels().
+//      Log debug messages for a named level using Log() or Logf(). These are only logged
+//      if the named level is active.
+//
+//   In much more detail:
+//
+//      The Debug Handler for a sub-system can be just a declared variable, or it can be created
+//      using 'new' when the sub-system is initialised, eg:
+//
+//          DebugHandler TheDebugHandler("Test");
+//      or
+//          DebugHandler* DebugHandlerPtr = new DebugHandler("Test");
+//
+//      where both examples create a new DebugHandler and sets the sub-system name to 'Test'.
+//
+//      A DebugHandler needs to be told the set of level names to be used. These should be passed
+//      to it using a call to SetLevelNames(), with the names passed as a comma-separated list, eg:
+//
+//          TheDebugHandler.SetLevelNames("Graphics,Timing,Data,Diagnostics");
+//
+//      A call to the SetLevelNames() method supplies a comma-separated list of the level names
+//      used with this debug handler. (And a ListLevels() call will return that list.)
+//      SetLevelNames() should normally only be called once. It resets the Debug Handler completely,
+//      with all the named levels flagged as inactive.
+//
+//      A call to the EnableLevels() method passes a comma-separated set of strings, each of the
+//      form "SubSystem.level". So, for example,
+//
+//          TheDebugHandler.EnableLevels("Test.Graphics,Test.Data");
+//
+//      would enable the Graphics and Data levels, but leave the Timing and Diagnostics levels
+//      disabled.
+//
+//      As the program runs, calls can be made to the Log() method, supplying a string giving
+//      a named level and a text string. If the level matches any of the active levels, the
+//      DebugHandler outputs the text string to standard output. For example:
+//
+//          TheDebugHandler.Log("Setup","This is a debug message connected with setup.");
+//
+//      This message will be output if the 'Setup' level has been enabled. If you need a more
+//      detailed message, the Logf() call provides printf() type formatting, eg:
+//
+//          TheDebugHandler.Log("Setup","Stage %d of setup took %.2f msec.",Stage,Msec);
+//
+//      The most complex part of all this is to do with the strings that can be passed to
+//      EnableLevels() Both the sub-system and level part of the string can include wildcards
+//      ('*' for any number of characters, or none, and '?' for a single character). If the
+//      subsystem matches that supplied in the DebugHandler's constructor, the DebugHandler adds
+//      any level that matches the level part of the string to its active list. If the subsystem
+//      part of the string - the bit before the '.' - is missing, all DebugHandlers will respond
+//      to the specification.
+//
+//      Moreover, a '!' prefixed to a 'subsystem.level' specification reverses the effect.
+//      Specifications are parsed in sequence, so a later specification can override an
+//      earlier one. For example,
+//
+//          TheDebugHandler.EnableLevels("Test.D*,!Test.Data");
+//
+//      would first enable any level in Test that started with 'D', eg both Data and Diagnostics,
+//      but then would disable just Data. That example is pretty silly, but could be useful if
+//      a system had a number of levels that started with 'D' and you want to enable all of them
+//      except for Data.
+//
+//      Levels can be de-activated using a call to DisableLevels(), which is passed a string
+//      identical to that for EnableLevels() but which removes any matching levels supported by the
+//      DebugHandler from the active list.
+//
+//      Debug code could also use this to reduce excessive debug output. For example, after 20
+//      times round the same loop, a program could explicitly switch of a named set of levels.
+//      And it could re-enable them later.
+//
+//      A call to Active() returns true if a specified level is active, and can be used to
+//      bypass a complete block of debug code if that is more efficient than relying on the
+//      tests performed by each Log() call. It could even be used by code to enable other levels
+//      explicitly if a specific named level is active. This is quite a flexible scheme!
+//
+//  Use with multiple sub-systems:
+//
+//      The idea is that the same string used to enable debugging levels can be passed to every
+//      DebugHandler used in a program. (Usually, there would be some mechanism that allowed such a
+//      string to be passed to each sub-system, which would then call the EnableLevels() method of
+//      its own DebugHandler. So, for example, if a program had three sub-systems, a 'view', a
+//      'model' and a 'controller' (to pick a possible combination), you might have:
+//
+//          DebugHandler ViewDebugHandler("View");                  (in the View code setup)
+//          DebugHandler ControllerDebugHandler("Controller");      (in the Controller code setup)
+//          DebugHandler ModelDebugHandler("Model");                (in the Model code setup)
+//
+//      and maybe:
+//
+//          ViewDebugHandler.SetLevelNames("Setup,Timing,Windows");
+//          ControllerDebugHandler.SetLevelNames("Setup,Events");
+//          ModelDebugHandler.SetLevelNames("Setup,Timing,Data,Diagnostics");
+//
+//      then passing the string "*.Setup" or just "Setup", to the EnableLevels() call of each
+//      of the three handlers would enable Setup level debugging in all three systems.
+//      Passing the string "View.Setup,Model.Timing" would enable Setup level debugging in
+//      the View subsystem, and also Timing level debugging in the Model subsystem.
+//
+//      This works particularly well with command line programs (and this code was always intended
+//      to be used in this way). A single string parameter set on the command line can be used
+//      to set debug levels for all the separate parts of a program.
+//
+//      CheckLevels() takes a list of levels such as those passed to Enable/DisableLevels() to
+//      check whether these will be recognised or not. It returns a list with all those that
+//      are not recognised. In principle, this allows CheckLevels() to be called for a series
+//      of different DebugHandlers, each being passed the string rejected by the previous handler.
+//      If you end up with a non-blank string, there may be a problem. In practice, this may be
+//      tricky to use for reasons of program structure.
+//
+//  Debug calls in time-critical code:
+//
+//      Active(), Log() and Logf() all look up the named level each time they are called, which
+//      involves a case-blind comparison with each level name in turn. That's fine for most debug
+//      code, but not in the middle of a loop being timed. For those cases, a level can be looked
+//      up once, using Level(), which returns a bit mask - a DebugHandler::LevelBits value - for
+//      it. That can be passed to Active(), Log() or Logf() instead of the level name, and the
+//      test is then just a check against a bit mask of the active levels that is updated
+//      whenever levels are enabled or disabled. The DEBUG_ACTIVE() and DEBUG_LOGF() macros
+//      wrap these, so the arguments to a disabled Logf() call are not even evaluated, eg:
+//
+//          DebugHandler::LevelBits TimingBits = TheDebugHandler.Level("Timing");
+//          ...
+//          DEBUG_LOGF(TheDebugHandler,TimingBits,"Pass took %.3f msec",Timer.ElapsedMsec());
+//
+//      If NO_DEBUG_HANDLER is defined when this is compiled, Active() always returns false, and
+//      the compiler can remove all such debug code completely.
+//
+//  Logging from several threads:
+//
+//      Normally, Log() and Logf() print each message as they are called, from whichever thread
+//      calls them. printf() holds a lock on stdout while it prints, so threads that log at the
+//      same time wait for each other, and that waiting gets into any timings being logged. Once
+//      the global DebugLogSink has been started, messages are instead queued by the thread that
+//      logs them, with the time, and written out - to stdout, or to a file - by a background
+//      thread, all of which is described with DebugLogSink below. For example:
+//
+//          DebugLogSink::Global().Start("Debug.log");
+//          ...
+//          DebugLogSink::Global().Stop();
+//
+//  Author(s): Keith Shortridge, K&V  (Keith@KnaveAndVarlet.com.au)
+//
+//  History:
+//     16th Jan 2021.  Original version. KS.
+//      9th Jun 2024.  Added SetSubSystem() and GetSubSystem(). KS.
+//     21st Jun 2024.  Log() and Logf() now allow for a blank subsystem. KS.
+//      1st Jul 2024.  Reformatted to 4-space indents, introductory commenting extended, some
+//                     routines re-named for clarity. Added use of '!' in level specifications. KS.
+//     14th Aug 2024.  Added CheckLevels(). Removed the programming note saying such a routine
+//                     would be a good idea. KS.
+//     15th Oct 2026.  Added Level() and the LevelBits versions of Active(), Log() and Logf(),
+//                     the DEBUG_ACTIVE() and DEBUG_LOGF() macros, and NO_DEBUG_HANDLER. KS.
+//                     Added DebugLogSink, to have messages written out by a background thread.
+//                     Logf() now calls va_end() for its name version too. KS.
+//
+//  Note:
+//
+//     This code needs to be compiled using at least -std=c++11, because it uses C++11 style
+//     iteration through containers.
+//
+//     SetLevelNames() was originally called LevelsList(), which was a silly name. LevelsList()
+//     is still supported - it now just calls SetLevelNames() - but should no longer be used.
+//     Similarly, EnableLevels() and DisableLevels() were originally called SetLevels() and
+//     UnsetLevels(), which was less silly but still was easy to confuse with SetLevelNames().
+//     Again, the old names are still supported, but their use is discouraged.
+
+#ifndef __DebugHandler__
+#define __DebugHandler__
+
+#include "Wildcard.h"
+#include "TcsUtil.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+//  DEBUG_ACTIVE() tests a level looked up using Level(), and DEBUG_LOGF() only evaluates its
+//  arguments if that level is active. With NO_DEBUG_HANDLER defined, both compile to nothing.
+
+#ifdef NO_DEBUG_HANDLER
+#define DEBUG_ACTIVE(Handler,Bits) (false)
+#else
+#define DEBUG_ACTIVE(Handler,Bits) ((Handler).Active(Bits))
+#endif
+
+#define DEBUG_LOGF(Handler,Bits,...) \
+    do { if (DEBUG_ACTIVE(Handler,Bits)) (Handler).Logf(Bits,__VA_ARGS__); } while (0)
+
+// -------------------------------------------------------------------------------------------------
+//
+//                               D e b u g  L o g  S i n k
+//
+//  There is just the one, global, DebugLogSink, returned by DebugLogSink::Global(). Until its
+//  Start() is called, it does nothing, and DebugHandlers print their messages directly. Once it
+//  is running, Post() copies each message into a ring buffer belonging to the calling thread,
+//  with the time in msec since the sink was created, and a background thread takes them from
+//  there and writes them out, each prefixed by that time and the number of the thread that
+//  logged it. Each ring has only the one thread adding to it and the background thread taking
+//  from it, so it needs no lock, just an atomic count at each end. The only lock is taken the
+//  first time a thread logs anything, to add a ring for it. If a thread logs messages faster
+//  than they can be written, and its ring fills up, the message is dropped rather than have the
+//  thread wait, and Stop() reports how many were dropped.
+//
+//  The background thread looks at the rings every few msec, and writes what it finds in time
+//  order, merging the rings, so messages from different threads are written in the order they
+//  were logged, unless one arrives in a later look than one logged after it. Stop() has it
+//  write out everything still queued, and then closes any file. The destructor calls Stop(),
+//  so nothing is lost if the program exits normally without calling it.
+
+class DebugLogSink {
+public:
+    
+    //  Returns the one global sink.
+    
+    static DebugLogSink& Global (void) {
+        static DebugLogSink TheSink;
+        return TheSink;
+    }
+    
+    //  The destructor writes out anything still queued.
+    
+    ~DebugLogSink () {
+        Stop();
+    }
+    
+    //  Start() starts the background thread, writing to the named file, or to stdout if the
+    //  name is blank or "stdout". Returns false if the file can't be created.
+    
+    bool Start (const std::string& FileName = "") {
+        std::lock_guard<std::mutex> Lock(I_Mutex);
+        if (I_Running) return true;
+        I_File = stdout;
+        if (FileName != "" && FileName != "stdout") {
+            I_File = fopen(FileName.c_str(),"w");
+            if (I_File == nullptr) {
+                I_File = stdout;
+                return false;
+            }
+        }
+        I_Dropped = 0;
+        I_Running = true;
+        I_Writer = std::thread([this]{ Drain(); });
+        return true;
+    }
+    
+    //  Running() returns true between Start() and Stop().
+    
+    bool Running (void) const {
+        return I_Running.load(std::memory_order_acquire);
+    }
+    
+    //  Post() queues one line of text, without its newline, logged by the calling thread.
+    //  Text longer than a ring record allows for is truncated.
+    
+    void Post (const char* Text) {
+        Ring* TheRing = ThreadRing();
+        uint64_t Head = TheRing->Head.load(std::memory_order_relaxed);
+        if (Head - TheRing->Tail.load(std::memory_order_acquire) >= C_RingRecords) {
+            I_Dropped++;
+            return;
+        }
+        Record& TheRecord = TheRing->Records[Head % C_RingRecords];
+        TheRecord.Msec = NowMsec();
+        strncpy(TheRecord.Text,Text,sizeof(TheRecord.Text) - 1);
+        TheRecord.Text[sizeof(TheRecord.Text) - 1] = '\0';
+        TheRing->Head.store(Head + 1,std::memory_order_release);
+    }
+    
+    //  Stop() stops the background thread, once it has written out everything queued, and
+    //  closes any file it was writing to. Messages logged after this are printed directly.
+    
+    void Stop (void) {
+        std::thread Writer;
+        {
+            std::lock_guard<std::mutex> Lock(I_Mutex);
+            if (!I_Running) return;
+            I_Running = false;
+            Writer = std::move(I_Writer);
+        }
+        Writer.join();
+        if (I_Dropped > 0) {
+            fprintf (I_File,"[DebugLogSink] %ld messages dropped, ring buffers full\n",
+                                                                          long(I_Dropped));
+        }
+        if (I_File != stdout) fclose(I_File);
+        else fflush(stdout);
+        I_File = stdout;
+    }
+    
+    //  NowMsec() returns the current time in msec, on the same scale as the times written.
+    
+    double NowMsec (void) const {
+        return std::chrono::duration<double,std::milli>(
+                                     std::chrono::steady_clock::now() - I_StartTime).count();
+    }
+    
+private:
+    
+    DebugLogSink () : I_StartTime(std::chrono::steady_clock::now()) {}
+    
+    //  The number of records in each thread's ring, and the interval between looks at them.
+    
+    static constexpr uint64_t C_RingRecords = 1024;
+    static constexpr int C_PollMsec = 5;
+    
+    //  One message, with its time. The record is 256 bytes in all.
+    
+    struct Record {
+        double Msec;
+        char Text[248];
+    };
+    
+    //  A thread's ring buffer. Head counts the records added, Tail those written out.
+    
+    struct Ring {
+        std::atomic<uint64_t> Head{0};
+        std::atomic<uint64_t> Tail{0};
+        int Thread = 0;
+        Record Records[C_RingRecords];
+    };
+    
+    //  ThreadRing() returns the calling thread's ring, adding one the first time it is called.
+    //  The rings belong to the sink, so a thread that finishes leaves its messages behind.
+    
+    Ring* ThreadRing (void) {
+        static thread_local Ring* TheRing = nullptr;
+        if (TheRing == nullptr) {
+            std::lock_guard<std::mutex> Lock(I_Mutex);
+            I_Rings.emplace_back(new Ring);
+            TheRing = I_Rings.back().get();
+            TheRing->Thread = int(I_Rings.size());
+        }
+        return TheRing;
+    }
+    
+    //  Drain() is the background thread. Each time round, it writes out everything queued,
+    //  always taking the earliest of the records at the front of the rings next. Once Stop()
+    //  has been called, it goes round once more, to catch anything logged just before.
+    
+    void Drain (void) {
+        bool Last = false;
+        while (!Last) {
+            Last = !Running();
+            std::vector<Ring*> Rings;
+            {
+                std::lock_guard<std::mutex> Lock(I_Mutex);
+                for (std::unique_ptr<Ring>& TheRing : I_Rings) Rings.push_back(TheRing.get());
+            }
+            for (;;) {
+                Ring* Earliest = nullptr;
+                double EarliestMsec = 0.0;
+                for (Ring* TheRing : Rings) {
+                    uint64_t Tail = TheRing->Tail.load(std::memory_order_relaxed);
+                    if (Tail != TheRing->Head.load(std::memory_order_acquire)) {
+                        double Msec = TheRing->Records[Tail % C_RingRecords].Msec;
+                        if (Earliest == nullptr || Msec < EarliestMsec) {
+                            Earliest = TheRing;
+                            EarliestMsec = Msec;
+                        }
+                    }
+                }
+                if (Earliest == nullptr) break;
+                uint64_t Tail = Earliest->Tail.load(std::memory_order_relaxed);
+                const Record& TheRecord = Earliest->Records[Tail % C_RingRecords];
+                fprintf (I_File,"%10.3f T%-2d %s\n",TheRecord.Msec,Earliest->Thread,
+                                                                             TheRecord.Text);
+                Earliest->Tail.store(Tail + 1,std::memory_order_release);
+            }
+            fflush(I_File);
+            if (!Last) std::this_thread::sleep_for(std::chrono::milliseconds(C_PollMsec));
+        }
+    }
+    
+    //  Set while the background thread is running.
+    std::atomic<bool> I_Running{false};
+    //  The number of messages dropped because a ring was full.
+    std::atomic<long> I_Dropped{0};
+    //  Taken to start and stop the background thread, and to add a ring.
+    std::mutex I_Mutex;
+    //  The background thread.
+    std::thread I_Writer;
+    //  Where the messages are written.
+    FILE* I_File = stdout;
+    //  The rings, one for each thread that has logged anything.
+    std::vector<std::unique_ptr<Ring>> I_Rings;
+    //  The time the sink was created, which the message times are relative to.
+    std::chrono::steady_clock::time_point I_StartTime;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+class DebugHandler {
+public:
+    
+    //  A bit mask for one or more levels, as returned by Level().
+    
+    typedef uint64_t LevelBits;
+    
+    //  Constructor, takes optional sub-system name.
+    
+    DebugHandler (const std::string& SubSystem = "") {
+        SetSubSystem(SubSystem);
+    }
+    
+    //  Destructor has nothing to do - no resources to release.
+    
+    ~DebugHandler () {}
+    
+    //  SetSubSystem() sets the subsystem name - usually used because the constructor didn't.
+    
+    void SetSubSystem (const std::string& SubSystem) {
+        I_SubSystem = SubSystem;
+    }
+    
+    //  GetSubSystem() returns the subssytem name.
+    
+    std::string GetSubSystem (void) {
+        return I_SubSystem;
+    }
+    
+    //  SetLevelNames() takes a comma-separated list of all the levels used by this subsystem.
+    
+    void SetLevelNames (const std::string& List) {
+        TcsUtil::Tokenize(List,I_Levels,",");
+        I_Flags.resize(I_Levels.size());
+        for (int& Flag : I_Flags) { Flag = false; }
+        I_ActiveBits = 0;
+    }
+    
+    //  Level() returns the bit mask for the named level, for use with the LevelBits versions of
+    //  Active(), Log() and Logf(). Only the first 64 levels have bits, and Level() returns 0 -
+    //  which is never active - for any later level, or for a level that isn't recognised.
+    
+    LevelBits Level (const std::string& Name) const {
+        int NLevels = I_Levels.size();
+        for (int I = 0; I < NLevels && I < 64; I++) {
+            if (TcsUtil::MatchCaseBlind(I_Levels[I].c_str(),Name.c_str())) {
+                return LevelBits(1) << I;
+            }
+        }
+        return 0;
+    }
+    
+    //  ListLevels() returns the level names used by this subsystem as a comma-separated string.
+    
+    std::string ListLevels (void) {
+        bool First = true;
+        std::string Levels = "";
+        for (std::string& Level : I_Levels) {
+            if (!First) Levels = Levels + ",";
+            First = false;
+            Levels = Levels + Level;
+        }
+        return Levels;
+    }
+    
+    //  EnableLevels() enables any levels that match the list it is passed.
+    
+    void EnableLevels (const std::string& Levels) {
+        (void) SetUnsetLevels (Levels,true);
+    }
+
+    //  DisableLevels() disables any levels that match the list it is passed.
+
+    void DisableLevels (const std::string& Levels) {
+        (void) SetUnsetLevels (Levels,false);
+    }
+    
+    //  CheckLevels() checks a list of levels and returns a comma-separated
+    //  list of those that it does not recognise.
+    
+    std::string CheckLevels (const std::string& Levels) {
+        return SetUnsetLevels (Levels,true,true);
+    }
+
+    //  Active() returns true if the named level is currently active.
+    
+    bool Active (const std::string& Level) {
+#ifdef NO_DEBUG_HANDLER
+        return false;
+#endif
+        bool Match = false;
+        int NLevels = I_Levels.size();
+        for (int I = 0; I < NLevels; I++) {
+            if (TcsUtil::MatchCaseBlind(I_Levels[I].c_str(),Level.c_str())) {
+                Match = I_Flags[I];
+                break;
+            }
+        }
+        return Match;
+    }
+    
+    //  This version of Active() takes a level returned by Level(), and just tests its bit.
+    
+    bool Active (LevelBits Bits) const {
+#ifdef NO_DEBUG_HANDLER
+        (void) Bits;
+        return false;
+#else
+        return (I_ActiveBits & Bits) != 0;
+#endif
+    }
+    
+    //  Log() outputs the text string supplied if the specified level is active.
+    
+    void Log (const std::string& Level,const std::string Text) {
+        if (Active(Level)) Output(Level,Text.c_str());
+    }
+
+    //  Logf() is like Log() but provides printf() style formatting.
+
+    void Logf (const std::string& Level,const char * const Format, ...) {
+        if (Active(Level)) {
+            char Message[1024];
+            va_list Args;
+            va_start (Args,Format);
+            vsnprintf (Message,sizeof(Message),Format,Args);
+            va_end (Args);
+            Output(Level,Message);
+        }
+    }
+
+    //  These versions of Log() and Logf() take a level returned by Level(). The level name is
+    //  only looked up if the message is actually going to be output.
+
+    void Log (LevelBits Bits,const std::string Text) {
+        if (Active(Bits)) Log(LevelName(Bits),Text);
+    }
+
+    void Logf (LevelBits Bits,const char * const Format, ...) {
+        if (Active(Bits)) {
+            char Message[1024];
+            va_list Args;
+            va_start (Args,Format);
+            vsnprintf (Message,sizeof(Message),Format,Args);
+            va_end (Args);
+            Log(LevelName(Bits),Message);
+        }
+    }
+
+    //  Deprecated routine names.
+    
+    void LevelsList (const std::string& List) {
+        SetLevelNames(List);
+    }
+    void SetLevels (const std::string& Levels) {
+        EnableLevels (Levels);
+    }
+    void UnsetLevels (const std::string& Levels) {
+        DisableLevels (Levels);
+    }
+
+
+private:
+    
+    //  SetUnsetLevels() does all the work for both EnableLevels() and
+    //  DisableLevels(), the only difference being whether the matching levels
+    //  are activated or deactivated.
+    //
+    //  Levels a list of level specifiers, comma-separated, with each specifier
+    //         a string that can include wildcard characters. This routine
+    //         finds all matching levels and activates/deactivates them.
+    //  Set    true if the matching levels are to be made active, false if
+    //         they are to be deactivated.
+    //  Check  if true, levels are not modified. The intent is that this mode
+    //         can be used simply to verify a levels specification.
+    //
+    //  Returns: A comma-separated string giving the unrecognised levels.
+    
+    std::string SetUnsetLevels (const std::string& Levels, bool Set, bool Check = false) {
+        
+        std::string Unrecognised = "";
+        
+        //  Split the Levels string into comma-separated tokens.
+        
+        std::vector<std::string> Tokens;
+        TcsUtil::Tokenize(Levels,Tokens,",");
+        
+        //  Work through the tokens (each should be 'subsystem,level') one by one.
+        
+        for (std::string Item : Tokens) {
+            
+            bool Known = false;
+            
+            //  Check for negation using '!' and reverse the effect of Set if present.
+            
+            bool Enable = Set;
+            if (Item.size() > 0 && Item[0] == '!') {
+                Item = Item.substr(1);
+                Enable = !Set;
+            }
+            
+            //  Split the token into subsystem and level. Defaulting to '*' means a missing
+            //  subsystem or level spec applies to all subsystems or levels.
+            
+            std::string SubSystem = "*";
+            std::string Level = "*";
+            size_t Dot = Item.find('.');
+            if (Dot == std::string::npos) {
+                Level = Item;
+            } else {
+                SubSystem = Item.substr(0,Dot);
+                if (Dot < Item.size()) {
+                    Level = Item.substr(Dot + 1);
+                }
+            }
+            
+            //  If the subsystem matches ours, check the level against all our levels.
+            //  Enable or disable any that match.
+            
+            if (WildcardMatchCaseBlind(SubSystem.c_str(),I_SubSystem.c_str())) {
+                int NLevels = I_Levels.size();
+                for (int I = 0; I < NLevels; I++) {
+                    if (WildcardMatchCaseBlind(Level.c_str(),I_Levels[I].c_str())) {
+                        I_Flags[I] = Enable;
+                        Known = true;
+                        if (I < 64) {
+                            if (Enable) I_ActiveBits |= LevelBits(1) << I;
+                            else I_ActiveBits &= ~(LevelBits(1) << I);
+                        }
+                    }
+                }
+            }
+            
+            if (!Known) {
+                if (Unrecognised == "") Unrecognised = Item;
+                else Unrecognised += "," + Item;
+            }
+        }
+        return Unrecognised;
+    }
+    
+    //  Output() outputs a message logged for a level, prefixed by the subsystem and level
+    //  names - printing it directly, or passing it to the DebugLogSink if that's running.
+    
+    void Output (const std::string& Level,const char* Text) {
+        char Line[1100];
+        if (I_SubSystem != "") {
+            snprintf (Line,sizeof(Line),"[%s.%s] %s",I_SubSystem.c_str(),Level.c_str(),Text);
+        } else {
+            snprintf (Line,sizeof(Line),"[%s] %s",Level.c_str(),Text);
+        }
+        DebugLogSink& Sink = DebugLogSink::Global();
+        if (Sink.Running()) Sink.Post(Line);
+        else printf ("%s\n",Line);
+    }
+    
+    //  LevelName() returns the name of the lowest level set in Bits.
+    
+    std::string LevelName (LevelBits Bits) const {
+        int NLevels = I_Levels.size();
+        for (int I = 0; I < NLevels && I < 64; I++) {
+            if (Bits & (LevelBits(1) << I)) return I_Levels[I];
+        }
+        return "";
+    }
+    
+    //  The name of the current sub-system.
+    std::string I_SubSystem;
+    //  All the individual level names.
+    std::vector<std::string> I_Levels;
+    //  Flags for each level, true when the level is active.
+    std::vector<int> I_Flags;
+    //  Bit mask of the active levels, bit I being set when I_Flags[I] is true.
+    LevelBits I_ActiveBits = 0;
+};
+
+#endif
+
+// -------------------------------------------------------------------------------------------------
+
+/*                        P r o g r a m m i n g  N o t e s
+
+ o  The DebugLogSink's rings are read by the background thread while the threads that own them
+    add to them, which is safe because each count is only ever changed by one side: a record
+    is filled in before Head is stored (with release ordering) and read after Head is loaded
+    (with acquire), and Tail works the same way in the other direction. A message logged by
+    another thread at the same moment Stop() is called may miss the last look at the rings,
+    and not be written at all.
+
+ o  I did play with using a map<string,bool> instead of the two vectors, one
+    for the strings and one for the flags, but found it too awkward in the end,
+    althogh it does feel like the obvious implementation. Maybe I'm just not
+    as au fait with maps as I should be. I tried having I_Flags as a
+    vector<bool> but this was made awkward by the speciailised implementation
+    of vector<bool> which potentially packs up individual bools into bit
+    patterns for efficiency. Storage efficiency isn't really important here.
+ */
@@ -0,0 +1,1388 @@
+//
+//                     R e d u c e . c p p     ( V u l k a n  V e r s i o n )
+//
+//  This program is intended as a piece of example code showing a reduction - a calculation
+//  that boils a whole 2D floating point array down to a few numbers - performed on a GPU,
+//  programmed in C++ using Vulkan. It allows the user to perform the same operation using the
+//  CPU and compare the timings, and allows some experimentation with the number of CPU threads
+//  to be used. The size of the array is set using command line parameters. Usually the
+//  operation needs to be repeated a number of times to get a reasonable execution time.
+//
+//  The reduction is the one needed for the basic statistics of an image - the sum, mean,
+//  standard deviation, minimum and maximum of its values. Where Adder is all memory traffic,
+//  with each element read and written once, and Median and Mandel are dominated by the
+//  calculation, a reduction reads each element once and writes almost nothing. The catch is
+//  that every element contributes to the same few results, so the work has to be shared out
+//  and the partial results combined, and how well that's done decides how close it comes to
+//  the memory bandwidth. The GPU version (Reduce.comp) combines them in a hierarchy: each
+//  invocation accumulates a number of values on its own, each workgroup combines its
+//  invocations' totals - through shared memory, or using subgroup arithmetic where the device
+//  supports it - and further passes of the same shader combine the workgroups' partial
+//  results until only one set is left. The CPU version has each thread work through a band of
+//  rows, keeping several running totals that can be held in one vector register, and then
+//  combines the threads' results.
+//
+//  Invocation:
+//     Reduce <Nx> <Ny> <Nrpt> <Threads> <cpu> <gpu> <validate> <debug>
+//
+//  Where:
+//
+//     Nx      is the X dimension of the array in question.
+//     Ny      is the Y dimension of the array in question.
+//     Nrpt    is the number of times the operation is to be repeated.
+//     Threads if the CPU is used, the number of CPU threads to be used.
+//
+//     Nx,Ny,Nrpt,Threads are positional parameters, and can be specified either by just
+//     providing values for them on the command line in the order above, or explicitly
+//     by name and value, with an optional '=' sign. If Threads is zero, the maximum number
+//     of CPU threads available will be used.
+//
+//     Cpu     specifies that the operation is to be carried out using the CPU.
+//     Gpu     specifies that the operation is to be carried out using the GPU.
+//
+//     Cpu and Gpu are boolean values that can be specified explicitly, eg Cpu = true,
+//     or just by appearing in the command line, optionally negated, for example as 'cpu'
+//     or 'nogpu'. They are not mutually exclusive. By default both are false, but if neither
+//     are specified the program will use the GPU.
+//
+//     Validate specifies that Vulkan validation is to be enabled.
+//
+//     Validation is enabled by default. If enabled, Vulkan overheads are increased -
+//     particularly for device initialisation, but the diagnostics provided can be very useful
+//     when debugging the Vulkan part of the code.
+//
+//     Debug    is a string that can be used to control debug output.
+//
+//     Debug must be specified explicitly by name, eg Debug = "timing". The '=' is optional.
+//     There are a number of different options for Debug. If you are prompted for the value
+//     of Debug and reply with '?' a list of the options will be provided. 'Startup' lists how
+//     long each stage of the program's start-up took - creating the Vulkan instance and device,
+//     reading the shader, creating buffers, descriptors and pipeline - once the GPU is ready
+//     to run.
+//
+//     Subgroups has the GPU use the version of the shader that combines the values within
+//     each subgroup using subgroup arithmetic (ReduceSG.spv), if the device supports that.
+//     It is true by default. 'nosubgroups' uses the version that does it all through shared
+//     memory, for comparison.
+//
+//     Roofline has the program measure the peak memory bandwidth of the GPU and of the CPU,
+//              using simple copy tests, and report the bandwidth achieved by each as a
+//              percentage of that peak as well. A reduction does little but read memory, so
+//              this shows how close each comes to what the hardware can really do.
+//
+//     Simd     selects the vector instructions used by the CPU code - one of "Auto" (the
+//              default), "Scalar", "AVX2", "AVX512" or "NEON". "Auto" uses the best that the
+//              CPU supports. Asking for one the CPU doesn't support gets a warning, and "Auto".
+//
+//     Warmup   is the number of passes at the start left out of the timing statistics.
+//     Sizes    is a list of sizes to run the tests for in turn, instead of Nx by Ny, eg
+//              "512,1024x512".
+//     Report   is the name of a file (.csv or .json) to which the timings are appended.
+//
+//     Trace    is the name of a file to which a timeline of the run is written, in the Chrome
+//              trace format, so it can be viewed using chrome://tracing or Perfetto. Default
+//              "", for no trace.
+//
+//     Pin      controls the CPUs the CPU threads run on, which can make CPU timings more
+//              repeatable. It can be "None", the default, which leaves it to the system,
+//              "PCores", "Physical" or "Numa", as for Adder.
+//
+//     Priority raises the priority of the CPU threads. On Linux this needs permission to
+//              use real-time scheduling.
+//
+//     The command line is processed by the flexible but possibly quirky command line handler
+//     used for all these GPU examples. With luck you'll get used to it. It also supports the
+//     command line flags 'list' (lists all the parameter values that are going to be used),
+//     'prompt' (explicitly prompts for all unspecified parameters), 'reset' (resets all
+//     parameter values to their default - this is useful, because it remembers the values
+//     used the last time the program was run) and 'help' which outputs a summary and brief
+//     description of the various parameters.
+//
+//  Example:
+//     ./Reduce 4096 4096 100 cpu gpu
+//
+//  Note:
+//      The effect is like that of the following C code, if Nx and Ny give the image dimensions:
+//
+//      double Sum = 0.0, SumSq = 0.0;
+//      float Min = In[0][0], Max = In[0][0];
+//      for (int Iy = 0; Iy < Ny; Iy++) {
+//          for (int Ix = 0; Ix < Nx; Ix++) {
+//              Sum += In[Iy][Ix];
+//              SumSq += In[Iy][Ix] * In[Iy][Ix];
+//              if (In[Iy][Ix] < Min) Min = In[Iy][Ix];
+//              if (In[Iy][Ix] > Max) Max = In[Iy][Ix];
+//          }
+//      }
+//      double Mean = Sum / (Nx * Ny);
+//      double StdDev = sqrt((SumSq - Sum * Mean) / (Nx * Ny - 1));
+//
+//      (Except that the sums are actually of each value less the first, for the reasons
+//      given in Reduce.comp, and that both the GPU and the CPU sum in single precision.)
+//
+//  Acknowledgements:
+//      This is based on the Vulkan version of Adder, and follows its structure, so the two
+//      can be compared.
+//
+//  History:
+//      15th Oct 2026. First version, based on Adder. KS.
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                 I n c l u d e  F i l e s
+//
+//  Needed to allow multi-threading of the CPU code, and to combine the threads' results.
+
+#include <thread>
+#include <mutex>
+
+//  Needed for sqrt() and INFINITY.
+
+#include <math.h>
+
+//  Some utility code, just as used by Adder. A Command Handler provides a flexible way of
+//  handling command line parameters. An MsecTimer provides a very simple way of timing blocks
+//  of code, and an MsecStats collects the times for each pass. A Debug Handler provides control
+//  over debug output. A BenchReport collects the timings to be written out for 'Report', and
+//  the TraceRecorder records the timeline written out for 'Trace'. A ThreadPlacement pins the
+//  CPU threads for 'Pin', and the StartupProfile records the start-up stages listed for
+//  'Startup'.
+
+#include "CommandHandler.h"
+#include "MsecTimer.h"
+#include "BenchReport.h"
+#include "TraceRecorder.h"
+#include "ThreadPool.h"
+#include "ThreadPlacement.h"
+#include "StartupProfile.h"
+#include "DebugHandler.h"
+
+//  The input array shared by the CPU and GPU is allocated by the Vulkan Framework, so the GPU
+//  can use it without a copy.
+
+#include "KVVulkanFramework.h"
+
+//  This provides a global Debug Handler that all the routines here can use.
+
+DebugHandler TheDebugHandler;
+
+//  The bit for its 'Timing' level, set once the level names are known. The debug calls made on
+//  each pass of a timing loop test just this bit, rather than looking the level up by name.
+
+DebugHandler::LevelBits TimingDebug = 0;
+
+//  ------------------------------------------------------------------------------------------------
+//
+//               F o r w a r d  D e f i n i t i o n s  &  S t r u c t u r e s
+
+//  The results of a reduction, from either the GPU or the CPU. The sums are of each value less
+//  Shift, which the mean and standard deviation allow for.
+
+struct ReduceStats {
+    long long Count = 0;                //  The number of values.
+    float Shift = 0.0;                  //  Subtracted from each value before it is summed.
+    double Sum = 0.0;                   //  The sum of the values, less Shift.
+    double SumSq = 0.0;                 //  The sum of the squares of the values, less Shift.
+    float Min = INFINITY;               //  The smallest value.
+    float Max = -INFINITY;              //  The largest value.
+    double Total(void) const { return Sum + double(Count) * double(Shift); }
+    double Mean(void) const { return (Count > 0) ? Total() / double(Count) : 0.0; }
+    double StdDev(void) const {
+        if (Count < 2) return 0.0;
+        double Variance = (SumSq - Sum * Sum / double(Count)) / double(Count - 1);
+        return (Variance > 0.0) ? sqrt(Variance) : 0.0;
+    }
+};
+
+//  Perform the basic operation using the GPU
+void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,bool Subgroups,bool Roofline,
+                             const std::string& DebugLevels,int Warmup,BenchReport& Bench,
+                                                                float* SharedInput = nullptr);
+//  Report the memory bandwidth achieved, and optionally as a percentage of the peak
+void ReportBandwidth(const char* Device,const char* What,int Nx,int Ny,int Nrpt,float Msec,
+                                                                            double PeakGBytes);
+//  Measure the peak memory bandwidth of the CPU using a simple copy
+double MeasureCPUBandwidth(int Threads);
+//  Perform the basic operation using the CPU
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt,const std::string& Simd,
+           bool Roofline,int Warmup,BenchReport& Bench,float* SharedInput = nullptr);
+//  Set initial values for the input array.
+void SetInputArray(float** InputArray,int Nx,int Ny);
+//  Combine the results of reducing two parts of the array
+void CombineStats(ReduceStats* Into,const ReduceStats& From);
+//  Check the results of the operation
+bool CheckResults(float** InputArray,int Nx,int Ny,const ReduceStats& Stats,const char* Device);
+//  Utility to set up an array of row addresses to allow use of Array[Iy][Ix] syntax for access.
+float** CreateRowAddrs(float* Array,int Nx,int Ny);
+//  Mark the end of start-up, and list its stages if 'Startup' debugging is enabled
+void EndOfStartup(void);
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                             D e b u g  A r g  H e l p e r
+//
+//  This provides a way for the program to give some additional help to the command line handler
+//  for the 'Debug' parameter, just as in Adder.
+
+class DebugArgHelper : public CmdArgHelper {
+public:
+    bool CheckValidity(const std::string& Value,std::string* Reason);
+    std::string HelpText(void);
+};
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    M a i n
+//
+//  Most of the code in the main routine is taken up with getting the values for the various
+//  command line parameters. It then invokes either the CPU or the GPU (or both) to perform the
+//  reduction as specified by those parameters.
+
+int main (int Argc, char* Argv[]) {
+
+    //  Start-up stages are timed from here.
+
+    StartupProfile::Global().Start();
+
+    //  Set up the various levels for the Debug handler
+
+    TheDebugHandler.LevelsList("Timing,Setup,Startup");
+    TimingDebug = TheDebugHandler.Level("Timing");
+
+    //  Set up the Handler and the argument instances for the various command line arguments.
+
+    CmdHandler TheHandler("Reduce");
+    IntArg NxArg(TheHandler,"Nx",1,"",1024,2,1024*1024,"X-dimension of the array");
+    IntArg NyArg(TheHandler,"Ny",2,"",1024,2,1024*1024,"Y-dimension of the array");
+    IntArg NrptArg(TheHandler,"Nrpt",3,"",1,0,1000000,"Repeat count for operation");
+    int DefaultThreads = 1;
+    int MaxThreads = std::thread::hardware_concurrency();
+    if (MaxThreads < 0) { MaxThreads = 0; DefaultThreads = 0; }
+    IntArg ThreadsArg(TheHandler,"Threads",4,"",DefaultThreads,0,MaxThreads,"CPU threads to use");
+    BoolArg CpuArg(TheHandler,"Cpu",0,"",false,"Perform computation using CPU");
+    BoolArg GpuArg(TheHandler,"Gpu",0,"",false,"Perform computation using GPU");
+    BoolArg ValidateArg(TheHandler,"Validate",0,"",true,"Enable Vulkan validation layers");
+    BoolArg SubgroupsArg(TheHandler,"Subgroups",0,"",true,"Use subgroup arithmetic on the GPU");
+    BoolArg RooflineArg(TheHandler,"Roofline",0,"",false,"Report bandwidth as % of measured peak");
+    StringArg SimdArg(TheHandler,"Simd",0,"","Auto","CPU vector code (Auto,Scalar,AVX2,...)");
+    IntArg WarmupArg(TheHandler,"Warmup",0,"",0,0,1000000,"Passes left out of the timings");
+    StringArg SizesArg(TheHandler,"Sizes",0,"","","Sizes to run in turn, eg 512,1024x512");
+    StringArg ReportArg(TheHandler,"Report",0,"","","File for timings (.csv or .json)");
+    StringArg TraceArg(TheHandler,"Trace",0,"","","File for a timeline trace (.json)");
+    StringArg PinArg(TheHandler,"Pin",0,"","","Pin CPU threads (None,PCores,Physical,Numa)");
+    BoolArg PriorityArg(TheHandler,"Priority",0,"",false,"Raise the CPU threads' priority");
+    StringArg DebugArg(TheHandler,"Debug",0,"NoSave","","Debug levels");
+    DebugArgHelper DebugHelper;
+    DebugArg.SetHelper(&DebugHelper);
+
+    //  Now get the values for each of the command line arguments. The ReadPrevious() and
+    //  SaveCurrent() calls allow the handler to remember the argument values used the last
+    //  time the program was run. If you don't care for that, comment them out.
+
+    std::string Error = "";
+    if (TheHandler.IsInteractive()) TheHandler.ReadPrevious();
+    bool Ok = TheHandler.ParseArgs(Argc,Argv);
+    int Nx = NxArg.GetValue(&Ok,&Error);
+    int Ny = NyArg.GetValue(&Ok,&Error);
+    int Nrpt = NrptArg.GetValue(&Ok,&Error);
+    int Threads = ThreadsArg.GetValue(&Ok,&Error);
+    bool UseCPU = CpuArg.GetValue(&Ok,&Error);
+    bool UseGPU = GpuArg.GetValue(&Ok,&Error);
+    bool Validate = ValidateArg.GetValue(&Ok,&Error);
+    bool Subgroups = SubgroupsArg.GetValue(&Ok,&Error);
+    bool Roofline = RooflineArg.GetValue(&Ok,&Error);
+    std::string Simd = SimdArg.GetValue(&Ok,&Error);
+    int Warmup = WarmupArg.GetValue(&Ok,&Error);
+    std::string Sizes = SizesArg.GetValue(&Ok,&Error);
+    std::string Report = ReportArg.GetValue(&Ok,&Error);
+    std::string Trace = TraceArg.GetValue(&Ok,&Error);
+    std::string Pin = PinArg.GetValue(&Ok,&Error);
+    bool Priority = PriorityArg.GetValue(&Ok,&Error);
+    std::string DebugLevels = DebugArg.GetValue(&Ok,&Error);
+
+    //  If 'Pin' was given, it has to be one of the placements ThreadPlacement knows about.
+
+    ThreadPlacement Placement;
+    bool PinOK = Placement.SetMode(Pin);
+
+    //  If 'Sizes' was given, the tests are run for each of the sizes listed instead of Nx,Ny.
+
+    std::vector<int> SizesX(1,Nx),SizesY(1,Ny);
+    bool SizesOK = (Sizes == "" || BenchReport::Sizes(Sizes,SizesX,SizesY));
+
+    //  Check the argument parsing went OK, and didn't end with an exit being requested.
+
+    if (!Ok) {
+        if (!TheHandler.ExitRequested()) {
+            printf ("Error parsing command line: %s\n",TheHandler.GetError().c_str());
+        }
+    } else if (!SizesOK) {
+        printf ("Error in 'Sizes': '%s' should be a list such as 512,1024x512\n",Sizes.c_str());
+    } else if (!PinOK) {
+        printf ("Error in 'Pin': '%s' should be None, PCores, Physical or Numa\n",Pin.c_str());
+    } else {
+        if (TheHandler.IsInteractive()) TheHandler.SaveCurrent();
+
+        //  Set the active levels for the Debug handler as specified on the command line.
+
+        TheDebugHandler.SetLevels(DebugLevels);
+
+        //  With 'Startup', record the start-up stages, the first being the command line.
+
+        if (TheDebugHandler.Active("Startup")) {
+            StartupProfile::Global().Enable(true);
+            StartupProfile::Global().Record("Command line",0.0,StartupProfile::Global().NowMsec());
+        }
+
+        //  If a trace is wanted, start recording the timeline.
+
+        if (Trace != "") {
+            TraceRecorder::Global().Enable(true);
+            TraceRecorder::Global().SetThreadName("Main");
+            TraceRecorder::Global().WriteOnExit(Trace);
+        }
+
+        //  'Pin' and 'Priority' set up the threads of the shared pool used by the CPU code,
+        //  which include this main thread.
+
+        if (Pin != "" || Priority) {
+            printf ("\nCPU topology: %s\n",Placement.Topology().c_str());
+            std::string PlacementError;
+            if (!Placement.Apply(ThreadPool::Shared(),Priority,&PlacementError)) {
+                printf ("Warning: %s.\n",PlacementError.c_str());
+            }
+            printf ("CPU threads: %s%s\n",Placement.Description().c_str(),
+                                                   Priority ? ", raised priority" : "");
+            if (Placement.Threads() > 0 && (Threads <= 0 || Threads > Placement.Threads())) {
+                Threads = Placement.Threads();
+            }
+        }
+
+        //  If neither CPU not GPU were specified on the command line, use GPU.
+
+        if (!UseGPU && !UseCPU) UseGPU = true;
+
+        if (Warmup >= Nrpt && Nrpt > 0) {
+            printf ("\n'Warmup' (%d) leaves none of the %d passes to be timed.\n",Warmup,Nrpt);
+        }
+
+        //  Perform the test using either CPU or GPU (or both), for each size in turn. Both
+        //  ComputeUsingGPU() and its CPU equivalent, ComputeUsingCPU() are expected to create
+        //  an array of the size specified, call SetInputArray() to initialise it, then perform
+        //  the reduction as specified, and then call CheckResults() to verify that they got
+        //  the right answer. They add their timings to Bench. If both are used, the input
+        //  array is set up just once, in memory the GPU can import, and both work from that.
+
+        BenchReport Bench;
+        for (size_t Size = 0; Size < SizesX.size(); Size++) {
+            Nx = SizesX[Size];
+            Ny = SizesY[Size];
+            printf ("\nPerforming 'Reduce' test, array of %d rows, %d columns. "
+                                                       "Repeat count %d.\n\n",Ny,Nx,Nrpt);
+            float* SharedInput = nullptr;
+            if (UseGPU && UseCPU) {
+                SharedInput = (float*)KVVulkanFramework::AllocateImportableMemory(
+                                                      size_t(Nx) * size_t(Ny) * sizeof(float));
+                if (SharedInput) {
+                    float** SharedArray = CreateRowAddrs(SharedInput,Nx,Ny);
+                    SetInputArray(SharedArray,Nx,Ny);
+                    free(SharedArray);
+                }
+            }
+            if (UseGPU) {
+                ComputeUsingGPU(Nx,Ny,Nrpt,Validate,Subgroups,Roofline,DebugLevels,Warmup,Bench,
+                                                                                 SharedInput);
+            }
+            if (UseCPU) {
+                ComputeUsingCPU(Threads,Nx,Ny,Nrpt,Simd,Roofline,Warmup,Bench,SharedInput);
+            }
+            if (SharedInput) KVVulkanFramework::FreeImportableMemory(SharedInput);
+        }
+
+        //  'Report' appends the timings collected to a file.
+
+        if (Report != "" && Bench.Rows() > 0) Bench.Write(Report);
+    }
+    return 0;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    G P U  c o d e
+//
+//  This routine performs the reduction using the GPU, and is coded using Vulkan.
+//
+//  This routine is passed the dimensions, Nx and Ny of the array to use. It creates an array
+//  of floats, Nx by Ny, and calls SetInputArray() to initialise it - unless it is passed one
+//  already set up, as SharedInput. It is also passed the repeat count for the operation (Nrpt),
+//  and reduces the array that many times, which should give the same result each time, and is
+//  simply in order to get a better idea of the timing.
+
+//                               I n c l u d e  F i l e s
+//
+//  Needed for std::max().
+
+#include <algorithm>
+
+//                                  C o n s t a n t s
+//
+//  These have to match the values used by the GPU shader code in Reduce.comp. (The workgroup
+//  size is passed to the shader as a specialization constant, but has to be a power of two.)
+
+static const uint32_t C_WorkGroupSize = 256;
+static const int C_InputBufferBinding = 0;
+static const int C_PartialsBufferBinding = 1;
+
+//  The number of values each invocation of the shader accumulates by itself, before the
+//  workgroup combines them. Larger values mean fewer partial results, but fewer workgroups to
+//  keep the GPU busy.
+
+static const uint32_t C_ValuesPerThread = 16;
+
+//  The most workgroups a pass is given. Vulkan only guarantees 65535 in each dimension, and
+//  for a larger array each invocation just accumulates more values.
+
+static const uint32_t C_MaxWorkGroups = 65535;
+
+//  The two versions of the shader, combining the values in each workgroup through shared
+//  memory, or using subgroup arithmetic.
+
+static const char* const C_SharedShader = "Reduce.spv";
+static const char* const C_SubgroupShader = "ReduceSG.spv";
+
+//  The details of one pass of the reduction, passed to the shader as push constants. The
+//  layout of this structure must match that defined in Reduce.comp.
+
+struct ReduceArgs {
+    uint32_t Count;
+    uint32_t InOffset;
+    uint32_t OutOffset;
+    uint32_t PerThread;
+    uint32_t FromPartials;
+    float Shift;
+};
+
+//  PlanPasses() works out the passes needed to reduce Count values, setting Passes to the
+//  arguments for each and Groups to its number of workgroups. The first pass reduces the array
+//  to one set of partials for each of its workgroups, and each pass after that reduces the
+//  partials left by the one before, until a pass needs only one workgroup. The passes write
+//  their partials one after another in the one buffer, and this returns the total number, the
+//  last being the final result.
+
+static uint32_t PlanPasses(uint32_t Count,uint32_t LocalSize,float Shift,
+                               std::vector<ReduceArgs>* Passes,std::vector<uint32_t>* Groups)
+{
+    uint32_t InOffset = 0;
+    uint32_t OutOffset = 0;
+    bool FromPartials = false;
+    do {
+        uint32_t PerThread = C_ValuesPerThread;
+        uint32_t GroupCount = (Count + LocalSize * PerThread - 1) / (LocalSize * PerThread);
+        if (GroupCount > C_MaxWorkGroups) {
+            PerThread = (Count + LocalSize * C_MaxWorkGroups - 1) / (LocalSize * C_MaxWorkGroups);
+            GroupCount = (Count + LocalSize * PerThread - 1) / (LocalSize * PerThread);
+        }
+        ReduceArgs Args = {Count,InOffset,OutOffset,PerThread,FromPartials ? 1u : 0u,Shift};
+        Passes->push_back(Args);
+        Groups->push_back(GroupCount);
+        InOffset = OutOffset;
+        OutOffset += GroupCount;
+        Count = GroupCount;
+        FromPartials = true;
+    } while (Count > 1);
+    return OutOffset;
+}
+
+void ComputeUsingGPU(int Nx,int Ny,int Nrpt,bool Validate,bool Subgroups,bool Roofline,
+                              const std::string& DebugLevels,int Warmup,BenchReport& Bench,
+                                                                           float* SharedInput)
+{
+    bool StatusOK = true;
+
+    MsecTimer SetupTimer;
+    TheDebugHandler.Log("Setup","GPU setup starting");
+    TraceRecorder& Tracer = TraceRecorder::Global();
+    Tracer.Begin("GPU setup","Reduce");
+
+    //  This is the same basic Vulkan initialisation sequence used by Adder - it creates a
+    //  Vulkan 'instance', locates a suitable GPU device and opens that, creating a 'logical
+    //  device' that represents the selected GPU.
+
+    KVVulkanFramework Framework;
+    Framework.SetDebugSystemName("Vulkan");
+    Framework.SetDebugLevels(DebugLevels);
+    Framework.EnableValidation(Validate);
+    Framework.CreateVulkanInstance(StatusOK);
+    TheDebugHandler.Logf("Setup","Vulkan instance created at %.3f msec",SetupTimer.ElapsedMsec());
+    Framework.FindSuitableDevice(StatusOK);
+    Framework.CreateLogicalDevice(StatusOK);
+    TheDebugHandler.Logf("Setup","GPU device created at %.3f msec",SetupTimer.ElapsedMsec());
+
+    //  The subgroup version of the shader needs the device to support subgroup arithmetic.
+
+    uint32_t SubgroupSize = 0;
+    if (Subgroups && StatusOK && !Framework.DeviceSupportsSubgroupArithmetic(&SubgroupSize)) {
+        printf ("GPU does not support subgroup arithmetic, so 'Subgroups' is ignored.\n");
+        Subgroups = false;
+    }
+    const char* ShaderName = Subgroups ? C_SubgroupShader : C_SharedShader;
+    TheDebugHandler.Logf("Setup","Using shader %s",ShaderName);
+    if (Subgroups) TheDebugHandler.Logf("Setup","Subgroup size %d",SubgroupSize);
+
+    //  If we're to report the bandwidth as a fraction of the peak, we need to know the peak.
+
+    double PeakGBytes = 0.0;
+    if (Roofline) {
+        PeakGBytes = Framework.MeasureDeviceBandwidth(StatusOK);
+        printf ("GPU measured peak bandwidth = %.2f GBytes/sec\n",PeakGBytes);
+    }
+
+    //  Create a buffer for the input array, "SHARED" so the CPU can set its values, or
+    //  "IMPORTED" if main() has already set it up in memory the GPU can import. As with Adder,
+    //  the whole array has to fit in one storage buffer.
+
+    StartupPhase BufferPhase("GPU buffers");
+    VkDeviceSize Length = VkDeviceSize(Nx) * VkDeviceSize(Ny) * sizeof(float);
+    if (StatusOK && Length > Framework.GetMaxStorageBufferRange()) {
+        printf ("An array of %llu bytes is larger than the GPU's largest storage buffer "
+                "(%llu bytes).\n\n",(unsigned long long)Length,
+                                     (unsigned long long)Framework.GetMaxStorageBufferRange());
+        StatusOK = false;
+    }
+    KVVulkanFramework::KVBufferHandle InputBufferHndl;
+    if (SharedInput) {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                          "IMPORTED",StatusOK);
+        Framework.ImportBuffer(InputBufferHndl,SharedInput,Length,StatusOK);
+    } else {
+        InputBufferHndl = Framework.SetBufferDetails(C_InputBufferBinding,"STORAGE",
+                                                                            "SHARED",StatusOK);
+        Framework.CreateBuffer(InputBufferHndl,Length,StatusOK);
+    }
+    VkDeviceSize Bytes;
+    float* InputBufferAddr = (float*)Framework.MapBuffer(InputBufferHndl,&Bytes,StatusOK);
+    float** InputArray = nullptr;
+    if (StatusOK && InputBufferAddr) {
+        InputArray = CreateRowAddrs(InputBufferAddr,Nx,Ny);
+        if (!SharedInput) SetInputArray(InputArray,Nx,Ny);
+    }
+
+    //  Work out the passes needed. The sums are of each value less the first value of the
+    //  array - see Reduce.comp.
+
+    std::vector<ReduceArgs> Passes;
+    std::vector<uint32_t> Groups;
+    float Shift = InputArray ? InputArray[0][0] : 0.0f;
+    uint32_t Partials = PlanPasses(uint32_t(Nx) * uint32_t(Ny),C_WorkGroupSize,Shift,
+                                                                             &Passes,&Groups);
+    TheDebugHandler.Logf("Setup","%d passes, %u partial results",int(Passes.size()),Partials);
+
+    //  The partial results of each pass, four floats (a vec4 in the shader) for each workgroup.
+    //  The CPU only reads the last of them, the final result, so this is a "READBACK" buffer.
+
+    KVVulkanFramework::KVBufferHandle PartialsBufferHndl;
+    PartialsBufferHndl = Framework.SetBufferDetails(C_PartialsBufferBinding,"STORAGE",
+                                                                          "READBACK",StatusOK);
+    Framework.CreateBuffer(PartialsBufferHndl,VkDeviceSize(Partials) * 4 * sizeof(float),
+                                                                                   StatusOK);
+    float* PartialsAddr = (float*)Framework.MapBuffer(PartialsBufferHndl,&Bytes,StatusOK);
+    TheDebugHandler.Logf("Setup","GPU buffers created at %.3f msec",SetupTimer.ElapsedMsec());
+    BufferPhase.End();
+
+    //  The descriptor set layout, pool and set for those two buffers.
+
+    StartupPhase DescriptorPhase("GPU descriptors");
+    std::vector<KVVulkanFramework::KVBufferHandle> Handles;
+    Handles.push_back(InputBufferHndl);
+    Handles.push_back(PartialsBufferHndl);
+    VkDescriptorSetLayout SetLayout;
+    Framework.CreateVulkanDescriptorSetLayout(Handles,&SetLayout,StatusOK);
+    VkDescriptorPool DescriptorPool;
+    Framework.CreateVulkanDescriptorPool(Handles,1,&DescriptorPool,StatusOK);
+    VkDescriptorSet DescriptorSet;
+    Framework.AllocateVulkanDescriptorSet(SetLayout,DescriptorPool,&DescriptorSet,StatusOK);
+    Framework.SetupVulkanDescriptorSet(Handles,DescriptorSet,StatusOK);
+    TheDebugHandler.Logf("Setup","GPU descriptors created at %.3f msec",SetupTimer.ElapsedMsec());
+    DescriptorPhase.End();
+
+    //  The compute queue, command pool and command buffer. Nothing changes from one iteration
+    //  to the next, so the command buffer is recorded once and then just resubmitted.
+
+    VkQueue ComputeQueue;
+    Framework.GetDeviceQueue(&ComputeQueue,StatusOK);
+    VkCommandPool CommandPool;
+    VkCommandBuffer CommandBuffer;
+    Framework.CreateCommandPool(&CommandPool,StatusOK);
+    Framework.CreateComputeCommandBuffer(CommandPool,&CommandBuffer,StatusOK);
+    Framework.SetCommandBufferReusable(CommandBuffer,true,StatusOK);
+
+    //  The pipeline, with the workgroup size as a specialization constant and room for the
+    //  arguments for each pass as push constants.
+
+    VkPipelineLayout ComputePipelineLayout;
+    VkPipeline ComputePipeline;
+    std::vector<uint32_t> SpecConstants = {C_WorkGroupSize};
+    Framework.CreateComputePipeline(ShaderName,"main",&SetLayout,&ComputePipelineLayout,
+                          &ComputePipeline,SpecConstants,uint32_t(sizeof(ReduceArgs)),StatusOK);
+    TheDebugHandler.Logf("Setup","GPU pipeline for reduce created at %.3f msec",
+                                                               SetupTimer.ElapsedMsec());
+
+    //  All the passes go into the one command buffer, each as a dispatch with its own push
+    //  constants. RecordComputeBatch() puts a barrier between each dispatch and the next, so
+    //  each pass sees the partials written by the one before.
+
+    std::vector<KVVulkanFramework::KVDispatch> Dispatches;
+    for (size_t Pass = 0; Pass < Passes.size(); Pass++) {
+        KVVulkanFramework::KVDispatch Dispatch;
+        Dispatch.PipelineHndl = ComputePipeline;
+        Dispatch.PipelineLayoutHndl = ComputePipelineLayout;
+        Dispatch.DescriptorSetHndl = DescriptorSet;
+        Dispatch.WorkGroupCounts[0] = Groups[Pass];
+        Dispatch.WorkGroupCounts[1] = 1;
+        Dispatch.WorkGroupCounts[2] = 1;
+        Dispatch.PushConstants = &Passes[Pass];
+        Dispatch.PushConstantSize = uint32_t(sizeof(ReduceArgs));
+        Dispatches.push_back(Dispatch);
+        TheDebugHandler.Logf("Setup","Pass %d: %u values, %u work groups, %u values per thread",
+                          int(Pass),Passes[Pass].Count,Groups[Pass],Passes[Pass].PerThread);
+    }
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncBefore = {InputBufferHndl};
+    std::vector<KVVulkanFramework::KVBufferHandle> SyncAfter = {PartialsBufferHndl};
+
+    Tracer.End("GPU setup","Reduce");
+    EndOfStartup();
+    if (StatusOK) {
+        TheDebugHandler.Logf("Setup","GPU setup took %.3f msec",SetupTimer.ElapsedMsec());
+    } else {
+        printf("GPU setup failed.\n");
+        Nrpt = 0;
+    }
+
+    Framework.EnableDispatchTiming(true,StatusOK);
+    float KernelMsec = 0.0;
+    bool KernelTimed = false;
+    MsecStats LoopStats;
+    MsecStats KernelStats;
+    LoopStats.SetWarmup(Warmup);
+    KernelStats.SetWarmup(Warmup);
+    ReduceStats Stats;
+    MsecTimer ComputeTimer;
+
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+
+        MsecTimer LoopTimer;
+        TraceScope PassTrace("GPU pass","Reduce");
+
+        Framework.RecordComputeBatch(CommandBuffer,Dispatches,SyncBefore,SyncAfter,StatusOK);
+        Framework.RunCommandBuffer(ComputeQueue,CommandBuffer,StatusOK);
+        double DoneUsec = Tracer.NowUsec();
+
+        //  The final result is read by the CPU without a SyncBuffer() call, so if its memory
+        //  isn't coherent it has to be invalidated here. (Usually, this does nothing.) Reading
+        //  it back is part of each pass, as a program that wanted the statistics would have to.
+
+        Framework.InvalidateBuffer(PartialsBufferHndl,StatusOK);
+        if (StatusOK && PartialsAddr) {
+            const float* Final = PartialsAddr + size_t(Partials - 1) * 4;
+            Stats.Count = (long long)Nx * (long long)Ny;
+            Stats.Shift = Shift;
+            Stats.Sum = Final[0];
+            Stats.SumSq = Final[1];
+            Stats.Min = Final[2];
+            Stats.Max = Final[3];
+        }
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+        float DispatchMsec;
+        if (Framework.GetDispatchTimes(nullptr,&DispatchMsec,nullptr,StatusOK)) {
+            DEBUG_LOGF(TheDebugHandler,TimingDebug,"GPU kernel took %.3f msec",DispatchMsec);
+            KernelMsec += DispatchMsec;
+            KernelTimed = true;
+            KernelStats.Record(DispatchMsec);
+            Tracer.Complete("Reduce kernel","GPU",DoneUsec - DispatchMsec * 1000.0,
+                                                                       DispatchMsec * 1000.0);
+        }
+        if (!StatusOK) break;
+        LoopStats.Record(LoopTimer.ElapsedMsec());
+    }
+
+    //  Check that we got it right, and report on the timing.
+
+    if (StatusOK) {
+        float Msec = ComputeTimer.ElapsedMsec();
+        printf ("GPU took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for GPU = %.3f\n",Msec / float(Nrpt));
+        LoopStats.Report("GPU iterations");
+        if (LoopStats.Count() > 0) {
+            std::string Device,Driver;
+            Framework.GetDeviceDescription(&Device,&Driver);
+            Bench.SetContext("Reduce","Vulkan",Device,Driver);
+            Bench.AddRow(Subgroups ? "GPU subgroups" : "GPU shared",Nx,Ny,LoopStats,&KernelStats);
+        }
+        ReportBandwidth("GPU","overall",Nx,Ny,Nrpt,Msec,PeakGBytes);
+        if (KernelTimed) {
+            printf ("GPU kernel took %.3f msec, average %.3f msec per iteration\n",
+                                                          KernelMsec,KernelMsec / float(Nrpt));
+            ReportBandwidth("GPU","in kernel",Nx,Ny,Nrpt,KernelMsec,PeakGBytes);
+        }
+        if (Nrpt <= 0) {
+            printf ("No values computed using GPU, as number of repeats set to zero.\n");
+        } else if (CheckResults(InputArray,Nx,Ny,Stats,"GPU")) {
+            printf ("GPU completed OK, all values computed as expected.\n\n");
+        } else {
+            printf ("** GPU completes, but with errors **\n\n");
+        }
+    } else {
+        if (Nrpt > 0) printf ("GPU execution failed.\n\n");
+    }
+
+    //  Release the array of row addresses. The Framework destructor will release all the
+    //  various Vulkan resources.
+
+    if (InputArray) free(InputArray);
+}
+
+//  ReportBandwidth() prints the memory bandwidth achieved given the time taken for all the
+//  repeats. Each pass reads the whole array, and writes next to nothing, so moves 4 bytes for
+//  each element. Device is "GPU" or "CPU" and What describes what the time covers. If a
+//  measured peak bandwidth is supplied (PeakGBytes non-zero), the bandwidth is also given as
+//  a percentage of that.
+
+void ReportBandwidth(const char* Device,const char* What,int Nx,int Ny,int Nrpt,float Msec,
+                                                                            double PeakGBytes)
+{
+    if (Nrpt > 0 && Msec > 0.0) {
+        double Bytes = double(Nx) * double(Ny) * double(sizeof(float)) * double(Nrpt);
+        double GBytes = Bytes / (double(Msec) * 1.0e6);
+        if (PeakGBytes > 0.0) {
+            printf ("%s bandwidth (%s) = %.2f GBytes/sec, %.1f%% of peak\n",Device,What,
+                                                        GBytes,100.0 * GBytes / PeakGBytes);
+        } else {
+            printf ("%s bandwidth (%s) = %.2f GBytes/sec\n",Device,What,GBytes);
+        }
+    }
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    C P U  c o d e
+//
+//  This code performs the reduction using the CPU, and is designed to do exactly what
+//  ComputeUsingGPU() does, but using the CPU. The work is shared out between the threads of
+//  the shared pool by rows, each thread reducing its own band of rows with one of the versions
+//  of ReduceRangeUsingCPU(), and the threads' results are then combined.
+//
+//  Summing a row one value at a time would make each addition wait for the one before, and
+//  the compiler can't change the order of floating point additions to avoid that. So each
+//  version keeps a number of separate running totals - one for each lane of a vector
+//  register - and only combines them at the end of the row. The scalar version uses arrays
+//  of 8, which the compiler can turn into vector code for itself, and the AVX2, AVX-512 and
+//  NEON versions use the vector instructions explicitly. The running totals are floats, as
+//  on the GPU, but the totals for each row are added in double precision.
+
+//  AddLanes() adds the running totals for each lane, as left at the end of a row, to Stats.
+//  AddValues() adds the values left over at the end of a row that don't fill a vector.
+
+static void AddLanes(const float* Sum,const float* SumSq,const float* Min,const float* Max,
+                                                                 int Lanes,ReduceStats* Stats)
+{
+    double RowSum = 0.0;
+    double RowSumSq = 0.0;
+    for (int Lane = 0; Lane < Lanes; Lane++) {
+        RowSum += Sum[Lane];
+        RowSumSq += SumSq[Lane];
+        if (Min[Lane] < Stats->Min) Stats->Min = Min[Lane];
+        if (Max[Lane] > Stats->Max) Stats->Max = Max[Lane];
+    }
+    Stats->Sum += RowSum;
+    Stats->SumSq += RowSumSq;
+}
+
+static void AddValues(const float* Values,int Count,float Shift,ReduceStats* Stats)
+{
+    for (int I = 0; I < Count; I++) {
+        float Diff = Values[I] - Shift;
+        Stats->Sum += Diff;
+        Stats->SumSq += Diff * Diff;
+        if (Values[I] < Stats->Min) Stats->Min = Values[I];
+        if (Values[I] > Stats->Max) Stats->Max = Values[I];
+    }
+}
+
+//  ReduceRangeUsingCPU() reduces the rows from Iyst up to (but not including) Iyen, adding
+//  the results to Stats. Shift is the value subtracted from each before it is summed.
+
+void ReduceRangeUsingCPU(float** InputArray,int Nx,int Iyst,int Iyen,float Shift,
+                                                                         ReduceStats* Stats)
+{
+    const int Lanes = 8;
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* Row = InputArray[Iy];
+        float Sum[Lanes],SumSq[Lanes],Min[Lanes],Max[Lanes];
+        for (int Lane = 0; Lane < Lanes; Lane++) {
+            Sum[Lane] = SumSq[Lane] = 0.0f;
+            Min[Lane] = INFINITY;
+            Max[Lane] = -INFINITY;
+        }
+        int Ix = 0;
+        for (; Ix + Lanes <= Nx; Ix += Lanes) {
+            for (int Lane = 0; Lane < Lanes; Lane++) {
+                float Value = Row[Ix + Lane];
+                float Diff = Value - Shift;
+                Sum[Lane] += Diff;
+                SumSq[Lane] += Diff * Diff;
+                Min[Lane] = (Value < Min[Lane]) ? Value : Min[Lane];
+                Max[Lane] = (Value > Max[Lane]) ? Value : Max[Lane];
+            }
+        }
+        AddLanes(Sum,SumSq,Min,Max,Lanes,Stats);
+        AddValues(Row + Ix,Nx - Ix,Shift,Stats);
+    }
+}
+
+//                               I n c l u d e  F i l e s
+//
+//  Needed for the vector versions of the CPU code.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define REDUCE_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define REDUCE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+#include <ctype.h>
+
+//  The vector versions of ReduceRangeUsingCPU() do exactly the same as the scalar version,
+//  with one lane of a vector register for each of its running totals - 8 (AVX2), 16 (AVX-512)
+//  or 4 (NEON) of them. As in Adder, the x86 versions are compiled for their instruction sets
+//  using the 'target' attribute with gcc and clang, so the program still runs on older CPUs.
+
+#if defined(REDUCE_X86_SIMD) && defined(__GNUC__)
+#define REDUCE_TARGET(Isa) __attribute__((target(Isa)))
+#else
+#define REDUCE_TARGET(Isa)
+#endif
+
+#ifdef REDUCE_X86_SIMD
+
+REDUCE_TARGET("avx2")
+void ReduceRangeUsingAVX2(float** InputArray,int Nx,int Iyst,int Iyen,float Shift,
+                                                                         ReduceStats* Stats)
+{
+    const __m256 Shifts = _mm256_set1_ps(Shift);
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* Row = InputArray[Iy];
+        __m256 Sum = _mm256_setzero_ps();
+        __m256 SumSq = _mm256_setzero_ps();
+        __m256 Min = _mm256_set1_ps(INFINITY);
+        __m256 Max = _mm256_set1_ps(-INFINITY);
+        int Ix = 0;
+        for (; Ix + 8 <= Nx; Ix += 8) {
+            __m256 Value = _mm256_loadu_ps(Row + Ix);
+            __m256 Diff = _mm256_sub_ps(Value,Shifts);
+            Sum = _mm256_add_ps(Sum,Diff);
+            SumSq = _mm256_add_ps(SumSq,_mm256_mul_ps(Diff,Diff));
+            Min = _mm256_min_ps(Min,Value);
+            Max = _mm256_max_ps(Max,Value);
+        }
+        float Lanes[4][8];
+        _mm256_storeu_ps(Lanes[0],Sum);
+        _mm256_storeu_ps(Lanes[1],SumSq);
+        _mm256_storeu_ps(Lanes[2],Min);
+        _mm256_storeu_ps(Lanes[3],Max);
+        AddLanes(Lanes[0],Lanes[1],Lanes[2],Lanes[3],8,Stats);
+        AddValues(Row + Ix,Nx - Ix,Shift,Stats);
+    }
+}
+
+REDUCE_TARGET("avx512f")
+void ReduceRangeUsingAVX512(float** InputArray,int Nx,int Iyst,int Iyen,float Shift,
+                                                                         ReduceStats* Stats)
+{
+    const __m512 Shifts = _mm512_set1_ps(Shift);
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* Row = InputArray[Iy];
+        __m512 Sum = _mm512_setzero_ps();
+        __m512 SumSq = _mm512_setzero_ps();
+        __m512 Min = _mm512_set1_ps(INFINITY);
+        __m512 Max = _mm512_set1_ps(-INFINITY);
+        int Ix = 0;
+        for (; Ix + 16 <= Nx; Ix += 16) {
+            __m512 Value = _mm512_loadu_ps(Row + Ix);
+            __m512 Diff = _mm512_sub_ps(Value,Shifts);
+            Sum = _mm512_add_ps(Sum,Diff);
+            SumSq = _mm512_add_ps(SumSq,_mm512_mul_ps(Diff,Diff));
+            Min = _mm512_min_ps(Min,Value);
+            Max = _mm512_max_ps(Max,Value);
+        }
+        float Lanes[4][16];
+        _mm512_storeu_ps(Lanes[0],Sum);
+        _mm512_storeu_ps(Lanes[1],SumSq);
+        _mm512_storeu_ps(Lanes[2],Min);
+        _mm512_storeu_ps(Lanes[3],Max);
+        AddLanes(Lanes[0],Lanes[1],Lanes[2],Lanes[3],16,Stats);
+        AddValues(Row + Ix,Nx - Ix,Shift,Stats);
+    }
+}
+
+#endif
+
+#ifdef REDUCE_NEON_SIMD
+
+void ReduceRangeUsingNEON(float** InputArray,int Nx,int Iyst,int Iyen,float Shift,
+                                                                         ReduceStats* Stats)
+{
+    const float32x4_t Shifts = vdupq_n_f32(Shift);
+    for (int Iy = Iyst; Iy < Iyen; Iy++) {
+        const float* Row = InputArray[Iy];
+        float32x4_t Sum = vdupq_n_f32(0.0f);
+        float32x4_t SumSq = vdupq_n_f32(0.0f);
+        float32x4_t Min = vdupq_n_f32(INFINITY);
+        float32x4_t Max = vdupq_n_f32(-INFINITY);
+        int Ix = 0;
+        for (; Ix + 4 <= Nx; Ix += 4) {
+            float32x4_t Value = vld1q_f32(Row + Ix);
+            float32x4_t Diff = vsubq_f32(Value,Shifts);
+            Sum = vaddq_f32(Sum,Diff);
+            SumSq = vmlaq_f32(SumSq,Diff,Diff);
+            Min = vminq_f32(Min,Value);
+            Max = vmaxq_f32(Max,Value);
+        }
+        float Lanes[4][4];
+        vst1q_f32(Lanes[0],Sum);
+        vst1q_f32(Lanes[1],SumSq);
+        vst1q_f32(Lanes[2],Min);
+        vst1q_f32(Lanes[3],Max);
+        AddLanes(Lanes[0],Lanes[1],Lanes[2],Lanes[3],4,Stats);
+        AddValues(Row + Ix,Nx - Ix,Shift,Stats);
+    }
+}
+
+#endif
+
+//  All the versions of the routine have the same arguments, so OnePassUsingCPU() can be passed
+//  whichever is to be used.
+
+typedef void (*CPURangeRoutine)(float** InputArray,int Nx,int Iyst,int Iyen,float Shift,
+                                                                         ReduceStats* Stats);
+
+//  CPUSupports() returns true if the CPU being used supports a given set of vector instructions,
+//  "AVX2", "AVX512" or "NEON". (NEON is a standard part of 64-bit ARM, so is always there.)
+
+bool CPUSupports(const std::string& Isa)
+{
+    bool Supported = false;
+#ifdef REDUCE_X86_SIMD
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (Isa == "AVX2") Supported = __builtin_cpu_supports("avx2");
+    if (Isa == "AVX512") Supported = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER)
+
+    //  CPUID leaf 7 gives the instruction set bits, but the operating system also has to be
+    //  saving the wider registers, which _xgetbv() shows (bits 1,2 for AVX, 5-7 for AVX-512).
+
+    int Info[4];
+    __cpuid(Info,0);
+    if (Info[0] >= 7) {
+        __cpuidex(Info,7,0);
+        bool HasAVX2 = (Info[1] & (1 << 5)) != 0;
+        bool HasAVX512 = (Info[1] & (1 << 16)) != 0;
+        __cpuid(Info,1);
+        bool OSSaves = (Info[2] & (1 << 27)) != 0;
+        unsigned long long XCR0 = OSSaves ? _xgetbv(0) : 0;
+        if (Isa == "AVX2") Supported = HasAVX2 && ((XCR0 & 0x6) == 0x6);
+        if (Isa == "AVX512") Supported = HasAVX512 && ((XCR0 & 0xe6) == 0xe6);
+    }
+#endif
+#endif
+#ifdef REDUCE_NEON_SIMD
+    if (Isa == "NEON") Supported = true;
+#endif
+    return Supported;
+}
+
+//  SelectCPURange() returns the version of ReduceRangeUsingCPU() to use, given the value of
+//  the 'Simd' command line parameter, and sets Name to the instruction set it uses. "Auto"
+//  picks the widest vectors the CPU supports. If a specific set of instructions is requested
+//  but isn't supported, it says so and does the same as for "Auto".
+
+CPURangeRoutine SelectCPURange(const std::string& Simd,std::string* Name)
+{
+    std::string Requested = Simd;
+    for (char& Char : Requested) Char = toupper(Char);
+    if (Requested == "") Requested = "AUTO";
+    if (Requested != "AUTO" && Requested != "SCALAR" && !CPUSupports(Requested)) {
+        printf ("Warning: '%s' vector code is not supported on this CPU, using 'Auto'.\n",
+                                                                                Simd.c_str());
+        Requested = "AUTO";
+    }
+    CPURangeRoutine Routine = ReduceRangeUsingCPU;
+    *Name = "Scalar";
+#ifdef REDUCE_X86_SIMD
+    if ((Requested == "AUTO" && CPUSupports("AVX512")) || Requested == "AVX512") {
+        Routine = ReduceRangeUsingAVX512;
+        *Name = "AVX512";
+    } else if ((Requested == "AUTO" && CPUSupports("AVX2")) || Requested == "AVX2") {
+        Routine = ReduceRangeUsingAVX2;
+        *Name = "AVX2";
+    }
+#endif
+#ifdef REDUCE_NEON_SIMD
+    if (Requested == "AUTO" || Requested == "NEON") {
+        Routine = ReduceRangeUsingNEON;
+        *Name = "NEON";
+    }
+#endif
+    return Routine;
+}
+
+//  OnePassUsingCPU() performs one pass through the whole of the input data, splitting up
+//  the work across multiple threads, and returns the combined results in Stats. It will use
+//  as many CPU threads as are available, up to the value of Threads. If Threads is set to
+//  zero, it uses all available CPU threads. It returns the number of threads used.
+
+int OnePassUsingCPU(int Threads,float** InputArray,int Nx,int Ny,float Shift,
+                                                    CPURangeRoutine Range,ReduceStats* Stats)
+{
+    *Stats = ReduceStats();
+    Stats->Count = (long long)Nx * (long long)Ny;
+    Stats->Shift = Shift;
+    std::mutex StatsMutex;
+    return ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        ReduceStats RangeStats;
+        Range(InputArray,Nx,Iyst,Iyen,Shift,&RangeStats);
+        std::lock_guard<std::mutex> Lock(StatsMutex);
+        CombineStats(Stats,RangeStats);
+    },Threads);
+}
+
+void ComputeUsingCPU(int Threads,int Nx,int Ny,int Nrpt,const std::string& Simd,
+                      bool Roofline,int Warmup,BenchReport& Bench,float* SharedInput)
+{
+    //  Create the input array, with an array of row addresses to allow an InputArray[Iy][Ix]
+    //  syntax, just as Adder does. If main() passes a SharedInput, that's the array the GPU has
+    //  just used, and we use it as it is, rather than allocating and initialising another.
+
+    float* InputArrayData = SharedInput;
+    if (!SharedInput) InputArrayData = (float*)malloc(size_t(Nx) * size_t(Ny) * sizeof(float));
+    float** InputArray = CreateRowAddrs(InputArrayData,Nx,Ny);
+    TheDebugHandler.Log("Setup","CPU array created");
+    if (!SharedInput) SetInputArray(InputArray,Nx,Ny);
+
+    //  See how many threads the hardware supports. If Threads was passed as zero, use this
+    //  maximum number of threads. Otherwise use the number passed in Threads, if that many
+    //  are available.
+
+    int MaxThreads = std::thread::hardware_concurrency();
+    if (MaxThreads <= 0) MaxThreads = 1;
+    if (Threads <= 0) Threads = MaxThreads;
+    if (Threads > MaxThreads) Threads = MaxThreads;
+    TheDebugHandler.Logf("Setup","CPU using %d threads out of maximum of %d\n",Threads,MaxThreads);
+
+    //  Pick the version of the inner loop to use, depending on the vector instructions the
+    //  CPU supports and on what the command line asked for.
+
+    std::string SimdName;
+    CPURangeRoutine Range = SelectCPURange(Simd,&SimdName);
+    TheDebugHandler.Logf("Setup","CPU using %s code",SimdName.c_str());
+
+    //  If the bandwidth is to be compared with the peak, measure that, with the same threads.
+
+    double PeakGBytes = 0.0;
+    if (Roofline) {
+        PeakGBytes = MeasureCPUBandwidth(Threads);
+        printf ("CPU measured peak bandwidth = %.2f GBytes/sec (%d thread(s))\n",
+                                                                         PeakGBytes,Threads);
+    }
+
+    //  The sums are of each value less the first, as on the GPU.
+
+    float Shift = InputArray[0][0];
+    ReduceStats Stats;
+    MsecStats LoopStats;
+    LoopStats.SetWarmup(Warmup);
+    MsecTimer ComputeTimer;
+
+    for (int Irpt = 0; Irpt < Nrpt; Irpt++) {
+        MsecTimer LoopTimer;
+        TraceScope PassTrace("CPU pass","Reduce");
+        Threads = OnePassUsingCPU(Threads,InputArray,Nx,Ny,Shift,Range,&Stats);
+        DEBUG_LOGF(TheDebugHandler,TimingDebug,"CPU Compute complete at %.3f msec",
+                                                                           LoopTimer.ElapsedMsec());
+        LoopStats.Record(LoopTimer.ElapsedMsec());
+    }
+
+    //  Report on results, and on timing.
+
+    float Msec = ComputeTimer.ElapsedMsec();
+    if (Nrpt <= 0) {
+        printf ("No values computed using CPU, as number of repeats set to zero.\n");
+    } else {
+        printf ("CPU took %.3f msec\n",Msec);
+        printf ("Average msec per iteration for CPU = %.3f (%d thread(s), %s)\n",
+                                               Msec / float(Nrpt),Threads,SimdName.c_str());
+        LoopStats.Report("CPU iterations");
+        if (LoopStats.Count() > 0) {
+            Bench.SetContext("Reduce","CPU",SimdName,"");
+            Bench.AddRow("CPU " + std::to_string(Threads) + " thread(s)",Nx,Ny,LoopStats);
+        }
+        ReportBandwidth("CPU","overall",Nx,Ny,Nrpt,Msec,PeakGBytes);
+        if (CheckResults(InputArray,Nx,Ny,Stats,"CPU")) {
+            printf ("CPU completed OK, all values computed as expected.\n\n");
+        } else {
+            printf ("** CPU completes, but with errors **\n\n");
+        }
+    }
+
+    //  Release the array of row addresses, and the array data.
+
+    if (InputArray) free(InputArray);
+    if (InputArrayData && !SharedInput) free(InputArrayData);
+}
+
+//  MeasureCPUBandwidth() measures the memory bandwidth the CPU can manage using a given number
+//  of threads, by timing memcpy() between two buffers much larger than any cache, just as in
+//  Adder. Each byte copied is read once and written once, so counts twice. It returns the
+//  bandwidth in GBytes/sec, or zero if it failed.
+
+double MeasureCPUBandwidth(int Threads)
+{
+    const size_t Bytes = size_t(256) * 1024 * 1024;
+    char* Source = (char*)malloc(Bytes);
+    char* Dest = (char*)malloc(Bytes);
+    double GBytes = 0.0;
+    if (Source && Dest) {
+        memset(Source,1,Bytes);
+        const int Chunks = 1024;
+        const size_t ChunkBytes = Bytes / Chunks;
+        float BestMsec = 0.0;
+        for (int Run = 0; Run < 4; Run++) {
+            MsecTimer CopyTimer;
+            ThreadPool::Shared().ParallelFor(0,Chunks,[&](int First,int Last) {
+                memcpy(Dest + First * ChunkBytes,Source + First * ChunkBytes,
+                                                                   (Last - First) * ChunkBytes);
+            },Threads);
+            float Msec = CopyTimer.ElapsedMsec();
+            if (Run > 0 && (BestMsec <= 0.0 || Msec < BestMsec)) BestMsec = Msec;
+        }
+        if (BestMsec > 0.0) GBytes = 2.0 * double(Bytes) / (double(BestMsec) * 1.0e6);
+    }
+    if (Dest) free(Dest);
+    if (Source) free(Source);
+    return GBytes;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                    S e t  I n p u t  A r r a y
+//
+//  This sets initial values for the elements of the input array, and is intended to be called
+//  by ComputeUsingCPU() and ComputeUsingGPU() once they have allocated memory for the input
+//  array. Note that it expects to be passed not the actual start of the input array, but
+//  the start of an array giving the address of the start of each row of the input array.
+//
+//  The values are a pattern of multiples of a half, from 1000 up to 1499.5, like an image
+//  with a background level, except for one value well below that and one well above, at
+//  places that depend on the array size, so a reduction that misses part of the array, or
+//  mixes up the minimum and maximum, gets the wrong answer.
+
+void SetInputArray(float** InputArray,int Nx,int Ny)
+{
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            float* Row = InputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                Row[Ix] = 1000.0f + 0.5f * float((Ix * 7 + Iy * 13) % 1000);
+            }
+        }
+    });
+    InputArray[Ny / 2][Nx / 3] = 10.0f;
+    InputArray[Ny / 3][Nx / 2] = 5000.0f;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  C o m b i n e  S t a t s
+//
+//  Adds the results of reducing one part of the array to those for another. The sums have to
+//  have been made using the same shift. (The counts are set by the caller, for the array as a
+//  whole.)
+
+void CombineStats(ReduceStats* Into,const ReduceStats& From)
+{
+    Into->Sum += From.Sum;
+    Into->SumSq += From.SumSq;
+    if (From.Min < Into->Min) Into->Min = From.Min;
+    if (From.Max > Into->Max) Into->Max = From.Max;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                                  C r e a t e  R o w  A d d r s
+//
+//  A simple utility that allocates memory for an array that will hold the addresses of the start
+//  of each row for a block of memory (passed as Array) that holds an Nx by Ny array of floats.
+//  It returns the address of this array of row addresses, which will need to be released using
+//  free() once it is no longer needed.
+
+float** CreateRowAddrs(float* Array,int Nx,int Ny)
+{
+    float** RowAddrs = (float**)malloc(Ny * sizeof(float*));
+    for (int Iy = 0; Iy < Ny; Iy++) {
+        RowAddrs[Iy] = Array + (size_t(Iy) * size_t(Nx));
+    }
+    return RowAddrs;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              C h e c k  R e s u l t s
+//
+//  This routine uses the CPU to check the results of a reduction, passed as Stats, against
+//  results calculated in double precision, one value at a time, and reports both. The
+//  minimum and maximum have to be exact, but the sums made using floats, by the GPU or the
+//  CPU, can only be expected to agree to within their rounding errors. The sum and mean are
+//  allowed a relative error of C_SumTolerance in the sum of the magnitudes of the values, and
+//  the standard deviation a relative error of C_StdDevTolerance. Device is "GPU" or "CPU", and
+//  is used in the report. If there is a mismatch, it outputs an error message and returns false.
+//
+//  For large arrays this takes a while, so the rows are shared out between the threads in
+//  the shared pool. The sums of the squares are of each value less the mean of the first
+//  row, to keep their precision, just as the GPU and CPU code subtract a shift.
+
+static const double C_SumTolerance = 1.0e-5;
+static const double C_StdDevTolerance = 1.0e-4;
+
+bool CheckResults(float** InputArray,int Nx,int Ny,const ReduceStats& Stats,const char* Device)
+{
+    double Shift = 0.0;
+    for (int Ix = 0; Ix < Nx; Ix++) Shift += InputArray[0][Ix];
+    Shift /= double(Nx);
+    std::mutex TotalsMutex;
+    double Sum = 0.0,SumSq = 0.0,SumAbs = 0.0;
+    float Min = INFINITY,Max = -INFINITY;
+    ThreadPool::Shared().ParallelFor(0,Ny,[&](int Iyst,int Iyen) {
+        double BandSum = 0.0,BandSumSq = 0.0,BandSumAbs = 0.0;
+        float BandMin = INFINITY,BandMax = -INFINITY;
+        for (int Iy = Iyst; Iy < Iyen; Iy++) {
+            const float* Row = InputArray[Iy];
+            for (int Ix = 0; Ix < Nx; Ix++) {
+                double Diff = double(Row[Ix]) - Shift;
+                BandSum += Diff;
+                BandSumSq += Diff * Diff;
+                BandSumAbs += fabs(double(Row[Ix]));
+                if (Row[Ix] < BandMin) BandMin = Row[Ix];
+                if (Row[Ix] > BandMax) BandMax = Row[Ix];
+            }
+        }
+        std::lock_guard<std::mutex> Lock(TotalsMutex);
+        Sum += BandSum;
+        SumSq += BandSumSq;
+        SumAbs += BandSumAbs;
+        if (BandMin < Min) Min = BandMin;
+        if (BandMax > Max) Max = BandMax;
+    });
+    double Count = double(Nx) * double(Ny);
+    double Total = Sum + Count * Shift;
+    double Mean = Total / Count;
+    double StdDev = sqrt(std::max(0.0,(SumSq - Sum * Sum / Count) / (Count - 1.0)));
+
+    printf ("%s results: sum %.7g, mean %.7g, std dev %.7g, min %g, max %g\n",Device,
+                             Stats.Total(),Stats.Mean(),Stats.StdDev(),Stats.Min,Stats.Max);
+    bool AllOK = true;
+    if (Stats.Min != Min || Stats.Max != Max) {
+        printf ("*** Error: min %g, max %g, expected %g, %g\n",Stats.Min,Stats.Max,Min,Max);
+        AllOK = false;
+    }
+    if (fabs(Stats.Total() - Total) > C_SumTolerance * SumAbs) {
+        printf ("*** Error: sum %.10g, expected %.10g, mean %.10g, expected %.10g\n",
+                                                  Stats.Total(),Total,Stats.Mean(),Mean);
+        AllOK = false;
+    }
+    if (fabs(Stats.StdDev() - StdDev) > C_StdDevTolerance * StdDev) {
+        printf ("*** Error: std dev %.10g, expected %.10g\n",Stats.StdDev(),StdDev);
+        AllOK = false;
+    }
+    return AllOK;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                              E n d  O f  S t a r t u p
+//
+//  Called once the GPU is set up and ready to run the tests. This marks the end of the
+//  start-up recorded by the StartupProfile and, the first time it's called with the 'Startup'
+//  debug level set, lists the stages recorded. (For a list of sizes, this is the first size.)
+
+void EndOfStartup(void)
+{
+    if (StartupProfile::Global().Finish()) StartupProfile::Global().Report();
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//              D e b u g  A r g  H e l p e r  ::  C h e c k  V a l i d i t y
+//
+//  Checks that all the levels given for 'Debug' are recognised either by TheDebugHandler or
+//  by the Vulkan Framework's own handler. See the Adder code for a fuller explanation.
+
+bool DebugArgHelper::CheckValidity(const std::string& Value,std::string* Reason)
+{
+    bool Valid = true;
+    std::string Unrecognised = TheDebugHandler.CheckLevels(Value);
+    if (Unrecognised != "") {
+        DebugHandler VulkanStandInHandler("Vulkan");
+        VulkanStandInHandler.LevelsList(KVVulkanFramework::GetDebugOptions());
+        Unrecognised = VulkanStandInHandler.CheckLevels(Unrecognised);
+    }
+    if (Unrecognised != "") {
+        *Reason = "'" + Unrecognised + "' not recognised";
+        Valid = false;
+    }
+    return Valid;
+}
+
+//  ------------------------------------------------------------------------------------------------
+//
+//                D e b u g  A r g  H e l p e r  ::  H e l p  T e x t
+//
+//  Provides additional details about the available options for the Debug argument. The command
+//  line code uses this when the user responds to a prompt for the argument value with '?'
+
+std::string DebugArgHelper::HelpText(void)
+{
+    std::string Text = "";
+    Text += "Top level options: " + TheDebugHandler.ListLevels() + "\n" +
+            "Vulkan level options: " + KVVulkanFramework::GetDebugOptions() + "\n" +
+            "(Should be a comma-separated list of options. '*' acts as a wildcard).";
+    return Text;
+}
+
+//  ------------------------------------------------------------------------------------------------
+
+//                            P r o g r a m m i n g   N o t e s
+/*
+    o   Each GPU pass reads the final result back, rather than leaving it on the GPU, since a
+        program that wanted the statistics of an image would need them on the CPU. It's only
+        16 bytes, but it means every pass includes a complete round trip to the GPU, which for
+        small arrays is most of the time taken.
+
+    o   The GPU's bandwidth counts only the reading of the array. The partials written and
+        read by the later passes come to one vec4 for every 4096 values, which is small enough
+        to leave out.
+
+    o   Blank (NaN) values aren't treated specially, so an array with any would give a NaN sum.
+        An image reduction that had to allow for them would need a count of the values used
+        as well, and the minimum and maximum would need to ignore them explicitly, since the
+        GPU's min() and max() don't promise what they do with a NaN.
+
+    o   The vector min and max instructions used by the AVX2, AVX-512 and NEON versions of
+        the CPU code behave the same as the comparisons in the scalar version for ordinary
+        values, which is all the test array has.
+*/
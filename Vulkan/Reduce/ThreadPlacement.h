@@ -0,0 +1,422 @@
+//
+//                       T h r e a d  P l a c e m e n t . h
+//
+//  This lets the CPU versions of the calculations control which CPUs their threads run on,
+//  and at what priority, so CPU timings can be reproduced from one run to the next. Left to
+//  itself, the system moves threads between CPUs as it sees fit, and on a machine with both
+//  performance and efficiency cores, or with more than one NUMA node, where a thread happens
+//  to run can change its speed a lot.
+//
+//  A ThreadPlacement finds the CPU topology when it's created: the logical CPUs, which
+//  physical core each is part of, which of those are performance cores, and which NUMA node
+//  each is on. SetMode() then selects the CPUs the threads are to use:
+//
+//     None     Threads aren't pinned to any CPU. This is the default.
+//     PCores   Every logical CPU of the performance cores. (If all the cores are the same,
+//              this is every CPU.)
+//     Physical One logical CPU on each physical core, performance cores first, so no two
+//              threads share a core.
+//     Numa     Every logical CPU on the NUMA node the calling thread is running on, so the
+//              memory it allocates is local to all the threads.
+//
+//  Within each set, the CPUs are ordered so that each physical core is used once before any
+//  is used twice. Apply() pins each thread of a ThreadPool to one of the CPUs selected - the
+//  calling thread to the first, and the workers to the ones that follow - and can raise their
+//  priority as well. Topology() and Description() return descriptions for the programs to
+//  report, so a set of timings can say what they were measured on.
+//
+//  Linux and Windows can pin a thread to a CPU. MacOS can't, but on Apple silicon a thread
+//  given the 'user interactive' quality of service is run on the performance cores, so that
+//  is used for 'PCores', and to raise the priority. The other modes have no effect on MacOS.
+//  (On Windows, only the first group of 64 CPUs is used.)
+//
+//  15th Oct 2026. First version. KS.
+
+#ifndef __ThreadPlacement__
+#define __ThreadPlacement__
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sys/qos.h>
+#include <sys/sysctl.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+class ThreadPlacement
+{
+public:
+    ThreadPlacement() {
+        _mode = "None";
+        FindTopology();
+    }
+    ~ThreadPlacement() {}
+    //  Selects the CPUs to use, given one of the modes listed above (in any case). An empty
+    //  string is the same as 'None'. Returns false if Mode isn't recognised.
+    bool SetMode(const std::string& Mode) {
+        std::string Requested = Mode;
+        for (char& Char : Requested) Char = toupper(Char);
+        if (Requested == "") Requested = "NONE";
+        if (Requested != "NONE" && Requested != "PCORES" && Requested != "PHYSICAL" &&
+                                                           Requested != "NUMA") return false;
+        _cpus.clear();
+        if (Requested == "NONE") {
+            _mode = "None";
+            return true;
+        }
+        int Node = CurrentNode();
+        for (const Cpu& Logical : _topology) {
+            if (Requested == "PCORES" && !Logical.Performance) continue;
+            if (Requested == "PHYSICAL" && Logical.Sibling > 0) continue;
+            if (Requested == "NUMA" && Logical.Node != Node) continue;
+            _cpus.push_back(Logical.Id);
+        }
+        _mode = Requested == "PCORES" ? "PCores" : Requested == "PHYSICAL" ? "Physical" : "Numa";
+        return true;
+    }
+    //  Returns the CPUs selected, in the order they are used, empty for 'None'.
+    const std::vector<int>& Cpus(void) const { return _cpus; }
+    //  Returns the number of CPUs selected, or zero for 'None'.
+    int Threads(void) const { return int(_cpus.size()); }
+    //  Pins each thread of Pool to one of the CPUs selected, and raises their priority if
+    //  HighPriority is set. Returns false, with a description in Error, if any of that fails.
+    bool Apply(ThreadPool& Pool,bool HighPriority,std::string* Error) {
+        std::atomic<int> PinFailures(0);
+        std::atomic<int> PriorityFailures(0);
+        bool Pin = !_cpus.empty() && CanPin();
+        bool QoS = HighPriority || _mode == "PCores";
+        if (!Pin && !QoS) return true;
+        Pool.OnEachThread([&](int Index) {
+            if (Pin && !PinCurrentThread(_cpus[Index % _cpus.size()])) PinFailures++;
+            if (QoS && !RaiseCurrentThread(HighPriority)) PriorityFailures++;
+        });
+        if (Error) {
+            *Error = "";
+            if (PinFailures > 0) {
+                *Error = std::to_string(int(PinFailures)) + " thread(s) could not be pinned";
+            }
+            if (PriorityFailures > 0) {
+                if (*Error != "") *Error += ", ";
+                *Error += std::to_string(int(PriorityFailures)) +
+                                                " thread(s) could not have their priority raised";
+            }
+        }
+        return PinFailures == 0 && PriorityFailures == 0;
+    }
+    //  Returns a description of the CPU topology found.
+    std::string Topology(void) const {
+        int Physical = 0;
+        int Performance = 0;
+        std::vector<int> Nodes;
+        for (const Cpu& Logical : _topology) {
+            if (Logical.Sibling == 0) {
+                Physical++;
+                if (Logical.Performance) Performance++;
+            }
+            if (std::find(Nodes.begin(),Nodes.end(),Logical.Node) == Nodes.end()) {
+                Nodes.push_back(Logical.Node);
+            }
+        }
+        std::string Text = std::to_string(_topology.size()) + " logical CPU(s), " +
+                                               std::to_string(Physical) + " physical core(s)";
+        if (Performance < Physical) {
+            Text += " (" + std::to_string(Performance) + " performance)";
+        }
+        Text += ", " + std::to_string(Nodes.size()) + " NUMA node(s)";
+        return Text;
+    }
+    //  Returns a description of the placement selected.
+    std::string Description(void) const {
+        if (_mode == "None") return "None (threads not pinned)";
+        if (!CanPin()) {
+            if (_mode == "PCores") {
+                return "PCores (" + std::to_string(_cpus.size()) +
+                                              " CPUs, by quality of service, not pinned)";
+            }
+            return _mode + " (" + std::to_string(_cpus.size()) + " CPUs, not pinned)";
+        }
+        std::string Text = _mode + ", CPUs ";
+        for (size_t Index = 0; Index < _cpus.size(); Index++) {
+            if (Index > 0) Text += ",";
+            Text += std::to_string(_cpus[Index]);
+        }
+        return Text;
+    }
+    //  Returns true if threads can be pinned to CPUs on this system.
+    static bool CanPin(void) {
+#if defined(__linux__) || defined(_WIN32)
+        return true;
+#else
+        return false;
+#endif
+    }
+    //  Pins the calling thread to logical CPU Id. Returns false if this fails.
+    static bool PinCurrentThread(int Id) {
+#if defined(__linux__)
+        cpu_set_t Set;
+        CPU_ZERO(&Set);
+        CPU_SET(Id,&Set);
+        return pthread_setaffinity_np(pthread_self(),sizeof(Set),&Set) == 0;
+#elif defined(_WIN32)
+        if (Id >= 64) return false;
+        return SetThreadAffinityMask(GetCurrentThread(),DWORD_PTR(1) << Id) != 0;
+#else
+        (void) Id;
+        return false;
+#endif
+    }
+    //  Raises the priority of the calling thread. Without HighPriority, this only asks for
+    //  the thread to be run on a performance core, which only means anything on MacOS.
+    //  Returns false if this fails.
+    static bool RaiseCurrentThread(bool HighPriority) {
+#if defined(__linux__)
+        if (!HighPriority) return true;
+        struct sched_param Param;
+        Param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        return pthread_setschedparam(pthread_self(),SCHED_FIFO,&Param) == 0;
+#elif defined(__APPLE__)
+        (void) HighPriority;
+        return pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE,0) == 0;
+#elif defined(_WIN32)
+        if (!HighPriority) return true;
+        return SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_HIGHEST) != 0;
+#else
+        return !HighPriority;
+#endif
+    }
+private:
+    //  The details of each logical CPU. Sibling is 0 for the first logical CPU found on its
+    //  physical core, 1 for the second, and so on.
+    struct Cpu {
+        int Id;
+        int Core;
+        int Sibling;
+        int Node;
+        bool Performance;
+        long Capacity;
+    };
+    //  Fills _topology. If nothing can be found out, each CPU is taken to be a performance
+    //  core of its own, on NUMA node 0.
+    void FindTopology(void) {
+        _topology.clear();
+#if defined(__linux__)
+        FindLinuxTopology();
+#elif defined(_WIN32)
+        FindWindowsTopology();
+#elif defined(__APPLE__)
+        FindMacTopology();
+#endif
+        if (_topology.empty()) {
+            for (int Id = 0; Id < ThreadPool::MaxThreads(); Id++) {
+                _topology.push_back({Id,Id,0,0,true,0});
+            }
+        }
+
+        //  The performance cores are those with the highest capacity, if any differ. Then
+        //  the CPUs are numbered within their core, and sorted so that each core is used once
+        //  before any is used twice, with the performance cores first each time round.
+
+        long MaxCapacity = 0;
+        for (const Cpu& Logical : _topology) MaxCapacity = std::max(MaxCapacity,Logical.Capacity);
+        std::map<int,int> SiblingsSeen;
+        for (Cpu& Logical : _topology) {
+            if (MaxCapacity > 0) Logical.Performance = (Logical.Capacity == MaxCapacity);
+            Logical.Sibling = SiblingsSeen[Logical.Core]++;
+        }
+        std::stable_sort(_topology.begin(),_topology.end(),[](const Cpu& A,const Cpu& B) {
+            if (A.Sibling != B.Sibling) return A.Sibling < B.Sibling;
+            if (A.Performance != B.Performance) return A.Performance;
+            return A.Id < B.Id;
+        });
+    }
+    //  Returns the NUMA node the calling thread is running on, or 0 if that isn't known.
+    int CurrentNode(void) const {
+        int Id = -1;
+#if defined(__linux__)
+        Id = sched_getcpu();
+#elif defined(_WIN32)
+        Id = int(GetCurrentProcessorNumber());
+#endif
+        for (const Cpu& Logical : _topology) if (Logical.Id == Id) return Logical.Node;
+        return 0;
+    }
+#if defined(__linux__)
+    //  Reads a single number from a file, returning Default if it can't.
+    static long ReadNumber(const std::string& FileName,long Default) {
+        long Value = Default;
+        FILE* File = fopen(FileName.c_str(),"r");
+        if (File) {
+            if (fscanf(File,"%ld",&Value) != 1) Value = Default;
+            fclose(File);
+        }
+        return Value;
+    }
+    //  Reads a list of CPUs, such as "0-3,8,10-11", from a file, returning false if it can't.
+    static bool ReadCpuList(const std::string& FileName,std::vector<int>& Ids) {
+        FILE* File = fopen(FileName.c_str(),"r");
+        if (File == nullptr) return false;
+        int First,Last;
+        while (fscanf(File,"%d",&First) == 1) {
+            Last = First;
+            int Next = fgetc(File);
+            if (Next == '-') {
+                if (fscanf(File,"%d",&Last) != 1) break;
+                Next = fgetc(File);
+            }
+            for (int Id = First; Id <= Last; Id++) Ids.push_back(Id);
+            if (Next != ',') break;
+        }
+        fclose(File);
+        return true;
+    }
+    //  On Linux, all this is in /sys. Intel hybrid systems list their performance cores in
+    //  /sys/devices/cpu_core/cpus. ARM systems give each CPU a relative capacity. Failing
+    //  either, the maximum clock rate of each CPU shows which are the faster ones.
+    void FindLinuxTopology(void) {
+        std::string SysCpu = "/sys/devices/system/cpu/";
+        std::vector<int> Ids;
+        if (!ReadCpuList(SysCpu + "online",Ids)) return;
+        std::vector<int> PCores;
+        bool Hybrid = ReadCpuList("/sys/devices/cpu_core/cpus",PCores);
+        std::map<int,int> NodeOfCpu;
+        if (DIR* Dir = opendir("/sys/devices/system/node")) {
+            while (struct dirent* Entry = readdir(Dir)) {
+                int Node;
+                if (sscanf(Entry->d_name,"node%d",&Node) != 1) continue;
+                std::vector<int> NodeCpus;
+                ReadCpuList("/sys/devices/system/node/" + std::string(Entry->d_name) + "/cpulist",
+                                                                                    NodeCpus);
+                for (int Id : NodeCpus) NodeOfCpu[Id] = Node;
+            }
+            closedir(Dir);
+        }
+        std::map<std::pair<long,long>,int> CoreNumbers;
+        for (int Id : Ids) {
+            std::string Dir = SysCpu + "cpu" + std::to_string(Id) + "/";
+            long Package = ReadNumber(Dir + "topology/physical_package_id",0);
+            long CoreId = ReadNumber(Dir + "topology/core_id",Id);
+            auto Key = std::make_pair(Package,CoreId);
+            if (CoreNumbers.count(Key) == 0) {
+                int Number = int(CoreNumbers.size());
+                CoreNumbers[Key] = Number;
+            }
+            long Capacity = 0;
+            if (Hybrid) {
+                Capacity = std::find(PCores.begin(),PCores.end(),Id) != PCores.end() ? 2 : 1;
+            } else {
+                Capacity = ReadNumber(Dir + "cpu_capacity",0);
+                if (Capacity == 0) Capacity = ReadNumber(Dir + "cpufreq/cpuinfo_max_freq",0);
+            }
+            int Node = NodeOfCpu.count(Id) ? NodeOfCpu[Id] : 0;
+            _topology.push_back({Id,CoreNumbers[Key],0,Node,true,Capacity});
+        }
+    }
+#endif
+#if defined(_WIN32)
+    //  On Windows, each processor core reports the logical processors in it and an efficiency
+    //  class, which is higher for the faster cores.
+    void FindWindowsTopology(void) {
+        DWORD Bytes = 0;
+        GetLogicalProcessorInformationEx(RelationAll,nullptr,&Bytes);
+        std::vector<char> Buffer(Bytes);
+        auto Info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)Buffer.data();
+        if (Bytes == 0 || !GetLogicalProcessorInformationEx(RelationAll,Info,&Bytes)) return;
+        std::map<int,int> NodeOfCpu;
+        std::vector<std::pair<KAFFINITY,long>> Cores;
+        for (DWORD Offset = 0; Offset < Bytes; ) {
+            auto Entry = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(Buffer.data() + Offset);
+            if (Entry->Relationship == RelationProcessorCore &&
+                                                     Entry->Processor.GroupMask[0].Group == 0) {
+                Cores.push_back({Entry->Processor.GroupMask[0].Mask,
+                                            long(Entry->Processor.EfficiencyClass) + 1});
+            } else if (Entry->Relationship == RelationNumaNode &&
+                                                           Entry->NumaNode.GroupMask.Group == 0) {
+                for (int Id = 0; Id < 64; Id++) {
+                    if (Entry->NumaNode.GroupMask.Mask & (KAFFINITY(1) << Id)) {
+                        NodeOfCpu[Id] = int(Entry->NumaNode.NodeNumber);
+                    }
+                }
+            }
+            Offset += Entry->Size;
+        }
+        for (size_t Core = 0; Core < Cores.size(); Core++) {
+            for (int Id = 0; Id < 64; Id++) {
+                if (Cores[Core].first & (KAFFINITY(1) << Id)) {
+                    int Node = NodeOfCpu.count(Id) ? NodeOfCpu[Id] : 0;
+                    _topology.push_back({Id,int(Core),0,Node,true,Cores[Core].second});
+                }
+            }
+        }
+        std::stable_sort(_topology.begin(),_topology.end(),[](const Cpu& A,const Cpu& B) {
+            return A.Id < B.Id;
+        });
+    }
+#endif
+#if defined(__APPLE__)
+    //  On MacOS, only the numbers of CPUs can be found, not which is which, so the logical
+    //  CPUs are just numbered, performance cores first, and all on the one node.
+    void FindMacTopology(void) {
+        int Logical = 0;
+        int Physical = 0;
+        int PLogical = 0;
+        size_t Size = sizeof(int);
+        if (sysctlbyname("hw.logicalcpu",&Logical,&Size,nullptr,0) != 0) return;
+        Size = sizeof(int);
+        if (sysctlbyname("hw.physicalcpu",&Physical,&Size,nullptr,0) != 0) return;
+        Size = sizeof(int);
+        if (sysctlbyname("hw.perflevel0.logicalcpu",&PLogical,&Size,nullptr,0) != 0 ||
+                                                                               PLogical <= 0) {
+            PLogical = Logical;
+        }
+        if (Logical <= 0 || Physical <= 0) return;
+        int PerCore = std::max(1,Logical / Physical);
+        for (int Id = 0; Id < Logical; Id++) {
+            long Capacity = (Id < PLogical) ? 2 : 1;
+            _topology.push_back({Id,Id / PerCore,0,0,true,Capacity});
+        }
+    }
+#endif
+    std::string _mode;
+    std::vector<Cpu> _topology;
+    std::vector<int> _cpus;
+};
+
+#endif
+
+/*                       P r o g r a m m i n g   N o t e s
+
+    o   Pinning a thread to a CPU doesn't stop other threads - from this program or any
+        other - running on the same CPU. What it does stop is the thread being moved, which
+        on a hybrid system can mean a pass running partly on an efficiency core one time
+        and not the next. For the steadiest timings, pin to fewer CPUs than the system has,
+        so the rest of the system has somewhere else to run.
+
+    o   Raising the priority on Linux uses the real-time 'FIFO' scheduler, as does
+        TcsUtil::SetAsRealTimeHighPriority(), but only for the pool's threads, and without
+        locking all the program's memory, which for large images could well fail. It needs
+        the privilege to do so, usually root or CAP_SYS_NICE, and Apply() reports it if the
+        program doesn't have it. A thread at real-time priority that never blocks can lock
+        other work out of its CPU, which is one more reason not to pin to every CPU.
+
+    o   The memory for an image is allocated on the NUMA node of the thread that first
+        touches it, which is usually the one that initialises it. 'Numa' keeps all the
+        threads on the node the main thread was running on when the mode was set, which,
+        since the main thread is pinned there too, is the node that initialises the arrays.
+*/